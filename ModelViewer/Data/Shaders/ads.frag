@@ -7,10 +7,11 @@ in lowp vec3 vLs;
 in lowp vec3 vEs;
 in vec2 texCoord;
 
-uniform float uKa, uKd, uKs;
-uniform vec4 uSpecularColor;
-uniform float uShininess;
-uniform float uHasTexture;
+#include "UniformBlocks.glsl"
+#include "Shadows.glsl"
+#include "Lights.glsl"
+#include "Environment.glsl"
+#include "Surface.glsl"
 uniform sampler2D uTexture;
 
 void main() {
@@ -18,25 +19,62 @@ void main() {
 	vec3 Light;
 	vec3 Eye;
 	
-	Normal = normalize(vNs);
+#if !defined(SHADER_PERMUTATION) || defined(HAS_NORMALS)
+	// Flat shading takes the triangle's slope over the vertex normals
+	Normal = uFlatShading != 0 ? normalize(cross(dFdx(vEs), dFdy(vEs))) : normalize(vNs);
+#else
+	// Flat shaded from the triangle's slope
+	Normal = normalize(cross(dFdx(vEs), dFdy(vEs)));
+#endif
 	Light = normalize(vLs);
 	Eye = normalize(vEs);
 
-	vec4 adsColor = (texture(uTexture, texCoord) * uHasTexture) + col * (1.0 - uHasTexture);
-	
-	vec4 ambient = uKa * adsColor;
+	// Variants know whether the mesh is textured, the generic shader blends at run time
+#if !defined(SHADER_PERMUTATION)
+	vec4 baseColor = (SampleMaterialMap(0, uTexture, texCoord) * uHasTexture) + col * (1.0 - uHasTexture);
+#elif defined(HAS_TEXTURE)
+	vec4 baseColor = SampleMaterialMap(0, uTexture, texCoord);
+#else
+	vec4 baseColor = col;
+#endif
+
+	// The material's maps and factors, metallic-roughness materials bring their own
+	// specular color and shininess
+	Surface surface = MaterialSurface(baseColor, Normal, -vEs, texCoord, uSpecularColor.rgb, uShininess);
+	Normal = surface.normal;
+	vec4 adsColor = vec4(surface.diffuseColor, baseColor.a);
+	vec4 specularColor = vec4(surface.specularColor, 1.);
+
+	vec4 ambient = uKa * surface.occlusion * adsColor;
 
 	float d = max(dot(Normal, Light), 0.);
-	vec4 diffuse = uKd * d * adsColor;
+	// Shadowed points only get the ambient light
+	float shadow = ShadowFactor(-vEs);
+	vec4 diffuse = uKd * d * shadow * adsColor;
 
 	float s = 0.;
 	if( dot(Normal,Light) > 0. ) // only do specular if the light can see the point
 	{
 		vec3 ref = normalize( 2. * Normal * dot(Normal,Light) - Light );
-		s = pow( max( dot(Eye,ref),0. ), uShininess );
+		s = pow( max( dot(Eye,ref),0. ), surface.shininess );
 	}
 
-	vec4 specular = uKs * s * uSpecularColor;
+	vec4 specular = uKs * s * shadow * specularColor;
+
+	// The lights of the scene, only those reaching this point's cluster
+	vec3 scene = SceneLighting(-vEs, Normal, Eye, uKd * adsColor.rgb, uKs * specularColor.rgb, surface.shininess);
 
-	gl_FragColor = vec4( ambient.rgb + diffuse.rgb + specular.rgb, 1. );
+	// Light from the HDR environment, prefiltered for the surface's shininess and occluded
+	// like the ambient light
+	vec3 environment = surface.occlusion * EnvironmentLighting(Normal, Eye, uKd * adsColor.rgb, uKs * specularColor.rgb, surface.shininess);
+
+	vec3 color = ambient.rgb + diffuse.rgb + specular.rgb + scene + environment + surface.emissive;
+
+	// Blended materials are only drawn by the transparent pass, into both of its targets
+	if (uMaterialAlphaMode == 2) {
+		TransparentFragment(color, surface.alpha, gl_FragData[0], gl_FragData[1]);
+	}
+	else {
+		gl_FragData[0] = vec4(color, surface.alpha);
+	}
 }
\ No newline at end of file
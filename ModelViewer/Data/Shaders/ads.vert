@@ -1,17 +1,33 @@
 #version 410
 
+// Variants for a mesh's features define SHADER_PERMUTATION and HAS_NORMALS, HAS_UV and so on,
+// see ShaderPermutations.h. Without them every feature is handled, except for skinning, which
+// only variants do.
+#ifndef SHADER_PERMUTATION
+#define HAS_NORMALS
+#define HAS_UV
+#endif
+
 attribute highp vec4 posAttr;
 attribute lowp vec4 colAttr;
 attribute highp vec3 normAttr;
 attribute highp vec2 uvAttr;
+attribute highp mat4 instanceAttr; // Identity unless the mesh is drawn instanced
 
 varying lowp vec4 col;
 
-uniform highp mat4 matrix;
 uniform highp mat4 modelview;
 uniform highp mat3 normalMat;
 
-uniform vec3 uLightPos;
+// Projection, light and material, see UniformBlocks.h
+#include "UniformBlocks.glsl"
+
+#ifdef HAS_SKIN
+// The 4 bones that move the vertex most, and how much of it each one moves
+attribute highp vec4 boneIndexAttr;
+attribute highp vec4 boneWeightAttr;
+#include "BonePalette.glsl"
+#endif
 
 vec3 eyeLightPosition = uLightPos;
 
@@ -20,10 +36,29 @@ out lowp vec3 vLs;
 out lowp vec3 vEs;
 out vec2 texCoord;
 
+// Distances to the section planes, which cut away what is below 0
+out float gl_ClipDistance[6];
+
 void main() {
-	vec4 ECposition = modelview * posAttr;
+#ifdef HAS_SKIN
+	mat4 skin = boneWeightAttr.x * uBones[int(boneIndexAttr.x)]
+		+ boneWeightAttr.y * uBones[int(boneIndexAttr.y)]
+		+ boneWeightAttr.z * uBones[int(boneIndexAttr.z)]
+		+ boneWeightAttr.w * uBones[int(boneIndexAttr.w)];
+	vec4 position = skin * posAttr;
+	vec3 normal = mat3(skin) * normAttr;
+#else
+	vec4 position = posAttr;
+	vec3 normal = normAttr;
+#endif
+	vec4 instancePosition = instanceAttr * position;
+	vec4 ECposition = modelview * instancePosition;
 
-	vNs = normalize(normalMat * normAttr);
+#ifdef HAS_NORMALS
+	vNs = normalize(normalMat * transpose(inverse(mat3(instanceAttr))) * normal);
+#else
+	vNs = vec3(0.);
+#endif
 
 	vLs = eyeLightPosition - ECposition.xyz;
 
@@ -31,6 +66,13 @@ void main() {
 
 
    col = colAttr;
+#ifdef HAS_UV
    texCoord = uvAttr;
-   gl_Position = matrix * posAttr;
+#else
+   texCoord = vec2(0.);
+#endif
+   for (int i = 0; i < 6; ++i) {
+      gl_ClipDistance[i] = dot(uSectionPlanes[i], ECposition);
+   }
+   gl_Position = uProjection * ECposition;
 }
\ No newline at end of file
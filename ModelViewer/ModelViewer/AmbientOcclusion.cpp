@@ -0,0 +1,362 @@
+#include "AmbientOcclusion.h"
+#include "StateCache.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+
+#ifndef GL_RGBA32F
+#define GL_RGBA32F 0x8814
+#endif
+#ifndef GL_RG16F
+#define GL_RG16F 0x822F
+#endif
+
+
+namespace {
+
+const char* k_vertexShaderSource =
+	"#version 330\n"
+	"in vec2 posAttr;\n"
+	"void main() {\n"
+	"   gl_Position = vec4(posAttr, 0.0, 1.0);\n"
+	"}\n";
+
+// Both passes find the eye space point of a pixel from its linear depth
+#define EYE_POSITION \
+	"uniform vec4 uProjection;\n" \
+	"uniform vec2 uSceneSize;\n" \
+	"vec3 EyePosition(vec2 pixel, float depth) {\n" \
+	"   vec2 ndc = pixel / uSceneSize * 2.0 - 1.0;\n" \
+	"   return vec3((ndc + uProjection.zw) * depth / uProjection.xy, -depth);\n" \
+	"}\n"
+
+// Points in the hemisphere around the normal, denser toward it, are spread along a spiral the
+// noise turns for every pixel. A point is occluded where the surface drawn at it is nearer,
+// unless that surface is far in front of the pixel. Writes the occlusion and the depth, which
+// is 0 where nothing was drawn.
+const char* k_occlusionFragmentShaderSource =
+	"#version 330\n"
+	EYE_POSITION
+	"uniform sampler2D uDepthNormals;\n"
+	"uniform int uStep;\n"
+	"uniform float uRadius;\n"
+	"uniform int uFrame;\n"
+	"out vec4 fragColor;\n"
+	"const int k_samples = 16;\n"
+	"void main() {\n"
+	"   ivec2 texel = ivec2(gl_FragCoord.xy) * uStep;\n"
+	"   vec4 normalDepth = texelFetch(uDepthNormals, texel, 0);\n"
+	"   if (normalDepth.w <= 0.0) {\n"
+	"      fragColor = vec4(1.0, 0.0, 0.0, 1.0);\n"
+	"      return;\n"
+	"   }\n"
+	"   vec3 position = EyePosition(vec2(texel) + 0.5, normalDepth.w);\n"
+	"   vec3 normal = normalize(normalDepth.xyz);\n"
+	"   vec3 tangent = normalize(cross(normal, abs(normal.z) < 0.9 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0)));\n"
+	"   vec3 bitangent = cross(normal, tangent);\n"
+	"   vec2 noisePixel = gl_FragCoord.xy + 5.588238 * float(uFrame);\n"
+	"   float noise = fract(52.9829189 * fract(dot(noisePixel, vec2(0.06711056, 0.00583715))));\n"
+	"   float occlusion = 0.0;\n"
+	"   for (int i = 0; i < k_samples; ++i) {\n"
+	"      float f = (float(i) + 0.5) / float(k_samples);\n"
+	"      float angle = 6.2831853 * noise + 2.3999632 * float(i);\n"
+	"      float r = sqrt(f);\n"
+	"      vec3 direction = tangent * (r * cos(angle)) + bitangent * (r * sin(angle)) + normal * sqrt(1.0 - f);\n"
+	"      vec3 point = position + direction * (uRadius * mix(0.1, 1.0, fract(noise + 0.618034 * float(i))));\n"
+	"      if (point.z > -1e-4) {\n"
+	"         continue;\n"
+	"      }\n"
+	"      vec2 ndc = point.xy * uProjection.xy / -point.z - uProjection.zw;\n"
+	"      ivec2 sampleTexel = ivec2((ndc * 0.5 + 0.5) * uSceneSize);\n"
+	"      if (any(lessThan(sampleTexel, ivec2(0))) || any(greaterThanEqual(sampleTexel, ivec2(uSceneSize)))) {\n"
+	"         continue;\n"
+	"      }\n"
+	"      float depth = texelFetch(uDepthNormals, sampleTexel, 0).w;\n"
+	"      if (depth > 0.0 && depth < -point.z - 0.05 * uRadius) {\n"
+	"         occlusion += clamp(uRadius / abs(normalDepth.w - depth), 0.0, 1.0);\n"
+	"      }\n"
+	"   }\n"
+	"   fragColor = vec4(1.0 - occlusion / float(k_samples), normalDepth.w, 0.0, 1.0);\n"
+	"}\n";
+
+// The occlusion texels around a pixel count for less the further away they are and the more
+// their depth differs from the pixel's, so the blur stops at edges. With temporal accumulation
+// the result of the last frame is blended in where the point was seen at the same depth.
+const char* k_resolveFragmentShaderSource =
+	"#version 330\n"
+	EYE_POSITION
+	"uniform sampler2D uDepthNormals;\n"
+	"uniform sampler2D uOcclusion;\n"
+	"uniform sampler2D uHistory;\n"
+	"uniform vec2 uOcclusionSize;\n"
+	"uniform float uStep;\n"
+	"uniform int uTemporal;\n"
+	"uniform mat4 uReprojection;\n"
+	"uniform vec2 uHistorySize;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"   float depth = texelFetch(uDepthNormals, ivec2(gl_FragCoord.xy), 0).w;\n"
+	"   if (depth <= 0.0) {\n"
+	"      fragColor = vec4(1.0, 0.0, 0.0, 1.0);\n"
+	"      return;\n"
+	"   }\n"
+	"   vec2 center = gl_FragCoord.xy / uStep;\n"
+	"   ivec2 first = ivec2(floor(center - 1.5));\n"
+	"   ivec2 last = ivec2(uOcclusionSize) - 1;\n"
+	"   float sum = 0.0;\n"
+	"   float weights = 0.0;\n"
+	"   for (int y = 0; y < 4; ++y) {\n"
+	"      for (int x = 0; x < 4; ++x) {\n"
+	"         ivec2 texel = clamp(first + ivec2(x, y), ivec2(0), last);\n"
+	"         vec2 occlusion = texelFetch(uOcclusion, texel, 0).rg;\n"
+	"         float weight = max(0.0, 2.0 - length(vec2(texel) + 0.5 / uStep - center))\n"
+	"            * exp(-abs(occlusion.y - depth) / (0.02 * depth));\n"
+	"         sum += occlusion.x * weight;\n"
+	"         weights += weight;\n"
+	"      }\n"
+	"   }\n"
+	"   float occlusion = weights > 1e-4 ? sum / weights : 1.0;\n"
+	"   if (uTemporal != 0) {\n"
+	"      vec4 previous = uReprojection * vec4(EyePosition(gl_FragCoord.xy, depth), 1.0);\n"
+	"      ivec2 historyTexel = ivec2((previous.xy / previous.w * 0.5 + 0.5) * uHistorySize);\n"
+	"      if (previous.w > 0.0 && all(greaterThanEqual(historyTexel, ivec2(0))) && all(lessThan(historyTexel, ivec2(uHistorySize)))) {\n"
+	"         vec2 history = texelFetch(uHistory, historyTexel, 0).rg;\n"
+	"         if (abs(history.y - previous.w) < 0.02 * previous.w) {\n"
+	"            occlusion = mix(occlusion, history.x, 0.9);\n"
+	"         }\n"
+	"      }\n"
+	"   }\n"
+	"   fragColor = vec4(occlusion, depth, 0.0, 1.0);\n"
+	"}\n";
+
+#undef EYE_POSITION
+
+// One triangle covering the whole viewport
+const GLfloat k_fullScreenTriangle[] = { -1.f, -1.f, 3.f, -1.f, -1.f, 3.f };
+
+const GLuint k_posAttr = 0;
+
+// Bytes per pixel of the float normals and depth with their depth buffer, and of the two
+// histories. The occlusion target takes 4 bytes per pixel it is computed at.
+const qint64 k_bytesPerPixel = 16 + 4 + 4 + 4;
+const qint64 k_occlusionBytesPerPixel = 4;
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+QOpenGLShaderProgram* LinkProgram(const char* pFragmentSource)
+{
+	QOpenGLShaderProgram* pProgram = new QOpenGLShaderProgram();
+	pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, k_vertexShaderSource);
+	pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, pFragmentSource);
+	pProgram->bindAttributeLocation("posAttr", k_posAttr);
+	if (!pProgram->link()) {
+		qWarning("Could not link the ambient occlusion shader: %s", qPrintable(pProgram->log()));
+		delete pProgram;
+		return nullptr;
+	}
+	return pProgram;
+}
+
+}
+
+AmbientOcclusion::~AmbientOcclusion()
+{
+	// The framebuffers and buffer go with the context, only the programs are left
+	delete m_pOcclusionProgram;
+	delete m_pResolveProgram;
+}
+
+bool AmbientOcclusion::Create()
+{
+	Destroy();
+
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+
+	m_pOcclusionProgram = LinkProgram(k_occlusionFragmentShaderSource);
+	m_pResolveProgram = LinkProgram(k_resolveFragmentShaderSource);
+	if (!m_pOcclusionProgram || !m_pResolveProgram) {
+		Destroy();
+		return false;
+	}
+	m_pOcclusionProgram->bind();
+	m_pOcclusionProgram->setUniformValue("uDepthNormals", 0);
+	m_pResolveProgram->bind();
+	m_pResolveProgram->setUniformValue("uDepthNormals", 0);
+	m_pResolveProgram->setUniformValue("uOcclusion", 1);
+	m_pResolveProgram->setUniformValue("uHistory", UniformBlocks::k_ambientOcclusionUnit);
+	m_pResolveProgram->release();
+
+	m_triangle = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	m_triangle.create();
+	m_triangle.bind();
+	m_triangle.allocate(k_fullScreenTriangle, sizeof(k_fullScreenTriangle));
+	m_vao.create();
+	m_vao.bind();
+	Functions()->glVertexAttribPointer(k_posAttr, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+	Functions()->glEnableVertexAttribArray(k_posAttr);
+	m_vao.release();
+	m_triangle.release();
+	return true;
+}
+
+void AmbientOcclusion::Destroy()
+{
+	if (QOpenGLContext::currentContext()) {
+		delete m_pDepthNormals;
+		delete m_pOcclusion;
+		delete m_pHistory[0];
+		delete m_pHistory[1];
+		m_vao.destroy();
+		m_triangle.destroy();
+	}
+	m_pDepthNormals = nullptr;
+	m_pOcclusion = nullptr;
+	m_pHistory[0] = nullptr;
+	m_pHistory[1] = nullptr;
+	delete m_pOcclusionProgram;
+	m_pOcclusionProgram = nullptr;
+	delete m_pResolveProgram;
+	m_pResolveProgram = nullptr;
+	m_nativeSize = QSize();
+	m_historyValid = false;
+}
+
+bool AmbientOcclusion::IsCreated() const
+{
+	return m_pOcclusionProgram != nullptr;
+}
+
+void AmbientOcclusion::BeginPrepass(const QSize& nativeSize, const QSize& sceneSize, const Options& options)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	if (nativeSize != m_nativeSize || options.m_mode != m_options.m_mode) {
+		delete m_pDepthNormals;
+		delete m_pOcclusion;
+		delete m_pHistory[0];
+		delete m_pHistory[1];
+
+		// Half float depths aren't precise enough to tell a surface from the points just above it
+		QOpenGLFramebufferObjectFormat depthNormalsFormat;
+		depthNormalsFormat.setAttachment(QOpenGLFramebufferObject::Depth);
+		depthNormalsFormat.setInternalTextureFormat(GL_RGBA32F);
+		m_pDepthNormals = new QOpenGLFramebufferObject(nativeSize, depthNormalsFormat);
+
+		QOpenGLFramebufferObjectFormat occlusionFormat;
+		occlusionFormat.setInternalTextureFormat(GL_RG16F);
+		m_pOcclusion = new QOpenGLFramebufferObject(TargetSize(nativeSize, options.m_mode), occlusionFormat);
+		m_pHistory[0] = new QOpenGLFramebufferObject(nativeSize, occlusionFormat);
+		m_pHistory[1] = new QOpenGLFramebufferObject(nativeSize, occlusionFormat);
+		m_nativeSize = nativeSize;
+		m_historyValid = false;
+	}
+	m_sceneSize = sceneSize;
+	m_options = options;
+
+	m_pDepthNormals->bind();
+	state.Viewport(0, 0, sceneSize.width(), sceneSize.height());
+	const GLfloat background[] = { 0.f, 0.f, 0.f, 0.f };
+	const GLfloat farthest = 1.f;
+	f->glClearBufferfv(GL_COLOR, 0, background);
+	f->glClearBufferfv(GL_DEPTH, 0, &farthest);
+	state.Enable(GL_DEPTH_TEST);
+}
+
+void AmbientOcclusion::Compute(GLuint sceneFramebuffer, const QMatrix4x4& projection, const QMatrix4x4& modelView, float radius)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	const QVector4D parameters = ProjectionParameters(projection);
+	const QSize occlusionSize = TargetSize(m_sceneSize, m_options.m_mode);
+	const int step = m_options.m_mode == k_ambientOcclusionHalf ? 2 : 1;
+	const bool temporal = m_options.m_temporal && m_historyValid;
+	state.Disable(GL_DEPTH_TEST);
+	m_vao.bind();
+
+	// The noise only changes between frames when they are blended
+	m_pOcclusion->bind();
+	state.Viewport(0, 0, occlusionSize.width(), occlusionSize.height());
+	m_pOcclusionProgram->bind();
+	m_pOcclusionProgram->setUniformValue("uProjection", parameters);
+	m_pOcclusionProgram->setUniformValue("uSceneSize", QSizeF(m_sceneSize));
+	m_pOcclusionProgram->setUniformValue("uStep", step);
+	m_pOcclusionProgram->setUniformValue("uRadius", radius);
+	m_pOcclusionProgram->setUniformValue("uFrame", m_options.m_temporal ? m_frame % 64 : 0);
+	f->glActiveTexture(GL_TEXTURE0);
+	f->glBindTexture(GL_TEXTURE_2D, m_pDepthNormals->texture());
+	f->glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// The resolve reads the last history and writes the other one
+	const int next = 1 - m_current;
+	m_pHistory[next]->bind();
+	state.Viewport(0, 0, m_sceneSize.width(), m_sceneSize.height());
+	m_pResolveProgram->bind();
+	m_pResolveProgram->setUniformValue("uProjection", parameters);
+	m_pResolveProgram->setUniformValue("uSceneSize", QSizeF(m_sceneSize));
+	m_pResolveProgram->setUniformValue("uOcclusionSize", QSizeF(occlusionSize));
+	m_pResolveProgram->setUniformValue("uStep", GLfloat(step));
+	m_pResolveProgram->setUniformValue("uTemporal", temporal ? 1 : 0);
+	m_pResolveProgram->setUniformValue("uReprojection", m_historyTransform * modelView.inverted());
+	m_pResolveProgram->setUniformValue("uHistorySize", QSizeF(m_historySize));
+	f->glActiveTexture(GL_TEXTURE1);
+	f->glBindTexture(GL_TEXTURE_2D, m_pOcclusion->texture());
+	f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_ambientOcclusionUnit);
+	f->glBindTexture(GL_TEXTURE_2D, m_pHistory[m_current]->texture());
+	f->glDrawArrays(GL_TRIANGLES, 0, 3);
+	m_pResolveProgram->release();
+	m_vao.release();
+
+	f->glBindTexture(GL_TEXTURE_2D, m_pHistory[next]->texture());
+	f->glActiveTexture(GL_TEXTURE1);
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+	f->glActiveTexture(GL_TEXTURE0);
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_current = next;
+	m_historyValid = true;
+	m_historySize = m_sceneSize;
+	m_historyTransform = projection * modelView;
+	++m_frame;
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	state.Viewport(0, 0, m_sceneSize.width(), m_sceneSize.height());
+	state.Enable(GL_DEPTH_TEST);
+}
+
+qint64 AmbientOcclusion::Bytes() const
+{
+	if (!m_pDepthNormals) {
+		return 0;
+	}
+	const QSize occlusionSize = TargetSize(m_nativeSize, m_options.m_mode);
+	return qint64(m_nativeSize.width()) * m_nativeSize.height() * k_bytesPerPixel
+		+ qint64(occlusionSize.width()) * occlusionSize.height() * k_occlusionBytesPerPixel;
+}
+
+QSize AmbientOcclusion::TargetSize(const QSize& sceneSize, int mode)
+{
+	if (mode == k_ambientOcclusionHalf) {
+		return QSize((sceneSize.width() + 1) / 2, (sceneSize.height() + 1) / 2);
+	}
+	return sceneSize;
+}
+
+QVector4D AmbientOcclusion::ProjectionParameters(const QMatrix4x4& projection)
+{
+	return QVector4D(projection(0, 0), projection(1, 1), projection(0, 2), projection(1, 2));
+}
+
+QVector3D AmbientOcclusion::EyePosition(const QVector4D& projectionParameters, const QPointF& ndc, float depth)
+{
+	return QVector3D((float(ndc.x()) + projectionParameters.z()) * depth / projectionParameters.x(),
+		(float(ndc.y()) + projectionParameters.w()) * depth / projectionParameters.y(), -depth);
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QPointF>
+#include <QSize>
+#include <QVector3D>
+#include <QVector4D>
+#include <qopengl.h>
+
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+
+// Resolution the occlusion is computed at, the ViewerGraphicsWindow/ambientOcclusion setting
+enum AmbientOcclusionMode : int {
+	k_ambientOcclusionOff = 0,
+	k_ambientOcclusionFull = 1,
+	k_ambientOcclusionHalf = 2, // A quarter of the pixels, upsampled along the depth
+};
+
+// Screen-space ambient occlusion, darkening creases and corners the ambient and environment
+// light reach less of. The model is first drawn into a target of eye space normals and linear
+// depth. For every pixel, points in the hemisphere around its normal are then tested against
+// that depth, at the scene's resolution or half of it. A resolve blurs the noisy result with
+// weights that drop across depth edges, which upsamples it in half resolution, and can blend
+// in the last frame's result reprojected to where the point was then. The noise changes every
+// frame with that on, so a still view converges. Shaders that include "Surface.glsl" multiply
+// the material's occlusion by the result while the frame block's uAmbientOcclusion is set.
+class AmbientOcclusion
+{
+public:
+	struct Options {
+		int m_mode = k_ambientOcclusionOff;
+		bool m_temporal = true; // Blend in the reprojected result of the last frame
+	};
+
+	~AmbientOcclusion();
+
+	// Creating and destroying the programs and targets requires a current context. Create
+	// returns false without desktop OpenGL 3.3 or if the programs don't link.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Binds the normal and depth target, cleared, for the model to be drawn into with the
+	// programs of ShaderPermutations::DepthNormals. sceneSize is the part of the scene being
+	// drawn to, nativeSize the size of the scene framebuffer.
+	void BeginPrepass(const QSize& nativeSize, const QSize& sceneSize, const Options& options);
+
+	// Computes the occlusion of what was drawn since BeginPrepass, seen through projection and
+	// modelView, testing points up to radius away in eye space. Leaves sceneFramebuffer bound
+	// with the scene's viewport, no texture on unit 0 and the result on
+	// UniformBlocks::k_ambientOcclusionUnit, in the same corner of the target as the scene.
+	void Compute(GLuint sceneFramebuffer, const QMatrix4x4& projection, const QMatrix4x4& modelView, float radius);
+
+	// GPU memory taken by the targets
+	qint64 Bytes() const;
+
+	// Size the occlusion of a sceneSize part of the scene is computed at in mode
+	static QSize TargetSize(const QSize& sceneSize, int mode);
+
+	// What the shaders take from a perspective projection to move between eye space and
+	// normalized device coordinates, its x and y scale and the offsets of the view's center
+	static QVector4D ProjectionParameters(const QMatrix4x4& projection);
+
+	// The eye space point at linear depth, positive in front of the camera, that is seen at ndc,
+	// as the shaders compute it
+	static QVector3D EyePosition(const QVector4D& projectionParameters, const QPointF& ndc, float depth);
+
+private:
+	QOpenGLFramebufferObject* m_pDepthNormals = nullptr;
+	QOpenGLFramebufferObject* m_pOcclusion = nullptr;
+	QOpenGLFramebufferObject* m_pHistory[2] = {};
+	QOpenGLShaderProgram* m_pOcclusionProgram = nullptr;
+	QOpenGLShaderProgram* m_pResolveProgram = nullptr;
+	QOpenGLBuffer m_triangle;
+	QOpenGLVertexArrayObject m_vao;
+	QSize m_nativeSize;
+	QSize m_sceneSize;
+	Options m_options;
+
+	// The history written last, and what it was seen through
+	int m_current = 0;
+	bool m_historyValid = false;
+	QSize m_historySize;
+	QMatrix4x4 m_historyTransform;
+	int m_frame = 0;
+};
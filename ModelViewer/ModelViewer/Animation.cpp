@@ -0,0 +1,213 @@
+#include "Animation.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+	// Moves cursor to the last key at or before time. Time only goes back when the clip loops
+	// or is restarted, the search then starts over from the first key.
+	template<typename Key>
+	size_t Seek(const std::vector<Key>& keys, float time, size_t cursor) {
+		if (cursor >= keys.size() || keys[cursor].m_time > time) {
+			cursor = 0;
+		}
+		while (cursor + 1 < keys.size() && keys[cursor + 1].m_time <= time) {
+			++cursor;
+		}
+		return cursor;
+	}
+
+	// How far time is from the key at cursor to the next one, 0 past the last key
+	template<typename Key>
+	float Blend(const std::vector<Key>& keys, float time, size_t cursor) {
+		if (cursor + 1 >= keys.size()) {
+			return 0.f;
+		}
+		const float span = keys[cursor + 1].m_time - keys[cursor].m_time;
+		return span > 0.f ? std::min(1.f, std::max(0.f, (time - keys[cursor].m_time) / span)) : 0.f;
+	}
+
+	QVector3D Sample(const std::vector<VectorKey>& keys, float time, size_t& cursor) {
+		cursor = Seek(keys, time, cursor);
+		const float t = Blend(keys, time, cursor);
+		if (t <= 0.f) {
+			return keys[cursor].m_value;
+		}
+		return keys[cursor].m_value * (1.f - t) + keys[cursor + 1].m_value * t;
+	}
+
+	QQuaternion Sample(const std::vector<RotationKey>& keys, float time, size_t& cursor) {
+		cursor = Seek(keys, time, cursor);
+		const float t = Blend(keys, time, cursor);
+		if (t <= 0.f) {
+			return keys[cursor].m_value;
+		}
+		return QQuaternion::nlerp(keys[cursor].m_value, keys[cursor + 1].m_value, t);
+	}
+
+	void Sample(const std::vector<MorphKey>& keys, float time, size_t& cursor, std::vector<float>& weights) {
+		cursor = Seek(keys, time, cursor);
+		const float t = Blend(keys, time, cursor);
+		const std::vector<float>& from = keys[cursor].m_weights;
+		weights = from;
+		if (t <= 0.f) {
+			return;
+		}
+		const std::vector<float>& to = keys[cursor + 1].m_weights;
+		weights.resize(std::max(from.size(), to.size()), 0.f);
+		for (size_t i = 0; i < weights.size(); ++i) {
+			weights[i] = weights[i] * (1.f - t) + (i < to.size() ? to[i] : 0.f) * t;
+		}
+	}
+}
+
+int Skeleton::FindNode(const QString& name) const
+{
+	for (size_t i = 0; i < m_nodes.size(); ++i) {
+		if (m_nodes[i].m_name == name) {
+			return int(i);
+		}
+	}
+	return -1;
+}
+
+void AnimationPlayer::SetSkeleton(const QSharedPointer<const Skeleton>& skeleton)
+{
+	m_skeleton = skeleton;
+	m_clip = -1;
+	m_time = 0.f;
+	m_cursors.clear();
+	m_morphCursors.clear();
+	Pose();
+}
+
+const QSharedPointer<const Skeleton>& AnimationPlayer::GetSkeleton() const
+{
+	return m_skeleton;
+}
+
+void AnimationPlayer::Play(int clip)
+{
+	m_clip = (m_skeleton && clip >= 0 && clip < int(m_skeleton->m_clips.size())) ? clip : -1;
+	m_time = 0.f;
+	m_cursors.assign(m_clip < 0 ? 0 : m_skeleton->m_clips[m_clip].m_channels.size(), Cursor());
+	m_morphCursors.assign(m_clip < 0 ? 0 : m_skeleton->m_clips[m_clip].m_morphChannels.size(), 0);
+	Pose();
+}
+
+int AnimationPlayer::Clip() const
+{
+	return m_clip;
+}
+
+bool AnimationPlayer::IsPlaying() const
+{
+	return m_clip >= 0;
+}
+
+void AnimationPlayer::Advance(float seconds)
+{
+	SetTime(m_time + seconds);
+}
+
+void AnimationPlayer::SetTime(float seconds)
+{
+	if (m_clip < 0) {
+		return;
+	}
+	const float duration = m_skeleton->m_clips[m_clip].m_duration;
+	m_time = duration > 0.f ? std::fmod(std::max(0.f, seconds), duration) : 0.f;
+	Pose();
+}
+
+float AnimationPlayer::Time() const
+{
+	return m_time;
+}
+
+const std::vector<QMatrix4x4>& AnimationPlayer::NodeTransforms() const
+{
+	return m_global;
+}
+
+void AnimationPlayer::BonePalette(const std::vector<MeshBone>& bones, std::vector<QMatrix4x4>& palette) const
+{
+	palette.resize(std::min(bones.size(), size_t(k_maxBones)));
+	for (size_t i = 0; i < palette.size(); ++i) {
+		const MeshBone& bone = bones[i];
+		palette[i] = (bone.m_node >= 0 && bone.m_node < int(m_global.size())) ? m_global[bone.m_node] * bone.m_offset : bone.m_offset;
+	}
+}
+
+void AnimationPlayer::MorphWeights(int node, std::vector<float>& weights) const
+{
+	if (m_clip < 0) {
+		return;
+	}
+	const std::vector<MorphChannel>& channels = m_skeleton->m_clips[m_clip].m_morphChannels;
+	for (size_t i = 0; i < channels.size(); ++i) {
+		if (channels[i].m_node == node) {
+			const std::vector<float>& sampled = m_morphWeights[i];
+			std::copy(sampled.begin(), sampled.begin() + std::min(sampled.size(), weights.size()), weights.begin());
+		}
+	}
+}
+
+void AnimationPlayer::SkinnedBounds(const std::vector<MeshBone>& bones, const std::vector<QMatrix4x4>& palette, QVector3D& min, QVector3D& max)
+{
+	min = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+	max = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (size_t i = 0; i < std::min(bones.size(), palette.size()); ++i) {
+		// Bones that pull on no vertex have an empty box
+		if (bones[i].m_min.x() <= bones[i].m_max.x()) {
+			Model::AddTransformedAABB(palette[i], bones[i].m_min, bones[i].m_max, min, max);
+		}
+	}
+}
+
+void AnimationPlayer::Pose()
+{
+	if (!m_skeleton) {
+		m_local.clear();
+		m_global.clear();
+		m_morphWeights.clear();
+		return;
+	}
+
+	// Nodes the clip doesn't move stay at rest
+	const std::vector<SkeletonNode>& nodes = m_skeleton->m_nodes;
+	m_local.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		m_local[i] = nodes[i].m_transform;
+	}
+	if (m_clip >= 0) {
+		const AnimationClip& clip = m_skeleton->m_clips[m_clip];
+		for (size_t i = 0; i < clip.m_channels.size(); ++i) {
+			const AnimationChannel& channel = clip.m_channels[i];
+			if (channel.m_node < 0 || channel.m_node >= int(nodes.size())) {
+				continue;
+			}
+			Cursor& cursor = m_cursors[i];
+			QMatrix4x4 local;
+			local.translate(Sample(channel.m_positions, m_time, cursor.m_position));
+			local.rotate(Sample(channel.m_rotations, m_time, cursor.m_rotation));
+			local.scale(Sample(channel.m_scales, m_time, cursor.m_scale));
+			m_local[channel.m_node] = local;
+		}
+		m_morphWeights.resize(clip.m_morphChannels.size());
+		for (size_t i = 0; i < clip.m_morphChannels.size(); ++i) {
+			Sample(clip.m_morphChannels[i].m_keys, m_time, m_morphCursors[i], m_morphWeights[i]);
+		}
+	}
+	else {
+		m_morphWeights.clear();
+	}
+
+	// Parents come first, so theirs are done by the time their children need them
+	m_global.resize(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		const int parent = nodes[i].m_parent;
+		m_global[i] = parent >= 0 ? m_global[parent] * m_local[i] : m_local[i];
+	}
+}
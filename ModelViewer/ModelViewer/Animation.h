@@ -0,0 +1,124 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector3D>
+
+#include "ModelLoader.h"
+
+// A node of the scene's node tree, with its transform relative to its parent
+struct SkeletonNode {
+	QString m_name;
+	int m_parent = -1;
+	QMatrix4x4 m_transform;
+};
+
+// Keys of a channel, with their times in seconds
+struct VectorKey {
+	float m_time = 0.f;
+	QVector3D m_value;
+};
+
+struct RotationKey {
+	float m_time = 0.f;
+	QQuaternion m_value;
+};
+
+// Replaces the transform of one node while a clip plays. Each list has at least one key and
+// is sorted by time.
+struct AnimationChannel {
+	int m_node = -1;
+	std::vector<VectorKey> m_positions;
+	std::vector<RotationKey> m_rotations;
+	std::vector<VectorKey> m_scales;
+};
+
+// Weights of a node's morph targets at a time, indexed by target
+struct MorphKey {
+	float m_time = 0.f;
+	std::vector<float> m_weights;
+};
+
+// Replaces the morph target weights of the meshes at one node while a clip plays. Has at
+// least one key and is sorted by time.
+struct MorphChannel {
+	int m_node = -1;
+	std::vector<MorphKey> m_keys;
+};
+
+struct AnimationClip {
+	QString m_name;
+	float m_duration = 0.f; // In seconds
+	std::vector<AnimationChannel> m_channels;
+	std::vector<MorphChannel> m_morphChannels;
+};
+
+// The node tree of a model and the clips that move it. Nodes come before their children, so
+// the nodes can be walked in order to work out their transforms in model space.
+struct Skeleton {
+	std::vector<SkeletonNode> m_nodes;
+	std::vector<AnimationClip> m_clips;
+
+	// Index of the first node called name, or -1
+	int FindNode(const QString& name) const;
+};
+
+// Poses a skeleton at a time of one of its clips. Keys are found through a cursor per channel
+// that starts at the key found last frame, so playing forward only steps past the keys since,
+// instead of searching every list every frame.
+class AnimationPlayer
+{
+public:
+	// The most bones a mesh can have. Their matrices fill a 16 KB uniform block, which every
+	// implementation supports.
+	static const int k_maxBones = 256;
+
+	// Drops the clip and poses the skeleton at rest
+	void SetSkeleton(const QSharedPointer<const Skeleton>& skeleton);
+	const QSharedPointer<const Skeleton>& GetSkeleton() const;
+
+	// Plays a clip from its start, -1 goes back to the rest pose
+	void Play(int clip);
+	int Clip() const;
+	bool IsPlaying() const;
+
+	// Moves the time on by seconds, looping at the end of the clip, and poses the skeleton
+	void Advance(float seconds);
+	void SetTime(float seconds);
+	float Time() const;
+
+	// Transform of every node in model space at the current time
+	const std::vector<QMatrix4x4>& NodeTransforms() const;
+
+	// The matrix of each bone, which moves a vertex from the mesh into the pose
+	void BonePalette(const std::vector<MeshBone>& bones, std::vector<QMatrix4x4>& palette) const;
+
+	// Overwrites the weights of the morph targets at node the clip moves, the others keep theirs
+	void MorphWeights(int node, std::vector<float>& weights) const;
+
+	// Bounds of a mesh skinned with palette. Each bone's box is moved by its matrix, which
+	// contains every vertex it pulls on, so it also holds every blend of them.
+	static void SkinnedBounds(const std::vector<MeshBone>& bones, const std::vector<QMatrix4x4>& palette, QVector3D& min, QVector3D& max);
+
+private:
+	// The keys at or before the time each list was last sampled at
+	struct Cursor {
+		size_t m_position = 0;
+		size_t m_rotation = 0;
+		size_t m_scale = 0;
+	};
+
+	void Pose();
+
+	QSharedPointer<const Skeleton> m_skeleton;
+	int m_clip = -1;
+	float m_time = 0.f;
+	std::vector<Cursor> m_cursors;
+	std::vector<size_t> m_morphCursors;
+	std::vector<std::vector<float>> m_morphWeights; // Per morph channel of the clip
+	std::vector<QMatrix4x4> m_local;
+	std::vector<QMatrix4x4> m_global;
+};
@@ -0,0 +1,117 @@
+#include "AppSettings.h"
+#include "JobSystem.h"
+
+#include <QCoreApplication>
+#include <QSettings>
+
+
+namespace {
+
+AppSettings* g_pShared = nullptr;
+
+const char* k_organization = "The Model Viewers team";
+const char* k_application = "Model Viewer";
+
+}
+
+AppSettings* AppSettings::Shared()
+{
+	if (!g_pShared) {
+		Q_ASSERT(QCoreApplication::instance());
+		g_pShared = new AppSettings(QCoreApplication::instance());
+	}
+	return g_pShared;
+}
+
+AppSettings::AppSettings(QObject* parent)
+	: QObject(parent)
+{
+	QSettings settings(k_organization, k_application);
+	for (const QString& key : settings.allKeys()) {
+		m_values.insert(key, settings.value(key));
+	}
+
+	m_persistTimer.setSingleShot(true);
+	m_persistTimer.setInterval(k_persistDelayMs);
+	connect(&m_persistTimer, &QTimer::timeout, this, &AppSettings::Persist);
+}
+
+AppSettings::~AppSettings()
+{
+	sync();
+	if (g_pShared == this) {
+		g_pShared = nullptr;
+	}
+}
+
+QVariant AppSettings::value(const QString& key, const QVariant& defaultValue) const
+{
+	return m_values.value(key, defaultValue);
+}
+
+bool AppSettings::contains(const QString& key) const
+{
+	return m_values.contains(key);
+}
+
+void AppSettings::setValue(const QString& key, const QVariant& value)
+{
+	const auto it = m_values.constFind(key);
+	if (it != m_values.constEnd() && it.value() == value && it.value().userType() == value.userType()) {
+		return;
+	}
+	m_values.insert(key, value);
+	m_pending.push_back({ key, value, false });
+	m_persistTimer.start();
+	emit Changed(key);
+}
+
+void AppSettings::remove(const QString& key)
+{
+	// The keys below key follow it in order
+	const QString group = key + '/';
+	bool removed = m_values.remove(key) > 0;
+	for (auto it = m_values.lowerBound(group); it != m_values.end() && it.key().startsWith(group);) {
+		it = m_values.erase(it);
+		removed = true;
+	}
+	if (!removed) {
+		return;
+	}
+	m_pending.push_back({ key, QVariant(), true });
+	m_persistTimer.start();
+	emit Changed(key);
+}
+
+void AppSettings::sync()
+{
+	m_write.waitForFinished();
+	Persist();
+	m_write.waitForFinished();
+}
+
+void AppSettings::Persist()
+{
+	m_persistTimer.stop();
+	if (m_pending.empty()) {
+		return;
+	}
+	if (m_write.isRunning()) {
+		m_persistTimer.start();
+		return;
+	}
+	std::vector<Change> changes;
+	changes.swap(m_pending);
+	m_write = JobSystem::Run(JobPriority::Normal, [changes] {
+		QSettings settings(k_organization, k_application);
+		for (const Change& change : changes) {
+			if (change.m_remove) {
+				settings.remove(change.m_key);
+			}
+			else {
+				settings.setValue(change.m_key, change.m_value);
+			}
+		}
+		settings.sync();
+	});
+}
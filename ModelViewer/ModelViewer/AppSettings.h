@@ -0,0 +1,70 @@
+#pragma once
+#include <QFuture>
+#include <QMap>
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QVariant>
+
+#include <vector>
+
+// The settings of the application. Every window, panel and command reads and writes the same
+// store, which holds the values in memory: the settings are read from disk once, reading a
+// value is a lookup and a change is seen by everyone at once, with Changed. Changes are written
+// in batches by a job a moment after the last one, so dragging a slider never waits on the
+// registry or an INI file. The functions are those of QSettings of the same name.
+// Use it from the GUI thread, other threads make their own QSettings.
+class AppSettings : public QObject
+{
+	Q_OBJECT
+
+public:
+	// Time after a change that further changes are gathered before the batch is written
+	static const int k_persistDelayMs = 500;
+
+	// Made the first time it is asked for, owned by the application object, which has to exist
+	static AppSettings* Shared();
+
+	~AppSettings();
+
+	QVariant value(const QString& key, const QVariant& defaultValue = QVariant()) const;
+	bool contains(const QString& key) const;
+
+	// The value as T, or defaultValue if there is none or it doesn't convert
+	template <typename T>
+	T get(const QString& key, const T& defaultValue) const
+	{
+		const QVariant stored = value(key);
+		return stored.canConvert<T>() ? stored.value<T>() : defaultValue;
+	}
+
+	void setValue(const QString& key, const QVariant& value);
+	// Removes key and every key below it
+	void remove(const QString& key);
+
+	// Writes the changes not yet written and waits until they are
+	void sync();
+
+signals:
+	// After key, or a group of keys below it, was set to another value or removed
+	void Changed(const QString& key);
+
+private:
+	explicit AppSettings(QObject* parent);
+
+	struct Change {
+		QString m_key;
+		QVariant m_value;
+		bool m_remove = false;
+	};
+
+	// Hands the pending changes to a job writing them, once the last one finished so batches
+	// are written in the order they were made
+	void Persist();
+
+	QMap<QString, QVariant> m_values;
+	// Changes not handed to the writer yet, in the order they were made
+	std::vector<Change> m_pending;
+	QTimer m_persistTimer;
+	QFuture<void> m_write;
+};
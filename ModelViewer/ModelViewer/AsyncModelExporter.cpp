@@ -0,0 +1,255 @@
+#include "AsyncModelExporter.h"
+#include "JobSystem.h"
+#include "ModelLoader.h"
+
+#include <assimp/cexport.h>
+#include <assimp/Exporter.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+#include <assimp/IOSystem.hpp>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/scene.h>
+
+#include <QFile>
+#include <QFileInfo>
+
+#include <cstring>
+#include <vector>
+
+namespace {
+	// Share of the progress bar given to importing scenes that weren't kept
+	const float k_importProgressShare = 0.5f;
+
+	// Suffix of files being written until the export succeeded
+	const char* const k_partialSuffix = ".part";
+
+	// Reports progress from the worker thread and stops Assimp once the export is cancelled
+	class ExportProgressHandler : public Assimp::ProgressHandler
+	{
+	public:
+		ExportProgressHandler(AsyncModelExporter* pExporter, const std::atomic<bool>& cancelled, float start, float share)
+			: m_pExporter(pExporter), m_cancelled(cancelled), m_start(start), m_share(share) {}
+
+		bool Update(float percentage) override {
+			// Only report whole percent changes so the GUI thread is not flooded with events
+			if (percentage >= 0.f && percentage - m_lastReported >= 0.01f) {
+				m_lastReported = percentage;
+				emit m_pExporter->Progress(m_start + percentage * m_share);
+			}
+			return !m_cancelled;
+		}
+
+	private:
+		AsyncModelExporter* m_pExporter = nullptr;
+		const std::atomic<bool>& m_cancelled;
+		float m_start = 0.f;
+		float m_share = 1.f;
+		float m_lastReported = 0.f;
+	};
+
+	// A file the exporter writes or reads. Writes fail once the export is cancelled, which
+	// makes the exporters give up at their next write.
+	class ExportStream : public Assimp::IOStream
+	{
+	public:
+		ExportStream(const QString& path, QIODevice::OpenMode mode, const std::atomic<bool>& cancelled)
+			: m_file(path), m_cancelled(cancelled)
+		{
+			m_file.open(mode);
+		}
+
+		bool IsOpen() const {
+			return m_file.isOpen();
+		}
+
+		size_t Read(void* pvBuffer, size_t pSize, size_t pCount) override {
+			if (pSize == 0) {
+				return 0;
+			}
+			const qint64 read = m_file.read(static_cast<char*>(pvBuffer), qint64(pSize * pCount));
+			return read > 0 ? size_t(read) / pSize : 0;
+		}
+
+		size_t Write(const void* pvBuffer, size_t pSize, size_t pCount) override {
+			if (pSize == 0 || m_cancelled) {
+				return 0;
+			}
+			const qint64 written = m_file.write(static_cast<const char*>(pvBuffer), qint64(pSize * pCount));
+			return written > 0 ? size_t(written) / pSize : 0;
+		}
+
+		aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override {
+			qint64 position = qint64(pOffset);
+			if (pOrigin == aiOrigin_CUR) {
+				position += m_file.pos();
+			}
+			else if (pOrigin == aiOrigin_END) {
+				position = m_file.size() - qint64(pOffset);
+			}
+			return m_file.seek(position) ? AI_SUCCESS : AI_FAILURE;
+		}
+
+		size_t Tell() const override {
+			return size_t(m_file.pos());
+		}
+
+		size_t FileSize() const override {
+			return size_t(m_file.size());
+		}
+
+		void Flush() override {
+			m_file.flush();
+		}
+
+	private:
+		QFile m_file;
+		const std::atomic<bool>& m_cancelled;
+	};
+
+	// Opens the files the exporter writes, the main file and any it writes next to it such
+	// as .mtl files, under a temporary name. Commit() moves them into place.
+	class ExportIOSystem : public Assimp::IOSystem
+	{
+	public:
+		explicit ExportIOSystem(const std::atomic<bool>& cancelled)
+			: m_cancelled(cancelled) {}
+
+		bool Exists(const char* pFile) const override {
+			return QFileInfo::exists(QString::fromUtf8(pFile));
+		}
+
+		char getOsSeparator() const override {
+			return '/';
+		}
+
+		Assimp::IOStream* Open(const char* pFile, const char* pMode) override {
+			const QString path = QString::fromUtf8(pFile);
+			const bool write = strchr(pMode, 'w') != nullptr;
+			QIODevice::OpenMode mode = write ? QIODevice::WriteOnly : QIODevice::ReadOnly;
+			if (strchr(pMode, 't') != nullptr) {
+				mode |= QIODevice::Text;
+			}
+			ExportStream* pStream = new ExportStream(write ? path + k_partialSuffix : path, mode, m_cancelled);
+			if (!pStream->IsOpen()) {
+				delete pStream;
+				return nullptr;
+			}
+			if (write) {
+				m_written.push_back(path);
+			}
+			return pStream;
+		}
+
+		void Close(Assimp::IOStream* pFile) override {
+			delete pFile;
+		}
+
+		bool Commit() {
+			for (const QString& path : m_written) {
+				QFile::remove(path);
+				if (!QFile::rename(path + k_partialSuffix, path)) {
+					return false;
+				}
+			}
+			return true;
+		}
+
+		void Discard() {
+			for (const QString& path : m_written) {
+				QFile::remove(path + k_partialSuffix);
+			}
+		}
+
+	private:
+		const std::atomic<bool>& m_cancelled;
+		std::vector<QString> m_written;
+	};
+}
+
+
+AsyncModelExporter::AsyncModelExporter(QObject* parent)
+	: QObject(parent)
+{
+	connect(&m_exportWatcher, &QFutureWatcher<bool>::finished, this, &AsyncModelExporter::OnExportFinished);
+}
+
+AsyncModelExporter::~AsyncModelExporter()
+{
+	// The worker thread references this object through the progress handler
+	m_cancelled = true;
+	m_exportWatcher.waitForFinished();
+}
+
+bool AsyncModelExporter::IsExporting() const
+{
+	return m_exportWatcher.isRunning();
+}
+
+void AsyncModelExporter::Cancel()
+{
+	m_cancelled = true;
+}
+
+bool AsyncModelExporter::Export(const QString& filepath, const QString& formatId, const SimplifyOptions& simplify)
+{
+	// The reference keeps the scene alive even if the model is closed or replaced meanwhile
+	const std::shared_ptr<const Assimp::Importer> pImporter = ModelLoader::CurrentImporter();
+	const QString sourceFile = ModelLoader::CurrentFile();
+	if (IsExporting() || sourceFile.isEmpty()) {
+		return false;
+	}
+
+	m_filepath = filepath;
+	m_cancelled = false;
+	emit Progress(0.f);
+
+	m_exportWatcher.setFuture(JobSystem::Run(JobPriority::Load, [this, pImporter, sourceFile, filepath, formatId, simplify] {
+		// Scenes that weren't kept are imported again just for the export
+		std::shared_ptr<const Assimp::Importer> pSource = pImporter;
+		float progressStart = 0.f;
+		if (!pSource) {
+			ExportProgressHandler importProgress(this, m_cancelled, 0.f, k_importProgressShare);
+			pSource.reset(ModelLoader::ImportScene(sourceFile, &importProgress));
+			progressStart = k_importProgressShare;
+		}
+		if (!pSource->GetScene() || m_cancelled) {
+			return false;
+		}
+
+		// The scene may be shared with the view, the simplified triangles go into a copy
+		aiScene* pCopy = nullptr;
+		if (simplify.IsActive()) {
+			aiCopyScene(pSource->GetScene(), &pCopy);
+			MeshSimplifier::SimplifyScene(pCopy, simplify);
+		}
+		const aiScene* pScene = pCopy ? pCopy : pSource->GetScene();
+
+		// Most exporters build the whole file before writing it and report nothing
+		emit Progress(-1.f);
+		ExportProgressHandler exportProgress(this, m_cancelled, progressStart, 1.f - progressStart);
+		ExportIOSystem* pIOSystem = new ExportIOSystem(m_cancelled);
+		Assimp::Exporter exporter;
+		exporter.SetIOHandler(pIOSystem);
+		exporter.SetProgressHandler(&exportProgress);
+		const bool success = exporter.Export(pScene, formatId.toStdString(), filepath.toStdString()) == AI_SUCCESS
+			&& !m_cancelled && pIOSystem->Commit();
+		if (!success) {
+			pIOSystem->Discard();
+		}
+
+		// The exporter owns the IO system, the progress handler lives on this stack
+		exporter.SetProgressHandler(nullptr);
+		if (pCopy) {
+			aiFreeScene(pCopy);
+		}
+		return success;
+	}));
+	return true;
+}
+
+void AsyncModelExporter::OnExportFinished()
+{
+	const bool success = m_exportWatcher.result();
+	emit Progress(1.f);
+	emit Finished(success, m_filepath);
+}
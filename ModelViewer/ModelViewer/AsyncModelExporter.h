@@ -0,0 +1,50 @@
+#pragma once
+#include <atomic>
+#include <memory>
+
+#include <QFutureWatcher>
+#include <QObject>
+#include <QString>
+
+#include "MeshSimplifier.h"
+
+namespace Assimp {
+	class Importer;
+}
+
+// Exports the current scene without blocking the GUI thread. The worker holds a reference to
+// the importer of the scene, which Assimp never changes after the import, so the viewer keeps
+// drawing and may load another model while the export runs. Scenes that weren't kept are
+// imported again on the worker first. Files are written next to their destination and only
+// renamed into place when the export succeeds, so a cancelled export leaves nothing behind.
+class AsyncModelExporter : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit AsyncModelExporter(QObject* parent = nullptr);
+	~AsyncModelExporter();
+
+	// Starts exporting the current scene to filepath as the Assimp format formatId. False if an
+	// export is already running or nothing is loaded. With simplify active a copy of the scene
+	// is simplified by MeshSimplifier and exported instead, the scene itself is left alone.
+	bool Export(const QString& filepath, const QString& formatId, const SimplifyOptions& simplify = SimplifyOptions());
+	bool IsExporting() const;
+
+	// Stops at the next step of the import or the next write of the export. Finished() is
+	// still emitted, with success false.
+	void Cancel();
+
+signals:
+	// Progress of the current export from 0 to 1, or below 0 while the exporter writes
+	// without reporting how far it got
+	void Progress(float percent);
+	void Finished(bool success, QString filepath);
+
+private:
+	void OnExportFinished();
+
+	QFutureWatcher<bool> m_exportWatcher;
+	std::atomic<bool> m_cancelled{ false };
+	QString m_filepath;
+};
@@ -0,0 +1,494 @@
+#include "AsyncModelLoader.h"
+#include "GeometryStreamer.h"
+#include "GltfLoader.h"
+#include "GpuModelBuilder.h"
+#include "ImportTrace.h"
+#include "JobSystem.h"
+#include "ModelCache.h"
+#include "PointCloudLoader.h"
+#include "ResourceTracker.h"
+#include "TextModelLoader.h"
+#include "TextureCache.h"
+#include "TextureUploader.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
+#include <assimp/scene.h>
+
+#include <QOpenGLWidget>
+#include <QElapsedTimer>
+
+#include <algorithm>
+#include <limits>
+
+namespace {
+	// Share of the progress bar given to the Assimp import and decoding, the remainder is the GPU upload
+	const float k_importProgressShare = 0.8f;
+
+	// Models with fewer triangles load quickly enough without a preview
+	const size_t k_previewMinTriangles = 500000;
+
+	// Time spent uploading meshes before control is given back to the event loop
+	const qint64 k_uploadBudgetMs = 8;
+
+	// Forwards Assimp's progress reports from the worker thread. Emitting a signal from
+	// another thread is safe, the connected slots are queued onto the GUI thread. Returning
+	// false makes Assimp abandon the import once the load is cancelled.
+	class ImportProgressHandler : public Assimp::ProgressHandler
+	{
+	public:
+		ImportProgressHandler(AsyncModelLoader* pLoader, const std::atomic<bool>& cancelled)
+			: m_pLoader(pLoader), m_cancelled(cancelled) {}
+
+		bool Update(float percentage) override {
+			if (m_cancelled) {
+				return false;
+			}
+
+			// Only report whole percent changes so the GUI thread is not flooded with events
+			if (percentage >= 0.f && percentage - m_lastReported >= 0.01f) {
+				m_lastReported = percentage;
+				emit m_pLoader->Progress(percentage * k_importProgressShare);
+			}
+			return true;
+		}
+
+	private:
+		AsyncModelLoader* m_pLoader = nullptr;
+		const std::atomic<bool>& m_cancelled;
+		float m_lastReported = 0.f;
+	};
+}
+
+
+AsyncModelLoader::AsyncModelLoader(QOpenGLWidget* pContextWidget, TextureCache* pTextures, TextureUploader* pUploader, QObject* parent)
+	: QObject(parent), m_pContextWidget(pContextWidget), m_pTextures(pTextures), m_pUploader(pUploader), m_pTrace(std::make_shared<ImportTrace>())
+{
+	connect(&m_importWatcher, &QFutureWatcher<ImportResult>::finished, this, &AsyncModelLoader::OnImportFinished);
+
+	// The upload timer fires whenever the event loop is idle until all meshes are uploaded
+	m_uploadTimer.setInterval(0);
+	connect(&m_uploadTimer, &QTimer::timeout, this, &AsyncModelLoader::UploadMeshes);
+	m_textureTimer.setInterval(0);
+	connect(&m_textureTimer, &QTimer::timeout, this, &AsyncModelLoader::UploadTextures);
+}
+
+AsyncModelLoader::~AsyncModelLoader()
+{
+	// The worker threads reference this object through the progress handler
+	if (m_pCancelled) {
+		*m_pCancelled = true;
+	}
+	m_importWatcher.waitForFinished();
+
+	// Scenes of the load in progress that nobody adopted
+	if (m_loading) {
+		delete (m_importTaken ? m_pPendingImporter : m_importWatcher.result().m_pImporter);
+	}
+	for (QFutureWatcher<ImportResult>* pWatcher : m_abandonedImports) {
+		pWatcher->waitForFinished();
+		delete pWatcher->result().m_pImporter;
+	}
+}
+
+bool AsyncModelLoader::Load(const QString& filepath, const LoadOptions& options, bool adoptScene)
+{
+	// Only one model is loaded at a time, the newest request wins
+	Cancel();
+
+	m_loading = true;
+	m_pCancelled = std::make_shared<std::atomic<bool>>(false);
+	m_importTaken = false;
+	m_adoptScene = adoptScene;
+	m_filepath = filepath;
+	m_streamingBudget = options.m_streamingBudget;
+	m_lazyUpload = options.m_lazyUpload;
+	m_uploadBudget = options.m_uploadBudget;
+	m_textureUploadBudget = options.m_textureUploadBudget;
+	m_model = Model();
+	m_preview = Model();
+	m_pTrace = std::make_shared<ImportTrace>();
+
+	emit Progress(0.f);
+
+	// Import and decode on a worker thread. The progress handler lives on the worker's
+	// stack and is detached from the importer before ImportScene returns.
+	const std::shared_ptr<std::atomic<bool>> pCancelled = m_pCancelled;
+	const std::shared_ptr<ImportTrace> pTrace = m_pTrace;
+	m_importWatcher.setFuture(JobSystem::Run(JobPriority::Load, [this, filepath, options, pCancelled, pTrace] {
+		ImportResult result;
+		const ModelCache cache;
+		if (options.m_useCache) {
+			ImportTrace::Scope lookup(pTrace.get(), "Cache", ImportTrace::k_stage);
+			if (cache.Load(filepath, options, result.m_data)) {
+				result.m_success = true;
+				return result;
+			}
+		}
+
+		// Every stage stops early once the load is cancelled. The scene is freed here then,
+		// nobody takes the result of a cancelled load.
+		auto Abandon = [&result] {
+			delete result.m_pImporter;
+			return ImportResult();
+		};
+
+		// Writing the entry doesn't hold up the upload, the copy shares the decoded buffers
+		auto Store = [&] {
+			if (options.m_useCache && result.m_success) {
+				const ModelData data = result.m_data;
+				JobSystem::Run(JobPriority::Normal, [cache, filepath, options, data] {
+					cache.Store(filepath, options, data);
+				});
+			}
+		};
+
+		// glTF and text OBJ, PLY and STL files are read straight into a scene that is decoded
+		// without post-processing, point clouds straight into the decoded model. The scene
+		// belongs to the loader, so there is no importer to keep and the file is imported again
+		// for exports. Files only Assimp can read go on as any other.
+		auto DecodeScene = [&](auto& loader) {
+			return ModelLoader::DecodeModel(loader.Scene(), filepath, options, pCancelled.get(), pTrace.get());
+		};
+		auto ReadNative = [&](auto& loader, const char* stage, auto Decode) {
+			QElapsedTimer timer;
+			timer.start();
+			bool read = false;
+			{
+				ImportTrace::Scope native(pTrace.get(), stage, ImportTrace::k_stage);
+				read = loader.Read(filepath);
+			}
+			result.m_timings.push_back({ stage, float(timer.nsecsElapsed()) * 1e-9f });
+			if (read) {
+				result.m_data = Decode(loader);
+				result.m_success = !*pCancelled;
+			}
+			return read;
+		};
+		if (options.m_nativeGltf && GltfLoader::IsGltfFile(filepath)) {
+			GltfLoader gltf;
+			if (ReadNative(gltf, "glTF", DecodeScene)) {
+				if (*pCancelled) {
+					return Abandon();
+				}
+				Store();
+				return result;
+			}
+		}
+		if (PointCloudLoader::Handles(filepath)) {
+			PointCloudLoader cloud;
+			if (ReadNative(cloud, "Octree", [](PointCloudLoader& loader) { return loader.TakeModel(); })) {
+				if (*pCancelled) {
+					return Abandon();
+				}
+
+				// The octree is written to the cache right away and mapped back from there, so
+				// its nodes are paged in from disk as they are uploaded or streamed, rather than
+				// all of the points staying in memory
+				if (options.m_useCache && !options.m_compressCache) {
+					ImportTrace::Scope map(pTrace.get(), "Map", ImportTrace::k_stage);
+					ModelData mapped;
+					if (cache.Store(filepath, options, result.m_data) && cache.Load(filepath, options, mapped)) {
+						result.m_data = std::move(mapped);
+					}
+				}
+				else {
+					Store();
+				}
+				return result;
+			}
+		}
+		if (TextModelLoader::Handles(filepath, options)) {
+			TextModelLoader text;
+			if (ReadNative(text, "Parse", DecodeScene)) {
+				if (*pCancelled) {
+					return Abandon();
+				}
+				Store();
+				return result;
+			}
+		}
+
+		ImportProgressHandler progress(this, *pCancelled);
+		result.m_pImporter = ModelLoader::ReadScene(filepath, &progress, &result.m_timings, pTrace.get());
+		if (*pCancelled) {
+			return Abandon();
+		}
+
+		// Large models show a coarse proxy while the slow post-processing steps run. It is
+		// queued before the import result, so it always arrives first.
+		aiScene const* pReadScene = result.m_pImporter->GetScene();
+		if (options.m_previewProxy && ModelLoader::CountTriangles(pReadScene) >= k_previewMinTriangles) {
+			QElapsedTimer timer;
+			timer.start();
+			ModelData proxy;
+			{
+				ImportTrace::Scope preview(pTrace.get(), "Preview", ImportTrace::k_stage);
+				proxy = ModelLoader::DecodeProxy(pReadScene);
+			}
+			result.m_timings.push_back({ "Preview", float(timer.nsecsElapsed()) * 1e-9f });
+			QMetaObject::invokeMethod(this, [this, proxy, pCancelled] {
+				if (!*pCancelled) {
+					OnPreviewDecoded(proxy);
+				}
+			}, Qt::QueuedConnection);
+		}
+
+		ModelLoader::PostProcessScene(result.m_pImporter, ModelLoader::ImportFlags(options), &progress, &result.m_timings, pTrace.get());
+		if (*pCancelled) {
+			return Abandon();
+		}
+		result.m_success = result.m_pImporter->GetScene() != nullptr;
+		result.m_data = ModelLoader::DecodeModel(result.m_pImporter->GetScene(), filepath, options, pCancelled.get(), pTrace.get());
+		if (*pCancelled) {
+			return Abandon();
+		}
+
+		Store();
+
+		// Everything needed for drawing has been copied out, in low memory mode the scene goes now
+		if (!options.m_keepScene && result.m_success) {
+			delete result.m_pImporter;
+			result.m_pImporter = nullptr;
+		}
+		return result;
+	}));
+
+	return true;
+}
+
+bool AsyncModelLoader::IsLoading() const
+{
+	return m_loading;
+}
+
+void AsyncModelLoader::Cancel()
+{
+	if (!m_loading) {
+		return;
+	}
+	*m_pCancelled = true;
+	m_uploadTimer.stop();
+
+	// A worker still importing is left to wind down on its own. Its finished signal is
+	// ignored, or dropped when the next load sets the watcher's future.
+	if (!m_importTaken) {
+		AbandonImport(m_importWatcher.future());
+	}
+	delete m_pPendingImporter;
+	m_pPendingImporter = nullptr;
+
+	// Free what was uploaded so far, in the context it was created in
+	m_pContextWidget->makeCurrent();
+	m_model = Model();
+	m_preview = Model();
+	m_pendingData = ModelData();
+	m_pTextures->Purge();
+	m_pContextWidget->doneCurrent();
+
+	m_loading = false;
+	m_nextMesh = 0;
+	m_streamed = false;
+	emit Cancelled(m_filepath);
+}
+
+void AsyncModelLoader::AbandonImport(const QFuture<ImportResult>& future)
+{
+	// Only imports whose result wasn't taken yet still own a scene
+	QFutureWatcher<ImportResult>* pWatcher = new QFutureWatcher<ImportResult>(this);
+	connect(pWatcher, &QFutureWatcher<ImportResult>::finished, this, [this, pWatcher] {
+		delete pWatcher->result().m_pImporter;
+		m_abandonedImports.removeOne(pWatcher);
+		pWatcher->deleteLater();
+	});
+	m_abandonedImports.push_back(pWatcher);
+	pWatcher->setFuture(future);
+}
+
+const std::vector<ImportStepTime>& AsyncModelLoader::ImportTimings() const
+{
+	return m_importTimings;
+}
+
+const ImportTrace& AsyncModelLoader::LoadTrace() const
+{
+	return *m_pTrace;
+}
+
+Model AsyncModelLoader::TakeModel()
+{
+	// Moved out, so the loader holds no handles to buffers the viewer may drop
+	Model ret = std::move(m_model);
+	m_model = Model();
+	return ret;
+}
+
+Model AsyncModelLoader::TakePreview()
+{
+	Model ret = std::move(m_preview);
+	m_preview = Model();
+	return ret;
+}
+
+void AsyncModelLoader::OnPreviewDecoded(const ModelData& data)
+{
+	// The proxy is small enough to be uploaded in one go
+	m_pContextWidget->makeCurrent();
+	m_preview = GpuModelBuilder::BuildModel(data, *m_pTextures);
+	m_pContextWidget->doneCurrent();
+
+	if (m_preview.m_isValid) {
+		emit PreviewReady(m_filepath);
+	}
+}
+
+void AsyncModelLoader::OnImportFinished()
+{
+	if (!m_loading) {
+		return;
+	}
+	ImportResult result = m_importWatcher.result();
+	m_importTaken = true;
+	m_importSucceeded = result.m_success;
+	m_pPendingImporter = result.m_pImporter;
+	m_importTimings = result.m_timings;
+	if (!m_importTimings.empty()) {
+		QString report;
+		for (const ImportStepTime& step : m_importTimings) {
+			report += QString("\n  %1: %2 ms").arg(step.m_name).arg(step.m_seconds * 1e3f, 0, 'f', 1);
+		}
+		qInfo("Imported %s%s", qPrintable(m_filepath), qPrintable(report));
+	}
+	if (!result.m_success) {
+		Finish(false);
+		return;
+	}
+
+	// Upload the meshes incrementally. Models over the streaming budget, and all of them when
+	// uploading lazily, only get their materials now, their geometry is streamed in once it is
+	// in view.
+	m_pendingData = std::move(result.m_data);
+	m_nextMesh = 0;
+	m_model.m_meshes.reserve(m_pendingData.m_meshes.size());
+	const qint64 geometryBytes = GeometryStreamer::GeometryBytes(m_pendingData);
+	m_streamed = (m_lazyUpload && !m_pendingData.m_meshes.empty()) || (m_streamingBudget > 0 && geometryBytes > m_streamingBudget);
+
+	// A streamed model's geometry takes up to its streaming budget
+	if (m_uploadBudget >= 0) {
+		const qint64 streamedBytes = m_streamingBudget > 0 ? std::min(geometryBytes, m_streamingBudget) : geometryBytes;
+		const qint64 uploadBytes = ResourceTracker::UploadBytes(m_pendingData, !m_streamed) + (m_streamed ? streamedBytes : 0);
+		if (uploadBytes > m_uploadBudget) {
+			emit OverBudget(m_filepath, uploadBytes, m_uploadBudget);
+		}
+	}
+	if (!m_streamed) {
+		m_model.m_geometry.reset(new GeometryArena());
+	}
+	m_uploadTimer.start();
+}
+
+void AsyncModelLoader::UploadMeshes()
+{
+	// Buffers and textures are created in the widget's context
+	m_pContextWidget->makeCurrent();
+
+	QElapsedTimer budget;
+	budget.start();
+
+	// Every slice of the upload is a span of its own, the event loop runs in between
+	ImportTrace* pTrace = m_pTrace.get();
+	const qint64 uploadStartNs = pTrace->Now();
+
+	// The materials come first, every mesh points at one. Their images aren't needed afterwards.
+	// Their textures are streamed in a slice per call, the meshes get the rest of the time.
+	const bool streamTextures = m_textureUploadBudget > 0 && m_pUploader->IsCreated();
+	if (m_nextMesh == 0 && m_model.m_materials.empty()) {
+		ImportTrace::Scope materials(pTrace, "Materials");
+		m_model.m_materials = GpuModelBuilder::BuildMaterials(m_pendingData, *m_pTextures, streamTextures ? m_pUploader : nullptr);
+		m_pendingData.m_materials.clear();
+	}
+	if (!m_pUploader->IsIdle()) {
+		ImportTrace::Scope textures(pTrace, "Textures");
+		m_pUploader->Upload(m_textureUploadBudget);
+	}
+	// Bindless textures have no preview, the model waits for them
+	const bool texturesDrawable = m_pUploader->IsIdle() || !TextureCache::SupportsBindless();
+	const size_t meshCount = m_pendingData.m_meshes.size();
+	while (m_nextMesh < meshCount && budget.elapsed() < k_uploadBudgetMs) {
+		MeshData& data = m_pendingData.m_meshes[m_nextMesh++];
+		ImportTrace::Scope item(pTrace, "Mesh", ImportTrace::k_item);
+		if (m_streamed) {
+			m_model.m_meshes.push_back(GpuModelBuilder::BuildMesh(data, m_model.m_materials, nullptr, false));
+			continue;
+		}
+		m_model.m_meshes.push_back(GpuModelBuilder::BuildMesh(data, m_model.m_materials, m_model.m_geometry.data()));
+
+		// The CPU copy is not needed once it lives on the GPU
+		data = MeshData();
+	}
+
+	m_pContextWidget->doneCurrent();
+	pTrace->Add("Upload", ImportTrace::k_stage, uploadStartNs, pTrace->Now());
+
+	const float uploaded = meshCount == 0 ? 1.f : float(m_nextMesh) / float(meshCount);
+	emit Progress(k_importProgressShare + (1.f - k_importProgressShare) * uploaded);
+
+	if (m_nextMesh >= meshCount && texturesDrawable) {
+		m_uploadTimer.stop();
+		if (!m_pUploader->IsIdle()) {
+			m_textureTimer.start();
+		}
+		{
+			ImportTrace::Scope finalize(pTrace, "Finalize", ImportTrace::k_stage);
+			m_model.m_skeleton = m_pendingData.m_skeleton;
+			m_model.m_sceneGraph = m_pendingData.m_sceneGraph;
+			m_model.m_lights = m_pendingData.m_lights;
+			m_model.m_origin = m_pendingData.m_origin;
+			m_model.m_stats = m_pendingData.m_stats;
+			if (m_streamed) {
+				// Lazily uploaded models without a budget keep whatever they stream in
+				const qint64 budget = m_streamingBudget > 0 ? m_streamingBudget : std::numeric_limits<qint64>::max();
+				m_model.m_streamer.reset(new GeometryStreamer(std::move(m_pendingData), budget));
+			}
+			m_model.Finalize();
+		}
+		Finish(m_model.m_isValid);
+	}
+}
+
+void AsyncModelLoader::UploadTextures()
+{
+	// A model being loaded streams them alongside its meshes
+	if (m_loading || m_pUploader->IsIdle()) {
+		m_textureTimer.stop();
+		return;
+	}
+	m_pContextWidget->makeCurrent();
+	m_pUploader->Upload(m_textureUploadBudget);
+	m_pContextWidget->doneCurrent();
+	m_pContextWidget->update();
+}
+
+void AsyncModelLoader::Finish(bool success)
+{
+	// Adopt the new scene so it can be exported, this also releases the previous scene.
+	// Models without a scene are only imported again if they are exported.
+	if (!m_adoptScene) {
+		delete m_pPendingImporter;
+	}
+	else if (m_importSucceeded && !m_pPendingImporter) {
+		ModelLoader::SetCurrentFile(m_filepath);
+	}
+	else {
+		ModelLoader::SetCurrentScene(m_pPendingImporter, m_filepath);
+	}
+	m_pPendingImporter = nullptr;
+
+	m_loading = false;
+	m_pendingData = ModelData();
+	m_nextMesh = 0;
+	m_streamed = false;
+	m_preview = Model();
+
+	emit Finished(success, m_filepath);
+}
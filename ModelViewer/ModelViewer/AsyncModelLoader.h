@@ -0,0 +1,130 @@
+#pragma once
+#include "ModelLoader.h"
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include <QFutureWatcher>
+#include <QList>
+
+#include <atomic>
+#include <memory>
+
+class ImportTrace;
+class QOpenGLWidget;
+class TextureCache;
+class TextureUploader;
+
+// Loads a model without blocking the GUI thread. The Assimp import and the mesh decoding
+// run on a worker thread, then the decoded meshes are uploaded to the GL context of
+// pContextWidget a few at a time so the rest of the UI keeps repainting. With
+// LoadOptions::m_useCache the import is skipped for files found in the ModelCache.
+// With LoadOptions::m_previewProxy large models first get a coarse proxy, announced by
+// PreviewReady(), which stands in for the model until Finished() is emitted. Models over
+// LoadOptions::m_streamingBudget, and every model with LoadOptions::m_lazyUpload, keep their
+// decoded meshes in a GeometryStreamer instead.
+// Models estimated to take more GPU memory than LoadOptions::m_uploadBudget are announced by
+// OverBudget() before their upload starts. Textures are streamed in under
+// LoadOptions::m_textureUploadBudget bytes at a time alongside the meshes. The model is
+// finished once its meshes are uploaded, its textures are drawn from a small preview until
+// the rest of them streams in after it, each slice repainting pContextWidget. Bindless
+// textures have no preview, models using them finish once their textures are in.
+// A load can be cancelled at any stage, and starting another load cancels the current one.
+class AsyncModelLoader : public QObject
+{
+	Q_OBJECT
+
+public:
+	// Textures are shared through pTextures and streamed through pUploader, which must outlive
+	// the loader. Textures are uploaded whole while pUploader isn't created.
+	AsyncModelLoader(QOpenGLWidget* pContextWidget, TextureCache* pTextures, TextureUploader* pUploader, QObject* parent = nullptr);
+	~AsyncModelLoader();
+
+	// Cancels the load in progress, if any, and starts loading filepath. Without adoptScene the
+	// scene ModelLoader exports stays the one it was, for models added beside it.
+	bool Load(const QString& filepath, const LoadOptions& options = LoadOptions(), bool adoptScene = true);
+	bool IsLoading() const;
+
+	// Stops the current load and frees what was uploaded of it, emitting Cancelled(). The
+	// import stops at Assimp's next progress report or our next decoding stage, its scene is
+	// freed on the worker once it does.
+	void Cancel();
+
+	// Returns the finished model. Only valid after Finished() has been emitted.
+	Model TakeModel();
+
+	// Returns the proxy of the model being loaded. Only valid after PreviewReady() has been emitted.
+	Model TakePreview();
+
+	// Time spent in each stage of the last import. Empty when the model came from the cache.
+	const std::vector<ImportStepTime>& ImportTimings() const;
+
+	// Spans of the last load from start to finish, the cache lookup, import, decoding and upload.
+	// Only complete after Finished() has been emitted.
+	const ImportTrace& LoadTrace() const;
+
+signals:
+	// Overall progress of the current load, from 0 to 1
+	void Progress(float percent);
+	void PreviewReady(QString filepath);
+	void Finished(bool success, QString filepath);
+	void Cancelled(QString filepath);
+
+	// Uploading the model will take an estimated uploadBytes of GPU memory, more than the
+	// budgetBytes left of the memory budget
+	void OverBudget(QString filepath, qint64 uploadBytes, qint64 budgetBytes);
+
+private:
+	// Everything produced by the worker thread
+	struct ImportResult {
+		Assimp::Importer* m_pImporter = nullptr;
+		ModelData m_data;
+		bool m_success = false;
+		std::vector<ImportStepTime> m_timings;
+	};
+
+	void OnPreviewDecoded(const ModelData& data);
+	void OnImportFinished();
+	void UploadMeshes();
+	void UploadTextures();
+	void Finish(bool success);
+
+	// Frees the scene of a cancelled import once its worker returns
+	void AbandonImport(const QFuture<ImportResult>& future);
+
+	QOpenGLWidget* m_pContextWidget = nullptr;
+	TextureCache* m_pTextures = nullptr;
+	TextureUploader* m_pUploader = nullptr;
+	QFutureWatcher<ImportResult> m_importWatcher;
+	QList<QFutureWatcher<ImportResult>*> m_abandonedImports;
+
+	// Set when the current load is cancelled. Each load has its own, so a worker that is still
+	// winding down never sees the flag of the load that replaced it.
+	std::shared_ptr<std::atomic<bool>> m_pCancelled;
+	QTimer m_uploadTimer;
+	// Streams the textures left once a model is finished, while no other one loads
+	QTimer m_textureTimer;
+
+	bool m_loading = false;
+	QString m_filepath;
+
+	// The import's scene once its result was taken, adopted by ModelLoader when the load
+	// finishes so a cancelled load leaves the scene of the model being viewed in place
+	bool m_importTaken = false;
+	bool m_importSucceeded = false;
+	bool m_adoptScene = true;
+	Assimp::Importer* m_pPendingImporter = nullptr;
+	ModelData m_pendingData;
+	size_t m_nextMesh = 0;
+	qint64 m_streamingBudget = 0;
+	bool m_lazyUpload = false;
+	qint64 m_uploadBudget = -1;
+	qint64 m_textureUploadBudget = 0;
+	bool m_streamed = false;
+	Model m_model;
+	Model m_preview;
+	std::vector<ImportStepTime> m_importTimings;
+
+	// Each load has its own, a worker winding down adds to the trace of its own load
+	std::shared_ptr<ImportTrace> m_pTrace;
+};
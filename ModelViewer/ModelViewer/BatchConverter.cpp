@@ -0,0 +1,293 @@
+#include "BatchConverter.h"
+#include "JobSystem.h"
+
+#include <assimp/Exporter.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QThread>
+
+#include <map>
+#include <memory>
+
+
+namespace {
+	const char* const k_manifestName = ".convert-manifest.json";
+	const char* const k_reportName = "convert-report.json";
+
+	// What happened to one source file, written by the worker that took it
+	struct FileResult {
+		enum Status { k_pending, k_converted, k_skipped, k_failed };
+		Status m_status = k_pending;
+		QByteArray m_hash;
+		qint64 m_size = 0;
+		qint64 m_modified = 0;
+		QString m_error;
+	};
+
+	QJsonObject ReadJson(const QString& path)
+	{
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly)) {
+			return QJsonObject();
+		}
+		return QJsonDocument::fromJson(file.readAll()).object();
+	}
+
+	bool WriteJson(const QString& path, const QJsonObject& object)
+	{
+		// Written to a temporary file and renamed, so a cancelled or crashed run never leaves
+		// half a manifest behind
+		QSaveFile file(path);
+		if (!file.open(QIODevice::WriteOnly)) {
+			return false;
+		}
+		file.write(QJsonDocument(object).toJson());
+		return file.commit();
+	}
+}
+
+QString BatchConvertReport::Summary() const
+{
+	return QString("Converted %1, skipped %2 unchanged, %3 failed in %4 s")
+		.arg(m_converted)
+		.arg(m_skipped)
+		.arg(m_failed.size())
+		.arg(m_seconds, 0, 'f', 1);
+}
+
+BatchConverter::BatchConverter(const BatchConvertOptions& options)
+	: m_options(options)
+{
+}
+
+void BatchConverter::Cancel()
+{
+	m_cancelled = true;
+}
+
+QStringList BatchConverter::FormatIds()
+{
+	QStringList ret;
+	Assimp::Exporter exporter;
+	for (size_t i = 0; i < exporter.GetExportFormatCount(); ++i) {
+		ret << exporter.GetExportFormatDescription(i)->id;
+	}
+	return ret;
+}
+
+QString BatchConverter::FormatExtension(const QString& formatId)
+{
+	Assimp::Exporter exporter;
+	for (size_t i = 0; i < exporter.GetExportFormatCount(); ++i) {
+		const aiExportFormatDesc* pDesc = exporter.GetExportFormatDescription(i);
+		if (formatId == pDesc->id) {
+			return pDesc->fileExtension;
+		}
+	}
+	return QString();
+}
+
+QStringList BatchConverter::FindModels(const QString& folder)
+{
+	QStringList ret;
+	Assimp::Importer importer;
+	QDirIterator it(folder, QDir::Files, QDirIterator::Subdirectories);
+	while (it.hasNext()) {
+		const QString path = it.next();
+		if (importer.IsExtensionSupported(("." + QFileInfo(path).suffix()).toStdString())) {
+			ret << path;
+		}
+	}
+
+	// Sorted so runs report and convert in the same order
+	ret.sort();
+	return ret;
+}
+
+QByteArray BatchConverter::ContentHash(const QString& file)
+{
+	QFile source(file);
+	if (!source.open(QIODevice::ReadOnly)) {
+		return QByteArray();
+	}
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	if (!hash.addData(&source)) {
+		return QByteArray();
+	}
+	return hash.result().toHex();
+}
+
+BatchConvertReport BatchConverter::Convert(const ProgressFunc& progress)
+{
+	BatchConvertReport report;
+	QElapsedTimer timer;
+	timer.start();
+	m_cancelled = false;
+
+	const QString extension = FormatExtension(m_options.m_formatId);
+	if (extension.isEmpty()) {
+		report.m_failed << QString("Unknown export format %1").arg(m_options.m_formatId);
+		return report;
+	}
+	const QDir inputDir(QFileInfo(m_options.m_inputFolder).absoluteFilePath());
+	const QDir outputDir(QFileInfo(m_options.m_outputFolder).absoluteFilePath());
+	if (!inputDir.exists() || !QDir().mkpath(outputDir.path())) {
+		report.m_failed << QString("Can't read %1 or write %2").arg(inputDir.path(), outputDir.path());
+		return report;
+	}
+
+	// Outputs written into the input folder would be converted again on the next run
+	QStringList files;
+	const QString outputPrefix = outputDir.path() + "/";
+	for (const QString& file : FindModels(inputDir.path())) {
+		if (!QFileInfo(file).absoluteFilePath().startsWith(outputPrefix)) {
+			files << QFileInfo(file).absoluteFilePath();
+		}
+	}
+
+	// Sources that would write the same output, like a.fbx and a.obj, keep their suffix
+	QStringList outputs;
+	std::map<QString, int> outputCounts;
+	for (const QString& file : files) {
+		const QFileInfo info(inputDir.relativeFilePath(file));
+		outputs << QDir(info.path()).filePath(info.completeBaseName() + "." + extension);
+		++outputCounts[outputs.back()];
+	}
+	for (int i = 0; i < files.size(); ++i) {
+		if (outputCounts[outputs[i]] > 1) {
+			const QFileInfo info(inputDir.relativeFilePath(files[i]));
+			outputs[i] = QDir(info.path()).filePath(info.completeBaseName() + "_" + info.suffix() + "." + extension);
+		}
+	}
+
+	// The manifest only vouches for outputs written with the same format and import steps
+	const unsigned int importFlags = ModelLoader::ImportFlags(m_options.m_loadOptions);
+	const QString manifestPath = outputDir.filePath(k_manifestName);
+	const QJsonObject manifest = ReadJson(manifestPath);
+	const bool manifestValid = manifest["format"].toString() == m_options.m_formatId
+		&& manifest["importFlags"].toVariant().toUInt() == importFlags;
+	const QJsonObject entries = manifestValid ? manifest["files"].toObject() : QJsonObject();
+
+	std::vector<FileResult> results(files.size());
+	std::atomic<int> next{ 0 };
+	std::atomic<int> done{ 0 };
+	auto Work = [&]() {
+		for (int i = next++; i < files.size() && !m_cancelled; i = next++) {
+			FileResult& result = results[i];
+			const QString relative = inputDir.relativeFilePath(files[i]);
+			const QString outputPath = outputDir.filePath(outputs[i]);
+			const QFileInfo info(files[i]);
+			result.m_size = info.size();
+			result.m_modified = info.lastModified().toMSecsSinceEpoch();
+
+			// Unchanged size and time trust the recorded hash, otherwise the content decides.
+			// Touched files with the same content are skipped without another export.
+			const QJsonObject entry = entries[relative].toObject();
+			const bool upToDate = !m_options.m_force && !entry.isEmpty() && QFileInfo::exists(outputPath);
+			if (upToDate && entry["size"].toVariant().toLongLong() == result.m_size
+				&& entry["modified"].toVariant().toLongLong() == result.m_modified) {
+				result.m_hash = entry["hash"].toString().toLatin1();
+			}
+			else {
+				result.m_hash = ContentHash(files[i]);
+			}
+			if (upToDate && result.m_hash == entry["hash"].toString().toLatin1()) {
+				result.m_status = FileResult::k_skipped;
+			}
+			else {
+				std::unique_ptr<Assimp::Importer> pImporter(ModelLoader::ImportScene(files[i], nullptr, importFlags));
+				Assimp::Exporter exporter;
+				if (!pImporter->GetScene()) {
+					result.m_status = FileResult::k_failed;
+					result.m_error = pImporter->GetErrorString();
+				}
+				else if (!QDir().mkpath(QFileInfo(outputPath).path())
+					|| exporter.Export(pImporter->GetScene(), m_options.m_formatId.toStdString(), outputPath.toStdString()) != AI_SUCCESS) {
+					result.m_status = FileResult::k_failed;
+					result.m_error = exporter.GetErrorString();
+				}
+				else {
+					result.m_status = FileResult::k_converted;
+				}
+			}
+
+			const int count = ++done;
+			if (progress) {
+				progress(count, files.size());
+			}
+		}
+	};
+
+	// Each worker is a job that takes files until none are left, and holds one imported scene
+	// at a time. Loads the user starts meanwhile go ahead of workers that haven't started.
+	const int workers = std::max(1, std::min(m_options.m_workers > 0 ? m_options.m_workers : QThread::idealThreadCount(), int(files.size())));
+	std::vector<QFuture<void>> futures;
+	for (int w = 0; w < workers; ++w) {
+		futures.push_back(JobSystem::Run(JobPriority::Normal, Work));
+	}
+	for (const QFuture<void>& future : futures) {
+		JobSystem::Wait(future);
+	}
+
+	// Files that weren't reached keep their old entries, sources that are gone lose theirs
+	QJsonObject newEntries;
+	QJsonArray failures;
+	for (int i = 0; i < files.size(); ++i) {
+		const QString relative = inputDir.relativeFilePath(files[i]);
+		const FileResult& result = results[i];
+		switch (result.m_status) {
+		case FileResult::k_pending:
+			if (entries.contains(relative)) {
+				newEntries[relative] = entries[relative];
+			}
+			continue;
+		case FileResult::k_failed:
+			report.m_failed << QString("%1: %2").arg(relative, result.m_error);
+			failures.append(QJsonObject{ { "file", relative }, { "error", result.m_error } });
+			continue;
+		case FileResult::k_converted:
+			++report.m_converted;
+			break;
+		case FileResult::k_skipped:
+			++report.m_skipped;
+			break;
+		}
+		newEntries[relative] = QJsonObject{
+			{ "hash", QString::fromLatin1(result.m_hash) },
+			{ "size", result.m_size },
+			{ "modified", result.m_modified },
+			{ "output", outputs[i] },
+		};
+	}
+	QJsonObject newManifest;
+	newManifest["format"] = m_options.m_formatId;
+	newManifest["importFlags"] = qint64(importFlags);
+	newManifest["files"] = newEntries;
+	WriteJson(manifestPath, newManifest);
+
+	report.m_seconds = double(timer.nsecsElapsed()) * 1e-9;
+	QJsonObject reportJson;
+	reportJson["input"] = inputDir.path();
+	reportJson["format"] = m_options.m_formatId;
+	reportJson["workers"] = workers;
+	reportJson["files"] = int(files.size());
+	reportJson["converted"] = report.m_converted;
+	reportJson["skipped"] = report.m_skipped;
+	reportJson["failed"] = failures;
+	reportJson["cancelled"] = bool(m_cancelled);
+	reportJson["seconds"] = report.m_seconds;
+	WriteJson(outputDir.filePath(k_reportName), reportJson);
+	return report;
+}
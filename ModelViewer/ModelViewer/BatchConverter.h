@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <functional>
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+
+#include "ModelLoader.h"
+
+// Options for converting a folder of models to one Assimp export format
+struct BatchConvertOptions {
+	QString m_inputFolder;
+	QString m_outputFolder;
+
+	// Assimp export format id, such as obj, fbx, glb2 or stl
+	QString m_formatId = "obj";
+
+	// Importer and exporter pairs running at once, 0 for one per core
+	int m_workers = 0;
+
+	// Convert every file, even if its output is up to date
+	bool m_force = false;
+
+	// Picks the import post-processing applied before exporting
+	LoadOptions m_loadOptions;
+};
+
+// What a conversion did, also written to <output folder>/convert-report.json
+struct BatchConvertReport {
+	int m_converted = 0;
+	int m_skipped = 0;
+	QStringList m_failed;
+	double m_seconds = 0.0;
+
+	QString Summary() const;
+};
+
+// Converts every model below the input folder to the same relative path below the output
+// folder. Each worker imports and exports with its own Assimp::Importer and Assimp::Exporter,
+// so workers never share a scene. A manifest in the output folder remembers the content hash
+// of every source converted, and files whose content and settings match it are skipped.
+class BatchConverter
+{
+public:
+	// Called from the workers after each file with the number done so far and the total
+	using ProgressFunc = std::function<void(int done, int total)>;
+
+	explicit BatchConverter(const BatchConvertOptions& options);
+
+	// Blocks until every file is converted, skipped, failed, or Cancel() is called
+	BatchConvertReport Convert(const ProgressFunc& progress = ProgressFunc());
+
+	// Stops the workers after the files they are on. Safe to call from any thread.
+	void Cancel();
+
+	// Export format ids Assimp was built with, and the file extension of one
+	static QStringList FormatIds();
+	static QString FormatExtension(const QString& formatId);
+
+	// Files below folder, recursively, Assimp has an importer for
+	static QStringList FindModels(const QString& folder);
+
+	// Sha1 of the content of file, empty if it can't be read
+	static QByteArray ContentHash(const QString& file);
+
+private:
+	BatchConvertOptions m_options;
+	std::atomic<bool> m_cancelled{ false };
+};
@@ -0,0 +1,120 @@
+#include "BatchRenderer.h"
+#include "JobSystem.h"
+#include "ViewerGraphicsWindow.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QImage>
+
+#include <deque>
+
+
+namespace {
+	// Images waiting to be written are held in memory, so only this many are in flight
+	const int k_maxPendingWrites = 8;
+}
+
+BatchRenderer::BatchRenderer(const BatchRenderOptions& options)
+	: m_options(options)
+{
+}
+
+std::vector<BatchRenderer::View> BatchRenderer::ParseViews(const QStringList& views)
+{
+	std::vector<View> ret;
+	for (const QString& view : views) {
+		if (view == "front") {
+			ret.push_back({ view, 0.f, 0.f });
+		}
+		else if (view == "back") {
+			ret.push_back({ view, 180.f, 0.f });
+		}
+		else if (view == "left") {
+			ret.push_back({ view, 90.f, 0.f });
+		}
+		else if (view == "right") {
+			ret.push_back({ view, -90.f, 0.f });
+		}
+		else if (view == "top") {
+			ret.push_back({ view, 0.f, 90.f });
+		}
+		else if (view == "iso") {
+			ret.push_back({ view, 45.f, 30.f });
+		}
+		else if (view.startsWith("turntable")) {
+			const int count = std::max(1, view.section(':', 1).toInt());
+			for (int i = 0; i < count; ++i) {
+				ret.push_back({ QString("turntable_%1").arg(i, 3, 10, QChar('0')), 360.f * i / count, 30.f });
+			}
+		}
+		else {
+			qWarning("Unknown view %s", qPrintable(view));
+		}
+	}
+	return ret;
+}
+
+int BatchRenderer::Render(const QStringList& files)
+{
+	const std::vector<View> views = ParseViews(m_options.m_views);
+	if (files.isEmpty() || views.empty()) {
+		return 0;
+	}
+	QDir().mkpath(m_options.m_outputFolder);
+
+	// The window is never shown. Grabbing renders into the widget's own framebuffer object.
+	ViewerGraphicsWindow window;
+	window.resize(m_options.m_size);
+	window.grabFramebuffer();
+	if (!window.IsInitialized()) {
+		qWarning("Could not create an OpenGL context");
+		return 0;
+	}
+
+	const LoadOptions loadOptions = m_options.m_loadOptions;
+	auto Decode = [loadOptions](const QString& file) {
+		return ModelLoader::DecodeFile(file, loadOptions);
+	};
+
+	int written = 0;
+	std::deque<QFuture<bool>> writes;
+	auto WaitForWrite = [&]() {
+		if (writes.front().result()) {
+			++written;
+		}
+		writes.pop_front();
+	};
+
+	QFuture<ModelData> next = JobSystem::Run(JobPriority::Load, [=] { return Decode(files.front()); });
+	for (int i = 0; i < files.size(); ++i) {
+		// Start on the next model before rendering this one
+		ModelData data = next.result();
+		if (i + 1 < files.size()) {
+			const QString file = files[i + 1];
+			next = JobSystem::Run(JobPriority::Load, [=] { return Decode(file); });
+		}
+
+		if (!window.SetModelData(data)) {
+			qWarning("Could not load %s", qPrintable(files[i]));
+			continue;
+		}
+
+		const QString baseName = QFileInfo(files[i]).completeBaseName();
+		for (const View& view : views) {
+			window.SetRotation(view.m_rotX, view.m_rotY);
+			const QImage image = window.grabFramebuffer();
+			const QString path = QDir(m_options.m_outputFolder).filePath(QString("%1_%2.png").arg(baseName, view.m_name));
+
+			if (int(writes.size()) >= k_maxPendingWrites) {
+				WaitForWrite();
+			}
+			writes.push_back(JobSystem::Run(JobPriority::Normal, [image, path] { return image.save(path); }));
+		}
+	}
+
+	while (!writes.empty()) {
+		WaitForWrite();
+	}
+	window.unloadModel();
+	return written;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+#include "ModelLoader.h"
+
+// Command line options for rendering images of models without the main window
+struct BatchRenderOptions {
+	QString m_outputFolder;
+	QSize m_size = QSize(512, 512);
+
+	// Camera presets: front, back, left, right, top, iso, or turntable:<count> for
+	// count views evenly spaced around the model
+	QStringList m_views = { "iso" };
+
+	LoadOptions m_loadOptions;
+};
+
+// Renders every view of every model to <output folder>/<model name>_<view>.png. The next model
+// is imported and decoded on the thread pool while the current one renders, and images are
+// written on the thread pool as well.
+class BatchRenderer
+{
+public:
+	explicit BatchRenderer(const BatchRenderOptions& options);
+
+	// Returns the number of images written. Requires a QApplication.
+	int Render(const QStringList& files);
+
+private:
+	struct View {
+		QString m_name;
+		float m_rotX;
+		float m_rotY;
+	};
+	static std::vector<View> ParseViews(const QStringList& views);
+
+	BatchRenderOptions m_options;
+};
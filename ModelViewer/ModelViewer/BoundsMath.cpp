@@ -0,0 +1,233 @@
+#include "BoundsMath.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BOUNDS_MATH_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+#define BOUNDS_MATH_NEON
+#include <arm_neon.h>
+#endif
+
+
+namespace {
+
+bool IsAffine(const QMatrix4x4& transform)
+{
+	return transform(3, 0) == 0.f && transform(3, 1) == 0.f && transform(3, 2) == 0.f && transform(3, 3) == 1.f;
+}
+
+#if defined(BOUNDS_MATH_SSE2)
+
+__m128 Load3(const QVector3D& v)
+{
+	return _mm_set_ps(0.f, v.z(), v.y(), v.x());
+}
+
+QVector3D Store3(__m128 v)
+{
+	alignas(16) float values[4];
+	_mm_store_ps(values, v);
+	return QVector3D(values[0], values[1], values[2]);
+}
+
+__m128 Abs(__m128 v)
+{
+	return _mm_andnot_ps(_mm_set1_ps(-0.f), v);
+}
+
+#elif defined(BOUNDS_MATH_NEON)
+
+float32x4_t Load3(const QVector3D& v)
+{
+	const float values[4] = { v.x(), v.y(), v.z(), 0.f };
+	return vld1q_f32(values);
+}
+
+QVector3D Store3(float32x4_t v)
+{
+	float values[4];
+	vst1q_f32(values, v);
+	return QVector3D(values[0], values[1], values[2]);
+}
+
+#endif
+
+// Smallest signed distance of the box to the planes, measured from its corner furthest along
+// (sign 1) or against (sign -1) each plane's normal. Negative if a plane cuts off that corner.
+float MinPlaneDistance(const BoundsMath::PlaneSet& planes, const QVector3D& min, const QVector3D& max, float sign)
+{
+	const QVector3D center = (min + max) * 0.5f;
+	const QVector3D extent = (max - min) * 0.5f * sign;
+#if defined(BOUNDS_MATH_SSE2)
+	__m128 smallest = _mm_set1_ps(FLT_MAX);
+	for (int i = 0; i < BoundsMath::PlaneSet::k_capacity; i += 4) {
+		const __m128 a = _mm_load_ps(planes.m_a + i);
+		const __m128 b = _mm_load_ps(planes.m_b + i);
+		const __m128 c = _mm_load_ps(planes.m_c + i);
+		const __m128 d = _mm_load_ps(planes.m_d + i);
+		const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_set1_ps(center.x())), _mm_mul_ps(b, _mm_set1_ps(center.y()))),
+			_mm_add_ps(_mm_mul_ps(c, _mm_set1_ps(center.z())), d));
+		const __m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Abs(a), _mm_set1_ps(extent.x())), _mm_mul_ps(Abs(b), _mm_set1_ps(extent.y()))),
+			_mm_mul_ps(Abs(c), _mm_set1_ps(extent.z())));
+		smallest = _mm_min_ps(smallest, _mm_add_ps(distance, radius));
+	}
+	smallest = _mm_min_ps(smallest, _mm_shuffle_ps(smallest, smallest, _MM_SHUFFLE(1, 0, 3, 2)));
+	smallest = _mm_min_ps(smallest, _mm_shuffle_ps(smallest, smallest, _MM_SHUFFLE(2, 3, 0, 1)));
+	return _mm_cvtss_f32(smallest);
+#elif defined(BOUNDS_MATH_NEON)
+	float32x4_t smallest = vdupq_n_f32(FLT_MAX);
+	for (int i = 0; i < BoundsMath::PlaneSet::k_capacity; i += 4) {
+		const float32x4_t a = vld1q_f32(planes.m_a + i);
+		const float32x4_t b = vld1q_f32(planes.m_b + i);
+		const float32x4_t c = vld1q_f32(planes.m_c + i);
+		const float32x4_t d = vld1q_f32(planes.m_d + i);
+		float32x4_t distance = vmlaq_n_f32(d, a, center.x());
+		distance = vmlaq_n_f32(distance, b, center.y());
+		distance = vmlaq_n_f32(distance, c, center.z());
+		distance = vmlaq_n_f32(distance, vabsq_f32(a), extent.x());
+		distance = vmlaq_n_f32(distance, vabsq_f32(b), extent.y());
+		distance = vmlaq_n_f32(distance, vabsq_f32(c), extent.z());
+		smallest = vminq_f32(smallest, distance);
+	}
+	const float32x2_t pair = vpmin_f32(vget_low_f32(smallest), vget_high_f32(smallest));
+	return vget_lane_f32(vpmin_f32(pair, pair), 0);
+#else
+	float smallest = FLT_MAX;
+	for (int i = 0; i < BoundsMath::PlaneSet::k_capacity; ++i) {
+		const float distance = planes.m_a[i] * center.x() + planes.m_b[i] * center.y() + planes.m_c[i] * center.z() + planes.m_d[i];
+		const float radius = std::abs(planes.m_a[i]) * extent.x() + std::abs(planes.m_b[i]) * extent.y() + std::abs(planes.m_c[i]) * extent.z();
+		smallest = std::min(smallest, distance + radius);
+	}
+	return smallest;
+#endif
+}
+
+}
+
+void BoundsMath::SetPlanes(const QVector4D* pPlanes, int count, PlaneSet& planes)
+{
+	for (int i = 0; i < PlaneSet::k_capacity; ++i) {
+		const QVector4D plane = i < count ? pPlanes[i] : QVector4D(0.f, 0.f, 0.f, 1.f);
+		planes.m_a[i] = plane.x();
+		planes.m_b[i] = plane.y();
+		planes.m_c[i] = plane.z();
+		planes.m_d[i] = plane.w();
+	}
+}
+
+void BoundsMath::AddPoints(const float* pPoints, size_t count, size_t stride, QVector3D& min, QVector3D& max)
+{
+	if (count == 0) {
+		return;
+	}
+
+#if defined(BOUNDS_MATH_SSE2) || defined(BOUNDS_MATH_NEON)
+	// Every point but the last is read with the float after it, which is ignored. The last
+	// point may end the array, so it is read on its own.
+	const float* pLast = pPoints + (count - 1) * stride;
+#if defined(BOUNDS_MATH_SSE2)
+	__m128 vMin = Load3(min);
+	__m128 vMax = Load3(max);
+	for (const float* p = pPoints; p < pLast; p += stride) {
+		const __m128 point = _mm_loadu_ps(p);
+		vMin = _mm_min_ps(vMin, point);
+		vMax = _mm_max_ps(vMax, point);
+	}
+	const __m128 last = _mm_set_ps(0.f, pLast[2], pLast[1], pLast[0]);
+	min = Store3(_mm_min_ps(vMin, last));
+	max = Store3(_mm_max_ps(vMax, last));
+#else
+	float32x4_t vMin = Load3(min);
+	float32x4_t vMax = Load3(max);
+	for (const float* p = pPoints; p < pLast; p += stride) {
+		const float32x4_t point = vld1q_f32(p);
+		vMin = vminq_f32(vMin, point);
+		vMax = vmaxq_f32(vMax, point);
+	}
+	const float32x4_t last = Load3(QVector3D(pLast[0], pLast[1], pLast[2]));
+	min = Store3(vminq_f32(vMin, last));
+	max = Store3(vmaxq_f32(vMax, last));
+#endif
+#else
+	for (size_t i = 0; i < count; ++i) {
+		const float* p = pPoints + i * stride;
+		for (int axis = 0; axis < 3; ++axis) {
+			min[axis] = std::min(min[axis], p[axis]);
+			max[axis] = std::max(max[axis], p[axis]);
+		}
+	}
+#endif
+}
+
+void BoundsMath::AddTransformedBox(const QMatrix4x4& transform, const QVector3D& boxMin, const QVector3D& boxMax, QVector3D& min, QVector3D& max)
+{
+	if (boxMin.x() > boxMax.x() || boxMin.y() > boxMax.y() || boxMin.z() > boxMax.z()) {
+		return;
+	}
+
+	if (!IsAffine(transform)) {
+		// The box's shape changes under a projection, only the corners tell its bounds
+		for (int corner = 0; corner < 8; ++corner) {
+			const QVector3D p = transform * QVector3D(corner & 1 ? boxMax.x() : boxMin.x(),
+				corner & 2 ? boxMax.y() : boxMin.y(),
+				corner & 4 ? boxMax.z() : boxMin.z());
+			for (int i = 0; i < 3; ++i) {
+				min[i] = std::min(min[i], p[i]);
+				max[i] = std::max(max[i], p[i]);
+			}
+		}
+		return;
+	}
+
+	// The center moves with the transform, each extent spreads over the absolute values of
+	// its column
+	const QVector3D center = (boxMin + boxMax) * 0.5f;
+	const QVector3D extent = (boxMax - boxMin) * 0.5f;
+	const float* m = transform.constData();
+#if defined(BOUNDS_MATH_SSE2)
+	const __m128 col0 = _mm_loadu_ps(m);
+	const __m128 col1 = _mm_loadu_ps(m + 4);
+	const __m128 col2 = _mm_loadu_ps(m + 8);
+	const __m128 col3 = _mm_loadu_ps(m + 12);
+	const __m128 newCenter = _mm_add_ps(_mm_add_ps(_mm_mul_ps(col0, _mm_set1_ps(center.x())), _mm_mul_ps(col1, _mm_set1_ps(center.y()))),
+		_mm_add_ps(_mm_mul_ps(col2, _mm_set1_ps(center.z())), col3));
+	const __m128 newExtent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Abs(col0), _mm_set1_ps(extent.x())), _mm_mul_ps(Abs(col1), _mm_set1_ps(extent.y()))),
+		_mm_mul_ps(Abs(col2), _mm_set1_ps(extent.z())));
+	min = Store3(_mm_min_ps(Load3(min), _mm_sub_ps(newCenter, newExtent)));
+	max = Store3(_mm_max_ps(Load3(max), _mm_add_ps(newCenter, newExtent)));
+#elif defined(BOUNDS_MATH_NEON)
+	const float32x4_t col0 = vld1q_f32(m);
+	const float32x4_t col1 = vld1q_f32(m + 4);
+	const float32x4_t col2 = vld1q_f32(m + 8);
+	const float32x4_t col3 = vld1q_f32(m + 12);
+	float32x4_t newCenter = vmlaq_n_f32(col3, col0, center.x());
+	newCenter = vmlaq_n_f32(newCenter, col1, center.y());
+	newCenter = vmlaq_n_f32(newCenter, col2, center.z());
+	float32x4_t newExtent = vmulq_n_f32(vabsq_f32(col0), extent.x());
+	newExtent = vmlaq_n_f32(newExtent, vabsq_f32(col1), extent.y());
+	newExtent = vmlaq_n_f32(newExtent, vabsq_f32(col2), extent.z());
+	min = Store3(vminq_f32(Load3(min), vsubq_f32(newCenter, newExtent)));
+	max = Store3(vmaxq_f32(Load3(max), vaddq_f32(newCenter, newExtent)));
+#else
+	for (int i = 0; i < 3; ++i) {
+		const float newCenter = m[i] * center.x() + m[4 + i] * center.y() + m[8 + i] * center.z() + m[12 + i];
+		const float newExtent = std::abs(m[i]) * extent.x() + std::abs(m[4 + i]) * extent.y() + std::abs(m[8 + i]) * extent.z();
+		min[i] = std::min(min[i], newCenter - newExtent);
+		max[i] = std::max(max[i], newCenter + newExtent);
+	}
+#endif
+}
+
+bool BoundsMath::BoxIntersects(const PlaneSet& planes, const QVector3D& min, const QVector3D& max)
+{
+	return MinPlaneDistance(planes, min, max, 1.f) >= 0.f;
+}
+
+bool BoundsMath::BoxInside(const PlaneSet& planes, const QVector3D& min, const QVector3D& max)
+{
+	return MinPlaneDistance(planes, min, max, -1.f) >= 0.f;
+}
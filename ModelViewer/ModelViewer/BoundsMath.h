@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+// Bulk bounding box math shared by loading, culling and the mesh hierarchy. Uses SSE2 on x86
+// and NEON on ARM, with plain C++ everywhere else.
+class BoundsMath
+{
+public:
+	// Planes a x + b y + c z + d, one array per coefficient so 4 planes are tested at a time.
+	// Unused slots hold a plane everything is inside of.
+	struct PlaneSet {
+		static const int k_capacity = 12;
+		alignas(16) float m_a[k_capacity];
+		alignas(16) float m_b[k_capacity];
+		alignas(16) float m_c[k_capacity];
+		alignas(16) float m_d[k_capacity];
+	};
+	static void SetPlanes(const QVector4D* pPlanes, int count, PlaneSet& planes);
+
+	// Grows min and max to contain count points of three floats, stride floats apart
+	static void AddPoints(const float* pPoints, size_t count, size_t stride, QVector3D& min, QVector3D& max);
+
+	// Grows min and max to contain the box from boxMin to boxMax moved by transform. Affine
+	// transforms move the center and extents instead of all eight corners. Empty boxes, with
+	// boxMin above boxMax, add nothing.
+	static void AddTransformedBox(const QMatrix4x4& transform, const QVector3D& boxMin, const QVector3D& boxMax, QVector3D& min, QVector3D& max);
+
+	// False if the box lies entirely outside one of the planes
+	static bool BoxIntersects(const PlaneSet& planes, const QVector3D& min, const QVector3D& max);
+
+	// True if the box lies entirely inside all planes
+	static bool BoxInside(const PlaneSet& planes, const QVector3D& min, const QVector3D& max);
+};
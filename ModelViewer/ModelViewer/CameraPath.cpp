@@ -0,0 +1,188 @@
+#include "CameraPath.h"
+
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+
+#include <algorithm>
+#include <cmath>
+
+
+bool CameraPose::operator==(const CameraPose& other) const
+{
+	return m_rotX == other.m_rotX && m_rotY == other.m_rotY && m_scale == other.m_scale && m_translation == other.m_translation;
+}
+
+bool CameraPose::operator!=(const CameraPose& other) const
+{
+	return !(*this == other);
+}
+
+void CameraPath::Clear()
+{
+	m_keys.clear();
+}
+
+void CameraPath::AddKey(float time, const CameraPose& pose)
+{
+	const auto it = std::upper_bound(m_keys.begin(), m_keys.end(), time, [](float t, const Key& key) { return t < key.m_time; });
+	m_keys.insert(it, { time, pose });
+}
+
+const std::vector<CameraPath::Key>& CameraPath::Keys() const
+{
+	return m_keys;
+}
+
+void CameraPath::Record(float time, const CameraPose& pose)
+{
+	const size_t count = m_keys.size();
+	if (count >= 2 && m_keys[count - 1].m_pose == pose && m_keys[count - 2].m_pose == pose) {
+		m_keys.back().m_time = time;
+		return;
+	}
+	m_keys.push_back({ std::max(time, Duration()), pose });
+}
+
+bool CameraPath::IsEmpty() const
+{
+	return m_keys.empty();
+}
+
+float CameraPath::Duration() const
+{
+	return m_keys.empty() ? 0.f : m_keys.back().m_time;
+}
+
+CameraPose CameraPath::Sample(float time) const
+{
+	if (m_keys.empty()) {
+		return CameraPose();
+	}
+	if (time <= m_keys.front().m_time) {
+		return m_keys.front().m_pose;
+	}
+	if (time >= m_keys.back().m_time) {
+		return m_keys.back().m_pose;
+	}
+
+	const auto next = std::upper_bound(m_keys.begin(), m_keys.end(), time, [](float t, const Key& key) { return t < key.m_time; });
+	const Key& a = *(next - 1);
+	const Key& b = *next;
+	const float span = b.m_time - a.m_time;
+	const float f = span > 0.f ? (time - a.m_time) / span : 1.f;
+
+	CameraPose pose;
+	pose.m_rotX = a.m_pose.m_rotX + (b.m_pose.m_rotX - a.m_pose.m_rotX) * f;
+	pose.m_rotY = a.m_pose.m_rotY + (b.m_pose.m_rotY - a.m_pose.m_rotY) * f;
+	pose.m_scale = a.m_pose.m_scale + (b.m_pose.m_scale - a.m_pose.m_scale) * f;
+	pose.m_translation = a.m_pose.m_translation + (b.m_pose.m_translation - a.m_pose.m_translation) * f;
+	return pose;
+}
+
+bool CameraPath::FromJson(const QJsonArray& keys, const CameraPose& start, CameraPath& path, QString* pError)
+{
+	path.Clear();
+	CameraPose pose = start;
+	for (int i = 0; i < keys.size(); ++i) {
+		const QJsonObject key = keys[i].toObject();
+		if (!key.value("time").isDouble()) {
+			if (pError) {
+				*pError = QString("Key %1 of the camera path has no time").arg(i);
+			}
+			return false;
+		}
+		pose.m_rotX = float(key.value("rotX").toDouble(pose.m_rotX));
+		pose.m_rotY = float(key.value("rotY").toDouble(pose.m_rotY));
+		pose.m_scale = float(key.value("scale").toDouble(pose.m_scale));
+		const QJsonArray translation = key.value("translation").toArray();
+		if (translation.size() == 3) {
+			pose.m_translation = QVector3D(float(translation[0].toDouble()), float(translation[1].toDouble()), float(translation[2].toDouble()));
+		}
+		path.AddKey(float(key.value("time").toDouble()), pose);
+	}
+	return true;
+}
+
+QJsonArray CameraPath::ToJson() const
+{
+	QJsonArray keys;
+	for (const Key& key : m_keys) {
+		QJsonObject object;
+		object.insert("time", key.m_time);
+		object.insert("rotX", key.m_pose.m_rotX);
+		object.insert("rotY", key.m_pose.m_rotY);
+		object.insert("scale", key.m_pose.m_scale);
+		object.insert("translation", QJsonArray{ key.m_pose.m_translation.x(), key.m_pose.m_translation.y(), key.m_pose.m_translation.z() });
+		keys.append(object);
+	}
+	return keys;
+}
+
+bool CameraPath::Save(const QString& filepath) const
+{
+	QFile file(filepath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+	QJsonObject root;
+	root.insert("keys", ToJson());
+	return file.write(QJsonDocument(root).toJson()) > 0;
+}
+
+bool CameraPath::Load(const QString& filepath, QString* pError)
+{
+	QFile file(filepath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		if (pError) {
+			*pError = QString("Could not open %1").arg(filepath);
+		}
+		return false;
+	}
+	QJsonParseError parseError;
+	const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+	if (!document.isObject()) {
+		if (pError) {
+			*pError = QString("%1 is not a camera path: %2").arg(filepath, parseError.errorString());
+		}
+		return false;
+	}
+	return FromJson(document.object().value("keys").toArray(), CameraPose(), *this, pError);
+}
+
+int CameraPath::FrameCount(float step) const
+{
+	if (m_keys.empty() || step <= 0.f) {
+		return 0;
+	}
+	return int(std::floor(Duration() / step)) + 1;
+}
+
+CameraPath CameraPath::Turntable(const CameraPose& start, float seconds)
+{
+	CameraPose end = start;
+	end.m_rotX += 360.f;
+	CameraPath path;
+	path.AddKey(0.f, start);
+	path.AddKey(std::max(seconds, 0.f), end);
+	return path;
+}
+
+bool CameraPath::SaveTimings(const QString& filepath, const std::vector<PlaybackFrame>& frames)
+{
+	QFile file(filepath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text)) {
+		return false;
+	}
+	QTextStream stream(&file);
+	stream << "frame,time,cpu_ms,gpu_ms\n";
+	for (const PlaybackFrame& frame : frames) {
+		stream << frame.m_frame << ',' << frame.m_time << ',' << frame.m_cpuSeconds * 1000.f << ',';
+		if (frame.m_gpuSeconds >= 0.f) {
+			stream << frame.m_gpuSeconds * 1000.f;
+		}
+		stream << '\n';
+	}
+	return stream.status() == QTextStream::Ok;
+}
@@ -0,0 +1,78 @@
+#pragma once
+#include <QJsonArray>
+#include <QString>
+#include <QVector3D>
+
+#include <vector>
+
+// Where the view is, as the mouse and keys leave it: the orbit angles in degrees, the uniform
+// scale of the model and the offset of the view
+struct CameraPose {
+	float m_rotX = 0.f;
+	float m_rotY = 0.f;
+	float m_scale = 1.f;
+	QVector3D m_translation;
+
+	bool operator==(const CameraPose& other) const;
+	bool operator!=(const CameraPose& other) const;
+};
+
+// What one frame of a played back path took. The GPU time comes in a few frames later, it is
+// -1 if it never did or the GPU can't time frames.
+struct PlaybackFrame {
+	int m_frame = 0;
+	float m_time = 0.f;
+	float m_cpuSeconds = 0.f;
+	float m_gpuSeconds = -1.f;
+};
+
+// Poses of the view at times in seconds. Between two keys the pose is interpolated linearly,
+// so a key going from 0 to 360 degrees turns the model around once.
+class CameraPath
+{
+public:
+	struct Key {
+		float m_time = 0.f;
+		CameraPose m_pose;
+	};
+
+	void Clear();
+
+	// Keys are kept in the order of their times
+	void AddKey(float time, const CameraPose& pose);
+	const std::vector<Key>& Keys() const;
+
+	// Adds a key after the last one for recording. A pose that is held keeps only its first and
+	// last key, so the path stays still for as long as the camera did.
+	void Record(float time, const CameraPose& pose);
+
+	bool IsEmpty() const;
+
+	// Time of the last key
+	float Duration() const;
+
+	// Before the first key and after the last, the pose of that key
+	CameraPose Sample(float time) const;
+
+	// A JSON array of objects with "time", "rotX", "rotY", "scale" and "translation" as [x, y, z].
+	// A key that leaves a value out keeps the one of the key before it, the first key the one of
+	// start. Returns false with pError set if a key has no time.
+	static bool FromJson(const QJsonArray& keys, const CameraPose& start, CameraPath& path, QString* pError = nullptr);
+	QJsonArray ToJson() const;
+
+	// A JSON file with the keys in "keys"
+	bool Save(const QString& filepath) const;
+	bool Load(const QString& filepath, QString* pError = nullptr);
+
+	// Frames to play at a fixed step, the first at time 0 and the last at the end or just before
+	int FrameCount(float step) const;
+
+	// One turn around the model from start over seconds, for turntable videos
+	static CameraPath Turntable(const CameraPose& start, float seconds);
+
+	// A CSV file of the timings with a line per frame, in milliseconds
+	static bool SaveTimings(const QString& filepath, const std::vector<PlaybackFrame>& frames);
+
+private:
+	std::vector<Key> m_keys;
+};
@@ -0,0 +1,170 @@
+#include "CompressedTexture.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <algorithm>
+
+
+namespace {
+
+quint32 ReadU32(const QByteArray& data, int offset)
+{
+	return qFromLittleEndian<quint32>(reinterpret_cast<const uchar*>(data.constData() + offset));
+}
+
+// Splits tightly packed 4x4 block data into mip levels, as stored in DDS files
+bool ReadBlockLevels(CompressedImage& image, const QByteArray& data, int offset, int levelCount, int blockBytes)
+{
+	int width = image.m_size.width();
+	int height = image.m_size.height();
+	for (int level = 0; level < levelCount; ++level) {
+		const int size = std::max(1, (width + 3) / 4) * std::max(1, (height + 3) / 4) * blockBytes;
+		if (offset + size > data.size()) {
+			// Keep the levels that are complete
+			break;
+		}
+		image.m_levels.push_back(data.mid(offset, size));
+		offset += size;
+		width = std::max(1, width / 2);
+		height = std::max(1, height / 2);
+	}
+	return !image.m_levels.empty();
+}
+
+CompressedImage ReadDds(const QByteArray& data)
+{
+	CompressedImage image;
+	if (data.size() < 128 || !data.startsWith("DDS ")) {
+		return image;
+	}
+
+	// Cube maps and volume textures are not used by the viewer
+	const quint32 flags = ReadU32(data, 8);
+	const quint32 pixelFlags = ReadU32(data, 80);
+	const quint32 caps2 = ReadU32(data, 112);
+	if (!(pixelFlags & 0x4) || caps2 != 0) {
+		return image;
+	}
+
+	image.m_size = QSize(int(ReadU32(data, 16)), int(ReadU32(data, 12)));
+	const int levelCount = (flags & 0x20000) ? std::max(1, int(ReadU32(data, 28))) : 1;
+
+	int offset = 128;
+	int blockBytes = 16;
+	const QByteArray fourCC = data.mid(84, 4);
+	if (fourCC == "DXT1") {
+		image.m_format = QOpenGLTexture::RGBA_DXT1;
+		blockBytes = 8;
+	}
+	else if (fourCC == "DXT3") {
+		image.m_format = QOpenGLTexture::RGBA_DXT3;
+	}
+	else if (fourCC == "DXT5") {
+		image.m_format = QOpenGLTexture::RGBA_DXT5;
+	}
+	else if (fourCC == "ATI1" || fourCC == "BC4U") {
+		image.m_format = QOpenGLTexture::R_ATI1N_UNorm;
+		blockBytes = 8;
+	}
+	else if (fourCC == "ATI2" || fourCC == "BC5U") {
+		image.m_format = QOpenGLTexture::RG_ATI2N_UNorm;
+	}
+	else if (fourCC == "DX10" && data.size() >= 148) {
+		// The extended header names the format with its DXGI_FORMAT value
+		offset = 148;
+		switch (ReadU32(data, 128)) {
+		case 71: image.m_format = QOpenGLTexture::RGBA_DXT1; blockBytes = 8; break;
+		case 72: image.m_format = QOpenGLTexture::SRGB_Alpha_DXT1; blockBytes = 8; break;
+		case 74: image.m_format = QOpenGLTexture::RGBA_DXT3; break;
+		case 75: image.m_format = QOpenGLTexture::SRGB_Alpha_DXT3; break;
+		case 77: image.m_format = QOpenGLTexture::RGBA_DXT5; break;
+		case 78: image.m_format = QOpenGLTexture::SRGB_Alpha_DXT5; break;
+		case 80: image.m_format = QOpenGLTexture::R_ATI1N_UNorm; blockBytes = 8; break;
+		case 81: image.m_format = QOpenGLTexture::R_ATI1N_SNorm; blockBytes = 8; break;
+		case 83: image.m_format = QOpenGLTexture::RG_ATI2N_UNorm; break;
+		case 84: image.m_format = QOpenGLTexture::RG_ATI2N_SNorm; break;
+		case 95: image.m_format = QOpenGLTexture::RGB_BP_UNSIGNED_FLOAT; break;
+		case 96: image.m_format = QOpenGLTexture::RGB_BP_SIGNED_FLOAT; break;
+		case 98: image.m_format = QOpenGLTexture::RGB_BP_UNorm; break;
+		case 99: image.m_format = QOpenGLTexture::SRGB_BP_UNorm; break;
+		default: break;
+		}
+	}
+
+	if (image.m_format == QOpenGLTexture::NoFormat || image.m_size.isEmpty()
+		|| !ReadBlockLevels(image, data, offset, levelCount, blockBytes)) {
+		return CompressedImage();
+	}
+	return image;
+}
+
+CompressedImage ReadKtx(const QByteArray& data)
+{
+	static const char identifier[12] = { '\xAB', 'K', 'T', 'X', ' ', '1', '1', '\xBB', '\r', '\n', '\x1A', '\n' };
+
+	CompressedImage image;
+	if (data.size() < 64 || !data.startsWith(QByteArray(identifier, sizeof(identifier)))) {
+		return image;
+	}
+
+	// Only little endian files holding a single compressed 2D image are supported. A glType
+	// of 0 marks compressed data, in which case glInternalFormat is the compressed format.
+	const quint32 endianness = ReadU32(data, 12);
+	const quint32 glType = ReadU32(data, 16);
+	const quint32 depth = ReadU32(data, 44);
+	const quint32 arrayElements = ReadU32(data, 48);
+	const quint32 faces = ReadU32(data, 52);
+	if (endianness != 0x04030201 || glType != 0 || depth > 1 || arrayElements > 1 || faces != 1) {
+		return image;
+	}
+	image.m_format = QOpenGLTexture::TextureFormat(ReadU32(data, 28));
+	image.m_size = QSize(int(ReadU32(data, 36)), int(ReadU32(data, 40)));
+	const int levelCount = std::max(1, int(ReadU32(data, 56)));
+	if (image.m_size.isEmpty()) {
+		return CompressedImage();
+	}
+
+	// Every level is prefixed with its size and padded to 4 bytes
+	int offset = 64 + int(ReadU32(data, 60));
+	for (int level = 0; level < levelCount && offset + 4 <= data.size(); ++level) {
+		const int size = int(ReadU32(data, offset));
+		offset += 4;
+		if (size <= 0 || offset + size > data.size()) {
+			break;
+		}
+		image.m_levels.push_back(data.mid(offset, size));
+		offset += (size + 3) & ~3;
+	}
+
+	if (image.isNull()) {
+		return CompressedImage();
+	}
+	return image;
+}
+
+}
+
+bool IsCompressedTextureFile(const QString& path)
+{
+	const QString suffix = QFileInfo(path).suffix().toLower();
+	return suffix == "dds" || suffix == "ktx";
+}
+
+CompressedImage ReadCompressedTexture(const QString& path)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return CompressedImage();
+	}
+	return ReadCompressedTexture(path, file.readAll());
+}
+
+CompressedImage ReadCompressedTexture(const QString& path, const QByteArray& data)
+{
+	if (QFileInfo(path).suffix().toLower() == "ktx") {
+		return ReadKtx(data);
+	}
+	return ReadDds(data);
+}
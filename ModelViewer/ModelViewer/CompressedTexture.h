@@ -0,0 +1,30 @@
+#pragma once
+#include <vector>
+
+#include <QByteArray>
+#include <QOpenGLTexture>
+#include <QSize>
+#include <QString>
+
+// A block compressed texture with its mip chain, read from a DDS or KTX file and uploaded as is.
+// Block compressed data can't be mirrored cheaply, so these files are expected to already use
+// the OpenGL bottom-left origin.
+struct CompressedImage {
+	QOpenGLTexture::TextureFormat m_format = QOpenGLTexture::NoFormat;
+	QSize m_size;
+
+	// One entry per mip level, starting with the full size image
+	std::vector<QByteArray> m_levels;
+
+	bool isNull() const { return m_levels.empty(); }
+};
+
+// True for the file suffixes ReadCompressedTexture understands
+bool IsCompressedTextureFile(const QString& path);
+
+// Reads BC1 to BC7 from DDS files, and any compressed format, such as ASTC, from KTX 1 files.
+// Returns a null image for uncompressed or unsupported files.
+CompressedImage ReadCompressedTexture(const QString& path);
+
+// The same for the contents of a file read some other way, path only tells the format
+CompressedImage ReadCompressedTexture(const QString& path, const QByteArray& data);
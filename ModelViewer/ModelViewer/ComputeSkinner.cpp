@@ -0,0 +1,305 @@
+#include "ComputeSkinner.h"
+#include "GeometryStreamer.h"
+#include "GpuModelBuilder.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+// Reads the mesh's own vertices as words, so every layout the loader writes can be decoded.
+// uOffsets are where the position, normal, bone indices and bone weights of vertex 0 start and
+// uSteps how far apart vertices are for each, both in words. The bone palette is declared above
+// main when the program is created.
+const char* k_skinShaderSource =
+	"#version 430\n"
+	"layout(local_size_x = 64) in;\n"
+	"layout(std430, binding = 0) readonly buffer Source {\n"
+	"   uint source[];\n"
+	"};\n"
+	"layout(std430, binding = 1) readonly buffer Morphs {\n"
+	"   vec4 morphs[];\n"
+	"};\n"
+	"layout(std430, binding = 2) writeonly buffer Skinned {\n"
+	"   vec4 skinned[];\n"
+	"};\n"
+	"uniform uint uVertexCount;\n"
+	"uniform uvec4 uOffsets;\n"
+	"uniform uvec4 uSteps;\n"
+	"uniform int uNormalType;\n"
+	"uniform int uTargetCount;\n"
+	"uniform int uTargets[16];\n"
+	"uniform float uWeights[16];\n"
+	"float Snorm10(uint bits) {\n"
+	"   return max(float(int(bits << 22) >> 22) / 511., -1.);\n"
+	"}\n"
+	"vec3 Fetch3(uint word) {\n"
+	"   return vec3(uintBitsToFloat(source[word]), uintBitsToFloat(source[word + 1u]), uintBitsToFloat(source[word + 2u]));\n"
+	"}\n"
+	"void main() {\n"
+	"   uint v = gl_GlobalInvocationID.x;\n"
+	"   if (v >= uVertexCount) {\n"
+	"      return;\n"
+	"   }\n"
+	"   vec3 position = Fetch3(uOffsets.x + v * uSteps.x);\n"
+	"   vec3 normal = vec3(0.);\n"
+	"   if (uNormalType == 1) {\n"
+	"      normal = Fetch3(uOffsets.y + v * uSteps.y);\n"
+	"   }\n"
+	"   else if (uNormalType == 2) {\n"
+	"      uint bits = source[uOffsets.y + v * uSteps.y];\n"
+	"      normal = vec3(Snorm10(bits), Snorm10(bits >> 10), Snorm10(bits >> 20));\n"
+	"   }\n"
+	"   for (int t = 0; t < uTargetCount; ++t) {\n"
+	"      uint morph = (uint(uTargets[t]) * uVertexCount + v) * 2u;\n"
+	"      position += morphs[morph].xyz * uWeights[t];\n"
+	"      normal += morphs[morph + 1u].xyz * uWeights[t];\n"
+	"   }\n"
+	"   uvec4 shifts = uvec4(0u, 8u, 16u, 24u);\n"
+	"   uvec4 index = (uvec4(source[uOffsets.z + v * uSteps.z]) >> shifts) & 0xFFu;\n"
+	"   vec4 weight = vec4((uvec4(source[uOffsets.w + v * uSteps.z]) >> shifts) & 0xFFu) / 255.;\n"
+	"   mat4 skin = uBones[index.x] * weight.x + uBones[index.y] * weight.y + uBones[index.z] * weight.z + uBones[index.w] * weight.w;\n"
+	"   normal = mat3(skin) * normal;\n"
+	"   skinned[2u * v] = vec4((skin * vec4(position, 1.)).xyz, 1.);\n"
+	"   skinned[2u * v + 1u] = vec4(dot(normal, normal) > 0. ? normalize(normal) : normal, 0.);\n"
+	"}\n";
+
+const GLuint k_skinGroupSize = 64;
+static_assert(ComputeSkinner::k_maxActiveTargets == 16, "The skinning shader's target arrays have to match the limit");
+
+// Storage buffer bindings of the shader above
+const GLuint k_sourceBinding = 0;
+const GLuint k_morphBinding = 1;
+const GLuint k_skinnedBinding = 2;
+
+// Vertices of separate attribute blocks are as far apart as the attribute is large
+int Step(const Mesh& mesh, int size)
+{
+	return (mesh.m_vertexStride > 0 ? mesh.m_vertexStride : size) / int(sizeof(GLuint));
+}
+
+}
+
+ComputeSkinner::~ComputeSkinner()
+{
+	// The buffers go with the context, only the program is left
+	delete m_pProgram;
+}
+
+bool ComputeSkinner::Create()
+{
+	Destroy();
+
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(4, 3)) {
+		return false;
+	}
+	m_pFunctions = pContext->versionFunctions<QOpenGLFunctions_4_3_Core>();
+	if (!m_pFunctions || !m_pFunctions->initializeOpenGLFunctions()) {
+		m_pFunctions = nullptr;
+		return false;
+	}
+
+	// The bone palette is the block the skinning shaders declare, so meshes keep one buffer
+	QByteArray source(k_skinShaderSource);
+	source.insert(source.indexOf('\n') + 1, UniformBlocks::k_boneDeclaration);
+	m_pProgram = new QOpenGLShaderProgram();
+	if (!m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Compute, source) || !m_pProgram->link()
+		|| !UniformBlocks::BindBlock(m_pProgram, "BonePalette", k_bonePaletteBinding)) {
+		qWarning("Could not link the skinning shader: %s", qPrintable(m_pProgram->log()));
+		Destroy();
+		return false;
+	}
+	m_vertexCountUniform = m_pProgram->uniformLocation("uVertexCount");
+	m_offsetsUniform = m_pProgram->uniformLocation("uOffsets");
+	m_stepsUniform = m_pProgram->uniformLocation("uSteps");
+	m_normalTypeUniform = m_pProgram->uniformLocation("uNormalType");
+	m_targetCountUniform = m_pProgram->uniformLocation("uTargetCount");
+	m_targetsUniform = m_pProgram->uniformLocation("uTargets");
+	m_weightsUniform = m_pProgram->uniformLocation("uWeights");
+	m_created = true;
+	return true;
+}
+
+void ComputeSkinner::Destroy()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		DeleteBuffers();
+	}
+	delete m_pProgram;
+	m_pProgram = nullptr;
+	m_entries.clear();
+	m_bytes = 0;
+	m_pFunctions = nullptr;
+	m_created = false;
+	m_built = false;
+}
+
+bool ComputeSkinner::IsCreated() const
+{
+	return m_created;
+}
+
+void ComputeSkinner::Build(Model& model)
+{
+	Clear(model);
+	if (!m_created || model.m_streamer) {
+		return;
+	}
+	QOpenGLFunctions_4_3_Core* f = m_pFunctions;
+	QOpenGLFunctions* pFunctions = QOpenGLContext::currentContext()->functions();
+
+	for (int meshIdx = 0; meshIdx < int(model.m_meshes.size()); ++meshIdx) {
+		Mesh& mesh = model.m_meshes[meshIdx];
+		if (!mesh.m_hasBones || !mesh.m_boneBuffer.isCreated() || !mesh.m_vao || !mesh.m_instanceTransforms.empty()
+			|| !GeometryStreamer::IsResident(mesh) || mesh.m_positionType != GL_FLOAT) {
+			continue;
+		}
+		Entry entry;
+		entry.m_mesh = meshIdx;
+		entry.m_sourceVao = mesh.m_vao;
+		entry.m_sourceBaseVertex = mesh.m_baseVertex;
+		f->glGenBuffers(1, &entry.m_buffer);
+		f->glBindBuffer(GL_ARRAY_BUFFER, entry.m_buffer);
+		f->glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(mesh.m_vertexCount) * k_skinnedStride, nullptr, GL_DYNAMIC_COPY);
+		m_bytes += qint64(mesh.m_vertexCount) * k_skinnedStride;
+
+		// UVs and colors stay in the mesh's buffer, moved to where its vertices start there, so
+		// the skinned mesh is drawn from vertex 0 of both buffers
+		Mesh layout = mesh;
+		layout.m_hasBones = false;
+		if (mesh.m_vertexStride > 0) {
+			const size_t start = size_t(mesh.m_baseVertex) * size_t(mesh.m_vertexStride);
+			layout.m_uvOffset += start;
+			layout.m_colorOffset += start;
+		}
+		entry.m_vao.reset(new QOpenGLVertexArrayObject());
+		entry.m_vao->create();
+		entry.m_vao->bind();
+		mesh.m_vertexBuffer.bind();
+		mesh.m_indexBuffer.bind();
+		GpuModelBuilder::EnableAttributes(pFunctions, layout);
+
+		// Positions and normals come from the skinned buffer instead
+		f->glBindBuffer(GL_ARRAY_BUFFER, entry.m_buffer);
+		f->glVertexAttribPointer(k_positionLocation, 4, GL_FLOAT, GL_FALSE, k_skinnedStride, nullptr);
+		if (mesh.m_hasNormals) {
+			f->glVertexAttribPointer(k_normalLocation, 3, GL_FLOAT, GL_FALSE, k_skinnedStride, reinterpret_cast<void*>(4 * sizeof(GLfloat)));
+		}
+		entry.m_vao->release();
+		f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		mesh.m_vao = entry.m_vao;
+		mesh.m_baseVertex = 0;
+		mesh.m_computeSkinned = true;
+		m_entries.push_back(entry);
+	}
+	m_built = true;
+}
+
+void ComputeSkinner::Clear(Model& model)
+{
+	for (const Entry& entry : m_entries) {
+		if (entry.m_mesh < int(model.m_meshes.size()) && model.m_meshes[entry.m_mesh].m_vao == entry.m_vao) {
+			Mesh& mesh = model.m_meshes[entry.m_mesh];
+			mesh.m_vao = entry.m_sourceVao;
+			mesh.m_baseVertex = entry.m_sourceBaseVertex;
+			mesh.m_computeSkinned = false;
+		}
+	}
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		DeleteBuffers();
+	}
+	m_entries.clear();
+	m_bytes = 0;
+	m_built = false;
+}
+
+bool ComputeSkinner::IsBuilt() const
+{
+	return m_built;
+}
+
+void ComputeSkinner::Skin(const Model& model)
+{
+	if (!m_built || m_entries.empty()) {
+		return;
+	}
+	QOpenGLFunctions_4_3_Core* f = m_pFunctions;
+	m_pProgram->bind();
+	for (const Entry& entry : m_entries) {
+		const Mesh& mesh = model.m_meshes[entry.m_mesh];
+		const GLuint base = GLuint(entry.m_sourceBaseVertex) * GLuint(mesh.m_vertexStride) / sizeof(GLuint);
+		const int normalSize = mesh.m_normalType == GL_FLOAT ? 3 * sizeof(GLfloat) : sizeof(GLuint);
+		f->glUniform4ui(m_offsetsUniform, base + GLuint(mesh.m_positionOffset / sizeof(GLuint)), base + GLuint(mesh.m_normalOffset / sizeof(GLuint)),
+			base + GLuint(mesh.m_boneIndexOffset / sizeof(GLuint)), base + GLuint(mesh.m_boneWeightOffset / sizeof(GLuint)));
+		f->glUniform4ui(m_stepsUniform, Step(mesh, mesh.m_numPositionComponents * sizeof(GLfloat)), Step(mesh, normalSize), Step(mesh, sizeof(GLuint)), 0);
+		m_pProgram->setUniformValue(m_vertexCountUniform, GLuint(mesh.m_vertexCount));
+		m_pProgram->setUniformValue(m_normalTypeUniform, !mesh.m_hasNormals ? 0 : mesh.m_normalType == GL_FLOAT ? 1 : 2);
+
+		// Targets without a weight are skipped rather than added as nothing
+		const std::vector<std::pair<int, float>> targets = mesh.m_morphBuffer.isCreated() ? ActiveTargets(mesh.m_morphWeights) : std::vector<std::pair<int, float>>();
+		GLint targetIndices[k_maxActiveTargets] = {};
+		GLfloat targetWeights[k_maxActiveTargets] = {};
+		for (size_t i = 0; i < targets.size(); ++i) {
+			targetIndices[i] = targets[i].first;
+			targetWeights[i] = targets[i].second;
+		}
+		m_pProgram->setUniformValue(m_targetCountUniform, int(targets.size()));
+		m_pProgram->setUniformValueArray(m_targetsUniform, targetIndices, k_maxActiveTargets);
+		m_pProgram->setUniformValueArray(m_weightsUniform, targetWeights, k_maxActiveTargets, 1);
+
+		f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, k_sourceBinding, mesh.m_vertexBuffer.bufferId());
+		f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, k_morphBinding, mesh.m_morphBuffer.isCreated() ? mesh.m_morphBuffer.bufferId() : 0);
+		f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, k_skinnedBinding, entry.m_buffer);
+		f->glBindBufferBase(GL_UNIFORM_BUFFER, k_bonePaletteBinding, mesh.m_boneBuffer.bufferId());
+		f->glDispatchCompute((GLuint(mesh.m_vertexCount) + k_skinGroupSize - 1) / k_skinGroupSize, 1, 1);
+	}
+	for (GLuint binding : { k_sourceBinding, k_morphBinding, k_skinnedBinding }) {
+		f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, binding, 0);
+	}
+	m_pProgram->release();
+
+	// The vertex fetch of every later draw reads what was written
+	f->glMemoryBarrier(GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+qint64 ComputeSkinner::Bytes() const
+{
+	return m_bytes;
+}
+
+std::vector<std::pair<int, float>> ComputeSkinner::ActiveTargets(const std::vector<float>& weights)
+{
+	std::vector<std::pair<int, float>> targets;
+	for (size_t i = 0; i < weights.size(); ++i) {
+		if (weights[i] != 0.f) {
+			targets.push_back({ int(i), weights[i] });
+		}
+	}
+	if (targets.size() > size_t(k_maxActiveTargets)) {
+		std::partial_sort(targets.begin(), targets.begin() + k_maxActiveTargets, targets.end(), [](const std::pair<int, float>& a, const std::pair<int, float>& b) {
+			return std::abs(a.second) > std::abs(b.second);
+		});
+		targets.resize(k_maxActiveTargets);
+	}
+	return targets;
+}
+
+void ComputeSkinner::DeleteBuffers()
+{
+	for (Entry& entry : m_entries) {
+		if (entry.m_vao) {
+			entry.m_vao->destroy();
+		}
+		m_pFunctions->glDeleteBuffers(1, &entry.m_buffer);
+	}
+}
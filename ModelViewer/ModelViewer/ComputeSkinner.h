@@ -0,0 +1,83 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+#include <QSharedPointer>
+#include <qopengl.h>
+
+#include "ModelLoader.h"
+
+class QOpenGLFunctions_4_3_Core;
+class QOpenGLShaderProgram;
+class QOpenGLVertexArrayObject;
+
+// Poses the skinned meshes of a model with a compute shader on OpenGL 4.3. Each mesh gets a
+// buffer of its own that Skin writes the posed positions and normals into, blend shapes first
+// and bones after. Every pass that draws the mesh afterwards, the depth pre-pass and picking
+// included, reads that buffer instead of skinning each vertex again, and blend shapes are only
+// shown this way. Instanced meshes and the meshes of streamed models are left to the shaders.
+class ComputeSkinner
+{
+public:
+	// Blend shapes Skin adds to a mesh, the ones with the largest weights
+	static const int k_maxActiveTargets = 16;
+
+	~ComputeSkinner();
+
+	// Creating and destroying the program and buffers requires the context they are used in to
+	// be current. Create returns false without OpenGL 4.3, the meshes are then skinned by the
+	// shaders. Destroy leaves the meshes Build took pointing at nothing, Clear gives them back.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Points the vertex array object of every skinned mesh of model at a buffer of its own,
+	// which Skin has to fill before the mesh is drawn. Replaces what the last Build took.
+	void Build(Model& model);
+
+	// Gives the meshes Build took their own vertex array objects back. model has to be the one
+	// Build was given.
+	void Clear(Model& model);
+	bool IsBuilt() const;
+
+	// Poses the meshes Build took with their bone palettes and blend shape weights, once for
+	// every pass drawn until the next pose
+	void Skin(const Model& model);
+
+	// GPU memory taken by the skinned vertices
+	qint64 Bytes() const;
+
+	// The targets Skin adds for weights, as pairs of target and weight. Targets with no weight
+	// are left out, and only the k_maxActiveTargets largest are kept.
+	static std::vector<std::pair<int, float>> ActiveTargets(const std::vector<float>& weights);
+
+private:
+	// A vec4 position and a vec4 normal
+	static const int k_skinnedStride = 32;
+
+	// A mesh Build took, and what it had before
+	struct Entry {
+		int m_mesh = -1;
+		GLuint m_buffer = 0;
+		QSharedPointer<QOpenGLVertexArrayObject> m_vao;
+		QSharedPointer<QOpenGLVertexArrayObject> m_sourceVao;
+		GLint m_sourceBaseVertex = 0;
+	};
+
+	void DeleteBuffers();
+
+	QOpenGLFunctions_4_3_Core* m_pFunctions = nullptr;
+	QOpenGLShaderProgram* m_pProgram = nullptr;
+	GLint m_vertexCountUniform = -1;
+	GLint m_offsetsUniform = -1;
+	GLint m_stepsUniform = -1;
+	GLint m_normalTypeUniform = -1;
+	GLint m_targetCountUniform = -1;
+	GLint m_targetsUniform = -1;
+	GLint m_weightsUniform = -1;
+	bool m_created = false;
+
+	std::vector<Entry> m_entries;
+	qint64 m_bytes = 0;
+	bool m_built = false;
+};
@@ -0,0 +1,640 @@
+#include "EnvironmentLighting.h"
+#include "StreamBuffer.h"
+#include "UniformBlocks.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+const quint32 k_cacheMagic = 0x4D56454E; // "MVEN"
+
+// Texels of an RGBA half float map
+const int k_texelBytes = 8;
+
+// A triangle covering the target, the texel's place in the map comes out as uv
+const char* k_prefilterVertexShaderSource =
+	"#version 330\n"
+	"out vec2 uv;\n"
+	"void main() {\n"
+	"   uv = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+	"   gl_Position = vec4(uv * 2.0 - 1.0, 0.0, 1.0);\n"
+	"}\n";
+
+// Directions and equirectangular coordinates, v runs from straight up to straight down. Has to
+// match EquirectUv in UniformBlocks::k_environmentDeclaration.
+const char* k_prefilterCommonSource =
+	"#version 330\n"
+	"const float PI = 3.14159265359;\n"
+	"in vec2 uv;\n"
+	"out vec4 fragColor;\n"
+	"uniform sampler2D uSource;\n"
+	"vec3 Direction(vec2 p) {\n"
+	"   float phi = (p.x - 0.5) * 2.0 * PI;\n"
+	"   float theta = p.y * PI;\n"
+	"   return vec3(cos(phi) * sin(theta), cos(theta), sin(phi) * sin(theta));\n"
+	"}\n"
+	"vec2 EquirectUv(vec3 d) {\n"
+	"   return vec2(atan(d.z, d.x) / (2.0 * PI) + 0.5, acos(clamp(d.y, -1.0, 1.0)) / PI);\n"
+	"}\n"
+	"float RadicalInverse(uint bits) {\n"
+	"   bits = (bits << 16u) | (bits >> 16u);\n"
+	"   bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);\n"
+	"   bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);\n"
+	"   bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);\n"
+	"   bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);\n"
+	"   return float(bits) * 2.3283064365386963e-10;\n"
+	"}\n"
+	"vec2 Hammersley(uint i, uint count) {\n"
+	"   return vec2(float(i) / float(count), RadicalInverse(i));\n"
+	"}\n"
+	"vec3 SampleGgx(vec2 xi, vec3 n, float roughness) {\n"
+	"   float a = roughness * roughness;\n"
+	"   float phi = 2.0 * PI * xi.x;\n"
+	"   float cosTheta = sqrt((1.0 - xi.y) / (1.0 + (a * a - 1.0) * xi.y));\n"
+	"   float sinTheta = sqrt(1.0 - cosTheta * cosTheta);\n"
+	"   vec3 up = abs(n.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);\n"
+	"   vec3 tangent = normalize(cross(up, n));\n"
+	"   vec3 bitangent = cross(n, tangent);\n"
+	"   return normalize(tangent * cos(phi) * sinTheta + bitangent * sin(phi) * sinTheta + n * cosTheta);\n"
+	"}\n";
+
+// Cosine weighted light over the hemisphere around each direction, sampled from a level of the
+// source about as coarse as the steps
+const char* k_irradianceShaderSource =
+	"uniform float uSourceLod;\n"
+	"void main() {\n"
+	"   vec3 n = Direction(uv);\n"
+	"   vec3 up = abs(n.y) < 0.999 ? vec3(0.0, 1.0, 0.0) : vec3(1.0, 0.0, 0.0);\n"
+	"   vec3 right = normalize(cross(up, n));\n"
+	"   up = cross(n, right);\n"
+	"   vec3 sum = vec3(0.0);\n"
+	"   float count = 0.0;\n"
+	"   for (float phi = 0.0; phi < 2.0 * PI; phi += 0.05) {\n"
+	"      for (float theta = 0.0; theta < 0.5 * PI; theta += 0.05) {\n"
+	"         vec3 t = vec3(sin(theta) * cos(phi), sin(theta) * sin(phi), cos(theta));\n"
+	"         vec3 d = t.x * right + t.y * up + t.z * n;\n"
+	"         sum += textureLod(uSource, EquirectUv(d), uSourceLod).rgb * cos(theta) * sin(theta);\n"
+	"         count += 1.0;\n"
+	"      }\n"
+	"   }\n"
+	"   fragColor = vec4(PI * sum / count, 1.0);\n"
+	"}\n";
+
+// The environment seen in a mirror direction off a surface of uRoughness, importance sampled
+// from the GGX distribution. Each sample reads a level of the source as wide as its share of
+// the lobe, which keeps a few hundred samples from speckling.
+const char* k_specularShaderSource =
+	"uniform float uRoughness;\n"
+	"uniform float uSourceTexels;\n"
+	"void main() {\n"
+	"   vec3 n = Direction(uv);\n"
+	"   const uint k_samples = 512u;\n"
+	"   vec3 sum = vec3(0.0);\n"
+	"   float weight = 0.0;\n"
+	"   for (uint i = 0u; i < k_samples; ++i) {\n"
+	"      vec3 h = SampleGgx(Hammersley(i, k_samples), n, uRoughness);\n"
+	"      vec3 l = normalize(2.0 * dot(n, h) * h - n);\n"
+	"      float nl = dot(n, l);\n"
+	"      if (nl > 0.0) {\n"
+	"         float nh = max(dot(n, h), 0.0);\n"
+	"         float a2 = uRoughness * uRoughness * uRoughness * uRoughness;\n"
+	"         float denominator = nh * nh * (a2 - 1.0) + 1.0;\n"
+	"         float pdf = a2 / (PI * denominator * denominator) / 4.0 + 1e-4;\n"
+	"         float sampleAngle = 1.0 / (float(k_samples) * pdf + 1e-4);\n"
+	"         float texelAngle = 4.0 * PI / uSourceTexels;\n"
+	"         float lod = uRoughness == 0.0 ? 0.0 : max(0.5 * log2(sampleAngle / texelAngle), 0.0);\n"
+	"         sum += textureLod(uSource, EquirectUv(l), lod).rgb * nl;\n"
+	"         weight += nl;\n"
+	"      }\n"
+	"   }\n"
+	"   fragColor = vec4(sum / max(weight, 1e-4), 1.0);\n"
+	"}\n";
+
+// Scale and bias of the specular color for uv.x = cos(normal, eye) and uv.y = roughness
+const char* k_brdfShaderSource =
+	"float Geometry(float cosine, float roughness) {\n"
+	"   float k = roughness * roughness / 2.0;\n"
+	"   return cosine / (cosine * (1.0 - k) + k);\n"
+	"}\n"
+	"void main() {\n"
+	"   float nv = max(uv.x, 1e-3);\n"
+	"   float roughness = uv.y;\n"
+	"   vec3 v = vec3(sqrt(1.0 - nv * nv), 0.0, nv);\n"
+	"   vec3 n = vec3(0.0, 0.0, 1.0);\n"
+	"   const uint k_samples = 512u;\n"
+	"   float scale = 0.0;\n"
+	"   float bias = 0.0;\n"
+	"   for (uint i = 0u; i < k_samples; ++i) {\n"
+	"      vec3 h = SampleGgx(Hammersley(i, k_samples), n, roughness);\n"
+	"      vec3 l = normalize(2.0 * dot(v, h) * h - v);\n"
+	"      float nl = max(l.z, 0.0);\n"
+	"      float nh = max(h.z, 0.0);\n"
+	"      float vh = max(dot(v, h), 0.0);\n"
+	"      if (nl > 0.0) {\n"
+	"         float g = Geometry(nl, roughness) * Geometry(nv, roughness);\n"
+	"         float visibility = g * vh / (nh * nv);\n"
+	"         float fresnel = pow(1.0 - vh, 5.0);\n"
+	"         scale += (1.0 - fresnel) * visibility;\n"
+	"         bias += fresnel * visibility;\n"
+	"      }\n"
+	"   }\n"
+	"   fragColor = vec4(scale / float(k_samples), bias / float(k_samples), 0.0, 1.0);\n"
+	"}\n";
+
+// Reads one line of the header, without its line break
+QByteArray ReadLine(const QByteArray& contents, int& pos)
+{
+	const int end = contents.indexOf('\n', pos);
+	const int stop = end < 0 ? contents.size() : end;
+	const QByteArray line = contents.mid(pos, stop - pos);
+	pos = stop + 1;
+	return line.trimmed();
+}
+
+// A run length encoded scanline, each of the four channels run by run. Returns false if it
+// runs past the end of the row or the file.
+bool ReadRleScanline(const uchar* pData, int size, int& pos, int width, std::vector<uchar>& scanline)
+{
+	for (int channel = 0; channel < 4; ++channel) {
+		int x = 0;
+		while (x < width) {
+			if (pos >= size) {
+				return false;
+			}
+			int count = pData[pos++];
+			if (count > 128) {
+				count -= 128;
+				if (pos >= size || x + count > width) {
+					return false;
+				}
+				const uchar value = pData[pos++];
+				for (int i = 0; i < count; ++i) {
+					scanline[(x + i) * 4 + channel] = value;
+				}
+			}
+			else {
+				if (count == 0 || pos + count > size || x + count > width) {
+					return false;
+				}
+				for (int i = 0; i < count; ++i) {
+					scanline[(x + i) * 4 + channel] = pData[pos++];
+				}
+			}
+			x += count;
+		}
+	}
+	return true;
+}
+
+void WriteMap(QDataStream& out, const PrefilteredEnvironment::Map& map)
+{
+	out << qint32(map.m_width) << qint32(map.m_height) << quint32(map.m_levels.size());
+	for (const QByteArray& level : map.m_levels) {
+		out << level;
+	}
+}
+
+bool ReadMap(QDataStream& in, PrefilteredEnvironment::Map& map)
+{
+	qint32 width = 0;
+	qint32 height = 0;
+	quint32 levels = 0;
+	in >> width >> height >> levels;
+	if (in.status() != QDataStream::Ok || width <= 0 || height <= 0 || levels == 0 || levels > 16) {
+		return false;
+	}
+	map.m_width = width;
+	map.m_height = height;
+	map.m_levels.resize(levels);
+	for (quint32 i = 0; i < levels; ++i) {
+		in >> map.m_levels[i];
+		const qint64 expected = qint64(std::max(width >> i, 1)) * std::max(height >> i, 1) * k_texelBytes;
+		if (in.status() != QDataStream::Ok || map.m_levels[i].size() != expected) {
+			return false;
+		}
+	}
+	return true;
+}
+
+}
+
+EnvironmentLighting::EnvironmentLighting(const QString& cacheFolder)
+	: m_cacheFolder(cacheFolder)
+{
+}
+
+EnvironmentLighting::~EnvironmentLighting()
+{
+	Destroy();
+}
+
+bool EnvironmentLighting::Create()
+{
+	Destroy();
+
+	// Float render targets need OpenGL 3.3 here. Uniform blocks are checked first so Bind can
+	// turn environment lighting off without them.
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || !UniformBlocks::SupportsUniformBuffers()) {
+		return false;
+	}
+	m_pFunctions = pContext->extraFunctions();
+	if (pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+	m_pFunctions->glGenTextures(3, m_maps);
+	m_pFunctions->glGenFramebuffers(1, &m_framebuffer);
+	m_pFunctions->glGenVertexArrays(1, &m_vao);
+	m_created = true;
+	return true;
+}
+
+void EnvironmentLighting::Destroy()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		m_pFunctions->glDeleteTextures(3, m_maps);
+		m_pFunctions->glDeleteFramebuffers(1, &m_framebuffer);
+		m_pFunctions->glDeleteVertexArrays(1, &m_vao);
+	}
+	std::fill(std::begin(m_maps), std::end(m_maps), 0u);
+	m_framebuffer = 0;
+	m_vao = 0;
+	m_pFunctions = nullptr;
+	m_created = false;
+	m_loaded = false;
+	m_bytes = 0;
+}
+
+bool EnvironmentLighting::IsCreated() const
+{
+	return m_created;
+}
+
+bool EnvironmentLighting::Load(const QString& file)
+{
+	QFile in(file);
+	if (!m_created || !in.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	const QByteArray contents = in.readAll();
+	const QString cachePath = CachePath(contents);
+
+	PrefilteredEnvironment maps;
+	const bool cached = ReadCache(cachePath, maps);
+	if (cached) {
+		Upload(maps);
+	}
+	else {
+		HdrImage image;
+		if (!ReadHdr(contents, image) || !Prefilter(image, maps)) {
+			return false;
+		}
+		if (QDir().mkpath(m_cacheFolder) && !WriteCache(cachePath, maps)) {
+			qWarning("Could not cache the prefiltered environment in %s", qPrintable(cachePath));
+		}
+	}
+	m_file = file;
+	m_loaded = true;
+	m_cached = cached;
+	return true;
+}
+
+void EnvironmentLighting::Clear()
+{
+	m_file.clear();
+	m_loaded = false;
+	m_cached = false;
+}
+
+bool EnvironmentLighting::IsLoaded() const
+{
+	return m_loaded;
+}
+
+const QString& EnvironmentLighting::File() const
+{
+	return m_file;
+}
+
+bool EnvironmentLighting::WasCached() const
+{
+	return m_cached;
+}
+
+void EnvironmentLighting::Bind(const QMatrix4x4& modelView, float intensity, StreamBuffer& stream)
+{
+	if (!m_pFunctions) {
+		return;
+	}
+	EnvironmentBlock block = {};
+	if (m_created && m_loaded && intensity > 0.f) {
+		// Directions are turned from eye space back into the model, where the environment is
+		const QMatrix4x4 eyeToModel = modelView.inverted();
+		std::copy(eyeToModel.constData(), eyeToModel.constData() + 16, block.m_eyeToModel);
+		block.m_intensity = intensity;
+		block.m_specularLevels = float(k_specularLevels);
+		block.m_enabled = 1;
+	}
+
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	stream.BindUniformBlock(k_environmentBlockBinding, &block, sizeof(block));
+	if (m_created) {
+		const GLint units[3] = { UniformBlocks::k_irradianceUnit, UniformBlocks::k_specularUnit, UniformBlocks::k_brdfUnit };
+		for (int i = 0; i < 3; ++i) {
+			f->glActiveTexture(GL_TEXTURE0 + units[i]);
+			f->glBindTexture(GL_TEXTURE_2D, m_maps[i]);
+		}
+		f->glActiveTexture(GL_TEXTURE0);
+	}
+}
+
+qint64 EnvironmentLighting::Bytes() const
+{
+	return m_loaded ? m_bytes : 0;
+}
+
+QString EnvironmentLighting::DefaultCacheFolder()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/environments";
+}
+
+QString EnvironmentLighting::CachePath(const QByteArray& contents) const
+{
+	// The sizes of the maps are part of the key, so changing them doesn't read old entries
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(contents);
+	hash.addData(QString("%1 %2 %3 %4 %5").arg(k_cacheVersion).arg(k_irradianceWidth).arg(k_specularWidth).arg(k_specularLevels).arg(k_brdfSize).toUtf8());
+	return m_cacheFolder + "/" + hash.result().toHex() + ".mvenv";
+}
+
+bool EnvironmentLighting::ReadHdr(const QByteArray& contents, HdrImage& image)
+{
+	int pos = 0;
+	const QByteArray signature = ReadLine(contents, pos);
+	if (signature != "#?RADIANCE" && signature != "#?RGBE") {
+		return false;
+	}
+	bool rgbe = false;
+	for (QByteArray line = ReadLine(contents, pos); !line.isEmpty(); line = ReadLine(contents, pos)) {
+		if (line.startsWith("FORMAT=")) {
+			rgbe = line == "FORMAT=32-bit_rle_rgbe";
+		}
+		if (pos >= contents.size()) {
+			return false;
+		}
+	}
+
+	// Only the usual orientation, rows from the top and pixels from the left
+	const QList<QByteArray> resolution = ReadLine(contents, pos).split(' ');
+	if (!rgbe || resolution.size() != 4 || resolution[0] != "-Y" || resolution[2] != "+X") {
+		return false;
+	}
+	const int height = resolution[1].toInt();
+	const int width = resolution[3].toInt();
+	if (width <= 0 || height <= 0 || qint64(width) * height > (1 << 28)) {
+		return false;
+	}
+
+	const uchar* pData = reinterpret_cast<const uchar*>(contents.constData());
+	const int size = contents.size();
+	std::vector<uchar> scanline(size_t(width) * 4);
+	std::vector<float> pixels(size_t(width) * height * 3);
+	for (int y = 0; y < height; ++y) {
+		// New style run length encoding starts each scanline with 2, 2 and the width
+		const bool rle = width >= 8 && width < 0x8000 && pos + 4 <= size && pData[pos] == 2 && pData[pos + 1] == 2
+			&& ((pData[pos + 2] << 8) | pData[pos + 3]) == width;
+		if (rle) {
+			pos += 4;
+			if (!ReadRleScanline(pData, size, pos, width, scanline)) {
+				return false;
+			}
+		}
+		else {
+			if (pos + width * 4 > size) {
+				return false;
+			}
+			std::copy(pData + pos, pData + pos + width * 4, scanline.begin());
+			pos += width * 4;
+		}
+		float* pRow = pixels.data() + size_t(y) * width * 3;
+		for (int x = 0; x < width; ++x) {
+			const uchar* pTexel = scanline.data() + x * 4;
+			const float scale = pTexel[3] == 0 ? 0.f : std::ldexp(1.f, int(pTexel[3]) - (128 + 8));
+			pRow[x * 3] = pTexel[0] * scale;
+			pRow[x * 3 + 1] = pTexel[1] * scale;
+			pRow[x * 3 + 2] = pTexel[2] * scale;
+		}
+	}
+	image.m_width = width;
+	image.m_height = height;
+	image.m_pixels = std::move(pixels);
+	return true;
+}
+
+bool EnvironmentLighting::ReadCache(const QString& path, PrefilteredEnvironment& maps)
+{
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	QDataStream in(&file);
+	quint32 magic = 0;
+	quint32 version = 0;
+	in >> magic >> version;
+	if (magic != k_cacheMagic || version != k_cacheVersion) {
+		return false;
+	}
+	PrefilteredEnvironment read;
+	if (!ReadMap(in, read.m_irradiance) || !ReadMap(in, read.m_specular) || !ReadMap(in, read.m_brdf)) {
+		return false;
+	}
+	if (read.m_irradiance.m_width != k_irradianceWidth || read.m_specular.m_width != k_specularWidth
+		|| int(read.m_specular.m_levels.size()) != k_specularLevels || read.m_brdf.m_width != k_brdfSize) {
+		return false;
+	}
+	maps = std::move(read);
+	return true;
+}
+
+bool EnvironmentLighting::WriteCache(const QString& path, const PrefilteredEnvironment& maps)
+{
+	// Written next to the entry and renamed over it, so a half written entry is never read
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	QDataStream out(&file);
+	out << k_cacheMagic << k_cacheVersion;
+	WriteMap(out, maps.m_irradiance);
+	WriteMap(out, maps.m_specular);
+	WriteMap(out, maps.m_brdf);
+	return out.status() == QDataStream::Ok && file.commit();
+}
+
+bool EnvironmentLighting::Prefilter(const HdrImage& image, PrefilteredEnvironment& maps)
+{
+	auto Link = [](const char* pSource) {
+		QOpenGLShaderProgram* pProgram = new QOpenGLShaderProgram();
+		pProgram->addShaderFromSourceCode(QOpenGLShader::Vertex, k_prefilterVertexShaderSource);
+		pProgram->addShaderFromSourceCode(QOpenGLShader::Fragment, QByteArray(k_prefilterCommonSource) + pSource);
+		if (!pProgram->link()) {
+			qWarning("Could not link the environment prefilter: %s", qPrintable(pProgram->log()));
+			delete pProgram;
+			return static_cast<QOpenGLShaderProgram*>(nullptr);
+		}
+		return pProgram;
+	};
+	QOpenGLShaderProgram* pIrradiance = Link(k_irradianceShaderSource);
+	QOpenGLShaderProgram* pSpecular = Link(k_specularShaderSource);
+	QOpenGLShaderProgram* pBrdf = Link(k_brdfShaderSource);
+	if (!pIrradiance || !pSpecular || !pBrdf) {
+		delete pIrradiance;
+		delete pSpecular;
+		delete pBrdf;
+		return false;
+	}
+
+	// The source keeps its full range and gets levels for the wide samples to read
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	GLuint source = 0;
+	f->glGenTextures(1, &source);
+	f->glActiveTexture(GL_TEXTURE0);
+	f->glBindTexture(GL_TEXTURE_2D, source);
+	f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, image.m_width, image.m_height, 0, GL_RGB, GL_FLOAT, image.m_pixels.data());
+	f->glGenerateMipmap(GL_TEXTURE_2D);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	maps = PrefilteredEnvironment();
+	maps.m_irradiance.m_width = k_irradianceWidth;
+	maps.m_irradiance.m_height = k_irradianceWidth / 2;
+	maps.m_specular.m_width = k_specularWidth;
+	maps.m_specular.m_height = k_specularWidth / 2;
+	maps.m_brdf.m_width = k_brdfSize;
+	maps.m_brdf.m_height = k_brdfSize;
+	maps.m_irradiance.m_levels.resize(1);
+	maps.m_specular.m_levels.resize(k_specularLevels);
+	maps.m_brdf.m_levels.resize(1);
+	AllocateMaps();
+
+	GLint previousFramebuffer = 0;
+	GLint viewport[4] = {};
+	f->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	f->glGetIntegerv(GL_VIEWPORT, viewport);
+	const GLboolean depthTest = f->glIsEnabled(GL_DEPTH_TEST);
+	const GLboolean blend = f->glIsEnabled(GL_BLEND);
+	const GLboolean cullFace = f->glIsEnabled(GL_CULL_FACE);
+	f->glDisable(GL_DEPTH_TEST);
+	f->glDisable(GL_BLEND);
+	f->glDisable(GL_CULL_FACE);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	f->glBindVertexArray(m_vao);
+	f->glBindTexture(GL_TEXTURE_2D, source);
+
+	const float sourceLod = std::max(0.f, std::log2(float(image.m_width) / float(k_irradianceWidth * 2)));
+	pIrradiance->bind();
+	pIrradiance->setUniformValue("uSource", 0);
+	pIrradiance->setUniformValue("uSourceLod", sourceLod);
+	DrawLevel(k_irradianceMap, 0, maps.m_irradiance.m_width, maps.m_irradiance.m_height, maps.m_irradiance.m_levels[0]);
+
+	// The first level is the sharp mirror, the last fully rough
+	pSpecular->bind();
+	pSpecular->setUniformValue("uSource", 0);
+	pSpecular->setUniformValue("uSourceTexels", float(image.m_width) * float(image.m_height));
+	for (int level = 0; level < k_specularLevels; ++level) {
+		pSpecular->setUniformValue("uRoughness", float(level) / float(k_specularLevels - 1));
+		DrawLevel(k_specularMap, level, std::max(maps.m_specular.m_width >> level, 1), std::max(maps.m_specular.m_height >> level, 1),
+			maps.m_specular.m_levels[level]);
+	}
+
+	pBrdf->bind();
+	DrawLevel(k_brdfMap, 0, maps.m_brdf.m_width, maps.m_brdf.m_height, maps.m_brdf.m_levels[0]);
+	pBrdf->release();
+
+	f->glBindVertexArray(0);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+	f->glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	if (depthTest) {
+		f->glEnable(GL_DEPTH_TEST);
+	}
+	if (blend) {
+		f->glEnable(GL_BLEND);
+	}
+	if (cullFace) {
+		f->glEnable(GL_CULL_FACE);
+	}
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+	f->glDeleteTextures(1, &source);
+	delete pIrradiance;
+	delete pSpecular;
+	delete pBrdf;
+	return true;
+}
+
+void EnvironmentLighting::DrawLevel(int map, int level, int width, int height, QByteArray& pixels)
+{
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	f->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_maps[map], level);
+	f->glViewport(0, 0, width, height);
+	f->glDrawArrays(GL_TRIANGLES, 0, 3);
+
+	// Read back for the cache. The rows come bottom first, which is the top of the map.
+	pixels.resize(width * height * k_texelBytes);
+	f->glReadPixels(0, 0, width, height, GL_RGBA, GL_HALF_FLOAT, pixels.data());
+}
+
+void EnvironmentLighting::Upload(const PrefilteredEnvironment& maps)
+{
+	AllocateMaps();
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	const PrefilteredEnvironment::Map* pMaps[3] = { &maps.m_irradiance, &maps.m_specular, &maps.m_brdf };
+	for (int i = 0; i < 3; ++i) {
+		const PrefilteredEnvironment::Map& map = *pMaps[i];
+		f->glBindTexture(GL_TEXTURE_2D, m_maps[i]);
+		for (int level = 0; level < int(map.m_levels.size()); ++level) {
+			f->glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, std::max(map.m_width >> level, 1), std::max(map.m_height >> level, 1),
+				GL_RGBA, GL_HALF_FLOAT, map.m_levels[level].constData());
+		}
+	}
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void EnvironmentLighting::AllocateMaps()
+{
+	// Every map has its fixed size, the specular one with a level for each roughness
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	const int widths[3] = { k_irradianceWidth, k_specularWidth, k_brdfSize };
+	const int heights[3] = { k_irradianceWidth / 2, k_specularWidth / 2, k_brdfSize };
+	m_bytes = 0;
+	f->glActiveTexture(GL_TEXTURE0);
+	for (int i = 0; i < 3; ++i) {
+		const int levels = i == k_specularMap ? k_specularLevels : 1;
+		f->glBindTexture(GL_TEXTURE_2D, m_maps[i]);
+		for (int level = 0; level < levels; ++level) {
+			const int width = std::max(widths[i] >> level, 1);
+			const int height = std::max(heights[i] >> level, 1);
+			f->glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA16F, width, height, 0, GL_RGBA, GL_HALF_FLOAT, nullptr);
+			m_bytes += qint64(width) * height * k_texelBytes;
+		}
+		f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+		f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, i == k_brdfMap ? GL_CLAMP_TO_EDGE : GL_REPEAT);
+		f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	}
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <vector>
+
+#include <QByteArray>
+#include <QMatrix4x4>
+#include <QString>
+#include <qopengl.h>
+
+class QOpenGLExtraFunctions;
+class StreamBuffer;
+
+// An image read from a Radiance .hdr file, in linear RGB with the top row first
+struct HdrImage {
+	int m_width = 0;
+	int m_height = 0;
+	std::vector<float> m_pixels;
+
+	bool IsNull() const { return m_pixels.empty(); }
+};
+
+// The maps prefiltered from an environment, as kept in the cache. Every map is RGBA half float
+// with each level stored as its own block, top row first.
+struct PrefilteredEnvironment {
+	struct Map {
+		int m_width = 0;
+		int m_height = 0;
+		std::vector<QByteArray> m_levels;
+	};
+	Map m_irradiance;
+	Map m_specular;
+	Map m_brdf;
+};
+
+// Lights the model with an equirectangular HDR environment, split sum style. The environment is
+// prefiltered once on the GPU into an irradiance map for the diffuse light, a specular map whose
+// levels are blurred for rougher surfaces, and the lookup table of the BRDF's scale and bias.
+// The maps are then cached on disk keyed by the hash of the HDR file, so opening the same
+// environment again only reads them back. The environment stays fixed to the model, reflections
+// turn with the camera.
+class EnvironmentLighting
+{
+public:
+	static const int k_irradianceWidth = 64;
+	static const int k_specularWidth = 512;
+	static const int k_specularLevels = 6;
+	static const int k_brdfSize = 128;
+
+	// Bump whenever the prefiltering or the cache layout change
+	static const quint32 k_cacheVersion = 1;
+
+	explicit EnvironmentLighting(const QString& cacheFolder = DefaultCacheFolder());
+	~EnvironmentLighting();
+
+	// Creating and destroying the maps requires the context they are used in to be current.
+	// Create returns false without OpenGL 3.3, Bind then turns environment lighting off.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Loads the environment of an equirectangular .hdr file. The maps are read from the cache if
+	// it holds them for the file's contents, otherwise they are prefiltered and stored. Returns
+	// false if the file can't be read, the environment loaded before is then kept. Leaves the
+	// framebuffer and viewport it found bound.
+	bool Load(const QString& file);
+	void Clear();
+	bool IsLoaded() const;
+	const QString& File() const;
+
+	// Whether the last Load read the maps from the cache instead of prefiltering them
+	bool WasCached() const;
+
+	// Writes the environment block for a frame seen through modelView into stream and binds the
+	// maps. At an intensity of 0, or without an environment, the block turns environment
+	// lighting off.
+	void Bind(const QMatrix4x4& modelView, float intensity, StreamBuffer& stream);
+
+	// GPU memory taken by the maps
+	qint64 Bytes() const;
+
+	// Per user cache location of the application
+	static QString DefaultCacheFolder();
+
+	// The cache entry for the contents of an .hdr file
+	QString CachePath(const QByteArray& contents) const;
+
+	// Decodes the contents of a Radiance .hdr file, flat or run length encoded. Returns false
+	// for files that aren't RGBE or aren't stored top row first.
+	static bool ReadHdr(const QByteArray& contents, HdrImage& image);
+
+	// Reads and writes cache entries. Entries of another version or with maps of other sizes
+	// are not read.
+	static bool ReadCache(const QString& path, PrefilteredEnvironment& maps);
+	static bool WriteCache(const QString& path, const PrefilteredEnvironment& maps);
+
+private:
+	enum MapIndex {
+		k_irradianceMap = 0,
+		k_specularMap = 1,
+		k_brdfMap = 2,
+	};
+
+	// Draws the maps from image into the textures, and reads them back into maps
+	bool Prefilter(const HdrImage& image, PrefilteredEnvironment& maps);
+	void DrawLevel(int map, int level, int width, int height, QByteArray& pixels);
+	void Upload(const PrefilteredEnvironment& maps);
+	void AllocateMaps();
+
+	QString m_cacheFolder;
+	QOpenGLExtraFunctions* m_pFunctions = nullptr;
+	GLuint m_maps[3] = {};
+	GLuint m_framebuffer = 0;
+	GLuint m_vao = 0;
+	bool m_created = false;
+
+	QString m_file;
+	bool m_loaded = false;
+	bool m_cached = false;
+	qint64 m_bytes = 0;
+};
@@ -0,0 +1,103 @@
+#include "FileContents.h"
+
+#include <QFileInfo>
+#include <QStorageInfo>
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+
+FileContents::~FileContents()
+{
+	if (m_pMapping) {
+		m_file.unmap(m_pMapping);
+	}
+}
+
+QSharedPointer<const FileContents> FileContents::Open(const QString& path)
+{
+	QSharedPointer<FileContents> pContents(new FileContents());
+	pContents->m_file.setFileName(path);
+	if (!pContents->m_file.open(QIODevice::ReadOnly)) {
+		return QSharedPointer<const FileContents>();
+	}
+
+	// Empty files can't be mapped and have nothing to read
+	const qint64 size = pContents->m_file.size();
+	if (size == 0) {
+		return pContents;
+	}
+	if (!IsNetworkPath(path)) {
+		pContents->m_pMapping = pContents->m_file.map(0, size);
+		if (pContents->m_pMapping) {
+			pContents->m_pData = pContents->m_pMapping;
+			pContents->m_size = size;
+			return pContents;
+		}
+	}
+
+	// Unmapped files are read into one array, which holds up to 2 GB
+	if (size > std::numeric_limits<int>::max()) {
+		return QSharedPointer<const FileContents>();
+	}
+	pContents->m_buffer.resize(int(size));
+	qint64 offset = 0;
+	while (offset < size) {
+		const qint64 read = pContents->m_file.read(pContents->m_buffer.data() + offset, std::min(k_readBlockBytes, size - offset));
+		if (read <= 0) {
+			return QSharedPointer<const FileContents>();
+		}
+		offset += read;
+	}
+	pContents->m_file.close();
+	pContents->m_pData = reinterpret_cast<const uchar*>(pContents->m_buffer.constData());
+	pContents->m_size = size;
+	return pContents;
+}
+
+QSharedPointer<const FileContents> FileContents::FromBytes(const QByteArray& bytes)
+{
+	QSharedPointer<FileContents> pContents(new FileContents());
+	pContents->m_buffer = bytes;
+	pContents->m_pData = reinterpret_cast<const uchar*>(pContents->m_buffer.constData());
+	pContents->m_size = bytes.size();
+	return pContents;
+}
+
+QSharedPointer<const FileContents> FileContents::Slice(const QSharedPointer<const FileContents>& pSource, qint64 offset, qint64 size)
+{
+	if (offset < 0 || size < 0 || offset > pSource->Size() || size > pSource->Size() - offset) {
+		return QSharedPointer<const FileContents>();
+	}
+	QSharedPointer<FileContents> pContents(new FileContents());
+	pContents->m_pSource = pSource;
+	pContents->m_pData = pSource->Data() + offset;
+	pContents->m_size = size;
+	return pContents;
+}
+
+const uchar* FileContents::Data() const
+{
+	return m_pData;
+}
+
+qint64 FileContents::Size() const
+{
+	return m_size;
+}
+
+bool FileContents::IsMapped() const
+{
+	return m_pMapping || (m_pSource && m_pSource->IsMapped());
+}
+
+bool FileContents::IsNetworkPath(const QString& path)
+{
+	if (path.startsWith("//") || path.startsWith("\\\\")) {
+		return true;
+	}
+	static const QByteArray k_networkFileSystems[] = { "nfs", "nfs4", "cifs", "smbfs", "smb3", "afs", "9p", "fuse.sshfs" };
+	const QByteArray type = QStorageInfo(QFileInfo(path).absolutePath()).fileSystemType().toLower();
+	return std::find(std::begin(k_networkFileSystems), std::end(k_networkFileSystems), type) != std::end(k_networkFileSystems);
+}
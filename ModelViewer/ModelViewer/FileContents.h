@@ -0,0 +1,45 @@
+#pragma once
+#include <QFile>
+#include <QByteArray>
+#include <QSharedPointer>
+#include <QString>
+
+// A whole file held in memory for reading. Local files are mapped. Files on network shares,
+// and any that can't be mapped, are read up front in large blocks, as every small read on a
+// share pays its latency again. Contents can also be bytes from elsewhere, such as a download,
+// or a part of other contents, such as a file stored in an archive.
+class FileContents
+{
+public:
+	// Reads are this big for files that aren't mapped
+	static const qint64 k_readBlockBytes = 8 * 1024 * 1024;
+
+	~FileContents();
+
+	// Null if the file can't be opened or read
+	static QSharedPointer<const FileContents> Open(const QString& path);
+
+	static QSharedPointer<const FileContents> FromBytes(const QByteArray& bytes);
+
+	// size bytes of pSource from offset on, without copying them. The slice keeps pSource
+	// alive. Null if the range is outside of it.
+	static QSharedPointer<const FileContents> Slice(const QSharedPointer<const FileContents>& pSource, qint64 offset, qint64 size);
+
+	const uchar* Data() const;
+	qint64 Size() const;
+	// True for slices of a mapped file as well
+	bool IsMapped() const;
+
+	// Whether path is on a network share, by its UNC prefix or the type of its file system
+	static bool IsNetworkPath(const QString& path);
+
+private:
+	FileContents() = default;
+
+	QFile m_file;
+	uchar* m_pMapping = nullptr;
+	QByteArray m_buffer;
+	QSharedPointer<const FileContents> m_pSource;
+	const uchar* m_pData = nullptr;
+	qint64 m_size = 0;
+};
@@ -0,0 +1,110 @@
+#include "FrameAccumulator.h"
+#include "StateCache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+
+#ifndef GL_RGBA16F
+#define GL_RGBA16F 0x881A
+#endif
+
+
+FrameAccumulator::~FrameAccumulator()
+{
+	// The target goes with the context
+}
+
+bool FrameAccumulator::Create()
+{
+	Destroy();
+	m_created = QOpenGLFramebufferObject::hasOpenGLFramebufferBlit();
+	return m_created;
+}
+
+void FrameAccumulator::Destroy()
+{
+	if (QOpenGLContext::currentContext()) {
+		delete m_pTarget;
+	}
+	m_pTarget = nullptr;
+	m_created = false;
+	m_samples = 0;
+}
+
+bool FrameAccumulator::IsCreated() const
+{
+	return m_created;
+}
+
+void FrameAccumulator::BeginSample(const QSize& size)
+{
+	QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+	StateCache& state = StateCache::Current();
+	if (!m_pTarget || m_pTarget->size() != size) {
+		delete m_pTarget;
+
+		// Eight bits lose the low bits of the later samples, which only add a sixteenth or so
+		const QOpenGLContext* pContext = QOpenGLContext::currentContext();
+		const bool halfFloat = !pContext->isOpenGLES() || pContext->format().majorVersion() >= 3;
+		m_pTarget = new QOpenGLFramebufferObject(size, QOpenGLFramebufferObject::NoAttachment, GL_TEXTURE_2D, halfFloat ? GL_RGBA16F : GL_RGBA8);
+		m_samples = 0;
+	}
+
+	m_pTarget->bind();
+	state.Enable(GL_BLEND);
+	f->glBlendColor(0.f, 0.f, 0.f, 1.f / float(m_samples + 1));
+	state.BlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+}
+
+GLuint FrameAccumulator::Framebuffer() const
+{
+	return m_pTarget ? m_pTarget->handle() : 0;
+}
+
+void FrameAccumulator::EndSample()
+{
+	StateCache& state = StateCache::Current();
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.Disable(GL_BLEND);
+	++m_samples;
+}
+
+void FrameAccumulator::Present(GLuint framebuffer)
+{
+	// The widget's framebuffer isn't a QOpenGLFramebufferObject, so this blits by hand
+	QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+	const QSize size = m_pTarget->size();
+	f->glBindFramebuffer(GL_READ_FRAMEBUFFER, m_pTarget->handle());
+	f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebuffer);
+	f->glBlitFramebuffer(0, 0, size.width(), size.height(), 0, 0, size.width(), size.height(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void FrameAccumulator::Reset()
+{
+	m_samples = 0;
+}
+
+int FrameAccumulator::SampleCount() const
+{
+	return m_samples;
+}
+
+QPointF FrameAccumulator::Jitter(int sample)
+{
+	// Index 0 of the sequence is 0 in every base, the first sample starts at 1
+	return QPointF(Halton(sample + 1, 2) - 0.5, Halton(sample + 1, 3) - 0.5);
+}
+
+float FrameAccumulator::Halton(int index, int base)
+{
+	float fraction = 1.f;
+	float result = 0.f;
+	while (index > 0) {
+		fraction /= float(base);
+		result += fraction * float(index % base);
+		index /= base;
+	}
+	return result;
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <QPointF>
+#include <QSize>
+#include <qopengl.h>
+
+class QOpenGLFramebufferObject;
+
+// Averages frames drawn with the projection shifted by a different fraction of a pixel each
+// time, which supersamples a still image a frame at a time. Frames are blended into a
+// floating point target where the hardware has one, and the average is blitted to the window.
+class FrameAccumulator
+{
+public:
+	~FrameAccumulator();
+
+	// Creating and destroying the target requires a current context. Create returns false
+	// without framebuffer blits.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Binds the target with blending set up to add the frame drawn next at 1 / (samples + 1)
+	// of the average, so the first one replaces whatever was there. A target of another size
+	// is reallocated.
+	void BeginSample(const QSize& size);
+	GLuint Framebuffer() const;
+
+	// Restores blending and counts the sample
+	void EndSample();
+
+	// Copies the average to all of framebuffer
+	void Present(GLuint framebuffer);
+
+	// Starts the average over with the next sample
+	void Reset();
+	int SampleCount() const;
+
+	// Offset of the projection for a sample in pixels, between -0.5 and 0.5. The offsets come
+	// from the Halton sequence in bases 2 and 3, so any first few of them cover the pixel evenly.
+	static QPointF Jitter(int sample);
+	static float Halton(int index, int base);
+
+private:
+	QOpenGLFramebufferObject* m_pTarget = nullptr;
+	bool m_created = false;
+	int m_samples = 0;
+};
@@ -0,0 +1,354 @@
+#include "FrameCapture.h"
+#include "FrameStream.h"
+#include "JobSystem.h"
+#include "VideoEncoder.h"
+
+#include <QDir>
+#include <QImage>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+
+#include <cstring>
+
+
+namespace {
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+// Fences and mapping buffer ranges need OpenGL 3.2 or OpenGL ES 3.0
+bool SupportsFences(const QOpenGLContext* pContext)
+{
+	const QSurfaceFormat format = pContext->format();
+	if (pContext->isOpenGLES()) {
+		return format.majorVersion() >= 3;
+	}
+	return format.version() >= qMakePair(3, 2)
+		|| (format.majorVersion() >= 3 && pContext->hasExtension("GL_ARB_sync"));
+}
+
+}
+
+FrameCapture::~FrameCapture()
+{
+	// The buffers go with the context, only the writes are left to finish here
+	for (QFuture<bool>& write : m_writes) {
+		write.waitForFinished();
+	}
+}
+
+void FrameCapture::Create()
+{
+	Destroy();
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	m_async = SupportsFences(pContext);
+	if (m_async) {
+		for (Slot& slot : m_slots) {
+			slot.m_buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+			if (!slot.m_buffer.create()) {
+				m_async = false;
+			}
+		}
+	}
+	m_created = true;
+}
+
+void FrameCapture::Destroy()
+{
+	if (!m_created) {
+		return;
+	}
+	for (int i = 0; i < k_slotCount; ++i) {
+		Finish(m_slots[(m_next + i) % k_slotCount]);
+	}
+	for (Slot& slot : m_slots) {
+		slot.m_buffer.destroy();
+	}
+
+	// A video cut short keeps the frames it got
+	if (m_pVideo) {
+		m_pVideo->Close();
+		m_pVideo = nullptr;
+	}
+	delete m_pResolve;
+	m_pResolve = nullptr;
+	m_created = false;
+}
+
+bool FrameCapture::IsCreated() const
+{
+	return m_created;
+}
+
+void FrameCapture::Request(const QString& path)
+{
+	m_requestedPath = path;
+}
+
+void FrameCapture::StartRecording(const QString& folder, int frameCount)
+{
+	QDir().mkpath(folder);
+	m_recordFolder = folder;
+	m_recordedFrames = 0;
+	m_recordLimit = frameCount;
+}
+
+void FrameCapture::StopRecording()
+{
+	m_recordFolder.clear();
+}
+
+bool FrameCapture::IsRecording() const
+{
+	return !m_recordFolder.isEmpty();
+}
+
+void FrameCapture::StartVideo(VideoEncoder* pEncoder, int frameCount)
+{
+	if (m_pVideo && m_pVideo != pEncoder) {
+		m_pVideo->Close();
+	}
+	m_pVideo = pEncoder;
+	m_videoFrameCount = frameCount;
+	m_videoCaptured = 0;
+	m_videoEncoded = 0;
+}
+
+bool FrameCapture::IsRecordingVideo() const
+{
+	return m_pVideo != nullptr;
+}
+
+void FrameCapture::StartStream(FrameStream* pStream)
+{
+	m_pStream = pStream;
+}
+
+void FrameCapture::StopStream()
+{
+	m_pStream = nullptr;
+}
+
+bool FrameCapture::IsStreaming() const
+{
+	return m_pStream != nullptr;
+}
+
+bool FrameCapture::FinishWrites()
+{
+	for (QFuture<bool>& write : m_writes) {
+		if (!write.result()) {
+			m_writeFailed = true;
+		}
+	}
+	m_writes.clear();
+	const bool written = !m_writeFailed;
+	m_writeFailed = false;
+	return written;
+}
+
+bool FrameCapture::IsBusy() const
+{
+	if (IsRecording() || IsRecordingVideo() || !m_requestedPath.isEmpty()) {
+		return true;
+	}
+	for (const Slot& slot : m_slots) {
+		if (slot.m_fence) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void FrameCapture::Capture(GLuint framebuffer, const QSize& size, int samples)
+{
+	if (!m_created) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+
+	// Save the readbacks the GPU has finished, oldest first. Later ones won't be done either.
+	for (int i = 0; i < k_slotCount; ++i) {
+		Slot& slot = m_slots[(m_next + i) % k_slotCount];
+		if (slot.m_fence) {
+			const GLenum status = f->glClientWaitSync(slot.m_fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+				break;
+			}
+			Finish(slot);
+		}
+	}
+
+	QString path;
+	bool video = false;
+	bool stream = false;
+	if (!m_requestedPath.isEmpty()) {
+		path = m_requestedPath;
+		m_requestedPath.clear();
+	}
+	else if (m_pVideo && m_videoCaptured < m_videoFrameCount) {
+		video = true;
+		++m_videoCaptured;
+	}
+	else if (IsRecording()) {
+		path = QDir(m_recordFolder).filePath(QString("frame_%1.png").arg(m_recordedFrames++, 5, 10, QChar('0')));
+		if (m_recordLimit >= 0 && m_recordedFrames >= m_recordLimit) {
+			StopRecording();
+		}
+	}
+	else if (m_pStream && m_pStream->WantsFrame()) {
+		stream = true;
+	}
+	if ((path.isEmpty() && !video && !stream) || size.isEmpty()) {
+		return;
+	}
+
+	// Multisampled framebuffers can't be read from, resolve them into a plain one first
+	GLuint readFramebuffer = framebuffer;
+	if (samples > 0) {
+		if (!QOpenGLFramebufferObject::hasOpenGLFramebufferBlit()) {
+			qWarning("Could not capture %s, multisampled frames can't be resolved", qPrintable(video ? QString("the video") : stream ? QString("the stream") : path));
+			if (video) {
+				Encode(nullptr, size);
+			}
+			else if (stream) {
+				m_pStream->AddFrame(nullptr, size);
+			}
+			return;
+		}
+		if (!m_pResolve || m_pResolve->size() != size) {
+			delete m_pResolve;
+			m_pResolve = new QOpenGLFramebufferObject(size);
+		}
+		f->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+		f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_pResolve->handle());
+		f->glBlitFramebuffer(0, 0, size.width(), size.height(), 0, 0, size.width(), size.height(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+		readFramebuffer = m_pResolve->handle();
+	}
+	f->glBindFramebuffer(GL_FRAMEBUFFER, readFramebuffer);
+
+	if (!m_async) {
+		QImage image(size, QImage::Format_RGBA8888_Premultiplied);
+		f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, image.bits());
+		f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		if (video) {
+			Encode(image.constBits(), size);
+		}
+		else if (stream) {
+			m_pStream->AddFrame(image.constBits(), size);
+		}
+		else {
+			Save(image, path);
+		}
+		return;
+	}
+
+	// All slots busy means the GPU is several frames behind, wait for the oldest one
+	Slot& slot = m_slots[m_next];
+	m_next = (m_next + 1) % k_slotCount;
+	Finish(slot);
+
+	const int bytes = size.width() * size.height() * 4;
+	slot.m_buffer.bind();
+	if (slot.m_buffer.size() != bytes) {
+		slot.m_buffer.allocate(bytes);
+	}
+	f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	slot.m_buffer.release();
+	slot.m_fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.m_size = size;
+	slot.m_path = path;
+	slot.m_video = video;
+	slot.m_stream = stream;
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+}
+
+void FrameCapture::Finish(Slot& slot)
+{
+	if (!slot.m_fence) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+	f->glClientWaitSync(slot.m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	f->glDeleteSync(slot.m_fence);
+	slot.m_fence = nullptr;
+
+	// Copy the pixels out so the buffer can be reused right away. Video and stream frames go
+	// from the mapped buffer straight to the encoder and the stream, which copy them.
+	QImage image;
+	slot.m_buffer.bind();
+	const int bytes = slot.m_size.width() * slot.m_size.height() * 4;
+	const void* pPixels = slot.m_buffer.mapRange(0, bytes, QOpenGLBuffer::RangeRead);
+	if (pPixels) {
+		if (slot.m_video) {
+			Encode(static_cast<const uchar*>(pPixels), slot.m_size);
+		}
+		else if (slot.m_stream) {
+			// The stream may have stopped while the frame was read back
+			if (m_pStream) {
+				m_pStream->AddFrame(static_cast<const uchar*>(pPixels), slot.m_size);
+			}
+		}
+		else {
+			image = QImage(slot.m_size, QImage::Format_RGBA8888_Premultiplied);
+			std::memcpy(image.bits(), pPixels, size_t(bytes));
+		}
+		slot.m_buffer.unmap();
+	}
+	else if (slot.m_video) {
+		Encode(nullptr, slot.m_size);
+	}
+	else if (slot.m_stream && m_pStream) {
+		m_pStream->AddFrame(nullptr, slot.m_size);
+	}
+	slot.m_buffer.release();
+
+	if (!image.isNull()) {
+		Save(image, slot.m_path);
+	}
+	slot.m_path.clear();
+	slot.m_video = false;
+	slot.m_stream = false;
+}
+
+void FrameCapture::Save(const QImage& image, const QString& path)
+{
+	// Drop the writes that finished, and wait when the disk can't keep up
+	while (!m_writes.empty() && (m_writes.front().isFinished() || int(m_writes.size()) >= k_maxPendingWrites)) {
+		if (!m_writes.front().result()) {
+			m_writeFailed = true;
+		}
+		m_writes.pop_front();
+	}
+
+	// OpenGL rows start at the bottom
+	m_writes.push_back(JobSystem::Run(JobPriority::Normal, [image, path] {
+		if (!image.mirrored().save(path)) {
+			qWarning("Could not save %s", qPrintable(path));
+			return false;
+		}
+		return true;
+	}));
+}
+
+void FrameCapture::Encode(const uchar* pPixels, const QSize& size)
+{
+	if (!m_pVideo) {
+		return;
+	}
+
+	// A frame that couldn't be read back or queued ends the video, which then fails
+	if (!pPixels || !m_pVideo->AddFrame(pPixels, size)) {
+		m_pVideo->Cancel();
+		m_pVideo = nullptr;
+		return;
+	}
+	if (++m_videoEncoded >= m_videoFrameCount) {
+		m_pVideo->Close();
+		m_pVideo = nullptr;
+	}
+}
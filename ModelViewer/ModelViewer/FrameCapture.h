@@ -0,0 +1,101 @@
+#pragma once
+#include <deque>
+
+#include <QFuture>
+#include <QOpenGLBuffer>
+#include <QSize>
+#include <QString>
+#include <qopengl.h>
+
+class QImage;
+class FrameStream;
+class QOpenGLFramebufferObject;
+class VideoEncoder;
+
+// Reads frames back into pixel buffer objects and saves them on a worker thread. Every readback
+// is fenced and only mapped once the GPU is done with it, usually a frame or two later, so
+// capturing doesn't stall rendering. Without fence support frames are read back right away,
+// but encoding still happens on the worker thread.
+class FrameCapture
+{
+public:
+	static const int k_slotCount = 3;
+	static const int k_maxPendingWrites = 8;
+
+	~FrameCapture();
+
+	// Creating and destroying the buffers requires the context they are used in to be current.
+	// Destroy saves the frames that are still being read back.
+	void Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Saves the next frame to path, the image format is chosen by its suffix
+	void Request(const QString& path);
+
+	// Saves every frame as folder/frame_00000.png and onwards until StopRecording, or until
+	// frameCount frames are saved
+	void StartRecording(const QString& folder, int frameCount = -1);
+	void StopRecording();
+	bool IsRecording() const;
+
+	// Passes the next frameCount frames to pEncoder straight from the mapped buffers, and
+	// closes it after the last one. The encoder has to outlive the video.
+	void StartVideo(VideoEncoder* pEncoder, int frameCount);
+	bool IsRecordingVideo() const;
+
+	// Passes every frame pStream wants to it, until StopStream. Frames saved or encoded take
+	// precedence. Streaming alone doesn't make the capture busy, frames are only streamed
+	// while they are drawn anyway.
+	void StartStream(FrameStream* pStream);
+	void StopStream();
+	bool IsStreaming() const;
+
+	// Waits for the images still being written. False if any image since the last call
+	// couldn't be.
+	bool FinishWrites();
+
+	// True while frames are being read back, recorded or encoded. Frames have to keep being drawn
+	// until this is false, because readbacks are only finished from Capture.
+	bool IsBusy() const;
+
+	// Called at the end of every frame with the framebuffer that holds it. Multisampled
+	// framebuffers are resolved first.
+	void Capture(GLuint framebuffer, const QSize& size, int samples);
+
+private:
+	struct Slot {
+		QOpenGLBuffer m_buffer = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+		GLsync m_fence = nullptr;
+		QSize m_size;
+		QString m_path;
+		bool m_video = false;
+		bool m_stream = false;
+	};
+	void Finish(Slot& slot);
+	void Save(const QImage& image, const QString& path);
+	void Encode(const uchar* pPixels, const QSize& size);
+
+	Slot m_slots[k_slotCount];
+	int m_next = 0;
+	bool m_created = false;
+	bool m_async = false;
+	QOpenGLFramebufferObject* m_pResolve = nullptr;
+
+	QString m_requestedPath;
+	QString m_recordFolder;
+	int m_recordedFrames = 0;
+	int m_recordLimit = -1;
+
+	// The video being captured, with the frames read back for it and those passed on
+	VideoEncoder* m_pVideo = nullptr;
+	int m_videoFrameCount = 0;
+	int m_videoCaptured = 0;
+	int m_videoEncoded = 0;
+
+	FrameStream* m_pStream = nullptr;
+
+	// Encoding and writing happens on the global thread pool
+	std::deque<QFuture<bool>> m_writes;
+	bool m_writeFailed = false;
+};
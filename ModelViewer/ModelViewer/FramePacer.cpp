@@ -0,0 +1,101 @@
+#include "FramePacer.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+// A measured step this close to a whole number of intervals, as a share of one, is snapped to it
+const float k_snapTolerance = 0.25f;
+
+}
+
+int FramePacer::SwapInterval(int mode)
+{
+	switch (mode) {
+	case k_presentAdaptive:
+		return -1;
+	case k_presentUncapped:
+	case k_presentLimited:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+void FramePacer::SetOptions(const PacingOptions& options, float refreshRate)
+{
+	if (options.m_presentMode != m_options.m_presentMode || options.m_frameLimit != m_options.m_frameLimit) {
+		Reset();
+	}
+	m_options = options;
+	m_options.m_frameLimit = std::max(1, m_options.m_frameLimit);
+	m_refreshInterval = refreshRate > 0.f ? 1.f / refreshRate : 1.f / 60.f;
+}
+
+const PacingOptions& FramePacer::Options() const
+{
+	return m_options;
+}
+
+float FramePacer::TargetInterval() const
+{
+	switch (m_options.m_presentMode) {
+	case k_presentUncapped:
+		return 0.f;
+	case k_presentLimited:
+		return 1.f / float(m_options.m_frameLimit);
+	default:
+		return m_refreshInterval;
+	}
+}
+
+bool FramePacer::Delays() const
+{
+	return m_options.m_presentMode == k_presentLimited || (m_options.m_lowLatency && m_options.m_presentMode != k_presentUncapped);
+}
+
+float FramePacer::FrameStep(float measured) const
+{
+	const float interval = TargetInterval();
+	if (interval <= 0.f || measured <= 0.f) {
+		return measured;
+	}
+	const float intervals = std::round(measured / interval);
+	if (intervals >= 1.f && std::abs(measured - intervals * interval) < k_snapTolerance * interval) {
+		return intervals * interval;
+	}
+	return measured;
+}
+
+float FramePacer::NextFrameDelay(double now, float frameCost)
+{
+	if (m_options.m_presentMode == k_presentLimited) {
+		// Each frame starts an interval after the last was due, a late one starts the count over
+		const double interval = double(TargetInterval());
+		m_nextStart = m_nextStart < 0.0 ? now : m_nextStart + interval;
+		if (m_nextStart < now) {
+			m_nextStart = now;
+		}
+		return float(m_nextStart - now);
+	}
+	if (m_options.m_lowLatency && m_options.m_presentMode != k_presentUncapped) {
+		return std::max(0.f, m_refreshInterval - frameCost - k_lowLatencyMargin);
+	}
+	return 0.f;
+}
+
+void FramePacer::Reset()
+{
+	m_nextStart = -1.0;
+}
+
+float FramePacer::InputToPhoton(float inputAge, float cpuSeconds, float gpuSeconds) const
+{
+	float present = 0.f;
+	if (m_options.m_presentMode == k_presentVsync || m_options.m_presentMode == k_presentAdaptive) {
+		present = m_options.m_lowLatency ? k_lowLatencyMargin : m_refreshInterval;
+	}
+	return inputAge + cpuSeconds + gpuSeconds + present + 0.5f * m_refreshInterval;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+// How frames are presented, the ViewerGraphicsWindow/presentMode setting
+enum PresentMode : int {
+	k_presentVsync = 0, // One frame per refresh of the screen
+	k_presentAdaptive = 1, // Like vsync, but a frame that misses its refresh is shown at once and may tear
+	k_presentUncapped = 2, // As quickly as frames are drawn, for benchmarking. Tears.
+	k_presentLimited = 3, // Without vsync, frames paced to a target rate
+};
+
+struct PacingOptions {
+	int m_presentMode = k_presentVsync;
+	// Frames per second of k_presentLimited
+	int m_frameLimit = 60;
+	// Start each frame as late as it can and still make its refresh, so the input it samples
+	// is as recent as can be, and don't let the driver queue frames ahead
+	bool m_lowLatency = false;
+};
+
+// Decides when the window draws its next frame and how far the view moves with it. The swap
+// interval is fixed when the context is created, the rest follows the options at once. Times
+// are in seconds on a steady clock.
+class FramePacer
+{
+public:
+	// Margin a late started frame leaves before its refresh
+	static constexpr float k_lowLatencyMargin = 0.002f;
+
+	// Swap interval of the surface format for mode, see QSurfaceFormat::setSwapInterval.
+	// Adaptive asks for -1, which drivers without EXT_swap_control_tear treat like vsync.
+	static int SwapInterval(int mode);
+
+	// refreshRate is that of the screen the window is on, in Hz
+	void SetOptions(const PacingOptions& options, float refreshRate);
+	const PacingOptions& Options() const;
+
+	// Time between two frames presented, 0 for uncapped
+	float TargetInterval() const;
+	// Whether NextFrameDelay ever waits, otherwise the next frame can be asked for at once
+	bool Delays() const;
+
+	// How far the view moves in a frame measured seconds after the last one. Close to a whole
+	// number of intervals it is that many intervals, so the jitter of when the event loop got
+	// to the frame doesn't show as uneven motion.
+	float FrameStep(float measured) const;
+
+	// Seconds to wait after the frame presented at now before drawing the next one, which
+	// takes about frameCost. The limiter keeps to its rate without drifting, low latency
+	// waits out the part of the refresh the frame doesn't need. Frames otherwise follow at once.
+	float NextFrameDelay(double now, float frameCost);
+	void Reset();
+
+	// Rough seconds from an input to the middle of the screen showing it. The input waited
+	// inputAge for the frame to sample it, which then took cpuSeconds and gpuSeconds. Vsync
+	// adds the frame queued ahead of it, unless low latency keeps the queue empty, and the
+	// scan out half a refresh.
+	float InputToPhoton(float inputAge, float cpuSeconds, float gpuSeconds) const;
+
+private:
+	PacingOptions m_options;
+	float m_refreshInterval = 1.f / 60.f;
+	// When the limiter starts the next frame, negative until it started one
+	double m_nextStart = -1.0;
+};
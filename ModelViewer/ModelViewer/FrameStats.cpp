@@ -0,0 +1,62 @@
+#include "FrameStats.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+void FrameStats::AddFrame(float seconds)
+{
+	m_frames[m_next] = seconds;
+	m_next = (m_next + 1) % k_capacity;
+	m_count = std::min(m_count + 1, k_capacity);
+}
+
+void FrameStats::Clear()
+{
+	m_next = 0;
+	m_count = 0;
+}
+
+int FrameStats::Count() const
+{
+	return m_count;
+}
+
+float FrameStats::Latest() const
+{
+	if (m_count == 0) {
+		return 0.f;
+	}
+	return m_frames[(m_next + k_capacity - 1) % k_capacity];
+}
+
+FrameStats::Summary FrameStats::Summarize() const
+{
+	Summary ret;
+	if (m_count == 0) {
+		return ret;
+	}
+
+	// Sort a copy on the stack to read the percentiles. The order of the ring doesn't matter
+	// because only the first m_count entries are ever written before it wraps.
+	std::array<float, k_capacity> sorted;
+	std::copy(m_frames.begin(), m_frames.begin() + m_count, sorted.begin());
+	std::sort(sorted.begin(), sorted.begin() + m_count);
+
+	float total = 0.f;
+	for (int i = 0; i < m_count; ++i) {
+		total += sorted[i];
+	}
+
+	auto Percentile = [&](float p) {
+		const int idx = std::min(m_count - 1, int(std::ceil(p * m_count)) - 1);
+		return sorted[std::max(0, idx)];
+	};
+
+	ret.m_min = sorted[0];
+	ret.m_avg = total / m_count;
+	ret.m_p95 = Percentile(0.95f);
+	ret.m_p99 = Percentile(0.99f);
+	ret.m_fps = total > 0.f ? int(std::round(m_count / total)) : 0;
+	return ret;
+}
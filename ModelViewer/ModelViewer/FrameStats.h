@@ -0,0 +1,33 @@
+#pragma once
+#include <array>
+
+// Fixed size ring buffer of the most recent frame times, in seconds. Adding a frame and
+// summarizing never allocate, so this can be used from the render loop.
+class FrameStats
+{
+public:
+	static const int k_capacity = 240;
+
+	struct Summary {
+		float m_min = 0.f;
+		float m_avg = 0.f;
+		float m_p95 = 0.f;
+		float m_p99 = 0.f;
+		int m_fps = 0;
+	};
+
+	// Replaces the oldest frame once the buffer is full
+	void AddFrame(float seconds);
+	void Clear();
+
+	int Count() const;
+	float Latest() const;
+
+	// Statistics over all frames in the buffer, all zero when it is empty
+	Summary Summarize() const;
+
+private:
+	std::array<float, k_capacity> m_frames = {};
+	int m_next = 0;
+	int m_count = 0;
+};
@@ -0,0 +1,104 @@
+#include "FrameStream.h"
+#include "ResolutionScaler.h"
+
+#include <QBuffer>
+#include <QImage>
+
+#include <algorithm>
+#include <cstring>
+
+
+FrameStream::FrameStream(QObject* parent)
+	: QObject(parent)
+{
+	m_clock.start();
+}
+
+bool FrameStream::WantsFrame()
+{
+	if (m_busy || int(m_inFlight.size()) >= k_maxFramesInFlight) {
+		m_skipped = true;
+		return false;
+	}
+	m_busy = true;
+	return true;
+}
+
+void FrameStream::AddFrame(const uchar* pPixels, const QSize& size)
+{
+	if (!pPixels) {
+		m_busy = false;
+		m_skipped = true;
+		return;
+	}
+
+	// The pixels are in a mapped buffer that is reused as soon as this returns
+	QImage image(size, QImage::Format_RGBA8888_Premultiplied);
+	std::memcpy(image.bits(), pPixels, size_t(size.width()) * size_t(size.height()) * 4);
+	const int frame = m_nextFrame++;
+	const float scale = m_scale;
+
+	JobSystem::Then(JobPriority::Interactive, [image, scale] {
+		// OpenGL rows start at the bottom
+		QImage frameImage = image.mirrored().convertToFormat(QImage::Format_RGB888);
+		if (scale < 1.f) {
+			frameImage = frameImage.scaled(std::max(1, int(float(image.width()) * scale)), std::max(1, int(float(image.height()) * scale)), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+		}
+		QByteArray jpeg;
+		QBuffer buffer(&jpeg);
+		buffer.open(QIODevice::WriteOnly);
+		frameImage.save(&buffer, "JPG", k_jpegQuality);
+		return std::make_pair(frameImage.size(), jpeg);
+	}, this, [=](const std::pair<QSize, QByteArray>& encoded) {
+		m_busy = false;
+		if (encoded.second.isEmpty()) {
+			// Frames are only drawn when asked for, so the view as it is now is asked for again
+			qWarning("Could not compress frame %d", frame);
+			m_skipped = true;
+			emit FrameWanted();
+			return;
+		}
+		m_inFlight.emplace_back(frame, m_clock.nsecsElapsed());
+		emit FrameEncoded(frame, encoded.first, encoded.second);
+	}, m_token);
+}
+
+void FrameStream::Acknowledge(int frame)
+{
+	// The newest frame acknowledged says how long frames take to get through now
+	qint64 sent = -1;
+	while (!m_inFlight.empty() && m_inFlight.front().first <= frame) {
+		sent = m_inFlight.front().second;
+		m_inFlight.pop_front();
+	}
+	if (sent < 0) {
+		return;
+	}
+	const float seconds = float(double(m_clock.nsecsElapsed() - sent) * 1e-9);
+	const float scale = ResolutionScaler::NextScale(m_scale, seconds, k_targetSeconds);
+	if (scale != m_scale || m_skipped) {
+		m_scale = scale;
+		m_skipped = false;
+		emit FrameWanted();
+	}
+}
+
+void FrameStream::Reset()
+{
+	m_token.Cancel();
+	m_token = CancelToken();
+	m_inFlight.clear();
+	m_busy = false;
+	m_skipped = false;
+	m_scale = 1.f;
+}
+
+float FrameStream::Scale() const
+{
+	return m_scale;
+}
+
+int FrameStream::FramesInFlight() const
+{
+	return int(m_inFlight.size());
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include "JobSystem.h"
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QObject>
+#include <QSize>
+
+#include <deque>
+#include <utility>
+
+// Compresses the frames FrameCapture reads back into JPEG images for a remote client, and paces
+// them so the client never falls behind. A frame is only read back while none is being
+// compressed and fewer than k_maxFramesInFlight sent frames wait for the client to say it has
+// shown them, so a frame is at most that many frames old once it is shown however slow the
+// link is. Frames turned down meanwhile aren't lost: once the client caught up, FrameWanted
+// asks for the view as it is then. The time from sending a frame to hearing back sets the
+// scale frames are sent at, like ResolutionScaler sets the scale they are drawn at, so frames
+// are smaller while the link is slow and sharp again once it is fast.
+class FrameStream : public QObject
+{
+	Q_OBJECT
+
+public:
+	static const int k_maxFramesInFlight = 2;
+	// Seconds a frame may take to reach the client and be acknowledged at the full scale
+	static constexpr float k_targetSeconds = 0.1f;
+	static const int k_jpegQuality = 80;
+
+	explicit FrameStream(QObject* parent = nullptr);
+
+	// Whether the frame drawn now is to be read back, which then has to be passed to AddFrame.
+	// Frames turned down are remembered, so the next one is asked for once the stream can
+	// take it.
+	bool WantsFrame();
+
+	// Compresses a frame of RGBA rows, bottom row first as OpenGL reads them, on a worker
+	// thread. FrameEncoded is emitted with it on this thread. Null pixels for a frame that
+	// couldn't be read back.
+	void AddFrame(const uchar* pPixels, const QSize& size);
+
+	// The client has shown frame, and every frame before it
+	void Acknowledge(int frame);
+
+	// Drops the frames being compressed and waiting, for a new client
+	void Reset();
+
+	float Scale() const;
+	int FramesInFlight() const;
+
+signals:
+	// A frame compressed at the current scale, to be sent now
+	void FrameEncoded(int frame, QSize size, QByteArray jpeg);
+
+	// A frame was turned down since the last one, or the scale changed, and the stream can
+	// take one now
+	void FrameWanted();
+
+private:
+	QElapsedTimer m_clock;
+	CancelToken m_token;
+	int m_nextFrame = 0;
+	// A frame is read back or compressed
+	bool m_busy = false;
+	bool m_skipped = false;
+	float m_scale = 1.f;
+
+	// The frames sent and not acknowledged yet, with the nanoseconds they were sent at
+	std::deque<std::pair<int, qint64>> m_inFlight;
+};
@@ -0,0 +1,53 @@
+#include "Frustum.h"
+
+#include <algorithm>
+
+
+Frustum::Frustum(const QMatrix4x4& viewProjection)
+	: Frustum(viewProjection, nullptr, 0)
+{
+}
+
+Frustum::Frustum(const QMatrix4x4& viewProjection, const QVector4D* pPlanes, int count)
+{
+	// A point is inside the clip volume if -w <= x, y, z <= w, so every plane is the last
+	// row of the matrix plus or minus one of the others
+	const QVector4D x = viewProjection.row(0);
+	const QVector4D y = viewProjection.row(1);
+	const QVector4D z = viewProjection.row(2);
+	const QVector4D w = viewProjection.row(3);
+	m_planes[0] = w + x;
+	m_planes[1] = w - x;
+	m_planes[2] = w + y;
+	m_planes[3] = w - y;
+	m_planes[4] = w + z;
+	m_planes[5] = w - z;
+	count = std::max(0, std::min(count, int(k_maxExtraPlanes)));
+	std::copy(pPlanes, pPlanes + count, m_planes + 6);
+	m_planeCount = 6 + count;
+	static_assert(6 + k_maxExtraPlanes <= BoundsMath::PlaneSet::k_capacity, "The plane set has to hold every plane");
+	BoundsMath::SetPlanes(m_planes, m_planeCount, m_planeSet);
+}
+
+bool Frustum::Intersects(const QVector3D& min, const QVector3D& max) const
+{
+	return BoundsMath::BoxIntersects(m_planeSet, min, max);
+}
+
+bool Frustum::Contains(const QVector3D& min, const QVector3D& max) const
+{
+	return BoundsMath::BoxInside(m_planeSet, min, max);
+}
+
+bool Frustum::IntersectsSphere(const QVector3D& center, float radius) const
+{
+	// The planes aren't normalized, so the radius is scaled by the length of each normal
+	for (int i = 0; i < m_planeCount; ++i) {
+		const QVector4D& plane = m_planes[i];
+		const QVector3D normal = plane.toVector3D();
+		if (QVector3D::dotProduct(normal, center) + plane.w() < -radius * normal.length()) {
+			return false;
+		}
+	}
+	return true;
+}
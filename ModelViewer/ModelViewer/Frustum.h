@@ -0,0 +1,42 @@
+#pragma once
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+#include "BoundsMath.h"
+
+// The six planes bounding what a view projection can see, for skipping meshes off screen, and
+// up to k_maxExtraPlanes more cutting it down, such as section planes
+class Frustum
+{
+public:
+	static const int k_maxExtraPlanes = 6;
+
+	// Planes of the clip volume of viewProjection, in the space it maps from
+	explicit Frustum(const QMatrix4x4& viewProjection);
+
+	// The same volume cut by count more planes in the same space, further ones are ignored
+	Frustum(const QMatrix4x4& viewProjection, const QVector4D* pPlanes, int count);
+
+	// False if the box lies entirely outside one of the planes. Boxes close to an edge of
+	// the frustum can pass without being visible, which only costs a draw.
+	bool Intersects(const QVector3D& min, const QVector3D& max) const;
+
+	// True if the box lies entirely inside all planes
+	bool Contains(const QVector3D& min, const QVector3D& max) const;
+
+	// False if the sphere lies entirely outside one of the planes
+	bool IntersectsSphere(const QVector3D& center, float radius) const;
+
+	// Left, right, bottom, top, near and far plane, as a x + b y + c z + d, then the extra ones
+	const QVector4D& Plane(int i) const { return m_planes[i]; }
+	int PlaneCount() const { return m_planeCount; }
+
+private:
+	// a x + b y + c z + d >= 0 on the inside
+	QVector4D m_planes[6 + k_maxExtraPlanes];
+	int m_planeCount = 6;
+
+	// The same planes laid out for testing several at once
+	BoundsMath::PlaneSet m_planeSet;
+};
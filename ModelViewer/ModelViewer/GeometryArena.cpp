@@ -0,0 +1,108 @@
+#include "GeometryArena.h"
+#include "ModelLoader.h"
+
+#include <QOpenGLContext>
+
+#include <algorithm>
+
+
+bool GeometryArena::Allocate(Mesh& mesh, const QByteArray& vertexData, const QByteArray& indexData)
+{
+	// Separate attribute blocks can't be reached with a base vertex, their offsets depend on
+	// the mesh's vertex count
+	if (mesh.m_vertexStride <= 0 || !SupportsBaseVertex()) {
+		return false;
+	}
+
+	// Vertices start on a whole vertex so the base vertex can point at them, and indices on a
+	// whole index
+	QOpenGLBuffer vertexBuffer;
+	QOpenGLBuffer indexBuffer;
+	int vertexOffset = 0;
+	int indexOffset = 0;
+	const int indexSize = mesh.m_indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	if (!Suballocate(m_vertexPages, QOpenGLBuffer::VertexBuffer, vertexData, mesh.m_vertexStride, vertexBuffer, vertexOffset)
+		|| !Suballocate(m_indexPages, QOpenGLBuffer::IndexBuffer, indexData, indexSize, indexBuffer, indexOffset)) {
+		return false;
+	}
+
+	mesh.m_vertexBuffer = vertexBuffer;
+	mesh.m_indexBuffer = indexBuffer;
+	mesh.m_baseVertex = vertexOffset / mesh.m_vertexStride;
+	mesh.m_indexOffset = indexOffset;
+	mesh.m_vertexBytes = vertexData.size();
+	mesh.m_indexBytes = indexData.size();
+	mesh.m_sharesBuffers = true;
+	return true;
+}
+
+qint64 GeometryArena::Bytes() const
+{
+	return VertexBytes() + IndexBytes();
+}
+
+qint64 GeometryArena::VertexBytes() const
+{
+	qint64 bytes = 0;
+	for (const Page& page : m_vertexPages) {
+		bytes += page.m_capacity;
+	}
+	return bytes;
+}
+
+qint64 GeometryArena::IndexBytes() const
+{
+	qint64 bytes = 0;
+	for (const Page& page : m_indexPages) {
+		bytes += page.m_capacity;
+	}
+	return bytes;
+}
+
+int GeometryArena::PageCount() const
+{
+	return int(m_vertexPages.size() + m_indexPages.size());
+}
+
+int GeometryArena::FitOffset(int used, int capacity, int size, int alignment)
+{
+	const qint64 offset = (qint64(used) + alignment - 1) / alignment * alignment;
+	return offset + size <= capacity ? int(offset) : -1;
+}
+
+bool GeometryArena::SupportsBaseVertex()
+{
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext) {
+		return false;
+	}
+	return pContext->format().version() >= qMakePair(3, 2);
+}
+
+bool GeometryArena::Suballocate(std::vector<Page>& pages, QOpenGLBuffer::Type type, const QByteArray& data, int alignment, QOpenGLBuffer& buffer, int& offset)
+{
+	// The first page with room takes it, meshes bigger than a page get a page of their own
+	auto fits = std::find_if(pages.begin(), pages.end(), [&](const Page& page) {
+		return FitOffset(page.m_used, page.m_capacity, data.size(), alignment) >= 0;
+	});
+	if (fits == pages.end()) {
+		Page page;
+		page.m_buffer = QOpenGLBuffer(type);
+		if (!page.m_buffer.create() || !page.m_buffer.bind()) {
+			return false;
+		}
+		page.m_capacity = std::max(int(k_pageBytes), data.size());
+		page.m_buffer.allocate(page.m_capacity);
+		page.m_buffer.release();
+		pages.push_back(page);
+		fits = pages.end() - 1;
+	}
+
+	offset = FitOffset(fits->m_used, fits->m_capacity, data.size(), alignment);
+	fits->m_buffer.bind();
+	fits->m_buffer.write(offset, data.constData(), data.size());
+	fits->m_buffer.release();
+	fits->m_used = offset + data.size();
+	buffer = fits->m_buffer;
+	return true;
+}
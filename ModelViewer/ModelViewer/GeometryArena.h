@@ -0,0 +1,47 @@
+#pragma once
+#include <vector>
+
+#include <QByteArray>
+#include <QOpenGLBuffer>
+
+struct Mesh;
+
+// A few large vertex and index buffers the meshes of one model are suballocated from, instead
+// of every mesh owning two buffer objects. Meshes are drawn from their range with a base vertex.
+// Ranges are never freed on their own, the pages go once the model and its meshes are released.
+class GeometryArena
+{
+public:
+	// Pages are this big unless a mesh needs more
+	static const int k_pageBytes = 16 * 1024 * 1024;
+
+	// Suballocates the mesh's interleaved vertices and its indices, and points the mesh's
+	// buffers and offsets at them. Returns false when base vertex draws aren't supported or a
+	// page can't be created, the mesh then needs buffers of its own. Requires a current context.
+	bool Allocate(Mesh& mesh, const QByteArray& vertexData, const QByteArray& indexData);
+
+	// GPU memory taken by the pages, including the space not handed out yet
+	qint64 Bytes() const;
+	qint64 VertexBytes() const;
+	qint64 IndexBytes() const;
+	int PageCount() const;
+
+	// Offset a range of size bytes starts at in a page with used of capacity bytes taken, or -1
+	// if it doesn't fit. The offset is a multiple of alignment.
+	static int FitOffset(int used, int capacity, int size, int alignment);
+
+	// glDrawElementsBaseVertex needs OpenGL 3.2 or OpenGL ES 3.2
+	static bool SupportsBaseVertex();
+
+private:
+	struct Page {
+		QOpenGLBuffer m_buffer;
+		int m_capacity = 0;
+		int m_used = 0;
+	};
+
+	static bool Suballocate(std::vector<Page>& pages, QOpenGLBuffer::Type type, const QByteArray& data, int alignment, QOpenGLBuffer& buffer, int& offset);
+
+	std::vector<Page> m_vertexPages;
+	std::vector<Page> m_indexPages;
+};
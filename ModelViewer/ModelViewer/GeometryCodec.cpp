@@ -0,0 +1,216 @@
+#include "GeometryCodec.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+// Differences are bit packed 16 to a group. A 2 bit code per group picks one of these widths.
+const size_t k_groupSize = 16;
+const int k_groupWidths[4] = { 0, 2, 4, 8 };
+
+// Small differences either way become small numbers
+uchar ZigZag(uchar delta)
+{
+	return uchar((delta << 1) ^ uchar(qint8(delta) >> 7));
+}
+
+uchar UnZigZag(uchar value)
+{
+	return uchar((value >> 1) ^ uchar(-(value & 1)));
+}
+
+quint32 ReadIndex(const uchar* pIndices, size_t i, size_t indexSize)
+{
+	if (indexSize == 1) {
+		return pIndices[i];
+	}
+	if (indexSize == 2) {
+		quint16 index;
+		std::memcpy(&index, pIndices + i * 2, 2);
+		return index;
+	}
+	quint32 index;
+	std::memcpy(&index, pIndices + i * 4, 4);
+	return index;
+}
+
+void WriteIndex(uchar* pIndices, size_t i, size_t indexSize, quint32 index)
+{
+	if (indexSize == 1) {
+		pIndices[i] = uchar(index);
+	}
+	else if (indexSize == 2) {
+		const quint16 index16 = quint16(index);
+		std::memcpy(pIndices + i * 2, &index16, 2);
+	}
+	else {
+		std::memcpy(pIndices + i * 4, &index, 4);
+	}
+}
+
+}
+
+std::vector<uchar> GeometryCodec::EncodeVertices(const uchar* pVertices, size_t vertexCount, size_t stride)
+{
+	std::vector<uchar> out;
+	out.reserve(vertexCount * stride / 2);
+	std::vector<uchar> previous(stride, 0);
+	uchar deltas[k_blockVertices];
+	for (size_t first = 0; first < vertexCount; first += k_blockVertices) {
+		const size_t count = std::min<size_t>(vertexCount - first, size_t(k_blockVertices));
+		const size_t groupCount = (count + k_groupSize - 1) / k_groupSize;
+		for (size_t column = 0; column < stride; ++column) {
+			uchar last = previous[column];
+			for (size_t i = 0; i < count; ++i) {
+				const uchar value = pVertices[(first + i) * stride + column];
+				deltas[i] = ZigZag(uchar(value - last));
+				last = value;
+			}
+			std::fill(deltas + count, deltas + groupCount * k_groupSize, uchar(0));
+			previous[column] = last;
+
+			// The codes of all groups of the column, then their bits
+			const size_t header = out.size();
+			out.resize(out.size() + (groupCount + 3) / 4, 0);
+			for (size_t group = 0; group < groupCount; ++group) {
+				const uchar* pGroup = deltas + group * k_groupSize;
+				uchar bits = 0;
+				for (size_t i = 0; i < k_groupSize; ++i) {
+					bits |= pGroup[i];
+				}
+				const int code = bits == 0 ? 0 : bits < 4 ? 1 : bits < 16 ? 2 : 3;
+				out[header + group / 4] |= uchar(code << (group % 4 * 2));
+
+				const int width = k_groupWidths[code];
+				if (width == 0) {
+					continue;
+				}
+				const size_t perByte = size_t(8 / width);
+				for (size_t i = 0; i < k_groupSize; i += perByte) {
+					uchar packed = 0;
+					for (size_t j = 0; j < perByte; ++j) {
+						packed |= uchar(pGroup[i + j] << (j * width));
+					}
+					out.push_back(packed);
+				}
+			}
+		}
+	}
+	return out;
+}
+
+bool GeometryCodec::DecodeVertices(uchar* pVertices, size_t vertexCount, size_t stride, const uchar* pData, size_t size)
+{
+	const uchar* p = pData;
+	const uchar* pEnd = pData + size;
+	std::vector<uchar> previous(stride, 0);
+	uchar deltas[k_blockVertices];
+	for (size_t first = 0; first < vertexCount; first += k_blockVertices) {
+		const size_t count = std::min<size_t>(vertexCount - first, size_t(k_blockVertices));
+		const size_t groupCount = (count + k_groupSize - 1) / k_groupSize;
+		for (size_t column = 0; column < stride; ++column) {
+			const size_t headerBytes = (groupCount + 3) / 4;
+			if (size_t(pEnd - p) < headerBytes) {
+				return false;
+			}
+			const uchar* pHeader = p;
+			p += headerBytes;
+
+			for (size_t group = 0; group < groupCount; ++group) {
+				uchar* pGroup = deltas + group * k_groupSize;
+				const int width = k_groupWidths[(pHeader[group / 4] >> (group % 4 * 2)) & 3];
+				const size_t bytes = size_t(width) * k_groupSize / 8;
+				if (size_t(pEnd - p) < bytes) {
+					return false;
+				}
+				switch (width) {
+				case 0:
+					std::memset(pGroup, 0, k_groupSize);
+					break;
+				case 2:
+					for (size_t i = 0; i < 4; ++i) {
+						pGroup[i * 4] = p[i] & 3;
+						pGroup[i * 4 + 1] = (p[i] >> 2) & 3;
+						pGroup[i * 4 + 2] = (p[i] >> 4) & 3;
+						pGroup[i * 4 + 3] = p[i] >> 6;
+					}
+					break;
+				case 4:
+					for (size_t i = 0; i < 8; ++i) {
+						pGroup[i * 2] = p[i] & 15;
+						pGroup[i * 2 + 1] = p[i] >> 4;
+					}
+					break;
+				default:
+					std::memcpy(pGroup, p, k_groupSize);
+					break;
+				}
+				p += bytes;
+			}
+
+			// Each byte adds its difference to the same byte of the vertex before
+			uchar value = previous[column];
+			uchar* pOut = pVertices + first * stride + column;
+			for (size_t i = 0; i < count; ++i) {
+				value = uchar(value + UnZigZag(deltas[i]));
+				pOut[i * stride] = value;
+			}
+			previous[column] = value;
+		}
+	}
+	return p == pEnd;
+}
+
+std::vector<uchar> GeometryCodec::EncodeIndices(const uchar* pIndices, size_t indexCount, size_t indexSize)
+{
+	// Meshes in vertex cache order mostly use the next new vertex or one used shortly before,
+	// both a small difference from the next new one. 7 bits are stored per byte, the top bit
+	// says another byte follows.
+	std::vector<uchar> out;
+	out.reserve(indexCount + indexCount / 4);
+	qint64 next = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		const qint64 index = ReadIndex(pIndices, i, indexSize);
+		const qint64 delta = index - next;
+		quint64 value = (quint64(delta) << 1) ^ quint64(delta >> 63);
+		while (value >= 0x80) {
+			out.push_back(uchar(value | 0x80));
+			value >>= 7;
+		}
+		out.push_back(uchar(value));
+		next = std::max(next, index + 1);
+	}
+	return out;
+}
+
+bool GeometryCodec::DecodeIndices(uchar* pIndices, size_t indexCount, size_t indexSize, const uchar* pData, size_t size)
+{
+	const uchar* p = pData;
+	const uchar* pEnd = pData + size;
+	const qint64 maxIndex = (qint64(1) << (indexSize * 8)) - 1;
+	qint64 next = 0;
+	for (size_t i = 0; i < indexCount; ++i) {
+		quint64 value = 0;
+		int shift = 0;
+		for (;;) {
+			if (p == pEnd || shift > 35) {
+				return false;
+			}
+			const uchar byte = *p++;
+			value |= quint64(byte & 0x7f) << shift;
+			shift += 7;
+			if (!(byte & 0x80)) {
+				break;
+			}
+		}
+		const qint64 index = next + (qint64(value >> 1) ^ -qint64(value & 1));
+		if (index < 0 || index > maxIndex) {
+			return false;
+		}
+		WriteIndex(pIndices, i, indexSize, quint32(index));
+		next = std::max(next, index + 1);
+	}
+	return p == pEnd;
+}
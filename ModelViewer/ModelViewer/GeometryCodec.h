@@ -0,0 +1,27 @@
+#pragma once
+#include <vector>
+
+#include <QtGlobal>
+
+// Lossless compression of vertex and index buffers for the ModelCache, in the spirit of
+// meshoptimizer's codecs. Both rely on meshes being ordered for the vertex cache, so nearby
+// vertices are similar and indices mostly refer to recent or new vertices.
+// Vertices are split into byte columns, each byte is stored as the difference to the same
+// byte of the vertex before it, and the differences are bit packed in groups of 16. Indices
+// are stored as variable length differences to the next vertex not used yet.
+// Decoding only shifts and adds, so it runs well above the speed of reading the raw data.
+class GeometryCodec
+{
+public:
+	// Vertices are coded in blocks of this many, so a block's columns stay in the L1 cache
+	static const size_t k_blockVertices = 256;
+
+	static std::vector<uchar> EncodeVertices(const uchar* pVertices, size_t vertexCount, size_t stride);
+
+	// False if the data is malformed or doesn't hold exactly vertexCount vertices
+	static bool DecodeVertices(uchar* pVertices, size_t vertexCount, size_t stride, const uchar* pData, size_t size);
+
+	// indexSize is 1, 2 or 4 bytes
+	static std::vector<uchar> EncodeIndices(const uchar* pIndices, size_t indexCount, size_t indexSize);
+	static bool DecodeIndices(uchar* pIndices, size_t indexCount, size_t indexSize, const uchar* pData, size_t size);
+};
@@ -0,0 +1,169 @@
+#include "GeometryStreamer.h"
+#include "GpuModelBuilder.h"
+
+#include <algorithm>
+#include <functional>
+
+
+GeometryStreamer::GeometryStreamer(ModelData data, qint64 budget)
+	: m_data(std::move(data)), m_budget(budget)
+{
+	// The materials were uploaded with the meshes and are never needed again
+	m_data.m_materials.clear();
+
+	const size_t meshCount = m_data.m_meshes.size();
+	m_bytes.resize(meshCount);
+	for (size_t i = 0; i < meshCount; ++i) {
+		m_bytes[i] = GeometryBytes(m_data.m_meshes[i]);
+	}
+	m_lastUsed.resize(meshCount, 0);
+	m_resident.resize(meshCount, false);
+}
+
+qint64 GeometryStreamer::GeometryBytes(const MeshData& mesh)
+{
+	return qint64(mesh.m_vertexData.size()) + qint64(mesh.m_indexData.size()) + qint64(mesh.m_instanceTransforms.size()) * 16 * qint64(sizeof(GLfloat));
+}
+
+qint64 GeometryStreamer::GeometryBytes(const ModelData& model)
+{
+	qint64 ret = 0;
+	for (const MeshData& mesh : model.m_meshes) {
+		ret += GeometryBytes(mesh);
+	}
+	return ret;
+}
+
+void GeometryStreamer::SetBudget(qint64 budget)
+{
+	m_budget = budget;
+}
+
+qint64 GeometryStreamer::Budget() const
+{
+	return m_budget;
+}
+
+void GeometryStreamer::Request(int meshIdx, float priority)
+{
+	if (meshIdx >= 0 && meshIdx < int(m_bytes.size())) {
+		m_requests.push_back({ priority, meshIdx });
+	}
+}
+
+bool GeometryStreamer::Update(Model& model)
+{
+	++m_frame;
+	for (const std::pair<float, int>& request : m_requests) {
+		m_lastUsed[request.second] = m_frame;
+	}
+	std::sort(m_requests.begin(), m_requests.end(), std::greater<std::pair<float, int>>());
+
+	bool changed = false;
+	qint64 uploaded = 0;
+	m_complete = true;
+	for (const std::pair<float, int>& request : m_requests) {
+		const int meshIdx = request.second;
+		if (m_resident[meshIdx]) {
+			continue;
+		}
+		const qint64 bytes = m_bytes[meshIdx];
+		if (uploaded > 0 && uploaded + bytes > k_frameUploadBytes) {
+			m_complete = false;
+			break;
+		}
+
+		// Meshes that don't fit next to the larger ones in view are left out until those go
+		if (m_residentBytes + bytes > m_budget) {
+			changed |= Evict(model, m_residentBytes + bytes - m_budget);
+			if (m_residentBytes + bytes > m_budget) {
+				continue;
+			}
+		}
+		if (!GpuModelBuilder::UploadGeometry(model.m_meshes[meshIdx], m_data.m_meshes[meshIdx])) {
+			continue;
+		}
+		m_resident[meshIdx] = true;
+		m_residentBytes += bytes;
+		++m_residentCount;
+		uploaded += bytes;
+		changed = true;
+	}
+	m_requests.clear();
+
+	// The budget may have shrunk
+	if (m_residentBytes > m_budget) {
+		changed |= Evict(model, m_residentBytes - m_budget);
+	}
+	return changed;
+}
+
+bool GeometryStreamer::IsComplete() const
+{
+	return m_complete;
+}
+
+bool GeometryStreamer::IsResident(const Mesh& mesh)
+{
+	return mesh.m_vertexBuffer.isCreated();
+}
+
+int GeometryStreamer::MeshCount() const
+{
+	return int(m_bytes.size());
+}
+
+int GeometryStreamer::ResidentCount() const
+{
+	return m_residentCount;
+}
+
+qint64 GeometryStreamer::ResidentBytes() const
+{
+	return m_residentBytes;
+}
+
+qint64 GeometryStreamer::DataBytes() const
+{
+	qint64 bytes = 0;
+	for (qint64 meshBytes : m_bytes) {
+		bytes += meshBytes;
+	}
+	return bytes;
+}
+
+std::vector<int> GeometryStreamer::SelectEvictions(const std::vector<qint64>& bytes, const std::vector<quint64>& lastUsed, const std::vector<bool>& resident, quint64 frame, qint64 needed)
+{
+	std::vector<int> candidates;
+	for (int i = 0; i < int(bytes.size()); ++i) {
+		if (resident[i] && lastUsed[i] < frame) {
+			candidates.push_back(i);
+		}
+	}
+	std::stable_sort(candidates.begin(), candidates.end(), [&](int a, int b) {
+		return lastUsed[a] < lastUsed[b];
+	});
+
+	std::vector<int> ret;
+	qint64 freed = 0;
+	for (int meshIdx : candidates) {
+		if (freed >= needed) {
+			break;
+		}
+		ret.push_back(meshIdx);
+		freed += bytes[meshIdx];
+	}
+	return ret;
+}
+
+bool GeometryStreamer::Evict(Model& model, qint64 needed)
+{
+	const std::vector<int> evictions = SelectEvictions(m_bytes, m_lastUsed, m_resident, m_frame, needed);
+	for (int meshIdx : evictions) {
+		GpuModelBuilder::ReleaseGeometry(model.m_meshes[meshIdx]);
+		m_resident[meshIdx] = false;
+		m_residentBytes -= m_bytes[meshIdx];
+		--m_residentCount;
+	}
+	return !evictions.empty();
+}
@@ -0,0 +1,71 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+#include "ModelLoader.h"
+
+// Keeps the meshes of a model too big for GPU memory on the CPU side, and gives the ones in
+// view buffers within a fixed budget. Each frame the meshes in view are requested with the
+// size they cover on screen. Update uploads the largest missing ones first and frees the
+// buffers of the meshes out of view the longest to make room. Models read from the
+// ModelCache point into the mapped file, so the system pages their meshes in from disk as
+// they are uploaded and can drop them again afterwards.
+class GeometryStreamer
+{
+public:
+	// At most this much is uploaded per frame, so turning the view doesn't stall on streaming
+	static const qint64 k_frameUploadBytes = 32ll * 1024 * 1024;
+
+	// Takes the decoded meshes of a model whose meshes were built from them without geometry,
+	// in the same order
+	GeometryStreamer(ModelData data, qint64 budget);
+
+	// Bytes the vertex, index and instance buffers of mesh take once uploaded
+	static qint64 GeometryBytes(const MeshData& mesh);
+	static qint64 GeometryBytes(const ModelData& model);
+
+	// Applies from the next Update on
+	void SetBudget(qint64 budget);
+	qint64 Budget() const;
+
+	// Asks for the mesh to be resident this frame. Meshes with a larger priority, the size
+	// they cover on screen, are uploaded first.
+	void Request(int meshIdx, float priority);
+
+	// Uploads the requested meshes and frees others to stay within the budget, then drops the
+	// requests. The context of the model's buffers has to be current. Returns true if any mesh
+	// was uploaded or freed.
+	bool Update(Model& model);
+
+	// False while requested meshes that fit into the budget are still missing, because of the
+	// per frame upload limit
+	bool IsComplete() const;
+
+	// Whether mesh has its buffers, meshes without them are skipped when drawing
+	static bool IsResident(const Mesh& mesh);
+
+	int MeshCount() const;
+	int ResidentCount() const;
+	qint64 ResidentBytes() const;
+
+	// CPU memory of the decoded meshes kept to upload them again
+	qint64 DataBytes() const;
+
+	// Resident meshes not used in frame to free, least recently used first, until they add up
+	// to needed bytes or there are no more
+	static std::vector<int> SelectEvictions(const std::vector<qint64>& bytes, const std::vector<quint64>& lastUsed, const std::vector<bool>& resident, quint64 frame, qint64 needed);
+
+private:
+	bool Evict(Model& model, qint64 needed);
+
+	ModelData m_data;
+	qint64 m_budget = 0;
+	std::vector<qint64> m_bytes;
+	std::vector<quint64> m_lastUsed;
+	std::vector<bool> m_resident;
+	std::vector<std::pair<float, int>> m_requests;
+	qint64 m_residentBytes = 0;
+	int m_residentCount = 0;
+	quint64 m_frame = 0;
+	bool m_complete = true;
+};
@@ -0,0 +1,704 @@
+#include "GltfLoader.h"
+#include "BoundsMath.h"
+#include "ImportIOSystem.h"
+
+#include <assimp/scene.h>
+#include <assimp/pbrmaterial.h>
+
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QMatrix4x4>
+#include <QQuaternion>
+#include <QUrl>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <limits>
+#include <numeric>
+
+
+namespace {
+
+// Component types of accessors
+const int k_byte = 5120;
+const int k_unsignedByte = 5121;
+const int k_short = 5122;
+const int k_unsignedShort = 5123;
+const int k_unsignedInt = 5125;
+const int k_float = 5126;
+
+// Chunk types of a .glb, "JSON" and "BIN\0" read as little endian
+const quint32 k_jsonChunk = 0x4E4F534A;
+const quint32 k_binaryChunk = 0x004E4942;
+
+// Primitives of triangles, the only mode that is read
+const int k_triangles = 4;
+
+int ComponentSize(int componentType)
+{
+	switch (componentType) {
+	case k_byte:
+	case k_unsignedByte:
+		return 1;
+	case k_short:
+	case k_unsignedShort:
+		return 2;
+	case k_unsignedInt:
+	case k_float:
+		return 4;
+	}
+	return 0;
+}
+
+// The bytes of a data URI, or of a file next to the model
+QSharedPointer<const FileContents> ReadUri(const QString& folder, const QString& uri)
+{
+	if (uri.startsWith("data:")) {
+		return FileContents::FromBytes(QByteArray::fromBase64(uri.mid(uri.indexOf(',') + 1).toLatin1()));
+	}
+	const QString path = ImportIOSystem::ResolvePath(folder, QUrl::fromPercentEncoding(uri.toUtf8()));
+	return path.isEmpty() ? QSharedPointer<const FileContents>() : ImportIOSystem::Read(path);
+}
+
+}
+
+static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "Assimp's vectors are read in place as 3 floats");
+static_assert(sizeof(aiColor4D) == 4 * sizeof(float), "Assimp's colors are read in place as 4 floats");
+
+GltfLoader::~GltfLoader()
+{
+	Clear();
+}
+
+bool GltfLoader::IsGltfFile(const QString& file)
+{
+	const QString suffix = QFileInfo(file).suffix().toLower();
+	return suffix == "gltf" || suffix == "glb";
+}
+
+bool GltfLoader::Read(const QString& file)
+{
+	Clear();
+	m_pFile = ImportIOSystem::Read(file);
+	if (!m_pFile || m_pFile->Size() > std::numeric_limits<int>::max()) {
+		return Fail("The file can't be read");
+	}
+	m_folder = ImportIOSystem::Folder(file);
+
+	// A .glb is a 12 byte header followed by chunks of a length, a type and the data padded to
+	// 4 bytes. The JSON comes first, the binary chunk is the buffer without a uri.
+	const uchar* pData = m_pFile->Data();
+	const qint64 size = m_pFile->Size();
+	QByteArray json;
+	QSharedPointer<const FileContents> pBinary;
+	if (size >= 12 && std::memcmp(pData, "glTF", 4) == 0) {
+		quint32 version = 0;
+		std::memcpy(&version, pData + 4, sizeof(version));
+		if (version != 2) {
+			return Fail("Only glTF 2.0 is read");
+		}
+		for (qint64 offset = 12; offset + 8 <= size;) {
+			quint32 chunk[2];
+			std::memcpy(chunk, pData + offset, sizeof(chunk));
+			const qint64 begin = offset + 8;
+			if (begin + chunk[0] > size) {
+				return Fail("A chunk runs past the end of the file");
+			}
+			if (chunk[1] == k_jsonChunk && json.isEmpty()) {
+				json = QByteArray::fromRawData(reinterpret_cast<const char*>(pData + begin), int(chunk[0]));
+			}
+			else if (chunk[1] == k_binaryChunk && !pBinary) {
+				pBinary = FileContents::Slice(m_pFile, begin, chunk[0]);
+			}
+			offset = begin + ((qint64(chunk[0]) + 3) & ~qint64(3));
+		}
+	}
+	else {
+		json = QByteArray::fromRawData(reinterpret_cast<const char*>(pData), int(size));
+	}
+
+	QJsonParseError error;
+	m_json = QJsonDocument::fromJson(json, &error).object();
+	if (error.error != QJsonParseError::NoError) {
+		return Fail(error.errorString());
+	}
+	if (!m_json.value("asset").toObject()["version"].toString().startsWith("2.")) {
+		return Fail("Only glTF 2.0 is read");
+	}
+
+	// What the viewer only gets through Assimp's importer
+	if (!m_json.value("extensionsRequired").toArray().isEmpty()) {
+		return Fail("The file requires extensions");
+	}
+	for (const QJsonValue& extension : m_json.value("extensionsUsed").toArray()) {
+		if (extension.toString() == "KHR_lights_punctual" || extension.toString() == "KHR_materials_pbrSpecularGlossiness") {
+			return Fail(QString("The file uses %1").arg(extension.toString()));
+		}
+	}
+	if (!m_json.value("skins").toArray().isEmpty() || !m_json.value("animations").toArray().isEmpty()) {
+		return Fail("The file has skins or animations");
+	}
+
+	m_pScene.reset(new aiScene());
+	if (!ReadBuffers(pBinary) || !ReadImages() || !ReadMaterials() || !ReadMeshes()) {
+		return false;
+	}
+
+	// The root nodes of the scene shown hang off a root of their own
+	const QJsonArray scenes = m_json.value("scenes").toArray();
+	const int sceneIndex = m_json.value("scene").toInt(0);
+	if (sceneIndex < 0 || sceneIndex >= scenes.size()) {
+		return Fail("The file has no scene");
+	}
+	const QJsonArray roots = scenes[sceneIndex].toObject()["nodes"].toArray();
+	aiNode* pRoot = new aiNode("ROOT");
+	m_pScene->mRootNode = pRoot;
+	if (!roots.isEmpty()) {
+		pRoot->mChildren = new aiNode*[roots.size()]();
+		pRoot->mNumChildren = uint(roots.size());
+		for (int i = 0; i < roots.size(); ++i) {
+			if (!ReadNode(roots[i].toInt(-1), 1, pRoot->mChildren[i])) {
+				return false;
+			}
+			pRoot->mChildren[i]->mParent = pRoot;
+		}
+	}
+	m_read = true;
+	return true;
+}
+
+const QString& GltfLoader::FailureReason() const
+{
+	return m_reason;
+}
+
+aiScene const* GltfLoader::Scene() const
+{
+	return m_read ? m_pScene.get() : nullptr;
+}
+
+int GltfLoader::BorrowedArrays() const
+{
+	return m_borrowedArrays;
+}
+
+bool GltfLoader::Fail(const QString& reason)
+{
+	m_reason = reason;
+	return false;
+}
+
+void GltfLoader::Clear()
+{
+	if (m_pScene) {
+		for (uint i = 0; i < m_pScene->mNumMeshes; ++i) {
+			aiMesh* pMesh = m_pScene->mMeshes[i];
+			if (!pMesh) {
+				continue;
+			}
+			for (uint f = 0; f < pMesh->mNumFaces; ++f) {
+				pMesh->mFaces[f].mIndices = nullptr;
+			}
+			if (m_borrowed[i].m_vertices) {
+				pMesh->mVertices = nullptr;
+			}
+			if (m_borrowed[i].m_normals) {
+				pMesh->mNormals = nullptr;
+			}
+			if (m_borrowed[i].m_colors) {
+				pMesh->mColors[0] = nullptr;
+			}
+		}
+		for (uint i = 0; i < m_pScene->mNumTextures; ++i) {
+			m_pScene->mTextures[i]->pcData = nullptr;
+		}
+		m_pScene.reset();
+	}
+	m_json = QJsonObject();
+	m_folder.clear();
+	m_reason.clear();
+	m_pFile.clear();
+	m_buffers.clear();
+	m_indices.clear();
+	m_firstMesh.clear();
+	m_imagePaths.clear();
+	m_borrowed.clear();
+	m_borrowedArrays = 0;
+	m_read = false;
+}
+
+bool GltfLoader::ReadBuffers(const QSharedPointer<const FileContents>& pBinary)
+{
+	for (const QJsonValue& value : m_json.value("buffers").toArray()) {
+		const QJsonObject buffer = value.toObject();
+		const QString uri = buffer["uri"].toString();
+
+		// Only the first buffer of a .glb goes without a uri, it is the binary chunk
+		QSharedPointer<const FileContents> pContents;
+		if (!uri.isEmpty()) {
+			pContents = ReadUri(m_folder, uri);
+		}
+		else if (m_buffers.empty()) {
+			pContents = pBinary;
+		}
+		if (!pContents || pContents->Size() < qint64(buffer["byteLength"].toDouble())) {
+			return Fail(QString("Buffer %1 can't be read").arg(m_buffers.size()));
+		}
+		m_buffers.push_back(pContents);
+	}
+	return true;
+}
+
+bool GltfLoader::ReadAccessor(int index, Accessor& accessor)
+{
+	const QJsonArray accessors = m_json.value("accessors").toArray();
+	const QJsonArray views = m_json.value("bufferViews").toArray();
+	if (index < 0 || index >= accessors.size()) {
+		return Fail(QString("Accessor %1 doesn't exist").arg(index));
+	}
+
+	// Sparse accessors, and those without a view that are all zeros, are rare enough to be
+	// left to Assimp
+	const QJsonObject object = accessors[index].toObject();
+	const int viewIndex = object["bufferView"].toInt(-1);
+	if (object.contains("sparse") || viewIndex < 0 || viewIndex >= views.size()) {
+		return Fail(QString("Accessor %1 is sparse or has no buffer view").arg(index));
+	}
+	const QJsonObject view = views[viewIndex].toObject();
+	const int bufferIndex = view["buffer"].toInt(-1);
+	if (bufferIndex < 0 || bufferIndex >= int(m_buffers.size())) {
+		return Fail(QString("Buffer view %1 has no buffer").arg(viewIndex));
+	}
+
+	static const char* const k_types[] = { "SCALAR", "VEC2", "VEC3", "VEC4" };
+	const QString type = object["type"].toString();
+	accessor.m_components = 0;
+	for (int i = 0; i < 4; ++i) {
+		if (type == k_types[i]) {
+			accessor.m_components = i + 1;
+		}
+	}
+	accessor.m_componentType = object["componentType"].toInt();
+	accessor.m_count = object["count"].toInt(-1);
+	accessor.m_normalized = object["normalized"].toBool();
+	const int elementSize = accessor.m_components * ComponentSize(accessor.m_componentType);
+	accessor.m_stride = view["byteStride"].toInt(elementSize);
+
+	// The last element has to end within the view, and the view within the buffer
+	const qint64 viewOffset = qint64(view["byteOffset"].toDouble());
+	const qint64 viewLength = qint64(view["byteLength"].toDouble());
+	const qint64 offset = qint64(object["byteOffset"].toDouble());
+	if (elementSize == 0 || accessor.m_count < 0 || accessor.m_stride < elementSize
+		|| offset + qint64(accessor.m_stride) * std::max(accessor.m_count - 1, 0) + elementSize > viewLength
+		|| viewOffset + viewLength > m_buffers[bufferIndex]->Size()) {
+		return Fail(QString("Accessor %1 isn't within its buffer").arg(index));
+	}
+	accessor.m_pData = m_buffers[bufferIndex]->Data() + viewOffset + offset;
+	return true;
+}
+
+float GltfLoader::Component(const Accessor& accessor, int element, int component)
+{
+	const uchar* p = accessor.m_pData + qint64(element) * accessor.m_stride + component * ComponentSize(accessor.m_componentType);
+	switch (accessor.m_componentType) {
+	case k_byte: {
+		const qint8 val = qint8(p[0]);
+		return accessor.m_normalized ? std::max(val / 127.f, -1.f) : float(val);
+	}
+	case k_unsignedByte:
+		return accessor.m_normalized ? p[0] / 255.f : float(p[0]);
+	case k_short: {
+		qint16 val;
+		std::memcpy(&val, p, sizeof(val));
+		return accessor.m_normalized ? std::max(val / 32767.f, -1.f) : float(val);
+	}
+	case k_unsignedShort: {
+		quint16 val;
+		std::memcpy(&val, p, sizeof(val));
+		return accessor.m_normalized ? val / 65535.f : float(val);
+	}
+	case k_unsignedInt: {
+		quint32 val;
+		std::memcpy(&val, p, sizeof(val));
+		return float(val);
+	}
+	case k_float: {
+		float val;
+		std::memcpy(&val, p, sizeof(val));
+		return val;
+	}
+	}
+	return 0.f;
+}
+
+quint32 GltfLoader::Index(const Accessor& accessor, int element)
+{
+	const uchar* p = accessor.m_pData + qint64(element) * accessor.m_stride;
+	if (accessor.m_componentType == k_unsignedByte) {
+		return p[0];
+	}
+	if (accessor.m_componentType == k_unsignedShort) {
+		quint16 val;
+		std::memcpy(&val, p, sizeof(val));
+		return val;
+	}
+	quint32 val;
+	std::memcpy(&val, p, sizeof(val));
+	return val;
+}
+
+bool GltfLoader::IsPacked(const Accessor& accessor, int components)
+{
+	return accessor.m_componentType == k_float && accessor.m_components == components
+		&& accessor.m_stride == components * int(sizeof(float)) && quintptr(accessor.m_pData) % alignof(float) == 0;
+}
+
+bool GltfLoader::ReadImages()
+{
+	// Images in a buffer or a data URI become embedded textures, the others are files next to
+	// the model and are found the way Assimp's texture paths are
+	const QJsonArray images = m_json.value("images").toArray();
+	const QJsonArray views = m_json.value("bufferViews").toArray();
+	auto IsFile = [](const QJsonObject& image) {
+		const QString uri = image["uri"].toString();
+		return !uri.isEmpty() && !uri.startsWith("data:");
+	};
+	const int embeddedCount = int(std::count_if(images.begin(), images.end(), [&IsFile](const QJsonValue& value) { return !IsFile(value.toObject()); }));
+	if (embeddedCount > 0) {
+		m_pScene->mTextures = new aiTexture*[embeddedCount];
+		for (int i = 0; i < embeddedCount; ++i) {
+			m_pScene->mTextures[i] = new aiTexture();
+		}
+		m_pScene->mNumTextures = uint(embeddedCount);
+	}
+
+	uint embedded = 0;
+	for (int i = 0; i < images.size(); ++i) {
+		const QJsonObject image = images[i].toObject();
+		const QString uri = image["uri"].toString();
+		if (IsFile(image)) {
+			m_imagePaths.push_back(QUrl::fromPercentEncoding(uri.toUtf8()));
+			continue;
+		}
+
+		// The bytes of data URIs are kept with the buffers
+		const uchar* pData = nullptr;
+		qint64 size = 0;
+		if (!uri.isEmpty()) {
+			const QSharedPointer<const FileContents> pContents = ReadUri(m_folder, uri);
+			if (!pContents) {
+				return Fail(QString("Image %1 can't be read").arg(i));
+			}
+			m_buffers.push_back(pContents);
+			pData = pContents->Data();
+			size = pContents->Size();
+		}
+		else {
+			const int viewIndex = image["bufferView"].toInt(-1);
+			const QJsonObject view = (viewIndex >= 0 && viewIndex < views.size()) ? views[viewIndex].toObject() : QJsonObject();
+			const int bufferIndex = view["buffer"].toInt(-1);
+			const qint64 offset = qint64(view["byteOffset"].toDouble());
+			size = qint64(view["byteLength"].toDouble());
+			if (bufferIndex < 0 || bufferIndex >= int(m_buffers.size()) || offset + size > m_buffers[bufferIndex]->Size()) {
+				return Fail(QString("Image %1 isn't within its buffer").arg(i));
+			}
+			pData = m_buffers[bufferIndex]->Data() + offset;
+			++m_borrowedArrays;
+		}
+
+		// A compressed file of mWidth bytes, as Assimp keeps them
+		aiTexture* pTexture = m_pScene->mTextures[embedded];
+		pTexture->mWidth = uint(size);
+		pTexture->mHeight = 0;
+		pTexture->pcData = reinterpret_cast<aiTexel*>(const_cast<uchar*>(pData));
+		m_imagePaths.push_back(QString("*%1").arg(embedded++));
+	}
+	return true;
+}
+
+bool GltfLoader::ReadMaterials()
+{
+	// Every material is stored under the keys Assimp's glTF importer uses, followed by the
+	// default material of the primitives without one
+	const QJsonArray materials = m_json.value("materials").toArray();
+	const QJsonArray textures = m_json.value("textures").toArray();
+	const int materialCount = materials.size() + 1;
+	m_pScene->mMaterials = new aiMaterial*[materialCount];
+	for (int i = 0; i < materialCount; ++i) {
+		m_pScene->mMaterials[i] = new aiMaterial();
+	}
+	m_pScene->mNumMaterials = uint(materialCount);
+
+	auto AddTexture = [&](aiMaterial* pMaterial, const QJsonObject& info, aiTextureType type) {
+		const int texture = info["index"].toInt(-1);
+		const int image = (texture >= 0 && texture < textures.size()) ? textures[texture].toObject()["source"].toInt(-1) : -1;
+		if (image >= 0 && image < int(m_imagePaths.size())) {
+			const aiString path(m_imagePaths[image].toStdString());
+			pMaterial->AddProperty(&path, AI_MATKEY_TEXTURE(type, 0));
+		}
+	};
+
+	for (int i = 0; i < materialCount; ++i) {
+		const QJsonObject material = i < materials.size() ? materials[i].toObject() : QJsonObject();
+		const QJsonObject pbr = material["pbrMetallicRoughness"].toObject();
+		aiMaterial* pMaterial = m_pScene->mMaterials[i];
+
+		const aiString name(material["name"].toString().toStdString());
+		pMaterial->AddProperty(&name, AI_MATKEY_NAME);
+
+		const QJsonArray baseColorFactor = pbr["baseColorFactor"].toArray();
+		aiColor4D baseColor(1.f, 1.f, 1.f, 1.f);
+		if (baseColorFactor.size() == 4) {
+			baseColor = aiColor4D(float(baseColorFactor[0].toDouble()), float(baseColorFactor[1].toDouble()), float(baseColorFactor[2].toDouble()), float(baseColorFactor[3].toDouble()));
+		}
+		pMaterial->AddProperty(&baseColor, 1, AI_MATKEY_COLOR_DIFFUSE);
+		pMaterial->AddProperty(&baseColor, 1, AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_BASE_COLOR_FACTOR);
+		const float metallic = float(pbr["metallicFactor"].toDouble(1.0));
+		const float roughness = float(pbr["roughnessFactor"].toDouble(1.0));
+		pMaterial->AddProperty(&metallic, 1, AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_METALLIC_FACTOR);
+		pMaterial->AddProperty(&roughness, 1, AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_ROUGHNESS_FACTOR);
+
+		const QJsonArray emissiveFactor = material["emissiveFactor"].toArray();
+		if (emissiveFactor.size() == 3) {
+			const aiColor3D emissive(float(emissiveFactor[0].toDouble()), float(emissiveFactor[1].toDouble()), float(emissiveFactor[2].toDouble()));
+			pMaterial->AddProperty(&emissive, 1, AI_MATKEY_COLOR_EMISSIVE);
+		}
+
+		const aiString alphaMode(material["alphaMode"].toString("OPAQUE").toStdString());
+		const float alphaCutoff = float(material["alphaCutoff"].toDouble(0.5));
+		pMaterial->AddProperty(&alphaMode, AI_MATKEY_GLTF_ALPHAMODE);
+		pMaterial->AddProperty(&alphaCutoff, 1, AI_MATKEY_GLTF_ALPHACUTOFF);
+
+		AddTexture(pMaterial, pbr["baseColorTexture"].toObject(), aiTextureType_DIFFUSE);
+		AddTexture(pMaterial, pbr["metallicRoughnessTexture"].toObject(), aiTextureType_UNKNOWN);
+		AddTexture(pMaterial, material["normalTexture"].toObject(), aiTextureType_NORMALS);
+		AddTexture(pMaterial, material["occlusionTexture"].toObject(), aiTextureType_LIGHTMAP);
+		AddTexture(pMaterial, material["emissiveTexture"].toObject(), aiTextureType_EMISSIVE);
+	}
+	return true;
+}
+
+bool GltfLoader::ReadMeshes()
+{
+	// Each primitive is a mesh of its own, the meshes of a glTF mesh follow each other
+	const QJsonArray meshes = m_json.value("meshes").toArray();
+	uint meshCount = 0;
+	for (const QJsonValue& value : meshes) {
+		m_firstMesh.push_back(meshCount);
+		meshCount += uint(value.toObject()["primitives"].toArray().size());
+	}
+	m_borrowed.resize(meshCount);
+	m_pScene->mMeshes = new aiMesh*[meshCount]();
+	m_pScene->mNumMeshes = meshCount;
+	const uint defaultMaterial = m_pScene->mNumMaterials - 1;
+
+	for (int m = 0; m < meshes.size(); ++m) {
+		const QJsonObject mesh = meshes[m].toObject();
+		const QJsonArray primitives = mesh["primitives"].toArray();
+		for (int p = 0; p < primitives.size(); ++p) {
+			const QJsonObject primitive = primitives[p].toObject();
+			const QJsonObject attributes = primitive["attributes"].toObject();
+			const uint meshIdx = m_firstMesh[m] + uint(p);
+			Borrowed& borrowed = m_borrowed[meshIdx];
+			aiMesh* pMesh = new aiMesh();
+			m_pScene->mMeshes[meshIdx] = pMesh;
+
+			// Assimp triangulates the other modes and generates the normals glTF leaves out, flat
+			// or smooth as the import profile says. Blend shapes are posed through its skeleton.
+			if (primitive["mode"].toInt(k_triangles) != k_triangles) {
+				return Fail(QString("Mesh %1 has primitives other than triangles").arg(m));
+			}
+			if (!attributes.contains("NORMAL")) {
+				return Fail(QString("Mesh %1 has no normals").arg(m));
+			}
+			if (primitive.contains("targets")) {
+				return Fail(QString("Mesh %1 has blend shapes").arg(m));
+			}
+
+			const QString name = mesh["name"].toString();
+			pMesh->mName = aiString((primitives.size() > 1 ? QString("%1-%2").arg(name).arg(p) : name).toStdString());
+			pMesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+			const int material = primitive["material"].toInt(-1);
+			pMesh->mMaterialIndex = (material >= 0 && uint(material) < defaultMaterial) ? uint(material) : defaultMaterial;
+
+			// Float vectors are used where they are, anything else is converted
+			Accessor positions;
+			Accessor normals;
+			if (!ReadAccessor(attributes["POSITION"].toInt(-1), positions) || !ReadAccessor(attributes["NORMAL"].toInt(-1), normals)) {
+				return false;
+			}
+			const int vertexCount = positions.m_count;
+			if (positions.m_components != 3 || normals.m_components != 3 || normals.m_count != vertexCount) {
+				return Fail(QString("Mesh %1 has positions or normals that don't match").arg(m));
+			}
+			auto ReadVectors = [vertexCount](const Accessor& accessor, aiVector3D* pDest) {
+				for (int v = 0; v < vertexCount; ++v) {
+					pDest[v] = aiVector3D(Component(accessor, v, 0), Component(accessor, v, 1), Component(accessor, v, 2));
+				}
+				return pDest;
+			};
+			pMesh->mNumVertices = uint(vertexCount);
+			borrowed.m_vertices = IsPacked(positions, 3);
+			pMesh->mVertices = borrowed.m_vertices ? reinterpret_cast<aiVector3D*>(const_cast<uchar*>(positions.m_pData)) : ReadVectors(positions, new aiVector3D[vertexCount]);
+			borrowed.m_normals = IsPacked(normals, 3);
+			pMesh->mNormals = borrowed.m_normals ? reinterpret_cast<aiVector3D*>(const_cast<uchar*>(normals.m_pData)) : ReadVectors(normals, new aiVector3D[vertexCount]);
+			m_borrowedArrays += int(borrowed.m_vertices) + int(borrowed.m_normals);
+
+			// UVs are flipped to Assimp's lower left origin, so they always get a copy
+			if (attributes.contains("TEXCOORD_0")) {
+				Accessor uvs;
+				if (!ReadAccessor(attributes["TEXCOORD_0"].toInt(-1), uvs)) {
+					return false;
+				}
+				if (uvs.m_components != 2 || uvs.m_count != vertexCount) {
+					return Fail(QString("Mesh %1 has UVs that don't match").arg(m));
+				}
+				pMesh->mTextureCoords[0] = new aiVector3D[vertexCount];
+				pMesh->mNumUVComponents[0] = 2;
+				for (int v = 0; v < vertexCount; ++v) {
+					pMesh->mTextureCoords[0][v] = aiVector3D(Component(uvs, v, 0), 1.f - Component(uvs, v, 1), 0.f);
+				}
+			}
+
+			if (attributes.contains("COLOR_0")) {
+				Accessor colors;
+				if (!ReadAccessor(attributes["COLOR_0"].toInt(-1), colors)) {
+					return false;
+				}
+				if (colors.m_components < 3 || colors.m_count != vertexCount) {
+					return Fail(QString("Mesh %1 has colors that don't match").arg(m));
+				}
+				borrowed.m_colors = IsPacked(colors, 4);
+				if (borrowed.m_colors) {
+					pMesh->mColors[0] = reinterpret_cast<aiColor4D*>(const_cast<uchar*>(colors.m_pData));
+					++m_borrowedArrays;
+				}
+				else {
+					pMesh->mColors[0] = new aiColor4D[vertexCount];
+					for (int v = 0; v < vertexCount; ++v) {
+						const float alpha = colors.m_components == 4 ? Component(colors, v, 3) : 1.f;
+						pMesh->mColors[0][v] = aiColor4D(Component(colors, v, 0), Component(colors, v, 1), Component(colors, v, 2), alpha);
+					}
+				}
+			}
+
+			// The faces point into the indices, which are used in place when they are 32 bit
+			const quint32* pIndices = nullptr;
+			int indexCount = vertexCount;
+			if (primitive.contains("indices")) {
+				Accessor indices;
+				if (!ReadAccessor(primitive["indices"].toInt(-1), indices)) {
+					return false;
+				}
+				if (indices.m_components != 1 || (indices.m_componentType != k_unsignedByte && indices.m_componentType != k_unsignedShort && indices.m_componentType != k_unsignedInt)) {
+					return Fail(QString("Mesh %1 has indices of the wrong type").arg(m));
+				}
+				indexCount = indices.m_count;
+				if (indices.m_componentType == k_unsignedInt && indices.m_stride == int(sizeof(quint32)) && quintptr(indices.m_pData) % alignof(quint32) == 0) {
+					pIndices = reinterpret_cast<const quint32*>(indices.m_pData);
+					++m_borrowedArrays;
+				}
+				else {
+					m_indices.emplace_back(indexCount);
+					for (int i = 0; i < indexCount; ++i) {
+						m_indices.back()[i] = Index(indices, i);
+					}
+					pIndices = m_indices.back().data();
+				}
+			}
+			else {
+				m_indices.emplace_back(vertexCount);
+				std::iota(m_indices.back().begin(), m_indices.back().end(), 0u);
+				pIndices = m_indices.back().data();
+			}
+			if (indexCount % 3 != 0 || std::any_of(pIndices, pIndices + indexCount, [vertexCount](quint32 index) { return index >= quint32(vertexCount); })) {
+				return Fail(QString("Mesh %1 has indices out of range").arg(m));
+			}
+			pMesh->mFaces = new aiFace[indexCount / 3];
+			pMesh->mNumFaces = uint(indexCount / 3);
+			for (uint f = 0; f < pMesh->mNumFaces; ++f) {
+				pMesh->mFaces[f].mNumIndices = 3;
+				pMesh->mFaces[f].mIndices = const_cast<unsigned int*>(pIndices + 3 * f);
+			}
+
+			// The bounds Assimp's post-processing would generate
+			QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+			QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			if (vertexCount > 0) {
+				BoundsMath::AddPoints(&pMesh->mVertices[0].x, size_t(vertexCount), 3, min, max);
+			}
+			pMesh->mAABB = aiAABB(aiVector3D(min.x(), min.y(), min.z()), aiVector3D(max.x(), max.y(), max.z()));
+		}
+	}
+	return true;
+}
+
+bool GltfLoader::ReadNode(int index, int depth, aiNode*& pNode)
+{
+	// Every node is reached once, a path longer than there are nodes goes around a cycle
+	const QJsonArray nodes = m_json.value("nodes").toArray();
+	if (index < 0 || index >= nodes.size() || depth > nodes.size()) {
+		return Fail(QString("Node %1 doesn't exist or is its own ancestor").arg(index));
+	}
+	const QJsonObject node = nodes[index].toObject();
+	pNode = new aiNode(node["name"].toString().toStdString());
+
+	// The matrix is stored column major. Without one the node is translated, rotated and scaled.
+	QMatrix4x4 transform;
+	const QJsonArray matrix = node["matrix"].toArray();
+	if (matrix.size() == 16) {
+		float values[16];
+		for (int i = 0; i < 16; ++i) {
+			values[i] = float(matrix[i].toDouble());
+		}
+		transform = QMatrix4x4(values).transposed();
+	}
+	else {
+		const QJsonArray translation = node["translation"].toArray();
+		const QJsonArray rotation = node["rotation"].toArray();
+		const QJsonArray scale = node["scale"].toArray();
+		if (translation.size() == 3) {
+			transform.translate(float(translation[0].toDouble()), float(translation[1].toDouble()), float(translation[2].toDouble()));
+		}
+		if (rotation.size() == 4) {
+			transform.rotate(QQuaternion(float(rotation[3].toDouble()), float(rotation[0].toDouble()), float(rotation[1].toDouble()), float(rotation[2].toDouble())));
+		}
+		if (scale.size() == 3) {
+			transform.scale(float(scale[0].toDouble()), float(scale[1].toDouble()), float(scale[2].toDouble()));
+		}
+	}
+	pNode->mTransformation = aiMatrix4x4(transform(0, 0), transform(0, 1), transform(0, 2), transform(0, 3),
+		transform(1, 0), transform(1, 1), transform(1, 2), transform(1, 3),
+		transform(2, 0), transform(2, 1), transform(2, 2), transform(2, 3),
+		transform(3, 0), transform(3, 1), transform(3, 2), transform(3, 3));
+
+	// The node draws every primitive of its mesh
+	if (node.contains("mesh")) {
+		const int mesh = node["mesh"].toInt(-1);
+		if (mesh < 0 || mesh >= int(m_firstMesh.size())) {
+			return Fail(QString("Node %1 has no mesh %2").arg(index).arg(mesh));
+		}
+		const uint first = m_firstMesh[mesh];
+		const uint end = mesh + 1 < int(m_firstMesh.size()) ? m_firstMesh[mesh + 1] : m_pScene->mNumMeshes;
+		if (end > first) {
+			pNode->mMeshes = new unsigned int[end - first];
+			pNode->mNumMeshes = end - first;
+			std::iota(pNode->mMeshes, pNode->mMeshes + pNode->mNumMeshes, first);
+		}
+	}
+
+	const QJsonArray children = node["children"].toArray();
+	if (!children.isEmpty()) {
+		pNode->mChildren = new aiNode*[children.size()]();
+		pNode->mNumChildren = uint(children.size());
+		for (int i = 0; i < children.size(); ++i) {
+			if (!ReadNode(children[i].toInt(-1), depth + 1, pNode->mChildren[i])) {
+				return false;
+			}
+			pNode->mChildren[i]->mParent = pNode;
+		}
+	}
+	return true;
+}
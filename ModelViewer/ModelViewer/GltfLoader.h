@@ -0,0 +1,101 @@
+#pragma once
+#include "FileContents.h"
+
+#include <QJsonObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+struct aiScene;
+struct aiNode;
+
+// Reads glTF 2.0 files, .gltf with their buffers and .glb, straight into an aiScene for
+// ModelLoader::DecodeModel, without Assimp's importer or its post-processing. glTF is already
+// indexed triangles with normals, which is what the post-processing would make of it. Vertex
+// arrays stored the way Assimp stores them, tightly packed float positions, normals and RGBA
+// colors, point into the file's buffers instead of being copied, as do 32 bit indices and
+// embedded images. Other component types are converted.
+// Files using what only Assimp's importer gives the viewer, such as skins, animations, blend
+// shapes, lights, specular-glossiness materials or primitives other than triangles, aren't
+// read, Read() returns false and they are imported as before.
+class GltfLoader
+{
+public:
+	GltfLoader() = default;
+	~GltfLoader();
+	GltfLoader(const GltfLoader&) = delete;
+	GltfLoader& operator=(const GltfLoader&) = delete;
+
+	// By the suffix, .gltf or .glb
+	static bool IsGltfFile(const QString& file);
+
+	// False if the file can't be read this way, FailureReason() then says why. Reading
+	// another file frees the scene of the last one.
+	bool Read(const QString& file);
+	const QString& FailureReason() const;
+
+	// The scene read, null unless Read() succeeded. It points into the loader's buffers and
+	// lives as long as the loader.
+	aiScene const* Scene() const;
+
+	// Vertex, index and image arrays of the scene used in place rather than copied
+	int BorrowedArrays() const;
+
+private:
+	// A view of an accessor's elements in its buffer
+	struct Accessor {
+		const uchar* m_pData = nullptr;
+		int m_count = 0;
+		int m_components = 0;
+		int m_componentType = 0;
+		int m_stride = 0;
+		bool m_normalized = false;
+	};
+
+	// Arrays of a mesh that point into the buffers. They are detached before the scene is
+	// deleted, which would free them. Faces always point into the buffers or m_indices.
+	struct Borrowed {
+		bool m_vertices = false;
+		bool m_normals = false;
+		bool m_colors = false;
+	};
+
+	bool Fail(const QString& reason);
+	void Clear();
+	bool ReadBuffers(const QSharedPointer<const FileContents>& pBinary);
+	bool ReadAccessor(int index, Accessor& accessor);
+
+	// A component of an element as a float, normalized integers scaled to their range
+	static float Component(const Accessor& accessor, int element, int component);
+	static quint32 Index(const Accessor& accessor, int element);
+
+	// Whether the elements are arrays of components floats one after the other, as Assimp
+	// stores its vectors and colors
+	static bool IsPacked(const Accessor& accessor, int components);
+
+	bool ReadMeshes();
+	bool ReadMaterials();
+	bool ReadImages();
+	bool ReadNode(int index, int depth, aiNode*& pNode);
+
+	QJsonObject m_json;
+	QString m_folder;
+	QString m_reason;
+	QSharedPointer<const FileContents> m_pFile;
+	std::vector<QSharedPointer<const FileContents>> m_buffers;
+
+	// Index arrays converted to 32 bits, or made up for primitives without indices
+	std::vector<std::vector<quint32>> m_indices;
+
+	// The first mesh of the scene made from each glTF mesh, one per primitive, and the path
+	// each image is referenced by, "*<index>" for the embedded ones
+	std::vector<uint> m_firstMesh;
+	std::vector<QString> m_imagePaths;
+
+	std::unique_ptr<aiScene> m_pScene;
+	std::vector<Borrowed> m_borrowed;
+	int m_borrowedArrays = 0;
+	bool m_read = false;
+};
@@ -0,0 +1,708 @@
+#include "GpuModelBuilder.h"
+#include "Animation.h"
+#include "MeshSimplifier.h"
+#include "NormalGenerator.h"
+#include "UniformBlocks.h"
+#include "VirtualTextures.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+// Packs a normal into GL_INT_2_10_10_10_REV like ModelLoader does, x in the lowest bits
+quint32 PackSnorm10(const float* pNormal)
+{
+	auto Pack = [](float val) {
+		return quint32(qRound(qBound(-1.f, val, 1.f) * 511.f)) & 0x3FF;
+	};
+	return Pack(pNormal[0]) | (Pack(pNormal[1]) << 10) | (Pack(pNormal[2]) << 20);
+}
+
+// The position of vertex v in vertices read back from the mesh's buffer, in the mesh's space
+QVector3D DecodePosition(const Mesh& mesh, const char* pVertices, size_t v, size_t positionStride)
+{
+	const char* pSrc = pVertices + mesh.m_positionOffset + v * positionStride;
+	if (mesh.m_positionType == GL_UNSIGNED_SHORT) {
+		quint16 q[3];
+		std::memcpy(q, pSrc, sizeof(q));
+		return mesh.m_positionDecode.map(QVector3D(q[0], q[1], q[2]) / 65535.f);
+	}
+	float position[3];
+	std::memcpy(position, pSrc, sizeof(position));
+	return QVector3D(position[0], position[1], position[2]);
+}
+
+} // namespace
+
+std::vector<QSharedPointer<const Material>> GpuModelBuilder::BuildMaterials(const ModelData& data, TextureCache& textures, TextureUploader* pUploader)
+{
+	std::vector<QSharedPointer<const Material>> ret;
+	ret.reserve(data.m_materials.size());
+	for (const MaterialData& materialData : data.m_materials) {
+		QSharedPointer<Material> material(new Material());
+		material->m_name = materialData.m_name;
+		material->m_properties = materialData.m_properties;
+
+		// Upload the maps, unless another material already did
+		for (int map = 0; map < k_materialMapCount; ++map) {
+			const TextureData& texture = materialData.m_maps[map];
+			if (!texture.m_compressed.isNull()) {
+				material->m_maps[map] = textures.Get(texture.m_key, texture.m_compressed);
+			}
+			else if (!texture.m_image.isNull()) {
+				material->m_maps[map] = textures.Get(texture.m_key, texture.m_image, pUploader);
+			}
+			material->m_handles[map] = textures.Handle(material->m_maps[map]);
+		}
+
+		// The tail of a paged base color map is the map, its pages are streamed in as needed
+		const TextureData& baseColor = materialData.m_maps[k_baseColorMap];
+		if (!baseColor.m_pageFile.isEmpty() && !material->m_maps[k_baseColorMap].isNull() && textures.Virtual()) {
+			material->m_virtualBaseColor = textures.Virtual()->Get(baseColor.m_pageFile);
+		}
+		UploadMaterial(*material);
+		ret.push_back(material);
+	}
+	return ret;
+}
+
+QSharedPointer<const Material> GpuModelBuilder::WithBaseColorMap(const Material& material, const QSharedPointer<QOpenGLTexture>& texture, TextureCache& textures)
+{
+	// The copy needs a buffer of its own, the original one stays with the original material
+	QSharedPointer<Material> ret(new Material(material));
+	if (!texture.isNull()) {
+		ret->m_maps[k_baseColorMap] = texture;
+		ret->m_handles[k_baseColorMap] = textures.Handle(texture);
+		ret->m_virtualBaseColor.reset();
+	}
+	ret->m_buffer = QOpenGLBuffer();
+	UploadMaterial(*ret);
+	return ret;
+}
+
+void GpuModelBuilder::UploadMaterial(Material& material)
+{
+	// The material goes into a uniform buffer once, draws only bind it. Buffers have no fixed
+	// type in OpenGL, the vertex buffer target is just used to upload it.
+	if (!UniformBlocks::SupportsUniformBuffers()) {
+		return;
+	}
+	const MaterialProperties& properties = material.m_properties;
+	MaterialBlock block = {};
+	std::copy(properties.m_ambient, properties.m_ambient + 4, block.m_ambient);
+	std::copy(properties.m_diffuse, properties.m_diffuse + 4, block.m_diffuse);
+	std::copy(properties.m_specular, properties.m_specular + 4, block.m_specular);
+	block.m_shininess = properties.m_shininess;
+	block.m_hasTexture = material.m_maps[k_baseColorMap].isNull() ? 0.f : 1.f;
+	block.m_metallic = properties.m_metallic;
+	block.m_roughness = properties.m_roughness;
+	for (int i = 0; i < 4; ++i) {
+		block.m_baseColor[i] = properties.m_baseColor[i];
+	}
+	for (int i = 0; i < 3; ++i) {
+		block.m_emissive[i] = properties.m_emissive[i];
+	}
+	for (int map = 0; map < k_materialMapCount; ++map) {
+		if (!material.m_maps[map].isNull()) {
+			block.m_maps |= 1 << map;
+		}
+		block.m_handles[map / 2][(map % 2) * 2] = GLuint(material.m_handles[map]);
+		block.m_handles[map / 2][(map % 2) * 2 + 1] = GLuint(material.m_handles[map] >> 32);
+	}
+	if (material.m_virtualBaseColor) {
+		block.m_maps |= UniformBlocks::k_virtualMapBit;
+		material.m_virtualBaseColor->Parameters(block.m_virtual);
+	}
+	block.m_metallicRoughness = properties.m_metallicRoughness ? 1 : 0;
+	block.m_alphaMode = properties.m_alphaMode;
+	block.m_alphaCutoff = properties.m_alphaCutoff;
+
+	material.m_buffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	if (material.m_buffer.create()) {
+		material.m_buffer.bind();
+		material.m_buffer.allocate(&block, sizeof(block));
+		material.m_buffer.release();
+	}
+}
+
+Mesh GpuModelBuilder::BuildMesh(const MeshData& data, const std::vector<QSharedPointer<const Material>>& materials, GeometryArena* pArena, bool uploadGeometry)
+{
+	Mesh newMesh;
+	newMesh.m_name = data.m_name;
+
+	// Point at the material, meshes without one get a blank one of their own
+	if (data.m_material >= 0 && size_t(data.m_material) < materials.size()) {
+		newMesh.m_material = materials[data.m_material];
+	}
+	else {
+		QSharedPointer<Material> blank(new Material());
+		UploadMaterial(*blank);
+		newMesh.m_material = blank;
+	}
+	newMesh.m_hasTexture = !newMesh.m_material->m_maps[k_baseColorMap].isNull();
+
+	// Copy the vertex layout
+	newMesh.m_hasNormals = data.m_hasNormals;
+	newMesh.m_hasUVCoordinates = data.m_hasUVCoordinates;
+	newMesh.m_hasColors = data.m_hasColors;
+	newMesh.m_vertexStride = data.m_vertexStride;
+	newMesh.m_positionOffset = data.m_positionOffset;
+	newMesh.m_normalOffset = data.m_normalOffset;
+	newMesh.m_uvOffset = data.m_uvOffset;
+	newMesh.m_colorOffset = data.m_colorOffset;
+	newMesh.m_numPositionComponents = data.m_numPositionComponents;
+	newMesh.m_numNormalComponents = data.m_numNormalComponents;
+	newMesh.m_numUVComponents = data.m_numUVComponents;
+	newMesh.m_numColorComponents = data.m_numColorComponents;
+	newMesh.m_positionType = data.m_positionType;
+	newMesh.m_normalType = data.m_normalType;
+	newMesh.m_uvType = data.m_uvType;
+	newMesh.m_colorType = data.m_colorType;
+	newMesh.m_positionDecode = data.m_positionDecode;
+	if (data.m_hasNormals) {
+		newMesh.m_normalStreams.reset(new NormalStreams());
+	}
+	newMesh.m_hasBones = data.m_hasBones;
+	newMesh.m_boneIndexOffset = data.m_boneIndexOffset;
+	newMesh.m_boneWeightOffset = data.m_boneWeightOffset;
+	newMesh.m_bones = data.m_bones;
+	newMesh.m_morphTargets = data.m_morphTargets;
+	newMesh.m_morphNode = data.m_morphNode;
+	for (const MorphTarget& target : data.m_morphTargets) {
+		newMesh.m_morphWeights.push_back(target.m_weight);
+	}
+
+	newMesh.m_indexCount = data.m_indexCount;
+	newMesh.m_indexType = data.m_indexType;
+	newMesh.m_lods = data.m_lods;
+	newMesh.m_meshlets = data.m_meshlets;
+
+	// Separate attribute blocks start with the positions, so their size gives the vertex count
+	const int positionBytes = data.m_numPositionComponents * (data.m_positionType == GL_UNSIGNED_SHORT ? int(sizeof(GLushort)) : int(sizeof(GLfloat)));
+	if (data.m_vertexStride > 0) {
+		newMesh.m_vertexCount = data.m_vertexData.size() / data.m_vertexStride;
+	}
+	else if (positionBytes > 0) {
+		newMesh.m_vertexCount = int(data.m_normalOffset) / positionBytes;
+	}
+
+	newMesh.m_transform = data.m_transform;
+	newMesh.m_AABBMin = data.m_AABBMin;
+	newMesh.m_AABBMax = data.m_AABBMax;
+	newMesh.m_instanceTransforms = data.m_instanceTransforms;
+	newMesh.m_nodes = data.m_nodes;
+	newMesh.m_vertexBytes = data.m_vertexData.size();
+	newMesh.m_indexBytes = data.m_indexData.size();
+
+	if (uploadGeometry && !UploadGeometry(newMesh, data, pArena)) {
+		return Mesh();
+	}
+
+	// Skinned meshes start out with every bone matrix at identity, the viewer poses them.
+	// Without uniform buffers they are drawn at rest.
+	if (newMesh.m_hasBones && UniformBlocks::SupportsUniformBuffers()) {
+		newMesh.m_boneBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+		newMesh.m_boneBuffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+		if (newMesh.m_boneBuffer.create()) {
+			UploadBonePalette(newMesh, std::vector<QMatrix4x4>(newMesh.m_bones.size()));
+		}
+	}
+
+	// Blend shapes are only read by a ComputeSkinner, which binds them as a storage buffer
+	if (!data.m_morphData.isEmpty()) {
+		newMesh.m_morphBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+		if (newMesh.m_morphBuffer.create()) {
+			newMesh.m_morphBuffer.bind();
+			newMesh.m_morphBuffer.allocate(data.m_morphData.constData(), data.m_morphData.size());
+			newMesh.m_morphBuffer.release();
+		}
+	}
+
+	return newMesh;
+}
+
+bool GpuModelBuilder::UploadGeometry(Mesh& mesh, const MeshData& data, GeometryArena* pArena)
+{
+	// The vertex data is already packed, upload it in one go. Meshes the arena can't take get
+	// buffers of their own.
+	if (!pArena || !pArena->Allocate(mesh, data.m_vertexData, data.m_indexData)) {
+		mesh.m_vertexBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+		mesh.m_indexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+		if (!mesh.m_vertexBuffer.create() || !mesh.m_indexBuffer.create()) {
+			mesh.m_vertexBuffer = QOpenGLBuffer();
+			mesh.m_indexBuffer = QOpenGLBuffer();
+			return false;
+		}
+		mesh.m_vertexBuffer.bind();
+		mesh.m_vertexBuffer.allocate(data.m_vertexData.constData(), data.m_vertexData.size());
+		mesh.m_vertexBuffer.release();
+		mesh.m_indexBuffer.bind();
+		mesh.m_indexBuffer.allocate(data.m_indexData.constData(), data.m_indexData.size());
+		mesh.m_indexBuffer.release();
+	}
+
+	// Upload the instance transforms. Quantized positions are decoded before the instance
+	// transform, which the instance attribute cannot express, so those meshes are drawn
+	// one instance at a time instead.
+	const bool instanced = !mesh.m_instanceTransforms.empty() && mesh.m_positionDecode.isIdentity() && SupportsInstancing();
+	if (instanced) {
+		std::vector<GLfloat> transforms;
+		transforms.reserve(mesh.m_instanceTransforms.size() * 16);
+		for (const QMatrix4x4& transform : mesh.m_instanceTransforms) {
+			transforms.insert(transforms.end(), transform.constData(), transform.constData() + 16);
+		}
+		mesh.m_instanceBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+		if (mesh.m_instanceBuffer.create()) {
+			mesh.m_instanceBuffer.bind();
+			mesh.m_instanceBuffer.allocate(transforms.data(), static_cast<int>(transforms.size() * sizeof(GLfloat)));
+			mesh.m_instanceBuffer.release();
+		}
+	}
+
+	// Record the buffer bindings and attribute setup, so drawing the mesh only needs the
+	// vertex array object. Without vertex array object support the mesh is set up every draw.
+	QSharedPointer<QOpenGLVertexArrayObject> vao(new QOpenGLVertexArrayObject());
+	if (vao->create()) {
+		vao->bind();
+		mesh.m_vertexBuffer.bind();
+		mesh.m_indexBuffer.bind();
+		EnableAttributes(QOpenGLContext::currentContext()->functions(), mesh);
+		if (mesh.m_instanceBuffer.isCreated()) {
+			EnableInstanceAttributes(QOpenGLContext::currentContext()->extraFunctions(), mesh);
+		}
+		vao->release();
+		mesh.m_vertexBuffer.release();
+		mesh.m_indexBuffer.release();
+		mesh.m_vao = vao;
+	}
+	return true;
+}
+
+void GpuModelBuilder::ReleaseGeometry(Mesh& mesh)
+{
+	// Copies of the mesh share its buffers, and lose them too
+	mesh.m_vao.reset();
+	mesh.m_vertexBuffer.destroy();
+	mesh.m_indexBuffer.destroy();
+	mesh.m_instanceBuffer.destroy();
+	mesh.m_vertexBuffer = QOpenGLBuffer();
+	mesh.m_indexBuffer = QOpenGLBuffer();
+	mesh.m_instanceBuffer = QOpenGLBuffer();
+	mesh.m_instanced = false;
+
+	// Uploading the mesh again brings back the normals it was loaded with
+	if (mesh.m_normalStreams) {
+		mesh.m_normalStreams->m_smoothed = false;
+	}
+}
+
+Model GpuModelBuilder::BuildModel(const ModelData& data, TextureCache& textures)
+{
+	Model ret;
+	ret.m_meshes.reserve(data.m_meshes.size());
+	ret.m_geometry.reset(new GeometryArena());
+	ret.m_materials = BuildMaterials(data, textures);
+
+	for (const MeshData& mesh : data.m_meshes) {
+		ret.m_meshes.emplace_back(BuildMesh(mesh, ret.m_materials, ret.m_geometry.data()));
+	}
+
+	ret.m_skeleton = data.m_skeleton;
+	ret.m_sceneGraph = data.m_sceneGraph;
+	ret.m_lights = data.m_lights;
+	ret.m_origin = data.m_origin;
+
+	// Data that wasn't decoded by the loader, such as a proxy, isn't counted yet
+	ret.m_stats = data.m_stats.m_meshStats.size() == data.m_meshes.size() ? data.m_stats : ModelStats::Compute(data);
+	ret.Finalize();
+	return ret;
+}
+
+void GpuModelBuilder::BindAttributeLocations(QOpenGLShaderProgram* pProgram)
+{
+	pProgram->bindAttributeLocation("posAttr", k_positionLocation);
+	pProgram->bindAttributeLocation("colAttr", k_colorLocation);
+	pProgram->bindAttributeLocation("normAttr", k_normalLocation);
+	pProgram->bindAttributeLocation("uvAttr", k_uvLocation);
+	pProgram->bindAttributeLocation("instanceAttr", k_instanceLocation);
+	pProgram->bindAttributeLocation("boneIndexAttr", k_boneIndexLocation);
+	pProgram->bindAttributeLocation("boneWeightAttr", k_boneWeightLocation);
+}
+
+void GpuModelBuilder::EnableAttributes(QOpenGLFunctions* f, const Mesh& mesh)
+{
+	// Integer attributes are quantized and have to be normalized to floats
+	auto IsNormalized = [](GLenum type) {
+		return (type == GL_FLOAT || type == GL_HALF_FLOAT) ? GL_FALSE : GL_TRUE;
+	};
+
+	// Positions
+	f->glVertexAttribPointer(k_positionLocation, mesh.m_numPositionComponents, mesh.m_positionType, IsNormalized(mesh.m_positionType), mesh.m_vertexStride, (void*)mesh.m_positionOffset);
+	f->glEnableVertexAttribArray(k_positionLocation);
+
+	// Normals
+	if (mesh.m_hasNormals) {
+		f->glVertexAttribPointer(k_normalLocation, mesh.m_numNormalComponents, mesh.m_normalType, IsNormalized(mesh.m_normalType), mesh.m_vertexStride, (void*)mesh.m_normalOffset);
+		f->glEnableVertexAttribArray(k_normalLocation);
+	}
+
+	// UV Coords
+	if (mesh.m_hasUVCoordinates) {
+		f->glVertexAttribPointer(k_uvLocation, mesh.m_numUVComponents, mesh.m_uvType, IsNormalized(mesh.m_uvType), mesh.m_vertexStride, (void*)mesh.m_uvOffset);
+		f->glEnableVertexAttribArray(k_uvLocation);
+	}
+
+	// Colors
+	if (mesh.m_hasColors) {
+		f->glVertexAttribPointer(k_colorLocation, mesh.m_numColorComponents, mesh.m_colorType, IsNormalized(mesh.m_colorType), mesh.m_vertexStride, (void*)mesh.m_colorOffset);
+		f->glEnableVertexAttribArray(k_colorLocation);
+	}
+
+	// Bones, the indices are whole numbers and the weights are normalized
+	if (mesh.m_hasBones) {
+		f->glVertexAttribPointer(k_boneIndexLocation, 4, GL_UNSIGNED_BYTE, GL_FALSE, mesh.m_vertexStride, (void*)mesh.m_boneIndexOffset);
+		f->glEnableVertexAttribArray(k_boneIndexLocation);
+		f->glVertexAttribPointer(k_boneWeightLocation, 4, GL_UNSIGNED_BYTE, GL_TRUE, mesh.m_vertexStride, (void*)mesh.m_boneWeightOffset);
+		f->glEnableVertexAttribArray(k_boneWeightLocation);
+	}
+}
+
+void GpuModelBuilder::DisableAttributes(QOpenGLFunctions* f, const Mesh& mesh)
+{
+	if (mesh.m_hasBones) {
+		f->glDisableVertexAttribArray(k_boneIndexLocation);
+		f->glDisableVertexAttribArray(k_boneWeightLocation);
+	}
+	if (mesh.m_hasColors) {
+		f->glDisableVertexAttribArray(k_colorLocation);
+	}
+	if (mesh.m_hasNormals) {
+		f->glDisableVertexAttribArray(k_normalLocation);
+	}
+	if (mesh.m_hasUVCoordinates) {
+		f->glDisableVertexAttribArray(k_uvLocation);
+	}
+
+	f->glDisableVertexAttribArray(k_positionLocation);
+}
+
+void GpuModelBuilder::DrawElements(QOpenGLExtraFunctions* f, const Mesh& mesh, int firstIndex, int count, int instanceCount, GLenum mode)
+{
+	const int indexSize = (mesh.m_indexType == GL_UNSIGNED_SHORT) ? sizeof(GLushort) : sizeof(GLuint);
+	const void* pIndices = reinterpret_cast<const void*>(size_t(mesh.m_indexOffset) + size_t(firstIndex) * indexSize);
+	if (mesh.m_sharesBuffers) {
+		if (instanceCount > 0) {
+			f->glDrawElementsInstancedBaseVertex(mode, count, mesh.m_indexType, pIndices, instanceCount, mesh.m_baseVertex);
+		}
+		else {
+			f->glDrawElementsBaseVertex(mode, count, mesh.m_indexType, pIndices, mesh.m_baseVertex);
+		}
+	}
+	else if (instanceCount > 0) {
+		f->glDrawElementsInstanced(mode, count, mesh.m_indexType, pIndices, instanceCount);
+	}
+	else {
+		f->glDrawElements(mode, count, mesh.m_indexType, pIndices);
+	}
+}
+
+void GpuModelBuilder::DrawPoints(QOpenGLExtraFunctions* f, const Mesh& mesh, int instanceCount)
+{
+	// The base vertex of a shared buffer is where the mesh's vertices start
+	if (instanceCount > 0) {
+		f->glDrawArraysInstanced(GL_POINTS, mesh.m_baseVertex, mesh.m_vertexCount, instanceCount);
+	}
+	else {
+		f->glDrawArrays(GL_POINTS, mesh.m_baseVertex, mesh.m_vertexCount);
+	}
+}
+
+bool GpuModelBuilder::SupportsInstancing()
+{
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext) {
+		return false;
+	}
+	const QPair<int, int> version = pContext->format().version();
+	return version >= (pContext->isOpenGLES() ? qMakePair(3, 0) : qMakePair(3, 3));
+}
+
+void GpuModelBuilder::UploadBonePalette(Mesh& mesh, const std::vector<QMatrix4x4>& palette)
+{
+	if (!mesh.m_boneBuffer.isCreated()) {
+		return;
+	}
+
+	// QMatrix4x4 is stored column major like a std140 mat4. The block always takes the most
+	// bones a mesh can have, so its size matches the declaration.
+	const size_t count = std::min(palette.size(), size_t(AnimationPlayer::k_maxBones));
+	std::vector<GLfloat> matrices(size_t(AnimationPlayer::k_maxBones) * 16, 0.f);
+	for (size_t i = 0; i < count; ++i) {
+		std::copy(palette[i].constData(), palette[i].constData() + 16, matrices.begin() + i * 16);
+	}
+	mesh.m_boneBuffer.bind();
+	if (mesh.m_boneBuffer.size() != int(matrices.size() * sizeof(GLfloat))) {
+		mesh.m_boneBuffer.allocate(matrices.data(), int(matrices.size() * sizeof(GLfloat)));
+	}
+	else {
+		mesh.m_boneBuffer.write(0, matrices.data(), int(count * 16 * sizeof(GLfloat)));
+	}
+	mesh.m_boneBuffer.release();
+}
+
+void GpuModelBuilder::UploadInstanceTransform(Mesh& mesh, int instance, const QMatrix4x4& transform)
+{
+	const int bytes = 16 * int(sizeof(GLfloat));
+	if (!mesh.m_instanceBuffer.isCreated() || (instance + 1) * bytes > mesh.m_instanceBuffer.size()) {
+		return;
+	}
+	mesh.m_instanceBuffer.bind();
+	mesh.m_instanceBuffer.write(instance * bytes, transform.constData(), bytes);
+	mesh.m_instanceBuffer.release();
+}
+
+bool GpuModelBuilder::SetDrawHidden(Mesh& mesh, int draw, bool hidden)
+{
+	if (mesh.m_hiddenDraws.empty()) {
+		if (!hidden) {
+			return false;
+		}
+		mesh.m_hiddenDraws.assign(size_t(mesh.DrawCount()), false);
+	}
+	if (mesh.m_hiddenDraws[draw] == hidden) {
+		return false;
+	}
+	mesh.m_hiddenDraws[draw] = hidden;
+	mesh.m_hiddenDrawCount += hidden ? 1 : -1;
+	return true;
+}
+
+void GpuModelBuilder::VisibleRuns(const Mesh& mesh, std::vector<std::pair<int, int>>& runs)
+{
+	runs.clear();
+	const int drawCount = mesh.DrawCount();
+	if (mesh.m_hiddenDrawCount == 0) {
+		runs.emplace_back(0, drawCount);
+		return;
+	}
+	for (int draw = 0; draw < drawCount;) {
+		if (mesh.m_hiddenDraws[draw]) {
+			++draw;
+			continue;
+		}
+		const int first = draw;
+		while (draw < drawCount && !mesh.m_hiddenDraws[draw]) {
+			++draw;
+		}
+		runs.emplace_back(first, draw - first);
+	}
+}
+
+void GpuModelBuilder::SetFirstInstance(QOpenGLExtraFunctions* f, Mesh& mesh, int firstInstance)
+{
+	// Base instances need OpenGL 4.2, moving the start of the attribute works everywhere
+	const size_t start = size_t(firstInstance) * 16 * sizeof(GLfloat);
+	mesh.m_instanceBuffer.bind();
+	for (GLuint column = 0; column < 4; ++column) {
+		f->glVertexAttribPointer(k_instanceLocation + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), (void*)(start + column * 4 * sizeof(GLfloat)));
+	}
+	mesh.m_instanceBuffer.release();
+}
+
+bool GpuModelBuilder::SmoothNormals(Mesh& mesh, bool smooth)
+{
+	const bool floatNormals = mesh.m_normalType == GL_FLOAT;
+	if (!mesh.m_normalStreams || !mesh.m_hasNormals || mesh.m_hasBones || !mesh.m_vertexBuffer.isCreated() || !mesh.m_indexBuffer.isCreated()
+		|| mesh.m_numPositionComponents < 3 || mesh.m_vertexCount <= 0 || (!floatNormals && mesh.m_normalType != GL_INT_2_10_10_10_REV)) {
+		return false;
+	}
+	NormalStreams& streams = *mesh.m_normalStreams;
+	if (streams.m_smoothed == smooth) {
+		return true;
+	}
+
+	// Separate attribute blocks hold one normal after the other
+	const bool quantized = mesh.m_positionType == GL_UNSIGNED_SHORT;
+	const size_t count = size_t(mesh.m_vertexCount);
+	const size_t normalSize = floatNormals ? 3 * sizeof(GLfloat) : sizeof(GLuint);
+	const size_t positionStride = mesh.m_vertexStride > 0 ? size_t(mesh.m_vertexStride) : mesh.m_numPositionComponents * (quantized ? sizeof(GLushort) : sizeof(GLfloat));
+	const size_t normalStride = mesh.m_vertexStride > 0 ? size_t(mesh.m_vertexStride) : normalSize;
+	if (mesh.m_normalOffset + (count - 1) * normalStride + normalSize > size_t(mesh.m_vertexBytes)) {
+		return false;
+	}
+
+	// The vertices of the mesh, from the start of its range when it shares a page. A block of
+	// normals alone is written as it is kept, without reading anything back.
+	const int vertexStart = mesh.m_sharesBuffers ? mesh.m_baseVertex * mesh.m_vertexStride : 0;
+	if (mesh.m_vertexStride <= 0 && !streams.m_loaded.isEmpty() && !(smooth && streams.m_smooth.isEmpty())) {
+		const QByteArray& stream = smooth ? streams.m_smooth : streams.m_loaded;
+		mesh.m_vertexBuffer.bind();
+		mesh.m_vertexBuffer.write(vertexStart + int(mesh.m_normalOffset), stream.constData(), stream.size());
+		mesh.m_vertexBuffer.release();
+		streams.m_smoothed = smooth;
+		return true;
+	}
+	QByteArray vertices(mesh.m_vertexBytes, Qt::Uninitialized);
+	mesh.m_vertexBuffer.bind();
+	const bool readVertices = mesh.m_vertexBuffer.read(vertexStart, vertices.data(), vertices.size());
+	mesh.m_vertexBuffer.release();
+	if (!readVertices) {
+		return false;
+	}
+	char* pNormals = vertices.data() + mesh.m_normalOffset;
+	if (streams.m_loaded.isEmpty()) {
+		streams.m_loaded.resize(int(count * normalSize));
+		for (size_t v = 0; v < count; ++v) {
+			std::memcpy(streams.m_loaded.data() + v * normalSize, pNormals + v * normalStride, normalSize);
+		}
+	}
+
+	// The smooth normals are only computed the first time they are asked for
+	if (smooth && streams.m_smooth.isEmpty()) {
+		std::vector<quint32> indices;
+		if (!ReadIndices(mesh, mesh.m_indexCount / 3 * 3, indices)) {
+			return false;
+		}
+
+		std::vector<float> positions(3 * count);
+		for (size_t v = 0; v < count; ++v) {
+			const QVector3D position = DecodePosition(mesh, vertices.constData(), v, positionStride);
+			positions[3 * v] = position.x();
+			positions[3 * v + 1] = position.y();
+			positions[3 * v + 2] = position.z();
+		}
+		std::vector<float> normals(3 * count);
+		NormalGenerator::SmoothNormals(positions.data(), count, indices.data(), indices.size() / 3, normals.data());
+
+		// Vertices no triangle reaches keep the normal they were loaded with
+		QByteArray smoothNormals = streams.m_loaded;
+		for (size_t v = 0; v < count; ++v) {
+			char* pDst = smoothNormals.data() + v * normalSize;
+			const float* pNormal = &normals[3 * v];
+			if (pNormal[0] == 0.f && pNormal[1] == 0.f && pNormal[2] == 0.f) {
+				continue;
+			}
+			if (floatNormals) {
+				std::memcpy(pDst, pNormal, normalSize);
+			}
+			else {
+				const quint32 packed = PackSnorm10(pNormal);
+				std::memcpy(pDst, &packed, sizeof(packed));
+			}
+		}
+		streams.m_smooth = smoothNormals;
+	}
+
+	const QByteArray& stream = smooth ? streams.m_smooth : streams.m_loaded;
+	for (size_t v = 0; v < count; ++v) {
+		std::memcpy(pNormals + v * normalStride, stream.constData() + v * normalSize, normalSize);
+	}
+	streams.m_smoothed = smooth;
+
+	mesh.m_vertexBuffer.bind();
+	mesh.m_vertexBuffer.write(vertexStart, vertices.constData(), vertices.size());
+	mesh.m_vertexBuffer.release();
+	return true;
+}
+
+bool GpuModelBuilder::ReadTriangles(Mesh& mesh, MeshTriangles& triangles)
+{
+	if (!mesh.m_vertexBuffer.isCreated() || !mesh.m_indexBuffer.isCreated() || mesh.m_numPositionComponents < 3
+		|| mesh.m_vertexCount <= 0 || mesh.m_indexCount < 3) {
+		return false;
+	}
+	const bool quantized = mesh.m_positionType == GL_UNSIGNED_SHORT;
+	const size_t count = size_t(mesh.m_vertexCount);
+	const size_t positionSize = mesh.m_numPositionComponents * (quantized ? sizeof(GLushort) : sizeof(GLfloat));
+	const size_t positionStride = mesh.m_vertexStride > 0 ? size_t(mesh.m_vertexStride) : positionSize;
+	const size_t positionEnd = mesh.m_positionOffset + (count - 1) * positionStride + positionSize;
+	if (positionEnd > size_t(mesh.m_vertexBytes)) {
+		return false;
+	}
+
+	// The vertices up to the last position, from the start of the mesh's range when it shares a page
+	const int vertexStart = mesh.m_sharesBuffers ? mesh.m_baseVertex * mesh.m_vertexStride : 0;
+	QByteArray vertices(int(positionEnd), Qt::Uninitialized);
+	mesh.m_vertexBuffer.bind();
+	const bool readVertices = mesh.m_vertexBuffer.read(vertexStart, vertices.data(), vertices.size());
+	mesh.m_vertexBuffer.release();
+	if (!readVertices) {
+		return false;
+	}
+	triangles.m_positions.resize(count);
+	for (size_t v = 0; v < count; ++v) {
+		triangles.m_positions[v] = DecodePosition(mesh, vertices.constData(), v, positionStride);
+	}
+	return ReadIndices(mesh, mesh.m_indexCount / 3 * 3, triangles.m_indices);
+}
+
+bool GpuModelBuilder::WriteIndices(Mesh& mesh, const std::vector<quint32>& indices)
+{
+	const bool shortIndices = mesh.m_indexType == GL_UNSIGNED_SHORT;
+	const size_t indexSize = shortIndices ? sizeof(GLushort) : sizeof(GLuint);
+	if (!mesh.m_indexBuffer.isCreated() || indices.size() * indexSize > size_t(mesh.m_indexBytes)) {
+		return false;
+	}
+	QByteArray indexData(int(indices.size() * indexSize), Qt::Uninitialized);
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (shortIndices) {
+			const quint16 index = quint16(indices[i]);
+			std::memcpy(indexData.data() + i * indexSize, &index, sizeof(index));
+		}
+		else {
+			std::memcpy(indexData.data() + i * indexSize, &indices[i], sizeof(quint32));
+		}
+	}
+	mesh.m_indexBuffer.bind();
+	mesh.m_indexBuffer.write(mesh.m_indexOffset, indexData.constData(), indexData.size());
+	mesh.m_indexBuffer.release();
+	mesh.m_indexCount = int(indices.size());
+	return true;
+}
+
+bool GpuModelBuilder::ReadIndices(Mesh& mesh, int count, std::vector<quint32>& indices)
+{
+	const size_t indexSize = mesh.m_indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+	QByteArray indexData(int(count * indexSize), Qt::Uninitialized);
+	mesh.m_indexBuffer.bind();
+	const bool readIndices = mesh.m_indexBuffer.read(mesh.m_indexOffset, indexData.data(), indexData.size());
+	mesh.m_indexBuffer.release();
+	if (!readIndices) {
+		return false;
+	}
+	indices.resize(size_t(count));
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (indexSize == sizeof(GLushort)) {
+			quint16 index;
+			std::memcpy(&index, indexData.constData() + i * indexSize, sizeof(index));
+			indices[i] = index;
+		}
+		else {
+			std::memcpy(&indices[i], indexData.constData() + i * indexSize, sizeof(quint32));
+		}
+		if (indices[i] >= quint32(mesh.m_vertexCount)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void GpuModelBuilder::EnableInstanceAttributes(QOpenGLExtraFunctions* f, Mesh& mesh)
+{
+	// A mat4 attribute takes 4 locations, one per column. Each instance advances by one matrix.
+	mesh.m_instanceBuffer.bind();
+	for (GLuint column = 0; column < 4; ++column) {
+		f->glVertexAttribPointer(k_instanceLocation + column, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(GLfloat), (void*)(column * 4 * sizeof(GLfloat)));
+		f->glEnableVertexAttribArray(k_instanceLocation + column);
+		f->glVertexAttribDivisor(k_instanceLocation + column, 1);
+	}
+	mesh.m_instanceBuffer.release();
+	mesh.m_instanced = true;
+}
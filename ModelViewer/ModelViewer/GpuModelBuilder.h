@@ -0,0 +1,115 @@
+#pragma once
+#include "GeometryArena.h"
+#include "ModelLoader.h"
+#include "TextureCache.h"
+
+class QOpenGLFunctions;
+class QOpenGLExtraFunctions;
+class QOpenGLShaderProgram;
+struct MeshTriangles;
+
+// Attribute locations every model shader is linked with. Fixing them lets the vertex array
+// objects built at upload time work with any shader the user loads.
+enum AttributeLocation : GLuint {
+	k_positionLocation = 0,
+	k_colorLocation = 1,
+	k_normalLocation = 2,
+	k_uvLocation = 3,
+	k_instanceLocation = 4, // A mat4, uses locations 4 to 7
+	k_objectLocation = 8, // Per instance index into the transforms of the IndirectRenderer
+	k_boneIndexLocation = 9, // 4 bytes, read as unnormalized floats
+	k_boneWeightLocation = 10,
+};
+
+// Turns decoded models into GPU resources. Everything here requires a current OpenGL context.
+class GpuModelBuilder
+{
+public:
+	// Builds the materials of a model, once each. Their maps are looked up in and added to
+	// textures, so materials sharing an image share the texture, and made resident when the
+	// context has bindless textures. With pUploader new images are streamed through it.
+	static std::vector<QSharedPointer<const Material>> BuildMaterials(const ModelData& data, TextureCache& textures, TextureUploader* pUploader = nullptr);
+
+	// A copy of material with its base color map replaced by texture from textures, for
+	// textures the user puts on a model. Null keeps the material's own.
+	static QSharedPointer<const Material> WithBaseColorMap(const Material& material, const QSharedPointer<QOpenGLTexture>& texture, TextureCache& textures);
+
+	// The mesh points at its entry of materials, the result of BuildMaterials on its model.
+	// Vertices and indices are suballocated from pArena when it can take them. Without
+	// uploadGeometry the mesh gets everything but its vertex, index and instance buffers, which
+	// UploadGeometry adds later.
+	static Mesh BuildMesh(const MeshData& data, const std::vector<QSharedPointer<const Material>>& materials, GeometryArena* pArena = nullptr, bool uploadGeometry = true);
+	static Model BuildModel(const ModelData& data, TextureCache& textures);
+
+	// Uploads the vertices, indices and instance transforms of data, which mesh was built
+	// from, and records its vertex array object. Returns false if the buffers can't be created.
+	static bool UploadGeometry(Mesh& mesh, const MeshData& data, GeometryArena* pArena = nullptr);
+
+	// Frees what UploadGeometry created, the rest of the mesh stays. Meshes in a GeometryArena
+	// can't give their range back.
+	static void ReleaseGeometry(Mesh& mesh);
+
+	// Binds the attribute names model shaders use to their locations, before linking pProgram.
+	// Cached program binaries hold the bindings, so every program with the same sources has
+	// to be bound the same way.
+	static void BindAttributeLocations(QOpenGLShaderProgram* pProgram);
+
+	// Points the attribute locations at the mesh's vertex buffer, which must be bound.
+	// Used to record a mesh's vertex array object, and for drawing when those are not supported.
+	static void EnableAttributes(QOpenGLFunctions* f, const Mesh& mesh);
+	static void DisableAttributes(QOpenGLFunctions* f, const Mesh& mesh);
+
+	// Draws count indices of the bound mesh from firstIndex on, instanceCount times if it is
+	// above 0. Adds the mesh's offsets into buffers shared through a GeometryArena.
+	static void DrawElements(QOpenGLExtraFunctions* f, const Mesh& mesh, int firstIndex, int count, int instanceCount = 0, GLenum mode = GL_TRIANGLES);
+
+	// Draws every vertex of the bound mesh once as a point, without the indices
+	static void DrawPoints(QOpenGLExtraFunctions* f, const Mesh& mesh, int instanceCount = 0);
+
+	// Instanced draws need glVertexAttribDivisor and glDrawElementsInstanced
+	static bool SupportsInstancing();
+
+	// Writes the bone matrices of a skinned mesh to its BonePalette buffer
+	static void UploadBonePalette(Mesh& mesh, const std::vector<QMatrix4x4>& palette);
+
+	// Overwrites one matrix of the mesh's instance buffer, if it has one. Like the rest of the
+	// buffer it doesn't include the ModelScene placement, which instanced draws apply on their own.
+	static void UploadInstanceTransform(Mesh& mesh, int instance, const QMatrix4x4& transform);
+
+	// Hides or shows one draw of the mesh, an instance or 0 for a mesh drawn once. Only the
+	// mesh's m_hiddenDraws change, no buffer does. Returns whether the draw changed.
+	static bool SetDrawHidden(Mesh& mesh, int draw, bool hidden);
+
+	// The draws of the mesh that aren't hidden, as runs of first draw and count in order
+	static void VisibleRuns(const Mesh& mesh, std::vector<std::pair<int, int>>& runs);
+
+	// Points the instance attribute of the mesh's bound vertex array object at firstInstance,
+	// so instanced draws start there. Used to draw the runs of shown instances, 0 goes back to
+	// drawing all of them.
+	static void SetFirstInstance(QOpenGLExtraFunctions* f, Mesh& mesh, int firstInstance);
+
+	// Replaces the normals in the mesh's vertex buffer with smooth ones from NormalGenerator,
+	// or puts back the ones it was loaded with. The positions and indices are read back from
+	// its buffers, so only the normals change and nothing is imported again. Both sets are
+	// kept in the mesh's NormalStreams, later switches just write one back. Returns false for
+	// meshes it can't smooth: ones without normals or buffers, and skinned meshes, whose
+	// normals the bones move.
+	static bool SmoothNormals(Mesh& mesh, bool smooth);
+
+	// Reads the positions of the mesh's vertices and its full detail indices back from its
+	// buffers, quantized positions decoded into the mesh's space. Returns false for meshes
+	// without buffers and where buffers can't be read back, as on OpenGL ES.
+	static bool ReadTriangles(Mesh& mesh, MeshTriangles& triangles);
+
+	// Writes indices over the start of the mesh's full detail indices and draws only those
+	// from then on. There can't be more of them than the mesh's index range holds, and the
+	// levels of detail and meshlets stored after and over them are up to the caller.
+	static bool WriteIndices(Mesh& mesh, const std::vector<quint32>& indices);
+
+private:
+	static void UploadMaterial(Material& material);
+	static void EnableInstanceAttributes(QOpenGLExtraFunctions* f, Mesh& mesh);
+
+	// The first count indices of the mesh, false if they can't be read or point past its vertices
+	static bool ReadIndices(Mesh& mesh, int count, std::vector<quint32>& indices);
+};
@@ -0,0 +1,184 @@
+#include "GpuProfiler.h"
+
+#include <QFile>
+#include <QOpenGLTimerQuery>
+#include <QTextStream>
+
+#include <algorithm>
+
+
+namespace {
+
+// Stop recording a trace that is never saved before it takes too much memory
+const size_t k_maxTraceEvents = 100000;
+
+}
+
+GpuProfiler::~GpuProfiler()
+{
+	Destroy();
+}
+
+bool GpuProfiler::Create()
+{
+	Destroy();
+	for (Frame& frame : m_frames) {
+		for (int i = 0; i < k_maxPasses; ++i) {
+			frame.m_begin[i] = new QOpenGLTimerQuery();
+			frame.m_end[i] = new QOpenGLTimerQuery();
+			if (!frame.m_begin[i]->create() || !frame.m_end[i]->create()) {
+				Destroy();
+				return false;
+			}
+		}
+	}
+	m_created = true;
+	return true;
+}
+
+void GpuProfiler::Destroy()
+{
+	for (Frame& frame : m_frames) {
+		for (int i = 0; i < k_maxPasses; ++i) {
+			delete frame.m_begin[i];
+			delete frame.m_end[i];
+			frame.m_begin[i] = nullptr;
+			frame.m_end[i] = nullptr;
+		}
+		frame.m_passCount = 0;
+		frame.m_pending = false;
+	}
+	m_created = false;
+	m_inPass = false;
+}
+
+bool GpuProfiler::IsCreated() const
+{
+	return m_created;
+}
+
+bool GpuProfiler::BeginFrame()
+{
+	if (!m_created) {
+		return false;
+	}
+
+	// Reuse the queries of the oldest frame, reading its results first if they are ready
+	m_current = (m_current + 1) % k_frameLatency;
+	Frame& frame = m_frames[m_current];
+	bool collected = false;
+	if (frame.m_pending && frame.m_passCount > 0 && frame.m_end[frame.m_passCount - 1]->isResultAvailable()) {
+		Collect(frame);
+		collected = true;
+	}
+	frame.m_passCount = 0;
+	frame.m_pending = false;
+	return collected;
+}
+
+void GpuProfiler::EndFrame()
+{
+	if (!m_created) {
+		return;
+	}
+	if (m_inPass) {
+		EndPass();
+	}
+	m_frames[m_current].m_pending = true;
+}
+
+void GpuProfiler::BeginPass(const char* name)
+{
+	Frame& frame = m_frames[m_current];
+	if (!m_created || m_inPass || frame.m_passCount == k_maxPasses) {
+		return;
+	}
+	frame.m_names[frame.m_passCount] = name;
+	frame.m_begin[frame.m_passCount]->recordTimestamp();
+	m_inPass = true;
+}
+
+void GpuProfiler::EndPass()
+{
+	if (!m_created || !m_inPass) {
+		return;
+	}
+	Frame& frame = m_frames[m_current];
+	frame.m_end[frame.m_passCount]->recordTimestamp();
+	++frame.m_passCount;
+	m_inPass = false;
+}
+
+void GpuProfiler::Collect(Frame& frame)
+{
+	quint64 frameStart = 0;
+	quint64 frameEnd = 0;
+	m_resultCount = frame.m_passCount;
+	for (int i = 0; i < frame.m_passCount; ++i) {
+		const quint64 start = frame.m_begin[i]->waitForResult();
+		const quint64 end = frame.m_end[i]->waitForResult();
+		m_results[i].m_name = frame.m_names[i];
+		m_results[i].m_seconds = end > start ? float(end - start) * 1e-9f : 0.f;
+		if (i == 0) {
+			frameStart = start;
+		}
+		frameEnd = std::max(frameEnd, end);
+
+		if (m_tracing && m_trace.size() < k_maxTraceEvents) {
+			m_trace.push_back({ frame.m_names[i], start, end });
+		}
+	}
+	m_frameSeconds = frameEnd > frameStart ? float(frameEnd - frameStart) * 1e-9f : 0.f;
+}
+
+int GpuProfiler::PassCount() const
+{
+	return m_resultCount;
+}
+
+const GpuProfiler::PassTime& GpuProfiler::Pass(int idx) const
+{
+	return m_results[idx];
+}
+
+float GpuProfiler::FrameSeconds() const
+{
+	return m_frameSeconds;
+}
+
+void GpuProfiler::StartTrace()
+{
+	m_trace.clear();
+	m_tracing = true;
+}
+
+bool GpuProfiler::IsTracing() const
+{
+	return m_tracing;
+}
+
+bool GpuProfiler::SaveTrace(const QString& path)
+{
+	m_tracing = false;
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+
+	// Complete events on a single GPU track, in microseconds from the first pass
+	const quint64 origin = m_trace.empty() ? 0 : m_trace.front().m_start;
+	QTextStream out(&file);
+	out << "{\"traceEvents\":[\n";
+	for (size_t i = 0; i < m_trace.size(); ++i) {
+		const TraceEvent& event = m_trace[i];
+		out << QString("{\"name\":\"%1\",\"cat\":\"gpu\",\"ph\":\"X\",\"pid\":0,\"tid\":0,\"ts\":%2,\"dur\":%3}")
+			.arg(event.m_name)
+			.arg(double(event.m_start - origin) / 1000.0, 0, 'f', 3)
+			.arg(double(event.m_end - event.m_start) / 1000.0, 0, 'f', 3);
+		out << (i + 1 < m_trace.size() ? ",\n" : "\n");
+	}
+	out << "],\"displayTimeUnit\":\"ms\"}\n";
+	m_trace.clear();
+	return true;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <vector>
+
+#include <QString>
+
+class QOpenGLTimerQuery;
+
+// Measures how long each render pass takes on the GPU with GL_TIMESTAMP queries. Every
+// frame records into its own set of queries and results are read k_frameLatency frames
+// later, so the CPU never waits on the GPU. Results that are late are dropped.
+class GpuProfiler
+{
+public:
+	static const int k_maxPasses = 16;
+	static const int k_frameLatency = 2;
+
+	struct PassTime {
+		const char* m_name = nullptr;
+		float m_seconds = 0.f;
+	};
+
+	// Times a pass for as long as it is in scope
+	class Scope
+	{
+	public:
+		Scope(GpuProfiler& profiler, const char* name) : m_profiler(profiler) { m_profiler.BeginPass(name); }
+		~Scope() { m_profiler.EndPass(); }
+	private:
+		GpuProfiler& m_profiler;
+	};
+
+	~GpuProfiler();
+
+	// Creating and destroying the queries requires the context they are used in to be current.
+	// Create returns false if timestamps are not supported, the profiler then does nothing.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Returns true when the results of an earlier frame came in
+	bool BeginFrame();
+	void EndFrame();
+
+	// Pass names must outlive the profiler, string literals are expected
+	void BeginPass(const char* name);
+	void EndPass();
+
+	// Results of the most recent frame that came in
+	int PassCount() const;
+	const PassTime& Pass(int idx) const;
+	float FrameSeconds() const;
+
+	// Records every pass that comes in until SaveTrace, which writes a Chrome trace
+	// (chrome://tracing) JSON file
+	void StartTrace();
+	bool IsTracing() const;
+	bool SaveTrace(const QString& path);
+
+private:
+	struct Frame {
+		QOpenGLTimerQuery* m_begin[k_maxPasses] = {};
+		QOpenGLTimerQuery* m_end[k_maxPasses] = {};
+		const char* m_names[k_maxPasses] = {};
+		int m_passCount = 0;
+		bool m_pending = false;
+	};
+	void Collect(Frame& frame);
+
+	Frame m_frames[k_frameLatency];
+	int m_current = 0;
+	bool m_created = false;
+	bool m_inPass = false;
+
+	PassTime m_results[k_maxPasses];
+	int m_resultCount = 0;
+	float m_frameSeconds = 0.f;
+
+	struct TraceEvent {
+		const char* m_name;
+		quint64 m_start;
+		quint64 m_end;
+	};
+	std::vector<TraceEvent> m_trace;
+	bool m_tracing = false;
+};
@@ -41,12 +41,16 @@ GraphicsWindowDelegate::GraphicsWindowDelegate(ViewerGraphicsWindow* graphicsWin
 	pErrorLayout->addWidget(m_pErrorText);
 	m_pErrorWidget->setLayout(pErrorLayout);
 
-	// Loading screen, shown during synchronous model loading
+	// Loading screen, shown while a model is loading in the background
 	m_pLoadingWidget = new QWidget();
 	QGridLayout* pLoadingLayout = new QGridLayout(m_pLoadingWidget);
 	pLoadingLayout->setAlignment(Qt::AlignCenter);
 	m_pLoadingText = new QLabel("Loading");
 	pLoadingLayout->addWidget(m_pLoadingText);
+	QPushButton* pCancelButton = new QPushButton("Cancel");
+	pCancelButton->setObjectName("cancelLoadingButton");
+	pLoadingLayout->addWidget(pCancelButton, 1, 0, Qt::AlignCenter);
+	connect(pCancelButton, &QPushButton::clicked, m_pGraphicsWindow, &ViewerGraphicsWindow::cancelModelLoading);
 	m_pLoadingWidget->setLayout(pLoadingLayout);
 
 	// Setup the style for placeholder widgets
@@ -69,10 +73,14 @@ GraphicsWindowDelegate::GraphicsWindowDelegate(ViewerGraphicsWindow* graphicsWin
 	// Connect to signals from the graphics window
 	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::Initialized, this, &GraphicsWindowDelegate::OnViewerInitialized);
 	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::BeginModelLoading, this, &GraphicsWindowDelegate::OnBeginModelLoading);
+	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ModelLoadingProgress, this, &GraphicsWindowDelegate::OnModelLoadingProgress);
+	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ModelPreviewLoaded, this, &GraphicsWindowDelegate::OnModelPreviewLoaded);
 	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::EndModelLoading, this, &GraphicsWindowDelegate::OnEndModelLoading);
+	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ModelLoadingCancelled, this, &GraphicsWindowDelegate::OnModelLoadingCancelled);
 	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::Error, this, &GraphicsWindowDelegate::OnError);
 	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ClearError, this, &GraphicsWindowDelegate::OnClearError);
 	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ModelUnloaded, this, &GraphicsWindowDelegate::OnModelUnloaded);
+	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::SceneChanged, this, &GraphicsWindowDelegate::OnSceneChanged);
 }
 
 LandingPage* GraphicsWindowDelegate::GetLandingWidget()
@@ -122,8 +130,7 @@ void GraphicsWindowDelegate::DoOnStatusChanged() {
 		break;
 	}
 
-	// Force repaint so the loading screen will be visible before performing a
-	// long synchronous load
+	// Force repaint so the new screen is visible immediately
 	repaint();
 }
 
@@ -131,12 +138,25 @@ void GraphicsWindowDelegate::OnBeginModelLoading(QString filepath)
 {
 	// Change the loading text
 	QFileInfo fileInfo(filepath);
-	QString text = QString("Loading %1...").arg(fileInfo.fileName());
+	m_loadingFileName = fileInfo.fileName();
+	QString text = QString("Loading %1...").arg(m_loadingFileName);
 	m_pLoadingText->setText(text);
 	
 	SetStatus(Status::k_loading);
 }
 
+void GraphicsWindowDelegate::OnModelLoadingProgress(float percent)
+{
+	QString text = QString("Loading %1... %2%").arg(m_loadingFileName).arg(int(percent * 100.f));
+	m_pLoadingText->setText(text);
+}
+
+void GraphicsWindowDelegate::OnModelPreviewLoaded(QString filepath)
+{
+	// The proxy can be looked at while the rest loads, the full model replaces it when it is done
+	SetStatus(Status::k_model);
+}
+
 void GraphicsWindowDelegate::OnViewerInitialized()
 {
 	// When the viewer is initialized (i.e. the OpenGL context created),
@@ -157,6 +177,12 @@ void GraphicsWindowDelegate::OnEndModelLoading(bool success, QString filepath)
 	}
 }
 
+void GraphicsWindowDelegate::OnModelLoadingCancelled(QString filepath)
+{
+	// Back to whatever was shown before the load started
+	SetStatus(m_pGraphicsWindow->IsModelValid() ? Status::k_model : Status::k_empty);
+}
+
 void GraphicsWindowDelegate::OnError(QString message)
 {
 	// Change the error text
@@ -175,4 +201,15 @@ void GraphicsWindowDelegate::OnClearError()
 void GraphicsWindowDelegate::OnModelUnloaded()
 {
 	SetStatus(Status::k_empty);
+}
+
+void GraphicsWindowDelegate::OnSceneChanged()
+{
+	// Models are also added and removed without a load, such as generated primitives
+	if (m_status == Status::k_empty && m_pGraphicsWindow->IsModelValid()) {
+		SetStatus(Status::k_model);
+	}
+	else if (m_status == Status::k_model && !m_pGraphicsWindow->IsModelValid()) {
+		SetStatus(Status::k_empty);
+	}
 }
\ No newline at end of file
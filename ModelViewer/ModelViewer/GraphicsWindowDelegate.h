@@ -30,10 +30,14 @@ public:
 private slots:
 	void OnViewerInitialized();
 	void OnBeginModelLoading(QString filepath);
+	void OnModelLoadingProgress(float percent);
+	void OnModelPreviewLoaded(QString filepath);
 	void OnEndModelLoading(bool success, QString filepath);
+	void OnModelLoadingCancelled(QString filepath);
 	void OnError(QString message);
 	void OnClearError();
 	void OnModelUnloaded();
+	void OnSceneChanged();
 
 private:
 	void DoOnStatusChanged();
@@ -50,6 +54,7 @@ private:
 	QLabel* m_pEmptyText = nullptr;
 	QLabel* m_pErrorText = nullptr;
 	QLabel* m_pLoadingText = nullptr;
+	QString m_loadingFileName;
 
 	Status m_status = Status::k_empty;
 	Status m_lastStatus = Status::k_empty;
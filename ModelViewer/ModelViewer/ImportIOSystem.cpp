@@ -0,0 +1,247 @@
+#include "ImportIOSystem.h"
+#include "RemoteFile.h"
+#include "ZipArchive.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/IOStream.hpp>
+
+#include <QFileInfo>
+#include <QList>
+#include <QMutexLocker>
+#include <QPair>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+// Reads from FileContents, which the stream keeps alive
+class ContentStream : public Assimp::IOStream
+{
+public:
+	explicit ContentStream(const QSharedPointer<const FileContents>& pContents)
+		: m_pContents(pContents) {}
+
+	size_t Read(void* pvBuffer, size_t pSize, size_t pCount) override {
+		if (pSize == 0) {
+			return 0;
+		}
+		const size_t available = size_t(m_pContents->Size()) - m_position;
+		const size_t count = std::min(pCount, available / pSize);
+		memcpy(pvBuffer, m_pContents->Data() + m_position, count * pSize);
+		m_position += count * pSize;
+		return count;
+	}
+
+	size_t Write(const void*, size_t, size_t) override {
+		return 0;
+	}
+
+	aiReturn Seek(size_t pOffset, aiOrigin pOrigin) override {
+		size_t position = pOffset;
+		if (pOrigin == aiOrigin_CUR) {
+			position += m_position;
+		}
+		else if (pOrigin == aiOrigin_END) {
+			position = size_t(m_pContents->Size()) - pOffset;
+		}
+		if (position > size_t(m_pContents->Size())) {
+			return AI_FAILURE;
+		}
+		m_position = position;
+		return AI_SUCCESS;
+	}
+
+	size_t Tell() const override {
+		return m_position;
+	}
+
+	size_t FileSize() const override {
+		return size_t(m_pContents->Size());
+	}
+
+	void Flush() override {}
+
+private:
+	QSharedPointer<const FileContents> m_pContents;
+	size_t m_position = 0;
+};
+
+// Archives and files on servers stay open for the last few paths that went through them. The
+// textures of a model, which are read after its import, and other models of the same pack
+// then don't read the directory of the archive or ask the server for the file again.
+template <class T>
+class OpenSources
+{
+public:
+	static const int k_kept = 4;
+
+	T Get(const QString& path, T (*pOpen)(const QString&)) {
+		{
+			QMutexLocker lock(&m_mutex);
+			for (int i = 0; i < m_sources.size(); ++i) {
+				if (m_sources[i].first == path) {
+					m_sources.move(i, 0);
+					return m_sources.front().second;
+				}
+			}
+		}
+
+		// Opened without the lock, so one slow server doesn't hold up other reads
+		const T pSource = pOpen(path);
+		if (pSource) {
+			QMutexLocker lock(&m_mutex);
+			m_sources.prepend(qMakePair(path, pSource));
+			while (m_sources.size() > k_kept) {
+				m_sources.removeLast();
+			}
+		}
+		return pSource;
+	}
+
+private:
+	QMutex m_mutex;
+	// The most recently used first
+	QList<QPair<QString, T>> m_sources;
+};
+
+QSharedPointer<RemoteFile> OpenRemote(const QString& url)
+{
+	return RemoteFile::Open(QUrl(url));
+}
+
+QSharedPointer<RemoteFile> Remote(const QString& url)
+{
+	static OpenSources<QSharedPointer<RemoteFile>> remotes;
+	return remotes.Get(url, &OpenRemote);
+}
+
+QSharedPointer<const ZipArchive> OpenArchive(const QString& path)
+{
+	if (RemoteFile::IsUrl(path)) {
+		const QSharedPointer<RemoteFile> pRemote = Remote(path);
+		return pRemote ? ZipArchive::Open(pRemote) : QSharedPointer<const ZipArchive>();
+	}
+	const QSharedPointer<const FileContents> pContents = FileContents::Open(path);
+	return pContents ? ZipArchive::Open(pContents) : QSharedPointer<const ZipArchive>();
+}
+
+QSharedPointer<const ZipArchive> Archive(const QString& path)
+{
+	static OpenSources<QSharedPointer<const ZipArchive>> archives;
+	return archives.Get(path, &OpenArchive);
+}
+
+}
+
+bool ImportIOSystem::Exists(const char* pFile) const
+{
+	return PathExists(QString::fromUtf8(pFile));
+}
+
+char ImportIOSystem::getOsSeparator() const
+{
+	return '/';
+}
+
+Assimp::IOStream* ImportIOSystem::Open(const char* pFile, const char* pMode)
+{
+	if (strchr(pMode, 'w') || strchr(pMode, 'a') || strchr(pMode, '+')) {
+		return nullptr;
+	}
+	const QSharedPointer<const FileContents> pContents = Contents(QString::fromUtf8(pFile));
+	return pContents ? new ContentStream(pContents) : nullptr;
+}
+
+void ImportIOSystem::Close(Assimp::IOStream* pFile)
+{
+	delete pFile;
+}
+
+QSharedPointer<const FileContents> ImportIOSystem::Contents(const QString& path)
+{
+	const QString key = RemoteFile::IsUrl(path) ? path : QFileInfo(path).absoluteFilePath();
+	QMutexLocker lock(&m_mutex);
+	QSharedPointer<const FileContents>& pContents = m_files[key];
+	if (!pContents) {
+		pContents = Read(path);
+		if (!pContents) {
+			m_files.remove(key);
+			return QSharedPointer<const FileContents>();
+		}
+	}
+	return pContents;
+}
+
+void ImportIOSystem::Release()
+{
+	QMutexLocker lock(&m_mutex);
+	m_files.clear();
+}
+
+QSharedPointer<const FileContents> ImportIOSystem::Read(const QString& path)
+{
+	QString archive;
+	QString name;
+	if (ZipArchive::SplitPath(path, archive, name)) {
+		const QSharedPointer<const ZipArchive> pArchive = Archive(archive);
+		return pArchive ? pArchive->Read(name) : QSharedPointer<const FileContents>();
+	}
+	if (RemoteFile::IsUrl(path)) {
+		const QSharedPointer<RemoteFile> pRemote = Remote(path);
+		return pRemote ? pRemote->ReadAll() : QSharedPointer<const FileContents>();
+	}
+	return FileContents::Open(path);
+}
+
+bool ImportIOSystem::PathExists(const QString& path)
+{
+	QString archive;
+	QString name;
+	if (ZipArchive::SplitPath(path, archive, name)) {
+		const QSharedPointer<const ZipArchive> pArchive = Archive(archive);
+		return pArchive && pArchive->Contains(name);
+	}
+	if (RemoteFile::IsUrl(path)) {
+		return !Remote(path).isNull();
+	}
+	return QFileInfo::exists(path);
+}
+
+QString ImportIOSystem::ResolvePath(const QString& folder, const QString& fileName)
+{
+	const QString path = folder + '/' + fileName;
+	QString archive;
+	QString name;
+	if (RemoteFile::IsUrl(path) || ZipArchive::SplitPath(path, archive, name)) {
+		return PathExists(path) ? path : QString();
+	}
+	const QFileInfo info(path);
+	return info.exists() ? info.canonicalFilePath() : QString();
+}
+
+QString ImportIOSystem::Folder(const QString& path)
+{
+	if (RemoteFile::IsUrl(path)) {
+		return path.left(path.lastIndexOf('/'));
+	}
+	return QFileInfo(path).absolutePath();
+}
+
+QStringList ImportIOSystem::ArchiveModels(const QString& archive)
+{
+	const QSharedPointer<const ZipArchive> pArchive = Archive(archive);
+	if (!pArchive) {
+		return QStringList();
+	}
+	QStringList ret;
+	Assimp::Importer importer;
+	for (const QString& name : pArchive->Names()) {
+		if (importer.IsExtensionSupported(("." + QFileInfo(name).suffix()).toStdString())) {
+			ret << name;
+		}
+	}
+	ret.sort();
+	return ret;
+}
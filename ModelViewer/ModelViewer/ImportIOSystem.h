@@ -0,0 +1,50 @@
+#pragma once
+#include "FileContents.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+#include <assimp/IOSystem.hpp>
+
+// The IO system models are imported through. Every file Assimp opens, the model and any it
+// references such as .mtl files, is read once as FileContents and kept until Release(), so
+// importers that open a file several times, to check its format and then to read it, read it
+// from disk only once. Streams are read only.
+// Paths can also go through a zip archive, as in "pack.zip/models/car.obj", or be http(s) URLs,
+// including ones through an archive on a server. Files an importer opens next to the model,
+// and the textures of the model, are then found in the same archive or on the same server.
+class ImportIOSystem : public Assimp::IOSystem
+{
+public:
+	bool Exists(const char* pFile) const override;
+	char getOsSeparator() const override;
+	Assimp::IOStream* Open(const char* pFile, const char* pMode) override;
+	void Close(Assimp::IOStream* pFile) override;
+
+	// The contents of path, read on the first request. Safe to call from any thread.
+	QSharedPointer<const FileContents> Contents(const QString& path);
+
+	// Forgets the files read so far, which are freed once their last stream is closed. The
+	// importer keeps its IO system as long as its scene, this keeps the files from staying
+	// in memory with it.
+	void Release();
+
+	// The contents of any such path, read anew
+	static QSharedPointer<const FileContents> Read(const QString& path);
+	static bool PathExists(const QString& path);
+
+	// The path of fileName in folder, empty if it isn't there. Local paths are canonical.
+	static QString ResolvePath(const QString& folder, const QString& fileName);
+
+	// The folder the file at path is in, to resolve the files next to it
+	static QString Folder(const QString& path);
+
+	// The files in archive Assimp can import, sorted. Empty if it can't be opened.
+	static QStringList ArchiveModels(const QString& archive);
+
+private:
+	QMutex m_mutex;
+	QHash<QString, QSharedPointer<const FileContents>> m_files;
+};
@@ -0,0 +1,195 @@
+#include "ImportTrace.h"
+
+#include <QFile>
+#include <QHash>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+
+#include <algorithm>
+
+
+namespace {
+
+QString Seconds(qint64 ns)
+{
+	return ns >= 1000000000 ? QString("%1 s").arg(double(ns) * 1e-9, 0, 'f', 2) : QString("%1 ms").arg(double(ns) * 1e-6, 0, 'f', 1);
+}
+
+const char* LevelName(ImportTrace::Level level)
+{
+	switch (level) {
+	case ImportTrace::k_stage:
+		return "stage";
+	case ImportTrace::k_step:
+		return "step";
+	default:
+		return "item";
+	}
+}
+
+}
+
+ImportTrace::Scope::Scope(ImportTrace* pTrace, const char* name, Level level, const QString& detail)
+	: m_pTrace(pTrace), m_name(name), m_level(level), m_detail(detail), m_startNs(pTrace ? pTrace->Now() : 0)
+{
+}
+
+ImportTrace::Scope::~Scope()
+{
+	if (m_pTrace) {
+		m_pTrace->Add(m_name, m_level, m_startNs, m_pTrace->Now(), m_detail);
+	}
+}
+
+ImportTrace::Sequence::Sequence(ImportTrace* pTrace, Level level)
+	: m_pTrace(pTrace), m_level(level)
+{
+}
+
+ImportTrace::Sequence::~Sequence()
+{
+	Next(nullptr);
+}
+
+void ImportTrace::Sequence::Next(const char* name)
+{
+	if (!m_pTrace) {
+		return;
+	}
+	const qint64 now = m_pTrace->Now();
+	if (m_name) {
+		m_pTrace->Add(m_name, m_level, m_startNs, now);
+	}
+	m_name = name;
+	m_startNs = now;
+}
+
+ImportTrace::ImportTrace()
+{
+	m_clock.start();
+}
+
+ImportTrace::ImportTrace(const ImportTrace& other)
+{
+	*this = other;
+}
+
+ImportTrace& ImportTrace::operator=(const ImportTrace& other)
+{
+	if (this == &other) {
+		return *this;
+	}
+	const std::vector<Event> events = other.Events();
+	QMutexLocker lock(&m_mutex);
+	m_clock = other.m_clock;
+	m_events = events;
+	return *this;
+}
+
+void ImportTrace::Clear()
+{
+	QMutexLocker lock(&m_mutex);
+	m_clock.start();
+	m_events.clear();
+}
+
+qint64 ImportTrace::Now() const
+{
+	return m_clock.nsecsElapsed();
+}
+
+void ImportTrace::Add(const char* name, Level level, qint64 startNs, qint64 endNs, const QString& detail)
+{
+	Event event;
+	event.m_name = name;
+	event.m_detail = detail;
+	event.m_level = level;
+	event.m_thread = quint64(quintptr(QThread::currentThreadId()));
+	event.m_startNs = startNs;
+	event.m_endNs = endNs;
+	QMutexLocker lock(&m_mutex);
+	m_events.push_back(event);
+}
+
+std::vector<ImportTrace::Event> ImportTrace::Events() const
+{
+	QMutexLocker lock(&m_mutex);
+	return m_events;
+}
+
+qint64 ImportTrace::DurationNs() const
+{
+	QMutexLocker lock(&m_mutex);
+	qint64 end = 0;
+	for (const Event& event : m_events) {
+		end = std::max(end, event.m_endNs);
+	}
+	return end;
+}
+
+std::vector<std::pair<const char*, qint64>> ImportTrace::StageTotals() const
+{
+	std::vector<std::pair<const char*, qint64>> totals;
+	for (const Event& event : Events()) {
+		if (event.m_level != k_stage) {
+			continue;
+		}
+		const auto it = std::find_if(totals.begin(), totals.end(), [&](const std::pair<const char*, qint64>& total) { return qstrcmp(total.first, event.m_name) == 0; });
+		if (it == totals.end()) {
+			totals.push_back({ event.m_name, event.m_endNs - event.m_startNs });
+		}
+		else {
+			it->second += event.m_endNs - event.m_startNs;
+		}
+	}
+	std::stable_sort(totals.begin(), totals.end(), [](const std::pair<const char*, qint64>& a, const std::pair<const char*, qint64>& b) { return a.second > b.second; });
+	return totals;
+}
+
+QString ImportTrace::Summary(int maxStages) const
+{
+	const std::vector<std::pair<const char*, qint64>> totals = StageTotals();
+	QStringList stages;
+	for (int i = 0; i < std::min(maxStages, int(totals.size())); ++i) {
+		stages += QString("%1 %2").arg(totals[i].first, Seconds(totals[i].second));
+	}
+	return QString("Loaded in %1: %2").arg(Seconds(DurationNs()), stages.join(", "));
+}
+
+bool ImportTrace::Save(const QString& filepath) const
+{
+	QFile file(filepath);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+
+	// Complete events in microseconds from the start of the load, a track per thread numbered
+	// in the order the threads first show up
+	const std::vector<Event> events = Events();
+	QHash<quint64, int> tracks;
+	QTextStream out(&file);
+	out << "{\"traceEvents\":[\n";
+	for (size_t i = 0; i < events.size(); ++i) {
+		const Event& event = events[i];
+		const auto track = tracks.constFind(event.m_thread);
+		QJsonObject object;
+		object.insert("name", event.m_name);
+		object.insert("cat", LevelName(event.m_level));
+		object.insert("ph", "X");
+		object.insert("pid", 0);
+		object.insert("tid", track != tracks.constEnd() ? *track : *tracks.insert(event.m_thread, tracks.size()));
+		object.insert("ts", double(event.m_startNs) / 1000.0);
+		object.insert("dur", double(event.m_endNs - event.m_startNs) / 1000.0);
+		if (!event.m_detail.isEmpty()) {
+			object.insert("args", QJsonObject{ { "detail", event.m_detail } });
+		}
+		out << QJsonDocument(object).toJson(QJsonDocument::Compact);
+		out << (i + 1 < events.size() ? ",\n" : "\n");
+	}
+	out << "],\"displayTimeUnit\":\"ms\"}\n";
+	return out.status() == QTextStream::Ok;
+}
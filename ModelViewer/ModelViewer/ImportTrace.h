@@ -0,0 +1,94 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QString>
+#include <QtGlobal>
+
+#include <utility>
+#include <vector>
+
+// Spans of time spent loading one model, on whichever thread they ran: reading the file, each
+// post-processing step, decoding the materials, textures and meshes, and uploading them. The
+// trace can be saved as a Chrome trace (chrome://tracing) JSON file, with a track per thread,
+// and summed up per stage. Spans are added from the worker, the thread pool and the GUI
+// thread at once.
+class ImportTrace
+{
+public:
+	// Stages of a load follow each other, steps are parts of a stage and items are the single
+	// meshes and textures the steps work through
+	enum Level : int {
+		k_stage,
+		k_step,
+		k_item,
+	};
+
+	struct Event {
+		const char* m_name = nullptr;
+		QString m_detail;
+		Level m_level = k_stage;
+		quint64 m_thread = 0;
+		qint64 m_startNs = 0;
+		qint64 m_endNs = 0;
+	};
+
+	// Adds a span for as long as it is in scope. Does nothing without a trace.
+	class Scope
+	{
+	public:
+		Scope(ImportTrace* pTrace, const char* name, Level level = k_step, const QString& detail = QString());
+		~Scope();
+	private:
+		ImportTrace* m_pTrace;
+		const char* m_name;
+		Level m_level;
+		QString m_detail;
+		qint64 m_startNs;
+	};
+
+	// Spans of parts that follow each other, each one ends where the next starts and the last
+	// when the sequence goes out of scope
+	class Sequence
+	{
+	public:
+		Sequence(ImportTrace* pTrace, Level level = k_step);
+		~Sequence();
+		void Next(const char* name);
+	private:
+		ImportTrace* m_pTrace;
+		Level m_level;
+		const char* m_name = nullptr;
+		qint64 m_startNs = 0;
+	};
+
+	// The clock starts when the trace is made
+	ImportTrace();
+	ImportTrace(const ImportTrace& other);
+	ImportTrace& operator=(const ImportTrace& other);
+
+	void Clear();
+
+	// Nanoseconds since the trace was made or cleared
+	qint64 Now() const;
+
+	// Names must outlive the trace, string literals are expected
+	void Add(const char* name, Level level, qint64 startNs, qint64 endNs, const QString& detail = QString());
+
+	std::vector<Event> Events() const;
+
+	// From the start of the trace to the end of its last span
+	qint64 DurationNs() const;
+
+	// Time of each stage over all its spans, longest first
+	std::vector<std::pair<const char*, qint64>> StageTotals() const;
+
+	// The duration and the longest stages on one line, for the status bar
+	QString Summary(int maxStages = 4) const;
+
+	bool Save(const QString& filepath) const;
+
+private:
+	mutable QMutex m_mutex;
+	QElapsedTimer m_clock;
+	std::vector<Event> m_events;
+};
@@ -0,0 +1,930 @@
+#include "IndirectRenderer.h"
+#include "Frustum.h"
+#include "GpuModelBuilder.h"
+#include "StreamBuffer.h"
+#include "TextureCache.h"
+#include "UniformBlocks.h"
+
+#include <QHash>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLFunctions_4_3_Core>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+
+#include <algorithm>
+
+
+namespace {
+
+// The default ads shaders, with the matrices of each instance read from the storage buffer.
+// A hidden instance of a mesh that is drawn, which the culling shader can only drop as a
+// whole, puts all its vertices on one point beyond the far plane.
+const char* k_vertexShaderSource =
+	"#version 430\n"
+	"layout(location = 0) in vec4 posAttr;\n"
+	"layout(location = 1) in vec4 colAttr;\n"
+	"layout(location = 2) in vec3 normAttr;\n"
+	"layout(location = 3) in vec2 uvAttr;\n"
+	"layout(location = 8) in uint objectAttr;\n"
+	"struct Object {\n"
+	"   mat4 transform;\n"
+	"   mat4 normal;\n"
+	"};\n"
+	"layout(std430, binding = 0) readonly buffer Objects {\n"
+	"   Object objects[];\n"
+	"};\n"
+	"layout(std430, binding = 6) readonly buffer HiddenObjects {\n"
+	"   uint hiddenObjects[];\n"
+	"};\n"
+	"#ifdef BINDLESS_TEXTURES\n"
+	"layout(std430, binding = 4) readonly buffer ObjectMaterials {\n"
+	"   uint objectMaterials[];\n"
+	"};\n"
+	"flat out uint vMaterial;\n"
+	"#endif\n"
+	"uniform mat4 uModelView;\n"
+	"uniform mat3 uNormalMat;\n"
+	"out vec4 col;\n"
+	"out vec3 vNs;\n"
+	"out vec3 vLs;\n"
+	"out vec3 vEs;\n"
+	"out vec2 texCoord;\n"
+	"out float gl_ClipDistance[6];\n"
+	"void main() {\n"
+	"   if ((hiddenObjects[objectAttr >> 5u] & (1u << (objectAttr & 31u))) != 0u) {\n"
+	"      gl_Position = vec4(0., 0., 2., 1.);\n"
+	"      return;\n"
+	"   }\n"
+	"   vec4 ECposition = uModelView * objects[objectAttr].transform * posAttr;\n"
+	"   vNs = normalize(uNormalMat * mat3(objects[objectAttr].normal) * normAttr);\n"
+	"   vLs = uLightPos - ECposition.xyz;\n"
+	"   vEs = -ECposition.xyz;\n"
+	"   col = colAttr;\n"
+	"   texCoord = uvAttr;\n"
+	"#ifdef BINDLESS_TEXTURES\n"
+	"   vMaterial = objectMaterials[objectAttr];\n"
+	"#endif\n"
+	"   for (int i = 0; i < 6; ++i) {\n"
+	"      gl_ClipDistance[i] = dot(uSectionPlanes[i], ECposition);\n"
+	"   }\n"
+	"   gl_Position = uProjection * ECposition;\n"
+	"}\n";
+
+// With bindless textures the materials of all meshes are in a storage buffer, each laid out
+// like a MaterialBlock, and each instance picks its own. The material block's names stand for
+// the instance's material, so MaterialSurface reads it as it would the block.
+const char* k_materialRecordDeclaration =
+	"struct MaterialRecord {\n"
+	"   vec4 ambient;\n"
+	"   vec4 diffuse;\n"
+	"   vec4 specular;\n"
+	"   float shininess;\n"
+	"   float hasTexture;\n"
+	"   float metallic;\n"
+	"   float roughness;\n"
+	"   vec4 baseColor;\n"
+	"   vec3 emissive;\n"
+	"   int maps;\n"
+	"   int metallicRoughness;\n"
+	"   int alphaMode;\n"
+	"   float alphaCutoff;\n"
+	"   uvec4 handles[3];\n"
+	"   vec4 virtualTexture;\n"
+	"};\n"
+	"layout(std430, binding = 5) readonly buffer Materials {\n"
+	"   MaterialRecord materials[];\n"
+	"};\n"
+	"flat in uint vMaterial;\n"
+	"#define uMaterialAmbient materials[vMaterial].ambient\n"
+	"#define uMaterialDiffuse materials[vMaterial].diffuse\n"
+	"#define uMaterialSpecular materials[vMaterial].specular\n"
+	"#define uMaterialShininess materials[vMaterial].shininess\n"
+	"#define uHasTexture materials[vMaterial].hasTexture\n"
+	"#define uMaterialMetallic materials[vMaterial].metallic\n"
+	"#define uMaterialRoughness materials[vMaterial].roughness\n"
+	"#define uMaterialBaseColor materials[vMaterial].baseColor\n"
+	"#define uMaterialEmissive materials[vMaterial].emissive\n"
+	"#define uMaterialMaps materials[vMaterial].maps\n"
+	"#define uMaterialMetallicRoughness materials[vMaterial].metallicRoughness\n"
+	"#define uMaterialAlphaMode materials[vMaterial].alphaMode\n"
+	"#define uMaterialAlphaCutoff materials[vMaterial].alphaCutoff\n"
+	"#define uMaterialHandles materials[vMaterial].handles\n"
+	"#define uMaterialVirtual materials[vMaterial].virtualTexture\n";
+
+const char* k_fragmentShaderSource =
+	"#version 430\n"
+	"in vec4 col;\n"
+	"in vec3 vNs;\n"
+	"in vec3 vLs;\n"
+	"in vec3 vEs;\n"
+	"in vec2 texCoord;\n"
+	"uniform sampler2D uTexture;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"   vec3 Normal = normalize(vNs);\n"
+	"   vec3 Light = normalize(vLs);\n"
+	"   vec3 Eye = normalize(vEs);\n"
+	"   vec4 baseColor = (SampleMaterialMap(0, uTexture, texCoord) * uHasTexture) + col * (1.0 - uHasTexture);\n"
+	"   Surface surface = MaterialSurface(baseColor, Normal, -vEs, texCoord, uSpecularColor.rgb, uShininess);\n"
+	"   Normal = surface.normal;\n"
+	"   vec4 adsColor = vec4(surface.diffuseColor, baseColor.a);\n"
+	"   vec4 ambient = uKa * surface.occlusion * adsColor;\n"
+	"   float d = max(dot(Normal, Light), 0.);\n"
+	"   float shadow = ShadowFactor(-vEs);\n"
+	"   vec4 diffuse = uKd * d * shadow * adsColor;\n"
+	"   float s = 0.;\n"
+	"   if (dot(Normal, Light) > 0.) {\n"
+	"      vec3 ref = normalize(2. * Normal * dot(Normal, Light) - Light);\n"
+	"      s = pow(max(dot(Eye, ref), 0.), surface.shininess);\n"
+	"   }\n"
+	"   vec3 specular = uKs * s * shadow * surface.specularColor;\n"
+	"   vec3 scene = SceneLighting(-vEs, Normal, Eye, uKd * adsColor.rgb, uKs * surface.specularColor, surface.shininess);\n"
+	"   vec3 environment = surface.occlusion * EnvironmentLighting(Normal, Eye, uKd * adsColor.rgb, uKs * surface.specularColor, surface.shininess);\n"
+	"   fragColor = vec4(ambient.rgb + diffuse.rgb + specular + scene + environment + surface.emissive, surface.alpha);\n"
+	"}\n";
+
+// Culls one mesh per invocation and writes its draw command. With uCompact the visible meshes
+// of a group are packed from the start of its region and counted, otherwise every mesh keeps
+// its slot and a culled one draws no instances. Meshes with every instance hidden are culled.
+const char* k_cullShaderSource =
+	"#version 430\n"
+	"layout(local_size_x = 64) in;\n"
+	"struct DrawCommand {\n"
+	"   uint count;\n"
+	"   uint instanceCount;\n"
+	"   uint firstIndex;\n"
+	"   int baseVertex;\n"
+	"   uint baseInstance;\n"
+	"};\n"
+	"struct MeshRecord {\n"
+	"   vec4 aabbMin;\n"
+	"   vec4 aabbMax;\n"
+	"   uint levelFirstIndex[4];\n"
+	"   uint levelIndexCount[4];\n"
+	"   int baseVertex;\n"
+	"   uint baseInstance;\n"
+	"   uint instanceCount;\n"
+	"   uint levelCount;\n"
+	"   uint group;\n"
+	"   uint firstCommand;\n"
+	"   uint slot;\n"
+	"   uint padding;\n"
+	"};\n"
+	"layout(std430, binding = 1) readonly buffer Meshes {\n"
+	"   MeshRecord meshes[];\n"
+	"};\n"
+	"layout(std430, binding = 2) writeonly buffer Commands {\n"
+	"   DrawCommand commands[];\n"
+	"};\n"
+	"layout(std430, binding = 3) buffer DrawCounts {\n"
+	"   uint drawCounts[];\n"
+	"};\n"
+	"layout(std430, binding = 7) readonly buffer HiddenCounts {\n"
+	"   uint hiddenCounts[];\n"
+	"};\n"
+	"uniform vec4 uPlanes[12];\n"
+	"uniform int uPlaneCount;\n"
+	"uniform mat4 uModelView;\n"
+	"uniform float uLodScale;\n"
+	"uniform float uPixelsPerTriangle;\n"
+	"uniform uint uMeshCount;\n"
+	"uniform int uCompact;\n"
+	"void main() {\n"
+	"   uint i = gl_GlobalInvocationID.x;\n"
+	"   if (i >= uMeshCount) {\n"
+	"      return;\n"
+	"   }\n"
+	"   MeshRecord mesh = meshes[i];\n"
+	"   bool visible = hiddenCounts[i] < mesh.instanceCount;\n"
+	"   for (int p = 0; p < uPlaneCount; ++p) {\n"
+	"      vec3 corner = mix(mesh.aabbMin.xyz, mesh.aabbMax.xyz, greaterThanEqual(uPlanes[p].xyz, vec3(0.)));\n"
+	"      if (dot(uPlanes[p].xyz, corner) + uPlanes[p].w < 0.) {\n"
+	"         visible = false;\n"
+	"      }\n"
+	"   }\n"
+	"   if (!visible && uCompact != 0) {\n"
+	"      return;\n"
+	"   }\n"
+	"   uint level = 0u;\n"
+	"   if (uLodScale > 0. && mesh.levelCount > 1u) {\n"
+	"      vec3 center = (uModelView * vec4((mesh.aabbMin.xyz + mesh.aabbMax.xyz) * 0.5, 1.)).xyz;\n"
+	"      float radius = length(mat3(uModelView) * ((mesh.aabbMax.xyz - mesh.aabbMin.xyz) * 0.5));\n"
+	"      float distance = -center.z;\n"
+	"      if (distance > radius) {\n"
+	"         float projectedRadius = radius / distance * uLodScale;\n"
+	"         float budget = 3.14159265 * projectedRadius * projectedRadius / uPixelsPerTriangle;\n"
+	"         while (level + 1u < mesh.levelCount && float(mesh.levelIndexCount[level] / 3u) * float(mesh.instanceCount) > budget) {\n"
+	"            ++level;\n"
+	"         }\n"
+	"      }\n"
+	"   }\n"
+	"   DrawCommand command;\n"
+	"   command.count = mesh.levelIndexCount[level];\n"
+	"   command.instanceCount = visible ? mesh.instanceCount : 0u;\n"
+	"   command.firstIndex = mesh.levelFirstIndex[level];\n"
+	"   command.baseVertex = mesh.baseVertex;\n"
+	"   command.baseInstance = mesh.baseInstance;\n"
+	"   uint slot = uCompact != 0 ? atomicAdd(drawCounts[mesh.group], 1u) : mesh.slot;\n"
+	"   commands[mesh.firstCommand + slot] = command;\n"
+	"}\n";
+
+const GLuint k_cullGroupSize = 64;
+const int k_maxLevels = 4;
+
+// One entry of the Objects storage buffer in std430 layout
+struct ObjectMatrices {
+	GLfloat m_transform[16];
+	GLfloat m_normal[16];
+};
+
+// One entry of the Meshes storage buffer in std430 layout. Level 0 is the full mesh.
+struct MeshRecord {
+	GLfloat m_aabbMin[4];
+	GLfloat m_aabbMax[4];
+	GLuint m_levelFirstIndex[k_maxLevels];
+	GLuint m_levelIndexCount[k_maxLevels];
+	GLint m_baseVertex;
+	GLuint m_baseInstance;
+	GLuint m_instanceCount;
+	GLuint m_levelCount;
+	GLuint m_group;
+	GLuint m_firstCommand;
+	GLuint m_slot;
+	GLuint m_padding;
+};
+static_assert(sizeof(MeshRecord) == 96, "MeshRecord has to match the std430 layout");
+
+typedef void (QOPENGLF_APIENTRYP MultiDrawElementsIndirectCount)(GLenum mode, GLenum type, const void* indirect, GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+#ifndef GL_PARAMETER_BUFFER_ARB
+#define GL_PARAMETER_BUFFER_ARB 0x80EE
+#endif
+
+int IndexSize(GLenum indexType)
+{
+	return indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+}
+
+}
+
+IndirectRenderer::~IndirectRenderer()
+{
+	// The buffers go with the context, only the programs are left
+	delete m_pProgram;
+	delete m_pCullProgram;
+}
+
+bool IndirectRenderer::Create()
+{
+	Destroy();
+
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(4, 3)) {
+		return false;
+	}
+	m_pFunctions = pContext->versionFunctions<QOpenGLFunctions_4_3_Core>();
+	if (!m_pFunctions || !m_pFunctions->initializeOpenGLFunctions()) {
+		m_pFunctions = nullptr;
+		return false;
+	}
+
+	// The frame block comes first, the shaders use its light and projection. The fragment
+	// shader also takes the material, the shadows, the scene lights and the environment.
+	// Bindless textures let meshes of any material share a draw, each instance then reads
+	// its material from a storage buffer rather than the bound block.
+	m_bindless = TextureCache::SupportsBindless();
+	const QByteArray bindless = m_bindless ? UniformBlocks::k_bindlessDirectives : "";
+	const QByteArray frameBlock(UniformBlocks::k_frameDeclaration);
+	const QByteArray materialBlock(m_bindless ? k_materialRecordDeclaration : UniformBlocks::k_materialDeclaration);
+	QByteArray vertexSource(k_vertexShaderSource);
+	QByteArray fragmentSource(k_fragmentShaderSource);
+	vertexSource.insert(vertexSource.indexOf('\n') + 1, bindless + frameBlock);
+	fragmentSource.insert(fragmentSource.indexOf('\n') + 1, bindless + frameBlock + materialBlock + UniformBlocks::k_surfaceDeclaration
+		+ UniformBlocks::k_shadowDeclaration + UniformBlocks::k_lightDeclaration + UniformBlocks::k_environmentDeclaration);
+
+	m_pProgram = new QOpenGLShaderProgram();
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+	if (!m_pProgram->link() || !UniformBlocks::BindBlock(m_pProgram, "FrameBlock", k_frameBlockBinding)) {
+		qWarning("Could not link the multi-draw shader: %s", qPrintable(m_pProgram->log()));
+		Destroy();
+		return false;
+	}
+	if (!m_bindless) {
+		UniformBlocks::BindMaterial(m_pProgram);
+	}
+	else {
+		UniformBlocks::BindPages(m_pProgram);
+	}
+	UniformBlocks::BindShadows(m_pProgram);
+	UniformBlocks::BindLights(m_pProgram);
+	UniformBlocks::BindEnvironment(m_pProgram);
+	m_modelViewUniform = m_pProgram->uniformLocation("uModelView");
+	m_normalUniform = m_pProgram->uniformLocation("uNormalMat");
+	m_textureUniform = m_pProgram->uniformLocation("uTexture");
+
+	m_created = true;
+
+	// Culling on the GPU is optional, the CPU fills the commands without it
+	if (!CreateCullProgram()) {
+		delete m_pCullProgram;
+		m_pCullProgram = nullptr;
+	}
+	if (pContext->format().version() >= qMakePair(4, 6)) {
+		m_pMultiDrawCount = pContext->getProcAddress("glMultiDrawElementsIndirectCount");
+	}
+	else if (pContext->hasExtension("GL_ARB_indirect_parameters")) {
+		m_pMultiDrawCount = pContext->getProcAddress("glMultiDrawElementsIndirectCountARB");
+	}
+	return true;
+}
+
+bool IndirectRenderer::CreateCullProgram()
+{
+	m_pCullProgram = new QOpenGLShaderProgram();
+	if (!m_pCullProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Compute, k_cullShaderSource) || !m_pCullProgram->link()) {
+		qWarning("Could not link the culling shader: %s", qPrintable(m_pCullProgram->log()));
+		return false;
+	}
+	m_planesUniform = m_pCullProgram->uniformLocation("uPlanes");
+	m_planeCountUniform = m_pCullProgram->uniformLocation("uPlaneCount");
+	m_cullModelViewUniform = m_pCullProgram->uniformLocation("uModelView");
+	m_lodScaleUniform = m_pCullProgram->uniformLocation("uLodScale");
+	m_pixelsPerTriangleUniform = m_pCullProgram->uniformLocation("uPixelsPerTriangle");
+	m_meshCountUniform = m_pCullProgram->uniformLocation("uMeshCount");
+	m_compactUniform = m_pCullProgram->uniformLocation("uCompact");
+	return true;
+}
+
+void IndirectRenderer::Destroy()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		Clear();
+	}
+	delete m_pProgram;
+	m_pProgram = nullptr;
+	delete m_pCullProgram;
+	m_pCullProgram = nullptr;
+	m_pMultiDrawCount = nullptr;
+	m_groups.clear();
+	m_entries.clear();
+	m_pFunctions = nullptr;
+	m_created = false;
+	m_built = false;
+}
+
+bool IndirectRenderer::IsCreated() const
+{
+	return m_created;
+}
+
+void IndirectRenderer::Build(const Model& model)
+{
+	Clear();
+	if (!m_created) {
+		return;
+	}
+	QOpenGLFunctions_4_3_Core* f = m_pFunctions;
+
+	// Sort the meshes into groups that can share a vertex array object and a material binding,
+	// which with bindless textures every material can.
+	// Attributes stored in separate blocks can't share one, their offsets differ per mesh.
+	// Skinned meshes are drawn one by one with their bone matrices, and see-through meshes in
+	// the transparent pass.
+	m_entries.resize(model.m_meshes.size());
+	std::vector<GLsizeiptr> vertexBytes;
+	std::vector<GLsizeiptr> indexBytes;
+	std::vector<ObjectMatrices> objects;
+	std::vector<GLuint> objectMaterials;
+	std::vector<bool> objectHidden;
+	std::vector<const Material*> materials;
+	QHash<const Material*, GLuint> materialIndices;
+	for (int meshIdx = 0; meshIdx < int(model.m_meshes.size()); ++meshIdx) {
+		const Mesh& mesh = model.m_meshes[meshIdx];
+		if (mesh.m_vertexStride == 0 || mesh.m_hasBones || !mesh.m_vertexBuffer.isCreated() || !mesh.m_indexBuffer.isCreated()
+			|| (mesh.m_material && mesh.m_material->m_properties.m_alphaMode == k_alphaBlend)) {
+			m_excludedMeshes.push_back(meshIdx);
+			continue;
+		}
+
+		int groupIdx = 0;
+		while (groupIdx < int(m_groups.size())) {
+			const Group& group = m_groups[groupIdx];
+			if (group.m_indexType == mesh.m_indexType && (m_bindless || group.m_material == mesh.m_material) && SameLayout(model.m_meshes[group.m_layoutMesh], mesh)) {
+				break;
+			}
+			++groupIdx;
+		}
+		if (groupIdx == int(m_groups.size())) {
+			Group group;
+			group.m_layoutMesh = meshIdx;
+			group.m_indexType = mesh.m_indexType;
+			group.m_material = mesh.m_material;
+			m_groups.push_back(group);
+			vertexBytes.push_back(0);
+			indexBytes.push_back(0);
+		}
+
+		// Vertices start on a whole vertex, so the base vertex can point at them
+		const GLsizeiptr stride = mesh.m_vertexStride;
+		vertexBytes[groupIdx] = (vertexBytes[groupIdx] + stride - 1) / stride * stride;
+		Entry& entry = m_entries[meshIdx];
+		entry.m_group = groupIdx;
+		++m_groups[groupIdx].m_meshCount;
+		entry.m_baseVertex = GLint(vertexBytes[groupIdx] / stride);
+		entry.m_firstIndex = GLuint(indexBytes[groupIdx] / IndexSize(mesh.m_indexType));
+		vertexBytes[groupIdx] += mesh.m_vertexBytes;
+		indexBytes[groupIdx] += mesh.m_indexBytes;
+
+		// Each material goes into the storage buffer once
+		GLuint materialIdx = 0;
+		if (m_bindless && mesh.m_material) {
+			auto it = materialIndices.find(mesh.m_material.data());
+			if (it == materialIndices.end()) {
+				it = materialIndices.insert(mesh.m_material.data(), GLuint(materials.size()));
+				materials.push_back(mesh.m_material.data());
+			}
+			materialIdx = it.value();
+		}
+
+		// Quantized positions are decoded before the instance transform, normals aren't
+		entry.m_firstObject = GLuint(objects.size());
+		auto AddObject = [&](const QMatrix4x4& transform) {
+			ObjectMatrices object;
+			const QMatrix4x4 positionTransform = transform * mesh.m_positionDecode;
+			const QMatrix3x3 normal = transform.normalMatrix();
+			std::copy(positionTransform.constData(), positionTransform.constData() + 16, object.m_transform);
+			std::fill(object.m_normal, object.m_normal + 16, 0.f);
+			for (int column = 0; column < 3; ++column) {
+				for (int row = 0; row < 3; ++row) {
+					object.m_normal[column * 4 + row] = normal(row, column);
+				}
+			}
+			objects.push_back(object);
+			objectMaterials.push_back(materialIdx);
+			objectHidden.push_back(!mesh.m_hiddenDraws.empty() && mesh.m_hiddenDraws[objectHidden.size() - entry.m_firstObject]);
+		};
+		if (mesh.m_instanceTransforms.empty()) {
+			AddObject(mesh.m_transform);
+		}
+		for (const QMatrix4x4& transform : mesh.m_instanceTransforms) {
+			AddObject(transform);
+		}
+		entry.m_objectCount = GLuint(objects.size()) - entry.m_firstObject;
+	}
+	if (m_groups.empty()) {
+		return;
+	}
+
+	// The instance matrices, and the index of each instance for the per instance attribute
+	std::vector<GLuint> objectIds(objects.size());
+	for (size_t i = 0; i < objectIds.size(); ++i) {
+		objectIds[i] = GLuint(i);
+	}
+	f->glGenBuffers(1, &m_objectBuffer);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectBuffer);
+	f->glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(ObjectMatrices), objects.data(), GL_STATIC_DRAW);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	f->glGenBuffers(1, &m_objectIdBuffer);
+	f->glBindBuffer(GL_ARRAY_BUFFER, m_objectIdBuffer);
+	f->glBufferData(GL_ARRAY_BUFFER, objectIds.size() * sizeof(GLuint), objectIds.data(), GL_STATIC_DRAW);
+	m_bytes = qint64(objects.size() * (sizeof(ObjectMatrices) + sizeof(GLuint)));
+
+	// The hidden objects, which SetHidden changes a bit of at a time
+	m_hiddenObjects.assign((objects.size() + 31) / 32, 0);
+	for (size_t i = 0; i < objectHidden.size(); ++i) {
+		if (objectHidden[i]) {
+			m_hiddenObjects[i >> 5] |= 1u << (i & 31);
+		}
+	}
+	f->glGenBuffers(1, &m_hiddenObjectBuffer);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_hiddenObjectBuffer);
+	f->glBufferData(GL_SHADER_STORAGE_BUFFER, m_hiddenObjects.size() * sizeof(GLuint), m_hiddenObjects.data(), GL_DYNAMIC_DRAW);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	m_bytes += qint64(m_hiddenObjects.size() * sizeof(GLuint));
+
+	// The material of each instance, and the materials copied from their uniform buffers
+	if (m_bindless) {
+		f->glGenBuffers(1, &m_objectMaterialBuffer);
+		f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_objectMaterialBuffer);
+		f->glBufferData(GL_SHADER_STORAGE_BUFFER, objectMaterials.size() * sizeof(GLuint), objectMaterials.data(), GL_STATIC_DRAW);
+		f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		const GLsizeiptr recordSize = sizeof(MaterialBlock);
+		f->glGenBuffers(1, &m_materialBuffer);
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, m_materialBuffer);
+		f->glBufferData(GL_COPY_WRITE_BUFFER, std::max<GLsizeiptr>(GLsizeiptr(materials.size()) * recordSize, recordSize), nullptr, GL_STATIC_DRAW);
+		for (size_t i = 0; i < materials.size(); ++i) {
+			if (materials[i]->m_buffer.isCreated()) {
+				f->glBindBuffer(GL_COPY_READ_BUFFER, materials[i]->m_buffer.bufferId());
+				f->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, GLintptr(i) * recordSize, recordSize);
+			}
+		}
+		m_bytes += qint64(objectMaterials.size() * sizeof(GLuint)) + qint64(materials.size()) * recordSize;
+	}
+
+	// Allocate the arenas and copy the meshes in without a trip through the CPU
+	for (int groupIdx = 0; groupIdx < int(m_groups.size()); ++groupIdx) {
+		Group& group = m_groups[groupIdx];
+		f->glGenBuffers(1, &group.m_vertexBuffer);
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, group.m_vertexBuffer);
+		f->glBufferData(GL_COPY_WRITE_BUFFER, vertexBytes[groupIdx], nullptr, GL_STATIC_DRAW);
+		f->glGenBuffers(1, &group.m_indexBuffer);
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, group.m_indexBuffer);
+		f->glBufferData(GL_COPY_WRITE_BUFFER, indexBytes[groupIdx], nullptr, GL_STATIC_DRAW);
+		m_bytes += vertexBytes[groupIdx] + indexBytes[groupIdx];
+	}
+	for (int meshIdx = 0; meshIdx < int(m_entries.size()); ++meshIdx) {
+		const Entry& entry = m_entries[meshIdx];
+		if (entry.m_group < 0) {
+			continue;
+		}
+		const Mesh& mesh = model.m_meshes[meshIdx];
+		const Group& group = m_groups[entry.m_group];
+		f->glBindBuffer(GL_COPY_READ_BUFFER, mesh.m_vertexBuffer.bufferId());
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, group.m_vertexBuffer);
+		f->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, GLintptr(mesh.m_baseVertex) * mesh.m_vertexStride, GLintptr(entry.m_baseVertex) * mesh.m_vertexStride, mesh.m_vertexBytes);
+		f->glBindBuffer(GL_COPY_READ_BUFFER, mesh.m_indexBuffer.bufferId());
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, group.m_indexBuffer);
+		f->glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, mesh.m_indexOffset, GLintptr(entry.m_firstIndex) * IndexSize(mesh.m_indexType), mesh.m_indexBytes);
+	}
+	f->glBindBuffer(GL_COPY_READ_BUFFER, 0);
+	f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	// Every mesh of a group has the layout of the first one, offsets within a vertex included
+	for (Group& group : m_groups) {
+		f->glGenVertexArrays(1, &group.m_vao);
+		f->glBindVertexArray(group.m_vao);
+		f->glBindBuffer(GL_ARRAY_BUFFER, group.m_vertexBuffer);
+		f->glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, group.m_indexBuffer);
+		GpuModelBuilder::EnableAttributes(QOpenGLContext::currentContext()->functions(), model.m_meshes[group.m_layoutMesh]);
+		f->glBindBuffer(GL_ARRAY_BUFFER, m_objectIdBuffer);
+		f->glVertexAttribIPointer(k_objectLocation, 1, GL_UNSIGNED_INT, 0, nullptr);
+		f->glEnableVertexAttribArray(k_objectLocation);
+		f->glVertexAttribDivisor(k_objectLocation, 1);
+		f->glBindVertexArray(0);
+	}
+	f->glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	// What the culling shader needs to know about each mesh, and room for the commands it writes
+	GLuint commandCount = 0;
+	for (Group& group : m_groups) {
+		group.m_firstCommand = commandCount;
+		commandCount += group.m_meshCount;
+	}
+	std::vector<MeshRecord> records;
+	std::vector<GLuint> slots(m_groups.size(), 0);
+	for (int meshIdx = 0; meshIdx < int(m_entries.size()); ++meshIdx) {
+		Entry& entry = m_entries[meshIdx];
+		if (entry.m_group < 0) {
+			continue;
+		}
+		const Mesh& mesh = model.m_meshes[meshIdx];
+		MeshRecord record = {};
+		for (int axis = 0; axis < 3; ++axis) {
+			record.m_aabbMin[axis] = mesh.m_AABBMin[axis];
+			record.m_aabbMax[axis] = mesh.m_AABBMax[axis];
+		}
+		record.m_levelFirstIndex[0] = entry.m_firstIndex;
+		record.m_levelIndexCount[0] = GLuint(mesh.m_indexCount);
+		record.m_levelCount = 1;
+		for (const MeshLod& lod : mesh.m_lods) {
+			if (record.m_levelCount == k_maxLevels) {
+				break;
+			}
+			record.m_levelFirstIndex[record.m_levelCount] = entry.m_firstIndex + GLuint(lod.m_firstIndex);
+			record.m_levelIndexCount[record.m_levelCount] = GLuint(lod.m_indexCount);
+			++record.m_levelCount;
+		}
+		record.m_baseVertex = entry.m_baseVertex;
+		record.m_baseInstance = entry.m_firstObject;
+		record.m_instanceCount = entry.m_objectCount;
+		record.m_group = GLuint(entry.m_group);
+		record.m_firstCommand = m_groups[entry.m_group].m_firstCommand;
+		record.m_slot = slots[entry.m_group]++;
+		entry.m_record = int(records.size());
+		records.push_back(record);
+		m_hiddenCounts.push_back(GLuint(mesh.m_hiddenDrawCount));
+	}
+	m_meshRecordCount = GLuint(records.size());
+	m_zeroDrawCounts.assign(m_groups.size(), 0);
+	f->glGenBuffers(1, &m_meshRecordBuffer);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_meshRecordBuffer);
+	f->glBufferData(GL_SHADER_STORAGE_BUFFER, records.size() * sizeof(MeshRecord), records.data(), GL_STATIC_DRAW);
+	f->glGenBuffers(1, &m_culledCommandBuffer);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_culledCommandBuffer);
+	f->glBufferData(GL_SHADER_STORAGE_BUFFER, commandCount * sizeof(DrawCommand), nullptr, GL_DYNAMIC_COPY);
+	f->glGenBuffers(1, &m_drawCountBuffer);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawCountBuffer);
+	f->glBufferData(GL_SHADER_STORAGE_BUFFER, m_zeroDrawCounts.size() * sizeof(GLuint), m_zeroDrawCounts.data(), GL_DYNAMIC_COPY);
+	f->glGenBuffers(1, &m_hiddenCountBuffer);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_hiddenCountBuffer);
+	f->glBufferData(GL_SHADER_STORAGE_BUFFER, m_hiddenCounts.size() * sizeof(GLuint), m_hiddenCounts.data(), GL_DYNAMIC_DRAW);
+	f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	m_bytes += qint64(records.size() * (sizeof(MeshRecord) + sizeof(GLuint)) + commandCount * sizeof(DrawCommand) + m_zeroDrawCounts.size() * sizeof(GLuint));
+	m_built = true;
+}
+
+void IndirectRenderer::Clear()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		for (Group& group : m_groups) {
+			m_pFunctions->glDeleteVertexArrays(1, &group.m_vao);
+			m_pFunctions->glDeleteBuffers(1, &group.m_vertexBuffer);
+			m_pFunctions->glDeleteBuffers(1, &group.m_indexBuffer);
+		}
+		m_pFunctions->glDeleteBuffers(1, &m_objectBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_objectIdBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_objectMaterialBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_materialBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_meshRecordBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_culledCommandBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_drawCountBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_hiddenObjectBuffer);
+		m_pFunctions->glDeleteBuffers(1, &m_hiddenCountBuffer);
+	}
+	m_groups.clear();
+	m_entries.clear();
+	m_excludedMeshes.clear();
+	m_objectBuffer = 0;
+	m_objectIdBuffer = 0;
+	m_objectMaterialBuffer = 0;
+	m_materialBuffer = 0;
+	m_meshRecordBuffer = 0;
+	m_culledCommandBuffer = 0;
+	m_drawCountBuffer = 0;
+	m_hiddenObjectBuffer = 0;
+	m_hiddenCountBuffer = 0;
+	m_hiddenObjects.clear();
+	m_hiddenCounts.clear();
+	m_dirtyObjects = DirtyRange();
+	m_dirtyCounts = DirtyRange();
+	m_meshRecordCount = 0;
+	m_bytes = 0;
+	m_built = false;
+}
+
+bool IndirectRenderer::IsBuilt() const
+{
+	return m_built;
+}
+
+bool IndirectRenderer::Contains(int mesh) const
+{
+	return mesh >= 0 && mesh < int(m_entries.size()) && m_entries[mesh].m_group >= 0;
+}
+
+const std::vector<int>& IndirectRenderer::ExcludedMeshes() const
+{
+	return m_excludedMeshes;
+}
+
+qint64 IndirectRenderer::Bytes() const
+{
+	return m_bytes;
+}
+
+void IndirectRenderer::SetHidden(int mesh, int draw, bool hidden)
+{
+	if (!Contains(mesh) || draw < 0 || GLuint(draw) >= m_entries[mesh].m_objectCount) {
+		return;
+	}
+	const Entry& entry = m_entries[mesh];
+	const GLuint object = entry.m_firstObject + GLuint(draw);
+	if (IsObjectHidden(object) == hidden) {
+		return;
+	}
+	m_hiddenObjects[object >> 5] ^= 1u << (object & 31u);
+	GLuint& hiddenCount = m_hiddenCounts[entry.m_record];
+	hiddenCount = hidden ? hiddenCount + 1 : hiddenCount - 1;
+	m_dirtyObjects.Add(object >> 5);
+	m_dirtyCounts.Add(size_t(entry.m_record));
+}
+
+void IndirectRenderer::Add(int mesh, const MeshLod& lod)
+{
+	const Entry& entry = m_entries[mesh];
+	const GLuint hiddenCount = m_hiddenCounts[entry.m_record];
+	if (hiddenCount == entry.m_objectCount) {
+		return;
+	}
+	DrawCommand command;
+	command.m_count = GLuint(lod.m_indexCount);
+	command.m_instanceCount = entry.m_objectCount;
+	command.m_firstIndex = entry.m_firstIndex + GLuint(lod.m_firstIndex);
+	command.m_baseVertex = entry.m_baseVertex;
+	command.m_baseInstance = entry.m_firstObject;
+	std::vector<DrawCommand>& commands = m_groups[entry.m_group].m_commands;
+	if (hiddenCount == 0) {
+		commands.push_back(command);
+		return;
+	}
+
+	// Each run of shown instances gets a command of its own
+	const GLuint end = entry.m_firstObject + entry.m_objectCount;
+	for (GLuint object = entry.m_firstObject; object < end;) {
+		if (IsObjectHidden(object)) {
+			++object;
+			continue;
+		}
+		command.m_baseInstance = object;
+		while (object < end && !IsObjectHidden(object)) {
+			++object;
+		}
+		command.m_instanceCount = object - command.m_baseInstance;
+		commands.push_back(command);
+	}
+}
+
+int IndirectRenderer::Draw(const QMatrix4x4& modelView, const QVector4D& color, StreamBuffer& stream)
+{
+	// Gather the commands of all groups into one upload
+	m_frameCommands.clear();
+	for (const Group& group : m_groups) {
+		m_frameCommands.insert(m_frameCommands.end(), group.m_commands.begin(), group.m_commands.end());
+	}
+	if (m_frameCommands.empty()) {
+		return 0;
+	}
+	const qint64 commandOffset = stream.Write(m_frameCommands.data(), qint64(m_frameCommands.size() * sizeof(DrawCommand)), sizeof(GLuint));
+	if (commandOffset < 0) {
+		for (Group& group : m_groups) {
+			group.m_commands.clear();
+		}
+		return 0;
+	}
+	QOpenGLFunctions_4_3_Core* f = m_pFunctions;
+	f->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.Buffer());
+	BeginDraw(modelView, color);
+
+	int drawCalls = 0;
+	size_t firstCommand = 0;
+	for (Group& group : m_groups) {
+		if (group.m_commands.empty()) {
+			continue;
+		}
+		BindGroup(group);
+		f->glMultiDrawElementsIndirect(GL_TRIANGLES, group.m_indexType, reinterpret_cast<const void*>(commandOffset + firstCommand * sizeof(DrawCommand)), GLsizei(group.m_commands.size()), 0);
+		firstCommand += group.m_commands.size();
+		group.m_commands.clear();
+		++drawCalls;
+	}
+	EndDraw();
+	return drawCalls;
+}
+
+bool IndirectRenderer::SupportsGpuCulling() const
+{
+	return m_pCullProgram != nullptr;
+}
+
+int IndirectRenderer::DrawCulled(const Frustum& frustum, const QMatrix4x4& modelView, const QVector4D& color, float lodScale, float pixelsPerTriangle)
+{
+	if (!m_pCullProgram || m_meshRecordCount == 0) {
+		return 0;
+	}
+	QOpenGLFunctions_4_3_Core* f = m_pFunctions;
+	UploadVisibility();
+	const bool compact = m_pMultiDrawCount != nullptr;
+	if (compact) {
+		f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawCountBuffer);
+		f->glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_zeroDrawCounts.size() * sizeof(GLuint), m_zeroDrawCounts.data());
+		f->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	QVector4D planes[6 + Frustum::k_maxExtraPlanes];
+	for (int i = 0; i < frustum.PlaneCount(); ++i) {
+		planes[i] = frustum.Plane(i);
+	}
+	m_pCullProgram->bind();
+	m_pCullProgram->setUniformValueArray(m_planesUniform, planes, frustum.PlaneCount());
+	m_pCullProgram->setUniformValue(m_planeCountUniform, frustum.PlaneCount());
+	m_pCullProgram->setUniformValue(m_cullModelViewUniform, modelView);
+	m_pCullProgram->setUniformValue(m_lodScaleUniform, lodScale);
+	m_pCullProgram->setUniformValue(m_pixelsPerTriangleUniform, pixelsPerTriangle);
+	m_pCullProgram->setUniformValue(m_meshCountUniform, m_meshRecordCount);
+	m_pCullProgram->setUniformValue(m_compactUniform, compact ? 1 : 0);
+	f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_meshRecordBuffer);
+	f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_culledCommandBuffer);
+	f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_drawCountBuffer);
+	f->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_hiddenCountBuffer);
+	f->glDispatchCompute((m_meshRecordCount + k_cullGroupSize - 1) / k_cullGroupSize, 1, 1);
+	m_pCullProgram->release();
+
+	// The draws read what the dispatch wrote as commands and counts
+	f->glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+	f->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_culledCommandBuffer);
+	if (compact) {
+		f->glBindBuffer(GL_PARAMETER_BUFFER_ARB, m_drawCountBuffer);
+	}
+	BeginDraw(modelView, color);
+	int drawCalls = 0;
+	for (int groupIdx = 0; groupIdx < int(m_groups.size()); ++groupIdx) {
+		Group& group = m_groups[groupIdx];
+		BindGroup(group);
+		const void* pCommands = reinterpret_cast<const void*>(GLintptr(group.m_firstCommand) * GLintptr(sizeof(DrawCommand)));
+		if (compact) {
+			reinterpret_cast<MultiDrawElementsIndirectCount>(m_pMultiDrawCount)(GL_TRIANGLES, group.m_indexType, pCommands,
+				GLintptr(groupIdx) * GLintptr(sizeof(GLuint)), GLsizei(group.m_meshCount), 0);
+		}
+		else {
+			f->glMultiDrawElementsIndirect(GL_TRIANGLES, group.m_indexType, pCommands, GLsizei(group.m_meshCount), 0);
+		}
+		++drawCalls;
+	}
+	EndDraw();
+	if (compact) {
+		f->glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+	}
+	return drawCalls;
+}
+
+bool IndirectRenderer::IsObjectHidden(GLuint object) const
+{
+	return (m_hiddenObjects[object >> 5] & (1u << (object & 31u))) != 0;
+}
+
+void IndirectRenderer::UploadVisibility()
+{
+	// Only the words between the first and last one changed are written
+	auto Upload = [this](GLuint buffer, const std::vector<GLuint>& words, DirtyRange& dirty) {
+		if (dirty.m_first < dirty.m_end) {
+			m_pFunctions->glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+			m_pFunctions->glBufferSubData(GL_SHADER_STORAGE_BUFFER, GLintptr(dirty.m_first * sizeof(GLuint)),
+				GLsizeiptr((dirty.m_end - dirty.m_first) * sizeof(GLuint)), words.data() + dirty.m_first);
+			m_pFunctions->glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		}
+		dirty = DirtyRange();
+	};
+	Upload(m_hiddenObjectBuffer, m_hiddenObjects, m_dirtyObjects);
+	Upload(m_hiddenCountBuffer, m_hiddenCounts, m_dirtyCounts);
+}
+
+void IndirectRenderer::BeginDraw(const QMatrix4x4& modelView, const QVector4D& color)
+{
+	UploadVisibility();
+	m_pFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_objectBuffer);
+	m_pFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 6, m_hiddenObjectBuffer);
+	if (m_bindless) {
+		m_pFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4, m_objectMaterialBuffer);
+		m_pFunctions->glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 5, m_materialBuffer);
+	}
+	m_pProgram->bind();
+	m_pProgram->setUniformValue(m_modelViewUniform, modelView);
+	m_pProgram->setUniformValue(m_normalUniform, modelView.normalMatrix());
+	m_pProgram->setUniformValue(m_textureUniform, 0);
+	m_pProgram->setAttributeValue(k_colorLocation, color);
+}
+
+void IndirectRenderer::BindGroup(Group& group)
+{
+	// The material block holds whether the base color map is used. Bindless groups have no
+	// material of their own, their instances read theirs with the maps' handles.
+	const Material* pMaterial = m_bindless ? nullptr : group.m_material.data();
+	if (pMaterial) {
+		if (pMaterial->m_buffer.isCreated()) {
+			m_pFunctions->glBindBufferBase(GL_UNIFORM_BUFFER, k_materialBlockBinding, pMaterial->m_buffer.bufferId());
+		}
+		const GLint units[k_materialMapCount] = { 0, UniformBlocks::k_normalMapUnit, UniformBlocks::k_metallicRoughnessMapUnit,
+			UniformBlocks::k_occlusionMapUnit, UniformBlocks::k_emissiveMapUnit };
+		for (int map = 0; map < k_materialMapCount; ++map) {
+			if (pMaterial->m_maps[map]) {
+				pMaterial->m_maps[map]->bind(units[map]);
+			}
+		}
+	}
+	m_pFunctions->glBindVertexArray(group.m_vao);
+}
+
+void IndirectRenderer::EndDraw()
+{
+	m_pFunctions->glBindVertexArray(0);
+	m_pFunctions->glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	m_pProgram->release();
+}
+
+void IndirectRenderer::DirtyRange::Add(size_t i)
+{
+	if (m_first == m_end) {
+		m_first = i;
+		m_end = i + 1;
+	}
+	else {
+		m_first = std::min(m_first, i);
+		m_end = std::max(m_end, i + 1);
+	}
+}
+
+bool IndirectRenderer::SameLayout(const Mesh& a, const Mesh& b)
+{
+	return a.m_vertexStride == b.m_vertexStride
+		&& a.m_positionOffset == b.m_positionOffset && a.m_normalOffset == b.m_normalOffset
+		&& a.m_uvOffset == b.m_uvOffset && a.m_colorOffset == b.m_colorOffset
+		&& a.m_numPositionComponents == b.m_numPositionComponents && a.m_numNormalComponents == b.m_numNormalComponents
+		&& a.m_numUVComponents == b.m_numUVComponents && a.m_numColorComponents == b.m_numColorComponents
+		&& a.m_positionType == b.m_positionType && a.m_normalType == b.m_normalType
+		&& a.m_uvType == b.m_uvType && a.m_colorType == b.m_colorType
+		&& a.m_hasNormals == b.m_hasNormals && a.m_hasUVCoordinates == b.m_hasUVCoordinates
+		&& a.m_hasColors == b.m_hasColors;
+}
@@ -0,0 +1,172 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QSharedPointer>
+#include <QVector4D>
+#include <qopengl.h>
+
+#include "ModelLoader.h"
+
+class Frustum;
+class StreamBuffer;
+class QOpenGLFunctions_4_3_Core;
+class QOpenGLShaderProgram;
+
+// Draws a model with one glMultiDrawElementsIndirect per vertex layout and material, on OpenGL 4.3.
+// With bindless textures the materials don't split the draws, every instance reads its own.
+// The meshes' vertices and indices are copied into shared arenas on the GPU, and the transform
+// and normal matrix of every mesh instance go into a shader storage buffer once. A frame then only
+// writes the draw commands of the meshes in view. Each command's base instance selects the
+// instance's matrices through a per instance attribute, gl_DrawID would need OpenGL 4.6.
+// DrawCulled goes one step further and leaves culling and level of detail to a compute shader.
+// Hiding an instance flips its bit in a storage buffer, which both paths read, nothing is built again.
+class IndirectRenderer
+{
+public:
+	~IndirectRenderer();
+
+	// Creating and destroying the program and buffers requires the context they are used in to
+	// be current. Create returns false without OpenGL 4.3, the renderer then draws nothing.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Copies the buffers of model's meshes into the arenas, replacing the previous ones. Meshes
+	// with their attributes in separate blocks are left out, and so are skinned meshes, which
+	// need their bone matrices, and see-through ones.
+	void Build(const Model& model);
+	void Clear();
+	bool IsBuilt() const;
+
+	// Whether mesh is in the arenas and can be added
+	bool Contains(int mesh) const;
+
+	// The meshes Build left out, DrawCulled doesn't draw them
+	const std::vector<int>& ExcludedMeshes() const;
+
+	// GPU memory taken by the arenas and the instance matrices
+	qint64 Bytes() const;
+
+	// Hides or shows an instance of mesh, or draw 0 of a mesh drawn once. Only its bit and the
+	// mesh's count of hidden instances change, the words that changed are written to the GPU
+	// with the next draw. Meshes not in the arenas are left alone.
+	void SetHidden(int mesh, int draw, bool hidden);
+
+	// Queues the shown instances of mesh at lod for the next Draw, one command per run of them
+	void Add(int mesh, const MeshLod& lod);
+
+	// Draws the queued meshes with the lighting of the default shaders, their commands written
+	// into stream. The frame uniform block has to be bound. color is used for meshes without
+	// vertex colors. Returns the number of draw calls, and leaves no program or vertex array
+	// object bound.
+	int Draw(const QMatrix4x4& modelView, const QVector4D& color, StreamBuffer& stream);
+
+	// Whether the culling compute shader linked, DrawCulled does nothing otherwise
+	bool SupportsGpuCulling() const;
+
+	// Draws the meshes in the arenas that intersect frustum, without the CPU looking at any of
+	// them. A compute pass tests every mesh's AABB against all planes of frustum, which is in
+	// model space, section planes included, picks its level of detail and writes the draw
+	// commands. lodScale is half the viewport height over the tangent of half the field of view,
+	// 0 draws every mesh in full. Returns the number of draw calls, the number of meshes drawn
+	// stays on the GPU.
+	int DrawCulled(const Frustum& frustum, const QMatrix4x4& modelView, const QVector4D& color, float lodScale, float pixelsPerTriangle);
+
+private:
+	// Laid out as glMultiDrawElementsIndirect reads it
+	struct DrawCommand {
+		GLuint m_count;
+		GLuint m_instanceCount;
+		GLuint m_firstIndex;
+		GLint m_baseVertex;
+		GLuint m_baseInstance;
+	};
+
+	// Meshes sharing a vertex layout, index type and material
+	struct Group {
+		int m_layoutMesh = -1;
+		GLenum m_indexType = GL_UNSIGNED_INT;
+		QSharedPointer<const Material> m_material;
+		GLuint m_vao = 0;
+		GLuint m_vertexBuffer = 0;
+		GLuint m_indexBuffer = 0;
+		std::vector<DrawCommand> m_commands;
+
+		// The group's region of the culled command buffer
+		GLuint m_firstCommand = 0;
+		GLuint m_meshCount = 0;
+	};
+
+	// Where a mesh ended up, m_group is -1 if it's not in the arenas
+	struct Entry {
+		int m_group = -1;
+		GLuint m_firstIndex = 0;
+		GLint m_baseVertex = 0;
+		GLuint m_firstObject = 0;
+		GLuint m_objectCount = 0;
+		int m_record = -1; // Its entry of the Meshes storage buffer
+	};
+
+	// Elements of a buffer changed since it was last written, from m_first up to m_end
+	struct DirtyRange {
+		size_t m_first = 0;
+		size_t m_end = 0;
+		void Add(size_t i);
+	};
+
+	static bool SameLayout(const Mesh& a, const Mesh& b);
+
+	bool CreateCullProgram();
+	bool IsObjectHidden(GLuint object) const;
+	void UploadVisibility();
+	void BeginDraw(const QMatrix4x4& modelView, const QVector4D& color);
+	void BindGroup(Group& group);
+	void EndDraw();
+
+	QOpenGLFunctions_4_3_Core* m_pFunctions = nullptr;
+	QOpenGLShaderProgram* m_pProgram = nullptr;
+	GLint m_modelViewUniform = -1;
+	GLint m_normalUniform = -1;
+	GLint m_textureUniform = -1;
+	bool m_created = false;
+	bool m_bindless = false;
+
+	QOpenGLShaderProgram* m_pCullProgram = nullptr;
+	GLint m_planesUniform = -1;
+	GLint m_planeCountUniform = -1;
+	GLint m_cullModelViewUniform = -1;
+	GLint m_lodScaleUniform = -1;
+	GLint m_pixelsPerTriangleUniform = -1;
+	GLint m_meshCountUniform = -1;
+	GLint m_compactUniform = -1;
+
+	// glMultiDrawElementsIndirectCount, from OpenGL 4.6 or ARB_indirect_parameters. Without it
+	// culled meshes keep their command with no instances instead of being compacted away.
+	QFunctionPointer m_pMultiDrawCount = nullptr;
+
+	std::vector<Group> m_groups;
+	std::vector<Entry> m_entries;
+	GLuint m_objectBuffer = 0;
+	GLuint m_objectIdBuffer = 0;
+	GLuint m_objectMaterialBuffer = 0;
+	GLuint m_materialBuffer = 0;
+	std::vector<DrawCommand> m_frameCommands;
+	std::vector<int> m_excludedMeshes;
+	GLuint m_meshRecordBuffer = 0;
+	GLuint m_culledCommandBuffer = 0;
+	GLuint m_drawCountBuffer = 0;
+	GLuint m_meshRecordCount = 0;
+	std::vector<GLuint> m_zeroDrawCounts;
+
+	// One bit per object, set when hidden, and the number of hidden objects of each mesh
+	// record, as the vertex and culling shaders read them
+	std::vector<GLuint> m_hiddenObjects;
+	std::vector<GLuint> m_hiddenCounts;
+	DirtyRange m_dirtyObjects;
+	DirtyRange m_dirtyCounts;
+	GLuint m_hiddenObjectBuffer = 0;
+	GLuint m_hiddenCountBuffer = 0;
+	qint64 m_bytes = 0;
+	bool m_built = false;
+};
@@ -0,0 +1,359 @@
+#include "Inflate.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+
+
+namespace {
+
+// Codes up to this long are decoded with one table lookup, longer ones bit by bit
+const int k_fastBits = 10;
+
+const uint16_t k_lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const uint8_t k_lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const uint16_t k_distBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+const uint8_t k_distExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// The order the lengths of the code length code are stored in
+const uint8_t k_codeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Deflate packs its bits starting with the lowest bit of each byte
+class BitReader
+{
+public:
+	BitReader(const unsigned char* pData, size_t size) : m_pNext(pData), m_pEnd(pData + size) {}
+
+	// The next n bits, at most 32, zeros past the end of the data
+	uint32_t Peek(int n) {
+		while (m_count <= 56 && m_pNext < m_pEnd) {
+			m_bits |= uint64_t(*m_pNext++) << m_count;
+			m_count += 8;
+		}
+		return uint32_t(m_bits & ((uint64_t(1) << n) - 1));
+	}
+
+	// False if the data has fewer than n bits left
+	bool Consume(int n) {
+		if (n > m_count) {
+			return false;
+		}
+		m_bits >>= n;
+		m_count -= n;
+		return true;
+	}
+
+	bool Bits(int n, uint32_t& value) {
+		value = Peek(n);
+		return Consume(n);
+	}
+
+	// Skips to the next byte boundary and gives back the whole bytes read ahead, so stored
+	// blocks are copied straight from the data
+	void AlignToByte() {
+		Consume(m_count & 7);
+		m_pNext -= m_count / 8;
+		m_bits = 0;
+		m_count = 0;
+	}
+
+	const unsigned char* m_pNext;
+	const unsigned char* m_pEnd;
+
+private:
+	uint64_t m_bits = 0;
+	int m_count = 0;
+};
+
+// A canonical Huffman code, as deflate defines it by the code length of each symbol
+class Huffman
+{
+public:
+	// False if the lengths describe more codes than there are
+	bool Build(const uint8_t* pLengths, int symbolCount) {
+		std::fill(std::begin(m_count), std::end(m_count), uint16_t(0));
+		for (int i = 0; i < symbolCount; ++i) {
+			++m_count[pLengths[i]];
+		}
+		m_count[0] = 0;
+		int left = 1;
+		for (int len = 1; len < 16; ++len) {
+			left = left * 2 - m_count[len];
+			if (left < 0) {
+				return false;
+			}
+		}
+
+		// Symbols sorted by their code, which sorts them by length and then by value
+		uint16_t offsets[16] = {};
+		for (int len = 1; len < 15; ++len) {
+			offsets[len + 1] = offsets[len] + m_count[len];
+		}
+		for (int i = 0; i < symbolCount; ++i) {
+			if (pLengths[i]) {
+				m_symbol[offsets[pLengths[i]]++] = uint16_t(i);
+			}
+		}
+
+		// Every k_fastBits wide bit pattern starting with a short code maps to its symbol
+		std::fill(std::begin(m_fast), std::end(m_fast), uint16_t(0));
+		int code = 0;
+		int index = 0;
+		for (int len = 1; len <= k_fastBits; ++len, code <<= 1) {
+			for (int i = 0; i < m_count[len]; ++i, ++code) {
+				int reversed = 0;
+				for (int bit = 0; bit < len; ++bit) {
+					reversed |= ((code >> bit) & 1) << (len - 1 - bit);
+				}
+				const uint16_t entry = uint16_t(m_symbol[index++] << 4 | len);
+				for (int pattern = reversed; pattern < (1 << k_fastBits); pattern += 1 << len) {
+					m_fast[pattern] = entry;
+				}
+			}
+		}
+		return true;
+	}
+
+	// The next symbol, -1 if the bits are no code
+	int Decode(BitReader& in) const {
+		const uint32_t bits = in.Peek(15);
+		const uint16_t entry = m_fast[bits & ((1 << k_fastBits) - 1)];
+		if (entry) {
+			return in.Consume(entry & 15) ? entry >> 4 : -1;
+		}
+
+		// The first code of each length follows from the counts of the shorter ones
+		int code = 0;
+		int first = 0;
+		int index = 0;
+		for (int len = 1; len < 16; ++len) {
+			code |= (bits >> (len - 1)) & 1;
+			const int count = m_count[len];
+			if (code - count < first) {
+				return in.Consume(len) ? m_symbol[index + (code - first)] : -1;
+			}
+			index += count;
+			first = (first + count) << 1;
+			code <<= 1;
+		}
+		return -1;
+	}
+
+private:
+	uint16_t m_count[16];
+	uint16_t m_symbol[288];
+	// Symbol << 4 | code length, 0 for codes longer than k_fastBits
+	uint16_t m_fast[1 << k_fastBits];
+};
+
+// The codes of blocks compressed with the fixed codes of the format
+struct FixedCodes {
+	FixedCodes() {
+		uint8_t lengths[288];
+		std::fill(lengths, lengths + 144, uint8_t(8));
+		std::fill(lengths + 144, lengths + 256, uint8_t(9));
+		std::fill(lengths + 256, lengths + 280, uint8_t(7));
+		std::fill(lengths + 280, lengths + 288, uint8_t(8));
+		m_literals.Build(lengths, 288);
+		std::fill(lengths, lengths + 30, uint8_t(5));
+		m_distances.Build(lengths, 30);
+	}
+
+	Huffman m_literals;
+	Huffman m_distances;
+};
+
+class Inflater
+{
+public:
+	Inflater(const unsigned char* pData, size_t size, unsigned char* pOut, size_t outSize)
+		: m_in(pData, size), m_pOut(pOut), m_outSize(outSize) {}
+
+	bool Run() {
+		uint32_t last = 0;
+		do {
+			uint32_t type = 0;
+			if (!m_in.Bits(1, last) || !m_in.Bits(2, type)) {
+				return false;
+			}
+			if (type == 0) {
+				if (!Stored()) {
+					return false;
+				}
+			}
+			else if (type == 1) {
+				static const FixedCodes fixed;
+				if (!Codes(fixed.m_literals, fixed.m_distances)) {
+					return false;
+				}
+			}
+			else if (type == 2) {
+				if (!Dynamic()) {
+					return false;
+				}
+			}
+			else {
+				return false;
+			}
+		} while (!last);
+		return m_written == m_outSize;
+	}
+
+private:
+	bool Stored() {
+		m_in.AlignToByte();
+		const unsigned char* p = m_in.m_pNext;
+		if (m_in.m_pEnd - p < 4) {
+			return false;
+		}
+		const size_t len = size_t(p[0] | p[1] << 8);
+		const size_t inverse = size_t(p[2] | p[3] << 8);
+		p += 4;
+		if (len != (~inverse & 0xffff) || size_t(m_in.m_pEnd - p) < len || m_outSize - m_written < len) {
+			return false;
+		}
+		memcpy(m_pOut + m_written, p, len);
+		m_written += len;
+		m_in.m_pNext = p + len;
+		return true;
+	}
+
+	bool Dynamic() {
+		uint32_t literalCount = 0;
+		uint32_t distanceCount = 0;
+		uint32_t codeLengthCount = 0;
+		if (!m_in.Bits(5, literalCount) || !m_in.Bits(5, distanceCount) || !m_in.Bits(4, codeLengthCount)) {
+			return false;
+		}
+		literalCount += 257;
+		distanceCount += 1;
+		codeLengthCount += 4;
+		if (literalCount > 286 || distanceCount > 30) {
+			return false;
+		}
+
+		// The code lengths of both codes are themselves Huffman coded
+		uint8_t codeLengths[19] = {};
+		for (uint32_t i = 0; i < codeLengthCount; ++i) {
+			uint32_t len = 0;
+			if (!m_in.Bits(3, len)) {
+				return false;
+			}
+			codeLengths[k_codeLengthOrder[i]] = uint8_t(len);
+		}
+		Huffman codeLengthCode;
+		if (!codeLengthCode.Build(codeLengths, 19)) {
+			return false;
+		}
+
+		// 16 repeats the previous length, 17 and 18 are runs of zeros
+		uint8_t lengths[286 + 30] = {};
+		const uint32_t total = literalCount + distanceCount;
+		uint32_t index = 0;
+		while (index < total) {
+			const int symbol = codeLengthCode.Decode(m_in);
+			if (symbol < 0) {
+				return false;
+			}
+			if (symbol < 16) {
+				lengths[index++] = uint8_t(symbol);
+				continue;
+			}
+			uint8_t len = 0;
+			uint32_t repeat = 0;
+			if (symbol == 16) {
+				if (index == 0 || !m_in.Bits(2, repeat)) {
+					return false;
+				}
+				len = lengths[index - 1];
+				repeat += 3;
+			}
+			else if (symbol == 17) {
+				if (!m_in.Bits(3, repeat)) {
+					return false;
+				}
+				repeat += 3;
+			}
+			else {
+				if (!m_in.Bits(7, repeat)) {
+					return false;
+				}
+				repeat += 11;
+			}
+			if (index + repeat > total) {
+				return false;
+			}
+			std::fill(lengths + index, lengths + index + repeat, len);
+			index += repeat;
+		}
+
+		// A block without an end code could never end
+		if (lengths[256] == 0) {
+			return false;
+		}
+		Huffman literals;
+		Huffman distances;
+		return literals.Build(lengths, int(literalCount)) && distances.Build(lengths + literalCount, int(distanceCount)) && Codes(literals, distances);
+	}
+
+	// Literals and back references up to the end of the block
+	bool Codes(const Huffman& literals, const Huffman& distances) {
+		for (;;) {
+			int symbol = literals.Decode(m_in);
+			if (symbol < 0) {
+				return false;
+			}
+			if (symbol < 256) {
+				if (m_written == m_outSize) {
+					return false;
+				}
+				m_pOut[m_written++] = uint8_t(symbol);
+				continue;
+			}
+			if (symbol == 256) {
+				return true;
+			}
+
+			symbol -= 257;
+			uint32_t extra = 0;
+			if (symbol >= 29 || !m_in.Bits(k_lengthExtra[symbol], extra)) {
+				return false;
+			}
+			const size_t length = k_lengthBase[symbol] + extra;
+			symbol = distances.Decode(m_in);
+			if (symbol < 0 || symbol >= 30 || !m_in.Bits(k_distExtra[symbol], extra)) {
+				return false;
+			}
+			const size_t distance = k_distBase[symbol] + extra;
+			if (distance > m_written || length > m_outSize - m_written) {
+				return false;
+			}
+
+			// References closer than their length repeat the bytes they are copying
+			unsigned char* pDst = m_pOut + m_written;
+			const unsigned char* pSrc = pDst - distance;
+			if (distance >= length) {
+				memcpy(pDst, pSrc, length);
+			}
+			else {
+				for (size_t i = 0; i < length; ++i) {
+					pDst[i] = pSrc[i];
+				}
+			}
+			m_written += length;
+		}
+	}
+
+	BitReader m_in;
+	unsigned char* m_pOut;
+	size_t m_outSize;
+	size_t m_written = 0;
+};
+
+}
+
+bool Inflate(const unsigned char* pData, size_t size, unsigned char* pOut, size_t outSize)
+{
+	return Inflater(pData, size, pOut, outSize).Run();
+}
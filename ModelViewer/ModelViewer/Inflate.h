@@ -0,0 +1,7 @@
+#pragma once
+#include <cstddef>
+
+// Decompresses raw deflate data (RFC 1951), as zip archives store it, into pOut. outSize is
+// the size the data decompresses to, which archives record next to it. False if the data is
+// malformed or doesn't decompress to exactly outSize bytes.
+bool Inflate(const unsigned char* pData, size_t size, unsigned char* pOut, size_t outSize);
@@ -0,0 +1,71 @@
+#include "JobSystem.h"
+
+#include <QCoreApplication>
+#include <QMetaObject>
+#include <QRunnable>
+
+
+namespace {
+
+thread_local bool t_inJob = false;
+
+}
+
+CancelToken::CancelToken()
+	: m_pFlag(std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+CancelToken::CancelToken(std::shared_ptr<std::atomic<bool>> pFlag)
+	: m_pFlag(pFlag ? std::move(pFlag) : std::make_shared<std::atomic<bool>>(false))
+{
+}
+
+void CancelToken::Cancel()
+{
+	*m_pFlag = true;
+}
+
+bool CancelToken::IsCancelled() const
+{
+	return *m_pFlag;
+}
+
+const std::shared_ptr<std::atomic<bool>>& CancelToken::Flag() const
+{
+	return m_pFlag;
+}
+
+QThreadPool* JobSystem::Pool()
+{
+	return QThreadPool::globalInstance();
+}
+
+void JobSystem::Post(QObject* context, std::function<void()> function)
+{
+	PostGuarded(QPointer<QObject>(context), std::move(function));
+}
+
+bool JobSystem::InJob()
+{
+	return t_inJob;
+}
+
+void JobSystem::Start(JobPriority priority, std::function<void()> job)
+{
+	Pool()->start(QRunnable::create([job] {
+		t_inJob = true;
+		job();
+		t_inJob = false;
+	}), int(priority));
+}
+
+void JobSystem::PostGuarded(const QPointer<QObject>& pContext, std::function<void()> function)
+{
+	// The application outlives every context, the guard is only read on the main thread
+	QMetaObject::invokeMethod(QCoreApplication::instance(), [pContext, function] {
+		if (pContext) {
+			function();
+		}
+	}, Qt::QueuedConnection);
+}
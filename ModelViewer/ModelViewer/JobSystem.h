@@ -0,0 +1,161 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+
+#include <QFuture>
+#include <QFutureInterface>
+#include <QObject>
+#include <QPointer>
+#include <QThreadPool>
+
+// Which of the queued jobs a free worker takes first. The parallel loops of QtConcurrent queue
+// their parts at Normal.
+enum class JobPriority : int {
+	Prewarm = -1, // Speculative work nobody waits on
+	Normal = 0, // Writing files, batch work
+	Load = 1, // Importing and exporting the models the user asked for
+	Interactive = 2, // What the next frame or the action the user just took waits on
+};
+
+// Set to stop the jobs it was given. Jobs that haven't started are skipped, running ones look
+// at it between their steps. Copies share the flag, a new token has a flag of its own.
+class CancelToken
+{
+public:
+	CancelToken();
+	// Shares a flag made elsewhere
+	explicit CancelToken(std::shared_ptr<std::atomic<bool>> pFlag);
+
+	void Cancel();
+	bool IsCancelled() const;
+
+	// For code that takes the flag itself
+	const std::shared_ptr<std::atomic<bool>>& Flag() const;
+
+private:
+	std::shared_ptr<std::atomic<bool>> m_pFlag;
+};
+
+namespace JobDetail {
+
+// Runs a job and reports what it returned to its future
+template <typename Result>
+struct Runner {
+	template <typename Function>
+	static void Run(QFutureInterface<Result>& promise, Function& job)
+	{
+		promise.reportResult(job());
+	}
+};
+
+template <>
+struct Runner<void> {
+	template <typename Function>
+	static void Run(QFutureInterface<void>&, Function& job)
+	{
+		job();
+	}
+};
+
+// Runs a job and binds what it returned to the continuation
+template <typename Result>
+struct Binder {
+	template <typename Function, typename Continuation>
+	static std::function<void()> Run(Function& job, const Continuation& continuation)
+	{
+		const Result result = job();
+		return [continuation, result] { continuation(result); };
+	}
+};
+
+template <>
+struct Binder<void> {
+	template <typename Function, typename Continuation>
+	static std::function<void()> Run(Function& job, const Continuation& continuation)
+	{
+		job();
+		return continuation;
+	}
+};
+
+}
+
+// The worker threads of the viewer, one per core. Loading, exporting, converting, measuring,
+// culling and writing files all queue their jobs here, ahead of the jobs of lower priority, so
+// several kinds of background work at once never run more threads than there are cores. The
+// pool is QThreadPool's global one, which QtConcurrent's parallel loops use too. Their calling
+// thread works through the loop's parts along with the workers, so a job can split itself
+// up without waiting idle.
+class JobSystem
+{
+public:
+	static QThreadPool* Pool();
+
+	// Queues job, which returns a value or nothing. The job is skipped, and its future
+	// cancelled, if token or the future was cancelled before it started.
+	template <typename Function>
+	static auto Run(JobPriority priority, Function job, const CancelToken& token = CancelToken()) -> QFuture<decltype(job())>
+	{
+		using Result = decltype(job());
+		QFutureInterface<Result> promise;
+		promise.reportStarted();
+		const QFuture<Result> future = promise.future();
+		Start(priority, [promise, job, token]() mutable {
+			if (token.IsCancelled() || promise.isCanceled()) {
+				promise.reportCanceled();
+			}
+			else {
+				JobDetail::Runner<Result>::Run(promise, job);
+			}
+			promise.reportFinished();
+		});
+		return future;
+	}
+
+	// Queues job and calls continuation with what it returned on the main thread. Nothing is
+	// called if token was cancelled or context deleted by then. Called from the main thread.
+	template <typename Function, typename Continuation>
+	static void Then(JobPriority priority, Function job, QObject* context, Continuation continuation, const CancelToken& token = CancelToken())
+	{
+		using Result = decltype(job());
+		const QPointer<QObject> pContext(context);
+		Start(priority, [job, pContext, continuation, token]() mutable {
+			if (token.IsCancelled()) {
+				return;
+			}
+			const std::function<void()> next = JobDetail::Binder<Result>::Run(job, continuation);
+			PostGuarded(pContext, [next, token] {
+				if (!token.IsCancelled()) {
+					next();
+				}
+			});
+		});
+	}
+
+	// Calls function on the main thread on its next pass of the event loop, unless context
+	// was deleted by then. context has to be alive when this is called.
+	static void Post(QObject* context, std::function<void()> function);
+
+	// Waits for future. In a job the thread is given back to the pool meanwhile, so jobs that
+	// wait on other jobs can't hold up every worker.
+	template <typename T>
+	static void Wait(QFuture<T> future)
+	{
+		const bool inJob = InJob();
+		if (inJob) {
+			Pool()->releaseThread();
+		}
+		future.waitForFinished();
+		if (inJob) {
+			Pool()->reserveThread();
+		}
+	}
+
+	// Whether the calling thread is running a job
+	static bool InJob();
+
+private:
+	static void Start(JobPriority priority, std::function<void()> job);
+	static void PostGuarded(const QPointer<QObject>& pContext, std::function<void()> function);
+};
@@ -1,19 +1,19 @@
 #include "KeyBindEdit.h"
+#include "AppSettings.h"
 #include "KeySequenceParse.h"
 
 #include <QKeyEvent>
-#include <QSettings>
 
 KeyBindEdit::KeyBindEdit(QString text, Qt::Key defaultKey, QWidget* pParent) :QLineEdit(pParent)
 {
-    QSettings settings;
+    AppSettings* settings = AppSettings::Shared();
     if (defaultKey != Qt::Key::Key_AsciiTilde)
         defalutKeys.append(defaultKey);
 
     // Check to see if we already have this keybind
-    if (settings.value(text, NULL) != NULL) {
+    if (settings->contains(text)) {
         // If we do parse it and set
-        keySequence = KeySequenceParse(text).getVec();    
+        keySequence = KeySequenceParse(settings->value(text).toString()).getVec();    
     }
     else {
         keySequence = defalutKeys;
@@ -1,16 +1,19 @@
 #include "LandingPage.h"
+#include "StartupTrace.h"
 #include "ViewerGraphicsWindow.h"
 
 #include <QPushButton>
 #include <QFileInfo>
+#include <QHBoxLayout>
 #include <QLayoutItem>
+#include <QTimer>
 
 
 LandingPage::LandingPage(ViewerGraphicsWindow* gWindow, QWidget* parent)
 	: m_pGraphicsWindow(gWindow), QWidget(parent)
 {
 	// Build our objects
-	settings = new QSettings("The Model Viewers team", "Model Viewer");
+	settings = AppSettings::Shared();
 	m_pMainLayout = new QGridLayout(this);
 	m_pMainLayout->setAlignment(Qt::AlignCenter);
 	m_pWelcomeText = new QLabel("Welcome to Model Viewer!");
@@ -38,6 +41,15 @@ LandingPage::LandingPage(ViewerGraphicsWindow* gWindow, QWidget* parent)
 		}
 	});
 
+	// Warm the recent files once startup settled. Opening any other file stops it, the
+	// loader needs the disk and cores then.
+	QTimer::singleShot(ModelPrewarmer::k_idleDelayMs, this, [=] { startPrewarm(); });
+	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::BeginModelLoading, this, [=](QString filepath) {
+		if (!previousFiles().contains(filepath)) {
+			m_prewarmer.Cancel();
+		}
+	});
+
 	// Setup style scheets
 	this->setStyleSheet("alignment: center");
 	m_pWelcomeText->setStyleSheet("font-size: 32px");
@@ -81,16 +93,65 @@ void LandingPage::setupPreviousFiles(bool first) {
 		if (first) {
 			previousFilesLayout->addRow(QString::fromLatin1("Previous files:"), emptyWidget);
 		}
-		previousFilesLayout->addRow(QFileInfo(file1).fileName(), loadFile1);
+		previousFilesLayout->addRow(fileLabel(file1), loadFile1);
 	}
 	if (!file2.isEmpty()) {
-		previousFilesLayout->addRow(QFileInfo(file2).fileName(), loadFile2);
+		previousFilesLayout->addRow(fileLabel(file2), loadFile2);
 	}
 	if (!file3.isEmpty()) {
-		previousFilesLayout->addRow(QFileInfo(file3).fileName(), loadFile3);
+		previousFilesLayout->addRow(fileLabel(file3), loadFile3);
 	}
 
 	connect(loadFile1, &QPushButton::pressed, this, [=] {m_pGraphicsWindow->loadModel(settings->value("LandingPage/file1", "").toString()); });
 	connect(loadFile2, &QPushButton::pressed, this, [=] {m_pGraphicsWindow->loadModel(settings->value("LandingPage/file2", "").toString()); });
 	connect(loadFile3, &QPushButton::pressed, this, [=] {m_pGraphicsWindow->loadModel(settings->value("LandingPage/file3", "").toString()); });
 }
+
+QWidget* LandingPage::fileLabel(const QString& file) {
+	// Only the index is read, the model itself isn't touched
+	const ThumbnailIndex& index = m_pGraphicsWindow->GetThumbnailIndex();
+	const QFileInfo info(file);
+	QString text = info.fileName();
+	QLabel* pThumbnail = new QLabel();
+	pThumbnail->setFixedSize(ThumbnailIndex::k_thumbnailSize / 2, ThumbnailIndex::k_thumbnailSize / 2);
+	ModelSummary summary;
+	if (index.Find(info, summary)) {
+		text += "\n" + ThumbnailIndex::Describe(summary);
+		const QImage thumbnail = index.Thumbnail(file);
+		if (!thumbnail.isNull()) {
+			pThumbnail->setPixmap(QPixmap::fromImage(thumbnail.scaled(pThumbnail->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation)));
+		}
+	}
+
+	QWidget* pLabel = new QWidget();
+	QHBoxLayout* pLayout = new QHBoxLayout(pLabel);
+	pLayout->setContentsMargins(0, 0, 0, 0);
+	pLayout->addWidget(pThumbnail);
+	pLayout->addWidget(new QLabel(text));
+	return pLabel;
+}
+
+QStringList LandingPage::previousFiles() const {
+	QStringList ret;
+	for (const char* key : { "LandingPage/file1", "LandingPage/file2", "LandingPage/file3" }) {
+		const QString file = settings->value(key, "").toString();
+		if (!file.isEmpty() && !ret.contains(file)) {
+			ret << file;
+		}
+	}
+	return ret;
+}
+
+void LandingPage::paintEvent(QPaintEvent* event) {
+	QWidget::paintEvent(event);
+	StartupTrace::Finish();
+}
+
+void LandingPage::startPrewarm() {
+	// Warming behind a load that already started would only slow it down
+	if (m_pGraphicsWindow->IsLoadingModel()) {
+		return;
+	}
+	const qint64 budget = qint64(settings->value("ViewerGraphicsWindow/prewarmBudget", 1024).toInt()) * 1024 * 1024;
+	m_prewarmer.Start(previousFiles(), m_pGraphicsWindow->GetLoadOptions(), budget);
+}
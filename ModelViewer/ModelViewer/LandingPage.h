@@ -2,10 +2,12 @@
 #include <QWidget>
 #include <QGridLayout>
 #include <QLabel>
-#include <QSettings>
 #include <QFormLayout>
 #include <QPushButton>
 
+#include "AppSettings.h"
+#include "ModelPrewarmer.h"
+
 // Forward Declares
 class ViewerGraphicsWindow;
 
@@ -16,18 +18,32 @@ public:
 	LandingPage(ViewerGraphicsWindow* gWindow, QWidget* parent = nullptr);
 	void setupPreviousFiles(bool first = false);
 
+	// The recent files, most recent first
+	QStringList previousFiles() const;
+
 	//private slots:
 
+protected:
+	// The first paint of the landing page ends the startup trace
+	void paintEvent(QPaintEvent* event) override;
+
 private:
 	ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
 	QFormLayout* previousFilesLayout = nullptr;
 	QGridLayout* m_pMainLayout = nullptr;
 	QLabel* m_pWelcomeText = nullptr;
 	QWidget* emptyWidget = nullptr;
-	QSettings* settings;
+	AppSettings* settings;
 
 	QPushButton* loadFile1 = nullptr;
 	QPushButton* loadFile2 = nullptr;
 	QPushButton* loadFile3 = nullptr;
+
+	// The name, thumbnail and summary of a recent file, from the thumbnail index
+	QWidget* fileLabel(const QString& file);
+
+	// Gets the recent files ready to open once startup is idle
+	void startPrewarm();
+	ModelPrewarmer m_prewarmer;
 	
 };
\ No newline at end of file
@@ -0,0 +1,380 @@
+#include "LightClusters.h"
+#include "StreamBuffer.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+namespace {
+
+// Lights fade out once they are this much of their full strength, which is less than one step
+// of an 8 bit channel
+const float k_faintestLight = 1.f / 256.f;
+
+// The grid starts at least this far into its depth, so a camera inside the model doesn't give
+// all the slices to the last stretch before the eye
+const float k_minNearRatio = 1e-3f;
+
+// Spot lights fade over at least this much of the cosine of their cone
+const float k_minConeFade = 1e-3f;
+
+// Floats per light, the four texels Lights.glsl reads
+const int k_lightFloats = 16;
+
+enum Buffer {
+	k_lightBuffer = 0,
+	k_clusterBuffer = 1,
+	k_indexBuffer = 2,
+};
+
+int Tile(float ndc, int tiles)
+{
+	return std::min(std::max(int(std::floor((ndc * 0.5f + 0.5f) * float(tiles))), 0), tiles - 1);
+}
+
+// The first and last tile across and down and the first and last slice a light reaches.
+// Returns false if it reaches no part of the grid.
+bool ClusterBox(const QVector4D& sphere, const QMatrix4x4& projection, float nearDepth, float farDepth, int* pMin, int* pMax)
+{
+	pMin[0] = pMin[1] = pMin[2] = 0;
+	pMax[0] = LightClusters::k_tilesX - 1;
+	pMax[1] = LightClusters::k_tilesY - 1;
+	pMax[2] = LightClusters::k_depthSlices - 1;
+	const float radius = sphere.w();
+	if (radius <= 0.f) {
+		return true;
+	}
+	const QVector3D center = sphere.toVector3D();
+	const float closest = -center.z() - radius;
+	const float farthest = -center.z() + radius;
+	if (farthest <= 0.f || closest > farDepth) {
+		return false;
+	}
+	pMin[2] = LightClusters::Slice(closest, nearDepth, farDepth);
+	pMax[2] = LightClusters::Slice(farthest, nearDepth, farDepth);
+
+	// A sphere reaching behind the eye can cover any tile
+	if (closest <= 0.f) {
+		return true;
+	}
+
+	// The box around the sphere covers it on screen too
+	float ndcMin[2] = { FLT_MAX, FLT_MAX };
+	float ndcMax[2] = { -FLT_MAX, -FLT_MAX };
+	for (int corner = 0; corner < 8; ++corner) {
+		const QVector3D offset(corner & 1 ? radius : -radius, corner & 2 ? radius : -radius, corner & 4 ? radius : -radius);
+		const QVector4D clip = projection * QVector4D(center + offset, 1.f);
+		for (int i = 0; i < 2; ++i) {
+			ndcMin[i] = std::min(ndcMin[i], clip[i] / clip.w());
+			ndcMax[i] = std::max(ndcMax[i], clip[i] / clip.w());
+		}
+	}
+	for (int i = 0; i < 2; ++i) {
+		if (ndcMax[i] < -1.f || ndcMin[i] > 1.f) {
+			return false;
+		}
+		const int tiles = i == 0 ? LightClusters::k_tilesX : LightClusters::k_tilesY;
+		pMin[i] = Tile(ndcMin[i], tiles);
+		pMax[i] = Tile(ndcMax[i], tiles);
+	}
+	return true;
+}
+
+int ClusterIndex(int x, int y, int slice)
+{
+	return (slice * LightClusters::k_tilesY + y) * LightClusters::k_tilesX + x;
+}
+
+}
+
+LightClusters::~LightClusters()
+{
+	Destroy();
+}
+
+bool LightClusters::Create()
+{
+	Destroy();
+
+	// Texture buffers need OpenGL 3.1, the ads shaders 4.1 anyway. Uniform blocks are checked
+	// first so Bind can turn scene lights off without them.
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || !UniformBlocks::SupportsUniformBuffers()) {
+		return false;
+	}
+	m_pFunctions = pContext->extraFunctions();
+	if (pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	const GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R16UI };
+	f->glGenBuffers(3, m_buffers);
+	f->glGenTextures(3, m_textures);
+	for (int i = 0; i < 3; ++i) {
+		f->glBindBuffer(GL_TEXTURE_BUFFER, m_buffers[i]);
+		f->glBufferData(GL_TEXTURE_BUFFER, 16, nullptr, GL_STREAM_DRAW);
+		f->glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+		f->glTexBuffer(GL_TEXTURE_BUFFER, formats[i], m_buffers[i]);
+		m_bufferBytes[i] = 16;
+	}
+	f->glBindTexture(GL_TEXTURE_BUFFER, 0);
+	f->glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	m_created = true;
+	m_binned = false;
+	return true;
+}
+
+void LightClusters::Destroy()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		m_pFunctions->glDeleteTextures(3, m_textures);
+		m_pFunctions->glDeleteBuffers(3, m_buffers);
+	}
+	std::fill(std::begin(m_buffers), std::end(m_buffers), 0u);
+	std::fill(std::begin(m_textures), std::end(m_textures), 0u);
+	std::fill(std::begin(m_bufferBytes), std::end(m_bufferBytes), 0);
+	m_pFunctions = nullptr;
+	m_created = false;
+	m_binned = false;
+}
+
+bool LightClusters::IsCreated() const
+{
+	return m_created;
+}
+
+void LightClusters::SetLights(const std::vector<SceneLight>& lights)
+{
+	m_lights.clear();
+	for (const SceneLight& light : lights) {
+		if (light.m_type == k_lightDirectional) {
+			m_lights.push_back(light);
+		}
+	}
+	for (const SceneLight& light : lights) {
+		if (light.m_type != k_lightDirectional) {
+			m_lights.push_back(light);
+		}
+	}
+	if (m_lights.size() > size_t(k_maxLights)) {
+		m_lights.resize(k_maxLights);
+	}
+
+	m_directionalCount = 0;
+	m_ranges.resize(m_lights.size());
+	for (size_t i = 0; i < m_lights.size(); ++i) {
+		const SceneLight& light = m_lights[i];
+		m_directionalCount += light.m_type == k_lightDirectional ? 1 : 0;
+		m_ranges[i] = light.m_type == k_lightDirectional ? 0.f : Range(light.m_color, light.m_attenuation);
+	}
+	m_binned = false;
+	m_binCount = 0;
+}
+
+int LightClusters::LightCount() const
+{
+	return int(m_lights.size());
+}
+
+bool LightClusters::Update(const QMatrix4x4& projection, const QMatrix4x4& modelView, const QVector3D& min, const QVector3D& max)
+{
+	if (!m_created || (m_binned && projection == m_projection && modelView == m_modelView)) {
+		return false;
+	}
+	m_projection = projection;
+	m_modelView = modelView;
+	m_binned = true;
+	++m_binCount;
+
+	// The grid only has to cover the depth of the model, which the camera may be inside of
+	float nearest = FLT_MAX;
+	float farthest = -FLT_MAX;
+	for (int corner = 0; corner < 8; ++corner) {
+		const QVector3D point(corner & 1 ? max.x() : min.x(), corner & 2 ? max.y() : min.y(), corner & 4 ? max.z() : min.z());
+		const float depth = -modelView.map(point).z();
+		nearest = std::min(nearest, depth);
+		farthest = std::max(farthest, depth);
+	}
+	m_nearDepth = std::max(nearest, farthest * k_minNearRatio);
+	m_farDepth = std::max(farthest, m_nearDepth * (1.f + k_minNearRatio));
+	m_gridActive = farthest > 0.f && m_directionalCount < int(m_lights.size());
+
+	// Zooming scales the view, distances in eye space and the falloff over them scale with it
+	const float scale = std::max(modelView.mapVector(QVector3D(1.f, 0.f, 0.f)).length(), FLT_MIN);
+	std::vector<GLfloat> texels(m_lights.size() * k_lightFloats);
+	std::vector<QVector4D> spheres;
+	spheres.reserve(m_lights.size() - m_directionalCount);
+	for (size_t i = 0; i < m_lights.size(); ++i) {
+		const SceneLight& light = m_lights[i];
+		const QVector3D position = modelView.map(light.m_position);
+		const QVector3D direction = modelView.mapVector(light.m_direction).normalized();
+		const float range = m_ranges[i] * scale;
+		const float outer = std::min(std::cos(light.m_outerCone * 0.5f), 1.f - k_minConeFade);
+		const float inner = std::min(std::max(std::cos(light.m_innerCone * 0.5f), outer + k_minConeFade), 1.f);
+		const GLfloat packed[k_lightFloats] = {
+			position.x(), position.y(), position.z(), range,
+			light.m_color.x(), light.m_color.y(), light.m_color.z(), float(light.m_type),
+			direction.x(), direction.y(), direction.z(), outer,
+			light.m_attenuation.x(), light.m_attenuation.y() / scale, light.m_attenuation.z() / (scale * scale), inner,
+		};
+		std::copy(packed, packed + k_lightFloats, texels.begin() + i * k_lightFloats);
+		if (int(i) >= m_directionalCount) {
+			spheres.push_back(QVector4D(position, range));
+		}
+	}
+
+	std::vector<quint32> clusters;
+	std::vector<quint16> indices;
+	if (m_gridActive) {
+		Assign(spheres, m_directionalCount, projection, m_nearDepth, m_farDepth, clusters, indices);
+	}
+	else {
+		clusters.assign(2 * k_clusterCount, 0);
+	}
+
+	// Texture buffers can't be empty
+	texels.resize(std::max(texels.size(), size_t(4)), 0.f);
+	indices.resize(std::max(indices.size(), size_t(1)), 0);
+	Upload(m_buffers[k_lightBuffer], texels.data(), qint64(texels.size() * sizeof(GLfloat)), m_bufferBytes[k_lightBuffer]);
+	Upload(m_buffers[k_clusterBuffer], clusters.data(), qint64(clusters.size() * sizeof(quint32)), m_bufferBytes[k_clusterBuffer]);
+	Upload(m_buffers[k_indexBuffer], indices.data(), qint64(indices.size() * sizeof(quint16)), m_bufferBytes[k_indexBuffer]);
+	return true;
+}
+
+void LightClusters::Bind(bool enabled, StreamBuffer& stream)
+{
+	if (!m_pFunctions) {
+		return;
+	}
+	LightBlock block = {};
+	if (enabled && m_created && m_binned && !m_lights.empty()) {
+		block.m_grid[0] = k_tilesX;
+		block.m_grid[1] = k_tilesY;
+		block.m_grid[2] = k_depthSlices;
+		block.m_grid[3] = m_gridActive ? 1 : 0;
+
+		// Lights.glsl finds the slice as log(depth) * scale + bias
+		const float sliceScale = float(k_depthSlices) / std::log(m_farDepth / m_nearDepth);
+		block.m_depth[0] = m_nearDepth;
+		block.m_depth[1] = m_farDepth;
+		block.m_depth[2] = sliceScale;
+		block.m_depth[3] = -std::log(m_nearDepth) * sliceScale;
+		block.m_directionalLights = m_directionalCount;
+	}
+
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	stream.BindUniformBlock(k_lightBlockBinding, &block, sizeof(block));
+	if (m_created) {
+		const GLint units[3] = { UniformBlocks::k_sceneLightsUnit, UniformBlocks::k_lightClustersUnit, UniformBlocks::k_lightIndicesUnit };
+		for (int i = 0; i < 3; ++i) {
+			f->glActiveTexture(GL_TEXTURE0 + units[i]);
+			f->glBindTexture(GL_TEXTURE_BUFFER, m_textures[i]);
+		}
+		f->glActiveTexture(GL_TEXTURE0);
+	}
+}
+
+int LightClusters::BinCount() const
+{
+	return m_binCount;
+}
+
+qint64 LightClusters::Bytes() const
+{
+	return m_bufferBytes[k_lightBuffer] + m_bufferBytes[k_clusterBuffer] + m_bufferBytes[k_indexBuffer];
+}
+
+float LightClusters::Range(const QVector3D& color, const QVector3D& attenuation)
+{
+	// Where constant + linear * d + quadratic * d^2 grows to brightest / k_faintestLight. A
+	// light too faint to see even up close is given the smallest range instead of none.
+	const float brightest = std::max(color.x(), std::max(color.y(), color.z()));
+	const float left = attenuation.x() - brightest / k_faintestLight;
+	if (left >= 0.f) {
+		return FLT_MIN;
+	}
+	const float linear = attenuation.y();
+	const float quadratic = attenuation.z();
+	if (quadratic > 0.f) {
+		return (-linear + std::sqrt(linear * linear - 4.f * quadratic * left)) / (2.f * quadratic);
+	}
+	if (linear > 0.f) {
+		return -left / linear;
+	}
+	return 0.f;
+}
+
+int LightClusters::Slice(float depth, float nearDepth, float farDepth)
+{
+	if (depth <= nearDepth || farDepth <= nearDepth) {
+		return 0;
+	}
+	const int slice = int(std::log(depth / nearDepth) / std::log(farDepth / nearDepth) * float(k_depthSlices));
+	return std::min(slice, k_depthSlices - 1);
+}
+
+void LightClusters::Assign(const std::vector<QVector4D>& spheres, int firstLight, const QMatrix4x4& projection, float nearDepth, float farDepth,
+	std::vector<quint32>& clusters, std::vector<quint16>& indices)
+{
+	// The clusters each light reaches, as its first and last tile across, down and slice
+	struct Box {
+		int m_light;
+		int m_min[3];
+		int m_max[3];
+	};
+	std::vector<Box> boxes;
+	boxes.reserve(spheres.size());
+	for (size_t i = 0; i < spheres.size(); ++i) {
+		Box box;
+		box.m_light = firstLight + int(i);
+		if (ClusterBox(spheres[i], projection, nearDepth, farDepth, box.m_min, box.m_max)) {
+			boxes.push_back(box);
+		}
+	}
+
+	// Counted first, so every cluster gets a run of the indices of its own
+	clusters.assign(2 * k_clusterCount, 0);
+	for (const Box& box : boxes) {
+		for (int slice = box.m_min[2]; slice <= box.m_max[2]; ++slice) {
+			for (int y = box.m_min[1]; y <= box.m_max[1]; ++y) {
+				for (int x = box.m_min[0]; x <= box.m_max[0]; ++x) {
+					++clusters[2 * ClusterIndex(x, y, slice) + 1];
+				}
+			}
+		}
+	}
+	quint32 offset = 0;
+	for (int i = 0; i < k_clusterCount; ++i) {
+		clusters[2 * i] = offset;
+		offset += clusters[2 * i + 1];
+		clusters[2 * i + 1] = 0;
+	}
+	indices.resize(offset);
+	for (const Box& box : boxes) {
+		for (int slice = box.m_min[2]; slice <= box.m_max[2]; ++slice) {
+			for (int y = box.m_min[1]; y <= box.m_max[1]; ++y) {
+				for (int x = box.m_min[0]; x <= box.m_max[0]; ++x) {
+					const int cluster = ClusterIndex(x, y, slice);
+					indices[clusters[2 * cluster] + clusters[2 * cluster + 1]++] = quint16(box.m_light);
+				}
+			}
+		}
+	}
+}
+
+void LightClusters::Upload(GLuint buffer, const void* pData, qint64 bytes, qint64& storedBytes)
+{
+	// Replacing the whole buffer lets the driver hand out fresh storage instead of waiting for
+	// the last frame to stop reading it
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	f->glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+	f->glBufferData(GL_TEXTURE_BUFFER, GLsizeiptr(bytes), pData, GL_STREAM_DRAW);
+	f->glBindBuffer(GL_TEXTURE_BUFFER, 0);
+	storedBytes = bytes;
+}
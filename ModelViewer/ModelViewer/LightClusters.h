@@ -0,0 +1,96 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+#include <qopengl.h>
+
+#include "ModelLoader.h"
+
+class QOpenGLExtraFunctions;
+class StreamBuffer;
+
+// Shades the lights that came with the scene, clustered forward. The view is cut into tiles
+// across the screen and slices along the depth of the model, and every cluster of that grid
+// gets the list of point and spot lights reaching into it. Lights.glsl then only shades the
+// lights of the cluster a pixel is in, so hundreds of small lights cost about as much as the
+// few that overlap each pixel. Directional lights reach everything and are always shaded.
+// The lights are binned on the CPU, and only again when the view or the lights change.
+class LightClusters
+{
+public:
+	static const int k_tilesX = 16;
+	static const int k_tilesY = 9;
+	static const int k_depthSlices = 24;
+	static const int k_clusterCount = k_tilesX * k_tilesY * k_depthSlices;
+
+	// Lights past this are dropped
+	static const int k_maxLights = 4096;
+
+	~LightClusters();
+
+	// Creating and destroying the buffers requires the context they are used in to be current.
+	// Create returns false without OpenGL 3.3, Bind then turns scene lights off.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Takes the lights to shade, in model space
+	void SetLights(const std::vector<SceneLight>& lights);
+	int LightCount() const;
+
+	// Moves the lights into eye space through modelView and bins them into a grid covering the
+	// depth of the bounds, if the view or the lights changed since the last time. Returns true
+	// if it binned.
+	bool Update(const QMatrix4x4& projection, const QMatrix4x4& modelView, const QVector3D& min, const QVector3D& max);
+
+	// Writes the light block into stream and binds the lights and clusters. Without enabled, or
+	// before the first Update, the block turns scene lights off.
+	void Bind(bool enabled, StreamBuffer& stream);
+
+	// Times the lights were binned since they were set
+	int BinCount() const;
+
+	// GPU memory taken by the lights and clusters
+	qint64 Bytes() const;
+
+	// Distance at which a light of color with attenuation has faded to nothing, 0 for a light
+	// that doesn't fade with distance
+	static float Range(const QVector3D& color, const QVector3D& attenuation);
+
+	// Slice of a grid from nearDepth to farDepth that an eye space depth falls in. Depths past
+	// either end fall in the first or last slice.
+	static int Slice(float depth, float nearDepth, float farDepth);
+
+	// Bins lights into the clusters they reach. spheres are the eye space centers and ranges of
+	// the lights, a range of 0 reaches every cluster, and light i is stored as firstLight + i.
+	// clusters gets the first index and count of each cluster, tiles across first, then down,
+	// then slices, and indices the lights of all clusters one after the other.
+	static void Assign(const std::vector<QVector4D>& spheres, int firstLight, const QMatrix4x4& projection, float nearDepth, float farDepth,
+		std::vector<quint32>& clusters, std::vector<quint16>& indices);
+
+private:
+	// Replaces the contents of a texture buffer
+	void Upload(GLuint buffer, const void* pData, qint64 bytes, qint64& storedBytes);
+
+	QOpenGLExtraFunctions* m_pFunctions = nullptr;
+	GLuint m_buffers[3] = {};
+	GLuint m_textures[3] = {};
+	qint64 m_bufferBytes[3] = {};
+	bool m_created = false;
+
+	// Directional lights first, they aren't binned
+	std::vector<SceneLight> m_lights;
+	std::vector<float> m_ranges;
+	int m_directionalCount = 0;
+
+	// What the clusters were last binned for
+	QMatrix4x4 m_projection;
+	QMatrix4x4 m_modelView;
+	float m_nearDepth = 0.f;
+	float m_farDepth = 0.f;
+	bool m_gridActive = false;
+	bool m_binned = false;
+	int m_binCount = 0;
+};
@@ -0,0 +1,326 @@
+#include "MeshBvh.h"
+#include "Frustum.h"
+#include "ModelLoader.h"
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+	float SurfaceArea(const QVector3D& min, const QVector3D& max) {
+		const QVector3D e = max - min;
+		return 2.f * (e.x() * e.y() + e.y() * e.z() + e.z() * e.x());
+	}
+
+	void Grow(QVector3D& min, QVector3D& max, const QVector3D& boxMin, const QVector3D& boxMax) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = std::min(min[i], boxMin[i]);
+			max[i] = std::max(max[i], boxMax[i]);
+		}
+	}
+
+	// Distance along the ray at which it enters the box, or FLT_MAX if it misses
+	float RayEntry(const QVector3D& origin, const QVector3D& invDirection, const QVector3D& min, const QVector3D& max) {
+		// An empty box, of a mesh without vertices, would turn inside out below
+		if (min.x() > max.x()) {
+			return FLT_MAX;
+		}
+		float tMin = 0.f;
+		float tMax = FLT_MAX;
+		for (int i = 0; i < 3; ++i) {
+			float t0 = (min[i] - origin[i]) * invDirection[i];
+			float t1 = (max[i] - origin[i]) * invDirection[i];
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+			tMin = std::max(tMin, t0);
+			tMax = std::min(tMax, t1);
+			if (tMin > tMax) {
+				return FLT_MAX;
+			}
+		}
+		return tMin;
+	}
+}
+
+
+void MeshBvh::Build(const Model& model)
+{
+	Clear();
+	const int meshCount = int(model.m_meshes.size());
+	if (meshCount == 0) {
+		return;
+	}
+
+	m_boxMin.reserve(meshCount);
+	m_boxMax.reserve(meshCount);
+	m_items.reserve(meshCount);
+	m_hidden.reserve(meshCount);
+	for (int i = 0; i < meshCount; ++i) {
+		m_boxMin.push_back(model.m_meshes[i].m_AABBMin);
+		m_boxMax.push_back(model.m_meshes[i].m_AABBMax);
+		m_items.push_back(i);
+		m_hidden.push_back(model.m_meshes[i].IsHidden());
+	}
+
+	// A binary tree with leaves of one mesh has fewer than two nodes per mesh
+	m_nodes.reserve(2 * meshCount);
+	BuildNode(0, meshCount);
+}
+
+int MeshBvh::BuildNode(int first, int count)
+{
+	const int nodeIdx = int(m_nodes.size());
+	m_nodes.emplace_back();
+
+	// Bounds of the boxes and of their centers
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	QVector3D centerMin = min;
+	QVector3D centerMax = max;
+	for (int i = first; i < first + count; ++i) {
+		const int item = m_items[i];
+		Grow(min, max, m_boxMin[item], m_boxMax[item]);
+		const QVector3D center = (m_boxMin[item] + m_boxMax[item]) * 0.5f;
+		Grow(centerMin, centerMax, center, center);
+	}
+	m_nodes[nodeIdx].m_min = min;
+	m_nodes[nodeIdx].m_max = max;
+	m_nodes[nodeIdx].m_offset = first;
+	m_nodes[nodeIdx].m_count = count;
+
+	// Split along the axis the centers spread furthest on
+	const QVector3D centerExtent = centerMax - centerMin;
+	int axis = 0;
+	if (centerExtent.y() > centerExtent[axis]) {
+		axis = 1;
+	}
+	if (centerExtent.z() > centerExtent[axis]) {
+		axis = 2;
+	}
+	if (count <= k_maxLeafSize || centerExtent[axis] <= 0.f) {
+		return nodeIdx;
+	}
+
+	// Sort the boxes into bins by their centers
+	struct Bin {
+		QVector3D m_min = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+		QVector3D m_max = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		int m_count = 0;
+	};
+	Bin bins[k_binCount];
+	const float binScale = float(k_binCount) / centerExtent[axis];
+	auto BinOf = [&](int item) {
+		const float center = (m_boxMin[item][axis] + m_boxMax[item][axis]) * 0.5f;
+		return std::min(int((center - centerMin[axis]) * binScale), k_binCount - 1);
+	};
+	for (int i = first; i < first + count; ++i) {
+		Bin& bin = bins[BinOf(m_items[i])];
+		Grow(bin.m_min, bin.m_max, m_boxMin[m_items[i]], m_boxMax[m_items[i]]);
+		++bin.m_count;
+	}
+
+	// The cost of a split is the area of each side times the meshes in it. Sweep from the
+	// right once to get the right sides, then from the left to find the cheapest plane.
+	float rightCosts[k_binCount] = {};
+	QVector3D rightMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D rightMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	int rightCount = 0;
+	for (int b = k_binCount - 1; b > 0; --b) {
+		Grow(rightMin, rightMax, bins[b].m_min, bins[b].m_max);
+		rightCount += bins[b].m_count;
+		rightCosts[b] = rightCount > 0 ? SurfaceArea(rightMin, rightMax) * float(rightCount) : 0.f;
+	}
+	QVector3D leftMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D leftMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	int leftCount = 0;
+	int bestSplit = -1;
+	float bestCost = FLT_MAX;
+	for (int b = 1; b < k_binCount; ++b) {
+		Grow(leftMin, leftMax, bins[b - 1].m_min, bins[b - 1].m_max);
+		leftCount += bins[b - 1].m_count;
+		if (leftCount == 0 || leftCount == count) {
+			continue;
+		}
+		const float cost = SurfaceArea(leftMin, leftMax) * float(leftCount) + rightCosts[b];
+		if (cost < bestCost) {
+			bestCost = cost;
+			bestSplit = b;
+		}
+	}
+	if (bestSplit < 0) {
+		return nodeIdx;
+	}
+
+	// Meshes left of the plane go first, the left subtree is built right after this node
+	int* pMid = std::partition(m_items.data() + first, m_items.data() + first + count, [&](int item) {
+		return BinOf(item) < bestSplit;
+	});
+	const int leftItems = int(pMid - (m_items.data() + first));
+	BuildNode(first, leftItems);
+	const int right = BuildNode(first + leftItems, count - leftItems);
+	m_nodes[nodeIdx].m_offset = right;
+	m_nodes[nodeIdx].m_count = 0;
+	return nodeIdx;
+}
+
+void MeshBvh::Refit(const Model& model)
+{
+	if (model.m_meshes.size() != m_boxMin.size()) {
+		Build(model);
+		return;
+	}
+	for (size_t i = 0; i < model.m_meshes.size(); ++i) {
+		m_boxMin[i] = model.m_meshes[i].m_AABBMin;
+		m_boxMax[i] = model.m_meshes[i].m_AABBMax;
+	}
+
+	// Children are stored after their parents, so walking backwards visits them first
+	for (int n = int(m_nodes.size()) - 1; n >= 0; --n) {
+		Node& node = m_nodes[n];
+		QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+		QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		if (node.m_count > 0) {
+			for (int i = node.m_offset; i < node.m_offset + node.m_count; ++i) {
+				Grow(min, max, m_boxMin[m_items[i]], m_boxMax[m_items[i]]);
+			}
+		}
+		else {
+			Grow(min, max, m_nodes[n + 1].m_min, m_nodes[n + 1].m_max);
+			Grow(min, max, m_nodes[node.m_offset].m_min, m_nodes[node.m_offset].m_max);
+		}
+		node.m_min = min;
+		node.m_max = max;
+	}
+}
+
+void MeshBvh::SetHidden(int mesh, bool hidden)
+{
+	if (mesh >= 0 && mesh < int(m_hidden.size())) {
+		m_hidden[mesh] = hidden;
+	}
+}
+
+void MeshBvh::Clear()
+{
+	m_nodes.clear();
+	m_items.clear();
+	m_boxMin.clear();
+	m_boxMax.clear();
+	m_hidden.clear();
+}
+
+bool MeshBvh::IsEmpty() const
+{
+	return m_nodes.empty();
+}
+
+int MeshBvh::NodeCount() const
+{
+	return int(m_nodes.size());
+}
+
+QVector3D MeshBvh::Min() const
+{
+	return m_nodes.empty() ? QVector3D() : m_nodes.front().m_min;
+}
+
+QVector3D MeshBvh::Max() const
+{
+	return m_nodes.empty() ? QVector3D() : m_nodes.front().m_max;
+}
+
+void MeshBvh::CollectVisible(const Frustum& frustum, std::vector<int>& meshes) const
+{
+	meshes.clear();
+	if (!m_nodes.empty()) {
+		CollectNode(0, frustum, false, meshes);
+	}
+
+	// Drawing in the model's order keeps the order meshes are drawn in stable
+	std::sort(meshes.begin(), meshes.end());
+}
+
+void MeshBvh::CollectNode(int nodeIdx, const Frustum& frustum, bool inside, std::vector<int>& meshes) const
+{
+	// Once a node is entirely inside, everything below it is too and needs no more tests
+	const Node& node = m_nodes[nodeIdx];
+	if (!inside) {
+		if (!frustum.Intersects(node.m_min, node.m_max)) {
+			return;
+		}
+		inside = frustum.Contains(node.m_min, node.m_max);
+	}
+
+	if (node.m_count > 0) {
+		for (int i = node.m_offset; i < node.m_offset + node.m_count; ++i) {
+			// Hidden meshes and empty boxes are still in the bounds of a node inside
+			const int item = m_items[i];
+			if (m_hidden[item] || m_boxMin[item].x() > m_boxMax[item].x()) {
+				continue;
+			}
+			if (inside || frustum.Intersects(m_boxMin[item], m_boxMax[item])) {
+				meshes.push_back(item);
+			}
+		}
+		return;
+	}
+	CollectNode(nodeIdx + 1, frustum, inside, meshes);
+	CollectNode(node.m_offset, frustum, inside, meshes);
+}
+
+int MeshBvh::Raycast(const QVector3D& origin, const QVector3D& direction, float* pDistance) const
+{
+	if (m_nodes.empty()) {
+		return -1;
+	}
+
+	// Division by zero gives infinities, which the slab test handles
+	const QVector3D invDirection(1.f / direction.x(), 1.f / direction.y(), 1.f / direction.z());
+
+	// Visit the nearer child first and skip nodes entered after the closest hit so far
+	int hit = -1;
+	float closest = FLT_MAX;
+	std::vector<int> stack;
+	stack.push_back(0);
+	while (!stack.empty()) {
+		const int nodeIdx = stack.back();
+		stack.pop_back();
+		const Node& node = m_nodes[nodeIdx];
+		if (RayEntry(origin, invDirection, node.m_min, node.m_max) >= closest) {
+			continue;
+		}
+
+		if (node.m_count > 0) {
+			for (int i = node.m_offset; i < node.m_offset + node.m_count; ++i) {
+				const int item = m_items[i];
+				if (m_hidden[item]) {
+					continue;
+				}
+				const float t = RayEntry(origin, invDirection, m_boxMin[item], m_boxMax[item]);
+				if (t < closest) {
+					closest = t;
+					hit = item;
+				}
+			}
+			continue;
+		}
+
+		const int left = nodeIdx + 1;
+		const int right = node.m_offset;
+		const float leftEntry = RayEntry(origin, invDirection, m_nodes[left].m_min, m_nodes[left].m_max);
+		const float rightEntry = RayEntry(origin, invDirection, m_nodes[right].m_min, m_nodes[right].m_max);
+		if (leftEntry < rightEntry) {
+			stack.push_back(right);
+			stack.push_back(left);
+		}
+		else {
+			stack.push_back(left);
+			stack.push_back(right);
+		}
+	}
+
+	if (pDistance && hit >= 0) {
+		*pDistance = closest;
+	}
+	return hit;
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+
+#include <QVector3D>
+
+class Frustum;
+struct Model;
+
+// Bounding volume hierarchy over the model space AABBs of a model's meshes, so culling and
+// picking don't have to test every mesh. Nodes are split by the surface area heuristic and
+// stored depth first in one array: the left child of an inner node follows it directly.
+class MeshBvh
+{
+public:
+	// Leaves hold at most this many meshes, unless their centers can't be told apart
+	static const int k_maxLeafSize = 4;
+
+	// Candidate split planes tried along the widest axis of a node
+	static const int k_binCount = 16;
+
+	// Replaces the hierarchy with one over the meshes of model. Model::Finalize must have run.
+	void Build(const Model& model);
+
+	// Updates the bounds after the AABBs of the meshes changed, keeping the structure. Faster
+	// than a rebuild, but the hierarchy gets worse the further the meshes moved.
+	void Refit(const Model& model);
+
+	// Leaves a mesh out of culling and picking, or takes it back in. Only a bit per mesh
+	// changes, the bounds and the structure stay. Build takes the meshes hidden on the model.
+	void SetHidden(int mesh, bool hidden);
+
+	void Clear();
+	bool IsEmpty() const;
+	int NodeCount() const;
+
+	// Bounds of all meshes, zero when empty
+	QVector3D Min() const;
+	QVector3D Max() const;
+
+	// Indices of the meshes whose AABB intersects frustum, in ascending order
+	void CollectVisible(const Frustum& frustum, std::vector<int>& meshes) const;
+
+	// Index of the mesh whose AABB the ray enters first, or -1. The distance along direction
+	// to the entry point is stored in pDistance.
+	int Raycast(const QVector3D& origin, const QVector3D& direction, float* pDistance = nullptr) const;
+
+private:
+	struct Node {
+		QVector3D m_min;
+		QVector3D m_max;
+
+		// Leaves: the first entry in m_items and how many there are.
+		// Inner nodes: m_count is 0 and m_offset is the index of the right child.
+		int m_offset = 0;
+		int m_count = 0;
+	};
+
+	int BuildNode(int first, int count);
+	void CollectNode(int nodeIdx, const Frustum& frustum, bool inside, std::vector<int>& meshes) const;
+
+	std::vector<Node> m_nodes;
+	std::vector<int> m_items;
+	std::vector<QVector3D> m_boxMin;
+	std::vector<QVector3D> m_boxMax;
+	std::vector<bool> m_hidden;
+};
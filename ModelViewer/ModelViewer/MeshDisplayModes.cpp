@@ -0,0 +1,241 @@
+#include "MeshDisplayModes.h"
+#include "GpuModelBuilder.h"
+#include "StateCache.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QVector2D>
+#include <QtMath>
+
+#ifndef GL_PROGRAM_POINT_SIZE
+#define GL_PROGRAM_POINT_SIZE 0x8642
+#endif
+
+
+namespace {
+
+// The frame block is inserted after the #version line, for the section planes
+const char* k_wireframeVertexShaderSource =
+	"#version 150\n"
+	"in vec4 posAttr;\n"
+	"in mat4 instanceAttr;\n"
+	"uniform mat4 matrix;\n"
+	"uniform mat4 modelview;\n"
+	"out float gl_ClipDistance[6];\n"
+	"void main() {\n"
+	"   vec4 position = instanceAttr * posAttr;\n"
+	"   vec4 eye = modelview * position;\n"
+	"   for (int i = 0; i < 6; ++i) {\n"
+	"      gl_ClipDistance[i] = dot(uSectionPlanes[i], eye);\n"
+	"   }\n"
+	"   gl_Position = matrix * position;\n"
+	"}\n";
+
+// Each corner gets its distance in pixels to the opposite edge, interpolated without
+// perspective the smallest component is the fragment's distance to the nearest edge. The clip
+// distances of the corners are passed on, the inputs can only be indexed by constants.
+const char* k_wireframeGeometryShaderSource =
+	"#version 150\n"
+	"layout(triangles) in;\n"
+	"layout(triangle_strip, max_vertices = 3) out;\n"
+	"uniform vec2 uHalfViewport;\n"
+	"noperspective out vec3 edgeDistance;\n"
+	"out float gl_ClipDistance[6];\n"
+	"#define CLIP_CORNER(v) gl_ClipDistance[0] = gl_in[v].gl_ClipDistance[0]; gl_ClipDistance[1] = gl_in[v].gl_ClipDistance[1]; "
+	"gl_ClipDistance[2] = gl_in[v].gl_ClipDistance[2]; gl_ClipDistance[3] = gl_in[v].gl_ClipDistance[3]; "
+	"gl_ClipDistance[4] = gl_in[v].gl_ClipDistance[4]; gl_ClipDistance[5] = gl_in[v].gl_ClipDistance[5]\n"
+	"void main() {\n"
+	"   vec2 p0 = uHalfViewport * gl_in[0].gl_Position.xy / gl_in[0].gl_Position.w;\n"
+	"   vec2 p1 = uHalfViewport * gl_in[1].gl_Position.xy / gl_in[1].gl_Position.w;\n"
+	"   vec2 p2 = uHalfViewport * gl_in[2].gl_Position.xy / gl_in[2].gl_Position.w;\n"
+	"   float area = abs((p1.x - p0.x) * (p2.y - p0.y) - (p1.y - p0.y) * (p2.x - p0.x));\n"
+	"   vec3 heights = area / max(vec3(length(p2 - p1), length(p2 - p0), length(p1 - p0)), vec3(1e-6));\n"
+	"   edgeDistance = vec3(heights.x, 0.0, 0.0);\n"
+	"   CLIP_CORNER(0);\n"
+	"   gl_Position = gl_in[0].gl_Position;\n"
+	"   EmitVertex();\n"
+	"   edgeDistance = vec3(0.0, heights.y, 0.0);\n"
+	"   CLIP_CORNER(1);\n"
+	"   gl_Position = gl_in[1].gl_Position;\n"
+	"   EmitVertex();\n"
+	"   edgeDistance = vec3(0.0, 0.0, heights.z);\n"
+	"   CLIP_CORNER(2);\n"
+	"   gl_Position = gl_in[2].gl_Position;\n"
+	"   EmitVertex();\n"
+	"   EndPrimitive();\n"
+	"}\n";
+
+// Lines are about a pixel wide with smoothed sides, the inside of triangles is discarded
+const char* k_wireframeFragmentShaderSource =
+	"#version 150\n"
+	"noperspective in vec3 edgeDistance;\n"
+	"uniform vec4 uColor;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"   float distance = min(edgeDistance.x, min(edgeDistance.y, edgeDistance.z));\n"
+	"   float coverage = 1.0 - smoothstep(0.5, 1.5, distance);\n"
+	"   if (coverage <= 0.0) {\n"
+	"       discard;\n"
+	"   }\n"
+	"   fragColor = vec4(uColor.rgb, uColor.a * coverage);\n"
+	"}\n";
+
+// Nearer points are bigger, like the surface they were sampled from
+const char* k_pointVertexShaderSource =
+	"attribute highp vec4 posAttr;\n"
+	"attribute lowp vec4 colAttr;\n"
+	"attribute highp mat4 instanceAttr;\n"
+	"uniform highp mat4 matrix;\n"
+	"uniform highp float uPointScale;\n"
+	"varying lowp vec4 col;\n"
+	"void main() {\n"
+	"   gl_Position = matrix * (instanceAttr * posAttr);\n"
+	"   gl_PointSize = clamp(uPointScale / max(gl_Position.w, 1e-4), 1.0, 32.0);\n"
+	"   col = colAttr;\n"
+	"}\n";
+
+const char* k_pointFragmentShaderSource =
+	"varying lowp vec4 col;\n"
+	"void main() {\n"
+	"   gl_FragColor = col;\n"
+	"}\n";
+
+}
+
+MeshDisplayModes::~MeshDisplayModes()
+{
+	delete m_wireframe.m_pProgram;
+	delete m_points.m_pProgram;
+}
+
+bool MeshDisplayModes::Create()
+{
+	Destroy();
+	if (!Link(m_points, k_pointVertexShaderSource, nullptr, k_pointFragmentShaderSource)) {
+		return false;
+	}
+	m_pointScaleUniform = m_points.m_pProgram->uniformLocation("uPointScale");
+
+	QByteArray wireframeVertexSource(k_wireframeVertexShaderSource);
+	wireframeVertexSource.insert(wireframeVertexSource.indexOf('\n') + 1, UniformBlocks::k_frameDeclaration);
+	if (QOpenGLShader::hasOpenGLShaders(QOpenGLShader::Geometry) && UniformBlocks::SupportsUniformBuffers()
+		&& Link(m_wireframe, wireframeVertexSource.constData(), k_wireframeGeometryShaderSource, k_wireframeFragmentShaderSource)) {
+		UniformBlocks::BindBlock(m_wireframe.m_pProgram, "FrameBlock", k_frameBlockBinding);
+		m_halfViewportUniform = m_wireframe.m_pProgram->uniformLocation("uHalfViewport");
+		m_colorUniform = m_wireframe.m_pProgram->uniformLocation("uColor");
+	}
+
+	// OpenGL ES always takes the size from the vertex shader
+	m_programPointSize = !QOpenGLContext::currentContext()->isOpenGLES();
+	return true;
+}
+
+void MeshDisplayModes::Destroy()
+{
+	for (ShaderPermutations::Variant* pVariant : { &m_wireframe, &m_points }) {
+		delete pVariant->m_pProgram;
+		*pVariant = ShaderPermutations::Variant();
+	}
+	m_halfViewportUniform = -1;
+	m_colorUniform = -1;
+	m_pointScaleUniform = -1;
+}
+
+bool MeshDisplayModes::IsCreated() const
+{
+	return m_points.m_pProgram != nullptr;
+}
+
+bool MeshDisplayModes::HasWireframe() const
+{
+	return m_wireframe.m_pProgram != nullptr;
+}
+
+const ShaderPermutations::Variant* MeshDisplayModes::BeginWireframe(const QSize& viewport, const QColor& color)
+{
+	if (!m_wireframe.m_pProgram) {
+		return nullptr;
+	}
+	QOpenGLShaderProgram* pProgram = m_wireframe.m_pProgram;
+	pProgram->bind();
+	pProgram->setUniformValue(m_halfViewportUniform, QVector2D(viewport.width() * 0.5f, viewport.height() * 0.5f));
+	pProgram->setUniformValue(m_colorUniform, color);
+
+	// The lines only go where the shaded model is, pulled in front of it
+	QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+	StateCache& state = StateCache::Current();
+	state.DepthFunc(GL_LEQUAL);
+	state.DepthMask(false);
+	state.Enable(GL_BLEND);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.Enable(GL_POLYGON_OFFSET_FILL);
+	f->glPolygonOffset(-1.f, -1.f);
+
+	// Meshes drawn without instancing take the identity as their instance transform
+	pProgram->setAttributeValue(k_instanceLocation, QMatrix4x4().constData(), 4, 4);
+	return &m_wireframe;
+}
+
+const ShaderPermutations::Variant* MeshDisplayModes::BeginPoints(float pointScale)
+{
+	if (!m_points.m_pProgram) {
+		return nullptr;
+	}
+	QOpenGLShaderProgram* pProgram = m_points.m_pProgram;
+	pProgram->bind();
+	pProgram->setUniformValue(m_pointScaleUniform, pointScale);
+	pProgram->setAttributeValue(k_instanceLocation, QMatrix4x4().constData(), 4, 4);
+	if (m_programPointSize) {
+		StateCache::Current().Enable(GL_PROGRAM_POINT_SIZE);
+	}
+	return &m_points;
+}
+
+void MeshDisplayModes::End()
+{
+	StateCache& state = StateCache::Current();
+	state.DepthFunc(GL_LESS);
+	state.DepthMask(true);
+	state.Disable(GL_BLEND);
+	state.Disable(GL_POLYGON_OFFSET_FILL);
+	if (m_programPointSize) {
+		state.Disable(GL_PROGRAM_POINT_SIZE);
+	}
+}
+
+float MeshDisplayModes::PointSpacing(const QVector3D& min, const QVector3D& max, qint64 pointCount)
+{
+	// A scan covers the surface of its box more than the volume, so the points are spread
+	// over an area of about the diagonal squared
+	const float diagonal = (max - min).length();
+	return diagonal / qSqrt(float(qMax<qint64>(1, pointCount)));
+}
+
+float MeshDisplayModes::PointScale(float spacing, float viewportHeight, float fieldOfView)
+{
+	// Pixels per unit at a distance of 1
+	return spacing * viewportHeight * 0.5f / qTan(qDegreesToRadians(fieldOfView) * 0.5f);
+}
+
+bool MeshDisplayModes::Link(ShaderPermutations::Variant& variant, const char* vertexSource, const char* geometrySource, const char* fragmentSource)
+{
+	variant.m_pProgram = new QOpenGLShaderProgram();
+	variant.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+	if (geometrySource) {
+		variant.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Geometry, geometrySource);
+	}
+	variant.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+	GpuModelBuilder::BindAttributeLocations(variant.m_pProgram);
+	if (!variant.m_pProgram->link()) {
+		qWarning("Could not link a display mode shader: %s", qPrintable(variant.m_pProgram->log()));
+		delete variant.m_pProgram;
+		variant = ShaderPermutations::Variant();
+		return false;
+	}
+	variant.m_matrixUniform = variant.m_pProgram->uniformLocation("matrix");
+	variant.m_modelviewUniform = variant.m_pProgram->uniformLocation("modelview");
+	variant.m_instanceAttr = variant.m_pProgram->attributeLocation("instanceAttr");
+	return true;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include "ShaderPermutations.h"
+
+#include <QColor>
+#include <QSize>
+#include <QVector3D>
+
+// How the model is shown, the ViewerGraphicsWindow/displayMode setting
+enum DisplayMode : int {
+	k_displayShaded = 0,
+	k_displayWireframe = 1, // Edges drawn over the shaded model
+	k_displayPoints = 2, // Only the vertices, for scans
+};
+
+// Programs the model is drawn with instead of its own in the other display modes. They read
+// the attributes and per mesh matrices of the model program, so DrawMesh can draw with them.
+// The wireframe finds each fragment's distance to the edges of its triangle in a geometry
+// shader, so it needs no line indices and draws over the shaded model in one pass. It is cut by
+// the section planes of the frame block like the model, points are only left out with the
+// meshes cut away whole.
+class MeshDisplayModes
+{
+public:
+	~MeshDisplayModes();
+
+	// Creating and destroying the programs requires a current context. Create returns false
+	// if the point program doesn't link. Without geometry shaders there is no wireframe.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+	bool HasWireframe() const;
+
+	// Bind a program and set up its state for a pass over the meshes, End restores the state.
+	// viewport is the size in pixels of what is drawn to. Points are pointScale divided by
+	// their distance from the eye in pixels.
+	const ShaderPermutations::Variant* BeginWireframe(const QSize& viewport, const QColor& color);
+	const ShaderPermutations::Variant* BeginPoints(float pointScale);
+	void End();
+
+	// Average distance between the points of a surface scan of pointCount points in a box
+	// from min to max
+	static float PointSpacing(const QVector3D& min, const QVector3D& max, qint64 pointCount);
+
+	// The pointScale of BeginPoints that draws points spacing apart just touching, with the
+	// projection of a viewport viewportHeight pixels high and fieldOfView degrees
+	static float PointScale(float spacing, float viewportHeight, float fieldOfView);
+
+private:
+	static bool Link(ShaderPermutations::Variant& variant, const char* vertexSource, const char* geometrySource, const char* fragmentSource);
+
+	ShaderPermutations::Variant m_wireframe;
+	ShaderPermutations::Variant m_points;
+	GLint m_halfViewportUniform = -1;
+	GLint m_colorUniform = -1;
+	GLint m_pointScaleUniform = -1;
+	bool m_programPointSize = false;
+};
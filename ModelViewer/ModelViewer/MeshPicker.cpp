@@ -0,0 +1,338 @@
+#include "MeshPicker.h"
+#include "Frustum.h"
+#include "GpuModelBuilder.h"
+#include "StateCache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef GL_CLIP_DISTANCE0
+#define GL_CLIP_DISTANCE0 0x3000
+#endif
+
+
+namespace {
+
+// gl_PrimitiveID and integer render targets need GLSL 3.30. Section planes are in model space,
+// uModel takes a vertex there.
+const char* k_pickVertexShaderSource =
+	"#version 330\n"
+	"in highp vec4 posAttr;\n"
+	"in highp mat4 instanceAttr;\n"
+	"uniform highp mat4 matrix;\n"
+	"uniform highp mat4 uModel;\n"
+	"uniform highp vec4 uSectionPlanes[6];\n"
+	"flat out int vInstance;\n"
+	"out float gl_ClipDistance[6];\n"
+	"void main() {\n"
+	"   vInstance = gl_InstanceID;\n"
+	"   vec4 position = instanceAttr * posAttr;\n"
+	"   vec4 model = uModel * position;\n"
+	"   for (int i = 0; i < 6; ++i) {\n"
+	"      gl_ClipDistance[i] = dot(uSectionPlanes[i], model);\n"
+	"   }\n"
+	"   gl_Position = matrix * position;\n"
+	"}\n";
+
+const char* k_pickFragmentShaderSource =
+	"#version 330\n"
+	"flat in int vInstance;\n"
+	"uniform uint uMesh;\n"
+	"uniform int uFirstInstance;\n"
+	"out uvec4 id;\n"
+	"void main() {\n"
+	"   id = uvec4(uMesh, uint(gl_PrimitiveID), uint(vInstance + uFirstInstance), 0u);\n"
+	"}\n";
+
+// The ids in GL_RGBA_INTEGER followed by the depth
+const int k_idBytes = 4 * sizeof(GLuint);
+const int k_readbackBytes = k_idBytes + sizeof(GLfloat);
+
+}
+
+MeshPicker::~MeshPicker()
+{
+	// The framebuffer goes with the context, only the program is left
+	delete m_pProgram;
+}
+
+bool MeshPicker::Create()
+{
+	Destroy();
+
+	// Depth can't be read back on OpenGL ES
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+	m_pFunctions = pContext->extraFunctions();
+
+	m_pProgram = new QOpenGLShaderProgram();
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, k_pickVertexShaderSource);
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, k_pickFragmentShaderSource);
+	m_pProgram->bindAttributeLocation("posAttr", k_positionLocation);
+	m_pProgram->bindAttributeLocation("instanceAttr", k_instanceLocation);
+	if (!m_pProgram->link()) {
+		qWarning("Could not link the picking shader: %s", qPrintable(m_pProgram->log()));
+		Destroy();
+		return false;
+	}
+	m_matrixUniform = m_pProgram->uniformLocation("matrix");
+	m_modelUniform = m_pProgram->uniformLocation("uModel");
+	m_sectionPlanesUniform = m_pProgram->uniformLocation("uSectionPlanes");
+	m_meshUniform = m_pProgram->uniformLocation("uMesh");
+	m_instanceUniform = m_pProgram->uniformLocation("uFirstInstance");
+
+	// One pixel is all a pick ever draws
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	GLint previousFramebuffer = 0;
+	f->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	f->glGenRenderbuffers(1, &m_idBuffer);
+	f->glBindRenderbuffer(GL_RENDERBUFFER, m_idBuffer);
+	f->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA32UI, 1, 1);
+	f->glGenRenderbuffers(1, &m_depthBuffer);
+	f->glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+	f->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, 1, 1);
+	f->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	f->glGenFramebuffers(1, &m_framebuffer);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	f->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_idBuffer);
+	f->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+	const bool complete = f->glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	f->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+
+	m_readback.setUsagePattern(QOpenGLBuffer::StreamRead);
+	if (!complete || !m_readback.create()) {
+		Destroy();
+		return false;
+	}
+	m_readback.bind();
+	m_readback.allocate(k_readbackBytes);
+	m_readback.release();
+
+	m_created = true;
+	return true;
+}
+
+void MeshPicker::Destroy()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		if (m_fence) {
+			m_pFunctions->glDeleteSync(m_fence);
+		}
+		m_pFunctions->glDeleteFramebuffers(1, &m_framebuffer);
+		m_pFunctions->glDeleteRenderbuffers(1, &m_idBuffer);
+		m_pFunctions->glDeleteRenderbuffers(1, &m_depthBuffer);
+		m_readback.destroy();
+	}
+	delete m_pProgram;
+	m_pProgram = nullptr;
+	m_fence = nullptr;
+	m_framebuffer = 0;
+	m_idBuffer = 0;
+	m_depthBuffer = 0;
+	m_pFunctions = nullptr;
+	m_created = false;
+}
+
+bool MeshPicker::IsCreated() const
+{
+	return m_created;
+}
+
+void MeshPicker::Pick(Model& model, const std::vector<int>& meshes, const QMatrix4x4& viewProjection, const QSize& viewport, const QPoint& pixel, GLuint framebuffer,
+	const std::vector<QVector4D>& sectionPlanes)
+{
+	if (!m_created || viewport.isEmpty()) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	StateCache& state = StateCache::Current();
+	if (m_fence) {
+		f->glDeleteSync(m_fence);
+		m_fence = nullptr;
+	}
+	m_viewProjection = viewProjection;
+	m_viewport = viewport;
+	m_pixel = pixel;
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	state.Viewport(0, 0, 1, 1);
+	const GLuint background[4] = {};
+	const GLfloat farDepth = 1.f;
+	f->glClearBufferuiv(GL_COLOR, 0, background);
+	f->glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	state.Enable(GL_DEPTH_TEST);
+	state.DepthFunc(GL_LESS);
+
+	m_pProgram->bind();
+
+	// Meshes drawn without instancing use the identity as their instance transform
+	const QMatrix4x4 identity;
+	m_pProgram->setAttributeValue(k_instanceLocation, identity.constData(), 4, 4);
+
+	// Planes that aren't set keep everything
+	QVector4D planes[Frustum::k_maxExtraPlanes];
+	const int planeCount = std::min(int(sectionPlanes.size()), int(Frustum::k_maxExtraPlanes));
+	for (int i = 0; i < Frustum::k_maxExtraPlanes; ++i) {
+		planes[i] = i < planeCount ? sectionPlanes[i] : QVector4D(0.f, 0.f, 0.f, 1.f);
+		state.SetEnabled(GL_CLIP_DISTANCE0 + i, i < planeCount);
+	}
+	m_pProgram->setUniformValueArray(m_sectionPlanesUniform, planes, Frustum::k_maxExtraPlanes);
+
+	// Triangle ids have to refer to the full mesh, so levels of detail are not used here
+	const QMatrix4x4 pixelViewProjection = PixelProjection(viewport, pixel) * viewProjection;
+	QOpenGLVertexArrayObject* pBoundVao = nullptr;
+	std::vector<std::pair<int, int>> runs;
+	for (int meshIdx : meshes) {
+		Mesh& mesh = model.m_meshes[meshIdx];
+		if (mesh.IsHidden()) {
+			continue;
+		}
+		if (mesh.m_vao) {
+			mesh.m_vao->bind();
+			pBoundVao = mesh.m_vao.data();
+		}
+		else {
+			if (pBoundVao) {
+				pBoundVao->release();
+				pBoundVao = nullptr;
+			}
+			mesh.m_vertexBuffer.bind();
+			mesh.m_indexBuffer.bind();
+			GpuModelBuilder::EnableAttributes(f, mesh);
+		}
+
+		m_pProgram->setUniformValue(m_meshUniform, GLuint(meshIdx + 1));
+		auto Draw = [&](const QMatrix4x4& transform, int instance) {
+			m_pProgram->setUniformValue(m_matrixUniform, pixelViewProjection * transform * mesh.m_positionDecode);
+			m_pProgram->setUniformValue(m_modelUniform, transform * mesh.m_positionDecode);
+			m_pProgram->setUniformValue(m_instanceUniform, instance);
+			GpuModelBuilder::DrawElements(f, mesh, 0, mesh.m_indexCount);
+		};
+		// Hidden instances are left out, each run of shown ones counts its instances from
+		// its first
+		GpuModelBuilder::VisibleRuns(mesh, runs);
+		if (mesh.m_instanced) {
+			m_pProgram->setUniformValue(m_matrixUniform, pixelViewProjection * mesh.m_placement);
+			m_pProgram->setUniformValue(m_modelUniform, mesh.m_placement);
+			for (const std::pair<int, int>& run : runs) {
+				m_pProgram->setUniformValue(m_instanceUniform, run.first);
+				if (mesh.m_hiddenDrawCount > 0) {
+					GpuModelBuilder::SetFirstInstance(f, mesh, run.first);
+				}
+				GpuModelBuilder::DrawElements(f, mesh, 0, mesh.m_indexCount, run.second);
+			}
+			if (mesh.m_hiddenDrawCount > 0) {
+				GpuModelBuilder::SetFirstInstance(f, mesh, 0);
+			}
+		}
+		else if (!mesh.m_instanceTransforms.empty()) {
+			for (const std::pair<int, int>& run : runs) {
+				for (int i = run.first; i < run.first + run.second; ++i) {
+					Draw(mesh.m_instanceTransforms[i], i);
+				}
+			}
+		}
+		else {
+			Draw(mesh.m_transform, 0);
+		}
+
+		if (!mesh.m_vao) {
+			GpuModelBuilder::DisableAttributes(f, mesh);
+			mesh.m_vertexBuffer.release();
+			mesh.m_indexBuffer.release();
+		}
+	}
+	if (pBoundVao) {
+		pBoundVao->release();
+	}
+	m_pProgram->release();
+	for (int i = 0; i < planeCount; ++i) {
+		state.Disable(GL_CLIP_DISTANCE0 + i);
+	}
+
+	// Queue the readback, TakeHit maps it once the fence has passed
+	m_readback.bind();
+	f->glReadBuffer(GL_COLOR_ATTACHMENT0);
+	f->glReadPixels(0, 0, 1, 1, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);
+	f->glReadPixels(0, 0, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, reinterpret_cast<void*>(k_idBytes));
+	m_readback.release();
+	m_fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	state.Viewport(0, 0, viewport.width(), viewport.height());
+}
+
+bool MeshPicker::IsPending() const
+{
+	return m_fence != nullptr;
+}
+
+bool MeshPicker::TakeHit(Hit& hit)
+{
+	if (!m_fence) {
+		return false;
+	}
+	const GLenum status = m_pFunctions->glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		return false;
+	}
+	m_pFunctions->glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	ReadHit(hit);
+	return true;
+}
+
+void MeshPicker::ReadHit(Hit& hit)
+{
+	hit = Hit();
+	GLuint ids[4] = {};
+	GLfloat depth = 1.f;
+	m_readback.bind();
+	const char* pData = static_cast<const char*>(m_readback.mapRange(0, k_readbackBytes, QOpenGLBuffer::RangeRead));
+	if (pData) {
+		std::memcpy(ids, pData, k_idBytes);
+		std::memcpy(&depth, pData + k_idBytes, sizeof(depth));
+		m_readback.unmap();
+	}
+	m_readback.release();
+
+	// Mesh ids start at 1, 0 is the background
+	if (ids[0] == 0) {
+		return;
+	}
+	hit.m_mesh = int(ids[0]) - 1;
+	hit.m_triangle = int(ids[1]);
+	hit.m_instance = int(ids[2]);
+	hit.m_point = Unproject(m_viewProjection, m_viewport, QPointF(m_pixel) + QPointF(0.5, 0.5), depth);
+}
+
+QMatrix4x4 MeshPicker::PixelProjection(const QSize& viewport, const QPoint& pixel)
+{
+	// Move the pixel's center to the middle of the clip volume and grow the pixel to fill it
+	const float width = float(viewport.width());
+	const float height = float(viewport.height());
+	const float centerX = 2.f * (float(pixel.x()) + 0.5f) / width - 1.f;
+	const float centerY = 1.f - 2.f * (float(pixel.y()) + 0.5f) / height;
+
+	QMatrix4x4 projection;
+	projection.scale(width, height, 1.f);
+	projection.translate(-centerX, -centerY, 0.f);
+	return projection;
+}
+
+QVector3D MeshPicker::Unproject(const QMatrix4x4& viewProjection, const QSize& viewport, const QPointF& pixel, float depth)
+{
+	const QVector4D ndc(2.f * float(pixel.x()) / float(viewport.width()) - 1.f,
+		1.f - 2.f * float(pixel.y()) / float(viewport.height()),
+		2.f * depth - 1.f,
+		1.f);
+	return (viewProjection.inverted() * ndc).toVector3DAffine();
+}
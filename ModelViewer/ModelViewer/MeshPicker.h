@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QPoint>
+#include <QSize>
+#include <QVector3D>
+#include <QVector4D>
+#include <qopengl.h>
+
+class QOpenGLExtraFunctions;
+class QOpenGLShaderProgram;
+struct Model;
+
+// Finds the mesh and triangle under a pixel. The candidate meshes are drawn with their mesh,
+// triangle and instance ids into a one pixel framebuffer, through a projection that only
+// covers the picked pixel, so almost nothing is rasterized. The ids and the depth are read
+// back into a fenced pixel buffer and collected a frame later, picking never waits on the GPU.
+class MeshPicker
+{
+public:
+	struct Hit {
+		// Index into the model's meshes, -1 if the pixel shows the background
+		int m_mesh = -1;
+
+		// Triangle in the mesh's full detail indices, and the instance it was drawn for
+		int m_triangle = -1;
+		int m_instance = 0;
+
+		// Where the pixel's center meets the triangle, in model space
+		QVector3D m_point;
+	};
+
+	~MeshPicker();
+
+	// Creating and destroying the framebuffer requires the context it is used in to be current.
+	// Create returns false without OpenGL 3.3, the picker then does nothing.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Draws the ids of meshes, indices into model, as seen at pixel of a viewport drawn with
+	// viewProjection. Pixels are counted from the top left. Replaces a pick still in flight.
+	// Binds framebuffer and the full viewport again when done. What the section planes cut
+	// away, up to Frustum::k_maxExtraPlanes of them in model space, can't be picked.
+	void Pick(Model& model, const std::vector<int>& meshes, const QMatrix4x4& viewProjection, const QSize& viewport, const QPoint& pixel, GLuint framebuffer,
+		const std::vector<QVector4D>& sectionPlanes = std::vector<QVector4D>());
+
+	// True from Pick until its hit has been taken
+	bool IsPending() const;
+
+	// Stores the hit of the last pick once the GPU is done with it, and returns true once per pick
+	bool TakeHit(Hit& hit);
+
+	// Narrows a projection onto viewport to the clip volume of pixel alone, multiply it onto
+	// the projection
+	static QMatrix4x4 PixelProjection(const QSize& viewport, const QPoint& pixel);
+
+	// Point of the space viewProjection maps from that shows up at pixel, with depth from 0
+	// at the near plane to 1 at the far plane. Pixels are counted from the top left.
+	static QVector3D Unproject(const QMatrix4x4& viewProjection, const QSize& viewport, const QPointF& pixel, float depth);
+
+private:
+	void ReadHit(Hit& hit);
+
+	QOpenGLExtraFunctions* m_pFunctions = nullptr;
+	QOpenGLShaderProgram* m_pProgram = nullptr;
+	GLint m_matrixUniform = -1;
+	GLint m_modelUniform = -1;
+	GLint m_sectionPlanesUniform = -1;
+	GLint m_meshUniform = -1;
+	GLint m_instanceUniform = -1;
+
+	GLuint m_framebuffer = 0;
+	GLuint m_idBuffer = 0;
+	GLuint m_depthBuffer = 0;
+	QOpenGLBuffer m_readback = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+	GLsync m_fence = nullptr;
+	bool m_created = false;
+
+	// What the pending pick needs to turn the depth into a point
+	QMatrix4x4 m_viewProjection;
+	QSize m_viewport;
+	QPoint m_pixel;
+};
@@ -0,0 +1,513 @@
+#include "MeshSimplifier.h"
+#include "VertexWelder.h"
+
+#include <assimp/mesh.h>
+#include <assimp/scene.h>
+
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <numeric>
+#include <queue>
+#include <unordered_map>
+
+namespace {
+	// Weight of the planes through open borders, relative to the planes of the triangles
+	const double k_borderWeight = 10.0;
+
+	// A collapse is skipped if it turns a triangle further than this from the way it faced, as
+	// the cosine of the angle between the normals before and after
+	const float k_minNormalCos = 0.2f;
+
+	// Marks vertices no triangle uses any more in the remap of a scene's mesh
+	const uint k_dropped = UINT_MAX;
+
+	// The sum of the squared distances to a set of planes, as the upper triangle of a symmetric
+	// 4x4 matrix. Kept in doubles, the terms of distant planes cancel out in floats.
+	struct Quadric {
+		double m_a[10] = {};
+
+		void AddPlane(const QVector3D& normal, float d, double weight) {
+			const double a = normal.x();
+			const double b = normal.y();
+			const double c = normal.z();
+			m_a[0] += weight * a * a;
+			m_a[1] += weight * a * b;
+			m_a[2] += weight * a * c;
+			m_a[3] += weight * a * d;
+			m_a[4] += weight * b * b;
+			m_a[5] += weight * b * c;
+			m_a[6] += weight * b * d;
+			m_a[7] += weight * c * c;
+			m_a[8] += weight * c * d;
+			m_a[9] += weight * double(d) * d;
+		}
+
+		Quadric& operator+=(const Quadric& other) {
+			for (int i = 0; i < 10; ++i) {
+				m_a[i] += other.m_a[i];
+			}
+			return *this;
+		}
+
+		// Rounding can take points on every plane slightly below 0
+		double Error(const QVector3D& point) const {
+			const double x = point.x();
+			const double y = point.y();
+			const double z = point.z();
+			const double error = m_a[0] * x * x + 2.0 * m_a[1] * x * y + 2.0 * m_a[2] * x * z + 2.0 * m_a[3] * x
+				+ m_a[4] * y * y + 2.0 * m_a[5] * y * z + 2.0 * m_a[6] * y
+				+ m_a[7] * z * z + 2.0 * m_a[8] * z + m_a[9];
+			return std::max(error, 0.0);
+		}
+	};
+
+	// Moving the point m_from onto m_to. The versions are those of the two points when the
+	// collapse was queued, it is stale once either changed.
+	struct Collapse {
+		double m_error = 0.0;
+		int m_from = 0;
+		int m_to = 0;
+		int m_fromVersion = 0;
+		int m_toVersion = 0;
+
+		// The queue takes the largest first, the cheapest collapse has to come out on top
+		bool operator<(const Collapse& other) const { return m_error > other.m_error; }
+	};
+
+	quint64 EdgeKey(int a, int b) {
+		return (quint64(quint32(std::min(a, b))) << 32) | quint32(std::max(a, b));
+	}
+
+	// Triangles a mesh of triangleCount is reduced to, at least one so it doesn't vanish. With
+	// only an error to stop at, as few as that allows.
+	size_t MeshTarget(size_t triangleCount, const SimplifyOptions& options, float ratio) {
+		if (!options.IsActive()) {
+			return triangleCount;
+		}
+		if (options.m_targetTriangles <= 0) {
+			return std::min(triangleCount, size_t(1));
+		}
+		return std::max(size_t(1), size_t(std::ceil(double(triangleCount) * double(ratio))));
+	}
+
+	// The error a mesh may take, targetError of the diagonal of its box
+	float MeshMaxError(const std::vector<QVector3D>& positions, float targetError) {
+		if (targetError <= 0.f || positions.empty()) {
+			return FLT_MAX;
+		}
+		QVector3D min = positions.front();
+		QVector3D max = positions.front();
+		for (const QVector3D& position : positions) {
+			for (int i = 0; i < 3; ++i) {
+				min[i] = std::min(min[i], position[i]);
+				max[i] = std::max(max[i], position[i]);
+			}
+		}
+		return targetError * (max - min).length();
+	}
+
+	// Moves the entries of an attribute at kept vertices down over the dropped ones. Vertices
+	// keep their order, so every entry moves to an index at or below its own.
+	template <typename T>
+	void CompactArray(T* pArray, const std::vector<uint>& remap) {
+		if (!pArray) {
+			return;
+		}
+		for (uint v = 0; v < uint(remap.size()); ++v) {
+			if (remap[v] != k_dropped) {
+				pArray[remap[v]] = pArray[v];
+			}
+		}
+	}
+
+	// Replaces the faces of pMesh with the triangles of indices and drops the vertices they
+	// don't use, with their attributes, bone weights and blend shape offsets. The arrays keep
+	// their size, only the counts shrink.
+	void ReplaceTriangles(aiMesh* pMesh, const std::vector<quint32>& indices) {
+		std::vector<uint> remap(pMesh->mNumVertices, k_dropped);
+		for (quint32 index : indices) {
+			remap[index] = 0;
+		}
+		uint kept = 0;
+		for (uint& target : remap) {
+			if (target != k_dropped) {
+				target = kept++;
+			}
+		}
+
+		CompactArray(pMesh->mVertices, remap);
+		CompactArray(pMesh->mNormals, remap);
+		CompactArray(pMesh->mTangents, remap);
+		CompactArray(pMesh->mBitangents, remap);
+		for (uint set = 0; set < AI_MAX_NUMBER_OF_COLOR_SETS; ++set) {
+			CompactArray(pMesh->mColors[set], remap);
+		}
+		for (uint set = 0; set < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++set) {
+			CompactArray(pMesh->mTextureCoords[set], remap);
+		}
+		for (uint i = 0; i < pMesh->mNumAnimMeshes; ++i) {
+			aiAnimMesh* pAnimMesh = pMesh->mAnimMeshes[i];
+			if (pAnimMesh->mNumVertices != pMesh->mNumVertices) {
+				continue;
+			}
+			CompactArray(pAnimMesh->mVertices, remap);
+			CompactArray(pAnimMesh->mNormals, remap);
+			CompactArray(pAnimMesh->mTangents, remap);
+			CompactArray(pAnimMesh->mBitangents, remap);
+			for (uint set = 0; set < AI_MAX_NUMBER_OF_COLOR_SETS; ++set) {
+				CompactArray(pAnimMesh->mColors[set], remap);
+			}
+			for (uint set = 0; set < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++set) {
+				CompactArray(pAnimMesh->mTextureCoords[set], remap);
+			}
+			pAnimMesh->mNumVertices = kept;
+		}
+		for (uint i = 0; i < pMesh->mNumBones; ++i) {
+			aiBone* pBone = pMesh->mBones[i];
+			uint weights = 0;
+			for (uint w = 0; w < pBone->mNumWeights; ++w) {
+				const aiVertexWeight weight = pBone->mWeights[w];
+				if (weight.mVertexId < remap.size() && remap[weight.mVertexId] != k_dropped) {
+					pBone->mWeights[weights++] = aiVertexWeight(remap[weight.mVertexId], weight.mWeight);
+				}
+			}
+			pBone->mNumWeights = weights;
+		}
+		pMesh->mNumVertices = kept;
+
+		delete[] pMesh->mFaces;
+		pMesh->mNumFaces = uint(indices.size() / 3);
+		pMesh->mFaces = new aiFace[pMesh->mNumFaces];
+		for (uint f = 0; f < pMesh->mNumFaces; ++f) {
+			aiFace& face = pMesh->mFaces[f];
+			face.mNumIndices = 3;
+			face.mIndices = new unsigned int[3];
+			for (uint i = 0; i < 3; ++i) {
+				face.mIndices[i] = remap[indices[3 * f + i]];
+			}
+		}
+	}
+}
+
+
+SimplifiedMesh MeshSimplifier::Simplify(const MeshTriangles& mesh, size_t targetTriangles, float maxError)
+{
+	SimplifiedMesh ret;
+	const std::vector<QVector3D>& positions = mesh.m_positions;
+	const size_t triangleCount = mesh.m_indices.size() / 3;
+	ret.m_indices.assign(mesh.m_indices.begin(), mesh.m_indices.begin() + triangleCount * 3);
+	if (triangleCount <= targetTriangles) {
+		return ret;
+	}
+	for (quint32 index : ret.m_indices) {
+		if (index >= positions.size()) {
+			return ret;
+		}
+	}
+
+	// Vertices at the same position are one point of the surface, however their attributes differ
+	std::vector<quint32> pointVertices;
+	const std::vector<quint32> pointOf = VertexWelder::Weld(positions, pointVertices,
+		[](const QVector3D& p) { return VertexWelder::HashVector(p.x(), p.y(), p.z()); },
+		[](const QVector3D& a, const QVector3D& b) { return a.x() == b.x() && a.y() == b.y() && a.z() == b.z(); });
+	const size_t pointCount = pointVertices.size();
+	const auto Point = [&](size_t corner) { return int(pointOf[ret.m_indices[corner]]); };
+	const auto Position = [&](int point) { return positions[pointVertices[point]]; };
+
+	// Every triangle adds its plane to the quadrics of its corners. Triangles whose corners
+	// already meet are dropped right away.
+	std::vector<char> alive(triangleCount, 0);
+	std::vector<std::vector<int>> pointTriangles(pointCount);
+	std::vector<Quadric> quadrics(pointCount);
+	std::vector<QVector3D> normals(triangleCount);
+	std::unordered_map<quint64, int> edgeTriangles;
+	size_t liveCount = 0;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		const int points[3] = { Point(3 * t), Point(3 * t + 1), Point(3 * t + 2) };
+		if (points[0] == points[1] || points[1] == points[2] || points[2] == points[0]) {
+			continue;
+		}
+		alive[t] = 1;
+		++liveCount;
+		const QVector3D a = Position(points[0]);
+		normals[t] = QVector3D::crossProduct(Position(points[1]) - a, Position(points[2]) - a).normalized();
+		for (int i = 0; i < 3; ++i) {
+			quadrics[points[i]].AddPlane(normals[t], -QVector3D::dotProduct(normals[t], a), 1.0);
+			pointTriangles[points[i]].push_back(int(t));
+
+			// The triangle of an edge only one triangle has, -1 once a second one has it too
+			const auto inserted = edgeTriangles.emplace(EdgeKey(points[i], points[(i + 1) % 3]), int(t));
+			if (!inserted.second) {
+				inserted.first->second = -1;
+			}
+		}
+	}
+
+	// Open borders get planes upright on their triangle, so collapses don't pull them inward
+	for (const auto& edge : edgeTriangles) {
+		if (edge.second < 0) {
+			continue;
+		}
+		const int a = int(edge.first >> 32);
+		const int b = int(edge.first & 0xFFFFFFFFu);
+		const QVector3D normal = QVector3D::crossProduct(Position(b) - Position(a), normals[edge.second]).normalized();
+		const float d = -QVector3D::dotProduct(normal, Position(a));
+		quadrics[a].AddPlane(normal, d, k_borderWeight);
+		quadrics[b].AddPlane(normal, d, k_borderWeight);
+	}
+
+	// Each edge is queued to collapse toward whichever end adds the smaller error
+	std::vector<int> versions(pointCount, 0);
+	std::priority_queue<Collapse> queue;
+	const auto Queue = [&](int a, int b) {
+		Quadric sum = quadrics[a];
+		sum += quadrics[b];
+		const double toB = sum.Error(Position(b));
+		const double toA = sum.Error(Position(a));
+		if (toB <= toA) {
+			queue.push({ toB, a, b, versions[a], versions[b] });
+		}
+		else {
+			queue.push({ toA, b, a, versions[b], versions[a] });
+		}
+	};
+	for (const auto& edge : edgeTriangles) {
+		Queue(int(edge.first >> 32), int(edge.first & 0xFFFFFFFFu));
+	}
+
+	// The other points of the live triangles around point, sorted
+	const auto Neighbours = [&](int point, std::vector<int>& neighbours) {
+		neighbours.clear();
+		for (int t : pointTriangles[point]) {
+			if (!alive[t]) {
+				continue;
+			}
+			for (int i = 0; i < 3; ++i) {
+				const int other = Point(3 * size_t(t) + i);
+				if (other != point) {
+					neighbours.push_back(other);
+				}
+			}
+		}
+		std::sort(neighbours.begin(), neighbours.end());
+		neighbours.erase(std::unique(neighbours.begin(), neighbours.end()), neighbours.end());
+	};
+
+	const double maxErrorSquared = double(maxError) * double(maxError);
+	double largestError = 0.0;
+	std::vector<int> fromNeighbours;
+	std::vector<int> toNeighbours;
+	std::vector<std::pair<quint32, quint32>> moves;
+	while (liveCount > targetTriangles && !queue.empty()) {
+		const Collapse collapse = queue.top();
+		queue.pop();
+		const int from = collapse.m_from;
+		const int to = collapse.m_to;
+		if (versions[from] != collapse.m_fromVersion || versions[to] != collapse.m_toVersion) {
+			continue;
+		}
+
+		// Every other collapse queued is at least as expensive as this one
+		if (collapse.m_error > maxErrorSquared) {
+			break;
+		}
+
+		// The two ends may only share the points of the triangles on the edge, any other
+		// point they share would be pinched into an edge with four or more triangles
+		int edgeTriangleCount = 0;
+		for (int t : pointTriangles[from]) {
+			if (alive[t] && (Point(3 * size_t(t)) == to || Point(3 * size_t(t) + 1) == to || Point(3 * size_t(t) + 2) == to)) {
+				++edgeTriangleCount;
+			}
+		}
+		Neighbours(from, fromNeighbours);
+		Neighbours(to, toNeighbours);
+		int shared = 0;
+		for (size_t i = 0, j = 0; i < fromNeighbours.size() && j < toNeighbours.size();) {
+			if (fromNeighbours[i] < toNeighbours[j]) {
+				++i;
+			}
+			else if (toNeighbours[j] < fromNeighbours[i]) {
+				++j;
+			}
+			else {
+				++shared;
+				++i;
+				++j;
+			}
+		}
+		if (edgeTriangleCount == 0 || shared != edgeTriangleCount) {
+			continue;
+		}
+
+		// The triangles that stay must keep facing the way they did
+		bool flips = false;
+		for (int t : pointTriangles[from]) {
+			if (!alive[t]) {
+				continue;
+			}
+			QVector3D corners[3];
+			bool onEdge = false;
+			for (int i = 0; i < 3; ++i) {
+				const int point = Point(3 * size_t(t) + i);
+				onEdge = onEdge || point == to;
+				corners[i] = Position(point == from ? to : point);
+			}
+			if (onEdge || normals[t].isNull()) {
+				continue;
+			}
+			const QVector3D moved = QVector3D::crossProduct(corners[1] - corners[0], corners[2] - corners[0]);
+			if (QVector3D::dotProduct(normals[t], moved) <= k_minNormalCos * moved.length()) {
+				flips = true;
+				break;
+			}
+		}
+		if (flips) {
+			continue;
+		}
+
+		// The triangles on the edge go. A vertex at from moves to the vertex at to it shared one
+		// of them with, so the attributes on either side of a seam stay on their side.
+		moves.clear();
+		for (int t : pointTriangles[from]) {
+			if (!alive[t]) {
+				continue;
+			}
+			int fromCorner = -1;
+			int toCorner = -1;
+			for (int i = 0; i < 3; ++i) {
+				const int point = Point(3 * size_t(t) + i);
+				if (point == from) {
+					fromCorner = i;
+				}
+				else if (point == to) {
+					toCorner = i;
+				}
+			}
+			if (toCorner >= 0) {
+				moves.emplace_back(ret.m_indices[3 * size_t(t) + fromCorner], ret.m_indices[3 * size_t(t) + toCorner]);
+				alive[t] = 0;
+				--liveCount;
+			}
+		}
+		for (int t : pointTriangles[from]) {
+			if (!alive[t]) {
+				continue;
+			}
+			for (int i = 0; i < 3; ++i) {
+				quint32& vertex = ret.m_indices[3 * size_t(t) + i];
+				if (int(pointOf[vertex]) != from) {
+					continue;
+				}
+				const auto move = std::find_if(moves.begin(), moves.end(), [vertex](const std::pair<quint32, quint32>& m) { return m.first == vertex; });
+				vertex = move != moves.end() ? move->second : pointVertices[to];
+			}
+			const QVector3D a = Position(Point(3 * size_t(t)));
+			normals[t] = QVector3D::crossProduct(Position(Point(3 * size_t(t) + 1)) - a, Position(Point(3 * size_t(t) + 2)) - a).normalized();
+			pointTriangles[to].push_back(t);
+		}
+		quadrics[to] += quadrics[from];
+		pointTriangles[from] = std::vector<int>();
+		++versions[from];
+		++versions[to];
+		largestError = std::max(largestError, collapse.m_error);
+
+		// The edges around to cost more now
+		std::vector<int>& around = pointTriangles[to];
+		around.erase(std::remove_if(around.begin(), around.end(), [&](int t) { return !alive[t]; }), around.end());
+		Neighbours(to, toNeighbours);
+		for (int neighbour : toNeighbours) {
+			Queue(to, neighbour);
+		}
+	}
+
+	size_t kept = 0;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		if (alive[t]) {
+			for (int i = 0; i < 3; ++i) {
+				ret.m_indices[3 * kept + i] = ret.m_indices[3 * t + i];
+			}
+			++kept;
+		}
+	}
+	ret.m_indices.resize(3 * kept);
+	ret.m_error = float(std::sqrt(largestError));
+	return ret;
+}
+
+std::vector<SimplifiedMesh> MeshSimplifier::SimplifyMeshes(const std::vector<MeshTriangles>& meshes, const SimplifyOptions& options)
+{
+	qint64 triangleCount = 0;
+	for (const MeshTriangles& mesh : meshes) {
+		triangleCount += qint64(mesh.m_indices.size() / 3);
+	}
+	const float ratio = KeepRatio(options, triangleCount);
+
+	std::vector<SimplifiedMesh> ret(meshes.size());
+	std::vector<size_t> meshWork(meshes.size());
+	std::iota(meshWork.begin(), meshWork.end(), size_t(0));
+	QtConcurrent::blockingMap(meshWork, [&](size_t i) {
+		const MeshTriangles& mesh = meshes[i];
+		ret[i] = Simplify(mesh, MeshTarget(mesh.m_indices.size() / 3, options, ratio), MeshMaxError(mesh.m_positions, options.m_targetError));
+	});
+	return ret;
+}
+
+bool MeshSimplifier::SimplifyScene(aiScene* pScene, const SimplifyOptions& options)
+{
+	if (!pScene || !options.IsActive()) {
+		return false;
+	}
+
+	// The meshes made of triangles alone
+	std::vector<uint> meshIndices;
+	std::vector<MeshTriangles> meshes;
+	for (uint m = 0; m < pScene->mNumMeshes; ++m) {
+		const aiMesh* pMesh = pScene->mMeshes[m];
+		if (!pMesh->HasPositions() || !pMesh->HasFaces()) {
+			continue;
+		}
+		MeshTriangles triangles;
+		bool onlyTriangles = true;
+		triangles.m_indices.reserve(size_t(pMesh->mNumFaces) * 3);
+		for (uint f = 0; f < pMesh->mNumFaces && onlyTriangles; ++f) {
+			const aiFace& face = pMesh->mFaces[f];
+			onlyTriangles = face.mNumIndices == 3;
+			for (uint i = 0; i < face.mNumIndices && onlyTriangles; ++i) {
+				triangles.m_indices.push_back(face.mIndices[i]);
+			}
+		}
+		if (!onlyTriangles) {
+			continue;
+		}
+		triangles.m_positions.resize(pMesh->mNumVertices);
+		for (uint v = 0; v < pMesh->mNumVertices; ++v) {
+			const aiVector3D& position = pMesh->mVertices[v];
+			triangles.m_positions[v] = QVector3D(position.x, position.y, position.z);
+		}
+		meshIndices.push_back(m);
+		meshes.push_back(std::move(triangles));
+	}
+
+	const std::vector<SimplifiedMesh> simplified = SimplifyMeshes(meshes, options);
+	bool changed = false;
+	for (size_t i = 0; i < meshes.size(); ++i) {
+		if (simplified[i].m_indices.size() != meshes[i].m_indices.size()) {
+			ReplaceTriangles(pScene->mMeshes[meshIndices[i]], simplified[i].m_indices);
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+float MeshSimplifier::KeepRatio(const SimplifyOptions& options, qint64 triangleCount)
+{
+	if (options.m_targetTriangles <= 0 || triangleCount <= options.m_targetTriangles) {
+		return 1.f;
+	}
+	return float(double(options.m_targetTriangles) / double(triangleCount));
+}
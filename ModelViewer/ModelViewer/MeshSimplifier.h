@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+
+#include <QVector3D>
+#include <QtGlobal>
+
+struct aiScene;
+
+// How far MeshSimplifier reduces a model. Each mesh stops at whichever limit it reaches first,
+// nothing is simplified while both are 0.
+struct SimplifyOptions {
+	// Triangles the whole model is reduced to. Every mesh keeps the same share of its own.
+	qint64 m_targetTriangles = 0;
+
+	// Largest error a collapse may add, as a share of the diagonal of the mesh's bounding box
+	float m_targetError = 0.f;
+
+	bool IsActive() const { return m_targetTriangles > 0 || m_targetError > 0.f; }
+};
+
+// The triangles of one mesh to simplify, three indices into the positions per triangle
+struct MeshTriangles {
+	std::vector<QVector3D> m_positions;
+	std::vector<quint32> m_indices;
+};
+
+// The triangles a mesh kept, indexing the same vertices as before, and the largest error of the
+// collapses that removed the others
+struct SimplifiedMesh {
+	std::vector<quint32> m_indices;
+	float m_error = 0.f;
+};
+
+// Simplifies triangle meshes by collapsing edges in the order of the quadric error metric of
+// Garland and Heckbert. An edge collapses into one of its ends, so the simplified triangles use
+// a subset of the mesh's vertices and can replace the full detail indices without touching the
+// vertex buffer. Vertices at the same position are collapsed together, each moving to a vertex
+// of the other end it shared a triangle with, so seams where UVs or normals differ stay closed.
+// Open borders are held in place by extra planes through their edges, and collapses that would
+// flip a triangle or pinch the surface together are skipped.
+class MeshSimplifier
+{
+public:
+	// Collapses edges of the triangles in mesh until at most targetTriangles are left or the
+	// next collapse would add more than maxError. The error of a point is the root of the summed
+	// squared distances to the planes of the triangles merged into it, so it is never less than
+	// how far the point is from any of them.
+	static SimplifiedMesh Simplify(const MeshTriangles& mesh, size_t targetTriangles, float maxError);
+
+	// Simplifies every mesh to options on the global thread pool, one mesh per task. Meshes are
+	// large and few enough that this keeps every core busy without splitting a mesh up.
+	static std::vector<SimplifiedMesh> SimplifyMeshes(const std::vector<MeshTriangles>& meshes, const SimplifyOptions& options);
+
+	// Simplifies the meshes of pScene made of triangles alone in place, the same way, and drops
+	// the vertices no triangle uses any more so an exported file shrinks with them. Points,
+	// lines and polygons are left as they are. Returns false if nothing was simplified.
+	static bool SimplifyScene(aiScene* pScene, const SimplifyOptions& options);
+
+	// Share of its triangles every mesh keeps for options, in a model of triangleCount triangles
+	static float KeepRatio(const SimplifyOptions& options, qint64 triangleCount);
+};
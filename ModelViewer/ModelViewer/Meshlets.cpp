@@ -0,0 +1,134 @@
+#include "Meshlets.h"
+#include "Frustum.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+namespace {
+
+// Bounding sphere and normal cone of the triangles of meshlet
+void SetBounds(Meshlet& meshlet, const std::vector<QVector3D>& positions, const quint32* pIndices)
+{
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	const int end = meshlet.m_firstIndex + meshlet.m_indexCount;
+	for (int i = meshlet.m_firstIndex; i < end; ++i) {
+		const QVector3D& p = positions[pIndices[i]];
+		min = QVector3D(std::min(min.x(), p.x()), std::min(min.y(), p.y()), std::min(min.z(), p.z()));
+		max = QVector3D(std::max(max.x(), p.x()), std::max(max.y(), p.y()), std::max(max.z(), p.z()));
+	}
+	meshlet.m_center = (min + max) * 0.5f;
+	float radius = 0.f;
+	for (int i = meshlet.m_firstIndex; i < end; ++i) {
+		radius = std::max(radius, (positions[pIndices[i]] - meshlet.m_center).length());
+	}
+	meshlet.m_radius = radius;
+
+	// The cone is centered on the average normal and opens as far as the normal furthest
+	// from it. Degenerate triangles face no way and are left out.
+	std::vector<QVector3D> normals;
+	normals.reserve(meshlet.m_indexCount / 3);
+	QVector3D sum;
+	for (int i = meshlet.m_firstIndex; i + 2 < end; i += 3) {
+		const QVector3D& a = positions[pIndices[i]];
+		const QVector3D normal = QVector3D::crossProduct(positions[pIndices[i + 1]] - a, positions[pIndices[i + 2]] - a);
+		const float length = normal.length();
+		if (length > 0.f) {
+			normals.push_back(normal / length);
+			sum += normals.back();
+		}
+	}
+	const float sumLength = sum.length();
+	if (normals.empty() || sumLength < 1e-3f * float(normals.size())) {
+		meshlet.m_coneAxis = QVector3D();
+		meshlet.m_coneCos = -1.f;
+		return;
+	}
+	meshlet.m_coneAxis = sum / sumLength;
+	float coneCos = 1.f;
+	for (const QVector3D& normal : normals) {
+		coneCos = std::min(coneCos, QVector3D::dotProduct(normal, meshlet.m_coneAxis));
+	}
+	meshlet.m_coneCos = coneCos;
+}
+
+}
+
+std::vector<Meshlet> Meshlets::Build(const std::vector<QVector3D>& positions, const quint32* pIndices, int indexCount)
+{
+	std::vector<Meshlet> ret;
+	if (indexCount / 3 < k_minTriangles) {
+		return ret;
+	}
+
+	// Triangles are added in order until the next one would take the meshlet over a limit.
+	// Each vertex remembers the last meshlet it was counted in.
+	std::vector<int> stamps(positions.size(), -1);
+	Meshlet current;
+	int vertexCount = 0;
+	for (int i = 0; i + 2 < indexCount; i += 3) {
+		const int stamp = int(ret.size());
+		int newVertices = 0;
+		for (int k = 0; k < 3; ++k) {
+			newVertices += (stamps[pIndices[i + k]] != stamp) ? 1 : 0;
+		}
+		if (current.m_indexCount == 3 * k_maxTriangles || vertexCount + newVertices > k_maxVertices) {
+			SetBounds(current, positions, pIndices);
+			ret.push_back(current);
+			current = Meshlet();
+			current.m_firstIndex = i;
+			vertexCount = 0;
+			i -= 3;
+			continue;
+		}
+		for (int k = 0; k < 3; ++k) {
+			stamps[pIndices[i + k]] = stamp;
+		}
+		vertexCount += newVertices;
+		current.m_indexCount += 3;
+	}
+	if (current.m_indexCount > 0) {
+		SetBounds(current, positions, pIndices);
+		ret.push_back(current);
+	}
+	return ret;
+}
+
+bool Meshlets::IsBackFacing(const Meshlet& meshlet, const QVector3D& camera)
+{
+	// Cones half a sphere or wider always have a normal facing the camera
+	if (meshlet.m_coneCos <= 0.f) {
+		return false;
+	}
+	const QVector3D toCenter = meshlet.m_center - camera;
+	const float distance = toCenter.length();
+	if (distance <= meshlet.m_radius) {
+		return false;
+	}
+
+	// The normal in the cone closest to facing the camera is the angle of the cone further
+	// round from the direction to the center. If even that one faces away by more than the
+	// radius, every point of every triangle is seen from behind.
+	const float cosTheta = QVector3D::dotProduct(toCenter, meshlet.m_coneAxis) / distance;
+	const float sinTheta = std::sqrt(std::max(0.f, 1.f - cosTheta * cosTheta));
+	const float sinAlpha = std::sqrt(std::max(0.f, 1.f - meshlet.m_coneCos * meshlet.m_coneCos));
+	return distance * (cosTheta * meshlet.m_coneCos - sinTheta * sinAlpha) > meshlet.m_radius;
+}
+
+void Meshlets::VisibleRuns(const std::vector<Meshlet>& meshlets, const Frustum& frustum, const QVector3D* pCamera, std::vector<std::pair<int, int>>& runs)
+{
+	runs.clear();
+	for (const Meshlet& meshlet : meshlets) {
+		if (!frustum.IntersectsSphere(meshlet.m_center, meshlet.m_radius) || (pCamera && IsBackFacing(meshlet, *pCamera))) {
+			continue;
+		}
+		if (!runs.empty() && runs.back().first + runs.back().second == meshlet.m_firstIndex) {
+			runs.back().second += meshlet.m_indexCount;
+		}
+		else {
+			runs.push_back({ meshlet.m_firstIndex, meshlet.m_indexCount });
+		}
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+#include <QVector3D>
+
+#include "ModelLoader.h"
+
+class Frustum;
+
+// Which meshlets of large meshes are skipped, the ViewerGraphicsWindow/meshletCulling setting
+enum MeshletCulling : int {
+	k_meshletCullingOff = 0,
+	k_meshletCullingFrustum = 1, // Meshlets off screen
+	k_meshletCullingBackFaces = 2, // Meshlets off screen or facing away, for closed models
+};
+
+// Divides a mesh's triangles into meshlets and culls them. Meshlets are consecutive runs of the
+// index buffer, so the triangles keep the order they were optimized in for the vertex cache and
+// the visible meshlets of a mesh are drawn with a few draws from the buffer it already has.
+class Meshlets
+{
+public:
+	// Limits of one meshlet, the sizes mesh shading hardware works best with
+	static const int k_maxVertices = 64;
+	static const int k_maxTriangles = 124;
+
+	// Meshes with fewer triangles are culled as a whole, their meshlets wouldn't save a draw
+	static const int k_minTriangles = 4096;
+
+	// Meshlets of the indexCount indices starting at pIndices into positions, in order. Empty
+	// if there are fewer than k_minTriangles triangles.
+	static std::vector<Meshlet> Build(const std::vector<QVector3D>& positions, const quint32* pIndices, int indexCount);
+
+	// True if every triangle of the meshlet faces away from camera, in the mesh's space
+	static bool IsBackFacing(const Meshlet& meshlet, const QVector3D& camera);
+
+	// The first index and index count of the runs of meshlets that pass the frustum, and face
+	// camera unless it is null. Neighboring meshlets that both pass are merged into one run.
+	static void VisibleRuns(const std::vector<Meshlet>& meshlets, const Frustum& frustum, const QVector3D* pCamera, std::vector<std::pair<int, int>>& runs);
+};
@@ -0,0 +1,203 @@
+#include "ModelBrowser.h"
+#include "AppSettings.h"
+#include "ThumbnailIndex.h"
+#include "ViewerGraphicsWindow.h"
+
+#include <QAbstractListModel>
+#include <QApplication>
+#include <QCache>
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QIcon>
+#include <QLabel>
+#include <QListView>
+#include <QPushButton>
+#include <QStyle>
+#include <QVBoxLayout>
+
+#include <assimp/Importer.hpp>
+
+#include <vector>
+
+
+namespace {
+
+// Decoded thumbnails kept while scrolling, the others are decoded again when shown
+const int k_cachedIcons = 512;
+
+}
+
+// The files of the folder, each with what the index knows about it
+class ModelListModel : public QAbstractListModel
+{
+public:
+	ModelListModel(const ThumbnailIndex& index, QObject* parent)
+		: QAbstractListModel(parent), m_index(index), m_icons(k_cachedIcons)
+	{
+		m_fileIcon = QApplication::style()->standardIcon(QStyle::SP_FileIcon);
+	}
+
+	void SetFiles(const QFileInfoList& files)
+	{
+		beginResetModel();
+		m_rows.clear();
+		m_icons.clear();
+		m_indexedCount = 0;
+		for (const QFileInfo& info : files) {
+			Row row;
+			row.m_path = info.absoluteFilePath();
+			row.m_name = info.fileName();
+			row.m_indexed = m_index.Find(info, row.m_summary);
+			m_indexedCount += row.m_indexed ? 1 : 0;
+			m_rows.push_back(row);
+		}
+		endResetModel();
+	}
+
+	int IndexedCount() const
+	{
+		return m_indexedCount;
+	}
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override
+	{
+		return parent.isValid() ? 0 : int(m_rows.size());
+	}
+
+	QVariant data(const QModelIndex& index, int role) const override
+	{
+		if (!index.isValid() || index.row() >= int(m_rows.size())) {
+			return QVariant();
+		}
+		const Row& row = m_rows[index.row()];
+		switch (role) {
+		case Qt::DisplayRole:
+			return row.m_name;
+		case Qt::ToolTipRole:
+			return row.m_name + "\n" + (row.m_indexed ? ThumbnailIndex::Describe(row.m_summary) : QString("Not loaded yet"));
+		case Qt::DecorationRole:
+			return Icon(index.row());
+		case Qt::UserRole:
+			return row.m_path;
+		default:
+			return QVariant();
+		}
+	}
+
+private:
+	struct Row {
+		QString m_path;
+		QString m_name;
+		bool m_indexed = false;
+		ModelSummary m_summary;
+	};
+
+	// Thumbnails are only decoded once their row is drawn
+	QIcon Icon(int row) const
+	{
+		if (const QIcon* pIcon = m_icons.object(row)) {
+			return *pIcon;
+		}
+		const QImage thumbnail = m_rows[row].m_indexed ? m_index.Thumbnail(m_rows[row].m_path) : QImage();
+		QIcon* pIcon = new QIcon(thumbnail.isNull() ? m_fileIcon : QIcon(QPixmap::fromImage(thumbnail)));
+		m_icons.insert(row, pIcon);
+		return *pIcon;
+	}
+
+	const ThumbnailIndex& m_index;
+	std::vector<Row> m_rows;
+	int m_indexedCount = 0;
+	QIcon m_fileIcon;
+	mutable QCache<int, QIcon> m_icons;
+};
+
+ModelBrowser::ModelBrowser(ViewerGraphicsWindow* gWindow, QWidget* parent)
+	: QDialog(parent), m_pGraphicsWindow(gWindow)
+{
+	setWindowTitle("Browse Models");
+	resize(720, 520);
+	settings = AppSettings::Shared();
+
+	// Every extension Assimp reads, and the point clouds only PointCloudLoader reads
+	std::string extensions;
+	Assimp::Importer().GetExtensionList(extensions);
+	m_nameFilters = QString::fromStdString(extensions).split(';', Qt::SkipEmptyParts);
+	m_nameFilters << "*.las";
+
+	// Build our objects
+	m_pModels = new ModelListModel(m_pGraphicsWindow->GetThumbnailIndex(), this);
+	m_pView = new QListView();
+	m_pView->setObjectName("modelBrowserView");
+	m_pView->setModel(m_pModels);
+	m_pView->setViewMode(QListView::IconMode);
+	m_pView->setMovement(QListView::Static);
+	m_pView->setResizeMode(QListView::Adjust);
+	m_pView->setIconSize(QSize(ThumbnailIndex::k_thumbnailSize, ThumbnailIndex::k_thumbnailSize));
+	m_pView->setGridSize(QSize(ThumbnailIndex::k_thumbnailSize + 32, ThumbnailIndex::k_thumbnailSize + 40));
+	m_pView->setWordWrap(true);
+
+	// Every item takes the same space, so laying out thousands of them doesn't measure each
+	m_pView->setUniformItemSizes(true);
+	m_pView->setLayoutMode(QListView::Batched);
+
+	m_pFolderLabel = new QLabel();
+	m_pCountLabel = new QLabel();
+	QPushButton* pChooseButton = new QPushButton("Choose Folder...");
+
+	// Setup the layout format
+	QHBoxLayout* pFolderLayout = new QHBoxLayout();
+	pFolderLayout->addWidget(m_pFolderLabel, 1);
+	pFolderLayout->addWidget(pChooseButton);
+	QVBoxLayout* pLayout = new QVBoxLayout(this);
+	pLayout->addLayout(pFolderLayout);
+	pLayout->addWidget(m_pView, 1);
+	pLayout->addWidget(m_pCountLabel);
+
+	// Connect up all the buttons
+	connect(pChooseButton, &QPushButton::released, this, [=] {
+		const QString folder = QFileDialog::getExistingDirectory(this, "Browse Models", m_folder);
+		if (!folder.isEmpty()) {
+			setFolder(folder);
+		}
+	});
+	connect(m_pView, &QListView::activated, this, [=](const QModelIndex& index) {
+		m_pGraphicsWindow->loadModel(index.data(Qt::UserRole).toString());
+		hide();
+	});
+
+	// A model loaded from the folder gets its thumbnail
+	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ModelIndexed, this, [=](QString filepath) {
+		if (QFileInfo(filepath).absolutePath() == QFileInfo(m_folder).absoluteFilePath()) {
+			setFolder(m_folder);
+		}
+	});
+
+	setFolder(settings->value("ModelBrowser/folder", "../Data/Models/").toString());
+}
+
+void ModelBrowser::setFolder(const QString& folder)
+{
+	// The listing holds the times and sizes the index is checked against, no model is opened
+	m_folder = folder;
+	settings->setValue("ModelBrowser/folder", folder);
+	m_pModels->SetFiles(QDir(folder).entryInfoList(m_nameFilters, QDir::Files, QDir::Name | QDir::IgnoreCase));
+	m_pFolderLabel->setText(QDir::toNativeSeparators(QFileInfo(folder).absoluteFilePath()));
+	m_pCountLabel->setText(QString("%1 models, %2 with thumbnails").arg(modelCount()).arg(indexedCount()));
+}
+
+QString ModelBrowser::folder() const
+{
+	return m_folder;
+}
+
+int ModelBrowser::modelCount() const
+{
+	return m_pModels->rowCount();
+}
+
+int ModelBrowser::indexedCount() const
+{
+	return m_pModels->IndexedCount();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <QDialog>
+#include <QString>
+#include <QStringList>
+
+class AppSettings;
+class ViewerGraphicsWindow;
+class ModelListModel;
+class QLabel;
+class QListView;
+
+// Lists the models in a folder with the thumbnails and summaries the ThumbnailIndex has of
+// them. Only the folder itself is read, no model is opened, so folders of thousands of models
+// show at once. Models that were never loaded have a plain file icon until they are.
+// Activating a model loads it.
+class ModelBrowser : public QDialog
+{
+	Q_OBJECT
+public:
+	ModelBrowser(ViewerGraphicsWindow* gWindow, QWidget* parent = nullptr);
+
+	void setFolder(const QString& folder);
+	QString folder() const;
+
+	// Models in the folder, and how many of them the index has a summary of
+	int modelCount() const;
+	int indexedCount() const;
+
+private:
+	ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
+	AppSettings* settings;
+
+	ModelListModel* m_pModels = nullptr;
+	QListView* m_pView = nullptr;
+	QLabel* m_pFolderLabel = nullptr;
+	QLabel* m_pCountLabel = nullptr;
+	QString m_folder;
+
+	// File name patterns of the formats Assimp can import
+	QStringList m_nameFilters;
+};
@@ -0,0 +1,956 @@
+#include "ModelCache.h"
+#include "Animation.h"
+#include "GeometryCodec.h"
+#include "GltfLoader.h"
+#include "PointCloudLoader.h"
+#include "SceneGraph.h"
+#include "TextModelLoader.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+
+
+namespace {
+
+const char k_magic[8] = { 'M', 'V', 'C', 'A', 'C', 'H', 'E', '\0' };
+
+// Blocks start on this boundary so vertex data can be read in place
+const qint64 k_blockAlignment = 16;
+
+// Typed data isn't written field by field with QDataStream, so the blocks can be used straight
+// from the mapping. Entries are only read back on the machine that wrote them.
+class Writer
+{
+public:
+	explicit Writer(QIODevice& device) : m_device(device) {}
+
+	template<typename T>
+	void Pod(const T& val) {
+		Raw(reinterpret_cast<const char*>(&val), sizeof(T));
+	}
+
+	void Matrix(const QMatrix4x4& matrix) {
+		float values[16];
+		matrix.copyDataTo(values);
+		Raw(reinterpret_cast<const char*>(values), sizeof(values));
+	}
+
+	void Vector(const QVector3D& vec) {
+		Pod(vec.x());
+		Pod(vec.y());
+		Pod(vec.z());
+	}
+
+	void Block(const char* pData, qint64 size) {
+		Pod(quint64(size));
+		static const char padding[k_blockAlignment] = {};
+		Raw(padding, (k_blockAlignment - m_offset % k_blockAlignment) % k_blockAlignment);
+		Raw(pData, size);
+	}
+
+	void Block(const QByteArray& data) {
+		Block(data.constData(), data.size());
+	}
+
+	bool Ok() const { return m_ok; }
+
+private:
+	void Raw(const char* pData, qint64 size) {
+		if (size > 0 && m_device.write(pData, size) != size) {
+			m_ok = false;
+		}
+		m_offset += size;
+	}
+
+	QIODevice& m_device;
+	qint64 m_offset = 0;
+	bool m_ok = true;
+};
+
+// Reads what Writer wrote from a mapped file. Reading past the end fails the whole entry.
+class Reader
+{
+public:
+	Reader(const uchar* pData, qint64 size) : m_pData(pData), m_size(size) {}
+
+	template<typename T>
+	T Pod() {
+		T val = T();
+		if (Check(sizeof(T))) {
+			std::memcpy(&val, m_pData + m_offset, sizeof(T));
+			m_offset += sizeof(T);
+		}
+		return val;
+	}
+
+	QMatrix4x4 Matrix() {
+		float values[16] = {};
+		if (Check(sizeof(values))) {
+			std::memcpy(values, m_pData + m_offset, sizeof(values));
+			m_offset += sizeof(values);
+		}
+		return QMatrix4x4(values);
+	}
+
+	QVector3D Vector() {
+		const float x = Pod<float>();
+		const float y = Pod<float>();
+		const float z = Pod<float>();
+		return QVector3D(x, y, z);
+	}
+
+	// Points into the mapping, nothing is copied
+	const uchar* Block(qint64& size) {
+		size = qint64(Pod<quint64>());
+		m_offset += (k_blockAlignment - m_offset % k_blockAlignment) % k_blockAlignment;
+		if (size < 0 || !Check(size)) {
+			size = 0;
+			return nullptr;
+		}
+		const uchar* pBlock = m_pData + m_offset;
+		m_offset += size;
+		return pBlock;
+	}
+
+	QByteArray Block() {
+		qint64 size = 0;
+		const uchar* pBlock = Block(size);
+		return pBlock ? QByteArray::fromRawData(reinterpret_cast<const char*>(pBlock), int(size)) : QByteArray();
+	}
+
+	void Fail() { m_ok = false; }
+	bool Ok() const { return m_ok; }
+
+private:
+	bool Check(qint64 size) {
+		if (!m_ok || m_offset + size > m_size) {
+			m_ok = false;
+		}
+		return m_ok;
+	}
+
+	const uchar* m_pData;
+	qint64 m_size;
+	qint64 m_offset = 0;
+	bool m_ok = true;
+};
+
+void WriteTexture(Writer& out, const TextureData& texture)
+{
+	out.Block(texture.m_key.toUtf8());
+	out.Block(texture.m_pageFile.toUtf8());
+	if (!texture.m_compressed.isNull()) {
+		const CompressedImage& image = texture.m_compressed;
+		out.Pod(quint8(1));
+		out.Pod(quint32(image.m_format));
+		out.Pod(qint32(image.m_size.width()));
+		out.Pod(qint32(image.m_size.height()));
+		out.Pod(quint32(image.m_levels.size()));
+		for (const QByteArray& level : image.m_levels) {
+			out.Block(level);
+		}
+		return;
+	}
+	const QImage& image = texture.m_image;
+	out.Pod(quint8(0));
+	out.Pod(quint32(image.format()));
+	out.Pod(qint32(image.width()));
+	out.Pod(qint32(image.height()));
+	out.Pod(qint32(image.bytesPerLine()));
+	out.Block(reinterpret_cast<const char*>(image.constBits()), image.sizeInBytes());
+}
+
+TextureData ReadTexture(Reader& in)
+{
+	TextureData texture;
+	texture.m_key = QString::fromUtf8(in.Block());
+	texture.m_pageFile = QString::fromUtf8(in.Block());
+	const quint8 compressed = in.Pod<quint8>();
+	const quint32 format = in.Pod<quint32>();
+	const int width = in.Pod<qint32>();
+	const int height = in.Pod<qint32>();
+	if (compressed) {
+		texture.m_compressed.m_format = QOpenGLTexture::TextureFormat(format);
+		texture.m_compressed.m_size = QSize(width, height);
+		const quint32 levelCount = in.Pod<quint32>();
+		for (quint32 i = 0; i < levelCount && in.Ok(); ++i) {
+			texture.m_compressed.m_levels.push_back(in.Block());
+		}
+		return texture;
+	}
+
+	// The image only references the mapping, uploading it doesn't modify it
+	const int bytesPerLine = in.Pod<qint32>();
+	qint64 size = 0;
+	const uchar* pBits = in.Block(size);
+	if (pBits && size >= qint64(bytesPerLine) * height) {
+		texture.m_image = QImage(pBits, width, height, bytesPerLine, QImage::Format(format));
+	}
+	return texture;
+}
+
+void WriteMaterial(Writer& out, const MaterialData& material, const std::array<int, k_materialMapCount>& textureIdx)
+{
+	const MaterialProperties& properties = material.m_properties;
+	out.Block(material.m_name.toUtf8());
+	out.Pod(properties.m_ambient);
+	out.Pod(properties.m_specular);
+	out.Pod(properties.m_diffuse);
+	out.Pod(properties.m_shininess);
+	out.Pod(quint8(properties.m_metallicRoughness));
+	for (int i = 0; i < 4; ++i) {
+		out.Pod(properties.m_baseColor[i]);
+	}
+	out.Pod(properties.m_metallic);
+	out.Pod(properties.m_roughness);
+	out.Vector(properties.m_emissive);
+	out.Pod(quint8(properties.m_alphaMode));
+	out.Pod(properties.m_alphaCutoff);
+	for (int idx : textureIdx) {
+		out.Pod(qint32(idx));
+	}
+}
+
+MaterialData ReadMaterial(Reader& in, const std::vector<TextureData>& textures)
+{
+	auto ReadColor = [&](GLfloat* pColor) {
+		for (int i = 0; i < 4; ++i) {
+			pColor[i] = in.Pod<GLfloat>();
+		}
+	};
+	MaterialData material;
+	MaterialProperties& properties = material.m_properties;
+	material.m_name = QString::fromUtf8(in.Block());
+	ReadColor(properties.m_ambient);
+	ReadColor(properties.m_specular);
+	ReadColor(properties.m_diffuse);
+	properties.m_shininess = in.Pod<GLfloat>();
+	properties.m_metallicRoughness = in.Pod<quint8>() != 0;
+	for (int i = 0; i < 4; ++i) {
+		properties.m_baseColor[i] = in.Pod<float>();
+	}
+	properties.m_metallic = in.Pod<float>();
+	properties.m_roughness = in.Pod<float>();
+	properties.m_emissive = in.Vector();
+	properties.m_alphaMode = AlphaMode(qBound(int(k_alphaOpaque), int(in.Pod<quint8>()), int(k_alphaBlend)));
+	properties.m_alphaCutoff = in.Pod<float>();
+	for (TextureData& map : material.m_maps) {
+		const int textureIdx = in.Pod<qint32>();
+		if (textureIdx >= 0 && textureIdx < int(textures.size())) {
+			map = textures[textureIdx];
+		}
+	}
+	return material;
+}
+
+// How a vertex or index block is stored. Coded blocks are followed by the size of their
+// elements and the size they decode to.
+enum BlockCodec : quint8 {
+	k_codecNone,
+	k_codecVertices,
+	k_codecIndices,
+};
+
+// Codes the block with GeometryCodec if asked to and if that makes it smaller
+void WriteGeometry(Writer& out, const QByteArray& data, BlockCodec codec, size_t elementSize)
+{
+	std::vector<uchar> coded;
+	if (codec != k_codecNone && elementSize > 0 && size_t(data.size()) % elementSize == 0) {
+		const uchar* pData = reinterpret_cast<const uchar*>(data.constData());
+		const size_t count = size_t(data.size()) / elementSize;
+		coded = codec == k_codecVertices ? GeometryCodec::EncodeVertices(pData, count, elementSize)
+			: GeometryCodec::EncodeIndices(pData, count, elementSize);
+	}
+	if (coded.empty() || coded.size() >= size_t(data.size())) {
+		out.Pod(quint8(k_codecNone));
+		out.Block(data);
+		return;
+	}
+	out.Pod(quint8(codec));
+	out.Pod(quint32(elementSize));
+	out.Pod(quint64(data.size()));
+	out.Block(reinterpret_cast<const char*>(coded.data()), qint64(coded.size()));
+}
+
+// Plain blocks point into the mapping, coded ones are decoded into memory of their own
+QByteArray ReadGeometry(Reader& in)
+{
+	const quint8 codec = in.Pod<quint8>();
+	if (codec == k_codecNone) {
+		return in.Block();
+	}
+	const quint32 elementSize = in.Pod<quint32>();
+	const quint64 size = in.Pod<quint64>();
+	qint64 codedSize = 0;
+	const uchar* pCoded = in.Block(codedSize);
+
+	// A coded index takes at least a byte, and 64 bytes of vertices at least one. Larger sizes
+	// come from a damaged entry and aren't allocated.
+	const bool indices = codec == k_codecIndices;
+	const quint64 maxSize = quint64(codedSize) * (indices ? elementSize : 64);
+	if (!pCoded || (codec != k_codecVertices && !indices) || elementSize == 0 || (indices && elementSize > 4)
+		|| size % elementSize != 0 || size > maxSize || size > quint64(std::numeric_limits<int>::max())) {
+		in.Fail();
+		return QByteArray();
+	}
+	QByteArray data(int(size), Qt::Uninitialized);
+	uchar* pData = reinterpret_cast<uchar*>(data.data());
+	const size_t count = size_t(size / elementSize);
+	const bool decoded = indices ? GeometryCodec::DecodeIndices(pData, count, elementSize, pCoded, size_t(codedSize))
+		: GeometryCodec::DecodeVertices(pData, count, elementSize, pCoded, size_t(codedSize));
+	if (!decoded) {
+		in.Fail();
+		return QByteArray();
+	}
+	return data;
+}
+
+size_t IndexSize(GLenum indexType)
+{
+	return indexType == GL_UNSIGNED_BYTE ? 1 : indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+}
+
+void WriteMesh(Writer& out, const MeshData& mesh, bool compress)
+{
+	// Separate attribute blocks are mostly made of 32 bit components
+	const size_t vertexSize = mesh.m_vertexStride > 0 ? size_t(mesh.m_vertexStride) : 4;
+	WriteGeometry(out, mesh.m_vertexData, compress ? k_codecVertices : k_codecNone, vertexSize);
+	out.Pod(qint32(mesh.m_vertexStride));
+	out.Pod(quint64(mesh.m_positionOffset));
+	out.Pod(quint64(mesh.m_normalOffset));
+	out.Pod(quint64(mesh.m_uvOffset));
+	out.Pod(quint64(mesh.m_colorOffset));
+	out.Pod(qint32(mesh.m_numPositionComponents));
+	out.Pod(qint32(mesh.m_numNormalComponents));
+	out.Pod(qint32(mesh.m_numUVComponents));
+	out.Pod(qint32(mesh.m_numColorComponents));
+	out.Pod(quint32(mesh.m_positionType));
+	out.Pod(quint32(mesh.m_normalType));
+	out.Pod(quint32(mesh.m_uvType));
+	out.Pod(quint32(mesh.m_colorType));
+	out.Matrix(mesh.m_positionDecode);
+	out.Pod(quint8(mesh.m_hasBones));
+	out.Pod(quint64(mesh.m_boneIndexOffset));
+	out.Pod(quint64(mesh.m_boneWeightOffset));
+	out.Pod(quint32(mesh.m_bones.size()));
+	for (const MeshBone& bone : mesh.m_bones) {
+		out.Pod(qint32(bone.m_node));
+		out.Matrix(bone.m_offset);
+		out.Vector(bone.m_min);
+		out.Vector(bone.m_max);
+	}
+	out.Pod(quint32(mesh.m_morphTargets.size()));
+	for (const MorphTarget& target : mesh.m_morphTargets) {
+		out.Pod(target.m_weight);
+		out.Vector(target.m_min);
+		out.Vector(target.m_max);
+	}
+	out.Pod(qint32(mesh.m_morphNode));
+	out.Block(mesh.m_morphData);
+
+	WriteGeometry(out, mesh.m_indexData, compress ? k_codecIndices : k_codecNone, IndexSize(mesh.m_indexType));
+	out.Pod(qint32(mesh.m_indexCount));
+	out.Pod(quint32(mesh.m_indexType));
+	out.Pod(quint32(mesh.m_lods.size()));
+	for (const MeshLod& lod : mesh.m_lods) {
+		out.Pod(qint32(lod.m_firstIndex));
+		out.Pod(qint32(lod.m_indexCount));
+	}
+	out.Pod(quint32(mesh.m_meshlets.size()));
+	for (const Meshlet& meshlet : mesh.m_meshlets) {
+		out.Pod(qint32(meshlet.m_firstIndex));
+		out.Pod(qint32(meshlet.m_indexCount));
+		out.Vector(meshlet.m_center);
+		out.Pod(meshlet.m_radius);
+		out.Vector(meshlet.m_coneAxis);
+		out.Pod(meshlet.m_coneCos);
+	}
+
+	out.Block(mesh.m_name.toUtf8());
+	out.Pod(qint32(mesh.m_material));
+
+	out.Pod(quint32(mesh.m_instanceTransforms.size()));
+	for (const QMatrix4x4& transform : mesh.m_instanceTransforms) {
+		out.Matrix(transform);
+	}
+	out.Pod(quint32(mesh.m_nodes.size()));
+	for (int node : mesh.m_nodes) {
+		out.Pod(qint32(node));
+	}
+
+	out.Pod(quint8(mesh.m_hasNormals));
+	out.Pod(quint8(mesh.m_hasUVCoordinates));
+	out.Pod(quint8(mesh.m_hasColors));
+	out.Matrix(mesh.m_transform);
+	out.Vector(mesh.m_AABBMin);
+	out.Vector(mesh.m_AABBMax);
+}
+
+MeshData ReadMesh(Reader& in)
+{
+	MeshData mesh;
+	mesh.m_vertexData = ReadGeometry(in);
+	mesh.m_vertexStride = in.Pod<qint32>();
+	mesh.m_positionOffset = size_t(in.Pod<quint64>());
+	mesh.m_normalOffset = size_t(in.Pod<quint64>());
+	mesh.m_uvOffset = size_t(in.Pod<quint64>());
+	mesh.m_colorOffset = size_t(in.Pod<quint64>());
+	mesh.m_numPositionComponents = in.Pod<qint32>();
+	mesh.m_numNormalComponents = in.Pod<qint32>();
+	mesh.m_numUVComponents = in.Pod<qint32>();
+	mesh.m_numColorComponents = in.Pod<qint32>();
+	mesh.m_positionType = GLenum(in.Pod<quint32>());
+	mesh.m_normalType = GLenum(in.Pod<quint32>());
+	mesh.m_uvType = GLenum(in.Pod<quint32>());
+	mesh.m_colorType = GLenum(in.Pod<quint32>());
+	mesh.m_positionDecode = in.Matrix();
+	mesh.m_hasBones = in.Pod<quint8>() != 0;
+	mesh.m_boneIndexOffset = size_t(in.Pod<quint64>());
+	mesh.m_boneWeightOffset = size_t(in.Pod<quint64>());
+	const quint32 boneCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < boneCount && in.Ok(); ++i) {
+		MeshBone bone;
+		bone.m_node = in.Pod<qint32>();
+		bone.m_offset = in.Matrix();
+		bone.m_min = in.Vector();
+		bone.m_max = in.Vector();
+		mesh.m_bones.push_back(bone);
+	}
+	const quint32 targetCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < targetCount && in.Ok(); ++i) {
+		MorphTarget target;
+		target.m_weight = in.Pod<float>();
+		target.m_min = in.Vector();
+		target.m_max = in.Vector();
+		mesh.m_morphTargets.push_back(target);
+	}
+	mesh.m_morphNode = in.Pod<qint32>();
+	mesh.m_morphData = in.Block();
+
+	mesh.m_indexData = ReadGeometry(in);
+	mesh.m_indexCount = in.Pod<qint32>();
+	mesh.m_indexType = GLenum(in.Pod<quint32>());
+	const quint32 lodCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < lodCount && in.Ok(); ++i) {
+		MeshLod lod;
+		lod.m_firstIndex = in.Pod<qint32>();
+		lod.m_indexCount = in.Pod<qint32>();
+		mesh.m_lods.push_back(lod);
+	}
+	const quint32 meshletCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < meshletCount && in.Ok(); ++i) {
+		Meshlet meshlet;
+		meshlet.m_firstIndex = in.Pod<qint32>();
+		meshlet.m_indexCount = in.Pod<qint32>();
+		meshlet.m_center = in.Vector();
+		meshlet.m_radius = in.Pod<float>();
+		meshlet.m_coneAxis = in.Vector();
+		meshlet.m_coneCos = in.Pod<float>();
+		mesh.m_meshlets.push_back(meshlet);
+	}
+
+	mesh.m_name = QString::fromUtf8(in.Block());
+	mesh.m_material = in.Pod<qint32>();
+
+	const quint32 instanceCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < instanceCount && in.Ok(); ++i) {
+		mesh.m_instanceTransforms.push_back(in.Matrix());
+	}
+	const quint32 nodeCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < nodeCount && in.Ok(); ++i) {
+		mesh.m_nodes.push_back(in.Pod<qint32>());
+	}
+
+	mesh.m_hasNormals = in.Pod<quint8>() != 0;
+	mesh.m_hasUVCoordinates = in.Pod<quint8>() != 0;
+	mesh.m_hasColors = in.Pod<quint8>() != 0;
+	mesh.m_transform = in.Matrix();
+	mesh.m_AABBMin = in.Vector();
+	mesh.m_AABBMax = in.Vector();
+	return mesh;
+}
+
+void WriteVectorKeys(Writer& out, const std::vector<VectorKey>& keys)
+{
+	out.Pod(quint32(keys.size()));
+	for (const VectorKey& key : keys) {
+		out.Pod(key.m_time);
+		out.Vector(key.m_value);
+	}
+}
+
+std::vector<VectorKey> ReadVectorKeys(Reader& in)
+{
+	std::vector<VectorKey> keys(in.Ok() ? in.Pod<quint32>() : 0);
+	for (VectorKey& key : keys) {
+		key.m_time = in.Pod<float>();
+		key.m_value = in.Vector();
+	}
+	return keys;
+}
+
+// The node tree and clips, after the meshes. A flag says whether there is one.
+void WriteSkeleton(Writer& out, const Skeleton* pSkeleton)
+{
+	out.Pod(quint8(pSkeleton != nullptr));
+	if (!pSkeleton) {
+		return;
+	}
+	out.Pod(quint32(pSkeleton->m_nodes.size()));
+	for (const SkeletonNode& node : pSkeleton->m_nodes) {
+		out.Block(node.m_name.toUtf8());
+		out.Pod(qint32(node.m_parent));
+		out.Matrix(node.m_transform);
+	}
+	out.Pod(quint32(pSkeleton->m_clips.size()));
+	for (const AnimationClip& clip : pSkeleton->m_clips) {
+		out.Block(clip.m_name.toUtf8());
+		out.Pod(clip.m_duration);
+		out.Pod(quint32(clip.m_channels.size()));
+		for (const AnimationChannel& channel : clip.m_channels) {
+			out.Pod(qint32(channel.m_node));
+			WriteVectorKeys(out, channel.m_positions);
+			out.Pod(quint32(channel.m_rotations.size()));
+			for (const RotationKey& key : channel.m_rotations) {
+				out.Pod(key.m_time);
+				out.Pod(key.m_value.scalar());
+				out.Vector(key.m_value.vector());
+			}
+			WriteVectorKeys(out, channel.m_scales);
+		}
+		out.Pod(quint32(clip.m_morphChannels.size()));
+		for (const MorphChannel& channel : clip.m_morphChannels) {
+			out.Pod(qint32(channel.m_node));
+			out.Pod(quint32(channel.m_keys.size()));
+			for (const MorphKey& key : channel.m_keys) {
+				out.Pod(key.m_time);
+				out.Pod(quint32(key.m_weights.size()));
+				for (float weight : key.m_weights) {
+					out.Pod(weight);
+				}
+			}
+		}
+	}
+}
+
+// Null if there is none, or if a channel has no keys for something, which the entry then fails on
+QSharedPointer<const Skeleton> ReadSkeleton(Reader& in)
+{
+	if (in.Pod<quint8>() == 0) {
+		return QSharedPointer<const Skeleton>();
+	}
+	QSharedPointer<Skeleton> skeleton(new Skeleton());
+	const quint32 nodeCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < nodeCount && in.Ok(); ++i) {
+		SkeletonNode node;
+		node.m_name = QString::fromUtf8(in.Block());
+		node.m_parent = in.Pod<qint32>();
+		node.m_transform = in.Matrix();
+		skeleton->m_nodes.push_back(node);
+	}
+	const quint32 clipCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < clipCount && in.Ok(); ++i) {
+		AnimationClip clip;
+		clip.m_name = QString::fromUtf8(in.Block());
+		clip.m_duration = in.Pod<float>();
+		const quint32 channelCount = in.Pod<quint32>();
+		for (quint32 c = 0; c < channelCount && in.Ok(); ++c) {
+			AnimationChannel channel;
+			channel.m_node = in.Pod<qint32>();
+			channel.m_positions = ReadVectorKeys(in);
+			const quint32 rotationCount = in.Pod<quint32>();
+			for (quint32 k = 0; k < rotationCount && in.Ok(); ++k) {
+				RotationKey key;
+				key.m_time = in.Pod<float>();
+				const float scalar = in.Pod<float>();
+				key.m_value = QQuaternion(scalar, in.Vector());
+				channel.m_rotations.push_back(key);
+			}
+			channel.m_scales = ReadVectorKeys(in);
+			if (channel.m_positions.empty() || channel.m_rotations.empty() || channel.m_scales.empty()) {
+				return QSharedPointer<const Skeleton>();
+			}
+			clip.m_channels.push_back(std::move(channel));
+		}
+		const quint32 morphChannelCount = in.Pod<quint32>();
+		for (quint32 c = 0; c < morphChannelCount && in.Ok(); ++c) {
+			MorphChannel channel;
+			channel.m_node = in.Pod<qint32>();
+			const quint32 keyCount = in.Pod<quint32>();
+			for (quint32 k = 0; k < keyCount && in.Ok(); ++k) {
+				MorphKey key;
+				key.m_time = in.Pod<float>();
+				const quint32 weightCount = in.Pod<quint32>();
+				for (quint32 w = 0; w < weightCount && in.Ok(); ++w) {
+					key.m_weights.push_back(in.Pod<float>());
+				}
+				channel.m_keys.push_back(std::move(key));
+			}
+			if (channel.m_keys.empty()) {
+				return QSharedPointer<const Skeleton>();
+			}
+			clip.m_morphChannels.push_back(std::move(channel));
+		}
+		skeleton->m_clips.push_back(std::move(clip));
+	}
+	return skeleton;
+}
+
+// The node tree at rest, after the skeleton. A flag says whether there is one. The world
+// matrices are stored as well, as the loader multiplies them out in double precision.
+void WriteSceneGraph(Writer& out, const SceneGraph* pGraph)
+{
+	out.Pod(quint8(pGraph != nullptr));
+	if (!pGraph) {
+		return;
+	}
+	out.Pod(quint32(pGraph->NodeCount()));
+	for (int i = 0; i < pGraph->NodeCount(); ++i) {
+		const SceneNode& node = pGraph->Node(i);
+		out.Block(node.m_name.toUtf8());
+		out.Pod(qint32(node.m_parent));
+		out.Matrix(node.m_local);
+		out.Matrix(node.m_world);
+	}
+}
+
+// Null if there is none. Nodes are stored depth first, a node whose parent isn't the node before
+// it or one above that fails the entry.
+QSharedPointer<const SceneGraph> ReadSceneGraph(Reader& in, bool& failed)
+{
+	if (in.Pod<quint8>() == 0) {
+		return QSharedPointer<const SceneGraph>();
+	}
+	QSharedPointer<SceneGraph> graph(new SceneGraph());
+	const quint32 nodeCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < nodeCount && in.Ok(); ++i) {
+		const QString name = QString::fromUtf8(in.Block());
+		const int parent = in.Pod<qint32>();
+		const QMatrix4x4 local = in.Matrix();
+		const QMatrix4x4 world = in.Matrix();
+		if (parent >= int(i) || (parent >= 0 && graph->Node(parent).m_end != int(i))) {
+			failed = true;
+			return QSharedPointer<const SceneGraph>();
+		}
+		graph->AddNode(name, parent, local, world);
+	}
+	return graph;
+}
+
+// The lights of the scene, after the node tree
+void WriteLights(Writer& out, const std::vector<SceneLight>& lights)
+{
+	out.Pod(quint32(lights.size()));
+	for (const SceneLight& light : lights) {
+		out.Pod(qint32(light.m_type));
+		out.Vector(light.m_position);
+		out.Vector(light.m_direction);
+		out.Vector(light.m_color);
+		out.Vector(light.m_attenuation);
+		out.Pod(light.m_innerCone);
+		out.Pod(light.m_outerCone);
+	}
+}
+
+std::vector<SceneLight> ReadLights(Reader& in)
+{
+	std::vector<SceneLight> lights;
+	const quint32 lightCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < lightCount && in.Ok(); ++i) {
+		SceneLight light;
+		light.m_type = in.Pod<qint32>();
+		light.m_position = in.Vector();
+		light.m_direction = in.Vector();
+		light.m_color = in.Vector();
+		light.m_attenuation = in.Vector();
+		light.m_innerCone = in.Pod<float>();
+		light.m_outerCone = in.Pod<float>();
+		lights.push_back(light);
+	}
+	return lights;
+}
+
+// Maps just the part of the file covering blocks, which currently point into pBase, and points
+// them into the new mapping instead. The mapping is released with the last block using it.
+QSharedPointer<const uchar> Remap(const QSharedPointer<QFile>& pFile, const uchar* pBase, const std::vector<QByteArray*>& blocks)
+{
+	qint64 begin = pFile->size();
+	qint64 end = 0;
+	for (const QByteArray* pBlock : blocks) {
+		if (!pBlock->isEmpty()) {
+			const qint64 offset = reinterpret_cast<const uchar*>(pBlock->constData()) - pBase;
+			begin = std::min(begin, offset);
+			end = std::max(end, offset + pBlock->size());
+		}
+	}
+	if (end <= begin) {
+		return QSharedPointer<const uchar>();
+	}
+
+	uchar* pRegion = pFile->map(begin, end - begin);
+	if (!pRegion) {
+		return QSharedPointer<const uchar>();
+	}
+	for (QByteArray* pBlock : blocks) {
+		if (!pBlock->isEmpty()) {
+			const qint64 offset = reinterpret_cast<const uchar*>(pBlock->constData()) - pBase;
+			*pBlock = QByteArray::fromRawData(reinterpret_cast<const char*>(pRegion + offset - begin), pBlock->size());
+		}
+	}
+	return QSharedPointer<const uchar>(pRegion, [pFile](const uchar* pRegion) {
+		pFile->unmap(const_cast<uchar*>(pRegion));
+	});
+}
+
+bool RemapTexture(const QSharedPointer<QFile>& pFile, const uchar* pBase, TextureData& texture)
+{
+	if (!texture.m_compressed.isNull()) {
+		// One region for the whole mip chain
+		std::vector<QByteArray*> levels;
+		for (QByteArray& level : texture.m_compressed.m_levels) {
+			levels.push_back(&level);
+		}
+		texture.m_pMapping = Remap(pFile, pBase, levels);
+		return !texture.m_pMapping.isNull();
+	}
+	if (texture.m_image.isNull()) {
+		return true;
+	}
+	const QImage& image = texture.m_image;
+	QByteArray bits = QByteArray::fromRawData(reinterpret_cast<const char*>(image.constBits()), int(image.sizeInBytes()));
+	texture.m_pMapping = Remap(pFile, pBase, { &bits });
+	texture.m_image = QImage(reinterpret_cast<const uchar*>(bits.constData()), image.width(), image.height(), image.bytesPerLine(), image.format());
+	return !texture.m_pMapping.isNull();
+}
+
+}
+
+ModelCache::ModelCache(const QString& folder)
+	: m_folder(folder)
+{
+}
+
+QString ModelCache::DefaultFolder()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/models";
+}
+
+QByteArray ModelCache::Key(const QString& file, const LoadOptions& options)
+{
+	const QFileInfo info(file);
+	if (!info.exists()) {
+		return QByteArray();
+	}
+	const int optionBits = int(options.m_interleaved) | int(options.m_quantize) << 1
+		| int(options.m_quantizePositions) << 2 | int(options.m_batchStatic) << 3
+		| int(options.m_generateLods) << 4 | int(options.m_buildMeshlets) << 5
+		| int(options.m_optimizeVertexCache) << 6 | int(options.m_optimizeOverdraw) << 7
+		| int(options.m_nativeGltf && GltfLoader::IsGltfFile(file)) << 8
+		| int(TextModelLoader::Handles(file, options)) << 9
+		| int(PointCloudLoader::Handles(file)) << 10;
+	return QString("%1|%2|%3|%4|%5|%6|%7|%8")
+		.arg(info.absoluteFilePath())
+		.arg(info.lastModified().toMSecsSinceEpoch())
+		.arg(info.size())
+		.arg(ModelLoader::ImportFlags(options))
+		.arg(optionBits)
+		.arg(options.m_clusterTriangles)
+		.arg(options.m_virtualTextureSize)
+		.arg(k_version)
+		.toUtf8();
+}
+
+QString ModelCache::EntryPath(const QString& file, const LoadOptions& options) const
+{
+	const QByteArray key = Key(file, options);
+	if (key.isEmpty()) {
+		return QString();
+	}
+	const QByteArray name = QCryptographicHash::hash(key, QCryptographicHash::Sha1).toHex();
+	return QDir(m_folder).filePath(QString::fromLatin1(name) + ".mvcache");
+}
+
+bool ModelCache::Load(const QString& file, const LoadOptions& options, ModelData& data) const
+{
+	const QString path = EntryPath(file, options);
+	if (path.isEmpty()) {
+		return false;
+	}
+
+	QSharedPointer<QFile> pFile(new QFile(path));
+	if (!pFile->open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	uchar* pData = pFile->map(0, pFile->size());
+	if (!pData) {
+		return false;
+	}
+
+	Reader in(pData, pFile->size());
+	char magic[sizeof(k_magic)];
+	for (char& c : magic) {
+		c = in.Pod<char>();
+	}
+	if (std::memcmp(magic, k_magic, sizeof(k_magic)) != 0 || in.Pod<quint32>() != k_version
+		|| in.Block() != Key(file, options)) {
+		return false;
+	}
+
+	// Parsing only touches the small records between the blocks. Each texture and mesh then
+	// gets its own mapping of its blocks, so the pages of a mesh are released once it was
+	// uploaded and dropped, rather than the whole file staying resident until the end.
+	ModelData ret;
+	ret.m_pMappedFile = pFile;
+	std::vector<TextureData> textures(in.Pod<quint32>());
+	for (TextureData& texture : textures) {
+		texture = ReadTexture(in);
+		if (!in.Ok() || !RemapTexture(pFile, pData, texture)) {
+			return false;
+		}
+		// Page files are trimmed apart from the entries, a model whose pages are gone is
+		// decoded again
+		if (!texture.m_pageFile.isEmpty() && !QFileInfo::exists(texture.m_pageFile)) {
+			return false;
+		}
+	}
+	const quint32 materialCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < materialCount && in.Ok(); ++i) {
+		ret.m_materials.push_back(ReadMaterial(in, textures));
+	}
+	const quint32 meshCount = in.Pod<quint32>();
+	for (quint32 i = 0; i < meshCount && in.Ok(); ++i) {
+		MeshData mesh = ReadMesh(in);
+		if (!in.Ok()) {
+			return false;
+		}
+
+		// Decoded blocks already have their own memory, only the plain ones are mapped
+		std::vector<QByteArray*> blocks;
+		for (QByteArray* pBlock : { &mesh.m_vertexData, &mesh.m_indexData, &mesh.m_morphData }) {
+			const uchar* pBlockData = reinterpret_cast<const uchar*>(pBlock->constData());
+			if (!pBlock->isEmpty() && pBlockData >= pData && pBlockData < pData + pFile->size()) {
+				blocks.push_back(pBlock);
+			}
+		}
+		mesh.m_pMapping = Remap(pFile, pData, blocks);
+		if (mesh.m_pMapping.isNull() && !blocks.empty()) {
+			return false;
+		}
+		ret.m_meshes.push_back(std::move(mesh));
+	}
+	ret.m_skeleton = ReadSkeleton(in);
+	bool badGraph = false;
+	ret.m_sceneGraph = ReadSceneGraph(in, badGraph);
+	ret.m_lights = ReadLights(in);
+	for (double& coordinate : ret.m_origin) {
+		coordinate = in.Pod<double>();
+	}
+	const bool skinned = std::any_of(ret.m_meshes.begin(), ret.m_meshes.end(), [](const MeshData& mesh) { return mesh.m_hasBones; });
+	const int graphNodes = ret.m_sceneGraph ? ret.m_sceneGraph->NodeCount() : 0;
+	for (const MeshData& mesh : ret.m_meshes) {
+		badGraph = badGraph || std::any_of(mesh.m_nodes.begin(), mesh.m_nodes.end(), [graphNodes](int node) { return node < 0 || node >= graphNodes; });
+	}
+	if (!in.Ok() || ret.m_meshes.empty() || (skinned && !ret.m_skeleton) || badGraph) {
+		return false;
+	}
+	pFile->unmap(pData);
+
+	// Not stored, counting takes a fraction of reading the blocks
+	ret.m_stats = ModelStats::Compute(ret);
+	data = std::move(ret);
+	return true;
+}
+
+bool ModelCache::Store(const QString& file, const LoadOptions& options, const ModelData& data) const
+{
+	const QString path = EntryPath(file, options);
+	if (path.isEmpty() || data.m_meshes.empty() || !QDir().mkpath(m_folder)) {
+		return false;
+	}
+
+	// Textures shared by several maps are written once
+	std::vector<const TextureData*> textures;
+	std::vector<std::array<int, k_materialMapCount>> materialTextures;
+	QHash<QString, int> textureIndices;
+	for (const MaterialData& material : data.m_materials) {
+		std::array<int, k_materialMapCount> indices;
+		for (int map = 0; map < k_materialMapCount; ++map) {
+			const TextureData& texture = material.m_maps[map];
+			indices[map] = -1;
+			if (!texture.isNull()) {
+				auto it = textureIndices.find(texture.m_key);
+				if (it == textureIndices.end()) {
+					it = textureIndices.insert(texture.m_key, int(textures.size()));
+					textures.push_back(&texture);
+				}
+				indices[map] = it.value();
+			}
+		}
+		materialTextures.push_back(indices);
+	}
+
+	// Written next to the entry and renamed over it, so a half written entry is never read
+	QSaveFile saveFile(path);
+	if (!saveFile.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	Writer out(saveFile);
+	for (char c : k_magic) {
+		out.Pod(c);
+	}
+	out.Pod(k_version);
+	out.Block(Key(file, options));
+
+	out.Pod(quint32(textures.size()));
+	for (const TextureData* pTexture : textures) {
+		WriteTexture(out, *pTexture);
+	}
+	out.Pod(quint32(data.m_materials.size()));
+	for (size_t i = 0; i < data.m_materials.size(); ++i) {
+		WriteMaterial(out, data.m_materials[i], materialTextures[i]);
+	}
+	out.Pod(quint32(data.m_meshes.size()));
+	for (const MeshData& mesh : data.m_meshes) {
+		WriteMesh(out, mesh, options.m_compressCache);
+	}
+	WriteSkeleton(out, data.m_skeleton.data());
+	WriteSceneGraph(out, data.m_sceneGraph.data());
+	WriteLights(out, data.m_lights);
+	for (double coordinate : data.m_origin) {
+		out.Pod(coordinate);
+	}
+
+	if (!out.Ok() || !saveFile.commit()) {
+		return false;
+	}
+	Trim();
+	return true;
+}
+
+void ModelCache::Trim() const
+{
+	// Remove the least recently written entries until the cache fits. Entries that are
+	// mapped right now can't be removed on Windows, they are left for the next time.
+	QFileInfoList entries = QDir(m_folder).entryInfoList(QStringList("*.mvcache"), QDir::Files, QDir::Time);
+	qint64 total = 0;
+	for (const QFileInfo& entry : entries) {
+		total += entry.size();
+	}
+	while (total > k_maxBytes && !entries.isEmpty()) {
+		const QFileInfo oldest = entries.takeLast();
+		if (QFile::remove(oldest.filePath())) {
+			total -= oldest.size();
+		}
+	}
+}
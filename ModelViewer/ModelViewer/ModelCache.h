@@ -0,0 +1,43 @@
+#pragma once
+#include <QString>
+
+#include "ModelLoader.h"
+
+// Keeps decoded models on disk so reopening a file skips the Assimp import and post-processing.
+// Entries are keyed by the file's path, modification time and size, the import flags and the
+// load options. Vertex, index and texture data are stored in 16 byte aligned blocks, and a
+// loaded model points straight into memory mapped regions of the file instead of copying them.
+// Each mesh and texture maps its own region, which is unmapped together with it.
+// With LoadOptions::m_compressCache vertex and index blocks are stored coded by GeometryCodec
+// instead, and decoded into memory on load.
+class ModelCache
+{
+public:
+	// Bump whenever the layout of the file or of MeshData changes
+	static const quint32 k_version = 13;
+
+	// Oldest entries are removed once the cache grows past this
+	static const qint64 k_maxBytes = 4ll * 1024 * 1024 * 1024;
+
+	explicit ModelCache(const QString& folder = DefaultFolder());
+
+	// Per user cache location of the application
+	static QString DefaultFolder();
+
+	// Fills data and returns true if a valid entry for file exists. The mesh data points
+	// into the mapped file, each region stays mapped for as long as a mesh or texture uses it.
+	bool Load(const QString& file, const LoadOptions& options, ModelData& data) const;
+
+	// Writes data as the entry for file. Safe to call from a worker thread.
+	bool Store(const QString& file, const LoadOptions& options, const ModelData& data) const;
+
+	// Where the entry for file would be stored, empty if file does not exist
+	QString EntryPath(const QString& file, const LoadOptions& options) const;
+
+private:
+	// Identifies the source file and how it was decoded, stored in the entry as a check
+	static QByteArray Key(const QString& file, const LoadOptions& options);
+	void Trim() const;
+
+	QString m_folder;
+};
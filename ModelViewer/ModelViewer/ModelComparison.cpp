@@ -0,0 +1,386 @@
+#include "ModelComparison.h"
+#include "SplitView.h"
+#include "StateCache.h"
+#include "SurfaceDistance.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+
+#include <algorithm>
+#include <cfloat>
+
+#ifndef GL_RGBA32F
+#define GL_RGBA32F 0x8814
+#endif
+
+
+namespace {
+
+// The heatmap color of a distance divided by the largest one, as HeatColor computes it
+#define HEAT_COLOR \
+	"vec3 HeatColor(float t) {\n" \
+	"   t = clamp(t, 0.0, 1.0);\n" \
+	"   return t < 0.5 ? mix(vec3(0.0, 0.0, 1.0), vec3(0.0, 1.0, 0.0), t * 2.0) : mix(vec3(0.0, 1.0, 0.0), vec3(1.0, 0.0, 0.0), t * 2.0 - 1.0);\n" \
+	"}\n"
+
+const char* k_surfaceVertexShaderSource =
+	"#version 330\n"
+	"in vec3 posAttr;\n"
+	"in float distanceAttr;\n"
+	"uniform mat4 uModelView;\n"
+	"uniform mat4 uProjection;\n"
+	"uniform float uMaxDistance;\n"
+	"out vec3 eyePosition;\n"
+	"out float heat;\n"
+	"void main() {\n"
+	"   vec4 eye = uModelView * vec4(posAttr, 1.0);\n"
+	"   eyePosition = eye.xyz;\n"
+	"   heat = uMaxDistance > 0.0 ? distanceAttr / uMaxDistance : 0.0;\n"
+	"   gl_Position = uProjection * eye;\n"
+	"}\n";
+
+// Output 0 shades the surface grey, 1 by the heatmap and 2 writes its eye space normal and
+// linear depth for the difference pass
+const char* k_surfaceFragmentShaderSource =
+	"#version 330\n"
+	HEAT_COLOR
+	"uniform int uOutput;\n"
+	"in vec3 eyePosition;\n"
+	"in float heat;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"   vec3 normal = normalize(cross(dFdx(eyePosition), dFdy(eyePosition)));\n"
+	"   if (uOutput == 2) {\n"
+	"      fragColor = vec4(normal, -eyePosition.z);\n"
+	"      return;\n"
+	"   }\n"
+	"   vec3 base = uOutput == 1 ? HeatColor(heat) : vec3(0.8);\n"
+	"   fragColor = vec4(base * (0.25 + 0.75 * abs(normal.z)), 1.0);\n"
+	"}\n";
+
+#undef HEAT_COLOR
+
+const char* k_differenceVertexShaderSource =
+	"#version 330\n"
+	"in vec2 posAttr;\n"
+	"void main() {\n"
+	"   gl_Position = vec4(posAttr, 0.0, 1.0);\n"
+	"}\n";
+
+// Pixels only one model covers are yellow. Where both do, the original is shaded grey with red
+// mixed in by how far apart the depths are and blue by the angle between the normals, at full
+// strength from uDepthTolerance and 30 degrees on. The background is left as it was.
+const char* k_differenceFragmentShaderSource =
+	"#version 330\n"
+	"uniform sampler2D uOriginal;\n"
+	"uniform sampler2D uCompared;\n"
+	"uniform float uDepthTolerance;\n"
+	"out vec4 fragColor;\n"
+	"const float k_angleTolerance = 0.5235988;\n"
+	"void main() {\n"
+	"   ivec2 texel = ivec2(gl_FragCoord.xy);\n"
+	"   vec4 original = texelFetch(uOriginal, texel, 0);\n"
+	"   vec4 compared = texelFetch(uCompared, texel, 0);\n"
+	"   bool hasOriginal = original.w > 0.0;\n"
+	"   bool hasCompared = compared.w > 0.0;\n"
+	"   if (!hasOriginal && !hasCompared) {\n"
+	"      discard;\n"
+	"   }\n"
+	"   if (hasOriginal != hasCompared) {\n"
+	"      fragColor = vec4(1.0, 0.85, 0.0, 1.0);\n"
+	"      return;\n"
+	"   }\n"
+	"   float depth = clamp(abs(original.w - compared.w) / uDepthTolerance, 0.0, 1.0);\n"
+	"   float angle = clamp(acos(clamp(dot(original.xyz, compared.xyz), -1.0, 1.0)) / k_angleTolerance, 0.0, 1.0);\n"
+	"   vec3 grey = vec3(0.25 + 0.5 * abs(original.z));\n"
+	"   fragColor = vec4(grey * (1.0 - max(depth, angle)) + vec3(depth, 0.0, angle), 1.0);\n"
+	"}\n";
+
+// One triangle covering the whole viewport
+const GLfloat k_fullScreenTriangle[] = { -1.f, -1.f, 3.f, -1.f, -1.f, 3.f };
+
+const GLuint k_posAttr = 0;
+const GLuint k_distanceAttr = 1;
+
+// A position and the distance to the other model per vertex
+const int k_vertexFloats = 4;
+
+// The largest depth difference the difference view tells apart, as a fraction of the size of
+// the original model
+const float k_depthTolerance = 0.01f;
+
+// Bytes per pixel of the float normals and depth of both models, with their depth buffers
+const qint64 k_targetBytesPerPixel = 2 * (16 + 4);
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+QOpenGLShaderProgram* LinkProgram(const char* pVertexSource, const char* pFragmentSource)
+{
+	QOpenGLShaderProgram* pProgram = new QOpenGLShaderProgram();
+	pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, pVertexSource);
+	pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, pFragmentSource);
+	pProgram->bindAttributeLocation("posAttr", k_posAttr);
+	pProgram->bindAttributeLocation("distanceAttr", k_distanceAttr);
+	if (!pProgram->link()) {
+		qWarning("Could not link the comparison shader: %s", qPrintable(pProgram->log()));
+		delete pProgram;
+		return nullptr;
+	}
+	return pProgram;
+}
+
+}
+
+ModelComparison::~ModelComparison()
+{
+	// The buffers and framebuffers go with the context, only the programs are left
+	delete m_pSurfaceProgram;
+	delete m_pDifferenceProgram;
+}
+
+bool ModelComparison::Create()
+{
+	Destroy();
+
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+
+	m_pSurfaceProgram = LinkProgram(k_surfaceVertexShaderSource, k_surfaceFragmentShaderSource);
+	m_pDifferenceProgram = LinkProgram(k_differenceVertexShaderSource, k_differenceFragmentShaderSource);
+	if (!m_pSurfaceProgram || !m_pDifferenceProgram) {
+		Destroy();
+		return false;
+	}
+	m_pDifferenceProgram->bind();
+	m_pDifferenceProgram->setUniformValue("uOriginal", 0);
+	m_pDifferenceProgram->setUniformValue("uCompared", 1);
+	m_pDifferenceProgram->release();
+
+	m_triangle = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	m_triangle.create();
+	m_triangle.bind();
+	m_triangle.allocate(k_fullScreenTriangle, sizeof(k_fullScreenTriangle));
+	m_vao.create();
+	m_vao.bind();
+	Functions()->glVertexAttribPointer(k_posAttr, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+	Functions()->glEnableVertexAttribArray(k_posAttr);
+	m_vao.release();
+	m_triangle.release();
+	return true;
+}
+
+void ModelComparison::Destroy()
+{
+	if (QOpenGLContext::currentContext()) {
+		Clear();
+		delete m_pTargets[0];
+		delete m_pTargets[1];
+		m_vao.destroy();
+		m_triangle.destroy();
+	}
+	m_pTargets[0] = nullptr;
+	m_pTargets[1] = nullptr;
+	m_targetSize = QSize();
+	delete m_pSurfaceProgram;
+	m_pSurfaceProgram = nullptr;
+	delete m_pDifferenceProgram;
+	m_pDifferenceProgram = nullptr;
+}
+
+bool ModelComparison::IsCreated() const
+{
+	return m_pSurfaceProgram != nullptr;
+}
+
+void ModelComparison::Upload(const SurfaceComparison& comparison)
+{
+	if (!IsCreated()) {
+		return;
+	}
+	UploadSurface(m_surfaces[0], comparison.m_original.Positions(), comparison.m_originalDistances, comparison.m_original.Indices());
+	UploadSurface(m_surfaces[1], comparison.m_compared.Positions(), comparison.m_comparedDistances, comparison.m_compared.Indices());
+	m_maxDistance = comparison.m_hausdorff;
+
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const QVector3D& position : comparison.m_original.Positions()) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = std::min(min[i], position[i]);
+			max[i] = std::max(max[i], position[i]);
+		}
+	}
+	m_extent = comparison.m_original.Positions().empty() ? 0.f : (max - min).length();
+}
+
+void ModelComparison::UploadSurface(Surface& surface, const std::vector<QVector3D>& positions, const std::vector<float>& distances, const std::vector<GLuint>& indices)
+{
+	std::vector<GLfloat> vertices(positions.size() * k_vertexFloats);
+	for (size_t v = 0; v < positions.size(); ++v) {
+		GLfloat* pVertex = &vertices[v * k_vertexFloats];
+		pVertex[0] = positions[v].x();
+		pVertex[1] = positions[v].y();
+		pVertex[2] = positions[v].z();
+		pVertex[3] = v < distances.size() ? distances[v] : 0.f;
+	}
+
+	if (!surface.m_vao.isCreated()) {
+		surface.m_vertices.create();
+		surface.m_indices.create();
+		surface.m_vao.create();
+		surface.m_vao.bind();
+		surface.m_vertices.bind();
+		surface.m_indices.bind();
+		QOpenGLExtraFunctions* f = Functions();
+		const GLsizei stride = GLsizei(k_vertexFloats * sizeof(GLfloat));
+		f->glVertexAttribPointer(k_posAttr, 3, GL_FLOAT, GL_FALSE, stride, nullptr);
+		f->glVertexAttribPointer(k_distanceAttr, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<const void*>(3 * sizeof(GLfloat)));
+		f->glEnableVertexAttribArray(k_posAttr);
+		f->glEnableVertexAttribArray(k_distanceAttr);
+		surface.m_vao.release();
+		surface.m_vertices.release();
+		surface.m_indices.release();
+	}
+	surface.m_vertices.bind();
+	surface.m_vertices.allocate(vertices.data(), int(vertices.size() * sizeof(GLfloat)));
+	surface.m_vertices.release();
+
+	// The vertex array object holds the index buffer binding, so it is bound around the upload
+	surface.m_vao.bind();
+	surface.m_indices.bind();
+	surface.m_indices.allocate(indices.data(), int(indices.size() * sizeof(GLuint)));
+	surface.m_vao.release();
+	surface.m_indexCount = int(indices.size());
+	surface.m_bytes = qint64(vertices.size() * sizeof(GLfloat) + indices.size() * sizeof(GLuint));
+}
+
+void ModelComparison::Clear()
+{
+	for (Surface& surface : m_surfaces) {
+		if (QOpenGLContext::currentContext()) {
+			surface.m_vao.destroy();
+			surface.m_vertices.destroy();
+			surface.m_indices.destroy();
+		}
+		surface.m_indexCount = 0;
+		surface.m_bytes = 0;
+	}
+	m_maxDistance = 0.f;
+	m_extent = 0.f;
+}
+
+bool ModelComparison::HasModels() const
+{
+	return m_surfaces[0].m_indexCount > 0 || m_surfaces[1].m_indexCount > 0;
+}
+
+int ModelComparison::Draw(int mode, GLuint framebuffer, const QSize& nativeSize, const QMatrix4x4& projection, const QMatrix4x4& modelView)
+{
+	if (!IsCreated() || !HasModels() || mode == k_compareOff) {
+		return 0;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	state.Enable(GL_DEPTH_TEST);
+	int drawCalls = 0;
+
+	if (mode != k_compareDifference) {
+		// Each model gets half of the window, seen through the middle of the projection at
+		// the same size as in the single view
+		const int output = mode == k_compareHeatmap ? 1 : 0;
+		for (int i = 0; i < 2; ++i) {
+			const QRect cell = SplitView::Cell(nativeSize, 2, i);
+			QMatrix4x4 crop;
+			crop.scale(float(nativeSize.width()) / float(std::max(1, cell.width())), 1.f, 1.f);
+			state.Viewport(cell.x(), nativeSize.height() - cell.y() - cell.height(), cell.width(), cell.height());
+			DrawSurface(m_surfaces[i], output, crop * projection, modelView);
+			++drawCalls;
+		}
+		state.Viewport(0, 0, nativeSize.width(), nativeSize.height());
+		return drawCalls;
+	}
+
+	// Half float depths would show the rounding of far surfaces as differences
+	if (nativeSize != m_targetSize) {
+		delete m_pTargets[0];
+		delete m_pTargets[1];
+		QOpenGLFramebufferObjectFormat format;
+		format.setAttachment(QOpenGLFramebufferObject::Depth);
+		format.setInternalTextureFormat(GL_RGBA32F);
+		m_pTargets[0] = new QOpenGLFramebufferObject(nativeSize, format);
+		m_pTargets[1] = new QOpenGLFramebufferObject(nativeSize, format);
+		m_targetSize = nativeSize;
+	}
+	const GLfloat background[] = { 0.f, 0.f, 0.f, 0.f };
+	const GLfloat farthest = 1.f;
+	state.Viewport(0, 0, nativeSize.width(), nativeSize.height());
+	for (int i = 0; i < 2; ++i) {
+		m_pTargets[i]->bind();
+		f->glClearBufferfv(GL_COLOR, 0, background);
+		f->glClearBufferfv(GL_DEPTH, 0, &farthest);
+		DrawSurface(m_surfaces[i], 2, projection, modelView);
+		++drawCalls;
+	}
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	state.Disable(GL_DEPTH_TEST);
+	m_pDifferenceProgram->bind();
+	const float scale = modelView.column(0).toVector3D().length();
+	m_pDifferenceProgram->setUniformValue("uDepthTolerance", std::max(k_depthTolerance * m_extent * scale, 1e-6f));
+	f->glActiveTexture(GL_TEXTURE1);
+	f->glBindTexture(GL_TEXTURE_2D, m_pTargets[1]->texture());
+	f->glActiveTexture(GL_TEXTURE0);
+	f->glBindTexture(GL_TEXTURE_2D, m_pTargets[0]->texture());
+	m_vao.bind();
+	f->glDrawArrays(GL_TRIANGLES, 0, 3);
+	m_vao.release();
+	m_pDifferenceProgram->release();
+	++drawCalls;
+
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+	f->glActiveTexture(GL_TEXTURE1);
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+	f->glActiveTexture(GL_TEXTURE0);
+	state.Enable(GL_DEPTH_TEST);
+	return drawCalls;
+}
+
+void ModelComparison::DrawSurface(Surface& surface, int output, const QMatrix4x4& projection, const QMatrix4x4& modelView)
+{
+	if (surface.m_indexCount == 0) {
+		return;
+	}
+	m_pSurfaceProgram->bind();
+	m_pSurfaceProgram->setUniformValue("uModelView", modelView);
+	m_pSurfaceProgram->setUniformValue("uProjection", projection);
+	m_pSurfaceProgram->setUniformValue("uMaxDistance", m_maxDistance);
+	m_pSurfaceProgram->setUniformValue("uOutput", output);
+	surface.m_vao.bind();
+	Functions()->glDrawElements(GL_TRIANGLES, surface.m_indexCount, GL_UNSIGNED_INT, nullptr);
+	surface.m_vao.release();
+	m_pSurfaceProgram->release();
+}
+
+qint64 ModelComparison::Bytes() const
+{
+	qint64 bytes = m_pTargets[0] ? k_targetBytesPerPixel * m_targetSize.width() * m_targetSize.height() : 0;
+	for (const Surface& surface : m_surfaces) {
+		bytes += surface.m_bytes;
+	}
+	return bytes;
+}
+
+QVector3D ModelComparison::HeatColor(float distance)
+{
+	const float t = std::min(std::max(distance, 0.f), 1.f);
+	if (t < 0.5f) {
+		return QVector3D(0.f, t * 2.f, 1.f - t * 2.f);
+	}
+	return QVector3D(t * 2.f - 1.f, 2.f - t * 2.f, 0.f);
+}
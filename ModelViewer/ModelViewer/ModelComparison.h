@@ -0,0 +1,82 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QSize>
+#include <QVector3D>
+#include <qopengl.h>
+
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+struct SurfaceComparison;
+
+// How the two models of a comparison are shown, see ViewerGraphicsWindow::setCompareMode
+enum CompareMode : int {
+	k_compareOff = 0,
+	k_compareSideBySide = 1, // The original on the left, the compared model on the right
+	k_compareHeatmap = 2, // Side by side, each colored by how far its vertices are from the other
+	k_compareDifference = 3, // Where the depth and normals of the two differ, in one view
+};
+
+// Shows an original model and a simplified version of it, such as a level of detail, the same
+// way and from the same camera. The surfaces of a SurfaceComparison are uploaded as they are,
+// positions in model space and the distance of each vertex to the other model, and shaded with
+// face normals from the screen space derivatives, so both look alike whatever their normals.
+// The difference view draws the eye space normal and linear depth of each model into a float
+// target of its own, and a full-screen pass colors each pixel by how far the two are apart.
+class ModelComparison
+{
+public:
+	~ModelComparison();
+
+	// Creating and destroying the programs and buffers requires a current context. Create
+	// returns false without desktop OpenGL 3.3 or if the programs don't link.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Uploads the surfaces of comparison, replacing the ones shown so far. The heatmap runs
+	// from no distance to the comparison's Hausdorff distance.
+	void Upload(const SurfaceComparison& comparison);
+	void Clear();
+	bool HasModels() const;
+
+	// Draws the models in mode into framebuffer, whose size is nativeSize, through projection
+	// and modelView as the single view would draw them. Leaves framebuffer bound with the full
+	// viewport and depth testing on. Returns the draw calls made.
+	int Draw(int mode, GLuint framebuffer, const QSize& nativeSize, const QMatrix4x4& projection, const QMatrix4x4& modelView);
+
+	// GPU memory taken by the buffers and targets
+	qint64 Bytes() const;
+
+	// Colors of the heatmap, from blue at no distance over green to red at the largest.
+	// distance is divided by the largest first.
+	static QVector3D HeatColor(float distance);
+
+private:
+	// A surface uploaded with its distances, drawn with one indexed draw
+	struct Surface {
+		QOpenGLBuffer m_vertices = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+		QOpenGLBuffer m_indices = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
+		QOpenGLVertexArrayObject m_vao;
+		int m_indexCount = 0;
+		qint64 m_bytes = 0;
+	};
+	void UploadSurface(Surface& surface, const std::vector<QVector3D>& positions, const std::vector<float>& distances, const std::vector<GLuint>& indices);
+	void DrawSurface(Surface& surface, int output, const QMatrix4x4& projection, const QMatrix4x4& modelView);
+
+	Surface m_surfaces[2];
+	float m_maxDistance = 0.f;
+	// Length of the diagonal of the original model's box, which depth differences are measured against
+	float m_extent = 0.f;
+	QOpenGLShaderProgram* m_pSurfaceProgram = nullptr;
+	QOpenGLShaderProgram* m_pDifferenceProgram = nullptr;
+	QOpenGLBuffer m_triangle;
+	QOpenGLVertexArrayObject m_vao;
+
+	// The normals and depth of each model, for the difference view
+	QOpenGLFramebufferObject* m_pTargets[2] = {};
+	QSize m_targetSize;
+};
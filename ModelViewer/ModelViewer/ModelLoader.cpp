@@ -1,61 +1,611 @@
 #include "ModelLoader.h"
+#include "Animation.h"
+#include "GltfLoader.h"
+#include "GpuModelBuilder.h"
+#include "ImportIOSystem.h"
+#include "ImportTrace.h"
+#include "TextModelLoader.h"
+#include "Meshlets.h"
+#include "NormalGenerator.h"
+#include "PageFile.h"
+#include "PointCloudLoader.h"
+#include "SceneGraph.h"
+#include "ScratchArena.h"
+#include "VertexCacheOptimizer.h"
 
 #include <assimp/Importer.hpp>      // C++ importer interface
 #include <assimp/scene.h>           // Output data structure
 #include <assimp/postprocess.h>     // Post processing flags
+#include <assimp/pbrmaterial.h>     // glTF material keys
 #include <assimp/Exporter.hpp>      // C++ exporter interface
+#include <assimp/ProgressHandler.hpp>
 
 #include <vector>
+#include <map>
+#include <tuple>
+#include <numeric>
+#include <memory>
+#include <cmath>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <array>
+#include <iterator>
+#include <limits>
+#include <cfloat>
 #include <QMatrix4x4>
+#include <QBuffer>
 #include <QImage>
+#include <QImageReader>
 #include <QFileDialog>
 #include <QFileInfo>
 #include <QDir>
+#include <QFloat16>
+#include <QHash>
+#include <QElapsedTimer>
+#include <QtConcurrent/QtConcurrent>
 
 namespace {
-	// Static importer and scene
-	Assimp::Importer* pImporter = nullptr;
+	// Static importer and scene, shared with exports still writing a previous scene
+	std::shared_ptr<Assimp::Importer> pImporter;
 	const aiScene* pCurrentScene = nullptr;
 	QString lastImportedPath;
+
+	// Set when lastImportedPath was loaded from the cache and has not been imported yet
+	bool sceneDeferred = false;
+
+	// Steps drawing can't do without: triangles only, and AABBs for framing the view. Every
+	// profile also generates normals, flat or smooth.
+	const unsigned int k_requiredImportSteps = aiProcess_Triangulate | aiProcess_SortByPType | aiProcess_GenBoundingBoxes;
+
+	// Every post-processing step an import profile may use, in the order Assimp runs them.
+	// Running them one by one in this order is what ReadFile does with all flags at once.
+	const ModelLoader::ImportStep k_importSteps[] = {
+		{ aiProcess_ValidateDataStructure, "Validate" },
+		{ aiProcess_RemoveRedundantMaterials, "Remove redundant materials" },
+		{ aiProcess_FindInstances, "Find instances" },
+		{ aiProcess_OptimizeGraph, "Optimize graph" },
+		{ aiProcess_OptimizeMeshes, "Optimize meshes" },
+		{ aiProcess_FindDegenerates, "Find degenerates" },
+		{ aiProcess_GenUVCoords, "Generate UVs" },
+		{ aiProcess_Triangulate, "Triangulate" },
+		{ aiProcess_SortByPType, "Sort by primitive type" },
+		{ aiProcess_FindInvalidData, "Find invalid data" },
+		{ aiProcess_FixInfacingNormals, "Fix infacing normals" },
+		{ aiProcess_SplitLargeMeshes, "Split large meshes" },
+		{ aiProcess_GenNormals, "Generate normals" },
+		{ aiProcess_GenSmoothNormals, "Generate smooth normals" },
+		{ aiProcess_CalcTangentSpace, "Calculate tangents" },
+		{ aiProcess_JoinIdenticalVertices, "Join identical vertices" },
+		{ aiProcess_LimitBoneWeights, "Limit bone weights" },
+		{ aiProcess_ImproveCacheLocality, "Improve cache locality" },
+		{ aiProcess_GenBoundingBoxes, "Generate bounding boxes" },
+	};
+
+	// Runs the steps NormalGenerator replaces on the importer's scene, which the importer
+	// keeps modifiable for its own steps. False for the other steps, and for scenes
+	// NormalGenerator leaves to Assimp.
+	bool ApplyNativeStep(Assimp::Importer* pImporter, unsigned int step) {
+		aiScene* pScene = const_cast<aiScene*>(pImporter->GetScene());
+		switch (step) {
+		case aiProcess_GenNormals:
+			return NormalGenerator::GenerateNormals(pScene, false);
+		case aiProcess_GenSmoothNormals:
+			return NormalGenerator::GenerateNormals(pScene, true);
+		case aiProcess_JoinIdenticalVertices:
+			return NormalGenerator::JoinIdenticalVertices(pScene);
+		default:
+			return false;
+		}
+	}
+
+	// Preview proxies keep about one in this many triangles of a mesh, with at most this many
+	// grid cells along the longest axis of its AABB
+	const float k_proxyReduction = 16.f;
+	const int k_proxyMaxCells = 512;
+
+	// Share of the triangles kept by each level of detail. Meshes with fewer triangles than
+	// k_lodMinTriangles are always drawn in full.
+	const float k_lodRatios[] = { 0.5f, 0.25f, 0.1f };
+	const uint k_lodMinTriangles = 1024;
+
+	// Levels are simplified again with a finer or coarser grid until they are within
+	// k_lodTolerance of their share, and dropped if they don't remove at least a fifth of the
+	// triangles of the finer level
+	const int k_lodAttempts = 4;
+	const float k_lodTolerance = 0.2f;
+	const float k_lodMinReduction = 0.8f;
+	const int k_lodMaxCells = 1 << 20;
+
+	// Helpers for quantizing vertex attributes, values are clamped to the representable range
+	quint16 QuantizeUnorm16(float val) {
+		return quint16(qBound(0.f, val, 1.f) * 65535.f + 0.5f);
+	}
+
+	quint8 QuantizeUnorm8(float val) {
+		return quint8(qBound(0.f, val, 1.f) * 255.f + 0.5f);
+	}
+
+	// Packs a normal into GL_INT_2_10_10_10_REV, x in the lowest bits and w left at 0
+	quint32 PackSnorm10(const aiVector3D& n) {
+		auto Pack = [](float val) {
+			return quint32(qRound(qBound(-1.f, val, 1.f) * 511.f)) & 0x3FF;
+		};
+		return Pack(n.x) | (Pack(n.y) << 10) | (Pack(n.z) << 20);
+	}
+
+	QMatrix4x4 ToMatrix(const aiMatrix4x4& t) {
+		return QMatrix4x4(t.a1, t.a2, t.a3, t.a4, t.b1, t.b2, t.b3, t.b4, t.c1, t.c2, t.c3, t.c4, t.d1, t.d2, t.d3, t.d4);
+	}
+
+	// Node transforms are multiplied in double precision, so a translation far from the origin
+	// keeps the detail of what it moves until the origin is taken off
+	typedef aiMatrix4x4t<double> DoubleMatrix;
+	typedef aiVector3t<double> DoubleVector;
+
+	DoubleMatrix ToDouble(const aiMatrix4x4& t) {
+		return DoubleMatrix(t.a1, t.a2, t.a3, t.a4, t.b1, t.b2, t.b3, t.b4, t.c1, t.c2, t.c3, t.c4, t.d1, t.d2, t.d3, t.d4);
+	}
+
+	// The transform followed by a move by minus origin, which is only rounded to float once
+	// the two large translations have cancelled
+	QMatrix4x4 ToMatrix(const DoubleMatrix& t, const std::array<double, 3>& origin) {
+		auto Row = [&t](int row, double shift) {
+			return QVector4D(float(t[row][0] - shift * t.d1), float(t[row][1] - shift * t.d2), float(t[row][2] - shift * t.d3), float(t[row][3] - shift * t.d4));
+		};
+		QMatrix4x4 matrix;
+		matrix.setRow(0, Row(0, origin[0]));
+		matrix.setRow(1, Row(1, origin[1]));
+		matrix.setRow(2, Row(2, origin[2]));
+		matrix.setRow(3, QVector4D(float(t.d1), float(t.d2), float(t.d3), float(t.d4)));
+		return matrix;
+	}
+
+	QVector3D Rebased(const DoubleVector& point, const std::array<double, 3>& origin) {
+		return QVector3D(float(point.x - origin[0]), float(point.y - origin[1]), float(point.z - origin[2]));
+	}
+
+	// The bounds of a mesh's vertices, from the AABB post-processing adds when it did
+	void MeshBounds(aiMesh const* pMesh, QVector3D& min, QVector3D& max) {
+		const aiAABB& box = pMesh->mAABB;
+		if (box.mMin != box.mMax || pMesh->mNumVertices == 0) {
+			min = QVector3D(box.mMin.x, box.mMin.y, box.mMin.z);
+			max = QVector3D(box.mMax.x, box.mMax.y, box.mMax.z);
+			return;
+		}
+		min = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+		max = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		BoundsMath::AddPoints(&pMesh->mVertices[0].x, pMesh->mNumVertices, 3, min, max);
+	}
+
+	// Whether a box is further from the origin than k_rebaseRatio times its radius
+	bool FarFromOrigin(const QVector3D& min, const QVector3D& max) {
+		const double radius = 0.5 * double((max - min).length());
+		const double distance = 0.5 * double((max + min).length());
+		return distance > ModelLoader::k_rebaseRatio * radius;
+	}
+
+	// Animations that don't say how long a tick is are played at this rate
+	const double k_defaultTicksPerSecond = 25.0;
+
+	// Meshes moved by bones or blend shapes. Both are posed through the skeleton.
+	bool IsAnimated(aiMesh const* pMesh) {
+		return pMesh->HasBones() || pMesh->mNumAnimMeshes > 0;
+	}
+
+	// Skinned meshes are bounded by where their bones put them at rest, which need not be
+	// where their vertices are
+	void BoundAtRest(ModelData& model) {
+		if (!model.m_skeleton) {
+			return;
+		}
+		AnimationPlayer rest;
+		rest.SetSkeleton(model.m_skeleton);
+		std::vector<QMatrix4x4> palette;
+		for (MeshData& mesh : model.m_meshes) {
+			if (mesh.m_hasBones) {
+				rest.BonePalette(mesh.m_bones, palette);
+				AnimationPlayer::SkinnedBounds(mesh.m_bones, palette, mesh.m_AABBMin, mesh.m_AABBMax);
+			}
+		}
+	}
+
+	// Copies the name, colors and factors of a material
+	void ReadMaterial(aiMaterial const* pMaterial, MaterialData& material) {
+		aiString name;
+		if (pMaterial->Get(AI_MATKEY_NAME, name) == AI_SUCCESS) {
+			material.m_name = QString::fromUtf8(name.C_Str());
+		}
+
+		auto AssignColor = [](GLfloat* vec, aiColor3D col) {
+			vec[0] = col.r;
+			vec[1] = col.g;
+			vec[2] = col.b;
+			vec[3] = 1.f; // No alpha
+		};
+
+		MaterialProperties& properties = material.m_properties;
+		aiColor3D color;
+		float val = 0.f;
+		pMaterial->Get(AI_MATKEY_COLOR_AMBIENT, color);
+		AssignColor(properties.m_ambient, color);
+		pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, color);
+		AssignColor(properties.m_diffuse, color);
+		pMaterial->Get(AI_MATKEY_COLOR_SPECULAR, color);
+		AssignColor(properties.m_specular, color);
+		pMaterial->Get(AI_MATKEY_SHININESS, val);
+		properties.m_shininess = val;
+		aiColor3D emissive;
+		if (pMaterial->Get(AI_MATKEY_COLOR_EMISSIVE, emissive) == AI_SUCCESS) {
+			properties.m_emissive = QVector3D(emissive.r, emissive.g, emissive.b);
+		}
+
+		// glTF says how to apply the alpha, other formats only have an opacity, which makes the
+		// material see-through when it is below 1. Exporters writing 0 for opaque materials are
+		// common enough that a material nobody could see is taken as one of those.
+		aiString alphaMode;
+		if (pMaterial->Get(AI_MATKEY_GLTF_ALPHAMODE, alphaMode) == AI_SUCCESS) {
+			if (strcmp(alphaMode.C_Str(), "MASK") == 0) {
+				properties.m_alphaMode = k_alphaMask;
+			}
+			else if (strcmp(alphaMode.C_Str(), "BLEND") == 0) {
+				properties.m_alphaMode = k_alphaBlend;
+			}
+			if (pMaterial->Get(AI_MATKEY_GLTF_ALPHACUTOFF, val) == AI_SUCCESS) {
+				properties.m_alphaCutoff = val;
+			}
+		}
+		else if (pMaterial->Get(AI_MATKEY_OPACITY, val) == AI_SUCCESS && val > 0.f && val < 1.f) {
+			properties.m_alphaMode = k_alphaBlend;
+			properties.m_baseColor.setW(val);
+		}
+
+		// glTF keeps its metallic-roughness factors under keys of its own. Materials using the
+		// specular-glossiness extension are left to the phong colors.
+		int specularGlossiness = 0;
+		if (pMaterial->Get(AI_MATKEY_GLTF_PBRSPECULARGLOSSINESS, specularGlossiness) == AI_SUCCESS && specularGlossiness) {
+			return;
+		}
+		aiColor4D baseColor;
+		if (pMaterial->Get(AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_BASE_COLOR_FACTOR, baseColor) == AI_SUCCESS) {
+			properties.m_metallicRoughness = true;
+			properties.m_baseColor = QVector4D(baseColor.r, baseColor.g, baseColor.b, baseColor.a);
+		}
+		if (pMaterial->Get(AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_METALLIC_FACTOR, val) == AI_SUCCESS) {
+			properties.m_metallicRoughness = true;
+			properties.m_metallic = qBound(0.f, val, 1.f);
+		}
+		if (pMaterial->Get(AI_MATKEY_GLTF_PBRMETALLICROUGHNESS_ROUGHNESS_FACTOR, val) == AI_SUCCESS) {
+			properties.m_metallicRoughness = true;
+			properties.m_roughness = qBound(0.f, val, 1.f);
+		}
+	}
+
+	// Assigns every vertex to its cell of a grid over the AABB with the given number of cells along
+	// the longest axis. Cells are numbered in the order their first vertex appears.
+	std::vector<quint32> ClusterVertices(const aiVector3D* pPositions, uint vertexCount, const aiVector3D& min, const aiVector3D& max, int cells, size_t& clusterCount) {
+		const aiVector3D extent = max - min;
+		const float longest = std::max(extent.x, std::max(extent.y, extent.z));
+		const float cellSize = longest > 0.f ? longest / float(cells) : 1.f;
+		auto Cell = [=](float val, float lo) {
+			return quint64(qBound(0, int((val - lo) / cellSize), cells));
+		};
+
+		std::vector<quint32> clusters(vertexCount);
+		std::unordered_map<quint64, quint32> clusterIndices;
+		for (uint v = 0; v < vertexCount; ++v) {
+			const aiVector3D& p = pPositions[v];
+			const quint64 key = Cell(p.x, min.x) | (Cell(p.y, min.y) << 21) | (Cell(p.z, min.z) << 42);
+			clusters[v] = clusterIndices.emplace(key, quint32(clusterIndices.size())).first->second;
+		}
+		clusterCount = clusterIndices.size();
+		return clusters;
+	}
+
+	// Applies remap to the vertices of a triangle list. Triangles that collapse to a line or a
+	// point are dropped, as are repeats of a triangle that is already there.
+	std::vector<quint32> CollapseTriangles(const std::vector<quint32>& triangles, const std::vector<quint32>& remap) {
+		struct TriangleHash {
+			size_t operator()(const std::array<quint32, 3>& t) const {
+				return size_t((quint64(t[0]) * 73856093u) ^ (quint64(t[1]) * 19349663u) ^ (quint64(t[2]) * 83492791u));
+			}
+		};
+		std::unordered_set<std::array<quint32, 3>, TriangleHash> seen;
+		std::vector<quint32> ret;
+		for (size_t i = 0; i + 2 < triangles.size(); i += 3) {
+			const quint32 a = remap[triangles[i]];
+			const quint32 b = remap[triangles[i + 1]];
+			const quint32 c = remap[triangles[i + 2]];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			std::array<quint32, 3> sorted = { a, b, c };
+			std::sort(sorted.begin(), sorted.end());
+			if (!seen.insert(sorted).second) {
+				continue;
+			}
+			ret.push_back(a);
+			ret.push_back(b);
+			ret.push_back(c);
+		}
+		return ret;
+	}
+
+	// Index lists of coarser versions of a triangle mesh with about k_lodRatios of its triangles.
+	// The vertices in each cell of a grid are merged into the one closest to their average, so
+	// every level reuses the vertices of the mesh.
+	std::vector<std::vector<quint32>> SimplifyTriangles(const aiVector3D* pPositions, uint vertexCount, const aiVector3D& min, const aiVector3D& max, const std::vector<quint32>& triangles) {
+		std::vector<std::vector<quint32>> levels;
+		size_t previous = triangles.size();
+		for (float ratio : k_lodRatios) {
+			// Same estimate as the preview proxy, a surface keeps roughly 6 n^2 triangles
+			const float target = ratio * float(triangles.size() / 3);
+			float cells = std::sqrt(target / 6.f);
+			std::vector<quint32> best;
+			for (int attempt = 0; attempt < k_lodAttempts; ++attempt) {
+				const int n = qBound(1, int(cells + 0.5f), k_lodMaxCells);
+				size_t clusterCount = 0;
+				const std::vector<quint32> clusters = ClusterVertices(pPositions, vertexCount, min, max, n, clusterCount);
+
+				std::vector<aiVector3D> centers(clusterCount, aiVector3D(0.f, 0.f, 0.f));
+				std::vector<uint> sizes(clusterCount, 0);
+				for (uint v = 0; v < vertexCount; ++v) {
+					centers[clusters[v]] += pPositions[v];
+					sizes[clusters[v]] += 1;
+				}
+				std::vector<quint32> representatives(clusterCount, 0);
+				std::vector<float> distances(clusterCount, FLT_MAX);
+				for (uint v = 0; v < vertexCount; ++v) {
+					const quint32 c = clusters[v];
+					const float distance = (pPositions[v] - centers[c] / float(sizes[c])).SquareLength();
+					if (distance < distances[c]) {
+						distances[c] = distance;
+						representatives[c] = v;
+					}
+				}
+				std::vector<quint32> remap(vertexCount);
+				for (uint v = 0; v < vertexCount; ++v) {
+					remap[v] = representatives[clusters[v]];
+				}
+
+				std::vector<quint32> level = CollapseTriangles(triangles, remap);
+				const float count = float(level.size() / 3);
+				if (best.empty() || std::abs(count - target) < std::abs(float(best.size() / 3) - target)) {
+					best = std::move(level);
+				}
+				if (std::abs(count - target) <= k_lodTolerance * target) {
+					break;
+				}
+				cells *= std::sqrt(target / std::max(count, 1.f));
+			}
+
+			if (best.empty() || float(best.size()) > k_lodMinReduction * float(previous)) {
+				continue;
+			}
+			previous = best.size();
+			levels.push_back(std::move(best));
+		}
+		return levels;
+	}
 }
 
 
-Model ModelLoader::LoadModel(const QString& file)
+Model ModelLoader::LoadModel(const QString& file, const LoadOptions& options)
 {
-	// Create a new instance of the Importer class
-	if (pImporter) {
-		delete pImporter;
-	}
-	pImporter = new Assimp::Importer();
-	
-	// And have it read the given file with some example postprocessing
-	// Usually - if speed is not the most important aspect for you - you'll
-	// probably to request more postprocessing than we do in this example.
-	pCurrentScene = pImporter->ReadFile(file.toStdString(), aiProcessPreset_TargetRealtime_Quality ^ aiProcess_GenSmoothNormals | aiProcess_GenNormals | aiProcess_GenBoundingBoxes);
-	
+	// Import the file and keep the importer around so the scene can be exported
+	SetCurrentScene(ImportScene(file, nullptr, ImportFlags(options)), file);
+
 	// If the import failed, report it
 	if (!pCurrentScene) {
 		return Model();
 	}
 
+	// We're done. Everything will be cleaned up by the importer destructor
+	TextureCache textures;
+	return GpuModelBuilder::BuildModel(DecodeModel(pCurrentScene, file, options), textures);
+}
+
+ModelData ModelLoader::DecodeFile(const QString& file, const LoadOptions& options)
+{
+	// glTF files are read without Assimp unless they use what only its importer handles
+	if (options.m_nativeGltf && GltfLoader::IsGltfFile(file)) {
+		GltfLoader gltf;
+		if (gltf.Read(file)) {
+			return DecodeModel(gltf.Scene(), file, options);
+		}
+	}
+	if (PointCloudLoader::Handles(file)) {
+		PointCloudLoader cloud;
+		if (cloud.Read(file)) {
+			return cloud.TakeModel();
+		}
+	}
+	if (TextModelLoader::Handles(file, options)) {
+		TextModelLoader text;
+		if (text.Read(file)) {
+			return DecodeModel(text.Scene(), file, options);
+		}
+	}
+
+	// Use a separate importer so the current scene is left alone
+	Assimp::Importer* pFileImporter = ImportScene(file, nullptr, ImportFlags(options));
+	ModelData ret = DecodeModel(pFileImporter->GetScene(), file, options);
+	delete pFileImporter;
+	return ret;
+}
+
+ModelData ModelLoader::DecodeProxyFile(const QString& file)
+{
+	Assimp::Importer* pFileImporter = ReadScene(file);
+	ModelData ret = DecodeProxy(pFileImporter->GetScene());
+	delete pFileImporter;
+	return ret;
+}
+
+Assimp::Importer* ModelLoader::ImportScene(const QString& file, Assimp::ProgressHandler* pProgress, unsigned int flags, std::vector<ImportStepTime>* pTimings, ImportTrace* pTrace)
+{
+	Assimp::Importer* pNewImporter = ReadScene(file, pProgress, pTimings, pTrace);
+	PostProcessScene(pNewImporter, flags, pProgress, pTimings, pTrace);
+	return pNewImporter;
+}
+
+Assimp::Importer* ModelLoader::ReadScene(const QString& file, Assimp::ProgressHandler* pProgress, std::vector<ImportStepTime>* pTimings, ImportTrace* pTrace)
+{
+	// Create a new instance of the Importer class. Each import gets its own importer so
+	// a load on a worker thread never touches the scene currently being viewed.
+	Assimp::Importer* pNewImporter = new Assimp::Importer();
+	if (pProgress) {
+		pNewImporter->SetProgressHandler(pProgress);
+	}
+
+	// Files are read whole, mapped or in large blocks, rather than in the many small reads of
+	// Assimp's default IO system. The importer owns the IO system, the files it read are
+	// freed right after so they don't stay in memory with a kept scene.
+	ImportIOSystem* pIOSystem = new ImportIOSystem();
+	pNewImporter->SetIOHandler(pIOSystem);
+
+	// Read the file without post-processing, the steps are applied by PostProcessScene
+	QElapsedTimer timer;
+	timer.start();
+	{
+		ImportTrace::Scope read(pTrace, "Read", ImportTrace::k_stage, pTrace ? QFileInfo(file).fileName() : QString());
+		pNewImporter->ReadFile(file.toUtf8().constData(), 0);
+		pIOSystem->Release();
+	}
+	if (pTimings) {
+		pTimings->push_back({ "Read", float(timer.nsecsElapsed()) * 1e-9f });
+	}
+
+	// Detach the handler again. Assimp hands it back to the caller rather than deleting it,
+	// and it must never be called once whoever supplied it has gone away.
+	if (pProgress) {
+		pNewImporter->SetProgressHandler(nullptr);
+	}
+
+	return pNewImporter;
+}
+
+void ModelLoader::PostProcessScene(Assimp::Importer* pImporter, unsigned int flags, Assimp::ProgressHandler* pProgress, std::vector<ImportStepTime>* pTimings, ImportTrace* pTrace)
+{
+	if (pProgress) {
+		pImporter->SetProgressHandler(pProgress);
+	}
+
+	// Apply the steps one at a time so each one can be timed. Some are costly on large
+	// meshes, the import profiles pick which run.
+	QElapsedTimer timer;
+	for (const ImportStep& step : k_importSteps) {
+		if (!(flags & step.m_flag) || !pImporter->GetScene()) {
+			continue;
+		}
+		if (pProgress && !pProgress->Update()) {
+			break;
+		}
+		timer.start();
+		{
+			ImportTrace::Scope scope(pTrace, step.m_name, ImportTrace::k_stage);
+			if (!ApplyNativeStep(pImporter, step.m_flag)) {
+				pImporter->ApplyPostProcessing(step.m_flag);
+			}
+		}
+		if (pTimings) {
+			pTimings->push_back({ step.m_name, float(timer.nsecsElapsed()) * 1e-9f });
+		}
+	}
+
+	if (pProgress) {
+		pImporter->SetProgressHandler(nullptr);
+	}
+}
+
+void ModelLoader::SetCurrentScene(Assimp::Importer* pNewImporter, const QString& file)
+{
+	// Replace the previous importer. This frees the previous scene.
+	if (pNewImporter != pImporter.get()) {
+		pImporter.reset(pNewImporter);
+	}
+	pCurrentScene = pImporter ? pImporter->GetScene() : nullptr;
+	sceneDeferred = false;
+
 	// Store the path for later use
+	if (pCurrentScene) {
+		lastImportedPath = file;
+	}
+}
+
+void ModelLoader::SetCurrentFile(const QString& file)
+{
+	SetCurrentScene(nullptr, file);
 	lastImportedPath = file;
+	sceneDeferred = true;
+}
 
-	// We're done. Everything will be cleaned up by the importer destructor
-	return ProcessModel(pCurrentScene);
+unsigned int ModelLoader::ImportFlags(const LoadOptions& options)
+{
+	// Flat normals are only generated where smooth ones were not asked for
+	switch (options.m_importProfile) {
+	case ImportProfile::FastPreview:
+		return k_requiredImportSteps | aiProcess_GenNormals;
+	case ImportProfile::Balanced:
+		return k_requiredImportSteps | aiProcess_GenNormals | aiProcess_JoinIdenticalVertices | aiProcess_RemoveRedundantMaterials
+			| aiProcess_GenUVCoords | aiProcess_FindDegenerates | aiProcess_FindInvalidData | aiProcess_LimitBoneWeights;
+	case ImportProfile::Custom:
+		return k_requiredImportSteps | options.m_customImportSteps
+			| ((options.m_customImportSteps & aiProcess_GenSmoothNormals) ? 0 : aiProcess_GenNormals);
+	case ImportProfile::Quality:
+	default:
+		return aiProcessPreset_TargetRealtime_Quality ^ aiProcess_GenSmoothNormals | aiProcess_GenNormals | aiProcess_GenBoundingBoxes;
+	}
+}
+
+const std::vector<ModelLoader::ImportStep>& ModelLoader::CustomImportSteps()
+{
+	static const std::vector<ImportStep> steps = [] {
+		std::vector<ImportStep> ret;
+		for (const ImportStep& step : k_importSteps) {
+			if (!(step.m_flag & (k_requiredImportSteps | aiProcess_GenNormals))) {
+				ret.push_back(step);
+			}
+		}
+		return ret;
+	}();
+	return steps;
 }
 
 bool ModelLoader::ExportModel(const QString& path)
 {
+	QString filepath;
+	QString formatId;
+	if (!(pCurrentScene || sceneDeferred) || !ChooseExportFile(path, filepath, formatId)) {
+		return false;
+	}
+
+	// Models read from the cache or loaded in low memory mode have no scene. The file is
+	// imported again just for the export and freed afterwards.
+	std::unique_ptr<Assimp::Importer> pExportImporter;
+	const aiScene* pScene = pCurrentScene;
+	if (!pScene && sceneDeferred) {
+		pExportImporter.reset(ImportScene(lastImportedPath));
+		pScene = pExportImporter->GetScene();
+	}
+
 	// Ensure the scene is valid
-	if (!pCurrentScene) {
+	if (!pScene) {
 		return false;
 	}
 
-	// Create an exporter
+	// Export the file
 	Assimp::Exporter exporter;
+	aiReturn ret = exporter.Export(pScene, formatId.toStdString(), filepath.toStdString());
+
+	// Return success
+	return (ret == AI_SUCCESS);
+}
 
+bool ModelLoader::ChooseExportFile(const QString& folder, QString& filepath, QString& formatId)
+{
 	// Determine all available file formats
+	Assimp::Exporter exporter;
 	const size_t formatCount = exporter.GetExportFormatCount();
 	std::vector<const aiExportFormatDesc*> formatDescriptions;
 	for (size_t i = 0; i < formatCount; ++i) {
@@ -79,9 +629,9 @@ bool ModelLoader::ExportModel(const QString& path)
 	}
 
 	// Prompt the user to select a file type
-	QString filepath = QFileDialog::getSaveFileName(nullptr,
+	filepath = QFileDialog::getSaveFileName(nullptr,
 		"Save Model",
-		path + "model",
+		folder + "model",
 		filters, &defaultFilter);
 
 	// Ensure the user selected a path
@@ -93,127 +643,217 @@ bool ModelLoader::ExportModel(const QString& path)
 	// Use QFileInfo to determine which type the user selected
 	QFileInfo fi(filepath);
 	QString ext = fi.suffix();
-	const char* chosenFormatId = nullptr;
+	formatId.clear();
 	for (auto it : formatDescriptions) {
 		if (it->fileExtension == ext) {
-			chosenFormatId = it->id;
+			formatId = it->id;
 		}
 	}
 
 	// Ensure the file type was supported
-	if (!chosenFormatId) {
-		return false;
-	}
-
-
-	// Export the file
-	aiReturn ret = exporter.Export(pCurrentScene, chosenFormatId, filepath.toStdString());
-
-	// Return success
-	return (ret == AI_SUCCESS);
+	return !formatId.isEmpty();
 }
 
-Mesh ModelLoader::ProcessMesh(aiScene const* pScene, uint meshIdx)
+std::shared_ptr<const Assimp::Importer> ModelLoader::CurrentImporter()
 {
-	Mesh newMesh;
+	return pCurrentScene ? pImporter : nullptr;
+}
 
-	// Generate and bind vertex/index buffers
-	newMesh.m_vertexBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
-	if (!newMesh.m_vertexBuffer.create()) {
-		return newMesh;
-	}
-	if (!newMesh.m_vertexBuffer.bind()) {
-		return newMesh;
-	}
-	newMesh.m_indexBuffer = QOpenGLBuffer(QOpenGLBuffer::IndexBuffer);
-	if (!newMesh.m_indexBuffer.create()) {
-		return newMesh;
-	}
-	if (!newMesh.m_indexBuffer.bind()) {
-		return newMesh;
+qint64 ModelLoader::CurrentSceneBytes()
+{
+	if (!pCurrentScene || !pImporter) {
+		return 0;
 	}
+	aiMemoryInfo info;
+	pImporter->GetMemoryRequirements(info);
+	return info.total;
+}
 
-	// Get pointers to the important information from ASSIMP
-	aiMesh const* pMesh = pScene->mMeshes[meshIdx];
-	aiMaterial const* pMaterial = pScene->mMaterials[pMesh->mMaterialIndex];
-
+QString ModelLoader::CurrentFile()
+{
+	return (pCurrentScene || sceneDeferred) ? lastImportedPath : QString();
+}
 
-	auto AssignColor = [](GLfloat* vec, aiColor3D col) {
-		vec[0] = col.r;
-		vec[1] = col.g;
-		vec[2] = col.b;
-		vec[3] = 1.f; // No alpha
+std::vector<TextureReference> ModelLoader::ResolveMaterialMap(aiScene const* pScene, aiMaterial const* pMaterial, MaterialMap map, const ModelLocation& model)
+{
+	// The texture types each map is stored as, most specific first. glTF base colors are
+	// stored as diffuse, its packed metallic-roughness map as unknown and its occlusion as a
+	// light map. Other types, like specular or opacity maps, are never used for these.
+	// aiTextureType_NONE ends the shorter lists.
+	static const aiTextureType mapTypes[k_materialMapCount][3] = {
+		{ aiTextureType_BASE_COLOR, aiTextureType_DIFFUSE, aiTextureType_AMBIENT },
+		{ aiTextureType_NORMAL_CAMERA, aiTextureType_NORMALS, aiTextureType_NONE },
+		{ aiTextureType_UNKNOWN, aiTextureType_METALNESS, aiTextureType_NONE },
+		{ aiTextureType_AMBIENT_OCCLUSION, aiTextureType_LIGHTMAP, aiTextureType_NONE },
+		{ aiTextureType_EMISSION_COLOR, aiTextureType_EMISSIVE, aiTextureType_NONE },
 	};
 
-	// Set up the material for this mesh
-	aiColor3D color;
-	float val;
-	pMaterial->Get(AI_MATKEY_COLOR_AMBIENT, color);
-	AssignColor(newMesh.m_ambient, color);
-	pMaterial->Get(AI_MATKEY_COLOR_DIFFUSE, color);
-	AssignColor(newMesh.m_diffuse, color);
-	pMaterial->Get(AI_MATKEY_COLOR_SPECULAR, color);
-	AssignColor(newMesh.m_specular, color);
-	pMaterial->Get(AI_MATKEY_SHININESS, val);
-	newMesh.m_shininess = val;
-
-
-
-	// Search for an ambient, diffuse, or specular texture.  We will only load the first one we find because our shader
-	// only handles a single texture
-	std::vector<aiTextureType> validTextureTypes = { 
-		aiTextureType_AMBIENT, 
-		aiTextureType_DIFFUSE, 
-		aiTextureType_SPECULAR, 
-		aiTextureType_HEIGHT, 
-		aiTextureType_NORMALS, 
-		aiTextureType_SHININESS,  
-		aiTextureType_OPACITY, 
-		aiTextureType_DISPLACEMENT, 
-		aiTextureType_LIGHTMAP,
-		aiTextureType_REFLECTION,
-		aiTextureType_BASE_COLOR,
-		aiTextureType_NORMAL_CAMERA,
-		aiTextureType_EMISSION_COLOR,
-		aiTextureType_METALNESS,
-		aiTextureType_DIFFUSE_ROUGHNESS,
-		aiTextureType_AMBIENT_OCCLUSION,
-		aiTextureType_UNKNOWN };
-	newMesh.m_hasTexture = false;
-	for (auto it : validTextureTypes)
+	std::vector<TextureReference> ret;
+	for (aiTextureType type : mapTypes[map])
 	{
-		// Only load 1 texture
-		if (newMesh.m_hasTexture) {
+		if (type == aiTextureType_NONE) {
 			break;
 		}
-
 		// Loop through all textures of this type
-		int count = pMaterial->GetTextureCount(it);
+		int count = pMaterial->GetTextureCount(type);
 		for (int i = 0; i < count; ++i) {
 			// Get the filepath
 			aiString path;
-			pMaterial->GetTexture(it, i, &path);
+			pMaterial->GetTexture(type, i, &path);
+
+			// Embedded textures are referenced as "*<index>" or by their file name. They are
+			// keyed by the model they belong to.
+			TextureReference ref;
+			ref.m_pEmbedded = pScene->GetEmbeddedTexture(path.C_Str());
+			if (ref.m_pEmbedded) {
+				ref.m_key = model.m_key + "|" + path.C_Str();
+				ret.push_back(ref);
+				continue;
+			}
+
+			// Search for the file name in the model's folder
+			const QString qPath = QString::fromUtf8(path.C_Str());
+			const QString textureFileName = qPath.mid(std::max(qPath.lastIndexOf('/'), qPath.lastIndexOf('\\')) + 1);
+			ref.m_path = ImportIOSystem::ResolvePath(model.m_folder, textureFileName);
+			if (!ref.m_path.isEmpty()) {
+				ref.m_key = ref.m_path;
+				ret.push_back(ref);
+			}
+		}
+	}
+	return ret;
+}
+
+namespace {
+
+// The most texels a texture is decoded with to be paged, 1 GB of RGBA8888
+const qint64 k_maxPagedPixels = qint64(1) << 28;
+
+// Pages a base color map larger than pagedSize into a page file in folder, unless it is there
+// already, and keeps only its tail. Returns false and leaves texture as it is for files Qt
+// can't read the size of and pages that can't be written, which are then decoded whole.
+bool PageTexture(const uchar* pData, qint64 size, const QByteArray& format, int pagedSize, const QString& folder, TextureData& texture)
+{
+	QByteArray data = QByteArray::fromRawData(reinterpret_cast<const char*>(pData), int(size));
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::ReadOnly);
+	QImageReader reader(&buffer, format);
+	const QSize imageSize = reader.size();
+	if (!imageSize.isValid() || std::max(imageSize.width(), imageSize.height()) <= std::max(pagedSize, int(PageFile::k_tailSize))) {
+		return false;
+	}
+
+	const QString pageFolder = folder.isEmpty() ? PageFile::DefaultFolder() : folder;
+	const QString path = PageFile::PathFor(data, pageFolder);
+	PageFile pages;
+	if (!pages.Open(path)) {
+		// Textures too large for the page tables or for QImage are decoded at the first level
+		// that fits, which readers that scale while decoding, as the JPEG one does, read directly
+		QSize decodeSize = imageSize;
+		while (std::max(decodeSize.width(), decodeSize.height()) > PageFile::k_maxPages * PageFile::k_pageContent
+			|| qint64(decodeSize.width()) * decodeSize.height() > k_maxPagedPixels) {
+			decodeSize = PageFile::LevelSize(decodeSize, 1);
+		}
+		if (decodeSize != imageSize) {
+			reader.setScaledSize(decodeSize);
+		}
+		QImage image = reader.read();
+		if (image.isNull() || !QDir().mkpath(pageFolder) || !PageFile::Write(path, std::move(image).mirrored()) || !pages.Open(path)) {
+			qWarning("Could not page %s into %s", qPrintable(texture.m_key), qPrintable(pageFolder));
+			return false;
+		}
+		PageFile::Trim(pageFolder);
+	}
+
+	const QImage tail = pages.Tail();
+	if (tail.isNull()) {
+		return false;
+	}
+	texture.m_image = tail;
+	texture.m_pageFile = path;
+	texture.m_key += "|pages";
+	return true;
+}
+
+}
 
-			// Use QFileInfo to strip the just the file name
-			QString qPath(path.C_Str());
-			QFileInfo fi(qPath);
-			QString textureFileName = fi.fileName();
+TextureData ModelLoader::DecodeTexture(const TextureReference& ref, int pagedSize, const QString& pageFolder)
+{
+	TextureData ret;
+	ret.m_key = ref.m_key;
 
-			// Search for this file in the current dir
-			fi = QFileInfo(lastImportedPath);
-			QString folderPath = fi.dir().absolutePath();
-			QString texturePath = folderPath + "/" + textureFileName;
+	QImage image;
+	aiTexture const* pTexture = ref.m_pEmbedded;
+	if (!pTexture) {
+		// Read the same way as the model, from disk, its archive or its server
+		const QSharedPointer<const FileContents> pContents = ImportIOSystem::Read(ref.m_path);
+		if (!pContents || pContents->Size() > std::numeric_limits<int>::max()) {
+			return ret;
+		}
 
-			// Load the texture to Qt
-			QImage image(texturePath);
-			if (!image.isNull())
-			{
-				newMesh.m_texture = new QOpenGLTexture(image.mirrored());
-				newMesh.m_hasTexture = true;
-				break;
+		// Block compressed files are uploaded as they are, anything else is decoded by Qt
+		if (IsCompressedTextureFile(ref.m_path)) {
+			ret.m_compressed = ReadCompressedTexture(ref.m_path, QByteArray(reinterpret_cast<const char*>(pContents->Data()), int(pContents->Size())));
+			if (!ret.m_compressed.isNull()) {
+				return ret;
 			}
 		}
+
+		// Textures too large to upload whole are paged, only their tail is kept here
+		const QByteArray format = QFileInfo(ref.m_path).suffix().toLatin1();
+		if (pagedSize > 0 && PageTexture(pContents->Data(), pContents->Size(), format, pagedSize, pageFolder, ret)) {
+			return ret;
+		}
+
+		// The suffix tells the format, or the contents if it's wrong
+		image = QImage::fromData(pContents->Data(), int(pContents->Size()), format.constData());
+		if (image.isNull()) {
+			image = QImage::fromData(pContents->Data(), int(pContents->Size()));
+		}
+	}
+	else if (pTexture->mHeight == 0) {
+		// A compressed file (png, jpg, ...) of mWidth bytes held in memory
+		const uchar* pData = reinterpret_cast<const uchar*>(pTexture->pcData);
+		if (pagedSize > 0 && PageTexture(pData, pTexture->mWidth, QByteArray(), pagedSize, pageFolder, ret)) {
+			return ret;
+		}
+		image = QImage::fromData(pData, int(pTexture->mWidth));
 	}
+	else {
+		// Raw BGRA texels, which is the byte order of QImage::Format_ARGB32 on little endian
+		// machines. Mirroring them copies them out of the scene.
+		const QImage texels(reinterpret_cast<const uchar*>(pTexture->pcData), int(pTexture->mWidth), int(pTexture->mHeight), QImage::Format_ARGB32);
+		ret.m_image = texels.mirrored().convertToFormat(QImage::Format_RGBA8888);
+		return ret;
+	}
+
+	// The decoded image isn't shared, so it is mirrored in place rather than into a copy. The
+	// texels are converted to the upload format here, so uploading them is a plain copy.
+	if (!image.isNull()) {
+		ret.m_image = std::move(image).mirrored().convertToFormat(QImage::Format_RGBA8888);
+	}
+	return ret;
+}
+
+std::vector<MaterialData> ModelLoader::DecodeMaterials(aiScene const* pScene)
+{
+	std::vector<MaterialData> materials(pScene->mNumMaterials);
+	for (uint i = 0; i < pScene->mNumMaterials; ++i) {
+		ReadMaterial(pScene->mMaterials[i], materials[i]);
+	}
+	return materials;
+}
+
+MeshData ModelLoader::DecodeMesh(aiMesh const* pMesh, const QMatrix4x4& transform, const LoadOptions& options, const Skeleton* pSkeleton, int meshNode)
+{
+	// The arrays only needed while decoding come from the thread's scratch arena, which is
+	// rewound when the mesh is done
+	ScratchArena::Scope scratch(ScratchArena::ForThread());
+	MeshData newMesh;
+
+	// Materials are decoded once, the mesh only points to its own
+	newMesh.m_name = QString::fromUtf8(pMesh->mName.C_Str());
+	newMesh.m_material = int(pMesh->mMaterialIndex);
 
 
 	// Determine if we have colors, normals, or texture coordinates
@@ -221,83 +861,356 @@ Mesh ModelLoader::ProcessMesh(aiScene const* pScene, uint meshIdx)
 	newMesh.m_hasUVCoordinates = pMesh->HasTextureCoords(0);
 	newMesh.m_hasColors = pMesh->HasVertexColors(0);
 
-	// Determine the size of a single attribute
-	newMesh.m_numPositionComponents = 3;
-	newMesh.m_numNormalComponents = 3;
-	newMesh.m_numUVComponents = pMesh->mNumUVComponents[0];  // Various
+	// Blend shapes store where they put each vertex, which is kept as an offset from it. Targets
+	// that don't match the mesh move nothing, so the others keep their index.
+	auto MorphOffset = [pMesh](uint target, uint v, bool normal) {
+		aiAnimMesh const* pTarget = pMesh->mAnimMeshes[target];
+		if (pTarget->mNumVertices != pMesh->mNumVertices || (normal ? !pTarget->HasNormals() || !pMesh->mNormals : !pTarget->HasPositions())) {
+			return QVector3D();
+		}
+		const aiVector3D offset = normal ? pTarget->mNormals[v] - pMesh->mNormals[v] : pTarget->mVertices[v] - pMesh->mVertices[v];
+		return QVector3D(offset.x, offset.y, offset.z);
+	};
+
+	// Skinned meshes keep the 4 bones that pull on each vertex the most. Vertices no bone pulls
+	// on get a bone of their own at the mesh's node, which poses them as if it had no bones.
+	// Meshes with only blend shapes are skinned that way too, so they follow their node.
+	ScratchVector<std::array<quint8, 4>> boneIndices;
+	ScratchVector<std::array<float, 4>> boneWeights;
+	if (pSkeleton && IsAnimated(pMesh) && pMesh->mNumBones >= uint(AnimationPlayer::k_maxBones)) {
+		qWarning("Mesh %s has more than %d bones and is shown at rest", pMesh->mName.C_Str(), AnimationPlayer::k_maxBones - 1);
+	}
+	else if (pSkeleton && IsAnimated(pMesh)) {
+		boneIndices.assign(pMesh->mNumVertices, {});
+		boneWeights.assign(pMesh->mNumVertices, {});
+		for (uint b = 0; b < pMesh->mNumBones; ++b) {
+			aiBone const* pBone = pMesh->mBones[b];
+			MeshBone bone;
+			bone.m_node = pSkeleton->FindNode(QString::fromUtf8(pBone->mName.C_Str()));
+			bone.m_offset = ToMatrix(pBone->mOffsetMatrix);
+			newMesh.m_bones.push_back(bone);
+			for (uint w = 0; w < pBone->mNumWeights; ++w) {
+				const aiVertexWeight& weight = pBone->mWeights[w];
+				if (weight.mVertexId >= pMesh->mNumVertices || weight.mWeight <= 0.f) {
+					continue;
+				}
+				std::array<float, 4>& weights = boneWeights[weight.mVertexId];
+				const size_t weakest = std::min_element(weights.begin(), weights.end()) - weights.begin();
+				if (weight.mWeight > weights[weakest]) {
+					weights[weakest] = weight.mWeight;
+					boneIndices[weight.mVertexId][weakest] = quint8(b);
+				}
+			}
+		}
+		bool unweighted = false;
+		for (uint v = 0; v < pMesh->mNumVertices; ++v) {
+			std::array<float, 4>& weights = boneWeights[v];
+			if (weights[0] + weights[1] + weights[2] + weights[3] <= 0.f) {
+				boneIndices[v] = { quint8(newMesh.m_bones.size()), 0, 0, 0 };
+				weights = { 1.f, 0.f, 0.f, 0.f };
+				unweighted = true;
+			}
+		}
+		if (unweighted) {
+			MeshBone rest;
+			rest.m_node = meshNode;
+			newMesh.m_bones.push_back(rest);
+		}
+
+		// With weights from 0 to 1 the targets can move a vertex by the sum of their offsets
+		// that point each way
+		ScratchVector<QVector3D> reachMin(pMesh->mNumVertices);
+		ScratchVector<QVector3D> reachMax(pMesh->mNumVertices);
+		for (uint t = 0; t < pMesh->mNumAnimMeshes; ++t) {
+			MorphTarget target;
+			target.m_weight = pMesh->mAnimMeshes[t]->mWeight;
+			target.m_min = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+			target.m_max = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			for (uint v = 0; v < pMesh->mNumVertices; ++v) {
+				const QVector3D offset = MorphOffset(t, v, false);
+				for (int axis = 0; axis < 3; ++axis) {
+					target.m_min[axis] = std::min(target.m_min[axis], offset[axis]);
+					target.m_max[axis] = std::max(target.m_max[axis], offset[axis]);
+					reachMin[v][axis] += std::min(0.f, offset[axis]);
+					reachMax[v][axis] += std::max(0.f, offset[axis]);
+				}
+			}
+			newMesh.m_morphTargets.push_back(target);
+		}
+		newMesh.m_morphNode = newMesh.m_morphTargets.empty() ? -1 : meshNode;
+
+		// The box of each bone holds the vertices it pulls on, wherever the targets move them
+		for (MeshBone& bone : newMesh.m_bones) {
+			bone.m_min = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+			bone.m_max = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		}
+		for (uint v = 0; v < pMesh->mNumVertices; ++v) {
+			const QVector3D p(pMesh->mVertices[v].x, pMesh->mVertices[v].y, pMesh->mVertices[v].z);
+			for (int i = 0; i < 4; ++i) {
+				if (boneWeights[v][i] > 0.f) {
+					MeshBone& bone = newMesh.m_bones[boneIndices[v][i]];
+					for (int axis = 0; axis < 3; ++axis) {
+						bone.m_min[axis] = std::min(bone.m_min[axis], p[axis] + reachMin[v][axis]);
+						bone.m_max[axis] = std::max(bone.m_max[axis], p[axis] + reachMax[v][axis]);
+					}
+				}
+			}
+		}
+		newMesh.m_hasBones = true;
+	}
+	const bool skinned = newMesh.m_hasBones;
+
+	// Determine the format of every attribute. Quantized attributes are stored as normalized
+	// integers or half floats, which the vertex fetch converts back for the shader. Skinned
+	// positions are moved by the bones before anything else, so they stay floats.
+	const bool quantize = options.m_quantize;
+	const bool quantizePositions = quantize && options.m_quantizePositions && !skinned;
+	newMesh.m_positionType = quantizePositions ? GL_UNSIGNED_SHORT : GL_FLOAT;
+	newMesh.m_normalType = quantize ? GL_INT_2_10_10_10_REV : GL_FLOAT;
+	newMesh.m_uvType = quantize ? GL_HALF_FLOAT : GL_FLOAT;
+	newMesh.m_colorType = quantize ? GL_UNSIGNED_BYTE : GL_FLOAT;
+
+	// Determine the size of a single attribute. Quantized positions get a fourth component
+	// that is always 1 so every attribute stays 4 byte aligned. Packed normals always have 4
+	// components, and the shader only reads 2 UV components.
+	newMesh.m_numPositionComponents = quantizePositions ? 4 : 3;
+	newMesh.m_numNormalComponents = quantize ? 4 : 3;
+	newMesh.m_numUVComponents = quantize ? 2 : pMesh->mNumUVComponents[0];  // Various
 	newMesh.m_numColorComponents = 4;
 
-	// Compute sizes for all attributes
-	const int positionBufferSize = newMesh.m_numPositionComponents * pMesh->mNumVertices * sizeof(float);
-	const int normalBufferSize = newMesh.m_numNormalComponents * pMesh->mNumVertices * sizeof(float);
-	const int uvBufferSize = newMesh.m_numUVComponents * pMesh->mNumVertices * sizeof(float);
-	const int colorBufferSize = newMesh.m_numColorComponents * pMesh->mNumVertices * sizeof(float);
+	// Compute the size of each attribute for a single vertex
+	const int positionSize = newMesh.m_numPositionComponents * (quantizePositions ? sizeof(quint16) : sizeof(float));
+	const int normalSize = !newMesh.m_hasNormals ? 0 : quantize ? sizeof(quint32) : newMesh.m_numNormalComponents * sizeof(float);
+	const int uvSize = !newMesh.m_hasUVCoordinates ? 0 : newMesh.m_numUVComponents * (quantize ? sizeof(qfloat16) : sizeof(float));
+	const int colorSize = !newMesh.m_hasColors ? 0 : newMesh.m_numColorComponents * (quantize ? sizeof(quint8) : sizeof(float));
+	const int boneSize = skinned ? 4 * sizeof(quint8) : 0; // For the indices and the weights each
+	const int vertexSize = positionSize + normalSize + uvSize + colorSize + 2 * boneSize;
+	const int vertexCount = pMesh->mNumVertices;
 
 	// Compute the offsets of features in the overall vertex buffer
 	//   1. Positions (required)
 	//   2. Normals (optional)
 	//   3. UV Coordinates (optional)
 	//   4. Colors (optional)
-	int currentOffset = 0;
-	if (true) { // Always has positions
-		newMesh.m_positionOffset = currentOffset;
-		currentOffset += positionBufferSize;
-	}
-	if (newMesh.m_hasNormals) {
-		newMesh.m_normalOffset = currentOffset;
-		currentOffset += normalBufferSize;
-	}
-	if (newMesh.m_hasUVCoordinates) {
-		newMesh.m_uvOffset = currentOffset;
-		currentOffset += uvBufferSize;
+	//   5. Bone indices and weights (optional)
+	// Interleaved vertices store the attributes of each vertex next to each other, which keeps a
+	// vertex fetch in one cache line. Otherwise every attribute gets its own block in the buffer.
+	const int blockScale = options.m_interleaved ? 1 : vertexCount;
+	newMesh.m_vertexStride = options.m_interleaved ? vertexSize : 0;
+	newMesh.m_positionOffset = 0;
+	newMesh.m_normalOffset = newMesh.m_positionOffset + positionSize * blockScale;
+	newMesh.m_uvOffset = newMesh.m_normalOffset + normalSize * blockScale;
+	newMesh.m_colorOffset = newMesh.m_uvOffset + uvSize * blockScale;
+	newMesh.m_boneIndexOffset = newMesh.m_colorOffset + colorSize * blockScale;
+	newMesh.m_boneWeightOffset = newMesh.m_boneIndexOffset + boneSize * blockScale;
+
+	// The triangles are read first, so they can be reordered for the post-transform vertex
+	// cache before anything is written. The vertices are then stored in the order the
+	// triangles first use them, and the indices refer to that order.
+	std::vector<quint32> triangles(size_t(pMesh->mNumFaces) * 3);
+	for (uint j = 0; j < pMesh->mNumFaces; ++j) {
+		aiFace const& face = pMesh->mFaces[j];
+		triangles[3 * j + 0] = face.mIndices[0];
+		triangles[3 * j + 1] = face.mIndices[1];
+		triangles[3 * j + 2] = face.mIndices[2];
 	}
-	if (newMesh.m_hasColors) {
-		newMesh.m_colorOffset = currentOffset;
-		currentOffset += colorBufferSize;
+	std::vector<quint32> vertexOrder; // The vertex of pMesh stored at each index, empty if unchanged
+	if (options.m_optimizeVertexCache && !triangles.empty()) {
+		triangles = VertexCacheOptimizer::OptimizeCache(triangles, vertexCount);
+		if (options.m_optimizeOverdraw) {
+			std::vector<QVector3D> positions(vertexCount);
+			for (int v = 0; v < vertexCount; ++v) {
+				positions[v] = QVector3D(pMesh->mVertices[v].x, pMesh->mVertices[v].y, pMesh->mVertices[v].z);
+			}
+			triangles = VertexCacheOptimizer::OptimizeOverdraw(triangles, positions);
+		}
+		vertexOrder = VertexCacheOptimizer::FetchOrder(triangles, vertexCount);
+		ScratchVector<quint32> remap(vertexCount);
+		for (int v = 0; v < vertexCount; ++v) {
+			remap[vertexOrder[v]] = quint32(v);
+		}
+		for (quint32& index : triangles) {
+			index = remap[index];
+		}
 	}
-	const int vertexBufferTotalSize = currentOffset;
+	auto Source = [&vertexOrder](int v) {
+		return vertexOrder.empty() ? v : int(vertexOrder[v]);
+	};
 
-	// Allocate the vertex buffer all at once to save time
-	newMesh.m_vertexBuffer.allocate(vertexBufferTotalSize);
+	// Allocate the vertex block all at once to save time
+	newMesh.m_vertexData.resize(vertexSize * vertexCount);
+	char* pVertexData = newMesh.m_vertexData.data();
 
-	// Positions
-	newMesh.m_vertexBuffer.write(newMesh.m_positionOffset, pMesh->mVertices, positionBufferSize);
+	// Writes one attribute of every vertex, Encode(v, pDest) stores vertex v of pMesh at pDest
+	auto WriteAttribute = [=](size_t offset, int size, auto Encode) {
+		const int step = options.m_interleaved ? vertexSize : size;
+		for (int v = 0; v < vertexCount; ++v) {
+			Encode(Source(v), pVertexData + offset + v * step);
+		}
+	};
+
+	// Positions. Quantized positions are stored relative to the AABB of the mesh, the decode
+	// matrix maps them back into model space.
+	if (quantizePositions) {
+		const aiVector3D min = pMesh->mAABB.mMin;
+		aiVector3D extent = pMesh->mAABB.mMax - pMesh->mAABB.mMin;
+		extent.x = extent.x > 0.f ? extent.x : 1.f;
+		extent.y = extent.y > 0.f ? extent.y : 1.f;
+		extent.z = extent.z > 0.f ? extent.z : 1.f;
+		newMesh.m_positionDecode.translate(min.x, min.y, min.z);
+		newMesh.m_positionDecode.scale(extent.x, extent.y, extent.z);
+
+		WriteAttribute(newMesh.m_positionOffset, positionSize, [=](int v, char* pDest) {
+			const aiVector3D p = pMesh->mVertices[v] - min;
+			const quint16 q[4] = { QuantizeUnorm16(p.x / extent.x), QuantizeUnorm16(p.y / extent.y), QuantizeUnorm16(p.z / extent.z), 0xFFFF };
+			memcpy(pDest, q, sizeof(q));
+		});
+	}
+	else {
+		WriteAttribute(newMesh.m_positionOffset, positionSize, [=](int v, char* pDest) {
+			memcpy(pDest, &pMesh->mVertices[v].x, positionSize);
+		});
+	}
 
 	// Normals
 	if (newMesh.m_hasNormals) {
-		newMesh.m_vertexBuffer.write(newMesh.m_normalOffset, pMesh->mNormals, normalBufferSize);
+		WriteAttribute(newMesh.m_normalOffset, normalSize, [=](int v, char* pDest) {
+			if (quantize) {
+				const quint32 packed = PackSnorm10(pMesh->mNormals[v]);
+				memcpy(pDest, &packed, sizeof(packed));
+			}
+			else {
+				memcpy(pDest, &pMesh->mNormals[v].x, normalSize);
+			}
+		});
 	}
 
-	// UV Coordinates
+	// UV Coordinates. Assimp always stores 3 components per vertex, only the used ones are copied.
 	if (newMesh.m_hasUVCoordinates) {
-		newMesh.m_vertexBuffer.write(newMesh.m_uvOffset, pMesh->mTextureCoords[0], uvBufferSize);
+		WriteAttribute(newMesh.m_uvOffset, uvSize, [=](int v, char* pDest) {
+			const aiVector3D& uv = pMesh->mTextureCoords[0][v];
+			if (quantize) {
+				const qfloat16 h[2] = { qfloat16(uv.x), qfloat16(uv.y) };
+				memcpy(pDest, h, sizeof(h));
+			}
+			else {
+				memcpy(pDest, &uv.x, uvSize);
+			}
+		});
 	}
 
 	// Colors
 	if (newMesh.m_hasColors)
 	{
-		newMesh.m_vertexBuffer.write(newMesh.m_colorOffset, pMesh->mColors[0], colorBufferSize);
+		WriteAttribute(newMesh.m_colorOffset, colorSize, [=](int v, char* pDest) {
+			const aiColor4D& c = pMesh->mColors[0][v];
+			if (quantize) {
+				const quint8 rgba[4] = { QuantizeUnorm8(c.r), QuantizeUnorm8(c.g), QuantizeUnorm8(c.b), QuantizeUnorm8(c.a) };
+				memcpy(pDest, rgba, sizeof(rgba));
+			}
+			else {
+				memcpy(pDest, &c.r, colorSize);
+			}
+		});
 	}
 
+	// Bones. The weights are scaled to add up to one, rounding errors go to the strongest.
+	if (skinned) {
+		WriteAttribute(newMesh.m_boneIndexOffset, boneSize, [&](int v, char* pDest) {
+			memcpy(pDest, boneIndices[v].data(), boneSize);
+		});
+		WriteAttribute(newMesh.m_boneWeightOffset, boneSize, [&](int v, char* pDest) {
+			const std::array<float, 4>& weights = boneWeights[v];
+			const float total = weights[0] + weights[1] + weights[2] + weights[3];
+			quint8 q[4];
+			int sum = 0;
+			for (int i = 0; i < 4; ++i) {
+				q[i] = QuantizeUnorm8(weights[i] / total);
+				sum += q[i];
+			}
+			const size_t strongest = std::max_element(weights.begin(), weights.end()) - weights.begin();
+			q[strongest] = quint8(qBound(0, int(q[strongest]) + 255 - sum, 255));
+			memcpy(pDest, q, boneSize);
+		});
+	}
+
+	// Blend shape offsets, in the order the vertices are stored
+	if (!newMesh.m_morphTargets.empty()) {
+		newMesh.m_morphData.resize(int(newMesh.m_morphTargets.size() * vertexCount * 8 * sizeof(float)));
+		float* pMorph = reinterpret_cast<float*>(newMesh.m_morphData.data());
+		for (uint t = 0; t < uint(newMesh.m_morphTargets.size()); ++t) {
+			for (int v = 0; v < vertexCount; ++v) {
+				const QVector3D position = MorphOffset(t, uint(Source(v)), false);
+				const QVector3D normal = MorphOffset(t, uint(Source(v)), true);
+				const float offsets[8] = { position.x(), position.y(), position.z(), 0.f, normal.x(), normal.y(), normal.z(), 0.f };
+				pMorph = std::copy(offsets, offsets + 8, pMorph);
+			}
+		}
+	}
 
-	// Load indices
+
+	// Load indices. Most meshes have few enough vertices for 16 bit indices, which halves the
+	// size of the index buffer.
 	newMesh.m_indexCount = pMesh->mNumFaces * 3;
-	const int indexBufferSize = sizeof(int) * newMesh.m_indexCount;
-	newMesh.m_indexBuffer.allocate(indexBufferSize);
+	newMesh.m_indexType = (vertexCount <= 0x10000) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	if (newMesh.m_indexType == GL_UNSIGNED_SHORT) {
+		newMesh.m_indexData.resize(newMesh.m_indexCount * sizeof(quint16));
+		std::copy(triangles.begin(), triangles.end(), reinterpret_cast<quint16*>(newMesh.m_indexData.data()));
+	}
+	else {
+		newMesh.m_indexData.resize(newMesh.m_indexCount * sizeof(quint32));
+		memcpy(newMesh.m_indexData.data(), triangles.data(), triangles.size() * sizeof(quint32));
+	}
 
-	std::vector<int> indices;
-	indices.reserve(newMesh.m_indexCount);
+	// The positions in the order they are stored, for the levels of detail and meshlets. The
+	// bounds of meshlets would only hold at rest, skinned meshes have none.
+	const bool buildMeshlets = options.m_buildMeshlets && !skinned && pMesh->mNumFaces >= uint(Meshlets::k_minTriangles);
+	ScratchVector<aiVector3D> orderedPositions;
+	const aiVector3D* pPositions = pMesh->mVertices;
+	if (!vertexOrder.empty() && ((options.m_generateLods && pMesh->mNumFaces >= k_lodMinTriangles) || buildMeshlets)) {
+		orderedPositions.resize(vertexCount);
+		for (int v = 0; v < vertexCount; ++v) {
+			orderedPositions[v] = pMesh->mVertices[vertexOrder[v]];
+		}
+		pPositions = orderedPositions.data();
+	}
 
-	// Loop through all faces
-	// Potentially use OpenMP to multithread this if it is slow
-	for (int j = 0; j < pMesh->mNumFaces; ++j) {
-		aiFace const& face = pMesh->mFaces[j];
-		indices.push_back(face.mIndices[0]);
-		indices.push_back(face.mIndices[1]);
-		indices.push_back(face.mIndices[2]);
+	// Levels of detail are appended to the same index block, each in a cache friendly order
+	// of its own
+	if (options.m_generateLods && pMesh->mNumFaces >= k_lodMinTriangles) {
+		std::vector<std::vector<quint32>> levels = SimplifyTriangles(pPositions, vertexCount, pMesh->mAABB.mMin, pMesh->mAABB.mMax, triangles);
+		if (options.m_optimizeVertexCache) {
+			for (std::vector<quint32>& level : levels) {
+				level = VertexCacheOptimizer::OptimizeCache(level, vertexCount);
+			}
+		}
+
+		const int indexSize = (newMesh.m_indexType == GL_UNSIGNED_SHORT) ? sizeof(quint16) : sizeof(quint32);
+		int firstIndex = newMesh.m_indexCount;
+		for (const std::vector<quint32>& level : levels) {
+			newMesh.m_lods.push_back({ firstIndex, int(level.size()) });
+			firstIndex += int(level.size());
+		}
+		newMesh.m_indexData.resize(firstIndex * indexSize);
+		for (size_t i = 0; i < levels.size(); ++i) {
+			char* pDest = newMesh.m_indexData.data() + newMesh.m_lods[i].m_firstIndex * indexSize;
+			if (newMesh.m_indexType == GL_UNSIGNED_SHORT) {
+				std::copy(levels[i].begin(), levels[i].end(), reinterpret_cast<quint16*>(pDest));
+			}
+			else {
+				memcpy(pDest, levels[i].data(), levels[i].size() * sizeof(quint32));
+			}
+		}
 	}
 
-	newMesh.m_indexBuffer.write(0, indices.data(), indexBufferSize);
+	// Meshlets cover the full detail triangles in the order they were written
+	if (buildMeshlets) {
+		std::vector<QVector3D> positions(vertexCount);
+		for (int v = 0; v < vertexCount; ++v) {
+			positions[v] = QVector3D(pPositions[v].x, pPositions[v].y, pPositions[v].z);
+		}
+		newMesh.m_meshlets = Meshlets::Build(positions, triangles.data(), newMesh.m_indexCount);
+	}
 
 
 	// Load axis aligned bounding box (AABB)
@@ -308,37 +1221,965 @@ Mesh ModelLoader::ProcessMesh(aiScene const* pScene, uint meshIdx)
 	newMesh.m_AABBMax.setY(pMesh->mAABB.mMax.y);
 	newMesh.m_AABBMax.setZ(pMesh->mAABB.mMax.z);
 
+	newMesh.m_transform = transform;
+
 	return newMesh;
 }
 
-void ModelLoader::TraverseNodeTree(aiNode const* pNode, aiScene const* pScene, Model& model, QMatrix4x4 transform)
+std::vector<std::vector<MeshReference>> ModelLoader::GroupForBatching(aiScene const* pScene, const std::vector<MeshReference>& refs)
+{
+	// Meshes can only share a draw if they share a material and have the same attributes.
+	// Skinned meshes and meshes with blend shapes are posed on their own, each one is a batch
+	// of its own. So are point meshes, which are the nodes of a point cloud's octree that
+	// PointCloudLod picks from.
+	auto BatchKey = [pScene, &refs](const MeshReference& ref) {
+		aiMesh const* pMesh = pScene->mMeshes[ref.m_meshIdx];
+		const bool points = pMesh->mPrimitiveTypes == aiPrimitiveType_POINT && pMesh->mNumFaces == 0;
+		const int ownBatch = IsAnimated(pMesh) || points ? int(&ref - refs.data()) : -1;
+		return std::make_tuple(pMesh->mMaterialIndex, pMesh->mNormals != NULL, pMesh->HasTextureCoords(0),
+			pMesh->HasTextureCoords(0) ? pMesh->mNumUVComponents[0] : 0u, pMesh->HasVertexColors(0), ownBatch);
+	};
+
+	// Keep the batches in the order their first mesh appears in the node tree
+	std::vector<std::vector<MeshReference>> batches;
+	std::map<decltype(BatchKey(refs.front())), size_t> batchIndices;
+	for (const MeshReference& ref : refs) {
+		auto it = batchIndices.emplace(BatchKey(ref), batches.size()).first;
+		if (it->second == batches.size()) {
+			batches.emplace_back();
+		}
+		batches[it->second].push_back(ref);
+	}
+	return batches;
+}
+
+MeshData ModelLoader::DecodeBatch(aiScene const* pScene, const std::vector<MeshReference>& batch, const LoadOptions& options)
+{
+	// Build one Assimp mesh out of all meshes in the batch, with the node transforms already applied.
+	// It is then decoded like any other mesh and its destructor frees the arrays.
+	aiMesh const* pFirst = pScene->mMeshes[batch.front().m_meshIdx];
+	uint vertexCount = 0;
+	uint faceCount = 0;
+	for (const MeshReference& ref : batch) {
+		vertexCount += pScene->mMeshes[ref.m_meshIdx]->mNumVertices;
+		faceCount += pScene->mMeshes[ref.m_meshIdx]->mNumFaces;
+	}
+
+	aiMesh merged;
+	merged.mName = pFirst->mName;
+	merged.mMaterialIndex = pFirst->mMaterialIndex;
+	merged.mNumVertices = vertexCount;
+	merged.mVertices = new aiVector3D[vertexCount];
+	if (pFirst->mNormals) {
+		merged.mNormals = new aiVector3D[vertexCount];
+	}
+	if (pFirst->HasTextureCoords(0)) {
+		merged.mTextureCoords[0] = new aiVector3D[vertexCount];
+		merged.mNumUVComponents[0] = pFirst->mNumUVComponents[0];
+	}
+	if (pFirst->HasVertexColors(0)) {
+		merged.mColors[0] = new aiColor4D[vertexCount];
+	}
+	merged.mNumFaces = faceCount;
+	merged.mFaces = new aiFace[faceCount];
+
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	uint firstVertex = 0;
+	uint firstFace = 0;
+	for (const MeshReference& ref : batch) {
+		aiMesh const* pMesh = pScene->mMeshes[ref.m_meshIdx];
+		const QMatrix3x3 normalMatrix = ref.m_transform.normalMatrix();
+
+		for (uint v = 0; v < pMesh->mNumVertices; ++v) {
+			const aiVector3D& p = pMesh->mVertices[v];
+			const QVector3D transformed = ref.m_transform.map(QVector3D(p.x, p.y, p.z));
+			merged.mVertices[firstVertex + v] = aiVector3D(transformed.x(), transformed.y(), transformed.z());
+
+			if (merged.mNormals) {
+				const aiVector3D& n = pMesh->mNormals[v];
+				const float* m = normalMatrix.constData();
+				// QMatrix3x3 is stored column major
+				aiVector3D tn(m[0] * n.x + m[3] * n.y + m[6] * n.z,
+					m[1] * n.x + m[4] * n.y + m[7] * n.z,
+					m[2] * n.x + m[5] * n.y + m[8] * n.z);
+				merged.mNormals[firstVertex + v] = tn.NormalizeSafe();
+			}
+			if (merged.mTextureCoords[0]) {
+				merged.mTextureCoords[0][firstVertex + v] = pMesh->mTextureCoords[0][v];
+			}
+			if (merged.mColors[0]) {
+				merged.mColors[0][firstVertex + v] = pMesh->mColors[0][v];
+			}
+		}
+
+		for (uint f = 0; f < pMesh->mNumFaces; ++f) {
+			aiFace const& face = pMesh->mFaces[f];
+			aiFace& mergedFace = merged.mFaces[firstFace + f];
+			mergedFace.mNumIndices = face.mNumIndices;
+			mergedFace.mIndices = new unsigned int[face.mNumIndices];
+			for (uint i = 0; i < face.mNumIndices; ++i) {
+				mergedFace.mIndices[i] = face.mIndices[i] + firstVertex;
+			}
+		}
+
+		firstVertex += pMesh->mNumVertices;
+		firstFace += pMesh->mNumFaces;
+	}
+	if (vertexCount > 0) {
+		BoundsMath::AddPoints(&merged.mVertices[0].x, vertexCount, 3, min, max);
+	}
+	merged.mAABB = aiAABB(aiVector3D(min.x(), min.y(), min.z()), aiVector3D(max.x(), max.y(), max.z()));
+
+	return DecodeMesh(&merged, QMatrix4x4(), options);
+}
+
+void ModelLoader::TraverseNodeTree(aiNode const* pNode, int parent, const aiMatrix4x4t<double>& parentWorld, const std::array<double, 3>& origin, std::vector<MeshReference>& meshes, SceneGraph& graph)
 {
-	// Get the transformation matrix for this node
-	const aiMatrix4x4 t = pNode->mTransformation;
-	const QMatrix4x4 qTrans = QMatrix4x4(t.a1, t.a2, t.a3, t.a4, t.b1, t.b2, t.b3, t.b4, t.c1, t.c2, t.c3, t.c4, t.d1, t.d2, t.d3, t.d4);
+	// The root is moved by minus origin, which the nodes below inherit. Their world matrices
+	// are multiplied out here, as in float the origin would only cancel after rounding.
+	const DoubleMatrix world = parentWorld * ToDouble(pNode->mTransformation);
+	const QMatrix4x4 local = parent < 0 ? ToMatrix(world, origin) : ToMatrix(pNode->mTransformation);
+	const int nodeIdx = graph.AddNode(QString::fromUtf8(pNode->mName.C_Str()), parent, local, ToMatrix(world, origin));
+	const QMatrix4x4& transform = graph.Node(nodeIdx).m_world;
 
-	// Load all meshes in this node
-	for (int i = 0; i < pNode->mNumMeshes; ++i) {
-		uint meshIdx = pNode->mMeshes[i];
-		Mesh newMesh = ProcessMesh(pScene, meshIdx);
-		newMesh.m_transform = transform * qTrans;
-		model.m_meshes.push_back(newMesh);
+	// Record all meshes in this node
+	for (uint i = 0; i < pNode->mNumMeshes; ++i) {
+		meshes.push_back({ pNode->mMeshes[i], transform, nodeIdx });
 	}
 
 	// Traverse all child nodes
-	for (int i = 0; i < pNode->mNumChildren; ++i) {
-		aiNode* child = pNode->mChildren[i];
-		TraverseNodeTree(child, pScene, model, qTrans);
+	for (uint i = 0; i < pNode->mNumChildren; ++i) {
+		TraverseNodeTree(pNode->mChildren[i], nodeIdx, world, origin, meshes, graph);
+	}
+}
+
+std::vector<MeshReference> ModelLoader::CollectMeshes(aiScene const* pScene, const std::array<double, 3>& origin, SceneGraph& graph)
+{
+	std::vector<MeshReference> meshes;
+	meshes.reserve(pScene->mNumMeshes);
+	graph.Clear();
+	TraverseNodeTree(pScene->mRootNode, -1, DoubleMatrix(), origin, meshes, graph);
+	return meshes;
+}
+
+std::array<double, 3> ModelLoader::FindOrigin(aiScene const* pScene)
+{
+	std::array<double, 3> origin = {};
+	if (!pScene || !pScene->mRootNode) {
+		return origin;
+	}
+
+	// The bounds of every mesh where each node referencing it puts it
+	std::vector<std::pair<QVector3D, QVector3D>> meshBounds(pScene->mNumMeshes);
+	for (uint i = 0; i < pScene->mNumMeshes; ++i) {
+		MeshBounds(pScene->mMeshes[i], meshBounds[i].first, meshBounds[i].second);
+	}
+	DoubleVector min(DBL_MAX, DBL_MAX, DBL_MAX);
+	DoubleVector max(-DBL_MAX, -DBL_MAX, -DBL_MAX);
+	std::vector<std::pair<aiNode const*, DoubleMatrix>> stack = { { pScene->mRootNode, ToDouble(pScene->mRootNode->mTransformation) } };
+	while (!stack.empty()) {
+		aiNode const* pNode = stack.back().first;
+		const DoubleMatrix world = stack.back().second;
+		stack.pop_back();
+		for (uint i = 0; i < pNode->mNumMeshes; ++i) {
+			const QVector3D& boxMin = meshBounds[pNode->mMeshes[i]].first;
+			const QVector3D& boxMax = meshBounds[pNode->mMeshes[i]].second;
+			if (boxMin.x() > boxMax.x()) {
+				continue;
+			}
+			for (int corner = 0; corner < 8; ++corner) {
+				const DoubleVector p = world * DoubleVector(corner & 1 ? boxMax.x() : boxMin.x(), corner & 2 ? boxMax.y() : boxMin.y(), corner & 4 ? boxMax.z() : boxMin.z());
+				min = DoubleVector(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+				max = DoubleVector(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+			}
+		}
+		for (uint i = 0; i < pNode->mNumChildren; ++i) {
+			stack.push_back({ pNode->mChildren[i], world * ToDouble(pNode->mChildren[i]->mTransformation) });
+		}
+	}
+	if (min.x > max.x) {
+		return origin;
+	}
+
+	// Whole units keep the origin exact in float too, for coordinates up to 2^24
+	const DoubleVector center = (min + max) * 0.5;
+	if (center.Length() > k_rebaseRatio * 0.5 * (max - min).Length()) {
+		origin = { std::round(center.x), std::round(center.y), std::round(center.z) };
+	}
+	return origin;
+}
+
+QSharedPointer<Skeleton> ModelLoader::DecodeSkeleton(aiScene const* pScene, const std::array<double, 3>& origin, std::vector<int>& meshNodes)
+{
+	QSharedPointer<Skeleton> skeleton(new Skeleton());
+	meshNodes.assign(pScene->mNumMeshes, -1);
+
+	// Depth first, children in order, so every node is stored after its parent
+	std::vector<std::pair<aiNode const*, int>> stack = { { pScene->mRootNode, -1 } };
+	while (!stack.empty()) {
+		aiNode const* pNode = stack.back().first;
+		const int parent = stack.back().second;
+		stack.pop_back();
+
+		const int nodeIdx = int(skeleton->m_nodes.size());
+		SkeletonNode node;
+		node.m_name = QString::fromUtf8(pNode->mName.C_Str());
+		node.m_parent = parent;
+		node.m_transform = parent < 0 ? ToMatrix(ToDouble(pNode->mTransformation), origin) : ToMatrix(pNode->mTransformation);
+		skeleton->m_nodes.push_back(node);
+		for (uint i = 0; i < pNode->mNumMeshes; ++i) {
+			int& meshNode = meshNodes[pNode->mMeshes[i]];
+			meshNode = meshNode < 0 ? nodeIdx : meshNode;
+		}
+		for (uint i = pNode->mNumChildren; i-- > 0;) {
+			stack.push_back({ pNode->mChildren[i], nodeIdx });
+		}
+	}
+
+	// Weights of targets no mesh has are dropped
+	uint targetCount = 0;
+	for (uint i = 0; i < pScene->mNumMeshes; ++i) {
+		targetCount = std::max(targetCount, pScene->mMeshes[i]->mNumAnimMeshes);
+	}
+
+	// Key times are converted from ticks to seconds
+	for (uint i = 0; i < pScene->mNumAnimations; ++i) {
+		aiAnimation const* pAnimation = pScene->mAnimations[i];
+		const double ticksPerSecond = pAnimation->mTicksPerSecond > 0.0 ? pAnimation->mTicksPerSecond : k_defaultTicksPerSecond;
+		AnimationClip clip;
+		clip.m_name = QString::fromUtf8(pAnimation->mName.C_Str());
+		if (clip.m_name.isEmpty()) {
+			clip.m_name = QString("Animation %1").arg(i + 1);
+		}
+		clip.m_duration = float(pAnimation->mDuration / ticksPerSecond);
+		auto Seconds = [ticksPerSecond](double ticks) {
+			return float(ticks / ticksPerSecond);
+		};
+
+		for (uint c = 0; c < pAnimation->mNumChannels; ++c) {
+			aiNodeAnim const* pChannel = pAnimation->mChannels[c];
+			aiNode const* pNode = pScene->mRootNode->FindNode(pChannel->mNodeName);
+			AnimationChannel channel;
+			channel.m_node = skeleton->FindNode(QString::fromUtf8(pChannel->mNodeName.C_Str()));
+			if (!pNode || channel.m_node < 0) {
+				continue;
+			}
+
+			// Parts the channel has no keys for keep the node's value at rest
+			aiVector3D restScale;
+			aiQuaternion restRotation;
+			aiVector3D restPosition;
+			pNode->mTransformation.Decompose(restScale, restRotation, restPosition);
+
+			// The root's positions are moved like its transform at rest
+			const std::array<double, 3> shift = skeleton->m_nodes[channel.m_node].m_parent < 0 ? origin : std::array<double, 3>();
+			auto Position = [&shift](const aiVector3D& position) {
+				return Rebased(DoubleVector(position.x, position.y, position.z), shift);
+			};
+			for (uint k = 0; k < pChannel->mNumPositionKeys; ++k) {
+				const aiVectorKey& key = pChannel->mPositionKeys[k];
+				channel.m_positions.push_back({ Seconds(key.mTime), Position(key.mValue) });
+			}
+			for (uint k = 0; k < pChannel->mNumRotationKeys; ++k) {
+				const aiQuatKey& key = pChannel->mRotationKeys[k];
+				channel.m_rotations.push_back({ Seconds(key.mTime), QQuaternion(key.mValue.w, key.mValue.x, key.mValue.y, key.mValue.z) });
+			}
+			for (uint k = 0; k < pChannel->mNumScalingKeys; ++k) {
+				const aiVectorKey& key = pChannel->mScalingKeys[k];
+				channel.m_scales.push_back({ Seconds(key.mTime), QVector3D(key.mValue.x, key.mValue.y, key.mValue.z) });
+			}
+			if (channel.m_positions.empty()) {
+				channel.m_positions.push_back({ 0.f, Position(restPosition) });
+			}
+			if (channel.m_rotations.empty()) {
+				channel.m_rotations.push_back({ 0.f, QQuaternion(restRotation.w, restRotation.x, restRotation.y, restRotation.z) });
+			}
+			if (channel.m_scales.empty()) {
+				channel.m_scales.push_back({ 0.f, QVector3D(restScale.x, restScale.y, restScale.z) });
+			}
+			clip.m_channels.push_back(std::move(channel));
+		}
+
+		// Morph channels are named after the node of the meshes they weight
+		for (uint c = 0; c < pAnimation->mNumMorphMeshChannels; ++c) {
+			aiMeshMorphAnim const* pChannel = pAnimation->mMorphMeshChannels[c];
+			MorphChannel channel;
+			channel.m_node = skeleton->FindNode(QString::fromUtf8(pChannel->mName.C_Str()));
+			if (channel.m_node < 0 || pChannel->mNumKeys == 0) {
+				continue;
+			}
+			for (uint k = 0; k < pChannel->mNumKeys; ++k) {
+				const aiMeshMorphKey& key = pChannel->mKeys[k];
+				MorphKey morphKey;
+				morphKey.m_time = Seconds(key.mTime);
+				for (uint w = 0; w < key.mNumValuesAndWeights; ++w) {
+					const uint target = key.mValues[w];
+					if (target >= targetCount) {
+						continue;
+					}
+					if (target >= morphKey.m_weights.size()) {
+						morphKey.m_weights.resize(target + 1, 0.f);
+					}
+					morphKey.m_weights[target] = float(key.mWeights[w]);
+				}
+				channel.m_keys.push_back(std::move(morphKey));
+			}
+			clip.m_morphChannels.push_back(std::move(channel));
+		}
+		skeleton->m_clips.push_back(std::move(clip));
+	}
+	return skeleton;
+}
+
+std::vector<SceneLight> ModelLoader::DecodeLights(aiScene const* pScene, const std::array<double, 3>& origin)
+{
+	std::vector<SceneLight> lights;
+	for (uint i = 0; i < pScene->mNumLights; ++i) {
+		aiLight const* pLight = pScene->mLights[i];
+		SceneLight light;
+		switch (pLight->mType) {
+		case aiLightSource_DIRECTIONAL:
+			light.m_type = k_lightDirectional;
+			break;
+		case aiLightSource_SPOT:
+			light.m_type = k_lightSpot;
+			break;
+		case aiLightSource_POINT:
+		case aiLightSource_AREA:
+			light.m_type = k_lightPoint;
+			break;
+		default:
+			// Ambient light is left to the material's ambient term
+			continue;
+		}
+
+		// The light is placed by the node of the same name, and all of its parents
+		DoubleMatrix placement;
+		for (aiNode const* pNode = pScene->mRootNode->FindNode(pLight->mName); pNode; pNode = pNode->mParent) {
+			placement = ToDouble(pNode->mTransformation) * placement;
+		}
+		const QMatrix4x4 transform = ToMatrix(placement, origin);
+		light.m_position = Rebased(placement * DoubleVector(pLight->mPosition.x, pLight->mPosition.y, pLight->mPosition.z), origin);
+		const QVector3D direction = transform.mapVector(QVector3D(pLight->mDirection.x, pLight->mDirection.y, pLight->mDirection.z));
+		if (!direction.isNull()) {
+			light.m_direction = direction.normalized();
+		}
+		light.m_color = QVector3D(pLight->mColorDiffuse.r, pLight->mColorDiffuse.g, pLight->mColorDiffuse.b);
+		light.m_attenuation = QVector3D(pLight->mAttenuationConstant, pLight->mAttenuationLinear, pLight->mAttenuationQuadratic);
+		if (light.m_attenuation.x() <= 0.f && light.m_attenuation.y() <= 0.f && light.m_attenuation.z() <= 0.f) {
+			light.m_attenuation = QVector3D(1.f, 0.f, 0.f);
+		}
+		light.m_innerCone = pLight->mAngleInnerCone;
+		light.m_outerCone = std::max(pLight->mAngleOuterCone, pLight->mAngleInnerCone);
+		if (light.m_color.x() > 0.f || light.m_color.y() > 0.f || light.m_color.z() > 0.f) {
+			lights.push_back(light);
+		}
+	}
+	return lights;
+}
+
+void ModelLoader::GroupInstances(const std::vector<MeshReference>& refs, std::vector<uint>& uniqueMeshes, std::vector<std::vector<QMatrix4x4>>& instanceTransforms, std::vector<std::vector<int>>& instanceNodes)
+{
+	std::map<uint, size_t> uniqueIndices;
+	for (const MeshReference& ref : refs) {
+		auto it = uniqueIndices.emplace(ref.m_meshIdx, uniqueMeshes.size()).first;
+		if (it->second == uniqueMeshes.size()) {
+			uniqueMeshes.push_back(ref.m_meshIdx);
+			instanceTransforms.emplace_back();
+			instanceNodes.emplace_back();
+		}
+		instanceTransforms[it->second].push_back(ref.m_transform);
+		instanceNodes[it->second].push_back(ref.m_node);
 	}
 }
 
-Model ModelLoader::ProcessModel(aiScene const* pScene)
+ModelData ModelLoader::DecodeModel(aiScene const* pScene, const QString& file, const LoadOptions& options, const std::atomic<bool>* pCancelled, ImportTrace* pTrace)
 {
-	Model ret;
+	ModelData ret;
+	if (!pScene) {
+		return ret;
+	}
+	ImportTrace::Scope decode(pTrace, "Decode", ImportTrace::k_stage);
+	ImportTrace::Sequence steps(pTrace);
+	auto Cancelled = [pCancelled] {
+		return pCancelled && pCancelled->load(std::memory_order_relaxed);
+	};
 
-	aiNode* root = pScene->mRootNode;
-	TraverseNodeTree(root, pScene, ret, QMatrix4x4());
+	// Large meshes are split into clusters once they are decoded, also on the thread pool
+	auto SplitLargeMeshes = [&options, &steps](ModelData& model) {
+		if (options.m_clusterTriangles <= 0) {
+			return;
+		}
+		steps.Next("Split");
+		std::vector<std::vector<MeshData>> parts(model.m_meshes.size());
+		std::vector<size_t> splitWork(model.m_meshes.size());
+		std::iota(splitWork.begin(), splitWork.end(), size_t(0));
+		QtConcurrent::blockingMap(splitWork, [&](size_t i) {
+			// Clusters of a skinned mesh would only be compact at rest
+			if (model.m_meshes[i].m_hasBones) {
+				parts[i].push_back(std::move(model.m_meshes[i]));
+				return;
+			}
+			parts[i] = SplitMesh(model.m_meshes[i], options.m_clusterTriangles);
+			model.m_meshes[i] = MeshData();
+		});
+		model.m_meshes.clear();
+		for (std::vector<MeshData>& meshParts : parts) {
+			std::move(meshParts.begin(), meshParts.end(), std::back_inserter(model.m_meshes));
+		}
+	};
+
+	// Gather the unique textures of all maps of all materials up front. Many materials and maps
+	// usually share a texture, so each one is decoded only once. A map is the first of its
+	// candidates that decodes, so maps are told apart by all of them. Only metallic-roughness
+	// materials get that map, other files use the same texture types for other things.
+	steps.Next("Materials");
+	ret.m_materials = DecodeMaterials(pScene);
+	std::vector<std::vector<TextureReference>> textureRefs;
+	std::vector<std::array<int, k_materialMapCount>> mapTextureIdx(pScene->mNumMaterials);
+	QHash<QString, int> textureIndices;
+	// The maps each texture is used for, as bits
+	std::vector<int> textureMaps;
+	const QFileInfo modelInfo(file);
+	const QString canonicalPath = modelInfo.canonicalFilePath();
+	const ModelLocation location = { ImportIOSystem::Folder(file), canonicalPath.isEmpty() ? file : canonicalPath };
+	for (uint i = 0; i < pScene->mNumMaterials; ++i) {
+		mapTextureIdx[i].fill(-1);
+		for (int map = 0; map < k_materialMapCount; ++map) {
+			if (map == k_metallicRoughnessMap && !ret.m_materials[i].m_properties.m_metallicRoughness) {
+				continue;
+			}
+			std::vector<TextureReference> candidates = ResolveMaterialMap(pScene, pScene->mMaterials[i], MaterialMap(map), location);
+			if (candidates.empty()) {
+				continue;
+			}
+			QString key;
+			for (const TextureReference& ref : candidates) {
+				key += ref.m_key + '\n';
+			}
+			auto it = textureIndices.find(key);
+			if (it == textureIndices.end()) {
+				it = textureIndices.insert(key, int(textureRefs.size()));
+				textureRefs.push_back(std::move(candidates));
+			}
+			mapTextureIdx[i][map] = it.value();
+			textureMaps.resize(textureRefs.size());
+			textureMaps[it.value()] |= 1 << map;
+		}
+	}
+
+	// Only textures that are nothing but base color maps are paged, the other maps are sampled
+	// whole
+	const int pagedSize = options.m_virtualTextureSize;
+	auto PagedSize = [&](size_t i) {
+		return textureMaps[i] == 1 << k_baseColorMap ? pagedSize : 0;
+	};
+
+	// Decode them in parallel, from disk or from the embedded data. A file that is found but
+	// doesn't decode gives way to the next candidate.
+	steps.Next("Textures");
+	std::vector<TextureData> textures(textureRefs.size());
+	std::vector<size_t> textureWork(textureRefs.size());
+	std::iota(textureWork.begin(), textureWork.end(), size_t(0));
+	QtConcurrent::blockingMap(textureWork, [&](size_t i) {
+		for (const TextureReference& ref : textureRefs[i]) {
+			if (Cancelled()) {
+				return;
+			}
+			ImportTrace::Scope item(pTrace, "Texture", ImportTrace::k_item, pTrace ? ref.m_key : QString());
+			textures[i] = DecodeTexture(ref, PagedSize(i), options.m_pageFolder);
+			if (!textures[i].isNull()) {
+				return;
+			}
+		}
+	});
+	if (Cancelled()) {
+		return ModelData();
+	}
+
+	for (uint i = 0; i < pScene->mNumMaterials; ++i) {
+		for (int map = 0; map < k_materialMapCount; ++map) {
+			if (mapTextureIdx[i][map] >= 0) {
+				ret.m_materials[i].m_maps[map] = textures[mapTextureIdx[i][map]];
+			}
+		}
+	}
+
+	// Skinned meshes are posed by the node tree, which is kept along with the animations.
+	// Blend shapes are weighted by the animations of their node.
+	steps.Next("Skeleton");
+	ret.m_origin = FindOrigin(pScene);
+	std::vector<int> meshNodes;
+	QSharedPointer<Skeleton> skeleton;
+	for (uint i = 0; i < pScene->mNumMeshes && !skeleton; ++i) {
+		if (IsAnimated(pScene->mMeshes[i])) {
+			skeleton = DecodeSkeleton(pScene, ret.m_origin, meshNodes);
+		}
+	}
+	ret.m_skeleton = skeleton;
+	ret.m_lights = DecodeLights(pScene, ret.m_origin);
+	auto Skinned = [&](uint meshIdx) {
+		return skeleton && IsAnimated(pScene->mMeshes[meshIdx]);
+	};
+
+	// A mesh whose own vertices are far out can't be brought back by its transform, which
+	// rounds them in float first. It gets its vertices moved like a batch of one instead, and
+	// is no longer placed by its node.
+	const bool rebased = ret.m_origin != std::array<double, 3>();
+	auto Baked = [&](uint meshIdx) {
+		QVector3D min, max;
+		MeshBounds(pScene->mMeshes[meshIdx], min, max);
+		return rebased && !IsAnimated(pScene->mMeshes[meshIdx]) && FarFromOrigin(min, max);
+	};
+
+	// Flatten the node tree into a work list and decode the meshes on the thread pool.
+	// Every mesh writes to its own slot, so the results keep the order of the node tree.
+	steps.Next("Traverse");
+	QSharedPointer<SceneGraph> graph(new SceneGraph());
+	const std::vector<MeshReference> refs = CollectMeshes(pScene, ret.m_origin, *graph);
+	ret.m_sceneGraph = graph;
+	if (options.m_batchStatic && !refs.empty()) {
+		// Merge the meshes that can be drawn together into one mesh per batch
+		const std::vector<std::vector<MeshReference>> batches = GroupForBatching(pScene, refs);
+		steps.Next("Meshes");
+		ret.m_meshes.resize(batches.size());
+		std::vector<size_t> batchWork(batches.size());
+		std::iota(batchWork.begin(), batchWork.end(), size_t(0));
+		QtConcurrent::blockingMap(batchWork, [&](size_t i) {
+			const std::vector<MeshReference>& batch = batches[i];
+			if (Cancelled()) {
+				return;
+			}
+			const uint meshIdx = batch.front().m_meshIdx;
+			ImportTrace::Scope item(pTrace, "Mesh", ImportTrace::k_item, pTrace ? QString::fromUtf8(pScene->mMeshes[meshIdx]->mName.C_Str()) : QString());
+			if (Skinned(meshIdx)) {
+				ret.m_meshes[i] = DecodeMesh(pScene->mMeshes[meshIdx], QMatrix4x4(), options, skeleton.data(), meshNodes[meshIdx]);
+			}
+			else if (batch.size() == 1 && !Baked(meshIdx)) {
+				ret.m_meshes[i] = DecodeMesh(pScene->mMeshes[meshIdx], batch.front().m_transform, options);
+				ret.m_meshes[i].m_nodes = { batch.front().m_node };
+			}
+			else {
+				ret.m_meshes[i] = DecodeBatch(pScene, batch, options);
+			}
+		});
+		if (Cancelled()) {
+			return ModelData();
+		}
+		steps.Next("Bounds");
+		BoundAtRest(ret);
+		SplitLargeMeshes(ret);
+		steps.Next("Stats");
+		ret.m_stats = ModelStats::Compute(ret);
+		return ret;
+	}
+
+	// Nodes often reference the same mesh many times. Each mesh is decoded once and drawn once
+	// per reference as an instance. Meshes keep the order they first appear in. Skinned meshes
+	// are drawn once, where their bones put them.
+	std::vector<uint> uniqueMeshes;
+	std::vector<std::vector<QMatrix4x4>> instanceTransforms;
+	std::vector<std::vector<int>> instanceNodes;
+	GroupInstances(refs, uniqueMeshes, instanceTransforms, instanceNodes);
+
+	steps.Next("Meshes");
+	ret.m_meshes.resize(uniqueMeshes.size());
+	std::vector<size_t> meshWork(uniqueMeshes.size());
+	std::iota(meshWork.begin(), meshWork.end(), size_t(0));
+	QtConcurrent::blockingMap(meshWork, [&](size_t i) {
+		aiMesh const* pMesh = pScene->mMeshes[uniqueMeshes[i]];
+		const std::vector<QMatrix4x4>& instances = instanceTransforms[i];
+		if (Cancelled()) {
+			return;
+		}
+		ImportTrace::Scope item(pTrace, "Mesh", ImportTrace::k_item, pTrace ? QString::fromUtf8(pMesh->mName.C_Str()) : QString());
+		if (Skinned(uniqueMeshes[i])) {
+			ret.m_meshes[i] = DecodeMesh(pMesh, QMatrix4x4(), options, skeleton.data(), meshNodes[uniqueMeshes[i]]);
+		}
+		else if (instances.size() == 1 && Baked(uniqueMeshes[i])) {
+			ret.m_meshes[i] = DecodeBatch(pScene, { { uniqueMeshes[i], instances.front(), instanceNodes[i].front() } }, options);
+		}
+		else if (instances.size() == 1) {
+			ret.m_meshes[i] = DecodeMesh(pMesh, instances.front(), options);
+			ret.m_meshes[i].m_nodes = instanceNodes[i];
+		}
+		else {
+			ret.m_meshes[i] = DecodeMesh(pMesh, QMatrix4x4(), options);
+			ret.m_meshes[i].m_instanceTransforms = instances;
+			ret.m_meshes[i].m_nodes = instanceNodes[i];
+		}
+	});
+	if (Cancelled()) {
+		return ModelData();
+	}
+
+	steps.Next("Bounds");
+	BoundAtRest(ret);
+	SplitLargeMeshes(ret);
+
+	// The meshes are final now, so they are counted once here instead of whenever shown
+	steps.Next("Stats");
+	ret.m_stats = ModelStats::Compute(ret);
+	return ret;
+}
+
+ModelData ModelLoader::DecodeProxy(aiScene const* pScene)
+{
+	ModelData ret;
+	if (!pScene) {
+		return ret;
+	}
+
+	// Instances are kept, so the proxy has the same meshes as the model it stands in for. The
+	// materials keep their colors, without maps.
+	ret.m_materials = DecodeMaterials(pScene);
+	ret.m_origin = FindOrigin(pScene);
+	std::vector<uint> uniqueMeshes;
+	std::vector<std::vector<QMatrix4x4>> instanceTransforms;
+	std::vector<std::vector<int>> instanceNodes;
+	SceneGraph graph;
+	GroupInstances(CollectMeshes(pScene, ret.m_origin, graph), uniqueMeshes, instanceTransforms, instanceNodes);
+
+	ret.m_meshes.resize(uniqueMeshes.size());
+	std::vector<size_t> meshWork(uniqueMeshes.size());
+	std::iota(meshWork.begin(), meshWork.end(), size_t(0));
+	QtConcurrent::blockingMap(meshWork, [&](size_t i) {
+		ret.m_meshes[i] = DecodeProxyMesh(pScene->mMeshes[uniqueMeshes[i]]);
+		const std::vector<QMatrix4x4>& instances = instanceTransforms[i];
+		if (instances.size() == 1) {
+			ret.m_meshes[i].m_transform = instances.front();
+		}
+		else {
+			ret.m_meshes[i].m_instanceTransforms = instances;
+		}
+	});
 
-	ret.Finalize();
 	return ret;
 }
+
+size_t ModelLoader::CountTriangles(aiScene const* pScene)
+{
+	size_t count = 0;
+	for (uint i = 0; pScene && i < pScene->mNumMeshes; ++i) {
+		aiMesh const* pMesh = pScene->mMeshes[i];
+		for (uint j = 0; j < pMesh->mNumFaces; ++j) {
+			const uint numIndices = pMesh->mFaces[j].mNumIndices;
+			count += numIndices >= 3 ? numIndices - 2 : 0;
+		}
+	}
+	return count;
+}
+
+std::vector<MeshData> ModelLoader::SplitMesh(const MeshData& mesh, int maxTriangles)
+{
+	const int triangleCount = mesh.m_indexCount / 3;
+	if (maxTriangles <= 0 || triangleCount <= maxTriangles) {
+		return { mesh };
+	}
+
+	// Vertices are either interleaved or stored a block per attribute, in the order DecodeMesh
+	// writes them. Separate blocks start with the positions.
+	const int positionBytes = mesh.m_numPositionComponents * (mesh.m_positionType == GL_UNSIGNED_SHORT ? int(sizeof(quint16)) : int(sizeof(float)));
+	const int vertexCount = mesh.m_vertexStride > 0 ? mesh.m_vertexData.size() / mesh.m_vertexStride
+		: positionBytes > 0 ? int(mesh.m_normalOffset) / positionBytes : 0;
+	if (vertexCount == 0) {
+		return { mesh };
+	}
+	const char* pVertices = mesh.m_vertexData.constData();
+	const char* pIndices = mesh.m_indexData.constData();
+	auto Position = [&](quint32 v) {
+		const char* pSrc = pVertices + mesh.m_positionOffset + size_t(v) * size_t(mesh.m_vertexStride > 0 ? mesh.m_vertexStride : positionBytes);
+		if (mesh.m_positionType == GL_UNSIGNED_SHORT) {
+			quint16 q[3];
+			memcpy(q, pSrc, sizeof(q));
+			return mesh.m_positionDecode.map(QVector3D(q[0], q[1], q[2]) / 65535.f);
+		}
+		float p[3];
+		memcpy(p, pSrc, sizeof(p));
+		return QVector3D(p[0], p[1], p[2]);
+	};
+	auto Index = [&](int i) {
+		if (mesh.m_indexType == GL_UNSIGNED_SHORT) {
+			quint16 index;
+			memcpy(&index, pIndices + size_t(i) * sizeof(quint16), sizeof(index));
+			return quint32(index);
+		}
+		quint32 index;
+		memcpy(&index, pIndices + size_t(i) * sizeof(quint32), sizeof(index));
+		return index;
+	};
+	auto Center = [&](int firstIndex) {
+		return (Position(Index(firstIndex)) + Position(Index(firstIndex + 1)) + Position(Index(firstIndex + 2))) / 3.f;
+	};
+
+	// Split the full detail triangles, keeping the planes so the triangles of the coarser
+	// levels can be sorted into the same parts
+	struct Node {
+		int m_axis = 0;
+		float m_split = 0.f;
+		int m_left = -1;
+		int m_right = -1;
+		int m_part = -1;
+	};
+	std::vector<QVector3D> centers(triangleCount);
+	for (int t = 0; t < triangleCount; ++t) {
+		centers[t] = Center(3 * t);
+	}
+	std::vector<int> order(triangleCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::vector<Node> nodes(1);
+	std::vector<std::pair<int, int>> parts; // First entry in order and count
+	std::vector<std::array<int, 3>> work = { { 0, 0, triangleCount } }; // Node, first and count
+	while (!work.empty()) {
+		const std::array<int, 3> item = work.back();
+		work.pop_back();
+		const int nodeIdx = item[0];
+		const int first = item[1];
+		const int count = item[2];
+		if (count <= maxTriangles) {
+			nodes[nodeIdx].m_part = int(parts.size());
+			parts.push_back({ first, count });
+			continue;
+		}
+
+		QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+		QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int i = first; i < first + count; ++i) {
+			const QVector3D& c = centers[order[i]];
+			min = QVector3D(std::min(min.x(), c.x()), std::min(min.y(), c.y()), std::min(min.z(), c.z()));
+			max = QVector3D(std::max(max.x(), c.x()), std::max(max.y(), c.y()), std::max(max.z(), c.z()));
+		}
+		const QVector3D extent = max - min;
+		const int axis = (extent.x() >= extent.y() && extent.x() >= extent.z()) ? 0 : (extent.y() >= extent.z() ? 1 : 2);
+		const int half = count / 2;
+		std::nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count, [&](int a, int b) {
+			return centers[a][axis] < centers[b][axis];
+		});
+
+		Node& node = nodes[nodeIdx];
+		node.m_axis = axis;
+		node.m_split = centers[order[first + half]][axis];
+		node.m_left = int(nodes.size());
+		node.m_right = int(nodes.size()) + 1;
+		work.push_back({ node.m_right, first + half, count - half });
+		work.push_back({ node.m_left, first, half });
+		nodes.resize(nodes.size() + 2);
+	}
+	auto PartOf = [&](const QVector3D& center) {
+		int nodeIdx = 0;
+		while (nodes[nodeIdx].m_part < 0) {
+			const Node& node = nodes[nodeIdx];
+			nodeIdx = center[node.m_axis] < node.m_split ? node.m_left : node.m_right;
+		}
+		return nodes[nodeIdx].m_part;
+	};
+
+	// Neighboring parts may pick different levels, which can leave small cracks between them
+	const int levelCount = int(mesh.m_lods.size());
+	std::vector<std::vector<std::vector<int>>> levelTriangles(parts.size(), std::vector<std::vector<int>>(levelCount));
+	for (int level = 0; level < levelCount; ++level) {
+		const MeshLod& lod = mesh.m_lods[level];
+		for (int i = lod.m_firstIndex; i + 2 < lod.m_firstIndex + lod.m_indexCount; i += 3) {
+			levelTriangles[PartOf(Center(i))][level].push_back(i);
+		}
+	}
+
+	// Where each attribute block starts and ends, when they aren't interleaved
+	const size_t blockOffsets[4] = { mesh.m_positionOffset, mesh.m_normalOffset, mesh.m_uvOffset, mesh.m_colorOffset };
+	const size_t blockEnds[4] = { mesh.m_normalOffset, mesh.m_uvOffset, mesh.m_colorOffset, size_t(mesh.m_vertexData.size()) };
+	const int vertexBytes = mesh.m_vertexData.size() / vertexCount;
+
+	std::vector<MeshData> ret;
+	ret.reserve(parts.size());
+	std::vector<int> remap(vertexCount, -1);
+	for (size_t partIdx = 0; partIdx < parts.size(); ++partIdx) {
+		// Each part keeps the original order of its triangles, which was optimized for the cache
+		const int first = parts[partIdx].first;
+		const int count = parts[partIdx].second;
+		std::sort(order.begin() + first, order.begin() + first + count);
+
+		std::vector<quint32> vertices; // Index in mesh of each vertex of the part
+		std::vector<quint32> indices;
+		auto AddTriangle = [&](int firstIndex) {
+			for (int k = 0; k < 3; ++k) {
+				const quint32 v = Index(firstIndex + k);
+				if (remap[v] < 0) {
+					remap[v] = int(vertices.size());
+					vertices.push_back(v);
+				}
+				indices.push_back(quint32(remap[v]));
+			}
+		};
+
+		MeshData part = mesh;
+		part.m_pMapping.reset();
+		part.m_lods.clear();
+		for (int i = first; i < first + count; ++i) {
+			AddTriangle(3 * order[i]);
+		}
+		part.m_indexCount = int(indices.size());
+		for (int level = 0; level < levelCount; ++level) {
+			const int firstIndex = int(indices.size());
+			for (int i : levelTriangles[partIdx][level]) {
+				AddTriangle(i);
+			}
+			if (int(indices.size()) > firstIndex) {
+				part.m_lods.push_back({ firstIndex, int(indices.size()) - firstIndex });
+			}
+		}
+
+		// Copy the vertices the part uses
+		const int partVertexCount = int(vertices.size());
+		part.m_vertexData = QByteArray(vertexBytes * partVertexCount, Qt::Uninitialized);
+		char* pDest = part.m_vertexData.data();
+		if (mesh.m_vertexStride > 0) {
+			for (int v = 0; v < partVertexCount; ++v) {
+				memcpy(pDest + size_t(v) * vertexBytes, pVertices + size_t(vertices[v]) * vertexBytes, vertexBytes);
+			}
+		}
+		else {
+			size_t partOffsets[4];
+			size_t destOffset = 0;
+			for (int block = 0; block < 4; ++block) {
+				const size_t size = (blockEnds[block] - blockOffsets[block]) / size_t(vertexCount);
+				for (int v = 0; size > 0 && v < partVertexCount; ++v) {
+					memcpy(pDest + destOffset + size_t(v) * size, pVertices + blockOffsets[block] + size_t(vertices[v]) * size, size);
+				}
+				partOffsets[block] = destOffset;
+				destOffset += size * partVertexCount;
+			}
+			part.m_positionOffset = partOffsets[0];
+			part.m_normalOffset = partOffsets[1];
+			part.m_uvOffset = partOffsets[2];
+			part.m_colorOffset = partOffsets[3];
+		}
+
+		// Parts are small enough that most fit 16 bit indices, even if the mesh didn't
+		part.m_indexType = (partVertexCount <= 0x10000) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+		if (part.m_indexType == GL_UNSIGNED_SHORT) {
+			part.m_indexData = QByteArray(int(indices.size() * sizeof(quint16)), Qt::Uninitialized);
+			std::copy(indices.begin(), indices.end(), reinterpret_cast<quint16*>(part.m_indexData.data()));
+		}
+		else {
+			part.m_indexData = QByteArray(reinterpret_cast<const char*>(indices.data()), int(indices.size() * sizeof(quint32)));
+		}
+
+		QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+		QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (quint32 v : vertices) {
+			const QVector3D p = Position(v);
+			min = QVector3D(std::min(min.x(), p.x()), std::min(min.y(), p.y()), std::min(min.z(), p.z()));
+			max = QVector3D(std::max(max.x(), p.x()), std::max(max.y(), p.y()), std::max(max.z(), p.z()));
+			remap[v] = -1;
+		}
+		part.m_AABBMin = min;
+		part.m_AABBMax = max;
+
+		// The part's triangles are in a different order, so it gets meshlets of its own
+		part.m_meshlets.clear();
+		if (!mesh.m_meshlets.empty()) {
+			std::vector<QVector3D> positions(partVertexCount);
+			for (int v = 0; v < partVertexCount; ++v) {
+				positions[v] = Position(vertices[v]);
+			}
+			part.m_meshlets = Meshlets::Build(positions, indices.data(), part.m_indexCount);
+		}
+		ret.push_back(std::move(part));
+	}
+	return ret;
+}
+
+MeshData ModelLoader::DecodeProxyMesh(aiMesh const* pMesh)
+{
+	MeshData newMesh;
+	newMesh.m_name = QString::fromUtf8(pMesh->mName.C_Str());
+	newMesh.m_material = int(pMesh->mMaterialIndex);
+
+	// The bounding boxes are generated by post-processing, so the AABB comes from the vertices.
+	// It matches the one of the full model, which keeps the view the same when it is swapped in.
+	const uint vertexCount = pMesh->mNumVertices;
+	if (vertexCount == 0) {
+		return newMesh;
+	}
+	static_assert(sizeof(aiVector3D) == 3 * sizeof(float), "Vertices are read as packed floats");
+	newMesh.m_AABBMin = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+	newMesh.m_AABBMax = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	BoundsMath::AddPoints(&pMesh->mVertices[0].x, vertexCount, 3, newMesh.m_AABBMin, newMesh.m_AABBMax);
+
+	// A surface cut by a grid of n cells along its longest axis keeps roughly 6 n^2 triangles.
+	// The grid is sized so the proxy has about 1 / k_proxyReduction of the mesh's triangles.
+	size_t triangleCount = 0;
+	for (uint j = 0; j < pMesh->mNumFaces; ++j) {
+		const uint numIndices = pMesh->mFaces[j].mNumIndices;
+		triangleCount += numIndices >= 3 ? numIndices - 2 : 0;
+	}
+	const int cells = qBound(2, int(std::sqrt(float(triangleCount) / (6.f * k_proxyReduction))), k_proxyMaxCells);
+	// Merge the vertices of each cell into one at their average position
+	size_t clusterCount = 0;
+	const std::vector<quint32> vertexClusters = ClusterVertices(pMesh->mVertices, vertexCount, min, max, cells, clusterCount);
+	std::vector<aiVector3D> positions(clusterCount, aiVector3D(0.f, 0.f, 0.f));
+	std::vector<uint> clusterSizes(clusterCount, 0);
+	for (uint v = 0; v < vertexCount; ++v) {
+		positions[vertexClusters[v]] += pMesh->mVertices[v];
+		clusterSizes[vertexClusters[v]] += 1;
+	}
+	for (size_t c = 0; c < clusterCount; ++c) {
+		positions[c] /= float(clusterSizes[c]);
+	}
+
+	// Fan triangulate the faces and keep the triangles between three different clusters. The
+	// normals are accumulated from the triangles, weighted by their area.
+	std::vector<quint32> fan;
+	fan.reserve(triangleCount * 3);
+	for (uint j = 0; j < pMesh->mNumFaces; ++j) {
+		aiFace const& face = pMesh->mFaces[j];
+		for (uint k = 2; k < face.mNumIndices; ++k) {
+			fan.push_back(face.mIndices[0]);
+			fan.push_back(face.mIndices[k - 1]);
+			fan.push_back(face.mIndices[k]);
+		}
+	}
+	const std::vector<quint32> indices = CollapseTriangles(fan, vertexClusters);
+	std::vector<aiVector3D> normals(clusterCount, aiVector3D(0.f, 0.f, 0.f));
+	for (size_t i = 0; i < indices.size(); i += 3) {
+		const quint32 a = indices[i];
+		const quint32 b = indices[i + 1];
+		const quint32 c = indices[i + 2];
+		const aiVector3D n = (positions[b] - positions[a]) ^ (positions[c] - positions[a]);
+		normals[a] += n;
+		normals[b] += n;
+		normals[c] += n;
+	}
+
+	// Interleaved float positions and normals
+	newMesh.m_hasNormals = true;
+	newMesh.m_numPositionComponents = 3;
+	newMesh.m_numNormalComponents = 3;
+	newMesh.m_vertexStride = 6 * sizeof(float);
+	newMesh.m_positionOffset = 0;
+	newMesh.m_normalOffset = 3 * sizeof(float);
+	newMesh.m_uvOffset = newMesh.m_vertexStride;
+	newMesh.m_colorOffset = newMesh.m_vertexStride;
+	newMesh.m_vertexData.resize(int(clusterCount) * newMesh.m_vertexStride);
+	float* pVertices = reinterpret_cast<float*>(newMesh.m_vertexData.data());
+	for (size_t c = 0; c < clusterCount; ++c) {
+		aiVector3D n = normals[c];
+		n = n.SquareLength() > 0.f ? n.Normalize() : aiVector3D(0.f, 0.f, 1.f);
+		const float vertex[6] = { positions[c].x, positions[c].y, positions[c].z, n.x, n.y, n.z };
+		memcpy(pVertices + 6 * c, vertex, sizeof(vertex));
+	}
+
+	newMesh.m_indexCount = int(indices.size());
+	newMesh.m_indexType = (clusterCount <= 0x10000) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	if (newMesh.m_indexType == GL_UNSIGNED_SHORT) {
+		newMesh.m_indexData.resize(newMesh.m_indexCount * sizeof(quint16));
+		std::copy(indices.begin(), indices.end(), reinterpret_cast<quint16*>(newMesh.m_indexData.data()));
+	}
+	else {
+		newMesh.m_indexData.resize(newMesh.m_indexCount * sizeof(quint32));
+		memcpy(newMesh.m_indexData.data(), indices.data(), newMesh.m_indexData.size());
+	}
+
+	return newMesh;
+}
@@ -1,18 +1,180 @@
 #pragma once
+#include <array>
+#include <atomic>
+#include <memory>
 #include <vector>
 
 #include <QString>
 #include <QOpenGLBuffer>
 #include <QVector3D>
+#include <QVector4D>
 #include <QMatrix4x4>
 #include <QOpenGLTexture>
+#include <QOpenGLVertexArrayObject>
+#include <QSharedPointer>
+#include <QByteArray>
+#include <QImage>
+
+#include "BoundsMath.h"
+#include "CompressedTexture.h"
+#include "ModelStats.h"
+
+class GeometryArena;
+class GeometryStreamer;
+class ImportTrace;
+class QFile;
+class SceneGraph;
+class VirtualTexture;
+struct Skeleton;
 
 struct aiScene;
 struct aiNode;
+struct aiMaterial;
+struct aiMesh;
+struct aiTexture;
+template <typename TReal> class aiMatrix4x4t;
+namespace Assimp {
+	class Importer;
+	class ProgressHandler;
+}
+
+// A coarser version of a mesh, drawn from the part of the index buffer it covers
+struct MeshLod {
+	int m_firstIndex = 0;
+	int m_indexCount = 0;
+};
+
+// A short run of a mesh's full detail triangles with bounds of its own in the mesh's space,
+// so parts of a large mesh can be culled. The normals of the triangles lie within the cone
+// around m_coneAxis whose half angle has the cosine m_coneCos, -1 when they point every way.
+struct Meshlet {
+	int m_firstIndex = 0;
+	int m_indexCount = 0;
+	QVector3D m_center;
+	float m_radius = 0.f;
+	QVector3D m_coneAxis;
+	float m_coneCos = -1.f;
+};
+
+// A node of the Skeleton that pulls on a skinned mesh's vertices. The offset matrix moves them
+// from the mesh into the node's space at rest. The box holds the vertices it pulls on, in the
+// mesh's space, and is empty if there are none.
+struct MeshBone {
+	int m_node = -1;
+	QMatrix4x4 m_offset;
+	QVector3D m_min;
+	QVector3D m_max;
+};
+
+// A blend shape of a mesh. The box holds how far it moves the vertices at full weight, in the
+// mesh's space, and m_weight is how much of it the mesh shows when no clip moves it.
+struct MorphTarget {
+	float m_weight = 0.f;
+	QVector3D m_min;
+	QVector3D m_max;
+};
+
+// What kind of light a SceneLight is
+enum SceneLightType : int {
+	k_lightPoint = 0,
+	k_lightSpot = 1,
+	k_lightDirectional = 2,
+};
+
+// A light imported with the scene, in model space. The color includes the light's intensity,
+// which falls off as 1 / (constant + linear * distance + quadratic * distance^2) for point and
+// spot lights. The cone angles are the full angles of a spot light, in radians: it is at full
+// strength inside the inner one and fades out toward the outer one.
+struct SceneLight {
+	int m_type = k_lightPoint;
+	QVector3D m_position;
+	QVector3D m_direction = QVector3D(0.f, 0.f, -1.f);
+	QVector3D m_color = QVector3D(1.f, 1.f, 1.f);
+	QVector3D m_attenuation = QVector3D(1.f, 0.f, 0.f);
+	float m_innerCone = 0.f;
+	float m_outerCone = 0.f;
+};
+
+// The maps a material can have, all read with the mesh's first set of UVs
+enum MaterialMap : int {
+	k_baseColorMap = 0,
+	k_normalMap = 1, // In tangent space, the tangents are derived per pixel from the UVs
+	k_metallicRoughnessMap = 2, // Roughness in green and metalness in blue, packed as in glTF
+	k_occlusionMap = 3, // In red
+	k_emissiveMap = 4,
+	k_materialMapCount = 5,
+};
+
+// How a material's alpha is applied. Opaque materials ignore it, masked ones are cut out where
+// it is below their cutoff, like foliage, and blended ones are see-through and drawn in the
+// transparent pass.
+enum AlphaMode : int {
+	k_alphaOpaque = 0,
+	k_alphaMask = 1,
+	k_alphaBlend = 2,
+};
+
+// The colors and factors of a material. Materials with m_metallicRoughness, such as those of
+// glTF, are shaded from their base color, metalness and roughness. The others keep the
+// viewer's specular color and shininess, and a white base color so the texture or vertex
+// colors show as they are. The phong colors are kept for shaders reading them.
+struct MaterialProperties {
+	GLfloat m_ambient[4] = {};
+	GLfloat m_specular[4] = {};
+	GLfloat m_diffuse[4] = {};
+	GLfloat m_shininess = 0.f;
+
+	bool m_metallicRoughness = false;
+	QVector4D m_baseColor = QVector4D(1.f, 1.f, 1.f, 1.f);
+	float m_metallic = 1.f;
+	float m_roughness = 1.f;
+	QVector3D m_emissive;
+
+	// The opacity is the base color's alpha, times the alpha of the base color map
+	AlphaMode m_alphaMode = k_alphaOpaque;
+	float m_alphaCutoff = 0.5f;
+};
+
+// A material on the GPU, stored once and shared by every mesh using it
+struct Material {
+	QString m_name;
+	MaterialProperties m_properties;
+
+	// Null for the maps the material doesn't have. Shared with the other materials using the
+	// same image through the TextureCache.
+	QSharedPointer<QOpenGLTexture> m_maps[k_materialMapCount];
+
+	// Resident bindless handles of the maps, which shaders built with bindless textures
+	// sample instead of the bound maps. 0 without GL_ARB_bindless_texture.
+	GLuint64 m_handles[k_materialMapCount] = {};
+
+	// The pages of a base color map too large to upload whole, m_maps then holds its tail.
+	// Null for every other material.
+	QSharedPointer<VirtualTexture> m_virtualBaseColor;
+
+	// The material as a MaterialBlock for shaders that declare it. Not created without
+	// uniform buffer support.
+	QOpenGLBuffer m_buffer;
+};
+
+// A mesh's GPU resources are all reference counted handles: the buffers, the vertex array
+// object and, through its material, the textures. A copy shares them and the last one to go
+// frees them, with the context they were created in current. Copying is how a ModelScene
+// shares meshes between its models and the composed one, anywhere else meshes are moved.
+// Normals of a mesh in the layout of its vertex buffer, one after the other. Each is kept once
+// it was needed, so switching between them only writes the other one back.
+struct NormalStreams {
+	QByteArray m_loaded;
+	QByteArray m_smooth;
+
+	// Set while the vertex buffer holds the smooth normals
+	bool m_smoothed = false;
+};
 
 struct Mesh {
 	// Stores vertex attribute data
 	QOpenGLBuffer m_vertexBuffer;
+	int m_vertexStride = 0; // 0 when each attribute is tightly packed in its own block
 	size_t m_positionOffset;
 	size_t m_normalOffset;
 	size_t m_uvOffset;
@@ -24,20 +186,97 @@ struct Mesh {
 	int m_numUVComponents;
 	int m_numColorComponents;
 
+	// Component types of the attributes, anything other than float is normalized by the vertex fetch
+	GLenum m_positionType = GL_FLOAT;
+	GLenum m_normalType = GL_FLOAT;
+	GLenum m_uvType = GL_FLOAT;
+	GLenum m_colorType = GL_FLOAT;
+
+	// Skinned meshes store the 4 bones that pull on each vertex the most as 8 bit indices into
+	// m_bones, and how much each one does as normalized 8 bit weights
+	bool m_hasBones = false;
+	size_t m_boneIndexOffset = 0;
+	size_t m_boneWeightOffset = 0;
+	std::vector<MeshBone> m_bones;
+
+	// The skeleton m_bones refer to, and the matrices of the bones in its current pose as a
+	// BonePalette uniform block. Null for meshes without bones.
+	QSharedPointer<const Skeleton> m_skeleton;
+	QOpenGLBuffer m_boneBuffer;
+
+	// Blend shapes of the mesh, moved by the morph channels of m_morphNode. m_morphBuffer holds
+	// a position and a normal offset as two vec4 per vertex, target after target, and
+	// m_morphWeights the weights of the current pose. Meshes with targets also have bones.
+	std::vector<MorphTarget> m_morphTargets;
+	int m_morphNode = -1;
+	std::vector<float> m_morphWeights;
+	QOpenGLBuffer m_morphBuffer;
+
+	// Set while a ComputeSkinner poses the mesh. m_vao then reads the skinned positions and
+	// normals it wrote, and the shaders draw them as they are.
+	bool m_computeSkinned = false;
+
+	// Maps quantized positions back into the mesh's space. Identity unless positions are quantized.
+	QMatrix4x4 m_positionDecode;
+
+	// The normals the Smoothing switch swaps in and out of the vertex buffer, see
+	// GpuModelBuilder::SmoothNormals. Null for meshes without normals. Copies of the mesh
+	// share them like they share the buffer.
+	QSharedPointer<NormalStreams> m_normalStreams;
+
+	// Holds the buffer bindings and attribute setup. Null if vertex array objects are not supported.
+	QSharedPointer<QOpenGLVertexArrayObject> m_vao;
+
+	// Meshes referenced by several nodes are stored once and drawn once per instance transform.
+	// Empty when the mesh is only drawn once with m_transform.
+	std::vector<QMatrix4x4> m_instanceTransforms;
+
+	// The SceneGraph node placing each instance, or the one node placing a mesh drawn once.
+	// Empty for meshes no single node places: skinned meshes and merged batches.
+	std::vector<int> m_nodes;
+
+	// The draws a SceneGraph hid, by instance, or draw 0 of a mesh drawn once, and how many
+	// are set. Empty while none is, every pass then draws the mesh without looking further.
+	std::vector<bool> m_hiddenDraws;
+	int m_hiddenDrawCount = 0;
+
+	int DrawCount() const { return m_instanceTransforms.empty() ? 1 : int(m_instanceTransforms.size()); }
+	bool IsHidden() const { return m_hiddenDrawCount > 0 && m_hiddenDrawCount == DrawCount(); }
+
+	// Per instance transforms for instanced draws. m_instanced is set when the vertex array
+	// object feeds them to the instance attribute.
+	QOpenGLBuffer m_instanceBuffer;
+	bool m_instanced = false;
+
 	// Stores the indices in order to generate faces
 	QOpenGLBuffer m_indexBuffer;
 	int m_indexCount;
+	GLenum m_indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT when the mesh has few enough vertices
+
+	// Where the mesh starts in its buffers. Meshes suballocated from a GeometryArena share its
+	// pages with other meshes, the others own their buffers and start at 0.
+	bool m_sharesBuffers = false;
+	GLint m_baseVertex = 0;
+	int m_indexOffset = 0; // In bytes
+	int m_vertexBytes = 0;
+	int m_indexBytes = 0;
+	int m_vertexCount = 0;
 
-	// Define material properties
-	GLfloat m_ambient[4];
-	GLfloat m_specular[4];
-	GLfloat m_diffuse[4];
-	GLfloat m_shininess;
+	// Levels of detail from finest to coarsest, stored after the full detail indices and using
+	// the same vertices. Empty when the mesh is always drawn in full.
+	std::vector<MeshLod> m_lods;
 
-	// We only allow 1 texture per mesh for now. Usually there are not more.
-	QOpenGLTexture* m_texture = nullptr;
+	// The full detail indices in runs that are culled on their own. Empty for small meshes.
+	std::vector<Meshlet> m_meshlets;
 
-	// Keep track of what features this mesh has
+	// Name of the mesh in the source file, shown when the mesh is picked
+	QString m_name;
+
+	// Shared with the other meshes of the same material. Null only for meshes that failed to build.
+	QSharedPointer<const Material> m_material;
+
+	// Keep track of what features this mesh has. m_hasTexture is set when the material has a
+	// base color map.
 	bool m_hasNormals;
 	bool m_hasUVCoordinates;
 	bool m_hasColors;
@@ -46,29 +285,198 @@ struct Mesh {
 	// Store the transformation matrix for this mesh
 	QMatrix4x4 m_transform;
 
+	// Where a ModelScene put the model of this mesh. It is already part of m_transform and
+	// m_instanceTransforms, instanced draws read m_instanceBuffer and apply it themselves.
+	QMatrix4x4 m_placement;
+
 	// Define 2 points, the min and max of the axis aligned bounding box
 	QVector3D m_AABBMin;
 	QVector3D m_AABBMax;
+
+	// The bounding box in the mesh's own space, which the one above is worked out from again
+	// when a node of the SceneGraph moves it
+	QVector3D m_localAABBMin;
+	QVector3D m_localAABBMax;
+};
+
+// A decoded texture, already mirrored for OpenGL. Meshes using the same key share one GPU texture.
+// DDS and KTX files are kept block compressed instead of being decoded to m_image.
+struct TextureData {
+	QString m_key;
+	QImage m_image;
+	CompressedImage m_compressed;
+
+	// The PageFile of a base color map too large to upload whole, whose pages VirtualTextures
+	// streams in as the view needs them. m_image then holds its tail.
+	QString m_pageFile;
+
+	bool isNull() const { return m_image.isNull() && m_compressed.isNull(); }
+
+	// The mapped region of a ModelCache file the image data points into, if any
+	QSharedPointer<const uchar> m_pMapping;
+};
+
+// CPU side copy of a material, decoded once per aiMaterial
+struct MaterialData {
+	QString m_name;
+	MaterialProperties m_properties;
+
+	// Null images for the maps the material doesn't have. Maps of the same image have the same key.
+	TextureData m_maps[k_materialMapCount];
+};
+
+// CPU side copy of a mesh, decoded from the scene without touching OpenGL
+struct MeshData {
+	// Vertex attributes packed into one block, laid out as described by the stride and offsets
+	QByteArray m_vertexData;
+	int m_vertexStride = 0;
+	size_t m_positionOffset = 0;
+	size_t m_normalOffset = 0;
+	size_t m_uvOffset = 0;
+	size_t m_colorOffset = 0;
+
+	int m_numPositionComponents = 0;
+	int m_numNormalComponents = 0;
+	int m_numUVComponents = 0;
+	int m_numColorComponents = 0;
+
+	GLenum m_positionType = GL_FLOAT;
+	GLenum m_normalType = GL_FLOAT;
+	GLenum m_uvType = GL_FLOAT;
+	GLenum m_colorType = GL_FLOAT;
+	QMatrix4x4 m_positionDecode;
+
+	// Bone indices and weights, see Mesh. Skinned meshes are posed by their bones alone, so
+	// their transform is identity and they have no instances.
+	bool m_hasBones = false;
+	size_t m_boneIndexOffset = 0;
+	size_t m_boneWeightOffset = 0;
+	std::vector<MeshBone> m_bones;
+
+	// Blend shapes, see Mesh. The offsets are stored like m_morphBuffer in m_morphData.
+	std::vector<MorphTarget> m_morphTargets;
+	int m_morphNode = -1;
+	QByteArray m_morphData;
+
+	// Index block holding m_indexCount indices of m_indexType
+	QByteArray m_indexData;
+	int m_indexCount = 0;
+	GLenum m_indexType = GL_UNSIGNED_INT;
+	std::vector<MeshLod> m_lods;
+	std::vector<Meshlet> m_meshlets;
+
+	// The mapped region of a ModelCache file the vertex and index blocks point into, if any.
+	// Releasing the mesh data after its upload unmaps it.
+	QSharedPointer<const uchar> m_pMapping;
+
+	QString m_name;
+
+	// Index into ModelData::m_materials, -1 for none
+	int m_material = -1;
+
+	std::vector<QMatrix4x4> m_instanceTransforms;
+	std::vector<int> m_nodes; // See Mesh
+
+	bool m_hasNormals = false;
+	bool m_hasUVCoordinates = false;
+	bool m_hasColors = false;
+
+	QMatrix4x4 m_transform;
+
+	QVector3D m_AABBMin;
+	QVector3D m_AABBMax;
+};
+
+struct ModelData {
+	std::vector<MeshData> m_meshes;
+
+	// The materials of the scene, in the order of aiScene::mMaterials
+	std::vector<MaterialData> m_materials;
+
+	// The node tree and animations of the scene. Null unless a mesh has bones.
+	QSharedPointer<const Skeleton> m_skeleton;
+
+	// The node tree at rest, which the meshes' m_nodes point into. Null for models that weren't
+	// decoded from a scene.
+	QSharedPointer<const SceneGraph> m_sceneGraph;
+
+	// The point, spot and directional lights of the scene
+	std::vector<SceneLight> m_lights;
+
+	// The point of the file that was moved to the origin, see ModelLoader::FindOrigin. Adding
+	// it to a point of the model gives the point in the file's coordinates.
+	std::array<double, 3> m_origin = {};
+
+	// Set when the model was read from the ModelCache. The vertex, index and texture data
+	// then point into mapped regions of this file, which is closed with the last of them.
+	QSharedPointer<QFile> m_pMappedFile;
+
+	// Counted once the meshes are decoded or read from the cache
+	ModelStats m_stats;
 };
 
 struct Model {
 	bool m_isValid = false;
 	std::vector<Mesh> m_meshes;
 
+	// The materials the meshes point to, see ModelData
+	std::vector<QSharedPointer<const Material>> m_materials;
+
+	// The pages the meshes are suballocated from. Null when every mesh owns its buffers.
+	QSharedPointer<GeometryArena> m_geometry;
+
+	// Set when the model is too big to upload at once. The meshes then only get buffers while
+	// the streamer keeps them resident, and are skipped while they have none.
+	QSharedPointer<GeometryStreamer> m_streamer;
+
+	// What the skinned meshes are posed by, see ModelData
+	QSharedPointer<const Skeleton> m_skeleton;
+
+	// The node tree at rest, see ModelData
+	QSharedPointer<const SceneGraph> m_sceneGraph;
+
+	// The lights of the scene, see ModelData
+	std::vector<SceneLight> m_lights;
+
+	// Where the model was moved from, see ModelData
+	std::array<double, 3> m_origin = {};
+
+	// Counts of the meshes and materials, see ModelData
+	ModelStats m_stats;
+
 	// Define 2 points, the min and max of the axis aligned bounding box
 	QVector3D m_AABBMin;
 	QVector3D m_AABBMax;
 
+	// Grows min and max to contain the box from boxMin to boxMax moved by transform. A rotated
+	// box can reach further than its transformed min and max.
+	static void AddTransformedAABB(const QMatrix4x4& transform, const QVector3D& boxMin, const QVector3D& boxMax, QVector3D& min, QVector3D& max) {
+		BoundsMath::AddTransformedBox(transform, boxMin, boxMax, min, max);
+	}
+
 	void Finalize() {
-		// Scale the AABB by the transformation matrix
+		// Move the AABBs into model space. Instanced meshes cover the AABBs of all of their instances.
 		for (auto& it : m_meshes) {
-			it.m_AABBMin = it.m_transform * it.m_AABBMin;
-			it.m_AABBMax = it.m_transform * it.m_AABBMax;
+			if (it.m_hasBones) {
+				it.m_skeleton = m_skeleton;
+			}
+			it.m_localAABBMin = it.m_AABBMin;
+			it.m_localAABBMax = it.m_AABBMax;
+			QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+			QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+			if (it.m_instanceTransforms.empty()) {
+				AddTransformedAABB(it.m_transform, it.m_AABBMin, it.m_AABBMax, min, max);
+			}
+			for (const QMatrix4x4& transform : it.m_instanceTransforms) {
+				AddTransformedAABB(transform, it.m_AABBMin, it.m_AABBMax, min, max);
+			}
+			it.m_AABBMin = min;
+			it.m_AABBMax = max;
 		}
 
 		// Compute the AABB for the entire model
 		m_AABBMin = { FLT_MAX, FLT_MAX, FLT_MAX };
-		m_AABBMax = { FLT_MIN, FLT_MIN, FLT_MIN };
+		m_AABBMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
 
 		for (auto& it : m_meshes) {
 			m_AABBMin[0] = std::min(m_AABBMin[0], it.m_AABBMin[0]);
@@ -86,14 +494,249 @@ struct Model {
 	}
 };
 
+// Assimp post-processing presets, from only the steps drawing needs to everything the viewer uses
+enum class ImportProfile {
+	FastPreview,
+	Balanced,
+	Quality,
+	Custom,
+};
+
+// Time spent in one stage of an import, the file read or a post-processing step
+struct ImportStepTime {
+	const char* m_name = nullptr;
+	float m_seconds = 0.f;
+};
+
+// Choices made when decoding a model. These are read from the settings on the GUI thread
+// so the decoding itself never touches QSettings.
+struct LoadOptions {
+	// Store all attributes of a vertex together rather than in separate blocks
+	bool m_interleaved = true;
+
+	// Store packed 10:10:10:2 normals, half float UVs and RGBA8 colors instead of floats
+	bool m_quantize = false;
+
+	// Also store positions as 16 bit integers relative to the mesh's AABB. Only used with m_quantize.
+	bool m_quantizePositions = false;
+
+	// Pre-transform the vertices and merge meshes that share a material into one mesh, so
+	// they are drawn together. Individual meshes can no longer be told apart.
+	bool m_batchStatic = false;
+
+	// Simplify large meshes to about half, a quarter and a tenth of their triangles, so
+	// meshes that cover few pixels can be drawn with fewer triangles
+	bool m_generateLods = true;
+
+	// Split meshes with more triangles than this into spatially compact clusters, which can be
+	// culled, simplified and streamed on their own. 0 keeps every mesh whole.
+	int m_clusterTriangles = 0;
+
+	// Reorder triangles for the post-transform vertex cache and vertices for fetch locality.
+	// Optionally also sort clusters of triangles so the outward facing ones are drawn first,
+	// which lets the depth test reject more of the surfaces behind them.
+	bool m_optimizeVertexCache = true;
+	bool m_optimizeOverdraw = false;
+
+	// Divide the triangles of large meshes into meshlets with bounding spheres and normal
+	// cones, so the parts of a mesh that are off screen or face away can be skipped
+	bool m_buildMeshlets = true;
+
+	// Post-processing applied on import. Custom runs the aiPostProcessSteps flags in
+	// m_customImportSteps on top of the steps drawing needs.
+	ImportProfile m_importProfile = ImportProfile::Quality;
+	unsigned int m_customImportSteps = 0;
+
+	// Read glTF files with GltfLoader rather than Assimp's importer, which is kept for the
+	// files it can't read. They are decoded without the import profile's post-processing.
+	bool m_nativeGltf = true;
+
+	// Parse text OBJ, PLY and STL files on every core with TextModelLoader rather than with
+	// Assimp's importer, which is kept for the files it can't read. Also decoded without the
+	// import profile's post-processing, and not used when the profile asks for smooth normals.
+	bool m_parallelText = true;
+
+	// Read the decoded model from the ModelCache if it is there, and store it there otherwise.
+	// Only used by AsyncModelLoader, and not part of the cache key.
+	bool m_useCache = false;
+
+	// Store vertices and indices in the cache coded by GeometryCodec, which about halves their
+	// size at the cost of decoding them on load instead of mapping them. Entries are read either
+	// way. Not part of the cache key.
+	bool m_compressCache = false;
+
+	// Keep the imported scene around so exporting is instant. Without it the scene is freed
+	// right after decoding, which roughly halves resident memory for large models, and the
+	// file is imported again on export. Only used by AsyncModelLoader.
+	bool m_keepScene = true;
+
+	// Show a coarse proxy of large models while the full model is post-processed and
+	// uploaded. Only used by AsyncModelLoader.
+	bool m_previewProxy = true;
+
+	// Models whose vertices and indices take more bytes than this are streamed through a
+	// GeometryStreamer with this budget instead of being uploaded whole. 0 uploads everything.
+	// Only used by AsyncModelLoader, and not part of the cache key.
+	qint64 m_streamingBudget = 0;
+
+	// Stream every model through a GeometryStreamer, not only the ones over the streaming
+	// budget, so the first frames upload just the meshes in view and the rest follow as they
+	// come into view. Without a streaming budget nothing is freed again. Only used by
+	// AsyncModelLoader, and not part of the cache key.
+	bool m_lazyUpload = false;
+
+	// GPU memory the model may take before AsyncModelLoader warns that uploading it goes over
+	// the memory budget, -1 for no limit. The model is uploaded either way.
+	qint64 m_uploadBudget = -1;
+
+	// Bytes of texels AsyncModelLoader streams into textures each time it gets to upload, so
+	// large textures are spread over several frames. 0 uploads every texture at once.
+	qint64 m_textureUploadBudget = 4 * 1024 * 1024;
+
+	// Base color maps with a side longer than this, PageFile::k_tailSize at least, are cut
+	// into a PageFile that VirtualTextures streams into a fixed budget, so a scan's gigapixel
+	// textures take as much GPU memory as any other. Only their tail is decoded for the model.
+	// Block compressed files and raw embedded texels are uploaded whole. 0 pages nothing.
+	int m_virtualTextureSize = 4096;
+
+	// Where page files are kept, PageFile::DefaultFolder() if empty
+	QString m_pageFolder;
+};
+
+// Where a material's map comes from, either a file on disk or data embedded in the scene
+struct TextureReference {
+	QString m_key;
+	QString m_path;
+	aiTexture const* m_pEmbedded = nullptr;
+};
+
+// A single reference from a node in the scene to one of the meshes in aiScene::mMeshes
+struct MeshReference {
+	uint m_meshIdx;
+	QMatrix4x4 m_transform;
+	int m_node = -1; // In the SceneGraph the references were collected into
+};
+
 class ModelLoader
 {
 public:
-	static Model LoadModel(const QString& file);
+	static Model LoadModel(const QString& file, const LoadOptions& options = LoadOptions());
+
+	// Exports the current scene to a file the user picks, blocking until it is written
 	static bool ExportModel(const QString& path);
 
+	// Asks for the file to export to, starting in folder, and the Assimp format id its suffix
+	// stands for. False if the user cancelled or picked no supported format.
+	static bool ChooseExportFile(const QString& folder, QString& filepath, QString& formatId);
+
+	// The importer of the scene being viewed. It is shared, so an export on a worker thread
+	// keeps the scene alive while another model replaces it. Null if the scene wasn't kept,
+	// CurrentFile() is then imported again to export it. Empty once nothing is loaded.
+	static std::shared_ptr<const Assimp::Importer> CurrentImporter();
+	static QString CurrentFile();
+
+	// Memory Assimp reports the kept scene takes, 0 if none is kept
+	static qint64 CurrentSceneBytes();
+
+	// Imports and decodes a file without keeping the scene around. Does not need a context.
+	static ModelData DecodeFile(const QString& file, const LoadOptions& options = LoadOptions());
+
+	// Same for the coarse proxy of DecodeProxy, the file is read without any post-processing
+	static ModelData DecodeProxyFile(const QString& file);
+
+	// Loading can also be done in stages so the slow parts stay off the GUI thread:
+	//   1. ImportScene() reads and post-processes the file. The caller keeps ownership of pProgress.
+	//   2. DecodeModel() copies the meshes, materials and textures out of the scene.
+	//   3. SetCurrentScene() adopts the importer so the scene can be exported later.
+	//   4. GpuModelBuilder uploads the decoded model, which requires a current context.
+	// Steps 1 and 2 do not touch OpenGL and are safe to call from a worker thread.
+	// The post-processing steps run one at a time, and the time each took is added to pTimings.
+	// Normals and joining identical vertices are done by NormalGenerator on every core, unless
+	// it leaves the scene to Assimp's steps.
+	// With pTrace the stages and the meshes and textures decoded are added to it as they run.
+	// ImportScene() is ReadScene() followed by PostProcessScene(), which can also be called
+	// separately to look at the scene as it was read.
+	// Loads are cancelled through pProgress: Assimp stops reading once its Update() returns
+	// false, and PostProcessScene() asks it before every step. DecodeModel() skips the textures
+	// and meshes it hasn't started once *pCancelled is set, and returns an empty model.
+	static Assimp::Importer* ImportScene(const QString& file, Assimp::ProgressHandler* pProgress = nullptr, unsigned int flags = ImportFlags(), std::vector<ImportStepTime>* pTimings = nullptr, ImportTrace* pTrace = nullptr);
+	static Assimp::Importer* ReadScene(const QString& file, Assimp::ProgressHandler* pProgress = nullptr, std::vector<ImportStepTime>* pTimings = nullptr, ImportTrace* pTrace = nullptr);
+	static void PostProcessScene(Assimp::Importer* pImporter, unsigned int flags, Assimp::ProgressHandler* pProgress = nullptr, std::vector<ImportStepTime>* pTimings = nullptr, ImportTrace* pTrace = nullptr);
+	static ModelData DecodeModel(aiScene const* pScene, const QString& file, const LoadOptions& options = LoadOptions(), const std::atomic<bool>* pCancelled = nullptr, ImportTrace* pTrace = nullptr);
+	static void SetCurrentScene(Assimp::Importer* pNewImporter, const QString& file);
+
+	// Coarse stand in for a scene straight from ReadScene(), shown while the full model is
+	// still being post-processed. The vertices of every mesh are clustered on a grid over its
+	// AABB, so it needs neither triangulated faces nor normals. Textures are left out.
+	static ModelData DecodeProxy(aiScene const* pScene);
+
+	// Number of triangles of the scene once its polygons are triangulated
+	static size_t CountTriangles(aiScene const* pScene);
+
+	// The middle of the scene's bounds rounded to whole units, for scenes further from the
+	// origin than k_rebaseRatio times their radius, such as georeferenced ones. Zero for the
+	// rest. The decoded model is moved by minus this point, so its floats keep the detail
+	// they would lose that far out. The node transforms are put together in double precision
+	// before the point is taken off.
+	static std::array<double, 3> FindOrigin(aiScene const* pScene);
+	static constexpr double k_rebaseRatio = 100.0;
+
+	// The triangles of mesh split at the median of their centers along the longest axis until
+	// no part has more than maxTriangles. Each part gets the vertices its triangles use, and
+	// the triangles of every level of detail whose center falls into it. Returns just mesh
+	// if it is small enough already.
+	static std::vector<MeshData> SplitMesh(const MeshData& mesh, int maxTriangles);
+
+	// For models whose scene was not kept, because they were read from the ModelCache or
+	// loaded with LoadOptions::m_keepScene off. The file is imported again for each export.
+	static void SetCurrentFile(const QString& file);
+
+	// Post-processing flags of the import profile chosen in options
+	static unsigned int ImportFlags(const LoadOptions& options = LoadOptions());
+
+	// Post-processing steps that can be picked for ImportProfile::Custom
+	struct ImportStep {
+		unsigned int m_flag;
+		const char* m_name;
+	};
+	static const std::vector<ImportStep>& CustomImportSteps();
+
 private:
-	static Mesh ProcessMesh(aiScene const* pObject, uint meshIdx);
-	static void TraverseNodeTree(aiNode const* pNode, aiScene const* pObject, Model& model, QMatrix4x4 transform);
-	static Model ProcessModel(aiScene const* pScene);
+	// Adds pNode and the nodes below it to graph under parent, and the meshes they reference
+	// with their transforms in model space, moved by minus origin. parentWorld is the transform
+	// of parent in the file's coordinates.
+	static void TraverseNodeTree(aiNode const* pNode, int parent, const aiMatrix4x4t<double>& parentWorld, const std::array<double, 3>& origin, std::vector<MeshReference>& meshes, SceneGraph& graph);
+
+	// The node tree of the scene and its animations, its root moved by minus origin.
+	// meshNodes gets the first node referencing each mesh, or -1.
+	static QSharedPointer<Skeleton> DecodeSkeleton(aiScene const* pScene, const std::array<double, 3>& origin, std::vector<int>& meshNodes);
+
+	// The point, spot and directional lights of the scene, placed by their nodes
+	static std::vector<SceneLight> DecodeLights(aiScene const* pScene, const std::array<double, 3>& origin);
+
+	static std::vector<MeshReference> CollectMeshes(aiScene const* pScene, const std::array<double, 3>& origin, SceneGraph& graph);
+	static void GroupInstances(const std::vector<MeshReference>& refs, std::vector<uint>& uniqueMeshes, std::vector<std::vector<QMatrix4x4>>& instanceTransforms, std::vector<std::vector<int>>& instanceNodes);
+	// Where the model file is, looked up once per load. Texture files are searched for in its
+	// folder, which can be in an archive or on a server, embedded textures are keyed by its path.
+	struct ModelLocation {
+		QString m_folder;
+		QString m_key;
+	};
+
+	// The textures map can come from, of the texture types glTF, FBX and OBJ files store it
+	// as, most specific first. They are tried in turn until one decodes. Files that can't be
+	// found are left out, empty if the material has none.
+	static std::vector<TextureReference> ResolveMaterialMap(aiScene const* pScene, aiMaterial const* pMaterial, MaterialMap map, const ModelLocation& model);
+	// Textures larger than pagedSize are paged into pageFolder, see LoadOptions::m_virtualTextureSize
+	static TextureData DecodeTexture(const TextureReference& ref, int pagedSize = 0, const QString& pageFolder = QString());
+
+	// The name, colors and factors of every material, without their maps
+	static std::vector<MaterialData> DecodeMaterials(aiScene const* pScene);
+
+	// Meshes with bones are skinned by pSkeleton, vertices no bone pulls on follow meshNode.
+	// Without a skeleton they are decoded as they are at rest.
+	static MeshData DecodeMesh(aiMesh const* pMesh, const QMatrix4x4& transform, const LoadOptions& options, const Skeleton* pSkeleton = nullptr, int meshNode = -1);
+	static std::vector<std::vector<MeshReference>> GroupForBatching(aiScene const* pScene, const std::vector<MeshReference>& refs);
+	static MeshData DecodeBatch(aiScene const* pScene, const std::vector<MeshReference>& batch, const LoadOptions& options);
+	static MeshData DecodeProxyMesh(aiMesh const* pMesh);
 };
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "ModelPrewarmer.h"
+
+#include <assimp/Importer.hpp>
+#include <assimp/ProgressHandler.hpp>
+
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+
+#include <vector>
+
+namespace {
+	// Files are read in chunks of this size, cancelling is checked between them
+	const qint64 k_readChunkBytes = 1024 * 1024;
+
+	// Stops Assimp once warming is cancelled
+	class PrewarmProgressHandler : public Assimp::ProgressHandler
+	{
+	public:
+		explicit PrewarmProgressHandler(const std::atomic<bool>& cancelled)
+			: m_cancelled(cancelled) {}
+
+		bool Update(float) override {
+			return !m_cancelled;
+		}
+
+	private:
+		const std::atomic<bool>& m_cancelled;
+	};
+
+	// Reads the whole file so the OS keeps its pages cached, returns false if cancelled
+	bool ReadThrough(const QString& path, const std::atomic<bool>& cancelled)
+	{
+		QFile file(path);
+		if (!file.open(QIODevice::ReadOnly)) {
+			return false;
+		}
+		std::vector<char> buffer(k_readChunkBytes);
+		while (!cancelled && file.read(buffer.data(), k_readChunkBytes) > 0) {
+		}
+		return !cancelled;
+	}
+}
+
+ModelPrewarmer::ModelPrewarmer(const QString& cacheFolder)
+	: m_cache(cacheFolder)
+{
+}
+
+ModelPrewarmer::~ModelPrewarmer()
+{
+	Cancel();
+	m_future.waitForFinished();
+}
+
+void ModelPrewarmer::Cancel()
+{
+	m_cancel.Cancel();
+}
+
+bool ModelPrewarmer::IsRunning() const
+{
+	return m_future.isRunning();
+}
+
+void ModelPrewarmer::Start(const QStringList& files, const LoadOptions& options, qint64 budgetBytes)
+{
+	Cancel();
+	if (budgetBytes <= 0 || files.isEmpty()) {
+		return;
+	}
+
+	// One job that warms one file at a time, it is the loads the user asks for that need the
+	// cores. Queued behind every other job.
+	m_cancel = CancelToken();
+	const CancelToken token = m_cancel;
+	const ModelCache cache = m_cache;
+	m_future = JobSystem::Run(JobPriority::Prewarm, [files, options, budgetBytes, cache, token] {
+		QThread::currentThread()->setPriority(QThread::LowestPriority);
+		qint64 remaining = budgetBytes;
+		for (const QString& file : files) {
+			if (token.IsCancelled() || remaining <= 0) {
+				break;
+			}
+			remaining -= Warm(file, options, remaining, cache, *token.Flag());
+		}
+		QThread::currentThread()->setPriority(QThread::NormalPriority);
+	});
+}
+
+qint64 ModelPrewarmer::Warm(const QString& file, const LoadOptions& options, qint64 budgetBytes, const ModelCache& cache, const std::atomic<bool>& cancelled)
+{
+	const QFileInfo source(file);
+	if (!source.exists() || cancelled) {
+		return 0;
+	}
+
+	// Without the cache the loader reads the source, which is all there is to warm
+	if (!options.m_useCache) {
+		return (source.size() <= budgetBytes && ReadThrough(file, cancelled)) ? source.size() : 0;
+	}
+
+	// A valid entry only needs its pages read. Load checks the entry against the file.
+	const QString entryPath = cache.EntryPath(file, options);
+	ModelData cached;
+	if (cache.Load(file, options, cached)) {
+		cached = ModelData();
+		const qint64 entryBytes = QFileInfo(entryPath).size();
+		return (entryBytes <= budgetBytes && ReadThrough(entryPath, cancelled)) ? entryBytes : 0;
+	}
+
+	// Otherwise the entry is written the way the loader would write it. Decoding takes some
+	// multiple of the source size in memory, so sources over the budget are left to the loader.
+	if (source.size() > budgetBytes) {
+		return 0;
+	}
+	PrewarmProgressHandler progress(cancelled);
+	std::unique_ptr<Assimp::Importer> pImporter(ModelLoader::ImportScene(file, &progress, ModelLoader::ImportFlags(options)));
+	if (cancelled || !pImporter->GetScene()) {
+		return 0;
+	}
+	const ModelData data = ModelLoader::DecodeModel(pImporter->GetScene(), file, options, &cancelled);
+	pImporter.reset();
+	if (cancelled || !cache.Store(file, options, data)) {
+		return 0;
+	}
+
+	// The entry was just written, its pages are still cached
+	return QFileInfo(entryPath).size();
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <atomic>
+
+#include <QFuture>
+#include <QStringList>
+
+#include "JobSystem.h"
+#include "ModelCache.h"
+#include "ModelLoader.h"
+
+// Gets the recent files ready to open while the viewer sits idle. Files with a valid ModelCache
+// entry have the entry read once, so the pages the loader maps are in the OS file cache.
+// Files without one are imported and decoded to write it. With the cache off only the source
+// file is read. The work is a single job of the lowest priority, on a low priority thread, that
+// warms one file at a time and stops once the files it warmed take up the budget.
+class ModelPrewarmer
+{
+public:
+	// Startup usually settles within this long, warming starts after it
+	static const int k_idleDelayMs = 2000;
+
+	explicit ModelPrewarmer(const QString& cacheFolder = ModelCache::DefaultFolder());
+	~ModelPrewarmer();
+
+	// Cancels warming still running and starts on files, most recent first, until they take
+	// budgetBytes
+	void Start(const QStringList& files, const LoadOptions& options, qint64 budgetBytes);
+	void Cancel();
+	bool IsRunning() const;
+
+	// Warms file if that takes at most budgetBytes, returning the bytes it took. Returns 0 if
+	// it was skipped, failed, or cancelled was set meanwhile.
+	static qint64 Warm(const QString& file, const LoadOptions& options, qint64 budgetBytes, const ModelCache& cache, const std::atomic<bool>& cancelled);
+
+private:
+	ModelCache m_cache;
+	QFuture<void> m_future;
+
+	// Each run has its own token, so a run that is winding down can't see the next one's
+	CancelToken m_cancel;
+};
@@ -0,0 +1,178 @@
+#include "ModelScene.h"
+#include "GpuModelBuilder.h"
+
+#include <QHash>
+
+#include <algorithm>
+#include <cfloat>
+
+namespace {
+	// Space left between a model and the ones it is placed beside, as a share of the wider one
+	const float k_placementGap = 0.1f;
+}
+
+int ModelScene::Add(Model model, const QString& name, const QMatrix4x4& placement)
+{
+	if (!model.m_isValid) {
+		return 0;
+	}
+	Entry entry;
+	entry.m_id = m_nextId++;
+	entry.m_name = name;
+	entry.m_model = std::move(model);
+	entry.m_placement = placement;
+	m_entries.push_back(std::move(entry));
+	return m_entries.back().m_id;
+}
+
+void ModelScene::SetPrimary(Model model, const QString& name)
+{
+	if (!model.m_isValid) {
+		if (!m_entries.empty()) {
+			m_entries.erase(m_entries.begin());
+		}
+		return;
+	}
+	if (m_entries.empty()) {
+		Add(std::move(model), name);
+		return;
+	}
+
+	// The primary model keeps its id and placement, so it can be removed the same way
+	m_entries.front().m_name = name;
+	m_entries.front().m_model = std::move(model);
+}
+
+bool ModelScene::Remove(int id)
+{
+	const auto it = std::find_if(m_entries.begin(), m_entries.end(), [id](const Entry& entry) { return entry.m_id == id; });
+	if (it == m_entries.end()) {
+		return false;
+	}
+	m_entries.erase(it);
+	return true;
+}
+
+void ModelScene::Clear()
+{
+	m_entries.clear();
+}
+
+bool ModelScene::IsEmpty() const
+{
+	return m_entries.empty();
+}
+
+const std::vector<ModelScene::Entry>& ModelScene::Entries() const
+{
+	return m_entries;
+}
+
+void ModelScene::SetTexture(const QSharedPointer<QOpenGLTexture>& texture, TextureCache& textures)
+{
+	// Each material is copied once, its meshes keep sharing the copy
+	for (Entry& entry : m_entries) {
+		QHash<const Material*, QSharedPointer<const Material>> copies;
+		for (QSharedPointer<const Material>& material : entry.m_model.m_materials) {
+			QSharedPointer<const Material>& copy = copies[material.data()];
+			copy = GpuModelBuilder::WithBaseColorMap(*material, texture, textures);
+			material = copy;
+		}
+		for (Mesh& mesh : entry.m_model.m_meshes) {
+			if (mesh.m_material.isNull()) {
+				continue;
+			}
+			QSharedPointer<const Material>& copy = copies[mesh.m_material.data()];
+			if (copy.isNull()) {
+				copy = GpuModelBuilder::WithBaseColorMap(*mesh.m_material, texture, textures);
+			}
+			mesh.m_material = copy;
+			mesh.m_hasTexture = true;
+		}
+	}
+}
+
+Model ModelScene::Compose() const
+{
+	Model composed;
+	composed.m_AABBMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+	composed.m_AABBMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+	size_t meshCount = 0;
+	for (const Entry& entry : m_entries) {
+		meshCount += entry.m_model.m_meshes.size();
+	}
+	composed.m_meshes.reserve(meshCount);
+
+	for (const Entry& entry : m_entries) {
+		composed.m_stats.Add(entry.m_model.m_stats, int(composed.m_materials.size()));
+		composed.m_materials.insert(composed.m_materials.end(), entry.m_model.m_materials.begin(), entry.m_model.m_materials.end());
+		const QMatrix4x4& placement = entry.m_placement;
+		const bool placed = !placement.isIdentity();
+		for (Mesh mesh : entry.m_model.m_meshes) {
+			// The bounds are already in model space, only the placement is left to apply.
+			// Instanced draws take their transforms from the instance buffer, so they apply
+			// m_placement on their own.
+			if (placed) {
+				mesh.m_placement = placement * mesh.m_placement;
+				mesh.m_transform = placement * mesh.m_transform;
+				for (QMatrix4x4& transform : mesh.m_instanceTransforms) {
+					transform = placement * transform;
+				}
+				QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+				QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+				Model::AddTransformedAABB(placement, mesh.m_AABBMin, mesh.m_AABBMax, min, max);
+				mesh.m_AABBMin = min;
+				mesh.m_AABBMax = max;
+			}
+			for (int i = 0; i < 3; ++i) {
+				composed.m_AABBMin[i] = std::min(composed.m_AABBMin[i], mesh.m_AABBMin[i]);
+				composed.m_AABBMax[i] = std::max(composed.m_AABBMax[i], mesh.m_AABBMax[i]);
+			}
+			composed.m_meshes.push_back(std::move(mesh));
+		}
+		for (SceneLight light : entry.m_model.m_lights) {
+			if (placed) {
+				light.m_position = placement.map(light.m_position);
+				light.m_direction = placement.mapVector(light.m_direction).normalized();
+			}
+			composed.m_lights.push_back(light);
+		}
+	}
+	composed.m_isValid = !composed.m_meshes.empty();
+
+	// The models beside it are placed in the coordinates of the primary one
+	if (!m_entries.empty()) {
+		composed.m_origin = m_entries.front().m_model.m_origin;
+	}
+
+	// Arenas stay with the models that suballocate from them. A model shown on its own is
+	// composed into itself, and may keep streaming.
+	if (m_entries.size() == 1) {
+		composed.m_geometry = m_entries.front().m_model.m_geometry;
+		composed.m_streamer = m_entries.front().m_model.m_streamer;
+	}
+	return composed;
+}
+
+QMatrix4x4 ModelScene::PlaceBeside(const QVector3D& min, const QVector3D& max) const
+{
+	QMatrix4x4 placement;
+	if (m_entries.empty()) {
+		return placement;
+	}
+
+	QVector3D sceneMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D sceneMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const Entry& entry : m_entries) {
+		Model::AddTransformedAABB(entry.m_placement, entry.m_model.m_AABBMin, entry.m_model.m_AABBMax, sceneMin, sceneMax);
+	}
+
+	// To the right of everything, on the lowest floor, centered in depth
+	const float gap = k_placementGap * std::max(sceneMax.x() - sceneMin.x(), max.x() - min.x());
+	placement.translate(
+		sceneMax.x() + gap - min.x(),
+		sceneMin.y() - min.y(),
+		(sceneMin.z() + sceneMax.z() - min.z() - max.z()) * 0.5f);
+	return placement;
+}
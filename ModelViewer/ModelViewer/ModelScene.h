@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector3D>
+
+#include "ModelLoader.h"
+
+class QOpenGLTexture;
+class TextureCache;
+
+// The models shown together, such as a part with a reference primitive beside it. Each model
+// keeps the buffers and arena it was uploaded with, the textures are shared through the one
+// TextureCache and the shaders are the viewer's. Compose() returns a Model holding the meshes
+// of all of them, placed, which only copies their GPU handles, so adding or removing a model
+// never uploads the others again.
+// The first model is the primary one, the one a load replaces. Only a model shown on its own
+// keeps its GeometryStreamer, which addresses meshes by their index in the streamed model.
+// Dropping a model frees its buffers, so changes are made with the viewer's context current.
+class ModelScene
+{
+public:
+	struct Entry {
+		int m_id = 0;
+		QString m_name;
+		Model m_model;
+
+		// Where the scene puts the model, applied on top of its own mesh transforms
+		QMatrix4x4 m_placement;
+	};
+
+	// Adds model at placement and returns its id. Invalid models are not added, 0 is returned.
+	// The scene takes the model, pass a copy to keep sharing its buffers with the caller.
+	int Add(Model model, const QString& name, const QMatrix4x4& placement = QMatrix4x4());
+
+	// Replaces the primary model, or adds model to an empty scene. An invalid model removes the
+	// primary one.
+	void SetPrimary(Model model, const QString& name);
+	bool Remove(int id);
+	void Clear();
+
+	bool IsEmpty() const;
+	const std::vector<Entry>& Entries() const;
+
+	// Gives every material of every model texture as its base color map. Needs the context
+	// current, the materials are copied with buffers of their own.
+	void SetTexture(const QSharedPointer<QOpenGLTexture>& texture, TextureCache& textures);
+
+	// The meshes of all models in order, moved by their placement, with the bounds of them all
+	Model Compose() const;
+
+	// A placement that sets a model with the bounds min and max beside the models already in
+	// the scene, standing on the same floor. Identity in an empty scene.
+	QMatrix4x4 PlaceBeside(const QVector3D& min, const QVector3D& max) const;
+
+private:
+	std::vector<Entry> m_entries;
+	int m_nextId = 1;
+};
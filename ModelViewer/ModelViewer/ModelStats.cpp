@@ -0,0 +1,163 @@
+#include "ModelStats.h"
+#include "ModelLoader.h"
+#include "TextureCache.h"
+
+#include <QLocale>
+#include <QSet>
+#include <QtConcurrent/QtConcurrent>
+
+#include <cstring>
+#include <numeric>
+
+
+ModelStats ModelStats::Compute(const ModelData& data)
+{
+	ModelStats stats;
+	stats.m_meshStats.resize(data.m_meshes.size());
+	std::vector<size_t> meshWork(data.m_meshes.size());
+	std::iota(meshWork.begin(), meshWork.end(), size_t(0));
+	QtConcurrent::blockingMap(meshWork, [&](size_t i) {
+		stats.m_meshStats[i] = ComputeMesh(data.m_meshes[i]);
+	});
+
+	QSet<int> materials;
+	for (const MeshStats& mesh : stats.m_meshStats) {
+		stats.m_meshes += 1;
+		stats.m_instances += mesh.m_instances;
+		stats.m_vertices += mesh.m_vertices;
+		stats.m_meshTriangles += mesh.m_triangles;
+		stats.m_triangles += qint64(mesh.m_triangles) * mesh.m_instances;
+		stats.m_degenerateTriangles += mesh.m_degenerateTriangles;
+		stats.m_vertexBytes += mesh.m_vertexBytes;
+		stats.m_indexBytes += mesh.m_indexBytes;
+		if (mesh.m_material >= 0) {
+			materials.insert(mesh.m_material);
+		}
+	}
+	stats.m_materials = materials.size();
+
+	// Maps of the same image share one texture, estimated the way the caches do
+	QSet<QString> keys;
+	for (const MaterialData& material : data.m_materials) {
+		for (const TextureData& map : material.m_maps) {
+			if (map.isNull() || keys.contains(map.m_key)) {
+				continue;
+			}
+			keys.insert(map.m_key);
+			stats.m_textureBytes += map.m_compressed.isNull() ? TextureCache::EstimateBytes(map.m_image) : TextureCache::EstimateBytes(map.m_compressed);
+		}
+	}
+	stats.m_textures = keys.size();
+	return stats;
+}
+
+MeshStats ModelStats::ComputeMesh(const MeshData& mesh)
+{
+	MeshStats stats;
+	stats.m_name = mesh.m_name;
+	stats.m_triangles = mesh.m_indexCount / 3;
+	stats.m_instances = mesh.m_instanceTransforms.empty() ? 1 : int(mesh.m_instanceTransforms.size());
+	stats.m_material = mesh.m_material;
+	stats.m_vertexBytes = mesh.m_vertexData.size();
+	stats.m_indexBytes = mesh.m_indexData.size();
+	stats.m_lods = int(mesh.m_lods.size());
+	stats.m_meshlets = int(mesh.m_meshlets.size());
+
+	// Separate attribute blocks start with the positions, so their size gives the vertex count
+	const bool quantized = mesh.m_positionType == GL_UNSIGNED_SHORT;
+	const int positionBytes = mesh.m_numPositionComponents * (quantized ? int(sizeof(quint16)) : int(sizeof(float)));
+	if (mesh.m_vertexStride > 0) {
+		stats.m_vertices = mesh.m_vertexData.size() / mesh.m_vertexStride;
+	}
+	else if (positionBytes > 0) {
+		stats.m_vertices = int(mesh.m_normalOffset) / positionBytes;
+	}
+	if (mesh.m_numPositionComponents < 3 || mesh.m_indexData.size() < qint64(mesh.m_indexCount) * (mesh.m_indexType == GL_UNSIGNED_SHORT ? 2 : 4)) {
+		return stats;
+	}
+
+	const char* pVertices = mesh.m_vertexData.constData();
+	const char* pIndices = mesh.m_indexData.constData();
+	const size_t vertexStride = size_t(mesh.m_vertexStride > 0 ? mesh.m_vertexStride : positionBytes);
+	auto Position = [&](quint32 v) {
+		const char* pSrc = pVertices + mesh.m_positionOffset + size_t(v) * vertexStride;
+		if (quantized) {
+			quint16 q[3];
+			memcpy(q, pSrc, sizeof(q));
+			return mesh.m_positionDecode.map(QVector3D(q[0], q[1], q[2]) / 65535.f);
+		}
+		float p[3];
+		memcpy(p, pSrc, sizeof(p));
+		return QVector3D(p[0], p[1], p[2]);
+	};
+	auto Index = [&](int i) {
+		if (mesh.m_indexType == GL_UNSIGNED_SHORT) {
+			quint16 index;
+			memcpy(&index, pIndices + size_t(i) * sizeof(quint16), sizeof(index));
+			return quint32(index);
+		}
+		quint32 index;
+		memcpy(&index, pIndices + size_t(i) * sizeof(quint32), sizeof(index));
+		return index;
+	};
+
+	// Only the full detail triangles count, the levels of detail are simplified from them
+	for (int t = 0; t < stats.m_triangles; ++t) {
+		const quint32 a = Index(t * 3);
+		const quint32 b = Index(t * 3 + 1);
+		const quint32 c = Index(t * 3 + 2);
+		if (a == b || b == c || a == c) {
+			++stats.m_degenerateTriangles;
+			continue;
+		}
+		if (a >= quint32(stats.m_vertices) || b >= quint32(stats.m_vertices) || c >= quint32(stats.m_vertices)) {
+			continue;
+		}
+		const QVector3D pa = Position(a);
+		if (QVector3D::crossProduct(Position(b) - pa, Position(c) - pa).isNull()) {
+			++stats.m_degenerateTriangles;
+		}
+	}
+	return stats;
+}
+
+void ModelStats::Add(const ModelStats& other, int materialOffset)
+{
+	m_meshes += other.m_meshes;
+	m_instances += other.m_instances;
+	m_vertices += other.m_vertices;
+	m_meshTriangles += other.m_meshTriangles;
+	m_triangles += other.m_triangles;
+	m_degenerateTriangles += other.m_degenerateTriangles;
+	m_materials += other.m_materials;
+	m_textures += other.m_textures;
+	m_textureBytes += other.m_textureBytes;
+	m_vertexBytes += other.m_vertexBytes;
+	m_indexBytes += other.m_indexBytes;
+	m_meshStats.reserve(m_meshStats.size() + other.m_meshStats.size());
+	for (MeshStats mesh : other.m_meshStats) {
+		if (mesh.m_material >= 0) {
+			mesh.m_material += materialOffset;
+		}
+		m_meshStats.push_back(mesh);
+	}
+}
+
+QString ModelStats::Report() const
+{
+	const QLocale locale;
+	const auto megabytes = [](qint64 bytes) { return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 1); };
+	return QString("Meshes: %1, drawn %2 times\nVertices: %3\nTriangles: %4, drawn %5\nDegenerate triangles: %6\n"
+		"Materials: %7\nTextures: %8, %9 MB\nVertex data: %10 MB\nIndex data: %11 MB")
+		.arg(locale.toString(m_meshes))
+		.arg(locale.toString(m_instances))
+		.arg(locale.toString(m_vertices))
+		.arg(locale.toString(m_meshTriangles))
+		.arg(locale.toString(m_triangles))
+		.arg(locale.toString(m_degenerateTriangles))
+		.arg(m_materials)
+		.arg(m_textures)
+		.arg(megabytes(m_textureBytes))
+		.arg(megabytes(m_vertexBytes))
+		.arg(megabytes(m_indexBytes));
+}
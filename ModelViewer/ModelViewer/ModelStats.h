@@ -0,0 +1,65 @@
+#pragma once
+#include <QString>
+#include <QtGlobal>
+
+#include <vector>
+
+struct MeshData;
+struct ModelData;
+
+// What one mesh of a model holds, and what drawing it takes
+struct MeshStats {
+	QString m_name;
+	int m_vertices = 0;
+	int m_triangles = 0;
+
+	// Triangles with two corners at the same vertex or position, which cover no pixels
+	int m_degenerateTriangles = 0;
+
+	// Copies of the mesh drawn, more than 1 for instanced meshes
+	int m_instances = 1;
+
+	// Index into the model's materials, -1 for none
+	int m_material = -1;
+
+	qint64 m_vertexBytes = 0;
+	qint64 m_indexBytes = 0;
+	int m_lods = 0;
+	int m_meshlets = 0;
+};
+
+// Counts of a model, taken once when it is decoded so nothing that shows them has to walk the
+// meshes again. A scene adds up the statistics of its models.
+struct ModelStats {
+	int m_meshes = 0;
+	int m_instances = 0;
+	qint64 m_vertices = 0;
+
+	// Triangles as stored, and as drawn with every copy of the instanced meshes
+	qint64 m_meshTriangles = 0;
+	qint64 m_triangles = 0;
+	qint64 m_degenerateTriangles = 0;
+
+	// Materials some mesh uses, and the distinct images of all maps with the GPU memory
+	// they are estimated to take
+	int m_materials = 0;
+	int m_textures = 0;
+	qint64 m_textureBytes = 0;
+
+	qint64 m_vertexBytes = 0;
+	qint64 m_indexBytes = 0;
+
+	// In the order of the model's meshes
+	std::vector<MeshStats> m_meshStats;
+
+	// The meshes are counted on the thread pool
+	static ModelStats Compute(const ModelData& data);
+	static MeshStats ComputeMesh(const MeshData& mesh);
+
+	// Adds the counts of another model, whose meshes go after these and whose materials
+	// start at materialOffset
+	void Add(const ModelStats& other, int materialOffset);
+
+	// A line per count, as the inspector shows them
+	QString Report() const;
+};
@@ -1,8 +1,14 @@
 #include "ModelViewer.h"
 #include "ViewerGraphicsWindow.h"
 #include "GraphicsWindowDelegate.h"
+#include "JobSystem.h"
 #include "SettingsMenu.h"
 #include "UniformController.h"
+#include "BatchConverter.h"
+#include "ModelBrowser.h"
+#include "SceneOutliner.h"
+#include "Primitives.h"
+#include "StartupTrace.h"
 
 #include <QWidget>
 #include <QLayout>
@@ -14,7 +20,29 @@
 #include <QUrl>
 #include <QSplitter>
 #include <QDesktopServices>
-#include <QSettings>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QDir>
+#include <QAction>
+#include <QFutureWatcher>
+#include <QInputDialog>
+#include <QMessageBox>
+#include <QCheckBox>
+#include <QDialog>
+#include <QDoubleSpinBox>
+#include <QFormLayout>
+#include <QGridLayout>
+#include <QLocale>
+#include <QPushButton>
+#include <QSlider>
+#include <QProgressDialog>
+#include <QStatusBar>
+#include <QTableWidget>
+#include <QHeaderView>
+#include <QTimer>
+#include <QVBoxLayout>
+
+#include <memory>
 
 ModelViewer::ModelViewer(QWidget *parent)
     : QMainWindow(parent)
@@ -27,12 +55,19 @@ ModelViewer::ModelViewer(QWidget *parent)
     // Change the window title to our app name
     setWindowTitle("Model Viewer");
 
-    // Create a new graphics window, and set it as the central widget
+    // Create a new graphics window, and set it as the central widget. What the window draws
+    // besides the first frame is created once the landing page has been painted, and the
+    // settings menu when it is first opened.
+    ImportTrace::Sequence steps(StartupTrace::Active());
+    steps.Next("graphics window");
     m_pGraphicsWindow = new ViewerGraphicsWindow();
+    m_pGraphicsWindow->setDeferredResources(true);
+    steps.Next("landing page");
     m_pGraphicsWindowDelegate = new GraphicsWindowDelegate(m_pGraphicsWindow);
+    steps.Next("uniform panel");
     m_pGraphicsWindowUniform = new GraphicsWindowUniform(m_pGraphicsWindow);
-    m_pSettingsMenu = new SettingsMenu(m_pGraphicsWindow);
-    
+    steps.Next("menus");
+
     // Create a central widget with horizontal splitter so the user can resize the widgets
     QSplitter* pCentralWidget = new QSplitter(Qt::Orientation::Horizontal, this);
     setCentralWidget(pCentralWidget);
@@ -53,6 +88,13 @@ ModelViewer::ModelViewer(QWidget *parent)
     QMenu* pLoadMenu = pFileMenu->addMenu("Load");
     pLoadMenu->setObjectName("LoadMenu");
     pLoadMenu->addAction("Model", [=] {m_pGraphicsWindow->loadModel(); }, QKeySequence(Qt::CTRL + Qt::Key_O));
+    pLoadMenu->addAction("Model from URL...", [=] {
+        const QString url = QInputDialog::getText(this, "Load Model from URL", "http(s) URL of a model or a zip archive:").trimmed();
+        if (!url.isEmpty()) {
+            m_pGraphicsWindow->loadModel(url);
+        }
+    });
+    pLoadMenu->addAction("Browse Models...", [=] { ShowModelBrowser(); });
 
     QMenu* pShaderMenu = pLoadMenu->addMenu("Shader");
     pShaderMenu->addAction("Vertex", [=]{m_pGraphicsWindow->loadVertexShader(); });
@@ -60,34 +102,52 @@ ModelViewer::ModelViewer(QWidget *parent)
     pShaderMenu->addAction("Reload Current Shaders", [=]{m_pGraphicsWindow->reloadCurrentShaders(); });
 
     pLoadMenu->addAction("Texture", [=] {  m_pGraphicsWindow->loadTexture(); });
+    pLoadMenu->addAction("Environment", [=] { m_pGraphicsWindow->loadEnvironment(); });
 
     // Primitive
     QMenu* pPrimitiveMenu = pLoadMenu->addMenu("Primitive");
     pPrimitiveMenu->setObjectName("PrimitiveMenu");
-    pPrimitiveMenu->addAction("Sphere", [=]{m_pGraphicsWindow->addPrimitive("Sphere.obj"); });
-    pPrimitiveMenu->addAction("Cube", [=] {m_pGraphicsWindow->addPrimitive("Cube.obj"); });
-    pPrimitiveMenu->addAction("Torus", [=]{m_pGraphicsWindow->addPrimitive("Torus.obj"); });
-    pPrimitiveMenu->addAction("Cylinder", [=] {m_pGraphicsWindow->addPrimitive("Cylinder.obj"); });
+    // The basic shapes are generated, the diamond is only available as a file
+    for (PrimitiveShape shape : Primitives::Shapes()) {
+        pPrimitiveMenu->addAction(Primitives::Name(shape), [=] {m_pGraphicsWindow->addPrimitive(shape); });
+    }
     pPrimitiveMenu->addAction("Diamond", [=] {m_pGraphicsWindow->addPrimitive("diamond.obj"); });
-    pPrimitiveMenu->addAction("Tetrahedron", [=] {m_pGraphicsWindow->addPrimitive("Tetrahedron.obj"); });
-    pPrimitiveMenu->addAction("Octahedron", [=] {m_pGraphicsWindow->addPrimitive("Octahedron.stl"); });
-    pPrimitiveMenu->addAction("Icosahedron", [=] {m_pGraphicsWindow->addPrimitive("Icosahedron.stl"); });
-    pPrimitiveMenu->addAction("Dodecahedron", [=] {m_pGraphicsWindow->addPrimitive("Dodecahedron.stl"); });
 
     QMenu* pSaveMenu = pFileMenu->addMenu("Save");
     pSaveMenu->setObjectName("SaveMenu");
     pSaveMenu->addAction("Model", [=] { m_pGraphicsWindow->saveModel(); }, QKeySequence(Qt::CTRL + Qt::Key_S));
     pSaveMenu->addAction("Shader", [=] { /* TODO: m_pGraphicsWindow->saveShader(); */ }, QKeySequence(Qt::CTRL + Qt::Key_X));
+    pSaveMenu->addAction("Batch Convert...", [=] { BatchConvert(); });
 
     //Screenshot
     pFileMenu->addAction("Screenshot", [=] {  m_pGraphicsWindow->screenshotDialog(); }, QKeySequence(Qt::CTRL + Qt::Key_P));
+    pFileMenu->addAction("Export Poster...", [=] { ExportPoster(); });
+    pFileMenu->addAction("Export Turntable Video...", [=] { ExportVideo(true); });
+    pFileMenu->addAction("Export Camera Path Video...", [=] { ExportVideo(false); });
 
     // setings menu
-    pFileMenu->addAction("Settings", [=] { m_pSettingsMenu->show(); }, QKeySequence(Qt::Key_F1));
+    pFileMenu->addAction("Settings", [=] { GetSettingsWindow()->show(); }, QKeySequence(Qt::Key_F1));
 
     // Close
     pFileMenu->addAction("Close Model", [=] { m_pGraphicsWindow->unloadModel(); }, QKeySequence(Qt::CTRL + Qt::Key_W));
 
+    // Scene, listing the models shown so each can be removed on its own
+    QMenu* pSceneMenu = pFileMenu->addMenu("Scene");
+    pSceneMenu->setObjectName("SceneMenu");
+    pSceneMenu->addAction("Add Model...");
+    connect(pSceneMenu, &QMenu::aboutToShow, this, [=] {
+        pSceneMenu->clear();
+        pSceneMenu->addAction("Add Model...", [=] { m_pGraphicsWindow->addModel(); });
+        const std::vector<ModelScene::Entry>& entries = m_pGraphicsWindow->GetScene().Entries();
+        if (!entries.empty()) {
+            pSceneMenu->addSeparator();
+        }
+        for (const ModelScene::Entry& entry : entries) {
+            const int id = entry.m_id;
+            pSceneMenu->addAction(QString("Remove %1").arg(entry.m_name), [=] { m_pGraphicsWindow->removeFromScene(id); });
+        }
+    });
+
     // quit button
     pFileMenu->addAction("Quit", [=] { GetQuit();}, QKeySequence(Qt::CTRL + Qt::Key_Q));
     
@@ -99,6 +159,8 @@ ModelViewer::ModelViewer(QWidget *parent)
 
     pEditMenu->addAction("Shader File", [=] { m_pGraphicsWindow->openShaderFile(); });
     pEditMenu->addAction("Current Shaders", [=] { m_pGraphicsWindow->editCurrentShaders(); });
+    pEditMenu->addAction("Simplify Model...", [=] { ShowSimplifyPanel(); });
+    pEditMenu->addAction("Section Planes...", [=] { ShowSectionPanel(); });
 
     // -> View menu
     QMenu* pViewMenu = new FocusMenu(m_pGraphicsWindow, "View", this);
@@ -106,6 +168,196 @@ ModelViewer::ModelViewer(QWidget *parent)
     pViewMenu->setObjectName("ViewMenu");
     pViewMenu->addAction("Reset", [=] { m_pGraphicsWindow->resetView(); }, QKeySequence(Qt::CTRL + Qt::Key_R));
 
+    // Record the GPU time of each render pass until the action is used again, then save them
+    QAction* pTraceAction = pViewMenu->addAction("Record GPU Trace");
+    connect(pTraceAction, &QAction::triggered, this, [=] {
+        if (!m_pGraphicsWindow->GetGpuProfiler().IsTracing()) {
+            m_pGraphicsWindow->StartGpuTrace();
+            pTraceAction->setText("Save GPU Trace");
+            return;
+        }
+        const QString filepath = QFileDialog::getSaveFileName(nullptr, "Save GPU Trace", "gpu_trace.json", "Chrome Trace (*.json)");
+        if (!filepath.isEmpty()) {
+            m_pGraphicsWindow->SaveGpuTrace(filepath);
+            pTraceAction->setText("Record GPU Trace");
+        }
+    });
+
+    // Save every frame as an image sequence until the action is used again
+    QAction* pRecordAction = pViewMenu->addAction("Record Image Sequence");
+    connect(pRecordAction, &QAction::triggered, this, [=] {
+        if (m_pGraphicsWindow->IsRecordingFrames()) {
+            m_pGraphicsWindow->StopFrameRecording();
+            pRecordAction->setText("Record Image Sequence");
+            return;
+        }
+        const QString folder = QFileDialog::getExistingDirectory(nullptr, "Record Image Sequence", "../data/Screenshots/");
+        if (!folder.isEmpty()) {
+            m_pGraphicsWindow->StartFrameRecording(folder);
+            pRecordAction->setText("Stop Recording");
+        }
+    });
+
+    // Record the camera into a path file, and play one back at a fixed step to benchmark with
+    QAction* pCameraRecordAction = pViewMenu->addAction("Record Camera Path");
+    connect(pCameraRecordAction, &QAction::triggered, this, [=] {
+        if (!m_pGraphicsWindow->IsRecordingCamera()) {
+            m_pGraphicsWindow->StartCameraRecording();
+            pCameraRecordAction->setText("Stop Recording Camera Path");
+            return;
+        }
+        const CameraPath path = m_pGraphicsWindow->StopCameraRecording();
+        pCameraRecordAction->setText("Record Camera Path");
+        const QString filepath = QFileDialog::getSaveFileName(nullptr, "Save Camera Path", "camera_path.json", "Camera Path (*.json)");
+        if (!filepath.isEmpty() && !path.Save(filepath)) {
+            statusBar()->showMessage(QString("Could not save %1").arg(filepath), 10000);
+        }
+    });
+    pViewMenu->addAction("Play Camera Path...", [=] {
+        const QString filepath = QFileDialog::getOpenFileName(nullptr, "Play Camera Path", "", "Camera Path (*.json)");
+        if (filepath.isEmpty()) {
+            return;
+        }
+        CameraPath path;
+        QString error;
+        if (!path.Load(filepath, &error)) {
+            statusBar()->showMessage(error, 10000);
+            return;
+        }
+        m_cameraPathFile = filepath;
+        m_pGraphicsWindow->PlayCameraPath(path);
+    });
+
+    // The timings of a path played from the menu are saved beside it
+    connect(m_pGraphicsWindow, &ViewerGraphicsWindow::CameraPlaybackFinished, this, [=] {
+        if (m_cameraPathFile.isEmpty()) {
+            return;
+        }
+        const QFileInfo info(m_cameraPathFile);
+        const QString timingsPath = info.dir().filePath(info.completeBaseName() + "_timings.csv");
+        m_cameraPathFile.clear();
+        const std::vector<PlaybackFrame>& frames = m_pGraphicsWindow->GetPlaybackFrames();
+        float cpuSeconds = 0.f;
+        float gpuSeconds = 0.f;
+        int gpuFrames = 0;
+        for (const PlaybackFrame& frame : frames) {
+            cpuSeconds += frame.m_cpuSeconds;
+            if (frame.m_gpuSeconds >= 0.f) {
+                gpuSeconds += frame.m_gpuSeconds;
+                ++gpuFrames;
+            }
+        }
+        if (!CameraPath::SaveTimings(timingsPath, frames)) {
+            statusBar()->showMessage(QString("Could not save %1").arg(timingsPath), 10000);
+            return;
+        }
+        statusBar()->showMessage(QString("Played %1 frames, %2 ms CPU and %3 ms GPU on average, saved to %4")
+            .arg(int(frames.size()))
+            .arg(frames.empty() ? 0.f : cpuSeconds * 1000.f / float(frames.size()), 0, 'f', 2)
+            .arg(gpuFrames == 0 ? 0.f : gpuSeconds * 1000.f / float(gpuFrames), 0, 'f', 2)
+            .arg(QDir::toNativeSeparators(timingsPath)), 20000);
+    });
+
+    // Where the last load spent its time, per thread, in a Chrome trace
+    pViewMenu->addAction("Save Import Trace...", [=] {
+        const QString filepath = QFileDialog::getSaveFileName(nullptr, "Save Import Trace", "import_trace.json", "Chrome Trace (*.json)");
+        if (!filepath.isEmpty() && !m_pGraphicsWindow->GetImportTrace().Save(filepath)) {
+            statusBar()->showMessage(QString("Could not save %1").arg(filepath), 10000);
+        }
+    });
+    connect(m_pGraphicsWindow, &ViewerGraphicsWindow::EndModelLoading, this, [=](bool success, QString filepath) {
+        if (success) {
+            statusBar()->showMessage(QFileInfo(filepath).fileName() + ": " + m_pGraphicsWindow->GetImportTrace().Summary(), 10000);
+        }
+    });
+
+    pViewMenu->addAction("Memory Usage", [=] { ShowMemoryPanel(); });
+    pViewMenu->addAction("Model Statistics", [=] { ShowStatsPanel(); });
+    pViewMenu->addAction("Scene Outliner", [=] { ShowSceneOutliner(); });
+
+    // Several views of the model side by side, turned apart or drawn with other shaders
+    QMenu* pSplitMenu = pViewMenu->addMenu("Split View");
+    pSplitMenu->setObjectName("SplitViewMenu");
+    pSplitMenu->addAction("Single View", [=] { m_pGraphicsWindow->setViewportCount(1); });
+    pSplitMenu->addAction("Front and Side", [=] {
+        m_pGraphicsWindow->setViewportCount(2);
+        m_pGraphicsWindow->setViewportAngles(0, 0.f, 0.f);
+        m_pGraphicsWindow->setViewportAngles(1, 90.f, 0.f);
+    });
+    pSplitMenu->addAction("Four Views", [=] {
+        m_pGraphicsWindow->setViewportCount(4);
+        m_pGraphicsWindow->setViewportAngles(0, 0.f, 0.f);
+        m_pGraphicsWindow->setViewportAngles(1, 90.f, 0.f);
+        m_pGraphicsWindow->setViewportAngles(2, 180.f, 0.f);
+        m_pGraphicsWindow->setViewportAngles(3, 0.f, 90.f);
+    });
+    pSplitMenu->addAction("Compare Shaders...", [=] {
+        const QString fragfilepath = QFileDialog::getOpenFileName(this, "Compare Fragment Shader", "../Data/Shaders/", "Fragment Shader (*.frag)");
+        if (fragfilepath.isEmpty()) {
+            return;
+        }
+        m_pGraphicsWindow->setViewportCount(2);
+        m_pGraphicsWindow->setViewportAngles(0, 0.f, 0.f);
+        m_pGraphicsWindow->setViewportAngles(1, 0.f, 0.f);
+        if (!m_pGraphicsWindow->setViewportShaders(1, QString(), fragfilepath)) {
+            statusBar()->showMessage(QString("Could not link %1").arg(QDir::toNativeSeparators(fragfilepath)), 10000);
+        }
+    });
+
+    // An original and a simplified version of it, such as a level of detail, shown together
+    QMenu* pCompareMenu = pViewMenu->addMenu("Compare");
+    pCompareMenu->setObjectName("CompareMenu");
+    connect(pCompareMenu, &QMenu::aboutToShow, this, [=] {
+        pCompareMenu->clear();
+        pCompareMenu->addAction("Compare With...", [=] {
+            if (!m_pGraphicsWindow->compareWith()) {
+                statusBar()->showMessage("Load the original model from a file to compare with it", 10000);
+            }
+        });
+        pCompareMenu->addSeparator();
+        const char* modes[] = { "Off", "Side by Side", "Distance Heatmap", "Depth and Normal Difference" };
+        for (int mode = k_compareOff; mode <= k_compareDifference; ++mode) {
+            QAction* pModeAction = pCompareMenu->addAction(modes[mode], [=] { m_pGraphicsWindow->setCompareMode(mode); });
+            pModeAction->setCheckable(true);
+            pModeAction->setChecked(mode == m_pGraphicsWindow->compareMode());
+        }
+    });
+    connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ComparisonFinished, this, [=](bool success, float hausdorff, float mean) {
+        statusBar()->showMessage(success ? QString("Hausdorff distance %1, mean distance %2").arg(hausdorff).arg(mean)
+            : QString("Could not compare, a model has no triangles"), 20000);
+    });
+
+    // Animation, listing the clips of the model so one can be played on a loop
+    QMenu* pAnimationMenu = pViewMenu->addMenu("Animation");
+    pAnimationMenu->setObjectName("AnimationMenu");
+    pAnimationMenu->addAction("Stop")->setEnabled(false);
+    connect(pAnimationMenu, &QMenu::aboutToShow, this, [=] {
+        pAnimationMenu->clear();
+        const QStringList clips = m_pGraphicsWindow->GetAnimationNames();
+        const int playing = m_pGraphicsWindow->GetPlayingAnimation();
+        for (int i = 0; i < clips.size(); ++i) {
+            QAction* pClipAction = pAnimationMenu->addAction(clips[i], [=] { m_pGraphicsWindow->playAnimation(i); });
+            pClipAction->setCheckable(true);
+            pClipAction->setChecked(i == playing);
+        }
+        if (!clips.isEmpty()) {
+            pAnimationMenu->addSeparator();
+        }
+        QAction* pStopAction = pAnimationMenu->addAction("Stop", [=] { m_pGraphicsWindow->playAnimation(-1); });
+        pStopAction->setEnabled(playing >= 0);
+    });
+
+    // Warnings that don't stop anything go to the status bar rather than the error screen
+    connect(m_pGraphicsWindow, &ViewerGraphicsWindow::MemoryWarning, this, [=](QString message) {
+        statusBar()->showMessage(message, 10000);
+    });
+    connect(m_pGraphicsWindow, &ViewerGraphicsWindow::PosterExported, this, [=](bool success, QString filepath) {
+        statusBar()->showMessage(QString(success ? "Saved %1" : "Could not save %1").arg(filepath), 10000);
+    });
+    connect(m_pGraphicsWindow, &ViewerGraphicsWindow::VideoExported, this, [=](bool success, QString filepath) {
+        statusBar()->showMessage(QString(success ? "Saved %1" : "Could not save %1").arg(QDir::toNativeSeparators(filepath)), 10000);
+    });
+
     // -> Help menu
 
     // if user click help menu, it will let user go to github page to read the Wiki
@@ -124,6 +376,9 @@ ViewerGraphicsWindow* ModelViewer::GetGraphicsWindow() {
 }
 
 SettingsMenu* ModelViewer::GetSettingsWindow() {
+    if (!m_pSettingsMenu) {
+        m_pSettingsMenu = new SettingsMenu(m_pGraphicsWindow);
+    }
     return m_pSettingsMenu;
 }
 
@@ -143,6 +398,329 @@ void ModelViewer::GetQuit() {
     close();
 }
 
+void ModelViewer::ShowMemoryPanel() {
+    if (!m_pMemoryPanel) {
+        m_pMemoryPanel = new QDialog(this, Qt::Tool);
+        m_pMemoryPanel->setWindowTitle("Memory Usage");
+        QLabel* pReport = new QLabel(m_pMemoryPanel);
+        pReport->setTextInteractionFlags(Qt::TextSelectableByMouse);
+        QVBoxLayout* pLayout = new QVBoxLayout(m_pMemoryPanel);
+        pLayout->addWidget(pReport);
+
+        // The numbers change as models load and stream, so refresh them while the panel is open
+        QTimer* pRefresh = new QTimer(m_pMemoryPanel);
+        pRefresh->setInterval(500);
+        connect(pRefresh, &QTimer::timeout, pReport, [=] { pReport->setText(m_pGraphicsWindow->GetResources().Report()); });
+        connect(m_pMemoryPanel, &QDialog::finished, pRefresh, &QTimer::stop);
+    }
+    m_pMemoryPanel->findChild<QLabel*>()->setText(m_pGraphicsWindow->GetResources().Report());
+    m_pMemoryPanel->findChild<QTimer*>()->start();
+    m_pMemoryPanel->show();
+    m_pMemoryPanel->raise();
+}
+
+void ModelViewer::ShowStatsPanel() {
+    if (!m_pStatsPanel) {
+        m_pStatsPanel = new QDialog(this, Qt::Tool);
+        m_pStatsPanel->setWindowTitle("Model Statistics");
+        m_pStatsPanel->resize(640, 480);
+        QLabel* pSummary = new QLabel(m_pStatsPanel);
+        pSummary->setTextInteractionFlags(Qt::TextSelectableByMouse);
+        QTableWidget* pMeshTable = new QTableWidget(0, 9, m_pStatsPanel);
+        pMeshTable->setHorizontalHeaderLabels({ "Mesh", "Vertices", "Triangles", "Degenerate", "Instances", "Material", "LODs", "Meshlets", "KB" });
+        pMeshTable->setEditTriggers(QAbstractItemView::NoEditTriggers);
+        pMeshTable->verticalHeader()->hide();
+        QVBoxLayout* pLayout = new QVBoxLayout(m_pStatsPanel);
+        pLayout->addWidget(pSummary);
+        pLayout->addWidget(pMeshTable, 1);
+
+        // The counts only change with the scene, they were taken when its models were loaded
+        connect(m_pGraphicsWindow, &ViewerGraphicsWindow::SceneChanged, m_pStatsPanel, [=] { UpdateStatsPanel(); });
+    }
+    UpdateStatsPanel();
+    m_pStatsPanel->show();
+    m_pStatsPanel->raise();
+}
+
+void ModelViewer::UpdateStatsPanel() {
+    const ModelStats& stats = m_pGraphicsWindow->GetModelStats();
+    m_pStatsPanel->findChild<QLabel*>()->setText(stats.Report());
+
+    // Sorting is off while filling, rows would move under the items being set
+    QTableWidget* pMeshTable = m_pStatsPanel->findChild<QTableWidget*>();
+    pMeshTable->setSortingEnabled(false);
+    pMeshTable->setRowCount(int(stats.m_meshStats.size()));
+    const auto SetNumber = [=](int row, int column, qint64 value) {
+        QTableWidgetItem* pItem = new QTableWidgetItem();
+        pItem->setData(Qt::DisplayRole, value);
+        pMeshTable->setItem(row, column, pItem);
+    };
+    for (int row = 0; row < int(stats.m_meshStats.size()); ++row) {
+        const MeshStats& mesh = stats.m_meshStats[row];
+        pMeshTable->setItem(row, 0, new QTableWidgetItem(mesh.m_name.isEmpty() ? QString("Mesh %1").arg(row) : mesh.m_name));
+        SetNumber(row, 1, mesh.m_vertices);
+        SetNumber(row, 2, mesh.m_triangles);
+        SetNumber(row, 3, mesh.m_degenerateTriangles);
+        SetNumber(row, 4, mesh.m_instances);
+        SetNumber(row, 5, mesh.m_material);
+        SetNumber(row, 6, mesh.m_lods);
+        SetNumber(row, 7, mesh.m_meshlets);
+        SetNumber(row, 8, (mesh.m_vertexBytes + mesh.m_indexBytes + 1023) / 1024);
+    }
+    pMeshTable->setSortingEnabled(true);
+    pMeshTable->resizeColumnsToContents();
+}
+
+void ModelViewer::ShowSimplifyPanel() {
+    if (!m_pSimplifyPanel) {
+        m_pSimplifyPanel = new QDialog(this, Qt::Tool);
+        m_pSimplifyPanel->setWindowTitle("Simplify Model");
+
+        // Simplifying a large model takes a moment, the preview follows the slider once it is let go
+        QSlider* pKeep = new QSlider(Qt::Horizontal, m_pSimplifyPanel);
+        pKeep->setObjectName("SimplifyKeep");
+        pKeep->setRange(1, 100);
+        pKeep->setValue(100);
+        pKeep->setTracking(false);
+        QDoubleSpinBox* pError = new QDoubleSpinBox(m_pSimplifyPanel);
+        pError->setObjectName("SimplifyError");
+        pError->setRange(0.0, 10.0);
+        pError->setSingleStep(0.1);
+        pError->setSuffix(" % of size");
+        pError->setSpecialValueText("No limit");
+        QLabel* pResult = new QLabel(m_pSimplifyPanel);
+        QPushButton* pExport = new QPushButton("Export...", m_pSimplifyPanel);
+        QPushButton* pReset = new QPushButton("Reset", m_pSimplifyPanel);
+        QHBoxLayout* pButtons = new QHBoxLayout();
+        pButtons->addWidget(pReset);
+        pButtons->addStretch();
+        pButtons->addWidget(pExport);
+        QFormLayout* pLayout = new QFormLayout(m_pSimplifyPanel);
+        pLayout->addRow("Keep triangles:", pKeep);
+        pLayout->addRow("Largest error:", pError);
+        pLayout->addRow(pResult);
+        pLayout->addRow(pButtons);
+
+        const auto Preview = [=] {
+            const qint64 triangles = m_pGraphicsWindow->GetModelStats().m_meshTriangles;
+            SimplifyOptions options;
+            if (pKeep->value() < 100) {
+                options.m_targetTriangles = std::max<qint64>(1, triangles * pKeep->value() / 100);
+            }
+            options.m_targetError = float(pError->value() / 100.0);
+            if (!m_pGraphicsWindow->previewSimplification(options)) {
+                pResult->setText("The model shown can't be simplified");
+            }
+            else {
+                pResult->setText(options.IsActive() ? "Simplifying..." : QString("%1 triangles").arg(QLocale().toString(triangles)));
+            }
+        };
+        const auto Reset = [=] {
+            const QSignalBlocker keepBlocker(pKeep);
+            const QSignalBlocker errorBlocker(pError);
+            pKeep->setValue(100);
+            pError->setValue(0.0);
+            pResult->setText(QString("%1 triangles").arg(QLocale().toString(m_pGraphicsWindow->GetModelStats().m_meshTriangles)));
+        };
+        connect(pKeep, &QSlider::valueChanged, m_pSimplifyPanel, Preview);
+        connect(pError, QOverload<double>::of(&QDoubleSpinBox::valueChanged), m_pSimplifyPanel, Preview);
+        connect(pReset, &QPushButton::clicked, m_pSimplifyPanel, [=] {
+            m_pGraphicsWindow->endSimplification();
+            Reset();
+        });
+
+        // Saving exports the model simplified as previewed
+        connect(pExport, &QPushButton::clicked, m_pSimplifyPanel, [=] { m_pGraphicsWindow->saveModel(); });
+        connect(m_pGraphicsWindow, &ViewerGraphicsWindow::SimplificationFinished, pResult, [=](qint64 triangles, qint64 originalTriangles, float error) {
+            pResult->setText(QString("%1 of %2 triangles, largest error %3")
+                .arg(QLocale().toString(triangles), QLocale().toString(originalTriangles)).arg(error));
+        });
+
+        // A new scene ends the preview
+        connect(m_pGraphicsWindow, &ViewerGraphicsWindow::SceneChanged, m_pSimplifyPanel, Reset);
+        Reset();
+    }
+    m_pSimplifyPanel->show();
+    m_pSimplifyPanel->raise();
+}
+
+void ModelViewer::ShowSectionPanel() {
+    if (!m_pSectionPanel) {
+        m_pSectionPanel = new QDialog(this, Qt::Tool);
+        m_pSectionPanel->setWindowTitle("Section Planes");
+
+        // One plane across each axis, keeping what is below its position unless flipped
+        const int steps = 1000;
+        const char* axisNames[3] = { "X", "Y", "Z" };
+        QCheckBox* pEnabled[3];
+        QSlider* pPositions[3];
+        QCheckBox* pFlipped[3];
+        QGridLayout* pLayout = new QGridLayout(m_pSectionPanel);
+        for (int axis = 0; axis < 3; ++axis) {
+            pEnabled[axis] = new QCheckBox(axisNames[axis], m_pSectionPanel);
+            pPositions[axis] = new QSlider(Qt::Horizontal, m_pSectionPanel);
+            pPositions[axis]->setObjectName(QString("Section%1").arg(axisNames[axis]));
+            pPositions[axis]->setRange(0, steps);
+            pPositions[axis]->setValue(steps / 2);
+            pFlipped[axis] = new QCheckBox("Flip", m_pSectionPanel);
+            pLayout->addWidget(pEnabled[axis], axis, 0);
+            pLayout->addWidget(pPositions[axis], axis, 1);
+            pLayout->addWidget(pFlipped[axis], axis, 2);
+        }
+        QCheckBox* pCaps = new QCheckBox("Fill cuts", m_pSectionPanel);
+        pCaps->setChecked(true);
+        pLayout->addWidget(pCaps, 3, 0, 1, 3);
+        pLayout->setColumnMinimumWidth(1, 200);
+
+        // The positions are parts of the model's box, so they stay put on models of any size
+        const auto Apply = [=] {
+            std::vector<QVector4D> planes;
+            QVector3D min, max;
+            if (m_pGraphicsWindow->modelBounds(min, max)) {
+                for (int axis = 0; axis < 3; ++axis) {
+                    if (!pEnabled[axis]->isChecked()) {
+                        continue;
+                    }
+                    const float position = min[axis] + (max[axis] - min[axis]) * float(pPositions[axis]->value()) / float(steps);
+                    const float side = pFlipped[axis]->isChecked() ? 1.f : -1.f;
+                    QVector4D plane;
+                    plane[axis] = side;
+                    plane[3] = -side * position;
+                    planes.push_back(plane);
+                }
+            }
+            m_pGraphicsWindow->setSectionPlanes(planes, pCaps->isChecked());
+        };
+        for (int axis = 0; axis < 3; ++axis) {
+            connect(pEnabled[axis], &QCheckBox::toggled, m_pSectionPanel, Apply);
+            connect(pPositions[axis], &QSlider::valueChanged, m_pSectionPanel, Apply);
+            connect(pFlipped[axis], &QCheckBox::toggled, m_pSectionPanel, Apply);
+        }
+        connect(pCaps, &QCheckBox::toggled, m_pSectionPanel, Apply);
+
+        // A new model has a box of its own
+        connect(m_pGraphicsWindow, &ViewerGraphicsWindow::SceneChanged, m_pSectionPanel, Apply);
+    }
+    m_pSectionPanel->show();
+    m_pSectionPanel->raise();
+}
+
+void ModelViewer::ShowModelBrowser() {
+    if (!m_pModelBrowser) {
+        m_pModelBrowser = new ModelBrowser(m_pGraphicsWindow, this);
+    }
+    m_pModelBrowser->show();
+    m_pModelBrowser->raise();
+}
+
+void ModelViewer::ShowSceneOutliner() {
+    if (!m_pSceneOutliner) {
+        m_pSceneOutliner = new SceneOutliner(m_pGraphicsWindow, this);
+    }
+    m_pSceneOutliner->show();
+    m_pSceneOutliner->raise();
+}
+
+void ModelViewer::ExportPoster() {
+    const QString filepath = QFileDialog::getSaveFileName(this, "Export Poster", "../data/Screenshots/poster.png", "Portable Network Graphics (*.png)");
+    if (filepath.isEmpty()) {
+        return;
+    }
+
+    // The height follows from the window's aspect
+    bool ok = false;
+    const int width = QInputDialog::getInt(this, "Export Poster", "Width in pixels:", 16384, 1, 65535, 1, &ok);
+    if (!ok) {
+        return;
+    }
+    if (m_pGraphicsWindow->exportPoster(filepath, QSize(width, 0))) {
+        statusBar()->showMessage(QString("Rendering %1...").arg(filepath));
+    }
+    else {
+        statusBar()->showMessage(QString("Could not save %1").arg(filepath), 10000);
+    }
+}
+
+void ModelViewer::ExportVideo(bool turntable) {
+    CameraPath path;
+    if (turntable) {
+        bool ok = false;
+        const int seconds = QInputDialog::getInt(this, "Export Turntable Video", "Seconds per turn:", 8, 1, 600, 1, &ok);
+        if (!ok) {
+            return;
+        }
+        path = CameraPath::Turntable(m_pGraphicsWindow->GetCameraPose(), float(seconds));
+    }
+    else {
+        const QString pathFile = QFileDialog::getOpenFileName(this, "Export Camera Path Video", "", "Camera Path (*.json)");
+        if (pathFile.isEmpty()) {
+            return;
+        }
+        QString error;
+        if (!path.Load(pathFile, &error)) {
+            statusBar()->showMessage(error, 10000);
+            return;
+        }
+    }
+
+    const QString filepath = QFileDialog::getSaveFileName(this, "Export Video", "../data/Screenshots/turntable.mp4", "MPEG-4 Video (*.mp4)");
+    if (filepath.isEmpty()) {
+        return;
+    }
+    if (m_pGraphicsWindow->exportVideo(filepath, path)) {
+        statusBar()->showMessage(QString("Rendering %1...").arg(QDir::toNativeSeparators(filepath)));
+    }
+    else {
+        statusBar()->showMessage(QString("Could not save %1").arg(QDir::toNativeSeparators(filepath)), 10000);
+    }
+}
+
+void ModelViewer::BatchConvert() {
+    BatchConvertOptions options;
+    options.m_inputFolder = QFileDialog::getExistingDirectory(this, "Models to Convert", "../Data/Models/");
+    if (options.m_inputFolder.isEmpty()) {
+        return;
+    }
+    options.m_outputFolder = QFileDialog::getExistingDirectory(this, "Output Folder", options.m_inputFolder);
+    if (options.m_outputFolder.isEmpty()) {
+        return;
+    }
+    const QStringList formats = BatchConverter::FormatIds();
+    bool ok = false;
+    options.m_formatId = QInputDialog::getItem(this, "Batch Convert", "Export format:", formats, std::max(0, formats.indexOf("obj")), false, &ok);
+    if (!ok) {
+        return;
+    }
+    options.m_loadOptions = m_pGraphicsWindow->GetLoadOptions();
+
+    // The conversion runs off the GUI thread, the workers report progress through queued calls
+    std::shared_ptr<BatchConverter> pConverter = std::make_shared<BatchConverter>(options);
+    QProgressDialog* pProgress = new QProgressDialog("Converting models...", "Cancel", 0, 0, this);
+    pProgress->setWindowModality(Qt::WindowModal);
+    pProgress->setMinimumDuration(0);
+    connect(pProgress, &QProgressDialog::canceled, this, [pConverter] { pConverter->Cancel(); });
+
+    QFutureWatcher<BatchConvertReport>* pWatcher = new QFutureWatcher<BatchConvertReport>(this);
+    connect(pWatcher, &QFutureWatcher<BatchConvertReport>::finished, this, [=] {
+        const BatchConvertReport report = pWatcher->result();
+        pProgress->deleteLater();
+        pWatcher->deleteLater();
+        QString text = report.Summary();
+        if (!report.m_failed.isEmpty()) {
+            text += "\n\n" + report.m_failed.mid(0, 20).join("\n");
+        }
+        QMessageBox::information(this, "Batch Convert", text);
+    });
+    pWatcher->setFuture(JobSystem::Run(JobPriority::Normal, [=] {
+        return pConverter->Convert([pProgress](int done, int total) {
+            QMetaObject::invokeMethod(pProgress, [=] {
+                pProgress->setMaximum(total);
+                pProgress->setValue(done);
+            }, Qt::QueuedConnection);
+        });
+    }));
+}
+
 FocusMenu::FocusMenu(ViewerGraphicsWindow* pGraphicsWindow, const QString& title, QWidget* parent)
     : QMenu(title, parent)
 {
@@ -7,6 +7,9 @@ class ViewerGraphicsWindow;
 class GraphicsWindowDelegate;
 class SettingsMenu;
 class GraphicsWindowUniform;
+class QDialog;
+class ModelBrowser;
+class SceneOutliner;
 
 class Q_DECL_EXPORT ModelViewer : public QMainWindow
 {
@@ -23,13 +26,50 @@ public:
 
     void GetQuit();
 
+    // Converts a folder of models to another format, with a progress dialog
+    void BatchConvert();
+
+    // Asks for a file and a width, and renders the view as a poster of that size
+    void ExportPoster();
+
+    // Asks for a file and renders a turntable of the view, or a camera path, into a video
+    void ExportVideo(bool turntable);
     
 
 private:
     ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
     GraphicsWindowDelegate* m_pGraphicsWindowDelegate = nullptr;
     GraphicsWindowUniform* m_pGraphicsWindowUniform = nullptr;
+    // Created the first time it is asked for
     SettingsMenu* m_pSettingsMenu = nullptr;
+
+    // Lists the memory the resources take, created the first time it is shown
+    QDialog* m_pMemoryPanel = nullptr;
+    void ShowMemoryPanel();
+
+    // Counts of the scene and each of its meshes, created the first time it is shown
+    QDialog* m_pStatsPanel = nullptr;
+    void ShowStatsPanel();
+    void UpdateStatsPanel();
+
+    // The camera path played from the menu, its timings are saved beside it
+    QString m_cameraPathFile;
+
+    // Lists a folder of models with their thumbnails, created the first time it is shown
+    ModelBrowser* m_pModelBrowser = nullptr;
+    void ShowModelBrowser();
+
+    // The node tree of the model shown, created the first time it is shown
+    SceneOutliner* m_pSceneOutliner = nullptr;
+    void ShowSceneOutliner();
+
+    // Previews the model simplified as its controls say, created the first time it is shown
+    QDialog* m_pSimplifyPanel = nullptr;
+    void ShowSimplifyPanel();
+
+    // Cuts the model open along the axes as its controls say, created the first time it is shown
+    QDialog* m_pSectionPanel = nullptr;
+    void ShowSectionPanel();
 };
 
 
@@ -0,0 +1,410 @@
+#include "NormalGenerator.h"
+#include "VertexWelder.h"
+
+#include <assimp/scene.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NORMAL_GENERATOR_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+// The NEON square root and division are only on 64 bit ARM
+#define NORMAL_GENERATOR_NEON
+#include <arm_neon.h>
+#endif
+
+
+namespace {
+
+static_assert(sizeof(aiVector3D) == 3 * sizeof(float) && sizeof(aiColor4D) == 4 * sizeof(float), "Normals are generated from single precision meshes");
+
+// Triangles whose normals are crossed at once
+const size_t k_lanes = 4;
+
+// Smooth normals are summed by shards of this many positions in a row, 3 cache lines of sums,
+// so threads summing different shards don't write to the same line
+const size_t k_positionBlock = 16;
+
+// The corners of four triangles, one array per coordinate of each corner
+struct Corners4 {
+	alignas(16) float m_x[3][k_lanes];
+	alignas(16) float m_y[3][k_lanes];
+	alignas(16) float m_z[3][k_lanes];
+};
+
+struct Normals4 {
+	alignas(16) float m_x[k_lanes];
+	alignas(16) float m_y[k_lanes];
+	alignas(16) float m_z[k_lanes];
+};
+
+// Crosses the edges from the first corner of each triangle to the second and third, and
+// normalizes the products. Zero products stay zero, as with Assimp's NormalizeSafe.
+void CrossNormalize(const Corners4& c, Normals4& n)
+{
+#if defined(NORMAL_GENERATOR_SSE2)
+	const __m128 x0 = _mm_load_ps(c.m_x[0]);
+	const __m128 y0 = _mm_load_ps(c.m_y[0]);
+	const __m128 z0 = _mm_load_ps(c.m_z[0]);
+	const __m128 ux = _mm_sub_ps(_mm_load_ps(c.m_x[1]), x0);
+	const __m128 uy = _mm_sub_ps(_mm_load_ps(c.m_y[1]), y0);
+	const __m128 uz = _mm_sub_ps(_mm_load_ps(c.m_z[1]), z0);
+	const __m128 vx = _mm_sub_ps(_mm_load_ps(c.m_x[2]), x0);
+	const __m128 vy = _mm_sub_ps(_mm_load_ps(c.m_y[2]), y0);
+	const __m128 vz = _mm_sub_ps(_mm_load_ps(c.m_z[2]), z0);
+	const __m128 nx = _mm_sub_ps(_mm_mul_ps(uy, vz), _mm_mul_ps(uz, vy));
+	const __m128 ny = _mm_sub_ps(_mm_mul_ps(uz, vx), _mm_mul_ps(ux, vz));
+	const __m128 nz = _mm_sub_ps(_mm_mul_ps(ux, vy), _mm_mul_ps(uy, vx));
+	const __m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+	const __m128 scale = _mm_and_ps(_mm_cmpgt_ps(length2, _mm_setzero_ps()), _mm_div_ps(_mm_set1_ps(1.f), _mm_sqrt_ps(length2)));
+	_mm_store_ps(n.m_x, _mm_mul_ps(nx, scale));
+	_mm_store_ps(n.m_y, _mm_mul_ps(ny, scale));
+	_mm_store_ps(n.m_z, _mm_mul_ps(nz, scale));
+#elif defined(NORMAL_GENERATOR_NEON)
+	const float32x4_t x0 = vld1q_f32(c.m_x[0]);
+	const float32x4_t y0 = vld1q_f32(c.m_y[0]);
+	const float32x4_t z0 = vld1q_f32(c.m_z[0]);
+	const float32x4_t ux = vsubq_f32(vld1q_f32(c.m_x[1]), x0);
+	const float32x4_t uy = vsubq_f32(vld1q_f32(c.m_y[1]), y0);
+	const float32x4_t uz = vsubq_f32(vld1q_f32(c.m_z[1]), z0);
+	const float32x4_t vx = vsubq_f32(vld1q_f32(c.m_x[2]), x0);
+	const float32x4_t vy = vsubq_f32(vld1q_f32(c.m_y[2]), y0);
+	const float32x4_t vz = vsubq_f32(vld1q_f32(c.m_z[2]), z0);
+	const float32x4_t nx = vsubq_f32(vmulq_f32(uy, vz), vmulq_f32(uz, vy));
+	const float32x4_t ny = vsubq_f32(vmulq_f32(uz, vx), vmulq_f32(ux, vz));
+	const float32x4_t nz = vsubq_f32(vmulq_f32(ux, vy), vmulq_f32(uy, vx));
+	const float32x4_t length2 = vaddq_f32(vaddq_f32(vmulq_f32(nx, nx), vmulq_f32(ny, ny)), vmulq_f32(nz, nz));
+	const float32x4_t zero = vdupq_n_f32(0.f);
+	const float32x4_t scale = vbslq_f32(vcgtq_f32(length2, zero), vdivq_f32(vdupq_n_f32(1.f), vsqrtq_f32(length2)), zero);
+	vst1q_f32(n.m_x, vmulq_f32(nx, scale));
+	vst1q_f32(n.m_y, vmulq_f32(ny, scale));
+	vst1q_f32(n.m_z, vmulq_f32(nz, scale));
+#else
+	for (size_t lane = 0; lane < k_lanes; ++lane) {
+		const float ux = c.m_x[1][lane] - c.m_x[0][lane];
+		const float uy = c.m_y[1][lane] - c.m_y[0][lane];
+		const float uz = c.m_z[1][lane] - c.m_z[0][lane];
+		const float vx = c.m_x[2][lane] - c.m_x[0][lane];
+		const float vy = c.m_y[2][lane] - c.m_y[0][lane];
+		const float vz = c.m_z[2][lane] - c.m_z[0][lane];
+		const float nx = uy * vz - uz * vy;
+		const float ny = uz * vx - ux * vz;
+		const float nz = ux * vy - uy * vx;
+		const float length2 = nx * nx + ny * ny + nz * nz;
+		const float scale = length2 > 0.f ? 1.f / std::sqrt(length2) : 0.f;
+		n.m_x[lane] = nx * scale;
+		n.m_y[lane] = ny * scale;
+		n.m_z[lane] = nz * scale;
+	}
+#endif
+}
+
+// Angle at corner p of the triangle, between the edges to q and r. Zero if an edge is.
+float CornerAngle(const float* p, const float* q, const float* r)
+{
+	const float u[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+	const float v[3] = { r[0] - p[0], r[1] - p[1], r[2] - p[2] };
+	const float lengths = std::sqrt((u[0] * u[0] + u[1] * u[1] + u[2] * u[2]) * (v[0] * v[0] + v[1] * v[1] + v[2] * v[2]));
+	if (!(lengths > 0.f)) {
+		return 0.f;
+	}
+	return std::acos(std::max(-1.f, std::min(1.f, (u[0] * v[0] + u[1] * v[1] + u[2] * v[2]) / lengths)));
+}
+
+// An attribute array of a mesh, floats floats per vertex
+struct Channel {
+	const float* m_pData;
+	size_t m_floats;
+};
+
+std::vector<Channel> Channels(const aiMesh* pMesh)
+{
+	std::vector<Channel> channels;
+	auto Add = [&](const void* pData, size_t floats) {
+		if (pData) {
+			channels.push_back(Channel{ static_cast<const float*>(pData), floats });
+		}
+	};
+	Add(pMesh->mVertices, 3);
+	Add(pMesh->mNormals, 3);
+	Add(pMesh->mTangents, 3);
+	Add(pMesh->mBitangents, 3);
+	for (unsigned int i = 0; i < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++i) {
+		Add(pMesh->mTextureCoords[i], 3);
+	}
+	for (unsigned int i = 0; i < AI_MAX_NUMBER_OF_COLOR_SETS; ++i) {
+		Add(pMesh->mColors[i], 4);
+	}
+	return channels;
+}
+
+// Replaces the array by the entries firsts picks from it
+template <typename T>
+void Gather(T*& pArray, const std::vector<quint32>& firsts)
+{
+	if (!pArray) {
+		return;
+	}
+	T* pGathered = new T[firsts.size()];
+	VertexWelder::ParallelRuns(firsts.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			pGathered[i] = pArray[firsts[i]];
+		}
+	});
+	delete[] pArray;
+	pArray = pGathered;
+}
+
+void JoinVertices(aiMesh* pMesh)
+{
+	// Every attribute is hashed and compared by value, -0 being 0
+	const std::vector<Channel> channels = Channels(pMesh);
+	const auto hash = [&channels](quint32 v) {
+		quint64 mixed = 0;
+		for (const Channel& channel : channels) {
+			const float* pValues = channel.m_pData + channel.m_floats * v;
+			for (size_t i = 0; i < channel.m_floats; ++i) {
+				const float value = pValues[i] + 0.f;
+				quint32 bits;
+				std::memcpy(&bits, &value, sizeof(bits));
+				mixed = VertexWelder::Mix(mixed ^ bits);
+			}
+		}
+		return size_t(mixed);
+	};
+	const auto equal = [&channels](quint32 a, quint32 b) {
+		for (const Channel& channel : channels) {
+			const float* pA = channel.m_pData + channel.m_floats * a;
+			const float* pB = channel.m_pData + channel.m_floats * b;
+			for (size_t i = 0; i < channel.m_floats; ++i) {
+				if (!(pA[i] == pB[i])) {
+					return false;
+				}
+			}
+		}
+		return true;
+	};
+
+	std::vector<quint32> vertices(pMesh->mNumVertices);
+	std::iota(vertices.begin(), vertices.end(), 0u);
+	std::vector<quint32> firsts;
+	const std::vector<quint32> numbers = VertexWelder::Weld(vertices, firsts, hash, equal);
+	if (firsts.size() == vertices.size()) {
+		return;
+	}
+
+	Gather(pMesh->mVertices, firsts);
+	Gather(pMesh->mNormals, firsts);
+	Gather(pMesh->mTangents, firsts);
+	Gather(pMesh->mBitangents, firsts);
+	for (unsigned int i = 0; i < AI_MAX_NUMBER_OF_TEXTURECOORDS; ++i) {
+		Gather(pMesh->mTextureCoords[i], firsts);
+	}
+	for (unsigned int i = 0; i < AI_MAX_NUMBER_OF_COLOR_SETS; ++i) {
+		Gather(pMesh->mColors[i], firsts);
+	}
+	VertexWelder::ParallelRuns(pMesh->mNumFaces, [&](size_t begin, size_t end) {
+		for (size_t f = begin; f < end; ++f) {
+			aiFace& face = pMesh->mFaces[f];
+			for (unsigned int i = 0; i < face.mNumIndices; ++i) {
+				face.mIndices[i] = numbers[face.mIndices[i]];
+			}
+		}
+	});
+	pMesh->mNumVertices = unsigned(firsts.size());
+}
+
+} // namespace
+
+void NormalGenerator::FaceNormals(const float* pPositions, const quint32* pIndices, size_t triangleCount, float* pNormals)
+{
+	Corners4 corners;
+	Normals4 normals;
+	for (size_t first = 0; first < triangleCount; first += k_lanes) {
+		// Lanes past the last triangle repeat it
+		const size_t lanes = std::min(k_lanes, triangleCount - first);
+		for (size_t lane = 0; lane < k_lanes; ++lane) {
+			const quint32* pTriangle = pIndices + 3 * (first + std::min(lane, lanes - 1));
+			for (int corner = 0; corner < 3; ++corner) {
+				const float* pPosition = pPositions + 3 * size_t(pTriangle[corner]);
+				corners.m_x[corner][lane] = pPosition[0];
+				corners.m_y[corner][lane] = pPosition[1];
+				corners.m_z[corner][lane] = pPosition[2];
+			}
+		}
+		CrossNormalize(corners, normals);
+		for (size_t lane = 0; lane < lanes; ++lane) {
+			float* pNormal = pNormals + 3 * (first + lane);
+			pNormal[0] = normals.m_x[lane];
+			pNormal[1] = normals.m_y[lane];
+			pNormal[2] = normals.m_z[lane];
+		}
+	}
+}
+
+void NormalGenerator::SmoothNormals(const float* pPositions, size_t vertexCount, const quint32* pIndices, size_t triangleCount, float* pNormals)
+{
+	std::fill(pNormals, pNormals + 3 * vertexCount, 0.f);
+	if (vertexCount == 0 || triangleCount == 0) {
+		return;
+	}
+
+	// The normal of every triangle and the angles of its corners
+	std::vector<float> faceNormals(3 * triangleCount);
+	std::vector<float> angles(3 * triangleCount);
+	VertexWelder::ParallelRuns(triangleCount, [&](size_t begin, size_t end) {
+		FaceNormals(pPositions, pIndices + 3 * begin, end - begin, &faceNormals[3 * begin]);
+		for (size_t t = begin; t < end; ++t) {
+			const float* pA = pPositions + 3 * size_t(pIndices[3 * t]);
+			const float* pB = pPositions + 3 * size_t(pIndices[3 * t + 1]);
+			const float* pC = pPositions + 3 * size_t(pIndices[3 * t + 2]);
+			angles[3 * t] = CornerAngle(pA, pB, pC);
+			angles[3 * t + 1] = CornerAngle(pB, pC, pA);
+			angles[3 * t + 2] = CornerAngle(pC, pA, pB);
+		}
+	});
+
+	// Vertices at the same position share a sum
+	std::vector<quint32> vertices(vertexCount);
+	std::iota(vertices.begin(), vertices.end(), 0u);
+	const auto hash = [pPositions](quint32 v) {
+		const float* pPosition = pPositions + 3 * size_t(v);
+		return VertexWelder::HashVector(pPosition[0], pPosition[1], pPosition[2]);
+	};
+	const auto equal = [pPositions](quint32 a, quint32 b) {
+		const float* pA = pPositions + 3 * size_t(a);
+		const float* pB = pPositions + 3 * size_t(b);
+		return pA[0] == pB[0] && pA[1] == pB[1] && pA[2] == pB[2];
+	};
+	std::vector<quint32> firsts;
+	const std::vector<quint32> positions = VertexWelder::Weld(vertices, firsts, hash, equal);
+
+	std::vector<quint32> cornerPositions(3 * triangleCount);
+	VertexWelder::ParallelRuns(cornerPositions.size(), [&](size_t begin, size_t end) {
+		for (size_t c = begin; c < end; ++c) {
+			cornerPositions[c] = positions[pIndices[c]];
+		}
+	});
+
+	// Every shard walks all corners and adds up the ones at its positions
+	std::vector<float> sums(3 * firsts.size(), 0.f);
+	const size_t shardCount = cornerPositions.size() > VertexWelder::k_run ? VertexWelder::k_shards : 1;
+	VertexWelder::ParallelFor(shardCount, [&](size_t shard) {
+		for (size_t c = 0; c < cornerPositions.size(); ++c) {
+			const size_t position = cornerPositions[c];
+			if (position / k_positionBlock % shardCount != shard) {
+				continue;
+			}
+			const float* pNormal = &faceNormals[3 * (c / 3)];
+			float* pSum = &sums[3 * position];
+			pSum[0] += angles[c] * pNormal[0];
+			pSum[1] += angles[c] * pNormal[1];
+			pSum[2] += angles[c] * pNormal[2];
+		}
+	});
+
+	VertexWelder::ParallelRuns(vertexCount, [&](size_t begin, size_t end) {
+		for (size_t v = begin; v < end; ++v) {
+			const float* pSum = &sums[3 * size_t(positions[v])];
+			const float length2 = pSum[0] * pSum[0] + pSum[1] * pSum[1] + pSum[2] * pSum[2];
+			if (length2 > 0.f) {
+				const float scale = 1.f / std::sqrt(length2);
+				pNormals[3 * v] = pSum[0] * scale;
+				pNormals[3 * v + 1] = pSum[1] * scale;
+				pNormals[3 * v + 2] = pSum[2] * scale;
+			}
+		}
+	});
+}
+
+bool NormalGenerator::GenerateNormals(aiScene* pScene, bool smooth)
+{
+	// Like Assimp's steps, this expects every face to have vertices of its own
+	if (!pScene || (pScene->mFlags & AI_SCENE_FLAGS_NON_VERBOSE_FORMAT)) {
+		return false;
+	}
+
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	for (unsigned int m = 0; m < pScene->mNumMeshes; ++m) {
+		// Normals are undefined for lines and points, meshes of only those get none
+		aiMesh* pMesh = pScene->mMeshes[m];
+		if (pMesh->mNormals || pMesh->mNumVertices == 0 || !(pMesh->mPrimitiveTypes & (aiPrimitiveType_TRIANGLE | aiPrimitiveType_POLYGON))) {
+			continue;
+		}
+		pMesh->mNormals = new aiVector3D[pMesh->mNumVertices];
+		const float* pPositions = &pMesh->mVertices[0].x;
+		float* pNormals = &pMesh->mNormals[0].x;
+
+		if (smooth) {
+			// Polygons are fanned into triangles
+			std::vector<quint32> triangles;
+			for (unsigned int f = 0; f < pMesh->mNumFaces; ++f) {
+				const aiFace& face = pMesh->mFaces[f];
+				for (unsigned int i = 2; i < face.mNumIndices; ++i) {
+					triangles.insert(triangles.end(), { face.mIndices[0], face.mIndices[i - 1], face.mIndices[i] });
+				}
+			}
+			SmoothNormals(pPositions, pMesh->mNumVertices, triangles.data(), triangles.size() / 3, pNormals);
+		}
+		else {
+			// A polygon takes the normal of its first two corners and its last, as in Assimp.
+			// Faces are written in order, so vertices shared all the same end up with the
+			// normal of their last face.
+			std::vector<quint32> triangles(3 * size_t(pMesh->mNumFaces), 0);
+			VertexWelder::ParallelRuns(pMesh->mNumFaces, [&](size_t begin, size_t end) {
+				for (size_t f = begin; f < end; ++f) {
+					const aiFace& face = pMesh->mFaces[f];
+					if (face.mNumIndices >= 3) {
+						triangles[3 * f] = face.mIndices[0];
+						triangles[3 * f + 1] = face.mIndices[1];
+						triangles[3 * f + 2] = face.mIndices[face.mNumIndices - 1];
+					}
+				}
+			});
+			std::vector<float> faceNormals(triangles.size());
+			VertexWelder::ParallelRuns(pMesh->mNumFaces, [&](size_t begin, size_t end) {
+				FaceNormals(pPositions, &triangles[3 * begin], end - begin, &faceNormals[3 * begin]);
+			});
+			for (unsigned int f = 0; f < pMesh->mNumFaces; ++f) {
+				const aiFace& face = pMesh->mFaces[f];
+				for (unsigned int i = 0; i < face.mNumIndices; ++i) {
+					std::memcpy(pNormals + 3 * size_t(face.mIndices[i]), &faceNormals[3 * size_t(f)], 3 * sizeof(float));
+				}
+			}
+		}
+
+		// Lines and points in a mesh of triangles get no normal either
+		for (unsigned int f = 0; f < pMesh->mNumFaces; ++f) {
+			const aiFace& face = pMesh->mFaces[f];
+			if (face.mNumIndices < 3) {
+				for (unsigned int i = 0; i < face.mNumIndices; ++i) {
+					pMesh->mNormals[face.mIndices[i]] = aiVector3D(nan);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool NormalGenerator::JoinIdenticalVertices(aiScene* pScene)
+{
+	if (!pScene) {
+		return false;
+	}
+	for (unsigned int m = 0; m < pScene->mNumMeshes; ++m) {
+		if (pScene->mMeshes[m]->HasBones() || pScene->mMeshes[m]->mNumAnimMeshes > 0) {
+			return false;
+		}
+	}
+	for (unsigned int m = 0; m < pScene->mNumMeshes; ++m) {
+		JoinVertices(pScene->mMeshes[m]);
+	}
+	pScene->mFlags |= AI_SCENE_FLAGS_NON_VERBOSE_FORMAT;
+	return true;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <QtGlobal>
+
+#include <cstddef>
+
+struct aiScene;
+
+// Generates normals and joins identical vertices on every core, in place of Assimp's
+// GenNormals, GenSmoothNormals and JoinIdenticalVertices steps, which run on one thread.
+// Face normals are crossed four triangles at a time, with SSE2 on x86 and NEON on 64 bit ARM.
+// Smooth normals weigh the normal of each triangle at a position by the angle of its corner
+// there. The sums are split by position into shards that each add up on a thread of their own,
+// so threads never write to the same normal and no atomics are needed.
+class NormalGenerator
+{
+public:
+	// Normals of triangleCount triangles of three indices into pPositions, three floats per
+	// position, written to pNormals, three floats per triangle. Degenerate triangles get zero.
+	static void FaceNormals(const float* pPositions, const quint32* pIndices, size_t triangleCount, float* pNormals);
+
+	// Angle weighted normals of vertexCount vertices of three floats, written to pNormals,
+	// three floats per vertex. Vertices at the same position get the same normal, whatever
+	// else splits them. Vertices no triangle reaches get zero.
+	static void SmoothNormals(const float* pPositions, size_t vertexCount, const quint32* pIndices, size_t triangleCount, float* pNormals);
+
+	// The GenNormals step, or GenSmoothNormals with smooth, for the meshes of the scene that
+	// have no normals. Returns false without touching the scene when it has to be left to
+	// Assimp, which is when the scene isn't verbose.
+	static bool GenerateNormals(aiScene* pScene, bool smooth);
+
+	// The JoinIdenticalVertices step, for vertices whose attributes are all equal. Returns
+	// false without touching the scene when it has bones or blend shapes, which Assimp's step
+	// keeps in step with the vertices.
+	static bool JoinIdenticalVertices(aiScene* pScene);
+};
@@ -0,0 +1,134 @@
+#include "OcclusionCuller.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#ifndef GL_ANY_SAMPLES_PASSED
+#define GL_ANY_SAMPLES_PASSED 0x8C2F
+#endif
+
+
+OcclusionCuller::~OcclusionCuller()
+{
+	Destroy();
+}
+
+bool OcclusionCuller::Create()
+{
+	Destroy();
+
+	// GL_ANY_SAMPLES_PASSED is core in OpenGL 3.3 and OpenGL ES 3.0
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext) {
+		return false;
+	}
+	const QSurfaceFormat format = pContext->format();
+	const bool supported = pContext->isOpenGLES() ? format.majorVersion() >= 3
+		: format.version() >= qMakePair(3, 3) || pContext->hasExtension("GL_ARB_occlusion_query2");
+	if (!supported) {
+		return false;
+	}
+
+	m_pFunctions = pContext->extraFunctions();
+	m_created = true;
+	return true;
+}
+
+void OcclusionCuller::Destroy()
+{
+	Reset();
+	m_pFunctions = nullptr;
+	m_created = false;
+}
+
+bool OcclusionCuller::IsCreated() const
+{
+	return m_created;
+}
+
+void OcclusionCuller::Reset()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		for (const Entry& entry : m_entries) {
+			if (entry.m_query) {
+				m_pFunctions->glDeleteQueries(1, &entry.m_query);
+			}
+		}
+	}
+	m_entries.clear();
+	m_active = -1;
+	m_waiting = false;
+	m_changed = false;
+}
+
+void OcclusionCuller::BeginFrame(int meshCount)
+{
+	m_waiting = false;
+	m_changed = false;
+	if (!m_created) {
+		return;
+	}
+	if (int(m_entries.size()) != meshCount) {
+		Reset();
+		m_entries.resize(meshCount);
+	}
+
+	// Results that are not in yet are left for a later frame
+	for (Entry& entry : m_entries) {
+		if (!entry.m_pending) {
+			continue;
+		}
+		GLuint available = 0;
+		m_pFunctions->glGetQueryObjectuiv(entry.m_query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) {
+			m_waiting = true;
+			continue;
+		}
+		GLuint samples = 0;
+		m_pFunctions->glGetQueryObjectuiv(entry.m_query, GL_QUERY_RESULT, &samples);
+		const bool visible = samples != 0;
+		m_changed = m_changed || visible != entry.m_visible;
+		entry.m_visible = visible;
+		entry.m_pending = false;
+	}
+}
+
+bool OcclusionCuller::WasVisible(int mesh) const
+{
+	return mesh >= int(m_entries.size()) || m_entries[mesh].m_visible;
+}
+
+void OcclusionCuller::SetVisible(int mesh)
+{
+	if (mesh < int(m_entries.size())) {
+		m_entries[mesh].m_visible = true;
+	}
+}
+
+void OcclusionCuller::BeginQuery(int mesh)
+{
+	if (!m_created || mesh >= int(m_entries.size()) || m_entries[mesh].m_pending) {
+		return;
+	}
+	Entry& entry = m_entries[mesh];
+	if (!entry.m_query) {
+		m_pFunctions->glGenQueries(1, &entry.m_query);
+	}
+	m_pFunctions->glBeginQuery(GL_ANY_SAMPLES_PASSED, entry.m_query);
+	m_active = mesh;
+}
+
+void OcclusionCuller::EndQuery()
+{
+	if (m_active < 0) {
+		return;
+	}
+	m_pFunctions->glEndQuery(GL_ANY_SAMPLES_PASSED);
+	m_entries[m_active].m_pending = true;
+	m_active = -1;
+}
+
+bool OcclusionCuller::NeedsFrame() const
+{
+	return m_waiting || m_changed;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+
+#include <qopengl.h>
+
+class QOpenGLExtraFunctions;
+
+// Skips meshes hidden behind others. Every frame the AABBs of the meshes in view are drawn
+// with GL_ANY_SAMPLES_PASSED queries after the model, and the results are read the next
+// frame so drawing never waits on the GPU. A mesh that comes out from behind another one
+// therefore appears a frame late.
+class OcclusionCuller
+{
+public:
+	~OcclusionCuller();
+
+	// Creating and destroying the queries requires the context they are used in to be current.
+	// Create returns false if occlusion queries are not supported, the culler then does nothing.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Forgets all results, every mesh counts as visible again. Needs the context to be current.
+	void Reset();
+
+	// Reads the results that came in, call once per frame before drawing
+	void BeginFrame(int meshCount);
+
+	// Whether the last result for mesh saw any of its AABB
+	bool WasVisible(int mesh) const;
+
+	// Treats mesh as visible without a query, for meshes that can't be tested this frame
+	void SetVisible(int mesh);
+
+	// Brackets the draw of the mesh's AABB. Nothing is queried while an earlier query of the
+	// mesh is still outstanding.
+	void BeginQuery(int mesh);
+	void EndQuery();
+
+	// True while results are outstanding or the last results changed which meshes are
+	// visible, in both cases another frame is needed to show the right meshes
+	bool NeedsFrame() const;
+
+private:
+	struct Entry {
+		GLuint m_query = 0;
+		bool m_pending = false;
+		bool m_visible = true;
+	};
+	std::vector<Entry> m_entries;
+
+	QOpenGLExtraFunctions* m_pFunctions = nullptr;
+	bool m_created = false;
+	int m_active = -1;
+	bool m_waiting = false;
+	bool m_changed = false;
+};
@@ -0,0 +1,342 @@
+#include "PageFile.h"
+
+#include <QtConcurrent/QtConcurrent>
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+
+namespace {
+
+const char k_magic[8] = { 'M', 'V', 'P', 'A', 'G', 'E', 'S', '\0' };
+
+// Magic, version, width, height, paged levels, opaque and the number of blobs, followed by
+// the offset and size of each blob
+const qint64 k_headerBytes = sizeof(k_magic) + 6 * sizeof(quint32);
+const qint64 k_indexEntryBytes = 2 * sizeof(quint64);
+
+// Pages of opaque textures are stored as JPEG, which is a fraction of the size of PNG
+const int k_jpegQuality = 90;
+
+template<class T>
+void Append(QByteArray& data, T value)
+{
+	data.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+template<class T>
+T Read(const uchar* pData)
+{
+	T value;
+	std::memcpy(&value, pData, sizeof(value));
+	return value;
+}
+
+QSize PageCount(const QSize& size)
+{
+	return QSize((size.width() + PageFile::k_pageContent - 1) / PageFile::k_pageContent,
+		(size.height() + PageFile::k_pageContent - 1) / PageFile::k_pageContent);
+}
+
+bool IsOpaque(const QImage& image)
+{
+	for (int y = 0; y < image.height(); ++y) {
+		const uchar* pLine = image.constScanLine(y);
+		for (int x = 0; x < image.width(); ++x) {
+			if (pLine[4 * x + 3] != 255) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// The next level of an RGBA8888 image, each texel the average of the two by two texels over it.
+// Odd sides repeat their last row or column.
+QImage Downsample(const QImage& image)
+{
+	QImage ret((image.width() + 1) / 2, (image.height() + 1) / 2, QImage::Format_RGBA8888);
+	uchar* pBits = ret.bits();
+	const int bytesPerLine = ret.bytesPerLine();
+	std::vector<int> rows(ret.height());
+	std::iota(rows.begin(), rows.end(), 0);
+	QtConcurrent::blockingMap(rows, [&](int y) {
+		const uchar* pRow0 = image.constScanLine(2 * y);
+		const uchar* pRow1 = image.constScanLine(std::min(2 * y + 1, image.height() - 1));
+		uchar* pOut = pBits + size_t(y) * bytesPerLine;
+		for (int x = 0; x < ret.width(); ++x) {
+			const int x0 = 8 * x;
+			const int x1 = 4 * std::min(2 * x + 1, image.width() - 1);
+			for (int c = 0; c < 4; ++c) {
+				pOut[4 * x + c] = uchar((pRow0[x0 + c] + pRow0[x1 + c] + pRow1[x0 + c] + pRow1[x1 + c] + 2) / 4);
+			}
+		}
+	});
+	return ret;
+}
+
+// A page with its border, texels outside the level repeat its edge
+QImage CutPage(const QImage& level, int pageX, int pageY)
+{
+	QImage page(PageFile::k_pageSize, PageFile::k_pageSize, QImage::Format_RGBA8888);
+	const int left = pageX * PageFile::k_pageContent - PageFile::k_pageBorder;
+	const int bottom = pageY * PageFile::k_pageContent - PageFile::k_pageBorder;
+	for (int y = 0; y < PageFile::k_pageSize; ++y) {
+		const uchar* pSource = level.constScanLine(qBound(0, bottom + y, level.height() - 1));
+		uchar* pOut = page.scanLine(y);
+		for (int x = 0; x < PageFile::k_pageSize; ++x) {
+			std::memcpy(pOut + 4 * x, pSource + 4 * qBound(0, left + x, level.width() - 1), 4);
+		}
+	}
+	return page;
+}
+
+QByteArray Encode(const QImage& image, bool opaque)
+{
+	QByteArray data;
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+	const bool written = opaque ? image.convertToFormat(QImage::Format_RGB888).save(&buffer, "JPG", k_jpegQuality) : image.save(&buffer, "PNG");
+	return written ? data : QByteArray();
+}
+
+}
+
+bool PageFile::Open(const QString& path)
+{
+	*this = PageFile();
+	QSharedPointer<QFile> file(new QFile(path));
+	if (!file->open(QIODevice::ReadOnly) || file->size() < k_headerBytes) {
+		return false;
+	}
+	const qint64 bytes = file->size();
+	const uchar* pData = file->map(0, bytes);
+	if (!pData || std::memcmp(pData, k_magic, sizeof(k_magic)) != 0) {
+		return false;
+	}
+	const uchar* pHeader = pData + sizeof(k_magic);
+	const quint32 version = Read<quint32>(pHeader);
+	const QSize size(Read<qint32>(pHeader + 4), Read<qint32>(pHeader + 8));
+	const int levels = int(Read<quint32>(pHeader + 12));
+	const bool opaque = Read<quint32>(pHeader + 16) != 0;
+	const qint64 blobCount = Read<quint32>(pHeader + 20);
+	if (version != k_version || size.isEmpty() || levels < 1 || levels > 16 || k_headerBytes + blobCount * k_indexEntryBytes > bytes) {
+		return false;
+	}
+
+	// The pages of every level and the tail, each blob has to lie within the file
+	std::vector<int> levelStart;
+	int pages = 0;
+	for (int level = 0; level < levels; ++level) {
+		const QSize levelPages = PageCount(LevelSize(size, level));
+		levelStart.push_back(pages);
+		pages += levelPages.width() * levelPages.height();
+	}
+	if (blobCount != pages + 1) {
+		return false;
+	}
+	std::vector<std::pair<qint64, qint64>> blobs(blobCount);
+	const uchar* pIndex = pData + k_headerBytes;
+	for (qint64 i = 0; i < blobCount; ++i) {
+		const qint64 offset = qint64(Read<quint64>(pIndex + i * k_indexEntryBytes));
+		const qint64 blobBytes = qint64(Read<quint64>(pIndex + i * k_indexEntryBytes + sizeof(quint64)));
+		if (offset < 0 || blobBytes <= 0 || offset > bytes || blobBytes > bytes - offset) {
+			return false;
+		}
+		blobs[i] = std::make_pair(offset, blobBytes);
+	}
+
+	m_file = file;
+	m_pData = pData;
+	m_bytes = bytes;
+	m_path = path;
+	m_size = size;
+	m_opaque = opaque;
+	m_levelStart = std::move(levelStart);
+	m_blobs = std::move(blobs);
+	return true;
+}
+
+bool PageFile::IsOpen() const
+{
+	return m_pData != nullptr;
+}
+
+QString PageFile::Path() const
+{
+	return m_path;
+}
+
+QSize PageFile::Size() const
+{
+	return m_size;
+}
+
+int PageFile::Levels() const
+{
+	return int(m_levelStart.size());
+}
+
+QSize PageFile::LevelSize(int level) const
+{
+	return LevelSize(m_size, level);
+}
+
+QSize PageFile::LevelPages(int level) const
+{
+	return PageCount(LevelSize(level));
+}
+
+QImage PageFile::ReadPage(int level, int x, int y) const
+{
+	if (level < 0 || level >= Levels()) {
+		return QImage();
+	}
+	const QSize pages = LevelPages(level);
+	if (x < 0 || y < 0 || x >= pages.width() || y >= pages.height()) {
+		return QImage();
+	}
+	return ReadBlob(m_levelStart[level] + y * pages.width() + x, QSize(k_pageSize, k_pageSize));
+}
+
+QImage PageFile::Tail() const
+{
+	if (!IsOpen()) {
+		return QImage();
+	}
+	return ReadBlob(int(m_blobs.size()) - 1, LevelSize(Levels()));
+}
+
+QImage PageFile::ReadBlob(int index, const QSize& size) const
+{
+	// The tail is always PNG, so it is exact where the pages are not
+	const bool jpeg = m_opaque && index + 1 < int(m_blobs.size());
+	const std::pair<qint64, qint64>& blob = m_blobs[index];
+	QImage image = QImage::fromData(m_pData + blob.first, int(blob.second), jpeg ? "JPG" : "PNG");
+	if (image.size() != size) {
+		return QImage();
+	}
+	return image.convertToFormat(QImage::Format_RGBA8888);
+}
+
+bool PageFile::Write(const QString& path, const QImage& image)
+{
+	QImage level = image.convertToFormat(QImage::Format_RGBA8888);
+	if (level.isNull()) {
+		return false;
+	}
+	// Textures too wide for the page tables start at the first level that fits them
+	while (std::max(level.width(), level.height()) > k_maxPages * k_pageContent) {
+		level = Downsample(level);
+	}
+	const QSize size = level.size();
+	const bool opaque = IsOpaque(level);
+
+	// Each level is paged and then replaced by the next, so only one is held at a time
+	std::vector<QByteArray> blobs;
+	int levels = 0;
+	while (NeedsPages(level.size())) {
+		const QSize pages = PageCount(level.size());
+		std::vector<QByteArray> levelBlobs(size_t(pages.width()) * pages.height());
+		std::vector<int> rows(pages.height());
+		std::iota(rows.begin(), rows.end(), 0);
+		QtConcurrent::blockingMap(rows, [&](int y) {
+			for (int x = 0; x < pages.width(); ++x) {
+				levelBlobs[size_t(y) * pages.width() + x] = Encode(CutPage(level, x, y), opaque);
+			}
+		});
+		for (QByteArray& blob : levelBlobs) {
+			if (blob.isEmpty()) {
+				return false;
+			}
+			blobs.push_back(std::move(blob));
+		}
+		level = Downsample(level);
+		++levels;
+	}
+	if (levels == 0) {
+		return false;
+	}
+	blobs.push_back(Encode(level, false));
+	if (blobs.back().isEmpty()) {
+		return false;
+	}
+
+	QByteArray header(k_magic, sizeof(k_magic));
+	Append(header, k_version);
+	Append(header, qint32(size.width()));
+	Append(header, qint32(size.height()));
+	Append(header, quint32(levels));
+	Append(header, quint32(opaque ? 1 : 0));
+	Append(header, quint32(blobs.size()));
+	qint64 offset = k_headerBytes + qint64(blobs.size()) * k_indexEntryBytes;
+	for (const QByteArray& blob : blobs) {
+		Append(header, quint64(offset));
+		Append(header, quint64(blob.size()));
+		offset += blob.size();
+	}
+
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly) || file.write(header) != header.size()) {
+		return false;
+	}
+	for (const QByteArray& blob : blobs) {
+		if (file.write(blob) != blob.size()) {
+			file.cancelWriting();
+			return false;
+		}
+	}
+	return file.commit();
+}
+
+QSize PageFile::LevelSize(const QSize& size, int level)
+{
+	QSize ret = size;
+	for (int i = 0; i < level; ++i) {
+		ret = QSize((ret.width() + 1) / 2, (ret.height() + 1) / 2);
+	}
+	return ret;
+}
+
+bool PageFile::NeedsPages(const QSize& size)
+{
+	return std::max(size.width(), size.height()) > k_tailSize;
+}
+
+QString PageFile::DefaultFolder()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/pages";
+}
+
+QString PageFile::PathFor(const QByteArray& contents, const QString& folder)
+{
+	// The layout is part of the key, so changing it doesn't read old files
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+	hash.addData(contents);
+	hash.addData(QString("%1 %2 %3 %4").arg(k_version).arg(k_pageSize).arg(k_pageBorder).arg(k_tailSize).toUtf8());
+	return folder + "/" + hash.result().toHex() + ".mvpages";
+}
+
+void PageFile::Trim(const QString& folder)
+{
+	// Files that are mapped right now can't be removed on Windows, they are left for the next time
+	QFileInfoList files = QDir(folder).entryInfoList(QStringList("*.mvpages"), QDir::Files, QDir::Time);
+	qint64 total = 0;
+	for (const QFileInfo& file : files) {
+		total += file.size();
+	}
+	while (total > k_maxBytes && !files.isEmpty()) {
+		const QFileInfo oldest = files.takeLast();
+		if (QFile::remove(oldest.filePath())) {
+			total -= oldest.size();
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <vector>
+
+#include <QByteArray>
+#include <QImage>
+#include <QSharedPointer>
+#include <QSize>
+#include <QString>
+
+class QFile;
+
+// A texture cut into square pages for VirtualTextures, so only the pages the view needs have
+// to be on the GPU. Each level of its mip chain whose longer side is over k_tailSize is split
+// into pages of k_pageContent texels, stored with a border of k_pageBorder texels of their
+// neighbours so filtering within a page never reads another. The first level that fits
+// k_tailSize is the tail, kept whole: it is drawn where no page is resident yet.
+// Pages are JPEG where the texture is opaque and PNG where it isn't, each read on its own
+// from the memory mapped file. Images are stored the way they are uploaded, bottom row first,
+// and pages are counted from the bottom left.
+class PageFile
+{
+public:
+	// Bump whenever the layout of the file changes
+	static const quint32 k_version = 1;
+
+	static const int k_pageSize = 128;
+	static const int k_pageBorder = 4;
+	static const int k_pageContent = k_pageSize - 2 * k_pageBorder;
+	static const int k_tailSize = 512;
+
+	// Pages a level may have per side, larger textures are paged from a smaller first level
+	static const int k_maxPages = 256;
+
+	// Oldest page files are removed once the folder grows past this
+	static const qint64 k_maxBytes = 4ll * 1024 * 1024 * 1024;
+
+	// Maps the file, false if it isn't a page file of this version
+	bool Open(const QString& path);
+	bool IsOpen() const;
+	QString Path() const;
+
+	// The first level, the number of paged levels, and the size and pages of each of them
+	QSize Size() const;
+	int Levels() const;
+	QSize LevelSize(int level) const;
+	QSize LevelPages(int level) const;
+
+	// Decodes a page as a k_pageSize square RGBA8888 image, null if it is out of range or
+	// broken. Safe to call from several threads at once.
+	QImage ReadPage(int level, int x, int y) const;
+	QImage Tail() const;
+
+	// Pages image, bottom row first as it is uploaded, into a new file at path
+	static bool Write(const QString& path, const QImage& image);
+
+	// Size of a level of a texture whose first level is size, each level is half the one before
+	// rounded up
+	static QSize LevelSize(const QSize& size, int level);
+
+	// Whether a texture of size has any levels to page
+	static bool NeedsPages(const QSize& size);
+
+	// Per user cache location of the application for page files
+	static QString DefaultFolder();
+
+	// Where the page file of an image file with contents is kept in folder
+	static QString PathFor(const QByteArray& contents, const QString& folder);
+
+	// Removes the least recently written page files until folder fits k_maxBytes
+	static void Trim(const QString& folder);
+
+private:
+	QImage ReadBlob(int index, const QSize& size) const;
+
+	QSharedPointer<QFile> m_file;
+	const uchar* m_pData = nullptr;
+	qint64 m_bytes = 0;
+	QString m_path;
+
+	QSize m_size;
+	bool m_opaque = false;
+	// Index of the first page of each level, the tail follows the last one
+	std::vector<int> m_levelStart;
+	// Offset and size of every page, level by level, row by row from the bottom
+	std::vector<std::pair<qint64, qint64>> m_blobs;
+};
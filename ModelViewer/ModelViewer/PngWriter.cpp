@@ -0,0 +1,285 @@
+#include "PngWriter.h"
+
+#include <algorithm>
+
+
+namespace {
+	// Compressed data is written as a chunk once this much has piled up
+	const size_t k_chunkBytes = 256 * 1024;
+
+	// Deflate matches are at most this long
+	const int k_maxMatch = 258;
+
+	// Where each length code of fixed Huffman blocks starts, and the extra bits after it
+	const int k_lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+	const int k_lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+	const int k_distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+	const int k_distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+	quint32 Crc32(quint32 crc, const uchar* pData, size_t size)
+	{
+		static const std::vector<quint32> table = [] {
+			std::vector<quint32> ret(256);
+			for (quint32 n = 0; n < 256; ++n) {
+				quint32 c = n;
+				for (int k = 0; k < 8; ++k) {
+					c = (c & 1) ? 0xedb88320u ^ (c >> 1) : c >> 1;
+				}
+				ret[n] = c;
+			}
+			return ret;
+		}();
+		crc = ~crc;
+		for (size_t i = 0; i < size; ++i) {
+			crc = table[(crc ^ pData[i]) & 0xff] ^ (crc >> 8);
+		}
+		return ~crc;
+	}
+
+	void AppendBigEndian(std::vector<uchar>& bytes, quint32 value)
+	{
+		for (int shift = 24; shift >= 0; shift -= 8) {
+			bytes.push_back(uchar(value >> shift));
+		}
+	}
+}
+
+PngWriter::~PngWriter()
+{
+	if (IsOpen()) {
+		Close();
+	}
+}
+
+bool PngWriter::Open(const QString& path, const QSize& size)
+{
+	if (IsOpen() || size.isEmpty()) {
+		return false;
+	}
+	m_file.setFileName(path);
+	if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+	m_size = size;
+	m_rowsWritten = 0;
+	m_failed = false;
+	m_previous.assign(size_t(size.width()) * 3, 0);
+	m_data.clear();
+	m_bitBuffer = 0;
+	m_bitCount = 0;
+	m_adlerA = 1;
+	m_adlerB = 0;
+
+	// 8 bits per channel, RGB, no interlacing
+	static const uchar signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	m_failed = m_file.write(reinterpret_cast<const char*>(signature), sizeof(signature)) != qint64(sizeof(signature));
+	std::vector<uchar> header;
+	AppendBigEndian(header, quint32(size.width()));
+	AppendBigEndian(header, quint32(size.height()));
+	header.insert(header.end(), { 8, 2, 0, 0, 0 });
+	WriteChunk("IHDR", header.data(), int(header.size()));
+
+	// The zlib header of the data, deflate with the smallest window that still checks out
+	m_data.push_back(0x78);
+	m_data.push_back(0x01);
+	return !m_failed;
+}
+
+bool PngWriter::IsOpen() const
+{
+	return m_file.isOpen();
+}
+
+bool PngWriter::WriteRows(const uchar* pPixels, int rowCount, int bytesPerLine)
+{
+	if (!IsOpen()) {
+		return false;
+	}
+	rowCount = std::min(rowCount, m_size.height() - m_rowsWritten);
+	if (rowCount <= 0) {
+		return !m_failed;
+	}
+
+	// Every row is stored as its difference to the one above, which turns flat areas and
+	// repeated rows into runs of zeros
+	const size_t rowBytes = m_previous.size();
+	m_filtered.resize((rowBytes + 1) * size_t(rowCount));
+	uchar* pOut = m_filtered.data();
+	for (int row = 0; row < rowCount; ++row) {
+		const uchar* pRow = pPixels + size_t(row) * size_t(bytesPerLine);
+		*pOut++ = 2;
+		for (int x = 0; x < m_size.width(); ++x) {
+			for (int c = 0; c < 3; ++c) {
+				const size_t i = size_t(x) * 3 + c;
+				const uchar value = pRow[size_t(x) * 4 + c];
+				*pOut++ = uchar(value - m_previous[i]);
+				m_previous[i] = value;
+			}
+		}
+	}
+	m_rowsWritten += rowCount;
+
+	Deflate(m_filtered.data(), int(m_filtered.size()));
+	return FlushData(false) && !m_failed;
+}
+
+bool PngWriter::Close()
+{
+	if (!IsOpen()) {
+		return false;
+	}
+
+	// An empty final block, then the checksum of everything compressed
+	PutBits(1, 1);
+	PutBits(1, 2);
+	PutLiteral(256);
+	FlushBits();
+	AppendBigEndian(m_data, (m_adlerB << 16) | m_adlerA);
+	FlushData(true);
+	WriteChunk("IEND", nullptr, 0);
+
+	const bool success = !m_failed && m_rowsWritten == m_size.height();
+	m_file.close();
+	if (!success) {
+		m_file.remove();
+	}
+	m_previous.clear();
+	m_filtered.clear();
+	m_data.clear();
+	return success;
+}
+
+void PngWriter::Deflate(const uchar* pData, int size)
+{
+	// The checksum is updated in runs short enough not to overflow before the modulo
+	for (int start = 0; start < size; start += 5552) {
+		const int end = std::min(size, start + 5552);
+		for (int i = start; i < end; ++i) {
+			m_adlerA += pData[i];
+			m_adlerB += m_adlerA;
+		}
+		m_adlerA %= 65521;
+		m_adlerB %= 65521;
+	}
+
+	// One block per band of rows. Only the byte before and the pixel before are looked at for
+	// a match, which is what filtered renders mostly repeat.
+	PutBits(0, 1);
+	PutBits(1, 2);
+	for (int i = 0; i < size;) {
+		int bestLength = 0;
+		int bestDistance = 0;
+		for (int distance : { 1, 3 }) {
+			if (i < distance) {
+				continue;
+			}
+			const int maxLength = std::min(k_maxMatch, size - i);
+			int length = 0;
+			while (length < maxLength && pData[i + length] == pData[i + length - distance]) {
+				++length;
+			}
+			if (length > bestLength) {
+				bestLength = length;
+				bestDistance = distance;
+			}
+		}
+		if (bestLength >= 3) {
+			PutMatch(bestLength, bestDistance);
+			i += bestLength;
+		}
+		else {
+			PutLiteral(pData[i]);
+			++i;
+		}
+	}
+	PutLiteral(256);
+}
+
+void PngWriter::PutBits(quint32 bits, int count)
+{
+	m_bitBuffer |= bits << m_bitCount;
+	m_bitCount += count;
+	while (m_bitCount >= 8) {
+		m_data.push_back(uchar(m_bitBuffer));
+		m_bitBuffer >>= 8;
+		m_bitCount -= 8;
+	}
+}
+
+void PngWriter::PutCode(quint32 code, int length)
+{
+	// Huffman codes go out starting with their most significant bit
+	quint32 reversed = 0;
+	for (int i = 0; i < length; ++i) {
+		reversed = (reversed << 1) | ((code >> i) & 1);
+	}
+	PutBits(reversed, length);
+}
+
+void PngWriter::PutLiteral(int value)
+{
+	if (value < 144) {
+		PutCode(0x30 + value, 8);
+	}
+	else if (value < 256) {
+		PutCode(0x190 + value - 144, 9);
+	}
+	else if (value < 280) {
+		PutCode(value - 256, 7);
+	}
+	else {
+		PutCode(0xc0 + value - 280, 8);
+	}
+}
+
+void PngWriter::PutMatch(int length, int distance)
+{
+	int lengthCode = 28;
+	while (k_lengthBase[lengthCode] > length) {
+		--lengthCode;
+	}
+	PutLiteral(257 + lengthCode);
+	PutBits(quint32(length - k_lengthBase[lengthCode]), k_lengthExtra[lengthCode]);
+
+	int distanceCode = 29;
+	while (k_distanceBase[distanceCode] > distance) {
+		--distanceCode;
+	}
+	PutCode(quint32(distanceCode), 5);
+	PutBits(quint32(distance - k_distanceBase[distanceCode]), k_distanceExtra[distanceCode]);
+}
+
+void PngWriter::FlushBits()
+{
+	if (m_bitCount > 0) {
+		PutBits(0, 8 - m_bitCount);
+	}
+}
+
+bool PngWriter::WriteChunk(const char* pType, const uchar* pData, int size)
+{
+	std::vector<uchar> header;
+	AppendBigEndian(header, quint32(size));
+	header.insert(header.end(), pType, pType + 4);
+	quint32 crc = Crc32(0, header.data() + 4, 4);
+	crc = Crc32(crc, pData, size_t(size));
+	std::vector<uchar> footer;
+	AppendBigEndian(footer, crc);
+
+	m_failed = m_failed
+		|| m_file.write(reinterpret_cast<const char*>(header.data()), qint64(header.size())) != qint64(header.size())
+		|| (size > 0 && m_file.write(reinterpret_cast<const char*>(pData), size) != size)
+		|| m_file.write(reinterpret_cast<const char*>(footer.data()), qint64(footer.size())) != qint64(footer.size());
+	return !m_failed;
+}
+
+bool PngWriter::FlushData(bool all)
+{
+	// Whole bytes only, the bits of the next byte stay in the bit buffer
+	if (m_data.empty() || (!all && m_data.size() < k_chunkBytes)) {
+		return !m_failed;
+	}
+	const bool written = WriteChunk("IDAT", m_data.data(), int(m_data.size()));
+	m_data.clear();
+	return written;
+}
@@ -0,0 +1,54 @@
+#pragma once
+#include <vector>
+
+#include <QFile>
+#include <QSize>
+#include <QString>
+
+// Writes an RGB PNG a band of rows at a time, so images too large to hold in memory can be
+// saved as they are rendered. Each row is filtered against the one above it and compressed
+// with fixed Huffman codes, matching only runs of repeated bytes and pixels. That is far from
+// the best PNG compression, but keeps flat backgrounds and repeated rows small at little cost.
+class PngWriter
+{
+public:
+	~PngWriter();
+
+	// Opens path and writes the header of an image of size. False if the file can't be opened.
+	bool Open(const QString& path, const QSize& size);
+	bool IsOpen() const;
+
+	// Appends rowCount rows of RGBA pixels, top row first, bytesPerLine apart. Alpha is dropped.
+	// Rows past the height of the image are ignored.
+	bool WriteRows(const uchar* pPixels, int rowCount, int bytesPerLine);
+
+	// Writes the end of the image and closes the file. False if any write failed or fewer rows
+	// than the height of the image were written, in which case the file is removed.
+	bool Close();
+
+private:
+	void Deflate(const uchar* pData, int size);
+	void PutBits(quint32 bits, int count);
+	void PutCode(quint32 code, int length);
+	void PutLiteral(int value);
+	void PutMatch(int length, int distance);
+	void FlushBits();
+	bool WriteChunk(const char* pType, const uchar* pData, int size);
+	bool FlushData(bool all);
+
+	QFile m_file;
+	QSize m_size;
+	int m_rowsWritten = 0;
+	bool m_failed = false;
+
+	// The last row as it was given, for the next one to be filtered against
+	std::vector<uchar> m_previous;
+	std::vector<uchar> m_filtered;
+
+	// The compressed data not yet written as a chunk, and the bits not yet making up a byte
+	std::vector<uchar> m_data;
+	quint32 m_bitBuffer = 0;
+	int m_bitCount = 0;
+	quint32 m_adlerA = 1;
+	quint32 m_adlerB = 0;
+};
@@ -0,0 +1,643 @@
+#include "PointCloudLoader.h"
+#include "BoundsMath.h"
+#include "FileContents.h"
+#include "ImportIOSystem.h"
+#include "ModelStats.h"
+#include "SceneGraph.h"
+#include "VertexWelder.h"
+
+#include <QByteArray>
+#include <QFileInfo>
+#include <QList>
+#include <QMutex>
+#include <QVector3D>
+
+#include <algorithm>
+#include <atomic>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+
+namespace {
+
+// Points without colors are drawn in this gray
+const quint32 k_defaultColor = 0xffccccccu;
+
+// The LAS header up to the point count of LAS 1.4, which follows the extended records
+const qint64 k_lasHeaderBytes = 227;
+const qint64 k_lasPointCountOffset = 247;
+
+// Where the 16 bit RGB of each LAS point format 0 to 10 is, -1 for formats without color, and
+// the least bytes a record of each takes
+const int k_lasColorOffsets[] = { -1, -1, 20, 28, -1, 28, -1, 30, 30, -1, 30 };
+const int k_lasRecordBytes[] = { 20, 28, 26, 34, 57, 63, 30, 36, 38, 59, 67 };
+
+using Point = PointCloudLoader::Point;
+static_assert(sizeof(Point) == 16, "Points are stored as they are drawn");
+
+struct Cloud {
+	std::vector<Point> m_points;
+	// Taken off the positions
+	std::array<double, 3> m_origin = {};
+};
+
+template <typename T>
+T Load(const uchar* p)
+{
+	T value;
+	std::memcpy(&value, p, sizeof(T));
+	return value;
+}
+
+// A value of a PLY file, whose byte order may be the other one
+template <typename T>
+double LoadValue(const uchar* p, bool swap)
+{
+	uchar bytes[sizeof(T)];
+	std::memcpy(bytes, p, sizeof(T));
+	if (swap) {
+		std::reverse(bytes, bytes + sizeof(T));
+	}
+	return double(Load<T>(bytes));
+}
+
+// Rounded to a whole number that a float holds exactly, so the root node's translation, which
+// is a float, moves the points back to where they were
+double RoundOrigin(double value)
+{
+	return double(float(std::round(value)));
+}
+
+void AtomicMax(std::atomic<int>& value, int candidate)
+{
+	int current = value.load(std::memory_order_relaxed);
+	while (candidate > current && !value.compare_exchange_weak(current, candidate, std::memory_order_relaxed)) {
+	}
+}
+
+QString ReadLas(const uchar* pBegin, qint64 size, Cloud& cloud)
+{
+	if (size < k_lasHeaderBytes || std::memcmp(pBegin, "LASF", 4) != 0) {
+		return "The file isn't a LAS file";
+	}
+	const int versionMinor = pBegin[25];
+	const quint32 pointOffset = Load<quint32>(pBegin + 96);
+	const int format = pBegin[104];
+	const int recordBytes = Load<quint16>(pBegin + 105);
+	quint64 count = Load<quint32>(pBegin + 107);
+	if (versionMinor >= 4 && size >= k_lasPointCountOffset + 8 && Load<quint64>(pBegin + k_lasPointCountOffset) > 0) {
+		count = Load<quint64>(pBegin + k_lasPointCountOffset);
+	}
+
+	// LASzip marks its compressed formats with the upper bits
+	if (format & 0xc0) {
+		return "The file is compressed with LASzip, which isn't built in. Decompress it to LAS first";
+	}
+	if (format >= int(sizeof(k_lasRecordBytes) / sizeof(k_lasRecordBytes[0]))) {
+		return QString("The file has points of format %1").arg(format);
+	}
+	if (recordBytes < k_lasRecordBytes[format]) {
+		return "The file has points too short for their format";
+	}
+	if (count == 0) {
+		return "The file has no points";
+	}
+	if (count > UINT_MAX) {
+		return "The file has too many points";
+	}
+	if (qint64(pointOffset) + qint64(count) * recordBytes > size) {
+		return "The file is cut short";
+	}
+
+	// Points are integers scaled and offset per axis. Z up is turned to Y up.
+	const double scale[3] = { Load<double>(pBegin + 131), Load<double>(pBegin + 139), Load<double>(pBegin + 147) };
+	const double offset[3] = { Load<double>(pBegin + 155), Load<double>(pBegin + 163), Load<double>(pBegin + 171) };
+	const double center[3] = {
+		(Load<double>(pBegin + 179) + Load<double>(pBegin + 187)) * 0.5,
+		(Load<double>(pBegin + 195) + Load<double>(pBegin + 203)) * 0.5,
+		(Load<double>(pBegin + 211) + Load<double>(pBegin + 219)) * 0.5,
+	};
+	cloud.m_origin = { RoundOrigin(center[0]), RoundOrigin(center[2]), RoundOrigin(-center[1]) };
+
+	// Colors meant to be 8 bit are often stored as they are rather than scaled to 16 bits, they
+	// are told apart by their largest value. Clouds without colors are shaded by intensity.
+	const uchar* pPoints = pBegin + pointOffset;
+	const int colorOffset = k_lasColorOffsets[format];
+	std::atomic<int> maxColor(0);
+	std::atomic<int> maxIntensity(0);
+	cloud.m_points.resize(size_t(count));
+	VertexWelder::ParallelRuns(size_t(count), [&](size_t begin, size_t end) {
+		int runColor = 0;
+		int runIntensity = 0;
+		for (size_t i = begin; i < end; ++i) {
+			const uchar* p = pPoints + i * recordBytes;
+			const double x = Load<qint32>(p) * scale[0] + offset[0];
+			const double y = Load<qint32>(p + 4) * scale[1] + offset[1];
+			const double z = Load<qint32>(p + 8) * scale[2] + offset[2];
+			cloud.m_points[i].m_position = { float(x - cloud.m_origin[0]), float(z - cloud.m_origin[1]), float(-y - cloud.m_origin[2]) };
+			cloud.m_points[i].m_color = k_defaultColor;
+			runIntensity = std::max(runIntensity, int(Load<quint16>(p + 12)));
+			if (colorOffset >= 0) {
+				const int rgb = std::max({ Load<quint16>(p + colorOffset), Load<quint16>(p + colorOffset + 2), Load<quint16>(p + colorOffset + 4) });
+				runColor = std::max(runColor, rgb);
+			}
+		}
+		AtomicMax(maxColor, runColor);
+		AtomicMax(maxIntensity, runIntensity);
+	});
+
+	if (maxColor == 0 && maxIntensity == 0) {
+		return QString();
+	}
+	const int shift = maxColor > 255 ? 8 : 0;
+	const int intensityRange = maxIntensity;
+	VertexWelder::ParallelRuns(size_t(count), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			const uchar* p = pPoints + i * recordBytes;
+			if (maxColor > 0) {
+				const quint32 r = Load<quint16>(p + colorOffset) >> shift;
+				const quint32 g = Load<quint16>(p + colorOffset + 2) >> shift;
+				const quint32 b = Load<quint16>(p + colorOffset + 4) >> shift;
+				cloud.m_points[i].m_color = 0xff000000u | b << 16 | g << 8 | r;
+			}
+			else {
+				const quint32 gray = quint32(Load<quint16>(p + 12)) * 255 / quint32(intensityRange);
+				cloud.m_points[i].m_color = 0xff000000u | gray << 16 | gray << 8 | gray;
+			}
+		}
+	});
+	return QString();
+}
+
+// The scalar types of PLY properties
+enum class PlyType {
+	Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64, Unknown,
+};
+
+PlyType ParsePlyType(const QByteArray& name)
+{
+	static const std::pair<const char*, PlyType> k_types[] = {
+		{ "char", PlyType::Int8 }, { "int8", PlyType::Int8 }, { "uchar", PlyType::UInt8 }, { "uint8", PlyType::UInt8 },
+		{ "short", PlyType::Int16 }, { "int16", PlyType::Int16 }, { "ushort", PlyType::UInt16 }, { "uint16", PlyType::UInt16 },
+		{ "int", PlyType::Int32 }, { "int32", PlyType::Int32 }, { "uint", PlyType::UInt32 }, { "uint32", PlyType::UInt32 },
+		{ "float", PlyType::Float32 }, { "float32", PlyType::Float32 }, { "double", PlyType::Float64 }, { "float64", PlyType::Float64 },
+	};
+	for (const auto& type : k_types) {
+		if (name == type.first) {
+			return type.second;
+		}
+	}
+	return PlyType::Unknown;
+}
+
+int PlySize(PlyType type)
+{
+	switch (type) {
+	case PlyType::Int8:
+	case PlyType::UInt8:
+		return 1;
+	case PlyType::Int16:
+	case PlyType::UInt16:
+		return 2;
+	case PlyType::Float64:
+		return 8;
+	default:
+		return 4;
+	}
+}
+
+double LoadPlyValue(const uchar* p, PlyType type, bool swap)
+{
+	switch (type) {
+	case PlyType::Int8:
+		return double(qint8(*p));
+	case PlyType::UInt8:
+		return double(*p);
+	case PlyType::Int16:
+		return LoadValue<qint16>(p, swap);
+	case PlyType::UInt16:
+		return LoadValue<quint16>(p, swap);
+	case PlyType::Int32:
+		return LoadValue<qint32>(p, swap);
+	case PlyType::UInt32:
+		return LoadValue<quint32>(p, swap);
+	case PlyType::Float32:
+		return LoadValue<float>(p, swap);
+	default:
+		return LoadValue<double>(p, swap);
+	}
+}
+
+// A color channel of a PLY vertex in 0 to 255, from the range of its type
+quint32 PlyColor(const uchar* p, PlyType type, bool swap)
+{
+	const double value = LoadPlyValue(p, type, swap);
+	const double scaled = type == PlyType::UInt8 ? value : type == PlyType::UInt16 ? value / 257.0 : value * 255.0;
+	return quint32(std::min(std::max(scaled, 0.0), 255.0) + 0.5);
+}
+
+QString ReadPly(const uchar* pBegin, qint64 size, Cloud& cloud)
+{
+	struct Property {
+		PlyType m_type;
+		int m_offset;
+	};
+	// x, y, z, red, green, blue
+	const int k_targetCount = 6;
+	Property targets[k_targetCount] = {};
+	bool has[k_targetCount] = {};
+
+	// The header, up to end_header
+	const char* pText = reinterpret_cast<const char*>(pBegin);
+	const char* pEnd = pText + size;
+	const char* pBody = nullptr;
+	bool swap = false;
+	bool inVertex = false;
+	bool hasVertex = false;
+	quint64 count = 0;
+	int stride = 0;
+	for (const char* p = pText; p < pEnd && !pBody;) {
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(pEnd - p)));
+		lineEnd = lineEnd ? lineEnd : pEnd;
+		const QList<QByteArray> words = QByteArray::fromRawData(p, int(lineEnd - p)).simplified().split(' ');
+		const bool first = p == pText;
+		p = lineEnd + 1;
+		if (first) {
+			if (words[0] != "ply") {
+				return "The file isn't a PLY file";
+			}
+			continue;
+		}
+		if (words[0] == "format") {
+			if (words.size() < 2 || words[1] == "ascii") {
+				return "Text PLY files are left to TextModelLoader";
+			}
+			swap = words[1] == "binary_big_endian";
+		}
+		else if (words[0] == "element" && words.size() >= 3) {
+			const quint64 elementCount = words[2].toULongLong();
+			inVertex = words[1] == "vertex" && !hasVertex;
+			if (inVertex) {
+				hasVertex = true;
+				count = elementCount;
+			}
+			else if (elementCount > 0) {
+				return QString("The file has %1 elements").arg(QString::fromLatin1(words[1]));
+			}
+		}
+		else if (words[0] == "property" && inVertex) {
+			if (words.size() < 3 || words[1] == "list") {
+				return "The file has vertices with lists";
+			}
+			const PlyType type = ParsePlyType(words[1]);
+			if (type == PlyType::Unknown) {
+				return QString("The file has vertices of type %1").arg(QString::fromLatin1(words[1]));
+			}
+			static const char* const k_names[k_targetCount][2] = {
+				{ "x", "x" }, { "y", "y" }, { "z", "z" },
+				{ "red", "diffuse_red" }, { "green", "diffuse_green" }, { "blue", "diffuse_blue" },
+			};
+			for (int target = 0; target < k_targetCount; ++target) {
+				if (words[2] == k_names[target][0] || words[2] == k_names[target][1]) {
+					targets[target] = Property{ type, stride };
+					has[target] = true;
+				}
+			}
+			stride += PlySize(type);
+		}
+		else if (words[0] == "end_header") {
+			pBody = p;
+		}
+	}
+	if (!pBody) {
+		return "The file has no header";
+	}
+	if (!has[0] || !has[1] || !has[2]) {
+		return "The file has vertices without positions";
+	}
+	if (count == 0) {
+		return "The file has no points";
+	}
+	if (count > UINT_MAX) {
+		return "The file has too many points";
+	}
+	if (pBody - pText + qint64(count) * stride > size) {
+		return "The file is cut short";
+	}
+	const uchar* pPoints = reinterpret_cast<const uchar*>(pBody);
+	auto Position = [&](size_t i, int axis) {
+		return LoadPlyValue(pPoints + i * stride + targets[axis].m_offset, targets[axis].m_type, swap);
+	};
+
+	// The bounds in double, for the center taken off the points
+	double min[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+	double max[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+	QMutex boundsMutex;
+	VertexWelder::ParallelRuns(size_t(count), [&](size_t begin, size_t end) {
+		double runMin[3] = { DBL_MAX, DBL_MAX, DBL_MAX };
+		double runMax[3] = { -DBL_MAX, -DBL_MAX, -DBL_MAX };
+		for (size_t i = begin; i < end; ++i) {
+			for (int axis = 0; axis < 3; ++axis) {
+				const double value = Position(i, axis);
+				runMin[axis] = std::min(runMin[axis], value);
+				runMax[axis] = std::max(runMax[axis], value);
+			}
+		}
+		QMutexLocker lock(&boundsMutex);
+		for (int axis = 0; axis < 3; ++axis) {
+			min[axis] = std::min(min[axis], runMin[axis]);
+			max[axis] = std::max(max[axis], runMax[axis]);
+		}
+	});
+	for (int axis = 0; axis < 3; ++axis) {
+		cloud.m_origin[axis] = RoundOrigin((min[axis] + max[axis]) * 0.5);
+	}
+
+	const bool hasColors = has[3] || has[4] || has[5];
+	cloud.m_points.resize(size_t(count));
+	VertexWelder::ParallelRuns(size_t(count), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			for (int axis = 0; axis < 3; ++axis) {
+				cloud.m_points[i].m_position[axis] = float(Position(i, axis) - cloud.m_origin[axis]);
+			}
+			cloud.m_points[i].m_color = k_defaultColor;
+			if (hasColors) {
+				quint32 color = 0xff000000u;
+				for (int channel = 0; channel < 3; ++channel) {
+					const Property& property = targets[3 + channel];
+					if (has[3 + channel]) {
+						color |= PlyColor(pPoints + i * stride + property.m_offset, property.m_type, swap) << (8 * channel);
+					}
+				}
+				cloud.m_points[i].m_color = color;
+			}
+		}
+	});
+	return QString();
+}
+
+}
+
+PointCloudLoader::~PointCloudLoader() = default;
+
+bool PointCloudLoader::Handles(const QString& file)
+{
+	const QString suffix = QFileInfo(file).suffix().toLower();
+	return suffix == "las" || suffix == "laz" || suffix == "e57" || suffix == "ply";
+}
+
+bool PointCloudLoader::Read(const QString& file)
+{
+	m_model = ModelData();
+	m_pointCount = 0;
+	m_nodeCount = 0;
+	const QString suffix = QFileInfo(file).suffix().toLower();
+	if (suffix == "laz") {
+		return Fail("LAZ files are compressed with LASzip, which isn't built in. Decompress them to LAS first");
+	}
+	if (suffix == "e57") {
+		return Fail("E57 files need libE57Format, which isn't built in. Export them to LAS or PLY first");
+	}
+	Cloud cloud;
+	{
+		const QSharedPointer<const FileContents> pFile = ImportIOSystem::Read(file);
+		if (!pFile) {
+			return Fail("The file can't be read");
+		}
+		const QString reason = suffix == "las" ? ReadLas(pFile->Data(), pFile->Size(), cloud)
+			: suffix == "ply" ? ReadPly(pFile->Data(), pFile->Size(), cloud) : QString("The file isn't a point cloud");
+		if (!reason.isEmpty()) {
+			return Fail(reason);
+		}
+	}
+	const std::vector<OctreeNode> nodes = BuildOctree(cloud.m_points);
+	for (const OctreeNode& node : nodes) {
+		if (node.m_count > size_t(INT_MAX) / sizeof(Point)) {
+			return Fail("The file has too many points in one place");
+		}
+	}
+	const int nodeCount = int(nodes.size());
+
+	// Clouds far from the origin are moved to it like other models, the root node moves the
+	// points to where they are from there
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	BoundsMath::AddPoints(cloud.m_points[0].m_position.data(), cloud.m_points.size(), 4, min, max);
+	double center[3];
+	double diagonal = 0.0;
+	for (int axis = 0; axis < 3; ++axis) {
+		center[axis] = cloud.m_origin[axis] + (double(min[axis]) + double(max[axis])) * 0.5;
+		diagonal += (double(max[axis]) - double(min[axis])) * (double(max[axis]) - double(min[axis]));
+	}
+	if (std::sqrt(center[0] * center[0] + center[1] * center[1] + center[2] * center[2]) > ModelLoader::k_rebaseRatio * 0.5 * std::sqrt(diagonal)) {
+		m_model.m_origin = { std::round(center[0]), std::round(center[1]), std::round(center[2]) };
+	}
+	QMatrix4x4 rootTransform;
+	rootTransform.translate(float(cloud.m_origin[0] - m_model.m_origin[0]), float(cloud.m_origin[1] - m_model.m_origin[1]), float(cloud.m_origin[2] - m_model.m_origin[2]));
+
+	// The scene graph is depth first, where the octree is level by level. The meshes follow
+	// the scene graph.
+	std::vector<std::vector<int>> children(nodes.size());
+	for (int n = 1; n < nodeCount; ++n) {
+		children[nodes[n].m_parent].push_back(n);
+	}
+	QSharedPointer<SceneGraph> graph(new SceneGraph());
+	std::vector<int> order;
+	std::vector<int> graphNodes(nodes.size(), -1);
+	std::vector<int> stack = { 0 };
+	while (!stack.empty()) {
+		const int n = stack.back();
+		stack.pop_back();
+		const int parent = nodes[n].m_parent >= 0 ? graphNodes[nodes[n].m_parent] : -1;
+		graphNodes[n] = graph->AddNode(QString::fromStdString(nodes[n].m_name), parent, parent < 0 ? rootTransform : QMatrix4x4());
+		order.push_back(n);
+		stack.insert(stack.end(), children[n].rbegin(), children[n].rend());
+	}
+
+	// The points are kept in one block that every mesh points into, and freed with the last
+	MaterialData material;
+	material.m_name = "DefaultMaterial";
+	std::fill(material.m_properties.m_diffuse, material.m_properties.m_diffuse + 4, 1.f);
+	material.m_properties.m_ambient[3] = 1.f;
+	material.m_properties.m_specular[3] = 1.f;
+	m_model.m_materials.push_back(material);
+	std::vector<Point>* pPoints = new std::vector<Point>(std::move(cloud.m_points));
+	const QSharedPointer<const uchar> pBlock(reinterpret_cast<const uchar*>(pPoints->data()), [pPoints](const uchar*) { delete pPoints; });
+	m_model.m_meshes.resize(nodes.size());
+	VertexWelder::ParallelFor(nodes.size(), [&](size_t i) {
+		const OctreeNode& node = nodes[order[i]];
+		const Point* pFirst = pPoints->data() + node.m_first;
+		MeshData& mesh = m_model.m_meshes[i];
+		mesh.m_vertexData = QByteArray::fromRawData(reinterpret_cast<const char*>(pFirst), int(node.m_count * sizeof(Point)));
+		mesh.m_pMapping = pBlock;
+		mesh.m_vertexStride = int(sizeof(Point));
+		mesh.m_normalOffset = offsetof(Point, m_color);
+		mesh.m_uvOffset = offsetof(Point, m_color);
+		mesh.m_colorOffset = offsetof(Point, m_color);
+		mesh.m_boneIndexOffset = sizeof(Point);
+		mesh.m_boneWeightOffset = sizeof(Point);
+		mesh.m_numPositionComponents = 3;
+		mesh.m_numColorComponents = 4;
+		mesh.m_colorType = GL_UNSIGNED_BYTE;
+		mesh.m_hasColors = true;
+		mesh.m_name = QString::fromStdString(node.m_name);
+		mesh.m_material = 0;
+		mesh.m_nodes = { graphNodes[order[i]] };
+		mesh.m_transform = graph->Node(graphNodes[order[i]]).m_world;
+		mesh.m_AABBMin = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+		mesh.m_AABBMax = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		BoundsMath::AddPoints(pFirst->m_position.data(), node.m_count, 4, mesh.m_AABBMin, mesh.m_AABBMax);
+	});
+	m_model.m_sceneGraph = graph;
+	m_model.m_stats = ModelStats::Compute(m_model);
+	m_pointCount = qint64(pPoints->size());
+	m_nodeCount = nodeCount;
+	return true;
+}
+
+std::vector<PointCloudLoader::OctreeNode> PointCloudLoader::BuildOctree(std::vector<Point>& points)
+{
+	std::vector<OctreeNode> nodes;
+	if (points.empty()) {
+		return nodes;
+	}
+
+	// The root is the cube around the points
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	BoundsMath::AddPoints(points[0].m_position.data(), points.size(), 4, min, max);
+	const QVector3D extent = max - min;
+	float size = std::max({ extent.x(), extent.y(), extent.z() });
+	size = size > 0.f ? size : 1.f;
+
+	// The nodes of a level still to split, with the run of points they were given
+	struct Pending {
+		int m_node;
+		QVector3D m_min;
+		float m_size;
+		int m_depth;
+		size_t m_first;
+		size_t m_count;
+	};
+	std::vector<Pending> level = { Pending{ 0, min, size, 0, 0, points.size() } };
+	nodes.emplace_back();
+	nodes[0].m_name = "r";
+
+	const int half = k_gridCells / 2;
+	while (!level.empty()) {
+		// Each node keeps one point in each cell and passes the rest on to its children. Its
+		// run is reordered into the points it keeps, then those of each child in turn. Nodes
+		// are only added between levels, so the ones of a level can be split in parallel.
+		std::vector<std::array<size_t, 8>> passed(level.size());
+		VertexWelder::ParallelFor(level.size(), [&](size_t i) {
+			const Pending& pending = level[i];
+			OctreeNode& node = nodes[pending.m_node];
+			node.m_first = pending.m_first;
+			passed[i].fill(0);
+			if (pending.m_count <= size_t(k_maxLeafPoints) || pending.m_depth >= k_maxDepth) {
+				node.m_count = pending.m_count;
+				return;
+			}
+
+			// The bucket of every point, 0 to keep it and 1 + its octant to pass it on
+			Point* pPoints = points.data() + pending.m_first;
+			std::vector<quint8> buckets(pending.m_count);
+			std::vector<bool> occupied(size_t(k_gridCells) * k_gridCells * k_gridCells, false);
+			size_t counts[9] = {};
+			const float scale = float(k_gridCells) / pending.m_size;
+			for (size_t p = 0; p < pending.m_count; ++p) {
+				int cell[3];
+				for (int axis = 0; axis < 3; ++axis) {
+					cell[axis] = std::min(std::max(int((pPoints[p].m_position[axis] - pending.m_min[axis]) * scale), 0), k_gridCells - 1);
+				}
+				const size_t key = (size_t(cell[0]) * k_gridCells + cell[1]) * k_gridCells + cell[2];
+				if (!occupied[key]) {
+					occupied[key] = true;
+					buckets[p] = 0;
+				}
+				else {
+					buckets[p] = quint8(1 + (int(cell[0] >= half) | int(cell[1] >= half) << 1 | int(cell[2] >= half) << 2));
+				}
+				++counts[buckets[p]];
+			}
+
+			// Every point is swapped straight into the next free place of its bucket, so each
+			// swap puts one in its place and the run needs no second copy
+			size_t next[9];
+			size_t end[9];
+			size_t begin = 0;
+			for (int bucket = 0; bucket < 9; ++bucket) {
+				next[bucket] = begin;
+				begin += counts[bucket];
+				end[bucket] = begin;
+			}
+			for (int bucket = 0; bucket < 9; ++bucket) {
+				while (next[bucket] < end[bucket]) {
+					const size_t p = next[bucket];
+					const int target = buckets[p];
+					if (target == bucket) {
+						++next[bucket];
+						continue;
+					}
+					std::swap(pPoints[p], pPoints[next[target]]);
+					std::swap(buckets[p], buckets[next[target]]);
+					++next[target];
+				}
+			}
+			node.m_count = counts[0];
+			std::copy(counts + 1, counts + 9, passed[i].begin());
+		});
+
+		std::vector<Pending> nextLevel;
+		for (size_t i = 0; i < level.size(); ++i) {
+			const Pending& parent = level[i];
+			size_t first = parent.m_first + nodes[parent.m_node].m_count;
+			for (int octant = 0; octant < 8; ++octant) {
+				const size_t count = passed[i][octant];
+				if (count == 0) {
+					continue;
+				}
+				const float childSize = parent.m_size * 0.5f;
+				const QVector3D childMin = parent.m_min + QVector3D(octant & 1 ? childSize : 0.f, octant & 2 ? childSize : 0.f, octant & 4 ? childSize : 0.f);
+				nextLevel.push_back(Pending{ int(nodes.size()), childMin, childSize, parent.m_depth + 1, first, count });
+				nodes.emplace_back();
+				nodes.back().m_parent = parent.m_node;
+				nodes.back().m_name = nodes[parent.m_node].m_name + char('0' + octant);
+				first += count;
+			}
+		}
+		level.swap(nextLevel);
+	}
+	return nodes;
+}
+
+const QString& PointCloudLoader::FailureReason() const
+{
+	return m_reason;
+}
+
+ModelData PointCloudLoader::TakeModel()
+{
+	ModelData ret = std::move(m_model);
+	m_model = ModelData();
+	return ret;
+}
+
+qint64 PointCloudLoader::PointCount() const
+{
+	return m_pointCount;
+}
+
+int PointCloudLoader::NodeCount() const
+{
+	return m_nodeCount;
+}
+
+bool PointCloudLoader::Fail(const QString& reason)
+{
+	m_reason = reason;
+	return false;
+}
@@ -0,0 +1,84 @@
+#pragma once
+#include "ModelLoader.h"
+
+#include <QString>
+
+#include <array>
+#include <string>
+#include <vector>
+
+// Reads scanned point clouds, LAS files and binary PLY files of vertices alone, which Assimp
+// reads slowly or not at all, straight into the decoded model of an octree of point meshes.
+// The points are converted in parallel runs from the mapped file into one block of 16 bytes
+// each, a float position and an RGBA8 color, which is all the memory the cloud takes. As in
+// Potree, each node of the octree keeps one point in every cell of a k_gridCells grid over
+// its cube and passes the others on to the child they fall in, so a node drawn with its
+// ancestors is the cloud at that node's spacing. The points are reordered in place as the
+// nodes of a level are split in parallel, until the points of every node follow one another,
+// and the meshes point into the block instead of copying it. Every node becomes a mesh of
+// points without faces under a scene node of its own, named for its path as in Potree ("r",
+// "r0", "r07"...), which PointCloudLod picks the nodes to draw by. Coordinates are read in
+// double and the rounded center of the cloud is taken off them, and clouds far from the
+// origin are rebased as ModelLoader::FindOrigin does. LAS files are turned from Z up to Y up.
+// LAZ and E57 files would need LASzip and libE57Format, which aren't built in. Read() fails for
+// them, and for text PLY files and PLY files with faces, which are left to TextModelLoader and
+// Assimp.
+class PointCloudLoader
+{
+public:
+	// Cells along each side of the grid a node keeps one point of
+	static const int k_gridCells = 128;
+	// Nodes with at most this many points keep all of them
+	static const int k_maxLeafPoints = 20000;
+	// Nodes this deep keep all of their points, which are then duplicates or nearly so
+	static const int k_maxDepth = 16;
+
+	PointCloudLoader() = default;
+	~PointCloudLoader();
+	PointCloudLoader(const PointCloudLoader&) = delete;
+	PointCloudLoader& operator=(const PointCloudLoader&) = delete;
+
+	// By the suffix, .las, .laz, .e57 or .ply. Whether a PLY file is a binary point cloud is
+	// only known once it is read.
+	static bool Handles(const QString& file);
+
+	// False if the file can't be read this way, FailureReason() then says why. Reading
+	// another file frees the model of the last one.
+	bool Read(const QString& file);
+	const QString& FailureReason() const;
+
+	// The model read, moved out of the loader. Empty unless Read() succeeded. The load options
+	// don't apply to it, the points are always stored as described above.
+	ModelData TakeModel();
+
+	qint64 PointCount() const;
+	int NodeCount() const;
+
+	// A point as it is stored and drawn
+	struct Point {
+		std::array<float, 3> m_position;
+		// RGBA8 with red in the low byte
+		quint32 m_color;
+	};
+
+	// A node of the octree: the run of points it keeps, the index of its parent, -1 for the
+	// root, and its name
+	struct OctreeNode {
+		size_t m_first = 0;
+		size_t m_count = 0;
+		int m_parent = -1;
+		std::string m_name;
+	};
+
+	// Splits points into the octree Read() builds, reordering them so the points each node
+	// keeps follow one another. The nodes come level by level, each after its parent.
+	static std::vector<OctreeNode> BuildOctree(std::vector<Point>& points);
+
+private:
+	bool Fail(const QString& reason);
+
+	QString m_reason;
+	ModelData m_model;
+	qint64 m_pointCount = 0;
+	int m_nodeCount = 0;
+};
@@ -0,0 +1,139 @@
+#include "PointCloudLod.h"
+#include "Frustum.h"
+#include "ModelLoader.h"
+#include "SceneGraph.h"
+
+#include <algorithm>
+
+
+namespace {
+
+// Nodes around the eye are the most important of all, their distance is clamped to this share
+// of their radius
+const float k_minDistanceRatio = 0.01f;
+
+bool IsPointMesh(const Mesh& mesh)
+{
+	return mesh.m_indexCount == 0 && mesh.m_vertexCount > 0 && mesh.m_instanceTransforms.empty() && mesh.m_nodes.size() == 1;
+}
+
+}
+
+void PointCloudLod::Build(const Model& model, const SceneGraph& graph)
+{
+	Clear();
+
+	// The node placing each point mesh, and the point node above each
+	std::vector<int> nodeOfGraph(graph.NodeCount(), -1);
+	for (int meshIdx = 0; meshIdx < int(model.m_meshes.size()); ++meshIdx) {
+		const Mesh& mesh = model.m_meshes[meshIdx];
+		if (IsPointMesh(mesh) && mesh.m_nodes[0] >= 0 && mesh.m_nodes[0] < graph.NodeCount()) {
+			nodeOfGraph[mesh.m_nodes[0]] = int(m_nodes.size());
+			Node node;
+			node.m_mesh = meshIdx;
+			m_nodes.push_back(node);
+			m_pointCount += mesh.m_vertexCount;
+		}
+	}
+	std::vector<int> parents(m_nodes.size(), -1);
+	bool tree = false;
+	for (int i = 0; i < int(m_nodes.size()); ++i) {
+		const int graphNode = model.m_meshes[m_nodes[i].m_mesh].m_nodes[0];
+		for (int above = graph.Node(graphNode).m_parent; above >= 0; above = graph.Node(above).m_parent) {
+			if (nodeOfGraph[above] >= 0) {
+				parents[i] = nodeOfGraph[above];
+				tree = true;
+				break;
+			}
+		}
+	}
+	if (!tree) {
+		Clear();
+		return;
+	}
+
+	// The children of each node in a run of their own
+	for (int i = 0; i < int(m_nodes.size()); ++i) {
+		if (parents[i] >= 0) {
+			++m_nodes[parents[i]].m_childCount;
+		}
+		else {
+			m_roots.push_back(i);
+		}
+	}
+	int first = 0;
+	for (Node& node : m_nodes) {
+		node.m_firstChild = first;
+		first += node.m_childCount;
+		node.m_childCount = 0;
+	}
+	m_children.resize(first);
+	for (int i = 0; i < int(m_nodes.size()); ++i) {
+		if (parents[i] >= 0) {
+			Node& parent = m_nodes[parents[i]];
+			m_children[parent.m_firstChild + parent.m_childCount++] = i;
+		}
+	}
+}
+
+void PointCloudLod::Clear()
+{
+	m_nodes.clear();
+	m_children.clear();
+	m_roots.clear();
+	m_pointCount = 0;
+}
+
+bool PointCloudLod::IsEmpty() const
+{
+	return m_nodes.empty();
+}
+
+int PointCloudLod::NodeCount() const
+{
+	return int(m_nodes.size());
+}
+
+qint64 PointCloudLod::PointCount() const
+{
+	return m_pointCount;
+}
+
+qint64 PointCloudLod::Select(const Model& model, const Frustum& frustum, const QMatrix4x4& modelView, float pixelScale, qint64 budget, std::vector<int>& meshes) const
+{
+	meshes.clear();
+	m_candidates.clear();
+
+	// Candidates are a heap by the pixels their bounding sphere covers across
+	auto Push = [&](int nodeIdx) {
+		const Mesh& mesh = model.m_meshes[m_nodes[nodeIdx].m_mesh];
+		if (mesh.IsHidden() || !frustum.Intersects(mesh.m_AABBMin, mesh.m_AABBMax)) {
+			return;
+		}
+		const QVector3D center = modelView.map((mesh.m_AABBMin + mesh.m_AABBMax) * 0.5f);
+		const float radius = modelView.mapVector((mesh.m_AABBMax - mesh.m_AABBMin) * 0.5f).length();
+		const float distance = std::max(-center.z(), radius * k_minDistanceRatio);
+		m_candidates.emplace_back(radius * pixelScale / std::max(distance, 1e-6f), nodeIdx);
+		std::push_heap(m_candidates.begin(), m_candidates.end());
+	};
+	for (int root : m_roots) {
+		Push(root);
+	}
+
+	qint64 points = 0;
+	while (!m_candidates.empty()) {
+		std::pop_heap(m_candidates.begin(), m_candidates.end());
+		const Node& node = m_nodes[m_candidates.back().second];
+		m_candidates.pop_back();
+		const int pointCount = model.m_meshes[node.m_mesh].m_vertexCount;
+		if (points + pointCount > budget && !meshes.empty()) {
+			break;
+		}
+		points += pointCount;
+		meshes.push_back(node.m_mesh);
+		for (int c = 0; c < node.m_childCount; ++c) {
+			Push(m_children[node.m_firstChild + c]);
+		}
+	}
+	return points;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <utility>
+#include <vector>
+
+#include <QMatrix4x4>
+
+class Frustum;
+class SceneGraph;
+struct Model;
+
+// Picks the nodes of a point cloud's octree to draw within a budget of points, the way Potree
+// does. The octree is found in the model: meshes of points without triangles, each placed by
+// a node of the SceneGraph, under the nearest node above that places another, as
+// PointCloudLoader builds them. From the roots on, the node in view covering the most of the
+// screen is taken next and its children become candidates, until the next one would go over
+// the budget. Near parts of the cloud so get the finest spacing the budget allows and far ones
+// a coarser one, and no node is drawn without its ancestors, which hold the points it lacks.
+class PointCloudLod
+{
+public:
+	// Points drawn per frame by default, which current GPUs draw in a few milliseconds
+	static const qint64 k_defaultBudget = 5000000;
+
+	// Finds the octree among the meshes of model, which the nodes of graph place. Stays empty
+	// for models whose point meshes aren't in a tree, which are drawn whole as before.
+	void Build(const Model& model, const SceneGraph& graph);
+	void Clear();
+	bool IsEmpty() const;
+	int NodeCount() const;
+
+	// Points of every node, the whole cloud
+	qint64 PointCount() const;
+
+	// Fills meshes with the nodes of model to draw and returns the points they have. The
+	// frustum is in model space, which modelView moves to eye space, and pixelScale is the
+	// pixels a unit at distance 1 covers: the viewport height over 2 tan(fov / 2). The first
+	// node is taken even if it goes over the budget on its own.
+	qint64 Select(const Model& model, const Frustum& frustum, const QMatrix4x4& modelView, float pixelScale, qint64 budget, std::vector<int>& meshes) const;
+
+private:
+	struct Node {
+		int m_mesh = -1;
+		int m_firstChild = 0;
+		int m_childCount = 0;
+	};
+
+	std::vector<Node> m_nodes;
+	// Node indices, the children of each node one after the other
+	std::vector<int> m_children;
+	std::vector<int> m_roots;
+	qint64 m_pointCount = 0;
+
+	// The candidates of Select, kept to save allocating them every frame
+	mutable std::vector<std::pair<float, int>> m_candidates;
+};
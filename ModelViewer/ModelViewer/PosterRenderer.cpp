@@ -0,0 +1,342 @@
+#include "PosterRenderer.h"
+#include "JobSystem.h"
+#include "PngWriter.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace {
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+// Fences and mapping buffer ranges need OpenGL 3.2 or OpenGL ES 3.0
+bool SupportsFences(const QOpenGLContext* pContext)
+{
+	const QSurfaceFormat format = pContext->format();
+	if (pContext->isOpenGLES()) {
+		return format.majorVersion() >= 3;
+	}
+	return format.version() >= qMakePair(3, 2)
+		|| (format.majorVersion() >= 3 && pContext->hasExtension("GL_ARB_sync"));
+}
+
+}
+
+PosterRenderer::~PosterRenderer()
+{
+	// The buffers go with the context, only the write is left to finish here
+	if (m_write.isRunning()) {
+		m_write.waitForFinished();
+	}
+}
+
+void PosterRenderer::Create()
+{
+	Destroy();
+	m_async = SupportsFences(QOpenGLContext::currentContext());
+	if (m_async) {
+		for (Slot& slot : m_slots) {
+			slot.m_buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+			if (!slot.m_buffer.create()) {
+				m_async = false;
+			}
+		}
+	}
+	m_created = true;
+}
+
+void PosterRenderer::Destroy()
+{
+	if (!m_created) {
+		return;
+	}
+	Cancel();
+	for (Slot& slot : m_slots) {
+		slot.m_buffer.destroy();
+	}
+	delete m_pResolve;
+	m_pResolve = nullptr;
+	m_created = false;
+}
+
+bool PosterRenderer::IsCreated() const
+{
+	return m_created;
+}
+
+bool PosterRenderer::Start(const QString& path, const QSize& imageSize, const QSize& tileSize)
+{
+	if (!m_created || m_active || imageSize.isEmpty() || tileSize.isEmpty()) {
+		return false;
+	}
+	m_pWriter.reset(new PngWriter());
+	if (!m_pWriter->Open(path, imageSize)) {
+		m_pWriter.reset();
+		return false;
+	}
+	m_path = path;
+	m_imageSize = imageSize;
+	m_tileSize = tileSize;
+	m_columns = (imageSize.width() + tileSize.width() - 1) / tileSize.width();
+	m_tileCount = m_columns * ((imageSize.height() + tileSize.height() - 1) / tileSize.height());
+	m_nextTile = 0;
+	m_gatheredTiles = 0;
+	m_band.assign(size_t(imageSize.width()) * size_t(tileSize.height()) * 4, 0);
+	m_bandTiles = 0;
+	m_nextBand = 0;
+	m_active = true;
+	m_finished = false;
+	return true;
+}
+
+void PosterRenderer::Cancel()
+{
+	if (!m_active) {
+		return;
+	}
+
+	// The readbacks in flight are dropped, the file is removed once the writer is closed
+	// without all of its rows
+	for (Slot& slot : m_slots) {
+		if (slot.m_fence) {
+			Functions()->glDeleteSync(slot.m_fence);
+			slot.m_fence = nullptr;
+		}
+	}
+	End(false);
+}
+
+bool PosterRenderer::IsActive() const
+{
+	return m_active;
+}
+
+bool PosterRenderer::NeedsTile() const
+{
+	return m_active && m_nextTile < m_tileCount;
+}
+
+QSize PosterRenderer::ImageSize() const
+{
+	return m_imageSize;
+}
+
+QMatrix4x4 PosterRenderer::TileProjection(const QMatrix4x4& projection) const
+{
+	return TileProjection(projection, m_imageSize, TileRect(m_nextTile));
+}
+
+float PosterRenderer::Scale() const
+{
+	return m_tileSize.isEmpty() ? 1.f : float(m_imageSize.height()) / float(m_tileSize.height());
+}
+
+QMatrix4x4 PosterRenderer::TileProjection(const QMatrix4x4& projection, const QSize& imageSize, const QRect& tile)
+{
+	// The tile's center moves to the middle of the viewport, and its size is stretched over
+	// it. Normalized device coordinates have y up, the image has its top row first.
+	const float bottom = float(imageSize.height() - tile.y() - tile.height());
+	const float centerX = (2.f * float(tile.x()) + float(tile.width())) / float(imageSize.width()) - 1.f;
+	const float centerY = (2.f * bottom + float(tile.height())) / float(imageSize.height()) - 1.f;
+	QMatrix4x4 crop;
+	crop.scale(float(imageSize.width()) / float(tile.width()), float(imageSize.height()) / float(tile.height()), 1.f);
+	crop.translate(-centerX, -centerY, 0.f);
+	return crop * projection;
+}
+
+void PosterRenderer::Capture(GLuint framebuffer, const QSize& size, int samples)
+{
+	if (!m_active) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+
+	// Gather the tiles the GPU has finished, oldest first. Later ones won't be done either.
+	for (int i = 0; i < k_slotCount && m_active; ++i) {
+		Slot& slot = m_slots[(m_next + i) % k_slotCount];
+		if (slot.m_fence) {
+			const GLenum status = f->glClientWaitSync(slot.m_fence, 0, 0);
+			if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+				break;
+			}
+			Finish(slot);
+		}
+	}
+
+	if (NeedsTile()) {
+		// The tiles are laid out for the framebuffer the image was started with
+		if (size != m_tileSize) {
+			qWarning("Could not render %s, the window was resized", qPrintable(m_path));
+			Cancel();
+			return;
+		}
+		const int tile = m_nextTile++;
+
+		// Multisampled framebuffers can't be read from, resolve them into a plain one first
+		GLuint readFramebuffer = framebuffer;
+		if (samples > 0) {
+			if (!QOpenGLFramebufferObject::hasOpenGLFramebufferBlit()) {
+				qWarning("Could not render %s, multisampled frames can't be resolved", qPrintable(m_path));
+				Cancel();
+				return;
+			}
+			if (!m_pResolve || m_pResolve->size() != size) {
+				delete m_pResolve;
+				m_pResolve = new QOpenGLFramebufferObject(size);
+			}
+			f->glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+			f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_pResolve->handle());
+			f->glBlitFramebuffer(0, 0, size.width(), size.height(), 0, 0, size.width(), size.height(), GL_COLOR_BUFFER_BIT, GL_NEAREST);
+			readFramebuffer = m_pResolve->handle();
+		}
+		f->glBindFramebuffer(GL_FRAMEBUFFER, readFramebuffer);
+
+		if (!m_async) {
+			std::vector<uchar> pixels(size_t(size.width()) * size_t(size.height()) * 4);
+			f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+			f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			AddTile(tile, pixels.data());
+		}
+		else {
+			// All slots busy means the GPU is several tiles behind, wait for the oldest one
+			Slot& slot = m_slots[m_next];
+			m_next = (m_next + 1) % k_slotCount;
+			Finish(slot);
+			if (!m_active) {
+				return;
+			}
+
+			const int bytes = size.width() * size.height() * 4;
+			slot.m_buffer.bind();
+			if (slot.m_buffer.size() != bytes) {
+				slot.m_buffer.allocate(bytes);
+			}
+			f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			slot.m_buffer.release();
+			slot.m_fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			slot.m_tile = tile;
+			f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		}
+	}
+
+	// The last band closes the file once it is written
+	if (m_active && m_gatheredTiles == m_tileCount && m_write.isFinished()) {
+		End(m_write.result());
+	}
+}
+
+bool PosterRenderer::TakeFinished(QString& path, bool& success)
+{
+	if (!m_finished) {
+		return false;
+	}
+	path = m_path;
+	success = m_succeeded;
+	m_finished = false;
+	return true;
+}
+
+QRect PosterRenderer::TileRect(int tile) const
+{
+	return QRect((tile % m_columns) * m_tileSize.width(), (tile / m_columns) * m_tileSize.height(), m_tileSize.width(), m_tileSize.height());
+}
+
+void PosterRenderer::Finish(Slot& slot)
+{
+	if (!slot.m_fence) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+	f->glClientWaitSync(slot.m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+	f->glDeleteSync(slot.m_fence);
+	slot.m_fence = nullptr;
+
+	slot.m_buffer.bind();
+	const int bytes = m_tileSize.width() * m_tileSize.height() * 4;
+	const void* pPixels = slot.m_buffer.mapRange(0, bytes, QOpenGLBuffer::RangeRead);
+	if (pPixels) {
+		AddTile(slot.m_tile, static_cast<const uchar*>(pPixels));
+		slot.m_buffer.unmap();
+	}
+	slot.m_buffer.release();
+	if (!pPixels) {
+		qWarning("Could not render %s, a tile could not be read back", qPrintable(m_path));
+		Cancel();
+	}
+}
+
+void PosterRenderer::AddTile(int tile, const uchar* pPixels)
+{
+	if (!m_active) {
+		return;
+	}
+
+	// Tiles come in order, so this one is in the band being gathered. Its rows start at the
+	// bottom, and the tiles at the right and bottom edges reach past the image.
+	const QRect rect = TileRect(tile);
+	const int width = std::min(rect.width(), m_imageSize.width() - rect.x());
+	const int height = std::min(rect.height(), m_imageSize.height() - rect.y());
+	for (int row = 0; row < height; ++row) {
+		const uchar* pSource = pPixels + size_t(rect.height() - 1 - row) * size_t(rect.width()) * 4;
+		uchar* pDest = m_band.data() + (size_t(row) * size_t(m_imageSize.width()) + size_t(rect.x())) * 4;
+		std::memcpy(pDest, pSource, size_t(width) * 4);
+	}
+	++m_gatheredTiles;
+	if (++m_bandTiles == m_columns) {
+		WriteBand();
+	}
+}
+
+void PosterRenderer::WriteBand()
+{
+	// The band before this one has to be out of the way first, which it usually is by the
+	// time the tiles of this one are drawn
+	if (m_nextBand > 0) {
+		if (!m_write.result()) {
+			qWarning("Could not write %s", qPrintable(m_path));
+			Cancel();
+			return;
+		}
+	}
+	std::swap(m_band, m_writingBand);
+	m_band.resize(m_writingBand.size());
+
+	const int firstRow = m_nextBand * m_tileSize.height();
+	const int rowCount = std::min(m_tileSize.height(), m_imageSize.height() - firstRow);
+	const bool last = firstRow + rowCount >= m_imageSize.height();
+	const int bytesPerLine = m_imageSize.width() * 4;
+	PngWriter* pWriter = m_pWriter.get();
+	const uchar* pRows = m_writingBand.data();
+	m_write = JobSystem::Run(JobPriority::Normal, [pWriter, pRows, rowCount, bytesPerLine, last] {
+		bool written = pWriter->WriteRows(pRows, rowCount, bytesPerLine);
+		if (last) {
+			written = pWriter->Close() && written;
+		}
+		return written;
+	});
+	++m_nextBand;
+	m_bandTiles = 0;
+}
+
+void PosterRenderer::End(bool success)
+{
+	if (m_write.isRunning()) {
+		m_write.waitForFinished();
+	}
+
+	// A writer still open has not had all its rows, and removes its file when closed
+	m_pWriter.reset();
+	m_band = std::vector<uchar>();
+	m_writingBand = std::vector<uchar>();
+	m_active = false;
+	m_finished = true;
+	m_succeeded = success;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <memory>
+#include <vector>
+
+#include <QFuture>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QRect>
+#include <QSize>
+#include <QString>
+#include <qopengl.h>
+
+class PngWriter;
+class QOpenGLFramebufferObject;
+
+// Renders images larger than the window, or than any framebuffer can be, as a grid of window
+// sized tiles, one tile a frame. Each tile is drawn through the part of the projection that
+// covers it, into the widget's own framebuffer, and read back into a pixel buffer object that
+// is only mapped once the GPU is done with it. The tiles of a row are gathered into a band,
+// and each finished band is compressed into the PNG on a worker thread while the next one
+// renders, so no more than two bands of the image are ever held in memory.
+class PosterRenderer
+{
+public:
+	static const int k_slotCount = 3;
+
+	~PosterRenderer();
+
+	// Creating and destroying the buffers requires the context they are used in to be current.
+	// Destroy drops the image being rendered.
+	void Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Starts rendering an image of imageSize to the PNG at path, in tiles of tileSize. False
+	// while another image is rendered, or if the file can't be written.
+	bool Start(const QString& path, const QSize& imageSize, const QSize& tileSize);
+
+	// Drops the image being rendered and removes its file. The context has to be current.
+	void Cancel();
+
+	// True from Start until the image is written, frames have to keep being drawn meanwhile.
+	// NeedsTile is true while tiles are left to draw, the next frame is then drawn as one.
+	bool IsActive() const;
+	bool NeedsTile() const;
+	QSize ImageSize() const;
+
+	// The projection to draw the next tile with, the part of projection, the projection of the
+	// whole image, covering it. Levels
+	// of detail are picked for a view Scale times the height of the tile.
+	QMatrix4x4 TileProjection(const QMatrix4x4& projection) const;
+	float Scale() const;
+
+	// The projection covering tile, a rectangle of an image of imageSize with its top row at
+	// the top, cut out of the projection of the whole image and stretched over the viewport
+	static QMatrix4x4 TileProjection(const QMatrix4x4& projection, const QSize& imageSize, const QRect& tile);
+
+	// Called at the end of every frame while active, with the framebuffer holding the frame.
+	// Reads the tile drawn into it back, if there was one, and gathers the tiles the GPU is
+	// done with. Multisampled framebuffers are resolved first.
+	void Capture(GLuint framebuffer, const QSize& size, int samples);
+
+	// Once the image is written or failed, returns true once with its path and whether it was
+	// written
+	bool TakeFinished(QString& path, bool& success);
+
+private:
+	struct Slot {
+		QOpenGLBuffer m_buffer = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+		GLsync m_fence = nullptr;
+		int m_tile = -1;
+	};
+	QRect TileRect(int tile) const;
+	void Finish(Slot& slot);
+	void AddTile(int tile, const uchar* pPixels);
+	void WriteBand();
+	void End(bool success);
+
+	Slot m_slots[k_slotCount];
+	int m_next = 0;
+	bool m_created = false;
+	bool m_async = false;
+	QOpenGLFramebufferObject* m_pResolve = nullptr;
+
+	QString m_path;
+	QSize m_imageSize;
+	QSize m_tileSize;
+	int m_columns = 0;
+	int m_tileCount = 0;
+	int m_nextTile = 0;
+	int m_gatheredTiles = 0;
+	bool m_active = false;
+
+	// The band being gathered and how many of its tiles are in, and the one being written
+	std::vector<uchar> m_band;
+	std::vector<uchar> m_writingBand;
+	int m_bandTiles = 0;
+	int m_nextBand = 0;
+	std::unique_ptr<PngWriter> m_pWriter;
+	QFuture<bool> m_write;
+
+	bool m_finished = false;
+	bool m_succeeded = false;
+};
@@ -0,0 +1,376 @@
+#include "Primitives.h"
+
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QPair>
+#include <QVector2D>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace {
+	const float k_pi = 3.14159265358979f;
+
+	// The tube's outer edge reaches 1
+	const float k_torusRadius = 0.75f;
+	const float k_torusTubeRadius = 0.25f;
+
+	// Collects the vertices and triangles of a shape, then packs them into a MeshData
+	class MeshBuilder
+	{
+	public:
+		int AddVertex(const QVector3D& position, const QVector3D& normal, const QVector2D& uv) {
+			m_positions.push_back(position);
+			m_normals.push_back(normal.normalized());
+			m_uvs.push_back(uv);
+			return int(m_positions.size()) - 1;
+		}
+
+		// Adds the triangle facing the way the normals of its vertices point. Triangles without
+		// area, such as those at the poles of a sphere, are left out.
+		void AddTriangle(int a, int b, int c) {
+			const QVector3D faceNormal = QVector3D::crossProduct(m_positions[b] - m_positions[a], m_positions[c] - m_positions[a]);
+			if (faceNormal.lengthSquared() < 1e-12f) {
+				return;
+			}
+			if (QVector3D::dotProduct(faceNormal, m_normals[a] + m_normals[b] + m_normals[c]) < 0.f) {
+				std::swap(b, c);
+			}
+			m_indices.push_back(quint32(a));
+			m_indices.push_back(quint32(b));
+			m_indices.push_back(quint32(c));
+		}
+
+		// Adds a flat convex polygon facing away from the origin, its corners in order around it.
+		// The UVs map the polygon's plane.
+		void AddFace(const std::vector<QVector3D>& corners) {
+			QVector3D center;
+			for (const QVector3D& corner : corners) {
+				center += corner;
+			}
+			center /= float(corners.size());
+			QVector3D normal = QVector3D::crossProduct(corners[1] - corners[0], corners[2] - corners[0]).normalized();
+			if (QVector3D::dotProduct(normal, center) < 0.f) {
+				normal = -normal;
+			}
+
+			float radius = 0.f;
+			for (const QVector3D& corner : corners) {
+				radius = std::max(radius, (corner - center).length());
+			}
+			const QVector3D tangent = (corners[0] - center).normalized();
+			const QVector3D bitangent = QVector3D::crossProduct(normal, tangent);
+			const int first = int(m_positions.size());
+			for (const QVector3D& corner : corners) {
+				const QVector3D d = (corner - center) / radius;
+				AddVertex(corner, normal, QVector2D(0.5f + 0.5f * QVector3D::dotProduct(d, tangent), 0.5f + 0.5f * QVector3D::dotProduct(d, bitangent)));
+			}
+			for (int i = 1; i + 1 < int(corners.size()); ++i) {
+				AddTriangle(first, first + i, first + i + 1);
+			}
+		}
+
+		// Adds a smooth surface of columns by rows quads. Vertex(u, v, position, normal) gives the
+		// point at u and v from 0 to 1, which are also its UVs.
+		template<typename VertexFunc>
+		void AddGrid(int columns, int rows, VertexFunc Vertex) {
+			const int first = int(m_positions.size());
+			for (int row = 0; row <= rows; ++row) {
+				for (int column = 0; column <= columns; ++column) {
+					const float u = float(column) / float(columns);
+					const float v = float(row) / float(rows);
+					QVector3D position;
+					QVector3D normal;
+					Vertex(u, v, position, normal);
+					AddVertex(position, normal, QVector2D(u, 1.f - v));
+				}
+			}
+			auto Index = [=](int column, int row) {
+				return first + row * (columns + 1) + column;
+			};
+			for (int row = 0; row < rows; ++row) {
+				for (int column = 0; column < columns; ++column) {
+					AddTriangle(Index(column, row), Index(column + 1, row), Index(column + 1, row + 1));
+					AddTriangle(Index(column, row), Index(column + 1, row + 1), Index(column, row + 1));
+				}
+			}
+		}
+
+		// Adds the convex solid with these corners, centered on the origin, whose faces are the
+		// triangles of its shortest edges. Used for the solids with triangular faces.
+		void AddTriangleSolid(const std::vector<QVector3D>& corners) {
+			for (const std::vector<int>& face : ShortestEdgeTriangles(corners)) {
+				AddFace({ corners[face[0]], corners[face[1]], corners[face[2]] });
+			}
+		}
+
+		static std::vector<std::vector<int>> ShortestEdgeTriangles(const std::vector<QVector3D>& corners) {
+			float edge = FLT_MAX;
+			for (size_t i = 0; i < corners.size(); ++i) {
+				for (size_t j = i + 1; j < corners.size(); ++j) {
+					edge = std::min(edge, (corners[i] - corners[j]).length());
+				}
+			}
+			auto IsEdge = [&](int i, int j) {
+				return (corners[i] - corners[j]).length() < edge * 1.01f;
+			};
+			std::vector<std::vector<int>> faces;
+			const int count = int(corners.size());
+			for (int i = 0; i < count; ++i) {
+				for (int j = i + 1; j < count; ++j) {
+					for (int k = j + 1; k < count; ++k) {
+						if (IsEdge(i, j) && IsEdge(j, k) && IsEdge(i, k)) {
+							faces.push_back({ i, j, k });
+						}
+					}
+				}
+			}
+			return faces;
+		}
+
+		MeshData Pack(const QString& name) const {
+			MeshData mesh;
+			mesh.m_name = name;
+			mesh.m_hasNormals = true;
+			mesh.m_hasUVCoordinates = true;
+			mesh.m_numPositionComponents = 3;
+			mesh.m_numNormalComponents = 3;
+			mesh.m_numUVComponents = 2;
+			mesh.m_numColorComponents = 4;
+
+			// Position, normal and UV of each vertex next to each other
+			const int floatsPerVertex = 8;
+			mesh.m_vertexStride = floatsPerVertex * sizeof(float);
+			mesh.m_positionOffset = 0;
+			mesh.m_normalOffset = 3 * sizeof(float);
+			mesh.m_uvOffset = 6 * sizeof(float);
+			mesh.m_colorOffset = floatsPerVertex * sizeof(float);
+
+			const int vertexCount = int(m_positions.size());
+			mesh.m_vertexData.resize(vertexCount * mesh.m_vertexStride);
+			float* pDest = reinterpret_cast<float*>(mesh.m_vertexData.data());
+			mesh.m_AABBMin = { FLT_MAX, FLT_MAX, FLT_MAX };
+			mesh.m_AABBMax = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+			for (int v = 0; v < vertexCount; ++v) {
+				const QVector3D& p = m_positions[v];
+				const QVector3D& n = m_normals[v];
+				const float vertex[floatsPerVertex] = { p.x(), p.y(), p.z(), n.x(), n.y(), n.z(), m_uvs[v].x(), m_uvs[v].y() };
+				std::copy(vertex, vertex + floatsPerVertex, pDest + v * floatsPerVertex);
+				for (int i = 0; i < 3; ++i) {
+					mesh.m_AABBMin[i] = std::min(mesh.m_AABBMin[i], p[i]);
+					mesh.m_AABBMax[i] = std::max(mesh.m_AABBMax[i], p[i]);
+				}
+			}
+
+			// Every shape but the finest spheres and tori fits 16 bit indices
+			mesh.m_indexCount = int(m_indices.size());
+			mesh.m_indexType = (vertexCount <= 0x10000) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			if (mesh.m_indexType == GL_UNSIGNED_SHORT) {
+				mesh.m_indexData.resize(mesh.m_indexCount * sizeof(quint16));
+				std::copy(m_indices.begin(), m_indices.end(), reinterpret_cast<quint16*>(mesh.m_indexData.data()));
+			}
+			else {
+				mesh.m_indexData.resize(mesh.m_indexCount * sizeof(quint32));
+				std::copy(m_indices.begin(), m_indices.end(), reinterpret_cast<quint32*>(mesh.m_indexData.data()));
+			}
+
+			// The model's only material, see GreyMaterial
+			mesh.m_material = 0;
+			return mesh;
+		}
+
+	private:
+		std::vector<QVector3D> m_positions;
+		std::vector<QVector3D> m_normals;
+		std::vector<QVector2D> m_uvs;
+		std::vector<quint32> m_indices;
+	};
+
+	// A plain grey material
+	MaterialData GreyMaterial() {
+		auto AssignColor = [](GLfloat* vec, float value) {
+			vec[0] = vec[1] = vec[2] = value;
+			vec[3] = 1.f;
+		};
+		MaterialData material;
+		AssignColor(material.m_properties.m_ambient, 0.2f);
+		AssignColor(material.m_properties.m_diffuse, 0.8f);
+		AssignColor(material.m_properties.m_specular, 0.5f);
+		material.m_properties.m_shininess = 32.f;
+		return material;
+	}
+
+	// Corners of a regular polygon around the y axis at height y
+	std::vector<QVector3D> Ring(int segments, float y) {
+		std::vector<QVector3D> corners;
+		for (int i = 0; i < segments; ++i) {
+			const float angle = 2.f * k_pi * float(i) / float(segments);
+			corners.push_back(QVector3D(std::cos(angle), y, std::sin(angle)));
+		}
+		return corners;
+	}
+
+	std::vector<QVector3D> IcosahedronCorners() {
+		const float phi = (1.f + std::sqrt(5.f)) * 0.5f;
+		std::vector<QVector3D> corners;
+		for (float a : { -1.f, 1.f }) {
+			for (float b : { -phi, phi }) {
+				corners.push_back(QVector3D(0.f, a, b).normalized());
+				corners.push_back(QVector3D(a, b, 0.f).normalized());
+				corners.push_back(QVector3D(b, 0.f, a).normalized());
+			}
+		}
+		return corners;
+	}
+
+	// The dodecahedron is the dual of the icosahedron, its corners are the centers of the
+	// icosahedron's faces and it has a pentagon around each corner of the icosahedron
+	void AddDodecahedron(MeshBuilder& builder) {
+		const std::vector<QVector3D> icosahedron = IcosahedronCorners();
+		const std::vector<std::vector<int>> triangles = MeshBuilder::ShortestEdgeTriangles(icosahedron);
+		for (int corner = 0; corner < int(icosahedron.size()); ++corner) {
+			const QVector3D axis = icosahedron[corner];
+			std::vector<QVector3D> pentagon;
+			for (const std::vector<int>& triangle : triangles) {
+				if (std::find(triangle.begin(), triangle.end(), corner) != triangle.end()) {
+					pentagon.push_back((icosahedron[triangle[0]] + icosahedron[triangle[1]] + icosahedron[triangle[2]]).normalized());
+				}
+			}
+
+			// Put the corners in order around the axis
+			const QVector3D tangent = (pentagon[0] - axis * QVector3D::dotProduct(pentagon[0], axis)).normalized();
+			const QVector3D bitangent = QVector3D::crossProduct(axis, tangent);
+			std::sort(pentagon.begin(), pentagon.end(), [&](const QVector3D& a, const QVector3D& b) {
+				return std::atan2(QVector3D::dotProduct(a, bitangent), QVector3D::dotProduct(a, tangent))
+					< std::atan2(QVector3D::dotProduct(b, bitangent), QVector3D::dotProduct(b, tangent));
+			});
+			builder.AddFace(pentagon);
+		}
+	}
+}
+
+const std::vector<PrimitiveShape>& Primitives::Shapes()
+{
+	static const std::vector<PrimitiveShape> shapes = {
+		PrimitiveShape::Sphere,
+		PrimitiveShape::Cube,
+		PrimitiveShape::Cylinder,
+		PrimitiveShape::Cone,
+		PrimitiveShape::Torus,
+		PrimitiveShape::Tetrahedron,
+		PrimitiveShape::Octahedron,
+		PrimitiveShape::Icosahedron,
+		PrimitiveShape::Dodecahedron,
+	};
+	return shapes;
+}
+
+const char* Primitives::Name(PrimitiveShape shape)
+{
+	switch (shape) {
+	case PrimitiveShape::Sphere: return "Sphere";
+	case PrimitiveShape::Cube: return "Cube";
+	case PrimitiveShape::Cylinder: return "Cylinder";
+	case PrimitiveShape::Cone: return "Cone";
+	case PrimitiveShape::Torus: return "Torus";
+	case PrimitiveShape::Tetrahedron: return "Tetrahedron";
+	case PrimitiveShape::Octahedron: return "Octahedron";
+	case PrimitiveShape::Icosahedron: return "Icosahedron";
+	case PrimitiveShape::Dodecahedron: return "Dodecahedron";
+	}
+	return "";
+}
+
+MeshData Primitives::Generate(PrimitiveShape shape, int tessellation)
+{
+	const int segments = qBound(k_minTessellation, tessellation, k_maxTessellation);
+	MeshBuilder builder;
+	switch (shape) {
+	case PrimitiveShape::Sphere:
+		builder.AddGrid(segments, std::max(2, segments / 2), [](float u, float v, QVector3D& position, QVector3D& normal) {
+			const float theta = 2.f * k_pi * u;
+			const float phi = k_pi * v;
+			normal = QVector3D(std::sin(phi) * std::cos(theta), std::cos(phi), std::sin(phi) * std::sin(theta));
+			position = normal;
+		});
+		break;
+	case PrimitiveShape::Cube:
+		for (int axis = 0; axis < 3; ++axis) {
+			for (float side : { -1.f, 1.f }) {
+				QVector3D center;
+				QVector3D right;
+				QVector3D up;
+				center[axis] = side;
+				right[(axis + 1) % 3] = 1.f;
+				up[(axis + 2) % 3] = 1.f;
+				builder.AddFace({ center - right - up, center + right - up, center + right + up, center - right + up });
+			}
+		}
+		break;
+	case PrimitiveShape::Cylinder:
+		builder.AddGrid(segments, 1, [](float u, float v, QVector3D& position, QVector3D& normal) {
+			const float theta = 2.f * k_pi * u;
+			normal = QVector3D(std::cos(theta), 0.f, std::sin(theta));
+			position = QVector3D(normal.x(), 1.f - 2.f * v, normal.z());
+		});
+		builder.AddFace(Ring(segments, 1.f));
+		builder.AddFace(Ring(segments, -1.f));
+		break;
+	case PrimitiveShape::Cone:
+		// Each segment of the side has its own apex vertex, with the normal of the segment
+		builder.AddGrid(segments, 1, [](float u, float v, QVector3D& position, QVector3D& normal) {
+			const float theta = 2.f * k_pi * u;
+			normal = QVector3D(2.f * std::cos(theta), 1.f, 2.f * std::sin(theta));
+			position = QVector3D(v * std::cos(theta), 1.f - 2.f * v, v * std::sin(theta));
+		});
+		builder.AddFace(Ring(segments, -1.f));
+		break;
+	case PrimitiveShape::Torus:
+		builder.AddGrid(segments, std::max(3, segments / 2), [](float u, float v, QVector3D& position, QVector3D& normal) {
+			const float theta = 2.f * k_pi * u;
+			const float phi = 2.f * k_pi * v;
+			normal = QVector3D(std::cos(phi) * std::cos(theta), std::sin(phi), std::cos(phi) * std::sin(theta));
+			position = QVector3D(k_torusRadius * std::cos(theta), 0.f, k_torusRadius * std::sin(theta)) + k_torusTubeRadius * normal;
+		});
+		break;
+	case PrimitiveShape::Tetrahedron:
+		builder.AddTriangleSolid({
+			QVector3D(1.f, 1.f, 1.f).normalized(),
+			QVector3D(1.f, -1.f, -1.f).normalized(),
+			QVector3D(-1.f, 1.f, -1.f).normalized(),
+			QVector3D(-1.f, -1.f, 1.f).normalized() });
+		break;
+	case PrimitiveShape::Octahedron:
+		builder.AddTriangleSolid({
+			QVector3D(1.f, 0.f, 0.f), QVector3D(-1.f, 0.f, 0.f),
+			QVector3D(0.f, 1.f, 0.f), QVector3D(0.f, -1.f, 0.f),
+			QVector3D(0.f, 0.f, 1.f), QVector3D(0.f, 0.f, -1.f) });
+		break;
+	case PrimitiveShape::Icosahedron:
+		builder.AddTriangleSolid(IcosahedronCorners());
+		break;
+	case PrimitiveShape::Dodecahedron:
+		AddDodecahedron(builder);
+		break;
+	}
+	return builder.Pack(Name(shape));
+}
+
+ModelData Primitives::Cached(PrimitiveShape shape, int tessellation)
+{
+	static QMutex mutex;
+	static QHash<QPair<int, int>, ModelData> cache;
+
+	const QPair<int, int> key(int(shape), qBound(k_minTessellation, tessellation, k_maxTessellation));
+	QMutexLocker lock(&mutex);
+	auto it = cache.find(key);
+	if (it == cache.end()) {
+		ModelData model;
+		model.m_materials.push_back(GreyMaterial());
+		model.m_meshes.push_back(Generate(shape, key.second));
+		it = cache.insert(key, model);
+	}
+	return *it;
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include "ModelLoader.h"
+
+// Shapes Primitives can generate
+enum class PrimitiveShape {
+	Sphere,
+	Cube,
+	Cylinder,
+	Cone,
+	Torus,
+	Tetrahedron,
+	Octahedron,
+	Icosahedron,
+	Dodecahedron,
+};
+
+// Generates the built-in primitives as packed vertices and indices, without reading a file or
+// going through Assimp. Every shape fits the box from -1 to 1. Vertices store float positions,
+// normals and UVs interleaved. Curved shapes are split into tessellation segments around
+// their axis, the platonic solids and the cube have flat faces and ignore it.
+class Primitives
+{
+public:
+	static const int k_defaultTessellation = 32;
+	static const int k_minTessellation = 3;
+	static const int k_maxTessellation = 256;
+
+	static const std::vector<PrimitiveShape>& Shapes();
+	static const char* Name(PrimitiveShape shape);
+
+	// Generates shape, tessellation is clamped to the limits above. The mesh uses material 0.
+	static MeshData Generate(PrimitiveShape shape, int tessellation = k_defaultTessellation);
+
+	// The model of Generate() with its plain grey material. Each shape and tessellation is generated once, later calls share
+	// the data. Safe to call from any thread.
+	static ModelData Cached(PrimitiveShape shape, int tessellation = k_defaultTessellation);
+};
@@ -0,0 +1,319 @@
+#include "ProgramInterface.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QVector2D>
+
+#include <algorithm>
+#include <iterator>
+
+
+namespace {
+
+struct SlotInfo {
+	const char* m_pName;
+	GLenum m_type;
+};
+
+// Names and types of the slots, in the order of ProgramInterface::Slot
+const SlotInfo k_slots[ProgramInterface::k_slotCount] = {
+	{ "uLightPos", GL_FLOAT_VEC3 },
+	{ "uKa", GL_FLOAT },
+	{ "uKd", GL_FLOAT },
+	{ "uKs", GL_FLOAT },
+	{ "uSpecularColor", GL_FLOAT_VEC4 },
+	{ "uShininess", GL_FLOAT },
+	{ "uMat4_1", GL_FLOAT_MAT4 },
+	{ "uVec3_1", GL_FLOAT_VEC3 },
+	{ "uVec4_1", GL_FLOAT_VEC4 },
+	{ "uFloat_1", GL_FLOAT },
+	{ "uInt_1", GL_INT },
+	{ "uHasTexture", GL_FLOAT },
+};
+
+// The per mesh uniforms, set by the variant a mesh is drawn with
+const char* const k_meshUniforms[] = { "matrix", "modelview", "normalMat" };
+
+bool IsViewerUniform(const QByteArray& name)
+{
+	for (const SlotInfo& slot : k_slots) {
+		if (name == slot.m_pName) {
+			return true;
+		}
+	}
+	for (const char* pName : k_meshUniforms) {
+		if (name == pName) {
+			return true;
+		}
+	}
+	return name.startsWith("gl_");
+}
+
+// Reads the active uniforms or attributes of a program into variables, with their locations
+void ReadVariables(QOpenGLFunctions* f, GLuint program, bool uniforms, std::vector<ProgramInterface::Variable>& variables, QHash<QByteArray, int>& indices)
+{
+	GLint count = 0;
+	GLint maxLength = 0;
+	f->glGetProgramiv(program, uniforms ? GL_ACTIVE_UNIFORMS : GL_ACTIVE_ATTRIBUTES, &count);
+	f->glGetProgramiv(program, uniforms ? GL_ACTIVE_UNIFORM_MAX_LENGTH : GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+	QByteArray name(std::max(maxLength, 1), '\0');
+	variables.reserve(count);
+	for (GLint i = 0; i < count; ++i) {
+		ProgramInterface::Variable variable;
+		GLsizei length = 0;
+		if (uniforms) {
+			f->glGetActiveUniform(program, GLuint(i), name.size(), &length, &variable.m_size, &variable.m_type, name.data());
+		}
+		else {
+			f->glGetActiveAttrib(program, GLuint(i), name.size(), &length, &variable.m_size, &variable.m_type, name.data());
+		}
+		variable.m_name = QByteArray(name.constData(), length);
+		if (variable.m_name.endsWith("[0]")) {
+			variable.m_name.chop(3);
+		}
+		variable.m_location = uniforms ? f->glGetUniformLocation(program, variable.m_name.constData())
+			: f->glGetAttribLocation(program, variable.m_name.constData());
+		indices.insert(variable.m_name, int(variables.size()));
+		variables.push_back(variable);
+	}
+}
+
+}
+
+ProgramInterface::ProgramInterface()
+{
+	Clear();
+}
+
+void ProgramInterface::Reflect(QOpenGLShaderProgram* pProgram)
+{
+	Clear();
+	QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+	const GLuint program = pProgram->programId();
+	ReadVariables(f, program, true, m_uniforms, m_uniformIndices);
+	ReadVariables(f, program, false, m_attributes, m_attributeIndices);
+
+	// A slot declared with another type would be set with the wrong call every frame, which
+	// the driver rejects with an error. It is left out once here instead.
+	for (int slot = 0; slot < k_slotCount; ++slot) {
+		const auto it = m_uniformIndices.constFind(k_slots[slot].m_pName);
+		if (it == m_uniformIndices.constEnd() || m_uniforms[*it].m_location == -1) {
+			continue;
+		}
+		const Variable& uniform = m_uniforms[*it];
+		const bool intSlot = k_slots[slot].m_type == GL_INT;
+		if (uniform.m_type != k_slots[slot].m_type && !(intSlot && uniform.m_type == GL_BOOL)) {
+			qWarning("%s is not of the type the viewer sets it with, it is left unset", k_slots[slot].m_pName);
+			continue;
+		}
+		m_slotLocations[slot] = uniform.m_location;
+		m_bindings.push_back({ Slot(slot), uniform.m_location });
+	}
+
+	for (const Variable& uniform : m_uniforms) {
+		if (uniform.m_location == -1 || uniform.m_size != 1 || UserComponents(uniform.m_type) == 0 || IsViewerUniform(uniform.m_name)) {
+			continue;
+		}
+		Variable user = uniform;
+		GLfloat values[4] = {};
+		f->glGetUniformfv(program, uniform.m_location, values);
+		user.m_initial = QVector4D(values[0], values[1], values[2], values[3]);
+		m_userUniforms.push_back(user);
+		m_userUploaded.push_back(user.m_initial);
+	}
+}
+
+void ProgramInterface::Clear()
+{
+	m_uniforms.clear();
+	m_attributes.clear();
+	m_userUniforms.clear();
+	m_uniformIndices.clear();
+	m_attributeIndices.clear();
+	m_bindings.clear();
+	std::fill(std::begin(m_slotLocations), std::end(m_slotLocations), -1);
+
+	// A new link starts out with the default values
+	m_uploadedSlots = 0;
+	m_userUploaded.clear();
+}
+
+GLint ProgramInterface::UniformLocation(const QByteArray& name) const
+{
+	const auto it = m_uniformIndices.constFind(name);
+	return it != m_uniformIndices.constEnd() ? m_uniforms[*it].m_location : -1;
+}
+
+GLint ProgramInterface::AttributeLocation(const QByteArray& name) const
+{
+	const auto it = m_attributeIndices.constFind(name);
+	return it != m_attributeIndices.constEnd() ? m_attributes[*it].m_location : -1;
+}
+
+bool ProgramInterface::HasSlot(Slot slot) const
+{
+	return m_slotLocations[slot] != -1;
+}
+
+const std::vector<ProgramInterface::Variable>& ProgramInterface::Uniforms() const
+{
+	return m_uniforms;
+}
+
+const std::vector<ProgramInterface::Variable>& ProgramInterface::Attributes() const
+{
+	return m_attributes;
+}
+
+const std::vector<ProgramInterface::Variable>& ProgramInterface::UserUniforms() const
+{
+	return m_userUniforms;
+}
+
+int ProgramInterface::Upload(QOpenGLShaderProgram* pProgram, const RenderState& frame, const QVector3D& lightPos)
+{
+	int uploads = 0;
+	for (const Binding& binding : m_bindings) {
+		switch (binding.m_slot) {
+		case k_lightPos:
+			if (Changed(k_lightPos, m_uploaded.m_lightPos, lightPos)) {
+				pProgram->setUniformValue(binding.m_location, lightPos);
+				++uploads;
+			}
+			break;
+		case k_ka:
+			if (Changed(k_ka, m_uploaded.m_ka, frame.m_ka)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_ka);
+				++uploads;
+			}
+			break;
+		case k_kd:
+			if (Changed(k_kd, m_uploaded.m_kd, frame.m_kd)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_kd);
+				++uploads;
+			}
+			break;
+		case k_ks:
+			if (Changed(k_ks, m_uploaded.m_ks, frame.m_ks)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_ks);
+				++uploads;
+			}
+			break;
+		case k_specularColor:
+			if (Changed(k_specularColor, m_uploaded.m_specularColor, frame.m_specularColor)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_specularColor);
+				++uploads;
+			}
+			break;
+		case k_shininess:
+			if (Changed(k_shininess, m_uploaded.m_shininess, frame.m_shininess)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_shininess);
+				++uploads;
+			}
+			break;
+		case k_mat4_1:
+			if (Changed(k_mat4_1, m_uploaded.m_mat4_1, frame.m_mat4_1)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_mat4_1);
+				++uploads;
+			}
+			break;
+		case k_vec3_1:
+			if (Changed(k_vec3_1, m_uploaded.m_vec3_1, frame.m_vec3_1)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_vec3_1);
+				++uploads;
+			}
+			break;
+		case k_vec4_1:
+			if (Changed(k_vec4_1, m_uploaded.m_vec4_1, frame.m_vec4_1)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_vec4_1);
+				++uploads;
+			}
+			break;
+		case k_float_1:
+			if (Changed(k_float_1, m_uploaded.m_float_1, frame.m_float_1)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_float_1);
+				++uploads;
+			}
+			break;
+		case k_int_1:
+			if (Changed(k_int_1, m_uploaded.m_int_1, frame.m_int_1)) {
+				pProgram->setUniformValue(binding.m_location, frame.m_int_1);
+				++uploads;
+			}
+			break;
+		case k_hasTexture:
+			// Textured meshes set it while they are drawn, so it is cleared every frame
+			pProgram->setUniformValue(binding.m_location, 0.f);
+			++uploads;
+			break;
+		default:
+			break;
+		}
+	}
+
+	// User uniforms nobody changed keep the value they were linked with
+	for (size_t i = 0; i < m_userUniforms.size(); ++i) {
+		const Variable& uniform = m_userUniforms[i];
+		const auto it = frame.m_userUniforms.constFind(uniform.m_name);
+		if (it == frame.m_userUniforms.constEnd() || *it == m_userUploaded[i]) {
+			continue;
+		}
+		const QVector4D& value = *it;
+		m_userUploaded[i] = value;
+		++uploads;
+		switch (uniform.m_type) {
+		case GL_FLOAT:
+			pProgram->setUniformValue(uniform.m_location, value.x());
+			break;
+		case GL_FLOAT_VEC2:
+			pProgram->setUniformValue(uniform.m_location, value.toVector2D());
+			break;
+		case GL_FLOAT_VEC3:
+			pProgram->setUniformValue(uniform.m_location, value.toVector3D());
+			break;
+		case GL_FLOAT_VEC4:
+			pProgram->setUniformValue(uniform.m_location, value);
+			break;
+		default:
+			pProgram->setUniformValue(uniform.m_location, GLint(value.x()));
+			break;
+		}
+	}
+	return uploads;
+}
+
+template <typename T>
+bool ProgramInterface::Changed(Slot slot, T& uploaded, const T& value)
+{
+	const quint32 bit = 1u << slot;
+	if ((m_uploadedSlots & bit) && uploaded == value) {
+		return false;
+	}
+	uploaded = value;
+	m_uploadedSlots |= bit;
+	return true;
+}
+
+const char* ProgramInterface::SlotName(Slot slot)
+{
+	return k_slots[slot].m_pName;
+}
+
+int ProgramInterface::UserComponents(GLenum type)
+{
+	switch (type) {
+	case GL_FLOAT:
+	case GL_INT:
+	case GL_BOOL:
+		return 1;
+	case GL_FLOAT_VEC2:
+		return 2;
+	case GL_FLOAT_VEC3:
+		return 3;
+	case GL_FLOAT_VEC4:
+		return 4;
+	default:
+		return 0;
+	}
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include "RenderState.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QVector4D>
+#include <qopengl.h>
+
+#include <vector>
+
+class QOpenGLShaderProgram;
+
+// The uniforms and attributes a linked program actually has, read back from the driver once
+// per link. Looking a name up is a hash lookup instead of a call into the driver, and the
+// shading values of a frame are uploaded from a table of the ones the program uses, each
+// checked once to have the type the viewer sets it with. Uniforms the viewer doesn't set are
+// the program's user uniforms, the uniform controller shows a control for each of them.
+// A program keeps its uniforms until it is linked again, so only values that changed since
+// they were last set are uploaded.
+class ProgramInterface
+{
+public:
+	// The loose uniforms set from the RenderState of a frame
+	enum Slot : int {
+		k_lightPos,
+		k_ka,
+		k_kd,
+		k_ks,
+		k_specularColor,
+		k_shininess,
+		k_mat4_1,
+		k_vec3_1,
+		k_vec4_1,
+		k_float_1,
+		k_int_1,
+		k_hasTexture,
+		k_slotCount
+	};
+
+	struct Variable {
+		// Arrays are named without their [0]
+		QByteArray m_name;
+		GLenum m_type = 0;
+		GLint m_size = 1;
+		// -1 for the members of uniform blocks
+		GLint m_location = -1;
+		// Of user uniforms, the value the program was linked with, in as many components as it has
+		QVector4D m_initial;
+	};
+
+	ProgramInterface();
+
+	// Reads the active uniforms and attributes of a linked program, its context has to be current
+	void Reflect(QOpenGLShaderProgram* pProgram);
+	void Clear();
+
+	// -1 if the program doesn't use the variable, or only in a uniform block
+	GLint UniformLocation(const QByteArray& name) const;
+	GLint AttributeLocation(const QByteArray& name) const;
+	bool HasSlot(Slot slot) const;
+
+	const std::vector<Variable>& Uniforms() const;
+	const std::vector<Variable>& Attributes() const;
+
+	// Single float, vector or int uniforms the viewer doesn't set itself
+	const std::vector<Variable>& UserUniforms() const;
+
+	// Sets the slots the program uses and the user uniforms values were given for, where they
+	// differ from what the program has. The program has to be bound. Returns the uniforms set.
+	int Upload(QOpenGLShaderProgram* pProgram, const RenderState& frame, const QVector3D& lightPos);
+
+	static const char* SlotName(Slot slot);
+
+	// Components of a float, vector or int uniform, 0 for the types user uniforms can't have
+	static int UserComponents(GLenum type);
+
+private:
+	struct Binding {
+		Slot m_slot;
+		GLint m_location;
+	};
+
+	std::vector<Variable> m_uniforms;
+	std::vector<Variable> m_attributes;
+	std::vector<Variable> m_userUniforms;
+	QHash<QByteArray, int> m_uniformIndices;
+	QHash<QByteArray, int> m_attributeIndices;
+
+	// Records value as the one of slot, returns false if the program already has it
+	template <typename T>
+	bool Changed(Slot slot, T& uploaded, const T& value);
+
+	// The slots the program uses with the right type, in the order of Slot
+	std::vector<Binding> m_bindings;
+	GLint m_slotLocations[k_slotCount];
+
+	// The values the program was last given, m_uploadedSlots has the bit 1 << Slot of each
+	// slot set since linking. The user uniforms start out with the values they were linked with.
+	RenderState m_uploaded;
+	quint32 m_uploadedSlots = 0;
+	std::vector<QVector4D> m_userUploaded;
+};
@@ -0,0 +1,143 @@
+#include "RemoteFile.h"
+
+#include <QEventLoop>
+#include <QMutexLocker>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+
+namespace {
+
+struct Response {
+	int m_status = 0;
+	QByteArray m_body;
+	QByteArray m_contentRange;
+};
+
+// Blocks until the reply is in. A manager belongs to the thread it was made on, so each
+// request makes its own.
+Response Get(const QUrl& url, const QByteArray& range = QByteArray())
+{
+	QNetworkAccessManager manager;
+	QNetworkRequest request(url);
+	request.setAttribute(QNetworkRequest::RedirectPolicyAttribute, QNetworkRequest::NoLessSafeRedirectPolicy);
+	request.setTransferTimeout(RemoteFile::k_timeoutMs);
+	if (!range.isEmpty()) {
+		request.setRawHeader("Range", range);
+	}
+
+	QNetworkReply* pReply = manager.get(request);
+	QEventLoop loop;
+	QObject::connect(pReply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
+	if (!pReply->isFinished()) {
+		loop.exec();
+	}
+
+	Response response;
+	if (pReply->error() == QNetworkReply::NoError) {
+		response.m_status = pReply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt();
+		response.m_body = pReply->readAll();
+		response.m_contentRange = pReply->rawHeader("Content-Range");
+	}
+	delete pReply;
+	return response;
+}
+
+QByteArray Range(qint64 offset, qint64 size)
+{
+	return "bytes=" + QByteArray::number(offset) + "-" + QByteArray::number(offset + size - 1);
+}
+
+}
+
+QSharedPointer<RemoteFile> RemoteFile::Open(const QUrl& url)
+{
+	// Asking for the first byte tells the size from "Content-Range: bytes 0-0/<size>", and
+	// whether ranges are served at all. Servers that don't send the whole file instead.
+	const Response response = Get(url, Range(0, 1));
+	QSharedPointer<RemoteFile> pFile(new RemoteFile());
+	pFile->m_url = url;
+	if (response.m_status == 206) {
+		bool ok = false;
+		pFile->m_size = response.m_contentRange.mid(response.m_contentRange.lastIndexOf('/') + 1).toLongLong(&ok);
+		if (ok) {
+			return pFile;
+		}
+		const Response whole = Get(url);
+		if (whole.m_status != 200) {
+			return QSharedPointer<RemoteFile>();
+		}
+		pFile->m_pWhole = FileContents::FromBytes(whole.m_body);
+	}
+	else if (response.m_status == 200) {
+		pFile->m_pWhole = FileContents::FromBytes(response.m_body);
+	}
+	else {
+		return QSharedPointer<RemoteFile>();
+	}
+	pFile->m_size = pFile->m_pWhole->Size();
+	return pFile;
+}
+
+const QUrl& RemoteFile::Url() const
+{
+	return m_url;
+}
+
+qint64 RemoteFile::Size() const
+{
+	return m_size;
+}
+
+bool RemoteFile::ServesRanges() const
+{
+	QMutexLocker lock(&m_mutex);
+	return !m_pWhole;
+}
+
+QSharedPointer<const FileContents> RemoteFile::Read(qint64 offset, qint64 size)
+{
+	{
+		QMutexLocker lock(&m_mutex);
+		if (m_pWhole) {
+			return FileContents::Slice(m_pWhole, offset, size);
+		}
+	}
+	if (offset < 0 || size < 0 || offset > m_size || size > m_size - offset) {
+		return QSharedPointer<const FileContents>();
+	}
+	if (size == 0) {
+		return FileContents::FromBytes(QByteArray());
+	}
+
+	const Response response = Get(m_url, Range(offset, size));
+	if (response.m_status == 206 && response.m_body.size() == size) {
+		return FileContents::FromBytes(response.m_body);
+	}
+
+	// The server sent the whole file after all, it is kept rather than asked for again
+	if (response.m_status == 200 && response.m_body.size() == m_size) {
+		QMutexLocker lock(&m_mutex);
+		m_pWhole = FileContents::FromBytes(response.m_body);
+		return FileContents::Slice(m_pWhole, offset, size);
+	}
+	return QSharedPointer<const FileContents>();
+}
+
+QSharedPointer<const FileContents> RemoteFile::ReadAll()
+{
+	{
+		QMutexLocker lock(&m_mutex);
+		if (m_pWhole) {
+			return m_pWhole;
+		}
+	}
+	const Response response = Get(m_url);
+	return response.m_status == 200 ? FileContents::FromBytes(response.m_body) : QSharedPointer<const FileContents>();
+}
+
+bool RemoteFile::IsUrl(const QString& path)
+{
+	return path.startsWith("http://", Qt::CaseInsensitive) || path.startsWith("https://", Qt::CaseInsensitive);
+}
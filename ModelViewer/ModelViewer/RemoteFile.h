@@ -0,0 +1,43 @@
+#pragma once
+#include "FileContents.h"
+
+#include <QMutex>
+#include <QSharedPointer>
+#include <QString>
+#include <QUrl>
+
+// A file on an http(s) server, read in ranges so only the parts needed are downloaded, such as
+// the directory and a few entries of a large archive. Servers that don't serve ranges send the
+// whole file once, parts are then taken from it.
+// Requests block the calling thread, so files are only read on loading threads.
+class RemoteFile
+{
+public:
+	// Requests give up once no data came for this long
+	static const int k_timeoutMs = 30000;
+
+	// Asks the server for the size of the file. Null if it can't be reached or has no such file.
+	static QSharedPointer<RemoteFile> Open(const QUrl& url);
+
+	const QUrl& Url() const;
+	qint64 Size() const;
+	bool ServesRanges() const;
+
+	// size bytes from offset on, null if the request failed
+	QSharedPointer<const FileContents> Read(qint64 offset, qint64 size);
+
+	// The whole file, downloaded again for each call unless the server doesn't serve ranges
+	QSharedPointer<const FileContents> ReadAll();
+
+	static bool IsUrl(const QString& path);
+
+private:
+	RemoteFile() = default;
+
+	QUrl m_url;
+	qint64 m_size = 0;
+
+	// Only kept for servers that don't serve ranges
+	mutable QMutex m_mutex;
+	QSharedPointer<const FileContents> m_pWhole;
+};
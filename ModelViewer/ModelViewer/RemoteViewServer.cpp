@@ -0,0 +1,190 @@
+#include "RemoteViewServer.h"
+#include "ScriptRunner.h"
+#include "ViewerGraphicsWindow.h"
+
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+
+
+namespace {
+
+void WriteError(QTcpSocket* pSocket, const QString& error)
+{
+	QJsonObject result;
+	result.insert("ok", false);
+	result.insert("error", error);
+	pSocket->write(QJsonDocument(result).toJson(QJsonDocument::Compact) + '\n');
+}
+
+}
+
+RemoteViewServer::RemoteViewServer(ViewerGraphicsWindow* pGraphicsWindow, ScriptRunner* pScript, QObject* parent)
+	: QObject(parent), m_pGraphicsWindow(pGraphicsWindow), m_pScript(pScript)
+{
+	connect(&m_stream, &FrameStream::FrameEncoded, this, [=](int frame, QSize size, QByteArray jpeg) { SendFrame(frame, size, jpeg); });
+}
+
+RemoteViewServer::~RemoteViewServer()
+{
+	if (m_authenticated) {
+		m_pGraphicsWindow->StopFrameStream();
+	}
+}
+
+void RemoteViewServer::SetToken(const QString& token)
+{
+	m_token = token;
+}
+
+bool RemoteViewServer::Listen(quint16 port, const QHostAddress& address)
+{
+	m_pServer = new QTcpServer(this);
+	if (!m_pServer->listen(address, port)) {
+		qWarning("Could not listen on port %d: %s", int(port), qPrintable(m_pServer->errorString()));
+		return false;
+	}
+	connect(m_pServer, &QTcpServer::newConnection, this, [=] { Accept(); });
+	return true;
+}
+
+quint16 RemoteViewServer::Port() const
+{
+	return m_pServer ? m_pServer->serverPort() : 0;
+}
+
+bool RemoteViewServer::HasClient() const
+{
+	return !m_pClient.isNull();
+}
+
+const FrameStream& RemoteViewServer::Stream() const
+{
+	return m_stream;
+}
+
+void RemoteViewServer::Accept()
+{
+	while (QTcpSocket* pSocket = m_pServer->nextPendingConnection()) {
+		if (m_pClient) {
+			WriteError(pSocket, "Another client is being served");
+			pSocket->disconnectFromHost();
+			connect(pSocket, &QTcpSocket::disconnected, pSocket, &QObject::deleteLater);
+			continue;
+		}
+
+		// Frames go out as soon as they are compressed, small writes aren't held back. They
+		// only start once the client gave the token.
+		m_pClient = pSocket;
+		m_authenticated = false;
+		pSocket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+		connect(pSocket, &QTcpSocket::readyRead, this, [=] { ReadClient(); });
+		connect(pSocket, &QTcpSocket::disconnected, this, [=] {
+			EndClient();
+			pSocket->deleteLater();
+		});
+		QTimer::singleShot(k_tokenTimeoutMs, pSocket, [=] {
+			if (m_pClient == pSocket && !m_authenticated) {
+				Drop("No token was given in time");
+			}
+		});
+	}
+}
+
+void RemoteViewServer::ReadClient()
+{
+	while (m_pClient && m_pClient->canReadLine()) {
+		const QByteArray line = m_pClient->readLine().trimmed();
+		if (line.size() > k_maxLineBytes) {
+			Drop(QString("Lines may be %1 bytes at most").arg(k_maxLineBytes));
+			return;
+		}
+		if (line.isEmpty()) {
+			continue;
+		}
+		QJsonParseError parseError;
+		const QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+		if (!document.isObject()) {
+			WriteError(m_pClient, QString("Not a JSON object: %1").arg(parseError.errorString()));
+			continue;
+		}
+		const QJsonObject object = document.object();
+
+		// The first line has to give the token, a client that doesn't is dropped
+		if (!m_authenticated) {
+			if (m_token.isEmpty() || object.value("token").toString() != m_token) {
+				Drop("Wrong token");
+				return;
+			}
+			m_authenticated = true;
+			m_stream.Reset();
+			m_pGraphicsWindow->StartFrameStream(&m_stream);
+			continue;
+		}
+
+		// Acknowledgements are answered with the next frame, everything else is a command
+		if (object.contains("ack")) {
+			m_stream.Acknowledge(object.value("ack").toInt());
+			continue;
+		}
+		QString error;
+		if (!IsViewCommand(object, &error)) {
+			WriteError(m_pClient, error);
+			continue;
+		}
+		m_pScript->AddCommand(object, m_pClient);
+	}
+
+	// A line that doesn't end would be buffered without bound
+	if (m_pClient && m_pClient->bytesAvailable() > k_maxLineBytes) {
+		Drop(QString("Lines may be %1 bytes at most").arg(k_maxLineBytes));
+	}
+}
+
+bool RemoteViewServer::IsViewCommand(const QJsonObject& command, QString* pError)
+{
+	// Commands that read or write files, change settings or quit are left to the local socket
+	// and scripts of the machine the viewer runs on
+	const QString name = command.value("command").toString();
+	const bool view = name == "camera" || name == "uniform" || name == "path"
+		|| (name == "wait" && command.value("seconds").toDouble() <= k_maxWaitSeconds)
+		|| (name == "playback" && command.contains("keys") && !command.contains("timings"));
+	if (!view && pError) {
+		*pError = name == "playback" ? QString("Remote playback takes \"keys\" and writes no timings")
+			: name == "wait" ? QString("Remote waits may be %1 seconds at most").arg(k_maxWaitSeconds)
+			: QString("The \"%1\" command isn't allowed remotely").arg(name);
+	}
+	return view;
+}
+
+void RemoteViewServer::SendFrame(int frame, const QSize& size, const QByteArray& jpeg)
+{
+	if (!m_pClient) {
+		return;
+	}
+	QJsonObject header;
+	header.insert("frame", frame);
+	header.insert("width", size.width());
+	header.insert("height", size.height());
+	header.insert("bytes", jpeg.size());
+	m_pClient->write(QJsonDocument(header).toJson(QJsonDocument::Compact) + '\n');
+	m_pClient->write(jpeg);
+}
+
+void RemoteViewServer::Drop(const QString& error)
+{
+	QTcpSocket* pClient = m_pClient;
+	WriteError(pClient, error);
+	EndClient();
+	pClient->disconnectFromHost();
+}
+
+void RemoteViewServer::EndClient()
+{
+	m_pGraphicsWindow->StopFrameStream();
+	m_stream.Reset();
+	m_pClient = nullptr;
+	m_authenticated = false;
+}
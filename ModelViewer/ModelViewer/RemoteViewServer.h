@@ -0,0 +1,79 @@
+#pragma once
+#include "FrameStream.h"
+
+#include <QHostAddress>
+#include <QObject>
+#include <QPointer>
+
+class QJsonObject;
+class QTcpServer;
+class QTcpSocket;
+class ScriptRunner;
+class ViewerGraphicsWindow;
+
+// Serves the view to a thin client over TCP, for machines without a GPU of their own. The
+// client first sends the token the server was given, then the commands of ScriptRunner that
+// only change the view, one JSON object per line, and gets their results back as lines as
+// well. Every frame drawn meanwhile that the FrameStream takes comes as a line of its own
+// followed by the JPEG image it announces, and the client answers each frame it has shown
+// with an acknowledgement, which keeps the stream going:
+//
+//   -> {"token": "..."}
+//   -> {"command": "camera", "rotX": 45}
+//   <- {"command": "camera", "ok": true, "seconds": 0.0001}
+//   <- {"frame": 12, "width": 960, "height": 540, "bytes": 48213}, then 48213 bytes of JPEG
+//   -> {"ack": 12}
+//
+// Only camera, uniform, path, wait and playback of "keys" are taken, as anyone who has the
+// token can send them, and waits of k_maxWaitSeconds at most, as the commands queue up with
+// those of local scripts. Commands that load models, write files, change settings or quit the
+// viewer are for the local socket and scripts of the machine the viewer runs on. A client
+// with the wrong token, without one after k_tokenTimeoutMs or with a line over k_maxLineBytes
+// is dropped. One client is served at a time, others are turned away until it disconnects.
+// Frames are as large as the window, at the scale the link allows.
+class RemoteViewServer : public QObject
+{
+	Q_OBJECT
+
+public:
+	// Longest line a client may send
+	static const int k_maxLineBytes = 64 * 1024;
+	// Longest a client may take to give the token, so one that never does can't keep others out
+	static const int k_tokenTimeoutMs = 3000;
+	// Longest wait a client may ask for
+	static constexpr double k_maxWaitSeconds = 10.0;
+
+	RemoteViewServer(ViewerGraphicsWindow* pGraphicsWindow, ScriptRunner* pScript, QObject* parent = nullptr);
+	~RemoteViewServer();
+
+	// The token clients have to give first. Without one every client is turned away.
+	void SetToken(const QString& token);
+
+	// A port of 0 picks a free one. Only this machine can connect unless another address,
+	// such as QHostAddress::Any, is given.
+	bool Listen(quint16 port, const QHostAddress& address = QHostAddress::LocalHost);
+	quint16 Port() const;
+	bool HasClient() const;
+
+	const FrameStream& Stream() const;
+
+	// Whether command only changes the view, which remote clients may do. pError says why not.
+	static bool IsViewCommand(const QJsonObject& command, QString* pError = nullptr);
+
+private:
+	void Accept();
+	void ReadClient();
+	// Tells the client why and disconnects it
+	void Drop(const QString& error);
+	void SendFrame(int frame, const QSize& size, const QByteArray& jpeg);
+	void EndClient();
+
+	ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
+	ScriptRunner* m_pScript = nullptr;
+	QTcpServer* m_pServer = nullptr;
+	QPointer<QTcpSocket> m_pClient;
+	QString m_token;
+	// The client gave the token, frames are streamed to it
+	bool m_authenticated = false;
+	FrameStream m_stream;
+};
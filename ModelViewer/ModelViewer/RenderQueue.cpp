@@ -0,0 +1,82 @@
+#include "RenderQueue.h"
+
+#include <cstring>
+
+
+quint64 RenderQueue::MakeKey(int program, quint32 texture, quint32 buffer, float depth)
+{
+	// Positive floats sort like their bit patterns, the lowest mantissa bits are dropped
+	quint32 depthBits = 0;
+	if (depth > 0.f) {
+		std::memcpy(&depthBits, &depth, sizeof(depthBits));
+		depthBits >>= 32 - k_depthBits;
+	}
+
+	quint64 key = quint64(program) & ((1u << k_programBits) - 1);
+	key = (key << k_textureBits) | (texture & ((1u << k_textureBits) - 1));
+	key = (key << k_bufferBits) | (buffer & ((1u << k_bufferBits) - 1));
+	key = (key << k_depthBits) | depthBits;
+	return key;
+}
+
+void RenderQueue::Clear()
+{
+	m_keys.clear();
+	m_meshes.clear();
+}
+
+void RenderQueue::Add(quint64 key, int meshIdx)
+{
+	m_keys.push_back(key);
+	m_meshes.push_back(meshIdx);
+}
+
+void RenderQueue::Sort()
+{
+	const size_t count = m_keys.size();
+	if (count < 2) {
+		return;
+	}
+
+	// Key bits set or clear in every key don't change the order
+	quint64 allSet = ~quint64(0);
+	quint64 anySet = 0;
+	for (quint64 key : m_keys) {
+		allSet &= key;
+		anySet |= key;
+	}
+	const quint64 varying = allSet ^ anySet;
+
+	// Least significant digit first, a byte per pass. Each pass is stable, so earlier ones
+	// break the ties of later ones.
+	m_sortedKeys.resize(count);
+	m_sortedMeshes.resize(count);
+	for (int shift = 0; shift < 64; shift += 8) {
+		if (((varying >> shift) & 0xff) == 0) {
+			continue;
+		}
+
+		size_t starts[256] = {};
+		for (quint64 key : m_keys) {
+			++starts[(key >> shift) & 0xff];
+		}
+		size_t offset = 0;
+		for (size_t& start : starts) {
+			const size_t digitCount = start;
+			start = offset;
+			offset += digitCount;
+		}
+		for (size_t i = 0; i < count; ++i) {
+			const size_t to = starts[(m_keys[i] >> shift) & 0xff]++;
+			m_sortedKeys[to] = m_keys[i];
+			m_sortedMeshes[to] = m_meshes[i];
+		}
+		m_keys.swap(m_sortedKeys);
+		m_meshes.swap(m_sortedMeshes);
+	}
+}
+
+const std::vector<int>& RenderQueue::Meshes() const
+{
+	return m_meshes;
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <vector>
+
+#include <QtGlobal>
+
+// Draw order for the meshes of a frame. Each mesh gets a key of the state it needs, and the keys
+// are sorted so meshes sharing a program, texture and vertex buffer are drawn together and, within
+// those, nearest first so the depth test rejects what is behind them early.
+class RenderQueue
+{
+public:
+	// Bits of each key field, most significant first. Textures and buffers are keyed by the low
+	// bits of their names, a collision only costs a state change.
+	static const int k_programBits = 8;
+	static const int k_textureBits = 14;
+	static const int k_bufferBits = 14;
+	static const int k_depthBits = 28;
+
+	// Key of a mesh drawn with program variant program, texture and vertex buffer names texture
+	// and buffer, depth in front of the camera
+	static quint64 MakeKey(int program, quint32 texture, quint32 buffer, float depth);
+
+	void Clear();
+	void Add(quint64 key, int meshIdx);
+
+	// Sorts the meshes by key, meshes with equal keys stay in the order they were added
+	void Sort();
+
+	// Indices of the meshes added, sorted once Sort was called
+	const std::vector<int>& Meshes() const;
+
+private:
+	std::vector<quint64> m_keys;
+	std::vector<int> m_meshes;
+
+	// Scratch space for the radix sort, kept between frames
+	std::vector<quint64> m_sortedKeys;
+	std::vector<int> m_sortedMeshes;
+};
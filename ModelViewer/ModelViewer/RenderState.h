@@ -0,0 +1,46 @@
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <QMatrix4x4>
+#include <QSize>
+#include <QVector3D>
+#include <QVector4D>
+
+#include <vector>
+
+// Everything a frame is drawn with that the user changes between frames: the camera, the
+// size of the widget and the shading values of the uniform controls. The viewer fills it
+// whenever it changes any of them, and a frame reads these values from it, so all of the
+// frame's passes use the same ones.
+struct RenderState {
+	// The projection and the model view matrix of the camera
+	QMatrix4x4 m_projection;
+	QMatrix4x4 m_model;
+
+	// The clip planes of the projection, fitted to the model unless they are set by hand
+	float m_nearPlane = 0.1f;
+	float m_farPlane = 100.f;
+	QSize m_nativeSize;
+	qreal m_retinaScale = 1.0;
+
+	// With the window split, the model matrix of each viewport and the projection of their
+	// cells. Empty for a single view.
+	std::vector<QMatrix4x4> m_viewportModels;
+	QMatrix4x4 m_viewportProjection;
+
+	QVector3D m_lightPos;
+	QVector4D m_color;
+	QVector4D m_specularColor;
+	float m_ka = 0.f;
+	float m_kd = 0.f;
+	float m_ks = 0.f;
+	float m_shininess = 1.f;
+	QMatrix4x4 m_mat4_1;
+	QVector3D m_vec3_1;
+	QVector4D m_vec4_1;
+	float m_float_1 = 0.f;
+	int m_int_1 = 0;
+
+	// Values of the shader's own uniforms set from the uniform controller, by name
+	QHash<QByteArray, QVector4D> m_userUniforms;
+};
@@ -0,0 +1,272 @@
+#include "ResolutionScaler.h"
+#include "StateCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+
+
+namespace {
+
+const char* k_upsampleVertexShaderSource =
+	"attribute highp vec2 posAttr;\n"
+	"varying highp vec2 uv;\n"
+	"uniform highp vec2 uUvScale;\n"
+	"void main() {\n"
+	"   uv = (posAttr * 0.5 + 0.5) * uUvScale;\n"
+	"   gl_Position = vec4(posAttr, 0.0, 1.0);\n"
+	"}\n";
+
+const char* k_upsampleFragmentShaderSource =
+	"varying highp vec2 uv;\n"
+	"uniform sampler2D uScene;\n"
+	"uniform highp vec2 uUvMax;\n"
+	"void main() {\n"
+	"   gl_FragColor = texture2D(uScene, min(uv, uUvMax));\n"
+	"}\n";
+
+// FXAA in the form of Timothy Lottes' console version. Each fragment blurs along the edge it is
+// on, found from the luma of its diagonal neighbours in the scene, not in the stretched image.
+const char* k_fxaaFragmentShaderSource =
+	"varying highp vec2 uv;\n"
+	"uniform sampler2D uScene;\n"
+	"uniform highp vec2 uUvMax;\n"
+	"uniform highp vec2 uTexelSize;\n"
+	"const highp vec3 k_luma = vec3(0.299, 0.587, 0.114);\n"
+	"const highp float k_reduceMin = 1.0 / 128.0;\n"
+	"const highp float k_reduceMul = 1.0 / 8.0;\n"
+	"const highp float k_spanMax = 8.0;\n"
+	"highp vec4 fetch(highp vec2 at) {\n"
+	"   return texture2D(uScene, min(at, uUvMax));\n"
+	"}\n"
+	"void main() {\n"
+	"   highp vec4 center = fetch(uv);\n"
+	"   highp float lumaNW = dot(fetch(uv + vec2(-1.0, -1.0) * uTexelSize).rgb, k_luma);\n"
+	"   highp float lumaNE = dot(fetch(uv + vec2(1.0, -1.0) * uTexelSize).rgb, k_luma);\n"
+	"   highp float lumaSW = dot(fetch(uv + vec2(-1.0, 1.0) * uTexelSize).rgb, k_luma);\n"
+	"   highp float lumaSE = dot(fetch(uv + vec2(1.0, 1.0) * uTexelSize).rgb, k_luma);\n"
+	"   highp float lumaM = dot(center.rgb, k_luma);\n"
+	"   highp float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));\n"
+	"   highp float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));\n"
+	"   highp vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), (lumaNW + lumaSW) - (lumaNE + lumaSE));\n"
+	"   highp float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * k_reduceMul, k_reduceMin);\n"
+	"   highp float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);\n"
+	"   dir = clamp(dir * rcpDirMin, vec2(-k_spanMax), vec2(k_spanMax)) * uTexelSize;\n"
+	"   highp vec3 rgbA = 0.5 * (fetch(uv + dir * (1.0 / 3.0 - 0.5)).rgb + fetch(uv + dir * (2.0 / 3.0 - 0.5)).rgb);\n"
+	"   highp vec3 rgbB = rgbA * 0.5 + 0.25 * (fetch(uv - dir * 0.5).rgb + fetch(uv + dir * 0.5).rgb);\n"
+	"   highp float lumaB = dot(rgbB, k_luma);\n"
+	"   gl_FragColor = vec4(lumaB < lumaMin || lumaB > lumaMax ? rgbA : rgbB, center.a);\n"
+	"}\n";
+
+// One triangle covering the whole viewport
+const GLfloat k_fullScreenTriangle[] = { -1.f, -1.f, 3.f, -1.f, -1.f, 3.f };
+
+const GLuint k_posAttr = 0;
+
+// Frames are aimed at this much of the target, so the scale settles before frames are late
+const float k_targetHeadroom = 0.9f;
+
+// Scale changes smaller than this are ignored
+const float k_minScaleStep = 0.05f;
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+}
+
+ResolutionScaler::~ResolutionScaler()
+{
+	// The framebuffers and buffer go with the context, only the programs are left
+	delete m_upsample.m_pProgram;
+	delete m_fxaa.m_pProgram;
+}
+
+bool ResolutionScaler::Create()
+{
+	Destroy();
+
+	if (!LinkPass(m_upsample, k_upsampleFragmentShaderSource)) {
+		Destroy();
+		return false;
+	}
+	LinkPass(m_fxaa, k_fxaaFragmentShaderSource);
+
+	m_triangle = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	m_triangle.create();
+	m_triangle.bind();
+	m_triangle.allocate(k_fullScreenTriangle, sizeof(k_fullScreenTriangle));
+	if (m_vao.create()) {
+		m_vao.bind();
+		Functions()->glVertexAttribPointer(k_posAttr, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+		Functions()->glEnableVertexAttribArray(k_posAttr);
+		m_vao.release();
+	}
+	m_triangle.release();
+	m_scale = 1.f;
+	return true;
+}
+
+void ResolutionScaler::Destroy()
+{
+	if (QOpenGLContext::currentContext()) {
+		delete m_pTarget;
+		delete m_pResolve;
+		m_vao.destroy();
+		m_triangle.destroy();
+	}
+	m_pTarget = nullptr;
+	m_pResolve = nullptr;
+	for (Pass* pPass : { &m_upsample, &m_fxaa }) {
+		delete pPass->m_pProgram;
+		*pPass = Pass();
+	}
+	m_nativeSize = QSize();
+}
+
+bool ResolutionScaler::IsCreated() const
+{
+	return m_upsample.m_pProgram != nullptr;
+}
+
+QSize ResolutionScaler::Begin(const QSize& nativeSize, int samples)
+{
+	if (!QOpenGLFramebufferObject::hasOpenGLFramebufferBlit()) {
+		samples = 0;
+	}
+	if (nativeSize != m_nativeSize || samples != m_samples) {
+		delete m_pTarget;
+		delete m_pResolve;
+		m_pResolve = nullptr;
+
+		QOpenGLFramebufferObjectFormat format;
+		format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+		format.setSamples(samples);
+		m_pTarget = new QOpenGLFramebufferObject(nativeSize, format);
+		if (samples > 0) {
+			m_pResolve = new QOpenGLFramebufferObject(nativeSize);
+		}
+
+		// Stretched, the scene is filtered
+		QOpenGLExtraFunctions* f = Functions();
+		f->glBindTexture(GL_TEXTURE_2D, (m_pResolve ? m_pResolve : m_pTarget)->texture());
+		f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		f->glBindTexture(GL_TEXTURE_2D, 0);
+		m_nativeSize = nativeSize;
+		m_samples = samples;
+	}
+
+	m_scaledSize = QSize(std::max(1, int(std::lround(nativeSize.width() * m_scale))), std::max(1, int(std::lround(nativeSize.height() * m_scale))));
+	m_pTarget->bind();
+	StateCache::Current().Viewport(0, 0, m_scaledSize.width(), m_scaledSize.height());
+	return m_scaledSize;
+}
+
+GLuint ResolutionScaler::Framebuffer() const
+{
+	return m_pTarget ? m_pTarget->handle() : 0;
+}
+
+void ResolutionScaler::End(GLuint framebuffer, bool fxaa)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	const QRect scene(QPoint(0, 0), m_scaledSize);
+	if (m_pResolve) {
+		QOpenGLFramebufferObject::blitFramebuffer(m_pResolve, scene, m_pTarget, scene);
+	}
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	state.Viewport(0, 0, m_nativeSize.width(), m_nativeSize.height());
+	state.Disable(GL_DEPTH_TEST);
+
+	// Texels outside the drawn corner are never sampled, not even by the filter
+	const Pass& pass = fxaa && m_fxaa.m_pProgram ? m_fxaa : m_upsample;
+	const float width = float(m_nativeSize.width());
+	const float height = float(m_nativeSize.height());
+	pass.m_pProgram->bind();
+	pass.m_pProgram->setUniformValue(pass.m_uvScaleUniform, m_scaledSize.width() / width, m_scaledSize.height() / height);
+	pass.m_pProgram->setUniformValue(pass.m_uvMaxUniform, (m_scaledSize.width() - 0.5f) / width, (m_scaledSize.height() - 0.5f) / height);
+	if (pass.m_texelSizeUniform >= 0) {
+		pass.m_pProgram->setUniformValue(pass.m_texelSizeUniform, 1.f / width, 1.f / height);
+	}
+	f->glActiveTexture(GL_TEXTURE0);
+	f->glBindTexture(GL_TEXTURE_2D, (m_pResolve ? m_pResolve : m_pTarget)->texture());
+	if (m_vao.isCreated()) {
+		m_vao.bind();
+	}
+	else {
+		m_triangle.bind();
+		f->glVertexAttribPointer(k_posAttr, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+		f->glEnableVertexAttribArray(k_posAttr);
+	}
+	f->glDrawArrays(GL_TRIANGLES, 0, 3);
+	if (m_vao.isCreated()) {
+		m_vao.release();
+	}
+	else {
+		f->glDisableVertexAttribArray(k_posAttr);
+		m_triangle.release();
+	}
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+	pass.m_pProgram->release();
+	state.Enable(GL_DEPTH_TEST);
+}
+
+void ResolutionScaler::Update(float frameSeconds, float targetSeconds)
+{
+	m_scale = NextScale(m_scale, frameSeconds, targetSeconds);
+}
+
+void ResolutionScaler::ResetScale()
+{
+	m_scale = 1.f;
+}
+
+float ResolutionScaler::Scale() const
+{
+	return m_scale;
+}
+
+float ResolutionScaler::NextScale(float scale, float frameSeconds, float targetSeconds)
+{
+	if (frameSeconds <= 0.f || targetSeconds <= 0.f) {
+		return scale;
+	}
+
+	// Frame time goes with the pixel count, which goes with the square of the scale. Half of
+	// the difference is applied each frame, so one slow frame doesn't halve the resolution.
+	const float ideal = scale * std::sqrt(targetSeconds * k_targetHeadroom / frameSeconds);
+	const float next = std::min(1.f, std::max(k_minScale, scale + (ideal - scale) * 0.5f));
+	if (std::abs(next - scale) < k_minScaleStep && next != 1.f && next != k_minScale) {
+		return scale;
+	}
+	return next;
+}
+
+bool ResolutionScaler::LinkPass(Pass& pass, const char* fragmentSource)
+{
+	pass.m_pProgram = new QOpenGLShaderProgram();
+	pass.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, k_upsampleVertexShaderSource);
+	pass.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+	pass.m_pProgram->bindAttributeLocation("posAttr", k_posAttr);
+	if (!pass.m_pProgram->link()) {
+		qWarning("Could not link an upsampling shader: %s", qPrintable(pass.m_pProgram->log()));
+		delete pass.m_pProgram;
+		pass = Pass();
+		return false;
+	}
+	pass.m_uvScaleUniform = pass.m_pProgram->uniformLocation("uUvScale");
+	pass.m_uvMaxUniform = pass.m_pProgram->uniformLocation("uUvMax");
+	pass.m_texelSizeUniform = pass.m_pProgram->uniformLocation("uTexelSize");
+	pass.m_pProgram->bind();
+	pass.m_pProgram->setUniformValue("uScene", 0);
+	pass.m_pProgram->release();
+	return true;
+}
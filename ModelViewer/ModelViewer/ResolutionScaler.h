@@ -0,0 +1,72 @@
+#pragma once
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QSize>
+#include <qopengl.h>
+
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+
+// Renders the scene at a fraction of the window's resolution and stretches it over the window,
+// lowering the fraction while frames take longer than the target and raising it again while
+// they are faster. The scene target is allocated at full size and only a corner of it is
+// drawn to, so changing the scale never reallocates anything. The target is also where the
+// scene is anti-aliased, multisampled targets are resolved and FXAA is applied while stretching,
+// so neither needs the window's own framebuffer to change.
+class ResolutionScaler
+{
+public:
+	// Fraction of the width and height the scene is never drawn below
+	static constexpr float k_minScale = 0.5f;
+
+	~ResolutionScaler();
+
+	// Creating and destroying the programs and framebuffers requires a current context. Create
+	// returns false if the upsampling program doesn't link, without the FXAA program End
+	// falls back to plain upsampling.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Binds the scene target for a frame of nativeSize pixels and returns the size of the part
+	// to draw to. Multisampled targets need framebuffer blits, without them the scene is drawn
+	// without multisampling.
+	QSize Begin(const QSize& nativeSize, int samples);
+
+	// Framebuffer Begin bound
+	GLuint Framebuffer() const;
+
+	// Resolves the scene and draws it stretched over all of framebuffer, smoothing its edges
+	// with FXAA if fxaa is set. Leaves framebuffer bound with the full viewport.
+	void End(GLuint framebuffer, bool fxaa);
+
+	// Moves the scale toward the one that makes frames of frameSeconds take targetSeconds
+	void Update(float frameSeconds, float targetSeconds);
+	void ResetScale();
+	float Scale() const;
+
+	// The scale after a frame at scale took frameSeconds. Aims a little below the target, and
+	// ignores small differences so the resolution doesn't flicker.
+	static float NextScale(float scale, float frameSeconds, float targetSeconds);
+
+private:
+	// A program drawing the scene over the window and its uniforms
+	struct Pass {
+		QOpenGLShaderProgram* m_pProgram = nullptr;
+		GLint m_uvScaleUniform = -1;
+		GLint m_uvMaxUniform = -1;
+		GLint m_texelSizeUniform = -1;
+	};
+	static bool LinkPass(Pass& pass, const char* fragmentSource);
+
+	QOpenGLFramebufferObject* m_pTarget = nullptr;
+	QOpenGLFramebufferObject* m_pResolve = nullptr;
+	Pass m_upsample;
+	Pass m_fxaa;
+	QOpenGLBuffer m_triangle;
+	QOpenGLVertexArrayObject m_vao;
+	int m_samples = 0;
+	QSize m_nativeSize;
+	QSize m_scaledSize;
+	float m_scale = 1.f;
+};
@@ -0,0 +1,198 @@
+#include "ResourceTracker.h"
+#include "GeometryStreamer.h"
+#include "ModelLoader.h"
+#include "TextureCache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QSet>
+#include <QStringList>
+
+// GL_NVX_gpu_memory_info and GL_ATI_meminfo, both reporting kilobytes
+#ifndef GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX
+#define GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX 0x9048
+#endif
+#ifndef GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX
+#define GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX 0x9049
+#endif
+#ifndef GL_TEXTURE_FREE_MEMORY_ATI
+#define GL_TEXTURE_FREE_MEMORY_ATI 0x87FC
+#endif
+
+
+namespace {
+
+const char* k_categoryNames[k_resourceCategoryCount] = {
+	"Vertices",
+	"Indices",
+	"Textures",
+	"Buffers",
+	"Passes",
+	"Assimp scene",
+	"Caches",
+};
+
+QString Megabytes(qint64 bytes)
+{
+	return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 1) + " MB";
+}
+
+}
+
+void ResourceTracker::Clear()
+{
+	for (qint64& bytes : m_bytes) {
+		bytes = 0;
+	}
+}
+
+void ResourceTracker::Set(ResourceCategory category, qint64 bytes)
+{
+	m_bytes[category] = bytes;
+}
+
+void ResourceTracker::Add(ResourceCategory category, qint64 bytes)
+{
+	m_bytes[category] += bytes;
+}
+
+qint64 ResourceTracker::Bytes(ResourceCategory category) const
+{
+	return m_bytes[category];
+}
+
+qint64 ResourceTracker::GpuBytes() const
+{
+	qint64 bytes = 0;
+	for (int i = 0; i < k_resourceCategoryCount; ++i) {
+		if (IsGpu(ResourceCategory(i))) {
+			bytes += m_bytes[i];
+		}
+	}
+	return bytes;
+}
+
+qint64 ResourceTracker::CpuBytes() const
+{
+	qint64 bytes = 0;
+	for (int i = 0; i < k_resourceCategoryCount; ++i) {
+		if (!IsGpu(ResourceCategory(i))) {
+			bytes += m_bytes[i];
+		}
+	}
+	return bytes;
+}
+
+qint64 ResourceTracker::ModelBytes() const
+{
+	return m_bytes[k_resourceVertices] + m_bytes[k_resourceIndices] + m_bytes[k_resourceTextures] + m_bytes[k_resourceBuffers];
+}
+
+void ResourceTracker::SetGpuBudget(qint64 bytes)
+{
+	m_gpuBudget = bytes;
+}
+
+qint64 ResourceTracker::GpuBudget() const
+{
+	return m_gpuBudget;
+}
+
+qint64 ResourceTracker::UploadAllowance(bool replaceModels) const
+{
+	if (m_gpuBudget <= 0) {
+		return -1;
+	}
+	const qint64 used = GpuBytes() - (replaceModels ? ModelBytes() : 0);
+	return qMax(qint64(0), m_gpuBudget - used);
+}
+
+void ResourceTracker::UpdateDeviceMemory()
+{
+	m_device = QueryDeviceMemory();
+}
+
+const ResourceTracker::DeviceMemory& ResourceTracker::Device() const
+{
+	return m_device;
+}
+
+ResourceTracker::DeviceMemory ResourceTracker::QueryDeviceMemory()
+{
+	DeviceMemory memory;
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext) {
+		return memory;
+	}
+	QOpenGLFunctions* f = pContext->functions();
+	if (pContext->hasExtension("GL_NVX_gpu_memory_info")) {
+		GLint total = 0;
+		GLint available = 0;
+		f->glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &total);
+		f->glGetIntegerv(GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &available);
+		memory.m_total = qint64(total) * 1024;
+		memory.m_available = qint64(available) * 1024;
+	}
+	else if (pContext->hasExtension("GL_ATI_meminfo")) {
+		// The free memory of the pool, the largest free block, and the same for shared memory
+		GLint free[4] = {};
+		f->glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, free);
+		memory.m_available = qint64(free[0]) * 1024;
+	}
+	return memory;
+}
+
+QString ResourceTracker::Report() const
+{
+	QStringList lines;
+	for (int i = 0; i < k_resourceCategoryCount; ++i) {
+		const ResourceCategory category = ResourceCategory(i);
+		lines << QString("%1 (%2): %3").arg(Name(category), IsGpu(category) ? "GPU" : "CPU", Megabytes(m_bytes[i]));
+	}
+	lines << QString("GPU total: %1").arg(Megabytes(GpuBytes()));
+	lines << QString("CPU total: %1").arg(Megabytes(CpuBytes()));
+	if (m_gpuBudget > 0) {
+		lines << QString("GPU budget: %1%2").arg(Megabytes(m_gpuBudget), GpuBytes() > m_gpuBudget ? ", exceeded" : "");
+	}
+	if (m_device.m_total >= 0) {
+		lines << QString("Video memory: %1 of %2 available").arg(Megabytes(m_device.m_available), Megabytes(m_device.m_total));
+	}
+	else if (m_device.m_available >= 0) {
+		lines << QString("Video memory: %1 available").arg(Megabytes(m_device.m_available));
+	}
+	return lines.join('\n');
+}
+
+bool ResourceTracker::IsGpu(ResourceCategory category)
+{
+	return category < k_resourceScene;
+}
+
+const char* ResourceTracker::Name(ResourceCategory category)
+{
+	return (category >= 0 && category < k_resourceCategoryCount) ? k_categoryNames[category] : "";
+}
+
+qint64 ResourceTracker::UploadBytes(const ModelData& data, bool includeGeometry)
+{
+	qint64 bytes = 0;
+	if (includeGeometry) {
+		bytes += GeometryStreamer::GeometryBytes(data);
+	}
+	for (const MeshData& mesh : data.m_meshes) {
+		bytes += mesh.m_morphData.size();
+	}
+
+	// Maps of the same image share one texture
+	QSet<QString> keys;
+	for (const MaterialData& material : data.m_materials) {
+		for (const TextureData& map : material.m_maps) {
+			if (map.isNull() || keys.contains(map.m_key)) {
+				continue;
+			}
+			keys.insert(map.m_key);
+			bytes += map.m_compressed.isNull() ? TextureCache::EstimateBytes(map.m_image) : TextureCache::EstimateBytes(map.m_compressed);
+		}
+	}
+	return bytes;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <QString>
+#include <QtGlobal>
+
+struct ModelData;
+
+// What the memory the viewer holds is used for. The first five are on the GPU.
+enum ResourceCategory : int {
+	k_resourceVertices = 0,
+	k_resourceIndices,
+	k_resourceTextures,
+	k_resourceBuffers, // Material, instance, bone and morph buffers of the meshes
+	k_resourcePasses, // Targets and buffers the render passes keep
+	k_resourceScene, // The imported Assimp scene kept for exporting
+	k_resourceCaches, // Decoded meshes a streamed model keeps on the CPU
+	k_resourceCategoryCount,
+};
+
+// Bytes of memory per category, filled in by whoever owns the resources whenever they change.
+// Nothing is tracked per allocation, each owner reports the sizes it already knows. Uploads
+// can be checked against a budget for the GPU categories before they are made, and the driver
+// can be asked how much video memory it has left where it tells.
+class ResourceTracker
+{
+public:
+	// Video memory the driver reports through GL_NVX_gpu_memory_info or GL_ATI_meminfo, -1
+	// where it doesn't. ATI only tells what is available.
+	struct DeviceMemory {
+		qint64 m_total = -1;
+		qint64 m_available = -1;
+	};
+
+	void Clear();
+	void Set(ResourceCategory category, qint64 bytes);
+	void Add(ResourceCategory category, qint64 bytes);
+	qint64 Bytes(ResourceCategory category) const;
+
+	qint64 GpuBytes() const;
+	qint64 CpuBytes() const;
+
+	// GPU memory of the models themselves, their geometry, textures and buffers
+	qint64 ModelBytes() const;
+
+	// 0 for no budget
+	void SetGpuBudget(qint64 bytes);
+	qint64 GpuBudget() const;
+
+	// GPU memory an upload may take before the budget is exceeded, -1 without a budget. The
+	// models' memory counts as free when replaceModels is set.
+	qint64 UploadAllowance(bool replaceModels) const;
+
+	// Queries the current context, which has to be current
+	void UpdateDeviceMemory();
+	const DeviceMemory& Device() const;
+	static DeviceMemory QueryDeviceMemory();
+
+	// A line per category with the megabytes it takes, then the totals, the budget and the
+	// driver's report
+	QString Report() const;
+
+	static bool IsGpu(ResourceCategory category);
+	static const char* Name(ResourceCategory category);
+
+	// Estimated GPU memory uploading data takes, with the same estimates the caches use for
+	// textures. Geometry is left out for models that stream it.
+	static qint64 UploadBytes(const ModelData& data, bool includeGeometry);
+
+private:
+	qint64 m_bytes[k_resourceCategoryCount] = {};
+	qint64 m_gpuBudget = 0;
+	DeviceMemory m_device;
+};
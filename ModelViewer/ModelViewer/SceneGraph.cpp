@@ -0,0 +1,168 @@
+#include "SceneGraph.h"
+
+#include <algorithm>
+
+int SceneGraph::AddNode(const QString& name, int parent, const QMatrix4x4& local)
+{
+	return AddNode(name, parent, local, parent >= 0 ? m_nodes[parent].m_world * local : local);
+}
+
+int SceneGraph::AddNode(const QString& name, int parent, const QMatrix4x4& local, const QMatrix4x4& world)
+{
+	const int nodeIdx = int(m_nodes.size());
+	SceneNode node;
+	node.m_name = name;
+	node.m_parent = parent;
+	node.m_end = nodeIdx + 1;
+	node.m_local = local;
+	node.m_world = world;
+	m_nodes.push_back(node);
+
+	// The subtrees of the nodes above now reach this one
+	for (int above = parent; above >= 0; above = m_nodes[above].m_parent) {
+		m_nodes[above].m_end = nodeIdx + 1;
+	}
+	return nodeIdx;
+}
+
+void SceneGraph::Clear()
+{
+	m_nodes.clear();
+	m_changed.clear();
+	m_moved.clear();
+	m_toggled.clear();
+	m_pending.clear();
+	m_isolated = -1;
+	m_edited = false;
+}
+
+bool SceneGraph::IsEmpty() const
+{
+	return m_nodes.empty();
+}
+
+int SceneGraph::NodeCount() const
+{
+	return int(m_nodes.size());
+}
+
+const SceneNode& SceneGraph::Node(int node) const
+{
+	return m_nodes[node];
+}
+
+int SceneGraph::FindNode(const QString& name) const
+{
+	for (size_t i = 0; i < m_nodes.size(); ++i) {
+		if (m_nodes[i].m_name == name) {
+			return int(i);
+		}
+	}
+	return -1;
+}
+
+void SceneGraph::SetLocal(int node, const QMatrix4x4& local)
+{
+	m_nodes[node].m_local = local;
+	m_moved.push_back(node);
+	m_edited = true;
+}
+
+void SceneGraph::SetHidden(int node, bool hidden)
+{
+	if (m_nodes[node].m_hidden != hidden) {
+		m_nodes[node].m_hidden = hidden;
+		m_toggled.push_back(node);
+		m_edited = true;
+	}
+}
+
+void SceneGraph::Isolate(int node)
+{
+	if (node == m_isolated) {
+		return;
+	}
+
+	// Only the nodes in one of the two subtrees but not the other change, which are up to two
+	// runs when the subtrees overlap
+	const NodeRange before = m_isolated >= 0 ? NodeRange{ m_isolated, m_nodes[m_isolated].m_end } : NodeRange{ 0, NodeCount() };
+	const NodeRange after = node >= 0 ? NodeRange{ node, m_nodes[node].m_end } : NodeRange{ 0, NodeCount() };
+	if (before.m_end <= after.m_first || after.m_end <= before.m_first) {
+		m_pending.push_back(before);
+		m_pending.push_back(after);
+	}
+	else {
+		const NodeRange head = { std::min(before.m_first, after.m_first), std::max(before.m_first, after.m_first) };
+		const NodeRange tail = { std::min(before.m_end, after.m_end), std::max(before.m_end, after.m_end) };
+		for (const NodeRange& range : { head, tail }) {
+			if (range.m_first < range.m_end) {
+				m_pending.push_back(range);
+			}
+		}
+	}
+	m_isolated = node;
+	m_edited = true;
+}
+
+int SceneGraph::Isolated() const
+{
+	return m_isolated;
+}
+
+bool SceneGraph::IsVisible(int node) const
+{
+	return m_nodes[node].m_shown && (m_isolated < 0 || (node >= m_isolated && node < m_nodes[m_isolated].m_end));
+}
+
+bool SceneGraph::IsEdited() const
+{
+	return m_edited;
+}
+
+void SceneGraph::CollectSubtrees(std::vector<int>& nodes)
+{
+	// A node inside the subtree of one before it is brought up to date with that one
+	m_changed.clear();
+	std::sort(nodes.begin(), nodes.end());
+	for (int node : nodes) {
+		if (m_changed.empty() || node >= m_changed.back().m_end) {
+			m_changed.push_back({ node, m_nodes[node].m_end });
+		}
+	}
+	nodes.clear();
+}
+
+const std::vector<NodeRange>& SceneGraph::UpdateTransforms()
+{
+	// Parents come first, so each world matrix is worked out from an up to date one
+	CollectSubtrees(m_moved);
+	for (const NodeRange& range : m_changed) {
+		for (int i = range.m_first; i < range.m_end; ++i) {
+			SceneNode& node = m_nodes[i];
+			node.m_world = node.m_parent >= 0 ? m_nodes[node.m_parent].m_world * node.m_local : node.m_local;
+		}
+	}
+	return m_changed;
+}
+
+const std::vector<NodeRange>& SceneGraph::UpdateVisibility()
+{
+	CollectSubtrees(m_toggled);
+	for (const NodeRange& range : m_changed) {
+		for (int i = range.m_first; i < range.m_end; ++i) {
+			SceneNode& node = m_nodes[i];
+			node.m_shown = !node.m_hidden && (node.m_parent < 0 || m_nodes[node.m_parent].m_shown);
+		}
+	}
+	m_changed.insert(m_changed.end(), m_pending.begin(), m_pending.end());
+	m_pending.clear();
+	return m_changed;
+}
+
+void SceneGraph::Invalidate()
+{
+	for (int i = 0; i < NodeCount(); i = m_nodes[i].m_end) {
+		m_moved.push_back(i);
+		m_toggled.push_back(i);
+	}
+}
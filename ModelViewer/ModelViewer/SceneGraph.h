@@ -0,0 +1,91 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QString>
+
+// A node of a SceneGraph. Its subtree is the node itself and the nodes after it up to m_end.
+struct SceneNode {
+	QString m_name;
+	int m_parent = -1;
+	int m_end = 0;
+	QMatrix4x4 m_local; // Relative to the parent
+	QMatrix4x4 m_world; // In model space
+	bool m_hidden = false; // Hidden on its own, which hides its subtree
+	bool m_shown = true; // Neither it nor a node above it hidden
+};
+
+// The nodes following one another in a SceneGraph, from m_first up to m_end
+struct NodeRange {
+	int m_first = 0;
+	int m_end = 0;
+};
+
+// The node tree of a model, flattened depth first into one array, so every subtree is a run of
+// nodes and a parent always comes before its children. Moving or hiding a node only notes it,
+// UpdateTransforms and UpdateVisibility then walk just the subtrees of the noted nodes and say
+// which runs of nodes changed, and nothing outside them is looked at. Moves and visibility are
+// kept apart, so hiding a node never touches a matrix.
+class SceneGraph
+{
+public:
+	// Adds a node under parent, -1 for a root, and returns its index. Nodes are added depth
+	// first, so parent must be the last node added or one above it. Its world matrix is worked
+	// out right away.
+	int AddNode(const QString& name, int parent, const QMatrix4x4& local);
+	// Same with the world matrix worked out by the caller, such as in double precision
+	int AddNode(const QString& name, int parent, const QMatrix4x4& local, const QMatrix4x4& world);
+
+	void Clear();
+	bool IsEmpty() const;
+	int NodeCount() const;
+	const SceneNode& Node(int node) const;
+
+	// Index of the first node called name, or -1
+	int FindNode(const QString& name) const;
+
+	// Moves a node and its subtree relative to its parent
+	void SetLocal(int node, const QMatrix4x4& local);
+
+	// Hides or shows a node's subtree. Nodes hidden on their own stay hidden when a node above
+	// them is shown again.
+	void SetHidden(int node, bool hidden);
+
+	// Shows only the subtree of node, on top of what is hidden. -1 shows every node again.
+	void Isolate(int node);
+	int Isolated() const;
+
+	// Whether a node is drawn: nothing above it hidden, and inside the isolated subtree if any
+	bool IsVisible(int node) const;
+
+	// Whether a node was moved or hidden since the graph was built
+	bool IsEdited() const;
+
+	// Works out the world matrices of the moved subtrees and returns them as runs of nodes,
+	// in order
+	const std::vector<NodeRange>& UpdateTransforms();
+
+	// Works out which nodes are shown below the nodes hidden or shown, and returns the runs of
+	// nodes whose visibility may have changed since the last call: those subtrees in order,
+	// then the runs an Isolate showed or hid
+	const std::vector<NodeRange>& UpdateVisibility();
+
+	// Marks every node as changed, for the next updates to hand out all of them
+	void Invalidate();
+
+private:
+	// Turns nodes into the runs of their subtrees in order, leaving out the ones inside another
+	void CollectSubtrees(std::vector<int>& nodes);
+
+	std::vector<SceneNode> m_nodes;
+	std::vector<NodeRange> m_changed;
+
+	// Nodes moved, and nodes hidden or shown, since the last update of each
+	std::vector<int> m_moved;
+	std::vector<int> m_toggled;
+
+	// Runs an Isolate changed, added to the next UpdateVisibility
+	std::vector<NodeRange> m_pending;
+	int m_isolated = -1;
+	bool m_edited = false;
+};
@@ -0,0 +1,207 @@
+#include "SceneOutliner.h"
+#include "SceneGraph.h"
+#include "ViewerGraphicsWindow.h"
+
+#include <QAbstractItemModel>
+#include <QFont>
+#include <QHBoxLayout>
+#include <QPushButton>
+#include <QTreeView>
+#include <QVBoxLayout>
+
+#include <vector>
+
+
+// The nodes of a SceneGraph as a tree. The graph is depth first, so the children of each node
+// are gathered into one array once, and a node's row is where it is among its parent's.
+class SceneNodeModel : public QAbstractItemModel
+{
+public:
+	SceneNodeModel(ViewerGraphicsWindow* pGraphicsWindow, QObject* parent)
+		: QAbstractItemModel(parent), m_pGraphicsWindow(pGraphicsWindow)
+	{
+		Reset();
+	}
+
+	// Picks up the node tree of a new model
+	void Reset()
+	{
+		beginResetModel();
+		const SceneGraph& graph = m_pGraphicsWindow->GetSceneGraph();
+		const int nodeCount = graph.NodeCount();
+
+		// Children of node n from m_childStart[n + 1] on, the roots from m_childStart[0] on
+		m_childStart.assign(size_t(nodeCount) + 2, 0);
+		for (int node = 0; node < nodeCount; ++node) {
+			++m_childStart[graph.Node(node).m_parent + 2];
+		}
+		for (size_t i = 1; i < m_childStart.size(); ++i) {
+			m_childStart[i] += m_childStart[i - 1];
+		}
+		m_children.resize(size_t(nodeCount));
+		m_rows.resize(size_t(nodeCount));
+		std::vector<int> next(m_childStart.begin(), m_childStart.end() - 1);
+		for (int node = 0; node < nodeCount; ++node) {
+			const int slot = next[graph.Node(node).m_parent + 1]++;
+			m_children[slot] = node;
+			m_rows[node] = slot - m_childStart[graph.Node(node).m_parent + 1];
+		}
+		m_isolated = graph.Isolated();
+		endResetModel();
+	}
+
+	QModelIndex IndexOf(int node) const
+	{
+		return node >= 0 && node < int(m_rows.size()) ? createIndex(m_rows[node], 0, quintptr(node)) : QModelIndex();
+	}
+
+	// Shows only the subtree of node, -1 shows every node again
+	void Isolate(int node)
+	{
+		const int previous = m_isolated;
+		if (!m_pGraphicsWindow->isolateNode(node)) {
+			return;
+		}
+		m_isolated = node;
+		for (int changed : { previous, node }) {
+			const QModelIndex index = IndexOf(changed);
+			if (index.isValid()) {
+				emit dataChanged(index, index, { Qt::FontRole });
+			}
+		}
+	}
+
+	QModelIndex index(int row, int column, const QModelIndex& parent = QModelIndex()) const override
+	{
+		const int parentNode = parent.isValid() ? int(parent.internalId()) : -1;
+		if (column != 0 || row < 0 || row >= ChildCount(parentNode)) {
+			return QModelIndex();
+		}
+		const int node = m_children[m_childStart[parentNode + 1] + row];
+		return createIndex(row, 0, quintptr(node));
+	}
+
+	QModelIndex parent(const QModelIndex& child) const override
+	{
+		if (!child.isValid()) {
+			return QModelIndex();
+		}
+		return IndexOf(m_pGraphicsWindow->GetSceneGraph().Node(int(child.internalId())).m_parent);
+	}
+
+	int rowCount(const QModelIndex& parent = QModelIndex()) const override
+	{
+		if (parent.column() > 0) {
+			return 0;
+		}
+		return ChildCount(parent.isValid() ? int(parent.internalId()) : -1);
+	}
+
+	int columnCount(const QModelIndex& = QModelIndex()) const override
+	{
+		return 1;
+	}
+
+	QVariant data(const QModelIndex& index, int role) const override
+	{
+		if (!index.isValid()) {
+			return QVariant();
+		}
+		const int node = int(index.internalId());
+		const SceneNode& sceneNode = m_pGraphicsWindow->GetSceneGraph().Node(node);
+		switch (role) {
+		case Qt::DisplayRole:
+			return sceneNode.m_name.isEmpty() ? QString("Node %1").arg(node) : sceneNode.m_name;
+		case Qt::CheckStateRole:
+			return sceneNode.m_hidden ? Qt::Unchecked : Qt::Checked;
+		case Qt::FontRole: {
+			QFont font;
+			font.setBold(node == m_isolated);
+			return font;
+		}
+		default:
+			return QVariant();
+		}
+	}
+
+	bool setData(const QModelIndex& index, const QVariant& value, int role) override
+	{
+		if (!index.isValid() || role != Qt::CheckStateRole) {
+			return false;
+		}
+		if (!m_pGraphicsWindow->setNodeHidden(int(index.internalId()), value.toInt() != Qt::Checked)) {
+			return false;
+		}
+		emit dataChanged(index, index, { Qt::CheckStateRole });
+		return true;
+	}
+
+	Qt::ItemFlags flags(const QModelIndex& index) const override
+	{
+		return index.isValid() ? Qt::ItemIsEnabled | Qt::ItemIsSelectable | Qt::ItemIsUserCheckable : Qt::NoItemFlags;
+	}
+
+private:
+	int ChildCount(int node) const
+	{
+		return m_childStart.empty() ? 0 : m_childStart[node + 2] - m_childStart[node + 1];
+	}
+
+	ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
+	std::vector<int> m_childStart;
+	std::vector<int> m_children;
+	std::vector<int> m_rows;
+	int m_isolated = -1;
+};
+
+SceneOutliner::SceneOutliner(ViewerGraphicsWindow* gWindow, QWidget* parent)
+	: QDialog(parent, Qt::Tool), m_pGraphicsWindow(gWindow)
+{
+	setWindowTitle("Scene Outliner");
+	resize(320, 480);
+
+	// Build our objects
+	m_pNodes = new SceneNodeModel(m_pGraphicsWindow, this);
+	m_pView = new QTreeView();
+	m_pView->setObjectName("sceneOutlinerView");
+	m_pView->setModel(m_pNodes);
+	m_pView->setHeaderHidden(true);
+
+	// Every row is as high as the others, so large trees scroll without measuring each
+	m_pView->setUniformRowHeights(true);
+
+	QPushButton* pIsolateButton = new QPushButton("Isolate");
+	pIsolateButton->setObjectName("isolateButton");
+	QPushButton* pShowAllButton = new QPushButton("Show All");
+	pShowAllButton->setObjectName("showAllButton");
+
+	// Setup the layout format
+	QHBoxLayout* pButtonLayout = new QHBoxLayout();
+	pButtonLayout->addWidget(pIsolateButton);
+	pButtonLayout->addWidget(pShowAllButton);
+	QVBoxLayout* pLayout = new QVBoxLayout(this);
+	pLayout->addWidget(m_pView, 1);
+	pLayout->addLayout(pButtonLayout);
+
+	// Connect up all the buttons
+	connect(pIsolateButton, &QPushButton::released, this, [=] {
+		const QModelIndex current = m_pView->currentIndex();
+		if (current.isValid()) {
+			m_pNodes->Isolate(int(current.internalId()));
+		}
+	});
+	connect(pShowAllButton, &QPushButton::released, this, [=] { m_pNodes->Isolate(-1); });
+
+	// The tree follows the model shown
+	connect(m_pGraphicsWindow, &ViewerGraphicsWindow::SceneChanged, this, [=] { m_pNodes->Reset(); });
+}
+
+QAbstractItemModel* SceneOutliner::nodeModel() const
+{
+	return m_pNodes;
+}
+
+QModelIndex SceneOutliner::nodeIndex(int node) const
+{
+	return m_pNodes->IndexOf(node);
+}
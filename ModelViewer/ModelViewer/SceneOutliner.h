@@ -0,0 +1,28 @@
+#pragma once
+#include <QDialog>
+#include <QModelIndex>
+
+class ViewerGraphicsWindow;
+class SceneNodeModel;
+class QAbstractItemModel;
+class QTreeView;
+
+// Lists the node tree of the model shown, read straight from its SceneGraph, so trees of a
+// hundred thousand nodes open without copying them into items. Unchecking a node hides its
+// subtree, Isolate shows only the subtree of the selected node and Show All ends that. Both
+// only flip visibility bits in the viewer, nothing is uploaded or loaded again.
+class SceneOutliner : public QDialog
+{
+	Q_OBJECT
+public:
+	SceneOutliner(ViewerGraphicsWindow* gWindow, QWidget* parent = nullptr);
+
+	// The tree the view shows, a node's internal id is its index in the SceneGraph
+	QAbstractItemModel* nodeModel() const;
+	QModelIndex nodeIndex(int node) const;
+
+private:
+	ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
+	SceneNodeModel* m_pNodes = nullptr;
+	QTreeView* m_pView = nullptr;
+};
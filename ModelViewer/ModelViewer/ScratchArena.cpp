@@ -0,0 +1,82 @@
+#include "ScratchArena.h"
+
+#include <algorithm>
+
+
+ScratchArena::Scope::Scope(ScratchArena& arena)
+	: m_arena(arena)
+	, m_mark(arena.GetMark())
+{
+	++m_arena.m_scopes;
+}
+
+ScratchArena::Scope::~Scope()
+{
+	m_arena.Rewind(m_mark);
+	if (--m_arena.m_scopes == 0) {
+		m_arena.Trim();
+	}
+}
+
+void* ScratchArena::Allocate(size_t bytes, size_t alignment)
+{
+	// Use the rest of the current block, or the next one that fits, or a new one
+	while (m_block < m_blocks.size()) {
+		Block& block = m_blocks[m_block];
+		const size_t start = (m_offset + alignment - 1) / alignment * alignment;
+		if (start + bytes <= block.m_size) {
+			m_offset = start + bytes;
+			return block.m_data.get() + start;
+		}
+		++m_block;
+		m_offset = 0;
+	}
+
+	// Blocks start out aligned for any type
+	Block block;
+	block.m_size = std::max(size_t(k_blockBytes), bytes);
+	block.m_data.reset(new char[block.m_size]);
+	m_blocks.push_back(std::move(block));
+	m_block = m_blocks.size() - 1;
+	m_offset = bytes;
+	return m_blocks.back().m_data.get();
+}
+
+ScratchArena::Mark ScratchArena::GetMark() const
+{
+	return { m_block, m_offset };
+}
+
+void ScratchArena::Rewind(const Mark& mark)
+{
+	m_block = mark.m_block;
+	m_offset = mark.m_offset;
+}
+
+void ScratchArena::Trim()
+{
+	// Only a block of the usual size is kept, one a large array needed goes as well
+	if (!m_blocks.empty() && m_blocks.front().m_size > k_blockBytes) {
+		m_blocks.clear();
+	}
+	else if (m_blocks.size() > 1) {
+		m_blocks.resize(1);
+	}
+	m_block = 0;
+	m_offset = 0;
+}
+
+size_t ScratchArena::Capacity() const
+{
+	size_t bytes = 0;
+	for (const Block& block : m_blocks) {
+		bytes += block.m_size;
+	}
+	return bytes;
+}
+
+ScratchArena& ScratchArena::ForThread()
+{
+	thread_local ScratchArena arena;
+	return arena;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Linear allocator for the short-lived arrays decoding builds and throws away, such as the
+// triangle lists and vertex remaps of each mesh. Allocating only bumps an offset into the
+// current block, freeing does nothing, and rewinding to a mark gives back everything allocated
+// since in one step. Blocks are kept for reuse, so decoding thousands of meshes on a thread
+// pool allocates each thread's blocks once instead of once per array.
+// Each thread has its own arena, an arena is never shared between threads.
+class ScratchArena
+{
+public:
+	// Blocks are this big unless an allocation needs more
+	static const size_t k_blockBytes = 1024 * 1024;
+
+	// Where the arena was, to rewind to
+	struct Mark {
+		size_t m_block = 0;
+		size_t m_offset = 0;
+	};
+
+	// Rewinds the arena to where it was when the scope started once it ends. Arrays allocated
+	// in the scope must be gone by then. The outermost scope on a thread also frees the blocks
+	// a large load needed beyond the first.
+	class Scope
+	{
+	public:
+		explicit Scope(ScratchArena& arena);
+		~Scope();
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+
+	private:
+		ScratchArena& m_arena;
+		Mark m_mark;
+	};
+
+	void* Allocate(size_t bytes, size_t alignment);
+	Mark GetMark() const;
+	void Rewind(const Mark& mark);
+
+	// Frees every block but the first, and that one too if a large array needed it
+	void Trim();
+
+	// Bytes of the blocks held
+	size_t Capacity() const;
+
+	// The arena of the calling thread
+	static ScratchArena& ForThread();
+
+private:
+	struct Block {
+		std::unique_ptr<char[]> m_data;
+		size_t m_size = 0;
+	};
+	std::vector<Block> m_blocks;
+	size_t m_block = 0;
+	size_t m_offset = 0;
+	int m_scopes = 0;
+};
+
+// Standard allocator drawing from a ScratchArena, for containers that don't outlive the scope
+// they were filled in
+template <class T>
+class ScratchAllocator
+{
+public:
+	typedef T value_type;
+
+	explicit ScratchAllocator(ScratchArena& arena = ScratchArena::ForThread()) : m_pArena(&arena) {}
+	template <class U>
+	ScratchAllocator(const ScratchAllocator<U>& other) : m_pArena(other.m_pArena) {}
+
+	T* allocate(size_t count) { return static_cast<T*>(m_pArena->Allocate(count * sizeof(T), alignof(T))); }
+	void deallocate(T*, size_t) {}
+
+	template <class U>
+	bool operator==(const ScratchAllocator<U>& other) const { return m_pArena == other.m_pArena; }
+	template <class U>
+	bool operator!=(const ScratchAllocator<U>& other) const { return m_pArena != other.m_pArena; }
+
+private:
+	template <class U>
+	friend class ScratchAllocator;
+
+	ScratchArena* m_pArena;
+};
+
+template <class T>
+using ScratchVector = std::vector<T, ScratchAllocator<T>>;
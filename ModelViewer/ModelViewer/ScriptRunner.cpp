@@ -0,0 +1,661 @@
+#include "ScriptRunner.h"
+#include "AppSettings.h"
+#include "ViewerGraphicsWindow.h"
+
+#include <QAbstractSocket>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QVector4D>
+
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <numeric>
+
+
+namespace {
+
+// Seconds a load may take before the command fails, unless it gives its own timeout
+const double k_defaultLoadTimeout = 120.0;
+
+QVector4D ReadVector(const QJsonValue& value)
+{
+	if (value.isDouble()) {
+		return QVector4D(float(value.toDouble()), 0.f, 0.f, 0.f);
+	}
+	const QJsonArray components = value.toArray();
+	QVector4D ret;
+	for (int i = 0; i < std::min(components.size(), 4); ++i) {
+		ret[i] = float(components[i].toDouble());
+	}
+	return ret;
+}
+
+// Timers take milliseconds in an int, longer times are cut to the longest one and times that
+// aren't numbers are none
+int TimerMs(double seconds)
+{
+	if (!(seconds > 0.0)) {
+		return 0;
+	}
+	return seconds < double(INT_MAX) / 1000.0 ? int(seconds * 1000.0) : INT_MAX;
+}
+
+double Milliseconds(float seconds)
+{
+	return double(seconds) * 1000.0;
+}
+
+// Of the times between the frames of a path or what each frame of a playback took. All of them
+// are kept, a path can be longer than the window's own statistics hold.
+QJsonObject TimeMetrics(std::vector<float> times)
+{
+	QJsonObject ret;
+	if (times.empty()) {
+		return ret;
+	}
+	std::sort(times.begin(), times.end());
+	const auto percentile = [&](float p) { return times[std::min(times.size() - 1, size_t(p * float(times.size())))]; };
+	const float total = std::accumulate(times.begin(), times.end(), 0.f);
+	ret.insert("minMs", Milliseconds(times.front()));
+	ret.insert("avgMs", Milliseconds(total / float(times.size())));
+	ret.insert("p95Ms", Milliseconds(percentile(0.95f)));
+	ret.insert("p99Ms", Milliseconds(percentile(0.99f)));
+	ret.insert("maxMs", Milliseconds(times.back()));
+	ret.insert("fps", total > 0.f ? double(times.size()) / double(total) : 0.0);
+	return ret;
+}
+
+}
+
+ScriptRunner::ScriptRunner(ViewerGraphicsWindow* pGraphicsWindow, QObject* parent)
+	: QObject(parent), m_pGraphicsWindow(pGraphicsWindow)
+{
+	m_timeout.setSingleShot(true);
+	connect(&m_timeout, &QTimer::timeout, this, [=] { TimedOut(); });
+}
+
+bool ScriptRunner::LoadScript(const QString& filepath, QString* pError)
+{
+	QFile file(filepath);
+	if (!file.open(QIODevice::ReadOnly)) {
+		if (pError) {
+			*pError = QString("Could not open %1").arg(filepath);
+		}
+		return false;
+	}
+	QJsonParseError parseError;
+	const QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parseError);
+	if (document.isNull()) {
+		if (pError) {
+			*pError = QString("%1 is not valid JSON: %2").arg(filepath, parseError.errorString());
+		}
+		return false;
+	}
+
+	const QJsonArray commands = document.isArray() ? document.array() : document.object().value("commands").toArray();
+	for (const QJsonValue& command : commands) {
+		AddCommand(command.toObject());
+	}
+	return true;
+}
+
+void ScriptRunner::AddCommand(const QJsonObject& command, QIODevice* pClient)
+{
+	m_queue.push_back({ command, pClient });
+	if (m_started && !m_running) {
+		QTimer::singleShot(0, this, [=] { RunNext(); });
+	}
+}
+
+bool ScriptRunner::Listen(const QString& name)
+{
+	// A server left behind by a viewer that crashed would keep the name taken
+	QLocalServer::removeServer(name);
+	m_pServer = new QLocalServer(this);
+	if (!m_pServer->listen(name)) {
+		qWarning("Could not listen on %s: %s", qPrintable(name), qPrintable(m_pServer->errorString()));
+		return false;
+	}
+	connect(m_pServer, &QLocalServer::newConnection, this, [=] {
+		while (QLocalSocket* pClient = m_pServer->nextPendingConnection()) {
+			connect(pClient, &QLocalSocket::readyRead, this, [=] { ReadClient(pClient); });
+			connect(pClient, &QLocalSocket::disconnected, pClient, &QObject::deleteLater);
+		}
+	});
+	return true;
+}
+
+bool ScriptRunner::SetMetricsFile(const QString& filepath)
+{
+	m_metricsFile.setFileName(filepath);
+	return m_metricsFile.open(QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text);
+}
+
+void ScriptRunner::SetQuitWhenDone(bool quit)
+{
+	m_quitWhenDone = quit;
+}
+
+void ScriptRunner::Start()
+{
+	// The window only has a context once it was first shown, which is done by the time the
+	// signal's handlers returned
+	if (!m_pGraphicsWindow->IsInitialized()) {
+		m_waitConnection = connect(m_pGraphicsWindow, &ViewerGraphicsWindow::Initialized, this, [=] {
+			disconnect(m_waitConnection);
+			Start();
+		}, Qt::QueuedConnection);
+		return;
+	}
+	m_started = true;
+	QTimer::singleShot(0, this, [=] { RunNext(); });
+}
+
+bool ScriptRunner::IsRunning() const
+{
+	return m_running || !m_queue.empty();
+}
+
+bool ScriptRunner::HasFailed() const
+{
+	return m_failed;
+}
+
+QJsonObject ScriptRunner::Metrics() const
+{
+	QJsonObject frames;
+	frames.insert("cpu", FrameMetrics(m_pGraphicsWindow->GetCpuFrameStats()));
+	frames.insert("gpu", FrameMetrics(m_pGraphicsWindow->GetGpuFrameStats()));
+
+	const ResourceTracker& resources = m_pGraphicsWindow->GetResources();
+	QJsonObject memory;
+	for (int category = 0; category < k_resourceCategoryCount; ++category) {
+		memory.insert(ResourceTracker::Name(ResourceCategory(category)), resources.Bytes(ResourceCategory(category)));
+	}
+	memory.insert("gpuBytes", resources.GpuBytes());
+	memory.insert("cpuBytes", resources.CpuBytes());
+	memory.insert("gpuBudget", resources.GpuBudget());
+	memory.insert("deviceTotal", resources.Device().m_total);
+	memory.insert("deviceAvailable", resources.Device().m_available);
+	memory.insert("uploadedBytes", m_pGraphicsWindow->GetUploadedBytes());
+
+	const ModelStats& stats = m_pGraphicsWindow->GetModelStats();
+	QJsonObject scene;
+	scene.insert("meshes", stats.m_meshes);
+	scene.insert("instances", stats.m_instances);
+	scene.insert("vertices", stats.m_vertices);
+	scene.insert("triangles", stats.m_triangles);
+	scene.insert("materials", stats.m_materials);
+	scene.insert("textures", stats.m_textures);
+
+	QJsonObject ret;
+	ret.insert("frames", frames);
+	ret.insert("memory", memory);
+	ret.insert("scene", scene);
+	return ret;
+}
+
+QJsonObject ScriptRunner::FrameMetrics(const FrameStats::Summary& summary)
+{
+	QJsonObject ret;
+	ret.insert("minMs", Milliseconds(summary.m_min));
+	ret.insert("avgMs", Milliseconds(summary.m_avg));
+	ret.insert("p95Ms", Milliseconds(summary.m_p95));
+	ret.insert("p99Ms", Milliseconds(summary.m_p99));
+	ret.insert("fps", summary.m_fps);
+	return ret;
+}
+
+void ScriptRunner::RunNext()
+{
+	if (!m_started || m_running) {
+		return;
+	}
+	if (m_queue.empty()) {
+		emit Finished(!m_failed);
+		if (m_quitWhenDone && !m_pServer) {
+			QCoreApplication::exit(m_failed ? 1 : 0);
+		}
+		return;
+	}
+
+	m_current = m_queue.front();
+	m_queue.pop_front();
+	m_running = true;
+	m_commandTimer.start();
+	Run(m_current.m_command);
+}
+
+void ScriptRunner::Run(const QJsonObject& command)
+{
+	const QString name = command.value("command").toString();
+	if (!m_pGraphicsWindow->IsInitialized()) {
+		Fail("The window has no OpenGL context");
+	}
+	else if (name == "load") {
+		RunLoad(command);
+	}
+	else if (name == "camera") {
+		RunCamera(command);
+	}
+	else if (name == "uniform") {
+		RunUniform(command);
+	}
+	else if (name == "setting") {
+		RunSetting(command);
+	}
+	else if (name == "path") {
+		RunPath(command);
+	}
+	else if (name == "playback") {
+		RunPlayback(command);
+	}
+	else if (name == "wait") {
+		m_timeout.start(TimerMs(command.value("seconds").toDouble()));
+	}
+	else if (name == "metrics") {
+		Finish(Metrics());
+	}
+	else if (name == "screenshot") {
+		// The frame is read back at the end of the next one
+		m_pGraphicsWindow->exportFrame(command.value("path").toString());
+		m_waitConnection = connect(m_pGraphicsWindow, &QOpenGLWidget::frameSwapped, this, [=] { Finish(); });
+		m_timeout.start(TimerMs(k_defaultLoadTimeout));
+	}
+	else if (name == "poster") {
+		// A tile is drawn a frame, the poster is done once its last rows are written
+		m_waitConnection = connect(m_pGraphicsWindow, &ViewerGraphicsWindow::PosterExported, this, [=](bool success, QString filepath) {
+			if (!success) {
+				Fail(QString("Could not write %1").arg(filepath));
+				return;
+			}
+			QJsonObject result;
+			result.insert("path", filepath);
+			Finish(result);
+		});
+		m_timeout.start(TimerMs(command.value("timeout").toDouble(k_defaultLoadTimeout)));
+		const QString path = command.value("path").toString();
+		if (!m_pGraphicsWindow->exportPoster(path, QSize(command.value("width").toInt(), command.value("height").toInt()))) {
+			Fail(QString("Could not start writing %1").arg(path));
+		}
+	}
+	else if (name == "video") {
+		RunVideo(command);
+	}
+	else if (name == "compare") {
+		// The model shown is measured against the one at path, then shown as mode says
+		m_waitConnection = connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ComparisonFinished, this, [=](bool success, float hausdorff, float mean) {
+			if (!success) {
+				Fail("Could not compare models without triangles");
+				return;
+			}
+			QJsonObject result;
+			result.insert("hausdorff", double(hausdorff));
+			result.insert("mean", double(mean));
+			Finish(result);
+		});
+		m_timeout.start(TimerMs(command.value("timeout").toDouble(k_defaultLoadTimeout)));
+		m_pGraphicsWindow->setCompareMode(command.value("mode").toInt(k_compareSideBySide));
+		const QString path = command.value("path").toString();
+		if (path.isEmpty() || !m_pGraphicsWindow->compareWith(path)) {
+			Fail(QString("Could not compare with %1").arg(path));
+		}
+	}
+	else if (name == "simplify") {
+		SimplifyOptions options;
+		options.m_targetTriangles = qint64(command.value("triangles").toDouble(0.0));
+		options.m_targetError = float(command.value("error").toDouble(0.0));
+		if (!options.IsActive()) {
+			m_pGraphicsWindow->endSimplification();
+			Finish();
+			return;
+		}
+		m_waitConnection = connect(m_pGraphicsWindow, &ViewerGraphicsWindow::SimplificationFinished, this, [=](qint64 triangles, qint64 originalTriangles, float error) {
+			QJsonObject result;
+			result.insert("triangles", double(triangles));
+			result.insert("originalTriangles", double(originalTriangles));
+			result.insert("error", double(error));
+			Finish(result);
+		});
+		m_timeout.start(TimerMs(command.value("timeout").toDouble(k_defaultLoadTimeout)));
+		if (!m_pGraphicsWindow->previewSimplification(options)) {
+			Fail("Could not simplify the model shown");
+		}
+	}
+	else if (name == "section") {
+		std::vector<QVector4D> planes;
+		for (const QJsonValue& value : command.value("planes").toArray()) {
+			planes.push_back(ReadVector(value));
+		}
+		m_pGraphicsWindow->setSectionPlanes(planes, command.value("caps").toBool(true));
+		Finish();
+	}
+	else if (name == "quit") {
+		Finish();
+		QCoreApplication::exit(m_failed ? 1 : 0);
+	}
+	else {
+		Fail(QString("Unknown command \"%1\"").arg(name));
+	}
+}
+
+void ScriptRunner::Finish(QJsonObject result)
+{
+	if (!m_running) {
+		return;
+	}
+	m_running = false;
+	m_timeout.stop();
+	disconnect(m_waitConnection);
+
+	const QJsonObject& command = m_current.m_command;
+	result.insert("command", command.value("command"));
+	if (command.contains("label")) {
+		result.insert("label", command.value("label"));
+	}
+	if (!result.contains("ok")) {
+		result.insert("ok", true);
+	}
+	result.insert("seconds", double(m_commandTimer.nsecsElapsed()) * 1e-9);
+	Write(result, m_current.m_pClient);
+	emit CommandFinished(result);
+
+	QTimer::singleShot(0, this, [=] { RunNext(); });
+}
+
+void ScriptRunner::Fail(const QString& error)
+{
+	m_failed = true;
+	qWarning("%s", qPrintable(error));
+	QJsonObject result;
+	result.insert("ok", false);
+	result.insert("error", error);
+	Finish(result);
+}
+
+void ScriptRunner::TimedOut()
+{
+	const QString name = m_current.m_command.value("command").toString();
+	if (name == "wait") {
+		Finish();
+		return;
+	}
+	if (name == "load") {
+		m_pGraphicsWindow->cancelModelLoading();
+	}
+	Fail(QString("The %1 command timed out").arg(name));
+}
+
+void ScriptRunner::RunLoad(const QJsonObject& command)
+{
+	const QString path = command.value("path").toString();
+	m_waitConnection = connect(m_pGraphicsWindow, &ViewerGraphicsWindow::EndModelLoading, this, [=](bool success, QString filepath) {
+		if (!success) {
+			Fail(QString("Could not load %1").arg(filepath));
+			return;
+		}
+		QJsonObject result = Metrics();
+		result.insert("path", filepath);
+
+		// Milliseconds spent in each stage of the load
+		const ImportTrace& trace = m_pGraphicsWindow->GetImportTrace();
+		QJsonObject stages;
+		for (const std::pair<const char*, qint64>& stage : trace.StageTotals()) {
+			stages.insert(stage.first, double(stage.second) * 1e-6);
+		}
+		result.insert("load_ms", double(trace.DurationNs()) * 1e-6);
+		result.insert("stages", stages);
+		Finish(result);
+	});
+
+	// A model from the cache can be done before loading returns
+	m_timeout.start(TimerMs(command.value("timeout").toDouble(k_defaultLoadTimeout)));
+	const bool started = command.value("add").toBool() ? m_pGraphicsWindow->addModel(path) : m_pGraphicsWindow->loadModel(path);
+	if (!started && m_running) {
+		Fail(QString("Could not start loading %1").arg(path));
+	}
+}
+
+void ScriptRunner::RunCamera(const QJsonObject& command)
+{
+	if (command.value("reset").toBool()) {
+		m_pGraphicsWindow->resetView();
+	}
+
+	// Values left out stay as they are
+	QJsonObject key = command;
+	key.insert("time", 0);
+	CameraPath pose;
+	CameraPath::FromJson(QJsonArray{ key }, m_pGraphicsWindow->GetCameraPose(), pose);
+	m_pGraphicsWindow->SetCameraPose(pose.Sample(0.f));
+	Finish();
+}
+
+void ScriptRunner::RunUniform(const QJsonObject& command)
+{
+	const QString name = command.value("name").toString();
+	const QVector4D value = ReadVector(command.value("value"));
+	const QVector3D ads = m_pGraphicsWindow->getADS();
+	if (name == "uLightPos") {
+		m_pGraphicsWindow->setLightLocation(value.x(), value.y(), value.z());
+	}
+	else if (name == "uKa") {
+		m_pGraphicsWindow->setADS(value.x(), ads.y(), ads.z());
+	}
+	else if (name == "uKd") {
+		m_pGraphicsWindow->setADS(ads.x(), value.x(), ads.z());
+	}
+	else if (name == "uKs") {
+		m_pGraphicsWindow->setADS(ads.x(), ads.y(), value.x());
+	}
+	else if (name == "uSpecularColor") {
+		m_pGraphicsWindow->setSpecularColor(value.x(), value.y(), value.z());
+	}
+	else if (name == "uShininess") {
+		m_pGraphicsWindow->setShininess(value.x());
+	}
+	else if (name == "color") {
+		m_pGraphicsWindow->setADColor(value.x(), value.y(), value.z());
+	}
+	else if (!name.isEmpty()) {
+		// The shaders loaded later may have it, so it is set even if these don't
+		m_pGraphicsWindow->setUserUniform(name.toUtf8(), value);
+	}
+	else {
+		Fail("The uniform command has no name");
+		return;
+	}
+	Finish();
+}
+
+void ScriptRunner::RunSetting(const QJsonObject& command)
+{
+	// Stored where the settings menu stores it, so it stays set for the next start as well
+	const QString key = command.value("key").toString();
+	if (key.isEmpty()) {
+		Fail("The setting command has no key");
+		return;
+	}
+	AppSettings* settings = AppSettings::Shared();
+	settings->setValue(key, command.value("value").toVariant());
+	settings->sync();
+	m_pGraphicsWindow->loadSettings();
+	Finish();
+}
+
+void ScriptRunner::RunPath(const QJsonObject& command)
+{
+	QString error;
+	if (!CameraPath::FromJson(command.value("keys").toArray(), m_pGraphicsWindow->GetCameraPose(), m_path, &error)) {
+		Fail(error);
+		return;
+	}
+	if (m_path.IsEmpty()) {
+		Fail("The camera path has no keys");
+		return;
+	}
+	if (!m_pGraphicsWindow->isVisible()) {
+		Fail("Camera paths are only played in a window that is shown");
+		return;
+	}
+
+	// Only the frames of the path count
+	m_pGraphicsWindow->ClearFrameStats();
+	m_pathIntervals.clear();
+	m_pathIntervals.reserve(size_t(m_path.Duration() * 240.f) + 1);
+	m_commandTimer.start();
+	m_lastFrameNs = 0;
+	m_waitConnection = connect(m_pGraphicsWindow, &QOpenGLWidget::frameSwapped, this, [=] { AdvancePath(); });
+	m_pGraphicsWindow->SetCameraPose(m_path.Sample(0.f));
+}
+
+void ScriptRunner::AdvancePath()
+{
+	const qint64 now = m_commandTimer.nsecsElapsed();
+	m_pathIntervals.push_back(float(double(now - m_lastFrameNs) * 1e-9));
+	m_lastFrameNs = now;
+
+	const float time = float(double(now) * 1e-9);
+	if (time < m_path.Duration()) {
+		m_pGraphicsWindow->SetCameraPose(m_path.Sample(time));
+		return;
+	}
+
+	QJsonObject result = Metrics();
+	result.insert("frameCount", int(m_pathIntervals.size()));
+	result.insert("intervals", TimeMetrics(m_pathIntervals));
+	Finish(result);
+}
+
+void ScriptRunner::RunPlayback(const QJsonObject& command)
+{
+	CameraPath path;
+	QString error;
+	const bool loaded = command.contains("keys") ? CameraPath::FromJson(command.value("keys").toArray(), m_pGraphicsWindow->GetCameraPose(), path, &error)
+		: path.Load(command.value("path").toString(), &error);
+	if (!loaded) {
+		Fail(error);
+		return;
+	}
+	const float step = float(command.value("step").toDouble(1.0 / 60.0));
+	if (path.FrameCount(step) == 0) {
+		Fail("The camera path has no frames to play");
+		return;
+	}
+	if (!m_pGraphicsWindow->isVisible()) {
+		Fail("Camera paths are only played in a window that is shown");
+		return;
+	}
+
+	const QString timingsPath = command.value("timings").toString();
+	m_waitConnection = connect(m_pGraphicsWindow, &ViewerGraphicsWindow::CameraPlaybackFinished, this, [=] {
+		const std::vector<PlaybackFrame>& frames = m_pGraphicsWindow->GetPlaybackFrames();
+		if (!timingsPath.isEmpty() && !CameraPath::SaveTimings(timingsPath, frames)) {
+			Fail(QString("Could not write %1").arg(timingsPath));
+			return;
+		}
+		std::vector<float> cpu;
+		std::vector<float> gpu;
+		for (const PlaybackFrame& frame : frames) {
+			cpu.push_back(frame.m_cpuSeconds);
+			if (frame.m_gpuSeconds >= 0.f) {
+				gpu.push_back(frame.m_gpuSeconds);
+			}
+		}
+		QJsonObject result = Metrics();
+		result.insert("frameCount", int(frames.size()));
+		result.insert("cpu", TimeMetrics(cpu));
+		result.insert("gpu", TimeMetrics(gpu));
+		Finish(result);
+	});
+	m_pGraphicsWindow->PlayCameraPath(path, step);
+}
+
+void ScriptRunner::RunVideo(const QJsonObject& command)
+{
+	CameraPath path;
+	QString error;
+	const CameraPose start = m_pGraphicsWindow->GetCameraPose();
+	if (command.contains("keys")) {
+		if (!CameraPath::FromJson(command.value("keys").toArray(), start, path, &error)) {
+			Fail(error);
+			return;
+		}
+	}
+	else if (command.contains("camera_path")) {
+		if (!path.Load(command.value("camera_path").toString(), &error)) {
+			Fail(error);
+			return;
+		}
+	}
+	else {
+		path = CameraPath::Turntable(start, float(command.value("seconds").toDouble(8.0)));
+	}
+
+	// The video is done once the encoder has written it, well after its last frame was drawn
+	m_waitConnection = connect(m_pGraphicsWindow, &ViewerGraphicsWindow::VideoExported, this, [=](bool success, QString filepath) {
+		if (!success) {
+			Fail(QString("Could not write %1").arg(filepath));
+			return;
+		}
+		QJsonObject result;
+		result.insert("path", filepath);
+		result.insert("frameCount", int(m_pGraphicsWindow->GetPlaybackFrames().size()));
+		Finish(result);
+	});
+	m_timeout.start(TimerMs(command.value("timeout").toDouble(k_defaultLoadTimeout)));
+	const QString output = command.value("path").toString();
+	if (!m_pGraphicsWindow->exportVideo(output, path, command.value("fps").toInt(30))) {
+		Fail(QString("Could not start writing %1").arg(output));
+	}
+}
+
+void ScriptRunner::ReadClient(QIODevice* pClient)
+{
+	while (pClient->canReadLine()) {
+		const QByteArray line = pClient->readLine().trimmed();
+		if (line.isEmpty()) {
+			continue;
+		}
+		QJsonParseError parseError;
+		const QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+		if (!document.isObject()) {
+			QJsonObject result;
+			result.insert("ok", false);
+			result.insert("error", QString("Not a JSON object: %1").arg(parseError.errorString()));
+			Write(result, pClient);
+			continue;
+		}
+		m_queue.push_back({ document.object(), pClient });
+	}
+	if (m_started && !m_running) {
+		RunNext();
+	}
+}
+
+void ScriptRunner::Write(const QJsonObject& result, QIODevice* pClient)
+{
+	const QByteArray line = QJsonDocument(result).toJson(QJsonDocument::Compact) + '\n';
+	if (m_metricsFile.isOpen()) {
+		m_metricsFile.write(line);
+		m_metricsFile.flush();
+	}
+	else {
+		fputs(line.constData(), stdout);
+		fflush(stdout);
+	}
+	if (pClient && pClient->isOpen()) {
+		// Sent right away, a quit command ends the event loop that would send it
+		pClient->write(line);
+		if (QLocalSocket* pLocal = qobject_cast<QLocalSocket*>(pClient)) {
+			pLocal->flush();
+		}
+		else if (QAbstractSocket* pSocket = qobject_cast<QAbstractSocket*>(pClient)) {
+			pSocket->flush();
+		}
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include "CameraPath.h"
+#include "FrameStats.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonObject>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QTimer>
+
+#include <deque>
+#include <vector>
+
+class ViewerGraphicsWindow;
+class QIODevice;
+class QLocalServer;
+
+// Runs commands against the viewer for performance tests that have to take the same steps
+// every time. Commands are JSON objects with a "command" name, read from a script file or
+// received over a local socket or from the client of a RemoteViewServer, one object per
+// line. They run one after the other, a command that loads a model or plays a camera path
+// finishes once it is done. Each command answers with an object of its results, written to
+// the metrics output as one line of JSON and sent back to the socket it came from.
+//
+//   {"command": "load", "path": "model.fbx", "add": false, "timeout": 120}
+//   {"command": "camera", "reset": true, "rotX": 45, "rotY": 30, "scale": 1, "translation": [0, 0, -4]}
+//   {"command": "uniform", "name": "uKd", "value": 0.8}, vectors as arrays, "color" for the model color
+//   {"command": "setting", "key": "ViewerGraphicsWindow/alwaysRedraw", "value": true}
+//   {"command": "path", "label": "orbit", "keys": [{"time": 0, "rotX": 0}, {"time": 5, "rotX": 360}]}
+//   {"command": "playback", "path": "camera_path.json", "step": 0.0166, "timings": "frames.csv"}
+//   {"command": "wait", "seconds": 1}
+//   {"command": "metrics", "label": "after load"}
+//   {"command": "screenshot", "path": "frame.png"}
+//   {"command": "poster", "path": "poster.png", "width": 16384, "height": 0, "timeout": 120}
+//   {"command": "video", "path": "turntable.mp4", "seconds": 8, "fps": 30, "timeout": 600}
+//   {"command": "compare", "path": "model_lod1.obj", "mode": 2, "timeout": 120}
+//   {"command": "simplify", "triangles": 50000, "error": 0.01, "timeout": 120}
+//   {"command": "section", "planes": [[-1, 0, 0, 0.5]], "caps": true}
+//   {"command": "quit"}
+//
+// A load answers with the time of each of its stages in milliseconds. A path plays over the
+// time that passes and measures the frame rate. Playback draws a frame
+// per fixed step of a recorded path, or of "keys" given like those of a path, and measures
+// what each frame took. A poster finishes once it is written, a height of 0 keeps the aspect
+// of the window. A video turns once around the model over "seconds", or follows a camera path
+// from "camera_path" or "keys", and finishes once it is encoded. A comparison measures the
+// model loaded against the one at "path", shows both in a CompareMode and answers with
+// the Hausdorff and mean distances. Simplify previews the model loaded with that many
+// "triangles" or that largest "error" as a share of each mesh's size, answers with the
+// triangles kept, and ends the preview without either. A section cuts the model open with
+// planes of a, b, c, d in model space, keeping where a.x + b.y + c.z + d >= 0, and shows the
+// whole model again without any.
+class ScriptRunner : public QObject
+{
+	Q_OBJECT
+public:
+	ScriptRunner(ViewerGraphicsWindow* pGraphicsWindow, QObject* parent = nullptr);
+
+	// A JSON array of commands, or an object with them in "commands". They run after the
+	// commands already queued.
+	bool LoadScript(const QString& filepath, QString* pError = nullptr);
+	// The result is sent back to pClient as well, if it is still open by then
+	void AddCommand(const QJsonObject& command, QIODevice* pClient = nullptr);
+
+	// Takes commands from clients of a local socket of the given name as well
+	bool Listen(const QString& name);
+
+	// Results are written to stdout unless a file is given
+	bool SetMetricsFile(const QString& filepath);
+
+	// Quits the application once the commands ran out, with exit code 1 if one of them failed.
+	// While listening on a socket only the quit command does.
+	void SetQuitWhenDone(bool quit);
+
+	// Runs the queued commands once the event loop runs
+	void Start();
+	bool IsRunning() const;
+	bool HasFailed() const;
+
+	// Frame times, memory and scene counts of the window as they are now
+	QJsonObject Metrics() const;
+	static QJsonObject FrameMetrics(const FrameStats::Summary& summary);
+
+signals:
+	void CommandFinished(QJsonObject result);
+
+	// No commands are left to run
+	void Finished(bool success);
+
+private:
+	struct Pending {
+		QJsonObject m_command;
+		// The client the command came from, if it still is connected
+		QPointer<QIODevice> m_pClient;
+	};
+
+	void RunNext();
+	void Run(const QJsonObject& command);
+	void Finish(QJsonObject result = QJsonObject());
+	void Fail(const QString& error);
+	void TimedOut();
+
+	void RunLoad(const QJsonObject& command);
+	void RunCamera(const QJsonObject& command);
+	void RunUniform(const QJsonObject& command);
+	void RunSetting(const QJsonObject& command);
+	void RunPath(const QJsonObject& command);
+	void AdvancePath();
+	void RunPlayback(const QJsonObject& command);
+	void RunVideo(const QJsonObject& command);
+
+	void ReadClient(QIODevice* pClient);
+	void Write(const QJsonObject& result, QIODevice* pClient);
+
+	ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
+	std::deque<Pending> m_queue;
+	Pending m_current;
+	bool m_running = false;
+	bool m_started = false;
+	bool m_failed = false;
+	bool m_quitWhenDone = false;
+
+	// Timing of the command running, and its timeout if it waits for the window
+	QElapsedTimer m_commandTimer;
+	QTimer m_timeout;
+	QMetaObject::Connection m_waitConnection;
+
+	// The path playing, advanced once per frame the window shows, with the time between frames
+	CameraPath m_path;
+	std::vector<float> m_pathIntervals;
+	qint64 m_lastFrameNs = 0;
+
+	QLocalServer* m_pServer = nullptr;
+	QFile m_metricsFile;
+};
@@ -0,0 +1,221 @@
+#include "SectionCaps.h"
+#include "Frustum.h"
+#include "StateCache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace {
+
+// The cap's own plane is replaced by one that keeps everything
+const char* k_capVertexShaderSource =
+	"#version 330\n"
+	"in vec3 posAttr;\n"
+	"uniform mat4 uModelView;\n"
+	"uniform mat4 uProjection;\n"
+	"uniform vec4 uPlanes[6];\n"
+	"out float gl_ClipDistance[6];\n"
+	"void main() {\n"
+	"   vec4 position = vec4(posAttr, 1.0);\n"
+	"   for (int i = 0; i < 6; ++i) {\n"
+	"      gl_ClipDistance[i] = dot(uPlanes[i], position);\n"
+	"   }\n"
+	"   gl_Position = uProjection * (uModelView * position);\n"
+	"}\n";
+
+const char* k_capFragmentShaderSource =
+	"#version 330\n"
+	"uniform vec4 uColor;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"   fragColor = uColor;\n"
+	"}\n";
+
+const GLuint k_posAttr = 0;
+
+// How much the box the cap is cut from is grown on every side, as a fraction of its diagonal,
+// so surfaces lying on the box are still covered
+const float k_boxMargin = 0.01f;
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+}
+
+SectionCaps::~SectionCaps()
+{
+	// The buffer goes with the context, only the program is left
+	delete m_pProgram;
+}
+
+bool SectionCaps::Create()
+{
+	Destroy();
+
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+
+	m_pProgram = new QOpenGLShaderProgram();
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, k_capVertexShaderSource);
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, k_capFragmentShaderSource);
+	m_pProgram->bindAttributeLocation("posAttr", k_posAttr);
+	if (!m_pProgram->link()) {
+		qWarning("Could not link the section cap shader: %s", qPrintable(m_pProgram->log()));
+		Destroy();
+		return false;
+	}
+	m_modelViewUniform = m_pProgram->uniformLocation("uModelView");
+	m_projectionUniform = m_pProgram->uniformLocation("uProjection");
+	m_planesUniform = m_pProgram->uniformLocation("uPlanes");
+	m_colorUniform = m_pProgram->uniformLocation("uColor");
+
+	m_corners = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	m_corners.setUsagePattern(QOpenGLBuffer::StreamDraw);
+	m_corners.create();
+	m_corners.bind();
+	m_vao.create();
+	m_vao.bind();
+	Functions()->glVertexAttribPointer(k_posAttr, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+	Functions()->glEnableVertexAttribArray(k_posAttr);
+	m_vao.release();
+	m_corners.release();
+	return true;
+}
+
+void SectionCaps::Destroy()
+{
+	if (QOpenGLContext::currentContext()) {
+		m_vao.destroy();
+		m_corners.destroy();
+	}
+	delete m_pProgram;
+	m_pProgram = nullptr;
+}
+
+bool SectionCaps::IsCreated() const
+{
+	return m_pProgram != nullptr;
+}
+
+void SectionCaps::BeginMarking()
+{
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	f->glClearStencil(0);
+	f->glClear(GL_STENCIL_BUFFER_BIT);
+	state.Enable(GL_STENCIL_TEST);
+	f->glStencilFunc(GL_ALWAYS, 0, 0xff);
+	f->glStencilOp(GL_KEEP, GL_KEEP, GL_INVERT);
+	state.ColorMask(false);
+	state.DepthMask(false);
+	state.Disable(GL_DEPTH_TEST);
+}
+
+int SectionCaps::DrawCap(const std::vector<QVector4D>& planes, int index, const QVector3D& boxMin, const QVector3D& boxMax, const QMatrix4x4& projection, const QMatrix4x4& modelView, const QColor& color)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	state.ColorMask(true);
+	state.DepthMask(true);
+	state.Enable(GL_DEPTH_TEST);
+	f->glStencilFunc(GL_NOTEQUAL, 0, 0xff);
+	f->glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+
+	const QVector3D margin = QVector3D(1.f, 1.f, 1.f) * (boxMax - boxMin).length() * k_boxMargin;
+	const std::vector<QVector3D> corners = BoxSection(planes[index], boxMin - margin, boxMax + margin);
+	int drawCalls = 0;
+	if (IsCreated() && corners.size() >= 3) {
+		QVector4D capPlanes[Frustum::k_maxExtraPlanes];
+		for (int i = 0; i < Frustum::k_maxExtraPlanes; ++i) {
+			capPlanes[i] = i < int(planes.size()) && i != index ? planes[i] : QVector4D(0.f, 0.f, 0.f, 1.f);
+		}
+
+		// Lit by a light at the eye, so the cap darkens as it turns away like the surfaces around it
+		const QVector3D normal = (modelView.normalMatrix() * planes[index].toVector3D()).normalized();
+		const float light = 0.35f + 0.65f * std::abs(normal.z());
+		const QVector4D shaded(float(color.redF()) * light, float(color.greenF()) * light, float(color.blueF()) * light, float(color.alphaF()));
+
+		m_pProgram->bind();
+		m_pProgram->setUniformValue(m_modelViewUniform, modelView);
+		m_pProgram->setUniformValue(m_projectionUniform, projection);
+		m_pProgram->setUniformValueArray(m_planesUniform, capPlanes, Frustum::k_maxExtraPlanes);
+		m_pProgram->setUniformValue(m_colorUniform, shaded);
+		m_corners.bind();
+		m_corners.allocate(corners.data(), int(corners.size() * sizeof(QVector3D)));
+		m_corners.release();
+		m_vao.bind();
+		f->glDrawArrays(GL_TRIANGLE_FAN, 0, GLsizei(corners.size()));
+		m_vao.release();
+		m_pProgram->release();
+		++drawCalls;
+	}
+
+	f->glStencilFunc(GL_ALWAYS, 0, 0xff);
+	state.Disable(GL_STENCIL_TEST);
+	return drawCalls;
+}
+
+bool SectionCaps::Crosses(const QVector4D& plane, const QVector3D& min, const QVector3D& max)
+{
+	const QVector3D center = (min + max) * 0.5f;
+	const QVector3D extent = (max - min) * 0.5f;
+	const float distance = plane.x() * center.x() + plane.y() * center.y() + plane.z() * center.z() + plane.w();
+	const float radius = std::abs(plane.x()) * extent.x() + std::abs(plane.y()) * extent.y() + std::abs(plane.z()) * extent.z();
+	return std::abs(distance) < radius;
+}
+
+std::vector<QVector3D> SectionCaps::BoxSection(const QVector4D& plane, const QVector3D& min, const QVector3D& max)
+{
+	std::vector<QVector3D> corners;
+	const QVector3D normal = plane.toVector3D();
+	if (normal.isNull()) {
+		return corners;
+	}
+
+	// Where the plane crosses the four edges of the box along each axis
+	for (int axis = 0; axis < 3; ++axis) {
+		const int u = (axis + 1) % 3;
+		const int v = (axis + 2) % 3;
+		for (int edge = 0; edge < 4; ++edge) {
+			QVector3D a;
+			a[axis] = min[axis];
+			a[u] = edge & 1 ? max[u] : min[u];
+			a[v] = edge & 2 ? max[v] : min[v];
+			QVector3D b = a;
+			b[axis] = max[axis];
+			const float da = QVector3D::dotProduct(normal, a) + plane.w();
+			const float db = QVector3D::dotProduct(normal, b) + plane.w();
+			if ((da < 0.f) != (db < 0.f)) {
+				corners.push_back(a + (b - a) * (da / (da - db)));
+			}
+		}
+	}
+	if (corners.size() < 3) {
+		corners.clear();
+		return corners;
+	}
+
+	// The corners of a convex polygon are in order of their angle about its center
+	QVector3D center;
+	for (const QVector3D& corner : corners) {
+		center += corner;
+	}
+	center /= float(corners.size());
+	const QVector3D tangent = (std::abs(normal.x()) < 0.9f * normal.length() ? QVector3D::crossProduct(normal, QVector3D(1.f, 0.f, 0.f))
+		: QVector3D::crossProduct(normal, QVector3D(0.f, 1.f, 0.f))).normalized();
+	const QVector3D bitangent = QVector3D::crossProduct(normal.normalized(), tangent);
+	std::sort(corners.begin(), corners.end(), [&](const QVector3D& a, const QVector3D& b) {
+		return std::atan2(QVector3D::dotProduct(a - center, bitangent), QVector3D::dotProduct(a - center, tangent))
+			< std::atan2(QVector3D::dotProduct(b - center, bitangent), QVector3D::dotProduct(b - center, tangent));
+	});
+	return corners;
+}
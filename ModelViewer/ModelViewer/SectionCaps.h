@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+
+#include <QColor>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QVector3D>
+#include <QVector4D>
+
+class QOpenGLShaderProgram;
+
+// Fills the surfaces section planes cut open. A ray through a point of a plane crosses the
+// surfaces a closed mesh keeps an odd number of times where the point is inside the mesh, so
+// drawing them with every fragment inverting the stencil, without the depth test, marks where
+// the cap goes. The caller draws the meshes between BeginMarking and DrawCap with programs that
+// clip them by the planes. Meshes the plane doesn't cross add an even count and can be left out
+// of the marking. The cap is drawn over the marks as the polygon the plane cuts out of the
+// model's box, clipped by the other planes, so caps don't show where another plane cut away.
+class SectionCaps
+{
+public:
+	~SectionCaps();
+
+	// Creating and destroying the program and buffer requires a current context. Create
+	// returns false without desktop OpenGL 3.3 or if the program doesn't link.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Clears the stencil and sets up the marking, which writes nothing but the stencil. The
+	// framebuffer bound has to have one.
+	void BeginMarking();
+
+	// Draws the cap of planes[index] where it was marked, in color lit from the eye, and puts
+	// back the state BeginMarking changed. The planes are in model space, which modelView
+	// moves into eye space. The box of the model bounds the cap. Leaves no program bound and
+	// returns the draw calls made.
+	int DrawCap(const std::vector<QVector4D>& planes, int index, const QVector3D& boxMin, const QVector3D& boxMax, const QMatrix4x4& projection, const QMatrix4x4& modelView, const QColor& color);
+
+	// Whether the box has corners on both sides of plane
+	static bool Crosses(const QVector4D& plane, const QVector3D& min, const QVector3D& max);
+
+	// The polygon plane cuts out of the box, its corners in order around the plane's normal.
+	// Empty where the plane misses the box.
+	static std::vector<QVector3D> BoxSection(const QVector4D& plane, const QVector3D& min, const QVector3D& max);
+
+private:
+	QOpenGLShaderProgram* m_pProgram = nullptr;
+	GLint m_modelViewUniform = -1;
+	GLint m_projectionUniform = -1;
+	GLint m_planesUniform = -1;
+	GLint m_colorUniform = -1;
+	QOpenGLBuffer m_corners;
+	QOpenGLVertexArrayObject m_vao;
+};
@@ -3,6 +3,7 @@
 #include "ModelViewer.h"
 #include "KeyBindEdit.h"
 #include "KeySequenceParse.h"
+#include "Primitives.h"
 
 #include <math.h>
 #include <QGridLayout>
@@ -27,36 +28,43 @@ SettingsMenu::SettingsMenu(ViewerGraphicsWindow* gWindow, QWidget* parent)
 	m_pMainLayout = new QGridLayout(this);
 
 	// Set up the settings
-	settings = new QSettings("The Model Viewers team", "Model Viewer");	
+	settings = AppSettings::Shared();
 
 	// Set up all of the widgets
 	m_pSettingsList = new QListWidget(this);
 	new QListWidgetItem(m_MouseTitle, m_pSettingsList, SettingsMenu::SETTINGSWIDGET::mouse);
 	new QListWidgetItem(m_KebindTitle, m_pSettingsList, SettingsMenu::SETTINGSWIDGET::keybind);
 	new QListWidgetItem(m_ViewTitle, m_pSettingsList, SettingsMenu::SETTINGSWIDGET::view);
+	new QListWidgetItem(m_ImportTitle, m_pSettingsList, SettingsMenu::SETTINGSWIDGET::modelImport);
 	m_pSettingsList->setMaximumWidth(100);
 
 	// Set up the indvidual setting menus
 	SetupMouseSettings();
 	SetupKeybindSettings();
 	SetupViewSettings();
+	SetupImportSettings();
 
 	m_pCurrentSettingsWidget = m_pMouseSettings;
 	m_pMainLayout->addWidget(m_pSettingsList, 0, 0, 5, 1);
 	m_pMainLayout->addWidget(m_pCurrentSettingsWidget, 0, 1, 5, 3);
 
 	connect(m_pSettingsList, &QListWidget::currentItemChanged, this, &SettingsMenu::ChangeWindow);
+
+	// The graphics window keeps a copy of the settings it uses while drawing, and only
+	// redraws when something changed
+	connect(this, &SettingsMenu::SettingsChanged, m_pGraphicsWindow, &ViewerGraphicsWindow::loadSettings);
 	this->setStyleSheet("background-color: rgb(28,30,37); color: rgb(186,186,186); border-color: blue; selection-color: rgb(100,100,100);");
 	m_pMouseSettings->setStyleSheet("QLineEdit {border-radius: 4px; border: 1px solid rgb(100,100,100)} QPushButton { border-style: outset; border-width: 1px; border-radius: 4px; border-color: rgb(100,100,100); padding: 3px;} QPushButton:pressed {background-color: rgb(128,130,137); border-style: inset;}");
 	m_pKeybindSettings->setStyleSheet("QLineEdit {border-radius: 4px; border: 1px solid rgb(100,100,100)} QPushButton { border-style: outset; border-width: 1px; border-radius: 4px; border-color: rgb(100,100,100); padding: 3px;} QPushButton:pressed {background-color: rgb(128,130,137); border-style: inset;}");
 	m_pViewSettings->setStyleSheet("QPushButton { border-style: outset; border-width: 1px; border-radius: 4px; border-color: rgb(100,100,100); padding: 3px;} QPushButton:pressed {background-color: rgb(128,130,137); border-style: inset;} QComboBox {border-style: inset; border-radius: 4px; border-width: 1px; border-color: rgb(100,100,100);}");
+	m_pImportSettings->setStyleSheet("QPushButton { border-style: outset; border-width: 1px; border-radius: 4px; border-color: rgb(100,100,100); padding: 3px;} QPushButton:pressed {background-color: rgb(128,130,137); border-style: inset;} QComboBox {border-style: inset; border-radius: 4px; border-width: 1px; border-color: rgb(100,100,100);}");
 
 
 	// Make sure that this window closes on main window close. Why set it to faslse? Only the QT gods know.
 	this->setAttribute(Qt::WA_QuitOnClose, false);
 }
 
-QSettings* SettingsMenu::getSettings()
+AppSettings* SettingsMenu::getSettings()
 {
 	return settings;
 }
@@ -87,6 +95,9 @@ void SettingsMenu::ChangeWindow(QListWidgetItem* current, QListWidgetItem* previ
 		case int(SettingsMenu::SETTINGSWIDGET::view):
 			swapCurrentWidget(m_pViewSettings);
 			break;
+		case int(SettingsMenu::SETTINGSWIDGET::modelImport):
+			swapCurrentWidget(m_pImportSettings);
+			break;
 	}
 }
 
@@ -117,6 +128,11 @@ void SettingsMenu::SetupMouseSettings()
 	nearPlane->setObjectName("nearPlane");
 	QLineEdit* farPlane = new QLineEdit(QString::number(m_pGraphicsWindow->farPlane));
 	farPlane->setObjectName("farPlane");
+	QPushButton* toggleAutoClipPlanes = new QPushButton(m_pGraphicsWindow->autoClipPlanes ? "On" : "Off");
+	toggleAutoClipPlanes->setObjectName("toggleAutoClipPlanes");
+	toggleAutoClipPlanes->setToolTip("Fit the near and far plane to the model and the grid in every frame, so models of any size and distance keep their depth precision. The planes below are then not used");
+	nearPlane->setEnabled(!m_pGraphicsWindow->autoClipPlanes);
+	farPlane->setEnabled(!m_pGraphicsWindow->autoClipPlanes);
 	QPushButton* reset = new QPushButton(QString::fromLatin1("Reset All"));
 	reset->setObjectName("resetMouseSettings");
 
@@ -138,6 +154,7 @@ void SettingsMenu::SetupMouseSettings()
 	layout->addRow(tr("Movement Sensitivity"), movementSensitivity);
 	layout->addRow(tr("Zoom Sensitivty"), zoomSensitivity);
 	layout->addRow(tr("Field of View"), fieldOfView);
+	layout->addRow(tr("Fit Clip Planes"), toggleAutoClipPlanes);
 	layout->addRow(tr("Near Plane"), nearPlane);
 	layout->addRow(tr("Far Plane"), farPlane);
 	layout->addRow(QString(), reset);
@@ -171,6 +188,13 @@ void SettingsMenu::SetupMouseSettings()
 		settings->setValue("ViewerGraphicsWindow/fieldOfView", fieldOfView->text().toFloat());
 		m_pGraphicsWindow->loadSettings();
 	});
+	connect(toggleAutoClipPlanes, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/autoClipPlanes", !m_pGraphicsWindow->autoClipPlanes);
+		m_pGraphicsWindow->loadSettings();
+		toggleAutoClipPlanes->setText(m_pGraphicsWindow->autoClipPlanes ? "On" : "Off");
+		nearPlane->setEnabled(!m_pGraphicsWindow->autoClipPlanes);
+		farPlane->setEnabled(!m_pGraphicsWindow->autoClipPlanes);
+	});
 	connect(nearPlane, &QLineEdit::editingFinished, this, [=] {
 		settings->setValue("ViewerGraphicsWindow/nearPlane", nearPlane->text().toFloat());
 		m_pGraphicsWindow->loadSettings();
@@ -190,6 +214,7 @@ void SettingsMenu::SetupMouseSettings()
 		settings->remove("ViewerGraphicsWindow/fieldOfView");
 		settings->remove("ViewerGraphicsWindow/nearPlane");
 		settings->remove("ViewerGraphicsWindow/farPlane");
+		settings->remove("ViewerGraphicsWindow/autoClipPlanes");
 
 		// Reset the defalut values
 		m_pGraphicsWindow->loadSettings();
@@ -203,6 +228,9 @@ void SettingsMenu::SetupMouseSettings()
 		fieldOfView->setText(QString::number(m_pGraphicsWindow->fieldOfView));
 		nearPlane->setText(QString::number(m_pGraphicsWindow->nearPlane));
 		farPlane->setText(QString::number(m_pGraphicsWindow->farPlane));
+		toggleAutoClipPlanes->setText(m_pGraphicsWindow->autoClipPlanes ? "On" : "Off");
+		nearPlane->setEnabled(!m_pGraphicsWindow->autoClipPlanes);
+		farPlane->setEnabled(!m_pGraphicsWindow->autoClipPlanes);
 	});
 }
 
@@ -255,39 +283,51 @@ void SettingsMenu::SetupKeybindSettings()
 
 	connect(increaseSpeed, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/increase_speed", increaseSpeed->getSequence());
+		emit SettingsChanged();
 	});
 	connect(decreaseSpeed, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/decrease_speed", decreaseSpeed->getSequence());
+		emit SettingsChanged();
 	});
 	connect(elevateForwards, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/elevate_forwards", elevateForwards->getSequence());
+		emit SettingsChanged();
 	});
 	connect(elevateBackwards, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/elevate_backwards", elevateBackwards->getSequence());
+		emit SettingsChanged();
 	});
 	connect(strafeLeft, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/strafe_left", strafeLeft->getSequence());
+		emit SettingsChanged();
 	});
 	connect(strafeRight, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/strafe_right", strafeRight->getSequence());
+		emit SettingsChanged();
 	});
 	connect(scaleUp, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/scale_up", scaleUp->getSequence());
+		emit SettingsChanged();
 	});
 	connect(scaleDown, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/scale_down", scaleDown->getSequence());
+		emit SettingsChanged();
 	});
 	connect(pitchUp, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/pitch_up", pitchUp->getSequence());
+		emit SettingsChanged();
 	});
 	connect(pitchDown, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/pitch_down", pitchDown->getSequence());
+		emit SettingsChanged();
 	});
 	connect(spinRight, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/spin_right", spinRight->getSequence());
+		emit SettingsChanged();
 	});
 	connect(spinLeft, &KeyBindEdit::editingFinished, this, [=]() {
 		settings->setValue("ViewerGraphicsWindow/spin_left", spinLeft->getSequence());
+		emit SettingsChanged();
 	});
 	connect(reset, &QPushButton::released, this, [=] {
 		// Remove the saved values
@@ -317,6 +357,7 @@ void SettingsMenu::SetupKeybindSettings()
 		pitchDown->reset();
 		spinRight->reset();
 		spinLeft->reset();
+		emit SettingsChanged();
 	});
 
 	m_pKeybindSettings->hide();// As it's not the defalut
@@ -336,37 +377,489 @@ void SettingsMenu::SetupViewSettings()
 	msaa->insertItem(2, "4x MSAA",4);
 	msaa->insertItem(3, "8x MSAA",8);
 	msaa->insertItem(4, "16x MSAA",16);
-	msaa->setCurrentIndex(int(sqrt(settings->value("ViewerGraphicsWindow/msaaLevel", 0).toInt())));
-	msaa->setToolTip("Higher for better quality, lower for better preformance");
+	msaa->insertItem(5, "FXAA", -1);
+	msaa->setCurrentIndex(qMax(0, msaa->findData(settings->value("ViewerGraphicsWindow/msaaLevel", 8).toInt())));
+	msaa->setToolTip("Higher for better quality, lower for better preformance. FXAA smooths edges after drawing, for about the cost of 2x MSAA without its memory");
 	QPushButton* toggleGrid = new QPushButton((settings->value("ViewerGraphicsWindow/toggleGrid", true).toBool()) ? "On" : "Off");
 	toggleGrid->setObjectName("toggleGrid");
 	QPushButton* toggleAxis = new QPushButton((settings->value("ViewerGraphicsWindow/toggleAxis", true).toBool()) ? "On" : "Off");
 	toggleAxis->setObjectName("toggleAxis");
 	QPushButton* toggleStats = new QPushButton((settings->value("ViewerGraphicsWindow/toggleStats", true).toBool()) ? "On" : "Off");
 	toggleStats->setObjectName("toggleStats");
+	QPushButton* toggleInterleaved = new QPushButton((settings->value("ViewerGraphicsWindow/interleavedVertices", true).toBool()) ? "On" : "Off");
+	toggleInterleaved->setObjectName("toggleInterleaved");
+	toggleInterleaved->setToolTip("Store vertex attributes together, applies to the next model loaded");
+	QPushButton* toggleQuantize = new QPushButton((settings->value("ViewerGraphicsWindow/quantizeVertices", false).toBool()) ? "On" : "Off");
+	toggleQuantize->setObjectName("toggleQuantize");
+	toggleQuantize->setToolTip("Store normals, texture coordinates and colors in fewer bits to save memory, applies to the next model loaded");
+	QPushButton* toggleQuantizePositions = new QPushButton((settings->value("ViewerGraphicsWindow/quantizePositions", false).toBool()) ? "On" : "Off");
+	toggleQuantizePositions->setObjectName("toggleQuantizePositions");
+	toggleQuantizePositions->setToolTip("Also store positions in 16 bits, may lose precision on large meshes");
+	QPushButton* toggleBatching = new QPushButton((settings->value("ViewerGraphicsWindow/batchStaticGeometry", false).toBool()) ? "On" : "Off");
+	toggleBatching->setObjectName("toggleBatching");
+	toggleBatching->setToolTip("Merge meshes that share a material to draw them together. Individual meshes can no longer be told apart. Applies to the next model loaded");
+	QPushButton* toggleVertexCache = new QPushButton((settings->value("ViewerGraphicsWindow/optimizeVertexCache", true).toBool()) ? "On" : "Off");
+	toggleVertexCache->setObjectName("toggleVertexCache");
+	toggleVertexCache->setToolTip("Reorder triangles so the GPU transforms fewer vertices more than once, and vertices so they are read in order. Applies to the next model loaded");
+	QPushButton* toggleOverdrawOrder = new QPushButton((settings->value("ViewerGraphicsWindow/optimizeOverdraw", false).toBool()) ? "On" : "Off");
+	toggleOverdrawOrder->setObjectName("toggleOverdrawOrder");
+	toggleOverdrawOrder->setToolTip("Also draw the outward facing parts of each mesh first, so fewer hidden surfaces are shaded. Needs Vertex Cache Order. Applies to the next model loaded");
+	QPushButton* toggleLevelOfDetail = new QPushButton((settings->value("ViewerGraphicsWindow/levelOfDetail", true).toBool()) ? "On" : "Off");
+	toggleLevelOfDetail->setObjectName("toggleLevelOfDetail");
+	toggleLevelOfDetail->setToolTip("Draw meshes that cover few pixels with fewer triangles. Simplified meshes are made for the next model loaded");
+	QPushButton* toggleOcclusionCulling = new QPushButton((settings->value("ViewerGraphicsWindow/occlusionCulling", false).toBool()) ? "On" : "Off");
+	toggleOcclusionCulling->setObjectName("toggleOcclusionCulling");
+	toggleOcclusionCulling->setToolTip("Skip meshes hidden behind others. Meshes coming into view may appear a frame late");
+	QPushButton* toggleMultiDraw = new QPushButton((settings->value("ViewerGraphicsWindow/multiDrawIndirect", false).toBool()) ? "On" : "Off");
+	toggleMultiDraw->setObjectName("toggleMultiDraw");
+	toggleMultiDraw->setToolTip("Draw the whole model with a few indirect draws on OpenGL 4.3. Keeps a second copy of the model on the GPU, and only applies with the default shaders and without occlusion culling");
+	QPushButton* toggleGpuCulling = new QPushButton((settings->value("ViewerGraphicsWindow/gpuCulling", true).toBool()) ? "On" : "Off");
+	toggleGpuCulling->setObjectName("toggleGpuCulling");
+	toggleGpuCulling->setToolTip("Let a compute shader cull and pick the level of detail of the meshes drawn with Multi-Draw Indirect. The stats then no longer count visible meshes and drawn triangles");
+	QPushButton* toggleModelCache = new QPushButton((settings->value("ViewerGraphicsWindow/modelCache", true).toBool()) ? "On" : "Off");
+	toggleModelCache->setObjectName("toggleModelCache");
+	toggleModelCache->setToolTip("Keep decoded models on disk so reopening them skips the import. Applies to the next model loaded");
+	QPushButton* toggleCompressCache = new QPushButton((settings->value("ViewerGraphicsWindow/compressModelCache", true).toBool()) ? "On" : "Off");
+	toggleCompressCache->setObjectName("toggleCompressCache");
+	toggleCompressCache->setToolTip("Store the vertices and indices of cached models compressed, which about halves the cache on disk but decodes them on load instead of mapping them. Applies to models cached from now on");
+	QPushButton* toggleLowMemory = new QPushButton((settings->value("ViewerGraphicsWindow/lowMemory", false).toBool()) ? "On" : "Off");
+	toggleLowMemory->setObjectName("toggleLowMemory");
+	toggleLowMemory->setToolTip("Free the imported scene once the model is decoded instead of keeping it for instant export. Exporting imports the file again. Applies to the next model loaded");
+	QComboBox* streamingBudget = new QComboBox();
+	streamingBudget->setObjectName("streamingBudget");
+	streamingBudget->insertItem(0, "Off", 0);
+	streamingBudget->insertItem(1, "256 MB", 256);
+	streamingBudget->insertItem(2, "512 MB", 512);
+	streamingBudget->insertItem(3, "1 GB", 1024);
+	streamingBudget->insertItem(4, "2 GB", 2048);
+	streamingBudget->insertItem(5, "4 GB", 4096);
+	streamingBudget->insertItem(6, "8 GB", 8192);
+	streamingBudget->setCurrentIndex(qMax(0, streamingBudget->findData(settings->value("ViewerGraphicsWindow/streamingBudget", 0).toInt())));
+	streamingBudget->setToolTip("GPU memory the geometry of a model may take. Larger models are split into clusters and only the ones in view are kept on the GPU, which works best with the model cache. Applies to the next model loaded, the budget of a streamed model changes right away");
+	QPushButton* toggleLazyUpload = new QPushButton((settings->value("ViewerGraphicsWindow/lazyUpload", false).toBool()) ? "On" : "Off");
+	toggleLazyUpload->setObjectName("toggleLazyUpload");
+	toggleLazyUpload->setToolTip("Stream every model like one over the streaming budget, so the first frame only waits for the meshes in view and hidden nodes are never uploaded. Streamed models can't be added to, smoothed or have their nodes moved. Applies to the next model loaded");
+	QComboBox* virtualTextureSize = new QComboBox();
+	virtualTextureSize->setObjectName("virtualTextureSize");
+	virtualTextureSize->insertItem(0, "Off", 0);
+	virtualTextureSize->insertItem(1, "2048", 2048);
+	virtualTextureSize->insertItem(2, "4096", 4096);
+	virtualTextureSize->insertItem(3, "8192", 8192);
+	virtualTextureSize->setCurrentIndex(qMax(0, virtualTextureSize->findData(settings->value("ViewerGraphicsWindow/virtualTextureSize", 4096).toInt())));
+	virtualTextureSize->setToolTip("Base color maps larger than this, such as the textures of scans, are cut into pages once and only the pages the view needs are kept on the GPU, within the texture budget. Off uploads every texture whole. Applies to the next model loaded");
+	QComboBox* textureBudget = new QComboBox();
+	textureBudget->setObjectName("textureBudget");
+	textureBudget->insertItem(0, "64 MB", 64);
+	textureBudget->insertItem(1, "128 MB", 128);
+	textureBudget->insertItem(2, "256 MB", 256);
+	textureBudget->insertItem(3, "512 MB", 512);
+	textureBudget->insertItem(4, "1 GB", 1024);
+	textureBudget->setCurrentIndex(qMax(0, textureBudget->findData(settings->value("ViewerGraphicsWindow/textureBudget", 256).toInt())));
+	textureBudget->setToolTip("GPU memory the pages of paged textures share, however large the textures are. A smaller budget draws more of them from coarser pages");
+	QComboBox* memoryBudget = new QComboBox();
+	memoryBudget->setObjectName("memoryBudget");
+	memoryBudget->insertItem(0, "Off", 0);
+	memoryBudget->insertItem(1, "512 MB", 512);
+	memoryBudget->insertItem(2, "1 GB", 1024);
+	memoryBudget->insertItem(3, "2 GB", 2048);
+	memoryBudget->insertItem(4, "4 GB", 4096);
+	memoryBudget->insertItem(5, "8 GB", 8192);
+	memoryBudget->setCurrentIndex(qMax(0, memoryBudget->findData(settings->value("ViewerGraphicsWindow/memoryBudget", 0).toInt())));
+	memoryBudget->setToolTip("GPU memory the viewer should stay within. Loading a model that would go over it shows a warning, the model is still loaded. The stats overlay shows the budget next to what is used");
+	QComboBox* evictHidden = new QComboBox();
+	evictHidden->setObjectName("evictHidden");
+	evictHidden->insertItem(0, "Off", 0);
+	evictHidden->insertItem(1, "1 min", 1);
+	evictHidden->insertItem(2, "5 min", 5);
+	evictHidden->insertItem(3, "15 min", 15);
+	evictHidden->insertItem(4, "60 min", 60);
+	evictHidden->setCurrentIndex(qMax(0, evictHidden->findData(settings->value("ViewerGraphicsWindow/evictHiddenMinutes", 0).toInt())));
+	evictHidden->setToolTip("Free the GPU memory of the model once the window has been minimized this long, so other programs can use it. The model is loaded again, from the model cache where it is there, when the window is shown");
+	QComboBox* prewarmBudget = new QComboBox();
+	prewarmBudget->setObjectName("prewarmBudget");
+	prewarmBudget->insertItem(0, "Off", 0);
+	prewarmBudget->insertItem(1, "256 MB", 256);
+	prewarmBudget->insertItem(2, "512 MB", 512);
+	prewarmBudget->insertItem(3, "1 GB", 1024);
+	prewarmBudget->insertItem(4, "2 GB", 2048);
+	prewarmBudget->setCurrentIndex(qMax(0, prewarmBudget->findData(settings->value("ViewerGraphicsWindow/prewarmBudget", 1024).toInt())));
+	prewarmBudget->setToolTip("Get the recent files of the start page ready to open in the background after startup, by importing them into the model cache or reading their cache entries. Stops once they take this much, and when another model is opened. Applies on the next start");
+	QComboBox* primitiveTessellation = new QComboBox();
+	primitiveTessellation->setObjectName("primitiveTessellation");
+	primitiveTessellation->insertItem(0, "Coarse", 8);
+	primitiveTessellation->insertItem(1, "Medium", 16);
+	primitiveTessellation->insertItem(2, "Fine", Primitives::k_defaultTessellation);
+	primitiveTessellation->insertItem(3, "Very Fine", 64);
+	primitiveTessellation->insertItem(4, "Smoothest", 128);
+	primitiveTessellation->setCurrentIndex(qMax(0, primitiveTessellation->findData(settings->value("ViewerGraphicsWindow/primitiveTessellation", Primitives::k_defaultTessellation).toInt())));
+	primitiveTessellation->setToolTip("Segments around the curved primitives, the sphere, cylinder, cone and torus. Applies to the next primitive added");
+	QPushButton* togglePreviewProxy = new QPushButton((settings->value("ViewerGraphicsWindow/previewProxy", true).toBool()) ? "On" : "Off");
+	togglePreviewProxy->setObjectName("togglePreviewProxy");
+	togglePreviewProxy->setToolTip("Show a coarse version of large models right after the file is read, while the full model is still loading");
+	QPushButton* toggleNativeGltf = new QPushButton((settings->value("ViewerGraphicsWindow/nativeGltf", true).toBool()) ? "On" : "Off");
+	toggleNativeGltf->setObjectName("toggleNativeGltf");
+	toggleNativeGltf->setToolTip("Read glTF files straight from their buffers instead of through Assimp, which is much quicker for large files. Files with skins, animations or lights are still read by Assimp. Applies to the next model loaded");
+	QPushButton* toggleParallelText = new QPushButton((settings->value("ViewerGraphicsWindow/parallelText", true).toBool()) ? "On" : "Off");
+	toggleParallelText->setObjectName("toggleParallelText");
+	toggleParallelText->setToolTip("Parse text OBJ, PLY and STL files on every core instead of through Assimp, which is much quicker for large scans. Binary PLY and STL files are still read by Assimp, as are all of them when the import profile asks for smooth normals. Applies to the next model loaded");
+	QPushButton* toggleAlwaysRedraw = new QPushButton((settings->value("ViewerGraphicsWindow/alwaysRedraw", false).toBool()) ? "On" : "Off");
+	toggleAlwaysRedraw->setObjectName("toggleAlwaysRedraw");
+	toggleAlwaysRedraw->setToolTip("Draw frames continuously instead of only when something changes, for measuring performance");
+	QComboBox* presentMode = new QComboBox();
+	presentMode->setObjectName("presentMode");
+	presentMode->insertItem(0, "Vsync", int(k_presentVsync));
+	presentMode->insertItem(1, "Adaptive Vsync", int(k_presentAdaptive));
+	presentMode->insertItem(2, "Uncapped", int(k_presentUncapped));
+	presentMode->insertItem(3, "Frame Limiter", int(k_presentLimited));
+	presentMode->setCurrentIndex(qMax(0, presentMode->findData(settings->value("ViewerGraphicsWindow/presentMode", int(k_presentVsync)).toInt())));
+	presentMode->setToolTip("How frames are shown. Adaptive Vsync shows a late frame at once instead of waiting for the next refresh, Uncapped draws as fast as it can for benchmarking, and the Frame Limiter paces frames to the Frame Limit without vsync. Turning vsync on or off applies on the next start");
+	QComboBox* frameLimit = new QComboBox();
+	frameLimit->setObjectName("frameLimit");
+	frameLimit->insertItem(0, "30 FPS", 30);
+	frameLimit->insertItem(1, "60 FPS", 60);
+	frameLimit->insertItem(2, "90 FPS", 90);
+	frameLimit->insertItem(3, "120 FPS", 120);
+	frameLimit->insertItem(4, "144 FPS", 144);
+	frameLimit->insertItem(5, "240 FPS", 240);
+	frameLimit->setCurrentIndex(qMax(0, frameLimit->findData(settings->value("ViewerGraphicsWindow/frameLimit", 60).toInt())));
+	frameLimit->setToolTip("Frame rate the Frame Limiter keeps to");
+	QPushButton* toggleLowLatency = new QPushButton((settings->value("ViewerGraphicsWindow/lowLatency", false).toBool()) ? "On" : "Off");
+	toggleLowLatency->setObjectName("toggleLowLatency");
+	toggleLowLatency->setToolTip("Start each frame as late as it can still make the next refresh, and wait for the GPU at the end of it, so what is shown is closer to the mouse and keys. Costs frame rate when frames take most of a refresh");
+	QComboBox* displayMode = new QComboBox();
+	displayMode->setObjectName("displayMode");
+	displayMode->insertItem(0, "Shaded", int(k_displayShaded));
+	displayMode->insertItem(1, "Wireframe on Shaded", int(k_displayWireframe));
+	displayMode->insertItem(2, "Point Cloud", int(k_displayPoints));
+	displayMode->setCurrentIndex(qMax(0, displayMode->findData(settings->value("ViewerGraphicsWindow/displayMode", int(k_displayShaded)).toInt())));
+	displayMode->setToolTip("Point Cloud draws only the vertices, which keeps scans with hundreds of millions of points interactive. The wireframe needs OpenGL 3.2");
+	QComboBox* meshletCulling = new QComboBox();
+	meshletCulling->setObjectName("meshletCulling");
+	meshletCulling->insertItem(0, "Off", int(k_meshletCullingOff));
+	meshletCulling->insertItem(1, "Frustum", int(k_meshletCullingFrustum));
+	meshletCulling->insertItem(2, "Frustum and Back Faces", int(k_meshletCullingBackFaces));
+	meshletCulling->setCurrentIndex(qMax(0, meshletCulling->findData(settings->value("ViewerGraphicsWindow/meshletCulling", int(k_meshletCullingFrustum)).toInt())));
+	meshletCulling->setToolTip("Skip the parts of large meshes that are off screen, and with Back Faces the parts that face away. Back Faces hides the inside of open models");
+	const int defaultPointBudget = int(PointCloudLod::k_defaultBudget / 1000000);
+	QComboBox* pointBudget = new QComboBox();
+	pointBudget->setObjectName("pointBudget");
+	pointBudget->insertItem(0, "1 M", 1);
+	pointBudget->insertItem(1, "2 M", 2);
+	pointBudget->insertItem(2, "5 M", 5);
+	pointBudget->insertItem(3, "10 M", 10);
+	pointBudget->insertItem(4, "20 M", 20);
+	pointBudget->insertItem(5, "50 M", 50);
+	pointBudget->setCurrentIndex(qMax(0, pointBudget->findData(settings->value("ViewerGraphicsWindow/pointBudget", defaultPointBudget).toInt())));
+	pointBudget->setToolTip("Points of a LAS or PLY point cloud drawn per frame at most, the parts nearest and largest on screen in the most detail");
+
+	QComboBox* targetFps = new QComboBox();
+	targetFps->setObjectName("targetFps");
+	targetFps->insertItem(0, "Off", 0);
+	targetFps->insertItem(1, "30 FPS", 30);
+	targetFps->insertItem(2, "60 FPS", 60);
+	targetFps->insertItem(3, "90 FPS", 90);
+	targetFps->insertItem(4, "120 FPS", 120);
+	targetFps->insertItem(5, "144 FPS", 144);
+	targetFps->setCurrentIndex(qMax(0, targetFps->findData(settings->value("ViewerGraphicsWindow/targetFps", 0).toInt())));
+	targetFps->setToolTip("Draw the model at a lower resolution while frames take longer than this, down to half the width and height. The overlays stay sharp");
+	QPushButton* toggleRefinement = new QPushButton((settings->value("ViewerGraphicsWindow/progressiveRefinement", true).toBool()) ? "On" : "Off");
+	toggleRefinement->setObjectName("toggleRefinement");
+	toggleRefinement->setToolTip("Smooth the edges further over the frames after the view stops moving");
+	QPushButton* toggleDepthPrepass = new QPushButton((settings->value("ViewerGraphicsWindow/depthPrepass", false).toBool()) ? "On" : "Off");
+	toggleDepthPrepass->setObjectName("toggleDepthPrepass");
+	toggleDepthPrepass->setToolTip("Draw the depth of the model first, so only the nearest surface of each pixel is lit. Pays off on dense models, see Overdraw View. Needs shaders with the frame block");
+	QPushButton* toggleComputeSkinning = new QPushButton((settings->value("ViewerGraphicsWindow/computeSkinning", true).toBool()) ? "On" : "Off");
+	toggleComputeSkinning->setObjectName("toggleComputeSkinning");
+	toggleComputeSkinning->setToolTip("Pose animated meshes once per frame in a compute pass that every pass then draws, instead of in each pass. Blend shapes only move this way. Needs OpenGL 4.3");
+	QComboBox* shadowMode = new QComboBox();
+	shadowMode->setObjectName("shadowMode");
+	shadowMode->insertItem(0, "Off", int(k_shadowsOff));
+	shadowMode->insertItem(1, "Directional", int(k_shadowsDirectional));
+	shadowMode->insertItem(2, "Spot", int(k_shadowsSpot));
+	shadowMode->setCurrentIndex(qMax(0, shadowMode->findData(settings->value("ViewerGraphicsWindow/shadowMode", int(k_shadowsOff)).toInt())));
+	shadowMode->setToolTip("Let the light cast shadows. While they are on the light stays in place on the model as the view turns, so the shadows are only drawn again when the light or the model changes. Needs OpenGL 3.3");
+	QComboBox* shadowCascades = new QComboBox();
+	shadowCascades->setObjectName("shadowCascades");
+	for (int cascades = 1; cascades <= ShadowMapper::k_maxCascades; ++cascades) {
+		shadowCascades->insertItem(cascades - 1, QString::number(cascades), cascades);
+	}
+	shadowCascades->setCurrentIndex(qMax(0, shadowCascades->findData(settings->value("ViewerGraphicsWindow/shadowCascades", 1).toInt())));
+	shadowCascades->setToolTip("Split directional shadows into slices along the view, for sharper shadows close to the camera. More than one has the shadows drawn again whenever the view moves");
+	QComboBox* shadowFilter = new QComboBox();
+	shadowFilter->setObjectName("shadowFilter");
+	shadowFilter->insertItem(0, "Hard", 0);
+	shadowFilter->insertItem(1, "Soft (3x3)", 1);
+	shadowFilter->insertItem(2, "Softer (5x5)", 2);
+	shadowFilter->setCurrentIndex(qMax(0, shadowFilter->findData(settings->value("ViewerGraphicsWindow/shadowFilter", 1).toInt())));
+	shadowFilter->setToolTip("Blend the shadow map over several texels, which softens the edges of the shadows at the cost of more taps per pixel");
+	QComboBox* shadowMapSize = new QComboBox();
+	shadowMapSize->setObjectName("shadowMapSize");
+	shadowMapSize->insertItem(0, "1024", 1024);
+	shadowMapSize->insertItem(1, "2048", 2048);
+	shadowMapSize->insertItem(2, "4096", 4096);
+	shadowMapSize->setCurrentIndex(qMax(0, shadowMapSize->findData(settings->value("ViewerGraphicsWindow/shadowMapSize", 2048).toInt())));
+	shadowMapSize->setToolTip("Texels across the shadow map, which covers the whole model. Each cascade takes a map of its own");
+	QPushButton* toggleSceneLights = new QPushButton((settings->value("ViewerGraphicsWindow/sceneLights", true).toBool()) ? "On" : "Off");
+	toggleSceneLights->setObjectName("toggleSceneLights");
+	toggleSceneLights->setToolTip("Also light the model with the point, spot and directional lights in its file. Each pixel only shades the lights that reach it");
+	QComboBox* environmentIntensity = new QComboBox();
+	environmentIntensity->setObjectName("environmentIntensity");
+	environmentIntensity->insertItem(0, "Off", 0.f);
+	environmentIntensity->insertItem(1, "0.25", 0.25f);
+	environmentIntensity->insertItem(2, "0.5", 0.5f);
+	environmentIntensity->insertItem(3, "1", 1.f);
+	environmentIntensity->insertItem(4, "2", 2.f);
+	environmentIntensity->setCurrentIndex(qMax(0, environmentIntensity->findData(settings->value("ViewerGraphicsWindow/environmentIntensity", 1.f).toFloat())));
+	environmentIntensity->setToolTip("How strongly the environment loaded with File > Load > Environment lights the model");
+	QPushButton* toggleOverdraw = new QPushButton((settings->value("ViewerGraphicsWindow/overdrawView", false).toBool()) ? "On" : "Off");
+	toggleOverdraw->setObjectName("toggleOverdraw");
+	toggleOverdraw->setToolTip("Show how many surfaces cover each pixel, from red for a few to yellow and white for many");
 	QPushButton* reset = new QPushButton(QString::fromLatin1("Reset All"));
 	reset->setObjectName("resetViewSettings");
 
 	layout->addRow(tr("Anti Aliasing"), msaa);
+	layout->addRow(tr("Display Mode"), displayMode);
 	layout->addRow(tr("Refrence Grid"), toggleGrid);
 	layout->addRow(tr("Axis Display"), toggleAxis);
 	layout->addRow(tr("Stats for Nerds"), toggleStats);
+	layout->addRow(tr("Interleaved Vertices"), toggleInterleaved);
+	layout->addRow(tr("Compressed Vertices"), toggleQuantize);
+	layout->addRow(tr("Compressed Positions"), toggleQuantizePositions);
+	layout->addRow(tr("Batch Static Geometry"), toggleBatching);
+	layout->addRow(tr("Vertex Cache Order"), toggleVertexCache);
+	layout->addRow(tr("Overdraw Order"), toggleOverdrawOrder);
+	layout->addRow(tr("Level of Detail"), toggleLevelOfDetail);
+	layout->addRow(tr("Occlusion Culling"), toggleOcclusionCulling);
+	layout->addRow(tr("Meshlet Culling"), meshletCulling);
+	layout->addRow(tr("Point Budget"), pointBudget);
+	layout->addRow(tr("Multi-Draw Indirect"), toggleMultiDraw);
+	layout->addRow(tr("GPU Culling"), toggleGpuCulling);
+	layout->addRow(tr("Compute Skinning"), toggleComputeSkinning);
+	layout->addRow(tr("Shadows"), shadowMode);
+	layout->addRow(tr("Shadow Cascades"), shadowCascades);
+	layout->addRow(tr("Shadow Filter"), shadowFilter);
+	layout->addRow(tr("Shadow Map Size"), shadowMapSize);
+	layout->addRow(tr("Scene Lights"), toggleSceneLights);
+	layout->addRow(tr("Environment Light"), environmentIntensity);
+	layout->addRow(tr("Model Cache"), toggleModelCache);
+	layout->addRow(tr("Compress Model Cache"), toggleCompressCache);
+	layout->addRow(tr("Low Memory Mode"), toggleLowMemory);
+	layout->addRow(tr("Streaming Budget"), streamingBudget);
+	layout->addRow(tr("Lazy Upload"), toggleLazyUpload);
+	layout->addRow(tr("Virtual Textures"), virtualTextureSize);
+	layout->addRow(tr("Texture Budget"), textureBudget);
+	layout->addRow(tr("Memory Budget"), memoryBudget);
+	layout->addRow(tr("Evict When Minimized"), evictHidden);
+	layout->addRow(tr("Pre-Warm Recent Files"), prewarmBudget);
+	layout->addRow(tr("Primitive Detail"), primitiveTessellation);
+	layout->addRow(tr("Quick Preview"), togglePreviewProxy);
+	layout->addRow(tr("Fast glTF Loading"), toggleNativeGltf);
+	layout->addRow(tr("Parallel OBJ/PLY/STL Parsing"), toggleParallelText);
+	layout->addRow(tr("Always Redraw"), toggleAlwaysRedraw);
+	layout->addRow(tr("Present Mode"), presentMode);
+	layout->addRow(tr("Frame Limit"), frameLimit);
+	layout->addRow(tr("Low Latency"), toggleLowLatency);
+	layout->addRow(tr("Target Frame Rate"), targetFps);
+	layout->addRow(tr("Progressive Refinement"), toggleRefinement);
+	layout->addRow(tr("Depth Pre-Pass"), toggleDepthPrepass);
+	layout->addRow(tr("Overdraw View"), toggleOverdraw);
 	layout->addRow(QString(), reset);
 
 	connect(msaa, QOverload<int>::of(&QComboBox::currentIndexChanged),[=](int index) { 
 		settings->setValue("ViewerGraphicsWindow/msaaLevel", msaa->itemData(index).toInt());
+		emit SettingsChanged();
 	});
 	connect(toggleGrid, &QPushButton::released, this, [=] {
 		settings->setValue("ViewerGraphicsWindow/toggleGrid", !settings->value("ViewerGraphicsWindow/toggleGrid", true).toBool());
 		toggleGrid->setText((settings->value("ViewerGraphicsWindow/toggleGrid", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
 	});
 	connect(toggleAxis, &QPushButton::released, this, [=] {
 		settings->setValue("ViewerGraphicsWindow/toggleAxis", !settings->value("ViewerGraphicsWindow/toggleAxis", true).toBool());
 		toggleAxis->setText((settings->value("ViewerGraphicsWindow/toggleAxis", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
 	});
 	connect(toggleStats, &QPushButton::released, this, [=] {
 		settings->setValue("ViewerGraphicsWindow/toggleStats", !settings->value("ViewerGraphicsWindow/toggleStats", true).toBool());
 		toggleStats->setText((settings->value("ViewerGraphicsWindow/toggleStats", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleInterleaved, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/interleavedVertices", !settings->value("ViewerGraphicsWindow/interleavedVertices", true).toBool());
+		toggleInterleaved->setText((settings->value("ViewerGraphicsWindow/interleavedVertices", true).toBool()) ? "On" : "Off");
+	});
+	connect(toggleQuantize, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/quantizeVertices", !settings->value("ViewerGraphicsWindow/quantizeVertices", false).toBool());
+		toggleQuantize->setText((settings->value("ViewerGraphicsWindow/quantizeVertices", false).toBool()) ? "On" : "Off");
+	});
+	connect(toggleQuantizePositions, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/quantizePositions", !settings->value("ViewerGraphicsWindow/quantizePositions", false).toBool());
+		toggleQuantizePositions->setText((settings->value("ViewerGraphicsWindow/quantizePositions", false).toBool()) ? "On" : "Off");
+	});
+	connect(toggleBatching, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/batchStaticGeometry", !settings->value("ViewerGraphicsWindow/batchStaticGeometry", false).toBool());
+		toggleBatching->setText((settings->value("ViewerGraphicsWindow/batchStaticGeometry", false).toBool()) ? "On" : "Off");
+	});
+	connect(toggleVertexCache, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/optimizeVertexCache", !settings->value("ViewerGraphicsWindow/optimizeVertexCache", true).toBool());
+		toggleVertexCache->setText((settings->value("ViewerGraphicsWindow/optimizeVertexCache", true).toBool()) ? "On" : "Off");
+	});
+	connect(toggleOverdrawOrder, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/optimizeOverdraw", !settings->value("ViewerGraphicsWindow/optimizeOverdraw", false).toBool());
+		toggleOverdrawOrder->setText((settings->value("ViewerGraphicsWindow/optimizeOverdraw", false).toBool()) ? "On" : "Off");
+	});
+	connect(toggleLevelOfDetail, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/levelOfDetail", !settings->value("ViewerGraphicsWindow/levelOfDetail", true).toBool());
+		toggleLevelOfDetail->setText((settings->value("ViewerGraphicsWindow/levelOfDetail", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleOcclusionCulling, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/occlusionCulling", !settings->value("ViewerGraphicsWindow/occlusionCulling", false).toBool());
+		toggleOcclusionCulling->setText((settings->value("ViewerGraphicsWindow/occlusionCulling", false).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleMultiDraw, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/multiDrawIndirect", !settings->value("ViewerGraphicsWindow/multiDrawIndirect", false).toBool());
+		toggleMultiDraw->setText((settings->value("ViewerGraphicsWindow/multiDrawIndirect", false).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleGpuCulling, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/gpuCulling", !settings->value("ViewerGraphicsWindow/gpuCulling", true).toBool());
+		toggleGpuCulling->setText((settings->value("ViewerGraphicsWindow/gpuCulling", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleModelCache, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/modelCache", !settings->value("ViewerGraphicsWindow/modelCache", true).toBool());
+		toggleModelCache->setText((settings->value("ViewerGraphicsWindow/modelCache", true).toBool()) ? "On" : "Off");
+	});
+	connect(toggleCompressCache, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/compressModelCache", !settings->value("ViewerGraphicsWindow/compressModelCache", true).toBool());
+		toggleCompressCache->setText((settings->value("ViewerGraphicsWindow/compressModelCache", true).toBool()) ? "On" : "Off");
+	});
+	connect(toggleLowMemory, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/lowMemory", !settings->value("ViewerGraphicsWindow/lowMemory", false).toBool());
+		toggleLowMemory->setText((settings->value("ViewerGraphicsWindow/lowMemory", false).toBool()) ? "On" : "Off");
+	});
+	connect(toggleLazyUpload, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/lazyUpload", !settings->value("ViewerGraphicsWindow/lazyUpload", false).toBool());
+		toggleLazyUpload->setText((settings->value("ViewerGraphicsWindow/lazyUpload", false).toBool()) ? "On" : "Off");
+	});
+	connect(togglePreviewProxy, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/previewProxy", !settings->value("ViewerGraphicsWindow/previewProxy", true).toBool());
+		togglePreviewProxy->setText((settings->value("ViewerGraphicsWindow/previewProxy", true).toBool()) ? "On" : "Off");
+	});
+	connect(toggleNativeGltf, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/nativeGltf", !settings->value("ViewerGraphicsWindow/nativeGltf", true).toBool());
+		toggleNativeGltf->setText((settings->value("ViewerGraphicsWindow/nativeGltf", true).toBool()) ? "On" : "Off");
+	});
+	connect(toggleParallelText, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/parallelText", !settings->value("ViewerGraphicsWindow/parallelText", true).toBool());
+		toggleParallelText->setText((settings->value("ViewerGraphicsWindow/parallelText", true).toBool()) ? "On" : "Off");
+	});
+	connect(toggleAlwaysRedraw, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/alwaysRedraw", !settings->value("ViewerGraphicsWindow/alwaysRedraw", false).toBool());
+		toggleAlwaysRedraw->setText((settings->value("ViewerGraphicsWindow/alwaysRedraw", false).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleRefinement, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/progressiveRefinement", !settings->value("ViewerGraphicsWindow/progressiveRefinement", true).toBool());
+		toggleRefinement->setText((settings->value("ViewerGraphicsWindow/progressiveRefinement", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleDepthPrepass, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/depthPrepass", !settings->value("ViewerGraphicsWindow/depthPrepass", false).toBool());
+		toggleDepthPrepass->setText((settings->value("ViewerGraphicsWindow/depthPrepass", false).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleComputeSkinning, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/computeSkinning", !settings->value("ViewerGraphicsWindow/computeSkinning", true).toBool());
+		toggleComputeSkinning->setText((settings->value("ViewerGraphicsWindow/computeSkinning", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(toggleOverdraw, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/overdrawView", !settings->value("ViewerGraphicsWindow/overdrawView", false).toBool());
+		toggleOverdraw->setText((settings->value("ViewerGraphicsWindow/overdrawView", false).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(displayMode, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/displayMode", displayMode->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(streamingBudget, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/streamingBudget", streamingBudget->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(virtualTextureSize, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/virtualTextureSize", virtualTextureSize->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(textureBudget, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/textureBudget", textureBudget->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(evictHidden, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/evictHiddenMinutes", evictHidden->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(memoryBudget, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/memoryBudget", memoryBudget->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(prewarmBudget, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/prewarmBudget", prewarmBudget->itemData(index).toInt());
+	});
+	connect(primitiveTessellation, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/primitiveTessellation", primitiveTessellation->itemData(index).toInt());
+	});
+	connect(meshletCulling, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/meshletCulling", meshletCulling->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(pointBudget, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/pointBudget", pointBudget->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(shadowMode, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/shadowMode", shadowMode->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(shadowCascades, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/shadowCascades", shadowCascades->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(shadowFilter, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/shadowFilter", shadowFilter->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(shadowMapSize, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/shadowMapSize", shadowMapSize->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(toggleSceneLights, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/sceneLights", !settings->value("ViewerGraphicsWindow/sceneLights", true).toBool());
+		toggleSceneLights->setText((settings->value("ViewerGraphicsWindow/sceneLights", true).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(environmentIntensity, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/environmentIntensity", environmentIntensity->itemData(index).toFloat());
+		emit SettingsChanged();
+	});
+	connect(presentMode, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/presentMode", presentMode->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(frameLimit, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/frameLimit", frameLimit->itemData(index).toInt());
+		emit SettingsChanged();
+	});
+	connect(toggleLowLatency, &QPushButton::released, this, [=] {
+		settings->setValue("ViewerGraphicsWindow/lowLatency", !settings->value("ViewerGraphicsWindow/lowLatency", false).toBool());
+		toggleLowLatency->setText((settings->value("ViewerGraphicsWindow/lowLatency", false).toBool()) ? "On" : "Off");
+		emit SettingsChanged();
+	});
+	connect(targetFps, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/targetFps", targetFps->itemData(index).toInt());
+		emit SettingsChanged();
 	});
 	connect(reset, &QPushButton::released, this, [=] {
 		// Remove the saved values
@@ -374,12 +867,158 @@ void SettingsMenu::SetupViewSettings()
 		settings->remove("ViewerGraphicsWindow/toggleAxis");
 		settings->remove("ViewerGraphicsWindow/toggleStats");
 		settings->remove("ViewerGraphicsWindow/msaaLevel");
+		settings->remove("ViewerGraphicsWindow/interleavedVertices");
+		settings->remove("ViewerGraphicsWindow/quantizeVertices");
+		settings->remove("ViewerGraphicsWindow/quantizePositions");
+		settings->remove("ViewerGraphicsWindow/batchStaticGeometry");
+		settings->remove("ViewerGraphicsWindow/optimizeVertexCache");
+		settings->remove("ViewerGraphicsWindow/optimizeOverdraw");
+		settings->remove("ViewerGraphicsWindow/levelOfDetail");
+		settings->remove("ViewerGraphicsWindow/occlusionCulling");
+		settings->remove("ViewerGraphicsWindow/multiDrawIndirect");
+		settings->remove("ViewerGraphicsWindow/gpuCulling");
+		settings->remove("ViewerGraphicsWindow/computeSkinning");
+		settings->remove("ViewerGraphicsWindow/shadowMode");
+		settings->remove("ViewerGraphicsWindow/shadowCascades");
+		settings->remove("ViewerGraphicsWindow/shadowFilter");
+		settings->remove("ViewerGraphicsWindow/shadowMapSize");
+		settings->remove("ViewerGraphicsWindow/sceneLights");
+		settings->remove("ViewerGraphicsWindow/environmentIntensity");
+		settings->remove("ViewerGraphicsWindow/modelCache");
+		settings->remove("ViewerGraphicsWindow/compressModelCache");
+		settings->remove("ViewerGraphicsWindow/lowMemory");
+		settings->remove("ViewerGraphicsWindow/streamingBudget");
+		settings->remove("ViewerGraphicsWindow/lazyUpload");
+		settings->remove("ViewerGraphicsWindow/virtualTextureSize");
+		settings->remove("ViewerGraphicsWindow/textureBudget");
+		settings->remove("ViewerGraphicsWindow/memoryBudget");
+		settings->remove("ViewerGraphicsWindow/evictHiddenMinutes");
+		settings->remove("ViewerGraphicsWindow/prewarmBudget");
+		settings->remove("ViewerGraphicsWindow/primitiveTessellation");
+		settings->remove("ViewerGraphicsWindow/previewProxy");
+		settings->remove("ViewerGraphicsWindow/nativeGltf");
+		settings->remove("ViewerGraphicsWindow/parallelText");
+		settings->remove("ViewerGraphicsWindow/alwaysRedraw");
+		settings->remove("ViewerGraphicsWindow/presentMode");
+		settings->remove("ViewerGraphicsWindow/frameLimit");
+		settings->remove("ViewerGraphicsWindow/lowLatency");
+		settings->remove("ViewerGraphicsWindow/targetFps");
+		settings->remove("ViewerGraphicsWindow/progressiveRefinement");
+		settings->remove("ViewerGraphicsWindow/depthPrepass");
+		settings->remove("ViewerGraphicsWindow/displayMode");
+		settings->remove("ViewerGraphicsWindow/overdrawView");
+		settings->remove("ViewerGraphicsWindow/meshletCulling");
+		settings->remove("ViewerGraphicsWindow/pointBudget");
 
 		toggleGrid->setText("On");
 		toggleAxis->setText("On");
 		toggleStats->setText("On");
+		toggleInterleaved->setText("On");
+		toggleQuantize->setText("Off");
+		toggleQuantizePositions->setText("Off");
+		toggleBatching->setText("Off");
+		toggleVertexCache->setText("On");
+		toggleOverdrawOrder->setText("Off");
+		toggleLevelOfDetail->setText("On");
+		toggleOcclusionCulling->setText("Off");
+		toggleMultiDraw->setText("Off");
+		toggleGpuCulling->setText("On");
+		toggleComputeSkinning->setText("On");
+		shadowMode->setCurrentIndex(shadowMode->findData(int(k_shadowsOff)));
+		shadowCascades->setCurrentIndex(shadowCascades->findData(1));
+		shadowFilter->setCurrentIndex(shadowFilter->findData(1));
+		shadowMapSize->setCurrentIndex(shadowMapSize->findData(2048));
+		toggleSceneLights->setText("On");
+		environmentIntensity->setCurrentIndex(environmentIntensity->findData(1.f));
+		toggleModelCache->setText("On");
+		toggleCompressCache->setText("On");
+		toggleLowMemory->setText("Off");
+		streamingBudget->setCurrentIndex(0);
+		toggleLazyUpload->setText("Off");
+		virtualTextureSize->setCurrentIndex(virtualTextureSize->findData(4096));
+		textureBudget->setCurrentIndex(textureBudget->findData(256));
+		memoryBudget->setCurrentIndex(0);
+		evictHidden->setCurrentIndex(0);
+		prewarmBudget->setCurrentIndex(prewarmBudget->findData(1024));
+		primitiveTessellation->setCurrentIndex(primitiveTessellation->findData(Primitives::k_defaultTessellation));
+		togglePreviewProxy->setText("On");
+		toggleNativeGltf->setText("On");
+		toggleParallelText->setText("On");
+		toggleAlwaysRedraw->setText("Off");
+		presentMode->setCurrentIndex(presentMode->findData(int(k_presentVsync)));
+		frameLimit->setCurrentIndex(frameLimit->findData(60));
+		toggleLowLatency->setText("Off");
+		toggleRefinement->setText("On");
+		toggleDepthPrepass->setText("Off");
+		displayMode->setCurrentIndex(0);
+		toggleOverdraw->setText("Off");
+		meshletCulling->setCurrentIndex(meshletCulling->findData(int(k_meshletCullingFrustum)));
+		pointBudget->setCurrentIndex(pointBudget->findData(defaultPointBudget));
+		targetFps->setCurrentIndex(0);
+		msaa->setCurrentIndex(msaa->findData(8));
+		emit SettingsChanged();
 	});
 
 	
 	m_pViewSettings->hide();// As it's not the defalut
 }
+
+void SettingsMenu::SetupImportSettings()
+{
+	m_pImportSettings = new QWidget(this);
+	m_pImportSettings->setObjectName("importSettings");
+	QFormLayout* layout = new QFormLayout(m_pImportSettings);
+
+	// Load the saved profile
+	QComboBox* profile = new QComboBox();
+	profile->setObjectName("importProfile");
+	profile->insertItem(0, "Fast Preview", int(ImportProfile::FastPreview));
+	profile->insertItem(1, "Balanced", int(ImportProfile::Balanced));
+	profile->insertItem(2, "Quality", int(ImportProfile::Quality));
+	profile->insertItem(3, "Custom", int(ImportProfile::Custom));
+	profile->setCurrentIndex(settings->value("ViewerGraphicsWindow/importProfile", int(ImportProfile::Quality)).toInt());
+	profile->setToolTip("Which post-processing steps run when a model is imported. Fast Preview only triangulates and generates normals. Applies to the next model loaded");
+
+	// The steps of the custom profile, only editable while it is chosen
+	QListWidget* customSteps = new QListWidget();
+	customSteps->setObjectName("customImportSteps");
+	const uint customFlags = settings->value("ViewerGraphicsWindow/customImportSteps", 0u).toUInt();
+	for (const ModelLoader::ImportStep& step : ModelLoader::CustomImportSteps()) {
+		QListWidgetItem* item = new QListWidgetItem(QString::fromLatin1(step.m_name), customSteps);
+		item->setData(Qt::UserRole, step.m_flag);
+		item->setCheckState((customFlags & step.m_flag) ? Qt::Checked : Qt::Unchecked);
+	}
+	customSteps->setEnabled(ImportProfile(profile->currentData().toInt()) == ImportProfile::Custom);
+	QPushButton* reset = new QPushButton(QString::fromLatin1("Reset All"));
+	reset->setObjectName("resetImportSettings");
+
+	layout->addRow(tr("Import Profile"), profile);
+	layout->addRow(tr("Custom Steps"), customSteps);
+	layout->addRow(QString(), reset);
+
+	connect(profile, QOverload<int>::of(&QComboBox::currentIndexChanged), [=](int index) {
+		settings->setValue("ViewerGraphicsWindow/importProfile", profile->itemData(index).toInt());
+		customSteps->setEnabled(ImportProfile(profile->itemData(index).toInt()) == ImportProfile::Custom);
+	});
+	connect(customSteps, &QListWidget::itemChanged, this, [=] {
+		uint flags = 0;
+		for (int i = 0; i < customSteps->count(); ++i) {
+			if (customSteps->item(i)->checkState() == Qt::Checked) {
+				flags |= customSteps->item(i)->data(Qt::UserRole).toUInt();
+			}
+		}
+		settings->setValue("ViewerGraphicsWindow/customImportSteps", flags);
+	});
+	connect(reset, &QPushButton::released, this, [=] {
+		settings->remove("ViewerGraphicsWindow/importProfile");
+		settings->remove("ViewerGraphicsWindow/customImportSteps");
+
+		profile->setCurrentIndex(int(ImportProfile::Quality));
+		const QSignalBlocker blocker(customSteps);
+		for (int i = 0; i < customSteps->count(); ++i) {
+			customSteps->item(i)->setCheckState(Qt::Unchecked);
+		}
+	});
+
+	m_pImportSettings->hide();// As it's not the defalut
+}
@@ -5,7 +5,7 @@
 #include <QLabel>
 #include <QTreeView>
 #include <QHeaderView>
-#include <QSettings>
+#include "AppSettings.h"
 
 // Forward Declares
 class ViewerGraphicsWindow;
@@ -16,8 +16,11 @@ class SettingsMenu : public QWidget
 public:
 	SettingsMenu(ViewerGraphicsWindow* gWindow, QWidget* parent = nullptr);
 	void ChangeWindow(QListWidgetItem* current, QListWidgetItem* previous);
-	QSettings* getSettings();
+	AppSettings* getSettings();
 	
+signals:
+	// Emitted when a setting that changes what is drawn was edited
+	void SettingsChanged();
 
 //private slots:
 
@@ -26,6 +29,7 @@ private:
 		mouse,
 		keybind,
 		view,
+		modelImport,
 	};
 
 	ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
@@ -33,7 +37,7 @@ private:
 	QListWidget* m_pSettingsList = nullptr;
 	QWidget* m_pCurrentSettingsWidget = nullptr;
 	QStringList settingHeader = { "Key","Value" };
-	QSettings* settings;
+	AppSettings* settings;
 
 	// Settings menus
 	void SetupMouseSettings();
@@ -47,6 +51,10 @@ private:
 	void SetupViewSettings();
 	QWidget* m_pViewSettings = nullptr;
 	QString m_ViewTitle = QString::fromLatin1("View");
+
+	void SetupImportSettings();
+	QWidget* m_pImportSettings = nullptr;
+	QString m_ImportTitle = QString::fromLatin1("Import");
 };
 
 
@@ -78,5 +86,46 @@ ViewerGraphicsWindow/
 	gridToggle | Bool
 	toggleAxis | Bool
 	toggleStats | Bool
-	msaaLevel | Int
+	msaaLevel | Int (-1 for FXAA)
+	interleavedVertices | Bool
+	quantizeVertices | Bool
+	quantizePositions | Bool
+	batchStaticGeometry | Bool
+	optimizeVertexCache | Bool
+	optimizeOverdraw | Bool
+	levelOfDetail | Bool
+	occlusionCulling | Bool
+	multiDrawIndirect | Bool
+	gpuCulling | Bool
+	computeSkinning | Bool
+	shadowMode | Int (ShadowMode)
+	shadowCascades | Int (1 to 4)
+	shadowFilter | Int (filter taps either side, 0 for hard)
+	shadowMapSize | Int (texels)
+	sceneLights | Bool
+	environmentMap | String (path of the .hdr file)
+	environmentIntensity | Float (0 for off)
+	ambientOcclusion | Int (AmbientOcclusionMode)
+	ambientOcclusionTemporal | Bool
+	modelCache | Bool
+	compressModelCache | Bool
+	lowMemory | Bool
+	streamingBudget | Int (MB, 0 for off)
+	lazyUpload | Bool
+	memoryBudget | Int (MB, 0 for off)
+	prewarmBudget | Int (MB, 0 for off)
+	primitiveTessellation | Int (segments)
+	previewProxy | Bool
+	nativeGltf | Bool
+	parallelText | Bool
+	importProfile | Int (ImportProfile)
+	customImportSteps | UInt (aiPostProcessSteps flags)
+	alwaysRedraw | Bool
+	targetFps | Int (0 for off)
+	progressiveRefinement | Bool
+	depthPrepass | Bool
+	overdrawView | Bool
+	displayMode | Int (DisplayMode)
+	meshletCulling | Int (MeshletCulling)
+	pointBudget | Int (millions of points)
 */
\ No newline at end of file
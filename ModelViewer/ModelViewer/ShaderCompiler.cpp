@@ -0,0 +1,95 @@
+#include "ShaderCompiler.h"
+#include "GpuModelBuilder.h"
+
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+#include <QOpenGLShaderProgram>
+
+
+ShaderCompiler::ShaderCompiler(QObject* parent)
+	: QObject(parent)
+{
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+	Destroy();
+}
+
+bool ShaderCompiler::Create(QOpenGLContext* pShareContext)
+{
+	Destroy();
+
+	// The surface has to be created on the GUI thread, the context can be moved to the worker
+	m_pSurface = new QOffscreenSurface();
+	m_pSurface->setFormat(pShareContext->format());
+	m_pSurface->create();
+	m_pContext = new QOpenGLContext();
+	m_pContext->setFormat(pShareContext->format());
+	m_pContext->setShareContext(pShareContext);
+	if (!m_pSurface->isValid() || !m_pContext->create()) {
+		qWarning("Could not create a context to compile shaders in the background");
+		delete m_pContext;
+		m_pContext = nullptr;
+		delete m_pSurface;
+		m_pSurface = nullptr;
+		return false;
+	}
+
+	// Both go with the thread, once it has stopped
+	m_pWorker = new QObject();
+	m_pWorker->moveToThread(&m_thread);
+	m_pContext->moveToThread(&m_thread);
+	connect(&m_thread, &QThread::finished, m_pWorker, &QObject::deleteLater);
+	connect(&m_thread, &QThread::finished, m_pContext, &QObject::deleteLater);
+	m_thread.start();
+	return true;
+}
+
+void ShaderCompiler::Destroy()
+{
+	if (!m_pWorker) {
+		return;
+	}
+	m_thread.quit();
+	m_thread.wait();
+	m_pWorker = nullptr;
+	m_pContext = nullptr;
+	delete m_pSurface;
+	m_pSurface = nullptr;
+}
+
+bool ShaderCompiler::IsCreated() const
+{
+	return m_pWorker != nullptr;
+}
+
+void ShaderCompiler::Compile(const QByteArray& vertexSource, const QByteArray& fragmentSource)
+{
+	if (!m_pWorker) {
+		return;
+	}
+	QOpenGLContext* pContext = m_pContext;
+	QOffscreenSurface* pSurface = m_pSurface;
+	QMetaObject::invokeMethod(m_pWorker, [=] {
+		bool success = false;
+		QString log;
+		if (pContext->makeCurrent(pSurface)) {
+			// Built like the GUI thread builds the model program, so the cached binary matches
+			QOpenGLShaderProgram program;
+			program.addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+			program.addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+			GpuModelBuilder::BindAttributeLocations(&program);
+			success = program.link();
+			log = program.log();
+		}
+		else {
+			log = "Could not make the compile context current";
+		}
+		pContext->doneCurrent();
+
+		QMetaObject::invokeMethod(this, [=] {
+			emit Compiled(vertexSource, fragmentSource, success, log);
+		}, Qt::QueuedConnection);
+	}, Qt::QueuedConnection);
+}
@@ -0,0 +1,40 @@
+#pragma once
+#include <QByteArray>
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+class QOffscreenSurface;
+class QOpenGLContext;
+
+// Compiles and links shader programs on a worker thread with its own context, sharing objects
+// with the viewer's. A program that links leaves its binary in Qt's program binary cache, so
+// linking the same sources with the same attribute bindings on the GUI thread afterwards skips
+// the compile. Programs that don't link never touch the GUI thread's program.
+class ShaderCompiler : public QObject
+{
+	Q_OBJECT
+
+public:
+	explicit ShaderCompiler(QObject* parent = nullptr);
+	~ShaderCompiler();
+
+	// Starts the worker with a context sharing pShareContext's objects, on the GUI thread.
+	// Returns false if that context can't be created.
+	bool Create(QOpenGLContext* pShareContext);
+	void Destroy();
+	bool IsCreated() const;
+
+	// Queues a test link of the model program. Requests are handled in order.
+	void Compile(const QByteArray& vertexSource, const QByteArray& fragmentSource);
+
+signals:
+	// The sources of a Compile call linked or failed to, log holds the compiler's messages
+	void Compiled(QByteArray vertexSource, QByteArray fragmentSource, bool success, QString log);
+
+private:
+	QThread m_thread;
+	QObject* m_pWorker = nullptr;
+	QOpenGLContext* m_pContext = nullptr;
+	QOffscreenSurface* m_pSurface = nullptr;
+};
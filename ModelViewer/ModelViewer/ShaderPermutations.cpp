@@ -0,0 +1,211 @@
+#include "ShaderPermutations.h"
+#include "GpuModelBuilder.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLShaderProgram>
+
+
+namespace {
+
+const char* const k_permutationMacro = "SHADER_PERMUTATION";
+
+// Macro of each ShaderFeature, in bit order
+const char* const k_featureMacros[k_featureCount] = { "HAS_NORMALS", "HAS_UV", "HAS_TEXTURE", "HAS_COLOR", "HAS_SKIN" };
+
+}
+
+ShaderPermutations::~ShaderPermutations()
+{
+	// Variants left at this point go with the context
+	for (Variant& variant : m_variants) {
+		delete variant.m_pProgram;
+	}
+	for (Variant& variant : m_depthNormals) {
+		delete variant.m_pProgram;
+	}
+	delete m_depthOnly.m_pProgram;
+}
+
+void ShaderPermutations::SetSources(const QByteArray& vertexSource, const QByteArray& fragmentSource)
+{
+	Clear();
+	m_vertexSource = vertexSource;
+	m_fragmentSource = fragmentSource;
+	m_active = vertexSource.contains(k_permutationMacro) || fragmentSource.contains(k_permutationMacro);
+	m_usedFeatures = UsedFeatures(vertexSource) | UsedFeatures(fragmentSource);
+}
+
+void ShaderPermutations::Clear()
+{
+	for (Variant& variant : m_variants) {
+		delete variant.m_pProgram;
+	}
+	m_variants.clear();
+	for (Variant& variant : m_depthNormals) {
+		delete variant.m_pProgram;
+	}
+	m_depthNormals.clear();
+	delete m_depthOnly.m_pProgram;
+	m_depthOnly = Variant();
+	m_depthOnlyLinked = false;
+	m_active = false;
+	m_usedFeatures = 0;
+}
+
+bool ShaderPermutations::IsActive() const
+{
+	return m_active;
+}
+
+int ShaderPermutations::FeatureMask(const Mesh& mesh) const
+{
+	int mask = 0;
+	mask |= mesh.m_hasNormals ? k_featureNormals : 0;
+	mask |= mesh.m_hasUVCoordinates ? k_featureUVs : 0;
+	mask |= mesh.m_hasTexture ? k_featureTexture : 0;
+	mask |= mesh.m_hasColors ? k_featureColors : 0;
+	mask |= mesh.m_hasBones && !mesh.m_computeSkinned ? k_featureSkinning : 0;
+	return mask & m_usedFeatures;
+}
+
+const ShaderPermutations::Variant* ShaderPermutations::Get(int mask)
+{
+	auto it = m_variants.find(mask);
+	if (it == m_variants.end()) {
+		// Failed variants are remembered too, so they aren't linked again every frame
+		Variant variant;
+		if (!Link(variant, Specialize(m_vertexSource, mask), Specialize(m_fragmentSource, mask))) {
+			qWarning("Could not link shader permutation %d", mask);
+		}
+		it = m_variants.insert(mask, variant);
+	}
+	return it->m_pProgram ? &it.value() : nullptr;
+}
+
+int ShaderPermutations::VariantCount() const
+{
+	return m_variants.size();
+}
+
+const ShaderPermutations::Variant* ShaderPermutations::DepthOnly()
+{
+	if (!m_depthOnlyLinked && !m_vertexSource.isEmpty()) {
+		m_depthOnlyLinked = true;
+		if (!Link(m_depthOnly, m_vertexSource, DepthFragmentSource(m_vertexSource))) {
+			qWarning("Could not link the depth only program");
+		}
+	}
+	return m_depthOnly.m_pProgram ? &m_depthOnly : nullptr;
+}
+
+const ShaderPermutations::Variant* ShaderPermutations::DepthNormals(int mask)
+{
+	auto it = m_depthNormals.find(mask);
+	if (it == m_depthNormals.end()) {
+		Variant variant;
+		if (!m_vertexSource.isEmpty() && !Link(variant, Specialize(m_vertexSource, mask), DepthNormalFragmentSource(m_vertexSource))) {
+			qWarning("Could not link the depth and normal program %d", mask);
+		}
+		it = m_depthNormals.insert(mask, variant);
+	}
+	return it->m_pProgram ? &it.value() : nullptr;
+}
+
+QByteArray ShaderPermutations::Specialize(const QByteArray& source, int mask)
+{
+	QByteArray defines = QByteArray("#define ") + k_permutationMacro + "\n";
+	for (int feature = 0; feature < k_featureCount; ++feature) {
+		if (mask & (1 << feature)) {
+			defines += QByteArray("#define ") + k_featureMacros[feature] + "\n";
+		}
+	}
+
+	// Everything has to follow #version, which is the first line if the shader has one
+	QByteArray ret = source;
+	int insertAt = 0;
+	int nextLine = 1;
+	if (source.startsWith("#version")) {
+		const int lineEnd = source.indexOf('\n');
+		insertAt = lineEnd < 0 ? source.size() : lineEnd + 1;
+		nextLine = 2;
+		if (lineEnd < 0) {
+			defines.prepend('\n');
+		}
+	}
+	defines += "#line " + QByteArray::number(nextLine) + "\n";
+	return ret.insert(insertAt, defines);
+}
+
+QByteArray ShaderPermutations::DepthFragmentSource(const QByteArray& vertexSource)
+{
+	QByteArray ret;
+	if (vertexSource.startsWith("#version")) {
+		const int lineEnd = vertexSource.indexOf('\n');
+		ret = (lineEnd < 0 ? vertexSource : vertexSource.left(lineEnd)) + "\n";
+	}
+	ret += "void main() {\n"
+		"   gl_FragColor = vec4(0.1, 0.05, 0.02, 1.0);\n"
+		"}\n";
+	return ret;
+}
+
+QByteArray ShaderPermutations::DepthNormalFragmentSource(const QByteArray& vertexSource)
+{
+	QByteArray ret;
+	if (vertexSource.startsWith("#version")) {
+		const int lineEnd = vertexSource.indexOf('\n');
+		ret = (lineEnd < 0 ? vertexSource : vertexSource.left(lineEnd)) + "\n";
+	}
+	// vEs points from the surface to the eye, so its z is the depth in front of the camera
+	ret += "in vec3 vNs;\n"
+		"in vec3 vEs;\n"
+		"void main() {\n"
+		"   vec3 normal = vNs;\n"
+		"   if (dot(normal, normal) < 1e-8) {\n"
+		"      normal = cross(dFdx(vEs), dFdy(vEs));\n"
+		"   }\n"
+		"   normal = normalize(normal);\n"
+		"   gl_FragColor = vec4(dot(normal, vEs) < 0.0 ? -normal : normal, vEs.z);\n"
+		"}\n";
+	return ret;
+}
+
+int ShaderPermutations::UsedFeatures(const QByteArray& source)
+{
+	int features = 0;
+	for (int feature = 0; feature < k_featureCount; ++feature) {
+		if (source.contains(k_featureMacros[feature])) {
+			features |= 1 << feature;
+		}
+	}
+	return features;
+}
+
+bool ShaderPermutations::Link(Variant& variant, const QByteArray& vertexSource, const QByteArray& fragmentSource)
+{
+	// Linked from the program binary cache after the first time
+	variant.m_pProgram = new QOpenGLShaderProgram();
+	variant.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+	variant.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+	GpuModelBuilder::BindAttributeLocations(variant.m_pProgram);
+	if (!variant.m_pProgram->link()) {
+		qWarning("%s", qPrintable(variant.m_pProgram->log()));
+		delete variant.m_pProgram;
+		variant.m_pProgram = nullptr;
+		return false;
+	}
+	QOpenGLShaderProgram* pProgram = variant.m_pProgram;
+	UniformBlocks::BindBlock(pProgram, "FrameBlock", k_frameBlockBinding);
+	UniformBlocks::BindMaterial(pProgram);
+	UniformBlocks::BindBlock(pProgram, "BonePalette", k_bonePaletteBinding);
+	UniformBlocks::BindShadows(pProgram);
+	UniformBlocks::BindLights(pProgram);
+	UniformBlocks::BindEnvironment(pProgram);
+	variant.m_matrixUniform = pProgram->uniformLocation("matrix");
+	variant.m_modelviewUniform = pProgram->uniformLocation("modelview");
+	variant.m_normalUniform = pProgram->uniformLocation("normalMat");
+	variant.m_textureUniform = pProgram->uniformLocation("uTexture");
+	variant.m_hasTextureUniform = pProgram->uniformLocation("uHasTexture");
+	variant.m_instanceAttr = pProgram->attributeLocation("instanceAttr");
+	return true;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <QByteArray>
+#include <QHash>
+#include <qopengl.h>
+
+struct Mesh;
+class QOpenGLShaderProgram;
+
+// Mesh features a model shader can be specialized for. A variant's sources define
+// SHADER_PERMUTATION and the HAS_ macro of each feature in its mask.
+enum ShaderFeature : int {
+	k_featureNormals = 1 << 0, // HAS_NORMALS
+	k_featureUVs = 1 << 1, // HAS_UV
+	k_featureTexture = 1 << 2, // HAS_TEXTURE
+	k_featureColors = 1 << 3, // HAS_COLOR
+	k_featureSkinning = 1 << 4, // HAS_SKIN
+	k_featureCount = 5,
+};
+
+// Variants of the model program with the features of a mesh compiled in, so meshes without a
+// texture or normals skip the fetches and blends for them. Only sources that check
+// SHADER_PERMUTATION get variants, and only the features they check split them.
+class ShaderPermutations
+{
+public:
+	// A linked variant and the per mesh uniforms DrawMesh sets. Per frame state comes from the
+	// uniform blocks, which variants must declare.
+	struct Variant {
+		QOpenGLShaderProgram* m_pProgram = nullptr;
+		GLint m_matrixUniform = -1;
+		GLint m_modelviewUniform = -1;
+		GLint m_normalUniform = -1;
+		GLint m_textureUniform = -1;
+		GLint m_hasTextureUniform = -1;
+		GLint m_instanceAttr = -1;
+	};
+
+	~ShaderPermutations();
+
+	// Takes the expanded sources of the model program and drops the variants of the previous
+	// ones. The context the variants were linked in has to be current.
+	void SetSources(const QByteArray& vertexSource, const QByteArray& fragmentSource);
+	void Clear();
+
+	// Whether the sources check SHADER_PERMUTATION
+	bool IsActive() const;
+
+	// The features of mesh the sources check for
+	int FeatureMask(const Mesh& mesh) const;
+
+	// The variant for a mask from FeatureMask, linked the first time it is asked for. Null if
+	// it doesn't link.
+	const Variant* Get(int mask);
+	int VariantCount() const;
+
+	// The vertex shader with a fragment shader that only writes a constant color, for the depth
+	// pre-pass and the overdraw view. Linked the first time it is asked for, null if it doesn't
+	// link. Like the other variants it takes the projection from the frame block.
+	const Variant* DepthOnly();
+
+	// The variant of the vertex shader for a mask from FeatureMask with a fragment shader that
+	// writes the eye space normal and linear depth, for the AmbientOcclusion pass. Needs the
+	// vertex shader to pass on vNs and vEs like the default one. Null if it doesn't link.
+	const Variant* DepthNormals(int mask);
+
+	// Source with the defines of mask added after its #version line. Line numbers in compiler
+	// messages still match the file.
+	static QByteArray Specialize(const QByteArray& source, int mask);
+
+	// The features whose macros appear in source
+	static int UsedFeatures(const QByteArray& source);
+
+	// Fragment shader of DepthOnly, with the #version of vertexSource. Each fragment adds
+	// about a tenth of red to an overdraw view, so layers show as red turning yellow.
+	static QByteArray DepthFragmentSource(const QByteArray& vertexSource);
+
+	// Fragment shader of DepthNormals, with the #version of vertexSource. Meshes without normals
+	// get their faces' normals from the slopes of the position.
+	static QByteArray DepthNormalFragmentSource(const QByteArray& vertexSource);
+
+private:
+	QByteArray m_vertexSource;
+	QByteArray m_fragmentSource;
+	int m_usedFeatures = 0;
+	bool m_active = false;
+	QHash<int, Variant> m_variants;
+	Variant m_depthOnly;
+	bool m_depthOnlyLinked = false;
+	QHash<int, Variant> m_depthNormals;
+
+	static bool Link(Variant& variant, const QByteArray& vertexSource, const QByteArray& fragmentSource);
+};
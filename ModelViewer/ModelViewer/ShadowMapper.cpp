@@ -0,0 +1,491 @@
+#include "ShadowMapper.h"
+#include "Frustum.h"
+#include "GeometryStreamer.h"
+#include "GpuModelBuilder.h"
+#include "StateCache.h"
+#include "StreamBuffer.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+#include <QtMath>
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+
+namespace {
+
+// Depth only, skinned meshes are posed like ads.vert and BonePalette.glsl pose them
+const char* k_shadowVertexShaderSource =
+	"in highp vec4 posAttr;\n"
+	"in highp mat4 instanceAttr;\n"
+	"uniform highp mat4 matrix;\n"
+	"#ifdef HAS_SKIN\n"
+	"in highp vec4 boneIndexAttr;\n"
+	"in highp vec4 boneWeightAttr;\n"
+	"#include \"BonePalette.glsl\"\n"
+	"#endif\n"
+	"void main() {\n"
+	"   vec4 position = posAttr;\n"
+	"#ifdef HAS_SKIN\n"
+	"   position = (boneWeightAttr.x * uBones[int(boneIndexAttr.x)]\n"
+	"      + boneWeightAttr.y * uBones[int(boneIndexAttr.y)]\n"
+	"      + boneWeightAttr.z * uBones[int(boneIndexAttr.z)]\n"
+	"      + boneWeightAttr.w * uBones[int(boneIndexAttr.w)]) * position;\n"
+	"#endif\n"
+	"   gl_Position = matrix * instanceAttr * position;\n"
+	"}\n";
+
+const char* k_shadowFragmentShaderSource =
+	"#version 330\n"
+	"void main() {\n"
+	"}\n";
+
+// Casters between the light and the model's bounds still have to be in the map, so the depth
+// range reaches a radius further toward the light than the bounds
+const float k_casterMargin = 1.f;
+
+// How many radii away directional light is placed, far enough for the shading to see it as
+// parallel
+const float k_directionalDistance = 1000.f;
+
+// Blend of logarithmic and even cascade splits, logarithmic gives near slices more detail
+const float k_logarithmicSplits = 0.75f;
+
+QVector3D UpVector(const QVector3D& direction)
+{
+	// Any vector will do that isn't parallel to the direction
+	return std::abs(direction.y()) > 0.99f ? QVector3D(1, 0, 0) : QVector3D(0, 1, 0);
+}
+
+// Bounds of the eight corners of a box after transform
+void TransformedBounds(const QMatrix4x4& transform, const QVector3D& min, const QVector3D& max, QVector3D& outMin, QVector3D& outMax)
+{
+	outMin = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+	outMax = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int corner = 0; corner < 8; ++corner) {
+		const QVector3D point = transform.map(QVector3D(corner & 1 ? max.x() : min.x(), corner & 2 ? max.y() : min.y(), corner & 4 ? max.z() : min.z()));
+		for (int i = 0; i < 3; ++i) {
+			outMin[i] = std::min(outMin[i], point[i]);
+			outMax[i] = std::max(outMax[i], point[i]);
+		}
+	}
+}
+
+}
+
+bool ShadowMapper::Options::operator==(const Options& other) const
+{
+	return m_mode == other.m_mode && m_cascades == other.m_cascades && m_filterRadius == other.m_filterRadius && m_mapSize == other.m_mapSize;
+}
+
+ShadowMapper::~ShadowMapper()
+{
+	// The map and buffers go with the context, only the programs are left
+	delete m_static.m_pProgram;
+	delete m_skinned.m_pProgram;
+}
+
+bool ShadowMapper::Create()
+{
+	Destroy();
+
+	// Depth texture arrays that compare need OpenGL 3.3 or OpenGL ES 3.0. Uniform blocks are
+	// checked first so Bind can turn shadows off without them.
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || !UniformBlocks::SupportsUniformBuffers()) {
+		return false;
+	}
+	m_pFunctions = pContext->extraFunctions();
+	if (pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+	if (!LinkPass(m_static, false) || !LinkPass(m_skinned, true)) {
+		qWarning("Could not link the shadow map shaders");
+		delete m_static.m_pProgram;
+		delete m_skinned.m_pProgram;
+		m_static = Pass();
+		m_skinned = Pass();
+		return false;
+	}
+	m_pFunctions->glGenFramebuffers(1, &m_framebuffer);
+	m_pFunctions->glGenTextures(1, &m_map);
+	m_created = true;
+	return true;
+}
+
+void ShadowMapper::Destroy()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		m_pFunctions->glDeleteFramebuffers(1, &m_framebuffer);
+		m_pFunctions->glDeleteTextures(1, &m_map);
+	}
+	delete m_static.m_pProgram;
+	delete m_skinned.m_pProgram;
+	m_static = Pass();
+	m_skinned = Pass();
+	m_framebuffer = 0;
+	m_map = 0;
+	m_mapSize = 0;
+	m_mapLayers = 0;
+	m_pFunctions = nullptr;
+	m_created = false;
+	m_valid = false;
+}
+
+bool ShadowMapper::IsCreated() const
+{
+	return m_created;
+}
+
+void ShadowMapper::Invalidate()
+{
+	m_valid = false;
+}
+
+bool ShadowMapper::Update(Model& model, const Options& options, const QVector3D& lightPosition, const QMatrix4x4& projection, const QMatrix4x4& modelView)
+{
+	if (!m_created || options.m_mode == k_shadowsOff) {
+		return false;
+	}
+
+	// The fit is a few matrix products, worked out every frame to find whether anything moved
+	QMatrix4x4 lightMatrices[k_maxCascades];
+	float splits[k_maxCascades] = {};
+	const int cascades = FitLight(options, lightPosition, model.m_AABBMin, model.m_AABBMax, projection, modelView, lightMatrices, splits);
+	if (m_valid && options == m_options && cascades == m_cascades && std::equal(lightMatrices, lightMatrices + cascades, m_lightMatrices)) {
+		return false;
+	}
+	if (!AllocateMap(options.m_mapSize, cascades)) {
+		m_valid = false;
+		return false;
+	}
+
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	StateCache& state = StateCache::Current();
+	GLint previousFramebuffer = 0;
+	GLint previousViewport[4] = {};
+	f->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	f->glGetIntegerv(GL_VIEWPORT, previousViewport);
+
+	// Slopes facing away from the light are pushed back further, wider filters reach further
+	// across them
+	f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	state.Viewport(0, 0, m_mapSize, m_mapSize);
+	state.Enable(GL_DEPTH_TEST);
+	state.DepthFunc(GL_LESS);
+	state.Enable(GL_POLYGON_OFFSET_FILL);
+	f->glPolygonOffset(1.5f + float(options.m_filterRadius), 4.f);
+	for (int cascade = 0; cascade < cascades; ++cascade) {
+		f->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_map, 0, cascade);
+		f->glClear(GL_DEPTH_BUFFER_BIT);
+		Draw(model, lightMatrices[cascade]);
+	}
+	state.Disable(GL_POLYGON_OFFSET_FILL);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+	state.Viewport(previousViewport[0], previousViewport[1], previousViewport[2], previousViewport[3]);
+
+	m_options = options;
+	m_cascades = cascades;
+	std::copy(lightMatrices, lightMatrices + cascades, m_lightMatrices);
+	std::copy(splits, splits + cascades, m_splits);
+	m_valid = true;
+	++m_drawCount;
+	return true;
+}
+
+void ShadowMapper::Bind(const QMatrix4x4& modelView, bool enabled, StreamBuffer& stream)
+{
+	if (!m_pFunctions) {
+		return;
+	}
+	ShadowBlock block = {};
+	if (enabled && m_created && m_valid) {
+		// From eye space back into the model, then into the map, from -1..1 to 0..1
+		QMatrix4x4 toTexture;
+		toTexture.translate(0.5f, 0.5f, 0.5f);
+		toTexture.scale(0.5f);
+		const QMatrix4x4 eyeToModel = modelView.inverted();
+		for (int cascade = 0; cascade < m_cascades; ++cascade) {
+			const QMatrix4x4 matrix = toTexture * m_lightMatrices[cascade] * eyeToModel;
+			std::copy(matrix.constData(), matrix.constData() + 16, block.m_matrices[cascade]);
+			block.m_splits[cascade] = m_splits[cascade];
+		}
+		block.m_cascades = m_cascades;
+		block.m_filterRadius = m_options.m_filterRadius;
+		block.m_texelSize = 1.f / float(m_mapSize);
+	}
+
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	stream.BindUniformBlock(k_shadowBlockBinding, &block, sizeof(block));
+	if (m_created) {
+		f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_shadowMapUnit);
+		f->glBindTexture(GL_TEXTURE_2D_ARRAY, m_map);
+		f->glActiveTexture(GL_TEXTURE0);
+	}
+}
+
+int ShadowMapper::DrawCount() const
+{
+	return m_drawCount;
+}
+
+qint64 ShadowMapper::Bytes() const
+{
+	return qint64(m_mapSize) * m_mapSize * m_mapLayers * 4;
+}
+
+QVector3D ShadowMapper::LightPosition(int mode, const QVector3D& light, const QVector3D& min, const QVector3D& max)
+{
+	const QVector3D center = (min + max) * 0.5f;
+	const float radius = std::max((max - min).length() * 0.5f, FLT_MIN);
+	const QVector3D direction = light.isNull() ? QVector3D(0, 0, 1) : light.normalized();
+	if (mode == k_shadowsDirectional) {
+		return center + direction * radius * k_directionalDistance;
+	}
+	return center + direction * radius * std::max(light.length(), 1.05f);
+}
+
+int ShadowMapper::FitLight(const Options& options, const QVector3D& lightPosition, const QVector3D& min, const QVector3D& max,
+	const QMatrix4x4& projection, const QMatrix4x4& modelView, QMatrix4x4* pLightMatrices, float* pSplits)
+{
+	const QVector3D center = (min + max) * 0.5f;
+	const float radius = std::max((max - min).length() * 0.5f, FLT_MIN);
+	QVector3D toLight = lightPosition - center;
+	const float distance = std::max(toLight.length(), radius * 1.05f);
+	toLight = toLight.isNull() ? QVector3D(0, 0, 1) : toLight.normalized();
+
+	// Spot light covers the bounding sphere with its cone
+	if (options.m_mode == k_shadowsSpot) {
+		QMatrix4x4 view;
+		view.lookAt(center + toLight * distance, center, UpVector(toLight));
+		QMatrix4x4 lightProjection;
+		lightProjection.perspective(qRadiansToDegrees(2.f * std::asin(radius / distance)), 1.f, distance - radius, distance + radius);
+		pLightMatrices[0] = lightProjection * view;
+		pSplits[0] = FLT_MAX;
+		return 1;
+	}
+
+	// Directional light looks at the model along the light, its box in light space is what the
+	// map has to cover
+	QMatrix4x4 view;
+	view.lookAt(center + toLight * radius, center, UpVector(toLight));
+	QVector3D lightMin;
+	QVector3D lightMax;
+	TransformedBounds(view, min, max, lightMin, lightMax);
+	const float nearDepth = -lightMax.z() - radius * k_casterMargin;
+	const float farDepth = -lightMin.z();
+	auto Fit = [&](const QVector3D& sliceMin, const QVector3D& sliceMax) {
+		// A little wider, so flat models seen edge on still have an extent
+		const float pad = radius * 1e-3f;
+		QMatrix4x4 lightProjection;
+		lightProjection.ortho(sliceMin.x() - pad, sliceMax.x() + pad, sliceMin.y() - pad, sliceMax.y() + pad, nearDepth, farDepth + pad);
+		return lightProjection * view;
+	};
+
+	// The model's depth range on screen is split into cascades, one without a range in front
+	// of the camera
+	float eyeNear = FLT_MAX;
+	float eyeFar = -FLT_MAX;
+	for (int corner = 0; corner < 8; ++corner) {
+		const float depth = -modelView.map(QVector3D(corner & 1 ? max.x() : min.x(), corner & 2 ? max.y() : min.y(), corner & 4 ? max.z() : min.z())).z();
+		eyeNear = std::min(eyeNear, depth);
+		eyeFar = std::max(eyeFar, depth);
+	}
+	const int cascades = std::max(1, std::min(options.m_cascades, int(k_maxCascades)));
+	if (cascades == 1 || eyeFar <= 0.f) {
+		pLightMatrices[0] = Fit(lightMin, lightMax);
+		pSplits[0] = FLT_MAX;
+		return 1;
+	}
+	eyeNear = std::max(eyeNear, eyeFar * 1e-3f);
+
+	// The view frustum's edges, from where they cross the near plane to the far plane, in eye space
+	const QMatrix4x4 inverseProjection = projection.inverted();
+	QVector3D nearCorners[4];
+	QVector3D farCorners[4];
+	for (int corner = 0; corner < 4; ++corner) {
+		const float x = corner & 1 ? 1.f : -1.f;
+		const float y = corner & 2 ? 1.f : -1.f;
+		nearCorners[corner] = (inverseProjection * QVector4D(x, y, -1.f, 1.f)).toVector3DAffine();
+		farCorners[corner] = (inverseProjection * QVector4D(x, y, 1.f, 1.f)).toVector3DAffine();
+	}
+	const QMatrix4x4 eyeToLight = view * modelView.inverted();
+	float sliceStart = eyeNear;
+	for (int cascade = 0; cascade < cascades; ++cascade) {
+		const float t = float(cascade + 1) / float(cascades);
+		const float logarithmic = eyeNear * std::pow(eyeFar / eyeNear, t);
+		const float even = eyeNear + (eyeFar - eyeNear) * t;
+		const float sliceEnd = cascade + 1 == cascades ? eyeFar : logarithmic * k_logarithmicSplits + even * (1.f - k_logarithmicSplits);
+
+		// Where the slice's edges are in light space, only the part over the model is kept
+		QVector3D sliceMin(FLT_MAX, FLT_MAX, FLT_MAX);
+		QVector3D sliceMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (int corner = 0; corner < 4; ++corner) {
+			const float span = farCorners[corner].z() - nearCorners[corner].z();
+			for (float depth : { sliceStart, sliceEnd }) {
+				const float along = span != 0.f ? (-depth - nearCorners[corner].z()) / span : 0.f;
+				const QVector3D point = eyeToLight.map(nearCorners[corner] + (farCorners[corner] - nearCorners[corner]) * along);
+				for (int i = 0; i < 2; ++i) {
+					sliceMin[i] = std::min(sliceMin[i], point[i]);
+					sliceMax[i] = std::max(sliceMax[i], point[i]);
+				}
+			}
+		}
+		for (int i = 0; i < 2; ++i) {
+			sliceMin[i] = std::max(sliceMin[i], lightMin[i]);
+			sliceMax[i] = std::min(sliceMax[i], lightMax[i]);
+			if (sliceMin[i] >= sliceMax[i]) {
+				sliceMin[i] = lightMin[i];
+				sliceMax[i] = lightMax[i];
+			}
+		}
+		pLightMatrices[cascade] = Fit(sliceMin, sliceMax);
+		pSplits[cascade] = cascade + 1 == cascades ? FLT_MAX : sliceEnd;
+		sliceStart = sliceEnd;
+	}
+	return cascades;
+}
+
+bool ShadowMapper::AllocateMap(int size, int layers)
+{
+	if (size == m_mapSize && layers == m_mapLayers) {
+		return true;
+	}
+
+	// Linear filtering of a compared map blends the results of four texels
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	f->glBindTexture(GL_TEXTURE_2D_ARRAY, m_map);
+	f->glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, layers, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+	f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	f->glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	// Depth only, nothing is drawn to or read from a color buffer
+	GLint previousFramebuffer = 0;
+	f->glGetIntegerv(GL_FRAMEBUFFER_BINDING, &previousFramebuffer);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	const GLenum none = GL_NONE;
+	f->glDrawBuffers(1, &none);
+	f->glReadBuffer(GL_NONE);
+	f->glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_map, 0, 0);
+	const bool complete = f->glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	f->glBindFramebuffer(GL_FRAMEBUFFER, GLuint(previousFramebuffer));
+	if (!complete) {
+		qWarning("Could not create a %dx%d shadow map", size, size);
+		m_mapSize = 0;
+		m_mapLayers = 0;
+		return false;
+	}
+	m_mapSize = size;
+	m_mapLayers = layers;
+	return true;
+}
+
+void ShadowMapper::Draw(Model& model, const QMatrix4x4& lightMatrix)
+{
+	// Every mesh in the light's view casts, whether or not the camera sees it
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	const Frustum frustum(lightMatrix);
+	const QMatrix4x4 identity;
+	const Pass* pBound = nullptr;
+	QOpenGLVertexArrayObject* pBoundVao = nullptr;
+	std::vector<std::pair<int, int>> runs;
+	for (Mesh& mesh : model.m_meshes) {
+		if (!GeometryStreamer::IsResident(mesh) || mesh.IsHidden() || !frustum.Intersects(mesh.m_AABBMin, mesh.m_AABBMax)) {
+			continue;
+		}
+		const bool skinned = mesh.m_hasBones && !mesh.m_computeSkinned && mesh.m_boneBuffer.isCreated();
+		const Pass* pPass = skinned ? &m_skinned : &m_static;
+		if (pPass != pBound) {
+			pPass->m_pProgram->bind();
+			pPass->m_pProgram->setAttributeValue(k_instanceLocation, identity.constData(), 4, 4);
+			pBound = pPass;
+		}
+		if (skinned) {
+			f->glBindBufferBase(GL_UNIFORM_BUFFER, k_bonePaletteBinding, mesh.m_boneBuffer.bufferId());
+		}
+		if (mesh.m_vao) {
+			mesh.m_vao->bind();
+			pBoundVao = mesh.m_vao.data();
+		}
+		else {
+			if (pBoundVao) {
+				pBoundVao->release();
+				pBoundVao = nullptr;
+			}
+			mesh.m_vertexBuffer.bind();
+			mesh.m_indexBuffer.bind();
+			GpuModelBuilder::EnableAttributes(f, mesh);
+		}
+
+		// Levels of detail would let the shadows shift as the camera moves, so casters are
+		// drawn at full detail. Hidden instances cast no shadow.
+		GpuModelBuilder::VisibleRuns(mesh, runs);
+		if (mesh.m_instanced) {
+			pPass->m_pProgram->setUniformValue(pPass->m_matrixUniform, lightMatrix * mesh.m_placement);
+			for (const std::pair<int, int>& run : runs) {
+				if (mesh.m_hiddenDrawCount > 0) {
+					GpuModelBuilder::SetFirstInstance(f, mesh, run.first);
+				}
+				GpuModelBuilder::DrawElements(f, mesh, 0, mesh.m_indexCount, run.second);
+			}
+			if (mesh.m_hiddenDrawCount > 0) {
+				GpuModelBuilder::SetFirstInstance(f, mesh, 0);
+			}
+		}
+		else if (!mesh.m_instanceTransforms.empty()) {
+			for (const std::pair<int, int>& run : runs) {
+				for (int i = run.first; i < run.first + run.second; ++i) {
+					pPass->m_pProgram->setUniformValue(pPass->m_matrixUniform, lightMatrix * mesh.m_instanceTransforms[i] * mesh.m_positionDecode);
+					GpuModelBuilder::DrawElements(f, mesh, 0, mesh.m_indexCount);
+				}
+			}
+		}
+		else {
+			pPass->m_pProgram->setUniformValue(pPass->m_matrixUniform, lightMatrix * mesh.m_transform * mesh.m_positionDecode);
+			GpuModelBuilder::DrawElements(f, mesh, 0, mesh.m_indexCount);
+		}
+
+		if (!mesh.m_vao) {
+			GpuModelBuilder::DisableAttributes(f, mesh);
+			mesh.m_vertexBuffer.release();
+			mesh.m_indexBuffer.release();
+		}
+	}
+	if (pBoundVao) {
+		pBoundVao->release();
+	}
+	if (pBound) {
+		pBound->m_pProgram->release();
+	}
+}
+
+bool ShadowMapper::LinkPass(Pass& pass, bool skinned)
+{
+	const QByteArray vertexSource = QByteArray("#version 330\n") + (skinned ? "#define HAS_SKIN\n" : "")
+		+ UniformBlocks::ExpandInclude(k_shadowVertexShaderSource);
+
+	// Linked from the program binary cache after the first time
+	pass.m_pProgram = new QOpenGLShaderProgram();
+	pass.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+	pass.m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, k_shadowFragmentShaderSource);
+	GpuModelBuilder::BindAttributeLocations(pass.m_pProgram);
+	if (!pass.m_pProgram->link()) {
+		qWarning("%s", qPrintable(pass.m_pProgram->log()));
+		return false;
+	}
+	if (skinned && !UniformBlocks::BindBlock(pass.m_pProgram, "BonePalette", k_bonePaletteBinding)) {
+		return false;
+	}
+	pass.m_matrixUniform = pass.m_pProgram->uniformLocation("matrix");
+	return true;
+}
@@ -0,0 +1,105 @@
+#pragma once
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <qopengl.h>
+
+class QOpenGLExtraFunctions;
+class QOpenGLShaderProgram;
+class StreamBuffer;
+struct Model;
+
+// How the light casts shadows, the ViewerGraphicsWindow/shadowMode setting
+enum ShadowMode : int {
+	k_shadowsOff = 0,
+	k_shadowsDirectional = 1, // Parallel light from the side of the model the light is on
+	k_shadowsSpot = 2, // Light spreading out from the light's position toward the model
+};
+
+// Shadows of the light on the model, from a depth map drawn from the light. While shadows are
+// on the light is fixed to the model instead of the camera, so the map only depends on the
+// light and the model: it is drawn when either changes, and every other frame only reads it.
+// A model at rest costs a few texture taps per pixel, however the camera moves.
+// Directional light can be split into cascades along the view, each covering a slice of the
+// model's depth on screen with the whole map. Those follow the camera, they are drawn again
+// whenever it moves.
+class ShadowMapper
+{
+public:
+	static const int k_maxCascades = 4;
+
+	struct Options {
+		int m_mode = k_shadowsOff;
+		int m_cascades = 1;
+		int m_filterRadius = 1; // Taps of the filter on either side of the center, 0 for one tap
+		int m_mapSize = 2048;
+
+		bool operator==(const Options& other) const;
+		bool operator!=(const Options& other) const { return !(*this == other); }
+	};
+
+	~ShadowMapper();
+
+	// Creating and destroying the map and programs requires the context they are used in to be
+	// current. Create returns false without OpenGL 3.3, Bind then turns shadows off.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Has the next Update draw the map again, for when the model or its pose changed
+	void Invalidate();
+
+	// Fits the light at lightPosition, in model space, to model and draws the map if the fit or
+	// the options changed since it was last drawn, or it was invalidated. projection and
+	// modelView are the camera's, only cascades depend on them. Returns true if it drew.
+	// Leaves the framebuffer and viewport it found bound.
+	bool Update(Model& model, const Options& options, const QVector3D& lightPosition, const QMatrix4x4& projection, const QMatrix4x4& modelView);
+
+	// Writes the shadow block for a frame seen through modelView into stream and binds it with
+	// the map. Without enabled, or before the first Update, the block turns shadows off.
+	void Bind(const QMatrix4x4& modelView, bool enabled, StreamBuffer& stream);
+
+	// Times the map was drawn since it was created
+	int DrawCount() const;
+
+	// GPU memory taken by the map
+	qint64 Bytes() const;
+
+	// Where the light shines from for a mode. light is measured from the model's center in
+	// radii of its bounds. Directional light is moved far out in the same direction, so the
+	// shading sees parallel light too, spot light is kept outside the bounds.
+	static QVector3D LightPosition(int mode, const QVector3D& light, const QVector3D& min, const QVector3D& max);
+
+	// The matrices from model space to the clip space of each cascade of the map, lit from
+	// lightPosition and fitted to the bounds, and the eye space depth each cascade ends at.
+	// Returns how many cascades there are.
+	static int FitLight(const Options& options, const QVector3D& lightPosition, const QVector3D& min, const QVector3D& max,
+		const QMatrix4x4& projection, const QMatrix4x4& modelView, QMatrix4x4* pLightMatrices, float* pSplits);
+
+private:
+	bool AllocateMap(int size, int layers);
+	void Draw(Model& model, const QMatrix4x4& lightMatrix);
+
+	// A program drawing depth only, and its matrix
+	struct Pass {
+		QOpenGLShaderProgram* m_pProgram = nullptr;
+		GLint m_matrixUniform = -1;
+	};
+	static bool LinkPass(Pass& pass, bool skinned);
+
+	QOpenGLExtraFunctions* m_pFunctions = nullptr;
+	Pass m_static;
+	Pass m_skinned;
+	GLuint m_framebuffer = 0;
+	GLuint m_map = 0;
+	int m_mapSize = 0;
+	int m_mapLayers = 0;
+	bool m_created = false;
+
+	// What the map was last drawn with
+	Options m_options;
+	QMatrix4x4 m_lightMatrices[k_maxCascades];
+	float m_splits[k_maxCascades] = {};
+	int m_cascades = 0;
+	bool m_valid = false;
+	int m_drawCount = 0;
+};
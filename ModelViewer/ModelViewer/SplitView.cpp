@@ -0,0 +1,65 @@
+#include "SplitView.h"
+#include "Frustum.h"
+#include "MeshBvh.h"
+#include "ModelLoader.h"
+#include "ShaderPermutations.h"
+
+#include <QOpenGLTexture>
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+
+
+QRect SplitView::Cell(const QSize& size, int count, int index)
+{
+	count = std::max(1, std::min(count, k_maxViewports));
+	if (index < 0 || index >= count) {
+		return QRect();
+	}
+
+	// Edges are rounded down, so the cells tile the window without gaps or overlaps
+	const int columns = count == 4 ? 2 : count;
+	const int rows = count == 4 ? 2 : 1;
+	const int column = index % columns;
+	const int row = index / columns;
+	const int left = size.width() * column / columns;
+	const int right = size.width() * (column + 1) / columns;
+	const int top = size.height() * row / rows;
+	const int bottom = size.height() * (row + 1) / rows;
+	return QRect(left, top, right - left, bottom - top);
+}
+
+int SplitView::CellAt(const QSize& size, int count, const QPoint& pos)
+{
+	count = std::max(1, std::min(count, k_maxViewports));
+	for (int index = 0; index < count; ++index) {
+		if (Cell(size, count, index).contains(pos)) {
+			return index;
+		}
+	}
+	return -1;
+}
+
+void SplitView::Gather(const Model& model, const MeshBvh& bvh, const ShaderPermutations& permutations, const std::vector<QVector4D>& sectionPlanes, std::vector<View>& views)
+{
+	auto GatherView = [&](View& view) {
+		const QMatrix4x4 modelViewProjection = view.m_projection * view.m_model;
+		bvh.CollectVisible(Frustum(modelViewProjection, sectionPlanes.data(), int(sectionPlanes.size())), view.m_visible);
+
+		// Keyed like the queue of the single view
+		view.m_queue.Clear();
+		for (int meshIdx : view.m_visible) {
+			const Mesh& mesh = model.m_meshes[meshIdx];
+			const int program = view.m_permuted ? permutations.FeatureMask(mesh) : 0;
+			const GLuint texture = mesh.m_hasTexture && !view.m_bindless ? mesh.m_material->m_maps[k_baseColorMap]->textureId() : 0;
+			const QVector3D center = (mesh.m_AABBMin + mesh.m_AABBMax) * 0.5f;
+			const float depth = (modelViewProjection * QVector4D(center, 1.f)).w();
+			view.m_queue.Add(RenderQueue::MakeKey(program, texture, mesh.m_vertexBuffer.bufferId(), depth), meshIdx);
+		}
+		view.m_queue.Sort();
+	};
+
+	// Jobs queued on the pool would wait behind loads and conversions that hold every worker.
+	// blockingMap gathers on the calling thread too, which takes the views no worker took.
+	QtConcurrent::blockingMap(views, GatherView);
+}
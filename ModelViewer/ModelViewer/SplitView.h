@@ -0,0 +1,48 @@
+#pragma once
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QPoint>
+#include <QRect>
+#include <QSize>
+#include <QVector4D>
+
+#include "RenderQueue.h"
+
+struct Model;
+class MeshBvh;
+class ShaderPermutations;
+
+// Lays the window out as up to k_maxViewports views of the same model and gathers what each of
+// them draws. Every view reads the one copy of the model on the GPU, only its camera and its
+// program differ. Culling a view and sorting its queue only reads the model, so the views are
+// gathered at once, each on a worker thread, before any of them is drawn.
+class SplitView
+{
+public:
+	static const int k_maxViewports = 4;
+
+	// What one viewport draws in a frame. The keys only tell program variants apart where the
+	// view is drawn with the permuted model program, and textures where they are bound.
+	struct View {
+		QMatrix4x4 m_projection;
+		QMatrix4x4 m_model;
+		bool m_permuted = false;
+		bool m_bindless = false;
+		std::vector<int> m_visible;
+		RenderQueue m_queue;
+	};
+
+	// The rectangle of viewport index out of count in a window of size, top row first as Qt
+	// lays widgets out. Two viewports are side by side, three are columns and four a grid.
+	static QRect Cell(const QSize& size, int count, int index);
+
+	// The viewport at pos, -1 if it is outside the window
+	static int CellAt(const QSize& size, int count, const QPoint& pos);
+
+	// Culls the meshes of model against each view and the section planes, which are in model
+	// space, and sorts the ones left into its queue. The views are gathered in a parallel loop
+	// the calling thread works through as well, so a frame never waits for workers that are
+	// busy with other jobs.
+	static void Gather(const Model& model, const MeshBvh& bvh, const ShaderPermutations& permutations, const std::vector<QVector4D>& sectionPlanes, std::vector<View>& views);
+};
@@ -0,0 +1,75 @@
+#include "StartupTrace.h"
+
+#include <QStringList>
+
+#include <algorithm>
+
+
+namespace {
+
+QString g_file;
+qint64 g_finishNs = -1;
+
+QString Milliseconds(qint64 ns)
+{
+	return QString("%1 ms").arg(double(ns) * 1e-6, 0, 'f', 1);
+}
+
+}
+
+ImportTrace& StartupTrace::Trace()
+{
+	static ImportTrace trace;
+	return trace;
+}
+
+ImportTrace* StartupTrace::Active()
+{
+	return IsFinished() ? nullptr : &Trace();
+}
+
+void StartupTrace::SetFile(const QString& filepath)
+{
+	g_file = filepath;
+}
+
+void StartupTrace::Finish()
+{
+	if (IsFinished()) {
+		return;
+	}
+	ImportTrace& trace = Trace();
+	qint64 lastStageNs = 0;
+	for (const ImportTrace::Event& event : trace.Events()) {
+		if (event.m_level == ImportTrace::k_stage) {
+			lastStageNs = std::max(lastStageNs, event.m_endNs);
+		}
+	}
+	g_finishNs = trace.Now();
+	trace.Add("first paint", ImportTrace::k_stage, lastStageNs, g_finishNs);
+
+	qInfo("%s", qPrintable(Summary()));
+	if (!g_file.isEmpty() && !trace.Save(g_file)) {
+		qWarning("Could not write the startup trace to %s", qPrintable(g_file));
+	}
+}
+
+bool StartupTrace::IsFinished()
+{
+	return g_finishNs >= 0;
+}
+
+qint64 StartupTrace::DurationNs()
+{
+	return std::max(qint64(0), g_finishNs);
+}
+
+QString StartupTrace::Summary(int maxStages)
+{
+	const std::vector<std::pair<const char*, qint64>> totals = Trace().StageTotals();
+	QStringList stages;
+	for (int i = 0; i < std::min(maxStages, int(totals.size())); ++i) {
+		stages += QString("%1 %2").arg(totals[i].first, Milliseconds(totals[i].second));
+	}
+	return QString("Started in %1: %2").arg(Milliseconds(DurationNs()), stages.join(", "));
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include "ImportTrace.h"
+
+#include <QString>
+
+// Spans of the start of the viewer, from the top of main to the first paint of the landing
+// page: making the application and the main window, creating the context and linking the
+// programs the first frame needs. Stages follow each other, the window's steps are parts of
+// them. The summary is logged when the start finishes, and the trace saved if a file was set.
+class StartupTrace
+{
+public:
+	// The clock starts the first time the trace is asked for
+	static ImportTrace& Trace();
+
+	// The trace while the start lasts, null once it finished so scopes taken later add nothing
+	static ImportTrace* Active();
+
+	// Where Finish saves the trace as a Chrome trace, none by default
+	static void SetFile(const QString& filepath);
+
+	// Ends the start with a stage from the end of the last one, at the first paint of the
+	// landing page. Only the first call does anything.
+	static void Finish();
+	static bool IsFinished();
+
+	// From the start of the trace to Finish, 0 before it finished
+	static qint64 DurationNs();
+
+	// The duration and the longest stages on one line
+	static QString Summary(int maxStages = 4);
+};
@@ -0,0 +1,186 @@
+#include "StateCache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QVariant>
+
+#include <algorithm>
+
+
+namespace {
+
+// Name of the property of the context that holds its cache
+const char* k_cacheProperty = "modelViewerStateCache";
+
+}
+
+StateCache& StateCache::Current()
+{
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	StateCache* pCache = static_cast<StateCache*>(pContext->property(k_cacheProperty).value<void*>());
+	if (!pCache) {
+		pCache = new StateCache(pContext->functions());
+		pContext->setProperty(k_cacheProperty, QVariant::fromValue(static_cast<void*>(pCache)));
+
+		// Cleanup that runs after this with the context current gets a new cache
+		QObject::connect(pContext, &QOpenGLContext::aboutToBeDestroyed, [pContext, pCache]() {
+			pContext->setProperty(k_cacheProperty, QVariant());
+			delete pCache;
+		});
+	}
+	return *pCache;
+}
+
+StateCache::StateCache(QOpenGLFunctions* pFunctions)
+	: m_pFunctions(pFunctions)
+{
+}
+
+bool StateCache::Change(bool known, bool same)
+{
+	if (known && same) {
+		++m_skipped;
+		return false;
+	}
+	++m_issued;
+	return true;
+}
+
+void StateCache::Enable(GLenum capability)
+{
+	SetEnabled(capability, true);
+}
+
+void StateCache::Disable(GLenum capability)
+{
+	SetEnabled(capability, false);
+}
+
+void StateCache::SetEnabled(GLenum capability, bool enabled)
+{
+	// A handful of capabilities are used, a search is as quick as a hash
+	auto it = std::find_if(m_capabilities.begin(), m_capabilities.end(), [capability](const Capability& cached) { return cached.m_capability == capability; });
+	if (!Change(it != m_capabilities.end(), it != m_capabilities.end() && it->m_enabled == enabled)) {
+		return;
+	}
+	if (it == m_capabilities.end()) {
+		it = m_capabilities.insert(m_capabilities.end(), Capability{ capability, enabled });
+	}
+	it->m_enabled = enabled;
+	if (enabled) {
+		m_pFunctions->glEnable(capability);
+	}
+	else {
+		m_pFunctions->glDisable(capability);
+	}
+}
+
+void StateCache::BlendFunc(GLenum source, GLenum destination)
+{
+	if (!Change(m_blendKnown, m_blend[0] == source && m_blend[1] == destination && m_blend[2] == source && m_blend[3] == destination)) {
+		return;
+	}
+	m_blend[0] = m_blend[2] = source;
+	m_blend[1] = m_blend[3] = destination;
+	m_blendKnown = true;
+	m_pFunctions->glBlendFunc(source, destination);
+}
+
+void StateCache::BlendFuncSeparate(GLenum sourceColor, GLenum destinationColor, GLenum sourceAlpha, GLenum destinationAlpha)
+{
+	if (!Change(m_blendKnown, m_blend[0] == sourceColor && m_blend[1] == destinationColor && m_blend[2] == sourceAlpha && m_blend[3] == destinationAlpha)) {
+		return;
+	}
+	m_blend[0] = sourceColor;
+	m_blend[1] = destinationColor;
+	m_blend[2] = sourceAlpha;
+	m_blend[3] = destinationAlpha;
+	m_blendKnown = true;
+	m_pFunctions->glBlendFuncSeparate(sourceColor, destinationColor, sourceAlpha, destinationAlpha);
+}
+
+void StateCache::DepthFunc(GLenum func)
+{
+	if (!Change(m_depthFuncKnown, m_depthFunc == func)) {
+		return;
+	}
+	m_depthFunc = func;
+	m_depthFuncKnown = true;
+	m_pFunctions->glDepthFunc(func);
+}
+
+void StateCache::DepthMask(bool write)
+{
+	if (!Change(m_depthMaskKnown, m_depthMask == write)) {
+		return;
+	}
+	m_depthMask = write;
+	m_depthMaskKnown = true;
+	m_pFunctions->glDepthMask(write ? GL_TRUE : GL_FALSE);
+}
+
+void StateCache::ColorMask(bool write)
+{
+	if (!Change(m_colorMaskKnown, m_colorMask == write)) {
+		return;
+	}
+	m_colorMask = write;
+	m_colorMaskKnown = true;
+	const GLboolean mask = write ? GL_TRUE : GL_FALSE;
+	m_pFunctions->glColorMask(mask, mask, mask, mask);
+}
+
+void StateCache::LineWidth(GLfloat width)
+{
+	if (!Change(m_lineWidthKnown, m_lineWidth == width)) {
+		return;
+	}
+	m_lineWidth = width;
+	m_lineWidthKnown = true;
+	m_pFunctions->glLineWidth(width);
+}
+
+void StateCache::Viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+{
+	if (!Change(m_viewportKnown, m_viewport[0] == x && m_viewport[1] == y && m_viewport[2] == width && m_viewport[3] == height)) {
+		return;
+	}
+	m_viewport[0] = x;
+	m_viewport[1] = y;
+	m_viewport[2] = width;
+	m_viewport[3] = height;
+	m_viewportKnown = true;
+	m_pFunctions->glViewport(x, y, width, height);
+}
+
+void StateCache::Invalidate()
+{
+	m_capabilities.clear();
+	m_blendKnown = false;
+	m_depthFuncKnown = false;
+	m_depthMaskKnown = false;
+	m_colorMaskKnown = false;
+	m_lineWidthKnown = false;
+	m_viewportKnown = false;
+}
+
+void StateCache::InvalidateViewport()
+{
+	m_viewportKnown = false;
+}
+
+int StateCache::IssuedCalls() const
+{
+	return m_issued;
+}
+
+int StateCache::SkippedCalls() const
+{
+	return m_skipped;
+}
+
+void StateCache::ResetCounts()
+{
+	m_issued = 0;
+	m_skipped = 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <qopengl.h>
+
+#include <vector>
+
+class QOpenGLFunctions;
+
+// Remembers the fixed function state last set in a context and passes only the calls that
+// change it on to the driver, which on some, like llvmpipe, costs as much as a draw. Every pass
+// sets its state through the cache of the current context, so a frame that sets what the last
+// one left behind sets nothing. Code that changes the state around the cache has to restore it
+// or call Invalidate. Vertex attribute arrays belong to the bound vertex array object and aren't
+// cached.
+class StateCache
+{
+public:
+	// The cache of the current context, made the first time it is asked for and deleted with
+	// the context. Requires a current context.
+	static StateCache& Current();
+
+	void Enable(GLenum capability);
+	void Disable(GLenum capability);
+	void SetEnabled(GLenum capability, bool enabled);
+	void BlendFunc(GLenum source, GLenum destination);
+	void BlendFuncSeparate(GLenum sourceColor, GLenum destinationColor, GLenum sourceAlpha, GLenum destinationAlpha);
+	void DepthFunc(GLenum func);
+	void DepthMask(bool write);
+	void ColorMask(bool write);
+	void LineWidth(GLfloat width);
+	void Viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+	// Forgets what was set, the next call of each kind is passed on
+	void Invalidate();
+	void InvalidateViewport();
+
+	// Calls passed on and left out since the counts were last reset
+	int IssuedCalls() const;
+	int SkippedCalls() const;
+	void ResetCounts();
+
+private:
+	explicit StateCache(QOpenGLFunctions* pFunctions);
+
+	// Counts the call and returns true if it changes what is cached
+	bool Change(bool known, bool same);
+
+	struct Capability {
+		GLenum m_capability = 0;
+		bool m_enabled = false;
+	};
+
+	QOpenGLFunctions* m_pFunctions = nullptr;
+	std::vector<Capability> m_capabilities;
+	GLenum m_blend[4] = {};
+	GLenum m_depthFunc = 0;
+	GLfloat m_lineWidth = 0.f;
+	GLint m_viewport[4] = {};
+	bool m_depthMask = false;
+	bool m_colorMask = false;
+	bool m_blendKnown = false;
+	bool m_depthFuncKnown = false;
+	bool m_depthMaskKnown = false;
+	bool m_colorMaskKnown = false;
+	bool m_lineWidthKnown = false;
+	bool m_viewportKnown = false;
+	int m_issued = 0;
+	int m_skipped = 0;
+};
@@ -0,0 +1,258 @@
+#include "StreamBuffer.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <algorithm>
+#include <cstring>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+
+namespace {
+
+typedef void (QOPENGLF_APIENTRYP BufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+// Fences need OpenGL 3.2 or OpenGL ES 3.0
+bool SupportsFences(const QOpenGLContext* pContext)
+{
+	const QSurfaceFormat format = pContext->format();
+	if (pContext->isOpenGLES()) {
+		return format.majorVersion() >= 3;
+	}
+	return format.version() >= qMakePair(3, 2)
+		|| (format.majorVersion() >= 3 && pContext->hasExtension("GL_ARB_sync"));
+}
+
+// Immutable buffer storage, which can stay mapped while the GPU reads it, is core in OpenGL 4.4
+BufferStorage GetBufferStorage(QOpenGLContext* pContext)
+{
+	if (pContext->isOpenGLES()) {
+		return nullptr;
+	}
+	if (pContext->format().version() < qMakePair(4, 4) && !pContext->hasExtension("GL_ARB_buffer_storage")) {
+		return nullptr;
+	}
+	return reinterpret_cast<BufferStorage>(pContext->getProcAddress("glBufferStorage"));
+}
+
+}
+
+bool StreamBuffer::Create(qint64 frameBytes)
+{
+	Destroy();
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || !UniformBlocks::SupportsUniformBuffers()) {
+		return false;
+	}
+	m_fenced = SupportsFences(pContext);
+	m_storage = m_fenced && GetBufferStorage(pContext);
+
+	// Blocks bound from the buffer have to start at a multiple of this
+	GLint alignment = 0;
+	Functions()->glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	m_uniformAlignment = std::max<qint64>(alignment, 16);
+
+	if (!Allocate(std::max<qint64>(frameBytes, m_uniformAlignment))) {
+		return false;
+	}
+	m_created = true;
+	return true;
+}
+
+bool StreamBuffer::Allocate(qint64 frameBytes)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	const GLsizeiptr bytes = GLsizeiptr(frameBytes * (m_fenced ? k_frameCount : 1));
+	f->glGenBuffers(1, &m_buffer);
+	f->glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+	if (m_storage) {
+		const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		GetBufferStorage(QOpenGLContext::currentContext())(GL_COPY_WRITE_BUFFER, bytes, nullptr, flags);
+		m_pMapped = static_cast<uchar*>(f->glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bytes, flags));
+		if (!m_pMapped) {
+			// Immutable storage can't be allocated again, the buffer is made anew
+			f->glDeleteBuffers(1, &m_buffer);
+			f->glGenBuffers(1, &m_buffer);
+			f->glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+			m_storage = false;
+		}
+	}
+	if (!m_pMapped) {
+		f->glBufferData(GL_COPY_WRITE_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+	}
+	f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	m_frameBytes = frameBytes;
+	return m_buffer != 0;
+}
+
+void StreamBuffer::Release(GLuint buffer, uchar* pMapped)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	if (pMapped) {
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+		f->glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	f->glDeleteBuffers(1, &buffer);
+}
+
+void StreamBuffer::Destroy()
+{
+	if (!m_created) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+	for (GLsync& fence : m_fences) {
+		if (fence) {
+			f->glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	for (const std::pair<GLuint, uchar*>& retired : m_retired) {
+		Release(retired.first, retired.second);
+	}
+	m_retired.clear();
+	Release(m_buffer, m_pMapped);
+	m_buffer = 0;
+	m_pMapped = nullptr;
+	m_frameBytes = 0;
+	m_frame = 0;
+	m_used = 0;
+	m_inFrame = false;
+	m_created = false;
+}
+
+bool StreamBuffer::IsCreated() const
+{
+	return m_created;
+}
+
+bool StreamBuffer::IsPersistent() const
+{
+	return m_pMapped != nullptr;
+}
+
+void StreamBuffer::BeginFrame()
+{
+	if (!m_created) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+
+	// The last frame's commands were issued, the buffers it outgrew can go
+	for (const std::pair<GLuint, uchar*>& retired : m_retired) {
+		Release(retired.first, retired.second);
+	}
+	m_retired.clear();
+
+	if (m_fenced) {
+		m_frame = (m_frame + 1) % k_frameCount;
+		GLsync& fence = m_fences[m_frame];
+		if (fence) {
+			f->glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+			f->glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	else {
+		// Without fences the driver hands out fresh storage instead of waiting for the GPU
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		f->glBufferData(GL_COPY_WRITE_BUFFER, GLsizeiptr(m_frameBytes), nullptr, GL_STREAM_DRAW);
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	m_used = 0;
+	m_inFrame = true;
+}
+
+void StreamBuffer::EndFrame()
+{
+	if (!m_inFrame) {
+		return;
+	}
+	if (m_fenced) {
+		m_fences[m_frame] = Functions()->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	m_inFrame = false;
+}
+
+qint64 StreamBuffer::Write(const void* pData, qint64 bytes, qint64 alignment)
+{
+	if (!m_inFrame) {
+		return -1;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+	qint64 offset = (m_used + alignment - 1) / alignment * alignment;
+	if (offset + bytes > m_frameBytes) {
+		// The regions of the frames before are in the old buffer, which they keep reading
+		m_retired.push_back({ m_buffer, m_pMapped });
+		m_buffer = 0;
+		m_pMapped = nullptr;
+		for (GLsync& fence : m_fences) {
+			if (fence) {
+				f->glDeleteSync(fence);
+				fence = nullptr;
+			}
+		}
+		if (!Allocate(std::max(m_frameBytes * 2, bytes + alignment))) {
+			return -1;
+		}
+		m_frame = 0;
+		offset = 0;
+	}
+
+	const qint64 bufferOffset = qint64(m_frame) * m_frameBytes + offset;
+	if (m_pMapped) {
+		std::memcpy(m_pMapped + bufferOffset, pData, size_t(bytes));
+	}
+	else {
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer);
+		void* pRange = m_fenced ? f->glMapBufferRange(GL_COPY_WRITE_BUFFER, GLintptr(bufferOffset), GLsizeiptr(bytes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT) : nullptr;
+		if (pRange) {
+			std::memcpy(pRange, pData, size_t(bytes));
+			f->glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		}
+		else {
+			f->glBufferSubData(GL_COPY_WRITE_BUFFER, GLintptr(bufferOffset), GLsizeiptr(bytes), pData);
+		}
+		f->glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	m_used = offset + bytes;
+	return bufferOffset;
+}
+
+GLuint StreamBuffer::Buffer() const
+{
+	return m_buffer;
+}
+
+bool StreamBuffer::BindUniformBlock(GLuint binding, const void* pData, qint64 bytes)
+{
+	const qint64 offset = Write(pData, bytes, m_uniformAlignment);
+	if (offset < 0) {
+		return false;
+	}
+	Functions()->glBindBufferRange(GL_UNIFORM_BUFFER, binding, m_buffer, GLintptr(offset), GLsizeiptr(bytes));
+	return true;
+}
+
+qint64 StreamBuffer::FrameBytes() const
+{
+	return m_frameBytes;
+}
+
+qint64 StreamBuffer::UsedBytes() const
+{
+	return m_used;
+}
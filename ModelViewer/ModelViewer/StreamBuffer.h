@@ -0,0 +1,62 @@
+#pragma once
+#include <QtGlobal>
+#include <qopengl.h>
+
+#include <vector>
+
+// One buffer for the data written anew every frame: uniform blocks, draw commands and the
+// vertices of the text overlay. It is split into a region per frame in flight. A frame writes
+// into its own region while the GPU still reads those of the frames before, each region is
+// fenced when its frame ends and only written again once the GPU is past it. With
+// GL_ARB_buffer_storage the buffer stays mapped, persistent and coherent, so writing is a copy.
+// Otherwise each write maps its range unsynchronized, and without fences the whole buffer is
+// orphaned every frame instead. Writes that don't fit the region make the buffer grow, the old
+// one is kept until the next frame so what was bound from it stays valid.
+class StreamBuffer
+{
+public:
+	static const int k_frameCount = 3;
+
+	// Creating and destroying the buffer requires the context it is used in to be current.
+	// Returns false without OpenGL 3.1 or OpenGL ES 3.0.
+	bool Create(qint64 frameBytes);
+	void Destroy();
+	bool IsCreated() const;
+	bool IsPersistent() const;
+
+	// Writes go between the two, waiting only when the GPU is k_frameCount frames behind
+	void BeginFrame();
+	void EndFrame();
+
+	// Copies bytes from pData at an offset into Buffer() aligned to alignment, which is
+	// returned. -1 outside of a frame. A later write can move to another buffer, so the buffer
+	// is asked for after each write.
+	qint64 Write(const void* pData, qint64 bytes, qint64 alignment = 16);
+	GLuint Buffer() const;
+
+	// Writes a uniform block and binds it to binding. False if it couldn't be written.
+	bool BindUniformBlock(GLuint binding, const void* pData, qint64 bytes);
+
+	// Size of a region, and how much of the current one has been written
+	qint64 FrameBytes() const;
+	qint64 UsedBytes() const;
+
+private:
+	bool Allocate(qint64 frameBytes);
+	void Release(GLuint buffer, uchar* pMapped);
+
+	GLuint m_buffer = 0;
+	uchar* m_pMapped = nullptr;
+	qint64 m_frameBytes = 0;
+	qint64 m_uniformAlignment = 256;
+	GLsync m_fences[k_frameCount] = {};
+	int m_frame = 0;
+	qint64 m_used = 0;
+	bool m_inFrame = false;
+	bool m_created = false;
+	bool m_fenced = false;
+	bool m_storage = false;
+
+	// Buffers outgrown this frame, deleted once it is over
+	std::vector<std::pair<GLuint, uchar*>> m_retired;
+};
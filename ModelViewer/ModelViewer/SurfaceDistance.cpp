@@ -0,0 +1,330 @@
+#include "SurfaceDistance.h"
+#include "JobSystem.h"
+#include "ModelLoader.h"
+
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace {
+	// Vertices are measured in runs of this many, each run a work item of the thread pool
+	const size_t k_vertexRun = 4096;
+
+	void Grow(QVector3D& min, QVector3D& max, const QVector3D& point) {
+		for (int i = 0; i < 3; ++i) {
+			min[i] = std::min(min[i], point[i]);
+			max[i] = std::max(max[i], point[i]);
+		}
+	}
+
+	// Squared distance from point to the nearest point of the box, 0 inside it
+	float BoxDistanceSquared(const QVector3D& point, const QVector3D& min, const QVector3D& max) {
+		float sum = 0.f;
+		for (int i = 0; i < 3; ++i) {
+			const float d = std::max(std::max(min[i] - point[i], point[i] - max[i]), 0.f);
+			sum += d * d;
+		}
+		return sum;
+	}
+}
+
+
+void SurfaceDistance::Build(const ModelData& data)
+{
+	Clear();
+	for (const MeshData& mesh : data.m_meshes) {
+		const bool quantized = mesh.m_positionType == GL_UNSIGNED_SHORT;
+		const int positionBytes = mesh.m_numPositionComponents * (quantized ? int(sizeof(quint16)) : int(sizeof(float)));
+		if (mesh.m_numPositionComponents < 3 || mesh.m_indexData.size() < qint64(mesh.m_indexCount) * (mesh.m_indexType == GL_UNSIGNED_SHORT ? 2 : 4)) {
+			continue;
+		}
+
+		// Separate attribute blocks start with the positions, so the next block gives the vertex count
+		int vertexCount = 0;
+		if (mesh.m_vertexStride > 0) {
+			vertexCount = mesh.m_vertexData.size() / mesh.m_vertexStride;
+		}
+		else {
+			size_t end = size_t(mesh.m_vertexData.size());
+			for (size_t offset : { mesh.m_normalOffset, mesh.m_uvOffset, mesh.m_colorOffset, mesh.m_boneIndexOffset, mesh.m_boneWeightOffset }) {
+				if (offset > mesh.m_positionOffset) {
+					end = std::min(end, offset);
+				}
+			}
+			vertexCount = int((end - mesh.m_positionOffset) / size_t(positionBytes));
+		}
+		const size_t vertexStride = size_t(mesh.m_vertexStride > 0 ? mesh.m_vertexStride : positionBytes);
+		std::vector<QVector3D> local(size_t(vertexCount));
+		for (int v = 0; v < vertexCount; ++v) {
+			const char* pSrc = mesh.m_vertexData.constData() + mesh.m_positionOffset + size_t(v) * vertexStride;
+			if (quantized) {
+				quint16 q[3];
+				memcpy(q, pSrc, sizeof(q));
+				local[v] = QVector3D(q[0], q[1], q[2]) / 65535.f;
+			}
+			else {
+				float p[3];
+				memcpy(p, pSrc, sizeof(p));
+				local[v] = QVector3D(p[0], p[1], p[2]);
+			}
+		}
+
+		std::vector<GLuint> indices;
+		indices.reserve(size_t(mesh.m_indexCount));
+		const char* pIndices = mesh.m_indexData.constData();
+		for (int i = 0; i + 2 < mesh.m_indexCount; i += 3) {
+			GLuint triangle[3];
+			for (int k = 0; k < 3; ++k) {
+				if (mesh.m_indexType == GL_UNSIGNED_SHORT) {
+					quint16 index;
+					memcpy(&index, pIndices + size_t(i + k) * sizeof(quint16), sizeof(index));
+					triangle[k] = index;
+				}
+				else {
+					memcpy(&triangle[k], pIndices + size_t(i + k) * sizeof(quint32), sizeof(quint32));
+				}
+			}
+			if (triangle[0] < GLuint(vertexCount) && triangle[1] < GLuint(vertexCount) && triangle[2] < GLuint(vertexCount)) {
+				indices.insert(indices.end(), triangle, triangle + 3);
+			}
+		}
+
+		// Instances are drawn with their own transforms in place of the mesh's
+		std::vector<QMatrix4x4> transforms = mesh.m_instanceTransforms;
+		if (transforms.empty()) {
+			transforms.push_back(mesh.m_transform);
+		}
+		for (const QMatrix4x4& transform : transforms) {
+			const QMatrix4x4 toModel = transform * mesh.m_positionDecode;
+			const GLuint base = GLuint(m_positions.size());
+			for (const QVector3D& position : local) {
+				m_positions.push_back(toModel.map(position));
+			}
+			for (GLuint index : indices) {
+				m_indices.push_back(base + index);
+			}
+		}
+	}
+
+	const int triangleCount = int(m_indices.size() / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+	m_items.resize(size_t(triangleCount));
+	std::iota(m_items.begin(), m_items.end(), 0);
+	m_centers.resize(size_t(triangleCount));
+	for (int t = 0; t < triangleCount; ++t) {
+		m_centers[t] = (m_positions[m_indices[t * 3]] + m_positions[m_indices[t * 3 + 1]] + m_positions[m_indices[t * 3 + 2]]) / 3.f;
+	}
+
+	// Splits only stop at leaves of more than half of k_maxLeafSize triangles
+	m_nodes.reserve(4 * size_t(triangleCount) / k_maxLeafSize + 1);
+	BuildNode(0, triangleCount);
+	m_centers = std::vector<QVector3D>();
+}
+
+int SurfaceDistance::BuildNode(int first, int count)
+{
+	const int nodeIdx = int(m_nodes.size());
+	m_nodes.emplace_back();
+
+	// Bounds of the triangles and of their centers
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	QVector3D centerMin = min;
+	QVector3D centerMax = max;
+	for (int i = first; i < first + count; ++i) {
+		const int triangle = m_items[i];
+		for (int k = 0; k < 3; ++k) {
+			Grow(min, max, m_positions[m_indices[triangle * 3 + k]]);
+		}
+		Grow(centerMin, centerMax, m_centers[triangle]);
+	}
+	m_nodes[nodeIdx].m_min = min;
+	m_nodes[nodeIdx].m_max = max;
+	m_nodes[nodeIdx].m_offset = first;
+	m_nodes[nodeIdx].m_count = count;
+
+	const QVector3D centerExtent = centerMax - centerMin;
+	int axis = 0;
+	if (centerExtent.y() > centerExtent[axis]) {
+		axis = 1;
+	}
+	if (centerExtent.z() > centerExtent[axis]) {
+		axis = 2;
+	}
+	if (count <= k_maxLeafSize || centerExtent[axis] <= 0.f) {
+		return nodeIdx;
+	}
+
+	// Half of the triangles on each side keeps the tree shallow whatever the model looks like
+	const int half = count / 2;
+	std::nth_element(m_items.begin() + first, m_items.begin() + first + half, m_items.begin() + first + count, [&](int a, int b) {
+		return m_centers[a][axis] < m_centers[b][axis];
+	});
+	BuildNode(first, half);
+	const int right = BuildNode(first + half, count - half);
+	m_nodes[nodeIdx].m_offset = right;
+	m_nodes[nodeIdx].m_count = 0;
+	return nodeIdx;
+}
+
+void SurfaceDistance::Clear()
+{
+	m_positions.clear();
+	m_indices.clear();
+	m_nodes.clear();
+	m_items.clear();
+	m_centers.clear();
+}
+
+bool SurfaceDistance::IsEmpty() const
+{
+	return m_nodes.empty();
+}
+
+int SurfaceDistance::NodeCount() const
+{
+	return int(m_nodes.size());
+}
+
+const std::vector<QVector3D>& SurfaceDistance::Positions() const
+{
+	return m_positions;
+}
+
+const std::vector<GLuint>& SurfaceDistance::Indices() const
+{
+	return m_indices;
+}
+
+float SurfaceDistance::Distance(const QVector3D& point, float maxDistance) const
+{
+	if (m_nodes.empty()) {
+		return maxDistance;
+	}
+	float best = maxDistance * maxDistance;
+	int stack[64];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0) {
+		const Node& node = m_nodes[stack[--stackSize]];
+		if (BoxDistanceSquared(point, node.m_min, node.m_max) >= best) {
+			continue;
+		}
+		if (node.m_count > 0) {
+			for (int i = node.m_offset; i < node.m_offset + node.m_count; ++i) {
+				const GLuint* pTriangle = &m_indices[size_t(m_items[i]) * 3];
+				const QVector3D closest = ClosestPoint(point, m_positions[pTriangle[0]], m_positions[pTriangle[1]], m_positions[pTriangle[2]]);
+				best = std::min(best, (closest - point).lengthSquared());
+			}
+			continue;
+		}
+
+		// The nearer child goes on top, so its triangles narrow the search before the other
+		// child is looked at. Median splits keep the tree well within the stack.
+		const int left = int(&node - m_nodes.data()) + 1;
+		const int right = node.m_offset;
+		const float leftDistance = BoxDistanceSquared(point, m_nodes[left].m_min, m_nodes[left].m_max);
+		const float rightDistance = BoxDistanceSquared(point, m_nodes[right].m_min, m_nodes[right].m_max);
+		if (leftDistance < rightDistance) {
+			stack[stackSize++] = right;
+			stack[stackSize++] = left;
+		}
+		else {
+			stack[stackSize++] = left;
+			stack[stackSize++] = right;
+		}
+	}
+	return std::sqrt(best);
+}
+
+QVector3D SurfaceDistance::ClosestPoint(const QVector3D& point, const QVector3D& a, const QVector3D& b, const QVector3D& c)
+{
+	// Finds the region of the triangle's plane the point projects into: a corner, an edge or
+	// the inside, from the barycentric coordinates along the way
+	const QVector3D ab = b - a;
+	const QVector3D ac = c - a;
+	const QVector3D ap = point - a;
+	const float d1 = QVector3D::dotProduct(ab, ap);
+	const float d2 = QVector3D::dotProduct(ac, ap);
+	if (d1 <= 0.f && d2 <= 0.f) {
+		return a;
+	}
+	const QVector3D bp = point - b;
+	const float d3 = QVector3D::dotProduct(ab, bp);
+	const float d4 = QVector3D::dotProduct(ac, bp);
+	if (d3 >= 0.f && d4 <= d3) {
+		return b;
+	}
+	const float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f) {
+		return a + ab * (d1 / (d1 - d3));
+	}
+	const QVector3D cp = point - c;
+	const float d5 = QVector3D::dotProduct(ab, cp);
+	const float d6 = QVector3D::dotProduct(ac, cp);
+	if (d6 >= 0.f && d5 <= d6) {
+		return c;
+	}
+	const float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f) {
+		return a + ac * (d2 / (d2 - d6));
+	}
+	const float va = d3 * d6 - d5 * d4;
+	if (va <= 0.f && d4 - d3 >= 0.f && d5 - d6 >= 0.f) {
+		return b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)));
+	}
+
+	// Only degenerate triangles are left without an inside
+	const float sum = va + vb + vc;
+	if (sum <= 0.f) {
+		return a;
+	}
+	return a + ab * (vb / sum) + ac * (vc / sum);
+}
+
+SurfaceComparison SurfaceComparison::Compare(const ModelData& original, const ModelData& compared)
+{
+	SurfaceComparison ret;
+	const QFuture<void> build = JobSystem::Run(JobPriority::Interactive, [&] { ret.m_compared.Build(compared); });
+	ret.m_original.Build(original);
+	JobSystem::Wait(build);
+
+	ret.m_originalDistances = VertexDistances(ret.m_original, ret.m_compared);
+	ret.m_comparedDistances = VertexDistances(ret.m_compared, ret.m_original);
+	double sum = 0.;
+	for (float distance : ret.m_originalDistances) {
+		ret.m_hausdorff = std::max(ret.m_hausdorff, distance);
+		sum += distance;
+	}
+	for (float distance : ret.m_comparedDistances) {
+		ret.m_comparedHausdorff = std::max(ret.m_comparedHausdorff, distance);
+		sum += distance;
+	}
+	ret.m_hausdorff = std::max(ret.m_hausdorff, ret.m_comparedHausdorff);
+	const size_t count = ret.m_originalDistances.size() + ret.m_comparedDistances.size();
+	ret.m_mean = count > 0 ? float(sum / double(count)) : 0.f;
+	return ret;
+}
+
+std::vector<float> SurfaceComparison::VertexDistances(const SurfaceDistance& from, const SurfaceDistance& to)
+{
+	const std::vector<QVector3D>& positions = from.Positions();
+	std::vector<float> distances(positions.size(), 0.f);
+	if (to.IsEmpty()) {
+		return distances;
+	}
+	std::vector<size_t> runs((positions.size() + k_vertexRun - 1) / k_vertexRun);
+	std::iota(runs.begin(), runs.end(), size_t(0));
+	QtConcurrent::blockingMap(runs, [&](size_t run) {
+		const size_t end = std::min(positions.size(), (run + 1) * k_vertexRun);
+		for (size_t v = run * k_vertexRun; v < end; ++v) {
+			distances[v] = to.Distance(positions[v]);
+		}
+	});
+	return distances;
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <cfloat>
+#include <vector>
+
+#include <QVector3D>
+#include <qopengl.h>
+
+struct ModelData;
+
+// The triangles of a model in model space, with every mesh placed by its transform and every
+// instance copied out, and a bounding volume hierarchy over them to find the nearest point of
+// the surface to any point. Nodes are split at the median of the triangle centers along their
+// widest axis and stored depth first like MeshBvh: the left child of an inner node follows it.
+class SurfaceDistance
+{
+public:
+	// Leaves hold at most this many triangles
+	static const int k_maxLeafSize = 8;
+
+	// Replaces the surface with the full detail triangles of data. Quantized positions are
+	// decoded, the levels of detail are left out.
+	void Build(const ModelData& data);
+
+	void Clear();
+	bool IsEmpty() const;
+	int NodeCount() const;
+
+	// The vertices of the surface, a copy per instance, and three indices into them per triangle
+	const std::vector<QVector3D>& Positions() const;
+	const std::vector<GLuint>& Indices() const;
+
+	// Distance from point to the nearest point of the surface, or maxDistance if none is
+	// nearer. Whole subtrees farther away than the nearest triangle found so far are skipped.
+	float Distance(const QVector3D& point, float maxDistance = FLT_MAX) const;
+
+	// The nearest point of the triangle a, b, c to point
+	static QVector3D ClosestPoint(const QVector3D& point, const QVector3D& a, const QVector3D& b, const QVector3D& c);
+
+private:
+	struct Node {
+		QVector3D m_min;
+		QVector3D m_max;
+
+		// Leaves: the first entry in m_items and how many there are.
+		// Inner nodes: m_count is 0 and m_offset is the index of the right child.
+		int m_offset = 0;
+		int m_count = 0;
+	};
+
+	int BuildNode(int first, int count);
+
+	std::vector<QVector3D> m_positions;
+	std::vector<GLuint> m_indices;
+	std::vector<Node> m_nodes;
+	std::vector<int> m_items;
+	std::vector<QVector3D> m_centers;
+};
+
+// How far apart two models are. Every vertex of each is measured against the surface of the
+// other on the global thread pool. The largest of these distances is the symmetric Hausdorff
+// distance as seen from the vertices, which the faces of dense models rarely stray from by much.
+struct SurfaceComparison {
+	SurfaceDistance m_original;
+	SurfaceDistance m_compared;
+
+	// Distance of each vertex of one model's surface to the other's, in the order of Positions()
+	std::vector<float> m_originalDistances;
+	std::vector<float> m_comparedDistances;
+
+	// The largest distance both ways, the largest of the compared model's vertices alone, and
+	// the average over the vertices of both
+	float m_hausdorff = 0.f;
+	float m_comparedHausdorff = 0.f;
+	float m_mean = 0.f;
+
+	// Builds the surfaces of original and compared and measures them against each other
+	static SurfaceComparison Compare(const ModelData& original, const ModelData& compared);
+
+	// Distances of the vertices of from to the surface of to
+	static std::vector<float> VertexDistances(const SurfaceDistance& from, const SurfaceDistance& to);
+};
@@ -0,0 +1,1266 @@
+#include "TextModelLoader.h"
+#include "BoundsMath.h"
+#include "FileContents.h"
+#include "ImportIOSystem.h"
+#include "ModelLoader.h"
+#include "VertexWelder.h"
+
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <QFileInfo>
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <numeric>
+#include <string>
+
+
+namespace {
+
+// Files are parsed in chunks of about this many bytes, cut after a line break
+const qint64 k_chunkBytes = 4 << 20;
+
+// Digits that fit a 64 bit mantissa, the ones after them are dropped
+const int k_maxDigits = 19;
+
+// Assimp's diffuse color for materials that don't say
+const float k_defaultDiffuse = 0.6f;
+
+using Chunk = std::pair<const char*, const char*>;
+
+bool IsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+bool IsDigit(char c)
+{
+	return unsigned(c - '0') <= 9;
+}
+
+const char* SkipSpaces(const char* p, const char* end)
+{
+	while (p < end && IsSpace(*p)) {
+		++p;
+	}
+	return p;
+}
+
+// Where the rest of the line starts if it starts with word, null otherwise
+const char* Keyword(const char* p, const char* end, const char* word)
+{
+	const size_t length = std::strlen(word);
+	if (size_t(end - p) < length || std::memcmp(p, word, length) != 0 || (p + length < end && !IsSpace(p[length]))) {
+		return nullptr;
+	}
+	return p + length;
+}
+
+// The text up to the end of the line without the spaces around it
+std::string Rest(const char* p, const char* end)
+{
+	p = SkipSpaces(p, end);
+	while (end > p && IsSpace(end[-1])) {
+		--end;
+	}
+	return std::string(p, end);
+}
+
+// The last word of the line, the file name of a texture after its options
+std::string LastWord(const char* p, const char* end)
+{
+	while (end > p && IsSpace(end[-1])) {
+		--end;
+	}
+	const char* begin = end;
+	while (begin > p && !IsSpace(begin[-1])) {
+		--begin;
+	}
+	return std::string(begin, end);
+}
+
+std::vector<std::string> Words(const char* p, const char* end)
+{
+	std::vector<std::string> words;
+	for (p = SkipSpaces(p, end); p < end; p = SkipSpaces(p, end)) {
+		const char* begin = p;
+		while (p < end && !IsSpace(*p)) {
+			++p;
+		}
+		words.emplace_back(begin, p);
+	}
+	return words;
+}
+
+// Whether the 8 characters of a little endian word are all digits, tested at once
+bool IsEightDigits(quint64 word)
+{
+	return ((word & 0xF0F0F0F0F0F0F0F0ull) | (((word + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) >> 4)) == 0x3333333333333333ull;
+}
+
+// The value of 8 digits in a little endian word, folding pairs of digits, then pairs of those,
+// in three multiplications
+quint32 ParseEightDigits(quint64 word)
+{
+	const quint64 mask = 0x000000FF000000FFull;
+	const quint64 mul1 = 0x000F424000000064ull;
+	const quint64 mul2 = 0x0000271000000001ull;
+	word -= 0x3030303030303030ull;
+	word = word * 10 + (word >> 8);
+	return quint32((((word & mask) * mul1) + (((word >> 16) & mask) * mul2)) >> 32);
+}
+
+// Parses a decimal number such as -1.25e-3, returns where it ends or null if there is none.
+// Runs of 8 digits are converted in a 64 bit word at a time, the mantissa is then scaled by
+// the power of ten in double precision, exactly for the powers doubles hold.
+const char* ParseFloat(const char* p, const char* end, float& value)
+{
+	const bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) {
+		++p;
+	}
+	quint64 mantissa = 0;
+	int digits = 0;
+	int exponent = 0;
+	bool any = false;
+	auto ReadDigits = [&](bool fraction) {
+		for (;;) {
+			quint64 word = 0;
+			if (digits + 8 <= k_maxDigits && end - p >= 8 && (std::memcpy(&word, p, 8), IsEightDigits(word))) {
+				mantissa = mantissa * 100000000u + ParseEightDigits(word);
+				digits += 8;
+				exponent -= fraction ? 8 : 0;
+				p += 8;
+				any = true;
+				continue;
+			}
+			if (p == end || !IsDigit(*p)) {
+				return;
+			}
+			if (digits < k_maxDigits) {
+				mantissa = mantissa * 10 + unsigned(*p - '0');
+				digits += mantissa != 0 ? 1 : 0;
+				exponent -= fraction ? 1 : 0;
+			}
+			else if (!fraction) {
+				++exponent;
+			}
+			++p;
+			any = true;
+		}
+	};
+	ReadDigits(false);
+	if (p < end && *p == '.') {
+		++p;
+		ReadDigits(true);
+	}
+	if (!any) {
+		return nullptr;
+	}
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		const bool negativeExponent = q < end && *q == '-';
+		if (q < end && (*q == '-' || *q == '+')) {
+			++q;
+		}
+		if (q < end && IsDigit(*q)) {
+			int written = 0;
+			for (; q < end && IsDigit(*q); ++q) {
+				written = std::min(written * 10 + (*q - '0'), 1000);
+			}
+			exponent += negativeExponent ? -written : written;
+			p = q;
+		}
+	}
+
+	static const double k_powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const int exactPowers = int(sizeof(k_powers) / sizeof(k_powers[0]));
+	double result = double(mantissa);
+	if (mantissa != 0 && exponent > 0) {
+		result *= exponent < exactPowers ? k_powers[exponent] : std::pow(10.0, exponent);
+	}
+	else if (mantissa != 0 && exponent < 0) {
+		result /= -exponent < exactPowers ? k_powers[-exponent] : std::pow(10.0, -exponent);
+	}
+	value = float(negative ? -result : result);
+	return p;
+}
+
+const char* ParseInt(const char* p, const char* end, int& value)
+{
+	const bool negative = p < end && *p == '-';
+	if (p < end && (*p == '-' || *p == '+')) {
+		++p;
+	}
+	const char* begin = p;
+	qint64 result = 0;
+	for (; p < end && IsDigit(*p); ++p) {
+		result = std::min<qint64>(result * 10 + (*p - '0'), INT_MAX);
+	}
+	if (p == begin) {
+		return nullptr;
+	}
+	value = int(negative ? -result : result);
+	return p;
+}
+
+// Reads up to count numbers separated by spaces, returns how many there were or -1 if one
+// isn't a number
+int ParseFloats(const char* p, const char* end, float* pValues, int count)
+{
+	int read = 0;
+	for (; read < count; ++read) {
+		p = SkipSpaces(p, end);
+		if (p == end) {
+			break;
+		}
+		p = ParseFloat(p, end, pValues[read]);
+		if (!p || (p < end && !IsSpace(*p))) {
+			return -1;
+		}
+	}
+	return read;
+}
+
+// Cuts the text into chunks of about k_chunkBytes that end after a line break
+std::vector<Chunk> SplitChunks(const char* begin, const char* end)
+{
+	std::vector<Chunk> chunks;
+	while (begin < end) {
+		const char* cut = end - begin > k_chunkBytes ? begin + k_chunkBytes : end;
+		if (cut < end) {
+			const void* pBreak = std::memchr(cut, '\n', size_t(end - cut));
+			cut = pBreak ? static_cast<const char*>(pBreak) + 1 : end;
+		}
+		chunks.emplace_back(begin, cut);
+		begin = cut;
+	}
+	return chunks;
+}
+
+// Calls visit with every line that isn't blank, from its first character that isn't a space
+template <typename Visit>
+void ForEachLine(const char* p, const char* end, const Visit& visit)
+{
+	while (p < end) {
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(end - p)));
+		if (!lineEnd) {
+			lineEnd = end;
+		}
+		const char* first = SkipSpaces(p, lineEnd);
+		if (first < lineEnd) {
+			visit(first, lineEnd);
+		}
+		p = lineEnd + 1;
+	}
+}
+
+// A corner of a triangle, the entries of the attribute arrays it uses. A negative normal is the
+// flat normal of triangle -1 - m_normal, a negative UV is none.
+struct Corner {
+	qint32 m_position;
+	qint32 m_uv;
+	qint32 m_normal;
+
+	bool operator==(const Corner& other) const
+	{
+		return m_position == other.m_position && m_uv == other.m_uv && m_normal == other.m_normal;
+	}
+};
+
+struct CornerHash {
+	size_t operator()(const Corner& corner) const
+	{
+		return size_t(VertexWelder::Mix(quint64(quint32(corner.m_position)) | quint64(quint32(corner.m_normal)) << 32) ^ VertexWelder::Mix(quint64(quint32(corner.m_uv)) + 0x9E3779B97F4A7C15ull));
+	}
+};
+
+// Polygons as a chunk lists them, three entries per corner for its position, UV and normal,
+// -1 where it has none
+struct FaceList {
+	std::vector<qint32> m_corners;
+
+	// Where the corners of each face end
+	std::vector<quint32> m_faceEnds;
+
+	size_t FaceBegin(size_t face) const
+	{
+		return face == 0 ? 0 : m_faceEnds[face - 1];
+	}
+};
+
+// Faces [m_begin, m_end) of a list that belong to a mesh
+struct Run {
+	size_t m_mesh;
+	const FaceList* m_pFaces;
+	size_t m_begin;
+	size_t m_end;
+};
+
+struct ParsedMesh {
+	std::string m_name;
+	std::string m_materialName;
+	uint m_material = 0;
+
+	// Three per triangle
+	std::vector<Corner> m_corners;
+
+	// Per triangle, used by the corners without a normal of the face the triangle starts
+	std::vector<aiVector3D> m_flatNormals;
+};
+
+// A file as it was parsed, before its corners became vertices
+struct ParsedModel {
+	std::vector<aiVector3D> m_positions;
+	std::vector<aiVector3D> m_normals;
+	std::vector<aiVector3D> m_uvs;
+
+	// Per position, empty without vertex colors
+	std::vector<aiColor4D> m_colors;
+
+	std::vector<ParsedMesh> m_meshes;
+
+	// Ending with the default material
+	std::vector<std::unique_ptr<aiMaterial>> m_materials;
+
+	int m_chunks = 0;
+};
+
+aiMaterial* DefaultMaterial()
+{
+	aiMaterial* pMaterial = new aiMaterial();
+	const aiString name(AI_DEFAULT_MATERIAL_NAME);
+	const aiColor3D diffuse(k_defaultDiffuse, k_defaultDiffuse, k_defaultDiffuse);
+	pMaterial->AddProperty(&name, AI_MATKEY_NAME);
+	pMaterial->AddProperty(&diffuse, 1, AI_MATKEY_COLOR_DIFFUSE);
+	return pMaterial;
+}
+
+// Fans the faces of the runs into triangles of their meshes. The runs are cut into pieces whose
+// triangles are counted, then written, in parallel. The positions have to be in range.
+void Triangulate(ParsedModel& model, const std::vector<Run>& runs)
+{
+	struct Piece {
+		Run m_run;
+		size_t m_firstTriangle;
+		size_t m_triangles;
+		bool m_flat;
+	};
+	std::vector<Piece> pieces;
+	for (const Run& run : runs) {
+		for (size_t begin = run.m_begin; begin < run.m_end; begin += VertexWelder::k_run) {
+			pieces.push_back(Piece{ Run{ run.m_mesh, run.m_pFaces, begin, std::min(run.m_end, begin + VertexWelder::k_run) }, 0, 0, false });
+		}
+	}
+	VertexWelder::ParallelFor(pieces.size(), [&](size_t p) {
+		Piece& piece = pieces[p];
+		const FaceList& faces = *piece.m_run.m_pFaces;
+		for (size_t f = piece.m_run.m_begin; f < piece.m_run.m_end; ++f) {
+			const size_t begin = faces.FaceBegin(f);
+			const size_t end = faces.m_faceEnds[f];
+			piece.m_triangles += end - begin - 2;
+			for (size_t c = begin; c < end && !piece.m_flat; ++c) {
+				piece.m_flat = faces.m_corners[3 * c + 2] < 0;
+			}
+		}
+	});
+
+	// The triangles of a piece follow those of the pieces of its mesh before it
+	std::vector<size_t> triangleCounts(model.m_meshes.size(), 0);
+	std::vector<bool> flat(model.m_meshes.size(), false);
+	for (Piece& piece : pieces) {
+		piece.m_firstTriangle = triangleCounts[piece.m_run.m_mesh];
+		triangleCounts[piece.m_run.m_mesh] += piece.m_triangles;
+		flat[piece.m_run.m_mesh] = flat[piece.m_run.m_mesh] || piece.m_flat;
+	}
+	for (size_t m = 0; m < model.m_meshes.size(); ++m) {
+		model.m_meshes[m].m_corners.resize(3 * triangleCounts[m]);
+		model.m_meshes[m].m_flatNormals.resize(flat[m] ? triangleCounts[m] : 0);
+	}
+
+	VertexWelder::ParallelFor(pieces.size(), [&](size_t p) {
+		const Piece& piece = pieces[p];
+		const FaceList& faces = *piece.m_run.m_pFaces;
+		ParsedMesh& mesh = model.m_meshes[piece.m_run.m_mesh];
+		size_t triangle = piece.m_firstTriangle;
+		for (size_t f = piece.m_run.m_begin; f < piece.m_run.m_end; ++f) {
+			const size_t begin = faces.FaceBegin(f);
+			const size_t count = faces.m_faceEnds[f] - begin;
+			const qint32* pFace = &faces.m_corners[3 * begin];
+			const qint32 flatNormal = -1 - qint32(triangle);
+			bool needsNormal = false;
+			for (size_t c = 0; c < count; ++c) {
+				needsNormal = needsNormal || pFace[3 * c + 2] < 0;
+			}
+			if (needsNormal) {
+				// Newell's normal, the average of the polygon's for ones that aren't planar
+				aiVector3D normal(0.f, 0.f, 0.f);
+				for (size_t c = 0; c < count; ++c) {
+					const aiVector3D& a = model.m_positions[pFace[3 * c]];
+					const aiVector3D& b = model.m_positions[pFace[3 * ((c + 1) % count)]];
+					normal.x += (a.y - b.y) * (a.z + b.z);
+					normal.y += (a.z - b.z) * (a.x + b.x);
+					normal.z += (a.x - b.x) * (a.y + b.y);
+				}
+				mesh.m_flatNormals[triangle] = normal.NormalizeSafe();
+			}
+			auto MakeCorner = [&](size_t c) {
+				return Corner{ pFace[3 * c], pFace[3 * c + 1], pFace[3 * c + 2] >= 0 ? pFace[3 * c + 2] : flatNormal };
+			};
+			for (size_t c = 1; c + 1 < count; ++c, ++triangle) {
+				mesh.m_corners[3 * triangle] = MakeCorner(0);
+				mesh.m_corners[3 * triangle + 1] = MakeCorner(c);
+				mesh.m_corners[3 * triangle + 2] = MakeCorner(c + 1);
+			}
+		}
+	});
+}
+
+// Copies the arrays of the chunks one after the other into all, at the offsets given
+template <typename T, typename Parsed>
+void Join(std::vector<T>& all, const std::vector<Parsed>& chunks, std::vector<T> Parsed::* pArray, const std::vector<size_t>& offsets)
+{
+	VertexWelder::ParallelFor(chunks.size(), [&](size_t c) {
+		const std::vector<T>& array = chunks[c].*pArray;
+		std::copy(array.begin(), array.end(), all.begin() + offsets[c]);
+	});
+}
+
+// Offsets of the arrays of the chunks joined, with the total last
+template <typename T, typename Parsed>
+std::vector<size_t> Offsets(const std::vector<Parsed>& chunks, std::vector<T> Parsed::* pArray)
+{
+	std::vector<size_t> offsets(chunks.size() + 1, 0);
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		offsets[c + 1] = offsets[c] + (chunks[c].*pArray).size();
+	}
+	return offsets;
+}
+
+struct ObjChunk {
+	std::vector<aiVector3D> m_positions;
+	std::vector<aiVector3D> m_normals;
+	std::vector<aiVector3D> m_uvs;
+
+	// White for the vertices without a color, once the chunk has one with
+	std::vector<aiColor4D> m_colors;
+
+	FaceList m_faces;
+
+	// Corner entries counted back from the end of the chunk's own arrays, which are made
+	// absolute once the chunks before it are known
+	std::vector<size_t> m_relative;
+
+	// Objects, groups, materials and material libraries, before the face they come before
+	struct Statement {
+		size_t m_face;
+		char m_kind;
+		std::string m_name;
+	};
+	std::vector<Statement> m_statements;
+
+	bool m_lines = false;
+	bool m_invalid = false;
+};
+
+void ParseObjFace(ObjChunk& chunk, const char* p, const char* end)
+{
+	FaceList& faces = chunk.m_faces;
+	const size_t counts[3] = { chunk.m_positions.size(), chunk.m_uvs.size(), chunk.m_normals.size() };
+	const size_t begin = faces.m_corners.size() / 3;
+	for (p = SkipSpaces(p, end); p < end; p = SkipSpaces(p, end)) {
+		// v, v/vt, v//vn or v/vt/vn
+		int values[3] = { 0, 0, 0 };
+		p = ParseInt(p, end, values[0]);
+		if (p && p < end && *p == '/') {
+			++p;
+			if (p < end && *p != '/') {
+				p = ParseInt(p, end, values[1]);
+			}
+			if (p && p < end && *p == '/') {
+				p = ParseInt(p + 1, end, values[2]);
+			}
+		}
+		if (!p || (p < end && !IsSpace(*p))) {
+			chunk.m_invalid = true;
+			return;
+		}
+		for (int a = 0; a < 3; ++a) {
+			qint32 entry = -1;
+			if (values[a] > 0) {
+				entry = values[a] - 1;
+			}
+			else if (values[a] < 0) {
+				entry = qint32(counts[a]) + values[a];
+				chunk.m_relative.push_back(faces.m_corners.size());
+			}
+			faces.m_corners.push_back(entry);
+		}
+	}
+	const size_t count = faces.m_corners.size() / 3 - begin;
+	if (count < 3) {
+		chunk.m_lines = chunk.m_lines || count > 0;
+		chunk.m_invalid = chunk.m_invalid || count == 0;
+		return;
+	}
+	faces.m_faceEnds.push_back(quint32(faces.m_corners.size() / 3));
+}
+
+void ParseObjLine(ObjChunk& chunk, const char* p, const char* end)
+{
+	float values[6];
+	const char* rest = nullptr;
+	if ((rest = Keyword(p, end, "v"))) {
+		const int count = ParseFloats(rest, end, values, 6);
+		if (count < 3) {
+			chunk.m_invalid = true;
+			return;
+		}
+		chunk.m_positions.emplace_back(values[0], values[1], values[2]);
+		if (count == 6) {
+			chunk.m_colors.resize(chunk.m_positions.size() - 1, aiColor4D(1.f, 1.f, 1.f, 1.f));
+			chunk.m_colors.emplace_back(values[3], values[4], values[5], 1.f);
+		}
+	}
+	else if ((rest = Keyword(p, end, "vn"))) {
+		if (ParseFloats(rest, end, values, 3) < 3) {
+			chunk.m_invalid = true;
+			return;
+		}
+		chunk.m_normals.emplace_back(values[0], values[1], values[2]);
+	}
+	else if ((rest = Keyword(p, end, "vt"))) {
+		const int count = ParseFloats(rest, end, values, 2);
+		if (count < 1) {
+			chunk.m_invalid = true;
+			return;
+		}
+		chunk.m_uvs.emplace_back(values[0], count > 1 ? values[1] : 0.f, 0.f);
+	}
+	else if ((rest = Keyword(p, end, "f"))) {
+		ParseObjFace(chunk, rest, end);
+	}
+	else if (Keyword(p, end, "l") || Keyword(p, end, "p")) {
+		chunk.m_lines = true;
+	}
+	else if ((rest = Keyword(p, end, "usemtl"))) {
+		chunk.m_statements.push_back({ chunk.m_faces.m_faceEnds.size(), 'u', Rest(rest, end) });
+	}
+	else if ((rest = Keyword(p, end, "o")) || (rest = Keyword(p, end, "g"))) {
+		chunk.m_statements.push_back({ chunk.m_faces.m_faceEnds.size(), 'o', Rest(rest, end) });
+	}
+	else if ((rest = Keyword(p, end, "mtllib"))) {
+		chunk.m_statements.push_back({ chunk.m_faces.m_faceEnds.size(), 'm', Rest(rest, end) });
+	}
+}
+
+// Adds the materials of an OBJ material library under the keys Assimp's importer uses. A
+// library that can't be read is left out, as Assimp leaves it out.
+void ReadMtl(const QString& folder, const std::string& library, ParsedModel& model, std::map<std::string, uint>& materials)
+{
+	const QString path = ImportIOSystem::ResolvePath(folder, QString::fromStdString(library));
+	const QSharedPointer<const FileContents> pFile = path.isEmpty() ? QSharedPointer<const FileContents>() : ImportIOSystem::Read(path);
+	if (!pFile) {
+		return;
+	}
+	const char* pBegin = reinterpret_cast<const char*>(pFile->Data());
+	aiMaterial* pMaterial = nullptr;
+	ForEachLine(pBegin, pBegin + pFile->Size(), [&](const char* p, const char* end) {
+		const char* rest = nullptr;
+		float values[3];
+		auto AddColor = [&](const char* key, uint type, uint index) {
+			const int count = ParseFloats(rest, end, values, 3);
+			if (count > 0) {
+				const aiColor3D color(values[0], count == 3 ? values[1] : values[0], count == 3 ? values[2] : values[0]);
+				pMaterial->AddProperty(&color, 1, key, type, index);
+			}
+		};
+		auto AddFloat = [&](const char* key, uint type, uint index, bool transparency) {
+			if (ParseFloats(rest, end, values, 1) == 1) {
+				const float value = transparency ? 1.f - values[0] : values[0];
+				pMaterial->AddProperty(&value, 1, key, type, index);
+			}
+		};
+		auto AddTexture = [&](aiTextureType type) {
+			const aiString file(LastWord(rest, end));
+			pMaterial->AddProperty(&file, AI_MATKEY_TEXTURE(type, 0));
+		};
+
+		if ((rest = Keyword(p, end, "newmtl"))) {
+			const std::string name = Rest(rest, end);
+			pMaterial = DefaultMaterial();
+			const aiString materialName(name);
+			pMaterial->AddProperty(&materialName, AI_MATKEY_NAME);
+			model.m_materials.emplace_back(pMaterial);
+			materials.emplace(name, uint(model.m_materials.size() - 1));
+		}
+		else if (!pMaterial) {
+			return;
+		}
+		else if ((rest = Keyword(p, end, "Kd"))) {
+			AddColor(AI_MATKEY_COLOR_DIFFUSE);
+		}
+		else if ((rest = Keyword(p, end, "Ka"))) {
+			AddColor(AI_MATKEY_COLOR_AMBIENT);
+		}
+		else if ((rest = Keyword(p, end, "Ks"))) {
+			AddColor(AI_MATKEY_COLOR_SPECULAR);
+		}
+		else if ((rest = Keyword(p, end, "Ke"))) {
+			AddColor(AI_MATKEY_COLOR_EMISSIVE);
+		}
+		else if ((rest = Keyword(p, end, "Ns"))) {
+			AddFloat(AI_MATKEY_SHININESS, false);
+		}
+		else if ((rest = Keyword(p, end, "d"))) {
+			AddFloat(AI_MATKEY_OPACITY, false);
+		}
+		else if ((rest = Keyword(p, end, "Tr"))) {
+			AddFloat(AI_MATKEY_OPACITY, true);
+		}
+		else if ((rest = Keyword(p, end, "map_Kd"))) {
+			AddTexture(aiTextureType_DIFFUSE);
+		}
+		else if ((rest = Keyword(p, end, "map_Ka"))) {
+			AddTexture(aiTextureType_AMBIENT);
+		}
+		else if ((rest = Keyword(p, end, "map_Ks"))) {
+			AddTexture(aiTextureType_SPECULAR);
+		}
+		else if ((rest = Keyword(p, end, "map_Ke"))) {
+			AddTexture(aiTextureType_EMISSIVE);
+		}
+		else if ((rest = Keyword(p, end, "map_d"))) {
+			AddTexture(aiTextureType_OPACITY);
+		}
+		else if ((rest = Keyword(p, end, "norm")) || (rest = Keyword(p, end, "map_Kn"))) {
+			AddTexture(aiTextureType_NORMALS);
+		}
+		else if ((rest = Keyword(p, end, "map_bump")) || (rest = Keyword(p, end, "bump"))) {
+			AddTexture(aiTextureType_HEIGHT);
+		}
+	});
+}
+
+// Returns why the file can't be read, empty if it was
+QString ReadObj(const char* pBegin, const char* pEnd, const QString& folder, ParsedModel& model)
+{
+	const std::vector<Chunk> chunks = SplitChunks(pBegin, pEnd);
+	std::vector<ObjChunk> parsed(chunks.size());
+	model.m_chunks = int(chunks.size());
+	VertexWelder::ParallelFor(chunks.size(), [&](size_t c) {
+		ObjChunk& chunk = parsed[c];
+		ForEachLine(chunks[c].first, chunks[c].second, [&chunk](const char* p, const char* end) {
+			ParseObjLine(chunk, p, end);
+		});
+		if (!chunk.m_colors.empty()) {
+			chunk.m_colors.resize(chunk.m_positions.size(), aiColor4D(1.f, 1.f, 1.f, 1.f));
+		}
+	});
+	for (const ObjChunk& chunk : parsed) {
+		if (chunk.m_lines) {
+			return "The file has lines or points";
+		}
+		if (chunk.m_invalid) {
+			return "The file has lines that can't be read";
+		}
+	}
+
+	// Each chunk's attributes follow those of the chunks before it
+	const std::vector<size_t> positionOffsets = Offsets(parsed, &ObjChunk::m_positions);
+	const std::vector<size_t> uvOffsets = Offsets(parsed, &ObjChunk::m_uvs);
+	const std::vector<size_t> normalOffsets = Offsets(parsed, &ObjChunk::m_normals);
+	const size_t totals[3] = { positionOffsets.back(), uvOffsets.back(), normalOffsets.back() };
+	if (totals[0] > size_t(INT_MAX) || totals[1] > size_t(INT_MAX) || totals[2] > size_t(INT_MAX)) {
+		return "The file has too many vertices";
+	}
+	model.m_positions.resize(totals[0]);
+	model.m_uvs.resize(totals[1]);
+	model.m_normals.resize(totals[2]);
+	Join(model.m_positions, parsed, &ObjChunk::m_positions, positionOffsets);
+	Join(model.m_uvs, parsed, &ObjChunk::m_uvs, uvOffsets);
+	Join(model.m_normals, parsed, &ObjChunk::m_normals, normalOffsets);
+	if (std::any_of(parsed.begin(), parsed.end(), [](const ObjChunk& chunk) { return !chunk.m_colors.empty(); })) {
+		model.m_colors.assign(totals[0], aiColor4D(1.f, 1.f, 1.f, 1.f));
+		Join(model.m_colors, parsed, &ObjChunk::m_colors, positionOffsets);
+	}
+
+	std::vector<char> valid(parsed.size(), 1);
+	VertexWelder::ParallelFor(parsed.size(), [&](size_t c) {
+		std::vector<qint32>& corners = parsed[c].m_faces.m_corners;
+		const size_t offsets[3] = { positionOffsets[c], uvOffsets[c], normalOffsets[c] };
+		for (size_t entry : parsed[c].m_relative) {
+			corners[entry] += qint32(offsets[entry % 3]);
+			valid[c] = valid[c] && corners[entry] >= 0;
+		}
+		for (size_t entry = 0; entry < corners.size() && valid[c]; ++entry) {
+			const qint32 value = corners[entry];
+			valid[c] = (value == -1 && entry % 3 != 0) || (value >= 0 && size_t(value) < totals[entry % 3]);
+		}
+	});
+	if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+		return "The file has faces with indices out of range";
+	}
+
+	// Faces go to the mesh of their object or group and material, named as the object
+	std::map<std::pair<std::string, std::string>, size_t> meshes;
+	std::vector<Run> runs;
+	std::vector<std::string> libraries;
+	std::string object;
+	std::string material;
+	auto AddRun = [&](const FaceList& faces, size_t begin, size_t end) {
+		if (begin == end) {
+			return;
+		}
+		auto it = meshes.find(std::make_pair(object, material));
+		if (it == meshes.end()) {
+			it = meshes.emplace(std::make_pair(object, material), model.m_meshes.size()).first;
+			model.m_meshes.emplace_back();
+			model.m_meshes.back().m_name = object;
+			model.m_meshes.back().m_materialName = material;
+		}
+		runs.push_back(Run{ it->second, &faces, begin, end });
+	};
+	for (const ObjChunk& chunk : parsed) {
+		size_t face = 0;
+		for (const ObjChunk::Statement& statement : chunk.m_statements) {
+			AddRun(chunk.m_faces, face, statement.m_face);
+			face = statement.m_face;
+			if (statement.m_kind == 'u') {
+				material = statement.m_name;
+			}
+			else if (statement.m_kind == 'o') {
+				object = statement.m_name;
+			}
+			else {
+				libraries.push_back(statement.m_name);
+			}
+		}
+		AddRun(chunk.m_faces, face, chunk.m_faces.m_faceEnds.size());
+	}
+	if (runs.empty()) {
+		return "The file has no faces";
+	}
+
+	// Materials that aren't defined are the default one
+	std::map<std::string, uint> materials;
+	for (const std::string& library : libraries) {
+		ReadMtl(folder, library, model, materials);
+	}
+	model.m_materials.emplace_back(DefaultMaterial());
+	for (ParsedMesh& mesh : model.m_meshes) {
+		const auto it = materials.find(mesh.m_materialName);
+		mesh.m_material = it != materials.end() ? it->second : uint(model.m_materials.size() - 1);
+	}
+
+	Triangulate(model, runs);
+	return QString();
+}
+
+struct StlChunk {
+	std::vector<aiVector3D> m_positions;
+	std::vector<aiVector3D> m_normals;
+	int m_solids = 0;
+	bool m_invalid = false;
+};
+
+QString ReadStl(const char* pBegin, const char* pEnd, ParsedModel& model)
+{
+	// A binary file starts with an 80 byte header, which may say solid too, and the count of
+	// the 50 byte triangles that make up the rest
+	const qint64 size = pEnd - pBegin;
+	if (size >= 84) {
+		quint32 count = 0;
+		std::memcpy(&count, pBegin + 80, sizeof(count));
+		if (84 + 50 * qint64(count) == size) {
+			return "Binary STL files are left to Assimp";
+		}
+	}
+	if (!Keyword(SkipSpaces(pBegin, pEnd), pEnd, "solid")) {
+		return "The file isn't a text STL file";
+	}
+
+	const std::vector<Chunk> chunks = SplitChunks(pBegin, pEnd);
+	std::vector<StlChunk> parsed(chunks.size());
+	model.m_chunks = int(chunks.size());
+	VertexWelder::ParallelFor(chunks.size(), [&](size_t c) {
+		StlChunk& chunk = parsed[c];
+		ForEachLine(chunks[c].first, chunks[c].second, [&chunk](const char* p, const char* end) {
+			float values[3] = {};
+			const char* rest = nullptr;
+			if ((rest = Keyword(p, end, "vertex"))) {
+				chunk.m_invalid = chunk.m_invalid || ParseFloats(rest, end, values, 3) < 3;
+				chunk.m_positions.emplace_back(values[0], values[1], values[2]);
+			}
+			else if ((rest = Keyword(p, end, "facet"))) {
+				rest = Keyword(SkipSpaces(rest, end), end, "normal");
+				chunk.m_invalid = chunk.m_invalid || !rest || ParseFloats(rest, end, values, 3) < 3;
+				chunk.m_normals.emplace_back(values[0], values[1], values[2]);
+			}
+			else if (Keyword(p, end, "solid")) {
+				++chunk.m_solids;
+			}
+		});
+	});
+	int solids = 0;
+	for (const StlChunk& chunk : parsed) {
+		if (chunk.m_invalid) {
+			return "The file has lines that can't be read";
+		}
+		solids += chunk.m_solids;
+	}
+	if (solids > 1) {
+		return "The file has more than one solid";
+	}
+
+	const std::vector<size_t> positionOffsets = Offsets(parsed, &StlChunk::m_positions);
+	const std::vector<size_t> normalOffsets = Offsets(parsed, &StlChunk::m_normals);
+	const size_t facetCount = normalOffsets.back();
+	if (facetCount == 0 || positionOffsets.back() != 3 * facetCount) {
+		return "The file has no facets or facets without three vertices";
+	}
+	if (positionOffsets.back() > size_t(INT_MAX)) {
+		return "The file has too many vertices";
+	}
+	std::vector<aiVector3D> positions(positionOffsets.back());
+	std::vector<aiVector3D> normals(facetCount);
+	Join(positions, parsed, &StlChunk::m_positions, positionOffsets);
+	Join(normals, parsed, &StlChunk::m_normals, normalOffsets);
+	parsed.clear();
+
+	// Facets written without a normal get the one of their triangle
+	VertexWelder::ParallelRuns(facetCount, [&](size_t begin, size_t end) {
+		for (size_t f = begin; f < end; ++f) {
+			if (normals[f].SquareLength() == 0.f) {
+				normals[f] = ((positions[3 * f + 1] - positions[3 * f]) ^ (positions[3 * f + 2] - positions[3 * f])).NormalizeSafe();
+			}
+		}
+	});
+
+	// Every facet repeats its corners, the same positions and normals are made one so that
+	// the corners become the vertices JoinIdenticalVertices would make of them
+	std::vector<quint32> firstPositions;
+	std::vector<quint32> firstNormals;
+	const std::vector<quint32> positionNumbers = VertexWelder::Weld<aiVector3D, VertexWelder::VectorHash>(positions, firstPositions);
+	const std::vector<quint32> normalNumbers = VertexWelder::Weld<aiVector3D, VertexWelder::VectorHash>(normals, firstNormals);
+	model.m_positions.resize(firstPositions.size());
+	model.m_normals.resize(firstNormals.size());
+	VertexWelder::ParallelRuns(firstPositions.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			model.m_positions[i] = positions[firstPositions[i]];
+		}
+	});
+	for (size_t i = 0; i < firstNormals.size(); ++i) {
+		model.m_normals[i] = normals[firstNormals[i]];
+	}
+
+	model.m_materials.emplace_back(DefaultMaterial());
+	model.m_meshes.emplace_back();
+	ParsedMesh& mesh = model.m_meshes.back();
+	mesh.m_corners.resize(positions.size());
+	VertexWelder::ParallelRuns(positions.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			mesh.m_corners[i] = Corner{ qint32(positionNumbers[i]), -1, qint32(normalNumbers[i / 3]) };
+		}
+	});
+	return QString();
+}
+
+// Where each property of a PLY vertex goes
+enum class PlyTarget {
+	Skip,
+	X, Y, Z,
+	NormalX, NormalY, NormalZ,
+	Red, Green, Blue, Alpha,
+	U, V,
+};
+
+PlyTarget PlyVertexTarget(const std::string& name)
+{
+	static const std::map<std::string, PlyTarget> k_targets = {
+		{ "x", PlyTarget::X }, { "y", PlyTarget::Y }, { "z", PlyTarget::Z },
+		{ "nx", PlyTarget::NormalX }, { "ny", PlyTarget::NormalY }, { "nz", PlyTarget::NormalZ },
+		{ "red", PlyTarget::Red }, { "green", PlyTarget::Green }, { "blue", PlyTarget::Blue }, { "alpha", PlyTarget::Alpha },
+		{ "diffuse_red", PlyTarget::Red }, { "diffuse_green", PlyTarget::Green }, { "diffuse_blue", PlyTarget::Blue },
+		{ "u", PlyTarget::U }, { "v", PlyTarget::V }, { "s", PlyTarget::U }, { "t", PlyTarget::V },
+		{ "texture_u", PlyTarget::U }, { "texture_v", PlyTarget::V }, { "texture_s", PlyTarget::U }, { "texture_t", PlyTarget::V },
+	};
+	const auto it = k_targets.find(name);
+	return it != k_targets.end() ? it->second : PlyTarget::Skip;
+}
+
+QString ReadPly(const char* pBegin, const char* pEnd, ParsedModel& model)
+{
+	struct Property {
+		PlyTarget m_target;
+		bool m_list;
+		float m_scale;
+	};
+	struct Element {
+		std::string m_name;
+		size_t m_count;
+		std::vector<Property> m_properties;
+		bool m_faceList;
+	};
+
+	// The header, up to end_header
+	std::vector<Element> elements;
+	const char* pBody = nullptr;
+	bool ascii = false;
+	for (const char* p = pBegin; p < pEnd && !pBody;) {
+		const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', size_t(pEnd - p)));
+		lineEnd = lineEnd ? lineEnd : pEnd;
+		const std::vector<std::string> words = Words(p, lineEnd);
+		p = lineEnd + 1;
+		if (words.empty() || words[0] == "comment" || words[0] == "obj_info") {
+			continue;
+		}
+		if (elements.empty() && !ascii && words[0] != "ply" && words[0] != "format") {
+			return "The file isn't a PLY file";
+		}
+		if (words[0] == "format") {
+			if (words.size() < 2 || words[1] != "ascii") {
+				return "Binary PLY files are left to Assimp";
+			}
+			ascii = true;
+		}
+		else if (words[0] == "element" && words.size() >= 3) {
+			elements.push_back(Element{ words[1], size_t(std::strtoull(words[2].c_str(), nullptr, 10)), {}, false });
+		}
+		else if (words[0] == "property" && !elements.empty()) {
+			// Integer colors are scaled from their range
+			const bool list = words.size() >= 5 && words[1] == "list";
+			const std::string& type = list ? words[3] : words[1];
+			const std::string& name = list ? words[4] : (words.size() >= 3 ? words[2] : std::string());
+			const float scale = (type == "uchar" || type == "uint8") ? 1.f / 255.f : ((type == "ushort" || type == "uint16") ? 1.f / 65535.f : 1.f);
+			elements.back().m_properties.push_back(Property{ PlyVertexTarget(name), list, scale });
+			elements.back().m_faceList = list && (name == "vertex_indices" || name == "vertex_index");
+		}
+		else if (words[0] == "end_header") {
+			pBody = p;
+		}
+	}
+	if (!pBody || !ascii) {
+		return "The file has no header";
+	}
+
+	// Vertices and faces of a list of indices alone are read, anything else is left to Assimp
+	const Element* pVertices = nullptr;
+	const Element* pFaces = nullptr;
+	size_t vertexFirstLine = 0;
+	size_t faceFirstLine = 0;
+	size_t lineCount = 0;
+	for (const Element& element : elements) {
+		if (element.m_name == "vertex" && !pVertices) {
+			pVertices = &element;
+			vertexFirstLine = lineCount;
+		}
+		else if (element.m_name == "face" && !pFaces && element.m_properties.size() == 1 && element.m_faceList) {
+			pFaces = &element;
+			faceFirstLine = lineCount;
+		}
+		else if (element.m_count > 0) {
+			return QString("The file has %1 elements").arg(QString::fromStdString(element.m_name));
+		}
+		lineCount += element.m_count;
+	}
+	if (!pVertices || !pFaces || pFaces->m_count == 0) {
+		return "The file has no faces";
+	}
+	if (pVertices->m_count > size_t(INT_MAX)) {
+		return "The file has too many vertices";
+	}
+	bool has[int(PlyTarget::V) + 1] = {};
+	for (const Property& property : pVertices->m_properties) {
+		if (property.m_list) {
+			return "The file has vertices with lists";
+		}
+		has[int(property.m_target)] = true;
+	}
+	if (!has[int(PlyTarget::X)] || !has[int(PlyTarget::Y)] || !has[int(PlyTarget::Z)]) {
+		return "The file has vertices without positions";
+	}
+	const bool hasNormals = has[int(PlyTarget::NormalX)] && has[int(PlyTarget::NormalY)] && has[int(PlyTarget::NormalZ)];
+	const bool hasColors = has[int(PlyTarget::Red)] || has[int(PlyTarget::Green)] || has[int(PlyTarget::Blue)];
+	const bool hasUVs = has[int(PlyTarget::U)] || has[int(PlyTarget::V)];
+	const size_t vertexCount = pVertices->m_count;
+	const std::vector<Property>& vertexProperties = pVertices->m_properties;
+	model.m_positions.resize(vertexCount);
+	model.m_normals.resize(hasNormals ? vertexCount : 0);
+	model.m_uvs.resize(hasUVs ? vertexCount : 0);
+	model.m_colors.resize(hasColors ? vertexCount : 0);
+
+	// Chunks count their lines first, so that each knows the element of the lines it parses
+	const std::vector<Chunk> chunks = SplitChunks(pBody, pEnd);
+	model.m_chunks = int(chunks.size());
+	std::vector<size_t> firstLines(chunks.size() + 1, 0);
+	VertexWelder::ParallelFor(chunks.size(), [&](size_t c) {
+		ForEachLine(chunks[c].first, chunks[c].second, [&](const char*, const char*) {
+			++firstLines[c + 1];
+		});
+	});
+	for (size_t c = 0; c < chunks.size(); ++c) {
+		firstLines[c + 1] += firstLines[c];
+	}
+	if (firstLines.back() < lineCount) {
+		return "The file ends early";
+	}
+
+	std::vector<FaceList> faces(chunks.size());
+	std::vector<char> valid(chunks.size(), 1);
+	VertexWelder::ParallelFor(chunks.size(), [&](size_t c) {
+		FaceList& chunkFaces = faces[c];
+		std::vector<float> values(vertexProperties.size());
+		size_t line = firstLines[c];
+		ForEachLine(chunks[c].first, chunks[c].second, [&](const char* p, const char* end) {
+			const size_t vertex = line - vertexFirstLine;
+			const size_t face = line - faceFirstLine;
+			++line;
+			if (!valid[c]) {
+				return;
+			}
+			if (vertex < vertexCount) {
+				if (ParseFloats(p, end, values.data(), int(values.size())) != int(values.size())) {
+					valid[c] = 0;
+					return;
+				}
+				aiVector3D position;
+				aiVector3D normal;
+				aiVector3D uv;
+				aiColor4D color(1.f, 1.f, 1.f, 1.f);
+				for (size_t i = 0; i < values.size(); ++i) {
+					const float value = values[i] * vertexProperties[i].m_scale;
+					switch (vertexProperties[i].m_target) {
+					case PlyTarget::X: position.x = values[i]; break;
+					case PlyTarget::Y: position.y = values[i]; break;
+					case PlyTarget::Z: position.z = values[i]; break;
+					case PlyTarget::NormalX: normal.x = values[i]; break;
+					case PlyTarget::NormalY: normal.y = values[i]; break;
+					case PlyTarget::NormalZ: normal.z = values[i]; break;
+					case PlyTarget::Red: color.r = value; break;
+					case PlyTarget::Green: color.g = value; break;
+					case PlyTarget::Blue: color.b = value; break;
+					case PlyTarget::Alpha: color.a = value; break;
+					case PlyTarget::U: uv.x = values[i]; break;
+					case PlyTarget::V: uv.y = values[i]; break;
+					case PlyTarget::Skip: break;
+					}
+				}
+				model.m_positions[vertex] = position;
+				if (hasNormals) {
+					model.m_normals[vertex] = normal;
+				}
+				if (hasUVs) {
+					model.m_uvs[vertex] = uv;
+				}
+				if (hasColors) {
+					model.m_colors[vertex] = color;
+				}
+			}
+			else if (face < pFaces->m_count) {
+				int count = 0;
+				p = ParseInt(p, end, count);
+				if (!p || count < 3) {
+					valid[c] = 0;
+					return;
+				}
+				for (int i = 0; i < count; ++i) {
+					int index = -1;
+					p = ParseInt(SkipSpaces(p, end), end, index);
+					if (!p || index < 0 || size_t(index) >= vertexCount) {
+						valid[c] = 0;
+						return;
+					}
+					chunkFaces.m_corners.push_back(index);
+					chunkFaces.m_corners.push_back(hasUVs ? index : -1);
+					chunkFaces.m_corners.push_back(hasNormals ? index : -1);
+				}
+				chunkFaces.m_faceEnds.push_back(quint32(chunkFaces.m_corners.size() / 3));
+			}
+		});
+	});
+	if (std::find(valid.begin(), valid.end(), 0) != valid.end()) {
+		return "The file has lines that can't be read";
+	}
+
+	model.m_materials.emplace_back(DefaultMaterial());
+	model.m_meshes.emplace_back();
+	std::vector<Run> runs;
+	for (const FaceList& chunkFaces : faces) {
+		if (!chunkFaces.m_faceEnds.empty()) {
+			runs.push_back(Run{ 0, &chunkFaces, 0, chunkFaces.m_faceEnds.size() });
+		}
+	}
+	Triangulate(model, runs);
+	return QString();
+}
+
+// Makes a mesh of each parsed mesh, its distinct corners the vertices
+void BuildScene(ParsedModel& model, aiScene* pScene, std::vector<std::vector<quint32>>& indices)
+{
+	pScene->mMaterials = new aiMaterial*[model.m_materials.size()];
+	pScene->mNumMaterials = uint(model.m_materials.size());
+	for (size_t i = 0; i < model.m_materials.size(); ++i) {
+		pScene->mMaterials[i] = model.m_materials[i].release();
+	}
+
+	const uint meshCount = uint(model.m_meshes.size());
+	pScene->mMeshes = new aiMesh*[meshCount]();
+	pScene->mNumMeshes = meshCount;
+	pScene->mRootNode = new aiNode("ROOT");
+	pScene->mRootNode->mMeshes = new uint[meshCount];
+	pScene->mRootNode->mNumMeshes = meshCount;
+	std::iota(pScene->mRootNode->mMeshes, pScene->mRootNode->mMeshes + meshCount, 0u);
+
+	for (uint m = 0; m < meshCount; ++m) {
+		ParsedMesh& parsed = model.m_meshes[m];
+		std::vector<quint32> firsts;
+		indices.push_back(VertexWelder::Weld<Corner, CornerHash>(parsed.m_corners, firsts));
+		const quint32* pIndices = indices.back().data();
+
+		aiMesh* pMesh = new aiMesh();
+		pScene->mMeshes[m] = pMesh;
+		pMesh->mName = aiString(parsed.m_name);
+		pMesh->mPrimitiveTypes = aiPrimitiveType_TRIANGLE;
+		pMesh->mMaterialIndex = parsed.m_material;
+		const size_t vertexCount = firsts.size();
+		const bool hasUVs = std::any_of(parsed.m_corners.begin(), parsed.m_corners.end(), [](const Corner& corner) { return corner.m_uv >= 0; });
+		pMesh->mNumVertices = uint(vertexCount);
+		pMesh->mVertices = new aiVector3D[vertexCount];
+		pMesh->mNormals = new aiVector3D[vertexCount];
+		if (hasUVs) {
+			pMesh->mTextureCoords[0] = new aiVector3D[vertexCount];
+			pMesh->mNumUVComponents[0] = 2;
+		}
+		if (!model.m_colors.empty()) {
+			pMesh->mColors[0] = new aiColor4D[vertexCount];
+		}
+		VertexWelder::ParallelRuns(vertexCount, [&](size_t begin, size_t end) {
+			for (size_t v = begin; v < end; ++v) {
+				const Corner& corner = parsed.m_corners[firsts[v]];
+				pMesh->mVertices[v] = model.m_positions[corner.m_position];
+				pMesh->mNormals[v] = corner.m_normal >= 0 ? model.m_normals[corner.m_normal] : parsed.m_flatNormals[-1 - corner.m_normal];
+				if (hasUVs) {
+					pMesh->mTextureCoords[0][v] = corner.m_uv >= 0 ? model.m_uvs[corner.m_uv] : aiVector3D();
+				}
+				if (pMesh->mColors[0]) {
+					pMesh->mColors[0][v] = model.m_colors[corner.m_position];
+				}
+			}
+		});
+
+		const size_t triangleCount = parsed.m_corners.size() / 3;
+		pMesh->mFaces = new aiFace[triangleCount];
+		pMesh->mNumFaces = uint(triangleCount);
+		VertexWelder::ParallelRuns(triangleCount, [&](size_t begin, size_t end) {
+			for (size_t f = begin; f < end; ++f) {
+				pMesh->mFaces[f].mNumIndices = 3;
+				pMesh->mFaces[f].mIndices = const_cast<unsigned int*>(pIndices + 3 * f);
+			}
+		});
+		std::vector<Corner>().swap(parsed.m_corners);
+		std::vector<aiVector3D>().swap(parsed.m_flatNormals);
+
+		// The bounds Assimp's post-processing would generate
+		QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+		QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		if (vertexCount > 0) {
+			BoundsMath::AddPoints(&pMesh->mVertices[0].x, vertexCount, 3, min, max);
+		}
+		pMesh->mAABB = aiAABB(aiVector3D(min.x(), min.y(), min.z()), aiVector3D(max.x(), max.y(), max.z()));
+	}
+}
+
+}
+
+TextModelLoader::~TextModelLoader()
+{
+	Clear();
+}
+
+bool TextModelLoader::IsTextModelFile(const QString& file)
+{
+	const QString suffix = QFileInfo(file).suffix().toLower();
+	return suffix == "obj" || suffix == "ply" || suffix == "stl";
+}
+
+bool TextModelLoader::Handles(const QString& file, const LoadOptions& options)
+{
+	return options.m_parallelText && IsTextModelFile(file) && !(ModelLoader::ImportFlags(options) & aiProcess_GenSmoothNormals);
+}
+
+bool TextModelLoader::Read(const QString& file)
+{
+	Clear();
+	const QSharedPointer<const FileContents> pFile = ImportIOSystem::Read(file);
+	if (!pFile) {
+		return Fail("The file can't be read");
+	}
+	const char* pBegin = reinterpret_cast<const char*>(pFile->Data());
+	const char* pEnd = pBegin + pFile->Size();
+	const QString suffix = QFileInfo(file).suffix().toLower();
+	ParsedModel model;
+	QString reason = "The file isn't an OBJ, PLY or STL file";
+	if (suffix == "obj") {
+		reason = ReadObj(pBegin, pEnd, ImportIOSystem::Folder(file), model);
+	}
+	else if (suffix == "ply") {
+		reason = ReadPly(pBegin, pEnd, model);
+	}
+	else if (suffix == "stl") {
+		reason = ReadStl(pBegin, pEnd, model);
+	}
+	m_chunkCount = model.m_chunks;
+	if (!reason.isEmpty()) {
+		return Fail(reason);
+	}
+
+	m_pScene.reset(new aiScene());
+	BuildScene(model, m_pScene.get(), m_indices);
+	m_read = true;
+	return true;
+}
+
+const QString& TextModelLoader::FailureReason() const
+{
+	return m_reason;
+}
+
+aiScene const* TextModelLoader::Scene() const
+{
+	return m_read ? m_pScene.get() : nullptr;
+}
+
+int TextModelLoader::ChunkCount() const
+{
+	return m_chunkCount;
+}
+
+bool TextModelLoader::Fail(const QString& reason)
+{
+	m_reason = reason;
+	return false;
+}
+
+void TextModelLoader::Clear()
+{
+	if (m_pScene) {
+		for (uint i = 0; i < m_pScene->mNumMeshes; ++i) {
+			aiMesh* pMesh = m_pScene->mMeshes[i];
+			for (uint f = 0; pMesh && f < pMesh->mNumFaces; ++f) {
+				pMesh->mFaces[f].mIndices = nullptr;
+			}
+		}
+		m_pScene.reset();
+	}
+	m_reason.clear();
+	m_indices.clear();
+	m_chunkCount = 0;
+	m_read = false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <QString>
+
+#include <memory>
+#include <vector>
+
+struct aiScene;
+struct LoadOptions;
+
+// Reads text OBJ, PLY and STL files, which scans make gigabytes big, on every core rather than
+// through Assimp's single threaded importers. The mapped file is cut at line ends into chunks
+// that are parsed in parallel, and the chunks are then joined into an aiScene for
+// ModelLoader::DecodeModel. Corners using the same position, UV and normal become one vertex,
+// found through a hash split into shards that are filled in parallel. Faces without normals
+// get the normal of the face, as Assimp's flat normals would give them.
+// Binary PLY and STL files, OBJ lines and points, and PLY elements other than vertices and
+// faces are left to Assimp: Read() returns false for them.
+class TextModelLoader
+{
+public:
+	TextModelLoader() = default;
+	~TextModelLoader();
+	TextModelLoader(const TextModelLoader&) = delete;
+	TextModelLoader& operator=(const TextModelLoader&) = delete;
+
+	// By the suffix, .obj, .ply or .stl. Whether a PLY or STL file is text is only known once
+	// it is read.
+	static bool IsTextModelFile(const QString& file);
+
+	// Whether options have files like file read this way. Not when they ask for smooth
+	// normals, which Assimp would generate for the faces without normals.
+	static bool Handles(const QString& file, const LoadOptions& options);
+
+	// False if the file can't be read this way, FailureReason() then says why. Reading
+	// another file frees the scene of the last one.
+	bool Read(const QString& file);
+	const QString& FailureReason() const;
+
+	// The scene read, null unless Read() succeeded. It lives as long as the loader.
+	aiScene const* Scene() const;
+
+	// Chunks the file was parsed in
+	int ChunkCount() const;
+
+private:
+	bool Fail(const QString& reason);
+	void Clear();
+
+	QString m_reason;
+	std::unique_ptr<aiScene> m_pScene;
+
+	// The triangles of every mesh. The faces of the scene point into them, and are detached
+	// before the scene is deleted.
+	std::vector<std::vector<quint32>> m_indices;
+
+	int m_chunkCount = 0;
+	bool m_read = false;
+};
@@ -0,0 +1,241 @@
+#include "TextRenderer.h"
+#include "StateCache.h"
+#include "StreamBuffer.h"
+
+#include <algorithm>
+
+#include <QFontMetrics>
+#include <QImage>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLTexture>
+#include <QPainter>
+
+
+namespace {
+
+const char* k_textVertexShaderSource =
+	"attribute highp vec4 posAttr;\n"
+	"varying highp vec2 uv;\n"
+	"uniform highp vec2 uScale;\n"
+	"void main() {\n"
+	"   uv = posAttr.zw;\n"
+	"   gl_Position = vec4(posAttr.x * uScale.x - 1.0, 1.0 - posAttr.y * uScale.y, 0.0, 1.0);\n"
+	"}\n";
+
+const char* k_textFragmentShaderSource =
+	"varying highp vec2 uv;\n"
+	"uniform sampler2D uAtlas;\n"
+	"uniform lowp vec4 uColor;\n"
+	"void main() {\n"
+	"   gl_FragColor = vec4(uColor.rgb, uColor.a * texture2D(uAtlas, uv).a);\n"
+	"}\n";
+
+// Atlas rows are this wide, a few rows hold all glyphs at overlay sizes
+const int k_atlasWidth = 512;
+
+// Attribute location of the packed position and uv
+const GLuint k_posAttr = 0;
+
+}
+
+TextRenderer::~TextRenderer()
+{
+	// The atlas and buffers go with the context, only the program is left
+	delete m_pProgram;
+}
+
+bool TextRenderer::Create(const QFont& font, qreal devicePixelRatio)
+{
+	Destroy();
+
+	// Glyphs are rasterized at device pixel size, so they are drawn one texel per pixel
+	QFont scaledFont = font;
+	if (font.pixelSize() > 0) {
+		scaledFont.setPixelSize(qRound(font.pixelSize() * devicePixelRatio));
+	}
+	else {
+		scaledFont.setPointSizeF(font.pointSizeF() * devicePixelRatio);
+	}
+	const QFontMetrics metrics(scaledFont);
+	m_glyphHeight = metrics.height();
+	m_lineSpacing = metrics.lineSpacing();
+
+	// Lay the glyphs out in rows, a pixel apart so filtering doesn't bleed
+	QPoint cursor(0, 0);
+	QRect cells[k_glyphCount];
+	for (int i = 0; i < k_glyphCount; ++i) {
+		const int width = metrics.horizontalAdvance(QChar(k_firstGlyph + i));
+		if (cursor.x() + width > k_atlasWidth) {
+			cursor = QPoint(0, cursor.y() + m_glyphHeight + 1);
+		}
+		cells[i] = QRect(cursor, QSize(width, m_glyphHeight));
+		m_glyphs[i].m_width = width;
+		cursor.rx() += width + 1;
+	}
+
+	QImage image(k_atlasWidth, cursor.y() + m_glyphHeight, QImage::Format_ARGB32_Premultiplied);
+	image.fill(Qt::transparent);
+	{
+		QPainter painter(&image);
+		painter.setFont(scaledFont);
+		painter.setPen(Qt::white);
+		painter.setRenderHint(QPainter::TextAntialiasing);
+		for (int i = 0; i < k_glyphCount; ++i) {
+			painter.drawText(cells[i].left(), cells[i].top() + metrics.ascent(), QString(QChar(k_firstGlyph + i)));
+		}
+	}
+	for (int i = 0; i < k_glyphCount; ++i) {
+		m_glyphs[i].m_uv = QRectF(double(cells[i].left()) / image.width(), double(cells[i].top()) / image.height(),
+			double(cells[i].width()) / image.width(), double(cells[i].height()) / image.height());
+	}
+
+	m_pAtlas = new QOpenGLTexture(image, QOpenGLTexture::DontGenerateMipMaps);
+	m_pAtlas->setMinMagFilters(QOpenGLTexture::Nearest, QOpenGLTexture::Nearest);
+	m_pAtlas->setWrapMode(QOpenGLTexture::ClampToEdge);
+
+	m_pProgram = new QOpenGLShaderProgram();
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, k_textVertexShaderSource);
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, k_textFragmentShaderSource);
+	m_pProgram->bindAttributeLocation("posAttr", k_posAttr);
+	if (!m_pProgram->link()) {
+		qWarning("Could not link the text shader: %s", qPrintable(m_pProgram->log()));
+		Destroy();
+		return false;
+	}
+	m_scaleUniform = m_pProgram->uniformLocation("uScale");
+	m_colorUniform = m_pProgram->uniformLocation("uColor");
+	m_pProgram->bind();
+	m_pProgram->setUniformValue("uAtlas", 0);
+	m_pProgram->release();
+
+	// The vertices are rewritten every frame, and may be anywhere in a stream buffer, so the
+	// attribute is pointed at them on every draw
+	m_vertexBuffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	m_vertexBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+	m_vertexBuffer.create();
+	m_vao.create();
+	return true;
+}
+
+void TextRenderer::Destroy()
+{
+	if (QOpenGLContext::currentContext()) {
+		m_vao.destroy();
+		m_vertexBuffer.destroy();
+		delete m_pAtlas;
+	}
+	m_pAtlas = nullptr;
+	delete m_pProgram;
+	m_pProgram = nullptr;
+	m_vertices.clear();
+}
+
+bool TextRenderer::IsCreated() const
+{
+	return m_pProgram != nullptr;
+}
+
+int TextRenderer::LineSpacing() const
+{
+	return m_lineSpacing;
+}
+
+int TextRenderer::TextWidth(const QString& text) const
+{
+	int widest = 0;
+	int width = 0;
+	for (QChar c : text) {
+		if (c == '\n') {
+			width = 0;
+			continue;
+		}
+		width += GlyphFor(c).m_width;
+		widest = std::max(widest, width);
+	}
+	return widest;
+}
+
+void TextRenderer::Add(const QString& text, const QPointF& position, bool alignRight)
+{
+	float y = float(position.y());
+	for (const QString& line : text.split('\n')) {
+		float x = float(position.x()) - (alignRight ? TextWidth(line) : 0);
+		for (QChar c : line) {
+			const Glyph& glyph = GlyphFor(c);
+			const float left = x;
+			const float right = x + glyph.m_width;
+			const float bottom = y + m_glyphHeight;
+			const GLfloat u0 = GLfloat(glyph.m_uv.left());
+			const GLfloat u1 = GLfloat(glyph.m_uv.right());
+			const GLfloat v0 = GLfloat(glyph.m_uv.top());
+			const GLfloat v1 = GLfloat(glyph.m_uv.bottom());
+			m_vertices.insert(m_vertices.end(), {
+				left, y, u0, v0,   right, y, u1, v0,   right, bottom, u1, v1,
+				left, y, u0, v0,   right, bottom, u1, v1,   left, bottom, u0, v1,
+			});
+			x = right;
+		}
+		y += m_lineSpacing;
+	}
+}
+
+int TextRenderer::Draw(const QSize& viewport, const QColor& color, StreamBuffer* pStream)
+{
+	if (!m_pProgram || m_vertices.empty()) {
+		m_vertices.clear();
+		return 0;
+	}
+
+	QOpenGLFunctions* pFunctions = QOpenGLContext::currentContext()->functions();
+	StateCache& state = StateCache::Current();
+	const int bytes = int(m_vertices.size() * sizeof(GLfloat));
+	const qint64 offset = pStream ? pStream->Write(m_vertices.data(), bytes) : -1;
+	if (m_vao.isCreated()) {
+		m_vao.bind();
+	}
+	if (offset >= 0) {
+		pFunctions->glBindBuffer(GL_ARRAY_BUFFER, pStream->Buffer());
+	}
+	else {
+		m_vertexBuffer.bind();
+		m_vertexBuffer.allocate(m_vertices.data(), bytes);
+	}
+	pFunctions->glVertexAttribPointer(k_posAttr, 4, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(std::max<qint64>(offset, 0)));
+	pFunctions->glEnableVertexAttribArray(k_posAttr);
+
+	state.Viewport(0, 0, viewport.width(), viewport.height());
+	m_pProgram->bind();
+	m_pProgram->setUniformValue(m_scaleUniform, 2.f / viewport.width(), 2.f / viewport.height());
+	m_pProgram->setUniformValue(m_colorUniform, color);
+	m_pAtlas->bind(0);
+
+	const GLboolean depthTest = pFunctions->glIsEnabled(GL_DEPTH_TEST);
+	state.Disable(GL_DEPTH_TEST);
+	state.Enable(GL_BLEND);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	pFunctions->glDrawArrays(GL_TRIANGLES, 0, GLsizei(m_vertices.size() / 4));
+	state.Disable(GL_BLEND);
+	if (depthTest) {
+		state.Enable(GL_DEPTH_TEST);
+	}
+
+	m_pAtlas->release(0);
+	m_pProgram->release();
+	if (m_vao.isCreated()) {
+		m_vao.release();
+	}
+	else {
+		pFunctions->glDisableVertexAttribArray(k_posAttr);
+	}
+	pFunctions->glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_vertices.clear();
+	return 1;
+}
+
+const TextRenderer::Glyph& TextRenderer::GlyphFor(QChar c) const
+{
+	const int index = c.unicode() - k_firstGlyph;
+	return m_glyphs[index >= 0 && index < k_glyphCount ? index : '?' - k_firstGlyph];
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <vector>
+
+#include <QColor>
+#include <QFont>
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QPointF>
+#include <QRectF>
+#include <QSize>
+#include <QString>
+#include <qopengl.h>
+
+class QOpenGLShaderProgram;
+class QOpenGLTexture;
+class StreamBuffer;
+
+// Draws overlay text from a glyph atlas rasterized once, so drawing text doesn't need a
+// QPainter on the GL widget. Text added during a frame is drawn in one batch by Draw. Covers
+// printable ASCII, other characters show as '?'.
+class TextRenderer
+{
+public:
+	~TextRenderer();
+
+	// Rasterizes the atlas at font's size times devicePixelRatio and creates the program and
+	// buffers. Creating and destroying requires a current context.
+	bool Create(const QFont& font, qreal devicePixelRatio);
+	void Destroy();
+	bool IsCreated() const;
+
+	// Height of a line in device pixels
+	int LineSpacing() const;
+
+	// Width of the widest line of text in device pixels
+	int TextWidth(const QString& text) const;
+
+	// Queues text with its lines aligned to the left or right of position, which is the top
+	// left or top right corner of the first line in device pixels
+	void Add(const QString& text, const QPointF& position, bool alignRight = false);
+
+	// Draws and clears the queued text over the whole viewport of the given size, blended on
+	// top of what is there. The vertices are written into pStream if given, otherwise into a
+	// buffer of the renderer's own. Returns the number of draw calls.
+	int Draw(const QSize& viewport, const QColor& color, StreamBuffer* pStream = nullptr);
+
+private:
+	static const int k_firstGlyph = 32;
+	static const int k_glyphCount = 95;
+
+	struct Glyph {
+		QRectF m_uv;
+		int m_width = 0;
+	};
+	const Glyph& GlyphFor(QChar c) const;
+
+	Glyph m_glyphs[k_glyphCount];
+	int m_glyphHeight = 0;
+	int m_lineSpacing = 0;
+
+	QOpenGLShaderProgram* m_pProgram = nullptr;
+	QOpenGLTexture* m_pAtlas = nullptr;
+	QOpenGLBuffer m_vertexBuffer;
+	QOpenGLVertexArrayObject m_vao;
+	GLint m_scaleUniform = -1;
+	GLint m_colorUniform = -1;
+
+	// Two triangles per glyph, each vertex x, y, u, v
+	std::vector<GLfloat> m_vertices;
+};
@@ -0,0 +1,179 @@
+#include "TextureCache.h"
+#include "TextureUploader.h"
+
+#include <QOpenGLContext>
+
+
+namespace {
+
+typedef GLuint64 (QOPENGLF_APIENTRYP GetTextureHandle)(GLuint texture);
+typedef void (QOPENGLF_APIENTRYP MakeTextureHandleResident)(GLuint64 handle);
+
+}
+
+
+QSharedPointer<QOpenGLTexture> TextureCache::Get(const QString& key, const QImage& image, TextureUploader* pUploader)
+{
+	// Reuse the texture if another mesh still holds it
+	QSharedPointer<QOpenGLTexture> texture = m_textures.value(key).m_texture.toStrongRef();
+	if (texture) {
+		return texture;
+	}
+
+	if (image.isNull()) {
+		return texture;
+	}
+
+	if (pUploader) {
+		texture = pUploader->Queue(image);
+		if (!texture) {
+			return texture;
+		}
+	}
+	else {
+		texture.reset(new QOpenGLTexture(image, QOpenGLTexture::GenerateMipMaps));
+	}
+	ConfigureSampler(*texture);
+
+	m_textures.insert(key, { texture, EstimateBytes(image) });
+	m_keys.insert(texture.data(), key);
+	return texture;
+}
+
+QSharedPointer<QOpenGLTexture> TextureCache::Get(const QString& key, const CompressedImage& image)
+{
+	QSharedPointer<QOpenGLTexture> texture = m_textures.value(key).m_texture.toStrongRef();
+	if (texture || image.isNull()) {
+		return texture;
+	}
+
+	const int levels = int(image.m_levels.size());
+	texture.reset(new QOpenGLTexture(QOpenGLTexture::Target2D));
+	texture->setFormat(image.m_format);
+	texture->setSize(image.m_size.width(), image.m_size.height());
+	texture->setMipLevels(levels);
+	texture->allocateStorage();
+	if (!texture->isStorageAllocated()) {
+		return QSharedPointer<QOpenGLTexture>();
+	}
+	for (int level = 0; level < levels; ++level) {
+		const QByteArray& data = image.m_levels[level];
+		texture->setCompressedData(level, data.size(), data.constData());
+	}
+
+	// Files don't always hold the whole chain, so only sample the levels that were uploaded
+	texture->setMipLevelRange(0, levels - 1);
+	ConfigureSampler(*texture);
+
+	m_textures.insert(key, { texture, EstimateBytes(image) });
+	m_keys.insert(texture.data(), key);
+	return texture;
+}
+
+void TextureCache::ConfigureSampler(QOpenGLTexture& texture)
+{
+	// Sample the mip chain so minified geometry doesn't shimmer
+	texture.setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+	texture.setMagnificationFilter(QOpenGLTexture::Linear);
+	if (texture.hasFeature(QOpenGLTexture::AnisotropicFiltering)) {
+		texture.setMaximumAnisotropy(16.f);
+	}
+	texture.setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::ClampToEdge);
+	texture.setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
+}
+
+GLuint64 TextureCache::Handle(const QSharedPointer<QOpenGLTexture>& texture)
+{
+	// The address of a destroyed texture can be reused, so the entry has to still hold it
+	auto it = m_textures.find(m_keys.value(texture.data()));
+	if (texture.isNull() || it == m_textures.end() || it.value().m_texture.toStrongRef() != texture) {
+		return 0;
+	}
+	Entry& entry = it.value();
+	if (entry.m_handle == 0 && SupportsBindless()) {
+		// Handles are freed with their texture, which also makes them non-resident
+		QOpenGLContext* pContext = QOpenGLContext::currentContext();
+		auto pGetHandle = reinterpret_cast<GetTextureHandle>(pContext->getProcAddress("glGetTextureHandleARB"));
+		auto pMakeResident = reinterpret_cast<MakeTextureHandleResident>(pContext->getProcAddress("glMakeTextureHandleResidentARB"));
+		if (pGetHandle && pMakeResident) {
+			entry.m_handle = pGetHandle(texture->textureId());
+			if (entry.m_handle != 0) {
+				pMakeResident(entry.m_handle);
+			}
+		}
+	}
+	return entry.m_handle;
+}
+
+bool TextureCache::SupportsBindless()
+{
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	return pContext && !pContext->isOpenGLES() && pContext->hasExtension("GL_ARB_bindless_texture");
+}
+
+void TextureCache::Purge()
+{
+	for (auto it = m_keys.begin(); it != m_keys.end();) {
+		if (m_textures.value(it.value()).m_texture.isNull()) {
+			it = m_keys.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+	for (auto it = m_textures.begin(); it != m_textures.end();) {
+		if (it.value().m_texture.isNull()) {
+			it = m_textures.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+}
+
+int TextureCache::Count() const
+{
+	int count = 0;
+	for (const Entry& entry : m_textures) {
+		if (!entry.m_texture.isNull()) {
+			++count;
+		}
+	}
+	return count;
+}
+
+qint64 TextureCache::Bytes() const
+{
+	qint64 bytes = 0;
+	for (const Entry& entry : m_textures) {
+		if (!entry.m_texture.isNull()) {
+			bytes += entry.m_bytes;
+		}
+	}
+	return bytes;
+}
+
+qint64 TextureCache::EstimateBytes(const QImage& image)
+{
+	// RGBA8 plus a third for the mip chain
+	return qint64(image.width()) * image.height() * 4 * 4 / 3;
+}
+
+qint64 TextureCache::EstimateBytes(const CompressedImage& image)
+{
+	qint64 bytes = 0;
+	for (const QByteArray& level : image.m_levels) {
+		bytes += level.size();
+	}
+	return bytes;
+}
+
+void TextureCache::SetVirtualTextures(VirtualTextures* pVirtualTextures)
+{
+	m_pVirtualTextures = pVirtualTextures;
+}
+
+VirtualTextures* TextureCache::Virtual() const
+{
+	return m_pVirtualTextures;
+}
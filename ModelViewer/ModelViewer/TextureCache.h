@@ -0,0 +1,70 @@
+#pragma once
+#include <QHash>
+#include <QImage>
+#include <QOpenGLTexture>
+#include <QSharedPointer>
+#include <QString>
+#include <QWeakPointer>
+
+#include "CompressedTexture.h"
+
+class TextureUploader;
+class VirtualTextures;
+
+// Shares textures between all meshes that use the same image. Textures are reference counted
+// by the meshes holding them and destroyed with the last one, which requires the context they
+// were created in to be current. The cache itself only keeps weak references.
+class TextureCache
+{
+public:
+	// Returns the texture for key, uploading image if no mesh uses that texture yet.
+	// Requires a current context.
+	// Images get a full mip chain generated on upload. With pUploader the texels are queued on it
+	// instead of uploaded right away, the texture can't be drawn until the uploader is done.
+	QSharedPointer<QOpenGLTexture> Get(const QString& key, const QImage& image, TextureUploader* pUploader = nullptr);
+
+	// Same as above for block compressed data, which is uploaded with the mip levels it has.
+	// Returns null if the format is not supported by the context.
+	QSharedPointer<QOpenGLTexture> Get(const QString& key, const CompressedImage& image);
+
+	// Bindless handle of texture, made resident on the first call so shaders can sample it
+	// without it being bound. Its sampler state can't change afterwards. 0 for textures that
+	// aren't from this cache, or without GL_ARB_bindless_texture.
+	GLuint64 Handle(const QSharedPointer<QOpenGLTexture>& texture);
+
+	// Whether the current context has GL_ARB_bindless_texture
+	static bool SupportsBindless();
+
+	// Forgets textures that are no longer used by any mesh
+	void Purge();
+
+	int Count() const;
+
+	// Estimated video memory used by the textures still in use
+	qint64 Bytes() const;
+
+	// Estimated video memory a texture of image takes once uploaded by Get
+	static qint64 EstimateBytes(const QImage& image);
+	static qint64 EstimateBytes(const CompressedImage& image);
+
+	// Where the pages of textures too large to upload whole go, null if they aren't paged and
+	// only their tails are drawn
+	void SetVirtualTextures(VirtualTextures* pVirtualTextures);
+	VirtualTextures* Virtual() const;
+
+private:
+	// Filtering and wrapping are set once at upload, so drawing only has to bind
+	static void ConfigureSampler(QOpenGLTexture& texture);
+
+	struct Entry {
+		QWeakPointer<QOpenGLTexture> m_texture;
+		qint64 m_bytes = 0;
+		GLuint64 m_handle = 0;
+	};
+	QHash<QString, Entry> m_textures;
+
+	// The key of each texture, for looking up its handle
+	QHash<const QOpenGLTexture*, QString> m_keys;
+
+	VirtualTextures* m_pVirtualTextures = nullptr;
+};
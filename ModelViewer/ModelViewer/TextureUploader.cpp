@@ -0,0 +1,318 @@
+#include "TextureUploader.h"
+#include "TextureCache.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+
+namespace {
+
+typedef void (QOPENGLF_APIENTRYP BufferStorage)(GLenum target, GLsizeiptr size, const void* data, GLbitfield flags);
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+// Fences and mapping buffer ranges need OpenGL 3.2 or OpenGL ES 3.0
+bool SupportsFences(const QOpenGLContext* pContext)
+{
+	const QSurfaceFormat format = pContext->format();
+	if (pContext->isOpenGLES()) {
+		return format.majorVersion() >= 3;
+	}
+	return format.version() >= qMakePair(3, 2)
+		|| (format.majorVersion() >= 3 && pContext->hasExtension("GL_ARB_sync"));
+}
+
+// Immutable buffer storage, which can stay mapped while the GPU reads it, is core in OpenGL 4.4
+BufferStorage GetBufferStorage(QOpenGLContext* pContext)
+{
+	if (pContext->isOpenGLES()) {
+		return nullptr;
+	}
+	if (pContext->format().version() < qMakePair(4, 4) && !pContext->hasExtension("GL_ARB_buffer_storage")) {
+		return nullptr;
+	}
+	return reinterpret_cast<BufferStorage>(pContext->getProcAddress("glBufferStorage"));
+}
+
+}
+
+void TextureUploader::Create()
+{
+	Destroy();
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	m_staged = SupportsFences(pContext) && m_buffer.create();
+	if (m_staged) {
+		const GLsizeiptr bytes = GLsizeiptr(k_slotCount * k_slotBytes);
+		m_buffer.bind();
+		const BufferStorage pBufferStorage = GetBufferStorage(pContext);
+		if (pBufferStorage) {
+			const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			pBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, flags);
+			m_pMapped = static_cast<uchar*>(Functions()->glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags));
+			if (!m_pMapped) {
+				// Immutable storage can't be allocated again, the buffer is made anew
+				m_buffer.destroy();
+				m_buffer.create();
+				m_buffer.bind();
+			}
+		}
+		if (!m_pMapped) {
+			m_buffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+			m_buffer.allocate(int(bytes));
+		}
+		m_buffer.release();
+	}
+	m_created = true;
+}
+
+void TextureUploader::Destroy()
+{
+	if (!m_created) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+	for (GLsync& fence : m_fences) {
+		if (fence) {
+			f->glDeleteSync(fence);
+			fence = nullptr;
+		}
+	}
+	if (m_pMapped) {
+		m_buffer.bind();
+		f->glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		m_buffer.release();
+		m_pMapped = nullptr;
+	}
+	m_buffer.destroy();
+	m_pending.clear();
+	m_next = 0;
+	m_staged = false;
+	m_created = false;
+}
+
+bool TextureUploader::IsCreated() const
+{
+	return m_created;
+}
+
+bool TextureUploader::IsStaged() const
+{
+	return m_staged;
+}
+
+bool TextureUploader::IsPersistent() const
+{
+	return m_pMapped != nullptr;
+}
+
+QSharedPointer<QOpenGLTexture> TextureUploader::Queue(const QImage& image)
+{
+	if (image.isNull()) {
+		return QSharedPointer<QOpenGLTexture>();
+	}
+
+	// Rows are copied as they are, so they have to be tightly packed
+	QImage texels = image.format() == QImage::Format_RGBA8888 ? image : image.convertToFormat(QImage::Format_RGBA8888);
+	if (texels.bytesPerLine() != texels.width() * 4) {
+		texels = texels.copy();
+	}
+
+	QSharedPointer<QOpenGLTexture> texture(new QOpenGLTexture(QOpenGLTexture::Target2D));
+	texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+	texture->setSize(texels.width(), texels.height());
+	texture->setMipLevels(texture->maximumMipLevels());
+	texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+	if (!texture->isStorageAllocated()) {
+		return QSharedPointer<QOpenGLTexture>();
+	}
+	const bool preview = !TextureCache::SupportsBindless() && UploadPreview(*texture, texels);
+	m_pending.push_back({ texture, texels, 0, preview });
+	return texture;
+}
+
+bool TextureUploader::UploadPreview(QOpenGLTexture& texture, const QImage& image)
+{
+	int base = 0;
+	while (std::max(texture.width() >> base, texture.height() >> base) > k_previewSize) {
+		++base;
+	}
+	if (base == 0) {
+		return false;
+	}
+
+	// Sampled down to a few times the preview's size first, which is quick for any image, and
+	// filtered from there, each level from the one above
+	const int sampled = std::max(0, base - 2);
+	QImage level = image.scaled(std::max(1, texture.width() >> sampled), std::max(1, texture.height() >> sampled));
+	for (int mip = base; mip < texture.mipLevels(); ++mip) {
+		level = level.scaled(std::max(1, texture.width() >> mip), std::max(1, texture.height() >> mip), Qt::IgnoreAspectRatio, Qt::SmoothTransformation)
+			.convertToFormat(QImage::Format_RGBA8888);
+		texture.setData(mip, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8, level.constBits());
+	}
+	texture.setMipBaseLevel(base);
+	return true;
+}
+
+void TextureUploader::DropFreed()
+{
+	m_pending.erase(std::remove_if(m_pending.begin(), m_pending.end(), [](const Pending& pending) {
+		return pending.m_texture.isNull();
+	}), m_pending.end());
+}
+
+qint64 TextureUploader::Upload(qint64 budgetBytes)
+{
+	DropFreed();
+	if (!m_staged) {
+		return UploadDirect(budgetBytes);
+	}
+
+	QOpenGLExtraFunctions* f = Functions();
+	qint64 uploaded = 0;
+	m_buffer.bind();
+	while (!m_pending.empty() && uploaded < budgetBytes && IsFree(m_next)) {
+		// Fill the slot with rows in the order the images were queued. An image that doesn't
+		// fit goes on in the next slot.
+		const qint64 slotOffset = qint64(m_next) * k_slotBytes;
+		const qint64 slotBudget = std::min(qint64(k_slotBytes), budgetBytes - uploaded);
+		std::vector<Band> bands;
+		qint64 used = 0;
+		for (Pending& pending : m_pending) {
+			const qint64 rowBytes = pending.m_image.bytesPerLine();
+			const int rowsLeft = pending.m_image.height() - pending.m_nextRow;
+			int rows = int(std::min<qint64>((slotBudget - used) / rowBytes, rowsLeft));
+			if (rows == 0 && bands.empty() && rowBytes <= k_slotBytes) {
+				rows = 1;
+			}
+			if (rows == 0) {
+				break;
+			}
+			bands.push_back({ &pending, pending.m_nextRow, rows, slotOffset + used });
+			used += rows * rowBytes;
+			if (rows < rowsLeft) {
+				break;
+			}
+		}
+		if (bands.empty()) {
+			break;
+		}
+
+		uchar* pSlot = m_pMapped ? m_pMapped + slotOffset
+			: static_cast<uchar*>(m_buffer.mapRange(int(slotOffset), int(used), QOpenGLBuffer::RangeWrite | QOpenGLBuffer::RangeInvalidate | QOpenGLBuffer::RangeUnsynchronized));
+		if (!pSlot) {
+			break;
+		}
+		for (const Band& band : bands) {
+			const QImage& image = band.m_pPending->m_image;
+			std::memcpy(pSlot + (band.m_offset - slotOffset), image.constScanLine(band.m_row), size_t(band.m_rows) * size_t(image.bytesPerLine()));
+		}
+		if (!m_pMapped) {
+			m_buffer.unmap();
+		}
+
+		// The offsets into the bound buffer take the place of pointers to the texels
+		f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (const Band& band : bands) {
+			Pending& pending = *band.m_pPending;
+			const QSharedPointer<QOpenGLTexture> texture = pending.m_texture.toStrongRef();
+			texture->bind();
+			f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, band.m_row, pending.m_image.width(), band.m_rows, GL_RGBA, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(band.m_offset));
+			texture->release();
+			pending.m_nextRow += band.m_rows;
+		}
+		m_fences[m_next] = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		m_next = (m_next + 1) % k_slotCount;
+		uploaded += used;
+
+		// Only the last band can be of an image that isn't complete
+		while (!m_pending.empty() && m_pending.front().m_nextRow >= m_pending.front().m_image.height()) {
+			Finish(m_pending.front());
+			m_pending.pop_front();
+		}
+	}
+	m_buffer.release();
+	return uploaded;
+}
+
+qint64 TextureUploader::UploadDirect(qint64 budgetBytes)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	f->glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	qint64 uploaded = 0;
+	while (!m_pending.empty() && uploaded < budgetBytes) {
+		Pending& pending = m_pending.front();
+		const qint64 rowBytes = pending.m_image.bytesPerLine();
+		const int rowsLeft = pending.m_image.height() - pending.m_nextRow;
+		const int rows = std::max(1, int(std::min<qint64>((budgetBytes - uploaded) / rowBytes, rowsLeft)));
+		const QSharedPointer<QOpenGLTexture> texture = pending.m_texture.toStrongRef();
+		texture->bind();
+		f->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, pending.m_nextRow, pending.m_image.width(), rows, GL_RGBA, GL_UNSIGNED_BYTE, pending.m_image.constScanLine(pending.m_nextRow));
+		texture->release();
+		pending.m_nextRow += rows;
+		uploaded += rows * rowBytes;
+		if (pending.m_nextRow >= pending.m_image.height()) {
+			Finish(pending);
+			m_pending.pop_front();
+		}
+	}
+	return uploaded;
+}
+
+bool TextureUploader::IsFree(int slot)
+{
+	GLsync& fence = m_fences[slot];
+	if (!fence) {
+		return true;
+	}
+	QOpenGLExtraFunctions* f = Functions();
+	if (f->glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+		return false;
+	}
+	f->glDeleteSync(fence);
+	fence = nullptr;
+	return true;
+}
+
+void TextureUploader::Finish(Pending& pending)
+{
+	// The smaller levels are made from the full image once all of it is in, which replaces the
+	// preview and draws from the full image again
+	const QSharedPointer<QOpenGLTexture> texture = pending.m_texture.toStrongRef();
+	if (pending.m_preview) {
+		texture->setMipBaseLevel(0);
+	}
+	texture->generateMipMaps();
+}
+
+bool TextureUploader::IsIdle() const
+{
+	return m_pending.empty();
+}
+
+qint64 TextureUploader::PendingBytes() const
+{
+	qint64 bytes = 0;
+	for (const Pending& pending : m_pending) {
+		bytes += qint64(pending.m_image.height() - pending.m_nextRow) * pending.m_image.bytesPerLine();
+	}
+	return bytes;
+}
+
+void TextureUploader::Clear()
+{
+	m_pending.clear();
+}
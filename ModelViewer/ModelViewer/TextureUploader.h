@@ -0,0 +1,85 @@
+#pragma once
+#include <QImage>
+#include <QOpenGLBuffer>
+#include <QOpenGLTexture>
+#include <QSharedPointer>
+#include <qopengl.h>
+
+#include <deque>
+
+// Streams the texels of images into textures a few rows at a time, so a model's textures don't
+// stall the frame they are created in. Rows are copied into a ring of slots in one pixel unpack
+// buffer and uploaded from there, the driver transfers them while drawing goes on. Each slot is
+// fenced and only written again once the GPU has read it. With GL_ARB_buffer_storage the buffer
+// stays mapped for its whole life, otherwise a slot is mapped unsynchronized while it is filled.
+// Without fences rows are uploaded straight from the images, still within the budget.
+class TextureUploader
+{
+public:
+	static const int k_slotCount = 3;
+	static const qint64 k_slotBytes = 8 * 1024 * 1024;
+	// Largest side of the preview a queued texture is drawn with until it is uploaded
+	static const int k_previewSize = 64;
+
+	// Creating and destroying the buffer requires the context it is used in to be current.
+	// Destroy drops the uploads that are still queued.
+	void Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Whether rows go through the pixel unpack buffer, and whether it stays mapped
+	bool IsStaged() const;
+	bool IsPersistent() const;
+
+	// Returns an RGBA8 texture with a full mip chain for image and queues its texels. Its levels
+	// of at most k_previewSize texels a side are filled from the image scaled down right away,
+	// and drawing is limited to them until Upload has copied all texels and generated the mip
+	// chain. With bindless textures, whose levels can't change once they have a handle, the
+	// contents are undefined until then instead. Images are expected as Format_RGBA8888, others
+	// are converted here. Requires a current context.
+	QSharedPointer<QOpenGLTexture> Queue(const QImage& image);
+
+	// Uploads queued rows until about budgetBytes went to the GPU, at least one row if any is
+	// queued. Stops early when the next slot is still being read. Textures that were freed
+	// meanwhile are dropped. Returns the bytes uploaded.
+	qint64 Upload(qint64 budgetBytes);
+
+	bool IsIdle() const;
+	qint64 PendingBytes() const;
+
+	// Drops the queued uploads, their textures are left with what was uploaded so far
+	void Clear();
+
+private:
+	// The uploader doesn't keep textures alive, the meshes using them do
+	struct Pending {
+		QWeakPointer<QOpenGLTexture> m_texture;
+		QImage m_image;
+		int m_nextRow = 0;
+		bool m_preview = false;
+	};
+
+	// Rows of one texture placed at an offset of the buffer
+	struct Band {
+		Pending* m_pPending = nullptr;
+		int m_row = 0;
+		int m_rows = 0;
+		qint64 m_offset = 0;
+	};
+
+	// True if the slot's previous upload is done, without waiting for it
+	bool IsFree(int slot);
+	static bool UploadPreview(QOpenGLTexture& texture, const QImage& image);
+	void DropFreed();
+	qint64 UploadDirect(qint64 budgetBytes);
+	void Finish(Pending& pending);
+
+	QOpenGLBuffer m_buffer = QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+	uchar* m_pMapped = nullptr;
+	GLsync m_fences[k_slotCount] = {};
+	int m_next = 0;
+	bool m_created = false;
+	bool m_staged = false;
+
+	std::deque<Pending> m_pending;
+};
@@ -0,0 +1,226 @@
+#include "ThumbnailIndex.h"
+
+#include <QBuffer>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFileInfo>
+#include <QLocale>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+
+#include <cstring>
+
+
+namespace {
+
+const char k_magic[8] = { 'M', 'V', 'T', 'H', 'U', 'M', 'B', 'S' };
+const qint64 k_headerBytes = sizeof(k_magic) + sizeof(quint32);
+
+// Each record starts with its size, the thumbnail takes what is left after the summary
+const qint64 k_recordSizeBytes = sizeof(quint32);
+
+QByteArray Header()
+{
+	QByteArray header(k_magic, sizeof(k_magic));
+	header.resize(int(k_headerBytes));
+	qToBigEndian<quint32>(ThumbnailIndex::k_version, header.data() + sizeof(k_magic));
+	return header;
+}
+
+QByteArray EncodeThumbnail(const QImage& frame)
+{
+	if (frame.isNull()) {
+		return QByteArray();
+	}
+	const QImage thumbnail = frame.scaled(ThumbnailIndex::k_thumbnailSize, ThumbnailIndex::k_thumbnailSize, Qt::KeepAspectRatio, Qt::SmoothTransformation)
+		.convertToFormat(QImage::Format_RGB32);
+
+	// JPEG keeps the thumbnail of a shaded model at a few KB, PNG is there in every Qt build
+	QByteArray data;
+	QBuffer buffer(&data);
+	buffer.open(QIODevice::WriteOnly);
+	if (!thumbnail.save(&buffer, "JPG", 85)) {
+		buffer.close();
+		data.clear();
+		buffer.open(QIODevice::WriteOnly);
+		thumbnail.save(&buffer, "PNG");
+	}
+	return data;
+}
+
+}
+
+ThumbnailIndex::ThumbnailIndex(const QString& path)
+	: m_path(path)
+{
+	Open();
+}
+
+QString ThumbnailIndex::DefaultPath()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails.mvindex";
+}
+
+bool ThumbnailIndex::Find(const QFileInfo& info, ModelSummary& summary) const
+{
+	const auto it = m_entries.constFind(Key(info.absoluteFilePath()));
+	if (it == m_entries.constEnd() || it->m_summary.m_modified != info.lastModified().toMSecsSinceEpoch()
+		|| it->m_summary.m_size != info.size()) {
+		return false;
+	}
+	summary = it->m_summary;
+	return true;
+}
+
+QImage ThumbnailIndex::Thumbnail(const QString& path) const
+{
+	const auto it = m_entries.constFind(Key(path));
+	return it != m_entries.constEnd() ? QImage::fromData(it->m_thumbnail) : QImage();
+}
+
+bool ThumbnailIndex::Insert(const ModelSummary& summary, const QImage& frame)
+{
+	Entry entry;
+	entry.m_summary = summary;
+	entry.m_thumbnail = EncodeThumbnail(frame);
+	const QByteArray record = Record(summary, entry.m_thumbnail);
+	entry.m_recordBytes = record.size();
+
+	QFile file(m_path);
+	if (!QDir().mkpath(QFileInfo(m_path).path()) || !file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		return false;
+	}
+	if (file.size() == 0 && file.write(Header()) != k_headerBytes) {
+		return false;
+	}
+	if (file.write(record) != record.size()) {
+		return false;
+	}
+
+	const QString key = Key(summary.m_path);
+	const auto it = m_entries.constFind(key);
+	if (it != m_entries.constEnd()) {
+		m_replacedBytes += it->m_recordBytes;
+	}
+	m_entries.insert(key, entry);
+	return true;
+}
+
+int ThumbnailIndex::Count() const
+{
+	return m_entries.size();
+}
+
+QString ThumbnailIndex::Describe(const ModelSummary& summary)
+{
+	const QLocale locale;
+	const QVector3D size = summary.m_AABBMax - summary.m_AABBMin;
+	return QString("%1 triangles, %2 meshes, %3 materials\n%4 x %5 x %6, loaded in %7 s")
+		.arg(locale.toString(summary.m_triangles))
+		.arg(summary.m_meshes)
+		.arg(summary.m_materials)
+		.arg(size.x(), 0, 'f', 2)
+		.arg(size.y(), 0, 'f', 2)
+		.arg(size.z(), 0, 'f', 2)
+		.arg(summary.m_loadSeconds, 0, 'f', 1);
+}
+
+void ThumbnailIndex::Open()
+{
+	// A file damaged by a crash while appending keeps the records before the damage. Appending
+	// after it would lose every later record, so it is rewritten.
+	if (!Parse() || (m_pContents && m_replacedBytes * 2 > m_pContents->Size())) {
+		Compact();
+	}
+}
+
+bool ThumbnailIndex::Parse()
+{
+	if (!QFile::exists(m_path)) {
+		return true;
+	}
+	m_pContents = FileContents::Open(m_path);
+	if (!m_pContents) {
+		return false;
+	}
+	const uchar* pData = m_pContents->Data();
+	const qint64 size = m_pContents->Size();
+	if (size < k_headerBytes || std::memcmp(pData, k_magic, sizeof(k_magic)) != 0
+		|| qFromBigEndian<quint32>(pData + sizeof(k_magic)) != k_version) {
+		return false;
+	}
+
+	// Only the summaries are read, the thumbnails are left in the mapping until shown
+	qint64 offset = k_headerBytes;
+	while (offset < size) {
+		if (size - offset < k_recordSizeBytes) {
+			return false;
+		}
+		const qint64 recordBytes = qFromBigEndian<quint32>(pData + offset);
+		if (recordBytes > size - offset - k_recordSizeBytes) {
+			return false;
+		}
+		const QByteArray record = QByteArray::fromRawData(reinterpret_cast<const char*>(pData + offset + k_recordSizeBytes), int(recordBytes));
+		QDataStream in(record);
+		in.setVersion(QDataStream::Qt_5_15);
+
+		Entry entry;
+		ModelSummary& summary = entry.m_summary;
+		in >> summary.m_path >> summary.m_modified >> summary.m_size >> summary.m_triangles >> summary.m_meshes
+			>> summary.m_materials >> summary.m_AABBMin >> summary.m_AABBMax >> summary.m_loadSeconds;
+		if (in.status() != QDataStream::Ok) {
+			return false;
+		}
+		const int thumbnailOffset = int(in.device()->pos());
+		entry.m_thumbnail = QByteArray::fromRawData(record.constData() + thumbnailOffset, record.size() - thumbnailOffset);
+		entry.m_recordBytes = k_recordSizeBytes + recordBytes;
+
+		// Later records are of later loads
+		const QString key = Key(summary.m_path);
+		const auto it = m_entries.constFind(key);
+		if (it != m_entries.constEnd()) {
+			m_replacedBytes += it->m_recordBytes;
+		}
+		m_entries.insert(key, entry);
+		offset += entry.m_recordBytes;
+	}
+	return true;
+}
+
+void ThumbnailIndex::Compact()
+{
+	QByteArray data = Header();
+	for (const Entry& entry : m_entries) {
+		data += Record(entry.m_summary, entry.m_thumbnail);
+	}
+
+	// The file can only be replaced once nothing maps it anymore
+	m_entries.clear();
+	m_pContents.reset();
+	m_replacedBytes = 0;
+	QSaveFile file(m_path);
+	if (QDir().mkpath(QFileInfo(m_path).path()) && file.open(QIODevice::WriteOnly)) {
+		file.write(data);
+		file.commit();
+	}
+	Parse();
+}
+
+QByteArray ThumbnailIndex::Record(const ModelSummary& summary, const QByteArray& thumbnail)
+{
+	QByteArray record(int(k_recordSizeBytes), '\0');
+	QDataStream out(&record, QIODevice::WriteOnly | QIODevice::Append);
+	out.setVersion(QDataStream::Qt_5_15);
+	out << summary.m_path << summary.m_modified << summary.m_size << summary.m_triangles << summary.m_meshes
+		<< summary.m_materials << summary.m_AABBMin << summary.m_AABBMax << summary.m_loadSeconds;
+	record += thumbnail;
+	qToBigEndian<quint32>(quint32(record.size() - k_recordSizeBytes), record.data());
+	return record;
+}
+
+QString ThumbnailIndex::Key(const QString& path)
+{
+	return QDir::cleanPath(QFileInfo(path).absoluteFilePath()).toCaseFolded();
+}
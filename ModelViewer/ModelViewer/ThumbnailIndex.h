@@ -0,0 +1,90 @@
+#pragma once
+#include "FileContents.h"
+
+#include <QByteArray>
+#include <QHash>
+#include <QImage>
+#include <QSharedPointer>
+#include <QString>
+#include <QVector3D>
+
+class QFileInfo;
+
+// What is known about a model file from the last time it was loaded
+struct ModelSummary {
+	// Absolute path, and the modification time and size of the file when it was loaded
+	QString m_path;
+	qint64 m_modified = 0;
+	qint64 m_size = 0;
+
+	qint64 m_triangles = 0;
+	int m_meshes = 0;
+	int m_materials = 0;
+	QVector3D m_AABBMin;
+	QVector3D m_AABBMax;
+
+	// From starting the load until the model was shown, reading it from the cache included
+	float m_loadSeconds = 0.f;
+};
+
+// Summaries and thumbnails of the models that have been loaded, so lists of files can show
+// them without opening a single model. They are kept in one packed file that records are
+// appended to. It is mapped when opened and only the summaries are parsed, so a thumbnail is
+// only read from disk once it is shown. A record for a file loaded again replaces the earlier
+// one, which is dropped when the file is compacted on opening.
+class ThumbnailIndex
+{
+public:
+	// Bump whenever the layout of the file changes, older files are started over
+	static const quint32 k_version = 1;
+
+	// Thumbnails fit in a square this big
+	static const int k_thumbnailSize = 128;
+
+	explicit ThumbnailIndex(const QString& path = DefaultPath());
+
+	// Per user cache location of the application
+	static QString DefaultPath();
+
+	// The summary of a file, if there is one made from the file as it is now. info usually
+	// comes from a folder listing, which already holds the time and size compared.
+	bool Find(const QFileInfo& info, ModelSummary& summary) const;
+
+	// Null if the index has no thumbnail of the file at path
+	QImage Thumbnail(const QString& path) const;
+
+	// Adds or replaces the summary of its file, with frame scaled down as its thumbnail
+	bool Insert(const ModelSummary& summary, const QImage& frame);
+
+	int Count() const;
+
+	// The summary as lists of models describe it, over two lines
+	static QString Describe(const ModelSummary& summary);
+
+private:
+	struct Entry {
+		ModelSummary m_summary;
+		// Points into m_pContents, or holds the thumbnail of an entry added since opening
+		QByteArray m_thumbnail;
+		qint64 m_recordBytes = 0;
+	};
+
+	// Parses the file, and rewrites it without replaced records if they take most of it
+	void Open();
+	// False if the file is damaged from some record on, the records before it are kept
+	bool Parse();
+	void Compact();
+
+	// The record of an entry, as appended to the file
+	static QByteArray Record(const ModelSummary& summary, const QByteArray& thumbnail);
+
+	// Paths are compared without case, as on Windows
+	static QString Key(const QString& path);
+
+	QString m_path;
+	QSharedPointer<const FileContents> m_pContents;
+	QHash<QString, Entry> m_entries;
+
+	// Bytes of the file taken by records that were replaced since
+	qint64 m_replacedBytes = 0;
+};
@@ -0,0 +1,97 @@
+#include "TransformCache.h"
+#include "ModelLoader.h"
+
+
+void TransformCache::Build(const Model& model)
+{
+	Clear();
+	const size_t count = model.m_meshes.size();
+	m_local.reserve(count);
+	m_localNormal.reserve(count);
+	for (const Mesh& mesh : model.m_meshes) {
+		// Normals aren't decoded, their matrix must not include the position decode
+		const QMatrix4x4 transform = MeshTransform(mesh);
+		m_local.push_back(transform * mesh.m_positionDecode);
+		m_localNormal.push_back(transform.normalMatrix());
+	}
+	m_modelViewProjection.resize(count);
+	m_modelView.resize(count);
+	m_normal.resize(count);
+	m_stamps.assign(count, 0);
+}
+
+void TransformCache::Clear()
+{
+	m_local.clear();
+	m_localNormal.clear();
+	m_modelViewProjection.clear();
+	m_modelView.clear();
+	m_normal.clear();
+	m_stamps.clear();
+
+	// Stamp 0 is never current, so the first view computes every mesh
+	m_stamp = 0;
+	m_updateCount = 0;
+}
+
+void TransformCache::UpdateMesh(int meshIdx, const Mesh& mesh)
+{
+	const QMatrix4x4 transform = MeshTransform(mesh);
+	m_local[meshIdx] = transform * mesh.m_positionDecode;
+	m_localNormal[meshIdx] = transform.normalMatrix();
+	m_stamps[meshIdx] = 0;
+}
+
+void TransformCache::SetView(const QMatrix4x4& projection, const QMatrix4x4& modelMatrix)
+{
+	if (m_stamp != 0 && projection == m_projection && modelMatrix == m_modelMatrix) {
+		return;
+	}
+	m_projection = projection;
+	m_modelMatrix = modelMatrix;
+	m_viewProjection = projection * modelMatrix;
+
+	// The inverse transpose of a product is the product of the inverse transposes
+	m_viewNormal = modelMatrix.normalMatrix();
+	++m_stamp;
+}
+
+const QMatrix4x4& TransformCache::ModelViewProjection(int meshIdx)
+{
+	Update(meshIdx);
+	return m_modelViewProjection[meshIdx];
+}
+
+const QMatrix4x4& TransformCache::ModelView(int meshIdx)
+{
+	Update(meshIdx);
+	return m_modelView[meshIdx];
+}
+
+const QMatrix3x3& TransformCache::Normal(int meshIdx)
+{
+	Update(meshIdx);
+	return m_normal[meshIdx];
+}
+
+qint64 TransformCache::UpdateCount() const
+{
+	return m_updateCount;
+}
+
+QMatrix4x4 TransformCache::MeshTransform(const Mesh& mesh)
+{
+	return mesh.m_instanced ? mesh.m_placement : mesh.m_transform;
+}
+
+void TransformCache::Update(int meshIdx)
+{
+	if (m_stamps[meshIdx] == m_stamp) {
+		return;
+	}
+	m_modelViewProjection[meshIdx] = m_viewProjection * m_local[meshIdx];
+	m_modelView[meshIdx] = m_modelMatrix * m_local[meshIdx];
+	m_normal[meshIdx] = m_viewNormal * m_localNormal[meshIdx];
+	m_stamps[meshIdx] = m_stamp;
+	++m_updateCount;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <vector>
+
+#include <QGenericMatrix>
+#include <QMatrix4x4>
+
+struct Mesh;
+struct Model;
+
+// The matrices DrawMesh sets for each mesh of a model. The parts that only depend on a mesh are
+// multiplied out once when the model is set, so a frame takes two matrix products and a 3x3
+// product per mesh and no inverse. A mesh's matrices are worked out the first time they are
+// asked for after the camera moved, and reused until it moves again.
+// Each matrix is kept in an array of its own, so walking one touches only that array.
+class TransformCache
+{
+public:
+	// Replaces the cache with the meshes of model
+	void Build(const Model& model);
+	void Clear();
+
+	// Takes the transform of a mesh again after it moved, its matrices are worked out anew
+	// when next asked for
+	void UpdateMesh(int meshIdx, const Mesh& mesh);
+
+	// Sets the projection and model matrix of the frame. Nothing is recomputed if neither changed.
+	void SetView(const QMatrix4x4& projection, const QMatrix4x4& modelMatrix);
+
+	// Matrices of a mesh drawn where the model put it. Instanced meshes are placed per instance
+	// by the shader, their matrices only include the ModelScene placement.
+	const QMatrix4x4& ModelViewProjection(int meshIdx);
+	const QMatrix4x4& ModelView(int meshIdx);
+	const QMatrix3x3& Normal(int meshIdx);
+
+	// Meshes whose matrices were recomputed since the model was set
+	qint64 UpdateCount() const;
+
+private:
+	void Update(int meshIdx);
+	static QMatrix4x4 MeshTransform(const Mesh& mesh);
+
+	// Mesh transform with the position decode, and the normal matrix of the mesh transform
+	std::vector<QMatrix4x4> m_local;
+	std::vector<QMatrix3x3> m_localNormal;
+
+	// The results, up to date for the meshes whose stamp is the view's
+	std::vector<QMatrix4x4> m_modelViewProjection;
+	std::vector<QMatrix4x4> m_modelView;
+	std::vector<QMatrix3x3> m_normal;
+	std::vector<quint32> m_stamps;
+
+	QMatrix4x4 m_projection;
+	QMatrix4x4 m_modelMatrix;
+	QMatrix4x4 m_viewProjection;
+	QMatrix3x3 m_viewNormal;
+	quint32 m_stamp = 0;
+	qint64 m_updateCount = 0;
+};
@@ -0,0 +1,199 @@
+#include "TransparencyPass.h"
+#include "StateCache.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+#include <QOpenGLShaderProgram>
+
+#ifndef GL_RGBA16F
+#define GL_RGBA16F 0x881A
+#endif
+
+
+namespace {
+
+const char* k_compositeVertexShaderSource =
+	"#version 330\n"
+	"in vec2 posAttr;\n"
+	"void main() {\n"
+	"   gl_Position = vec4(posAttr, 0.0, 1.0);\n"
+	"}\n";
+
+// The viewport covers the same corner of the targets and of the scene, so texels are fetched
+// where the fragment is. Where nothing see-through was drawn all the light comes through.
+const char* k_compositeFragmentShaderSource =
+	"#version 330\n"
+	"uniform sampler2D uAccumulated;\n"
+	"uniform sampler2D uWeights;\n"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	"   ivec2 texel = ivec2(gl_FragCoord.xy);\n"
+	"   vec4 accumulated = texelFetch(uAccumulated, texel, 0);\n"
+	"   if (accumulated.a >= 1.0) {\n"
+	"      discard;\n"
+	"   }\n"
+	"   float weight = texelFetch(uWeights, texel, 0).r;\n"
+	"   fragColor = vec4(accumulated.rgb / max(weight, 1e-5), 1.0 - accumulated.a);\n"
+	"}\n";
+
+// One triangle covering the whole viewport
+const GLfloat k_fullScreenTriangle[] = { -1.f, -1.f, 3.f, -1.f, -1.f, 3.f };
+
+const GLuint k_posAttr = 0;
+
+// Bytes per pixel of the two half float targets and the depth and stencil
+const qint64 k_bytesPerPixel = 8 + 8 + 4;
+
+QOpenGLExtraFunctions* Functions()
+{
+	return QOpenGLContext::currentContext()->extraFunctions();
+}
+
+}
+
+TransparencyPass::~TransparencyPass()
+{
+	// The framebuffer and buffer go with the context, only the program is left
+	delete m_pProgram;
+}
+
+bool TransparencyPass::Create()
+{
+	Destroy();
+
+	// The depth is copied from the scene, and the shaders fetch texels of float targets
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)
+		|| !QOpenGLFramebufferObject::hasOpenGLFramebufferBlit()) {
+		return false;
+	}
+
+	m_pProgram = new QOpenGLShaderProgram();
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, k_compositeVertexShaderSource);
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, k_compositeFragmentShaderSource);
+	m_pProgram->bindAttributeLocation("posAttr", k_posAttr);
+	if (!m_pProgram->link()) {
+		qWarning("Could not link the transparency shader: %s", qPrintable(m_pProgram->log()));
+		delete m_pProgram;
+		m_pProgram = nullptr;
+		return false;
+	}
+	m_pProgram->bind();
+	m_pProgram->setUniformValue("uAccumulated", 0);
+	m_pProgram->setUniformValue("uWeights", 1);
+	m_pProgram->release();
+
+	m_triangle = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+	m_triangle.create();
+	m_triangle.bind();
+	m_triangle.allocate(k_fullScreenTriangle, sizeof(k_fullScreenTriangle));
+	m_vao.create();
+	m_vao.bind();
+	Functions()->glVertexAttribPointer(k_posAttr, 2, GL_FLOAT, GL_FALSE, 0, nullptr);
+	Functions()->glEnableVertexAttribArray(k_posAttr);
+	m_vao.release();
+	m_triangle.release();
+	return true;
+}
+
+void TransparencyPass::Destroy()
+{
+	if (QOpenGLContext::currentContext()) {
+		delete m_pTarget;
+		m_vao.destroy();
+		m_triangle.destroy();
+	}
+	m_pTarget = nullptr;
+	delete m_pProgram;
+	m_pProgram = nullptr;
+	m_nativeSize = QSize();
+}
+
+bool TransparencyPass::IsCreated() const
+{
+	return m_pProgram != nullptr;
+}
+
+void TransparencyPass::Begin(GLuint sceneFramebuffer, const QSize& nativeSize, const QSize& sceneSize)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	if (nativeSize != m_nativeSize) {
+		delete m_pTarget;
+		QOpenGLFramebufferObjectFormat format;
+		format.setAttachment(QOpenGLFramebufferObject::CombinedDepthStencil);
+		format.setInternalTextureFormat(GL_RGBA16F);
+		m_pTarget = new QOpenGLFramebufferObject(nativeSize, format);
+		m_pTarget->addColorAttachment(nativeSize, GL_RGBA16F);
+		m_nativeSize = nativeSize;
+	}
+	m_sceneSize = sceneSize;
+
+	// Both depth buffers are combined depth and stencil buffers, which a blit takes as they
+	// are. A multisampled scene gives one of the samples of each pixel.
+	const int width = sceneSize.width();
+	const int height = sceneSize.height();
+	f->glBindFramebuffer(GL_READ_FRAMEBUFFER, sceneFramebuffer);
+	f->glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_pTarget->handle());
+	f->glBlitFramebuffer(0, 0, width, height, 0, 0, width, height, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	m_pTarget->bind();
+	const GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	f->glDrawBuffers(2, drawBuffers);
+	state.Viewport(0, 0, width, height);
+	const GLfloat allLight[] = { 0.f, 0.f, 0.f, 1.f };
+	const GLfloat noWeight[] = { 0.f, 0.f, 0.f, 0.f };
+	f->glClearBufferfv(GL_COLOR, 0, allLight);
+	f->glClearBufferfv(GL_COLOR, 1, noWeight);
+
+	// Colors and weights add up, the light let through is multiplied by what each fragment
+	// lets through. The weights' alpha isn't read.
+	state.DepthMask(false);
+	state.Enable(GL_BLEND);
+	state.BlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+void TransparencyPass::End(GLuint sceneFramebuffer)
+{
+	QOpenGLExtraFunctions* f = Functions();
+	StateCache& state = StateCache::Current();
+	state.DepthMask(true);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	state.Viewport(0, 0, m_sceneSize.width(), m_sceneSize.height());
+	state.Disable(GL_DEPTH_TEST);
+
+	// The scene's alpha is left as it is
+	state.BlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ZERO, GL_ONE);
+	const QVector<GLuint> textures = m_pTarget->textures();
+	m_pProgram->bind();
+	f->glActiveTexture(GL_TEXTURE1);
+	f->glBindTexture(GL_TEXTURE_2D, textures.value(1));
+	f->glActiveTexture(GL_TEXTURE0);
+	f->glBindTexture(GL_TEXTURE_2D, textures.value(0));
+	m_vao.bind();
+	f->glDrawArrays(GL_TRIANGLES, 0, 3);
+	m_vao.release();
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+	f->glActiveTexture(GL_TEXTURE1);
+	f->glBindTexture(GL_TEXTURE_2D, 0);
+	f->glActiveTexture(GL_TEXTURE0);
+	m_pProgram->release();
+
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.Disable(GL_BLEND);
+	state.Enable(GL_DEPTH_TEST);
+}
+
+qint64 TransparencyPass::Bytes() const
+{
+	return m_pTarget ? qint64(m_nativeSize.width()) * m_nativeSize.height() * k_bytesPerPixel : 0;
+}
+
+float TransparencyPass::Weight(float alpha, float z)
+{
+	return alpha * std::min(3e3f, std::max(1e-2f, 3e3f * std::pow(1.f - z, 3.f)));
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <QOpenGLBuffer>
+#include <QOpenGLVertexArrayObject>
+#include <QSize>
+#include <qopengl.h>
+
+class QOpenGLFramebufferObject;
+class QOpenGLShaderProgram;
+
+// Draws see-through meshes with weighted blended order-independent transparency, so they need
+// no sorting. The meshes are drawn into two half float targets of the pass' own, which start
+// out with the depth of the opaque scene. The first adds up their colors weighted by depth and
+// coverage and multiplies out how much light they let through, the second adds up the weights.
+// A full-screen pass then blends the weighted average color over the scene by the light that
+// didn't come through. Drawing writes no depth, so the meshes don't hide each other.
+class TransparencyPass
+{
+public:
+	~TransparencyPass();
+
+	// Creating and destroying the program and framebuffer requires a current context. Create
+	// returns false without framebuffer blits or float render targets, or if the compositing
+	// program doesn't link.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Copies the depth of the scene framebuffer, whose depth is a combined depth and stencil
+	// buffer, and binds the pass' targets with blending set up for the see-through meshes.
+	// sceneSize is the part of the scene being drawn to, nativeSize the size of the scene
+	// framebuffer.
+	void Begin(GLuint sceneFramebuffer, const QSize& nativeSize, const QSize& sceneSize);
+
+	// Blends the meshes drawn since Begin over the scene framebuffer, and leaves it bound with
+	// depth testing and writes on and blending off
+	void End(GLuint sceneFramebuffer);
+
+	// GPU memory taken by the targets
+	qint64 Bytes() const;
+
+	// Weight of a fragment of alpha at the window depth z, as the shaders compute it. Near
+	// fragments count for more, so the nearest surface's color wins where colors differ.
+	static float Weight(float alpha, float z);
+
+private:
+	QOpenGLFramebufferObject* m_pTarget = nullptr;
+	QOpenGLShaderProgram* m_pProgram = nullptr;
+	QOpenGLBuffer m_triangle;
+	QOpenGLVertexArrayObject m_vao;
+	QSize m_nativeSize;
+	QSize m_sceneSize;
+};
@@ -0,0 +1,462 @@
+#include "UniformBlocks.h"
+#include "Animation.h"
+#include "ModelLoader.h"
+#include "PageFile.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+
+#include <utility>
+
+
+namespace {
+	// Points each sampler a linked program uses at its texture unit
+	template<size_t N>
+	void SetSamplers(QOpenGLShaderProgram* pProgram, const std::pair<const char*, GLint>(&samplers)[N]) {
+		pProgram->bind();
+		for (const auto& sampler : samplers) {
+			const int samplerUniform = pProgram->uniformLocation(sampler.first);
+			if (samplerUniform != -1) {
+				pProgram->setUniformValue(samplerUniform, sampler.second);
+			}
+		}
+		pProgram->release();
+	}
+}
+
+const char* const UniformBlocks::k_includeLine = "#include \"UniformBlocks.glsl\"";
+const char* const UniformBlocks::k_boneIncludeLine = "#include \"BonePalette.glsl\"";
+const char* const UniformBlocks::k_shadowIncludeLine = "#include \"Shadows.glsl\"";
+const char* const UniformBlocks::k_lightIncludeLine = "#include \"Lights.glsl\"";
+const char* const UniformBlocks::k_environmentIncludeLine = "#include \"Environment.glsl\"";
+const char* const UniformBlocks::k_surfaceIncludeLine = "#include \"Surface.glsl\"";
+
+// Have to match FrameBlock and MaterialBlock member for member
+const char* const UniformBlocks::k_frameDeclaration =
+	"layout(std140) uniform FrameBlock {\n"
+	"   mat4 uProjection;\n"
+	"   mat4 uMat4_1;\n"
+	"   vec4 uSpecularColor;\n"
+	"   vec4 uVec4_1;\n"
+	"   vec3 uLightPos;\n"
+	"   float uKa;\n"
+	"   vec3 uVec3_1;\n"
+	"   float uKd;\n"
+	"   float uKs;\n"
+	"   float uShininess;\n"
+	"   float uFloat_1;\n"
+	"   int uInt_1;\n"
+	"   int uAlphaToCoverage;\n"
+	"   int uAmbientOcclusion;\n"
+	"   int uFlatShading;\n"
+	"   vec4 uSectionPlanes[6];\n"
+	"};\n";
+
+const char* const UniformBlocks::k_materialDeclaration =
+	"layout(std140) uniform MaterialBlock {\n"
+	"   vec4 uMaterialAmbient;\n"
+	"   vec4 uMaterialDiffuse;\n"
+	"   vec4 uMaterialSpecular;\n"
+	"   float uMaterialShininess;\n"
+	"   float uHasTexture;\n"
+	"   float uMaterialMetallic;\n"
+	"   float uMaterialRoughness;\n"
+	"   vec4 uMaterialBaseColor;\n"
+	"   vec3 uMaterialEmissive;\n"
+	"   int uMaterialMaps;\n"
+	"   int uMaterialMetallicRoughness;\n"
+	"   int uMaterialAlphaMode;\n"
+	"   float uMaterialAlphaCutoff;\n"
+	"   uvec4 uMaterialHandles[3];\n"
+	"   vec4 uMaterialVirtual;\n"
+	"};\n";
+static_assert(UniformBlocks::k_virtualMapBit == 1 << k_materialMapCount, "The paged bit has to follow those of the maps");
+static_assert(PageFile::k_pageSize == 128 && PageFile::k_pageBorder == 4, "k_surfaceDeclaration has to match the pages");
+
+// The array has to hold AnimationPlayer::k_maxBones matrices
+const char* const UniformBlocks::k_boneDeclaration =
+	"layout(std140) uniform BonePalette {\n"
+	"   mat4 uBones[256];\n"
+	"};\n";
+static_assert(AnimationPlayer::k_maxBones == 256, "k_boneDeclaration has to match the bone limit");
+
+// Has to match ShadowBlock. Points outside the map are lit, each tap of the filter compares
+// four texels of the map at once.
+const char* const UniformBlocks::k_shadowDeclaration =
+	"layout(std140) uniform ShadowBlock {\n"
+	"   mat4 uShadowMatrices[4];\n"
+	"   vec4 uShadowSplits;\n"
+	"   int uShadowCascades;\n"
+	"   int uShadowFilter;\n"
+	"   float uShadowTexel;\n"
+	"};\n"
+	"uniform sampler2DArrayShadow uShadowMap;\n"
+	"float ShadowFactor(vec3 eyePosition) {\n"
+	"   if (uShadowCascades == 0) {\n"
+	"      return 1.0;\n"
+	"   }\n"
+	"   int cascade = 0;\n"
+	"   while (cascade + 1 < uShadowCascades && -eyePosition.z > uShadowSplits[cascade]) {\n"
+	"      ++cascade;\n"
+	"   }\n"
+	"   vec4 p = uShadowMatrices[cascade] * vec4(eyePosition, 1.0);\n"
+	"   if (p.w <= 0.0) {\n"
+	"      return 1.0;\n"
+	"   }\n"
+	"   p.xyz /= p.w;\n"
+	"   if (any(lessThan(p.xyz, vec3(0.0))) || any(greaterThan(p.xyz, vec3(1.0)))) {\n"
+	"      return 1.0;\n"
+	"   }\n"
+	"   float lit = 0.0;\n"
+	"   for (int y = -uShadowFilter; y <= uShadowFilter; ++y) {\n"
+	"      for (int x = -uShadowFilter; x <= uShadowFilter; ++x) {\n"
+	"         lit += texture(uShadowMap, vec4(p.xy + vec2(x, y) * uShadowTexel, float(cascade), p.z));\n"
+	"      }\n"
+	"   }\n"
+	"   float taps = float(2 * uShadowFilter + 1);\n"
+	"   return lit / (taps * taps);\n"
+	"}\n";
+
+// Has to match LightBlock, and the four texels LightClusters writes for each light: position
+// and range, color and type, direction and cosine of the outer cone, and attenuation and cosine
+// of the inner cone, all in eye space. Takes uProjection from the frame block to find the tile.
+const char* const UniformBlocks::k_lightDeclaration =
+	"layout(std140) uniform LightBlock {\n"
+	"   ivec4 uClusterGrid;\n"
+	"   vec4 uClusterDepth;\n"
+	"   int uDirectionalLights;\n"
+	"};\n"
+	"uniform samplerBuffer uSceneLights;\n"
+	"uniform usamplerBuffer uLightClusters;\n"
+	"uniform usamplerBuffer uLightIndices;\n"
+	"vec3 ShadeSceneLight(int light, vec3 eyePosition, vec3 normal, vec3 eye, vec3 diffuseColor, vec3 specularColor, float shininess) {\n"
+	"   vec4 position = texelFetch(uSceneLights, 4 * light);\n"
+	"   vec4 color = texelFetch(uSceneLights, 4 * light + 1);\n"
+	"   vec4 direction = texelFetch(uSceneLights, 4 * light + 2);\n"
+	"   vec4 attenuation = texelFetch(uSceneLights, 4 * light + 3);\n"
+	"   vec3 toLight = -direction.xyz;\n"
+	"   float strength = 1.0;\n"
+	"   if (color.w != 2.0) {\n"
+	"      toLight = position.xyz - eyePosition;\n"
+	"      float dist = length(toLight);\n"
+	"      toLight /= max(dist, 1e-6);\n"
+	"      strength = 1.0 / max(attenuation.x + (attenuation.y + attenuation.z * dist) * dist, 1e-6);\n"
+	"      if (position.w > 0.0) {\n"
+	"         float fade = clamp(1.0 - pow(dist / position.w, 4.0), 0.0, 1.0);\n"
+	"         strength *= fade * fade;\n"
+	"      }\n"
+	"      if (color.w == 1.0) {\n"
+	"         strength *= smoothstep(direction.w, attenuation.w, dot(-toLight, direction.xyz));\n"
+	"      }\n"
+	"   }\n"
+	"   float d = dot(normal, toLight);\n"
+	"   if (d <= 0.0 || strength <= 0.0) {\n"
+	"      return vec3(0.0);\n"
+	"   }\n"
+	"   vec3 ref = normalize(2.0 * normal * d - toLight);\n"
+	"   float s = pow(max(dot(eye, ref), 0.0), shininess);\n"
+	"   return color.rgb * strength * (d * diffuseColor + s * specularColor);\n"
+	"}\n"
+	"vec3 SceneLighting(vec3 eyePosition, vec3 normal, vec3 eye, vec3 diffuseColor, vec3 specularColor, float shininess) {\n"
+	"   vec3 lit = vec3(0.0);\n"
+	"   for (int i = 0; i < uDirectionalLights; ++i) {\n"
+	"      lit += ShadeSceneLight(i, eyePosition, normal, eye, diffuseColor, specularColor, shininess);\n"
+	"   }\n"
+	"   if (uClusterGrid.w == 0 || eyePosition.z >= 0.0) {\n"
+	"      return lit;\n"
+	"   }\n"
+	"   vec4 clip = uProjection * vec4(eyePosition, 1.0);\n"
+	"   ivec2 tile = clamp(ivec2(floor((clip.xy / clip.w * 0.5 + 0.5) * vec2(uClusterGrid.xy))), ivec2(0), uClusterGrid.xy - 1);\n"
+	"   int slice = clamp(int(floor(log(-eyePosition.z) * uClusterDepth.z + uClusterDepth.w)), 0, uClusterGrid.z - 1);\n"
+	"   uvec2 cluster = texelFetch(uLightClusters, (slice * uClusterGrid.y + tile.y) * uClusterGrid.x + tile.x).xy;\n"
+	"   for (uint i = 0u; i < cluster.y; ++i) {\n"
+	"      int light = int(texelFetch(uLightIndices, int(cluster.x + i)).x);\n"
+	"      lit += ShadeSceneLight(light, eyePosition, normal, eye, diffuseColor, specularColor, shininess);\n"
+	"   }\n"
+	"   return lit;\n"
+	"}\n";
+
+// Has to match EnvironmentBlock, and the equirectangular layout EnvironmentLighting prefilters
+// into. The shininess is turned into the roughness of the specular level and the lookup table,
+// and the specular color is taken as the reflectance facing the eye.
+const char* const UniformBlocks::k_environmentDeclaration =
+	"layout(std140) uniform EnvironmentBlock {\n"
+	"   mat4 uEnvironmentMatrix;\n"
+	"   float uEnvironmentIntensity;\n"
+	"   float uEnvironmentLevels;\n"
+	"   int uEnvironmentEnabled;\n"
+	"};\n"
+	"uniform sampler2D uIrradianceMap;\n"
+	"uniform sampler2D uSpecularMap;\n"
+	"uniform sampler2D uBrdfLut;\n"
+	"vec2 EquirectUv(vec3 d) {\n"
+	"   return vec2(atan(d.z, d.x) / 6.28318530718 + 0.5, acos(clamp(d.y, -1.0, 1.0)) / 3.14159265359);\n"
+	"}\n"
+	"vec3 EnvironmentLighting(vec3 normal, vec3 eye, vec3 diffuseColor, vec3 specularColor, float shininess) {\n"
+	"   if (uEnvironmentEnabled == 0) {\n"
+	"      return vec3(0.0);\n"
+	"   }\n"
+	"   vec3 n = normalize(mat3(uEnvironmentMatrix) * normal);\n"
+	"   vec3 r = normalize(mat3(uEnvironmentMatrix) * reflect(-eye, normal));\n"
+	"   float roughness = clamp(sqrt(sqrt(2.0 / (max(shininess, 0.0) + 2.0))), 0.0, 1.0);\n"
+	"   vec3 irradiance = textureLod(uIrradianceMap, EquirectUv(n), 0.0).rgb;\n"
+	"   vec3 reflected = textureLod(uSpecularMap, EquirectUv(r), roughness * (uEnvironmentLevels - 1.0)).rgb;\n"
+	"   vec2 brdf = texture(uBrdfLut, vec2(max(dot(normal, eye), 0.0), roughness)).rg;\n"
+	"   return uEnvironmentIntensity * (irradiance * diffuseColor + reflected * (specularColor * brdf.x + brdf.y));\n"
+	"}\n";
+
+// Reads the material block, so it has to follow the uniform blocks. Normal maps are turned by a
+// tangent frame built from the screen space slopes of the position and the UVs, so meshes need
+// no tangents. Metallic-roughness materials get the diffuse and specular colors of their metal
+// and dielectric parts, and the shininess of their roughness as EnvironmentLighting reads it
+// back. Bit n of uMaterialMaps stands for the map MaterialMap n. The screen-space ambient
+// occlusion of the pixel is multiplied into the map's while it's on, except on blended
+// materials, which the AmbientOcclusion pass doesn't draw. Masked materials are cut out
+// where their alpha is below the cutoff. With alpha to coverage the alpha is sharpened into a
+// ramp a pixel wide around the cutoff instead, so the samples it covers smooth the edge.
+// TransparentFragment weights a blended fragment by its depth as in McGuire and Bavoil's
+// weighted blended order-independent transparency. Both targets are blended alike, so the
+// accumulated color and the light let through go into the first and the total weight into the
+// second. A paged base color map is read from the atlas at the two resident levels around the
+// pixel's level of detail, looked up in the texture's layer of the page tables, which point
+// each missing page at its nearest resident ancestor, and from its tail below the pages.
+// Derivatives are taken before any branch, so every path filters alike.
+const char* const UniformBlocks::k_surfaceDeclaration =
+	"#ifdef BINDLESS_TEXTURES\n"
+	"vec4 SampleBoundMap(int map, sampler2D bound, vec2 uv, vec2 dx, vec2 dy) {\n"
+	"   uvec4 handles = uMaterialHandles[map / 2];\n"
+	"   return textureGrad(sampler2D((map % 2) == 0 ? handles.xy : handles.zw), uv, dx, dy);\n"
+	"}\n"
+	"#else\n"
+	"vec4 SampleBoundMap(int map, sampler2D bound, vec2 uv, vec2 dx, vec2 dy) {\n"
+	"   return textureGrad(bound, uv, dx, dy);\n"
+	"}\n"
+	"#endif\n"
+	"uniform sampler2DArray uPageTable;\n"
+	"uniform sampler2D uPageAtlas;\n"
+	"bool SampleVirtualLevel(vec2 uv, float level, out vec4 color) {\n"
+	"   vec2 size = ceil(uMaterialVirtual.xy / exp2(level));\n"
+	"   ivec2 page = ivec2(clamp(uv * size, vec2(0.0), size - 0.5) / 120.0);\n"
+	"   vec4 entry = floor(texelFetch(uPageTable, ivec3(page, int(uMaterialVirtual.w)), int(level)) * 255.0 + 0.5);\n"
+	"   if (entry.a == 0.0) {\n"
+	"      return false;\n"
+	"   }\n"
+	"   vec2 residentSize = ceil(uMaterialVirtual.xy / exp2(entry.b));\n"
+	"   vec2 texel = clamp(uv * residentSize, vec2(0.0), residentSize - 0.5);\n"
+	"   vec2 atlas = entry.rg * 128.0 + 4.0 + texel - floor(texel / 120.0) * 120.0;\n"
+	"   color = textureLod(uPageAtlas, atlas / vec2(textureSize(uPageAtlas, 0)), 0.0);\n"
+	"   return true;\n"
+	"}\n"
+	"vec4 SampleVirtualMap(sampler2D tail, vec2 uv, vec2 dx, vec2 dy) {\n"
+	"   vec2 texelDx = dx * uMaterialVirtual.xy;\n"
+	"   vec2 texelDy = dy * uMaterialVirtual.xy;\n"
+	"   float lod = 0.5 * log2(max(max(dot(texelDx, texelDx), dot(texelDy, texelDy)), 1e-8));\n"
+	"   float level = max(floor(lod), 0.0);\n"
+	"   vec4 fine;\n"
+	"   if (level >= uMaterialVirtual.z || !SampleVirtualLevel(clamp(uv, 0.0, 1.0), level, fine)) {\n"
+	"      return SampleBoundMap(0, tail, uv, dx, dy);\n"
+	"   }\n"
+	"   vec4 coarse;\n"
+	"   if (level + 1.0 >= uMaterialVirtual.z || !SampleVirtualLevel(clamp(uv, 0.0, 1.0), level + 1.0, coarse)) {\n"
+	"      coarse = SampleBoundMap(0, tail, uv, dx, dy);\n"
+	"   }\n"
+	"   return mix(fine, coarse, clamp(lod - level, 0.0, 1.0));\n"
+	"}\n"
+	"vec4 SampleMaterialMap(int map, sampler2D bound, vec2 uv) {\n"
+	"   vec2 dx = dFdx(uv);\n"
+	"   vec2 dy = dFdy(uv);\n"
+	"   if (map == 0 && (uMaterialMaps & 32) != 0) {\n"
+	"      return SampleVirtualMap(bound, uv, dx, dy);\n"
+	"   }\n"
+	"   return SampleBoundMap(map, bound, uv, dx, dy);\n"
+	"}\n"
+	"uniform sampler2D uNormalMap;\n"
+	"uniform sampler2D uMetallicRoughnessMap;\n"
+	"uniform sampler2D uOcclusionMap;\n"
+	"uniform sampler2D uEmissiveMap;\n"
+	"uniform sampler2D uAmbientOcclusionMap;\n"
+	"struct Surface {\n"
+	"   vec3 normal;\n"
+	"   vec3 diffuseColor;\n"
+	"   vec3 specularColor;\n"
+	"   float shininess;\n"
+	"   float occlusion;\n"
+	"   vec3 emissive;\n"
+	"   float alpha;\n"
+	"};\n"
+	"Surface MaterialSurface(vec4 color, vec3 normal, vec3 eyePosition, vec2 uv, vec3 specularColor, float shininess) {\n"
+	"   Surface surface;\n"
+	"   vec3 base = color.rgb * uMaterialBaseColor.rgb;\n"
+	"   surface.normal = normal;\n"
+	"   if ((uMaterialMaps & 2) != 0) {\n"
+	"      vec3 dpx = cross(normal, dFdx(eyePosition));\n"
+	"      vec3 dpy = cross(dFdy(eyePosition), normal);\n"
+	"      vec2 duvx = dFdx(uv);\n"
+	"      vec2 duvy = dFdy(uv);\n"
+	"      vec3 tangent = dpy * duvx.x + dpx * duvy.x;\n"
+	"      vec3 bitangent = dpy * duvx.y + dpx * duvy.y;\n"
+	"      float scale = max(dot(tangent, tangent), dot(bitangent, bitangent));\n"
+	"      if (scale > 0.0) {\n"
+	"         vec3 m = SampleMaterialMap(1, uNormalMap, uv).xyz * 2.0 - 1.0;\n"
+	"         surface.normal = normalize(mat3(tangent, bitangent, normal * sqrt(scale)) * m);\n"
+	"      }\n"
+	"   }\n"
+	"   float metallic = uMaterialMetallic;\n"
+	"   float roughness = uMaterialRoughness;\n"
+	"   if ((uMaterialMaps & 4) != 0) {\n"
+	"      vec4 packed = SampleMaterialMap(2, uMetallicRoughnessMap, uv);\n"
+	"      roughness *= packed.g;\n"
+	"      metallic *= packed.b;\n"
+	"   }\n"
+	"   if (uMaterialMetallicRoughness != 0) {\n"
+	"      float a = max(roughness * roughness, 1e-3);\n"
+	"      surface.diffuseColor = base * (1.0 - metallic);\n"
+	"      surface.specularColor = mix(vec3(0.04), base, metallic);\n"
+	"      surface.shininess = 2.0 / (a * a) - 2.0;\n"
+	"   }\n"
+	"   else {\n"
+	"      surface.diffuseColor = base;\n"
+	"      surface.specularColor = specularColor;\n"
+	"      surface.shininess = shininess;\n"
+	"   }\n"
+	"   surface.occlusion = (uMaterialMaps & 8) != 0 ? SampleMaterialMap(3, uOcclusionMap, uv).r : 1.0;\n"
+	"   if (uAmbientOcclusion != 0 && uMaterialAlphaMode != 2) {\n"
+	"      surface.occlusion *= texelFetch(uAmbientOcclusionMap, ivec2(gl_FragCoord.xy), 0).r;\n"
+	"   }\n"
+	"   surface.emissive = uMaterialEmissive;\n"
+	"   if ((uMaterialMaps & 16) != 0) {\n"
+	"      surface.emissive *= SampleMaterialMap(4, uEmissiveMap, uv).rgb;\n"
+	"   }\n"
+	"   surface.alpha = uMaterialAlphaMode == 0 ? 1.0 : color.a * uMaterialBaseColor.a;\n"
+	"   if (uMaterialAlphaMode == 1) {\n"
+	"      if (uAlphaToCoverage != 0) {\n"
+	"         surface.alpha = clamp((surface.alpha - uMaterialAlphaCutoff) / max(fwidth(surface.alpha), 1e-4) + 0.5, 0.0, 1.0);\n"
+	"      }\n"
+	"      else {\n"
+	"         surface.alpha = surface.alpha < uMaterialAlphaCutoff ? 0.0 : 1.0;\n"
+	"      }\n"
+	"      if (surface.alpha <= 0.0) {\n"
+	"         discard;\n"
+	"      }\n"
+	"   }\n"
+	"   return surface;\n"
+	"}\n"
+	"void TransparentFragment(vec3 color, float alpha, out vec4 accumulated, out vec4 weight) {\n"
+	"   float w = alpha * clamp(3e3 * pow(1.0 - gl_FragCoord.z, 3.0), 1e-2, 3e3);\n"
+	"   accumulated = vec4(color * alpha * w, alpha);\n"
+	"   weight = vec4(alpha * w);\n"
+	"}\n";
+
+const char* const UniformBlocks::k_bindlessMacro = "BINDLESS_TEXTURES";
+const char* const UniformBlocks::k_bindlessDirectives =
+	"#extension GL_ARB_bindless_texture : require\n"
+	"#define BINDLESS_TEXTURES\n";
+
+QByteArray UniformBlocks::ExpandInclude(const QByteArray& source, bool bindless)
+{
+	QByteArray expanded = source;
+
+	// The extension has to come before anything but other directives, right after #version
+	if (bindless && source.contains(k_surfaceIncludeLine) && source.startsWith("#version")) {
+		const int lineEnd = source.indexOf('\n');
+		if (lineEnd >= 0) {
+			expanded.insert(lineEnd + 1, QByteArray(k_bindlessDirectives) + "#line 2\n");
+		}
+	}
+	expanded.replace(k_boneIncludeLine, k_boneDeclaration);
+	expanded.replace(k_shadowIncludeLine, k_shadowDeclaration);
+	expanded.replace(k_lightIncludeLine, k_lightDeclaration);
+	expanded.replace(k_environmentIncludeLine, k_environmentDeclaration);
+	expanded.replace(k_surfaceIncludeLine, k_surfaceDeclaration);
+	return expanded.replace(k_includeLine, QByteArray(k_frameDeclaration) + k_materialDeclaration);
+}
+
+bool UniformBlocks::BindBlock(QOpenGLShaderProgram* pProgram, const char* pName, GLuint binding)
+{
+	if (!SupportsUniformBuffers() || !pProgram->isLinked()) {
+		return false;
+	}
+	QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+	const GLuint blockIdx = f->glGetUniformBlockIndex(pProgram->programId(), pName);
+	if (blockIdx == GL_INVALID_INDEX) {
+		return false;
+	}
+	f->glUniformBlockBinding(pProgram->programId(), blockIdx, binding);
+	return true;
+}
+
+bool UniformBlocks::BindMaterial(QOpenGLShaderProgram* pProgram)
+{
+	if (!BindBlock(pProgram, "MaterialBlock", k_materialBlockBinding)) {
+		return false;
+	}
+	const std::pair<const char*, GLint> samplers[] = {
+		{ "uNormalMap", k_normalMapUnit },
+		{ "uMetallicRoughnessMap", k_metallicRoughnessMapUnit },
+		{ "uOcclusionMap", k_occlusionMapUnit },
+		{ "uEmissiveMap", k_emissiveMapUnit },
+		{ "uAmbientOcclusionMap", k_ambientOcclusionUnit },
+	};
+	SetSamplers(pProgram, samplers);
+	BindPages(pProgram);
+	return true;
+}
+
+void UniformBlocks::BindPages(QOpenGLShaderProgram* pProgram)
+{
+	const std::pair<const char*, GLint> samplers[] = {
+		{ "uPageTable", k_pageTableUnit },
+		{ "uPageAtlas", k_pageAtlasUnit },
+	};
+	SetSamplers(pProgram, samplers);
+}
+
+void UniformBlocks::BindShadows(QOpenGLShaderProgram* pProgram)
+{
+	if (!BindBlock(pProgram, "ShadowBlock", k_shadowBlockBinding)) {
+		return;
+	}
+	const int samplerUniform = pProgram->uniformLocation("uShadowMap");
+	if (samplerUniform != -1) {
+		pProgram->bind();
+		pProgram->setUniformValue(samplerUniform, k_shadowMapUnit);
+		pProgram->release();
+	}
+}
+
+void UniformBlocks::BindLights(QOpenGLShaderProgram* pProgram)
+{
+	if (!BindBlock(pProgram, "LightBlock", k_lightBlockBinding)) {
+		return;
+	}
+	const std::pair<const char*, GLint> samplers[] = {
+		{ "uSceneLights", k_sceneLightsUnit },
+		{ "uLightClusters", k_lightClustersUnit },
+		{ "uLightIndices", k_lightIndicesUnit },
+	};
+	SetSamplers(pProgram, samplers);
+}
+
+void UniformBlocks::BindEnvironment(QOpenGLShaderProgram* pProgram)
+{
+	if (!BindBlock(pProgram, "EnvironmentBlock", k_environmentBlockBinding)) {
+		return;
+	}
+	const std::pair<const char*, GLint> samplers[] = {
+		{ "uIrradianceMap", k_irradianceUnit },
+		{ "uSpecularMap", k_specularUnit },
+		{ "uBrdfLut", k_brdfUnit },
+	};
+	SetSamplers(pProgram, samplers);
+}
+
+bool UniformBlocks::SupportsUniformBuffers()
+{
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext) {
+		return false;
+	}
+	const QPair<int, int> version = pContext->format().version();
+	return version >= (pContext->isOpenGLES() ? qMakePair(3, 0) : qMakePair(3, 1));
+}
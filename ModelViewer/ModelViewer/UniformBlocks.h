@@ -0,0 +1,195 @@
+#pragma once
+#include <QByteArray>
+#include <qopengl.h>
+
+class QOpenGLShaderProgram;
+
+// Binding points of the uniform blocks model shaders can declare
+enum UniformBlockBinding : GLuint {
+	k_frameBlockBinding = 0,
+	k_materialBlockBinding = 1,
+	k_bonePaletteBinding = 2,
+	k_shadowBlockBinding = 3,
+	k_lightBlockBinding = 4,
+	k_environmentBlockBinding = 5,
+};
+
+// FrameBlock in std140 layout, written once per frame. Mirrors the loose uniforms older
+// shaders use, plus the projection so shaders don't need a per mesh matrix for gl_Position.
+// m_alphaToCoverage is set while the scene is multisampled with alpha to coverage on, and
+// m_ambientOcclusion while the AmbientOcclusion pass computed the occlusion of this frame.
+// m_flatShading has meshes shaded with the normals of their triangles instead of their vertices.
+// m_sectionPlanes are the section planes in eye space, which vertex shaders write to
+// gl_ClipDistance. Planes that aren't set keep everything.
+struct FrameBlock {
+	GLfloat m_projection[16];
+	GLfloat m_mat4_1[16];
+	GLfloat m_specularColor[4];
+	GLfloat m_vec4_1[4];
+	GLfloat m_lightPosition[3];
+	GLfloat m_ka;
+	GLfloat m_vec3_1[3];
+	GLfloat m_kd;
+	GLfloat m_ks;
+	GLfloat m_shininess;
+	GLfloat m_float_1;
+	GLint m_int_1;
+	GLint m_alphaToCoverage;
+	GLint m_ambientOcclusion;
+	GLint m_flatShading;
+	GLint m_padding;
+	GLfloat m_sectionPlanes[6][4];
+};
+static_assert(sizeof(FrameBlock) == 320, "FrameBlock has to match the std140 layout");
+
+// MaterialBlock in std140 layout, uploaded once per material together with it. m_maps has the
+// bit 1 << MaterialMap set for each map the material has, m_alphaMode is an AlphaMode. The bindless handles of the maps are
+// split into their low and high words, two maps to a row. With UniformBlocks::k_virtualMapBit
+// set in m_maps the base color map is paged, m_virtual is then VirtualTexture::Parameters.
+struct MaterialBlock {
+	GLfloat m_ambient[4];
+	GLfloat m_diffuse[4];
+	GLfloat m_specular[4];
+	GLfloat m_shininess;
+	GLfloat m_hasTexture;
+	GLfloat m_metallic;
+	GLfloat m_roughness;
+	GLfloat m_baseColor[4];
+	GLfloat m_emissive[3];
+	GLint m_maps;
+	GLint m_metallicRoughness;
+	GLint m_alphaMode;
+	GLfloat m_alphaCutoff;
+	GLfloat m_padding;
+	GLuint m_handles[3][4];
+	GLfloat m_virtual[4];
+};
+static_assert(sizeof(MaterialBlock) == 176, "MaterialBlock has to match the std140 layout");
+
+// ShadowBlock in std140 layout, written once per frame by the ShadowMapper. The matrices move
+// a point from eye space into the shadow map of each cascade.
+struct ShadowBlock {
+	GLfloat m_matrices[4][16];
+	GLfloat m_splits[4];
+	GLint m_cascades;
+	GLint m_filterRadius;
+	GLfloat m_texelSize;
+	GLfloat m_padding;
+};
+static_assert(sizeof(ShadowBlock) == 288, "ShadowBlock has to match the std140 layout");
+
+// LightBlock in std140 layout, written once per frame by the LightClusters. The grid holds the
+// tiles across and down, the depth slices, and 0 when there are no lights to look up in it.
+// The depth holds the grid's near and far depth and the scale and bias of the log of a depth
+// that give its slice.
+struct LightBlock {
+	GLint m_grid[4];
+	GLfloat m_depth[4];
+	GLint m_directionalLights;
+	GLint m_padding[3];
+};
+static_assert(sizeof(LightBlock) == 48, "LightBlock has to match the std140 layout");
+
+// EnvironmentBlock in std140 layout, written once per frame by the EnvironmentLighting. The
+// matrix turns eye space directions into the model's, where the environment is fixed.
+struct EnvironmentBlock {
+	GLfloat m_eyeToModel[16];
+	GLfloat m_intensity;
+	GLfloat m_specularLevels;
+	GLint m_enabled;
+	GLfloat m_padding;
+};
+static_assert(sizeof(EnvironmentBlock) == 80, "EnvironmentBlock has to match the std140 layout");
+
+// Shared declarations of the uniform blocks. A shader declares them with a line reading
+// #include "UniformBlocks.glsl", which is replaced by the declarations when it is loaded.
+// Skinning shaders also include "BonePalette.glsl" for the bone matrices of the mesh, one mat4
+// per bone up to AnimationPlayer::k_maxBones. Fragment shaders that include "Shadows.glsl" get
+// the shadow block and map, and ShadowFactor, which gives how much of the light reaches a point
+// in eye space. Those that include "Lights.glsl" after the uniform blocks get SceneLighting,
+// which adds up the lights of the scene reaching a point in eye space. "Environment.glsl" gives
+// EnvironmentLighting, the light of the HDR environment reflected by a surface. Those that
+// include "Surface.glsl" after the uniform blocks get MaterialSurface, which applies the
+// material's maps and factors to a point's color and normal, and SampleMaterialMap, which reads
+// a map from its bindless handle when the shader is built with bindless textures, and a paged
+// base color map from the pages VirtualTextures has resident, falling back to its tail. Their
+// TransparentFragment gives what a fragment of a blended material writes to the two targets of
+// the TransparencyPass.
+class UniformBlocks
+{
+public:
+	// Texture unit of the shadow map, the model's own texture or base color map is on unit 0
+	static const GLint k_shadowMapUnit = 2;
+
+	// Texture units of the scene lights, the clusters and the lights of each cluster
+	static const GLint k_sceneLightsUnit = 3;
+	static const GLint k_lightClustersUnit = 4;
+	static const GLint k_lightIndicesUnit = 5;
+
+	// Texture units of the prefiltered environment
+	static const GLint k_irradianceUnit = 6;
+	static const GLint k_specularUnit = 7;
+	static const GLint k_brdfUnit = 8;
+
+	// Texture units of the material's other maps, in the order of MaterialMap
+	static const GLint k_normalMapUnit = 9;
+	static const GLint k_metallicRoughnessMapUnit = 10;
+	static const GLint k_occlusionMapUnit = 11;
+	static const GLint k_emissiveMapUnit = 12;
+
+	// Texture unit of the screen-space ambient occlusion of the frame
+	static const GLint k_ambientOcclusionUnit = 13;
+
+	// Texture units of the page tables and the page atlas of the VirtualTextures
+	static const GLint k_pageTableUnit = 14;
+	static const GLint k_pageAtlasUnit = 15;
+
+	// Bit of MaterialBlock::m_maps set for materials whose base color map is paged, the one
+	// after those of the maps
+	static const GLint k_virtualMapBit = 32;
+
+	static const char* const k_includeLine;
+	static const char* const k_frameDeclaration;
+	static const char* const k_materialDeclaration;
+	static const char* const k_boneIncludeLine;
+	static const char* const k_boneDeclaration;
+	static const char* const k_shadowIncludeLine;
+	static const char* const k_shadowDeclaration;
+	static const char* const k_lightIncludeLine;
+	static const char* const k_lightDeclaration;
+	static const char* const k_environmentIncludeLine;
+	static const char* const k_environmentDeclaration;
+	static const char* const k_surfaceIncludeLine;
+	static const char* const k_surfaceDeclaration;
+
+	// Defined in shaders that sample the material's maps by their bindless handles
+	static const char* const k_bindlessMacro;
+	static const char* const k_bindlessDirectives;
+
+	// Replaces the include lines in a shader's source with their declarations. With bindless,
+	// shaders including "Surface.glsl" are built to sample the maps by their handles.
+	static QByteArray ExpandInclude(const QByteArray& source, bool bindless = false);
+
+	// Points the block called pName at binding, returns false if the linked program doesn't use it
+	static bool BindBlock(QOpenGLShaderProgram* pProgram, const char* pName, GLuint binding);
+
+	// Points the material block and maps of a linked program at theirs. Returns false if it
+	// doesn't use the block.
+	static bool BindMaterial(QOpenGLShaderProgram* pProgram);
+
+	// Points the page tables and atlas of a linked program at theirs, if it uses them. Programs
+	// that take their materials from elsewhere need them as well, BindMaterial binds them too.
+	static void BindPages(QOpenGLShaderProgram* pProgram);
+
+	// Points the shadow block and map of a linked program at theirs, if it uses them
+	static void BindShadows(QOpenGLShaderProgram* pProgram);
+
+	// Points the light block and buffers of a linked program at theirs, if it uses them
+	static void BindLights(QOpenGLShaderProgram* pProgram);
+
+	// Points the environment block and maps of a linked program at theirs, if it uses them
+	static void BindEnvironment(QOpenGLShaderProgram* pProgram);
+
+	// Uniform buffers need OpenGL 3.1 or OpenGL ES 3.0
+	static bool SupportsUniformBuffers();
+};
@@ -6,6 +6,8 @@
 #include <QLabel>
 #include <QSignalBlocker>
 
+#include <vector>
+
 GraphicsWindowUniform::GraphicsWindowUniform(ViewerGraphicsWindow* graphicsWindow, QWidget* parent)
     : m_pGraphicsWindow(graphicsWindow), QWidget(parent)
 {
@@ -30,6 +32,8 @@ GraphicsWindowUniform::GraphicsWindowUniform(ViewerGraphicsWindow* graphicsWindo
     createEffectController();
     //template of Spin box, example: ADS lighting features
     createLightingController();
+    //Spin boxes for whatever else the shaders declare
+    createShaderUniformController();
 
     //Windows layout
     QVBoxLayout* layout = new QVBoxLayout;
@@ -40,12 +44,14 @@ GraphicsWindowUniform::GraphicsWindowUniform(ViewerGraphicsWindow* graphicsWindo
     layout->addWidget(settingGroup);
     layout->addWidget(effectGroup);
     layout->addWidget(lightGroup);
+    layout->addWidget(shaderUniformGroup);
     setLayout(layout);
 
     setWindowTitle(tr("Uniform"));
 
     // Take the default values from the Viewer Graphics Window
     connect(m_pGraphicsWindow, &ViewerGraphicsWindow::Initialized, this, &GraphicsWindowUniform::UpdateControllerValues);
+    connect(m_pGraphicsWindow, &ViewerGraphicsWindow::ShaderUniformsChanged, this, &GraphicsWindowUniform::UpdateShaderUniforms);
 }
 
 void GraphicsWindowUniform::UpdateControllerValues()
@@ -62,12 +68,24 @@ void GraphicsWindowUniform::UpdateControllerValues()
     const QSignalBlocker blocker5(diffuseSpinBox);
     const QSignalBlocker blocker6(specularSpinBox);
     const QSignalBlocker blocker7(colorDial);
+    const QSignalBlocker blocker8(effectCombo);
+    const QSignalBlocker blocker9(aoTemporalOn);
 
     // Update the sliders
     colorRSlider->setValue(adColor.x() * 255);
     colorGSlider->setValue(adColor.y() * 255);
     colorBSlider->setValue(adColor.z() * 255);
 
+    // Show ambient occlusion if it's on, the other effects aren't kept
+    const AmbientOcclusion::Options ambientOcclusion = m_pGraphicsWindow->getAmbientOcclusion();
+    if (ambientOcclusion.m_mode == k_ambientOcclusionFull) {
+        effectCombo->setCurrentIndex(ViewerGraphicsWindow::k_effectAmbientOcclusion);
+    }
+    else if (ambientOcclusion.m_mode == k_ambientOcclusionHalf) {
+        effectCombo->setCurrentIndex(ViewerGraphicsWindow::k_effectAmbientOcclusionHalf);
+    }
+    aoTemporalOn->setChecked(ambientOcclusion.m_temporal);
+
     // Update spinboxes
     ambientSpinBox->setValue(ads.x());
     diffuseSpinBox->setValue(ads.y());
@@ -219,17 +237,21 @@ void GraphicsWindowUniform:: createSettingController() {
 
     //CheckBoxes for confirming whether to turn on smoothing and lighting
     smoothingOn = new QCheckBox(tr("Smoothing"));
+    flatShadingOn = new QCheckBox(tr("Flat Shading"));
     lightingOn = new QCheckBox(tr("Lighting"));
 
     //signal
     connect(smoothingOn, &QCheckBox::toggled, 
         m_pGraphicsWindow, &ViewerGraphicsWindow::smoothingSwitch);
+    connect(flatShadingOn, &QCheckBox::toggled,
+        m_pGraphicsWindow, &ViewerGraphicsWindow::flatShadingSwitch);
     connect(lightingOn, &QCheckBox::toggled,
         m_pGraphicsWindow, &ViewerGraphicsWindow::lightingSwitch);
 
     //layout
     QGridLayout* settingLayout = new QGridLayout;
     settingLayout->addWidget(smoothingOn);
+    settingLayout->addWidget(flatShadingOn);
     settingLayout->addWidget(lightingOn);
     settingGroup->setLayout(settingLayout);
 }
@@ -243,14 +265,26 @@ void GraphicsWindowUniform::createEffectController()
     effectCombo->addItem(tr("Negative"));
     effectCombo->addItem(tr("Saturation"));
     effectCombo->addItem(tr("Sharpening"));
+    effectCombo->addItem(tr("Ambient Occlusion"));
+    effectCombo->addItem(tr("Ambient Occlusion (Half Resolution)"));
+    effectCombo->setItemData(ViewerGraphicsWindow::k_effectAmbientOcclusion,
+        tr("Darken creases and corners the ambient light reaches less of. Its cost shows as Ambient Occlusion in the GPU pass times"), Qt::ToolTipRole);
+    effectCombo->setItemData(ViewerGraphicsWindow::k_effectAmbientOcclusionHalf,
+        tr("Ambient occlusion computed for a quarter of the pixels and upsampled along the edges, for about a quarter of the cost"), Qt::ToolTipRole);
+
+    //CheckBox for blending the occlusion of earlier frames in, which smooths its noise
+    aoTemporalOn = new QCheckBox(tr("Accumulate Occlusion Over Frames"));
 
     //singal
     connect(effectCombo, QOverload<int>::of(&QComboBox::activated), 
         m_pGraphicsWindow, &ViewerGraphicsWindow::effectType);
+    connect(aoTemporalOn, &QCheckBox::toggled,
+        m_pGraphicsWindow, &ViewerGraphicsWindow::ambientOcclusionTemporal);
 
     //layout
     QGridLayout* effectLayout = new QGridLayout;
     effectLayout->addWidget(effectCombo);
+    effectLayout->addWidget(aoTemporalOn);
     effectGroup->setLayout(effectLayout);
 }
 
@@ -296,3 +330,55 @@ void GraphicsWindowUniform::createLightingController()
     ADSLightingLayout->addWidget(specularSpinBox, 2, 1);
     lightGroup->setLayout(ADSLightingLayout);
 }
+
+void GraphicsWindowUniform::createShaderUniformController()
+{
+    shaderUniformGroup = new QGroupBox("Shader Uniforms");
+    shaderUniformGroup->setLayout(new QVBoxLayout);
+    UpdateShaderUniforms();
+}
+
+void GraphicsWindowUniform::UpdateShaderUniforms()
+{
+    // The rows of the previous shaders go all at once
+    delete shaderUniformRows;
+    shaderUniformRows = new QWidget;
+    QGridLayout* rowsLayout = new QGridLayout(shaderUniformRows);
+    rowsLayout->setContentsMargins(0, 0, 0, 0);
+
+    int row = 0;
+    for (const ProgramInterface::Variable& uniform : m_pGraphicsWindow->getUserUniforms()) {
+        const int components = ProgramInterface::UserComponents(uniform.m_type);
+        const bool integer = uniform.m_type == GL_INT || uniform.m_type == GL_BOOL;
+        const QVector4D value = m_pGraphicsWindow->getUserUniform(uniform.m_name);
+        rowsLayout->addWidget(new QLabel(QString::fromLatin1(uniform.m_name) + ":"), row, 0);
+
+        std::vector<QDoubleSpinBox*> spinBoxes;
+        for (int i = 0; i < components; ++i) {
+            QDoubleSpinBox* spinBox = new QDoubleSpinBox;
+            spinBox->setRange(-1000, 1000);
+            spinBox->setDecimals(integer ? 0 : 3);
+            spinBox->setSingleStep(integer ? 1 : 0.01);
+            spinBox->setValue(value[i]);
+            rowsLayout->addWidget(spinBox, row, i + 1);
+            spinBoxes.push_back(spinBox);
+        }
+
+        // Any component changing sets the whole value
+        const QByteArray name = uniform.m_name;
+        for (QDoubleSpinBox* spinBox : spinBoxes) {
+            connect(spinBox, QOverload<double>::of(&QDoubleSpinBox::valueChanged), this, [=] {
+                QVector4D newValue;
+                for (int i = 0; i < int(spinBoxes.size()); ++i) {
+                    newValue[i] = float(spinBoxes[i]->value());
+                }
+                m_pGraphicsWindow->setUserUniform(name, newValue);
+            });
+        }
+        ++row;
+    }
+    if (row == 0) {
+        rowsLayout->addWidget(new QLabel(tr("The shaders have no uniforms of their own")), 0, 0);
+    }
+    shaderUniformGroup->layout()->addWidget(shaderUniformRows);
+}
@@ -27,6 +27,10 @@ private:
     void createSettingController();
     void createEffectController();
     void createLightingController();
+    void createShaderUniformController();
+
+    // One row of spin boxes for each user uniform of the current shaders
+    void UpdateShaderUniforms();
 
     //Color uniform
     QLabel* colorRLabel;
@@ -56,10 +60,12 @@ private:
     //Seting uniform
     QCheckBox* lightingOn;
     QCheckBox* smoothingOn;
+    QCheckBox* flatShadingOn;
     QGroupBox* settingGroup;
 
     //effect uniform
     QComboBox* effectCombo;
+    QCheckBox* aoTemporalOn;
     QGroupBox* effectGroup;
 
     //ADS Lighting features
@@ -71,6 +77,10 @@ private:
     QDoubleSpinBox* specularSpinBox;
     QGroupBox* lightGroup;
 
+    //Uniforms the shaders declare themselves
+    QGroupBox* shaderUniformGroup;
+    QWidget* shaderUniformRows = nullptr;
+
     //ModelViewer
     ViewerGraphicsWindow* m_pGraphicsWindow = nullptr;
 };
@@ -0,0 +1,240 @@
+#include "VertexCacheOptimizer.h"
+
+#include <algorithm>
+#include <numeric>
+
+
+namespace {
+
+// Clusters for the overdraw order may cost this much more ACMR than the order they came from
+const double k_overdrawMaxAcmrGrowth = 1.05;
+
+// Triangles a cluster needs before a cache restart ends it, so the sort has something to gain
+const int k_overdrawMinClusterTriangles = 64;
+
+// Simulates a FIFO cache over indices, calling Miss(i) for every index that isn't in it. A
+// vertex is in the cache if fewer than cacheSize misses happened since it was last loaded.
+template <typename MissFunc>
+void SimulateCache(const quint32* pIndices, int indexCount, int cacheSize, std::vector<int>& loadedAt, MissFunc Miss)
+{
+	int misses = 0;
+	for (int i = 0; i < indexCount; ++i) {
+		int& loaded = loadedAt[pIndices[i]];
+		if (loaded < 0 || misses - loaded >= cacheSize) {
+			loaded = misses++;
+			Miss(i);
+		}
+	}
+}
+
+}
+
+VertexCacheOptimizer::Stats VertexCacheOptimizer::Analyze(const quint32* pIndices, int indexCount, int cacheSize)
+{
+	Stats ret;
+	if (indexCount < 3) {
+		return ret;
+	}
+	const quint32 vertexCount = *std::max_element(pIndices, pIndices + indexCount) + 1;
+	std::vector<int> loadedAt(vertexCount, -1);
+	int misses = 0;
+	SimulateCache(pIndices, indexCount, cacheSize, loadedAt, [&](int) {
+		++misses;
+	});
+	const int usedVertices = int(std::count_if(loadedAt.begin(), loadedAt.end(), [](int loaded) {
+		return loaded >= 0;
+	}));
+	ret.m_acmr = double(misses) / double(indexCount / 3);
+	ret.m_atvr = double(misses) / double(usedVertices);
+	return ret;
+}
+
+std::vector<quint32> VertexCacheOptimizer::OptimizeCache(const std::vector<quint32>& indices, int vertexCount, int cacheSize)
+{
+	const int triangleCount = int(indices.size() / 3);
+	if (triangleCount == 0 || vertexCount <= 0) {
+		return indices;
+	}
+
+	// The triangles of each vertex, and how many of them are still to be emitted
+	std::vector<int> adjacencyStart(vertexCount + 1, 0);
+	for (int i = 0; i < 3 * triangleCount; ++i) {
+		++adjacencyStart[indices[i] + 1];
+	}
+	std::partial_sum(adjacencyStart.begin(), adjacencyStart.end(), adjacencyStart.begin());
+	std::vector<int> adjacency(3 * triangleCount);
+	{
+		std::vector<int> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+		for (int i = 0; i < 3 * triangleCount; ++i) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+	std::vector<int> live(vertexCount);
+	for (int v = 0; v < vertexCount; ++v) {
+		live[v] = adjacencyStart[v + 1] - adjacencyStart[v];
+	}
+
+	// Times are counted in cache loads, a vertex is in the cache for cacheSize loads. Vertices
+	// start out of it.
+	std::vector<int> cacheTime(vertexCount, 0);
+	int time = cacheSize + 1;
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<quint32> deadEnds;
+	std::vector<quint32> candidates;
+	std::vector<quint32> ret;
+	ret.reserve(indices.size());
+	int cursor = 0;
+
+	// A vertex with triangles left, from the dead end stack first and then in input order
+	auto SkipDeadEnd = [&]() {
+		while (!deadEnds.empty()) {
+			const quint32 v = deadEnds.back();
+			deadEnds.pop_back();
+			if (live[v] > 0) {
+				return int(v);
+			}
+		}
+		while (cursor < vertexCount) {
+			if (live[cursor] > 0) {
+				return cursor;
+			}
+			++cursor;
+		}
+		return -1;
+	};
+
+	// Fan around the candidate that will still be in the cache when its remaining triangles
+	// are emitted and has been there longest. Vertices that would drop out don't count.
+	auto NextVertex = [&]() {
+		int best = -1;
+		int bestPriority = -1;
+		for (quint32 v : candidates) {
+			if (live[v] <= 0) {
+				continue;
+			}
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize) {
+				priority = time - cacheTime[v];
+			}
+			if (priority > bestPriority) {
+				best = int(v);
+				bestPriority = priority;
+			}
+		}
+		return best >= 0 ? best : SkipDeadEnd();
+	};
+
+	int fan = SkipDeadEnd();
+	while (fan >= 0) {
+		candidates.clear();
+		for (int a = adjacencyStart[fan]; a < adjacencyStart[fan + 1]; ++a) {
+			const int t = adjacency[a];
+			if (emitted[t]) {
+				continue;
+			}
+			emitted[t] = true;
+			for (int k = 0; k < 3; ++k) {
+				const quint32 v = indices[3 * t + k];
+				ret.push_back(v);
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cacheTime[v] > cacheSize) {
+					cacheTime[v] = time++;
+				}
+			}
+		}
+		fan = NextVertex();
+	}
+	return ret;
+}
+
+std::vector<quint32> VertexCacheOptimizer::OptimizeOverdraw(const std::vector<quint32>& indices, const std::vector<QVector3D>& positions, int cacheSize)
+{
+	const int indexCount = int(indices.size() / 3) * 3;
+	if (indexCount == 0) {
+		return indices;
+	}
+
+	// A cluster starts where a triangle misses all of its vertices, so moving it elsewhere
+	// costs little that the cache could have saved
+	std::vector<int> loadedAt(positions.size(), -1);
+	std::vector<int> missesPerTriangle(indexCount / 3, 0);
+	SimulateCache(indices.data(), indexCount, cacheSize, loadedAt, [&](int i) {
+		++missesPerTriangle[i / 3];
+	});
+	std::vector<int> clusterStarts = { 0 };
+	for (int t = 1; t < indexCount / 3; ++t) {
+		if (missesPerTriangle[t] == 3 && t - clusterStarts.back() >= k_overdrawMinClusterTriangles) {
+			clusterStarts.push_back(t);
+		}
+	}
+	if (clusterStarts.size() < 2) {
+		return indices;
+	}
+	clusterStarts.push_back(indexCount / 3);
+
+	// Area weighted center and normal of each cluster, and the center of the mesh
+	const int clusterCount = int(clusterStarts.size()) - 1;
+	std::vector<QVector3D> centers(clusterCount);
+	std::vector<QVector3D> normals(clusterCount);
+	QVector3D meshCenter;
+	float meshArea = 0.f;
+	for (int c = 0; c < clusterCount; ++c) {
+		float area = 0.f;
+		for (int t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+			const QVector3D& a = positions[indices[3 * t]];
+			const QVector3D& b = positions[indices[3 * t + 1]];
+			const QVector3D& d = positions[indices[3 * t + 2]];
+			const QVector3D normal = QVector3D::crossProduct(b - a, d - a);
+			const float triangleArea = normal.length();
+			centers[c] += (a + b + d) * (triangleArea / 3.f);
+			normals[c] += normal;
+			area += triangleArea;
+		}
+		meshCenter += centers[c];
+		meshArea += area;
+		centers[c] = area > 0.f ? centers[c] / area : positions[indices[3 * clusterStarts[c]]];
+	}
+	meshCenter = meshArea > 0.f ? meshCenter / meshArea : centers.front();
+
+	// Clusters facing furthest out are drawn first
+	std::vector<float> scores(clusterCount);
+	for (int c = 0; c < clusterCount; ++c) {
+		scores[c] = QVector3D::dotProduct(centers[c] - meshCenter, normals[c].normalized());
+	}
+	std::vector<int> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) {
+		return scores[a] > scores[b];
+	});
+
+	std::vector<quint32> ret;
+	ret.reserve(indices.size());
+	for (int c : order) {
+		ret.insert(ret.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * clusterStarts[c + 1]);
+	}
+	if (Analyze(ret.data(), indexCount, cacheSize).m_acmr > Analyze(indices.data(), indexCount, cacheSize).m_acmr * k_overdrawMaxAcmrGrowth) {
+		return indices;
+	}
+	return ret;
+}
+
+std::vector<quint32> VertexCacheOptimizer::FetchOrder(const std::vector<quint32>& indices, int vertexCount)
+{
+	std::vector<quint32> ret;
+	ret.reserve(vertexCount);
+	std::vector<bool> placed(vertexCount, false);
+	for (quint32 v : indices) {
+		if (!placed[v]) {
+			placed[v] = true;
+			ret.push_back(v);
+		}
+	}
+	for (int v = 0; v < vertexCount; ++v) {
+		if (!placed[v]) {
+			ret.push_back(quint32(v));
+		}
+	}
+	return ret;
+}
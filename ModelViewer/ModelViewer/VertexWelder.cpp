@@ -0,0 +1,46 @@
+#include "VertexWelder.h"
+
+#include <climits>
+#include <cstring>
+
+quint64 VertexWelder::Mix(quint64 hash)
+{
+	hash ^= hash >> 33;
+	hash *= 0xFF51AFD7ED558CCDull;
+	hash ^= hash >> 33;
+	hash *= 0xC4CEB9FE1A85EC53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+size_t VertexWelder::HashVector(float x, float y, float z)
+{
+	quint32 bits[3];
+	const float components[3] = { x + 0.f, y + 0.f, z + 0.f };
+	std::memcpy(bits, components, sizeof(bits));
+	return size_t(Mix(quint64(bits[0]) | quint64(bits[1]) << 32) ^ Mix(quint64(bits[2]) + 0x9E3779B97F4A7C15ull));
+}
+
+void VertexWelder::RenumberInOrder(std::vector<quint32>& numbers, std::vector<quint32>& firsts)
+{
+	// Mark the first key of every number, then walk the keys once to hand out the new numbers
+	std::vector<quint32> owners(numbers.size(), UINT_MAX);
+	ParallelRuns(firsts.size(), [&](size_t begin, size_t end) {
+		for (size_t number = begin; number < end; ++number) {
+			owners[firsts[number]] = quint32(number);
+		}
+	});
+	std::vector<quint32> renumbered(firsts.size());
+	quint32 next = 0;
+	for (size_t i = 0; i < owners.size(); ++i) {
+		if (owners[i] != UINT_MAX) {
+			renumbered[owners[i]] = next;
+			firsts[next++] = quint32(i);
+		}
+	}
+	ParallelRuns(numbers.size(), [&](size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			numbers[i] = renumbered[numbers[i]];
+		}
+	});
+}
@@ -0,0 +1,122 @@
+#pragma once
+#include <QtConcurrent/QtConcurrent>
+
+#include <algorithm>
+#include <functional>
+#include <numeric>
+#include <unordered_map>
+#include <vector>
+
+// Finds equal vertices of large meshes on every core. The keys are split into shards by their
+// hash, each numbered on a thread of its own, so no map is shared between threads. Used for
+// the corners of text files by TextModelLoader and for positions and vertices by
+// NormalGenerator.
+class VertexWelder
+{
+public:
+	// Arrays are split into runs of this many elements to work on them in parallel
+	static const size_t k_run = 1 << 16;
+
+	// Shards of the hash the keys of an array longer than a run are found in
+	static const size_t k_shards = 16;
+
+	// Calls work with every index below count on the thread pool, or right away for just one
+	template <typename Work>
+	static void ParallelFor(size_t count, const Work& work);
+
+	// Calls work with the begin and end of each run of k_run of count elements, in parallel
+	template <typename Work>
+	static void ParallelRuns(size_t count, const Work& work);
+
+	// Numbers the distinct keys, fills firsts with the first key of each number and returns the
+	// number of every key. Numbers follow the order the keys first appear in, so a mesh welded
+	// this way keeps the order of its vertices.
+	template <typename Key, typename Hash, typename Equal = std::equal_to<Key>>
+	static std::vector<quint32> Weld(const std::vector<Key>& keys, std::vector<quint32>& firsts, const Hash& hash = Hash(), const Equal& equal = Equal());
+
+	// Mixes the bits of a hash, so keys that differ in few bits spread over the shards
+	static quint64 Mix(quint64 hash);
+
+	// Hashes a vector by its bits, with -0 as 0 since the two compare equal
+	static size_t HashVector(float x, float y, float z);
+
+	// For vectors with x, y and z, like aiVector3D and QVector3D
+	struct VectorHash {
+		template <typename Vector>
+		size_t operator()(const Vector& vector) const
+		{
+			return HashVector(vector.x, vector.y, vector.z);
+		}
+	};
+
+private:
+	// Renumbers the keys in the order their numbers first appear, and sorts firsts to match
+	static void RenumberInOrder(std::vector<quint32>& numbers, std::vector<quint32>& firsts);
+};
+
+template <typename Work>
+void VertexWelder::ParallelFor(size_t count, const Work& work)
+{
+	if (count == 1) {
+		work(size_t(0));
+		return;
+	}
+	std::vector<size_t> items(count);
+	std::iota(items.begin(), items.end(), size_t(0));
+	QtConcurrent::blockingMap(items, [&work](size_t i) { work(i); });
+}
+
+template <typename Work>
+void VertexWelder::ParallelRuns(size_t count, const Work& work)
+{
+	ParallelFor((count + k_run - 1) / k_run, [&](size_t run) {
+		work(run * k_run, std::min(count, (run + 1) * k_run));
+	});
+}
+
+template <typename Key, typename Hash, typename Equal>
+std::vector<quint32> VertexWelder::Weld(const std::vector<Key>& keys, std::vector<quint32>& firsts, const Hash& hash, const Equal& equal)
+{
+	const size_t shardCount = keys.size() > k_run ? k_shards : 1;
+	std::vector<quint8> shards(keys.size(), 0);
+	if (shardCount > 1) {
+		ParallelRuns(keys.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				shards[i] = quint8(((quint64(hash(keys[i])) * 0x9E3779B97F4A7C15ull) >> 32) % shardCount);
+			}
+		});
+	}
+
+	std::vector<quint32> numbers(keys.size());
+	std::vector<std::vector<quint32>> shardFirsts(shardCount);
+	ParallelFor(shardCount, [&](size_t shard) {
+		std::unordered_map<Key, quint32, Hash, Equal> seen(keys.size() / shardCount / 4 + 1, hash, equal);
+		std::vector<quint32>& shardFirst = shardFirsts[shard];
+		for (size_t i = 0; i < keys.size(); ++i) {
+			if (shards[i] != shard) {
+				continue;
+			}
+			const auto inserted = seen.emplace(keys[i], quint32(shardFirst.size()));
+			if (inserted.second) {
+				shardFirst.push_back(quint32(i));
+			}
+			numbers[i] = inserted.first->second;
+		}
+	});
+
+	std::vector<quint32> bases(shardCount, 0);
+	firsts.clear();
+	for (size_t shard = 0; shard < shardCount; ++shard) {
+		bases[shard] = quint32(firsts.size());
+		firsts.insert(firsts.end(), shardFirsts[shard].begin(), shardFirsts[shard].end());
+	}
+	if (shardCount > 1) {
+		ParallelRuns(keys.size(), [&](size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				numbers[i] += bases[shards[i]];
+			}
+		});
+		RenumberInOrder(numbers, firsts);
+	}
+	return numbers;
+}
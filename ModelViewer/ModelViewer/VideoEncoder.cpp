@@ -0,0 +1,203 @@
+#include "VideoEncoder.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QProcess>
+#include <QStandardPaths>
+
+
+namespace {
+	// How long the pipe may take to drain below the queue depth before the encoder is given up on
+	const int k_writeTimeoutMs = 30000;
+}
+
+VideoEncoder::VideoEncoder(QObject* parent)
+	: QObject(parent)
+{
+}
+
+VideoEncoder::~VideoEncoder()
+{
+	// A video that wasn't closed is dropped along with the process
+	if (m_pProcess) {
+		m_pProcess->disconnect(this);
+		m_pProcess->kill();
+		m_pProcess->waitForFinished();
+	}
+}
+
+QString VideoEncoder::FindFfmpeg()
+{
+	const QString local = QStandardPaths::findExecutable("ffmpeg", { QCoreApplication::applicationDirPath() });
+	return local.isEmpty() ? QStandardPaths::findExecutable("ffmpeg") : local;
+}
+
+QStringList VideoEncoder::ListEncoders(const QString& ffmpeg)
+{
+	QProcess process;
+	process.start(ffmpeg, { "-hide_banner", "-encoders" });
+	if (!process.waitForFinished(10000) || process.exitStatus() != QProcess::NormalExit) {
+		process.kill();
+		return QStringList();
+	}
+
+	// After a legend, a line per encoder with its capabilities, its name and a description
+	QStringList encoders;
+	const QStringList lines = QString::fromLocal8Bit(process.readAllStandardOutput()).split('\n');
+	for (const QString& line : lines) {
+		const QStringList fields = line.simplified().split(' ');
+		if (fields.size() >= 2 && fields[0].size() == 6 && fields[0][0] == 'V' && fields[1] != "=") {
+			encoders.append(fields[1]);
+		}
+	}
+	return encoders;
+}
+
+QString VideoEncoder::PickEncoder(const QStringList& available)
+{
+	for (const char* pName : { "h264_nvenc", "h264_qsv", "h264_amf", "libx264", "mpeg4" }) {
+		if (available.contains(pName)) {
+			return pName;
+		}
+	}
+	return QString();
+}
+
+bool VideoEncoder::Open(const QString& ffmpeg, const QString& path, int fps)
+{
+	if (m_open || m_pProcess || fps <= 0) {
+		return false;
+	}
+	m_encoder = PickEncoder(ListEncoders(ffmpeg));
+	if (m_encoder.isEmpty()) {
+		return false;
+	}
+	m_ffmpeg = ffmpeg;
+	m_path = path;
+	m_fps = fps;
+	m_size = QSize();
+	m_open = true;
+	m_failed = false;
+	return true;
+}
+
+bool VideoEncoder::IsOpen() const
+{
+	return m_open;
+}
+
+QString VideoEncoder::Encoder() const
+{
+	return m_encoder;
+}
+
+bool VideoEncoder::AddFrame(const uchar* pPixels, const QSize& size)
+{
+	if (!m_open || m_failed) {
+		return false;
+	}
+	if (!m_pProcess && !Start(size)) {
+		m_failed = true;
+		return false;
+	}
+	if (size != m_size) {
+		qWarning("Could not encode %s, the frames changed size", qPrintable(m_path));
+		m_failed = true;
+		return false;
+	}
+
+	// The frame is copied into the write buffer of the process, which the event loop and the
+	// waits below drain into the pipe
+	const qint64 frameBytes = qint64(size.width()) * size.height() * 4;
+	if (m_pProcess->write(reinterpret_cast<const char*>(pPixels), frameBytes) != frameBytes) {
+		m_failed = true;
+		return false;
+	}
+	while (m_pProcess->bytesToWrite() > frameBytes * k_maxQueuedFrames) {
+		if (!m_pProcess->waitForBytesWritten(k_writeTimeoutMs)) {
+			qWarning("Could not encode %s, FFmpeg stopped taking frames", qPrintable(m_path));
+			m_failed = true;
+			return false;
+		}
+	}
+	return true;
+}
+
+void VideoEncoder::Close()
+{
+	if (!m_open) {
+		return;
+	}
+	m_open = false;
+	if (!m_pProcess || m_failed) {
+		End(false);
+		return;
+	}
+
+	// FFmpeg encodes what is left in the pipe and exits once its input ends
+	m_pProcess->closeWriteChannel();
+}
+
+void VideoEncoder::Cancel()
+{
+	m_failed = true;
+	Close();
+}
+
+bool VideoEncoder::Start(const QSize& size)
+{
+	if (size.isEmpty()) {
+		return false;
+	}
+	m_size = size;
+
+	// Frames come bottom row first. Most encoders only take even sizes in 4:2:0, so odd ones
+	// get a line of padding.
+	const QStringList arguments = {
+		"-hide_banner", "-loglevel", "error", "-y",
+		"-f", "rawvideo", "-pix_fmt", "rgba",
+		"-s", QString("%1x%2").arg(size.width()).arg(size.height()),
+		"-r", QString::number(m_fps),
+		"-i", "-",
+		"-vf", "vflip,pad=ceil(iw/2)*2:ceil(ih/2)*2",
+		"-c:v", m_encoder,
+		"-pix_fmt", "yuv420p",
+		QDir::toNativeSeparators(m_path)
+	};
+	QDir().mkpath(QFileInfo(m_path).absolutePath());
+
+	m_pProcess = new QProcess(this);
+	m_pProcess->setProcessChannelMode(QProcess::ForwardedErrorChannel);
+	m_pProcess->setStandardOutputFile(QProcess::nullDevice());
+	connect(m_pProcess, QOverload<int, QProcess::ExitStatus>::of(&QProcess::finished), this, [=](int exitCode, QProcess::ExitStatus status) {
+		End(!m_failed && status == QProcess::NormalExit && exitCode == 0);
+	});
+	m_pProcess->start(m_ffmpeg, arguments);
+	if (!m_pProcess->waitForStarted()) {
+		qWarning("Could not start %s", qPrintable(m_ffmpeg));
+		delete m_pProcess;
+		m_pProcess = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void VideoEncoder::End(bool success)
+{
+	if (m_pProcess) {
+		m_pProcess->disconnect(this);
+		if (m_pProcess->state() != QProcess::NotRunning) {
+			m_pProcess->kill();
+			m_pProcess->waitForFinished();
+		}
+		m_pProcess->deleteLater();
+		m_pProcess = nullptr;
+	}
+	m_open = false;
+	if (!success) {
+		QFile::remove(m_path);
+	}
+	emit Finished(success, m_path);
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <QObject>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+
+class QProcess;
+
+// Encodes frames into a video by piping them raw into an FFmpeg process, which compresses them
+// on its own threads with a hardware H.264 encoder if the GPU has one. Frames queue up in the
+// pipe, and adding one only waits once k_maxQueuedFrames are still in it, so rendering runs
+// ahead of the encoder by that many frames at most.
+class VideoEncoder : public QObject
+{
+	Q_OBJECT
+
+public:
+	static const int k_maxQueuedFrames = 8;
+
+	explicit VideoEncoder(QObject* parent = nullptr);
+	~VideoEncoder();
+
+	// The FFmpeg executable beside the application or on the PATH, empty if there is none
+	static QString FindFfmpeg();
+
+	// The encoders ffmpeg lists
+	static QStringList ListEncoders(const QString& ffmpeg);
+
+	// The first of NVENC, Quick Sync, AMF, x264 and MPEG-4 in available, empty if none is
+	static QString PickEncoder(const QStringList& available);
+
+	// Prepares to encode frames at fps into path with ffmpeg. The process is started with the
+	// first frame, once its size is known. False while another video is encoded or if ffmpeg
+	// has no encoder to use.
+	bool Open(const QString& ffmpeg, const QString& path, int fps);
+	bool IsOpen() const;
+	QString Encoder() const;
+
+	// Queues a frame of RGBA rows, bottom row first as OpenGL reads them. Every frame has to
+	// be the size of the first. False once encoding failed.
+	bool AddFrame(const uchar* pPixels, const QSize& size);
+
+	// Ends the video. Finished is emitted once FFmpeg has written it, right away if encoding
+	// failed or no frame was added.
+	void Close();
+
+	// Drops the video, Finished is emitted with success false
+	void Cancel();
+
+signals:
+	void Finished(bool success, QString filepath);
+
+private:
+	bool Start(const QSize& size);
+	void End(bool success);
+
+	QProcess* m_pProcess = nullptr;
+	QString m_ffmpeg;
+	QString m_path;
+	QString m_encoder;
+	int m_fps = 0;
+	QSize m_size;
+	bool m_open = false;
+	bool m_failed = false;
+};
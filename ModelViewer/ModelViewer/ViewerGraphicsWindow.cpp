@@ -1,47 +1,206 @@
 #include "ViewerGraphicsWindow.h"
 #include "SettingsMenu.h"
 #include "ModelLoader.h"
+#include "GpuModelBuilder.h"
+#include "JobSystem.h"
 #include "KeySequenceParse.h"
 #include "Axes.h"
+#include "Frustum.h"
+#include "GeometryStreamer.h"
+#include "Primitives.h"
+#include "StateCache.h"
+#include "StartupTrace.h"
+#include "UniformBlocks.h"
+#include "ImportIOSystem.h"
+#include "ZipArchive.h"
 
 #include <QGuiApplication>
 #include <QMatrix4x4>
 #include <QOpenGLShaderProgram>
 #include <QScreen>
+#include <QSurfaceFormat>
 #include <QtMath>
 #include <QFileDialog>
+#include <QFile>
 #include <QFileInfo>
+#include <QDateTime>
 #include <QMouseEvent>
 #include <QDesktopServices>
 #include <QUrl>
 #include <QtMath>
 #include <QKeyEvent>
 #include <QImage>
-#include <QPainter>
 #include <QColor>
 #include <QFont>
-#include <QFontMetrics>
-#include <QTimer>
+#include <QOpenGLExtraFunctions>
+#include <QMessageBox>
+#include <QProgressDialog>
+#include <QInputDialog>
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <limits>
+#include <numeric>
+
+#ifndef GL_CLIP_DISTANCE0
+#define GL_CLIP_DISTANCE0 0x3000
+#endif
+
+namespace {
+    // Meshes are drawn with the coarsest level of detail that has no more triangles than
+    // the pixels they cover on screen divided by this
+    const float k_lodPixelsPerTriangle = 4.f;
+
+    // Ambient occlusion looks for occluders up to this part of the model's diagonal away
+    const float k_occlusionRadius = 0.05f;
+
+    // Fitted clip planes leave this share of the depth range around what is shown, and keep
+    // the near plane at least this share of the far one, so the depth buffer keeps its precision
+    const float k_clipMargin = 0.02f;
+    const float k_minNearRatio = 1e-4f;
+
+    // A still view is refined with this many jittered samples, then drawing stops
+    const int k_refineSamples = 16;
+
+    // Room for the data of one frame in the stream buffer, which grows if a frame needs more
+    const qint64 k_streamFrameBytes = 256 * 1024;
+
+    // Streamed models are split into clusters of at most this many triangles, which are
+    // uploaded and freed on their own
+    const int k_streamClusterTriangles = 65536;
+
+    // With occlusion culling this many of the largest meshes on screen are drawn into the
+    // depth buffer before everything else
+    const int k_occluderCount = 8;
+
+    // Triangles of a box from 0 to 1, drawn scaled to a mesh's AABB for occlusion queries
+    const GLfloat k_unitCube[] = {
+        0, 0, 0,  1, 1, 0,  1, 0, 0,   0, 0, 0,  0, 1, 0,  1, 1, 0,
+        0, 0, 1,  1, 0, 1,  1, 1, 1,   0, 0, 1,  1, 1, 1,  0, 1, 1,
+        0, 0, 0,  0, 0, 1,  0, 1, 1,   0, 0, 0,  0, 1, 1,  0, 1, 0,
+        1, 0, 0,  1, 1, 1,  1, 0, 1,   1, 0, 0,  1, 1, 0,  1, 1, 1,
+        0, 0, 0,  1, 0, 0,  1, 0, 1,   0, 0, 0,  1, 0, 1,  0, 0, 1,
+        0, 1, 0,  0, 1, 1,  1, 1, 1,   0, 1, 0,  1, 1, 1,  1, 1, 0,
+    };
+    const int k_unitCubeVertexCount = 36;
+
+    // Shaders loaded at startup. Only these can be replaced by the multi-draw path.
+    const char* k_defaultVertexShader = "../Data/Shaders/ads.vert";
+    const char* k_defaultFragmentShader = "../Data/Shaders/ads.frag";
+
+    // A left click may move the cursor this many pixels and still pick instead of rotate
+    const int k_clickSlop = 3;
+}
 
 ViewerGraphicsWindow::ViewerGraphicsWindow(QWidget* parent)
     : QOpenGLWidget(parent)
 {
-    QSurfaceFormat format;
-    format.setSamples(settings->value("ViewerGraphicsWindow/msaaLevel", 8).toInt());
-    setFormat(format);
-
     resetView();
 
     loadSettings();
 
-    // Call update every millisecond to force repainting
-    // Calling update() several times normally results in just one paintGL() call
-    // This results in locking the fps to the monitor refresh rate
-    QTimer* updateTrigger = new QTimer(this);
-    updateTrigger->start();
-    connect(updateTrigger, &QTimer::timeout, this, [=] {
-        update();
-        updateTrigger->start(1);
+    // Models are imported in the background and uploaded to this widget's context, with the
+    // pages of their largest base color maps streamed in as they come into view
+    m_textureCache.SetVirtualTextures(&m_virtualTextures);
+    m_pModelLoader = new AsyncModelLoader(this, &m_textureCache, &m_textureUploader, this);
+    connect(m_pModelLoader, &AsyncModelLoader::Progress, this, &ViewerGraphicsWindow::ModelLoadingProgress);
+    connect(m_pModelLoader, &AsyncModelLoader::PreviewReady, this, [=](QString filepath) {
+        // Show the proxy until the full model replaces it
+        SetPrimaryModel(m_pModelLoader->TakePreview(), QFileInfo(filepath).completeBaseName());
+        m_showingPreview = true;
+        if (!m_keepView) {
+            resetView();
+        }
+        emit ModelPreviewLoaded(filepath);
+    });
+    connect(m_pModelLoader, &AsyncModelLoader::Finished, this, [=](bool success, QString filepath) {
+        const QString name = QFileInfo(filepath).completeBaseName();
+        if (m_addingToScene) {
+            AddSceneModel(m_pModelLoader->TakeModel(), name);
+        }
+        else {
+            SetPrimaryModel(m_pModelLoader->TakeModel(), name);
+            m_primaryFile = success ? filepath : QString();
+        }
+
+        // Let other widgets know that a model has been loaded
+        emit EndModelLoading(success, filepath);
+
+        // Reset the view to size properly for the new model. The proxy has the same bounds,
+        // so a view the user has already moved around in is kept, as is the view of an
+        // evicted model loaded again.
+        const bool restored = m_keepView;
+        if ((!m_showingPreview || !success) && !restored) {
+            resetView();
+        }
+        m_showingPreview = false;
+        m_keepView = false;
+
+        if (success && !m_addingToScene && !restored) {
+            IndexModel(filepath);
+        }
+    });
+    connect(m_pModelLoader, &AsyncModelLoader::Cancelled, this, [=](QString filepath) {
+        // The previous model stays, unless the proxy of the cancelled one already replaced it
+        if (m_showingPreview) {
+            SetPrimaryModel(Model(), QString());
+            m_showingPreview = false;
+        }
+        emit ModelLoadingCancelled(filepath);
+    });
+    connect(m_pModelLoader, &AsyncModelLoader::OverBudget, this, [=](QString filepath, qint64 uploadBytes, qint64 budgetBytes) {
+        const QString message = QString("%1 needs about %2 MB of GPU memory, %3 MB are left of the memory budget")
+            .arg(QFileInfo(filepath).fileName()).arg(uploadBytes / (1024 * 1024)).arg(budgetBytes / (1024 * 1024));
+        qWarning("%s", qPrintable(message));
+        emit MemoryWarning(message);
+    });
+
+    // Exports are written in the background, the model can be viewed meanwhile
+    m_pModelExporter = new AsyncModelExporter(this);
+
+    // Frames are only drawn when something changed. Anything that changes what is on screen
+    // calls update(), and paintGL keeps requesting frames while the view is moving.
+    connect(m_pModelLoader, &AsyncModelLoader::Progress, this, QOverload<>::of(&ViewerGraphicsWindow::update));
+
+    // Editors often write a file in several steps, the shaders are read once it has settled
+    m_shaderReloadTimer.setSingleShot(true);
+    m_shaderReloadTimer.setInterval(100);
+    connect(&m_shaderWatcher, &QFileSystemWatcher::fileChanged, &m_shaderReloadTimer, QOverload<>::of(&QTimer::start));
+    connect(&m_shaderReloadTimer, &QTimer::timeout, this, &ViewerGraphicsWindow::CompileChangedShaders);
+    connect(&m_shaderCompiler, &ShaderCompiler::Compiled, this, &ViewerGraphicsWindow::OnShadersCompiled);
+
+    // FFmpeg finishes the video after its last frame was drawn
+    connect(&m_videoEncoder, &VideoEncoder::Finished, this, &ViewerGraphicsWindow::VideoExported);
+
+    // Comparisons are measured on the thread pool and uploaded here
+    connect(&m_comparisonWatcher, &QFutureWatcher<QSharedPointer<SurfaceComparison>>::finished, this, &ViewerGraphicsWindow::OnComparisonMeasured);
+    connect(&m_simplifyWatcher, &QFutureWatcher<std::vector<SimplifiedMesh>>::finished, this, &ViewerGraphicsWindow::OnSimplified);
+
+    // Frames the pacer delays are asked for by a timer precise to the millisecond
+    m_paceTimer.setSingleShot(true);
+    m_paceTimer.setTimerType(Qt::PreciseTimer);
+    connect(&m_paceTimer, &QTimer::timeout, this, QOverload<>::of(&ViewerGraphicsWindow::update));
+    connect(this, &QOpenGLWidget::frameSwapped, this, &ViewerGraphicsWindow::OnFrameSwapped);
+    m_paceClock.start();
+
+    // Models are evicted once the window has stayed minimized or hidden long enough, not
+    // when the widget is only covered by another page of the window
+    m_evictTimer.setSingleShot(true);
+    connect(&m_evictTimer, &QTimer::timeout, this, [=] {
+        if (window()->isMinimized() || !window()->isVisible()) {
+            evictModel();
+        }
+    });
+
+    // Settings of the window changed anywhere, in the menu, by a script or by another window,
+    // are picked up without being asked for
+    m_settingsReloadTimer.setSingleShot(true);
+    connect(&m_settingsReloadTimer, &QTimer::timeout, this, &ViewerGraphicsWindow::loadSettings);
+    connect(settings, &AppSettings::Changed, this, [=](const QString& key) {
+        if (key.startsWith("ViewerGraphicsWindow")) {
+            m_settingsReloadTimer.start(0);
+        }
     });
 }
 
@@ -55,6 +214,83 @@ void ViewerGraphicsWindow::loadSettings() {
     fieldOfView = settings->value("ViewerGraphicsWindow/fieldOfView", 45.f).toFloat();
     nearPlane = settings->value("ViewerGraphicsWindow/nearPlane", 0.1f).toFloat();
     farPlane = settings->value("ViewerGraphicsWindow/farPlane", 100.f).toFloat();
+    autoClipPlanes = settings->value("ViewerGraphicsWindow/autoClipPlanes", true).toBool();
+
+    // Settings read while drawing are kept in a snapshot, so frames don't look up keys
+    m_settings.m_showGrid = settings->value("ViewerGraphicsWindow/toggleGrid", true).toBool();
+    m_settings.m_showAxis = settings->value("ViewerGraphicsWindow/toggleAxis", true).toBool();
+    m_settings.m_showStats = settings->value("ViewerGraphicsWindow/toggleStats", true).toBool();
+    m_settings.m_alwaysRedraw = settings->value("ViewerGraphicsWindow/alwaysRedraw", false).toBool();
+    m_settings.m_pacing.m_presentMode = settings->value("ViewerGraphicsWindow/presentMode", int(k_presentVsync)).toInt();
+    m_settings.m_pacing.m_frameLimit = settings->value("ViewerGraphicsWindow/frameLimit", 60).toInt();
+    m_settings.m_pacing.m_lowLatency = settings->value("ViewerGraphicsWindow/lowLatency", false).toBool();
+    m_settings.m_levelOfDetail = settings->value("ViewerGraphicsWindow/levelOfDetail", true).toBool();
+    m_settings.m_occlusionCulling = settings->value("ViewerGraphicsWindow/occlusionCulling", false).toBool();
+    m_settings.m_multiDrawIndirect = settings->value("ViewerGraphicsWindow/multiDrawIndirect", false).toBool();
+    m_settings.m_gpuCulling = settings->value("ViewerGraphicsWindow/gpuCulling", true).toBool();
+    m_settings.m_targetFps = settings->value("ViewerGraphicsWindow/targetFps", 0).toInt();
+    m_settings.m_evictMinutes = settings->value("ViewerGraphicsWindow/evictHiddenMinutes", 0).toInt();
+    m_settings.m_msaaLevel = settings->value("ViewerGraphicsWindow/msaaLevel", 8).toInt();
+    m_settings.m_progressiveRefinement = settings->value("ViewerGraphicsWindow/progressiveRefinement", true).toBool();
+    m_settings.m_depthPrepass = settings->value("ViewerGraphicsWindow/depthPrepass", false).toBool();
+    m_settings.m_overdrawView = settings->value("ViewerGraphicsWindow/overdrawView", false).toBool();
+    m_settings.m_displayMode = settings->value("ViewerGraphicsWindow/displayMode", int(k_displayShaded)).toInt();
+    m_settings.m_meshletCulling = settings->value("ViewerGraphicsWindow/meshletCulling", int(k_meshletCullingFrustum)).toInt();
+    m_settings.m_pointBudget = qint64(settings->value("ViewerGraphicsWindow/pointBudget", int(PointCloudLod::k_defaultBudget / 1000000)).toInt()) * 1000000;
+    m_settings.m_computeSkinning = settings->value("ViewerGraphicsWindow/computeSkinning", true).toBool();
+    m_settings.m_shadows.m_mode = settings->value("ViewerGraphicsWindow/shadowMode", int(k_shadowsOff)).toInt();
+    m_settings.m_shadows.m_cascades = settings->value("ViewerGraphicsWindow/shadowCascades", 1).toInt();
+    m_settings.m_shadows.m_filterRadius = settings->value("ViewerGraphicsWindow/shadowFilter", 1).toInt();
+    m_settings.m_shadows.m_mapSize = settings->value("ViewerGraphicsWindow/shadowMapSize", 2048).toInt();
+    m_settings.m_sceneLights = settings->value("ViewerGraphicsWindow/sceneLights", true).toBool();
+    m_settings.m_environmentIntensity = settings->value("ViewerGraphicsWindow/environmentIntensity", 1.f).toFloat();
+    m_settings.m_ambientOcclusion.m_mode = settings->value("ViewerGraphicsWindow/ambientOcclusion", int(k_ambientOcclusionOff)).toInt();
+    m_settings.m_ambientOcclusion.m_temporal = settings->value("ViewerGraphicsWindow/ambientOcclusionTemporal", true).toBool();
+    m_resources.SetGpuBudget(qint64(settings->value("ViewerGraphicsWindow/memoryBudget", 0).toInt()) * 1024 * 1024);
+    m_virtualTextures.SetBudget(qint64(settings->value("ViewerGraphicsWindow/textureBudget", int(VirtualTextures::k_defaultBudget / (1024 * 1024))).toInt()) * 1024 * 1024);
+
+    // Whether a model is streamed is decided when it is loaded, its budget can change any time.
+    // Turned off, a streamed model keeps whatever it streams in, as lazily uploaded ones do.
+    if (m_currentModel.m_streamer) {
+        const qint64 budgetMb = settings->value("ViewerGraphicsWindow/streamingBudget", 0).toInt();
+        m_currentModel.m_streamer->SetBudget(budgetMb > 0 ? budgetMb * 1024 * 1024 : std::numeric_limits<qint64>::max());
+    }
+
+    // Give every bound key its own bit, and store the bits each binding needs
+    static const std::pair<const char*, QString> keyBindings[k_keyActionCount] = {
+        { "ViewerGraphicsWindow/increase_speed", "Shift" },
+        { "ViewerGraphicsWindow/decrease_speed", "Ctrl" },
+        { "ViewerGraphicsWindow/elevate_forwards", QString(Qt::Key::Key_W) },
+        { "ViewerGraphicsWindow/elevate_backwards", QString(Qt::Key::Key_S) },
+        { "ViewerGraphicsWindow/strafe_left", QString(Qt::Key::Key_A) },
+        { "ViewerGraphicsWindow/strafe_right", QString(Qt::Key::Key_D) },
+        { "ViewerGraphicsWindow/scale_up", QString(Qt::Key::Key_E) },
+        { "ViewerGraphicsWindow/scale_down", QString(Qt::Key::Key_Q) },
+        { "ViewerGraphicsWindow/pitch_up", "Up" },
+        { "ViewerGraphicsWindow/pitch_down", "Down" },
+        { "ViewerGraphicsWindow/spin_right", "Right" },
+        { "ViewerGraphicsWindow/spin_left", "Left" },
+    };
+    m_settings.m_keyBits.clear();
+    for (int action = 0; action < k_keyActionCount; ++action) {
+        quint64 mask = 0;
+        const QVector<Qt::Key> keys = KeySequenceParse(settings->value(keyBindings[action].first, keyBindings[action].second).toString()).getVec();
+        for (Qt::Key key : keys) {
+            auto it = m_settings.m_keyBits.find(key);
+            if (it == m_settings.m_keyBits.end() && m_settings.m_keyBits.size() < 64) {
+                it = m_settings.m_keyBits.insert(key, m_settings.m_keyBits.size());
+            }
+            if (it != m_settings.m_keyBits.end()) {
+                mask |= quint64(1) << it.value();
+            }
+        }
+        m_settings.m_actionMasks[action] = mask;
+    }
+
+    // Keys held while the bindings change may now map to other bits
+    m_pressedKeys = 0;
+
+    RedrawScene();
 }
 
 bool ViewerGraphicsWindow::loadModel(QString filepath) {
@@ -69,20 +305,120 @@ bool ViewerGraphicsWindow::loadModel(QString filepath) {
             return false;
         }
     }
+    if (!ChooseArchiveModel(filepath)) {
+        return false;
+    }
+
+    return StartModelLoad(filepath, false);
+}
+
+bool ViewerGraphicsWindow::addModel(QString filepath)
+{
+    if (!initialized || m_currentModel.m_streamer) {
+        return false;
+    }
+
+    if (filepath.isEmpty()) {
+        filepath = QFileDialog::getOpenFileName(nullptr, "Add Model", "../Data/Models/", "");
+        if (filepath.isEmpty()) {
+            return false;
+        }
+    }
+    if (!ChooseArchiveModel(filepath)) {
+        return false;
+    }
+    return StartModelLoad(filepath, true);
+}
+
+bool ViewerGraphicsWindow::StartModelLoad(const QString& filepath, bool addToScene)
+{
+    // A new request replaces the one still loading rather than waiting for it
+    cancelModelLoading();
+    m_evictedFile.clear();
+    m_keepView = false;
 
     // Let other widgets know that we are beginning a load operation (may take some time)
     emit BeginModelLoading(filepath);
 
-    // Load the model
-    m_currentModel = ModelLoader::LoadModel(filepath);
-    
-    // Let other widgets know that a model has been loaded
-    emit EndModelLoading(m_currentModel.m_isValid, filepath);
+    // Models added beside others are not streamed, and have no proxy to stand in for them.
+    // Their scene is not kept, the primary model's is the one exported.
+    LoadOptions options = GetLoadOptions();
+    m_addingToScene = addToScene;
+    if (addToScene) {
+        options.m_streamingBudget = 0;
+        options.m_lazyUpload = false;
+        options.m_clusterTriangles = 0;
+        options.m_previewProxy = false;
+        options.m_keepScene = false;
+    }
 
-    // Reset the view to size properly for the new model
-    resetView();
+    // A model replacing the others can use the memory they free
+    options.m_uploadBudget = m_resources.UploadAllowance(!addToScene);
+    m_loadTimer.start();
 
-    return m_currentModel.m_isValid;
+    // Start loading the model in the background. EndModelLoading is emitted once it is
+    // ready to be displayed.
+    return m_pModelLoader->Load(filepath, options, !addToScene);
+}
+
+bool ViewerGraphicsWindow::ChooseArchiveModel(QString& filepath)
+{
+    if (!ZipArchive::IsArchiveFile(filepath)) {
+        return true;
+    }
+
+    // The models are read straight from the archive, it is never extracted
+    const QStringList models = ImportIOSystem::ArchiveModels(filepath);
+    if (models.isEmpty()) {
+        QMessageBox::warning(nullptr, "Load Model", QString("%1 holds no model that can be loaded.").arg(QFileInfo(filepath).fileName()));
+        return false;
+    }
+    QString model = models.front();
+    if (models.size() > 1) {
+        bool ok = false;
+        model = QInputDialog::getItem(nullptr, "Load Model", "Model in the archive:", models, 0, false, &ok);
+        if (!ok) {
+            return false;
+        }
+    }
+    filepath += "/" + model;
+    return true;
+}
+
+void ViewerGraphicsWindow::cancelModelLoading()
+{
+    m_pModelLoader->Cancel();
+}
+
+bool ViewerGraphicsWindow::IsLoadingModel() const
+{
+    return m_pModelLoader->IsLoading();
+}
+
+LoadOptions ViewerGraphicsWindow::GetLoadOptions()
+{
+    // The vertex formats are chosen when a model is loaded, changes apply to the next model
+    LoadOptions options;
+    options.m_interleaved = settings->value("ViewerGraphicsWindow/interleavedVertices", true).toBool();
+    options.m_quantize = settings->value("ViewerGraphicsWindow/quantizeVertices", false).toBool();
+    options.m_quantizePositions = settings->value("ViewerGraphicsWindow/quantizePositions", false).toBool();
+    options.m_batchStatic = settings->value("ViewerGraphicsWindow/batchStaticGeometry", false).toBool();
+    options.m_generateLods = settings->value("ViewerGraphicsWindow/levelOfDetail", true).toBool();
+    options.m_optimizeVertexCache = settings->value("ViewerGraphicsWindow/optimizeVertexCache", true).toBool();
+    options.m_optimizeOverdraw = options.m_optimizeVertexCache && settings->value("ViewerGraphicsWindow/optimizeOverdraw", false).toBool();
+    options.m_useCache = settings->value("ViewerGraphicsWindow/modelCache", true).toBool();
+    options.m_compressCache = settings->value("ViewerGraphicsWindow/compressModelCache", true).toBool();
+    options.m_keepScene = !settings->value("ViewerGraphicsWindow/lowMemory", false).toBool();
+    options.m_previewProxy = settings->value("ViewerGraphicsWindow/previewProxy", true).toBool();
+    options.m_nativeGltf = settings->value("ViewerGraphicsWindow/nativeGltf", true).toBool();
+    options.m_parallelText = settings->value("ViewerGraphicsWindow/parallelText", true).toBool();
+    options.m_importProfile = ImportProfile(settings->value("ViewerGraphicsWindow/importProfile", int(ImportProfile::Quality)).toInt());
+    options.m_customImportSteps = settings->value("ViewerGraphicsWindow/customImportSteps", 0u).toUInt();
+    options.m_streamingBudget = qint64(settings->value("ViewerGraphicsWindow/streamingBudget", 0).toInt()) * 1024 * 1024;
+    options.m_lazyUpload = settings->value("ViewerGraphicsWindow/lazyUpload", false).toBool();
+    options.m_virtualTextureSize = settings->value("ViewerGraphicsWindow/virtualTextureSize", 4096).toInt();
+    options.m_clusterTriangles = options.m_streamingBudget > 0 || options.m_lazyUpload ? k_streamClusterTriangles : 0;
+    return options;
 }
 
 void ViewerGraphicsWindow::loadTexture(QString filepath)
@@ -94,27 +430,392 @@ void ViewerGraphicsWindow::loadTexture(QString filepath)
         if (filepath.isEmpty()) {
             return;
         }
-        QOpenGLTexture* texture = new QOpenGLTexture(QImage(filepath).mirrored());
+        // Textures are shared and freed with the last mesh using them, which needs the context
+        makeCurrent();
+        const QString key = QFileInfo(filepath).canonicalFilePath();
+        QSharedPointer<QOpenGLTexture> texture;
+        if (IsCompressedTextureFile(filepath)) {
+            texture = m_textureCache.Get(key, ReadCompressedTexture(filepath));
+        }
+        if (!texture) {
+            texture = m_textureCache.Get(key, QImage(filepath).mirrored());
+        }
+        if (texture) {
+            // The shown model is composed from the scene in order, its meshes take the
+            // scene's new materials
+            m_scene.SetTexture(texture, m_textureCache);
+            size_t meshIdx = 0;
+            for (const ModelScene::Entry& entry : m_scene.Entries())
+            {
+                for (const Mesh& mesh : entry.m_model.m_meshes)
+                {
+                    if (meshIdx < m_currentModel.m_meshes.size())
+                    {
+                        m_currentModel.m_meshes[meshIdx].m_material = mesh.m_material;
+                        m_currentModel.m_meshes[meshIdx].m_hasTexture = mesh.m_hasTexture;
+                    }
+                    ++meshIdx;
+                }
+            }
+            m_currentModel.m_materials.clear();
+            for (const ModelScene::Entry& entry : m_scene.Entries())
+            {
+                m_currentModel.m_materials.insert(m_currentModel.m_materials.end(), entry.m_model.m_materials.begin(), entry.m_model.m_materials.end());
+            }
+        }
+        m_textureCache.Purge();
+        UpdateUploadedBytes();
+        doneCurrent();
+        RedrawScene();
+    }
+}
 
-        for (Mesh& mesh : m_currentModel.m_meshes)
-        {
-            mesh.m_hasTexture = true;
-            mesh.m_texture = texture;
+bool ViewerGraphicsWindow::loadEnvironment(QString filepath)
+{
+    if (!initialized) {
+        return false;
+    }
+    if (filepath.isEmpty()) {
+        filepath = QFileDialog::getOpenFileName(nullptr, "Load Environment", "../Data/", "HDR Images (*.hdr)");
+        if (filepath.isEmpty()) {
+            return false;
         }
     }
+
+    // Prefiltering draws with this widget's context, a cached environment only uploads
+    makeCurrent();
+    const bool loaded = m_environment.Load(filepath);
+    if (loaded) {
+        settings->setValue("ViewerGraphicsWindow/environmentMap", filepath);
+        UpdateUploadedBytes();
+    }
+    doneCurrent();
+    if (!loaded) {
+        emit Error(QString("Could not load the environment %1").arg(filepath));
+        return false;
+    }
+    RedrawScene();
+    return true;
 }
 
 bool ViewerGraphicsWindow::unloadModel()
 {
-    m_currentModel = Model();
+    makeCurrent();
+    EndComparison();
+    m_primaryFile.clear();
+    m_evictedFile.clear();
+    m_scene.Clear();
+    ApplyScene();
     emit ModelUnloaded();
 
     return true;
 }
 
+bool ViewerGraphicsWindow::evictModel()
+{
+    if (!initialized || m_primaryFile.isEmpty() || m_scene.Entries().size() != 1 || IsLoadingModel()) {
+        return false;
+    }
+
+    // Dropping the scene frees the model's buffers and textures, the widgets showing it are
+    // told once it is back
+    makeCurrent();
+    EndComparison();
+    m_evictedFile = m_primaryFile;
+    m_primaryFile.clear();
+    m_scene.Clear();
+    ApplyScene();
+
+    // This widget stays hidden behind the empty page until the model is back, so it is the
+    // window being shown that brings it back
+    window()->installEventFilter(this);
+    return true;
+}
+
+bool ViewerGraphicsWindow::IsSuspended() const
+{
+    return m_suspended;
+}
+
+bool ViewerGraphicsWindow::IsEvicted() const
+{
+    return !m_evictedFile.isEmpty();
+}
+
+bool ViewerGraphicsWindow::SetModelData(const ModelData& data)
+{
+    if (!initialized) {
+        return false;
+    }
+
+    makeCurrent();
+    SetPrimaryModel(GpuModelBuilder::BuildModel(data, m_textureCache), "Model");
+    resetView();
+
+    return m_currentModel.m_isValid;
+}
+
+bool ViewerGraphicsWindow::removeFromScene(int id)
+{
+    makeCurrent();
+    const bool removed = m_scene.Remove(id);
+    ApplyScene();
+    return removed;
+}
+
+const ModelScene& ViewerGraphicsWindow::GetScene() const
+{
+    return m_scene;
+}
+
+void ViewerGraphicsWindow::SetPrimaryModel(Model model, const QString& name)
+{
+    makeCurrent();
+    EndComparison();
+    m_primaryFile.clear();
+    m_scene.SetPrimary(std::move(model), name);
+    ApplyScene();
+}
+
+void ViewerGraphicsWindow::AddSceneModel(Model model, const QString& name)
+{
+    makeCurrent();
+    const QMatrix4x4 placement = m_scene.PlaceBeside(model.m_AABBMin, model.m_AABBMax);
+    m_scene.Add(std::move(model), name, placement);
+    ApplyScene();
+}
+
+void ViewerGraphicsWindow::ApplyScene()
+{
+    // Dropping a model frees its buffers and the textures no other model uses, which has to
+    // happen in this widget's context. The models that stay keep theirs, only the structures
+    // over the composed meshes are built again.
+    makeCurrent();
+    endSimplification();
+    m_computeSkinner.Clear(m_currentModel);
+    m_shadowMapper.Invalidate();
+    m_currentModel = m_scene.Compose();
+    m_lightClusters.SetLights(m_currentModel.m_lights);
+    PoseScene();
+    ApplySmoothing();
+    m_meshBvh.Build(m_currentModel);
+    m_transformCache.Build(m_currentModel);
+    ResetSceneGraph();
+    m_pointCloudLod.Build(m_currentModel, m_sceneGraph);
+    m_transparentMeshes.clear();
+    for (int meshIdx = 0; meshIdx < int(m_currentModel.m_meshes.size()); ++meshIdx) {
+        const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        if (mesh.m_material && mesh.m_material->m_properties.m_alphaMode == k_alphaBlend) {
+            m_transparentMeshes.push_back(meshIdx);
+        }
+    }
+    UpdateOverlayText();
+
+    // Point clouds are drawn with points about as big as the gaps between them
+    qint64 pointCount = 0;
+    for (const Mesh& mesh : m_currentModel.m_meshes) {
+        pointCount += qint64(mesh.m_vertexCount) * qMax<qint64>(1, qint64(mesh.m_instanceTransforms.size()));
+    }
+    m_pointSpacing = MeshDisplayModes::PointSpacing(m_currentModel.m_AABBMin, m_currentModel.m_AABBMax, pointCount);
+    m_occlusionCuller.Reset();
+    m_indirectRenderer.Clear();
+    m_selectedMesh = -1;
+    m_selectedTriangle = -1;
+    m_textureCache.Purge();
+    UpdateUploadedBytes();
+    doneCurrent();
+    RedrawScene();
+    emit SceneChanged();
+}
+
+QStringList ViewerGraphicsWindow::GetAnimationNames() const
+{
+    QStringList names;
+    if (m_animation.GetSkeleton()) {
+        for (const AnimationClip& clip : m_animation.GetSkeleton()->m_clips) {
+            names.append(clip.m_name);
+        }
+    }
+    return names;
+}
+
+void ViewerGraphicsWindow::playAnimation(int clip)
+{
+    makeCurrent();
+    m_animation.Play(clip);
+    PoseSkinnedMeshes(m_animation);
+    m_meshBvh.Refit(m_currentModel);
+    doneCurrent();
+    RedrawScene();
+}
+
+int ViewerGraphicsWindow::GetPlayingAnimation() const
+{
+    return m_animation.Clip();
+}
+
+const SceneGraph& ViewerGraphicsWindow::GetSceneGraph() const
+{
+    return m_sceneGraph;
+}
+
+bool ViewerGraphicsWindow::setNodeTransform(int node, const QMatrix4x4& local)
+{
+    if (node < 0 || node >= m_sceneGraph.NodeCount() || m_currentModel.m_streamer) {
+        return false;
+    }
+    m_sceneGraph.SetLocal(node, local);
+    makeCurrent();
+    PlaceSceneNodes();
+    doneCurrent();
+    RedrawScene();
+    return true;
+}
+
+bool ViewerGraphicsWindow::setNodeHidden(int node, bool hidden)
+{
+    // Streamed meshes keep their visibility bits while they are freed. Hidden ones are never
+    // requested, so they age out of the budget, and come back once shown and in view.
+    if (node < 0 || node >= m_sceneGraph.NodeCount()) {
+        return false;
+    }
+    m_sceneGraph.SetHidden(node, hidden);
+    ShowSceneNodes();
+    RedrawScene();
+    return true;
+}
+
+bool ViewerGraphicsWindow::isolateNode(int node)
+{
+    if (node < -1 || node >= m_sceneGraph.NodeCount()) {
+        return false;
+    }
+    m_sceneGraph.Isolate(node);
+    ShowSceneNodes();
+    RedrawScene();
+    return true;
+}
+
+void ViewerGraphicsWindow::PoseScene()
+{
+    // A new primary model starts at rest, the others keep playing
+    const QSharedPointer<const Skeleton> primary = m_scene.IsEmpty() ? QSharedPointer<const Skeleton>() : m_scene.Entries().front().m_model.m_skeleton;
+    if (m_animation.GetSkeleton() != primary) {
+        m_animation.SetSkeleton(primary);
+    }
+    for (const ModelScene::Entry& entry : m_scene.Entries()) {
+        if (entry.m_model.m_skeleton && entry.m_model.m_skeleton != primary) {
+            AnimationPlayer rest;
+            rest.SetSkeleton(entry.m_model.m_skeleton);
+            PoseSkinnedMeshes(rest);
+        }
+    }
+    PoseSkinnedMeshes(m_animation);
+}
+
+void ViewerGraphicsWindow::PoseSkinnedMeshes(const AnimationPlayer& player)
+{
+    // The bones put the vertices into the model's space, a placement in the scene comes after
+    if (!player.GetSkeleton()) {
+        return;
+    }
+    for (Mesh& mesh : m_currentModel.m_meshes) {
+        if (!mesh.m_hasBones || mesh.m_skeleton != player.GetSkeleton()) {
+            continue;
+        }
+        player.BonePalette(mesh.m_bones, m_bonePalette);
+        GpuModelBuilder::UploadBonePalette(mesh, m_bonePalette);
+        for (size_t i = 0; i < mesh.m_morphTargets.size(); ++i) {
+            mesh.m_morphWeights[i] = mesh.m_morphTargets[i].m_weight;
+        }
+        player.MorphWeights(mesh.m_morphNode, mesh.m_morphWeights);
+        m_skinPending = true;
+        m_shadowMapper.Invalidate();
+        QVector3D min;
+        QVector3D max;
+        AnimationPlayer::SkinnedBounds(mesh.m_bones, m_bonePalette, min, max);
+        mesh.m_AABBMin = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+        mesh.m_AABBMax = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        Model::AddTransformedAABB(mesh.m_transform, min, max, mesh.m_AABBMin, mesh.m_AABBMax);
+    }
+}
+
+void ViewerGraphicsWindow::UpdateUploadedBytes()
+{
+    // Buffer sizes are read back from OpenGL, so the context must be current. Pages shared
+    // through the arena are counted whole, once.
+    m_resources.Clear();
+    m_resources.Set(k_resourceTextures, m_textureCache.Bytes() + m_virtualTextures.Bytes());
+    m_resources.Set(k_resourcePasses, m_indirectRenderer.Bytes() + m_computeSkinner.Bytes() + m_shadowMapper.Bytes()
+        + m_lightClusters.Bytes() + m_environment.Bytes() + m_transparencyPass.Bytes() + m_ambientOcclusion.Bytes()
+        + m_modelComparison.Bytes());
+    m_resources.Set(k_resourceScene, ModelLoader::CurrentSceneBytes());
+    for (const ModelScene::Entry& entry : m_scene.Entries()) {
+        if (entry.m_model.m_geometry) {
+            m_resources.Add(k_resourceVertices, entry.m_model.m_geometry->VertexBytes());
+            m_resources.Add(k_resourceIndices, entry.m_model.m_geometry->IndexBytes());
+        }
+        if (entry.m_model.m_streamer) {
+            m_resources.Add(k_resourceCaches, entry.m_model.m_streamer->DataBytes());
+        }
+    }
+    for (const QSharedPointer<const Material>& material : m_currentModel.m_materials) {
+        m_resources.Add(k_resourceBuffers, std::max(0, material->m_buffer.size()));
+    }
+    for (Mesh& mesh : m_currentModel.m_meshes) {
+        if (!mesh.m_sharesBuffers && mesh.m_vertexBuffer.isCreated()) {
+            m_resources.Add(k_resourceVertices, mesh.m_vertexBytes);
+            m_resources.Add(k_resourceIndices, mesh.m_indexBytes);
+        }
+        m_resources.Add(k_resourceBuffers, std::max(0, mesh.m_instanceBuffer.size()));
+        m_resources.Add(k_resourceBuffers, std::max(0, mesh.m_boneBuffer.size()));
+        m_resources.Add(k_resourceBuffers, std::max(0, mesh.m_morphBuffer.size()));
+    }
+    m_resources.UpdateDeviceMemory();
+    m_uploadedBytes = m_resources.GpuBytes();
+
+    const qint64 budget = m_resources.GpuBudget();
+    if (budget > 0 && m_uploadedBytes > budget) {
+        qWarning("%lld MB of GPU memory in use, over the budget of %lld MB", m_uploadedBytes / (1024 * 1024), budget / (1024 * 1024));
+    }
+}
+
 void ViewerGraphicsWindow::saveModel()
 {
-    ModelLoader::ExportModel("../Data/Models/");
+    QString filepath;
+    QString formatId;
+    if (m_pModelExporter->IsExporting() || ModelLoader::CurrentFile().isEmpty()
+        || !ModelLoader::ChooseExportFile("../Data/Models/", filepath, formatId)) {
+        return;
+    }
+    if (!m_pModelExporter->Export(filepath, formatId, m_simplifyOptions)) {
+        return;
+    }
+
+    // The dialog isn't modal, so the view keeps responding while the file is written
+    QProgressDialog* pProgress = new QProgressDialog(QString("Exporting %1...").arg(QFileInfo(filepath).fileName()), "Cancel", 0, 100, this);
+    pProgress->setWindowModality(Qt::NonModal);
+    pProgress->setAutoClose(false);
+    pProgress->setAutoReset(false);
+    pProgress->setMinimumDuration(500);
+    connect(pProgress, &QProgressDialog::canceled, m_pModelExporter, &AsyncModelExporter::Cancel);
+    connect(m_pModelExporter, &AsyncModelExporter::Progress, pProgress, [pProgress](float percent) {
+        // The exporters that don't report progress get a busy indicator
+        if (percent < 0.f) {
+            pProgress->setRange(0, 0);
+        }
+        else {
+            pProgress->setRange(0, 100);
+            pProgress->setValue(int(percent * 100.f));
+        }
+    });
+    connect(m_pModelExporter, &AsyncModelExporter::Finished, pProgress, [this, pProgress](bool success, QString filepath) {
+        const bool cancelled = pProgress->wasCanceled();
+        pProgress->deleteLater();
+        if (!success && !cancelled) {
+            QMessageBox::warning(this, "Save Model", QString("Could not export %1").arg(filepath));
+        }
+    });
 }
 
 bool ViewerGraphicsWindow::loadVertexShader(QString vertfilepath)
@@ -130,23 +831,22 @@ bool ViewerGraphicsWindow::loadVertexShader(QString vertfilepath)
         }
     }
 
-    m_program->removeAllShaders();
-
-    if (!m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, vertfilepath)) 
-    {
-        m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, currentVertFile);
-        vertfilepath = currentVertFile;
-    }
-    m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, currentFragFile);
-    if (!m_program->link())
+    RedrawScene();
+    if (!LinkProgram(vertfilepath, currentFragFile))
     {
-        emit Error("Failed to link shader program.");
+        qDebug() << m_program->log() << endl;
 
-        currentVertFile = vertfilepath;
+        // Compile errors only show up when linking cacheable shaders, keep drawing with the
+        // shaders that worked
+        LinkProgram(currentVertFile, currentFragFile);
+        setUniformLocations();
+
+        emit Error("Failed to link shader program.");
         return false;
     }
 
     currentVertFile = vertfilepath;
+    WatchCurrentShaders();
 
     setUniformLocations();
     
@@ -168,20 +868,14 @@ bool ViewerGraphicsWindow::loadFragmentShader(QString fragfilepath)
         }
     }
 
-    m_program->removeAllShaders();
-
-    m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, currentVertFile);
-    if (!m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, fragfilepath)) 
-    {
-        m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, currentFragFile);
-        fragfilepath = currentFragFile;
-    }
-    if (!m_program->link())
+    RedrawScene();
+    if (!LinkProgram(currentVertFile, fragfilepath))
     {
         QString error = m_program->log();
         qDebug() << error << endl;
 
-        currentFragFile = fragfilepath;
+        LinkProgram(currentVertFile, currentFragFile);
+        setUniformLocations();
 
         emit Error("Failed to link shader program.");
 
@@ -189,6 +883,7 @@ bool ViewerGraphicsWindow::loadFragmentShader(QString fragfilepath)
     }
     
     currentFragFile = fragfilepath;
+    WatchCurrentShaders();
     
     setUniformLocations();
 
@@ -217,106 +912,273 @@ bool ViewerGraphicsWindow::editCurrentShaders()
     }
     return true;
 }
-void ViewerGraphicsWindow::setUniformVars() {
-    if (m_lightPosUniform != -1)
-    {
-        m_program->setUniformValue(m_lightPosUniform, lightPos);
-    }
-    if (m_uKa != -1)
-    {
-        m_program->setUniformValue(m_uKa, uKa);
-    }
-    if (m_uKd != -1)
-    {
-        m_program->setUniformValue(m_uKd, uKd);
-    }
-    if (m_uKs != -1)
-    {
-        m_program->setUniformValue(m_uKs, uKs);
-    }
-    if (m_uSpecularColor != -1)
-    {
-        m_program->setUniformValue(m_uSpecularColor, specularColor);
-    }
-    if (m_uShininess != -1)
-    {
-        m_program->setUniformValue(m_uShininess, shininess);
-    }
+void ViewerGraphicsWindow::setUniformVars(const RenderState& frame, const QVector3D& lightPos) {
+    // Only the uniforms the program was found to use at link time are set, and only when changed
+    m_programInterface.Upload(m_program, frame, lightPos);
     if (m_colAttr != -1)
     {
-        m_program->setAttributeValue(m_colAttr, ADColor);
-    }
-    if (m_uMat4_1 != -1)
-    {
-        m_program->setUniformValue(m_uMat4_1, uMat4_1);
-    }
-    if (m_uVec3_1 != -1)
-    {
-        m_program->setUniformValue(m_uVec3_1, uVec3_1);
-    }
-    if (m_uVec4_1 != -1)
-    {
-        m_program->setUniformValue(m_uVec4_1, uVec4_1);
-    }
-    if (m_uFloat_1 != -1)
-    {
-        m_program->setUniformValue(m_uFloat_1, uFloat_1);
-    }
-    if (m_uInt_1 != -1)
-    {
-        m_program->setUniformValue(m_uInt_1, uInt_1);
+        m_program->setAttributeValue(m_colAttr, frame.m_color);
     }
-    if (m_uHasTexture != -1) 
+    if (m_instanceAttr != -1)
     {
-        m_program->setUniformValue(m_uHasTexture, 0.f);
+        // Meshes drawn without instancing use the identity as their instance transform
+        const QMatrix4x4 identity;
+        m_program->setAttributeValue(m_instanceAttr, identity.constData(), 4, 4);
     }
 }
 
+void ViewerGraphicsWindow::bindAttributeLocations()
+{
+    // Meshes record their attribute setup in vertex array objects at upload time,
+    // so every shader has to use the same locations
+    GpuModelBuilder::BindAttributeLocations(m_program);
+}
+
 void ViewerGraphicsWindow::setUniformLocations()
 {
-    m_posAttr = m_program->attributeLocation("posAttr");
+    // Every location below comes from the table read once per link
+    m_programInterface.Reflect(m_program);
+    m_posAttr = m_programInterface.AttributeLocation("posAttr");
     Q_ASSERT(m_posAttr != -1);
-    m_colAttr = m_program->attributeLocation("colAttr");
+    m_colAttr = m_programInterface.AttributeLocation("colAttr");
     //Q_ASSERT(m_colAttr != -1);
-    m_matrixUniform = m_program->uniformLocation("matrix");
-    Q_ASSERT(m_matrixUniform != -1);
-
-    m_normAttr = m_program->attributeLocation("normAttr");
-    m_uvAttr = m_program->attributeLocation("uvAttr");
-
-    m_modelviewUniform = m_program->uniformLocation("modelview");
-    m_normalUniform = m_program->uniformLocation("normalMat");
-
-    m_lightPosUniform = m_program->uniformLocation("uLightPos");
-    m_uKa = m_program->uniformLocation("uKa");
-    m_uKd = m_program->uniformLocation("uKd");
-    m_uKs = m_program->uniformLocation("uKs");
-    m_uSpecularColor = m_program->uniformLocation("uSpecularColor");
-    m_uShininess = m_program->uniformLocation("uShininess");
-
-    m_uMat4_1 = m_program->uniformLocation("uMat4_1");
-    m_uVec3_1 = m_program->uniformLocation("uVec3_1");
-    m_uVec4_1 = m_program->uniformLocation("uVec4_1");
-    m_uFloat_1 = m_program->uniformLocation("uFloat_1");
-    m_uInt_1 = m_program->uniformLocation("uInt_1");
-  
-    m_uTexture = m_program->uniformLocation("uTexture");
-    m_uHasTexture = m_program->uniformLocation("uHasTexture");
+    // Shaders with the frame block can take the projection from there instead
+    m_matrixUniform = m_programInterface.UniformLocation("matrix");
+
+    m_normAttr = m_programInterface.AttributeLocation("normAttr");
+    m_uvAttr = m_programInterface.AttributeLocation("uvAttr");
+    m_instanceAttr = m_programInterface.AttributeLocation("instanceAttr");
+
+    m_modelviewUniform = m_programInterface.UniformLocation("modelview");
+    m_normalUniform = m_programInterface.UniformLocation("normalMat");
+
+    m_uTexture = m_programInterface.UniformLocation("uTexture");
+    m_uHasTexture = m_programInterface.UniformLocation("uHasTexture");
+
+    m_hasFrameBlock = m_frameBlockBuffer.isCreated() && UniformBlocks::BindBlock(m_program, "FrameBlock", k_frameBlockBinding);
+    m_hasMaterialBlock = UniformBlocks::BindMaterial(m_program);
+    UniformBlocks::BindShadows(m_program);
+    UniformBlocks::BindLights(m_program);
+    UniformBlocks::BindEnvironment(m_program);
+
+    m_baseVariant.m_pProgram = m_program;
+    m_baseVariant.m_matrixUniform = m_matrixUniform;
+    m_baseVariant.m_modelviewUniform = m_modelviewUniform;
+    m_baseVariant.m_normalUniform = m_normalUniform;
+    m_baseVariant.m_textureUniform = m_uTexture;
+    m_baseVariant.m_hasTextureUniform = m_uHasTexture;
+    m_baseVariant.m_instanceAttr = m_instanceAttr;
+
+    emit ShaderUniformsChanged();
 }
 
-bool ViewerGraphicsWindow::reloadCurrentShaders()
+void ViewerGraphicsWindow::UseMeshProgram(const Mesh& mesh)
 {
-    if (loadVertexShader(currentVertFile) &&
-        loadFragmentShader(currentFragFile)) {
-        return true;
+    // Variants take everything but the per mesh uniforms from the uniform blocks
+    const ShaderPermutations::Variant* pVariant = &m_baseVariant;
+    if (m_pOverrideVariant) {
+        pVariant = m_pOverrideVariant;
+    }
+    else if (m_pViewportVariant) {
+        pVariant = m_pViewportVariant;
+    }
+    else if (m_hasFrameBlock && m_hasMaterialBlock && m_shaderPermutations.IsActive()) {
+        const ShaderPermutations::Variant* pPermutation = m_shaderPermutations.Get(m_shaderPermutations.FeatureMask(mesh));
+        if (pPermutation) {
+            pVariant = pPermutation;
+        }
+    }
+    if (pVariant != m_pDrawVariant) {
+        pVariant->m_pProgram->bind();
+        m_pDrawVariant = pVariant;
+        ++m_programBinds;
+        ++m_stateChanges;
     }
-    return false;
 }
 
-bool ViewerGraphicsWindow::openShaderFile(QString filepath)
+void ViewerGraphicsWindow::BuildRenderQueue(const QMatrix4x4& modelViewProjection, bool prepass)
 {
-    if (filepath.isEmpty()) {
-        filepath = QFileDialog::getOpenFileName(nullptr, "Open Shader File", "../Data/Shaders/", "");
+    // Keys are rebuilt every frame, the depths change with the camera anyway
+    m_renderQueue.Clear();
+    m_prepassQueue.Clear();
+    const bool permuted = m_shaderPermutations.IsActive();
+    for (int meshIdx : m_visibleMeshIndices) {
+        const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        const int program = permuted ? m_shaderPermutations.FeatureMask(mesh) : 0;
+        // Bindless programs don't bind textures, the meshes only need to be sorted by program
+        const GLuint texture = mesh.m_hasTexture && !m_bindlessProgram ? mesh.m_material->m_maps[k_baseColorMap]->textureId() : 0;
+        const QVector3D center = (mesh.m_AABBMin + mesh.m_AABBMax) * 0.5f;
+        const float depth = (modelViewProjection * QVector4D(center, 1.f)).w();
+        m_renderQueue.Add(RenderQueue::MakeKey(program, texture, mesh.m_vertexBuffer.bufferId(), depth), meshIdx);
+        // The depth only program doesn't skin, skinned meshes are left to the shading pass
+        // unless they were skinned by the compute pass
+        if (prepass && (!mesh.m_hasBones || mesh.m_computeSkinned)) {
+            m_prepassQueue.Add(RenderQueue::MakeKey(0, 0, 0, depth), meshIdx);
+        }
+    }
+    m_renderQueue.Sort();
+    m_prepassQueue.Sort();
+}
+
+void ViewerGraphicsWindow::UpdateFrameBlock(const RenderState& frame, const QMatrix4x4& projection, const QMatrix4x4& modelView, const QVector3D& lightPos, bool alphaToCoverage, bool ambientOcclusion)
+{
+    if (!m_hasFrameBlock) {
+        return;
+    }
+    FrameBlock block = {};
+    std::copy(projection.constData(), projection.constData() + 16, block.m_projection);
+    std::copy(frame.m_mat4_1.constData(), frame.m_mat4_1.constData() + 16, block.m_mat4_1);
+    for (int i = 0; i < 4; ++i) {
+        block.m_specularColor[i] = frame.m_specularColor[i];
+        block.m_vec4_1[i] = frame.m_vec4_1[i];
+    }
+    for (int i = 0; i < 3; ++i) {
+        block.m_lightPosition[i] = lightPos[i];
+        block.m_vec3_1[i] = frame.m_vec3_1[i];
+    }
+    block.m_ka = frame.m_ka;
+    block.m_kd = frame.m_kd;
+    block.m_ks = frame.m_ks;
+    block.m_shininess = frame.m_shininess;
+    block.m_float_1 = frame.m_float_1;
+    block.m_int_1 = frame.m_int_1;
+    block.m_alphaToCoverage = alphaToCoverage ? 1 : 0;
+    block.m_ambientOcclusion = ambientOcclusion ? 1 : 0;
+    block.m_flatShading = m_flatShading ? 1 : 0;
+
+    // A plane moves into eye space by the inverse of the matrix that moves points there
+    static_assert(sizeof(block.m_sectionPlanes) / sizeof(block.m_sectionPlanes[0]) == Frustum::k_maxExtraPlanes, "FrameBlock holds every section plane");
+    const QMatrix4x4 eyeToModel = m_sectionPlanes.empty() ? QMatrix4x4() : modelView.inverted();
+    for (int i = 0; i < Frustum::k_maxExtraPlanes; ++i) {
+        const QVector4D plane = i < int(m_sectionPlanes.size()) ? m_sectionPlanes[i] * eyeToModel : QVector4D(0.f, 0.f, 0.f, 1.f);
+        for (int j = 0; j < 4; ++j) {
+            block.m_sectionPlanes[i][j] = plane[j];
+        }
+    }
+
+    // Replacing the whole buffer lets the driver hand out fresh storage instead of waiting
+    // for the last frame to stop reading it. A frame like the last keeps reading its block.
+    if (!m_frameBlockCurrent || std::memcmp(&block, &m_uploadedFrameBlock, sizeof(block)) != 0) {
+        m_frameBlockBuffer.bind();
+        m_frameBlockBuffer.allocate(&block, sizeof(block));
+        m_frameBlockBuffer.release();
+        m_uploadedFrameBlock = block;
+        m_frameBlockCurrent = true;
+    }
+    context()->extraFunctions()->glBindBufferBase(GL_UNIFORM_BUFFER, k_frameBlockBinding, m_frameBlockBuffer.bufferId());
+}
+
+bool ViewerGraphicsWindow::ReadShaderFile(const QString& filepath, QByteArray& source) const
+{
+    QFile file(filepath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    source = UniformBlocks::ExpandInclude(file.readAll(), m_bindlessTextures);
+    return true;
+}
+
+bool ViewerGraphicsWindow::LinkProgram(const QString& vertfilepath, const QString& fragfilepath)
+{
+    QByteArray vertexSource;
+    QByteArray fragmentSource;
+    if (!ReadShaderFile(vertfilepath, vertexSource) || !ReadShaderFile(fragfilepath, fragmentSource)) {
+        return false;
+    }
+    return LinkProgram(vertexSource, fragmentSource);
+}
+
+bool ViewerGraphicsWindow::LinkProgram(const QByteArray& vertexSource, const QByteArray& fragmentSource)
+{
+    m_program->removeAllShaders();
+    m_program->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+    m_program->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+    bindAttributeLocations();
+    m_bindlessProgram = false;
+    m_transparentProgram = false;
+    m_sectionClipping = false;
+    if (!m_program->link()) {
+        m_shaderPermutations.Clear();
+        return false;
+    }
+    m_shaderPermutations.SetSources(vertexSource, fragmentSource);
+    m_bindlessProgram = fragmentSource.contains(UniformBlocks::k_bindlessDirectives);
+    m_transparentProgram = fragmentSource.contains("gl_FragData[1]");
+    m_sectionClipping = vertexSource.contains("gl_ClipDistance");
+    return true;
+}
+
+void ViewerGraphicsWindow::WatchCurrentShaders()
+{
+    // A reload still compiling was for the files watched until now
+    m_pendingVertexSource.clear();
+    m_pendingFragmentSource.clear();
+    if (!m_shaderWatcher.files().isEmpty()) {
+        m_shaderWatcher.removePaths(m_shaderWatcher.files());
+    }
+    m_shaderWatcher.addPaths({ currentVertFile, currentFragFile });
+}
+
+void ViewerGraphicsWindow::CompileChangedShaders()
+{
+    // Editors that save by replacing the file drop it from the watcher
+    WatchCurrentShaders();
+
+    QByteArray vertexSource;
+    QByteArray fragmentSource;
+    if (!ReadShaderFile(currentVertFile, vertexSource) || !ReadShaderFile(currentFragFile, fragmentSource)) {
+        return;
+    }
+    if (!m_shaderCompiler.IsCreated()) {
+        reloadCurrentShaders();
+        return;
+    }
+    m_pendingVertexSource = vertexSource;
+    m_pendingFragmentSource = fragmentSource;
+    m_shaderCompiler.Compile(vertexSource, fragmentSource);
+}
+
+void ViewerGraphicsWindow::OnShadersCompiled(const QByteArray& vertexSource, const QByteArray& fragmentSource, bool success, const QString& log)
+{
+    // Only the last save counts, and loading another shader in the meantime supersedes it
+    if (vertexSource != m_pendingVertexSource || fragmentSource != m_pendingFragmentSource) {
+        return;
+    }
+    m_pendingVertexSource.clear();
+    m_pendingFragmentSource.clear();
+    if (!success) {
+        qDebug() << log << endl;
+        emit Error("Failed to link shader program.");
+        return;
+    }
+
+    // The worker left the binary in the cache, so this links without compiling
+    makeCurrent();
+    const bool linked = LinkProgram(vertexSource, fragmentSource);
+    setUniformLocations();
+    doneCurrent();
+    RedrawScene();
+    if (linked) {
+        emit ClearError();
+    }
+    else {
+        emit Error("Failed to link shader program.");
+    }
+}
+
+bool ViewerGraphicsWindow::reloadCurrentShaders()
+{
+    if (loadVertexShader(currentVertFile) &&
+        loadFragmentShader(currentFragFile)) {
+        return true;
+    }
+    return false;
+}
+
+bool ViewerGraphicsWindow::openShaderFile(QString filepath)
+{
+    if (filepath.isEmpty()) {
+        filepath = QFileDialog::getOpenFileName(nullptr, "Open Shader File", "../Data/Shaders/", "");
         if (filepath.isEmpty()) {
             return false;
         }
@@ -335,12 +1197,15 @@ bool ViewerGraphicsWindow::openShaderFile(QString filepath)
 
 void ViewerGraphicsWindow::mousePressEvent(QMouseEvent* event)
 {
+    NoteInput();
+
     // Focus this object
     setFocus();
 
     // Set class vars
     if (event->button() == Qt::LeftButton) {
         m_leftMousePressed = true;
+        m_pressPosition = event->pos();
     }
 
     if (event->button() == Qt::RightButton) {
@@ -353,6 +1218,7 @@ void ViewerGraphicsWindow::mousePressEvent(QMouseEvent* event)
 
     // Call the parent class 
     QOpenGLWidget::mousePressEvent(event);
+    update();
 }
 
 void ViewerGraphicsWindow::mouseReleaseEvent(QMouseEvent* event)
@@ -360,6 +1226,12 @@ void ViewerGraphicsWindow::mouseReleaseEvent(QMouseEvent* event)
     // Set class vars
     if (event->button() == Qt::LeftButton) {
         m_leftMousePressed = false;
+
+        // A click without dragging picks the mesh under the cursor with the next frame
+        if ((event->pos() - m_pressPosition).manhattanLength() <= k_clickSlop) {
+            m_pickRequested = true;
+            m_pickPixel = event->pos() * devicePixelRatio();
+        }
     }
 
     if (event->button() == Qt::RightButton) {
@@ -368,10 +1240,12 @@ void ViewerGraphicsWindow::mouseReleaseEvent(QMouseEvent* event)
 
     // Call the parent class
     QOpenGLWidget::mouseReleaseEvent(event);
+    update();
 }
 
 void ViewerGraphicsWindow::mouseMoveEvent(QMouseEvent* event)
 {
+    NoteInput();
     float deltaX = lastX - event->x();
     float deltaY = lastY - event->y();
 
@@ -398,21 +1272,32 @@ void ViewerGraphicsWindow::mouseMoveEvent(QMouseEvent* event)
 
     // Call the parent class 
     QOpenGLWidget::mouseMoveEvent(event);
+    PublishRenderState();
+    update();
 }
 
 void ViewerGraphicsWindow::keyPressEvent(QKeyEvent* event)
 {
-    // Store that this key is pressed
-    m_pressedKeys.insert(event->key());
+    NoteInput();
+
+    // Store that this key is pressed. Keys that aren't bound to anything are ignored.
+    if (!event->isAutoRepeat()) {
+        m_pressedKeys |= KeyBit(event->key());
+    }
 
+    // Start drawing continuously until all keys are released
     QOpenGLWidget::keyPressEvent(event);
+    update();
 }
 void ViewerGraphicsWindow::keyReleaseEvent(QKeyEvent* event)
 {
     // The key has been released
-    m_pressedKeys.remove(event->key());
+    if (!event->isAutoRepeat()) {
+        m_pressedKeys &= ~KeyBit(event->key());
+    }
 
     QOpenGLWidget::keyReleaseEvent(event);
+    update();
 }
 
 void ViewerGraphicsWindow::focusOutEvent(QFocusEvent* event)
@@ -422,42 +1307,124 @@ void ViewerGraphicsWindow::focusOutEvent(QFocusEvent* event)
     QOpenGLWidget::focusOutEvent(event);
 }
 
+void ViewerGraphicsWindow::showEvent(QShowEvent* event)
+{
+    QOpenGLWidget::showEvent(event);
+    m_suspended = false;
+    m_evictTimer.stop();
+    update();
+}
+
+bool ViewerGraphicsWindow::eventFilter(QObject* pWatched, QEvent* event)
+{
+    // An evicted model is loaded again in the view it was left in
+    if (pWatched == window() && event->type() == QEvent::Show) {
+        window()->removeEventFilter(this);
+        if (!m_evictedFile.isEmpty()) {
+            const QString filepath = m_evictedFile;
+            StartModelLoad(filepath, false);
+            m_keepView = true;
+        }
+    }
+    return QOpenGLWidget::eventFilter(pWatched, event);
+}
+
+void ViewerGraphicsWindow::hideEvent(QHideEvent* event)
+{
+    // Minimizing the window hides it as well. Frames stop coming as nothing is painted, and
+    // the pacer is kept from asking for more.
+    m_suspended = true;
+    m_paceTimer.stop();
+    m_framePacer.Reset();
+    ClearKeyboard();
+    if (m_settings.m_evictMinutes > 0) {
+        m_evictTimer.start(m_settings.m_evictMinutes * 60 * 1000);
+    }
+    QOpenGLWidget::hideEvent(event);
+}
+
 void ViewerGraphicsWindow::ClearKeyboard()
 {
     // Clear all pressed keys when the window loses focus
-    m_pressedKeys.clear();
+    m_pressedKeys = 0;
 }
 
 void ViewerGraphicsWindow::wheelEvent(QWheelEvent* event)
 {
+    NoteInput();
     const float zoomAmount = zoomSensitivity * event->angleDelta().y();
     m_scaleMatrix.scale(1.f + zoomAmount);
+    PublishRenderState();
+    update();
 }
 
 void ViewerGraphicsWindow::initializeGL()
 {
     initializeOpenGLFunctions();
+    m_bindlessTextures = TextureCache::SupportsBindless();
+
+    // Which driver draws is the first thing to know about a slow or broken frame
+    const QSurfaceFormat format = context()->format();
+    qInfo("OpenGL%s %d.%d%s on %s, %s", context()->isOpenGLES() ? " ES" : "", format.majorVersion(), format.minorVersion(),
+        format.profile() == QSurfaceFormat::CoreProfile ? " core" : "",
+        reinterpret_cast<const char*>(glGetString(GL_RENDERER)), reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+
+    // Uniforms shared by every mesh are written to a uniform buffer once per frame
+    if (UniformBlocks::SupportsUniformBuffers()) {
+        m_frameBlockBuffer.setUsagePattern(QOpenGLBuffer::StreamDraw);
+        m_frameBlockBuffer.create();
+    }
+    m_frameBlockCurrent = false;
 
+    ImportTrace::Sequence steps(StartupTrace::Active());
+    steps.Next("link program");
     m_program = new QOpenGLShaderProgram(this);
-    currentVertFile = "../Data/Shaders/ads.vert";
-    currentFragFile = "../Data/Shaders/ads.frag";
-    m_program->addShaderFromSourceFile(QOpenGLShader::Vertex, currentVertFile);
-    m_program->addShaderFromSourceFile(QOpenGLShader::Fragment, currentFragFile);
-    m_program->link();
+    currentVertFile = k_defaultVertexShader;
+    currentFragFile = k_defaultFragmentShader;
+    LinkProgram(currentVertFile, currentFragFile);
 
     setUniformLocations();
-    
-    // Load the flat shader
-    m_flatShader = new QOpenGLShaderProgram(this);
-    m_flatShader->addShaderFromSourceCode(QOpenGLShader::Vertex, flatVertexShaderSource);
-    m_flatShader->addShaderFromSourceCode(QOpenGLShader::Fragment, flatFragmentShaderSource);
-    m_flatShader->link();
-    m_flatShaderPosAttr = m_flatShader->attributeLocation("posAttr");
-    Q_ASSERT(m_flatShaderPosAttr != -1);
-    m_flatShaderColAttr = m_flatShader->attributeLocation("colAttr");
-    Q_ASSERT(m_flatShaderColAttr != -1);
-    m_flatShaderMatrixAttr = m_flatShader->uniformLocation("matrix");
-    Q_ASSERT(m_flatShaderMatrixAttr != -1);
+    steps.Next("frame state");
+
+    // The queries and buffers of the render passes have to go before the context does, created
+    // or not
+    connect(context(), &QOpenGLContext::aboutToBeDestroyed, this, [=] {
+        m_shaderCompiler.Destroy();
+        makeCurrent();
+        m_gpuProfiler.Destroy();
+        m_frameCapture.Destroy();
+        m_posterRenderer.Destroy();
+        m_textureUploader.Destroy();
+        m_streamBuffer.Destroy();
+        m_occlusionCuller.Destroy();
+        m_meshPicker.Destroy();
+        m_virtualTextures.Destroy();
+        m_indirectRenderer.Destroy();
+        m_computeSkinner.Clear(m_currentModel);
+        m_computeSkinner.Destroy();
+        m_shadowMapper.Destroy();
+        m_lightClusters.Destroy();
+        m_environment.Destroy();
+        m_transparencyPass.Destroy();
+        m_ambientOcclusion.Destroy();
+        m_modelComparison.Destroy();
+        m_sectionCaps.Destroy();
+        m_resolutionScaler.Destroy();
+        m_frameAccumulator.Destroy();
+        m_displayModes.Destroy();
+        m_shaderPermutations.Clear();
+        m_primitiveModels.clear();
+        m_frameBlockBuffer.destroy();
+        m_frameBlockCurrent = false;
+        m_textRenderer.Destroy();
+        m_textPixelRatio = 0.;
+        for (FlatLines* pLines : { &m_gridLines, &m_axesLines }) {
+            pLines->m_vao.destroy();
+            pLines->m_buffer.destroy();
+        }
+        doneCurrent();
+    });
+
 
     // Set up the default view
     resetView();
@@ -475,159 +1442,852 @@ void ViewerGraphicsWindow::initializeGL()
     uVec4_1 = QVector4D(1., 1., 1., 1.);
     uFloat_1 = 0.;
     uInt_1 = 0;
+    PublishRenderState();
+
+    m_resourcesCreated = false;
+    if (m_deferResources) {
+        m_skipFrame = true;
+    }
+    else {
+        CreateResources();
+    }
+    steps.Next(nullptr);
 
     emit Initialized();
 
     initialized = true;
+
+    // Queued behind the paint of the landing page the signal put up
+    if (m_deferResources) {
+        QTimer::singleShot(0, this, [=] {
+            if (!m_resourcesCreated) {
+                makeCurrent();
+                CreateResources();
+                doneCurrent();
+                update();
+            }
+        });
+    }
+}
+
+void ViewerGraphicsWindow::CreateResources()
+{
+    m_resourcesCreated = true;
+
+    // Load the flat shader. Like the model shaders it is linked from a cached binary after the
+    // first start with this driver.
+    m_flatShader = new QOpenGLShaderProgram(this);
+    m_flatShader->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, flatVertexShaderSource);
+    m_flatShader->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, flatFragmentShaderSource);
+    m_flatShader->link();
+    m_flatShaderPosAttr = m_flatShader->attributeLocation("posAttr");
+    Q_ASSERT(m_flatShaderPosAttr != -1);
+    m_flatShaderColAttr = m_flatShader->attributeLocation("colAttr");
+    Q_ASSERT(m_flatShaderColAttr != -1);
+    m_flatShaderMatrixAttr = m_flatShader->uniformLocation("matrix");
+    Q_ASSERT(m_flatShaderMatrixAttr != -1);
+
+    // The grid and axes never change, so they live on the GPU
+    CreateFlatLines(m_gridLines, grid, gridColors, int(sizeof(grid) / 3 / sizeof(float)), 4);
+    CreateFlatLines(m_axesLines, axes, axesColors, int(sizeof(axes) / 3 / sizeof(float)), 3);
+
+    // Time the render passes on the GPU, read captured frames back and stream textures in. The
+    // queries and buffers have to go before the context does.
+    m_gpuProfiler.Create();
+    m_frameCapture.Create();
+    m_posterRenderer.Create();
+    m_textureUploader.Create();
+    m_streamBuffer.Create(k_streamFrameBytes);
+    m_occlusionCuller.Create();
+    m_meshPicker.Create();
+    m_virtualTextures.Create();
+    m_indirectRenderer.Create();
+    m_computeSkinner.Create();
+    m_shadowMapper.Create();
+    m_lightClusters.Create();
+
+    // The environment of the last session is read back from the cache, without prefiltering
+    m_environment.Create();
+    const QString environment = settings->value("ViewerGraphicsWindow/environmentMap").toString();
+    if (!environment.isEmpty()) {
+        m_environment.Load(environment);
+    }
+    m_transparencyPass.Create();
+    m_ambientOcclusion.Create();
+    m_modelComparison.Create();
+    m_sectionCaps.Create();
+    m_resolutionScaler.Create();
+    m_frameAccumulator.Create();
+    m_displayModes.Create();
+    m_shaderCompiler.Create(context());
+    WatchCurrentShaders();
 }
 
 void ViewerGraphicsWindow::resizeGL(int w, int h) {
     // Compute viewport with support for high DPI monitors
     const qreal retinaScale = devicePixelRatio();
-    glViewport(0, 0,w * retinaScale, h * retinaScale);
+    StateCache::Current().Viewport(0, 0,w * retinaScale, h * retinaScale);
+    PublishRenderState();
 }
 
 void ViewerGraphicsWindow::paintGL()
 {
+    // The frame drawn with a new context is covered by the landing page at once, deferred
+    // resources are created after it was painted or by the first frame that is seen
+    if (!m_resourcesCreated) {
+        if (m_skipFrame) {
+            m_skipFrame = false;
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            return;
+        }
+        CreateResources();
+    }
+
     // Determine how much time has passed since the last update,
-    // call update, and reset the timer
+    // call update, and reset the timer. After idling no time has passed for
+    // held keys, so the first frame after a key press doesn't jump. The view
+    // moves by whole intervals of the pacer where the time is close to them.
     const qint64 nsec = m_updateTimer.nsecsElapsed();
     m_updateTimer.restart();
-    const float seconds = (float)nsec * 1e-9f;
-    m_frametimes.push_back(seconds);
-    Update(seconds);
+    m_framePacer.SetOptions(m_settings.m_pacing, float(screen()->refreshRate()));
+    float seconds = m_redrawing ? m_framePacer.FrameStep(float(nsec) * 1e-9f) : 0.f;
+    if (m_redrawing) {
+        m_frameIntervals.AddFrame(float(nsec) * 1e-9f);
+    }
 
-    // Compute viewport with support for high DPI monitors
-    const qreal retinaScale = devicePixelRatio();
-    glViewport(0, 0, width() * retinaScale, height() * retinaScale);
+    // The input this frame shows is sampled now, by Update and the render state
+    const float inputAge = m_inputPending ? float(m_inputTimer.nsecsElapsed()) * 1e-9f : -1.f;
+    m_inputPending = false;
 
-    QMatrix4x4 viewMatrix;
-    viewMatrix.perspective(fieldOfView, float(width() * retinaScale) / float(height() * retinaScale), nearPlane, farPlane);
+    // A camera path being played sets the camera instead of the keys, a fixed step per frame
+    const int playbackFrame = m_playbackFrame;
+    if (playbackFrame >= 0) {
+        seconds = m_playbackStep;
+        SetCameraPose(m_cameraPlayback.Sample(float(playbackFrame) * m_playbackStep));
+    }
+    else {
+        Update(seconds);
+    }
 
-    QMatrix4x4 modelMatrix = GetModelMatrix();
+    // Skinned meshes follow the clip, and the hierarchy follows their bounds
+    const bool animating = m_animation.IsPlaying() && m_currentModel.m_isValid;
+    if (animating) {
+        m_animation.Advance(seconds);
+        PoseSkinnedMeshes(m_animation);
+        m_meshBvh.Refit(m_currentModel);
+        m_virtualTextures.Invalidate();
+        m_sceneChanged = true;
+    }
 
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    // Select what an earlier click hit, once the GPU has it
+    MeshPicker::Hit hit;
+    if (m_meshPicker.TakeHit(hit)) {
+        ApplyPick(hit);
+    }
 
-    m_program->bind();
+    // Copy in the pages the last feedback asked for, paged textures sharpen as they arrive
+    if (m_virtualTextures.Update()) {
+        m_sceneChanged = true;
+    }
+
+    // Measure how long this frame takes to record on the CPU and to execute on the GPU
+    QElapsedTimer cpuTimer;
+    cpuTimer.start();
+    // A poster is drawn a tile per frame at the window's full resolution, without the effects
+    // that build on the frames before
+    const bool posterTile = m_posterRenderer.NeedsTile();
+    // A comparison shows the two models compared in place of the scene, and a split window
+    // each viewport. Both are drawn straight to the window, posters are of the single view.
+    const bool comparing = m_compareMode != k_compareOff && m_modelComparison.HasModels() && !posterTile;
+    const bool split = viewportCount() > 1 && !posterTile && !comparing;
+    const bool direct = split || comparing;
+    const bool scaled = m_settings.m_targetFps > 0 && m_resolutionScaler.IsCreated() && !posterTile && !direct;
+    m_streamBuffer.BeginFrame();
+    if (m_gpuProfiler.BeginFrame()) {
+        m_gpuFrameTimes.AddFrame(m_gpuProfiler.FrameSeconds());
+
+        // The results are of the frame k_frameLatency frames ago
+        const int timedFrame = playbackFrame - GpuProfiler::k_frameLatency;
+        if (playbackFrame >= 0 && timedFrame >= 0 && timedFrame < int(m_playbackFrames.size())) {
+            m_playbackFrames[timedFrame].m_gpuSeconds = m_gpuProfiler.FrameSeconds();
+        }
+        if (scaled) {
+            m_resolutionScaler.Update(m_gpuProfiler.FrameSeconds(), 1.f / float(m_settings.m_targetFps));
+        }
+    }
+    else if (scaled && m_redrawing && !m_gpuProfiler.IsCreated()) {
+        // Without timer queries the frame interval is the closest there is to the GPU time
+        m_resolutionScaler.Update(seconds, 1.f / float(m_settings.m_targetFps));
+    }
+    m_drawCalls = 0;
+    m_textureBinds = 0;
+    m_programBinds = 0;
+    m_stateChanges = 0;
+
+    // The widget sets the viewport before every frame, the rest is as the last frame left it.
+    // The overlay shows the state calls of the last whole frame.
+    StateCache& state = StateCache::Current();
+    state.InvalidateViewport();
+    m_stateCallsIssued = state.IssuedCalls();
+    m_stateCallsSkipped = state.SkippedCalls();
+    state.ResetCounts();
+    m_boundTexture = 0;
+    m_pBoundMaterial = nullptr;
+    m_drawnTriangles = 0;
+    m_drawnPoints = 0;
+    m_visibleMeshes = 0;
+    m_culledMeshes = 0;
+    m_culledOnGpu = false;
+
+    // Everything below draws from the state taken when the camera or a uniform last changed
+    // instead of the members the UI changes
+    const RenderState& frame = m_renderState;
+    const qreal retinaScale = frame.m_retinaScale;
+    const QSize nativeSize = frame.m_nativeSize;
+    QMatrix4x4 viewMatrix = frame.m_projection;
+    QMatrix4x4 modelMatrix = frame.m_model;
+
+    // Each tile of a poster sees its part of the poster's view, which has an aspect of its own.
+    // The shadows are fitted to the whole view, so they match across the tiles.
+    QMatrix4x4 viewProjection = frame.m_projection;
+    if (posterTile) {
+        const QSize posterSize = m_posterRenderer.ImageSize();
+        viewProjection.setToIdentity();
+        viewProjection.perspective(fieldOfView, float(posterSize.width()) / float(posterSize.height()), frame.m_nearPlane, frame.m_farPlane);
+        viewMatrix = m_posterRenderer.TileProjection(viewProjection);
+    }
+    const QMatrix4x4 projection = viewMatrix;
+
+    // While nothing changes, each frame adds a sample to the average of the ones since it last
+    // did. Any other frame is drawn as usual and starts the average over.
+    const bool refinement = m_settings.m_progressiveRefinement && m_frameAccumulator.IsCreated() && m_resolutionScaler.IsCreated() && !posterTile && !direct;
+    bool refining = false;
+    if (refinement) {
+        if (m_sceneChanged || viewMatrix != m_refineProjection || modelMatrix != m_refineModel || nativeSize != m_refineSize
+            || m_frameAccumulator.SampleCount() >= k_refineSamples) {
+            m_frameAccumulator.Reset();
+            m_refineProjection = viewMatrix;
+            m_refineModel = modelMatrix;
+            m_refineSize = nativeSize;
+        }
+        else {
+            refining = true;
+        }
+    }
+    m_sceneChanged = false;
+
+    // See-through meshes are left to a pass of their own, which starts from the depth of the
+    // opaque scene. It copies the depth from a target of a known format, so the scene is drawn
+    // offscreen for it.
+    const bool transparency = !m_transparentMeshes.empty() && m_transparentProgram && m_hasMaterialBlock && m_currentModel.m_isValid
+        && m_transparencyPass.IsCreated() && m_resolutionScaler.IsCreated() && !DrawsPoints() && !direct;
+
+    // Compute viewport with support for high DPI monitors, the scaled scene keeps its aspect.
+    // Samples are averaged at the full resolution.
+    const bool offscreen = (scaled || refining || m_settings.m_msaaLevel != 0 || transparency) && m_resolutionScaler.IsCreated() && !direct;
+    if (!scaled || refining) {
+        m_resolutionScaler.ResetScale();
+    }
+    m_sceneFramebuffer = defaultFramebufferObject();
+    m_sceneScale = 1.f;
+    if (offscreen) {
+        m_resolutionScaler.Begin(nativeSize, qMax(0, m_settings.m_msaaLevel));
+        m_sceneFramebuffer = m_resolutionScaler.Framebuffer();
+        m_sceneScale = m_resolutionScaler.Scale();
+    }
+    else {
+        state.Viewport(0, 0, nativeSize.width(), nativeSize.height());
+    }
 
-    setUniformVars();
+    // Masked materials, like foliage, cover as many samples as their alpha where the scene is
+    // multisampled, and are written opaque
+    GLint samples = 0;
+    glGetIntegerv(GL_SAMPLES, &samples);
+    const bool alphaToCoverage = samples > 1;
+
+    // Each sample shifts the image by a different fraction of a pixel
+    if (refining) {
+        const QPointF jitter = FrameAccumulator::Jitter(m_frameAccumulator.SampleCount());
+        QMatrix4x4 offset;
+        offset.translate(2.f * float(jitter.x()) / nativeSize.width(), 2.f * float(jitter.y()) / nativeSize.height());
+        viewMatrix = offset * viewMatrix;
+    }
+    m_transformCache.SetView(viewMatrix, modelMatrix);
 
-    glEnable(GL_DEPTH_TEST);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (m_currentModel.m_isValid)
-    {
-        // Loop through all meshes in the current model
-        for (Mesh& mesh : m_currentModel.m_meshes) {
-            mesh.m_vertexBuffer.bind();
-            mesh.m_indexBuffer.bind();
-
-            if (mesh.m_hasTexture) {
-                mesh.m_texture->setMinificationFilter(QOpenGLTexture::Linear);
-                mesh.m_texture->setMagnificationFilter(QOpenGLTexture::Linear);
-                mesh.m_texture->setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::ClampToEdge);
-                mesh.m_texture->setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::ClampToEdge);
-                mesh.m_texture->bind(0);
-                m_program->setUniformValue(m_uTexture, 0);
-                m_program->setUniformValue(m_uHasTexture, 1.f);
-            }
+    // Skinned meshes are posed once per pose by a compute pass, every pass after it draws
+    // the result. The buffers are taken on the first frame after the scene changed.
+    if (m_settings.m_computeSkinning && m_computeSkinner.IsCreated() && !m_computeSkinner.IsBuilt()) {
+        m_computeSkinner.Build(m_currentModel);
+        m_skinPending = true;
+        UpdateUploadedBytes();
+    }
+    else if (!m_settings.m_computeSkinning && m_computeSkinner.IsBuilt()) {
+        m_computeSkinner.Clear(m_currentModel);
+        UpdateUploadedBytes();
+    }
+    if (m_skinPending && m_computeSkinner.IsBuilt()) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Skinning");
+        m_computeSkinner.Skin(m_currentModel);
+    }
+    m_skinPending = false;
+
+    // The shadow map is fitted to the model from the light's place in it, and only drawn again
+    // when that fit, the model or its pose changed. The shading then lights the model from
+    // the same place, wherever the camera is.
+    QVector3D lightPos = frame.m_lightPos;
+    const bool shadows = m_settings.m_shadows.m_mode != k_shadowsOff && m_shadowMapper.IsCreated() && m_currentModel.m_isValid && !direct;
+    if (shadows) {
+        const QVector3D light = ShadowMapper::LightPosition(m_settings.m_shadows.m_mode, frame.m_lightPos, m_currentModel.m_AABBMin, m_currentModel.m_AABBMax);
+        GpuProfiler::Scope pass(m_gpuProfiler, "Shadows");
+        const qint64 shadowBytes = m_shadowMapper.Bytes();
+        m_shadowMapper.Update(m_currentModel, m_settings.m_shadows, light, viewProjection, modelMatrix);
+        if (m_shadowMapper.Bytes() != shadowBytes) {
+            UpdateUploadedBytes();
+        }
+        lightPos = modelMatrix.map(light);
+    }
+    m_shadowMapper.Bind(modelMatrix, shadows, m_streamBuffer);
+
+    // The lights of the scene are binned into clusters of the view whenever the camera moves
+    const bool sceneLights = m_settings.m_sceneLights && m_lightClusters.LightCount() > 0 && m_currentModel.m_isValid && !direct;
+    if (sceneLights) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Light Clusters");
+        const qint64 lightBytes = m_lightClusters.Bytes();
+        m_lightClusters.Update(projection, modelMatrix, m_currentModel.m_AABBMin, m_currentModel.m_AABBMax);
+        if (m_lightClusters.Bytes() != lightBytes) {
+            UpdateUploadedBytes();
+        }
+    }
+    m_lightClusters.Bind(sceneLights, m_streamBuffer);
+    m_environment.Bind(modelMatrix, m_settings.m_environmentIntensity, m_streamBuffer);
+
+    // The occlusion is computed before the shading pass, which reads it for every pixel. Its
+    // prepass takes the projection from the frame block.
+    const bool ambientOcclusion = m_settings.m_ambientOcclusion.m_mode != k_ambientOcclusionOff && m_ambientOcclusion.IsCreated()
+        && m_hasFrameBlock && m_currentModel.m_isValid && !DrawsPoints() && !direct;
+    UpdateFrameBlock(frame, viewMatrix, modelMatrix, lightPos, alphaToCoverage, ambientOcclusion);
+    if (ambientOcclusion) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Ambient Occlusion");
+        DrawAmbientOcclusion(viewMatrix, modelMatrix, nativeSize);
+    }
 
-            // Handle transformation for each mesh
-            QMatrix4x4 modelTransformed = modelMatrix * mesh.m_transform;
-            QMatrix4x4 modelViewProjectionMatrix;
-            modelViewProjectionMatrix = viewMatrix * modelTransformed;
+    m_gpuProfiler.BeginPass("Model");
 
-            m_program->setUniformValue(m_matrixUniform, modelViewProjectionMatrix);
+    m_program->bind();
+    m_pDrawVariant = &m_baseVariant;
+
+    setUniformVars(frame, lightPos);
 
-            m_program->setUniformValue(m_modelviewUniform, modelTransformed);
+    state.Enable(GL_DEPTH_TEST);
 
-            QMatrix3x3 normal = modelTransformed.normalMatrix();
-            m_program->setUniformValue(m_normalUniform, normal);
+    bool streaming = false;
+    if (comparing) {
+        m_drawCalls += m_modelComparison.Draw(m_compareMode, defaultFramebufferObject(), nativeSize, viewMatrix, modelMatrix);
+    }
+    else if (split) {
+        streaming = DrawSplitViews(frame, lightPos, alphaToCoverage);
+    }
+    else if (m_currentModel.m_isValid)
+    {
+        m_deferTransparent = transparency;
+        if (alphaToCoverage) {
+            state.Enable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+            state.Enable(GL_SAMPLE_ALPHA_TO_ONE);
+        }
 
-            // Positions
-            glVertexAttribPointer(m_posAttr, mesh.m_numPositionComponents, GL_FLOAT, GL_FALSE, 0, (void*)mesh.m_positionOffset);
-            glEnableVertexAttribArray(m_posAttr);
+        // Meshes whose AABB is entirely off screen or cut away by a section plane are skipped.
+        // The AABBs are in model space, so the frustum is too.
+        const Frustum frustum = SectionFrustum(viewMatrix * modelMatrix);
+        // Meshes drawn at a lower resolution cover fewer pixels, so coarser levels do. Those of
+        // a poster cover as many as in the whole poster.
+        const float viewportHeight = float(height() * retinaScale) * m_sceneScale * (posterTile ? m_posterRenderer.Scale() : 1.f);
+
+        // Point cloud octrees draw the nodes in view the point budget allows, those covering the
+        // most of the screen first
+        const bool pointCloud = !m_pointCloudLod.IsEmpty();
+        if (pointCloud) {
+            const float pixelScale = viewportHeight * 0.5f / qTan(qDegreesToRadians(fieldOfView) * 0.5f);
+            m_drawnPoints = m_pointCloudLod.Select(m_currentModel, frustum, viewMatrix * modelMatrix, pixelScale, m_settings.m_pointBudget, m_pointNodes);
+        }
 
-            // Normals
-            if (mesh.m_hasNormals) {
-                glVertexAttribPointer(m_normAttr, mesh.m_numNormalComponents, GL_FLOAT, GL_FALSE, 0, (void*)mesh.m_normalOffset);
-                glEnableVertexAttribArray(m_normAttr);
+        // Streamed models upload the meshes in view, largest on screen first, and draw the ones
+        // that are resident. A change shows in the next frame. Point clouds only ask for the
+        // nodes picked.
+        if (m_currentModel.m_streamer) {
+            if (pointCloud) {
+                m_streamRequests = m_pointNodes;
             }
-
-            // UV Coords
-            if (mesh.m_hasUVCoordinates) {
-                glVertexAttribPointer(m_uvAttr, mesh.m_numUVComponents, GL_FLOAT, GL_FALSE, 0, (void*)mesh.m_uvOffset);
-                glEnableVertexAttribArray(m_uvAttr);
+            else {
+                m_meshBvh.CollectVisible(frustum, m_streamRequests);
             }
-
-            // Colors
-            if (mesh.m_hasColors) {
-                glVertexAttribPointer(m_colAttr, mesh.m_numColorComponents, GL_FLOAT, GL_FALSE, 0, (void*)mesh.m_colorOffset);
-                glEnableVertexAttribArray(m_colAttr);
+            for (int meshIdx : m_streamRequests) {
+                const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+                const QVector3D center = modelMatrix.map((mesh.m_AABBMin + mesh.m_AABBMax) * 0.5f);
+                const float radius = modelMatrix.mapVector((mesh.m_AABBMax - mesh.m_AABBMin) * 0.5f).length();
+                m_currentModel.m_streamer->Request(meshIdx, radius / std::max(-center.z(), frame.m_nearPlane));
+            }
+            streaming = m_currentModel.m_streamer->Update(m_currentModel) || !m_currentModel.m_streamer->IsComplete();
+            if (streaming) {
+                m_sceneChanged = true;
+                m_shadowMapper.Invalidate();
             }
+        }
 
-            glDrawElements(GL_TRIANGLES, mesh.m_indexCount, GL_UNSIGNED_INT, nullptr);
+        // The multi-draw path reads the instance matrices from the GPU, so it only swaps in for
+        // the default shaders. Meshes it doesn't hold are drawn one by one. It copies the meshes
+        // into buffers of its own, which would defeat the budget of a streamed model.
+        const bool multiDraw = !m_settings.m_occlusionCulling && m_settings.m_multiDrawIndirect && m_indirectRenderer.IsCreated()
+            && m_hasFrameBlock && currentVertFile == k_defaultVertexShader && currentFragFile == k_defaultFragmentShader
+            && !m_currentModel.m_streamer;
+        if (multiDraw && !m_indirectRenderer.IsBuilt()) {
+            m_indirectRenderer.Build(m_currentModel);
+            UpdateUploadedBytes();
+        }
+        else if (!m_settings.m_multiDrawIndirect && m_indirectRenderer.IsBuilt()) {
+            m_indirectRenderer.Clear();
+            UpdateUploadedBytes();
+        }
 
-            // Disable all attributes
-            if (mesh.m_hasColors) {
-                glDisableVertexAttribArray(m_colAttr);
+        QOpenGLVertexArrayObject* pBoundVao = nullptr;
+        const ShaderPermutations::Variant* pPoints = nullptr;
+        if (DrawsPoints() && m_displayModes.IsCreated()) {
+            // The nodes picked of a point cloud hold fewer points than the whole cloud, spread
+            // further apart
+            const float spacing = pointCloud && m_drawnPoints > 0
+                ? m_pointSpacing * std::sqrt(float(m_pointCloudLod.PointCount()) / float(m_drawnPoints)) : m_pointSpacing;
+            pPoints = m_displayModes.BeginPoints(MeshDisplayModes::PointScale(spacing * modelMatrix.column(0).toVector3D().length(), viewportHeight, fieldOfView));
+        }
+        // The points program doesn't clip, points are only left out with their meshes
+        EnableSectionPlanes(!pPoints && m_sectionClipping);
+        if (pPoints) {
+            // Point clouds are culled and simplified like meshes, only their triangles are left out
+            if (pointCloud) {
+                m_visibleMeshIndices = m_pointNodes;
+            }
+            else {
+                m_meshBvh.CollectVisible(frustum, m_visibleMeshIndices);
+            }
+            m_visibleMeshes = int(m_visibleMeshIndices.size());
+            m_culledMeshes = int(m_currentModel.m_meshes.size()) - m_visibleMeshes;
+            m_occludedMeshes = 0;
+            m_pOverrideVariant = pPoints;
+            m_pDrawVariant = pPoints;
+            m_drawPoints = true;
+            for (int meshIdx : m_visibleMeshIndices) {
+                DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+            }
+            m_drawPoints = false;
+            m_pOverrideVariant = nullptr;
+            m_displayModes.End();
+        }
+        else if (multiDraw && m_settings.m_gpuCulling && m_indirectRenderer.SupportsGpuCulling()) {
+            // A compute pass culls the meshes in the arenas, the CPU only sees the few left out.
+            // How many meshes and triangles the GPU drew isn't read back.
+            m_culledOnGpu = true;
+            m_occludedMeshes = 0;
+            for (int meshIdx : m_indirectRenderer.ExcludedMeshes()) {
+                Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+                if (frustum.Intersects(mesh.m_AABBMin, mesh.m_AABBMax)) {
+                    DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+                }
+            }
+            if (pBoundVao) {
+                pBoundVao->release();
+                pBoundVao = nullptr;
+            }
+            const float lodScale = m_settings.m_levelOfDetail ? viewportHeight * 0.5f / qTan(qDegreesToRadians(fieldOfView) * 0.5f) : 0.f;
+            m_drawCalls += m_indirectRenderer.DrawCulled(frustum, modelMatrix, frame.m_color, lodScale, k_lodPixelsPerTriangle);
+            m_pBoundMaterial = nullptr;
+        }
+        else {
+            // The hierarchy rejects whole groups of meshes at once
+            m_meshBvh.CollectVisible(frustum, m_visibleMeshIndices);
+            m_visibleMeshes = int(m_visibleMeshIndices.size());
+            m_culledMeshes = int(m_currentModel.m_meshes.size()) - m_visibleMeshes;
+
+            // Meshes hidden behind others in the last frame are skipped as well, which for a
+            // poster's tile was another part of the view
+            if (m_settings.m_occlusionCulling && m_occlusionCuller.IsCreated() && !posterTile) {
+                DrawOcclusionCulled(viewMatrix, modelMatrix, pBoundVao);
             }
-            if (mesh.m_hasNormals) {
-                glDisableVertexAttribArray(m_normAttr);
+            else {
+                m_occludedMeshes = 0;
+
+                // The pre-pass lays down the depth front to back, so the shading pass below
+                // only lights the fragments that end up on screen
+                const ShaderPermutations::Variant* pDepthOnly = m_settings.m_depthPrepass && m_hasFrameBlock ? m_shaderPermutations.DepthOnly() : nullptr;
+                BuildRenderQueue(viewMatrix * modelMatrix, pDepthOnly != nullptr);
+                if (pDepthOnly) {
+                    state.ColorMask(false);
+                    m_pOverrideVariant = pDepthOnly;
+                    for (int meshIdx : m_prepassQueue.Meshes()) {
+                        if (!multiDraw || !m_indirectRenderer.Contains(meshIdx)) {
+                            DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+                        }
+                    }
+                    m_pOverrideVariant = nullptr;
+                    state.ColorMask(true);
+
+                    // The programs transform positions alike, so the nearest are drawn again
+                    state.DepthFunc(GL_LEQUAL);
+                }
+                for (int meshIdx : m_renderQueue.Meshes()) {
+                    Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+                    if (multiDraw && m_indirectRenderer.Contains(meshIdx)) {
+                        const MeshLod lod = m_settings.m_levelOfDetail ? SelectLod(mesh, modelMatrix, viewportHeight) : MeshLod{ 0, mesh.m_indexCount };
+                        m_drawnTriangles += qint64(lod.m_indexCount / 3) * (mesh.DrawCount() - mesh.m_hiddenDrawCount);
+                        m_indirectRenderer.Add(meshIdx, lod);
+                    }
+                    else {
+                        DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+                    }
+                }
+                if (multiDraw) {
+                    if (pBoundVao) {
+                        pBoundVao->release();
+                        pBoundVao = nullptr;
+                    }
+                    m_drawCalls += m_indirectRenderer.Draw(modelMatrix, frame.m_color, m_streamBuffer);
+                    m_pBoundMaterial = nullptr;
+                }
+                state.DepthFunc(GL_LESS);
+            }
+        }
+
+        m_deferTransparent = false;
+        if (alphaToCoverage) {
+            state.Disable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+            state.Disable(GL_SAMPLE_ALPHA_TO_ONE);
+        }
+
+        if (!pPoints) {
+            DrawSectionCaps(viewMatrix, modelMatrix, pBoundVao);
+        }
+
+        // Edges are drawn over the shaded meshes where they are the nearest surface
+        const ShaderPermutations::Variant* pWireframe = nullptr;
+        if (m_settings.m_displayMode == k_displayWireframe && m_displayModes.HasWireframe()) {
+            const QSize sceneSize(qRound(nativeSize.width() * m_sceneScale), qRound(nativeSize.height() * m_sceneScale));
+            pWireframe = m_displayModes.BeginWireframe(sceneSize, QColor(20, 20, 20, 200));
+        }
+        if (pWireframe) {
+            if (m_culledOnGpu) {
+                m_meshBvh.CollectVisible(frustum, m_visibleMeshIndices);
             }
-            if (mesh.m_hasUVCoordinates) {
-                glDisableVertexAttribArray(m_uvAttr);
+            m_pOverrideVariant = pWireframe;
+            m_pDrawVariant = pWireframe;
+            for (int meshIdx : m_visibleMeshIndices) {
+                DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
             }
+            m_pOverrideVariant = nullptr;
+            m_displayModes.End();
+        }
 
-            glDisableVertexAttribArray(m_posAttr);
+        // Every fragment of every visible mesh adds to the color, without depth testing, so
+        // the screen shows how often each pixel would be shaded without the pre-pass
+        const ShaderPermutations::Variant* pOverdraw = m_settings.m_overdrawView && m_hasFrameBlock ? m_shaderPermutations.DepthOnly() : nullptr;
+        if (pOverdraw) {
+            if (m_culledOnGpu) {
+                m_meshBvh.CollectVisible(frustum, m_visibleMeshIndices);
+            }
+            glClear(GL_COLOR_BUFFER_BIT);
+            state.Disable(GL_DEPTH_TEST);
+            state.Enable(GL_BLEND);
+            state.BlendFunc(GL_ONE, GL_ONE);
+            m_pOverrideVariant = pOverdraw;
+            for (int meshIdx : m_visibleMeshIndices) {
+                DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+            }
+            m_pOverrideVariant = nullptr;
+            state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            state.Disable(GL_BLEND);
+            state.Enable(GL_DEPTH_TEST);
+        }
+        EnableSectionPlanes(false);
 
-            mesh.m_vertexBuffer.release();
-            mesh.m_indexBuffer.release();
+        // Release the last vertex array object so later passes don't change its attributes
+        if (pBoundVao) {
+            pBoundVao->release();
         }
     }
     m_program->release();
+    m_gpuProfiler.EndPass();
+
+    if (transparency) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Transparency");
+        DrawTransparent(viewMatrix, modelMatrix, nativeSize);
+    }
 
-    // Draw a grid for the object
-    if (settings->value("ViewerGraphicsWindow/toggleGrid", true).toBool()) {
+    // Clicks into a split window or a comparison don't pick
+    if (direct) {
+        m_pickRequested = false;
+    }
+    if (m_pickRequested && !posterTile) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Pick");
+        PickMesh(viewMatrix * modelMatrix, size() * retinaScale);
+        if (offscreen) {
+            // The pick leaves the full window's viewport behind
+            state.Viewport(0, 0, qRound(width() * retinaScale * m_sceneScale), qRound(height() * retinaScale * m_sceneScale));
+        }
+    }
+    if (!direct && !posterTile && m_virtualTextures.NeedsFeedback(viewMatrix * modelMatrix, size() * retinaScale)) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Page Feedback");
+        DrawPageFeedback(viewMatrix * modelMatrix, size() * retinaScale);
+        if (offscreen) {
+            state.Viewport(0, 0, qRound(width() * retinaScale * m_sceneScale), qRound(height() * retinaScale * m_sceneScale));
+        }
+    }
+
+    // Draw a grid for the object, split windows drew one into each viewport
+    if (m_settings.m_showGrid && !direct) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Grid");
         RenderGrid(viewMatrix * modelMatrix);
     }
-    
+
+    // Resolve and stretch the scene over the window, the overlays are drawn at its full
+    // resolution and without anti-aliasing
+    if (offscreen) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Upsample");
+        if (refining) {
+            m_frameAccumulator.BeginSample(nativeSize);
+            m_resolutionScaler.End(m_frameAccumulator.Framebuffer(), m_settings.m_msaaLevel < 0);
+            m_frameAccumulator.EndSample();
+            m_frameAccumulator.Present(defaultFramebufferObject());
+        }
+        else {
+            m_resolutionScaler.End(defaultFramebufferObject(), m_settings.m_msaaLevel < 0);
+        }
+        ++m_drawCalls;
+    }
 
     // Draw axes so the user understands direction
-    if (settings->value("ViewerGraphicsWindow/toggleAxis", true).toBool()) {
+    if (m_settings.m_showAxis && !posterTile) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Axes");
         RenderAxes();
     }
     
 
-    // Draw the framerate counter and size of this mesh
-    if (settings->value("ViewerGraphicsWindow/toggleStats", true).toBool()) {
-        RenderText();
+    // Draw the framerate counter, size of this mesh and the selection
+    if ((m_settings.m_showStats || m_selectedMesh >= 0) && !posterTile) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Text");
+        if (devicePixelRatio() != m_textPixelRatio) {
+            // The atlas is rasterized for the screen the window is on
+            m_textPixelRatio = devicePixelRatio();
+            m_textRenderer.Create(font(), m_textPixelRatio);
+        }
+        if (m_settings.m_showStats) {
+            RenderText();
+        }
+        if (m_selectedMesh >= 0) {
+            RenderSelection();
+        }
+        m_drawCalls += m_textRenderer.Draw(size() * retinaScale, QColor(165, 165, 165, 200), &m_streamBuffer);
+    }
+
+    // Read back this frame for screenshots, image sequences and streams, and save earlier ones
+    if (m_frameCapture.IsBusy() || m_frameCapture.IsStreaming()) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Capture");
+        m_frameCapture.Capture(defaultFramebufferObject(), size() * retinaScale, format().samples());
+    }
+    if (m_posterRenderer.IsActive()) {
+        GpuProfiler::Scope pass(m_gpuProfiler, "Poster");
+        m_posterRenderer.Capture(defaultFramebufferObject(), size() * retinaScale, format().samples());
+    }
+
+    m_gpuProfiler.EndFrame();
+    m_streamBuffer.EndFrame();
+    // Low latency waits for the GPU, so the driver has no frame queued ahead of the next one
+    // and the CPU time holds the GPU's
+    const bool lowLatency = m_settings.m_pacing.m_lowLatency;
+    if (lowLatency) {
+        glFinish();
+    }
+    m_cpuFrameTimes.AddFrame(float(cpuTimer.nsecsElapsed()) * 1e-9f);
+    if (inputAge >= 0.f) {
+        m_inputLatencies.AddFrame(m_framePacer.InputToPhoton(inputAge, m_cpuFrameTimes.Latest(), lowLatency ? 0.f : m_gpuFrameTimes.Latest()));
+    }
+
+    // The path holds its last pose for the frames after it until their GPU times came in
+    if (playbackFrame >= 0) {
+        if (playbackFrame < m_cameraPlayback.FrameCount(m_playbackStep)) {
+            PlaybackFrame timing;
+            timing.m_frame = playbackFrame;
+            timing.m_time = float(playbackFrame) * m_playbackStep;
+            timing.m_cpuSeconds = m_cpuFrameTimes.Latest();
+            m_playbackFrames.push_back(timing);
+        }
+        m_playbackFrame = playbackFrame + 1;
+        if (m_playbackFrame >= m_cameraPlayback.FrameCount(m_playbackStep) + GpuProfiler::k_frameLatency) {
+            StopCameraPlayback();
+        }
+    }
+    if (m_recordingCamera) {
+        m_cameraRecording.Record(float(m_cameraRecordingTimer.nsecsElapsed()) * 1e-9f, GetCameraPose());
+    }
+    QString posterPath;
+    bool posterWritten = false;
+    if (m_posterRenderer.TakeFinished(posterPath, posterWritten)) {
+        emit PosterExported(posterWritten, posterPath);
+    }
+    if (!m_videoSequence.isEmpty() && !m_frameCapture.IsBusy()) {
+        const QString folder = m_videoSequence;
+        m_videoSequence.clear();
+        emit VideoExported(m_frameCapture.FinishWrites(), folder);
     }
 
     // Increase the frame counter by one
     ++m_frame;
+
+    // Keep drawing while the view is moving. Calling update() several times normally results
+    // in just one paintGL() call, which locks the fps to the monitor refresh rate.
+    m_redrawing = m_pressedKeys != 0 || m_settings.m_alwaysRedraw || m_frameCapture.IsBusy() || m_posterRenderer.IsActive() || m_recordingCamera || m_playbackFrame >= 0 || m_meshPicker.IsPending() || m_virtualTextures.IsStreaming() || (m_settings.m_occlusionCulling && m_occlusionCuller.NeedsFrame())
+        || (refinement && m_frameAccumulator.SampleCount() < k_refineSamples) || streaming || animating;
+    // Frames the pacer delays are asked for once this one was swapped
+    if (m_redrawing && !m_framePacer.Delays()) {
+        update();
+    }
+    else if (!m_redrawing) {
+        m_framePacer.Reset();
+    }
 }
 
-void ViewerGraphicsWindow::RenderGrid(QMatrix4x4 mvp)
+void ViewerGraphicsWindow::OnFrameSwapped()
 {
-    // Bind the flat shader for drawing gridlines
-    m_flatShader->bind();
+    if (!m_redrawing || !m_framePacer.Delays()) {
+        return;
+    }
+    float frameCost = m_cpuFrameTimes.Summarize().m_p95;
+    if (!m_settings.m_pacing.m_lowLatency) {
+        frameCost += m_gpuFrameTimes.Summarize().m_p95;
+    }
+    const float delay = m_framePacer.NextFrameDelay(double(m_paceClock.nsecsElapsed()) * 1e-9, frameCost);
+    m_paceTimer.start(int(delay * 1000.f));
+}
 
-    // Bind the grid attributes and colors
-    glVertexAttribPointer(m_flatShaderPosAttr, 3, GL_FLOAT, GL_FALSE, 0, grid);
-    glVertexAttribPointer(m_flatShaderColAttr, 4, GL_FLOAT, GL_FALSE, 0, gridColors);
+void ViewerGraphicsWindow::NoteInput()
+{
+    if (!m_inputPending) {
+        m_inputPending = true;
+        m_inputTimer.start();
+    }
+}
 
-    glEnableVertexAttribArray(m_flatShaderPosAttr);
-    glEnableVertexAttribArray(m_flatShaderColAttr);
+FrameStats::Summary ViewerGraphicsWindow::GetCpuFrameStats() const
+{
+    return m_cpuFrameTimes.Summarize();
+}
 
-    // Enable alpha blending
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+FrameStats::Summary ViewerGraphicsWindow::GetGpuFrameStats() const
+{
+    return m_gpuFrameTimes.Summarize();
+}
 
-    // Move the model so it's sitting on the grid
-    mvp.translate(0, m_currentModel.m_AABBMin.y(), 0);
-    m_flatShader->setUniformValue(m_flatShaderMatrixAttr, mvp);
+void ViewerGraphicsWindow::ClearFrameStats()
+{
+    m_frameIntervals.Clear();
+    m_cpuFrameTimes.Clear();
+    m_inputLatencies.Clear();
+    m_gpuFrameTimes.Clear();
+}
 
-    // Helper function to draw grids
+qint64 ViewerGraphicsWindow::GetUploadedBytes() const
+{
+    return m_uploadedBytes;
+}
+
+const ResourceTracker& ViewerGraphicsWindow::GetResources() const
+{
+    return m_resources;
+}
+
+const std::vector<ImportStepTime>& ViewerGraphicsWindow::GetImportTimings() const
+{
+    return m_pModelLoader->ImportTimings();
+}
+
+const ImportTrace& ViewerGraphicsWindow::GetImportTrace() const
+{
+    return m_pModelLoader->LoadTrace();
+}
+
+const ModelStats& ViewerGraphicsWindow::GetModelStats() const
+{
+    return m_currentModel.m_stats;
+}
+
+const ThumbnailIndex& ViewerGraphicsWindow::GetThumbnailIndex() const
+{
+    return m_thumbnailIndex;
+}
+
+void ViewerGraphicsWindow::IndexModel(const QString& filepath)
+{
+    // Only files on disk can be told apart from later versions of them
+    const QFileInfo info(filepath);
+    if (!info.isFile() || !m_currentModel.m_isValid) {
+        return;
+    }
+    ModelSummary summary;
+    summary.m_path = info.absoluteFilePath();
+    summary.m_modified = info.lastModified().toMSecsSinceEpoch();
+    summary.m_size = info.size();
+    summary.m_triangles = m_currentModel.m_stats.m_triangles;
+    summary.m_meshes = int(m_currentModel.m_meshes.size());
+    summary.m_materials = int(m_currentModel.m_materials.size());
+    summary.m_AABBMin = m_currentModel.m_AABBMin;
+    summary.m_AABBMax = m_currentModel.m_AABBMax;
+    summary.m_loadSeconds = m_loadTimer.elapsed() / 1000.f;
+
+    // The overlays would cover most of a frame scaled down this far
+    const bool showGrid = m_settings.m_showGrid;
+    const bool showAxis = m_settings.m_showAxis;
+    const bool showStats = m_settings.m_showStats;
+    m_settings.m_showGrid = m_settings.m_showAxis = m_settings.m_showStats = false;
+    const QImage frame = grabFramebuffer();
+    m_settings.m_showGrid = showGrid;
+    m_settings.m_showAxis = showAxis;
+    m_settings.m_showStats = showStats;
+
+    if (m_thumbnailIndex.Insert(summary, frame)) {
+        emit ModelIndexed(summary.m_path);
+    }
+}
+
+const GpuProfiler& ViewerGraphicsWindow::GetGpuProfiler() const
+{
+    return m_gpuProfiler;
+}
+
+void ViewerGraphicsWindow::StartGpuTrace()
+{
+    m_gpuProfiler.StartTrace();
+}
+
+bool ViewerGraphicsWindow::SaveGpuTrace(const QString& filepath)
+{
+    return m_gpuProfiler.SaveTrace(filepath);
+}
+
+void ViewerGraphicsWindow::RenderGrid(QMatrix4x4 mvp)
+{
+    StateCache& state = StateCache::Current();
+    // Bind the flat shader for drawing gridlines
+    m_flatShader->bind();
+
+    // Bind the grid attributes and colors
+    BindFlatLines(m_gridLines);
+
+    // Enable alpha blending
+    state.Enable(GL_BLEND);
+    state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+    // Move the model so it's sitting on the grid
+    mvp.translate(0, m_currentModel.m_AABBMin.y(), 0);
+    m_flatShader->setUniformValue(m_flatShaderMatrixAttr, mvp);
+
+    // Helper function to draw grids
     auto drawGrid = [&](float scale, QMatrix4x4 modelViewProj, float offset) {
         // Scale the drawing
         modelViewProj.scale(scale);
@@ -635,33 +2295,90 @@ void ViewerGraphicsWindow::RenderGrid(QMatrix4x4 mvp)
 
         // Draw the grid
         m_flatShader->setUniformValue(m_flatShaderMatrixAttr, modelViewProj);
-        glDrawArrays(GL_LINES, 0, sizeof(grid) / 3 / sizeof(float));
+        glDrawArrays(GL_LINES, 0, m_gridLines.m_vertexCount);
+        ++m_drawCalls;
 
         // Rotate 90 degrees for the next iteration
         modelViewProj.rotate(90.f, 0, 1, 0);
         m_flatShader->setUniformValue(m_flatShaderMatrixAttr, modelViewProj);
-        glDrawArrays(GL_LINES, 0, sizeof(grid) / 3 / sizeof(float));
+        glDrawArrays(GL_LINES, 0, m_gridLines.m_vertexCount);
+        ++m_drawCalls;
     };
 
-    glLineWidth(1.f);
+    state.LineWidth(1.f);
     drawGrid(m_gridScale, mvp, 0);
 
     // Disable all the stuff we enabled
-    glDisable(GL_BLEND);
+    state.Disable(GL_BLEND);
 
-    glDisableVertexAttribArray(m_flatShaderColAttr);
-    glDisableVertexAttribArray(m_flatShaderPosAttr);
+    ReleaseFlatLines(m_gridLines);
 
     m_flatShader->release();
 }
 
+void ViewerGraphicsWindow::CreateFlatLines(FlatLines& lines, const GLfloat* pPositions, const GLfloat* pColors, int vertexCount, int colorSize)
+{
+    const int positionBytes = vertexCount * 3 * int(sizeof(GLfloat));
+    const int colorBytes = vertexCount * colorSize * int(sizeof(GLfloat));
+    lines.m_vertexCount = vertexCount;
+    lines.m_colorSize = colorSize;
+    lines.m_buffer = QOpenGLBuffer(QOpenGLBuffer::VertexBuffer);
+    lines.m_buffer.create();
+    lines.m_buffer.bind();
+    lines.m_buffer.allocate(positionBytes + colorBytes);
+    lines.m_buffer.write(0, pPositions, positionBytes);
+    lines.m_buffer.write(positionBytes, pColors, colorBytes);
+
+    // The vertex array object remembers the attributes for every later draw
+    if (lines.m_vao.create()) {
+        lines.m_vao.bind();
+        EnableFlatLinesAttributes(lines);
+        lines.m_vao.release();
+    }
+    lines.m_buffer.release();
+}
+
+void ViewerGraphicsWindow::BindFlatLines(FlatLines& lines)
+{
+    if (lines.m_vao.isCreated()) {
+        lines.m_vao.bind();
+    }
+    else {
+        lines.m_buffer.bind();
+        EnableFlatLinesAttributes(lines);
+    }
+}
+
+void ViewerGraphicsWindow::ReleaseFlatLines(FlatLines& lines)
+{
+    if (lines.m_vao.isCreated()) {
+        lines.m_vao.release();
+    }
+    else {
+        glDisableVertexAttribArray(m_flatShaderColAttr);
+        glDisableVertexAttribArray(m_flatShaderPosAttr);
+        lines.m_buffer.release();
+    }
+}
+
+void ViewerGraphicsWindow::EnableFlatLinesAttributes(const FlatLines& lines)
+{
+    // Reads from the bound buffer, colors follow the positions
+    const size_t colorOffset = size_t(lines.m_vertexCount) * 3 * sizeof(GLfloat);
+    glVertexAttribPointer(m_flatShaderPosAttr, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
+    glVertexAttribPointer(m_flatShaderColAttr, lines.m_colorSize, GL_FLOAT, GL_FALSE, 0, reinterpret_cast<const void*>(colorOffset));
+    glEnableVertexAttribArray(m_flatShaderPosAttr);
+    glEnableVertexAttribArray(m_flatShaderColAttr);
+}
+
 void ViewerGraphicsWindow::RenderAxes()
 {
+    StateCache& state = StateCache::Current();
     // Viewport to the bottom right corner
     const qreal retinaScale = devicePixelRatio();
     const float size = width() * retinaScale * 0.1f;
     const float padding = 4.f * retinaScale;
-    glViewport(width() * retinaScale - size - padding, padding, size, size);
+    state.Viewport(width() * retinaScale - size - padding, padding, size, size);
 
     // Orithographic projection
     QMatrix4x4 viewMatrix;
@@ -678,64 +2395,102 @@ void ViewerGraphicsWindow::RenderAxes()
 
     m_flatShader->setUniformValue(m_flatShaderMatrixAttr, viewMatrix * modelMatrix);
 
-    // Bind the grid attributes and colors
-    glVertexAttribPointer(m_flatShaderPosAttr, 3, GL_FLOAT, GL_FALSE, 0, axes);
-    glVertexAttribPointer(m_flatShaderColAttr, 3, GL_FLOAT, GL_FALSE, 0, axesColors);
+    // Bind the axes attributes and colors
+    BindFlatLines(m_axesLines);
 
-    glEnableVertexAttribArray(m_flatShaderPosAttr);
-    glEnableVertexAttribArray(m_flatShaderColAttr);
-
-    glLineWidth(2.f);
-    glDrawArrays(GL_LINES, 0, sizeof(axes) / 3 / sizeof(float));
+    state.LineWidth(2.f);
+    glDrawArrays(GL_LINES, 0, m_axesLines.m_vertexCount);
+    ++m_drawCalls;
 
     // Disable all the stuff we enabled
-    glDisableVertexAttribArray(m_flatShaderColAttr);
-    glDisableVertexAttribArray(m_flatShaderPosAttr);
+    ReleaseFlatLines(m_axesLines);
 
     m_flatShader->release();
 }
 
 void ViewerGraphicsWindow::RenderText()
 {
-    // Prepare to draw text on the screen
-    QPainter painter(this);
-    QColor col(165, 165, 165, 200);
-    QFontMetrics f(painter.font());
-    painter.setPen(col);
-    painter.setRenderHints(QPainter::Antialiasing | QPainter::TextAntialiasing);
+    // Compute framerate and frame time statistics over the recent frames
+    const FrameStats::Summary frames = m_frameIntervals.Summarize();
+    const float cpuMs = m_cpuFrameTimes.Summarize().m_avg * 1000.f;
 
-    // Compute framerate
-    float total = 0;
-    for (auto it : m_frametimes) {
-        total += it;
+    // Format the text for drawing
+    const QString framerateText = QString("FPS: %1").arg(frames.m_fps);
+    const QString frametimeText = QString("Frame ms: min %1 avg %2 p95 %3 p99 %4")
+        .arg(frames.m_min * 1000.f, 0, 'f', 2)
+        .arg(frames.m_avg * 1000.f, 0, 'f', 2)
+        .arg(frames.m_p95 * 1000.f, 0, 'f', 2)
+        .arg(frames.m_p99 * 1000.f, 0, 'f', 2);
+    const QString gpuText = m_gpuFrameTimes.Count() > 0 ? QString::number(m_gpuFrameTimes.Summarize().m_avg * 1000.f, 'f', 2) : QString("n/a");
+    const PacingOptions& pacing = m_settings.m_pacing;
+    const char* presentNames[] = { "Vsync", "Adaptive vsync", "Uncapped", "Limited to" };
+    QString presentText = QString("Present: %1").arg(presentNames[std::max(0, std::min(pacing.m_presentMode, int(k_presentLimited)))]);
+    if (pacing.m_presentMode == k_presentLimited) {
+        presentText += QString(" %1 FPS").arg(pacing.m_frameLimit);
     }
-    const int fps = round(m_frametimes.size() / total);
-
-    // Remove any frametimes older than 0.25 seconds
-    total = 0;
-    QList<float> newFrametimes;
-    for (auto it = m_frametimes.rbegin(); it != m_frametimes.rend(); ++it) {
-        if (total < 0.25f) {
-            total += *it;
-            newFrametimes.push_front(*it);
-        }
-        else {
-            break;
-        }
+    if (pacing.m_lowLatency) {
+        presentText += " Low latency";
     }
-    m_frametimes = newFrametimes;
-
-    // Compute number of polygons, assume triangles
-    int polyCount = 0;
-    if (m_currentModel.m_isValid) {
-        for (auto it : m_currentModel.m_meshes) {
-            polyCount += (it.m_indexCount / 3);
-        }
+    if (m_inputLatencies.Count() > 0) {
+        presentText += QString(" Input to photon: ~%1 ms").arg(m_inputLatencies.Summarize().m_avg * 1000.f, 0, 'f', 1);
+    }
+    QString cpuGpuText = QString("CPU: %1 ms GPU: %2 ms").arg(cpuMs, 0, 'f', 2).arg(gpuText);
+    if (m_settings.m_targetFps > 0) {
+        cpuGpuText += QString(" Resolution: %1%").arg(qRound(m_sceneScale * 100.f));
+    }
+    if (m_settings.m_progressiveRefinement && m_frameAccumulator.IsCreated()) {
+        cpuGpuText += QString(" Samples: %1").arg(qMax(1, m_frameAccumulator.SampleCount()));
+    }
+    const QString drawText = QString("Draws: %1 Textures: %2 Programs: %3 State changes: %4 GL state calls: %5 skipped %6").arg(m_drawCalls).arg(m_textureBinds)
+        .arg(m_programBinds).arg(m_stateChanges).arg(m_stateCallsIssued).arg(m_stateCallsSkipped);
+    const QString cullText = m_culledOnGpu ? QString("Meshes: culled on the GPU")
+        : QString("Meshes: %1 visible %2 culled %3 occluded").arg(m_visibleMeshes - m_occludedMeshes).arg(m_culledMeshes).arg(m_occludedMeshes);
+    QString passText = QString("GPU ms:");
+    for (int i = 0; i < m_gpuProfiler.PassCount(); ++i) {
+        const GpuProfiler::PassTime& pass = m_gpuProfiler.Pass(i);
+        passText += QString(" %1 %2").arg(pass.m_name).arg(pass.m_seconds * 1000.f, 0, 'f', 2);
+    }
+    QString uploadText = QString("Uploaded: %1 MB").arg(double(m_uploadedBytes) / (1024.0 * 1024.0), 0, 'f', 1);
+    if (m_currentModel.m_streamer) {
+        const GeometryStreamer& streamer = *m_currentModel.m_streamer;
+        uploadText += QString(" Streamed: %1 of %2 meshes %3 MB").arg(streamer.ResidentCount()).arg(streamer.MeshCount())
+            .arg(double(streamer.ResidentBytes()) / (1024.0 * 1024.0), 0, 'f', 1);
+    }
+    const auto megabytes = [](qint64 bytes) { return QString::number(double(bytes) / (1024.0 * 1024.0), 'f', 1); };
+    QString memoryText = QString("GPU MB: vertices %1 indices %2 textures %3 buffers %4 passes %5 CPU MB: scene %6 caches %7")
+        .arg(megabytes(m_resources.Bytes(k_resourceVertices))).arg(megabytes(m_resources.Bytes(k_resourceIndices)))
+        .arg(megabytes(m_resources.Bytes(k_resourceTextures))).arg(megabytes(m_resources.Bytes(k_resourceBuffers)))
+        .arg(megabytes(m_resources.Bytes(k_resourcePasses))).arg(megabytes(m_resources.Bytes(k_resourceScene)))
+        .arg(megabytes(m_resources.Bytes(k_resourceCaches)));
+    if (m_resources.GpuBudget() > 0) {
+        memoryText += QString(" Budget: %1 MB%2").arg(megabytes(m_resources.GpuBudget()))
+            .arg(m_uploadedBytes > m_resources.GpuBudget() ? " exceeded" : "");
+    }
+    if (m_resources.Device().m_available >= 0) {
+        memoryText += QString(" VRAM free: %1 MB").arg(megabytes(m_resources.Device().m_available));
+    }
+    QString polygonText = m_overlayModelText + QString(" Drawn: %1").arg(m_culledOnGpu ? QString("n/a") : QString::number(m_drawnTriangles));
+    if (!m_pointCloudLod.IsEmpty()) {
+        polygonText += QString(" Points: %1 of %2 in %3 nodes").arg(m_drawnPoints).arg(m_pointCloudLod.PointCount()).arg(m_pointNodes.size());
     }
 
-    // Format the text for drawing
-    const QString framerateText = QString("FPS: %1").arg(fps);
-    const QString polygonText = QString("Polys: %1").arg(polyCount);
+    const QString topLeft = framerateText + "\n" + frametimeText + "\n" + presentText + "\n" + cpuGpuText + "\n" + passText + "\n" + drawText + "\n" + cullText + "\n" + uploadText + "\n" + memoryText + "\n" + polygonText;
+
+    // Queue the text, the grid and model size go in the bottom left corner
+    const qreal retinaScale = devicePixelRatio();
+    const float padding = 4.f * retinaScale;
+    m_textRenderer.Add(topLeft, QPointF(padding, padding));
+    m_textRenderer.Add(m_overlayStaticText, QPointF(padding, height() * retinaScale - m_textRenderer.LineSpacing() * 5 - padding));
+}
+
+void ViewerGraphicsWindow::UpdateOverlayText()
+{
+    // The counts were taken when the models were loaded
+    const ModelStats& stats = m_currentModel.m_stats;
+    m_overlayModelText = QString("Polys: %1 Vertices: %2").arg(stats.m_triangles).arg(stats.m_vertices);
+    if (stats.m_degenerateTriangles > 0) {
+        m_overlayModelText += QString(" Degenerate: %1").arg(stats.m_degenerateTriangles);
+    }
     QString sizeText;
     if (m_currentModel.m_isValid) {
         QVector3D max = m_currentModel.m_AABBMax;
@@ -745,16 +2500,18 @@ void ViewerGraphicsWindow::RenderText()
             .arg(max.x() - min.x(), 0, 'f', 2)
             .arg(max.y() - min.y(), 0, 'f', 2)
             .arg(max.z() - min.z(), 0, 'f', 2);
+
+        // Models far from the origin are shown moved to it, see ModelLoader::FindOrigin
+        const std::array<double, 3>& origin = m_currentModel.m_origin;
+        if (origin != std::array<double, 3>()) {
+            sizeText += QString("\nOrigin\nX: %1\nY: %2\nZ: %3")
+                .arg(origin[0], 0, 'f', 0)
+                .arg(origin[1], 0, 'f', 0)
+                .arg(origin[2], 0, 'f', 0);
+        }
     }
     const QString gridText = QString("Grid: %1x%1").arg(m_gridScale);
-
-    const QString topLeft = framerateText + "\n" + polygonText;
-    const QString bottomLeft = gridText + "\n" + sizeText;
-
-    // Draw the text
-    const int padding = 4;
-    painter.drawText(padding, padding, 500, 500, Qt::AlignTop, topLeft);
-    painter.drawText(padding, height() - (f.lineSpacing() * 5) - padding, 500, 500, Qt::AlignTop, bottomLeft);
+    m_overlayStaticText = gridText + "\n" + sizeText;
 }
 
 void ViewerGraphicsWindow::Update(float sec)
@@ -762,45 +2519,45 @@ void ViewerGraphicsWindow::Update(float sec)
     // Allow shift and ctrl to increase/decrease speed
     float effectiveSpeed = movementSensitivity * sec;
   
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/increase_speed", "Shift").toString()).get())) {
+    if (IsActionPressed(k_increaseSpeed)) {
         effectiveSpeed *= 3.f;
     }
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/decrease_speed", "Ctrl").toString()).get())) {
+    if (IsActionPressed(k_decreaseSpeed)) {
         effectiveSpeed /= 3.f;
     }
 
     // W/S to elevate
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/elevate_forwards", QString(Qt::Key::Key_W)).toString()).get())) {
+    if (IsActionPressed(k_elevateForwards)) {
         m_transMatrix.translate(0, -effectiveSpeed, 0);
     }
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/elevate_backwards", QString(Qt::Key::Key_S)).toString()).get())) {
+    if (IsActionPressed(k_elevateBackwards)) {
         m_transMatrix.translate(0, effectiveSpeed, 0);
     }
 
     // A/D to strafe
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/strafe_left", QString(Qt::Key::Key_A)).toString()).get())) {
+    if (IsActionPressed(k_strafeLeft)) {
         m_transMatrix.translate(effectiveSpeed, 0, 0);
     }
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/strafe_right", QString(Qt::Key::Key_D)).toString()).get())) {
+    if (IsActionPressed(k_strafeRight)) {
         m_transMatrix.translate(-effectiveSpeed, 0, 0);
     }
 
     // Implement Q and E as scale instead of translate so the user cannot
     // move behind the object
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/scale_up", QString(Qt::Key::Key_E)).toString()).get())) {
+    if (IsActionPressed(k_scaleUp)) {
         m_scaleMatrix.scale(1 + (effectiveSpeed / 2.f));
     }
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/scale_down", QString(Qt::Key::Key_Q)).toString()).get())) {
+    if (IsActionPressed(k_scaleDown)) {
         m_scaleMatrix.scale(1 - (effectiveSpeed / 2.f));
     }
 
 
     // Up and down arrows to pitch
     float rotSpeed = qRadiansToDegrees(effectiveSpeed);
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/pitch_up", "Up").toString()).get())) {
+    if (IsActionPressed(k_pitchUp)) {
         rotY += rotSpeed;
     }
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/pitch_down", "Down").toString()).get())) {
+    if (IsActionPressed(k_pitchDown)) {
         rotY += -rotSpeed;
     }
 
@@ -808,12 +2565,35 @@ void ViewerGraphicsWindow::Update(float sec)
     rotY = std::max(-90.f, std::min(rotY, 90.f));
 
     // Left and right to spin
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/spin_right", "Right").toString()).get())) {
+    if (IsActionPressed(k_spinRight)) {
         rotX += -rotSpeed;
     }
-    if (m_pressedKeys.contains(KeySequenceParse(settings->value("ViewerGraphicsWindow/spin_left", "Left").toString()).get())) {
+    if (IsActionPressed(k_spinLeft)) {
         rotX += rotSpeed;
     }
+
+    // Held keys move the camera every frame
+    if (m_pressedKeys != 0) {
+        PublishRenderState();
+    }
+}
+
+quint64 ViewerGraphicsWindow::KeyBit(int key) const
+{
+    auto it = m_settings.m_keyBits.constFind(key);
+    return it == m_settings.m_keyBits.constEnd() ? 0 : quint64(1) << it.value();
+}
+
+bool ViewerGraphicsWindow::IsActionPressed(KeyAction action) const
+{
+    // Every key of the binding has to be held
+    const quint64 mask = m_settings.m_actionMasks[action];
+    return mask != 0 && (m_pressedKeys & mask) == mask;
+}
+
+bool ViewerGraphicsWindow::DrawsPoints() const
+{
+    return m_settings.m_displayMode == k_displayPoints || !m_pointCloudLod.IsEmpty();
 }
 
 void ViewerGraphicsWindow::resetView()
@@ -824,6 +2604,7 @@ void ViewerGraphicsWindow::resetView()
     rotX = 0;
     m_transMatrix = QMatrix4x4();
     m_transMatrix.translate(0, 0, -4);
+    m_orbitPivot = QVector3D();
 
     const float optimalScale = ComputeOptimalScale();
     m_scaleMatrix.scale(optimalScale);
@@ -833,6 +2614,666 @@ void ViewerGraphicsWindow::resetView()
     const float gridScale = 1.f / optimalScale;
     const float logGridScale = (int)(log10f(gridScale));
     m_gridScale = powf(10.f, logGridScale);
+    PublishRenderState();
+    update();
+    UpdateOverlayText();
+}
+
+void ViewerGraphicsWindow::DrawMesh(int meshIdx, const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, QOpenGLVertexArrayObject*& pBoundVao)
+{
+    Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+
+    // Meshes of a streamed model have no buffers until they are streamed in, see-through
+    // ones may be left to the transparency pass, and the SceneGraph may have hidden all draws
+    if (!GeometryStreamer::IsResident(mesh) || mesh.IsHidden()
+        || (m_deferTransparent && mesh.m_material && mesh.m_material->m_properties.m_alphaMode == k_alphaBlend)) {
+        return;
+    }
+    QOpenGLExtraFunctions* extraFunctions = context()->extraFunctions();
+    const qreal retinaScale = devicePixelRatio();
+    UseMeshProgram(mesh);
+    QOpenGLShaderProgram* pProgram = m_pDrawVariant->m_pProgram;
+
+    // The vertex array object holds all buffer and attribute state of the mesh
+    if (mesh.m_vao) {
+        if (pBoundVao != mesh.m_vao.data()) {
+            mesh.m_vao->bind();
+            pBoundVao = mesh.m_vao.data();
+            ++m_stateChanges;
+        }
+    }
+    else {
+        // Fall back to the default vertex array object
+        if (pBoundVao) {
+            pBoundVao->release();
+            pBoundVao = nullptr;
+        }
+        ++m_stateChanges;
+        mesh.m_vertexBuffer.bind();
+        mesh.m_indexBuffer.bind();
+        GpuModelBuilder::EnableAttributes(this, mesh);
+    }
+
+    // The mesh's material was uploaded with its model, only its buffer and maps are bound.
+    // Meshes of the same material are queued together, so those are bound once for them all.
+    const bool overridden = m_pOverrideVariant != nullptr;
+    const Material* pMaterial = mesh.m_material.data();
+    if (m_hasMaterialBlock && pMaterial && pMaterial != m_pBoundMaterial && !overridden) {
+        if (pMaterial->m_buffer.isCreated()) {
+            extraFunctions->glBindBufferBase(GL_UNIFORM_BUFFER, k_materialBlockBinding, pMaterial->m_buffer.bufferId());
+        }
+        // Bindless programs read the maps by the handles in the material block
+        const GLint units[k_materialMapCount] = { 0, UniformBlocks::k_normalMapUnit, UniformBlocks::k_metallicRoughnessMapUnit,
+            UniformBlocks::k_occlusionMapUnit, UniformBlocks::k_emissiveMapUnit };
+        for (int map = k_normalMap; map < k_materialMapCount && !m_bindlessProgram; ++map) {
+            if (pMaterial->m_maps[map]) {
+                pMaterial->m_maps[map]->bind(units[map]);
+                ++m_textureBinds;
+            }
+        }
+        m_pBoundMaterial = pMaterial;
+        ++m_stateChanges;
+    }
+
+    // Skinned meshes are posed by their own bone matrices
+    if (mesh.m_boneBuffer.isCreated()) {
+        extraFunctions->glBindBufferBase(GL_UNIFORM_BUFFER, k_bonePaletteBinding, mesh.m_boneBuffer.bufferId());
+    }
+
+    if (mesh.m_hasTexture && !overridden) {
+        // Sampler state was set when the texture was uploaded
+        QOpenGLTexture* pTexture = pMaterial->m_maps[k_baseColorMap].data();
+        if (!m_bindlessProgram && pTexture->textureId() != m_boundTexture) {
+            pTexture->bind(0);
+            m_boundTexture = pTexture->textureId();
+            ++m_textureBinds;
+            ++m_stateChanges;
+        }
+        pProgram->setUniformValue(m_pDrawVariant->m_textureUniform, 0);
+        pProgram->setUniformValue(m_pDrawVariant->m_hasTextureUniform, 1.f);
+    }
+
+    // Instances drawn one at a time each need their own matrices
+    auto SetMeshMatrices = [&](const QMatrix4x4& transform) {
+        QMatrix4x4 modelTransformed = modelMatrix * transform;
+
+        // Quantized positions are decoded by the position matrices only, the normal matrix
+        // must not include the decode scale
+        QMatrix4x4 positionTransformed = modelTransformed * mesh.m_positionDecode;
+        QMatrix4x4 modelViewProjectionMatrix;
+        modelViewProjectionMatrix = viewMatrix * positionTransformed;
+
+        pProgram->setUniformValue(m_pDrawVariant->m_matrixUniform, modelViewProjectionMatrix);
+
+        pProgram->setUniformValue(m_pDrawVariant->m_modelviewUniform, positionTransformed);
+
+        QMatrix3x3 normal = modelTransformed.normalMatrix();
+        pProgram->setUniformValue(m_pDrawVariant->m_normalUniform, normal);
+    };
+    // Everything else takes the matrices cached for the frame's view
+    auto SetCachedMatrices = [&]() {
+        pProgram->setUniformValue(m_pDrawVariant->m_matrixUniform, m_transformCache.ModelViewProjection(meshIdx));
+        pProgram->setUniformValue(m_pDrawVariant->m_modelviewUniform, m_transformCache.ModelView(meshIdx));
+        pProgram->setUniformValue(m_pDrawVariant->m_normalUniform, m_transformCache.Normal(meshIdx));
+    };
+
+    // Meshes covering few pixels are drawn from a coarser part of the index buffer
+    const MeshLod lod = m_settings.m_levelOfDetail ? SelectLod(mesh, modelMatrix, float(height() * retinaScale) * m_sceneScale) : MeshLod{ 0, mesh.m_indexCount };
+    const int drawCount = mesh.m_instanceTransforms.empty() ? 1 : int(mesh.m_instanceTransforms.size());
+
+    // Large meshes drawn in full, once, are drawn as the runs of their meshlets that can be
+    // seen. The meshlets are in the mesh's space, before its transform. Mirrored meshes wind
+    // the other way, so the cone test is left out for them.
+    const bool cullMeshlets = m_settings.m_meshletCulling != k_meshletCullingOff && !mesh.m_meshlets.empty()
+        && mesh.m_instanceTransforms.empty() && lod.m_firstIndex == 0 && !m_drawPoints;
+    int indexCount = lod.m_indexCount;
+    if (cullMeshlets) {
+        const QMatrix4x4 meshModelView = modelMatrix * mesh.m_transform;
+        const QVector3D camera = meshModelView.inverted().map(QVector3D(0, 0, 0));
+        // Marking section caps counts the back faces too
+        const bool cullBackFaces = m_settings.m_meshletCulling == k_meshletCullingBackFaces && meshModelView.determinant() > 0.0 && !m_markingSections;
+        Meshlets::VisibleRuns(mesh.m_meshlets, SectionFrustum(viewMatrix * meshModelView, mesh.m_transform), cullBackFaces ? &camera : nullptr, m_meshletRuns);
+        indexCount = 0;
+        for (const std::pair<int, int>& run : m_meshletRuns) {
+            indexCount += run.second;
+        }
+    }
+    if (!overridden) {
+        m_drawnTriangles += qint64(indexCount / 3) * (drawCount - mesh.m_hiddenDrawCount);
+    }
+
+    // Points take every vertex once at full detail, coarser levels only the vertices their
+    // triangles use
+    auto Draw = [&](int instanceCount) {
+        if (cullMeshlets) {
+            for (const std::pair<int, int>& run : m_meshletRuns) {
+                GpuModelBuilder::DrawElements(extraFunctions, mesh, run.first, run.second, instanceCount);
+                ++m_drawCalls;
+            }
+            return;
+        }
+        if (!m_drawPoints) {
+            GpuModelBuilder::DrawElements(extraFunctions, mesh, lod.m_firstIndex, lod.m_indexCount, instanceCount);
+        }
+        else if (lod.m_firstIndex == 0 && mesh.m_vertexCount > 0) {
+            GpuModelBuilder::DrawPoints(extraFunctions, mesh, instanceCount);
+        }
+        else {
+            GpuModelBuilder::DrawElements(extraFunctions, mesh, lod.m_firstIndex, lod.m_indexCount, instanceCount, GL_POINTS);
+        }
+        ++m_drawCalls;
+    };
+
+    if (mesh.m_instanced && m_pDrawVariant->m_instanceAttr != -1) {
+        // The instance attribute applies each instance's transform in the shader. With some
+        // instances hidden, each run of shown ones is drawn with the attribute moved to it.
+        SetCachedMatrices();
+        if (mesh.m_hiddenDrawCount == 0) {
+            Draw(int(mesh.m_instanceTransforms.size()));
+        }
+        else {
+            GpuModelBuilder::VisibleRuns(mesh, m_instanceRuns);
+            for (const std::pair<int, int>& run : m_instanceRuns) {
+                GpuModelBuilder::SetFirstInstance(extraFunctions, mesh, run.first);
+                Draw(run.second);
+            }
+            GpuModelBuilder::SetFirstInstance(extraFunctions, mesh, 0);
+        }
+    }
+    else if (!mesh.m_instanceTransforms.empty()) {
+        // The shader cannot draw instances, draw the shown ones one at a time
+        GpuModelBuilder::VisibleRuns(mesh, m_instanceRuns);
+        for (const std::pair<int, int>& run : m_instanceRuns) {
+            for (int i = run.first; i < run.first + run.second; ++i) {
+                SetMeshMatrices(mesh.m_instanceTransforms[i]);
+                Draw(0);
+            }
+        }
+    }
+    else {
+        SetCachedMatrices();
+        Draw(0);
+    }
+
+    if (!mesh.m_vao) {
+        GpuModelBuilder::DisableAttributes(this, mesh);
+        mesh.m_vertexBuffer.release();
+        mesh.m_indexBuffer.release();
+    }
+}
+
+bool ViewerGraphicsWindow::DrawSplitViews(const RenderState& frame, const QVector3D& lightPos, bool alphaToCoverage)
+{
+    StateCache& state = StateCache::Current();
+    const QSize nativeSize = frame.m_nativeSize;
+    const int count = int(std::min(frame.m_viewportModels.size(), m_splitViewports.size()));
+
+    // Every view is culled and sorted, on worker threads, before the first one is drawn
+    m_splitViews.resize(size_t(count));
+    for (int i = 0; i < count; ++i) {
+        SplitView::View& view = m_splitViews[i];
+        const SplitViewport& viewport = m_splitViewports[i];
+        view.m_projection = frame.m_viewportProjection;
+        view.m_model = frame.m_viewportModels[i];
+        view.m_permuted = !viewport.m_pProgram && m_hasFrameBlock && m_hasMaterialBlock && m_shaderPermutations.IsActive();
+        view.m_bindless = viewport.m_pProgram ? viewport.m_bindless : m_bindlessProgram;
+    }
+    bool streaming = false;
+    if (m_currentModel.m_isValid) {
+        SplitView::Gather(m_currentModel, m_meshBvh, m_shaderPermutations, m_sectionPlanes, m_splitViews);
+        for (const SplitView::View& view : m_splitViews) {
+            m_visibleMeshes += int(view.m_visible.size());
+            m_culledMeshes += int(m_currentModel.m_meshes.size() - view.m_visible.size());
+        }
+        m_occludedMeshes = 0;
+
+        // A streamed model uploads the meshes any of the views shows
+        if (m_currentModel.m_streamer) {
+            for (const SplitView::View& view : m_splitViews) {
+                for (int meshIdx : view.m_visible) {
+                    const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+                    const QVector3D center = view.m_model.map((mesh.m_AABBMin + mesh.m_AABBMax) * 0.5f);
+                    const float radius = view.m_model.mapVector((mesh.m_AABBMax - mesh.m_AABBMin) * 0.5f).length();
+                    m_currentModel.m_streamer->Request(meshIdx, radius / std::max(-center.z(), frame.m_nearPlane));
+                }
+            }
+            streaming = m_currentModel.m_streamer->Update(m_currentModel) || !m_currentModel.m_streamer->IsComplete();
+            if (streaming) {
+                m_sceneChanged = true;
+                m_shadowMapper.Invalidate();
+            }
+        }
+    }
+
+    // The viewports with programs of their own draw with that, as if it were the model program
+    const bool bindlessProgram = m_bindlessProgram;
+    const bool hasMaterialBlock = m_hasMaterialBlock;
+    if (alphaToCoverage) {
+        state.Enable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+        state.Enable(GL_SAMPLE_ALPHA_TO_ONE);
+    }
+    for (int i = 0; i < count; ++i) {
+        const SplitView::View& view = m_splitViews[i];
+        SplitViewport& viewport = m_splitViewports[i];
+
+        // Cells are laid out from the top, OpenGL counts rows from the bottom
+        const QRect cell = SplitView::Cell(nativeSize, count, i);
+        state.Viewport(cell.x(), nativeSize.height() - cell.y() - cell.height(), cell.width(), cell.height());
+
+        RenderState viewFrame = frame;
+        viewFrame.m_projection = view.m_projection;
+        viewFrame.m_model = view.m_model;
+        UpdateFrameBlock(viewFrame, view.m_projection, view.m_model, lightPos, alphaToCoverage, false);
+        m_environment.Bind(view.m_model, m_settings.m_environmentIntensity, m_streamBuffer);
+        m_transformCache.SetView(view.m_projection, view.m_model);
+
+        if (m_currentModel.m_isValid) {
+            if (viewport.m_pProgram) {
+                viewport.m_pProgram->bind();
+                viewport.m_interface.Upload(viewport.m_pProgram, viewFrame, lightPos);
+                m_pViewportVariant = &viewport.m_variant;
+                m_bindlessProgram = viewport.m_bindless;
+                m_hasMaterialBlock = viewport.m_hasMaterialBlock;
+            }
+            else {
+                m_program->bind();
+                setUniformVars(viewFrame, lightPos);
+            }
+            m_pDrawVariant = viewport.m_pProgram ? &viewport.m_variant : &m_baseVariant;
+            m_pBoundMaterial = nullptr;
+            ++m_programBinds;
+
+            QOpenGLVertexArrayObject* pBoundVao = nullptr;
+            EnableSectionPlanes(viewport.m_pProgram ? viewport.m_sectionClipping : m_sectionClipping);
+            for (int meshIdx : view.m_queue.Meshes()) {
+                DrawMesh(meshIdx, view.m_projection, view.m_model, pBoundVao);
+            }
+            EnableSectionPlanes(false);
+            if (pBoundVao) {
+                pBoundVao->release();
+            }
+            m_pDrawVariant->m_pProgram->release();
+            m_pViewportVariant = nullptr;
+            m_bindlessProgram = bindlessProgram;
+            m_hasMaterialBlock = hasMaterialBlock;
+        }
+        if (m_settings.m_showGrid) {
+            RenderGrid(view.m_projection * view.m_model);
+        }
+    }
+    if (alphaToCoverage) {
+        state.Disable(GL_SAMPLE_ALPHA_TO_COVERAGE);
+        state.Disable(GL_SAMPLE_ALPHA_TO_ONE);
+    }
+
+    // The passes after this one draw over the whole window with the model program bound
+    state.Viewport(0, 0, nativeSize.width(), nativeSize.height());
+    m_pDrawVariant = &m_baseVariant;
+    m_program->bind();
+    return streaming;
+}
+
+void ViewerGraphicsWindow::DrawTransparent(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, const QSize& nativeSize)
+{
+    // The meshes in view are drawn with the model's own programs, which write the weighted
+    // color and alpha of blended materials to the pass' two targets
+    const qint64 transparencyBytes = m_transparencyPass.Bytes();
+    const QSize sceneSize(qRound(nativeSize.width() * m_sceneScale), qRound(nativeSize.height() * m_sceneScale));
+    m_transparencyPass.Begin(m_sceneFramebuffer, nativeSize, sceneSize);
+    if (m_transparencyPass.Bytes() != transparencyBytes) {
+        UpdateUploadedBytes();
+    }
+
+    const Frustum frustum = SectionFrustum(viewMatrix * modelMatrix);
+    QOpenGLVertexArrayObject* pBoundVao = nullptr;
+    m_program->bind();
+    m_pDrawVariant = &m_baseVariant;
+    m_pBoundMaterial = nullptr;
+    m_boundTexture = 0;
+    EnableSectionPlanes(m_sectionClipping);
+    for (int meshIdx : m_transparentMeshes) {
+        const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        if (frustum.Intersects(mesh.m_AABBMin, mesh.m_AABBMax)) {
+            DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+        }
+    }
+    EnableSectionPlanes(false);
+    if (pBoundVao) {
+        pBoundVao->release();
+    }
+    m_pDrawVariant->m_pProgram->release();
+
+    // The composite binds textures of its own
+    m_transparencyPass.End(m_sceneFramebuffer);
+    m_boundTexture = 0;
+    ++m_drawCalls;
+}
+
+void ViewerGraphicsWindow::DrawAmbientOcclusion(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, const QSize& nativeSize)
+{
+    const qint64 occlusionBytes = m_ambientOcclusion.Bytes();
+    const QSize sceneSize(qRound(nativeSize.width() * m_sceneScale), qRound(nativeSize.height() * m_sceneScale));
+    // The last frame of a poster is another part of the view, and can't be reprojected
+    AmbientOcclusion::Options options = m_settings.m_ambientOcclusion;
+    options.m_temporal = options.m_temporal && !m_posterRenderer.NeedsTile();
+    m_ambientOcclusion.BeginPrepass(nativeSize, sceneSize, options);
+    if (m_ambientOcclusion.Bytes() != occlusionBytes) {
+        UpdateUploadedBytes();
+    }
+
+    // Every mesh in view but the see-through ones is drawn with the variant for its features
+    m_meshBvh.CollectVisible(SectionFrustum(viewMatrix * modelMatrix), m_visibleMeshIndices);
+    QOpenGLVertexArrayObject* pBoundVao = nullptr;
+    m_pDrawVariant = nullptr;
+    m_deferTransparent = true;
+    EnableSectionPlanes(m_sectionClipping);
+    for (int meshIdx : m_visibleMeshIndices) {
+        m_pOverrideVariant = m_shaderPermutations.DepthNormals(m_shaderPermutations.FeatureMask(m_currentModel.m_meshes[meshIdx]));
+        if (m_pOverrideVariant) {
+            DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+        }
+    }
+    EnableSectionPlanes(false);
+    m_pOverrideVariant = nullptr;
+    m_deferTransparent = false;
+    if (pBoundVao) {
+        pBoundVao->release();
+    }
+    if (m_pDrawVariant) {
+        m_pDrawVariant->m_pProgram->release();
+    }
+
+    // Points are tested up to a small part of the model's size away
+    const float modelScale = modelMatrix.column(0).toVector3D().length();
+    const float radius = (m_currentModel.m_AABBMax - m_currentModel.m_AABBMin).length() * modelScale * k_occlusionRadius;
+    m_ambientOcclusion.Compute(m_sceneFramebuffer, viewMatrix, modelMatrix, radius);
+    m_boundTexture = 0;
+    m_drawCalls += 2;
+}
+
+void ViewerGraphicsWindow::DrawOcclusionCulled(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, QOpenGLVertexArrayObject*& pBoundVao)
+{
+    StateCache& state = StateCache::Current();
+    m_occlusionCuller.BeginFrame(int(m_currentModel.m_meshes.size()));
+    const float nearDistance = m_renderState.m_nearPlane;
+
+    // Meshes off screen are visible as soon as they come into view, their AABBs are only
+    // tested once they are on screen
+    size_t next = 0;
+    for (int i = 0; i < int(m_currentModel.m_meshes.size()); ++i) {
+        if (next < m_visibleMeshIndices.size() && m_visibleMeshIndices[next] == i) {
+            ++next;
+        }
+        else {
+            m_occlusionCuller.SetVisible(i);
+        }
+    }
+
+    // Draw the largest of the meshes seen last frame into the depth buffer first, so the
+    // surfaces behind them fail the depth test before they are shaded
+    m_occluders.clear();
+    m_occludedMeshes = 0;
+    for (int meshIdx : m_visibleMeshIndices) {
+        if (!m_occlusionCuller.WasVisible(meshIdx)) {
+            ++m_occludedMeshes;
+            continue;
+        }
+        const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        const QVector3D center = modelMatrix.map((mesh.m_AABBMin + mesh.m_AABBMax) * 0.5f);
+        const float radius = modelMatrix.mapVector((mesh.m_AABBMax - mesh.m_AABBMin) * 0.5f).length();
+        const float distance = std::max(-center.z(), nearDistance);
+        m_occluders.push_back({ radius / distance, meshIdx });
+    }
+    const size_t occluderCount = std::min(m_occluders.size(), size_t(k_occluderCount));
+    std::partial_sort(m_occluders.begin(), m_occluders.begin() + occluderCount, m_occluders.end(), std::greater<std::pair<float, int>>());
+    // The occluders are drawn again below, where they are counted
+    const int drawCalls = m_drawCalls;
+    const qint64 drawnTriangles = m_drawnTriangles;
+    state.ColorMask(false);
+    for (size_t i = 0; i < occluderCount; ++i) {
+        DrawMesh(m_occluders[i].second, viewMatrix, modelMatrix, pBoundVao);
+    }
+    state.ColorMask(true);
+    m_drawCalls = drawCalls;
+    m_drawnTriangles = drawnTriangles;
+
+    // Then draw everything seen last frame, the occluders again where their depth matches
+    state.DepthFunc(GL_LEQUAL);
+    for (int meshIdx : m_visibleMeshIndices) {
+        if (m_occlusionCuller.WasVisible(meshIdx)) {
+            DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+        }
+    }
+    state.DepthFunc(GL_LESS);
+
+    // Test the AABBs of all meshes in view against the finished depth buffer, without
+    // writing anything. The AABB of a drawn mesh encloses it, so it passes wherever the mesh
+    // can be seen. Boxes the camera is inside of would be clipped by the near plane and
+    // count as visible without a test.
+    if (pBoundVao) {
+        pBoundVao->release();
+        pBoundVao = nullptr;
+    }
+    m_program->release();
+    EnableSectionPlanes(false);
+    m_flatShader->bind();
+    state.ColorMask(false);
+    state.DepthMask(false);
+    state.DepthFunc(GL_LEQUAL);
+    glVertexAttribPointer(m_flatShaderPosAttr, 3, GL_FLOAT, GL_FALSE, 0, k_unitCube);
+    glEnableVertexAttribArray(m_flatShaderPosAttr);
+
+    const QMatrix4x4 modelInverse = modelMatrix.inverted();
+    const QVector3D camera = modelInverse.map(QVector3D(0, 0, 0));
+    const float margin = modelInverse.mapVector(QVector3D(nearDistance, nearDistance, nearDistance)).length();
+    for (int meshIdx : m_visibleMeshIndices) {
+        const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        const QVector3D min = mesh.m_AABBMin - QVector3D(margin, margin, margin);
+        const QVector3D max = mesh.m_AABBMax + QVector3D(margin, margin, margin);
+        if (camera.x() >= min.x() && camera.y() >= min.y() && camera.z() >= min.z()
+            && camera.x() <= max.x() && camera.y() <= max.y() && camera.z() <= max.z()) {
+            m_occlusionCuller.SetVisible(meshIdx);
+            continue;
+        }
+
+        // Grown a little so boxes of flat meshes are not hidden by the mesh itself
+        const QVector3D extent = mesh.m_AABBMax - mesh.m_AABBMin;
+        const float padding = 0.01f * std::max(extent.x(), std::max(extent.y(), extent.z()));
+        QMatrix4x4 box = viewMatrix * modelMatrix;
+        box.translate(mesh.m_AABBMin - QVector3D(padding, padding, padding));
+        box.scale(extent + 2.f * QVector3D(padding, padding, padding));
+        m_flatShader->setUniformValue(m_flatShaderMatrixAttr, box);
+        m_occlusionCuller.BeginQuery(meshIdx);
+        glDrawArrays(GL_TRIANGLES, 0, k_unitCubeVertexCount);
+        m_occlusionCuller.EndQuery();
+        ++m_drawCalls;
+    }
+
+    glDisableVertexAttribArray(m_flatShaderPosAttr);
+    state.DepthFunc(GL_LESS);
+    state.DepthMask(true);
+    state.ColorMask(true);
+    m_flatShader->release();
+    m_program->bind();
+    m_pDrawVariant = &m_baseVariant;
+    EnableSectionPlanes(m_sectionClipping);
+}
+
+Frustum ViewerGraphicsWindow::SectionFrustum(const QMatrix4x4& viewProjection, const QMatrix4x4& meshTransform) const
+{
+    QVector4D planes[Frustum::k_maxExtraPlanes];
+    const int count = int(m_sectionPlanes.size());
+    for (int i = 0; i < count; ++i) {
+        planes[i] = m_sectionPlanes[i] * meshTransform;
+    }
+    return Frustum(viewProjection, planes, count);
+}
+
+void ViewerGraphicsWindow::EnableSectionPlanes(bool enable)
+{
+    StateCache& state = StateCache::Current();
+    for (int i = 0; i < Frustum::k_maxExtraPlanes; ++i) {
+        state.SetEnabled(GL_CLIP_DISTANCE0 + i, enable && i < int(m_sectionPlanes.size()));
+    }
+}
+
+void ViewerGraphicsWindow::DrawSectionCaps(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, QOpenGLVertexArrayObject*& pBoundVao)
+{
+    if (m_sectionPlanes.empty() || !m_fillSections || !m_sectionClipping || !m_sectionCaps.IsCreated()
+        || !m_hasFrameBlock || !m_shaderPermutations.IsActive()) {
+        return;
+    }
+    if (m_culledOnGpu) {
+        m_meshBvh.CollectVisible(SectionFrustum(viewMatrix * modelMatrix), m_visibleMeshIndices);
+    }
+
+    // Each plane marks the insides of the meshes it crosses and fills them, before the next
+    // plane clears the marks. Transparent meshes are left open.
+    if (pBoundVao) {
+        pBoundVao->release();
+        pBoundVao = nullptr;
+    }
+    m_pDrawVariant->m_pProgram->release();
+    m_deferTransparent = true;
+    m_markingSections = true;
+    for (int i = 0; i < int(m_sectionPlanes.size()); ++i) {
+        m_sectionCaps.BeginMarking();
+        m_pDrawVariant = nullptr;
+        for (int meshIdx : m_visibleMeshIndices) {
+            const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+            m_pOverrideVariant = SectionCaps::Crosses(m_sectionPlanes[i], mesh.m_AABBMin, mesh.m_AABBMax)
+                ? m_shaderPermutations.DepthNormals(m_shaderPermutations.FeatureMask(mesh)) : nullptr;
+            if (m_pOverrideVariant) {
+                DrawMesh(meshIdx, viewMatrix, modelMatrix, pBoundVao);
+            }
+        }
+        m_pOverrideVariant = nullptr;
+        if (pBoundVao) {
+            pBoundVao->release();
+            pBoundVao = nullptr;
+        }
+        if (m_pDrawVariant) {
+            m_pDrawVariant->m_pProgram->release();
+        }
+        m_drawCalls += m_sectionCaps.DrawCap(m_sectionPlanes, i, m_currentModel.m_AABBMin, m_currentModel.m_AABBMax, viewMatrix, modelMatrix, QColor(190, 70, 60));
+    }
+    m_markingSections = false;
+    m_deferTransparent = false;
+    m_program->bind();
+    m_pDrawVariant = &m_baseVariant;
+    m_pBoundMaterial = nullptr;
+}
+
+void ViewerGraphicsWindow::PickMesh(const QMatrix4x4& viewProjection, const QSize& viewport)
+{
+    m_pickRequested = false;
+    if (!m_currentModel.m_isValid) {
+        ApplyPick(MeshPicker::Hit());
+        return;
+    }
+
+    // Only the meshes whose AABB reaches into the frustum of the pixel can cover it
+    if (m_meshPicker.IsCreated()) {
+        const QMatrix4x4 pixelViewProjection = MeshPicker::PixelProjection(viewport, m_pickPixel) * viewProjection;
+        m_meshBvh.CollectVisible(SectionFrustum(pixelViewProjection), m_pickCandidates);
+        m_pickCandidates.erase(std::remove_if(m_pickCandidates.begin(), m_pickCandidates.end(), [this](int meshIdx) {
+            return !GeometryStreamer::IsResident(m_currentModel.m_meshes[meshIdx]);
+        }), m_pickCandidates.end());
+        if (m_pickCandidates.empty()) {
+            ApplyPick(MeshPicker::Hit());
+            return;
+        }
+        m_meshPicker.Pick(m_currentModel, m_pickCandidates, viewProjection, viewport, m_pickPixel, m_sceneFramebuffer, m_sectionPlanes);
+        return;
+    }
+
+    // Without the picking framebuffer the ray through the pixel is cast against the AABBs,
+    // which finds the mesh but not the triangle
+    const QPointF center = QPointF(m_pickPixel) + QPointF(0.5, 0.5);
+    const QVector3D nearPoint = MeshPicker::Unproject(viewProjection, viewport, center, 0.f);
+    const QVector3D farPoint = MeshPicker::Unproject(viewProjection, viewport, center, 1.f);
+    MeshPicker::Hit hit;
+    float distance = 0.f;
+    hit.m_mesh = m_meshBvh.Raycast(nearPoint, farPoint - nearPoint, &distance);
+    hit.m_point = nearPoint + (farPoint - nearPoint) * distance;
+    ApplyPick(hit);
+}
+
+void ViewerGraphicsWindow::DrawPageFeedback(const QMatrix4x4& viewProjection, const QSize& viewport)
+{
+    if (!m_currentModel.m_isValid) {
+        return;
+    }
+
+    // Meshes out of view need no pages, and those not streamed in yet have nothing to draw
+    m_meshBvh.CollectVisible(SectionFrustum(viewProjection), m_feedbackMeshes);
+    m_feedbackMeshes.erase(std::remove_if(m_feedbackMeshes.begin(), m_feedbackMeshes.end(), [this](int meshIdx) {
+        return !GeometryStreamer::IsResident(m_currentModel.m_meshes[meshIdx]);
+    }), m_feedbackMeshes.end());
+    m_virtualTextures.DrawFeedback(m_currentModel, m_feedbackMeshes, viewProjection, viewport, m_sceneFramebuffer, m_sectionPlanes);
+}
+
+void ViewerGraphicsWindow::ApplyPick(const MeshPicker::Hit& hit)
+{
+    // Clicking the background clears the selection but keeps the pivot
+    const bool valid = hit.m_mesh >= 0 && hit.m_mesh < int(m_currentModel.m_meshes.size());
+    m_selectedMesh = valid ? hit.m_mesh : -1;
+    m_selectedTriangle = valid ? hit.m_triangle : -1;
+    if (valid) {
+        SetOrbitPivot(hit.m_point);
+    }
+}
+
+void ViewerGraphicsWindow::RenderSelection()
+{
+    const Mesh& mesh = m_currentModel.m_meshes[m_selectedMesh];
+    const int instanceCount = mesh.m_instanceTransforms.empty() ? 1 : int(mesh.m_instanceTransforms.size());
+
+    QString text = QString("Selected: %1").arg(mesh.m_name.isEmpty() ? QString("Mesh %1").arg(m_selectedMesh) : mesh.m_name);
+    text += QString("\nTriangles: %1").arg(mesh.m_indexCount / 3);
+    if (instanceCount > 1) {
+        text += QString(" x %1 instances").arg(instanceCount);
+    }
+    if (m_selectedTriangle >= 0) {
+        text += QString("\nTriangle: %1").arg(m_selectedTriangle);
+    }
+    const QString materialName = mesh.m_material ? mesh.m_material->m_name : QString();
+    text += QString("\nMaterial: %1").arg(materialName.isEmpty() ? QString("none") : materialName);
+
+    // Top right, out of the way of the stats
+    const qreal retinaScale = devicePixelRatio();
+    const float padding = 4.f * retinaScale;
+    m_textRenderer.Add(text, QPointF(width() * retinaScale - padding, padding), true);
+}
+
+MeshLod ViewerGraphicsWindow::SelectLod(const Mesh& mesh, const QMatrix4x4& modelMatrix, float viewportHeight) const
+{
+    const MeshLod full = { 0, mesh.m_indexCount };
+    if (mesh.m_lods.empty()) {
+        return full;
+    }
+
+    // Bounding sphere of the mesh in view space, the AABB already covers all instances
+    const QVector3D center = modelMatrix.map((mesh.m_AABBMin + mesh.m_AABBMax) * 0.5f);
+    const float radius = modelMatrix.mapVector((mesh.m_AABBMax - mesh.m_AABBMin) * 0.5f).length();
+    const float distance = -center.z();
+    if (distance <= radius) {
+        return full;
+    }
+
+    // Area the sphere covers on screen, and the triangles that can be made out on it
+    const float projectedRadius = radius / (distance * qTan(qDegreesToRadians(fieldOfView) * 0.5f)) * viewportHeight * 0.5f;
+    const float budget = float(M_PI) * projectedRadius * projectedRadius / k_lodPixelsPerTriangle;
+    const float drawCount = mesh.m_instanceTransforms.empty() ? 1.f : float(mesh.m_instanceTransforms.size());
+
+    MeshLod ret = full;
+    for (const MeshLod& lod : mesh.m_lods) {
+        if (float(ret.m_indexCount / 3) * drawCount <= budget) {
+            break;
+        }
+        ret = lod;
+    }
+    return ret;
 }
 
 float ViewerGraphicsWindow::ComputeOptimalScale() {
@@ -843,7 +3284,7 @@ float ViewerGraphicsWindow::ComputeOptimalScale() {
         const float effectiveFOV = std::min(fieldOfView, fieldOfView * float(width()) / float(height()));
 
         // Compute optimal viewing distance as modelSize / atan(fov)
-        const float modelSize = std::max(m_currentModel.m_AABBMax.length(), m_currentModel.m_AABBMin.length());
+        const float modelSize = std::max(m_meshBvh.Max().length(), m_meshBvh.Min().length());
         const float optimalViewingDistance = modelSize / qAtan(qDegreesToRadians(effectiveFOV)) * 1.6f;
 
         // Scale the world so 4 looks like optimalViewingDistance
@@ -854,9 +3295,39 @@ float ViewerGraphicsWindow::ComputeOptimalScale() {
 
 bool ViewerGraphicsWindow::addPrimitive(QString primitiveName) 
 {
-    // Load  model
+    // Set the primitive beside the models already shown
     QString filepath = QString("../Data/Primitives/%1").arg(primitiveName);
-    return loadModel(filepath);
+    return addModel(filepath);
+}
+
+bool ViewerGraphicsWindow::addPrimitive(PrimitiveShape shape)
+{
+    if (!initialized || m_currentModel.m_streamer) {
+        return false;
+    }
+
+    // Each shape is uploaded once per tessellation, every copy of it in the scene draws from
+    // the same buffers. The buffers are its own, a primitive is far smaller than an arena page.
+    const int tessellation = qBound(Primitives::k_minTessellation,
+        settings->value("ViewerGraphicsWindow/primitiveTessellation", Primitives::k_defaultTessellation).toInt(), Primitives::k_maxTessellation);
+    const QPair<int, int> key(int(shape), tessellation);
+    makeCurrent();
+    auto it = m_primitiveModels.find(key);
+    if (it == m_primitiveModels.end()) {
+        const ModelData& data = Primitives::Cached(shape, tessellation);
+        Model model;
+        model.m_materials = GpuModelBuilder::BuildMaterials(data, m_textureCache);
+        model.m_meshes.reserve(data.m_meshes.size());
+        for (const MeshData& mesh : data.m_meshes) {
+            model.m_meshes.emplace_back(GpuModelBuilder::BuildMesh(mesh, model.m_materials));
+        }
+        model.m_stats = ModelStats::Compute(data);
+        model.Finalize();
+        it = m_primitiveModels.insert(key, model);
+    }
+    AddSceneModel(*it, Primitives::Name(shape));
+    resetView();
+    return true;
 }
 
 
@@ -912,38 +3383,210 @@ void ViewerGraphicsWindow::colorRainbowChanged(int val)
     {
         setADColor(0.0 + ((color - (temp * 4)) * 6.0), 0.0, 1.0);
     }
-    else if (color < temp * 6.0)
-    {
-        setADColor(1.0, 0.0, 1.0 - ((color - (temp * 5)) * 6.0));
+    else if (color < temp * 6.0)
+    {
+        setADColor(1.0, 0.0, 1.0 - ((color - (temp * 5)) * 6.0));
+    }
+}
+
+void ViewerGraphicsWindow::colorRChanged64(double val)
+{
+    //TO DO
+}
+
+void ViewerGraphicsWindow::colorGChanged64(double val)
+{
+    //TO DO
+}
+void ViewerGraphicsWindow::colorBChanged64(double val)
+{
+    //TO DO
+}
+void ViewerGraphicsWindow::lightingSwitch(bool val)
+{
+    //TO DO, maybe ...
+}
+
+void ViewerGraphicsWindow::smoothingSwitch(bool val)
+{
+    // Only the normals in the vertex buffers change. The indirect renderer keeps copies of
+    // the vertices, so its batches are built again.
+    m_smoothNormals = val;
+    makeCurrent();
+    ApplySmoothing();
+    m_indirectRenderer.Clear();
+    doneCurrent();
+    RedrawScene();
+}
+
+void ViewerGraphicsWindow::flatShadingSwitch(bool val)
+{
+    // The shader takes the normals from the triangles, nothing is uploaded
+    m_flatShading = val;
+    RedrawScene();
+}
+
+void ViewerGraphicsWindow::ApplySmoothing()
+{
+    // Streamed meshes are uploaded again with the normals they were loaded with whenever
+    // they come back into view, so they are left as loaded
+    if (m_currentModel.m_streamer) {
+        return;
+    }
+    for (Mesh& mesh : m_currentModel.m_meshes) {
+        GpuModelBuilder::SmoothNormals(mesh, m_smoothNormals);
     }
 }
 
-void ViewerGraphicsWindow::colorRChanged64(double val)
+void ViewerGraphicsWindow::ResetSceneGraph()
 {
-    //TO DO
+    // A new primary model starts at rest. The meshes are composed at rest, so the changes made
+    // to the one shown so far are placed on them again.
+    const Model* pPrimary = m_scene.IsEmpty() ? nullptr : &m_scene.Entries().front().m_model;
+    const QSharedPointer<const SceneGraph> rest = pPrimary ? pPrimary->m_sceneGraph : QSharedPointer<const SceneGraph>();
+    if (rest != m_restSceneGraph) {
+        m_restSceneGraph = rest;
+        m_sceneGraph = rest ? *rest : SceneGraph();
+    }
+
+    // The meshes of the primary model come first in the composed model. Skinned meshes and
+    // merged batches aren't placed by a node of their own.
+    const int nodeCount = m_sceneGraph.NodeCount();
+    const int meshCount = pPrimary ? int(std::min(pPrimary->m_meshes.size(), m_currentModel.m_meshes.size())) : 0;
+    auto Placed = [nodeCount](const Mesh& mesh) {
+        return !mesh.m_hasBones && mesh.m_nodes.size() == std::max<size_t>(1, mesh.m_instanceTransforms.size())
+            && std::all_of(mesh.m_nodes.begin(), mesh.m_nodes.end(), [nodeCount](int node) { return node >= 0 && node < nodeCount; });
+    };
+    m_nodeDrawStart.assign(size_t(nodeCount) + 1, 0);
+    for (int meshIdx = 0; meshIdx < meshCount; ++meshIdx) {
+        const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        if (Placed(mesh)) {
+            for (int node : mesh.m_nodes) {
+                ++m_nodeDrawStart[node + 1];
+            }
+        }
+    }
+    std::partial_sum(m_nodeDrawStart.begin(), m_nodeDrawStart.end(), m_nodeDrawStart.begin());
+    m_nodeDraws.resize(size_t(m_nodeDrawStart.back()));
+    std::vector<int> next(m_nodeDrawStart.begin(), m_nodeDrawStart.end() - 1);
+    for (int meshIdx = 0; meshIdx < meshCount; ++meshIdx) {
+        const Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        if (Placed(mesh)) {
+            for (size_t i = 0; i < mesh.m_nodes.size(); ++i) {
+                m_nodeDraws[next[mesh.m_nodes[i]]++] = { meshIdx, mesh.m_instanceTransforms.empty() ? -1 : int(i) };
+            }
+        }
+    }
+
+    if (m_sceneGraph.IsEdited()) {
+        m_sceneGraph.Invalidate();
+        PlaceSceneNodes();
+        ShowSceneNodes();
+    }
 }
 
-void ViewerGraphicsWindow::colorGChanged64(double val)
+void ViewerGraphicsWindow::PlaceSceneNodes()
 {
-    //TO DO
+    // Only the draws of the nodes in the moved runs are placed again
+    m_placedMeshes.clear();
+    for (const NodeRange& range : m_sceneGraph.UpdateTransforms()) {
+        for (int node = range.m_first; node < range.m_end; ++node) {
+            const QMatrix4x4& world = m_sceneGraph.Node(node).m_world;
+            for (int i = m_nodeDrawStart[node]; i < m_nodeDrawStart[node + 1]; ++i) {
+                const NodeDraw& draw = m_nodeDraws[i];
+                Mesh& mesh = m_currentModel.m_meshes[draw.m_mesh];
+                if (draw.m_instance < 0) {
+                    mesh.m_transform = mesh.m_placement * world;
+                }
+                else {
+                    mesh.m_instanceTransforms[draw.m_instance] = mesh.m_placement * world;
+                    GpuModelBuilder::UploadInstanceTransform(mesh, draw.m_instance, world);
+                }
+                m_placedMeshes.push_back(draw.m_mesh);
+            }
+        }
+    }
+    if (m_placedMeshes.empty()) {
+        return;
+    }
+
+    // The bounds of a mesh take in all its draws, hidden ones too, so showing one again
+    // leaves them as they are
+    std::sort(m_placedMeshes.begin(), m_placedMeshes.end());
+    m_placedMeshes.erase(std::unique(m_placedMeshes.begin(), m_placedMeshes.end()), m_placedMeshes.end());
+    for (int meshIdx : m_placedMeshes) {
+        Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+        mesh.m_AABBMin = QVector3D(FLT_MAX, FLT_MAX, FLT_MAX);
+        mesh.m_AABBMax = QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+        for (size_t i = 0; i < mesh.m_nodes.size(); ++i) {
+            const QMatrix4x4& transform = mesh.m_instanceTransforms.empty() ? mesh.m_transform : mesh.m_instanceTransforms[i];
+            Model::AddTransformedAABB(transform, mesh.m_localAABBMin, mesh.m_localAABBMax, mesh.m_AABBMin, mesh.m_AABBMax);
+        }
+        m_transformCache.UpdateMesh(meshIdx, mesh);
+    }
+    m_meshBvh.Refit(m_currentModel);
+
+    // The multi-draw path copied the matrices and bounds of every mesh
+    if (m_indirectRenderer.IsBuilt()) {
+        m_indirectRenderer.Clear();
+        UpdateUploadedBytes();
+    }
+    m_shadowMapper.Invalidate();
 }
-void ViewerGraphicsWindow::colorBChanged64(double val)
+
+void ViewerGraphicsWindow::ShowSceneNodes()
 {
-    //TO DO
+    // Showing and hiding only flips bits: the draw's in its mesh, which every pass skips, the
+    // mesh's in the hierarchy once all or none of its draws are hidden, and the instance's in
+    // the multi-draw path. No matrix, bound or buffer is touched.
+    bool changed = false;
+    for (const NodeRange& range : m_sceneGraph.UpdateVisibility()) {
+        for (int node = range.m_first; node < range.m_end; ++node) {
+            const bool hidden = !m_sceneGraph.IsVisible(node);
+            for (int i = m_nodeDrawStart[node]; i < m_nodeDrawStart[node + 1]; ++i) {
+                const NodeDraw& draw = m_nodeDraws[i];
+                Mesh& mesh = m_currentModel.m_meshes[draw.m_mesh];
+                const int drawIdx = std::max(draw.m_instance, 0);
+                const bool wasHidden = mesh.IsHidden();
+                if (!GpuModelBuilder::SetDrawHidden(mesh, drawIdx, hidden)) {
+                    continue;
+                }
+                m_indirectRenderer.SetHidden(draw.m_mesh, drawIdx, hidden);
+                if (mesh.IsHidden() != wasHidden) {
+                    m_meshBvh.SetHidden(draw.m_mesh, !wasHidden);
+                }
+                changed = true;
+            }
+        }
+    }
+    if (changed) {
+        m_shadowMapper.Invalidate();
+    }
 }
-void ViewerGraphicsWindow::lightingSwitch(bool val)
+
+void ViewerGraphicsWindow::effectType(int val)
 {
-    //TO DO, maybe ...
+    // The other effects aren't drawn yet, choosing one turns ambient occlusion off
+    int mode = k_ambientOcclusionOff;
+    if (val == k_effectAmbientOcclusion) {
+        mode = k_ambientOcclusionFull;
+    }
+    else if (val == k_effectAmbientOcclusionHalf) {
+        mode = k_ambientOcclusionHalf;
+    }
+    settings->setValue("ViewerGraphicsWindow/ambientOcclusion", mode);
+    loadSettings();
 }
 
-void ViewerGraphicsWindow::smoothingSwitch(bool val)
+void ViewerGraphicsWindow::ambientOcclusionTemporal(bool val)
 {
-    //TO DO, maybe ...
+    settings->setValue("ViewerGraphicsWindow/ambientOcclusionTemporal", val);
+    loadSettings();
 }
 
-void ViewerGraphicsWindow::effectType(int val)
+AmbientOcclusion::Options ViewerGraphicsWindow::getAmbientOcclusion() const
 {
-    //TO DO, maybe ...
+    return m_settings.m_ambientOcclusion;
 }
 
 void ViewerGraphicsWindow::lightAmbient(float val)
@@ -1009,8 +3652,409 @@ void ViewerGraphicsWindow::saveDialog(QString filePath) {
 }
 
 void ViewerGraphicsWindow::exportFrame(QString filePath) {
-    QImage frameCapture = grabFramebuffer();
-    frameCapture.save(filePath);
+    // The frame is read back asynchronously at the end of the next paintGL
+    m_frameCapture.Request(filePath);
+    update();
+}
+
+bool ViewerGraphicsWindow::exportPoster(QString filePath, QSize size) {
+    if (!initialized || filePath.isEmpty() || size.width() <= 0) {
+        return false;
+    }
+    const QSize tileSize = this->size() * devicePixelRatio();
+    if (size.height() <= 0) {
+        size.setHeight(std::max(1, qRound(float(size.width()) * float(tileSize.height()) / float(std::max(tileSize.width(), 1)))));
+    }
+
+    // The tiles are read back at the end of the frames drawing them
+    if (!m_posterRenderer.Start(filePath, size, tileSize)) {
+        return false;
+    }
+    update();
+    return true;
+}
+
+bool ViewerGraphicsWindow::exportVideo(QString filePath, const CameraPath& path, int fps) {
+    if (!initialized || filePath.isEmpty() || fps <= 0 || m_frameCapture.IsBusy() || m_videoEncoder.IsOpen() || !m_videoSequence.isEmpty()) {
+        return false;
+    }
+    const float step = 1.f / float(fps);
+    const int frameCount = path.FrameCount(step);
+    if (frameCount == 0) {
+        return false;
+    }
+
+    // The frames are read back at the end of the frames playing the path, and passed on as
+    // the GPU finishes them
+    const QString ffmpeg = VideoEncoder::FindFfmpeg();
+    if (!ffmpeg.isEmpty() && m_videoEncoder.Open(ffmpeg, filePath, fps)) {
+        m_frameCapture.StartVideo(&m_videoEncoder, frameCount);
+    }
+    else {
+        const QFileInfo info(filePath);
+        m_videoSequence = info.dir().filePath(info.completeBaseName());
+        m_frameCapture.FinishWrites();
+        m_frameCapture.StartRecording(m_videoSequence, frameCount);
+    }
+    PlayCameraPath(path, step);
+    return true;
+}
+
+void ViewerGraphicsWindow::setViewportCount(int count) {
+    count = std::max(1, std::min(count, SplitView::k_maxViewports));
+    if (count == viewportCount()) {
+        return;
+    }
+
+    // A single view keeps none of the viewports, the programs of those that go are deleted
+    // with the context current
+    const size_t kept = count > 1 ? size_t(count) : 0;
+    if (initialized) {
+        makeCurrent();
+    }
+    for (size_t i = kept; i < m_splitViewports.size(); ++i) {
+        delete m_splitViewports[i].m_pProgram;
+    }
+    if (initialized) {
+        doneCurrent();
+    }
+    m_splitViewports.resize(kept);
+    PublishRenderState();
+    update();
+}
+
+int ViewerGraphicsWindow::viewportCount() const {
+    return std::max(1, int(m_splitViewports.size()));
+}
+
+bool ViewerGraphicsWindow::setViewportAngles(int index, float yaw, float pitch) {
+    if (index < 0 || index >= int(m_splitViewports.size())) {
+        return false;
+    }
+    m_splitViewports[index].m_yaw = yaw;
+    m_splitViewports[index].m_pitch = pitch;
+    PublishRenderState();
+    update();
+    return true;
+}
+
+bool ViewerGraphicsWindow::setViewportShaders(int index, QString vertfilepath, QString fragfilepath) {
+    if (!initialized || index < 0 || index >= int(m_splitViewports.size())) {
+        return false;
+    }
+    SplitViewport& viewport = m_splitViewports[index];
+    makeCurrent();
+    QOpenGLShaderProgram* pProgram = nullptr;
+    QByteArray vertexSource;
+    QByteArray fragmentSource;
+    if (!vertfilepath.isEmpty() || !fragfilepath.isEmpty()) {
+        pProgram = new QOpenGLShaderProgram(this);
+        GpuModelBuilder::BindAttributeLocations(pProgram);
+        const bool linked = ReadShaderFile(vertfilepath.isEmpty() ? currentVertFile : vertfilepath, vertexSource)
+            && ReadShaderFile(fragfilepath.isEmpty() ? currentFragFile : fragfilepath, fragmentSource)
+            && pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource)
+            && pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource)
+            && pProgram->link();
+        if (!linked) {
+            delete pProgram;
+            doneCurrent();
+            return false;
+        }
+    }
+    delete viewport.m_pProgram;
+    viewport.m_pProgram = pProgram;
+    viewport.m_interface.Clear();
+    viewport.m_variant = ShaderPermutations::Variant();
+    if (pProgram) {
+        // Set up like the model program, with the blocks at the same bindings
+        viewport.m_interface.Reflect(pProgram);
+        if (m_frameBlockBuffer.isCreated()) {
+            UniformBlocks::BindBlock(pProgram, "FrameBlock", k_frameBlockBinding);
+        }
+        viewport.m_hasMaterialBlock = UniformBlocks::BindMaterial(pProgram);
+        UniformBlocks::BindShadows(pProgram);
+        UniformBlocks::BindLights(pProgram);
+        UniformBlocks::BindEnvironment(pProgram);
+        viewport.m_bindless = fragmentSource.contains(UniformBlocks::k_bindlessDirectives);
+        viewport.m_sectionClipping = vertexSource.contains("gl_ClipDistance");
+        viewport.m_variant.m_pProgram = pProgram;
+        viewport.m_variant.m_matrixUniform = viewport.m_interface.UniformLocation("matrix");
+        viewport.m_variant.m_modelviewUniform = viewport.m_interface.UniformLocation("modelview");
+        viewport.m_variant.m_normalUniform = viewport.m_interface.UniformLocation("normalMat");
+        viewport.m_variant.m_textureUniform = viewport.m_interface.UniformLocation("uTexture");
+        viewport.m_variant.m_hasTextureUniform = viewport.m_interface.UniformLocation("uHasTexture");
+        viewport.m_variant.m_instanceAttr = viewport.m_interface.AttributeLocation("instanceAttr");
+    }
+    doneCurrent();
+    update();
+    return true;
+}
+
+bool ViewerGraphicsWindow::compareWith(QString filepath) {
+    if (!initialized || !m_currentModel.m_isValid || m_primaryFile.isEmpty()) {
+        return false;
+    }
+    if (filepath.isEmpty()) {
+        filepath = QFileDialog::getOpenFileName(nullptr, "Compare With", QFileInfo(m_primaryFile).path(), "");
+        if (filepath.isEmpty()) {
+            return false;
+        }
+    }
+
+    // The GPU copy of the model shown can't be read back, so it is decoded again beside the other
+    const QString original = m_primaryFile;
+    const LoadOptions options = GetLoadOptions();
+    StartComparison([original, filepath, options] {
+        const QFuture<ModelData> decode = JobSystem::Run(JobPriority::Interactive, [filepath, options] { return ModelLoader::DecodeFile(filepath, options); });
+        const ModelData originalData = ModelLoader::DecodeFile(original, options);
+        JobSystem::Wait(decode);
+        return SurfaceComparison::Compare(originalData, decode.result());
+    });
+    return true;
+}
+
+bool ViewerGraphicsWindow::compareModels(const ModelData& original, const ModelData& compared) {
+    if (!SetModelData(original)) {
+        return false;
+    }
+    StartComparison([original, compared] { return SurfaceComparison::Compare(original, compared); });
+    return true;
+}
+
+void ViewerGraphicsWindow::setCompareMode(int mode) {
+    m_compareMode = std::max(int(k_compareOff), std::min(mode, int(k_compareDifference)));
+    update();
+}
+
+int ViewerGraphicsWindow::compareMode() const {
+    return m_compareMode;
+}
+
+void ViewerGraphicsWindow::StartComparison(std::function<SurfaceComparison()> measure) {
+    // A comparison still being measured is left to finish, only its result is dropped
+    m_measuredGeneration = ++m_comparisonGeneration;
+    m_comparisonWatcher.setFuture(JobSystem::Run(JobPriority::Interactive, [measure] {
+        return QSharedPointer<SurfaceComparison>::create(measure());
+    }));
+}
+
+void ViewerGraphicsWindow::OnComparisonMeasured() {
+    const QSharedPointer<SurfaceComparison> comparison = m_comparisonWatcher.result();
+    if (m_measuredGeneration != m_comparisonGeneration || !initialized) {
+        return;
+    }
+    if (comparison->m_original.IsEmpty() || comparison->m_compared.IsEmpty()) {
+        emit ComparisonFinished(false, 0.f, 0.f);
+        return;
+    }
+    makeCurrent();
+    m_modelComparison.Upload(*comparison);
+    UpdateUploadedBytes();
+    if (m_compareMode == k_compareOff) {
+        m_compareMode = k_compareSideBySide;
+    }
+    update();
+    emit ComparisonFinished(true, comparison->m_hausdorff, comparison->m_mean);
+}
+
+void ViewerGraphicsWindow::EndComparison() {
+    ++m_comparisonGeneration;
+    if (m_modelComparison.HasModels()) {
+        makeCurrent();
+        m_modelComparison.Clear();
+        UpdateUploadedBytes();
+    }
+}
+
+bool ViewerGraphicsWindow::previewSimplification(const SimplifyOptions& options) {
+    if (!initialized || !m_currentModel.m_isValid || m_currentModel.m_streamer) {
+        return false;
+    }
+    if (!options.IsActive()) {
+        endSimplification();
+        return true;
+    }
+
+    // The full detail is read back for the first preview, the ones after may have replaced it
+    if (m_simplifiedSources.empty()) {
+        makeCurrent();
+        QSharedPointer<std::vector<MeshTriangles>> triangles(new std::vector<MeshTriangles>());
+        for (int meshIdx = 0; meshIdx < int(m_currentModel.m_meshes.size()); ++meshIdx) {
+            Mesh& mesh = m_currentModel.m_meshes[meshIdx];
+            MeshTriangles meshTriangles;
+            if (!GpuModelBuilder::ReadTriangles(mesh, meshTriangles)) {
+                continue;
+            }
+            m_simplifiedSources.push_back({ meshIdx, mesh.m_indexCount, mesh.m_lods, mesh.m_meshlets });
+            triangles->push_back(std::move(meshTriangles));
+        }
+        if (m_simplifiedSources.empty()) {
+            return false;
+        }
+        m_simplifyTriangles = triangles;
+    }
+
+    m_pendingSimplify = options;
+    m_simplifiedGeneration = ++m_simplifyGeneration;
+    const QSharedPointer<const std::vector<MeshTriangles>> triangles = m_simplifyTriangles;
+    m_simplifyWatcher.setFuture(JobSystem::Run(JobPriority::Interactive, [triangles, options] {
+        return MeshSimplifier::SimplifyMeshes(*triangles, options);
+    }));
+    return true;
+}
+
+void ViewerGraphicsWindow::endSimplification() {
+    ++m_simplifyGeneration;
+    m_simplifyOptions = SimplifyOptions();
+    if (m_simplifiedSources.empty()) {
+        return;
+    }
+    makeCurrent();
+    for (size_t i = 0; i < m_simplifiedSources.size(); ++i) {
+        const SimplifiedSource& source = m_simplifiedSources[i];
+        Mesh& mesh = m_currentModel.m_meshes[source.m_mesh];
+        GpuModelBuilder::WriteIndices(mesh, (*m_simplifyTriangles)[i].m_indices);
+        mesh.m_indexCount = source.m_indexCount;
+        mesh.m_lods = source.m_lods;
+        mesh.m_meshlets = source.m_meshlets;
+    }
+    m_simplifiedSources.clear();
+    m_simplifyTriangles.reset();
+    InvalidateIndices();
+    update();
+}
+
+SimplifyOptions ViewerGraphicsWindow::simplification() const {
+    return m_simplifyOptions;
+}
+
+void ViewerGraphicsWindow::setSectionPlanes(const std::vector<QVector4D>& planes, bool caps) {
+    m_sectionPlanes.assign(planes.begin(), planes.begin() + std::min(planes.size(), size_t(Frustum::k_maxExtraPlanes)));
+    m_fillSections = caps;
+    RedrawScene();
+}
+
+const std::vector<QVector4D>& ViewerGraphicsWindow::sectionPlanes() const {
+    return m_sectionPlanes;
+}
+
+bool ViewerGraphicsWindow::sectionCaps() const {
+    return m_fillSections;
+}
+
+bool ViewerGraphicsWindow::modelBounds(QVector3D& min, QVector3D& max) const {
+    if (!m_currentModel.m_isValid) {
+        return false;
+    }
+    min = m_currentModel.m_AABBMin;
+    max = m_currentModel.m_AABBMax;
+    return true;
+}
+
+void ViewerGraphicsWindow::OnSimplified() {
+    const std::vector<SimplifiedMesh> simplified = m_simplifyWatcher.result();
+    if (m_simplifiedGeneration != m_simplifyGeneration || !initialized || simplified.size() != m_simplifiedSources.size()) {
+        return;
+    }
+    makeCurrent();
+    qint64 triangles = 0;
+    qint64 originalTriangles = 0;
+    float error = 0.f;
+    for (size_t i = 0; i < simplified.size(); ++i) {
+        Mesh& mesh = m_currentModel.m_meshes[m_simplifiedSources[i].m_mesh];
+        GpuModelBuilder::WriteIndices(mesh, simplified[i].m_indices);
+        mesh.m_lods.clear();
+        mesh.m_meshlets.clear();
+        triangles += qint64(simplified[i].m_indices.size() / 3);
+        originalTriangles += qint64((*m_simplifyTriangles)[i].m_indices.size() / 3);
+        error = std::max(error, simplified[i].m_error);
+    }
+    m_simplifyOptions = m_pendingSimplify;
+    InvalidateIndices();
+    update();
+    emit SimplificationFinished(triangles, originalTriangles, error);
+}
+
+void ViewerGraphicsWindow::InvalidateIndices() {
+    if (m_indirectRenderer.IsBuilt()) {
+        m_indirectRenderer.Clear();
+        UpdateUploadedBytes();
+    }
+    m_shadowMapper.Invalidate();
+}
+
+void ViewerGraphicsWindow::StartFrameRecording(const QString& folder) {
+    m_frameCapture.StartRecording(folder);
+    update();
+}
+
+void ViewerGraphicsWindow::StopFrameRecording() {
+    m_frameCapture.StopRecording();
+}
+
+bool ViewerGraphicsWindow::IsRecordingFrames() const {
+    return m_frameCapture.IsRecording();
+}
+
+void ViewerGraphicsWindow::StartFrameStream(FrameStream* pStream) {
+    StopFrameStream();
+    m_frameCapture.StartStream(pStream);
+    m_frameStreamConnection = connect(pStream, &FrameStream::FrameWanted, this, [=] { update(); });
+    update();
+}
+
+void ViewerGraphicsWindow::StopFrameStream() {
+    m_frameCapture.StopStream();
+    disconnect(m_frameStreamConnection);
+}
+
+bool ViewerGraphicsWindow::IsStreamingFrames() const {
+    return m_frameCapture.IsStreaming();
+}
+
+void ViewerGraphicsWindow::StartCameraRecording() {
+    m_cameraRecording.Clear();
+    m_cameraRecordingTimer.start();
+    m_recordingCamera = true;
+    update();
+}
+
+CameraPath ViewerGraphicsWindow::StopCameraRecording() {
+    m_recordingCamera = false;
+    return m_cameraRecording;
+}
+
+bool ViewerGraphicsWindow::IsRecordingCamera() const {
+    return m_recordingCamera;
+}
+
+void ViewerGraphicsWindow::PlayCameraPath(const CameraPath& path, float step) {
+    if (path.IsEmpty() || step <= 0.f) {
+        return;
+    }
+    m_cameraPlayback = path;
+    m_playbackStep = step;
+    m_playbackFrame = 0;
+    m_playbackFrames.clear();
+    m_playbackFrames.reserve(path.FrameCount(step));
+    ClearFrameStats();
+    update();
+}
+
+void ViewerGraphicsWindow::StopCameraPlayback() {
+    if (m_playbackFrame < 0) {
+        return;
+    }
+    m_playbackFrame = -1;
+    emit CameraPlaybackFinished();
+}
+
+bool ViewerGraphicsWindow::IsPlayingCameraPath() const {
+    return m_playbackFrame >= 0;
+}
+
+const std::vector<PlaybackFrame>& ViewerGraphicsWindow::GetPlaybackFrames() const {
+    return m_playbackFrames;
 }
 
 
@@ -1035,6 +4079,15 @@ void ViewerGraphicsWindow::SetScale(float scale)
     QMatrix4x4 newMat;
     newMat.scale(scale);
     m_scaleMatrix = newMat;
+    PublishRenderState();
+    update();
+}
+void ViewerGraphicsWindow::SetRotation(float x, float y)
+{
+    rotX = x;
+    rotY = std::max(-90.f, std::min(y, 90.f));
+    PublishRenderState();
+    update();
 }
 float ViewerGraphicsWindow::GetRotY()
 {
@@ -1048,7 +4101,28 @@ QMatrix4x4 ViewerGraphicsWindow::GetTranslationMatrix()
 {
     return m_transMatrix;
 }
-QMatrix4x4 ViewerGraphicsWindow::GetModelMatrix()
+CameraPose ViewerGraphicsWindow::GetCameraPose() const
+{
+    // Only ever translated and uniformly scaled, so the matrices are read back directly
+    CameraPose pose;
+    pose.m_rotX = rotX;
+    pose.m_rotY = rotY;
+    pose.m_scale = m_scaleMatrix(0, 0);
+    pose.m_translation = m_transMatrix.column(3).toVector3D();
+    return pose;
+}
+void ViewerGraphicsWindow::SetCameraPose(const CameraPose& pose)
+{
+    rotX = pose.m_rotX;
+    rotY = std::max(-90.f, std::min(pose.m_rotY, 90.f));
+    m_scaleMatrix = QMatrix4x4();
+    m_scaleMatrix.scale(pose.m_scale);
+    m_transMatrix = QMatrix4x4();
+    m_transMatrix.translate(pose.m_translation);
+    PublishRenderState();
+    update();
+}
+QMatrix4x4 ViewerGraphicsWindow::GetRotationMatrix() const
 {
     QVector3D xAxis(1, 0, 0);
     QVector3D yAxis(0, 1, 0);
@@ -1056,13 +4130,141 @@ QMatrix4x4 ViewerGraphicsWindow::GetModelMatrix()
     QMatrix4x4 rotMatrix;
     rotMatrix.rotate(rotY, xAxis);
     rotMatrix.rotate(rotX, yAxis);
+    return rotMatrix;
+}
+void ViewerGraphicsWindow::PublishRenderState()
+{
+    // Overwritten in place, so its matrices keep their storage
+    RenderState& frame = m_renderState;
+    frame.m_retinaScale = devicePixelRatio();
+    frame.m_nativeSize = size() * frame.m_retinaScale;
+    frame.m_model = GetModelMatrix();
+    FitClipPlanes(frame.m_model, frame.m_nearPlane, frame.m_farPlane);
+    frame.m_projection.setToIdentity();
+    frame.m_projection.perspective(fieldOfView, float(width() * frame.m_retinaScale) / float(std::max(height(), 1) * frame.m_retinaScale), frame.m_nearPlane, frame.m_farPlane);
+
+    // The viewports of a split window orbit with the camera, each turned by its own angles.
+    // Their one projection takes in the depths of all of them.
+    frame.m_viewportModels.resize(m_splitViewports.size());
+    if (!m_splitViewports.empty()) {
+        float viewportNear = FLT_MAX;
+        float viewportFar = 0.f;
+        for (size_t i = 0; i < m_splitViewports.size(); ++i) {
+            frame.m_viewportModels[i] = ModelMatrix(rotX + m_splitViewports[i].m_yaw, rotY + m_splitViewports[i].m_pitch);
+            float nearDistance = 0.f;
+            float farDistance = 0.f;
+            FitClipPlanes(frame.m_viewportModels[i], nearDistance, farDistance);
+            viewportNear = std::min(viewportNear, nearDistance);
+            viewportFar = std::max(viewportFar, farDistance);
+        }
+        const QRect cell = SplitView::Cell(frame.m_nativeSize, int(m_splitViewports.size()), 0);
+        frame.m_viewportProjection.setToIdentity();
+        frame.m_viewportProjection.perspective(fieldOfView, float(cell.width()) / float(std::max(cell.height(), 1)), viewportNear, viewportFar);
+    }
+
+    frame.m_lightPos = lightPos;
+    frame.m_color = ADColor;
+    frame.m_specularColor = specularColor;
+    frame.m_ka = uKa;
+    frame.m_kd = uKd;
+    frame.m_ks = uKs;
+    frame.m_shininess = shininess;
+    frame.m_mat4_1 = uMat4_1;
+    frame.m_vec3_1 = uVec3_1;
+    frame.m_vec4_1 = uVec4_1;
+    frame.m_float_1 = uFloat_1;
+    frame.m_int_1 = uInt_1;
+    frame.m_userUniforms = m_userUniforms;
+}
+
+void ViewerGraphicsWindow::FitClipPlanes(const QMatrix4x4& modelView, float& nearDistance, float& farDistance) const
+{
+    nearDistance = nearPlane;
+    farDistance = farPlane;
+    if (!autoClipPlanes || !m_currentModel.m_isValid) {
+        return;
+    }
+
+    // The depths of the model's box, and of the grid under it while it is shown. The camera
+    // looks down -z.
+    QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+    QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    BoundsMath::AddTransformedBox(modelView, m_currentModel.m_AABBMin, m_currentModel.m_AABBMax, min, max);
+    if (m_settings.m_showGrid) {
+        const float extent = 10.f * m_gridScale;
+        const float floorY = m_currentModel.m_AABBMin.y();
+        BoundsMath::AddTransformedBox(modelView, QVector3D(-extent, floorY, -extent), QVector3D(extent, floorY, extent), min, max);
+    }
+    const float farthest = -min.z() * (1.f + k_clipMargin);
+    if (!(farthest > 0.f)) {
+        // Everything is behind the camera
+        return;
+    }
+    farDistance = farthest;
+    nearDistance = std::max(-max.z() * (1.f - k_clipMargin), farthest * k_minNearRatio);
+}
+
+QMatrix4x4 ViewerGraphicsWindow::GetModelMatrix()
+{
+    return ModelMatrix(rotX, rotY);
+}
+
+QMatrix4x4 ViewerGraphicsWindow::ModelMatrix(float rotationX, float rotationY) const
+{
+    QMatrix4x4 rotMatrix;
+    rotMatrix.rotate(rotationY, QVector3D(1, 0, 0));
+    rotMatrix.rotate(rotationX, QVector3D(0, 1, 0));
+
+    // Rotate about the pivot, which is scaled along with the model
+    const QVector3D pivot = m_scaleMatrix.map(m_orbitPivot);
+    QMatrix4x4 orbitMatrix;
+    orbitMatrix.translate(pivot);
+    orbitMatrix *= rotMatrix;
+    orbitMatrix.translate(-pivot);
+
+    return m_transMatrix * orbitMatrix * m_scaleMatrix;
+}
+void ViewerGraphicsWindow::SetOrbitPivot(const QVector3D& pivot)
+{
+    // Rotating about a different point shifts the model by how differently the rotation
+    // moves the two points, the translation takes that back out
+    const QVector3D offset = m_scaleMatrix.map(pivot) - m_scaleMatrix.map(m_orbitPivot);
+    m_transMatrix.translate(GetRotationMatrix().mapVector(offset) - offset);
+    m_orbitPivot = pivot;
+    PublishRenderState();
+    update();
+}
+QVector3D ViewerGraphicsWindow::GetOrbitPivot() const
+{
+    return m_orbitPivot;
+}
+int ViewerGraphicsWindow::GetSelectedMesh() const
+{
+    return m_selectedMesh;
+}
 
-    return m_transMatrix * rotMatrix * m_scaleMatrix;
+const Model& ViewerGraphicsWindow::GetCurrentModel() const
+{
+    return m_currentModel;
 }
 bool ViewerGraphicsWindow::IsModelValid() 
 {
     return m_currentModel.m_isValid;
 }
+bool ViewerGraphicsWindow::IsInitialized() const
+{
+    return initialized;
+}
+
+void ViewerGraphicsWindow::setDeferredResources(bool defer)
+{
+    m_deferResources = defer;
+}
+
+bool ViewerGraphicsWindow::IsResourcesCreated() const
+{
+    return m_resourcesCreated;
+}
 
 //uniform vars getters and setters
 QVector3D ViewerGraphicsWindow::getLightLocation()
@@ -1074,6 +4276,7 @@ void ViewerGraphicsWindow::setLightLocation(float x, float y, float z)
 {
     lightPos = QVector3D(x, y, z);
     //m_program->setUniformValue(m_lightPosUniform, lightPos);
+    RedrawScene();
 }
 
 QVector3D ViewerGraphicsWindow::getADS()
@@ -1087,6 +4290,7 @@ void ViewerGraphicsWindow::setADS(float a, float d, float s)
     uKa = a;
     uKd = d;
     uKs = s;
+    RedrawScene();
 }
 
 QVector4D ViewerGraphicsWindow::getSpecularColor()
@@ -1097,6 +4301,7 @@ QVector4D ViewerGraphicsWindow::getSpecularColor()
 void ViewerGraphicsWindow::setSpecularColor(float r, float g, float b)
 {
     specularColor = QVector4D(r, g, b, 1.);
+    RedrawScene();
 }
 
 float ViewerGraphicsWindow::getShininess()
@@ -1106,6 +4311,30 @@ float ViewerGraphicsWindow::getShininess()
 void ViewerGraphicsWindow::setShininess(float new_shininess)
 {
     shininess = new_shininess;
+    RedrawScene();
+}
+const std::vector<ProgramInterface::Variable>& ViewerGraphicsWindow::getUserUniforms() const
+{
+    return m_programInterface.UserUniforms();
+}
+QVector4D ViewerGraphicsWindow::getUserUniform(const QByteArray& name) const
+{
+    // Until it is given one, a uniform has the value the shader declares
+    const auto it = m_userUniforms.constFind(name);
+    if (it != m_userUniforms.constEnd()) {
+        return *it;
+    }
+    for (const ProgramInterface::Variable& uniform : m_programInterface.UserUniforms()) {
+        if (uniform.m_name == name) {
+            return uniform.m_initial;
+        }
+    }
+    return QVector4D();
+}
+void ViewerGraphicsWindow::setUserUniform(const QByteArray& name, const QVector4D& value)
+{
+    m_userUniforms.insert(name, value);
+    RedrawScene();
 }
 QVector4D ViewerGraphicsWindow::getADColor()
 {
@@ -1114,4 +4343,12 @@ QVector4D ViewerGraphicsWindow::getADColor()
 void ViewerGraphicsWindow::setADColor(float r, float g, float b)
 {
     ADColor = QVector4D(r, g, b, 1.);
+    RedrawScene();
+}
+
+void ViewerGraphicsWindow::RedrawScene()
+{
+    m_sceneChanged = true;
+    PublishRenderState();
+    update();
 }
@@ -1,12 +1,71 @@
 #pragma once
 #include "OpenGLWindow.h"
+#include "AppSettings.h"
+#include "Animation.h"
 #include "ModelLoader.h"
+#include "ModelScene.h"
+#include "Primitives.h"
 #include "SettingsMenu.h"
-
+#include "AsyncModelLoader.h"
+#include "AsyncModelExporter.h"
+#include "TextureCache.h"
+#include "TextureUploader.h"
+#include "StreamBuffer.h"
+#include "FrameStats.h"
+#include "FramePacer.h"
+#include "CameraPath.h"
+#include "ImportTrace.h"
+#include "GpuProfiler.h"
+#include "FrameCapture.h"
+#include "PosterRenderer.h"
+#include "VideoEncoder.h"
+#include "FrameStream.h"
+#include "MeshBvh.h"
+#include "PointCloudLod.h"
+#include "OcclusionCuller.h"
+#include "MeshPicker.h"
+#include "VirtualTextures.h"
+#include "MeshSimplifier.h"
+#include "IndirectRenderer.h"
+#include "ComputeSkinner.h"
+#include "ShadowMapper.h"
+#include "LightClusters.h"
+#include "EnvironmentLighting.h"
+#include "TransparencyPass.h"
+#include "AmbientOcclusion.h"
+#include "ShaderCompiler.h"
+#include "ShaderPermutations.h"
+#include "RenderQueue.h"
+#include "TransformCache.h"
+#include "TextRenderer.h"
+#include "ResolutionScaler.h"
+#include "FrameAccumulator.h"
+#include "MeshDisplayModes.h"
+#include "Meshlets.h"
+#include "RenderState.h"
+#include "ResourceTracker.h"
+#include "SceneGraph.h"
+#include "SplitView.h"
+#include "ModelComparison.h"
+#include "SectionCaps.h"
+#include "SurfaceDistance.h"
+#include "ThumbnailIndex.h"
+#include "ProgramInterface.h"
+#include "UniformBlocks.h"
+
+#include <QFileSystemWatcher>
+#include <QFutureWatcher>
 #include <QOpenGLWidget>
+#include <QTimer>
 #include <QOpenGLShaderProgram>
 #include <QElapsedTimer>
 #include <QList>
+#include <QHash>
+#include <QStringList>
+
+#include <functional>
+
+class Frustum;
 
 class ViewerGraphicsWindow : public QOpenGLWidget, protected QOpenGLFunctions
 {
@@ -17,21 +76,112 @@ public:
 
     void resetView();
 
+    // Starts loading a model in the background, cancelling a load that is still running.
+    // filepath can also be an http(s) URL, or go through a zip archive as in
+    // "pack.zip/models/car.obj". For an archive itself the model in it is loaded, or the one
+    // the user picks if it holds several.
     bool loadModel(QString filepath = QString());
+    void cancelModelLoading();
+    bool IsLoadingModel() const;
     bool unloadModel();
+    // Frees the GPU memory of the model shown, which is loaded again, from the model cache
+    // where it is there, once the window is shown. Happens by itself after the settings'
+    // timeout while the window is minimized or hidden. False for models that can't be loaded
+    // again as they were, those not loaded from a file on their own.
+    bool evictModel();
+    // Nothing is drawn while the window is hidden or minimized
+    bool IsSuspended() const;
+    bool IsEvicted() const;
+    // Uploads an already decoded model and shows it, bypassing the background loader
+    bool SetModelData(const ModelData& data);
+
+    // Load a model in the background and set it beside the models already shown. The scene
+    // being exported stays the primary model's. Streamed models are shown on their own, so
+    // nothing can be added beside one.
+    bool addModel(QString filepath = QString());
     bool addPrimitive(QString filepath);
+    // Generates the shape at the tessellation of the settings, without reading a file
+    bool addPrimitive(PrimitiveShape shape);
+    bool removeFromScene(int id);
+    const ModelScene& GetScene() const;
+
+    // Clips of the primary model, and playing one of them on a loop. -1 stops and puts the
+    // skinned meshes back at rest.
+    QStringList GetAnimationNames() const;
+    void playAnimation(int clip);
+    int GetPlayingAnimation() const;
+
+    // The node tree of the primary model, as moved and hidden so far. Moving a node relative to
+    // its parent places only the meshes of its subtree. Hiding it or showing only its subtree,
+    // -1 to show all again, flips the visibility bits of their draws and uploads nothing, the
+    // meshes of streamed models are then streamed in or left out as they are shown. False for
+    // nodes the tree doesn't have, and for moving the nodes of streamed models, whose meshes
+    // are uploaded again as they were loaded.
+    const SceneGraph& GetSceneGraph() const;
+    bool setNodeTransform(int node, const QMatrix4x4& local);
+    bool setNodeHidden(int node, bool hidden);
+    bool isolateNode(int node);
     bool loadVertexShader(QString vertfilepath = QString());
     bool loadFragmentShader(QString fragfilepath = QString());
     void loadTexture(QString filepath = QString());
+    // Lights the model with an equirectangular .hdr environment, which is loaded again on the
+    // next start. The prefiltered maps are cached, so opening it again is quick.
+    bool loadEnvironment(QString filepath = QString());
+    void bindAttributeLocations();
     void setUniformLocations();
-    void setUniformVars();
 
     void screenshotDialog();
     void saveDialog(QString filePath);
+    // Saves the next frame to filePath without waiting for the readback
     void exportFrame(QString filePath);
+    // Renders the view as a PNG of size, which may be far larger than the window or any
+    // framebuffer, a window sized tile per frame. A height of 0 keeps the window's aspect.
+    // PosterExported is emitted once it is written. False while another poster is rendered
+    // or if filePath can't be written.
+    bool exportPoster(QString filePath, QSize size);
+    // Plays path at fps and encodes every frame into the video at filePath, with FFmpeg and a
+    // hardware encoder where there is one. Without FFmpeg the frames are saved as a numbered
+    // PNG sequence in a folder named after the video instead. VideoExported is emitted once
+    // everything is written. False while frames are already being captured.
+    bool exportVideo(QString filePath, const CameraPath& path, int fps = 30);
+    // Saves every frame to a numbered image sequence in folder until stopped
+    void StartFrameRecording(const QString& folder);
+    void StopFrameRecording();
+    bool IsRecordingFrames() const;
+    // Passes the frames drawn to pStream until stopped, and draws one whenever it asks for
+    // one. The stream has to outlive it.
+    void StartFrameStream(FrameStream* pStream);
+    void StopFrameStream();
+    bool IsStreamingFrames() const;
+
+    // Records the camera pose of every frame until stopped, frames are drawn back to back
+    // meanwhile so a camera that is held still stays still in the path
+    void StartCameraRecording();
+    CameraPath StopCameraRecording();
+    bool IsRecordingCamera() const;
+
+    // Plays a camera path back a fixed step per frame instead of the time that passed, so every
+    // run draws the same frames on any GPU. Held keys don't move the camera meanwhile and
+    // animations advance by the step as well. CameraPlaybackFinished is emitted once the GPU
+    // times of the last frame came in.
+    void PlayCameraPath(const CameraPath& path, float step = 1.f / 60.f);
+    void StopCameraPlayback();
+    bool IsPlayingCameraPath() const;
+    const std::vector<PlaybackFrame>& GetPlaybackFrames() const;
     void saveModel();
     bool IsModelValid();
 
+    // How models are imported and decoded, from the settings
+    LoadOptions GetLoadOptions();
+    bool IsInitialized() const;
+
+    // Makes the context create only what its first frame needs, the default program and the
+    // frame block, and the render passes with their programs on the next pass of the event
+    // loop, after the landing page that covers the first frame was painted. A frame drawn
+    // before creates them itself. Set before the window is first shown.
+    void setDeferredResources(bool defer);
+    bool IsResourcesCreated() const;
+
     bool editCurrentShaders();
     bool reloadCurrentShaders();
     bool openShaderFile(QString filepath = QString());
@@ -47,6 +197,23 @@ public:
     float getShininess();
     void setShininess(float new_shininess);
 
+    // The uniforms of the current shaders the viewer doesn't set itself, and their values.
+    // Values given to uniforms of the same name keep applying after the shaders are reloaded.
+    const std::vector<ProgramInterface::Variable>& getUserUniforms() const;
+    QVector4D getUserUniform(const QByteArray& name) const;
+    void setUserUniform(const QByteArray& name, const QVector4D& value);
+
+    // Entries of the image effect choice of the uniform controller, effectType takes them.
+    // Ambient occlusion is the only one drawn so far.
+    enum ImageEffect : int {
+        k_effectNegative,
+        k_effectSaturation,
+        k_effectSharpening,
+        k_effectAmbientOcclusion,
+        k_effectAmbientOcclusionHalf,
+    };
+    AmbientOcclusion::Options getAmbientOcclusion() const;
+
     bool GetLeftMousePressed();
     bool GetRightMousePressed();
     QMatrix4x4 GetScaleMatrix();
@@ -58,6 +225,103 @@ public:
 
     void ClearKeyboard();
 
+    void SetRotation(float x, float y);
+
+    // Splits the window into count viewports of the model, side by side or in a 2x2 grid. They
+    // all follow the camera, each turned by its own angles, and draw the one copy of the model
+    // on the GPU. Split views are drawn straight to the window, without the offscreen effects,
+    // shadows or scene lights of the single view.
+    void setViewportCount(int count);
+    int viewportCount() const;
+    // Turns viewport index by yaw degrees about the vertical axis and pitch about the horizontal
+    bool setViewportAngles(int index, float yaw, float pitch);
+    // Draws viewport index with shaders of its own, a missing one taken from the model program.
+    // Without any it draws with the model program again. False if they don't link, the viewport
+    // then keeps the program it had.
+    bool setViewportShaders(int index, QString vertfilepath = QString(), QString fragfilepath = QString());
+
+    // Compares the model shown with a simplified version of it read from filepath, such as a
+    // level of detail. Both are decoded again and every vertex of each is measured against the
+    // surface of the other on worker threads, after which the two are shown as setCompareMode
+    // picks, side by side if comparing was off. ComparisonFinished is emitted with the
+    // distances. False while no model is shown.
+    bool compareWith(QString filepath = QString());
+    // Shows original and compares compared with it, as compareWith does with files
+    bool compareModels(const ModelData& original, const ModelData& compared);
+    // How the models of the last comparison are shown, k_compareOff shows the scene again
+    void setCompareMode(int mode);
+    int compareMode() const;
+
+    // Simplifies the meshes of the model shown to options on worker threads and writes the
+    // triangles they keep over the full detail indices of each mesh, so the view shows them
+    // without uploading anything else. The positions and indices are read back once per model,
+    // later previews start from the full detail again. Levels of detail and meshlets are left
+    // out while a preview is shown, and saveModel exports the model simplified the same way.
+    // SimplificationFinished is emitted once the preview is shown. False while no model is
+    // shown, for streamed models, and where buffers can't be read back.
+    bool previewSimplification(const SimplifyOptions& options);
+    // Puts the full detail back, which also happens whenever the scene changes
+    void endSimplification();
+    // The options of the preview shown, inactive without one
+    SimplifyOptions simplification() const;
+
+    // Cuts the model open with up to Frustum::k_maxExtraPlanes planes in model space, keeping
+    // what is on the side of each plane its normal points to, a.x + b.y + c.z + d >= 0. Meshes
+    // cut away whole are culled with the planes as well. With caps the surfaces a plane cuts
+    // open are filled where closed meshes cross it, in the single view. Shadows are still cast
+    // by the whole model, and shaders that don't write gl_ClipDistance only lose the meshes
+    // cut away whole. An empty list shows the whole model again.
+    void setSectionPlanes(const std::vector<QVector4D>& planes, bool caps = true);
+    const std::vector<QVector4D>& sectionPlanes() const;
+    bool sectionCaps() const;
+    // The box of the model shown in model space, false while none is shown
+    bool modelBounds(QVector3D& min, QVector3D& max) const;
+
+    // The rotation, scale and offset of the view together, for scripts and camera paths
+    CameraPose GetCameraPose() const;
+    void SetCameraPose(const CameraPose& pose);
+
+    // The clip planes for the camera at modelView, just around the model and the grid with
+    // autoClipPlanes, otherwise nearPlane and farPlane
+    void FitClipPlanes(const QMatrix4x4& modelView, float& nearDistance, float& farDistance) const;
+
+    // Point in model space the view rotates about. Moving it keeps the view where it is.
+    void SetOrbitPivot(const QVector3D& pivot);
+    QVector3D GetOrbitPivot() const;
+
+    // Index of the mesh picked by the last click, -1 if none is selected
+    int GetSelectedMesh() const;
+
+    // The models of the scene composed into one, its GPU resources require this window's context
+    const Model& GetCurrentModel() const;
+
+    // Statistics of the recent frames, as shown in the stats overlay
+    FrameStats::Summary GetCpuFrameStats() const;
+    FrameStats::Summary GetGpuFrameStats() const;
+    void ClearFrameStats();
+    qint64 GetUploadedBytes() const;
+
+    // Memory taken per kind of resource, the GPU budget and the driver's report, as of the last
+    // change to the models or passes
+    const ResourceTracker& GetResources() const;
+
+    // Time spent reading and post-processing the current model, empty if it came from the cache
+    const std::vector<ImportStepTime>& GetImportTimings() const;
+
+    // Spans of the last load on every thread it ran on, from the cache lookup to the upload
+    const ImportTrace& GetImportTrace() const;
+
+    // Counts of the meshes and materials of the scene, taken when its models were loaded
+    const ModelStats& GetModelStats() const;
+
+    // Summaries and thumbnails of the models loaded so far, added to as models finish loading
+    const ThumbnailIndex& GetThumbnailIndex() const;
+
+    // GPU time of each render pass, and recording them to a Chrome trace file
+    const GpuProfiler& GetGpuProfiler() const;
+    void StartGpuTrace();
+    bool SaveGpuTrace(const QString& filepath);
+
     // Mouse settings | % adjustment
     float panXSensitivity;
     float panYSensitivity;
@@ -68,6 +332,8 @@ public:
     float fieldOfView;
     float nearPlane;
     float farPlane;
+    // Fit the clip planes to the model in every frame instead of using the two above
+    bool autoClipPlanes;
 
     void loadSettings();
 
@@ -85,8 +351,10 @@ public slots:
     ////settings
     void lightingSwitch(bool val);
     void smoothingSwitch(bool val);
+    void flatShadingSwitch(bool val);
     ////effect
     void effectType(int val);
+    void ambientOcclusionTemporal(bool val);
     ////lighting
     void lightAmbient(float val);
     void lightDiffuse(float val);
@@ -98,8 +366,43 @@ signals:
     void Initialized();
     void BeginModelLoading(QString filepath);
     void EndModelLoading(bool success, QString filepath);
+
+    // A coarse proxy of the model is shown while the full model is still loading
+    void ModelPreviewLoaded(QString filepath);
+    void ModelLoadingProgress(float percent);
+    void ModelLoadingCancelled(QString filepath);
     void ModelUnloaded();
 
+    // The summary and thumbnail of a model that finished loading were added to the index
+    void ModelIndexed(QString filepath);
+
+    // Models were added to or removed from the scene, or it was cleared
+    void SceneChanged();
+
+    // The shaders were linked again, and may have other user uniforms
+    void ShaderUniformsChanged();
+
+    // Every frame of a camera path was drawn, or playing was stopped
+    void CameraPlaybackFinished();
+
+    // A model about to be uploaded would take more GPU memory than the budget has left
+    void MemoryWarning(QString message);
+
+    // The poster started by exportPoster was written, or could not be
+    void PosterExported(bool success, QString filepath);
+
+    // The video started by exportVideo was written, or could not be. filepath is the folder
+    // of the image sequence when it was saved as one.
+    void VideoExported(bool success, QString filepath);
+
+    // The comparison started by compareWith or compareModels was measured and is shown, or
+    // either model had no triangles. The distances are in the original model's space.
+    void ComparisonFinished(bool success, float hausdorff, float mean);
+
+    // The preview started by previewSimplification is shown with triangles of the
+    // originalTriangles of the meshes, error being the largest error a collapse added
+    void SimplificationFinished(qint64 triangles, qint64 originalTriangles, float error);
+
 protected:
     // Rendering functions
     virtual void initializeGL() override;
@@ -114,20 +417,183 @@ protected:
     virtual void keyPressEvent(QKeyEvent*) override;
     virtual void keyReleaseEvent(QKeyEvent*) override;
     virtual void focusOutEvent(QFocusEvent*) override;
+    virtual void showEvent(QShowEvent*) override;
+    virtual void hideEvent(QHideEvent*) override;
+    // Watches the top level window of an evicted model for being shown again
+    virtual bool eventFilter(QObject* pWatched, QEvent* event) override;
 
 private:
+    // The performance tests time the parts of a frame on their own
+    friend class ModelViewerPerfTest;
+
     SettingsMenu* m_pSettingsMenu = nullptr;
-    QSettings* settings = new QSettings("The Model Viewers team", "Model Viewer");
+    AppSettings* settings = AppSettings::Shared();
+    // Reloads the settings once for all the changes made in a pass of the event loop
+    QTimer m_settingsReloadTimer;
+
+    // Actions that can be bound to keys in the settings
+    enum KeyAction {
+        k_increaseSpeed,
+        k_decreaseSpeed,
+        k_elevateForwards,
+        k_elevateBackwards,
+        k_strafeLeft,
+        k_strafeRight,
+        k_scaleUp,
+        k_scaleDown,
+        k_pitchUp,
+        k_pitchDown,
+        k_spinRight,
+        k_spinLeft,
+        k_keyActionCount
+    };
+
+    // Settings used every frame, reloaded by loadSettings when the settings change
+    struct SettingsSnapshot {
+        bool m_showGrid = true;
+        bool m_showAxis = true;
+        bool m_showStats = true;
+        bool m_alwaysRedraw = false;
+        PacingOptions m_pacing;
+        bool m_levelOfDetail = true;
+        bool m_occlusionCulling = false;
+        bool m_multiDrawIndirect = false;
+        bool m_gpuCulling = true;
+        int m_targetFps = 0;
+        // Minutes hidden after which the model is evicted, 0 to keep it
+        int m_evictMinutes = 0;
+
+        // Samples of the scene target, or -1 for FXAA instead
+        int m_msaaLevel = 8;
+        bool m_progressiveRefinement = true;
+        bool m_depthPrepass = false;
+        bool m_overdrawView = false;
+        int m_displayMode = k_displayShaded;
+        int m_meshletCulling = k_meshletCullingFrustum;
+        // Points of a point cloud octree drawn per frame at most
+        qint64 m_pointBudget = PointCloudLod::k_defaultBudget;
+        bool m_computeSkinning = true;
+        ShadowMapper::Options m_shadows;
+        bool m_sceneLights = true;
+        float m_environmentIntensity = 1.f;
+        AmbientOcclusion::Options m_ambientOcclusion;
+
+        // Each bound key owns one bit, and each action needs all bits of its mask held
+        QHash<int, int> m_keyBits;
+        quint64 m_actionMasks[k_keyActionCount] = {};
+    };
+    SettingsSnapshot m_settings;
+
+    // The camera and uniform values paintGL draws with, taken whenever the UI changes them.
+    // Rendering stays on the GUI thread, with the widget's own context.
+    RenderState m_renderState;
+    void PublishRenderState();
+    quint64 KeyBit(int key) const;
+    bool IsActionPressed(KeyAction action) const;
+
+    // Whether the model is drawn as points, in the points display mode or as a point cloud
+    // octree in any
+    bool DrawsPoints() const;
 
     // Modifies the matrices based on how much time has passed
     void Update(float sec);
     QElapsedTimer m_updateTimer;
-    QList<float> m_frametimes;
+
+    // Paces the frames drawn while the view keeps moving. A frame the pacer delays is asked
+    // for once the last one was swapped, when m_paceTimer runs out.
+    FramePacer m_framePacer;
+    QTimer m_paceTimer;
+    QElapsedTimer m_paceClock;
+    void OnFrameSwapped();
+
+    // Time since the oldest input no frame has shown yet, and the estimated input to photon
+    // latency of the frames that showed one
+    QElapsedTimer m_inputTimer;
+    bool m_inputPending = false;
+    FrameStats m_inputLatencies;
+    void NoteInput();
+
+    // Statistics for the stats overlay. Frame intervals are only recorded while drawing
+    // continuously, CPU and GPU times for every frame.
+    FrameStats m_frameIntervals;
+    FrameStats m_cpuFrameTimes;
+    FrameStats m_gpuFrameTimes;
+    int m_drawCalls = 0;
+    int m_textureBinds = 0;
+    int m_programBinds = 0;
+    int m_stateChanges = 0;
+    // Fixed function state calls passed to the driver and left out as redundant in the last frame
+    int m_stateCallsIssued = 0;
+    int m_stateCallsSkipped = 0;
+    qint64 m_drawnTriangles = 0;
+    qint64 m_drawnPoints = 0;
+    int m_visibleMeshes = 0;
+    int m_culledMeshes = 0;
+    bool m_culledOnGpu = false;
+    int m_occludedMeshes = 0;
+    qint64 m_uploadedBytes = 0;
+    ResourceTracker m_resources;
+    void UpdateUploadedBytes();
+    GpuProfiler m_gpuProfiler;
+    FrameCapture m_frameCapture;
+    QMetaObject::Connection m_frameStreamConnection;
+    PosterRenderer m_posterRenderer;
+    VideoEncoder m_videoEncoder;
+    // The folder of a video saved as an image sequence, until its last image is written
+    QString m_videoSequence;
+
+    // Uniform blocks, draw commands and text written anew every frame
+    StreamBuffer m_streamBuffer;
+
+    // The camera path being recorded, and the one being played with the frame it is at, -1
+    // when none is
+    CameraPath m_cameraRecording;
+    QElapsedTimer m_cameraRecordingTimer;
+    bool m_recordingCamera = false;
+    CameraPath m_cameraPlayback;
+    float m_playbackStep = 0.f;
+    int m_playbackFrame = -1;
+    std::vector<PlaybackFrame> m_playbackFrames;
+
+    // With a target frame rate or anti-aliasing the model and grid are drawn into a target of
+    // their own, which is resolved and stretched over the window before the overlays are drawn.
+    // m_sceneFramebuffer is the one the model is being drawn to.
+    ResolutionScaler m_resolutionScaler;
+    GLuint m_sceneFramebuffer = 0;
+    float m_sceneScale = 1.f;
+
+    // A view left alone is supersampled over the next frames. Changes the matrices don't show,
+    // like new uniforms or shaders, go through RedrawScene to start the average over.
+    FrameAccumulator m_frameAccumulator;
+    bool m_sceneChanged = true;
+    QMatrix4x4 m_refineProjection;
+    QMatrix4x4 m_refineModel;
+    QSize m_refineSize;
+    void RedrawScene();
+
+    // True while frames are drawn back to back, because keys are held, alwaysRedraw is set,
+    // frames are being captured or the camera is recorded or played back
+    bool m_redrawing = false;
 
     void RenderText();
+
+    // The overlays are queued as text and drawn in one batch. The lines that only change with
+    // the model or the grid are formatted when they do.
+    TextRenderer m_textRenderer;
+    qreal m_textPixelRatio = 0.;
+    QString m_overlayModelText;
+    QString m_overlayStaticText;
+    void UpdateOverlayText();
     void RenderGrid(QMatrix4x4 mvp);
     void RenderAxes();
     float ComputeOptimalScale();
+    QMatrix4x4 GetRotationMatrix() const;
+    // The model matrix of the camera orbited to rotationX and rotationY
+    QMatrix4x4 ModelMatrix(float rotationX, float rotationY) const;
+
+    // Coarsest level of detail of the mesh that still has about one triangle per few pixels
+    // it covers on screen, or the full mesh
+    MeshLod SelectLod(const Mesh& mesh, const QMatrix4x4& modelMatrix, float viewportHeight) const;
 
     bool initialized = false;
 
@@ -135,24 +601,11 @@ private:
     GLint m_normAttr = 0;
     GLint m_uvAttr = 0;
     GLint m_colAttr = 0;
+    GLint m_instanceAttr = -1;
     
     GLint m_matrixUniform = 0;
     GLint m_modelviewUniform = 0;
     GLint m_normalUniform = 0;
-    GLint m_lightPosUniform = 0;
-    GLint m_uKa = 0;
-    GLint m_uKd = 0;
-    GLint m_uKs = 0;
-    //GLint m_uADColor = 0;
-    GLint m_uSpecularColor = 0;
-    GLint m_uShininess = 0;
-
-    GLint m_uMat4_1;
-    GLint m_uVec3_1;
-    GLint m_uVec4_1;
-    GLint m_uFloat_1;
-    GLint m_uInt_1;
-
     QVector3D lightPos;
     QVector4D ADColor;
     QVector4D specularColor;
@@ -174,12 +627,322 @@ private:
     GLint m_uTexture = 0;
     GLint m_uHasTexture = 0;
 
+    // Uniforms and attributes of m_program, read again whenever it is linked
+    ProgramInterface m_programInterface;
+    // Values given to its user uniforms, kept across relinks for uniforms of the same name
+    QHash<QByteArray, QVector4D> m_userUniforms;
+
     QOpenGLShaderProgram* m_program = nullptr;
+
+    // Reads a shader with the uniform block declarations pulled in where it includes them.
+    // Shaders including the material surface sample the maps bindless when the context can.
+    bool ReadShaderFile(const QString& filepath, QByteArray& source) const;
+
+    // Replaces m_program's shaders and links it. Shaders are cacheable, they are compiled when
+    // the program is linked unless a binary of the same sources is cached for this driver.
+    bool LinkProgram(const QString& vertfilepath, const QString& fragfilepath);
+    bool LinkProgram(const QByteArray& vertexSource, const QByteArray& fragmentSource);
+
+    // Saving the current shader files relinks m_program. The new sources are compiled in the
+    // background first, m_program keeps drawing until they have linked and only then swaps to
+    // them through the program binary cache.
+    QFileSystemWatcher m_shaderWatcher;
+    QTimer m_shaderReloadTimer;
+    ShaderCompiler m_shaderCompiler;
+    QByteArray m_pendingVertexSource;
+    QByteArray m_pendingFragmentSource;
+    void WatchCurrentShaders();
+    void CompileChangedShaders();
+
+    // The flat shader, the grid and axes and the render passes, created by initializeGL or,
+    // when they are deferred, after the first frame was skipped
+    bool m_deferResources = false;
+    bool m_resourcesCreated = false;
+    bool m_skipFrame = false;
+    void CreateResources();
+    void OnShadersCompiled(const QByteArray& vertexSource, const QByteArray& fragmentSource, bool success, const QString& log);
+
+    // Meshes are drawn with the variant of m_program for their features when its shaders have
+    // them. m_baseVariant is m_program itself, m_pDrawVariant the one bound.
+    ShaderPermutations m_shaderPermutations;
+    ShaderPermutations::Variant m_baseVariant;
+    const ShaderPermutations::Variant* m_pDrawVariant = &m_baseVariant;
+    void UseMeshProgram(const Mesh& mesh);
+
+    // While set, meshes are drawn with this program instead of their variant, without material
+    // or texture, and as points if m_drawPoints is set. For the depth pre-pass and the other
+    // display modes.
+    const ShaderPermutations::Variant* m_pOverrideVariant = nullptr;
+    bool m_drawPoints = false;
+    MeshDisplayModes m_displayModes;
+    float m_pointSpacing = 0.f;
+
+    // Visible meshes in the order that changes the least state between draws, and front to
+    // back for the depth pre-pass
+    RenderQueue m_renderQueue;
+    RenderQueue m_prepassQueue;
+    void BuildRenderQueue(const QMatrix4x4& modelViewProjection, bool prepass);
+    GLuint m_boundTexture = 0;
+    const Material* m_pBoundMaterial = nullptr;
+
+    // The viewports of a split window, empty for a single view. Those with shaders of their own
+    // hold a program bound to the attribute locations of the model program, so they draw the
+    // meshes' vertex arrays as they are. m_pViewportVariant is the one meshes are drawn with
+    // while such a viewport is drawn.
+    struct SplitViewport {
+        float m_yaw = 0.f;
+        float m_pitch = 0.f;
+        QOpenGLShaderProgram* m_pProgram = nullptr;
+        ProgramInterface m_interface;
+        ShaderPermutations::Variant m_variant;
+        bool m_hasMaterialBlock = false;
+        bool m_bindless = false;
+        bool m_sectionClipping = false;
+    };
+    std::vector<SplitViewport> m_splitViewports;
+    std::vector<SplitView::View> m_splitViews;
+    const ShaderPermutations::Variant* m_pViewportVariant = nullptr;
+    // Draws the model and grid into each viewport, true while a streamed model still streams
+    bool DrawSplitViews(const RenderState& frame, const QVector3D& lightPos, bool alphaToCoverage);
+
+    // The surfaces of the last comparison and how they are shown. A comparison is measured on
+    // the thread pool and dropped when it comes in after the model shown changed, which ends
+    // the comparison shown as well.
+    ModelComparison m_modelComparison;
+    int m_compareMode = k_compareOff;
+    QFutureWatcher<QSharedPointer<SurfaceComparison>> m_comparisonWatcher;
+    int m_comparisonGeneration = 0;
+    int m_measuredGeneration = 0;
+    void StartComparison(std::function<SurfaceComparison()> measure);
+    void OnComparisonMeasured();
+    void EndComparison();
+
+    // The section planes in model space, and whether m_program writes their clip distances.
+    // The caps are marked with the meshes drawn by the depth and normals variant while
+    // m_markingSections is set, which keeps back faces the meshlets would cull.
+    std::vector<QVector4D> m_sectionPlanes;
+    bool m_fillSections = true;
+    bool m_sectionClipping = false;
+    SectionCaps m_sectionCaps;
+    bool m_markingSections = false;
+    // The view frustum of viewProjection with the section planes, moved by meshTransform into
+    // the space of a mesh
+    Frustum SectionFrustum(const QMatrix4x4& viewProjection, const QMatrix4x4& meshTransform = QMatrix4x4()) const;
+    void EnableSectionPlanes(bool enable);
+    void DrawSectionCaps(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, QOpenGLVertexArrayObject*& pBoundVao);
+
+    // The full detail of the meshes the simplification preview read back, by index into the
+    // current model, and what each drew before the preview. Previews are simplified on the
+    // thread pool, those coming in after another started or the scene changed are dropped.
+    struct SimplifiedSource {
+        int m_mesh = -1;
+        int m_indexCount = 0;
+        std::vector<MeshLod> m_lods;
+        std::vector<Meshlet> m_meshlets;
+    };
+    std::vector<SimplifiedSource> m_simplifiedSources;
+    QSharedPointer<const std::vector<MeshTriangles>> m_simplifyTriangles;
+    SimplifyOptions m_simplifyOptions;
+    SimplifyOptions m_pendingSimplify;
+    QFutureWatcher<std::vector<SimplifiedMesh>> m_simplifyWatcher;
+    int m_simplifyGeneration = 0;
+    int m_simplifiedGeneration = 0;
+    void OnSimplified();
+    // The multi-draw path keeps copies of the indices and the shadows were drawn with the
+    // old ones, both are redone after the preview changes the indices
+    void InvalidateIndices();
+
+    // Per mesh matrices, kept while the camera stands still
+    TransformCache m_transformCache;
+
+    // Per frame uniforms for shaders that declare FrameBlock, and whether m_program declares
+    // FrameBlock and MaterialBlock. Loose uniforms are only set for shaders that don't.
+    QOpenGLBuffer m_frameBlockBuffer;
+    bool m_hasFrameBlock = false;
+    // What the buffer holds, false until it holds anything
+    FrameBlock m_uploadedFrameBlock = {};
+    bool m_frameBlockCurrent = false;
+    bool m_hasMaterialBlock = false;
+
+    // Whether the context has bindless textures, and whether m_program samples the material's
+    // maps by their handles. Such a program needs no texture bound to draw a mesh.
+    bool m_bindlessTextures = false;
+    bool m_bindlessProgram = false;
+    void setUniformVars(const RenderState& frame, const QVector3D& lightPos);
+    void UpdateFrameBlock(const RenderState& frame, const QMatrix4x4& projection, const QMatrix4x4& modelView, const QVector3D& lightPos, bool alphaToCoverage, bool ambientOcclusion);
     QOpenGLShaderProgram* m_flatShader = nullptr;
     int m_frame = 0;
 
+    // Lines drawn with the flat shader, uploaded once. The buffer holds all positions, then
+    // all colors. Without vertex array objects the attributes are set up for every draw.
+    struct FlatLines {
+        QOpenGLBuffer m_buffer;
+        QOpenGLVertexArrayObject m_vao;
+        int m_vertexCount = 0;
+        int m_colorSize = 0;
+    };
+    FlatLines m_gridLines;
+    FlatLines m_axesLines;
+    void CreateFlatLines(FlatLines& lines, const GLfloat* pPositions, const GLfloat* pColors, int vertexCount, int colorSize);
+    void BindFlatLines(FlatLines& lines);
+    void ReleaseFlatLines(FlatLines& lines);
+    void EnableFlatLinesAttributes(const FlatLines& lines);
+
+    // The models shown, and their meshes composed into the one model the frame draws
+    ModelScene m_scene;
     Model m_currentModel;
 
+    // Spatial index over the meshes of m_currentModel, rebuilt whenever the scene changes
+    MeshBvh m_meshBvh;
+    std::vector<int> m_visibleMeshIndices;
+    OcclusionCuller m_occlusionCuller;
+    std::vector<std::pair<float, int>> m_occluders;
+
+    // The octree of a point cloud model, rebuilt with m_meshBvh, and the nodes it picked to
+    // draw this frame
+    PointCloudLod m_pointCloudLod;
+    std::vector<int> m_pointNodes;
+
+    // Meshes in view of a streamed model, requested from its GeometryStreamer every frame
+    std::vector<int> m_streamRequests;
+
+    // Index ranges of the meshlets DrawMesh found visible in the mesh it draws
+    std::vector<std::pair<int, int>> m_meshletRuns;
+
+    // Runs of the instances of the mesh DrawMesh draws that the SceneGraph left shown
+    std::vector<std::pair<int, int>> m_instanceRuns;
+
+    // Draws the meshes in view with a few indirect draws instead of one draw per mesh. Its
+    // arenas are built on the first frame that needs them after the model changed.
+    IndirectRenderer m_indirectRenderer;
+
+    // Poses the skinned meshes for all passes of a frame at once, whenever a pose was uploaded
+    // since the last frame. Without it the shaders skin them in each pass.
+    ComputeSkinner m_computeSkinner;
+    bool m_skinPending = false;
+
+    // Draws the shadow map when the light, the model or its pose changes, the frames between
+    // only read it. With shadows on the light is fixed to the model.
+    ShadowMapper m_shadowMapper;
+
+    // Bins the lights that came with the scene into clusters of the view, so each pixel only
+    // shades the ones reaching it
+    LightClusters m_lightClusters;
+
+    // The prefiltered HDR environment, fixed to the model like the shadowing light
+    EnvironmentLighting m_environment;
+
+    // Meshes of blended materials, which the opaque passes skip while m_deferTransparent is
+    // set. The transparency pass draws them after the opaque meshes in any order, and needs
+    // the scene drawn offscreen for its depth. m_transparentProgram is set when m_program
+    // writes the pass' targets.
+    TransparencyPass m_transparencyPass;
+    std::vector<int> m_transparentMeshes;
+    bool m_deferTransparent = false;
+    bool m_transparentProgram = false;
+    void DrawTransparent(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, const QSize& nativeSize);
+
+    // Darkens the ambient and environment light in creases, from the depth and normals of the
+    // meshes in view drawn before the shading pass
+    AmbientOcclusion m_ambientOcclusion;
+    void DrawAmbientOcclusion(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, const QSize& nativeSize);
+
+    // A left click that doesn't drag picks the mesh under the cursor, in the next frame.
+    // The hit selects the mesh and becomes the orbit pivot once it has been read back.
+    MeshPicker m_meshPicker;
+    std::vector<int> m_pickCandidates;
+    bool m_pickRequested = false;
+    QPoint m_pickPixel;
+    QPoint m_pressPosition;
+    int m_selectedMesh = -1;
+    int m_selectedTriangle = -1;
+    QVector3D m_orbitPivot;
+    void PickMesh(const QMatrix4x4& viewProjection, const QSize& viewport);
+    void ApplyPick(const MeshPicker::Hit& hit);
+    void RenderSelection();
+
+    // Base color maps too large to upload whole are drawn from the pages the view needs, which
+    // a feedback pass after the scene finds whenever the view changed
+    VirtualTextures m_virtualTextures;
+    std::vector<int> m_feedbackMeshes;
+    void DrawPageFeedback(const QMatrix4x4& viewProjection, const QSize& viewport);
+
+    // Binds the mesh, unless pBoundVao already is its vertex array object, and draws all of
+    // its instances at the level of detail its size on screen calls for
+    void DrawMesh(int meshIdx, const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, QOpenGLVertexArrayObject*& pBoundVao);
+    void DrawOcclusionCulled(const QMatrix4x4& viewMatrix, const QMatrix4x4& modelMatrix, QOpenGLVertexArrayObject*& pBoundVao);
+    TextureCache m_textureCache;
+    TextureUploader m_textureUploader;
+    AsyncModelLoader* m_pModelLoader = nullptr;
+    AsyncModelExporter* m_pModelExporter = nullptr;
+    bool m_showingPreview = false;
+    bool m_addingToScene = false;
+
+    // The file of the model evicted while the window was hidden, and whether the load that
+    // brings it back keeps the view it was left in
+    bool m_suspended = false;
+    QTimer m_evictTimer;
+    QString m_evictedFile;
+    bool m_keepView = false;
+
+    // Thumbnails are taken of the first frame a loaded model is shown in
+    ThumbnailIndex m_thumbnailIndex;
+    QElapsedTimer m_loadTimer;
+    void IndexModel(const QString& filepath);
+
+    // Generated primitives, uploaded by shape and tessellation the first time they are added
+    QHash<QPair<int, int>, Model> m_primitiveModels;
+    bool StartModelLoad(const QString& filepath, bool addToScene);
+    // Turns the path of an archive into the path of the model to load from it. False if the
+    // archive holds no model or the user cancelled.
+    bool ChooseArchiveModel(QString& filepath);
+
+    // The file the primary model was loaded from, empty for models that weren't read from one
+    QString m_primaryFile;
+
+    // Replaces the primary model of the scene, or adds a model beside it, and shows the result
+    void SetPrimaryModel(Model model, const QString& name);
+    void AddSceneModel(Model model, const QString& name);
+    void ApplyScene();
+
+    // Skinned meshes of the primary model are posed by m_animation, the others stand at rest.
+    // Posing uploads the bone matrices and moves the bounds of the meshes, so the context has
+    // to be current.
+    AnimationPlayer m_animation;
+    std::vector<QMatrix4x4> m_bonePalette;
+    void PoseScene();
+    void PoseSkinnedMeshes(const AnimationPlayer& player);
+
+    // Set by the Smoothing switch. The composed meshes then have smooth normals in place of
+    // the ones they were loaded with, see GpuModelBuilder::SmoothNormals. The context has to
+    // be current.
+    bool m_smoothNormals = false;
+    void ApplySmoothing();
+
+    // The node tree of the primary model as the user changed it, copied from m_restSceneGraph
+    // when the primary model changes. The draws each node places follow one another in
+    // m_nodeDraws, from m_nodeDrawStart[node] on, instance -1 being a mesh drawn once.
+    struct NodeDraw {
+        int m_mesh;
+        int m_instance;
+    };
+    SceneGraph m_sceneGraph;
+    QSharedPointer<const SceneGraph> m_restSceneGraph;
+    std::vector<int> m_nodeDrawStart;
+    std::vector<NodeDraw> m_nodeDraws;
+    std::vector<int> m_placedMeshes;
+    void ResetSceneGraph();
+
+    // Places the draws of the moved nodes, and updates the bounds and matrices of their
+    // meshes. The context has to be current.
+    void PlaceSceneNodes();
+
+    // Hides and shows the draws of the nodes whose visibility changed
+    void ShowSceneNodes();
+
+    // Set by the Flat Shading switch, which the frame block passes on to the shaders
+    bool m_flatShading = false;
+
     // Stores the scale for drawing the grid under the object
     float m_gridScale = 1.f;
 
@@ -193,7 +956,7 @@ private:
     float rotY;
     bool m_leftMousePressed = false;
     bool m_rightMousePressed = false;
-    QSet<QKeySequence> m_pressedKeys;
+    quint64 m_pressedKeys = 0;
     QMatrix4x4 m_scaleMatrix;
     QMatrix4x4 m_transMatrix;
 };
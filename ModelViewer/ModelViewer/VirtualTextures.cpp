@@ -0,0 +1,837 @@
+#include "VirtualTextures.h"
+#include "Frustum.h"
+#include "GpuModelBuilder.h"
+#include "JobSystem.h"
+#include "StateCache.h"
+#include "UniformBlocks.h"
+
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QOpenGLVertexArrayObject>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#ifndef GL_CLIP_DISTANCE0
+#define GL_CLIP_DISTANCE0 0x3000
+#endif
+
+
+namespace {
+
+// Section planes are in model space, uModel takes a vertex there
+const char* k_feedbackVertexShaderSource =
+	"#version 330\n"
+	"in highp vec4 posAttr;\n"
+	"in highp vec2 uvAttr;\n"
+	"in highp mat4 instanceAttr;\n"
+	"uniform highp mat4 matrix;\n"
+	"uniform highp mat4 uModel;\n"
+	"uniform highp vec4 uSectionPlanes[6];\n"
+	"out vec2 vUv;\n"
+	"out float gl_ClipDistance[6];\n"
+	"void main() {\n"
+	"   vUv = uvAttr;\n"
+	"   vec4 position = instanceAttr * posAttr;\n"
+	"   vec4 model = uModel * position;\n"
+	"   for (int i = 0; i < 6; ++i) {\n"
+	"      gl_ClipDistance[i] = dot(uSectionPlanes[i], model);\n"
+	"   }\n"
+	"   gl_Position = matrix * position;\n"
+	"}\n";
+
+// The level of detail is that of SampleVirtualMap at the scene's resolution, the feedback's
+// pixels are k_feedbackScale times larger. uVirtual is VirtualTexture::Parameters, its slot is
+// negative for meshes without a paged map, which only hide what's behind them. The request is
+// the page across and up, the level and the slot plus one, 0 where nothing is needed.
+const char* k_feedbackFragmentShaderSource =
+	"#version 330\n"
+	"in vec2 vUv;\n"
+	"uniform vec4 uVirtual;\n"
+	"out vec4 request;\n"
+	"void main() {\n"
+	"   vec2 texelDx = dFdx(vUv) * uVirtual.xy;\n"
+	"   vec2 texelDy = dFdy(vUv) * uVirtual.xy;\n"
+	"   float lod = 0.5 * log2(max(max(dot(texelDx, texelDx), dot(texelDy, texelDy)), 1e-8)) - 3.0;\n"
+	"   float level = max(floor(lod), 0.0);\n"
+	"   if (uVirtual.w < 0.0 || level >= uVirtual.z) {\n"
+	"      request = vec4(0.0);\n"
+	"      return;\n"
+	"   }\n"
+	"   vec2 size = ceil(uVirtual.xy / exp2(level));\n"
+	"   vec2 page = floor(clamp(clamp(vUv, 0.0, 1.0) * size, vec2(0.0), size - 0.5) / 120.0);\n"
+	"   request = vec4(page, level, uVirtual.w + 1.0) / 255.0;\n"
+	"}\n";
+static_assert(VirtualTextures::k_feedbackScale == 8, "The feedback shader's bias has to match its scale");
+static_assert(PageFile::k_pageContent == 120, "The feedback shader has to match the pages");
+
+// The page tables have a texel per page of a texture's first level, halving with each level
+const int k_tableSize = PageFile::k_maxPages;
+const int k_tableLevels = 9;
+static_assert(1 << (k_tableLevels - 1) == k_tableSize, "The page tables need a level down to one texel");
+
+const qint64 k_pageBytes = qint64(PageFile::k_pageSize) * PageFile::k_pageSize * 4;
+
+quint32 TableEntry(int atlasX, int atlasY, int level)
+{
+	const uchar texel[4] = { uchar(atlasX), uchar(atlasY), uchar(level), 255 };
+	quint32 entry = 0;
+	std::memcpy(&entry, texel, sizeof(entry));
+	return entry;
+}
+
+int RequestLevel(quint32 request)
+{
+	return int((request >> 24) & 0xF);
+}
+
+}
+
+const PageFile& VirtualTexture::Pages() const
+{
+	return *m_pages;
+}
+
+int VirtualTexture::Slot() const
+{
+	return m_slot;
+}
+
+void VirtualTexture::Parameters(GLfloat* pParameters) const
+{
+	pParameters[0] = GLfloat(m_pages->Size().width());
+	pParameters[1] = GLfloat(m_pages->Size().height());
+	pParameters[2] = GLfloat(m_pages->Levels());
+	pParameters[3] = GLfloat(m_slot);
+}
+
+VirtualTextures::~VirtualTextures()
+{
+	// The textures go with the context, only the program is left
+	delete m_pProgram;
+}
+
+bool VirtualTextures::Create()
+{
+	Destroy();
+
+	QOpenGLContext* pContext = QOpenGLContext::currentContext();
+	if (!pContext || pContext->isOpenGLES() || pContext->format().version() < qMakePair(3, 3)) {
+		return false;
+	}
+	m_pFunctions = pContext->extraFunctions();
+
+	m_pProgram = new QOpenGLShaderProgram();
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Vertex, k_feedbackVertexShaderSource);
+	m_pProgram->addCacheableShaderFromSourceCode(QOpenGLShader::Fragment, k_feedbackFragmentShaderSource);
+	m_pProgram->bindAttributeLocation("posAttr", k_positionLocation);
+	m_pProgram->bindAttributeLocation("uvAttr", k_uvLocation);
+	m_pProgram->bindAttributeLocation("instanceAttr", k_instanceLocation);
+	if (!m_pProgram->link()) {
+		qWarning("Could not link the page feedback shader: %s", qPrintable(m_pProgram->log()));
+		Destroy();
+		return false;
+	}
+	m_matrixUniform = m_pProgram->uniformLocation("matrix");
+	m_modelUniform = m_pProgram->uniformLocation("uModel");
+	m_sectionPlanesUniform = m_pProgram->uniformLocation("uSectionPlanes");
+	m_virtualUniform = m_pProgram->uniformLocation("uVirtual");
+
+	// The framebuffer is sized by the first feedback, the atlas by the first texture
+	m_readback.setUsagePattern(QOpenGLBuffer::StreamRead);
+	if (!m_readback.create()) {
+		Destroy();
+		return false;
+	}
+	m_feedbackStale = true;
+	m_created = true;
+	return true;
+}
+
+void VirtualTextures::Destroy()
+{
+	if (m_pFunctions && QOpenGLContext::currentContext()) {
+		if (m_fence) {
+			m_pFunctions->glDeleteSync(m_fence);
+		}
+		m_pFunctions->glDeleteFramebuffers(1, &m_framebuffer);
+		m_pFunctions->glDeleteRenderbuffers(1, &m_requestBuffer);
+		m_pFunctions->glDeleteRenderbuffers(1, &m_depthBuffer);
+		m_pFunctions->glDeleteTextures(1, &m_atlas);
+		m_pFunctions->glDeleteTextures(1, &m_pageTables);
+		m_readback.destroy();
+	}
+	delete m_pProgram;
+	m_pProgram = nullptr;
+	m_fence = nullptr;
+	m_framebuffer = 0;
+	m_requestBuffer = 0;
+	m_depthBuffer = 0;
+	m_feedbackSize = QSize();
+	m_atlas = 0;
+	m_pageTables = 0;
+	m_atlasSide = 0;
+	m_pFunctions = nullptr;
+	m_created = false;
+
+	// Pages still being read are dropped with the textures they were for
+	for (int slot = 0; slot < k_maxTextures; ++slot) {
+		m_textures[slot].clear();
+		m_slotUsed[slot] = false;
+	}
+	m_atlasPages.clear();
+	m_resident.clear();
+	m_loads.clear();
+	m_loading.clear();
+	m_wanted.clear();
+}
+
+bool VirtualTextures::IsCreated() const
+{
+	return m_created;
+}
+
+void VirtualTextures::SetBudget(qint64 bytes)
+{
+	if (bytes != m_budget) {
+		m_budget = bytes;
+		m_budgetChanged = true;
+	}
+}
+
+qint64 VirtualTextures::Budget() const
+{
+	return m_budget;
+}
+
+qint64 VirtualTextures::Bytes() const
+{
+	qint64 bytes = 0;
+	if (m_atlas) {
+		bytes += qint64(m_atlasSide) * m_atlasSide * k_pageBytes;
+	}
+	if (m_pageTables) {
+		bytes += qint64(k_tableSize) * k_tableSize * 4 * k_maxTextures * 4 / 3;
+	}
+	return bytes;
+}
+
+QSharedPointer<VirtualTexture> VirtualTextures::Get(const QString& pageFile)
+{
+	if (!m_created) {
+		return QSharedPointer<VirtualTexture>();
+	}
+
+	// Materials of the same texture share it
+	int freeSlot = -1;
+	for (int slot = 0; slot < k_maxTextures; ++slot) {
+		const QSharedPointer<VirtualTexture> texture = m_textures[slot].toStrongRef();
+		if (texture && texture->m_pages->Path() == pageFile) {
+			return texture;
+		}
+		if (!texture && freeSlot < 0) {
+			freeSlot = slot;
+		}
+	}
+	if (freeSlot < 0) {
+		qWarning("Only %d textures are paged at once, %s is drawn from its tail", k_maxTextures, qPrintable(pageFile));
+		return QSharedPointer<VirtualTexture>();
+	}
+	QSharedPointer<PageFile> pages(new PageFile());
+	if (!pages->Open(pageFile) || pages->LevelPages(0).width() > k_tableSize || pages->LevelPages(0).height() > k_tableSize
+		|| (!m_atlas && !AllocateAtlas())) {
+		return QSharedPointer<VirtualTexture>();
+	}
+
+	// The pages of a texture that went since the last Update are freed first
+	ReleaseSlot(freeSlot);
+	QSharedPointer<VirtualTexture> texture(new VirtualTexture());
+	texture->m_pages = pages;
+	texture->m_slot = freeSlot;
+	texture->m_atlasPages.resize(pages->Levels());
+	for (int level = 0; level < pages->Levels(); ++level) {
+		const QSize levelPages = pages->LevelPages(level);
+		texture->m_atlasPages[level].assign(size_t(levelPages.width()) * levelPages.height(), -1);
+	}
+	m_textures[freeSlot] = texture;
+	m_slotUsed[freeSlot] = true;
+	m_feedbackStale = true;
+	return texture;
+}
+
+int VirtualTextures::Count() const
+{
+	int count = 0;
+	for (const QWeakPointer<VirtualTexture>& texture : m_textures) {
+		if (!texture.isNull()) {
+			++count;
+		}
+	}
+	return count;
+}
+
+int VirtualTextures::ResidentPages() const
+{
+	return m_resident.size();
+}
+
+int VirtualTextures::AtlasPages() const
+{
+	return int(m_atlasPages.size());
+}
+
+bool VirtualTextures::HasTextures() const
+{
+	return Count() > 0;
+}
+
+void VirtualTextures::Invalidate()
+{
+	m_feedbackStale = true;
+}
+
+bool VirtualTextures::NeedsFeedback(const QMatrix4x4& viewProjection, const QSize& viewport) const
+{
+	return m_created && m_atlas && !m_fence && HasTextures()
+		&& (m_feedbackStale || viewProjection != m_feedbackViewProjection || viewport != m_feedbackViewport);
+}
+
+void VirtualTextures::DrawFeedback(Model& model, const std::vector<int>& meshes, const QMatrix4x4& viewProjection, const QSize& viewport, GLuint framebuffer,
+	const std::vector<QVector4D>& sectionPlanes)
+{
+	if (!m_created || viewport.isEmpty()) {
+		return;
+	}
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	StateCache& state = StateCache::Current();
+	if (m_fence) {
+		f->glDeleteSync(m_fence);
+		m_fence = nullptr;
+	}
+	m_feedbackViewProjection = viewProjection;
+	m_feedbackViewport = viewport;
+	m_feedbackStale = false;
+
+	// The framebuffer follows the size of the scene
+	const QSize size((viewport.width() + k_feedbackScale - 1) / k_feedbackScale, (viewport.height() + k_feedbackScale - 1) / k_feedbackScale);
+	if (size != m_feedbackSize) {
+		f->glDeleteFramebuffers(1, &m_framebuffer);
+		f->glDeleteRenderbuffers(1, &m_requestBuffer);
+		f->glDeleteRenderbuffers(1, &m_depthBuffer);
+		f->glGenRenderbuffers(1, &m_requestBuffer);
+		f->glBindRenderbuffer(GL_RENDERBUFFER, m_requestBuffer);
+		f->glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size.width(), size.height());
+		f->glGenRenderbuffers(1, &m_depthBuffer);
+		f->glBindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+		f->glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, size.width(), size.height());
+		f->glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		f->glGenFramebuffers(1, &m_framebuffer);
+		f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+		f->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_requestBuffer);
+		f->glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+		const bool complete = f->glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		m_readback.bind();
+		m_readback.allocate(size.width() * size.height() * 4);
+		m_readback.release();
+		m_feedbackSize = complete ? size : QSize();
+		if (!complete) {
+			f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+			return;
+		}
+	}
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	state.Viewport(0, 0, size.width(), size.height());
+	const GLfloat background[4] = {};
+	const GLfloat farDepth = 1.f;
+	f->glClearBufferfv(GL_COLOR, 0, background);
+	f->glClearBufferfv(GL_DEPTH, 0, &farDepth);
+	state.Enable(GL_DEPTH_TEST);
+	state.DepthFunc(GL_LESS);
+	state.DepthMask(true);
+	state.ColorMask(true);
+	state.Disable(GL_BLEND);
+
+	m_pProgram->bind();
+
+	// Meshes drawn without instancing use the identity as their instance transform, and those
+	// without UVs ask for the corner page
+	const QMatrix4x4 identity;
+	m_pProgram->setAttributeValue(k_instanceLocation, identity.constData(), 4, 4);
+	m_pProgram->setAttributeValue(k_uvLocation, 0.f, 0.f);
+
+	// Planes that aren't set keep everything
+	QVector4D planes[Frustum::k_maxExtraPlanes];
+	const int planeCount = std::min(int(sectionPlanes.size()), int(Frustum::k_maxExtraPlanes));
+	for (int i = 0; i < Frustum::k_maxExtraPlanes; ++i) {
+		planes[i] = i < planeCount ? sectionPlanes[i] : QVector4D(0.f, 0.f, 0.f, 1.f);
+		state.SetEnabled(GL_CLIP_DISTANCE0 + i, i < planeCount);
+	}
+	m_pProgram->setUniformValueArray(m_sectionPlanesUniform, planes, Frustum::k_maxExtraPlanes);
+
+	QOpenGLVertexArrayObject* pBoundVao = nullptr;
+	std::vector<std::pair<int, int>> runs;
+	for (int meshIdx : meshes) {
+		Mesh& mesh = model.m_meshes[meshIdx];
+		if (mesh.IsHidden()) {
+			continue;
+		}
+		if (mesh.m_vao) {
+			mesh.m_vao->bind();
+			pBoundVao = mesh.m_vao.data();
+		}
+		else {
+			if (pBoundVao) {
+				pBoundVao->release();
+				pBoundVao = nullptr;
+			}
+			mesh.m_vertexBuffer.bind();
+			mesh.m_indexBuffer.bind();
+			GpuModelBuilder::EnableAttributes(f, mesh);
+		}
+
+		GLfloat parameters[4] = { 0.f, 0.f, 0.f, -1.f };
+		if (mesh.m_material && mesh.m_material->m_virtualBaseColor) {
+			mesh.m_material->m_virtualBaseColor->Parameters(parameters);
+		}
+		m_pProgram->setUniformValue(m_virtualUniform, QVector4D(parameters[0], parameters[1], parameters[2], parameters[3]));
+		auto Draw = [&](const QMatrix4x4& transform) {
+			m_pProgram->setUniformValue(m_matrixUniform, viewProjection * transform * mesh.m_positionDecode);
+			m_pProgram->setUniformValue(m_modelUniform, transform * mesh.m_positionDecode);
+			GpuModelBuilder::DrawElements(f, mesh, 0, mesh.m_indexCount);
+		};
+		GpuModelBuilder::VisibleRuns(mesh, runs);
+		if (mesh.m_instanced) {
+			m_pProgram->setUniformValue(m_matrixUniform, viewProjection * mesh.m_placement);
+			m_pProgram->setUniformValue(m_modelUniform, mesh.m_placement);
+			for (const std::pair<int, int>& run : runs) {
+				if (mesh.m_hiddenDrawCount > 0) {
+					GpuModelBuilder::SetFirstInstance(f, mesh, run.first);
+				}
+				GpuModelBuilder::DrawElements(f, mesh, 0, mesh.m_indexCount, run.second);
+			}
+			if (mesh.m_hiddenDrawCount > 0) {
+				GpuModelBuilder::SetFirstInstance(f, mesh, 0);
+			}
+		}
+		else if (!mesh.m_instanceTransforms.empty()) {
+			for (const std::pair<int, int>& run : runs) {
+				for (int i = run.first; i < run.first + run.second; ++i) {
+					Draw(mesh.m_instanceTransforms[i]);
+				}
+			}
+		}
+		else {
+			Draw(mesh.m_transform);
+		}
+
+		if (!mesh.m_vao) {
+			GpuModelBuilder::DisableAttributes(f, mesh);
+			mesh.m_vertexBuffer.release();
+			mesh.m_indexBuffer.release();
+		}
+	}
+	if (pBoundVao) {
+		pBoundVao->release();
+	}
+	m_pProgram->release();
+	for (int i = 0; i < planeCount; ++i) {
+		state.Disable(GL_CLIP_DISTANCE0 + i);
+	}
+
+	// Queue the readback, Update maps it once the fence has passed
+	m_readback.bind();
+	f->glReadBuffer(GL_COLOR_ATTACHMENT0);
+	f->glReadPixels(0, 0, size.width(), size.height(), GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	m_readback.release();
+	m_fence = f->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	state.Viewport(0, 0, viewport.width(), viewport.height());
+}
+
+bool VirtualTextures::Update()
+{
+	if (!m_created) {
+		return false;
+	}
+
+	// Pages of textures whose last material went make room for the others
+	for (int slot = 0; slot < k_maxTextures; ++slot) {
+		if (m_slotUsed[slot] && m_textures[slot].isNull()) {
+			ReleaseSlot(slot);
+		}
+	}
+	if (m_budgetChanged && m_atlas) {
+		ReleaseAtlas();
+		AllocateAtlas();
+	}
+	m_budgetChanged = false;
+	if (!m_atlas) {
+		return false;
+	}
+
+	TakeFeedback();
+	QueueLoads();
+	const bool uploaded = UploadPages();
+	UploadTables();
+	Bind();
+	return uploaded;
+}
+
+bool VirtualTextures::IsStreaming() const
+{
+	return m_fence || !m_loads.empty() || !m_wanted.empty();
+}
+
+bool VirtualTextures::AllocateAtlas()
+{
+	QOpenGLExtraFunctions* f = m_pFunctions;
+
+	// As many pages as the budget holds, in a square the atlas coordinates of the page tables
+	// can address
+	GLint maxSize = 0;
+	f->glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	const int maxSide = std::min(int(maxSize) / PageFile::k_pageSize, 255);
+	m_atlasSide = qBound(4, int(std::sqrt(double(m_budget) / double(k_pageBytes))), std::max(4, maxSide));
+	const int atlasSize = m_atlasSide * PageFile::k_pageSize;
+
+	f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_pageAtlasUnit);
+	f->glGenTextures(1, &m_atlas);
+	f->glBindTexture(GL_TEXTURE_2D, m_atlas);
+	f->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	f->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+	// A layer of page tables per slot, their texels are fetched rather than filtered
+	if (!m_pageTables) {
+		f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_pageTableUnit);
+		f->glGenTextures(1, &m_pageTables);
+		f->glBindTexture(GL_TEXTURE_2D_ARRAY, m_pageTables);
+		for (int level = 0; level < k_tableLevels; ++level) {
+			const int levelSize = k_tableSize >> level;
+			f->glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, levelSize, levelSize, k_maxTextures, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+		}
+		f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		f->glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, k_tableLevels - 1);
+	}
+	f->glActiveTexture(GL_TEXTURE0);
+
+	m_atlasPages.assign(size_t(m_atlasSide) * m_atlasSide, AtlasPage());
+	m_resident.clear();
+	m_feedbackStale = true;
+	return m_atlas != 0 && m_pageTables != 0;
+}
+
+void VirtualTextures::ReleaseAtlas()
+{
+	m_pFunctions->glDeleteTextures(1, &m_atlas);
+	m_atlas = 0;
+	m_atlasPages.clear();
+	m_resident.clear();
+	for (const QWeakPointer<VirtualTexture>& weak : m_textures) {
+		const QSharedPointer<VirtualTexture> texture = weak.toStrongRef();
+		if (texture) {
+			for (std::vector<int>& levelPages : texture->m_atlasPages) {
+				std::fill(levelPages.begin(), levelPages.end(), -1);
+			}
+			texture->m_tableChanged = true;
+		}
+	}
+}
+
+void VirtualTextures::ReleaseSlot(int slot)
+{
+	for (int i = 0; i < int(m_atlasPages.size()); ++i) {
+		int pageSlot, level, x, y;
+		UnpackRequest(m_atlasPages[i].m_request, pageSlot, level, x, y);
+		if (m_atlasPages[i].m_used && pageSlot == slot) {
+			m_resident.remove(m_atlasPages[i].m_request);
+			m_atlasPages[i] = AtlasPage();
+		}
+	}
+	auto OfSlot = [slot](quint32 request) {
+		return int(request >> 28) == slot;
+	};
+	for (auto it = m_loads.begin(); it != m_loads.end();) {
+		if (OfSlot(it->m_request)) {
+			m_loading.remove(it->m_request);
+			it = m_loads.erase(it);
+		}
+		else {
+			++it;
+		}
+	}
+	m_wanted.erase(std::remove_if(m_wanted.begin(), m_wanted.end(), OfSlot), m_wanted.end());
+	m_slotUsed[slot] = false;
+}
+
+void VirtualTextures::TakeFeedback()
+{
+	if (!m_fence) {
+		return;
+	}
+	const GLenum status = m_pFunctions->glClientWaitSync(m_fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+		return;
+	}
+	m_pFunctions->glDeleteSync(m_fence);
+	m_fence = nullptr;
+
+	QSet<quint32> requests;
+	const int bytes = m_feedbackSize.width() * m_feedbackSize.height() * 4;
+	m_readback.bind();
+	const uchar* pData = static_cast<const uchar*>(m_readback.mapRange(0, bytes, QOpenGLBuffer::RangeRead));
+	if (pData) {
+		quint32 request = 0;
+		for (int i = 0; i < bytes; i += 4) {
+			if (ReadFeedback(pData + i, request)) {
+				requests.insert(request);
+			}
+		}
+		m_readback.unmap();
+	}
+	m_readback.release();
+
+	// Each page needs its ancestors, which are drawn in its place until it comes in
+	QSet<quint32> needed;
+	for (quint32 request : requests) {
+		int slot, level, x, y;
+		UnpackRequest(request, slot, level, x, y);
+		const QSharedPointer<VirtualTexture> texture = m_textures[slot].toStrongRef();
+		if (!texture) {
+			continue;
+		}
+		for (; level < texture->m_pages->Levels(); ++level, x /= 2, y /= 2) {
+			const QSize levelPages = texture->m_pages->LevelPages(level);
+			if (x >= levelPages.width() || y >= levelPages.height()) {
+				break;
+			}
+			needed.insert(PackRequest(slot, level, x, y));
+		}
+	}
+
+	// Resident pages in view are kept, the others are wanted unless they are on their way
+	++m_feedbackSerial;
+	int pinned = 0;
+	m_wanted.clear();
+	for (quint32 request : needed) {
+		auto it = m_resident.find(request);
+		if (it != m_resident.end()) {
+			m_atlasPages[it.value()].m_lastNeeded = m_feedbackSerial;
+			++pinned;
+		}
+		else if (!m_loading.contains(request)) {
+			m_wanted.push_back(request);
+		}
+	}
+
+	// Coarse pages stand in for the finer ones, so they come first. The finest that don't fit
+	// the atlas next to the pages in view are left out.
+	std::sort(m_wanted.begin(), m_wanted.end(), [](quint32 a, quint32 b) {
+		return RequestLevel(a) != RequestLevel(b) ? RequestLevel(a) < RequestLevel(b) : a > b;
+	});
+	const int room = std::max(0, AtlasPages() - pinned - m_loading.size());
+	if (int(m_wanted.size()) > room) {
+		m_wanted.erase(m_wanted.begin(), m_wanted.end() - room);
+	}
+}
+
+void VirtualTextures::QueueLoads()
+{
+	while (!m_wanted.empty() && int(m_loads.size()) < k_maxLoads) {
+		const quint32 request = m_wanted.back();
+		m_wanted.pop_back();
+		int slot, level, x, y;
+		UnpackRequest(request, slot, level, x, y);
+		const QSharedPointer<VirtualTexture> texture = m_textures[slot].toStrongRef();
+		if (!texture) {
+			continue;
+		}
+		const QSharedPointer<const PageFile> pages = texture->m_pages;
+		Load load;
+		load.m_request = request;
+		load.m_texture = texture;
+		load.m_page = JobSystem::Run(JobPriority::Interactive, [pages, level, x, y] {
+			return pages->ReadPage(level, x, y);
+		});
+		m_loads.push_back(load);
+		m_loading.insert(request);
+	}
+}
+
+bool VirtualTextures::UploadPages()
+{
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	int uploads = 0;
+	for (auto it = m_loads.begin(); it != m_loads.end() && uploads < k_uploadsPerFrame;) {
+		if (!it->m_page.isFinished()) {
+			++it;
+			continue;
+		}
+		const quint32 request = it->m_request;
+		const QSharedPointer<VirtualTexture> texture = it->m_texture.toStrongRef();
+		const QImage page = it->m_page.isCanceled() ? QImage() : it->m_page.result();
+		m_loading.remove(request);
+		it = m_loads.erase(it);
+
+		int slot, level, x, y;
+		UnpackRequest(request, slot, level, x, y);
+		if (!texture || texture->m_slot != slot || page.isNull()) {
+			continue;
+		}
+		const int atlasPage = TakeAtlasPage();
+		if (atlasPage < 0) {
+			continue;
+		}
+		if (uploads == 0) {
+			f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_pageAtlasUnit);
+			f->glBindTexture(GL_TEXTURE_2D, m_atlas);
+		}
+		const int atlasX = atlasPage % m_atlasSide;
+		const int atlasY = atlasPage / m_atlasSide;
+		f->glTexSubImage2D(GL_TEXTURE_2D, 0, atlasX * PageFile::k_pageSize, atlasY * PageFile::k_pageSize, PageFile::k_pageSize, PageFile::k_pageSize,
+			GL_RGBA, GL_UNSIGNED_BYTE, page.constBits());
+
+		AtlasPage& entry = m_atlasPages[atlasPage];
+		entry.m_request = request;
+		entry.m_used = true;
+		entry.m_lastNeeded = m_feedbackSerial;
+		m_resident.insert(request, atlasPage);
+		texture->m_atlasPages[level][size_t(y) * texture->m_pages->LevelPages(level).width() + x] = atlasPage;
+		texture->m_tableChanged = true;
+		++uploads;
+	}
+	if (uploads > 0) {
+		f->glActiveTexture(GL_TEXTURE0);
+	}
+	return uploads > 0;
+}
+
+int VirtualTextures::TakeAtlasPage()
+{
+	int oldest = -1;
+	for (int i = 0; i < int(m_atlasPages.size()); ++i) {
+		const AtlasPage& page = m_atlasPages[i];
+		if (!page.m_used) {
+			return i;
+		}
+		if (page.m_lastNeeded < m_feedbackSerial && (oldest < 0 || page.m_lastNeeded < m_atlasPages[oldest].m_lastNeeded)) {
+			oldest = i;
+		}
+	}
+	if (oldest >= 0) {
+		Evict(oldest);
+	}
+	return oldest;
+}
+
+void VirtualTextures::Evict(int atlasPage)
+{
+	const quint32 request = m_atlasPages[atlasPage].m_request;
+	m_resident.remove(request);
+	m_atlasPages[atlasPage] = AtlasPage();
+	int slot, level, x, y;
+	UnpackRequest(request, slot, level, x, y);
+	const QSharedPointer<VirtualTexture> texture = m_textures[slot].toStrongRef();
+	if (texture && level < int(texture->m_atlasPages.size())) {
+		texture->m_atlasPages[level][size_t(y) * texture->m_pages->LevelPages(level).width() + x] = -1;
+		texture->m_tableChanged = true;
+	}
+}
+
+void VirtualTextures::UploadTables()
+{
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	bool bound = false;
+	std::vector<QSize> levelPages;
+	std::vector<std::vector<quint32>> table;
+	for (const QWeakPointer<VirtualTexture>& weak : m_textures) {
+		const QSharedPointer<VirtualTexture> texture = weak.toStrongRef();
+		if (!texture || !texture->m_tableChanged) {
+			continue;
+		}
+		if (!bound) {
+			f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_pageTableUnit);
+			f->glBindTexture(GL_TEXTURE_2D_ARRAY, m_pageTables);
+			bound = true;
+		}
+		levelPages.clear();
+		for (int level = 0; level < texture->m_pages->Levels(); ++level) {
+			levelPages.push_back(texture->m_pages->LevelPages(level));
+		}
+		FillPageTable(texture->m_atlasPages, levelPages, m_atlasSide, table);
+		for (int level = 0; level < int(table.size()) && level < k_tableLevels; ++level) {
+			f->glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, texture->m_slot, levelPages[level].width(), levelPages[level].height(), 1,
+				GL_RGBA, GL_UNSIGNED_BYTE, table[level].data());
+		}
+		texture->m_tableChanged = false;
+	}
+	if (bound) {
+		f->glActiveTexture(GL_TEXTURE0);
+	}
+}
+
+void VirtualTextures::Bind()
+{
+	QOpenGLExtraFunctions* f = m_pFunctions;
+	f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_pageTableUnit);
+	f->glBindTexture(GL_TEXTURE_2D_ARRAY, m_pageTables);
+	f->glActiveTexture(GL_TEXTURE0 + UniformBlocks::k_pageAtlasUnit);
+	f->glBindTexture(GL_TEXTURE_2D, m_atlas);
+	f->glActiveTexture(GL_TEXTURE0);
+}
+
+quint32 VirtualTextures::PackRequest(int slot, int level, int x, int y)
+{
+	return quint32(slot) << 28 | quint32(level) << 24 | quint32(x) << 12 | quint32(y);
+}
+
+void VirtualTextures::UnpackRequest(quint32 request, int& slot, int& level, int& x, int& y)
+{
+	slot = int(request >> 28);
+	level = RequestLevel(request);
+	x = int((request >> 12) & 0xFFF);
+	y = int(request & 0xFFF);
+}
+
+bool VirtualTextures::ReadFeedback(const uchar* pTexel, quint32& request)
+{
+	// The slot is stored plus one, so cleared pixels ask for nothing
+	if (pTexel[3] == 0 || pTexel[3] > k_maxTextures) {
+		return false;
+	}
+	request = PackRequest(pTexel[3] - 1, pTexel[2], pTexel[0], pTexel[1]);
+	return true;
+}
+
+void VirtualTextures::FillPageTable(const std::vector<std::vector<int>>& atlasPages, const std::vector<QSize>& levelPages, int atlasSide,
+	std::vector<std::vector<quint32>>& table)
+{
+	// From the coarsest level down, so each missing page can take its parent's entry
+	const int levels = int(levelPages.size());
+	table.resize(levels);
+	for (int level = levels - 1; level >= 0; --level) {
+		const QSize pages = levelPages[level];
+		std::vector<quint32>& entries = table[level];
+		entries.assign(size_t(pages.width()) * pages.height(), 0);
+		for (int y = 0; y < pages.height(); ++y) {
+			for (int x = 0; x < pages.width(); ++x) {
+				const size_t index = size_t(y) * pages.width() + x;
+				const int atlasPage = atlasPages[level][index];
+				if (atlasPage >= 0) {
+					entries[index] = TableEntry(atlasPage % atlasSide, atlasPage / atlasSide, level);
+				}
+				else if (level + 1 < levels) {
+					entries[index] = table[level + 1][size_t(y / 2) * levelPages[level + 1].width() + x / 2];
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include <vector>
+
+#include <QFuture>
+#include <QHash>
+#include <QImage>
+#include <QMatrix4x4>
+#include <QOpenGLBuffer>
+#include <QSet>
+#include <QSharedPointer>
+#include <QSize>
+#include <QVector4D>
+#include <QWeakPointer>
+#include <qopengl.h>
+
+#include "PageFile.h"
+
+class QOpenGLExtraFunctions;
+class QOpenGLShaderProgram;
+struct Model;
+
+// A paged base color map of the VirtualTextures, shared by the materials using it like the
+// textures of the TextureCache, and freed with the last of them
+class VirtualTexture
+{
+public:
+	const PageFile& Pages() const;
+
+	// Its layer of the page tables
+	int Slot() const;
+
+	// What MaterialBlock::m_virtual holds for it: the width and height of its first level,
+	// the number of paged levels and its slot
+	void Parameters(GLfloat* pParameters) const;
+
+private:
+	friend class VirtualTextures;
+
+	QSharedPointer<const PageFile> m_pages;
+	int m_slot = -1;
+
+	// The atlas page holding each page of each level, -1 for those that aren't resident
+	std::vector<std::vector<int>> m_atlasPages;
+	bool m_tableChanged = true;
+};
+
+// Streams the pages of base color maps too large to upload whole into an atlas of a fixed
+// size, however large the textures are. A feedback pass draws the visible meshes at
+// 1 / k_feedbackScale of the scene's resolution with the page and level of detail each pixel
+// of a paged map needs, and reads them back through a fenced pixel buffer a frame later, as the
+// MeshPicker does. The pages missing from the atlas are read from their PageFile on the job
+// system, coarsest first, and replace those the last feedback didn't ask for, least recently
+// needed first. Each texture has a layer of the page tables, a mip chain with an entry per
+// page pointing at its atlas page, or at that of its nearest resident ancestor, so shaders
+// always find something to draw and sharpen as the pages come in. Pages that don't fit next to
+// those in view wait for the view to change. The tail of a texture is an ordinary texture of
+// the TextureCache, for the levels below the pages and passes that don't read them.
+class VirtualTextures
+{
+public:
+	// Textures that can be paged at once, the layers of the page tables
+	static const int k_maxTextures = 16;
+
+	// Bytes of atlas pages when no budget is set
+	static const qint64 k_defaultBudget = 256ll * 1024 * 1024;
+
+	static const int k_feedbackScale = 8;
+
+	// Pages read at once, and pages copied into the atlas per frame
+	static const int k_maxLoads = 32;
+	static const int k_uploadsPerFrame = 16;
+
+	~VirtualTextures();
+
+	// Creating and destroying the textures requires the context they are used in to be current.
+	// Create returns false without OpenGL 3.3, textures are then drawn from their tails.
+	bool Create();
+	void Destroy();
+	bool IsCreated() const;
+
+	// Video memory the atlas may take, it is sized again by the next Update
+	void SetBudget(qint64 bytes);
+	qint64 Budget() const;
+
+	// Video memory of the atlas and the page tables
+	qint64 Bytes() const;
+
+	// The texture for a page file, shared with the materials already using it. Null if the
+	// textures aren't created, all slots are taken or the file doesn't open.
+	QSharedPointer<VirtualTexture> Get(const QString& pageFile);
+
+	// Textures in use, and atlas pages holding one of their pages out of all there are
+	int Count() const;
+	int ResidentPages() const;
+	int AtlasPages() const;
+
+	// Whether a feedback pass drawn for viewProjection and viewport would tell anything new:
+	// textures are paged, none is in flight, and the view or the textures changed since the last
+	void Invalidate();
+	bool NeedsFeedback(const QMatrix4x4& viewProjection, const QSize& viewport) const;
+
+	// Draws the pages meshes, indices into model, need as seen through viewProjection on a
+	// viewport of the scene's size. Binds framebuffer and the full viewport again when done.
+	// What the section planes cut away, up to Frustum::k_maxExtraPlanes of them in model space,
+	// asks for nothing.
+	void DrawFeedback(Model& model, const std::vector<int>& meshes, const QMatrix4x4& viewProjection, const QSize& viewport, GLuint framebuffer,
+		const std::vector<QVector4D>& sectionPlanes = std::vector<QVector4D>());
+
+	// Takes the last feedback once the GPU is done with it, queues the pages it misses, copies
+	// those that were read into the atlas and binds the page tables and the atlas. Call once a
+	// frame before drawing, returns true if pages were added.
+	bool Update();
+
+	// True while pages the view needs are still on their way
+	bool IsStreaming() const;
+
+	// A page request, as the feedback pass writes it and the atlas keys its pages
+	static quint32 PackRequest(int slot, int level, int x, int y);
+	static void UnpackRequest(quint32 request, int& slot, int& level, int& x, int& y);
+
+	// The request a texel of the feedback holds, false for pixels that need no page
+	static bool ReadFeedback(const uchar* pTexel, quint32& request);
+
+	// The page tables of a texture from the atlas pages holding its pages, level by level, as
+	// RGBA8 texels: the atlas page across and up, the level the page is from and 255. Missing
+	// pages get the entry of their parent, and are 0 where no ancestor is resident either.
+	static void FillPageTable(const std::vector<std::vector<int>>& atlasPages, const std::vector<QSize>& levelPages, int atlasSide,
+		std::vector<std::vector<quint32>>& table);
+
+private:
+	struct AtlasPage {
+		// The page held, valid while used
+		quint32 m_request = 0;
+		bool m_used = false;
+		// The feedback that last asked for it, pages of the latest one are never replaced
+		quint64 m_lastNeeded = 0;
+	};
+
+	struct Load {
+		quint32 m_request = 0;
+		QWeakPointer<VirtualTexture> m_texture;
+		QFuture<QImage> m_page;
+	};
+
+	bool AllocateAtlas();
+	void ReleaseAtlas();
+	// Frees the pages of the texture that had slot
+	void ReleaseSlot(int slot);
+	bool HasTextures() const;
+
+	void TakeFeedback();
+	void QueueLoads();
+	bool UploadPages();
+	void UploadTables();
+	void Bind();
+
+	// A free atlas page, or the one needed longest ago that the last feedback didn't ask for,
+	// -1 if all are in view
+	int TakeAtlasPage();
+	void Evict(int atlasPage);
+
+	QOpenGLExtraFunctions* m_pFunctions = nullptr;
+	QOpenGLShaderProgram* m_pProgram = nullptr;
+	GLint m_matrixUniform = -1;
+	GLint m_modelUniform = -1;
+	GLint m_sectionPlanesUniform = -1;
+	GLint m_virtualUniform = -1;
+	bool m_created = false;
+
+	GLuint m_framebuffer = 0;
+	GLuint m_requestBuffer = 0;
+	GLuint m_depthBuffer = 0;
+	QSize m_feedbackSize;
+	QOpenGLBuffer m_readback = QOpenGLBuffer(QOpenGLBuffer::PixelPackBuffer);
+	GLsync m_fence = nullptr;
+
+	// What the last feedback was drawn for
+	QMatrix4x4 m_feedbackViewProjection;
+	QSize m_feedbackViewport;
+	bool m_feedbackStale = true;
+	quint64 m_feedbackSerial = 0;
+
+	GLuint m_pageTables = 0;
+	GLuint m_atlas = 0;
+	// Pages across and up the atlas
+	int m_atlasSide = 0;
+	qint64 m_budget = k_defaultBudget;
+	bool m_budgetChanged = false;
+
+	QWeakPointer<VirtualTexture> m_textures[k_maxTextures];
+	bool m_slotUsed[k_maxTextures] = {};
+
+	std::vector<AtlasPage> m_atlasPages;
+	// The atlas page of each resident page
+	QHash<quint32, int> m_resident;
+
+	std::vector<Load> m_loads;
+	QSet<quint32> m_loading;
+	// Pages the last feedback asked for that are neither resident nor loading, the coarsest last
+	std::vector<quint32> m_wanted;
+};
@@ -0,0 +1,238 @@
+#include "ZipArchive.h"
+#include "Inflate.h"
+#include "RemoteFile.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QtEndian>
+
+#include <algorithm>
+#include <limits>
+
+
+namespace {
+
+const quint32 k_localHeaderSignature = 0x04034b50;
+const quint32 k_directoryHeaderSignature = 0x02014b50;
+const quint32 k_endSignature = 0x06054b50;
+const quint32 k_zip64EndSignature = 0x06064b50;
+const quint32 k_zip64LocatorSignature = 0x07064b50;
+
+const qint64 k_localHeaderBytes = 30;
+const qint64 k_directoryHeaderBytes = 46;
+const qint64 k_endBytes = 22;
+const qint64 k_zip64EndBytes = 56;
+const qint64 k_zip64LocatorBytes = 20;
+
+// The extra field with the 64 bit sizes and offset of files in a zip64 archive
+const quint16 k_zip64ExtraId = 0x0001;
+
+const quint16 k_methodStored = 0;
+const quint16 k_methodDeflate = 8;
+const quint16 k_flagEncrypted = 0x0001;
+const quint16 k_flagUtf8 = 0x0800;
+
+quint16 Read16(const uchar* p)
+{
+	return qFromLittleEndian<quint16>(p);
+}
+
+quint32 Read32(const uchar* p)
+{
+	return qFromLittleEndian<quint32>(p);
+}
+
+qint64 Read64(const uchar* p)
+{
+	return qint64(qFromLittleEndian<quint64>(p));
+}
+
+// Names are looked up as paths, so "a/./b" and "a\b" find "a/b"
+QString Key(const QString& name)
+{
+	return QDir::cleanPath(QDir::fromNativeSeparators(name)).toCaseFolded();
+}
+
+}
+
+QSharedPointer<const ZipArchive> ZipArchive::Open(const QSharedPointer<const FileContents>& pContents)
+{
+	QSharedPointer<ZipArchive> pArchive(new ZipArchive());
+	pArchive->m_pContents = pContents;
+	pArchive->m_size = pContents->Size();
+	return pArchive->ReadDirectory() ? pArchive : QSharedPointer<const ZipArchive>();
+}
+
+QSharedPointer<const ZipArchive> ZipArchive::Open(const QSharedPointer<RemoteFile>& pRemote)
+{
+	QSharedPointer<ZipArchive> pArchive(new ZipArchive());
+	pArchive->m_pRemote = pRemote;
+	pArchive->m_size = pRemote->Size();
+	return pArchive->ReadDirectory() ? pArchive : QSharedPointer<const ZipArchive>();
+}
+
+QStringList ZipArchive::Names() const
+{
+	return m_names;
+}
+
+bool ZipArchive::Contains(const QString& name) const
+{
+	return m_entries.contains(Key(name));
+}
+
+QSharedPointer<const FileContents> ZipArchive::Read(const QString& name) const
+{
+	const auto it = m_entries.constFind(Key(name));
+	if (it == m_entries.constEnd() || (it->m_flags & k_flagEncrypted)) {
+		return QSharedPointer<const FileContents>();
+	}
+
+	// The data follows the local header, whose extra field may differ from the directory's
+	const Entry& entry = *it;
+	const QSharedPointer<const FileContents> pHeader = Range(entry.m_headerOffset, k_localHeaderBytes);
+	if (!pHeader || Read32(pHeader->Data()) != k_localHeaderSignature) {
+		return QSharedPointer<const FileContents>();
+	}
+	const qint64 dataOffset = entry.m_headerOffset + k_localHeaderBytes + Read16(pHeader->Data() + 26) + Read16(pHeader->Data() + 28);
+
+	if (entry.m_method == k_methodStored) {
+		return entry.m_compressedSize == entry.m_size ? Range(dataOffset, entry.m_size) : QSharedPointer<const FileContents>();
+	}
+	if (entry.m_method != k_methodDeflate || entry.m_size > std::numeric_limits<int>::max()) {
+		return QSharedPointer<const FileContents>();
+	}
+	const QSharedPointer<const FileContents> pPacked = Range(dataOffset, entry.m_compressedSize);
+	if (!pPacked) {
+		return QSharedPointer<const FileContents>();
+	}
+	QByteArray data(int(entry.m_size), Qt::Uninitialized);
+	if (!Inflate(pPacked->Data(), size_t(pPacked->Size()), reinterpret_cast<uchar*>(data.data()), size_t(data.size()))) {
+		return QSharedPointer<const FileContents>();
+	}
+	return FileContents::FromBytes(data);
+}
+
+bool ZipArchive::SplitPath(const QString& path, QString& archive, QString& name)
+{
+	const bool url = RemoteFile::IsUrl(path);
+	const QString normalized = url ? path : QDir::fromNativeSeparators(path);
+	int from = 0;
+	for (;;) {
+		const int suffix = normalized.indexOf(".zip/", from, Qt::CaseInsensitive);
+		if (suffix < 0) {
+			return false;
+		}
+
+		// A folder named like an archive is passed over for one further down
+		archive = normalized.left(suffix + 4);
+		if (url || QFileInfo(archive).isFile()) {
+			name = normalized.mid(suffix + 5);
+			return !name.isEmpty();
+		}
+		from = suffix + 5;
+	}
+}
+
+bool ZipArchive::IsArchiveFile(const QString& path)
+{
+	return path.endsWith(".zip", Qt::CaseInsensitive);
+}
+
+bool ZipArchive::ReadDirectory()
+{
+	// The end record is last, only followed by a comment of up to 64 KB
+	const qint64 tailSize = std::min(m_size, k_endBytes + 0xffff);
+	if (tailSize < k_endBytes) {
+		return false;
+	}
+	const QSharedPointer<const FileContents> pTail = Range(m_size - tailSize, tailSize);
+	if (!pTail) {
+		return false;
+	}
+	const uchar* pTailData = pTail->Data();
+	qint64 end = tailSize - k_endBytes;
+	while (end >= 0 && Read32(pTailData + end) != k_endSignature) {
+		--end;
+	}
+	if (end < 0) {
+		return false;
+	}
+	qint64 count = Read16(pTailData + end + 10);
+	qint64 directorySize = Read32(pTailData + end + 12);
+	qint64 directoryOffset = Read32(pTailData + end + 16);
+
+	// Zip64 archives leave the fields that don't fit at their maximum, the values are in a
+	// record found through the locator just before the end record
+	if (count == 0xffff || directorySize == 0xffffffff || directoryOffset == 0xffffffff) {
+		if (end < k_zip64LocatorBytes || Read32(pTailData + end - k_zip64LocatorBytes) != k_zip64LocatorSignature) {
+			return false;
+		}
+		const QSharedPointer<const FileContents> pEnd = Range(Read64(pTailData + end - k_zip64LocatorBytes + 8), k_zip64EndBytes);
+		if (!pEnd || Read32(pEnd->Data()) != k_zip64EndSignature) {
+			return false;
+		}
+		count = Read64(pEnd->Data() + 32);
+		directorySize = Read64(pEnd->Data() + 40);
+		directoryOffset = Read64(pEnd->Data() + 48);
+	}
+
+	const QSharedPointer<const FileContents> pDirectory = Range(directoryOffset, directorySize);
+	if (!pDirectory) {
+		return false;
+	}
+	const uchar* p = pDirectory->Data();
+	const uchar* pEnd = p + pDirectory->Size();
+	for (qint64 i = 0; i < count; ++i) {
+		if (pEnd - p < k_directoryHeaderBytes || Read32(p) != k_directoryHeaderSignature) {
+			return false;
+		}
+		const quint16 nameBytes = Read16(p + 28);
+		const quint16 extraBytes = Read16(p + 30);
+		const quint16 commentBytes = Read16(p + 32);
+		if (pEnd - p < k_directoryHeaderBytes + nameBytes + extraBytes + commentBytes) {
+			return false;
+		}
+
+		Entry entry;
+		entry.m_flags = Read16(p + 8);
+		entry.m_method = Read16(p + 10);
+		entry.m_compressedSize = Read32(p + 20);
+		entry.m_size = Read32(p + 24);
+		entry.m_headerOffset = Read32(p + 42);
+
+		// The fields at their maximum follow in the zip64 extra field, in this order
+		const uchar* pExtra = p + k_directoryHeaderBytes + nameBytes;
+		const uchar* pExtraEnd = pExtra + extraBytes;
+		while (pExtraEnd - pExtra >= 4) {
+			const quint16 id = Read16(pExtra);
+			const quint16 size = Read16(pExtra + 2);
+			const uchar* pField = pExtra + 4;
+			pExtra = pField + size;
+			if (id != k_zip64ExtraId || pExtra > pExtraEnd) {
+				continue;
+			}
+			for (qint64* pValue : { &entry.m_size, &entry.m_compressedSize, &entry.m_headerOffset }) {
+				if (*pValue == 0xffffffff && pExtra - pField >= 8) {
+					*pValue = Read64(pField);
+					pField += 8;
+				}
+			}
+		}
+
+		// Folders are only there as the paths of their files
+		const QByteArray rawName(reinterpret_cast<const char*>(p + k_directoryHeaderBytes), nameBytes);
+		const QString name = (entry.m_flags & k_flagUtf8) ? QString::fromUtf8(rawName) : QString::fromLatin1(rawName);
+		if (!name.endsWith('/')) {
+			m_names << name;
+			m_entries.insert(Key(name), entry);
+		}
+		p += k_directoryHeaderBytes + nameBytes + extraBytes + commentBytes;
+	}
+	return true;
+}
+
+QSharedPointer<const FileContents> ZipArchive::Range(qint64 offset, qint64 size) const
+{
+	return m_pRemote ? m_pRemote->Read(offset, size) : FileContents::Slice(m_pContents, offset, size);
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "FileContents.h"
+
+#include <QHash>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+
+class RemoteFile;
+
+// The files of a zip archive, read straight from it without extracting it. Only the central
+// directory at its end is read up front. Files stored uncompressed point into the contents of
+// the archive, those compressed with deflate are inflated when read. Archives on a server are
+// read in ranges, so only the directory and the files read are downloaded.
+// Encrypted files, and other compression methods, can't be read.
+class ZipArchive
+{
+public:
+	// Null if the data isn't a zip archive
+	static QSharedPointer<const ZipArchive> Open(const QSharedPointer<const FileContents>& pContents);
+	static QSharedPointer<const ZipArchive> Open(const QSharedPointer<RemoteFile>& pRemote);
+
+	// The files in the archive, with '/' between their folders
+	QStringList Names() const;
+
+	// Names are compared without case, as on the file systems archives are usually made on
+	bool Contains(const QString& name) const;
+
+	// Null if the archive has no such file or it can't be read
+	QSharedPointer<const FileContents> Read(const QString& name) const;
+
+	// Paths can go through an archive as if it were a folder, as in "pack.zip/models/car.obj".
+	// Splits such a path into the archive and the name of the file in it. Local archives have
+	// to exist, any ".zip/" in a URL is taken as one.
+	static bool SplitPath(const QString& path, QString& archive, QString& name);
+
+	// Whether path names an archive that can be opened, by its suffix
+	static bool IsArchiveFile(const QString& path);
+
+private:
+	ZipArchive() = default;
+
+	struct Entry {
+		qint64 m_headerOffset = 0;
+		qint64 m_compressedSize = 0;
+		qint64 m_size = 0;
+		quint16 m_method = 0;
+		quint16 m_flags = 0;
+	};
+
+	bool ReadDirectory();
+
+	// Parts of local archives point into its contents, parts of remote ones are downloaded
+	QSharedPointer<const FileContents> Range(qint64 offset, qint64 size) const;
+
+	QSharedPointer<const FileContents> m_pContents;
+	QSharedPointer<RemoteFile> m_pRemote;
+	qint64 m_size = 0;
+
+	QStringList m_names;
+	// Keyed by the case folded name
+	QHash<QString, Entry> m_entries;
+};
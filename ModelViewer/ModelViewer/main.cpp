@@ -1,10 +1,162 @@
 #include "ModelViewer.h"
+#include "AppSettings.h"
+#include "BatchConverter.h"
+#include "BatchRenderer.h"
+#include "FramePacer.h"
+#include "RemoteViewServer.h"
+#include "ScriptRunner.h"
+#include "StartupTrace.h"
+#include "ViewerGraphicsWindow.h"
 #include <QtWidgets/QApplication>
+#include <QCommandLineParser>
+#include <QSurfaceFormat>
+#include <QUuid>
 
 int main(int argc, char *argv[])
 {
+    // The start is traced up to the first paint of the landing page
+    ImportTrace::Sequence startup(StartupTrace::Active(), ImportTrace::k_stage);
+    startup.Next("application");
     QApplication a(argc, argv);
+    startup.Next("options");
+
+    // Without --batch or --convert the viewer starts as usual
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption batchOption("batch", "Render images of the given models into folder without opening a window.", "folder");
+    QCommandLineOption sizeOption("size", "Size of the rendered images.", "WxH", "512x512");
+    QCommandLineOption viewsOption("views", "Comma separated camera presets: front, back, left, right, top, iso, turntable:<count>.", "views", "iso");
+    QCommandLineOption convertOption("convert", "Convert the models below the given input folder into folder without opening a window.", "folder");
+    QCommandLineOption formatOption("format", "Assimp export format id to convert to.", "id", "obj");
+    QCommandLineOption workersOption("workers", "Models converted at once, 0 for one per core.", "count", "0");
+    QCommandLineOption forceOption("force", "Convert models even if their output is up to date.");
+    QCommandLineOption scriptOption("script", "Run the commands of a JSON script file in the viewer.", "file");
+    QCommandLineOption listenOption("listen", "Take script commands from clients of a local socket, one JSON object per line.", "name");
+    QCommandLineOption serveOption("serve", "Stream the view to a client on a TCP port, which moves the camera with script commands. Without a display, run with -platform offscreen.", "port");
+    QCommandLineOption serveAddressOption("serve-address", "Address to serve on, such as 0.0.0.0 for every network.", "address", "127.0.0.1");
+    QCommandLineOption serveTokenOption("serve-token", "Token a client has to send first, a random one is printed if none is given.", "token");
+    QCommandLineOption metricsOption("metrics", "Write the results of script commands to file instead of stdout.", "file");
+    QCommandLineOption quitOption("quit", "Quit once the script ran, with exit code 1 if a command failed.");
+    QCommandLineOption startupTraceOption("startup-trace", "Write a Chrome trace of the start of the viewer to file.", "file");
+    parser.addOption(batchOption);
+    parser.addOption(sizeOption);
+    parser.addOption(viewsOption);
+    parser.addOption(convertOption);
+    parser.addOption(formatOption);
+    parser.addOption(workersOption);
+    parser.addOption(forceOption);
+    parser.addOption(scriptOption);
+    parser.addOption(listenOption);
+    parser.addOption(serveOption);
+    parser.addOption(serveAddressOption);
+    parser.addOption(serveTokenOption);
+    parser.addOption(metricsOption);
+    parser.addOption(quitOption);
+    parser.addOption(startupTraceOption);
+    parser.addPositionalArgument("models", "Models to render in batch mode, or the input folder in convert mode.", "[models...]");
+    parser.process(a);
+    StartupTrace::SetFile(parser.value(startupTraceOption));
+
+    // Use the same vertex formats and import steps as the viewer
+    startup.Next("settings");
+    const AppSettings& settings = *AppSettings::Shared();
+    LoadOptions loadOptions;
+    loadOptions.m_interleaved = settings.value("ViewerGraphicsWindow/interleavedVertices", true).toBool();
+    loadOptions.m_quantize = settings.value("ViewerGraphicsWindow/quantizeVertices", false).toBool();
+    loadOptions.m_quantizePositions = settings.value("ViewerGraphicsWindow/quantizePositions", false).toBool();
+    loadOptions.m_batchStatic = settings.value("ViewerGraphicsWindow/batchStaticGeometry", false).toBool();
+    loadOptions.m_importProfile = ImportProfile(settings.value("ViewerGraphicsWindow/importProfile", int(ImportProfile::Quality)).toInt());
+    loadOptions.m_customImportSteps = settings.value("ViewerGraphicsWindow/customImportSteps", 0u).toUInt();
+    // Batch runs draw each model once, there are no later frames for pages to stream into
+    loadOptions.m_virtualTextureSize = 0;
+
+    if (parser.isSet(convertOption)) {
+        if (parser.positionalArguments().size() != 1) {
+            qWarning("Convert mode takes one input folder");
+            return 1;
+        }
+        BatchConvertOptions options;
+        options.m_inputFolder = parser.positionalArguments().front();
+        options.m_outputFolder = parser.value(convertOption);
+        options.m_formatId = parser.value(formatOption);
+        options.m_workers = parser.value(workersOption).toInt();
+        options.m_force = parser.isSet(forceOption);
+        options.m_loadOptions = loadOptions;
+
+        BatchConverter converter(options);
+        const BatchConvertReport report = converter.Convert();
+        for (const QString& failure : report.m_failed) {
+            qWarning("%s", qPrintable(failure));
+        }
+        qInfo("%s", qPrintable(report.Summary()));
+        return report.m_failed.isEmpty() ? 0 : 1;
+    }
+
+    if (parser.isSet(batchOption)) {
+        BatchRenderOptions options;
+        options.m_outputFolder = parser.value(batchOption);
+        const QStringList size = parser.value(sizeOption).split('x');
+        if (size.size() == 2) {
+            options.m_size = QSize(size[0].toInt(), size[1].toInt());
+        }
+        options.m_views = parser.value(viewsOption).split(',', Qt::SkipEmptyParts);
+        options.m_loadOptions = loadOptions;
+
+        BatchRenderer renderer(options);
+        const int written = renderer.Render(parser.positionalArguments());
+        return written > 0 ? 0 : 1;
+    }
+
+    // The swap interval is fixed once the window's context is created
+    QSurfaceFormat format = QSurfaceFormat::defaultFormat();
+    format.setSwapInterval(FramePacer::SwapInterval(settings.value("ViewerGraphicsWindow/presentMode", int(k_presentVsync)).toInt()));
+    QSurfaceFormat::setDefaultFormat(format);
+
+    startup.Next("main window");
     ModelViewer w;
+
+    // Scripts run once the window is shown and has its context
+    ScriptRunner script(w.GetGraphicsWindow());
+    RemoteViewServer server(w.GetGraphicsWindow(), &script);
+    if (parser.isSet(scriptOption) || parser.isSet(listenOption) || parser.isSet(serveOption)) {
+        QString error;
+        if (parser.isSet(scriptOption) && !script.LoadScript(parser.value(scriptOption), &error)) {
+            qWarning("%s", qPrintable(error));
+            return 1;
+        }
+        if (parser.isSet(listenOption) && !script.Listen(parser.value(listenOption))) {
+            return 1;
+        }
+        if (parser.isSet(serveOption)) {
+            bool valid = false;
+            const uint port = parser.value(serveOption).toUInt(&valid);
+            const QHostAddress address(parser.value(serveAddressOption));
+            if (!valid || port < 1 || port > 65535) {
+                qWarning("%s is not a port from 1 to 65535", qPrintable(parser.value(serveOption)));
+                return 1;
+            }
+            if (address.isNull()) {
+                qWarning("%s is not an address", qPrintable(parser.value(serveAddressOption)));
+                return 1;
+            }
+            const QString token = parser.isSet(serveTokenOption) ? parser.value(serveTokenOption) : QUuid::createUuid().toString(QUuid::WithoutBraces);
+            server.SetToken(token);
+            if (!server.Listen(quint16(port), address)) {
+                return 1;
+            }
+            qInfo("Serving on %s port %d with token %s", qPrintable(address.toString()), int(server.Port()), qPrintable(token));
+        }
+        if (parser.isSet(metricsOption) && !script.SetMetricsFile(parser.value(metricsOption))) {
+            qWarning("Could not write %s", qPrintable(parser.value(metricsOption)));
+            return 1;
+        }
+        // A server runs until it is closed or quit from its local socket
+        script.SetQuitWhenDone(parser.isSet(quitOption) && !parser.isSet(serveOption));
+        script.Start();
+    }
+
+    startup.Next("show");
     w.show();
+    startup.Next(nullptr);
     return a.exec();
 }
@@ -0,0 +1,308 @@
+#include <QApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QOpenGLContext>
+#include <QTextStream>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include <windows.h>
+#include <psapi.h>
+
+#include "ModelLoader.h"
+#include "GpuModelBuilder.h"
+#include "TextureCache.h"
+#include "ViewerGraphicsWindow.h"
+#include "VertexCacheOptimizer.h"
+
+// Loads every model of a corpus and reports how long each loading stage takes and how fast it
+// renders, as one JSON object per model on stdout or in the --out file.
+//
+//   ModelViewerBench [--frames N] [--width W] [--height H] [--out results.json] [paths...]
+//
+// Paths can be files or folders, by default Data/Models and Data/Primitives are used.
+
+namespace {
+
+	// Splits the Assimp import into reading the file and post processing it. Assimp reports
+	// post processing steps after the file was read, so the first one ends the read phase.
+	qint64 PeakWorkingSet()
+	{
+		PROCESS_MEMORY_COUNTERS counters;
+		if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+			return qint64(counters.PeakWorkingSetSize);
+		}
+		return -1;
+	}
+
+	// Video memory in use as reported by the driver, where an extension for it exists
+	qint64 UsedVideoMemory(QOpenGLContext* pContext)
+	{
+		const GLenum GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX = 0x9048;
+		const GLenum GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX = 0x9049;
+		if (!pContext->hasExtension("GL_NVX_gpu_memory_info")) {
+			return -1;
+		}
+		GLint totalKb = 0;
+		GLint availableKb = 0;
+		pContext->functions()->glGetIntegerv(GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &totalKb);
+		pContext->functions()->glGetIntegerv(GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX, &availableKb);
+		return qint64(totalKb - availableKb) * 1024;
+	}
+
+	QJsonObject ToJson(const FrameStats::Summary& summary)
+	{
+		QJsonObject ret;
+		ret["minMs"] = summary.m_min * 1000.0;
+		ret["avgMs"] = summary.m_avg * 1000.0;
+		ret["p95Ms"] = summary.m_p95 * 1000.0;
+		ret["p99Ms"] = summary.m_p99 * 1000.0;
+		return ret;
+	}
+
+	// Vertex cache misses summed over the index buffers of a model
+	struct CacheTotals {
+		double m_misses = 0.0;
+		double m_triangles = 0.0;
+		double m_vertices = 0.0;
+	};
+
+	void AddCacheStats(const std::vector<quint32>& indices, CacheTotals& totals)
+	{
+		const VertexCacheOptimizer::Stats stats = VertexCacheOptimizer::Analyze(indices.data(), int(indices.size()));
+		const double triangles = double(indices.size() / 3);
+		totals.m_misses += stats.m_acmr * triangles;
+		totals.m_triangles += triangles;
+		totals.m_vertices += stats.m_atvr > 0.0 ? stats.m_acmr * triangles / stats.m_atvr : 0.0;
+	}
+
+	QJsonObject ToJson(const CacheTotals& totals)
+	{
+		QJsonObject ret;
+		ret["acmr"] = totals.m_triangles > 0.0 ? totals.m_misses / totals.m_triangles : 0.0;
+		ret["atvr"] = totals.m_vertices > 0.0 ? totals.m_misses / totals.m_vertices : 0.0;
+		return ret;
+	}
+
+	// The triangles as Assimp left them, after its own cache locality step if the profile has it
+	CacheTotals ImportedCacheStats(const aiScene* pScene)
+	{
+		CacheTotals totals;
+		std::vector<quint32> indices;
+		for (unsigned int m = 0; m < pScene->mNumMeshes; ++m) {
+			const aiMesh* pMesh = pScene->mMeshes[m];
+			indices.clear();
+			for (unsigned int f = 0; f < pMesh->mNumFaces; ++f) {
+				const aiFace& face = pMesh->mFaces[f];
+				if (face.mNumIndices == 3) {
+					indices.insert(indices.end(), face.mIndices, face.mIndices + 3);
+				}
+			}
+			AddCacheStats(indices, totals);
+		}
+		return totals;
+	}
+
+	// The full detail triangles of the decoded meshes, in the order they are drawn
+	CacheTotals DecodedCacheStats(const ModelData& data)
+	{
+		CacheTotals totals;
+		std::vector<quint32> indices;
+		for (const MeshData& mesh : data.m_meshes) {
+			indices.resize(mesh.m_indexCount);
+			if (mesh.m_indexType == GL_UNSIGNED_SHORT) {
+				const quint16* pIndices = reinterpret_cast<const quint16*>(mesh.m_indexData.constData());
+				std::copy(pIndices, pIndices + mesh.m_indexCount, indices.begin());
+			}
+			else {
+				memcpy(indices.data(), mesh.m_indexData.constData(), indices.size() * sizeof(quint32));
+			}
+			AddCacheStats(indices, totals);
+		}
+		return totals;
+	}
+
+	QStringList CollectFiles(const QStringList& paths)
+	{
+		QStringList files;
+		for (const QString& path : paths) {
+			if (QFileInfo(path).isDir()) {
+				QDirIterator it(path, QDir::Files, QDirIterator::Subdirectories);
+				while (it.hasNext()) {
+					files << it.next();
+				}
+			}
+			else {
+				files << path;
+			}
+		}
+		files.sort();
+		return files;
+	}
+
+	QJsonObject BenchmarkFile(ViewerGraphicsWindow& window, const QString& file, int frameCount)
+	{
+		QJsonObject result;
+		result["file"] = file;
+
+		// Import and decode the same way the viewer does, timing each stage
+		QElapsedTimer timer;
+		timer.start();
+		std::vector<ImportStepTime> steps;
+		Assimp::Importer* pImporter = ModelLoader::ImportScene(file, nullptr, ModelLoader::ImportFlags(), &steps);
+		const qint64 importNs = timer.nsecsElapsed();
+		if (!pImporter->GetScene()) {
+			delete pImporter;
+			result["error"] = "import failed";
+			return result;
+		}
+		timer.restart();
+		ModelData data = ModelLoader::DecodeModel(pImporter->GetScene(), file);
+		const qint64 decodeNs = timer.nsecsElapsed();
+
+		// Decoding reorders the triangles for the vertex cache, measured with a FIFO of
+		// VertexCacheOptimizer::k_cacheSize entries
+		result["vertexCacheImported"] = ToJson(ImportedCacheStats(pImporter->GetScene()));
+		result["vertexCacheDecoded"] = ToJson(DecodedCacheStats(data));
+		delete pImporter;
+
+		// Upload into the window's context, then throw the copy away again
+		window.makeCurrent();
+		const qint64 videoMemoryBefore = UsedVideoMemory(window.context());
+		timer.restart();
+		{
+			TextureCache textures;
+			Model model = GpuModelBuilder::BuildModel(data, textures);
+			window.context()->functions()->glFinish();
+		}
+		const qint64 uploadNs = timer.nsecsElapsed();
+		window.doneCurrent();
+
+		// The first stage is the file read, the rest are post-processing steps
+		QJsonObject stepMs;
+		double postProcessMs = 0.0;
+		for (size_t i = 1; i < steps.size(); ++i) {
+			stepMs[steps[i].m_name] = steps[i].m_seconds * 1e3;
+			postProcessMs += steps[i].m_seconds * 1e3;
+		}
+		result["readMs"] = steps.empty() ? importNs * 1e-6 : steps.front().m_seconds * 1e3;
+		result["postProcessMs"] = postProcessMs;
+		result["postProcessStepMs"] = stepMs;
+		result["decodeMs"] = decodeNs * 1e-6;
+		result["uploadMs"] = uploadNs * 1e-6;
+
+		// Load it into the viewer to measure rendering
+		QEventLoop loop;
+		bool loaded = false;
+		QObject::connect(&window, &ViewerGraphicsWindow::EndModelLoading, &loop, [&](bool success, QString) {
+			loaded = success;
+			loop.quit();
+		});
+		if (!window.loadModel(file)) {
+			result["error"] = "load failed";
+			return result;
+		}
+		loop.exec();
+		if (!loaded) {
+			result["error"] = "load failed";
+			return result;
+		}
+
+		// Warm up, then spin around the model once over the measured frames. Every grab
+		// renders one frame into the widget's framebuffer and reads it back.
+		for (int i = 0; i < 10; ++i) {
+			window.grabFramebuffer();
+		}
+		window.ClearFrameStats();
+		FrameStats wallFrames;
+		for (int i = 0; i < frameCount; ++i) {
+			window.SetRotation(360.f * i / frameCount, 30.f);
+			timer.restart();
+			window.grabFramebuffer();
+			wallFrames.AddFrame(timer.nsecsElapsed() * 1e-9f);
+		}
+
+		result["frames"] = frameCount;
+		result["frameWithReadback"] = ToJson(wallFrames.Summarize());
+		result["frameCpu"] = ToJson(window.GetCpuFrameStats());
+		result["frameGpu"] = ToJson(window.GetGpuFrameStats());
+		result["uploadedBytes"] = double(window.GetUploadedBytes());
+		window.makeCurrent();
+		const qint64 videoMemoryAfter = UsedVideoMemory(window.context());
+		window.doneCurrent();
+		result["videoMemoryBytes"] = (videoMemoryBefore < 0 || videoMemoryAfter < 0) ? -1.0 : double(videoMemoryAfter - videoMemoryBefore);
+		result["peakWorkingSetBytes"] = double(PeakWorkingSet());
+
+		window.unloadModel();
+		return result;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	QApplication app(argc, argv);
+	QApplication::setApplicationName("ModelViewerBench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Measures model loading and rendering performance");
+	parser.addHelpOption();
+	QCommandLineOption framesOption("frames", "Frames rendered per model.", "count", "120");
+	QCommandLineOption widthOption("width", "Width of the rendered frames.", "pixels", "1280");
+	QCommandLineOption heightOption("height", "Height of the rendered frames.", "pixels", "720");
+	QCommandLineOption outOption("out", "Write the results to this file instead of stdout.", "file");
+	parser.addOption(framesOption);
+	parser.addOption(widthOption);
+	parser.addOption(heightOption);
+	parser.addOption(outOption);
+	parser.addPositionalArgument("paths", "Model files or folders to load.", "[paths...]");
+	parser.process(app);
+
+	QStringList paths = parser.positionalArguments();
+	if (paths.isEmpty()) {
+		paths << "../Data/Models" << "../Data/Primitives";
+	}
+	const int frameCount = std::max(1, parser.value(framesOption).toInt());
+
+	// The window is never shown, frames are rendered into the widget's framebuffer
+	ViewerGraphicsWindow window;
+	window.resize(parser.value(widthOption).toInt(), parser.value(heightOption).toInt());
+	window.grabFramebuffer();
+	if (!window.IsInitialized()) {
+		fprintf(stderr, "Could not create an OpenGL context\n");
+		return 1;
+	}
+
+	QJsonArray results;
+	for (const QString& file : CollectFiles(paths)) {
+		results.append(BenchmarkFile(window, file, frameCount));
+	}
+
+	QJsonObject report;
+	window.makeCurrent();
+	report["renderer"] = QString(reinterpret_cast<const char*>(window.context()->functions()->glGetString(GL_RENDERER)));
+	window.doneCurrent();
+	report["results"] = results;
+	const QByteArray json = QJsonDocument(report).toJson();
+
+	if (parser.isSet(outOption)) {
+		QFile out(parser.value(outOption));
+		if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			fprintf(stderr, "Could not write %s\n", qPrintable(parser.value(outOption)));
+			return 1;
+		}
+		out.write(json);
+	}
+	else {
+		fwrite(json.constData(), 1, size_t(json.size()), stdout);
+	}
+	return 0;
+}
@@ -0,0 +1,260 @@
+#include <QtTest/QtTest>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+
+#include "ModelViewer.h"
+#include "ModelLoader.h"
+#include "GpuModelBuilder.h"
+#include "ViewerGraphicsWindow.h"
+
+namespace {
+
+// Set to write the times measured as the new baselines instead of comparing with them
+const char* k_recordVariable = "MODELVIEWER_PERF_RECORD";
+// Overrides the share a time may be above its baseline, such as 0.5 for 50%
+const char* k_toleranceVariable = "MODELVIEWER_PERF_TOLERANCE";
+const double k_defaultTolerance = 0.25;
+// Times this close to their baseline pass whatever their share, as they are timer noise
+const double k_slackMs = 0.05;
+// Timed calls of which the median is compared, after one that warms the caches up
+const int k_runs = 15;
+
+template <typename Work>
+double MedianMs(Work work)
+{
+	work();
+	std::vector<double> times;
+	QElapsedTimer timer;
+	for (int i = 0; i < k_runs; ++i) {
+		timer.start();
+		work();
+		times.push_back(double(timer.nsecsElapsed()) / 1e6);
+	}
+	std::nth_element(times.begin(), times.begin() + k_runs / 2, times.end());
+	return times[k_runs / 2];
+}
+
+}
+
+// Times loading, drawing and updating the view. QBENCHMARK reports each, and the median of
+// k_runs calls is compared with baselines.json next to this file, failing where it is more
+// than the tolerance above its baseline. The baselines only mean something on the machine
+// they were recorded on, so record them there first with MODELVIEWER_PERF_RECORD=1. Times
+// without a baseline only warn.
+class ModelViewerPerfTest : public QObject {
+	Q_OBJECT
+
+private slots:
+	void initTestCase();
+	void cleanupTestCase();
+
+	void loadModel_data();
+	void loadModel();
+	void paintFrame();
+	void renderText();
+	void updateKeysHeld();
+	void relinkShaders();
+
+private:
+	void CompareWithBaseline(double ms);
+
+	ModelViewer* m_pWindow = nullptr;
+	QString m_baselinePath;
+	QJsonObject m_baselines;
+	double m_tolerance = k_defaultTolerance;
+	bool m_record = false;
+};
+
+
+void ModelViewerPerfTest::initTestCase()
+{
+	m_baselinePath = QDir(QFileInfo(QString(__FILE__)).absolutePath()).filePath("baselines.json");
+	QFile file(m_baselinePath);
+	if (file.open(QIODevice::ReadOnly)) {
+		const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+		m_baselines = root.value("baselines").toObject();
+		m_tolerance = root.value("tolerance").toDouble(k_defaultTolerance);
+	}
+	if (qEnvironmentVariableIsSet(k_toleranceVariable)) {
+		m_tolerance = qEnvironmentVariable(k_toleranceVariable).toDouble();
+	}
+	m_record = qEnvironmentVariableIsSet(k_recordVariable);
+
+	// The frames are timed with a model in view, drawn as often as they are asked for
+	m_pWindow = new ModelViewer();
+	m_pWindow->show();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QSignalSpy endLoadSignalSpy(pGraphicsWindow, SIGNAL(EndModelLoading(bool, QString)));
+	QVERIFY(pGraphicsWindow->loadModel("../Data/Primitives/Sphere.obj"));
+	QVERIFY(endLoadSignalSpy.wait(30000));
+	QVERIFY(endLoadSignalSpy.takeFirst().at(0).toBool());
+	QTest::qWait(100);
+}
+
+void ModelViewerPerfTest::cleanupTestCase()
+{
+	delete m_pWindow;
+
+	if (m_record) {
+		QJsonObject root;
+		root.insert("tolerance", m_tolerance);
+		root.insert("baselines", m_baselines);
+		QFile file(m_baselinePath);
+		QVERIFY(file.open(QIODevice::WriteOnly | QIODevice::Truncate));
+		file.write(QJsonDocument(root).toJson());
+	}
+}
+
+void ModelViewerPerfTest::CompareWithBaseline(double ms)
+{
+	QString key = QTest::currentTestFunction();
+	if (QTest::currentDataTag()) {
+		key += QString("/%1").arg(QTest::currentDataTag());
+	}
+
+	if (m_record) {
+		m_baselines.insert(key, ms);
+		return;
+	}
+	if (!m_baselines.contains(key)) {
+		qWarning("%s took %.3f ms and has no baseline, record them with %s=1", qPrintable(key), ms, k_recordVariable);
+		return;
+	}
+	const double baseline = m_baselines.value(key).toDouble();
+	const double limit = std::max(baseline * (1.0 + m_tolerance), baseline + k_slackMs);
+	QVERIFY2(ms <= limit, qPrintable(QString("%1 took %2 ms, more than %3% above its baseline of %4 ms")
+		.arg(key).arg(ms, 0, 'f', 3).arg(m_tolerance * 100.0, 0, 'f', 0).arg(baseline, 0, 'f', 3)));
+}
+
+
+void ModelViewerPerfTest::loadModel_data()
+{
+	QTest::addColumn<QString>("file");
+
+	// Every bundled model and primitive Assimp reads
+	Assimp::Importer importer;
+	for (const QString& folder : { QString("../Data/Models"), QString("../Data/Primitives") }) {
+		for (const QFileInfo& info : QDir(folder).entryInfoList(QDir::Files, QDir::Name)) {
+			if (importer.IsExtensionSupported(("." + info.suffix()).toStdString())) {
+				QTest::newRow(qPrintable(info.fileName())) << info.filePath();
+			}
+		}
+	}
+}
+
+void ModelViewerPerfTest::loadModel()
+{
+	QFETCH(QString, file);
+
+	// Importing and decoding the file and uploading its meshes, which are released again
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+	bool valid = true;
+	auto load = [&]() {
+		Model model = ModelLoader::LoadModel(file);
+		valid = valid && model.m_isValid;
+		for (Mesh& mesh : model.m_meshes) {
+			GpuModelBuilder::ReleaseGeometry(mesh);
+		}
+	};
+	QBENCHMARK {
+		load();
+	}
+	const double ms = MedianMs(load);
+	pGraphicsWindow->doneCurrent();
+
+	QVERIFY(valid);
+	CompareWithBaseline(ms);
+}
+
+void ModelViewerPerfTest::paintFrame()
+{
+	// A frame of a view that doesn't change, finished on the GPU so its time counts as well
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+	QOpenGLFunctions* f = pGraphicsWindow->context()->functions();
+	auto frame = [&]() {
+		pGraphicsWindow->paintGL();
+		f->glFinish();
+	};
+	QBENCHMARK {
+		frame();
+	}
+	const double ms = MedianMs(frame);
+	pGraphicsWindow->doneCurrent();
+
+	CompareWithBaseline(ms);
+}
+
+void ModelViewerPerfTest::renderText()
+{
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+	QOpenGLFunctions* f = pGraphicsWindow->context()->functions();
+	auto text = [&]() {
+		pGraphicsWindow->RenderText();
+		f->glFinish();
+	};
+	QBENCHMARK {
+		text();
+	}
+	const double ms = MedianMs(text);
+	pGraphicsWindow->doneCurrent();
+
+	CompareWithBaseline(ms);
+}
+
+void ModelViewerPerfTest::updateKeysHeld()
+{
+	// Every bound key held, so each action moves the view in every update
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	for (auto it = pGraphicsWindow->m_settings.m_keyBits.constBegin(); it != pGraphicsWindow->m_settings.m_keyBits.constEnd(); ++it) {
+		QTest::keyPress(pGraphicsWindow, Qt::Key(it.key()));
+	}
+	QVERIFY(pGraphicsWindow->m_pressedKeys != 0);
+
+	auto update = [&]() {
+		pGraphicsWindow->Update(1.f / 60.f);
+	};
+	QBENCHMARK {
+		update();
+	}
+	const double ms = MedianMs(update);
+	pGraphicsWindow->ClearKeyboard();
+	pGraphicsWindow->resetView();
+
+	CompareWithBaseline(ms);
+}
+
+void ModelViewerPerfTest::relinkShaders()
+{
+	// Reading, compiling and linking the current shaders again, as editing them does
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	bool linked = true;
+	auto relink = [&]() {
+		linked = pGraphicsWindow->reloadCurrentShaders() && linked;
+	};
+	QBENCHMARK {
+		relink();
+	}
+	const double ms = MedianMs(relink);
+
+	QVERIFY(linked);
+	CompareWithBaseline(ms);
+}
+
+
+int RunPerformanceTests(int argc, char* argv[])
+{
+	ModelViewerPerfTest test;
+	return QTest::qExec(&test, argc, argv);
+}
+
+#include "perf.moc"
\ No newline at end of file
@@ -4,17 +4,108 @@
 #include <QSignalSpy>
 #include <QlineEdit>
 #include <QPushButton>
+#include <QTreeView>
 #include <QEvent>
 #include <QMouseEvent>
 #include <QComboBox>
+#include <QOpenGLFunctions>
+#include <QOpenGLShaderProgram>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSettings>
+#include <QTcpSocket>
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <random>
+#include <set>
+
+#include <assimp/cexport.h>
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
 
 #include "ModelViewer.h"
 #include "ModelLoader.h"
+#include "Animation.h"
+#include "ComputeSkinner.h"
+#include "ShadowMapper.h"
+#include "AmbientOcclusion.h"
+#include "AsyncModelExporter.h"
+#include "AppSettings.h"
 #include "ViewerGraphicsWindow.h"
 #include "GraphicsWindowDelegate.h"
+#include "LightClusters.h"
 #include "KeyBindEdit.h"
 #include "KeySequenceParse.h"
 #include "LandingPage.h"
+#include "BatchConverter.h"
+#include "BoundsMath.h"
+#include "CameraPath.h"
+#include "CompressedTexture.h"
+#include "EnvironmentLighting.h"
+#include "FrameAccumulator.h"
+#include "FrameStream.h"
+#include "FramePacer.h"
+#include "GeometryStreamer.h"
+#include "GpuModelBuilder.h"
+#include "JobSystem.h"
+#include "FrameStats.h"
+#include "GeometryCodec.h"
+#include "GltfLoader.h"
+#include "ImportTrace.h"
+#include "ModelBrowser.h"
+#include "ModelCache.h"
+#include "ModelPrewarmer.h"
+#include "ModelScene.h"
+#include "ModelStats.h"
+#include "FileContents.h"
+#include "Frustum.h"
+#include "GeometryArena.h"
+#include "MeshBvh.h"
+#include "MeshDisplayModes.h"
+#include "Meshlets.h"
+#include "MeshPicker.h"
+#include "MeshSimplifier.h"
+#include "ModelComparison.h"
+#include "NormalGenerator.h"
+#include "PageFile.h"
+#include "PngWriter.h"
+#include "PointCloudLoader.h"
+#include "PointCloudLod.h"
+#include "PosterRenderer.h"
+#include "SceneGraph.h"
+#include "SceneOutliner.h"
+#include "SplitView.h"
+#include "ProgramInterface.h"
+#include "Primitives.h"
+#include "RemoteViewServer.h"
+#include "RenderQueue.h"
+#include "ResolutionScaler.h"
+#include "ResourceTracker.h"
+#include "ScriptRunner.h"
+#include "ScratchArena.h"
+#include "SectionCaps.h"
+#include "ShaderPermutations.h"
+#include "StartupTrace.h"
+#include "StateCache.h"
+#include "StreamBuffer.h"
+#include "SurfaceDistance.h"
+#include "TextModelLoader.h"
+#include "TextRenderer.h"
+#include "TextureCache.h"
+#include "TextureUploader.h"
+#include "ThumbnailIndex.h"
+#include "TransformCache.h"
+#include "TransparencyPass.h"
+#include "ZipArchive.h"
+#include "UniformBlocks.h"
+#include "VertexCacheOptimizer.h"
+#include "VideoEncoder.h"
+#include "VirtualTextures.h"
 
 class ModelViewerTest : public QObject {
 	Q_OBJECT
@@ -34,12 +125,88 @@ private slots:
 
 	void testShow();
 	void loadModel();
+	void decodeVertexLayout();
+	void decodeQuantizedVertices();
+	void decodeBatchedMeshes();
+	void decodeInstancedMeshes();
+	void importProfiles();
+	void decodePreviewProxy();
+	void generateLevelsOfDetail();
+	void geometryArena();
+	void boundsMath();
+	void frustumCulling();
+	void transformCache();
+	void meshHierarchy();
+	void meshPicking();
+	void readCompressedTexture();
+	void frameStatistics();
+	void textOverlay();
+	void resolutionScaling();
+	void frameAccumulation();
+	void displayModes();
+	void geometryStreaming();
+	void meshlets();
+	void vertexCacheOrder();
+	void modelCacheRoundTrip();
+	void batchConvert();
+	void prewarmRecentFiles();
 	void saveModel();
+	void exportInBackground();
 	void loadShader();
+	void shaderPermutations();
+	void renderQueue();
 	void loadCurrentShaders();
 	void editCurrentShaders();
 	void openShaderFile();
 	void displayModel();
+	void cancelLoading();
+	void sceneOfModels();
+	void releaseModels();
+	void generatePrimitives();
+	void skeletalAnimation();
+	void morphTargets();
+	void shadowFit();
+	void clusteredLights();
+	void environmentCache();
+	void sharedMaterials();
+	void transparentMaterials();
+	void ambientOcclusion();
+	void resourceTracking();
+	void scratchArena();
+	void fileContents();
+	void zipArchive();
+	void geometryCodec();
+	void thumbnailIndex();
+	void programInterface();
+	void modelStats();
+	void scriptRunner();
+	void cameraPlayback();
+	void importTrace();
+	void textureUploader();
+	void streamBuffer();
+	void stateCache();
+	void gltfLoader();
+	void textModelLoader();
+	void normalGenerator();
+	void shadingSwitches();
+	void sceneGraph();
+	void nodeVisibility();
+	void lazyUpload();
+	void posterRendering();
+	void videoExport();
+	void splitViewports();
+	void modelComparison();
+	void meshSimplification();
+	void sectionPlanes();
+	void framePacing();
+	void startupPhases();
+	void settingsStore();
+	void jobSystem();
+	void virtualTextures();
+	void evictWhenHidden();
+	void largeCoordinates();
+	void pointCloud();
+	void remoteView();
 	void resetView();
 	void rotateWithMouse();
 	void panWithMouse();
@@ -54,6 +221,7 @@ private slots:
 private:
 	// Helpers
 	void ResetViewAndShow();
+	bool LoadModelAndWait(const QString& path);
 
 
 	ModelViewer* m_pWindow = nullptr;
@@ -101,6 +269,19 @@ void ModelViewerTest::ResetViewAndShow()
 	resetMatrix = m_pWindow->GetGraphicsWindow()->GetModelMatrix();
 }
 
+bool ModelViewerTest::LoadModelAndWait(const QString& path)
+{
+	// Models load in the background, wait for the load to complete
+	QSignalSpy endLoadSignalSpy(m_pWindow->GetGraphicsWindow(), SIGNAL(EndModelLoading(bool, QString)));
+	if (!m_pWindow->GetGraphicsWindow()->loadModel(path)) {
+		return false;
+	}
+	if (!endLoadSignalSpy.wait(30000)) {
+		return false;
+	}
+	return endLoadSignalSpy.takeFirst().at(0).toBool();
+}
+
 
 void ModelViewerTest::integration()
 {
@@ -135,7 +316,7 @@ void ModelViewerTest::integration()
 
 	// Check that the shape was loaded
 	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
-	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+	QTRY_VERIFY_WITH_TIMEOUT(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model, 30000);
 
 	// Rotate the camera
 	QTest::mousePress(m_pWindow->GetGraphicsWindow(), Qt::LeftButton);
@@ -173,180 +354,4310 @@ void ModelViewerTest::integration()
 
 	QTest::qWait(100);
 
-	m_pWindow->hide();
-	QVERIFY(m_pWindow->isHidden());
+	m_pWindow->hide();
+	QVERIFY(m_pWindow->isHidden());
+}
+
+void ModelViewerTest::invalidFile()
+{
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+
+	QSignalSpy beginLoadSignalSpy(pGraphicsWindow, SIGNAL(BeginModelLoading(QString)));
+	QSignalSpy endLoadSignalSpy(pGraphicsWindow, SIGNAL(EndModelLoading(bool, QString)));
+
+	QString path("../Data/Models/Avent.mtl");
+	m_pWindow->GetGraphicsWindow()->loadModel(path);
+
+	// Ensure the correct signals were sent
+	QCOMPARE(beginLoadSignalSpy.count(), 1);
+	QVERIFY(endLoadSignalSpy.wait(30000));
+	QCOMPARE(endLoadSignalSpy.count(), 1);
+
+	auto arguments = endLoadSignalSpy.takeFirst();
+	QVERIFY(arguments.at(0).toBool() == false);
+
+	// Check that the status is updated
+	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_error);
+}
+
+void ModelViewerTest::loadingPage()
+{
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+
+	pGraphicsWindow->unloadModel();
+
+	// Check the status before
+	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_empty);
+
+	QSignalSpy beginLoadSignalSpy(pGraphicsWindow, SIGNAL(BeginModelLoading(QString)));
+	QSignalSpy endLoadSignalSpy(pGraphicsWindow, SIGNAL(EndModelLoading(bool, QString)));
+
+	QString path("../Data/Models/cubeColor.ply");
+	m_pWindow->GetGraphicsWindow()->loadModel(path);
+
+	// Ensure the correct signals were sent, the loading page is shown in between
+	QCOMPARE(beginLoadSignalSpy.count(), 1);
+	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_loading);
+	QVERIFY(endLoadSignalSpy.wait(30000));
+	QCOMPARE(endLoadSignalSpy.count(), 1);
+
+	auto arguments = endLoadSignalSpy.takeFirst();
+	QVERIFY(arguments.at(0).toBool() == true);
+	
+	// Check that the status is updated
+	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+}
+
+void ModelViewerTest::unloadModel()
+{
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+
+	// Load model
+	QString path("../Data/Models/cubeColor.ply");
+	QVERIFY(LoadModelAndWait(path));
+
+	// Check the status after
+	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+
+	pGraphicsWindow->unloadModel();
+
+	// Check the status after
+	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_empty);
+}
+
+void ModelViewerTest::testShow()
+{
+	QVERIFY(m_pWindow->isHidden());
+	m_pWindow->show();
+	QTest::qWait(100);
+	QVERIFY(m_pWindow->isHidden() == false);
+	m_pWindow->hide();
+}
+
+void ModelViewerTest::loadModel()
+{
+	Model loaded = ModelLoader::LoadModel("../Data/Primitives/cube.obj");
+	QVERIFY(loaded.m_isValid);
+}
+
+void ModelViewerTest::decodeVertexLayout()
+{
+	// Decoding does not need a context, so both layouts can be compared directly
+	LoadOptions options;
+	options.m_interleaved = false;
+	ModelData planar = ModelLoader::DecodeFile("../Data/Primitives/cube.obj", options);
+	options.m_interleaved = true;
+	ModelData interleaved = ModelLoader::DecodeFile("../Data/Primitives/cube.obj", options);
+
+	QVERIFY(planar.m_meshes.size() > 0);
+	QCOMPARE(planar.m_meshes.size(), interleaved.m_meshes.size());
+	for (size_t i = 0; i < planar.m_meshes.size(); ++i) {
+		const MeshData& a = planar.m_meshes[i];
+		const MeshData& b = interleaved.m_meshes[i];
+		QCOMPARE(a.m_vertexStride, 0);
+		QVERIFY(b.m_vertexStride > 0);
+		QCOMPARE(a.m_vertexData.size(), b.m_vertexData.size());
+		QVERIFY(a.m_indexData == b.m_indexData);
+
+		// A cube is small enough for 16 bit indices
+		QCOMPARE(b.m_indexType, GLenum(GL_UNSIGNED_SHORT));
+		QCOMPARE(b.m_indexData.size(), int(b.m_indexCount * sizeof(quint16)));
+
+		// The last vertex position must be the same in both layouts
+		const int vertexCount = b.m_vertexData.size() / b.m_vertexStride;
+		const float* pA = reinterpret_cast<const float*>(a.m_vertexData.constData() + a.m_positionOffset) + 3 * (vertexCount - 1);
+		const float* pB = reinterpret_cast<const float*>(b.m_vertexData.constData() + b.m_positionOffset + b.m_vertexStride * (vertexCount - 1));
+		QCOMPARE(pA[0], pB[0]);
+		QCOMPARE(pA[1], pB[1]);
+		QCOMPARE(pA[2], pB[2]);
+	}
+}
+
+void ModelViewerTest::decodeQuantizedVertices()
+{
+	LoadOptions options;
+	ModelData full = ModelLoader::DecodeFile("../Data/Models/cubeColor.ply", options);
+	options.m_quantize = true;
+	options.m_quantizePositions = true;
+	ModelData quantized = ModelLoader::DecodeFile("../Data/Models/cubeColor.ply", options);
+
+	QVERIFY(full.m_meshes.size() > 0);
+	QCOMPARE(full.m_meshes.size(), quantized.m_meshes.size());
+	for (size_t i = 0; i < full.m_meshes.size(); ++i) {
+		const MeshData& a = full.m_meshes[i];
+		const MeshData& b = quantized.m_meshes[i];
+		QVERIFY(b.m_vertexStride < a.m_vertexStride);
+		QCOMPARE(b.m_positionType, GLenum(GL_UNSIGNED_SHORT));
+
+		// Decoding the first position gives back the original within the quantization error
+		const float* pA = reinterpret_cast<const float*>(a.m_vertexData.constData() + a.m_positionOffset);
+		const quint16* pB = reinterpret_cast<const quint16*>(b.m_vertexData.constData() + b.m_positionOffset);
+		const QVector3D decoded = b.m_positionDecode * QVector3D(pB[0] / 65535.f, pB[1] / 65535.f, pB[2] / 65535.f);
+		const float tolerance = (b.m_AABBMax - b.m_AABBMin).length() / 65535.f + 1e-6f;
+		QVERIFY(qAbs(decoded.x() - pA[0]) <= tolerance);
+		QVERIFY(qAbs(decoded.y() - pA[1]) <= tolerance);
+		QVERIFY(qAbs(decoded.z() - pA[2]) <= tolerance);
+	}
+}
+
+void ModelViewerTest::decodeBatchedMeshes()
+{
+	LoadOptions options;
+	ModelData separate = ModelLoader::DecodeFile("../Data/Primitives/prisms.fbx", options);
+	options.m_batchStatic = true;
+	ModelData batched = ModelLoader::DecodeFile("../Data/Primitives/prisms.fbx", options);
+
+	// Batching merges meshes but must not lose any geometry
+	QVERIFY(batched.m_meshes.size() > 0);
+	QVERIFY(batched.m_meshes.size() <= separate.m_meshes.size());
+	auto CountIndices = [](const ModelData& model) {
+		int count = 0;
+		for (const MeshData& mesh : model.m_meshes) {
+			count += mesh.m_indexCount;
+		}
+		return count;
+	};
+	QCOMPARE(CountIndices(batched), CountIndices(separate));
+}
+
+void ModelViewerTest::decodeInstancedMeshes()
+{
+	ModelData model = ModelLoader::DecodeFile("../Data/Primitives/prisms.fbx");
+	QVERIFY(model.m_meshes.size() > 0);
+
+	// Meshes referenced more than once are only decoded once, with a transform per reference
+	for (const MeshData& mesh : model.m_meshes) {
+		QVERIFY(mesh.m_instanceTransforms.size() != 1);
+		if (!mesh.m_instanceTransforms.empty()) {
+			QVERIFY(mesh.m_transform.isIdentity());
+		}
+	}
+}
+
+void ModelViewerTest::importProfiles()
+{
+	// Each profile runs at least the steps of the faster ones
+	LoadOptions options;
+	options.m_importProfile = ImportProfile::FastPreview;
+	const unsigned int fast = ModelLoader::ImportFlags(options);
+	options.m_importProfile = ImportProfile::Balanced;
+	const unsigned int balanced = ModelLoader::ImportFlags(options);
+	const unsigned int quality = ModelLoader::ImportFlags();
+	QCOMPARE(fast & balanced, fast);
+	QCOMPARE(balanced & quality, balanced);
+	QVERIFY(fast != quality);
+
+	// Custom steps are added to the ones drawing needs
+	options.m_importProfile = ImportProfile::Custom;
+	options.m_customImportSteps = ModelLoader::CustomImportSteps().front().m_flag;
+	QCOMPARE(ModelLoader::ImportFlags(options) & fast, fast);
+	QVERIFY(ModelLoader::ImportFlags(options) & options.m_customImportSteps);
+
+	// A fast import can still be drawn and lit
+	options.m_importProfile = ImportProfile::FastPreview;
+	ModelData data = ModelLoader::DecodeFile("../Data/Primitives/cube.obj", options);
+	QVERIFY(data.m_meshes.size() > 0);
+	QVERIFY(data.m_meshes[0].m_hasNormals);
+	QVERIFY(data.m_meshes[0].m_indexCount % 3 == 0);
+}
+
+void ModelViewerTest::decodePreviewProxy()
+{
+	// The proxy keeps the meshes and bounds of the full model with far fewer triangles
+	const QString path = "../Data/Models/13903_Mars_v1_l3.obj";
+	ModelData full = ModelLoader::DecodeFile(path);
+	ModelData proxy = ModelLoader::DecodeProxyFile(path);
+	QCOMPARE(proxy.m_meshes.size(), full.m_meshes.size());
+
+	int fullIndices = 0;
+	int proxyIndices = 0;
+	for (size_t i = 0; i < full.m_meshes.size(); ++i) {
+		const MeshData& fullMesh = full.m_meshes[i];
+		const MeshData& proxyMesh = proxy.m_meshes[i];
+		fullIndices += fullMesh.m_indexCount;
+		proxyIndices += proxyMesh.m_indexCount;
+		QVERIFY(proxyMesh.m_hasNormals);
+		QVERIFY(proxyMesh.m_indexCount % 3 == 0);
+		QVERIFY((proxyMesh.m_AABBMin - fullMesh.m_AABBMin).length() < 1e-3f);
+		QVERIFY((proxyMesh.m_AABBMax - fullMesh.m_AABBMax).length() < 1e-3f);
+	}
+	QVERIFY(proxyIndices > 0);
+	QVERIFY(proxyIndices * 4 < fullIndices);
+}
+
+void ModelViewerTest::generateLevelsOfDetail()
+{
+	// Each level has fewer triangles than the one before and lives in the same index block
+	LoadOptions options;
+	ModelData data = ModelLoader::DecodeFile("../Data/Models/13903_Mars_v1_l3.obj", options);
+	QVERIFY(data.m_meshes.size() > 0);
+	bool anyLods = false;
+	for (const MeshData& mesh : data.m_meshes) {
+		const int indexSize = mesh.m_indexType == GL_UNSIGNED_SHORT ? 2 : 4;
+		int previous = mesh.m_indexCount;
+		int end = mesh.m_indexCount;
+		for (const MeshLod& lod : mesh.m_lods) {
+			QCOMPARE(lod.m_firstIndex, end);
+			QVERIFY(lod.m_indexCount > 0);
+			QVERIFY(lod.m_indexCount % 3 == 0);
+			QVERIFY(lod.m_indexCount < previous);
+			previous = lod.m_indexCount;
+			end += lod.m_indexCount;
+		}
+		QCOMPARE(mesh.m_indexData.size(), end * indexSize);
+		anyLods = anyLods || !mesh.m_lods.empty();
+	}
+	QVERIFY(anyLods);
+
+	// Small meshes and disabled levels of detail are always drawn in full
+	QVERIFY(ModelLoader::DecodeFile("../Data/Primitives/cube.obj", options).m_meshes[0].m_lods.empty());
+	options.m_generateLods = false;
+	data = ModelLoader::DecodeFile("../Data/Models/13903_Mars_v1_l3.obj", options);
+	for (const MeshData& mesh : data.m_meshes) {
+		QVERIFY(mesh.m_lods.empty());
+	}
+}
+
+void ModelViewerTest::geometryArena()
+{
+	// Ranges start on a whole vertex or index after what is taken
+	QCOMPARE(GeometryArena::FitOffset(0, 100, 40, 12), 0);
+	QCOMPARE(GeometryArena::FitOffset(40, 100, 40, 12), 48);
+	QCOMPARE(GeometryArena::FitOffset(48, 100, 52, 4), 48);
+
+	// A range that doesn't fit behind the aligned offset needs another page
+	QCOMPARE(GeometryArena::FitOffset(50, 100, 48, 12), -1);
+	QCOMPARE(GeometryArena::FitOffset(0, 100, 101, 4), -1);
+
+	// Loaded meshes are suballocated from the pages when base vertex draws are supported
+	QVERIFY(LoadModelAndWait("../Data/Models/13903_Mars_v1_l3.obj"));
+	const Model& model = m_pWindow->GetGraphicsWindow()->GetCurrentModel();
+	QVERIFY(model.m_geometry);
+	qint64 sharedBytes = 0;
+	for (const Mesh& mesh : model.m_meshes) {
+		if (mesh.m_sharesBuffers) {
+			QVERIFY(mesh.m_baseVertex >= 0);
+			QVERIFY(mesh.m_indexOffset >= 0);
+			sharedBytes += mesh.m_vertexBytes + mesh.m_indexBytes;
+		}
+	}
+	QVERIFY(model.m_geometry->Bytes() >= sharedBytes);
+	QVERIFY(sharedBytes == 0 || model.m_geometry->PageCount() >= 2);
+}
+
+void ModelViewerTest::boundsMath()
+{
+	// Points lying entirely below zero, with a fourth float in between
+	const float points[] = { -1.f, -2.f, -3.f, 9.f, -5.f, -4.f, -1.f, 9.f, -2.f, -7.f, -0.5f };
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	BoundsMath::AddPoints(points, 3, 4, min, max);
+	QCOMPARE(min, QVector3D(-5.f, -7.f, -3.f));
+	QCOMPARE(max, QVector3D(-1.f, -2.f, -0.5f));
+
+	// So does a model made of them, its bounds don't reach up to zero
+	Model model;
+	model.m_meshes.resize(1);
+	model.m_meshes[0].m_AABBMin = min;
+	model.m_meshes[0].m_AABBMax = max;
+	model.Finalize();
+	QCOMPARE(model.m_AABBMax, max);
+
+	// Moving the center and extents bounds a box like its eight corners do
+	QMatrix4x4 transform;
+	transform.translate(3.f, -1.f, 2.f);
+	transform.rotate(30.f, 1, 2, 3);
+	transform.scale(1.f, 2.f, 0.5f);
+	QVector3D boxMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D boxMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	BoundsMath::AddTransformedBox(transform, QVector3D(-1, -2, -3), QVector3D(1, 2, 3), boxMin, boxMax);
+	QVector3D cornerMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D cornerMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (int corner = 0; corner < 8; ++corner) {
+		const QVector3D p = transform * QVector3D(corner & 1 ? 1 : -1, corner & 2 ? 2 : -2, corner & 4 ? 3 : -3);
+		for (int i = 0; i < 3; ++i) {
+			cornerMin[i] = std::min(cornerMin[i], p[i]);
+			cornerMax[i] = std::max(cornerMax[i], p[i]);
+		}
+	}
+	QVERIFY((boxMin - cornerMin).length() < 1e-4f);
+	QVERIFY((boxMax - cornerMax).length() < 1e-4f);
+
+	// An empty box adds nothing
+	BoundsMath::AddTransformedBox(transform, QVector3D(FLT_MAX, FLT_MAX, FLT_MAX), QVector3D(-FLT_MAX, -FLT_MAX, -FLT_MAX), boxMin, boxMax);
+	QVERIFY((boxMin - cornerMin).length() < 1e-4f);
+
+	// Boxes against two planes, x >= 0 and y <= 5
+	const QVector4D planes[] = { QVector4D(1, 0, 0, 0), QVector4D(0, -1, 0, 5) };
+	BoundsMath::PlaneSet planeSet;
+	BoundsMath::SetPlanes(planes, 2, planeSet);
+	QVERIFY(BoundsMath::BoxIntersects(planeSet, QVector3D(-1, 0, 0), QVector3D(1, 1, 1)));
+	QVERIFY(!BoundsMath::BoxInside(planeSet, QVector3D(-1, 0, 0), QVector3D(1, 1, 1)));
+	QVERIFY(!BoundsMath::BoxIntersects(planeSet, QVector3D(-3, 0, 0), QVector3D(-1, 1, 1)));
+	QVERIFY(BoundsMath::BoxInside(planeSet, QVector3D(1, 0, 0), QVector3D(2, 4, 1)));
+	QVERIFY(!BoundsMath::BoxIntersects(planeSet, QVector3D(1, 6, 0), QVector3D(2, 7, 1)));
+}
+
+void ModelViewerTest::frustumCulling()
+{
+	// A rotated box reaches past the transformed min and max, all corners count
+	Model model;
+	model.m_meshes.resize(1);
+	model.m_meshes[0].m_AABBMin = QVector3D(-1, -1, -1);
+	model.m_meshes[0].m_AABBMax = QVector3D(1, 1, 1);
+	model.m_meshes[0].m_transform.rotate(45.f, 0, 0, 1);
+	model.Finalize();
+	QVERIFY(qAbs(model.m_meshes[0].m_AABBMax.x() - std::sqrt(2.f)) < 1e-4f);
+	QVERIFY(qAbs(model.m_meshes[0].m_AABBMin.y() + std::sqrt(2.f)) < 1e-4f);
+
+	// Boxes in front of the camera pass, boxes behind it or off to the side don't
+	QMatrix4x4 viewProjection;
+	viewProjection.perspective(45.f, 1.f, 0.1f, 100.f);
+	const Frustum frustum(viewProjection);
+	QVERIFY(frustum.Intersects(QVector3D(-1, -1, -11), QVector3D(1, 1, -9)));
+	QVERIFY(!frustum.Intersects(QVector3D(-1, -1, 9), QVector3D(1, 1, 11)));
+	QVERIFY(!frustum.Intersects(QVector3D(49, -1, -11), QVector3D(51, 1, -9)));
+	QVERIFY(!frustum.Intersects(QVector3D(-1, -1, -211), QVector3D(1, 1, -209)));
+
+	// A box around the camera is always drawn
+	QVERIFY(frustum.Intersects(QVector3D(-100, -100, -100), QVector3D(100, 100, 100)));
+}
+
+void ModelViewerTest::transformCache()
+{
+	// A scaled and rotated mesh with quantized positions
+	Model model;
+	model.m_meshes.resize(2);
+	model.m_meshes[0].m_transform.rotate(30.f, 0, 1, 0);
+	model.m_meshes[0].m_transform.scale(1.f, 2.f, 3.f);
+	model.m_meshes[0].m_positionDecode.scale(0.5f);
+	model.m_meshes[1].m_transform.translate(5.f, 0.f, 0.f);
+
+	QMatrix4x4 projection;
+	projection.perspective(45.f, 1.f, 0.1f, 100.f);
+	QMatrix4x4 modelMatrix;
+	modelMatrix.translate(0.f, 0.f, -10.f);
+	modelMatrix.rotate(20.f, 1, 0, 0);
+
+	// The cached matrices match the ones worked out from scratch
+	TransformCache cache;
+	cache.Build(model);
+	cache.SetView(projection, modelMatrix);
+	const Mesh& mesh = model.m_meshes[0];
+	const QMatrix4x4 modelView = modelMatrix * mesh.m_transform * mesh.m_positionDecode;
+	const QMatrix3x3 normal = (modelMatrix * mesh.m_transform).normalMatrix();
+	for (int i = 0; i < 16; ++i) {
+		QVERIFY(qAbs(cache.ModelView(0).constData()[i] - modelView.constData()[i]) < 1e-4f);
+		QVERIFY(qAbs(cache.ModelViewProjection(0).constData()[i] - (projection * modelView).constData()[i]) < 1e-4f);
+	}
+	for (int i = 0; i < 9; ++i) {
+		QVERIFY(qAbs(cache.Normal(0).constData()[i] - normal.constData()[i]) < 1e-4f);
+	}
+	QCOMPARE(cache.UpdateCount(), qint64(1));
+
+	// Only meshes asked for are computed, and only once while the view stays the same
+	cache.SetView(projection, modelMatrix);
+	cache.ModelView(0);
+	cache.ModelView(1);
+	QCOMPARE(cache.UpdateCount(), qint64(2));
+
+	modelMatrix.rotate(10.f, 0, 1, 0);
+	cache.SetView(projection, modelMatrix);
+	cache.Normal(1);
+	QCOMPARE(cache.UpdateCount(), qint64(3));
+}
+
+void ModelViewerTest::meshHierarchy()
+{
+	// A 10x10x10 grid of unit boxes, two apart
+	Model model;
+	for (int x = 0; x < 10; ++x) {
+		for (int y = 0; y < 10; ++y) {
+			for (int z = 0; z < 10; ++z) {
+				Mesh mesh;
+				mesh.m_AABBMin = QVector3D(x * 2.f, y * 2.f, z * 2.f);
+				mesh.m_AABBMax = mesh.m_AABBMin + QVector3D(1, 1, 1);
+				model.m_meshes.push_back(mesh);
+			}
+		}
+	}
+	MeshBvh bvh;
+	bvh.Build(model);
+	QVERIFY(!bvh.IsEmpty());
+	QVERIFY(bvh.NodeCount() < 2 * int(model.m_meshes.size()));
+	QCOMPARE(bvh.Min(), QVector3D(0, 0, 0));
+	QCOMPARE(bvh.Max(), QVector3D(19, 19, 19));
+
+	// Finds the same meshes as testing each one
+	QMatrix4x4 viewProjection;
+	viewProjection.perspective(30.f, 1.f, 0.1f, 100.f);
+	viewProjection.lookAt(QVector3D(5, 5, 40), QVector3D(5, 5, 0), QVector3D(0, 1, 0));
+	const Frustum frustum(viewProjection);
+	std::vector<int> visible;
+	bvh.CollectVisible(frustum, visible);
+	std::vector<int> expected;
+	for (int i = 0; i < int(model.m_meshes.size()); ++i) {
+		if (frustum.Intersects(model.m_meshes[i].m_AABBMin, model.m_meshes[i].m_AABBMax)) {
+			expected.push_back(i);
+		}
+	}
+	QVERIFY(!visible.empty());
+	QVERIFY(visible.size() < model.m_meshes.size());
+	QVERIFY(visible == expected);
+
+	// Rays hit the nearest box
+	float distance = 0.f;
+	QCOMPARE(bvh.Raycast(QVector3D(0.5f, 0.5f, -5.f), QVector3D(0, 0, 1), &distance), 0);
+	QVERIFY(qAbs(distance - 5.f) < 1e-4f);
+	QCOMPARE(bvh.Raycast(QVector3D(1.5f, 0.5f, -5.f), QVector3D(0, 0, 1)), -1);
+
+	// Moved meshes are found after a refit
+	model.m_meshes[0].m_AABBMin = QVector3D(-10, -10, -10);
+	model.m_meshes[0].m_AABBMax = QVector3D(-9, -9, -9);
+	bvh.Refit(model);
+	QCOMPARE(bvh.Min(), QVector3D(-10, -10, -10));
+	QCOMPARE(bvh.Raycast(QVector3D(-9.5f, -9.5f, -20.f), QVector3D(0, 0, 1)), 0);
+}
+
+void ModelViewerTest::meshPicking()
+{
+	// The narrowed projection stretches the picked pixel over the whole clip volume
+	const QSize viewport(640, 480);
+	QMatrix4x4 projection;
+	projection.perspective(60.f, 640.f / 480.f, 0.1f, 100.f);
+	const QMatrix4x4 pixelProjection = MeshPicker::PixelProjection(viewport, QPoint(100, 50)) * projection;
+	const QVector3D center = pixelProjection.map(MeshPicker::Unproject(projection, viewport, QPointF(100.5, 50.5), 0.5f));
+	QVERIFY(qAbs(center.x()) < 1e-2f && qAbs(center.y()) < 1e-2f);
+	const QVector3D corner = pixelProjection.map(MeshPicker::Unproject(projection, viewport, QPointF(101, 50), 0.5f));
+	QVERIFY(qAbs(corner.x() - 1.f) < 1e-2f && qAbs(corner.y() - 1.f) < 1e-2f);
+
+	// Depth 0 is on the near plane, the middle of the viewport on the view axis
+	const QVector3D nearPoint = MeshPicker::Unproject(projection, viewport, QPointF(320, 240), 0.f);
+	QVERIFY((nearPoint - QVector3D(0, 0, -0.1f)).length() < 1e-4f);
+
+	// Moving the pivot doesn't move the view, and the pivot stays put while rotating
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphics = m_pWindow->GetGraphicsWindow();
+	const QVector3D pivot(0.3f, 0.2f, -0.1f);
+	const QVector3D point(-0.5f, 0.4f, 0.2f);
+	const QVector3D before = pGraphics->GetModelMatrix().map(point);
+	pGraphics->SetOrbitPivot(pivot);
+	QVERIFY((pGraphics->GetModelMatrix().map(point) - before).length() < 1e-4f);
+	const QVector3D eyePivot = pGraphics->GetModelMatrix().map(pivot);
+	pGraphics->SetRotation(pGraphics->GetRotX() + 40.f, pGraphics->GetRotY() - 20.f);
+	QVERIFY((pGraphics->GetModelMatrix().map(pivot) - eyePivot).length() < 1e-4f);
+
+	// Resetting the view goes back to rotating about the origin
+	pGraphics->resetView();
+	QCOMPARE(pGraphics->GetOrbitPivot(), QVector3D());
+	m_pWindow->hide();
+}
+
+void ModelViewerTest::readCompressedTexture()
+{
+	// An 8x8 DXT1 texture with 2 mip levels, made of 4 blocks and 1 block
+	QByteArray dds(128, '\0');
+	dds.replace(0, 4, "DDS ");
+	qToLittleEndian<quint32>(0x20000, dds.data() + 8);
+	qToLittleEndian<quint32>(8, dds.data() + 12);
+	qToLittleEndian<quint32>(8, dds.data() + 16);
+	qToLittleEndian<quint32>(2, dds.data() + 28);
+	qToLittleEndian<quint32>(0x4, dds.data() + 80);
+	dds.replace(84, 4, "DXT1");
+	dds.append(QByteArray(5 * 8, '\x7f'));
+
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath("texture.dds");
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write(dds);
+	file.close();
+
+	QVERIFY(IsCompressedTextureFile(path));
+	CompressedImage image = ReadCompressedTexture(path);
+	QCOMPARE(image.m_format, QOpenGLTexture::RGBA_DXT1);
+	QCOMPARE(image.m_size, QSize(8, 8));
+	QCOMPARE(int(image.m_levels.size()), 2);
+	QCOMPARE(image.m_levels[0].size(), 32);
+	QCOMPARE(image.m_levels[1].size(), 8);
+
+	// Uncompressed files are left to QImage
+	QVERIFY(!IsCompressedTextureFile("texture.png"));
+	QVERIFY(ReadCompressedTexture("../Data/Missing.dds").isNull());
+}
+
+void ModelViewerTest::frameStatistics()
+{
+	FrameStats stats;
+	QCOMPARE(stats.Summarize().m_fps, 0);
+
+	// 1 to 100 ms
+	for (int i = 1; i <= 100; ++i) {
+		stats.AddFrame(i / 1000.f);
+	}
+	FrameStats::Summary summary = stats.Summarize();
+	QCOMPARE(stats.Count(), 100);
+	QCOMPARE(summary.m_min, 0.001f);
+	QCOMPARE(summary.m_p95, 0.095f);
+	QCOMPARE(summary.m_p99, 0.099f);
+	QVERIFY(qAbs(summary.m_avg - 0.0505f) < 1e-5f);
+
+	// Only the most recent frames are kept
+	for (int i = 0; i < FrameStats::k_capacity; ++i) {
+		stats.AddFrame(0.01f);
+	}
+	QCOMPARE(stats.Count(), FrameStats::k_capacity);
+	QCOMPARE(stats.Latest(), 0.01f);
+	QCOMPARE(stats.Summarize().m_fps, 100);
+}
+
+void ModelViewerTest::textOverlay()
+{
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+
+	TextRenderer text;
+	QVERIFY(text.Create(QFont(), 1.));
+	QVERIFY(text.LineSpacing() > 0);
+
+	// Lines are as wide as their glyphs, characters outside the atlas are drawn as '?'
+	QCOMPARE(text.TextWidth("ab\nc"), text.TextWidth("a") + text.TextWidth("b"));
+	QCOMPARE(text.TextWidth(QString(QChar(0x00e9))), text.TextWidth("?"));
+
+	// Everything queued goes in one draw, and nothing is left for the next
+	text.Add("FPS: 60\nDraws: 10", QPointF(4, 4));
+	text.Add("Selected", QPointF(100, 4), true);
+	QCOMPARE(text.Draw(QSize(640, 480), Qt::white), 1);
+	QCOMPARE(text.Draw(QSize(640, 480), Qt::white), 0);
+
+	text.Destroy();
+	QVERIFY(!text.IsCreated());
+	pGraphicsWindow->doneCurrent();
+}
+
+void ModelViewerTest::resolutionScaling()
+{
+	const float target = 1.f / 60.f;
+
+	// Frames that take four times too long are drawn at a lower resolution, never below the minimum
+	float scale = ResolutionScaler::NextScale(1.f, target * 4.f, target);
+	QVERIFY(scale < 1.f);
+	for (int i = 0; i < 20; ++i) {
+		scale = ResolutionScaler::NextScale(scale, target * 4.f, target);
+	}
+	QCOMPARE(scale, ResolutionScaler::k_minScale);
+
+	// Fast frames bring the full resolution back
+	for (int i = 0; i < 20; ++i) {
+		scale = ResolutionScaler::NextScale(scale, target * 0.25f, target);
+	}
+	QCOMPARE(scale, 1.f);
+
+	// Frames close to the target leave the scale alone, so it doesn't flicker
+	QCOMPARE(ResolutionScaler::NextScale(0.75f, target * 0.9f, target), 0.75f);
+	QCOMPARE(ResolutionScaler::NextScale(0.75f, 0.f, target), 0.75f);
+}
+
+void ModelViewerTest::frameAccumulation()
+{
+	// The radical inverse of the index, 6 is 110 in base 2 and 20 in base 3
+	QCOMPARE(FrameAccumulator::Halton(1, 2), 0.5f);
+	QCOMPARE(FrameAccumulator::Halton(6, 2), 0.375f);
+	QVERIFY(qAbs(FrameAccumulator::Halton(6, 3) - 2.f / 9.f) < 1e-6f);
+
+	// Offsets stay inside the pixel, and sixteen of them average out close to its center
+	QPointF sum;
+	for (int sample = 0; sample < 16; ++sample) {
+		const QPointF jitter = FrameAccumulator::Jitter(sample);
+		QVERIFY(jitter.x() >= -0.5 && jitter.x() < 0.5);
+		QVERIFY(jitter.y() >= -0.5 && jitter.y() < 0.5);
+		sum += jitter;
+	}
+	QVERIFY(qAbs(sum.x() / 16.) < 0.05 && qAbs(sum.y() / 16.) < 0.05);
+}
+
+void ModelViewerTest::displayModes()
+{
+	// Points of a scan are spread over the square of its diagonal, a 3 by 4 box with 25 points
+	// has them 1 apart. With a 90 degree field of view a unit at distance 1 is half the viewport.
+	QCOMPARE(MeshDisplayModes::PointSpacing(QVector3D(0, 0, 0), QVector3D(3, 4, 0), 25), 1.f);
+	QVERIFY(qAbs(MeshDisplayModes::PointScale(1.f, 200.f, 90.f) - 100.f) < 1e-3f);
+
+	// Meshes know how many vertices to draw as points, interleaved or not
+	QVERIFY(LoadModelAndWait("../Data/Primitives/cube.obj"));
+	for (const Mesh& mesh : m_pWindow->GetGraphicsWindow()->GetCurrentModel().m_meshes) {
+		QVERIFY(mesh.m_vertexCount > 0);
+	}
+
+	// Every mode draws
+	AppSettings* settings = m_pWindow->GetSettingsWindow()->getSettings();
+	for (int mode : { k_displayWireframe, k_displayPoints, k_displayShaded }) {
+		settings->setValue("ViewerGraphicsWindow/displayMode", mode);
+		m_pWindow->GetGraphicsWindow()->loadSettings();
+		QTest::qWait(50);
+	}
+	settings->remove("ViewerGraphicsWindow/displayMode");
+	m_pWindow->GetGraphicsWindow()->loadSettings();
+}
+
+void ModelViewerTest::geometryStreaming()
+{
+	// Clusters hold every triangle of the mesh and of its levels once, no more than the
+	// limit at full detail, within the bounds of the mesh
+	LoadOptions options;
+	for (bool interleaved : { true, false }) {
+		options.m_interleaved = interleaved;
+		options.m_clusterTriangles = 0;
+		const ModelData whole = ModelLoader::DecodeFile("../Data/Primitives/Torus.obj", options);
+		options.m_clusterTriangles = 256;
+		const ModelData split = ModelLoader::DecodeFile("../Data/Primitives/Torus.obj", options);
+		QCOMPARE(whole.m_meshes.size(), size_t(1));
+		QVERIFY(split.m_meshes.size() > 1);
+
+		const MeshData& mesh = whole.m_meshes.front();
+		int lodIndices = 0;
+		for (const MeshLod& lod : mesh.m_lods) {
+			lodIndices += lod.m_indexCount;
+		}
+		int partIndices = 0;
+		int partLodIndices = 0;
+		for (const MeshData& part : split.m_meshes) {
+			QVERIFY(part.m_indexCount <= 256 * 3);
+			QVERIFY(part.m_AABBMin.x() >= mesh.m_AABBMin.x() - 1e-4f && part.m_AABBMax.x() <= mesh.m_AABBMax.x() + 1e-4f);
+			QVERIFY(part.m_AABBMin.z() >= mesh.m_AABBMin.z() - 1e-4f && part.m_AABBMax.z() <= mesh.m_AABBMax.z() + 1e-4f);
+			QCOMPARE(part.m_indexType, GLenum(GL_UNSIGNED_SHORT));
+			partIndices += part.m_indexCount;
+			for (const MeshLod& lod : part.m_lods) {
+				partLodIndices += lod.m_indexCount;
+			}
+		}
+		QCOMPARE(partIndices, mesh.m_indexCount);
+		QCOMPARE(partLodIndices, lodIndices);
+	}
+
+	// The meshes used longest ago are freed first, never one used this frame
+	const std::vector<qint64> bytes = { 100, 100, 100, 100 };
+	const std::vector<quint64> lastUsed = { 3, 1, 5, 2 };
+	const std::vector<bool> resident = { true, true, true, false };
+	QVERIFY(GeometryStreamer::SelectEvictions(bytes, lastUsed, resident, 5, 150) == std::vector<int>({ 1, 0 }));
+	QVERIFY(GeometryStreamer::SelectEvictions(bytes, lastUsed, resident, 5, 1000) == std::vector<int>({ 1, 0 }));
+	QVERIFY(GeometryStreamer::SelectEvictions(bytes, lastUsed, resident, 5, 0).empty());
+}
+
+void ModelViewerTest::meshlets()
+{
+	// A flat grid facing +z, large enough to be divided
+	const int size = 80;
+	std::vector<QVector3D> positions;
+	for (int y = 0; y <= size; ++y) {
+		for (int x = 0; x <= size; ++x) {
+			positions.push_back(QVector3D(x, y, 0));
+		}
+	}
+	std::vector<quint32> indices;
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			const quint32 v = quint32(y * (size + 1) + x);
+			indices.insert(indices.end(), { v, v + 1, v + size + 2, v, v + size + 2, v + size + 1 });
+		}
+	}
+	QVERIFY(Meshlets::Build(positions, indices.data(), 3 * (Meshlets::k_minTriangles - 1)).empty());
+
+	// Meshlets follow each other through the indices within the limits, and their cones
+	// point the way the grid faces
+	const std::vector<Meshlet> meshlets = Meshlets::Build(positions, indices.data(), int(indices.size()));
+	QVERIFY(meshlets.size() > 1);
+	int next = 0;
+	for (const Meshlet& meshlet : meshlets) {
+		QCOMPARE(meshlet.m_firstIndex, next);
+		QVERIFY(meshlet.m_indexCount <= 3 * Meshlets::k_maxTriangles);
+		const std::set<quint32> vertices(indices.begin() + meshlet.m_firstIndex, indices.begin() + meshlet.m_firstIndex + meshlet.m_indexCount);
+		QVERIFY(int(vertices.size()) <= Meshlets::k_maxVertices);
+		for (quint32 v : vertices) {
+			QVERIFY((positions[v] - meshlet.m_center).length() <= meshlet.m_radius + 1e-4f);
+		}
+		QVERIFY(meshlet.m_coneCos > 0.99f);
+		QVERIFY(meshlet.m_coneAxis.z() > 0.99f);
+		next += meshlet.m_indexCount;
+	}
+	QCOMPARE(next, int(indices.size()));
+
+	// Seen from below everything faces away, from above nothing does. Meshlets that pass
+	// are drawn as one run.
+	const QVector3D above(40, 40, 100);
+	const QVector3D below(40, 40, -100);
+	QVERIFY(!Meshlets::IsBackFacing(meshlets.front(), above));
+	QVERIFY(Meshlets::IsBackFacing(meshlets.front(), below));
+	QMatrix4x4 everything;
+	everything.ortho(-1000, 1000, -1000, 1000, -1000, 1000);
+	std::vector<std::pair<int, int>> runs;
+	Meshlets::VisibleRuns(meshlets, Frustum(everything), &above, runs);
+	QVERIFY(runs == std::vector<std::pair<int, int>>({ { 0, int(indices.size()) } }));
+	Meshlets::VisibleRuns(meshlets, Frustum(everything), &below, runs);
+	QVERIFY(runs.empty());
+
+	// Only the meshlets near the corner the view is moved to pass the frustum
+	QMatrix4x4 corner;
+	corner.ortho(-5, 5, -5, 5, -1000, 1000);
+	QVERIFY(Frustum(corner).IntersectsSphere(QVector3D(6, 0, 0), 2.f));
+	QVERIFY(!Frustum(corner).IntersectsSphere(QVector3D(8, 0, 0), 2.f));
+	Meshlets::VisibleRuns(meshlets, Frustum(corner), nullptr, runs);
+	QVERIFY(!runs.empty());
+	QVERIFY(runs.front().first == 0 && runs.back().first + runs.back().second < int(indices.size()));
+}
+
+void ModelViewerTest::vertexCacheOrder()
+{
+	// A grid with its triangles shuffled misses the cache almost every time
+	const int size = 60;
+	std::vector<std::array<quint32, 3>> triangles;
+	for (int y = 0; y < size; ++y) {
+		for (int x = 0; x < size; ++x) {
+			const quint32 v = quint32(y * (size + 1) + x);
+			triangles.push_back({ v, v + 1, v + size + 2 });
+			triangles.push_back({ v, v + size + 2, v + size + 1 });
+		}
+	}
+	std::mt19937 random(7);
+	std::shuffle(triangles.begin(), triangles.end(), random);
+	std::vector<quint32> shuffled;
+	for (const std::array<quint32, 3>& triangle : triangles) {
+		shuffled.insert(shuffled.end(), triangle.begin(), triangle.end());
+	}
+	const int vertexCount = (size + 1) * (size + 1);
+	const VertexCacheOptimizer::Stats before = VertexCacheOptimizer::Analyze(shuffled.data(), int(shuffled.size()));
+	QVERIFY(before.m_acmr > 2.5);
+
+	// Tipsify keeps every triangle with its winding and gets close to one miss per vertex
+	const std::vector<quint32> optimized = VertexCacheOptimizer::OptimizeCache(shuffled, vertexCount);
+	const VertexCacheOptimizer::Stats after = VertexCacheOptimizer::Analyze(optimized.data(), int(optimized.size()));
+	QVERIFY(after.m_acmr < 0.8);
+	QVERIFY(after.m_atvr < 1.5);
+	auto Sorted = [](const std::vector<quint32>& indices) {
+		std::vector<std::array<quint32, 3>> ret;
+		for (size_t i = 0; i < indices.size(); i += 3) {
+			std::array<quint32, 3> triangle = { indices[i], indices[i + 1], indices[i + 2] };
+			std::rotate(triangle.begin(), std::min_element(triangle.begin(), triangle.end()), triangle.end());
+			ret.push_back(triangle);
+		}
+		std::sort(ret.begin(), ret.end());
+		return ret;
+	};
+	QVERIFY(Sorted(optimized) == Sorted(shuffled));
+
+	// Sorting for overdraw keeps the triangles and most of the gain
+	std::vector<QVector3D> positions;
+	for (int v = 0; v < vertexCount; ++v) {
+		positions.push_back(QVector3D(v % (size + 1), v / (size + 1), std::sin(v * 0.1f)));
+	}
+	const std::vector<quint32> overdraw = VertexCacheOptimizer::OptimizeOverdraw(optimized, positions);
+	QVERIFY(Sorted(overdraw) == Sorted(shuffled));
+	QVERIFY(VertexCacheOptimizer::Analyze(overdraw.data(), int(overdraw.size())).m_acmr <= after.m_acmr * 1.05 + 1e-9);
+
+	// Vertices go in the order they are first used, unused ones last
+	QVERIFY(VertexCacheOptimizer::FetchOrder({ 2, 0, 3, 3, 0, 2 }, 5) == std::vector<quint32>({ 2, 0, 3, 1, 4 }));
+
+	// Decoding stores the same geometry in the new order. Assimp already ran its own cache
+	// step on the torus, so the new order only has to be about as good.
+	LoadOptions options;
+	options.m_optimizeVertexCache = false;
+	const ModelData original = ModelLoader::DecodeFile("../Data/Primitives/Torus.obj", options);
+	options.m_optimizeVertexCache = true;
+	const ModelData reordered = ModelLoader::DecodeFile("../Data/Primitives/Torus.obj", options);
+	QCOMPARE(original.m_meshes.size(), reordered.m_meshes.size());
+	for (size_t i = 0; i < original.m_meshes.size(); ++i) {
+		const MeshData& a = original.m_meshes[i];
+		const MeshData& b = reordered.m_meshes[i];
+		QCOMPARE(a.m_indexCount, b.m_indexCount);
+		QCOMPARE(a.m_vertexData.size(), b.m_vertexData.size());
+		QCOMPARE(a.m_lods.size(), b.m_lods.size());
+		auto Indices = [](const MeshData& mesh) {
+			std::vector<quint32> ret(mesh.m_indexCount);
+			const quint16* pIndices = reinterpret_cast<const quint16*>(mesh.m_indexData.constData());
+			std::copy(pIndices, pIndices + mesh.m_indexCount, ret.begin());
+			return ret;
+		};
+		QCOMPARE(b.m_indexType, GLenum(GL_UNSIGNED_SHORT));
+		const std::vector<quint32> indicesA = Indices(a);
+		const std::vector<quint32> indicesB = Indices(b);
+		QVERIFY(VertexCacheOptimizer::Analyze(indicesB.data(), b.m_indexCount).m_acmr <= VertexCacheOptimizer::Analyze(indicesA.data(), a.m_indexCount).m_acmr * 1.05);
+		QCOMPARE(indicesB.front(), quint32(0));
+	}
+}
+
+void ModelViewerTest::modelCacheRoundTrip()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	ModelCache cache(dir.path());
+
+	LoadOptions options;
+	const QString file = "../Data/Models/cubeColor.ply";
+	ModelData data;
+	QVERIFY(!cache.Load(file, options, data));
+
+	ModelData decoded = ModelLoader::DecodeFile(file, options);
+	QVERIFY(decoded.m_meshes.size() > 0);
+	SceneLight light;
+	light.m_type = k_lightSpot;
+	light.m_position = QVector3D(1.f, 2.f, 3.f);
+	light.m_outerCone = 0.5f;
+	decoded.m_lights.push_back(light);
+	QVERIFY(cache.Store(file, options, decoded));
+	QVERIFY(QFile::exists(cache.EntryPath(file, options)));
+
+	// Everything the GPU upload needs comes back unchanged
+	QVERIFY(cache.Load(file, options, data));
+	QVERIFY(!data.m_pMappedFile.isNull());
+	QCOMPARE(data.m_meshes.size(), decoded.m_meshes.size());
+	for (size_t i = 0; i < data.m_meshes.size(); ++i) {
+		const MeshData& a = decoded.m_meshes[i];
+		const MeshData& b = data.m_meshes[i];
+		QVERIFY(a.m_vertexData == b.m_vertexData);
+		QVERIFY(a.m_indexData == b.m_indexData);
+		QCOMPARE(a.m_vertexStride, b.m_vertexStride);
+		QCOMPARE(a.m_colorOffset, b.m_colorOffset);
+		QCOMPARE(a.m_indexCount, b.m_indexCount);
+		QCOMPARE(a.m_indexType, b.m_indexType);
+		QCOMPARE(a.m_lods.size(), b.m_lods.size());
+		QCOMPARE(a.m_meshlets.size(), b.m_meshlets.size());
+		QCOMPARE(a.m_name, b.m_name);
+		QCOMPARE(a.m_material, b.m_material);
+		QCOMPARE(a.m_hasColors, b.m_hasColors);
+		QCOMPARE(a.m_transform, b.m_transform);
+		QCOMPARE(a.m_AABBMin, b.m_AABBMin);
+		QCOMPARE(a.m_AABBMax, b.m_AABBMax);
+
+		// Every mesh maps its own blocks, aligned so vertices can be read in place
+		QVERIFY(!b.m_pMapping.isNull());
+		QCOMPARE(quintptr(b.m_vertexData.constData()) % 16, quintptr(0));
+	}
+	QCOMPARE(data.m_materials.size(), decoded.m_materials.size());
+	for (size_t i = 0; i < data.m_materials.size(); ++i) {
+		QCOMPARE(data.m_materials[i].m_name, decoded.m_materials[i].m_name);
+		QCOMPARE(data.m_materials[i].m_properties.m_shininess, decoded.m_materials[i].m_properties.m_shininess);
+		QCOMPARE(data.m_materials[i].m_properties.m_metallicRoughness, decoded.m_materials[i].m_properties.m_metallicRoughness);
+		QCOMPARE(data.m_materials[i].m_properties.m_baseColor, decoded.m_materials[i].m_properties.m_baseColor);
+		QCOMPARE(data.m_materials[i].m_properties.m_alphaMode, decoded.m_materials[i].m_properties.m_alphaMode);
+		QCOMPARE(data.m_materials[i].m_properties.m_alphaCutoff, decoded.m_materials[i].m_properties.m_alphaCutoff);
+	}
+	QCOMPARE(data.m_lights.size(), size_t(1));
+	QCOMPARE(data.m_lights[0].m_type, int(k_lightSpot));
+	QCOMPARE(data.m_lights[0].m_position, light.m_position);
+	QCOMPARE(data.m_lights[0].m_outerCone, light.m_outerCone);
+
+	// Other options are separate entries
+	options.m_quantize = true;
+	QVERIFY(cache.EntryPath(file, options) != cache.EntryPath(file, LoadOptions()));
+	QVERIFY(!cache.Load(file, options, data));
+	QVERIFY(cache.EntryPath("../Data/Missing.ply", options).isEmpty());
+}
+
+void ModelViewerTest::prewarmRecentFiles()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const ModelCache cache(dir.path());
+	const LoadOptions options;
+	const std::atomic<bool> running(false);
+	const std::atomic<bool> cancelled(true);
+	const QString file = "../Data/Models/cubeColor.ply";
+
+	// Files over the budget and cancelled runs are left alone
+	QCOMPARE(ModelPrewarmer::Warm(file, options, 1, cache, running), qint64(0));
+	QCOMPARE(ModelPrewarmer::Warm(file, options, 1 << 30, cache, cancelled), qint64(0));
+	QVERIFY(!QFile::exists(cache.EntryPath(file, options)));
+
+	// The first run writes the entry the loader will map, later ones read it back
+	const qint64 written = ModelPrewarmer::Warm(file, options, 1 << 30, cache, running);
+	QVERIFY(written > 0);
+	ModelData data;
+	QVERIFY(cache.Load(file, options, data));
+	QCOMPARE(ModelPrewarmer::Warm(file, options, 1 << 30, cache, running), written);
+	QCOMPARE(ModelPrewarmer::Warm("../Data/Missing.obj", options, 1 << 30, cache, running), qint64(0));
+
+	// Runs stop when cancelled, also when a destructor does it
+	ModelPrewarmer prewarmer(dir.path());
+	prewarmer.Start({ file, "../Data/Primitives/cube.obj" }, options, 1 << 30);
+	prewarmer.Cancel();
+	QTRY_VERIFY(!prewarmer.IsRunning());
+}
+
+void ModelViewerTest::batchConvert()
+{
+	QTemporaryDir input;
+	QTemporaryDir output;
+	QVERIFY(input.isValid() && output.isValid());
+	QVERIFY(QDir(input.path()).mkpath("nested"));
+	QVERIFY(QFile::copy("../Data/Primitives/cube.obj", input.filePath("cube.obj")));
+	QVERIFY(QFile::copy("../Data/Models/cubeColor.ply", input.filePath("nested/cubeColor.ply")));
+	QVERIFY(QFile::copy("../Data/Models/cubeColor.ply", input.filePath("cube.ply")));
+
+	BatchConvertOptions options;
+	options.m_inputFolder = input.path();
+	options.m_outputFolder = output.path();
+	options.m_formatId = "stl";
+	options.m_workers = 2;
+
+	// Sources sharing a base name keep their suffix, the folder layout is kept
+	BatchConverter converter(options);
+	BatchConvertReport report = converter.Convert();
+	QVERIFY2(report.m_failed.isEmpty(), qPrintable(report.m_failed.join("\n")));
+	QCOMPARE(report.m_converted, 3);
+	QVERIFY(QFile::exists(output.filePath("cube_obj.stl")));
+	QVERIFY(QFile::exists(output.filePath("cube_ply.stl")));
+	QVERIFY(QFile::exists(output.filePath("nested/cubeColor.stl")));
+	QVERIFY(QFile::exists(output.filePath("convert-report.json")));
+
+	// Nothing changed, nothing is exported again
+	report = converter.Convert();
+	QCOMPARE(report.m_converted, 0);
+	QCOMPARE(report.m_skipped, 3);
+
+	// A touched but identical file is still skipped, a changed one is converted
+	QFile cube(input.filePath("cube.obj"));
+	QVERIFY(cube.open(QIODevice::Append));
+	cube.write("\n# changed\n");
+	cube.close();
+	QFile ply(input.filePath("cube.ply"));
+	QVERIFY(ply.open(QIODevice::Append));
+	QVERIFY(ply.setFileTime(QDateTime::currentDateTime().addSecs(60), QFileDevice::FileModificationTime));
+	ply.close();
+	report = converter.Convert();
+	QCOMPARE(report.m_converted, 1);
+	QCOMPARE(report.m_skipped, 2);
+
+	options.m_formatId = "unknown";
+	QCOMPARE(BatchConverter(options).Convert().m_failed.size(), 1);
+}
+
+void ModelViewerTest::saveModel() 
+{
+	if (disableAnnoyingTests) {
+		return;
+	}
+
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+
+	// Load model
+	QString path("../Data/Models/cubeColor.ply");
+	QVERIFY(LoadModelAndWait(path));
+
+	// Check the status after
+	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+
+	// Save model
+	bool success = ModelLoader::ExportModel("../Data/Models/");
+	QVERIFY(success);
+}
+
+void ModelViewerTest::exportInBackground()
+{
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	AsyncModelExporter exporter;
+	QSignalSpy finished(&exporter, &AsyncModelExporter::Finished);
+	const QString path = dir.filePath("cube.obj");
+	QVERIFY(exporter.Export(path, "obj"));
+	QVERIFY(exporter.IsExporting());
+	QVERIFY(!exporter.Export(path, "obj"));
+
+	// The GUI thread is free while the file is written
+	QVERIFY(finished.wait(10000));
+	QVERIFY(finished.front()[0].toBool());
+	QVERIFY(QFile::exists(path));
+	QVERIFY(QDir(dir.path()).entryList({ "*.part" }).isEmpty());
+
+	// A cancelled export leaves no file behind, unless it was finished
+	const QString cancelledPath = dir.filePath("cancelled.obj");
+	QVERIFY(exporter.Export(cancelledPath, "obj"));
+	exporter.Cancel();
+	QVERIFY(finished.wait(10000));
+	QCOMPARE(QFile::exists(cancelledPath), finished.back()[0].toBool());
+	QVERIFY(QDir(dir.path()).entryList({ "*.part" }).isEmpty());
+}
+
+void ModelViewerTest::loadShader()
+{
+	bool success = m_pWindow->GetGraphicsWindow()->loadVertexShader("../Data/Shaders/ads.vert");
+	QVERIFY(success);
+	success = m_pWindow->GetGraphicsWindow()->loadFragmentShader("../Data/Shaders/ads.frag");
+	QVERIFY(success);
+
+	// The uniform block declarations replace the include line
+	const QByteArray source = QByteArray("#version 410\n") + UniformBlocks::k_includeLine + "\nvoid main() {}\n";
+	const QByteArray expanded = UniformBlocks::ExpandInclude(source);
+	QVERIFY(expanded.contains("uniform FrameBlock"));
+	QVERIFY(expanded.contains("uniform MaterialBlock"));
+	QVERIFY(!expanded.contains(UniformBlocks::k_includeLine));
+
+	// Shaders reading the material's maps sample them by their handles when bindless, with the
+	// extension enabled right after #version
+	const QByteArray surface = source + UniformBlocks::k_surfaceIncludeLine + "\n";
+	const QByteArray bindless = UniformBlocks::ExpandInclude(surface, true);
+	QVERIFY(bindless.startsWith(QByteArray("#version 410\n") + UniformBlocks::k_bindlessDirectives));
+	QVERIFY(bindless.contains("SampleMaterialMap"));
+	QVERIFY(!UniformBlocks::ExpandInclude(surface).contains(UniformBlocks::k_bindlessMacro));
+	QVERIFY(!UniformBlocks::ExpandInclude(source, true).contains(UniformBlocks::k_bindlessMacro));
+
+	// Shaders with loose uniforms still work
+	QVERIFY(m_pWindow->GetGraphicsWindow()->loadVertexShader("../Data/Shaders/ads_edit.vert"));
+	QVERIFY(m_pWindow->GetGraphicsWindow()->loadFragmentShader("../Data/Shaders/ads_edit.frag"));
+	QVERIFY(m_pWindow->GetGraphicsWindow()->loadVertexShader("../Data/Shaders/ads.vert"));
+	QVERIFY(m_pWindow->GetGraphicsWindow()->loadFragmentShader("../Data/Shaders/ads.frag"));
+}
+
+void ModelViewerTest::shaderPermutations()
+{
+	// The defines go after #version and the line numbers start over at the next line
+	const QByteArray source = "#version 410\nvoid main() {}\n";
+	QCOMPARE(ShaderPermutations::Specialize(source, k_featureNormals | k_featureTexture),
+		QByteArray("#version 410\n#define SHADER_PERMUTATION\n#define HAS_NORMALS\n#define HAS_TEXTURE\n#line 2\nvoid main() {}\n"));
+	QCOMPARE(ShaderPermutations::Specialize("void main() {}", 0), QByteArray("#define SHADER_PERMUTATION\n#line 1\nvoid main() {}"));
+
+	// Only the features a shader checks split its variants
+	QFile file("../Data/Shaders/ads.frag");
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	QCOMPARE(ShaderPermutations::UsedFeatures(file.readAll()), int(k_featureNormals | k_featureTexture));
+	QCOMPARE(ShaderPermutations::UsedFeatures(source), 0);
+
+	// The depth only fragment shader keeps the vertex shader's version
+	QVERIFY(ShaderPermutations::DepthFragmentSource(source).startsWith("#version 410\nvoid main() {"));
+	QVERIFY(ShaderPermutations::DepthFragmentSource("void main() {}").startsWith("void main() {"));
+
+	// The default shaders still link as variants
+	QVERIFY(LoadModelAndWait("../Data/Models/13903_Mars_v1_l3.obj"));
+	QVERIFY(m_pWindow->GetGraphicsWindow()->loadVertexShader("../Data/Shaders/ads.vert"));
+	QVERIFY(m_pWindow->GetGraphicsWindow()->loadFragmentShader("../Data/Shaders/ads.frag"));
+	m_pWindow->GetGraphicsWindow()->update();
+	QTest::qWait(100);
+}
+
+void ModelViewerTest::renderQueue()
+{
+	// Programs outrank textures, textures outrank buffers and buffers outrank depth
+	QVERIFY(RenderQueue::MakeKey(1, 0, 0, 0.f) > RenderQueue::MakeKey(0, 5, 5, 100.f));
+	QVERIFY(RenderQueue::MakeKey(0, 2, 0, 0.f) > RenderQueue::MakeKey(0, 1, 9, 100.f));
+	QVERIFY(RenderQueue::MakeKey(0, 0, 2, 0.f) > RenderQueue::MakeKey(0, 0, 1, 100.f));
+	QVERIFY(RenderQueue::MakeKey(0, 0, 0, 2.f) > RenderQueue::MakeKey(0, 0, 0, 1.f));
+	QCOMPARE(RenderQueue::MakeKey(0, 0, 0, -1.f), RenderQueue::MakeKey(0, 0, 0, 0.f));
+
+	// Meshes are grouped by texture and drawn near to far within a group, ties keep their order
+	RenderQueue queue;
+	queue.Add(RenderQueue::MakeKey(0, 7, 1, 10.f), 0);
+	queue.Add(RenderQueue::MakeKey(0, 3, 1, 5.f), 1);
+	queue.Add(RenderQueue::MakeKey(0, 7, 1, 2.f), 2);
+	queue.Add(RenderQueue::MakeKey(0, 3, 1, 5.f), 3);
+	queue.Add(RenderQueue::MakeKey(0, 3, 1, 1.f), 4);
+	queue.Sort();
+	QCOMPARE(queue.Meshes(), std::vector<int>({ 4, 1, 3, 2, 0 }));
+
+	queue.Clear();
+	QVERIFY(queue.Meshes().empty());
+}
+
+void ModelViewerTest::loadCurrentShaders()
+{
+	bool success = m_pWindow->GetGraphicsWindow()->reloadCurrentShaders();
+	QVERIFY(success);
+}
+
+void ModelViewerTest::editCurrentShaders()
+{
+	if (disableAnnoyingTests) {
+		return;
+	}
+
+	bool success = m_pWindow->GetGraphicsWindow()->editCurrentShaders();
+	QVERIFY(success);
+}
+
+void ModelViewerTest::openShaderFile()
+{
+	if (disableAnnoyingTests) {
+		return;
+	}
+
+	bool success = m_pWindow->GetGraphicsWindow()->openShaderFile("../Data/Shaders/basic.frag");
+	QVERIFY(success);
+}
+
+void ModelViewerTest::changeColorUniforms()
+{
+	m_pWindow->show();
+	m_pWindow->GetGraphicsWindow()->colorRChanged(255);
+	m_pWindow->GetGraphicsWindow()->colorGChanged(255);
+	m_pWindow->GetGraphicsWindow()->colorBChanged(255);
+	QVERIFY(m_pWindow->GetGraphicsWindow()->getADColor()[0] == 1.0
+		&& m_pWindow->GetGraphicsWindow()->getADColor()[1] == 1.0
+		&& m_pWindow->GetGraphicsWindow()->getADColor()[2] == 1.0);
+
+	m_pWindow->GetGraphicsWindow()->lightAmbient(0.20);
+	m_pWindow->GetGraphicsWindow()->lightDiffuse(0.40);
+	m_pWindow->GetGraphicsWindow()->lightSpecular(0.30);
+	m_pWindow->hide();
+	QVERIFY(m_pWindow->GetGraphicsWindow()->getADS()[0] > 0.18 && m_pWindow->GetGraphicsWindow()->getADS()[0] < 0.22);
+	QVERIFY(m_pWindow->GetGraphicsWindow()->getADS()[1] > 0.38 && m_pWindow->GetGraphicsWindow()->getADS()[1] < 0.42);
+	QVERIFY(m_pWindow->GetGraphicsWindow()->getADS()[2] > 0.28 && m_pWindow->GetGraphicsWindow()->getADS()[2] < 0.32);
+
+}
+
+void ModelViewerTest::displayModel()
+{
+	m_pWindow->show();
+	bool success = LoadModelAndWait("../Data/Primitives/cube.obj");
+	QVERIFY(success);
+	success = LoadModelAndWait("../Data/Models/cubeColor.ply");
+	QVERIFY(success);
+	success = LoadModelAndWait("../Data/Primitives/Dodecahedron.stl");
+	QVERIFY(success);
+	success = LoadModelAndWait("../Data/Primitives/Icosahedron.stl");
+	QVERIFY(success);
+	QTest::qWait(100);
+	QVERIFY(success);
+	m_pWindow->hide();
+}
+
+void ModelViewerTest::cancelLoading()
+{
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QSignalSpy cancelled(pGraphicsWindow, &ViewerGraphicsWindow::ModelLoadingCancelled);
+	QSignalSpy finished(pGraphicsWindow, &ViewerGraphicsWindow::EndModelLoading);
+
+	// A second request preempts the first instead of queueing behind it
+	const QString large = "../Data/Models/13903_Mars_v1_l3.obj";
+	const QString small = "../Data/Primitives/cube.obj";
+	QVERIFY(pGraphicsWindow->loadModel(large));
+	QVERIFY(pGraphicsWindow->loadModel(small));
+	QCOMPARE(cancelled.size(), 1);
+	QCOMPARE(cancelled.front()[0].toString(), large);
+	QVERIFY(finished.wait(10000));
+	QCOMPARE(finished.size(), 1);
+	QCOMPARE(finished.front()[1].toString(), small);
+	QVERIFY(pGraphicsWindow->IsModelValid());
+
+	// Cancelling keeps the model that was being viewed
+	QVERIFY(pGraphicsWindow->loadModel(large));
+	pGraphicsWindow->cancelModelLoading();
+	QCOMPARE(cancelled.size(), 2);
+	QVERIFY(!finished.wait(500));
+	QVERIFY(pGraphicsWindow->IsModelValid());
+	QVERIFY(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+}
+
+void ModelViewerTest::sceneOfModels()
+{
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(LoadModelAndWait("../Data/Primitives/Cube.obj"));
+	QCOMPARE(int(pGraphicsWindow->GetScene().Entries().size()), 1);
+	const int cubeMeshes = int(pGraphicsWindow->GetCurrentModel().m_meshes.size());
+	const GLuint cubeBuffer = pGraphicsWindow->GetCurrentModel().m_meshes.front().m_vertexBuffer.bufferId();
+	const float cubeMaxX = pGraphicsWindow->GetCurrentModel().m_AABBMax.x();
+
+	// A primitive is set beside the model instead of replacing it, which keeps its buffers
+	QSignalSpy finished(pGraphicsWindow, &ViewerGraphicsWindow::EndModelLoading);
+	QVERIFY(pGraphicsWindow->addPrimitive("Sphere.obj"));
+	QVERIFY(finished.wait(10000));
+	QVERIFY(finished.front()[0].toBool());
+	const std::vector<ModelScene::Entry>& entries = pGraphicsWindow->GetScene().Entries();
+	QCOMPARE(int(entries.size()), 2);
+	const Model& composed = pGraphicsWindow->GetCurrentModel();
+	QVERIFY(int(composed.m_meshes.size()) > cubeMeshes);
+	QCOMPARE(composed.m_meshes.front().m_vertexBuffer.bufferId(), cubeBuffer);
+	for (int i = cubeMeshes; i < int(composed.m_meshes.size()); ++i) {
+		QVERIFY(composed.m_meshes[i].m_AABBMin.x() > cubeMaxX);
+	}
+	QVERIFY(composed.m_AABBMax.x() > cubeMaxX);
+
+	// Removing the cube leaves the sphere where it was, with the same buffers
+	const GLuint sphereBuffer = composed.m_meshes[cubeMeshes].m_vertexBuffer.bufferId();
+	const int sphereId = entries.back().m_id;
+	QVERIFY(pGraphicsWindow->removeFromScene(entries.front().m_id));
+	QVERIFY(!pGraphicsWindow->removeFromScene(-1));
+	QCOMPARE(int(pGraphicsWindow->GetScene().Entries().size()), 1);
+	QCOMPARE(pGraphicsWindow->GetScene().Entries().front().m_id, sphereId);
+	QCOMPARE(pGraphicsWindow->GetCurrentModel().m_meshes.front().m_vertexBuffer.bufferId(), sphereBuffer);
+	QVERIFY(pGraphicsWindow->GetCurrentModel().m_AABBMin.x() > cubeMaxX);
+
+	pGraphicsWindow->unloadModel();
+	QVERIFY(pGraphicsWindow->GetScene().IsEmpty());
+	QVERIFY(!pGraphicsWindow->IsModelValid());
+}
+
+void ModelViewerTest::releaseModels()
+{
+	// Loading model after model keeps only the last one's buffers, and closing it frees those
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->unloadModel();
+	for (int i = 0; i < 4; ++i) {
+		QVERIFY(LoadModelAndWait(i % 2 ? "../Data/Primitives/Cube.obj" : "../Data/Primitives/Sphere.obj"));
+		const GLuint buffer = pGraphicsWindow->GetCurrentModel().m_meshes.front().m_vertexBuffer.bufferId();
+		QVERIFY(buffer != 0);
+		QVERIFY(pGraphicsWindow->GetResources().ModelBytes() > 0);
+
+		pGraphicsWindow->unloadModel();
+		QCOMPARE(pGraphicsWindow->GetResources().ModelBytes(), qint64(0));
+		pGraphicsWindow->makeCurrent();
+		QVERIFY(!pGraphicsWindow->context()->functions()->glIsBuffer(buffer));
+		pGraphicsWindow->doneCurrent();
+	}
+}
+
+void ModelViewerTest::generatePrimitives()
+{
+	// Every shape is closed, fits the unit box and faces outwards
+	const std::map<PrimitiveShape, int> triangleCounts = {
+		{ PrimitiveShape::Cube, 12 },
+		{ PrimitiveShape::Tetrahedron, 4 },
+		{ PrimitiveShape::Octahedron, 8 },
+		{ PrimitiveShape::Icosahedron, 20 },
+		{ PrimitiveShape::Dodecahedron, 36 },
+	};
+	for (PrimitiveShape shape : Primitives::Shapes()) {
+		const MeshData mesh = Primitives::Generate(shape, 16);
+		const int vertexCount = mesh.m_vertexData.size() / mesh.m_vertexStride;
+		QVERIFY(mesh.m_indexCount > 0);
+		QCOMPARE(mesh.m_indexCount % 3, 0);
+		QCOMPARE(mesh.m_indexType, GLenum(GL_UNSIGNED_SHORT));
+		QVERIFY(mesh.m_hasNormals && mesh.m_hasUVCoordinates);
+		QVERIFY(mesh.m_AABBMin.x() >= -1.001f && mesh.m_AABBMax.x() <= 1.001f);
+		QVERIFY(mesh.m_AABBMin.y() >= -1.001f && mesh.m_AABBMax.y() <= 1.001f);
+		if (triangleCounts.count(shape)) {
+			QCOMPARE(mesh.m_indexCount / 3, triangleCounts.at(shape));
+		}
+
+		const float* pVertices = reinterpret_cast<const float*>(mesh.m_vertexData.constData());
+		const quint16* pIndices = reinterpret_cast<const quint16*>(mesh.m_indexData.constData());
+		auto Position = [&](int index) {
+			const float* p = pVertices + pIndices[index] * 8;
+			return QVector3D(p[0], p[1], p[2]);
+		};
+		for (int i = 0; i < mesh.m_indexCount; i += 3) {
+			QVERIFY(pIndices[i] < vertexCount && pIndices[i + 1] < vertexCount && pIndices[i + 2] < vertexCount);
+			if (shape != PrimitiveShape::Torus) {
+				const QVector3D a = Position(i);
+				const QVector3D normal = QVector3D::crossProduct(Position(i + 1) - a, Position(i + 2) - a);
+				QVERIFY(QVector3D::dotProduct(normal, a + Position(i + 1) + Position(i + 2)) > 0.f);
+			}
+		}
+	}
+
+	// Curved shapes follow the tessellation, the data is generated once and then shared
+	QVERIFY(Primitives::Generate(PrimitiveShape::Sphere, 8).m_indexCount < Primitives::Generate(PrimitiveShape::Sphere, 32).m_indexCount);
+	QCOMPARE(Primitives::Generate(PrimitiveShape::Cube, 8).m_indexCount, Primitives::Generate(PrimitiveShape::Cube, 32).m_indexCount);
+	const ModelData first = Primitives::Cached(PrimitiveShape::Torus, 24);
+	const ModelData second = Primitives::Cached(PrimitiveShape::Torus, 24);
+	QCOMPARE(second.m_meshes.front().m_vertexData.constData(), first.m_meshes.front().m_vertexData.constData());
+
+	// Adding a generated primitive needs no load, copies of it draw from the same buffers
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->unloadModel();
+	QSignalSpy loads(pGraphicsWindow, &ViewerGraphicsWindow::BeginModelLoading);
+	QVERIFY(pGraphicsWindow->addPrimitive(PrimitiveShape::Cube));
+	QVERIFY(pGraphicsWindow->addPrimitive(PrimitiveShape::Cube));
+	QCOMPARE(loads.size(), 0);
+	QCOMPARE(int(pGraphicsWindow->GetScene().Entries().size()), 2);
+	const Model& composed = pGraphicsWindow->GetCurrentModel();
+	QCOMPARE(int(composed.m_meshes.size()), 2);
+	QCOMPARE(composed.m_meshes[0].m_vertexBuffer.bufferId(), composed.m_meshes[1].m_vertexBuffer.bufferId());
+	QVERIFY(composed.m_meshes[1].m_AABBMin.x() > composed.m_meshes[0].m_AABBMax.x());
+	QVERIFY(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+	pGraphicsWindow->unloadModel();
+}
+
+void ModelViewerTest::skeletalAnimation()
+{
+	// An arm one unit above the root turns a quarter around z over two seconds
+	QSharedPointer<Skeleton> skeleton(new Skeleton());
+	skeleton->m_nodes.push_back({ "Root", -1, QMatrix4x4() });
+	QMatrix4x4 armRest;
+	armRest.translate(0.f, 1.f, 0.f);
+	skeleton->m_nodes.push_back({ "Arm", 0, armRest });
+	AnimationClip wave;
+	wave.m_name = "Wave";
+	wave.m_duration = 2.f;
+	AnimationChannel arm;
+	arm.m_node = 1;
+	arm.m_positions = { { 0.f, QVector3D(0.f, 1.f, 0.f) } };
+	arm.m_rotations = { { 0.f, QQuaternion() }, { 2.f, QQuaternion::fromAxisAndAngle(0.f, 0.f, 1.f, 90.f) } };
+	arm.m_scales = { { 0.f, QVector3D(1.f, 1.f, 1.f) } };
+	wave.m_channels.push_back(arm);
+	skeleton->m_clips.push_back(wave);
+	QCOMPARE(skeleton->FindNode("Arm"), 1);
+	QCOMPARE(skeleton->FindNode("Leg"), -1);
+
+	// The bone moves vertices from the mesh into the arm's space at rest
+	MeshBone bone;
+	bone.m_node = 1;
+	bone.m_offset = armRest.inverted();
+	bone.m_min = QVector3D(0.f, 1.f, 0.f);
+	bone.m_max = QVector3D(1.f, 1.f, 0.f);
+	const std::vector<MeshBone> bones = { bone };
+
+	AnimationPlayer player;
+	player.SetSkeleton(skeleton);
+	std::vector<QMatrix4x4> palette;
+	player.BonePalette(bones, palette);
+	QCOMPARE(int(palette.size()), 1);
+	QVERIFY(qFuzzyCompare(palette[0].map(QVector3D(1.f, 1.f, 0.f)), QVector3D(1.f, 1.f, 0.f)));
+	QVERIFY(!player.IsPlaying());
+
+	// Halfway through, the tip of the arm is an eighth of a turn around
+	player.Play(0);
+	QVERIFY(player.IsPlaying());
+	player.Advance(1.f);
+	player.BonePalette(bones, palette);
+	const QVector3D tip = palette[0].map(QVector3D(1.f, 1.f, 0.f));
+	QVERIFY(qAbs(tip.x() - std::sqrt(0.5f)) < 1e-3f);
+	QVERIFY(qAbs(tip.y() - (1.f + std::sqrt(0.5f))) < 1e-3f);
+
+	// The bounds follow the bone
+	QVector3D min;
+	QVector3D max;
+	AnimationPlayer::SkinnedBounds(bones, palette, min, max);
+	QVERIFY(min.x() < 1e-3f && max.x() > tip.x() - 1e-3f && max.y() > tip.y() - 1e-3f);
+
+	// Playing forward past the end loops, and the cursors give the same pose as starting over
+	player.Advance(1.5f);
+	QVERIFY(qAbs(player.Time() - 0.5f) < 1e-4f);
+	AnimationPlayer fresh;
+	fresh.SetSkeleton(skeleton);
+	fresh.Play(0);
+	fresh.SetTime(0.5f);
+	QCOMPARE(player.NodeTransforms()[1], fresh.NodeTransforms()[1]);
+
+	// A long chain of bones played frame by frame matches a pose worked out from scratch
+	QSharedPointer<Skeleton> chain(new Skeleton());
+	AnimationClip sway;
+	sway.m_duration = 1.f;
+	for (int i = 0; i < AnimationPlayer::k_maxBones; ++i) {
+		QMatrix4x4 rest;
+		rest.translate(0.f, 0.1f, 0.f);
+		chain->m_nodes.push_back({ QString("Bone%1").arg(i), i - 1, rest });
+		AnimationChannel channel;
+		channel.m_node = i;
+		for (int k = 0; k <= 30; ++k) {
+			const float time = float(k) / 30.f;
+			channel.m_positions.push_back({ time, QVector3D(0.f, 0.1f, 0.f) });
+			channel.m_rotations.push_back({ time, QQuaternion::fromAxisAndAngle(1.f, 0.f, 0.f, std::sin(time * 6.28f) * 2.f) });
+		}
+		channel.m_scales = { { 0.f, QVector3D(1.f, 1.f, 1.f) } };
+		sway.m_channels.push_back(channel);
+	}
+	chain->m_clips.push_back(sway);
+	player.SetSkeleton(chain);
+	player.Play(0);
+	for (int frame = 0; frame < 100; ++frame) {
+		player.Advance(1.f / 60.f);
+	}
+	fresh.SetSkeleton(chain);
+	fresh.Play(0);
+	fresh.SetTime(player.Time());
+	QCOMPARE(player.NodeTransforms().back(), fresh.NodeTransforms().back());
+
+	// Stopping goes back to the rest pose
+	player.Play(-1);
+	QVERIFY(!player.IsPlaying());
+	QVERIFY(qAbs(player.NodeTransforms().back().column(3).y() - 0.1f * AnimationPlayer::k_maxBones) < 1e-2f);
+}
+
+void ModelViewerTest::morphTargets()
+{
+	// A face node smiles over one second while a second target stays off
+	QSharedPointer<Skeleton> skeleton(new Skeleton());
+	skeleton->m_nodes.push_back({ "Root", -1, QMatrix4x4() });
+	skeleton->m_nodes.push_back({ "Face", 0, QMatrix4x4() });
+	AnimationClip smile;
+	smile.m_duration = 1.f;
+	MorphChannel face;
+	face.m_node = 1;
+	face.m_keys = { { 0.f, { 0.f } }, { 1.f, { 1.f, 0.f } } };
+	smile.m_morphChannels.push_back(face);
+	skeleton->m_clips.push_back(smile);
+
+	// At rest and for nodes the clip doesn't move, the weights are left as they were
+	AnimationPlayer player;
+	player.SetSkeleton(skeleton);
+	std::vector<float> weights = { 0.25f, 0.5f };
+	player.MorphWeights(1, weights);
+	QCOMPARE(weights, std::vector<float>({ 0.25f, 0.5f }));
+	player.Play(0);
+	player.MorphWeights(0, weights);
+	QCOMPARE(weights, std::vector<float>({ 0.25f, 0.5f }));
+
+	// Keys with fewer weights count the missing ones as 0, and are blended between
+	player.SetTime(0.25f);
+	player.MorphWeights(1, weights);
+	QVERIFY(qAbs(weights[0] - 0.25f) < 1e-5f);
+	QCOMPARE(weights[1], 0.f);
+
+	// Only the heaviest targets are added, and the ones without a weight never are
+	std::vector<float> many(ComputeSkinner::k_maxActiveTargets + 4, 0.f);
+	for (size_t i = 0; i < many.size(); i += 2) {
+		many[i] = (i % 4 == 0 ? -1.f : 1.f) * float(i + 1);
+	}
+	std::vector<std::pair<int, float>> active = ComputeSkinner::ActiveTargets(many);
+	QCOMPARE(int(active.size()), int(many.size() / 2));
+	for (const std::pair<int, float>& target : active) {
+		QVERIFY(target.first % 2 == 0 && target.second == many[target.first]);
+	}
+	std::fill(many.begin(), many.end(), 0.5f);
+	many[3] = -2.f;
+	active = ComputeSkinner::ActiveTargets(many);
+	QCOMPARE(int(active.size()), ComputeSkinner::k_maxActiveTargets);
+	QCOMPARE(active.front().first, 3);
+	QVERIFY(ComputeSkinner::ActiveTargets(std::vector<float>(4, 0.f)).empty());
+}
+
+void ModelViewerTest::shadowFit()
+{
+	// A floor seen from just past its edge
+	const QVector3D min(-10.f, -1.f, -10.f);
+	const QVector3D max(10.f, 1.f, 10.f);
+	QMatrix4x4 projection;
+	projection.perspective(45.f, 1.f, 0.1f, 100.f);
+	QMatrix4x4 modelView;
+	modelView.translate(0.f, 0.f, -12.f);
+	QMatrix4x4 turned = modelView;
+	turned.rotate(60.f, 0.f, 1.f, 0.f);
+	auto InClip = [](const QMatrix4x4& matrix, const QVector3D& point) {
+		const QVector4D clip = matrix * QVector4D(point, 1.f);
+		const float w = clip.w() * 1.001f;
+		return clip.w() > 0.f && qAbs(clip.x()) <= w && qAbs(clip.y()) <= w && qAbs(clip.z()) <= w;
+	};
+	auto Corner = [&](int corner) {
+		return QVector3D(corner & 1 ? max.x() : min.x(), corner & 2 ? max.y() : min.y(), corner & 4 ? max.z() : min.z());
+	};
+
+	// Directional light is placed far out in the direction of the light
+	const QVector3D center = (min + max) * 0.5f;
+	const QVector3D light = ShadowMapper::LightPosition(k_shadowsDirectional, QVector3D(1.f, 1.f, -1.f), min, max);
+	QVERIFY(qFuzzyCompare((light - center).normalized(), QVector3D(1.f, 1.f, -1.f).normalized()));
+	QVERIFY((light - center).length() > 100.f * (max - min).length());
+
+	// One map covers the whole model, and doesn't move with the camera
+	ShadowMapper::Options options;
+	options.m_mode = k_shadowsDirectional;
+	QMatrix4x4 matrices[ShadowMapper::k_maxCascades];
+	QMatrix4x4 turnedMatrices[ShadowMapper::k_maxCascades];
+	float splits[ShadowMapper::k_maxCascades] = {};
+	QCOMPARE(ShadowMapper::FitLight(options, light, min, max, projection, modelView, matrices, splits), 1);
+	QCOMPARE(ShadowMapper::FitLight(options, light, min, max, projection, turned, turnedMatrices, splits), 1);
+	QCOMPARE(matrices[0], turnedMatrices[0]);
+	for (int corner = 0; corner < 8; ++corner) {
+		QVERIFY(InClip(matrices[0], Corner(corner)));
+	}
+
+	// Cascades split the model's depth in view front to back, the nearest covering less of it,
+	// and follow the camera
+	options.m_cascades = 3;
+	QCOMPARE(ShadowMapper::FitLight(options, light, min, max, projection, modelView, turnedMatrices, splits), 3);
+	QVERIFY(splits[0] > 2.f && splits[0] < splits[1] && splits[1] < 22.f);
+	QCOMPARE(splits[2], FLT_MAX);
+	const float fullWidth = 2.f / matrices[0].row(0).toVector3D().length();
+	QVERIFY(2.f / turnedMatrices[0].row(0).toVector3D().length() < fullWidth);
+	QMatrix4x4 cascades[ShadowMapper::k_maxCascades];
+	ShadowMapper::FitLight(options, light, min, max, projection, turned, cascades, splits);
+	QVERIFY(cascades[0] != turnedMatrices[0]);
+
+	// A camera behind the model falls back to one map
+	QMatrix4x4 behind;
+	behind.translate(0.f, 0.f, 30.f);
+	QCOMPARE(ShadowMapper::FitLight(options, light, min, max, projection, behind, cascades, splits), 1);
+
+	// Spot light stays outside the bounds and its cone takes in all of them
+	options.m_mode = k_shadowsSpot;
+	const QVector3D spot = ShadowMapper::LightPosition(k_shadowsSpot, QVector3D(0.f, 0.5f, 0.f), min, max);
+	QVERIFY((spot - center).length() > (max - min).length() * 0.5f);
+	QCOMPARE(ShadowMapper::FitLight(options, spot, min, max, projection, modelView, matrices, splits), 1);
+	for (int corner = 0; corner < 8; ++corner) {
+		QVERIFY(InClip(matrices[0], Corner(corner)));
+	}
+}
+
+void ModelViewerTest::clusteredLights()
+{
+	// Lights fade out where they get too faint to see, unless they don't fade with distance
+	QVERIFY(qAbs(LightClusters::Range(QVector3D(1.f, 1.f, 1.f), QVector3D(1.f, 0.f, 1.f)) - std::sqrt(255.f)) < 1e-3f);
+	QVERIFY(qAbs(LightClusters::Range(QVector3D(1.f, 0.5f, 0.f), QVector3D(1.f, 1.f, 0.f)) - 255.f) < 1e-3f);
+	QCOMPARE(LightClusters::Range(QVector3D(1.f, 1.f, 1.f), QVector3D(1.f, 0.f, 0.f)), 0.f);
+	const float faint = LightClusters::Range(QVector3D(1e-3f, 0.f, 0.f), QVector3D(1.f, 0.f, 1.f));
+	QVERIFY(faint > 0.f && faint < 1e-6f);
+
+	// Slices grow with depth, depths past the grid fall in the end slices
+	QCOMPARE(LightClusters::Slice(0.5f, 1.f, 100.f), 0);
+	QCOMPARE(LightClusters::Slice(11.f, 1.f, 100.f), LightClusters::k_depthSlices / 2);
+	QCOMPARE(LightClusters::Slice(1000.f, 1.f, 100.f), LightClusters::k_depthSlices - 1);
+
+	// A small light in front of the camera, one that never fades and one behind the camera
+	QMatrix4x4 projection;
+	projection.perspective(60.f, 16.f / 9.f, 0.1f, 1000.f);
+	const float nearDepth = 1.f;
+	const float farDepth = 100.f;
+	const QVector4D small(2.f, 1.f, -10.f, 1.f);
+	const std::vector<QVector4D> spheres = { small, QVector4D(0.f, 0.f, -5.f, 0.f), QVector4D(0.f, 0.f, 5.f, 1.f) };
+	std::vector<quint32> clusters;
+	std::vector<quint16> indices;
+	LightClusters::Assign(spheres, 2, projection, nearDepth, farDepth, clusters, indices);
+	QCOMPARE(clusters.size(), size_t(2 * LightClusters::k_clusterCount));
+	auto Lights = [&](int cluster) {
+		return std::set<int>(indices.begin() + clusters[2 * cluster], indices.begin() + clusters[2 * cluster] + clusters[2 * cluster + 1]);
+	};
+
+	// The cluster a point in eye space is shaded with, found the way Lights.glsl finds it
+	auto ClusterOf = [&](const QVector3D& point) {
+		auto Tile = [](float ndc, int tiles) {
+			return qBound(0, int(std::floor((ndc * 0.5f + 0.5f) * float(tiles))), tiles - 1);
+		};
+		const QVector4D clip = projection * QVector4D(point, 1.f);
+		const int x = Tile(clip.x() / clip.w(), LightClusters::k_tilesX);
+		const int y = Tile(clip.y() / clip.w(), LightClusters::k_tilesY);
+		return (LightClusters::Slice(-point.z(), nearDepth, farDepth) * LightClusters::k_tilesY + y) * LightClusters::k_tilesX + x;
+	};
+
+	// The light that never fades is in every cluster, the one behind the camera in none
+	size_t total = 0;
+	int smallClusters = 0;
+	for (int i = 0; i < LightClusters::k_clusterCount; ++i) {
+		const std::set<int> lights = Lights(i);
+		QCOMPARE(lights.count(3), size_t(1));
+		QCOMPARE(lights.count(4), size_t(0));
+		smallClusters += int(lights.count(2));
+		total += clusters[2 * i + 1];
+	}
+	QCOMPARE(total, indices.size());
+
+	// The small one is in every cluster a point it reaches is shaded with, and in few others
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> unit(-1.f, 1.f);
+	for (int i = 0; i < 200; ++i) {
+		const QVector3D offset(unit(random), unit(random), unit(random));
+		if (offset.length() < 1.f) {
+			QCOMPARE(Lights(ClusterOf(small.toVector3D() + offset * small.w())).count(2), size_t(1));
+		}
+	}
+	QVERIFY(smallClusters > 0 && smallClusters < LightClusters::k_clusterCount / 20);
+
+	// Lights are placed with the model they came with
+	Model lit;
+	lit.m_isValid = true;
+	SceneLight spot;
+	spot.m_type = k_lightSpot;
+	spot.m_position = QVector3D(0.f, 1.f, 0.f);
+	spot.m_direction = QVector3D(0.f, -1.f, 0.f);
+	lit.m_lights.push_back(spot);
+	QMatrix4x4 placement;
+	placement.translate(5.f, 0.f, 0.f);
+	ModelScene scene;
+	scene.Add(lit, "Lit", QMatrix4x4());
+	scene.Add(lit, "Placed", placement);
+	const Model composed = scene.Compose();
+	QCOMPARE(composed.m_lights.size(), size_t(2));
+	QCOMPARE(composed.m_lights[0].m_position, spot.m_position);
+	QCOMPARE(composed.m_lights[1].m_position, QVector3D(5.f, 1.f, 0.f));
+	QCOMPARE(composed.m_lights[1].m_direction, spot.m_direction);
+}
+
+void ModelViewerTest::environmentCache()
+{
+	// A run length encoded scanline followed by a flat one
+	QByteArray hdr("#?RADIANCE\n# made by hand\nFORMAT=32-bit_rle_rgbe\n\n-Y 2 +X 8\n");
+	const uchar rle[] = {
+		2, 2, 0, 8,
+		128 + 8, 128,
+		8, 0, 16, 32, 48, 64, 80, 96, 112,
+		128 + 8, 0,
+		128 + 8, 129,
+	};
+	hdr.append(reinterpret_cast<const char*>(rle), sizeof(rle));
+	for (int x = 0; x < 8; ++x) {
+		const uchar flat[] = { 64, 64, 64, 128 };
+		hdr.append(reinterpret_cast<const char*>(flat), sizeof(flat));
+	}
+	HdrImage image;
+	QVERIFY(EnvironmentLighting::ReadHdr(hdr, image));
+	QCOMPARE(image.m_width, 8);
+	QCOMPARE(image.m_height, 2);
+	QCOMPARE(image.m_pixels.size(), size_t(8 * 2 * 3));
+	for (int x = 0; x < 8; ++x) {
+		QCOMPARE(image.m_pixels[x * 3], 1.f);
+		QCOMPARE(image.m_pixels[x * 3 + 1], float(x * 16) / 128.f);
+		QCOMPARE(image.m_pixels[x * 3 + 2], 0.f);
+		QCOMPARE(image.m_pixels[(8 + x) * 3], 0.25f);
+	}
+
+	// Other layouts and cut off files are not read
+	QByteArray flipped = hdr;
+	flipped.replace("-Y 2", "+Y 2");
+	QVERIFY(!EnvironmentLighting::ReadHdr(flipped, image));
+	QVERIFY(!EnvironmentLighting::ReadHdr(hdr.left(hdr.size() - 4), image));
+	QVERIFY(!EnvironmentLighting::ReadHdr(QByteArray("P6\n8 2\n255\n"), image));
+
+	// Entries are keyed by the contents of the file
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const EnvironmentLighting environment(dir.path());
+	const QString path = environment.CachePath(hdr);
+	QVERIFY(path.startsWith(dir.path()));
+	QCOMPARE(environment.CachePath(hdr), path);
+	QVERIFY(environment.CachePath(flipped) != path);
+
+	// The maps come back as they were stored
+	PrefilteredEnvironment maps;
+	auto Fill = [](PrefilteredEnvironment::Map& map, int width, int height, int levels) {
+		map.m_width = width;
+		map.m_height = height;
+		for (int level = 0; level < levels; ++level) {
+			map.m_levels.push_back(QByteArray(std::max(width >> level, 1) * std::max(height >> level, 1) * 8, char('a' + level)));
+		}
+	};
+	Fill(maps.m_irradiance, EnvironmentLighting::k_irradianceWidth, EnvironmentLighting::k_irradianceWidth / 2, 1);
+	Fill(maps.m_specular, EnvironmentLighting::k_specularWidth, EnvironmentLighting::k_specularWidth / 2, EnvironmentLighting::k_specularLevels);
+	Fill(maps.m_brdf, EnvironmentLighting::k_brdfSize, EnvironmentLighting::k_brdfSize, 1);
+	PrefilteredEnvironment read;
+	QVERIFY(!EnvironmentLighting::ReadCache(path, read));
+	QVERIFY(EnvironmentLighting::WriteCache(path, maps));
+	QVERIFY(EnvironmentLighting::ReadCache(path, read));
+	QCOMPARE(read.m_specular.m_levels.size(), size_t(EnvironmentLighting::k_specularLevels));
+	QVERIFY(read.m_irradiance.m_levels == maps.m_irradiance.m_levels);
+	QVERIFY(read.m_specular.m_levels == maps.m_specular.m_levels);
+	QVERIFY(read.m_brdf.m_levels == maps.m_brdf.m_levels);
+
+	// Maps of other sizes, or levels of the wrong size, are not read
+	maps.m_specular.m_levels[2].chop(8);
+	QVERIFY(EnvironmentLighting::WriteCache(path, maps));
+	QVERIFY(!EnvironmentLighting::ReadCache(path, read));
+	maps.m_specular = PrefilteredEnvironment::Map();
+	Fill(maps.m_specular, EnvironmentLighting::k_specularWidth, EnvironmentLighting::k_specularWidth / 2, 2);
+	QVERIFY(EnvironmentLighting::WriteCache(path, maps));
+	QVERIFY(!EnvironmentLighting::ReadCache(path, read));
+}
+
+void ModelViewerTest::sharedMaterials()
+{
+	// Meshes point into the model's materials, which are decoded once per material of the file
+	const ModelData data = ModelLoader::DecodeFile("../Data/Models/lowpolytree.obj", LoadOptions());
+	QVERIFY(data.m_meshes.size() > 1);
+	int bark = -1;
+	int leaves = -1;
+	for (size_t i = 0; i < data.m_materials.size(); ++i) {
+		if (data.m_materials[i].m_name == "Bark") {
+			bark = int(i);
+		}
+		else if (data.m_materials[i].m_name == "Leaves") {
+			leaves = int(i);
+		}
+	}
+	QVERIFY(bark >= 0 && leaves >= 0);
+	for (const MeshData& mesh : data.m_meshes) {
+		QVERIFY(mesh.m_material == bark || mesh.m_material == leaves);
+	}
+
+	// Phong materials keep their colors and a white base color, and have no maps
+	const MaterialProperties& properties = data.m_materials[bark].m_properties;
+	QVERIFY(!properties.m_metallicRoughness);
+	QVERIFY(qAbs(properties.m_diffuse[0] - 0.176206f) < 1e-5f);
+	QCOMPARE(properties.m_baseColor, QVector4D(1.f, 1.f, 1.f, 1.f));
+	for (const TextureData& map : data.m_materials[bark].m_maps) {
+		QVERIFY(map.isNull());
+	}
+
+	// Primitives share a single grey material
+	const ModelData cube = Primitives::Cached(PrimitiveShape::Cube);
+	QCOMPARE(cube.m_materials.size(), size_t(1));
+	QCOMPARE(cube.m_meshes[0].m_material, 0);
+
+	// A map whose file is found but doesn't decode is taken from the next texture instead
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	QFile broken(dir.filePath("broken.png"));
+	QVERIFY(broken.open(QIODevice::WriteOnly));
+	broken.write("not a png");
+	broken.close();
+	QImage ambient(4, 2, QImage::Format_RGBA8888);
+	ambient.fill(Qt::red);
+	QVERIFY(ambient.save(dir.filePath("ambient.png")));
+	QFile mtl(dir.filePath("quad.mtl"));
+	QVERIFY(mtl.open(QIODevice::WriteOnly));
+	mtl.write("newmtl Quad\nKd 1 1 1\nmap_Kd broken.png\nmap_Ka ambient.png\n");
+	mtl.close();
+	QFile obj(dir.filePath("quad.obj"));
+	QVERIFY(obj.open(QIODevice::WriteOnly));
+	obj.write("mtllib quad.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\nvt 0 0\nvt 1 0\nvt 0 1\nusemtl Quad\nf 1/1 2/2 3/3\n");
+	obj.close();
+	const ModelData textured = ModelLoader::DecodeFile(dir.filePath("quad.obj"), LoadOptions());
+	QCOMPARE(textured.m_meshes.size(), size_t(1));
+	const TextureData& baseColor = textured.m_materials[textured.m_meshes[0].m_material].m_maps[k_baseColorMap];
+	QCOMPARE(baseColor.m_image.size(), QSize(4, 2));
+	QCOMPARE(baseColor.m_key, QFileInfo(dir.filePath("ambient.png")).canonicalFilePath());
+}
+
+void ModelViewerTest::transparentMaterials()
+{
+	// A material with an opacity below 1 is blended, with the opacity as its alpha
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	QFile mtl(dir.filePath("glass.mtl"));
+	QVERIFY(mtl.open(QIODevice::WriteOnly));
+	mtl.write("newmtl Glass\nKd 0.2 0.4 0.8\nd 0.25\n\nnewmtl Wall\nKd 0.8 0.8 0.8\nd 1.0\n");
+	mtl.close();
+	QFile obj(dir.filePath("glass.obj"));
+	QVERIFY(obj.open(QIODevice::WriteOnly));
+	obj.write("mtllib glass.mtl\nv 0 0 0\nv 1 0 0\nv 0 1 0\nv 1 1 0\n"
+		"usemtl Glass\nf 1 2 3\nusemtl Wall\nf 2 4 3\n");
+	obj.close();
+
+	const ModelData data = ModelLoader::DecodeFile(dir.filePath("glass.obj"), LoadOptions());
+	const MaterialData* pGlass = nullptr;
+	const MaterialData* pWall = nullptr;
+	for (const MaterialData& material : data.m_materials) {
+		if (material.m_name == "Glass") {
+			pGlass = &material;
+		}
+		else if (material.m_name == "Wall") {
+			pWall = &material;
+		}
+	}
+	QVERIFY(pGlass && pWall);
+	QCOMPARE(pGlass->m_properties.m_alphaMode, k_alphaBlend);
+	QCOMPARE(pGlass->m_properties.m_baseColor.w(), 0.25f);
+	QCOMPARE(pWall->m_properties.m_alphaMode, k_alphaOpaque);
+	QCOMPARE(pWall->m_properties.m_baseColor.w(), 1.f);
+
+	// Nearer fragments weigh more, down to a floor far away, and clear ones not at all
+	QVERIFY(TransparencyPass::Weight(0.5f, 0.2f) > TransparencyPass::Weight(0.5f, 0.8f));
+	QVERIFY(TransparencyPass::Weight(1.f, 0.9f) > TransparencyPass::Weight(0.5f, 0.9f));
+	QCOMPARE(TransparencyPass::Weight(0.5f, 1.f), 0.5f * 1e-2f);
+	QCOMPARE(TransparencyPass::Weight(0.f, 0.5f), 0.f);
+
+	// The alpha mode and cutoff fit in the material block's padding
+	QCOMPARE(offsetof(MaterialBlock, m_alphaMode), size_t(100));
+	QCOMPARE(offsetof(MaterialBlock, m_alphaCutoff), size_t(104));
+	QCOMPARE(offsetof(MaterialBlock, m_handles), size_t(112));
+	QCOMPARE(offsetof(MaterialBlock, m_virtual), size_t(160));
+}
+
+void ModelViewerTest::ambientOcclusion()
+{
+	// Half resolution rounds up, so every pixel of the scene has an occlusion texel
+	QCOMPARE(AmbientOcclusion::TargetSize(QSize(801, 600), k_ambientOcclusionHalf), QSize(401, 300));
+	QCOMPARE(AmbientOcclusion::TargetSize(QSize(801, 600), k_ambientOcclusionFull), QSize(801, 600));
+
+	// A point seen through a jittered perspective is found again from where it lands and its depth
+	QMatrix4x4 projection;
+	projection.translate(0.002f, -0.001f);
+	projection.perspective(45.f, 1.5f, 0.1f, 100.f);
+	const QVector3D point(0.7f, -0.4f, -3.f);
+	const QVector3D ndc = projection.map(point);
+	const QVector3D found = AmbientOcclusion::EyePosition(AmbientOcclusion::ProjectionParameters(projection), QPointF(ndc.x(), ndc.y()), 3.f);
+	QVERIFY((found - point).length() < 1e-4f);
+
+	// The switch fits in the frame block's padding
+	QCOMPARE(offsetof(FrameBlock, m_alphaToCoverage), size_t(208));
+	QCOMPARE(offsetof(FrameBlock, m_ambientOcclusion), size_t(212));
+
+	// The prepass writes normals and depth in the vertex shader's version of GLSL
+	const QByteArray fragment = ShaderPermutations::DepthNormalFragmentSource("#version 410\nvoid main() {}\n");
+	QVERIFY(fragment.startsWith("#version 410\n"));
+	QVERIFY(fragment.contains("in vec3 vEs;"));
+}
+
+void ModelViewerTest::resourceTracking()
+{
+	// Geometry, textures and buffers belong to the models, the rest is kept by the viewer
+	ResourceTracker tracker;
+	tracker.Set(k_resourceVertices, 300);
+	tracker.Set(k_resourceTextures, 200);
+	tracker.Add(k_resourcePasses, 100);
+	tracker.Set(k_resourceScene, 50);
+	QCOMPARE(tracker.GpuBytes(), qint64(600));
+	QCOMPARE(tracker.CpuBytes(), qint64(50));
+	QCOMPARE(tracker.ModelBytes(), qint64(500));
+	QVERIFY(!ResourceTracker::IsGpu(k_resourceCaches));
+	QCOMPARE(QString(ResourceTracker::Name(k_resourceIndices)), QString("Indices"));
+
+	// Without a budget anything may be uploaded, a replacing model can use what the models free
+	QCOMPARE(tracker.UploadAllowance(false), qint64(-1));
+	tracker.SetGpuBudget(1000);
+	QCOMPARE(tracker.UploadAllowance(false), qint64(400));
+	QCOMPARE(tracker.UploadAllowance(true), qint64(900));
+	tracker.SetGpuBudget(500);
+	QCOMPARE(tracker.UploadAllowance(false), qint64(0));
+	QVERIFY(tracker.Report().contains("exceeded"));
+
+	// Maps of the same image are one texture, streamed geometry is left out
+	ModelData data;
+	MeshData mesh;
+	mesh.m_vertexData = QByteArray(64, 0);
+	mesh.m_indexData = QByteArray(16, 0);
+	data.m_meshes.push_back(mesh);
+	MaterialData material;
+	material.m_maps[0].m_key = "wood.png";
+	material.m_maps[0].m_image = QImage(16, 16, QImage::Format_RGBA8888);
+	material.m_maps[1] = material.m_maps[0];
+	data.m_materials.push_back(material);
+	const qint64 textureBytes = TextureCache::EstimateBytes(material.m_maps[0].m_image);
+	QCOMPARE(textureBytes, qint64(16 * 16 * 4 * 4 / 3));
+	QCOMPARE(ResourceTracker::UploadBytes(data, true), qint64(80) + textureBytes);
+	QCOMPARE(ResourceTracker::UploadBytes(data, false), textureBytes);
+}
+
+void ModelViewerTest::scratchArena()
+{
+	// Allocations are aligned and follow each other in a block
+	ScratchArena arena;
+	char* pFirst = static_cast<char*>(arena.Allocate(3, 1));
+	char* pSecond = static_cast<char*>(arena.Allocate(8, 8));
+	QCOMPARE(reinterpret_cast<quintptr>(pSecond) % 8, quintptr(0));
+	QVERIFY(pSecond > pFirst && pSecond - pFirst <= 8);
+	QCOMPARE(arena.Capacity(), size_t(ScratchArena::k_blockBytes));
+
+	// Rewinding hands out the same memory again, larger requests get blocks of their own
+	const ScratchArena::Mark mark = arena.GetMark();
+	void* pThird = arena.Allocate(16, 4);
+	arena.Rewind(mark);
+	QCOMPARE(arena.Allocate(16, 4), pThird);
+	{
+		ScratchArena::Scope scope(arena);
+		ScratchVector<quint32> big(ScratchArena::k_blockBytes, 7u, ScratchAllocator<quint32>(arena));
+		QCOMPARE(big.back(), 7u);
+		QVERIFY(arena.Capacity() > ScratchArena::k_blockBytes);
+	}
+
+	// The outermost scope gives back the blocks beyond the first
+	QCOMPARE(arena.Capacity(), size_t(ScratchArena::k_blockBytes));
+	QCOMPARE(arena.Allocate(3, 1), static_cast<void*>(pFirst));
+}
+
+void ModelViewerTest::fileContents()
+{
+	// Local files are mapped and hold the whole file
+	const QString path("../Data/Primitives/Cube.obj");
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	const QByteArray expected = file.readAll();
+	const QSharedPointer<const FileContents> pContents = FileContents::Open(path);
+	QVERIFY(pContents);
+	QVERIFY(pContents->IsMapped());
+	QCOMPARE(pContents->Size(), qint64(expected.size()));
+	QVERIFY(memcmp(pContents->Data(), expected.constData(), expected.size()) == 0);
+	QVERIFY(!FileContents::Open("../Data/Primitives/Missing.obj"));
+
+	// Shares are told by their prefix, they are read instead of mapped
+	QVERIFY(FileContents::IsNetworkPath("//server/share/model.obj"));
+	QVERIFY(FileContents::IsNetworkPath("\\\\server\\share\\model.obj"));
+	QVERIFY(!FileContents::IsNetworkPath(path));
+
+	// Models and their textures load through it
+	ModelData data = ModelLoader::DecodeFile(path, LoadOptions());
+	QVERIFY(!data.m_meshes.empty());
+}
+
+void ModelViewerTest::zipArchive()
+{
+	// Stored files point into the mapped archive, deflated ones are inflated
+	const QString path("../Data/Models/quadPack.zip");
+	const QSharedPointer<const ZipArchive> pArchive = ZipArchive::Open(FileContents::Open(path));
+	QVERIFY(pArchive);
+	QCOMPARE(pArchive->Names().size(), 3);
+	QVERIFY(pArchive->Contains("Models\\Quad.OBJ"));
+	const QSharedPointer<const FileContents> pTexture = pArchive->Read("models/checker.png");
+	QVERIFY(pTexture && pTexture->IsMapped());
+	QCOMPARE(QImage::fromData(pTexture->Data(), int(pTexture->Size())).size(), QSize(8, 8));
+	const QSharedPointer<const FileContents> pObj = pArchive->Read("models/quad.obj");
+	QVERIFY(pObj && !pObj->IsMapped());
+	QVERIFY(QByteArray(reinterpret_cast<const char*>(pObj->Data()), int(pObj->Size())).startsWith("# A textured quad"));
+	QVERIFY(!pArchive->Read("models/missing.obj"));
+	QVERIFY(!ZipArchive::Open(FileContents::Open("../Data/Models/cubeColor.ply")));
+
+	// Paths go through an archive as if it were a folder
+	QString archive;
+	QString name;
+	QVERIFY(ZipArchive::SplitPath(path + "/models/quad.obj", archive, name));
+	QCOMPARE(archive, path);
+	QCOMPARE(name, QString("models/quad.obj"));
+	QVERIFY(ZipArchive::SplitPath("https://example.com/packs/city.zip/car.obj", archive, name));
+	QCOMPARE(name, QString("car.obj"));
+	QVERIFY(!ZipArchive::SplitPath("../Data/Models/lowpolytree.obj", archive, name));
+
+	// The model, and the texture its material names, load from the archive
+	const ModelData data = ModelLoader::DecodeFile(path + "/models/quad.obj", LoadOptions());
+	QVERIFY(!data.m_meshes.empty());
+	const MaterialData& material = data.m_materials[data.m_meshes[0].m_material];
+	QCOMPARE(material.m_name, QString("Checker"));
+	QCOMPARE(material.m_maps[k_baseColorMap].m_image.size(), QSize(8, 8));
+}
+
+void ModelViewerTest::geometryCodec()
+{
+	// A grid of vertices with positions, normals and UVs, and its triangles in order
+	const int side = 40;
+	std::vector<float> vertices;
+	std::vector<quint32> indices;
+	for (int y = 0; y < side; ++y) {
+		for (int x = 0; x < side; ++x) {
+			const float height = std::sin(x * 0.2f) * std::cos(y * 0.2f);
+			for (float value : { x * 0.1f, height, y * 0.1f, 0.f, 1.f, 0.f, x / float(side), y / float(side) }) {
+				vertices.push_back(value);
+			}
+			if (x + 1 < side && y + 1 < side) {
+				const quint32 i = quint32(y * side + x);
+				for (quint32 index : { i, i + 1, i + side, i + 1, i + side + 1, i + side }) {
+					indices.push_back(index);
+				}
+			}
+		}
+	}
+	const size_t stride = 8 * sizeof(float);
+	const size_t vertexCount = vertices.size() / 8;
+
+	// Both round trip exactly, and come out smaller than they went in
+	const std::vector<uchar> codedVertices = GeometryCodec::EncodeVertices(reinterpret_cast<const uchar*>(vertices.data()), vertexCount, stride);
+	QVERIFY(codedVertices.size() * 2 < vertices.size() * sizeof(float));
+	std::vector<float> decodedVertices(vertices.size());
+	QVERIFY(GeometryCodec::DecodeVertices(reinterpret_cast<uchar*>(decodedVertices.data()), vertexCount, stride, codedVertices.data(), codedVertices.size()));
+	QVERIFY(decodedVertices == vertices);
+
+	const std::vector<uchar> codedIndices = GeometryCodec::EncodeIndices(reinterpret_cast<const uchar*>(indices.data()), indices.size(), 4);
+	QVERIFY(codedIndices.size() * 2 < indices.size() * sizeof(quint32));
+	std::vector<quint32> decodedIndices(indices.size());
+	QVERIFY(GeometryCodec::DecodeIndices(reinterpret_cast<uchar*>(decodedIndices.data()), indices.size(), 4, codedIndices.data(), codedIndices.size()));
+	QVERIFY(decodedIndices == indices);
+
+	// 16 bit indices, and data that is cut short or doesn't fit the index size
+	std::vector<quint16> shortIndices(indices.begin(), indices.end());
+	const std::vector<uchar> codedShort = GeometryCodec::EncodeIndices(reinterpret_cast<const uchar*>(shortIndices.data()), shortIndices.size(), 2);
+	std::vector<quint16> decodedShort(shortIndices.size());
+	QVERIFY(GeometryCodec::DecodeIndices(reinterpret_cast<uchar*>(decodedShort.data()), shortIndices.size(), 2, codedShort.data(), codedShort.size()));
+	QVERIFY(decodedShort == shortIndices);
+	QVERIFY(!GeometryCodec::DecodeIndices(reinterpret_cast<uchar*>(decodedShort.data()), shortIndices.size(), 2, codedShort.data(), codedShort.size() - 1));
+	QVERIFY(!GeometryCodec::DecodeVertices(reinterpret_cast<uchar*>(decodedVertices.data()), vertexCount, stride, codedVertices.data(), codedVertices.size() - 1));
+	std::vector<uchar> bytes(decodedIndices.size());
+	QVERIFY(!GeometryCodec::DecodeIndices(bytes.data(), indices.size(), 1, codedIndices.data(), codedIndices.size()));
+
+	// A compressed cache entry loads the same meshes, decoded instead of mapped
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	ModelCache cache(dir.path());
+	LoadOptions options;
+	options.m_compressCache = true;
+	const QString file = "../Data/Models/lowpolytree.obj";
+	const ModelData model = ModelLoader::DecodeFile(file, options);
+	QVERIFY(model.m_meshes.size() > 0);
+	QVERIFY(cache.Store(file, options, model));
+	ModelData cached;
+	QVERIFY(cache.Load(file, options, cached));
+	QCOMPARE(cached.m_meshes.size(), model.m_meshes.size());
+	for (size_t i = 0; i < cached.m_meshes.size(); ++i) {
+		QVERIFY(cached.m_meshes[i].m_vertexData == model.m_meshes[i].m_vertexData);
+		QVERIFY(cached.m_meshes[i].m_indexData == model.m_meshes[i].m_indexData);
+		QCOMPARE(cached.m_meshes[i].m_indexType, model.m_meshes[i].m_indexType);
+	}
+}
+
+void ModelViewerTest::thumbnailIndex()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath("thumbnails.mvindex");
+	const QFileInfo file("../Data/Models/cubeColor.ply");
+
+	ModelSummary summary;
+	summary.m_path = file.absoluteFilePath();
+	summary.m_modified = file.lastModified().toMSecsSinceEpoch();
+	summary.m_size = file.size();
+	summary.m_triangles = 12;
+	summary.m_meshes = 1;
+	summary.m_materials = 1;
+	summary.m_AABBMin = QVector3D(-1.f, -1.f, -1.f);
+	summary.m_AABBMax = QVector3D(1.f, 1.f, 1.f);
+	summary.m_loadSeconds = 0.25f;
+	QImage frame(400, 300, QImage::Format_RGB32);
+	frame.fill(Qt::darkCyan);
+
+	// Thumbnails fit the square, summaries come back unchanged
+	{
+		ThumbnailIndex index(path);
+		QCOMPARE(index.Count(), 0);
+		ModelSummary found;
+		QVERIFY(!index.Find(file, found));
+		QVERIFY(index.Insert(summary, frame));
+		QVERIFY(index.Find(file, found));
+		QCOMPARE(found.m_triangles, summary.m_triangles);
+		const QImage thumbnail = index.Thumbnail(file.filePath());
+		QCOMPARE(thumbnail.width(), ThumbnailIndex::k_thumbnailSize);
+		QVERIFY(thumbnail.height() <= ThumbnailIndex::k_thumbnailSize);
+	}
+
+	// Reopened from the file, with loading the model again replacing its record
+	{
+		ThumbnailIndex index(path);
+		QCOMPARE(index.Count(), 1);
+		ModelSummary found;
+		QVERIFY(index.Find(file, found));
+		QCOMPARE(found.m_path, summary.m_path);
+		QCOMPARE(found.m_meshes, summary.m_meshes);
+		QCOMPARE(found.m_AABBMax, summary.m_AABBMax);
+		QCOMPARE(found.m_loadSeconds, summary.m_loadSeconds);
+		QVERIFY(!index.Thumbnail(file.filePath()).isNull());
+		for (int i = 0; i < 3; ++i) {
+			summary.m_triangles = 100 + i;
+			QVERIFY(index.Insert(summary, frame));
+		}
+		QCOMPARE(index.Count(), 1);
+	}
+
+	// Replaced records are dropped once they take most of the file
+	const qint64 appendedSize = QFileInfo(path).size();
+	{
+		ThumbnailIndex index(path);
+		QCOMPARE(index.Count(), 1);
+		ModelSummary found;
+		QVERIFY(index.Find(file, found));
+		QCOMPARE(found.m_triangles, qint64(102));
+	}
+	QVERIFY(QFileInfo(path).size() < appendedSize);
+
+	// A file changed since is not described by its old summary
+	summary.m_size += 1;
+	{
+		ThumbnailIndex index(path);
+		QVERIFY(index.Insert(summary, frame));
+		ModelSummary found;
+		QVERIFY(!index.Find(file, found));
+	}
+
+	// A damaged tail keeps the records before it
+	{
+		QFile damaged(path);
+		QVERIFY(damaged.open(QIODevice::WriteOnly | QIODevice::Append));
+		damaged.write(QByteArray("\0\0\1\0garbage", 11));
+	}
+	QCOMPARE(ThumbnailIndex(path).Count(), 1);
+
+	// The browser lists a folder from the index alone
+	ModelBrowser browser(m_pWindow->GetGraphicsWindow());
+	browser.setFolder("../Data/Models");
+	QVERIFY(browser.modelCount() >= 3);
+	QVERIFY(browser.indexedCount() <= browser.modelCount());
+}
+
+void ModelViewerTest::programInterface()
+{
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+
+	// uKa is declared with another type than the viewer sets it with
+	QOpenGLShaderProgram program;
+	QVERIFY(program.addShaderFromSourceCode(QOpenGLShader::Vertex,
+		"#version 410\n"
+		"in vec3 posAttr;\n"
+		"uniform vec3 uLightPos;\n"
+		"uniform vec4 uKa;\n"
+		"uniform float uGain = 0.5;\n"
+		"uniform vec2 uOffset;\n"
+		"uniform int uMode;\n"
+		"uniform float uWeights[4];\n"
+		"void main() {\n"
+		"   gl_Position = vec4(posAttr * uGain + uLightPos + vec3(uOffset, float(uMode) + uWeights[2]), 1.0) + uKa;\n"
+		"}\n"));
+	QVERIFY(program.addShaderFromSourceCode(QOpenGLShader::Fragment,
+		"#version 410\n"
+		"uniform sampler2D uTexture;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		"   fragColor = texture(uTexture, vec2(0.5));\n"
+		"}\n"));
+	QVERIFY(program.link());
+
+	// The table has the locations the driver gives, arrays by their name without [0]
+	ProgramInterface reflected;
+	reflected.Reflect(&program);
+	QCOMPARE(reflected.AttributeLocation("posAttr"), program.attributeLocation("posAttr"));
+	QCOMPARE(reflected.UniformLocation("uLightPos"), program.uniformLocation("uLightPos"));
+	QCOMPARE(reflected.UniformLocation("uWeights"), program.uniformLocation("uWeights"));
+	QCOMPARE(reflected.UniformLocation("uKd"), -1);
+	QCOMPARE(reflected.AttributeLocation("normAttr"), -1);
+
+	// Slots are only kept with the type they are set with
+	QVERIFY(reflected.HasSlot(ProgramInterface::k_lightPos));
+	QVERIFY(!reflected.HasSlot(ProgramInterface::k_ka));
+	QVERIFY(!reflected.HasSlot(ProgramInterface::k_kd));
+
+	// Single values the viewer doesn't set are the user's, with the value they were linked with
+	std::map<QByteArray, ProgramInterface::Variable> user;
+	for (const ProgramInterface::Variable& uniform : reflected.UserUniforms()) {
+		user[uniform.m_name] = uniform;
+	}
+	QCOMPARE(int(user.size()), 3);
+	QCOMPARE(user["uGain"].m_initial.x(), 0.5f);
+	QCOMPARE(ProgramInterface::UserComponents(user["uOffset"].m_type), 2);
+	QCOMPARE(user["uMode"].m_type, GLenum(GL_INT));
+
+	// A relink of the window's program lists the user uniforms again
+	QSignalSpy uniformsSpy(pGraphicsWindow, SIGNAL(ShaderUniformsChanged()));
+	QVERIFY(pGraphicsWindow->loadVertexShader("../Data/Shaders/ads.vert"));
+	QVERIFY(uniformsSpy.count() >= 1);
+	pGraphicsWindow->setUserUniform("uGain", QVector4D(2.f, 0.f, 0.f, 0.f));
+	QCOMPARE(pGraphicsWindow->getUserUniform("uGain").x(), 2.f);
+
+	// Only values that differ from what the program has are uploaded, until it is linked again
+	program.bind();
+	RenderState frame;
+	QCOMPARE(reflected.Upload(&program, frame, QVector3D(1.f, 2.f, 3.f)), 1);
+	QCOMPARE(reflected.Upload(&program, frame, QVector3D(1.f, 2.f, 3.f)), 0);
+	QCOMPARE(reflected.Upload(&program, frame, QVector3D(1.f, 2.f, 4.f)), 1);
+	frame.m_userUniforms.insert("uGain", QVector4D(0.5f, 0.f, 0.f, 0.f));
+	QCOMPARE(reflected.Upload(&program, frame, QVector3D(1.f, 2.f, 4.f)), 0);
+	frame.m_userUniforms.insert("uGain", QVector4D(2.f, 0.f, 0.f, 0.f));
+	frame.m_userUniforms.insert("uMode", QVector4D(3.f, 0.f, 0.f, 0.f));
+	QCOMPARE(reflected.Upload(&program, frame, QVector3D(1.f, 2.f, 4.f)), 2);
+	QCOMPARE(reflected.Upload(&program, frame, QVector3D(1.f, 2.f, 4.f)), 0);
+	GLint mode = 0;
+	QOpenGLContext::currentContext()->functions()->glGetUniformiv(program.programId(), reflected.UniformLocation("uMode"), &mode);
+	QCOMPARE(mode, 3);
+	QVERIFY(program.link());
+	reflected.Reflect(&program);
+	QCOMPARE(reflected.Upload(&program, frame, QVector3D(1.f, 2.f, 4.f)), 3);
+	program.release();
+
+	reflected.Clear();
+	QCOMPARE(reflected.UniformLocation("uLightPos"), -1);
+	QVERIFY(!reflected.HasSlot(ProgramInterface::k_lightPos));
+	pGraphicsWindow->doneCurrent();
+}
+
+void ModelViewerTest::modelStats()
+{
+	// Four positions where the last lies on the line through the first two
+	const float positions[] = { 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f, 2.f, 0.f, 0.f };
+	const quint16 indices[] = { 0, 1, 2, 0, 0, 1, 0, 1, 3, 2, 1, 0 };
+	MeshData mesh;
+	mesh.m_name = "strip";
+	mesh.m_vertexData = QByteArray(reinterpret_cast<const char*>(positions), sizeof(positions));
+	mesh.m_vertexStride = 3 * sizeof(float);
+	mesh.m_numPositionComponents = 3;
+	mesh.m_indexData = QByteArray(reinterpret_cast<const char*>(indices), sizeof(indices));
+	mesh.m_indexCount = 12;
+	mesh.m_indexType = GL_UNSIGNED_SHORT;
+	mesh.m_material = 1;
+
+	// Triangles repeating a vertex and those without area are both degenerate
+	const MeshStats meshStats = ModelStats::ComputeMesh(mesh);
+	QCOMPARE(meshStats.m_name, QString("strip"));
+	QCOMPARE(meshStats.m_vertices, 4);
+	QCOMPARE(meshStats.m_triangles, 4);
+	QCOMPARE(meshStats.m_degenerateTriangles, 2);
+	QCOMPARE(meshStats.m_indexBytes, qint64(sizeof(indices)));
+
+	// Instanced meshes are drawn once per instance, materials are counted once
+	ModelData data;
+	data.m_meshes.push_back(mesh);
+	mesh.m_instanceTransforms.resize(3);
+	data.m_meshes.push_back(mesh);
+	data.m_materials.resize(2);
+	const ModelStats stats = ModelStats::Compute(data);
+	QCOMPARE(stats.m_meshes, 2);
+	QCOMPARE(stats.m_instances, 4);
+	QCOMPARE(stats.m_vertices, qint64(8));
+	QCOMPARE(stats.m_meshTriangles, qint64(8));
+	QCOMPARE(stats.m_triangles, qint64(16));
+	QCOMPARE(stats.m_degenerateTriangles, qint64(4));
+	QCOMPARE(stats.m_materials, 1);
+	QCOMPARE(stats.m_textures, 0);
+	QCOMPARE(int(stats.m_meshStats.size()), 2);
+	QVERIFY(stats.Report().contains("Degenerate triangles: 4"));
+
+	// A scene's meshes point into the materials of all its models
+	ModelStats scene;
+	scene.Add(stats, 0);
+	scene.Add(stats, 2);
+	QCOMPARE(scene.m_triangles, qint64(32));
+	QCOMPARE(int(scene.m_meshStats.size()), 4);
+	QCOMPARE(scene.m_meshStats[3].m_material, 3);
+
+	// The loader counts a model once, and the window shows the count of the whole scene
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	const ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	const ModelStats& loaded = pGraphicsWindow->GetModelStats();
+	qint64 triangles = 0;
+	for (const Mesh& loadedMesh : pGraphicsWindow->GetCurrentModel().m_meshes) {
+		triangles += loadedMesh.m_indexCount / 3;
+	}
+	QCOMPARE(loaded.m_triangles, triangles);
+	QCOMPARE(int(loaded.m_meshStats.size()), int(pGraphicsWindow->GetCurrentModel().m_meshes.size()));
+	QVERIFY(loaded.m_vertices > 0);
+	QCOMPARE(ModelStats::Compute(Primitives::Cached(PrimitiveShape::Cube)).m_degenerateTriangles, qint64(0));
+}
+
+void ModelViewerTest::scriptRunner()
+{
+	// Keys are sorted, values left out carry over and the ends are held
+	CameraPose start;
+	start.m_scale = 2.f;
+	CameraPath path;
+	QVERIFY(CameraPath::FromJson(QJsonArray{ QJsonObject{ { "time", 2 }, { "rotX", 360 } }, QJsonObject{ { "time", 0 }, { "rotX", 0 }, { "translation", QJsonArray{ 0, 0, -4 } } } }, start, path));
+	QCOMPARE(int(path.Keys().size()), 2);
+	QCOMPARE(path.Duration(), 2.f);
+	QCOMPARE(path.Sample(1.f).m_rotX, 180.f);
+	QCOMPARE(path.Sample(1.f).m_scale, 2.f);
+	QCOMPARE(path.Sample(-1.f).m_rotX, 0.f);
+	QCOMPARE(path.Sample(5.f).m_rotX, 360.f);
+	CameraPath copy;
+	QVERIFY(CameraPath::FromJson(path.ToJson(), CameraPose(), copy));
+	QCOMPARE(copy.Sample(1.5f).m_rotX, path.Sample(1.5f).m_rotX);
+	QVERIFY(!CameraPath::FromJson(QJsonArray{ QJsonObject{ { "rotX", 1 } } }, start, copy));
+
+	// A script loads a model, moves the camera, plays a path and reports its frames
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QTemporaryDir folder;
+	ScriptRunner runner(pGraphicsWindow);
+	QVERIFY(runner.SetMetricsFile(folder.filePath("metrics.jsonl")));
+	runner.AddCommand(QJsonObject{ { "command", "load" }, { "path", "../Data/Models/cubeColor.ply" } });
+	runner.AddCommand(QJsonObject{ { "command", "camera" }, { "rotX", 45 }, { "rotY", 20 } });
+	runner.AddCommand(QJsonObject{ { "command", "uniform" }, { "name", "uKd" }, { "value", 0.25 } });
+	runner.AddCommand(QJsonObject{ { "command", "path" }, { "label", "orbit" }, { "keys", QJsonArray{ QJsonObject{ { "time", 0 } }, QJsonObject{ { "time", 0.5 }, { "rotX", 90 } } } } });
+	runner.AddCommand(QJsonObject{ { "command", "metrics" } });
+	runner.AddCommand(QJsonObject{ { "command", "dance" } });
+	QSignalSpy resultSpy(&runner, &ScriptRunner::CommandFinished);
+	QSignalSpy finishedSpy(&runner, &ScriptRunner::Finished);
+	runner.Start();
+	QVERIFY(finishedSpy.wait(30000));
+	QCOMPARE(finishedSpy.takeFirst().at(0).toBool(), false);
+	QCOMPARE(resultSpy.count(), 6);
+
+	std::vector<QJsonObject> results;
+	for (const QList<QVariant>& arguments : resultSpy) {
+		results.push_back(arguments.at(0).toJsonObject());
+	}
+	QVERIFY(results[0].value("ok").toBool());
+	QVERIFY(results[0].value("scene").toObject().value("triangles").toInt() > 0);
+	QCOMPARE(pGraphicsWindow->getADS().y(), 0.25f);
+	QCOMPARE(results[3].value("label").toString(), QString("orbit"));
+	QVERIFY(results[3].value("frameCount").toInt() > 0);
+	QVERIFY(results[3].value("intervals").toObject().contains("p99Ms"));
+	QCOMPARE(pGraphicsWindow->GetCameraPose().m_rotX, 90.f);
+	QVERIFY(results[4].value("memory").toObject().value("gpuBytes").toDouble() > 0);
+	QVERIFY(!results[5].value("ok").toBool());
+	QVERIFY(runner.HasFailed());
+
+	// Every result is a line of the metrics file
+	QFile metrics(folder.filePath("metrics.jsonl"));
+	QVERIFY(metrics.open(QIODevice::ReadOnly));
+	QCOMPARE(metrics.readAll().count('\n'), 6);
+}
+
+void ModelViewerTest::cameraPlayback()
+{
+	// A held pose keeps its first and last key, so the path stays still as long
+	CameraPose still;
+	CameraPose turned;
+	turned.m_rotX = 90.f;
+	CameraPath recorded;
+	recorded.Record(0.f, still);
+	recorded.Record(1.f, still);
+	recorded.Record(2.f, still);
+	recorded.Record(3.f, turned);
+	QCOMPARE(int(recorded.Keys().size()), 3);
+	QCOMPARE(recorded.Sample(1.5f).m_rotX, 0.f);
+	QCOMPARE(recorded.Sample(2.5f).m_rotX, 45.f);
+	QCOMPARE(recorded.FrameCount(0.5f), 7);
+
+	QTemporaryDir folder;
+	QVERIFY(recorded.Save(folder.filePath("path.json")));
+	CameraPath loaded;
+	QVERIFY(loaded.Load(folder.filePath("path.json")));
+	QCOMPARE(int(loaded.Keys().size()), 3);
+	QCOMPARE(loaded.Sample(2.5f).m_rotX, 45.f);
+	QVERIFY(!loaded.Load(folder.filePath("missing.json")));
+
+	// Playback draws a frame per step however long frames take, and times each of them
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	CameraPath path;
+	path.AddKey(0.f, still);
+	path.AddKey(0.5f, turned);
+	QSignalSpy finishedSpy(pGraphicsWindow, &ViewerGraphicsWindow::CameraPlaybackFinished);
+	pGraphicsWindow->PlayCameraPath(path, 0.1f);
+	QVERIFY(pGraphicsWindow->IsPlayingCameraPath());
+	QVERIFY(finishedSpy.wait(10000));
+	QVERIFY(!pGraphicsWindow->IsPlayingCameraPath());
+	const std::vector<PlaybackFrame>& frames = pGraphicsWindow->GetPlaybackFrames();
+	QCOMPARE(int(frames.size()), 6);
+	for (int i = 0; i < int(frames.size()); ++i) {
+		QCOMPARE(frames[i].m_frame, i);
+		QVERIFY(qFuzzyCompare(frames[i].m_time + 1.f, float(i) * 0.1f + 1.f));
+		QVERIFY(frames[i].m_cpuSeconds > 0.f);
+	}
+	QCOMPARE(pGraphicsWindow->GetCameraPose().m_rotX, 90.f);
+	QVERIFY(CameraPath::SaveTimings(folder.filePath("timings.csv"), frames));
+	QFile timings(folder.filePath("timings.csv"));
+	QVERIFY(timings.open(QIODevice::ReadOnly | QIODevice::Text));
+	QCOMPARE(timings.readLine(), QByteArray("frame,time,cpu_ms,gpu_ms\n"));
+
+	// Recording picks up where the camera was moved to
+	pGraphicsWindow->StartCameraRecording();
+	pGraphicsWindow->SetRotation(10.f, 0.f);
+	QTest::qWait(100);
+	const CameraPath camera = pGraphicsWindow->StopCameraRecording();
+	QVERIFY(!pGraphicsWindow->IsRecordingCamera());
+	QVERIFY(!camera.IsEmpty());
+	QCOMPARE(camera.Keys().back().m_pose.m_rotX, 10.f);
+}
+
+void ModelViewerTest::importTrace()
+{
+	// Stages add up over all their spans, steps of a sequence end where the next one starts
+	ImportTrace trace;
+	{
+		ImportTrace::Scope read(&trace, "Read", ImportTrace::k_stage, "model.obj");
+		QTest::qWait(20);
+	}
+	{
+		ImportTrace::Scope decode(&trace, "Decode", ImportTrace::k_stage);
+		ImportTrace::Sequence steps(&trace);
+		steps.Next("Materials");
+		steps.Next("Meshes");
+		QTest::qWait(5);
+	}
+	ImportTrace::Scope nothing(nullptr, "Nothing");
+	const std::vector<ImportTrace::Event> events = trace.Events();
+	QCOMPARE(int(events.size()), 4);
+	QCOMPARE(QString(events[0].m_name), QString("Read"));
+	QCOMPARE(events[0].m_detail, QString("model.obj"));
+	QCOMPARE(QString(events[1].m_name), QString("Materials"));
+	QCOMPARE(events[1].m_endNs, events[2].m_startNs);
+	QCOMPARE(events[1].m_level, ImportTrace::k_step);
+	const std::vector<std::pair<const char*, qint64>> totals = trace.StageTotals();
+	QCOMPARE(int(totals.size()), 2);
+	QCOMPARE(QString(totals.front().first), QString("Read"));
+	QVERIFY(trace.Summary().startsWith("Loaded in "));
+	QVERIFY(trace.Summary().contains("Read "));
+
+	QTemporaryDir folder;
+	QVERIFY(trace.Save(folder.filePath("trace.json")));
+	QFile file(folder.filePath("trace.json"));
+	QVERIFY(file.open(QIODevice::ReadOnly));
+	const QJsonDocument document = QJsonDocument::fromJson(file.readAll());
+	QCOMPARE(document.object().value("traceEvents").toArray().size(), 4);
+
+	// A load traces its stages from the worker to the upload on the GUI thread
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	const ImportTrace& loadTrace = m_pWindow->GetGraphicsWindow()->GetImportTrace();
+	QStringList stages;
+	for (const std::pair<const char*, qint64>& stage : loadTrace.StageTotals()) {
+		stages += stage.first;
+	}
+	QVERIFY(stages.contains("Read") || stages.contains("Cache"));
+	QVERIFY(stages.contains("Upload"));
+	QVERIFY(stages.contains("Finalize"));
+	QVERIFY(loadTrace.DurationNs() > 0);
+}
+
+void ModelViewerTest::textureUploader()
+{
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+	QOpenGLExtraFunctions* f = QOpenGLContext::currentContext()->extraFunctions();
+
+	// Rows of a different color each, so a row uploaded in the wrong place shows
+	QImage image(64, 64, QImage::Format_ARGB32);
+	for (int y = 0; y < image.height(); ++y) {
+		for (int x = 0; x < image.width(); ++x) {
+			image.setPixel(x, y, qRgba(x * 4, y * 4, 128, 255));
+		}
+	}
+
+	TextureUploader uploader;
+	uploader.Create();
+	QVERIFY(uploader.IsCreated());
+	const QSharedPointer<QOpenGLTexture> texture = uploader.Queue(image);
+	QVERIFY(texture);
+	QVERIFY(uploader.Queue(QImage()).isNull());
+	QCOMPARE(uploader.PendingBytes(), qint64(64 * 64 * 4));
+
+	// A budget of four kilobytes is four rows a call. Slots still being read wait for the next call.
+	int calls = 0;
+	while (!uploader.IsIdle() && calls < 1000) {
+		QVERIFY(uploader.Upload(64 * 4 * 4) <= 64 * 4 * 4);
+		++calls;
+	}
+	QVERIFY(uploader.IsIdle());
+	QVERIFY(calls >= 16);
+	QCOMPARE(uploader.PendingBytes(), qint64(0));
+
+	GLuint framebuffer = 0;
+	f->glGenFramebuffers(1, &framebuffer);
+	f->glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	f->glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture->textureId(), 0);
+	QImage readback(64, 64, QImage::Format_RGBA8888);
+	f->glReadPixels(0, 0, 64, 64, GL_RGBA, GL_UNSIGNED_BYTE, readback.bits());
+	f->glBindFramebuffer(GL_FRAMEBUFFER, pGraphicsWindow->defaultFramebufferObject());
+	f->glDeleteFramebuffers(1, &framebuffer);
+	QCOMPARE(readback.convertToFormat(QImage::Format_ARGB32), image);
+
+	// Larger textures are drawn from a preview of their smallest levels until they are in
+	const QSharedPointer<QOpenGLTexture> large = uploader.Queue(image.scaled(256, 256));
+	QCOMPARE(large->mipBaseLevel(), TextureCache::SupportsBindless() ? 0 : 2);
+	while (!uploader.IsIdle()) {
+		uploader.Upload(TextureUploader::k_slotBytes);
+	}
+	QCOMPARE(large->mipBaseLevel(), 0);
+
+	// Cleared uploads, and those of textures freed meanwhile, are dropped
+	uploader.Queue(image);
+	uploader.Clear();
+	QVERIFY(uploader.IsIdle());
+	uploader.Queue(image);
+	QVERIFY(!uploader.IsIdle());
+	QCOMPARE(uploader.Upload(TextureUploader::k_slotBytes), qint64(0));
+	QVERIFY(uploader.IsIdle());
+	uploader.Destroy();
+	QVERIFY(!uploader.IsCreated());
+	pGraphicsWindow->doneCurrent();
+
+	// Models load the same with their textures streamed in slices
+	QVERIFY(LoadModelAndWait("../Data/Models/13903_Mars_v1_l3.obj"));
+	QVERIFY(pGraphicsWindow->GetModelStats().m_textures > 0);
+}
+
+void ModelViewerTest::streamBuffer()
+{
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+	if (!UniformBlocks::SupportsUniformBuffers()) {
+		pGraphicsWindow->doneCurrent();
+		QSKIP("Uniform buffers are not supported");
+	}
+
+	StreamBuffer stream;
+	QVERIFY(stream.Create(64));
+	QVERIFY(stream.IsCreated());
+	QVERIFY(stream.Buffer() != 0);
+	const qint64 frameBytes = stream.FrameBytes();
+	QVERIFY(frameBytes >= 64);
+
+	// Nothing is written outside of a frame
+	const std::array<float, 4> values = { { 1.0f, 2.0f, 3.0f, 4.0f } };
+	QCOMPARE(stream.Write(values.data(), sizeof(values)), qint64(-1));
+
+	// Writes are placed one after the other at the alignment asked for
+	stream.BeginFrame();
+	const qint64 first = stream.Write(values.data(), 4, 1);
+	const qint64 second = stream.Write(values.data(), sizeof(values), 16);
+	QVERIFY(first >= 0);
+	QCOMPARE(second % 16, qint64(0));
+	QVERIFY(second >= first + 4);
+	QCOMPARE(stream.UsedBytes(), second % frameBytes + qint64(sizeof(values)));
+	QVERIFY(stream.BindUniformBlock(0, values.data(), sizeof(values)));
+	stream.EndFrame();
+
+	// The regions of the frames in flight are used in turn
+	std::set<qint64> offsets;
+	for (int i = 0; i < StreamBuffer::k_frameCount * 2; ++i) {
+		stream.BeginFrame();
+		QCOMPARE(stream.UsedBytes(), qint64(0));
+		const qint64 offset = stream.Write(values.data(), sizeof(values));
+		QVERIFY(offset >= 0);
+		offsets.insert(offset);
+		stream.EndFrame();
+	}
+	QVERIFY(offsets.size() <= size_t(StreamBuffer::k_frameCount));
+
+	// A frame that needs more than a region makes the buffer grow
+	std::vector<char> large(size_t(frameBytes * 2), 'x');
+	stream.BeginFrame();
+	QVERIFY(stream.Write(large.data(), qint64(large.size())) >= 0);
+	QVERIFY(stream.FrameBytes() > frameBytes);
+	QVERIFY(stream.Write(values.data(), sizeof(values)) >= 0);
+	stream.EndFrame();
+	QCOMPARE(QOpenGLContext::currentContext()->functions()->glGetError(), GLenum(GL_NO_ERROR));
+
+	stream.Destroy();
+	QVERIFY(!stream.IsCreated());
+	pGraphicsWindow->doneCurrent();
+
+	// The window writes its uniform blocks, draw commands and overlay through its own
+	QVERIFY(LoadModelAndWait("../Data/Models/13903_Mars_v1_l3.obj"));
+	pGraphicsWindow->update();
+	QTest::qWait(100);
+}
+
+void ModelViewerTest::stateCache()
+{
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+	QOpenGLFunctions* f = QOpenGLContext::currentContext()->functions();
+
+	// Each context has one cache
+	StateCache& state = StateCache::Current();
+	QCOMPARE(&StateCache::Current(), &state);
+
+	// Only calls that change what was set reach the driver
+	state.Invalidate();
+	state.ResetCounts();
+	state.Enable(GL_BLEND);
+	state.Enable(GL_BLEND);
+	QVERIFY(f->glIsEnabled(GL_BLEND));
+	state.BlendFunc(GL_ONE, GL_ONE);
+	state.BlendFuncSeparate(GL_ONE, GL_ONE, GL_ONE, GL_ONE);
+	state.BlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	state.Viewport(0, 0, 16, 16);
+	state.Viewport(0, 0, 16, 16);
+	GLint viewport[4] = {};
+	f->glGetIntegerv(GL_VIEWPORT, viewport);
+	QCOMPARE(viewport[2], 16);
+	state.ColorMask(false);
+	state.ColorMask(true);
+	state.ColorMask(true);
+	state.Disable(GL_BLEND);
+	QVERIFY(!f->glIsEnabled(GL_BLEND));
+	QCOMPARE(state.IssuedCalls(), 7);
+	QCOMPARE(state.SkippedCalls(), 4);
+
+	// Forgotten state is set again
+	state.Invalidate();
+	state.Disable(GL_BLEND);
+	QCOMPARE(state.IssuedCalls(), 8);
+	pGraphicsWindow->doneCurrent();
+
+	// A frame after another sets little of its state anew
+	pGraphicsWindow->update();
+	QTest::qWait(100);
+	pGraphicsWindow->update();
+	QTest::qWait(100);
+	pGraphicsWindow->makeCurrent();
+	QVERIFY(StateCache::Current().SkippedCalls() > 0);
+	pGraphicsWindow->doneCurrent();
+}
+
+void ModelViewerTest::gltfLoader()
+{
+	// A quad in a .glb: float positions and normals and 32 bit indices, drawn by two nodes
+	const float positions[] = { 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 2.f, 0.f, 0.f, 2.f, 0.f };
+	const float normals[] = { 0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 0.f, 0.f, 1.f };
+	const quint32 indices[] = { 0, 1, 2, 0, 2, 3 };
+	QByteArray binary;
+	binary.append(reinterpret_cast<const char*>(positions), sizeof(positions));
+	binary.append(reinterpret_cast<const char*>(normals), sizeof(normals));
+	binary.append(reinterpret_cast<const char*>(indices), sizeof(indices));
+
+	auto Document = [&](bool withNormals) {
+		QJsonObject attributes{ { "POSITION", 0 } };
+		if (withNormals) {
+			attributes["NORMAL"] = 1;
+		}
+		QJsonObject root;
+		root["asset"] = QJsonObject{ { "version", "2.0" } };
+		root["buffers"] = QJsonArray{ QJsonObject{ { "byteLength", binary.size() } } };
+		root["bufferViews"] = QJsonArray{
+			QJsonObject{ { "buffer", 0 }, { "byteOffset", 0 }, { "byteLength", 48 } },
+			QJsonObject{ { "buffer", 0 }, { "byteOffset", 48 }, { "byteLength", 48 } },
+			QJsonObject{ { "buffer", 0 }, { "byteOffset", 96 }, { "byteLength", 24 } },
+		};
+		root["accessors"] = QJsonArray{
+			QJsonObject{ { "bufferView", 0 }, { "componentType", 5126 }, { "count", 4 }, { "type", "VEC3" } },
+			QJsonObject{ { "bufferView", 1 }, { "componentType", 5126 }, { "count", 4 }, { "type", "VEC3" } },
+			QJsonObject{ { "bufferView", 2 }, { "componentType", 5125 }, { "count", 6 }, { "type", "SCALAR" } },
+		};
+		root["meshes"] = QJsonArray{ QJsonObject{ { "name", "quad" }, { "primitives", QJsonArray{ QJsonObject{ { "attributes", attributes }, { "indices", 2 } } } } } };
+		root["nodes"] = QJsonArray{
+			QJsonObject{ { "mesh", 0 } },
+			QJsonObject{ { "mesh", 0 }, { "translation", QJsonArray{ 5, 0, 0 } } },
+		};
+		root["scenes"] = QJsonArray{ QJsonObject{ { "nodes", QJsonArray{ 0, 1 } } } };
+		root["scene"] = 0;
+
+		QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+		while (json.size() % 4 != 0) {
+			json.append(' ');
+		}
+		auto Pod = [](QByteArray& bytes, quint32 val) {
+			bytes.append(reinterpret_cast<const char*>(&val), sizeof(val));
+		};
+		QByteArray glb("glTF");
+		Pod(glb, 2);
+		Pod(glb, quint32(12 + 8 + json.size() + 8 + binary.size()));
+		Pod(glb, quint32(json.size()));
+		glb.append("JSON");
+		glb.append(json);
+		Pod(glb, quint32(binary.size()));
+		glb.append("BIN", 4);
+		glb.append(binary);
+		return glb;
+	};
+
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath("quad.glb");
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write(Document(true));
+	file.close();
+
+	// Every array of the mesh is read where it is in the file
+	GltfLoader gltf;
+	QVERIFY(GltfLoader::IsGltfFile(path));
+	QVERIFY2(gltf.Read(path), qPrintable(gltf.FailureReason()));
+	QVERIFY(gltf.Scene());
+	QCOMPARE(gltf.Scene()->mNumMeshes, 1u);
+	QCOMPARE(gltf.BorrowedArrays(), 3);
+
+	// The mesh is drawn once per node, and the model matches the one Assimp imports
+	LoadOptions options;
+	const ModelData native = ModelLoader::DecodeFile(path, options);
+	options.m_nativeGltf = false;
+	const ModelData imported = ModelLoader::DecodeFile(path, options);
+	QCOMPARE(native.m_meshes.size(), size_t(1));
+	QCOMPARE(native.m_meshes.size(), imported.m_meshes.size());
+	const MeshData& mesh = native.m_meshes[0];
+	QCOMPARE(mesh.m_name, QString("quad"));
+	QCOMPARE(mesh.m_indexCount, 6);
+	QVERIFY(mesh.m_hasNormals);
+	QCOMPARE(mesh.m_instanceTransforms.size(), size_t(2));
+	QCOMPARE(mesh.m_instanceTransforms[1].column(3), QVector4D(5.f, 0.f, 0.f, 1.f));
+	QCOMPARE(mesh.m_AABBMin, imported.m_meshes[0].m_AABBMin);
+	QCOMPARE(mesh.m_AABBMax, imported.m_meshes[0].m_AABBMax);
+	QCOMPARE(mesh.m_vertexData.size(), imported.m_meshes[0].m_vertexData.size());
+	QCOMPARE(native.m_materials.size(), size_t(1));
+	QVERIFY(native.m_materials[0].m_properties.m_metallicRoughness);
+
+	// Without normals the file is left to Assimp, which generates them
+	const QString unlitPath = dir.filePath("unlit.glb");
+	QFile unlitFile(unlitPath);
+	QVERIFY(unlitFile.open(QIODevice::WriteOnly));
+	unlitFile.write(Document(false));
+	unlitFile.close();
+	QVERIFY(!gltf.Read(unlitPath));
+	QVERIFY(!gltf.FailureReason().isEmpty());
+	QVERIFY(!gltf.Scene());
+	options.m_nativeGltf = true;
+	const ModelData fallback = ModelLoader::DecodeFile(unlitPath, options);
+	QCOMPARE(fallback.m_meshes.size(), size_t(1));
+	QVERIFY(fallback.m_meshes[0].m_hasNormals);
+}
+
+void ModelViewerTest::textModelLoader()
+{
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	auto Write = [&](const QString& name, const QByteArray& text) {
+		QFile file(dir.filePath(name));
+		return file.open(QIODevice::WriteOnly) && file.write(text) == text.size();
+	};
+
+	// A textured quad with normals and a triangle without them, indexed from the end
+	QVERIFY(Write("quad.mtl", "newmtl red\nKd 1 0 0\n"));
+	QVERIFY(Write("quad.obj",
+		"mtllib quad.mtl\n"
+		"v 0 0 0\nv 1 0 0\nv 1 2 0\nv 0 2 0\n"
+		"vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvn 0 0 1\n"
+		"o quad\nusemtl red\nf 1/1/1 2/2/1 3/3/1 4/4/1\n"
+		"o triangle\nv 0 0 1\nv 1 0 1\nv 0 1 1\nf -3 -2 -1\n"));
+	const QString path = dir.filePath("quad.obj");
+	TextModelLoader text;
+	QVERIFY(TextModelLoader::IsTextModelFile(path));
+	QVERIFY2(text.Read(path), qPrintable(text.FailureReason()));
+	QVERIFY(text.Scene());
+	QCOMPARE(text.ChunkCount(), 1);
+	QCOMPARE(text.Scene()->mNumMeshes, 2u);
+	QCOMPARE(text.Scene()->mMeshes[0]->mNumVertices, 4u);
+	QCOMPARE(text.Scene()->mMeshes[0]->mNumFaces, 2u);
+	QCOMPARE(text.Scene()->mMeshes[1]->mNormals[0], aiVector3D(0.f, 0.f, 1.f));
+
+	// The model matches the one Assimp imports
+	LoadOptions options;
+	QVERIFY(TextModelLoader::Handles(path, options));
+	const ModelData parsed = ModelLoader::DecodeFile(path, options);
+	options.m_parallelText = false;
+	const ModelData imported = ModelLoader::DecodeFile(path, options);
+	QCOMPARE(parsed.m_meshes.size(), size_t(2));
+	QCOMPARE(parsed.m_meshes.size(), imported.m_meshes.size());
+	for (size_t i = 0; i < parsed.m_meshes.size(); ++i) {
+		QCOMPARE(parsed.m_meshes[i].m_indexCount, imported.m_meshes[i].m_indexCount);
+		QCOMPARE(parsed.m_meshes[i].m_vertexData.size(), imported.m_meshes[i].m_vertexData.size());
+		QCOMPARE(parsed.m_meshes[i].m_AABBMin, imported.m_meshes[i].m_AABBMin);
+		QCOMPARE(parsed.m_meshes[i].m_AABBMax, imported.m_meshes[i].m_AABBMax);
+	}
+	QCOMPARE(parsed.m_materials.size(), imported.m_materials.size());
+
+	// Text PLY and STL files, with normals from the faces and the facets
+	QVERIFY(Write("quad.ply",
+		"ply\nformat ascii 1.0\nelement vertex 4\nproperty float x\nproperty float y\nproperty float z\n"
+		"element face 1\nproperty list uchar int vertex_indices\nend_header\n"
+		"0 0 0\n1 0 0\n1 2 0\n0 2 0\n4 0 1 2 3\n"));
+	QVERIFY2(text.Read(dir.filePath("quad.ply")), qPrintable(text.FailureReason()));
+	QCOMPARE(text.Scene()->mMeshes[0]->mNumVertices, 4u);
+	QCOMPARE(text.Scene()->mMeshes[0]->mNormals[0], aiVector3D(0.f, 0.f, 1.f));
+	QVERIFY(Write("quad.stl",
+		"solid quad\n"
+		"facet normal 0 0 1\nouter loop\nvertex 0 0 0\nvertex 1 0 0\nvertex 1 2 0\nendloop\nendfacet\n"
+		"facet normal 0 0 0\nouter loop\nvertex 0 0 0\nvertex 1 2 0\nvertex 0 2 0\nendloop\nendfacet\n"
+		"endsolid quad\n"));
+	QVERIFY2(text.Read(dir.filePath("quad.stl")), qPrintable(text.FailureReason()));
+	QCOMPARE(text.Scene()->mMeshes[0]->mNumVertices, 4u);
+	QCOMPARE(text.Scene()->mMeshes[0]->mNumFaces, 2u);
+
+	// Binary files and lines are left to Assimp, as is everything when smooth normals are asked for
+	QVERIFY(!text.Read("../Data/Models/cubeColor.ply"));
+	QVERIFY(!text.Scene());
+	QVERIFY(Write("lines.obj", "v 0 0 0\nv 1 0 0\nl 1 2\n"));
+	QVERIFY(!text.Read(dir.filePath("lines.obj")));
+	options.m_parallelText = true;
+	options.m_importProfile = ImportProfile::Custom;
+	options.m_customImportSteps = aiProcess_GenSmoothNormals;
+	QVERIFY(!TextModelLoader::Handles(path, options));
+}
+
+void ModelViewerTest::normalGenerator()
+{
+	// Two triangles folded at a right angle along the edge from the origin to x, with
+	// vertices of their own
+	const float positions[] = { 0, 0, 0, 1, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0, 1, 1, 0, 0 };
+	const quint32 indices[] = { 0, 1, 2, 3, 4, 5 };
+	float faceNormals[6];
+	NormalGenerator::FaceNormals(positions, indices, 2, faceNormals);
+	QCOMPARE(QVector3D(faceNormals[0], faceNormals[1], faceNormals[2]), QVector3D(0.f, 0.f, 1.f));
+	QCOMPARE(QVector3D(faceNormals[3], faceNormals[4], faceNormals[5]), QVector3D(0.f, 1.f, 0.f));
+
+	// Corners at the same position share a normal, here with equal angles on both sides. The
+	// corner of just one triangle keeps its normal.
+	float normals[18];
+	NormalGenerator::SmoothNormals(positions, 6, indices, 2, normals);
+	const QVector3D fold = QVector3D(0.f, 1.f, 1.f).normalized();
+	QCOMPARE(QVector3D(normals[0], normals[1], normals[2]), fold);
+	QCOMPARE(QVector3D(normals[3], normals[4], normals[5]), fold);
+	QCOMPARE(QVector3D(normals[9], normals[10], normals[11]), fold);
+	QCOMPARE(QVector3D(normals[15], normals[16], normals[17]), fold);
+	QCOMPARE(QVector3D(normals[6], normals[7], normals[8]), QVector3D(0.f, 0.f, 1.f));
+
+	// On a scene the steps give what Assimp's do
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	QFile file(dir.filePath("fold.obj"));
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write("v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 0 0 1\nf 1 2 3\nf 1 3 4\nf 1 5 2\n");
+	file.close();
+	std::unique_ptr<Assimp::Importer> pNative(ModelLoader::ReadScene(file.fileName()));
+	std::unique_ptr<Assimp::Importer> pAssimp(ModelLoader::ReadScene(file.fileName()));
+	QVERIFY(pNative && pNative->GetScene() && pAssimp && pAssimp->GetScene());
+	aiScene* pScene = const_cast<aiScene*>(pNative->GetScene());
+	QVERIFY(NormalGenerator::GenerateNormals(pScene, false));
+	pAssimp->ApplyPostProcessing(aiProcess_GenNormals);
+	const aiMesh* pMesh = pScene->mMeshes[0];
+	const aiMesh* pExpected = pAssimp->GetScene()->mMeshes[0];
+	QCOMPARE(pMesh->mNumVertices, 9u);
+	for (unsigned int v = 0; v < pMesh->mNumVertices; ++v) {
+		QCOMPARE(pMesh->mNormals[v], pExpected->mNormals[v]);
+	}
+
+	// The two triangles facing up share two corners
+	QVERIFY(NormalGenerator::JoinIdenticalVertices(pScene));
+	pAssimp->ApplyPostProcessing(aiProcess_JoinIdenticalVertices);
+	QVERIFY(pScene->mFlags & AI_SCENE_FLAGS_NON_VERBOSE_FORMAT);
+	QCOMPARE(pMesh->mNumVertices, 7u);
+	QCOMPARE(pMesh->mNumVertices, pExpected->mNumVertices);
+	for (unsigned int f = 0; f < pMesh->mNumFaces; ++f) {
+		for (unsigned int i = 0; i < 3; ++i) {
+			QCOMPARE(pMesh->mFaces[f].mIndices[i], pExpected->mFaces[f].mIndices[i]);
+		}
+	}
+
+	// Joined scenes are left to Assimp's normal steps, as they expect vertices per face
+	QVERIFY(!NormalGenerator::GenerateNormals(pScene, true));
+}
+
+void ModelViewerTest::shadingSwitches()
+{
+	// Flat shading is a switch in the frame block
+	QCOMPARE(offsetof(FrameBlock, m_flatShading), size_t(216));
+	QVERIFY(QByteArray(UniformBlocks::k_frameDeclaration).contains("int uFlatShading;"));
+
+	// Two triangles folded at a right angle, flat shaded as loaded
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	QFile file(dir.filePath("fold.obj"));
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write("v 0 0 0\nv 1 0 0\nv 0 1 0\nv 0 0 1\nf 1 2 3\nf 1 4 2\n");
+	file.close();
+	const ModelData data = ModelLoader::DecodeFile(file.fileName());
+	QCOMPARE(data.m_meshes.size(), size_t(1));
+	const MeshData& meshData = data.m_meshes[0];
+
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->makeCurrent();
+	Mesh mesh = GpuModelBuilder::BuildMesh(meshData, {});
+	QVERIFY(mesh.m_normalStreams);
+	auto ReadVertices = [&]() {
+		QByteArray vertices(mesh.m_vertexBytes, Qt::Uninitialized);
+		mesh.m_vertexBuffer.bind();
+		mesh.m_vertexBuffer.read(0, vertices.data(), vertices.size());
+		mesh.m_vertexBuffer.release();
+		return vertices;
+	};
+
+	// Smoothing rewrites the normals, and switching back puts the loaded ones in again
+	QVERIFY(GpuModelBuilder::SmoothNormals(mesh, true));
+	QVERIFY(mesh.m_normalStreams->m_smoothed);
+	QCOMPARE(mesh.m_normalStreams->m_smooth.size(), mesh.m_normalStreams->m_loaded.size());
+	QVERIFY(mesh.m_normalStreams->m_smooth != mesh.m_normalStreams->m_loaded);
+	QVERIFY(ReadVertices() != meshData.m_vertexData);
+	QVERIFY(GpuModelBuilder::SmoothNormals(mesh, false));
+	QCOMPARE(ReadVertices(), meshData.m_vertexData);
+
+	// The smooth normals are kept for the next switch, and an upload starts as loaded
+	const QByteArray smooth = mesh.m_normalStreams->m_smooth;
+	QVERIFY(GpuModelBuilder::SmoothNormals(mesh, true));
+	QCOMPARE(mesh.m_normalStreams->m_smooth, smooth);
+	GpuModelBuilder::ReleaseGeometry(mesh);
+	QVERIFY(!mesh.m_normalStreams->m_smoothed);
+	QVERIFY(!GpuModelBuilder::SmoothNormals(mesh, true));
+	pGraphicsWindow->doneCurrent();
+}
+
+void ModelViewerTest::sceneGraph()
+{
+	// A root with a chain of two nodes under it and one beside the chain
+	auto Translation = [](float x, float y, float z) {
+		QMatrix4x4 matrix;
+		matrix.translate(x, y, z);
+		return matrix;
+	};
+	SceneGraph graph;
+	QCOMPARE(graph.AddNode("root", -1, QMatrix4x4()), 0);
+	QCOMPARE(graph.AddNode("arm", 0, Translation(1.f, 0.f, 0.f)), 1);
+	QCOMPARE(graph.AddNode("hand", 1, Translation(0.f, 2.f, 0.f)), 2);
+	QCOMPARE(graph.AddNode("leg", 0, Translation(5.f, 0.f, 0.f)), 3);
+	QCOMPARE(graph.Node(0).m_end, 4);
+	QCOMPARE(graph.Node(1).m_end, 3);
+	QCOMPARE(graph.Node(3).m_end, 4);
+	QCOMPARE(graph.Node(2).m_world.column(3), QVector4D(1.f, 2.f, 0.f, 1.f));
+	QCOMPARE(graph.FindNode("leg"), 3);
+	QVERIFY(graph.UpdateTransforms().empty());
+	QVERIFY(graph.UpdateVisibility().empty());
+	QVERIFY(!graph.IsEdited());
+
+	// Moving or hiding the arm only changes its subtree, and hiding moves nothing
+	graph.SetLocal(1, Translation(3.f, 0.f, 0.f));
+	QVERIFY(graph.UpdateVisibility().empty());
+	std::vector<NodeRange> changed = graph.UpdateTransforms();
+	QCOMPARE(changed.size(), size_t(1));
+	QCOMPARE(changed[0].m_first, 1);
+	QCOMPARE(changed[0].m_end, 3);
+	QCOMPARE(graph.Node(2).m_world.column(3), QVector4D(3.f, 2.f, 0.f, 1.f));
+	QVERIFY(graph.IsEdited());
+	graph.SetHidden(1, true);
+	QVERIFY(graph.UpdateTransforms().empty());
+	changed = graph.UpdateVisibility();
+	QCOMPARE(changed.size(), size_t(1));
+	QCOMPARE(changed[0].m_first, 1);
+	QVERIFY(!graph.IsVisible(2));
+	QVERIFY(graph.IsVisible(3));
+
+	// Isolating the leg changes everything but it, showing all again changes the same nodes
+	graph.SetHidden(1, false);
+	graph.UpdateVisibility();
+	graph.Isolate(3);
+	changed = graph.UpdateVisibility();
+	QCOMPARE(changed.size(), size_t(1));
+	QCOMPARE(changed[0].m_first, 0);
+	QCOMPARE(changed[0].m_end, 3);
+	QVERIFY(!graph.IsVisible(0));
+	QVERIFY(!graph.IsVisible(2));
+	QVERIFY(graph.IsVisible(3));
+	graph.Isolate(-1);
+	changed = graph.UpdateVisibility();
+	QCOMPARE(changed.size(), size_t(1));
+	QCOMPARE(changed[0].m_end, 3);
+	QVERIFY(graph.IsVisible(2));
+
+	// A mesh drawn by a node two levels down is placed by both nodes above it, and once more
+	// beside them
+	const float positions[] = { 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f };
+	const float normals[] = { 0.f, 0.f, 1.f, 0.f, 0.f, 1.f, 0.f, 0.f, 1.f };
+	const quint32 indices[] = { 0, 1, 2 };
+	QByteArray binary;
+	binary.append(reinterpret_cast<const char*>(positions), sizeof(positions));
+	binary.append(reinterpret_cast<const char*>(normals), sizeof(normals));
+	binary.append(reinterpret_cast<const char*>(indices), sizeof(indices));
+	QJsonObject root;
+	root["asset"] = QJsonObject{ { "version", "2.0" } };
+	root["buffers"] = QJsonArray{ QJsonObject{ { "byteLength", binary.size() } } };
+	root["bufferViews"] = QJsonArray{
+		QJsonObject{ { "buffer", 0 }, { "byteOffset", 0 }, { "byteLength", 36 } },
+		QJsonObject{ { "buffer", 0 }, { "byteOffset", 36 }, { "byteLength", 36 } },
+		QJsonObject{ { "buffer", 0 }, { "byteOffset", 72 }, { "byteLength", 12 } },
+	};
+	root["accessors"] = QJsonArray{
+		QJsonObject{ { "bufferView", 0 }, { "componentType", 5126 }, { "count", 3 }, { "type", "VEC3" } },
+		QJsonObject{ { "bufferView", 1 }, { "componentType", 5126 }, { "count", 3 }, { "type", "VEC3" } },
+		QJsonObject{ { "bufferView", 2 }, { "componentType", 5125 }, { "count", 3 }, { "type", "SCALAR" } },
+	};
+	root["meshes"] = QJsonArray{ QJsonObject{ { "name", "triangle" }, { "primitives", QJsonArray{ QJsonObject{ { "attributes", QJsonObject{ { "POSITION", 0 }, { "NORMAL", 1 } } }, { "indices", 2 } } } } } };
+	root["nodes"] = QJsonArray{
+		QJsonObject{ { "translation", QJsonArray{ 1, 0, 0 } }, { "children", QJsonArray{ 1 } } },
+		QJsonObject{ { "translation", QJsonArray{ 0, 2, 0 } }, { "children", QJsonArray{ 2 } } },
+		QJsonObject{ { "mesh", 0 }, { "translation", QJsonArray{ 0, 0, 3 } } },
+		QJsonObject{ { "mesh", 0 }, { "translation", QJsonArray{ 5, 0, 0 } } },
+	};
+	root["scenes"] = QJsonArray{ QJsonObject{ { "nodes", QJsonArray{ 0, 3 } } } };
+	root["scene"] = 0;
+	QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+	while (json.size() % 4 != 0) {
+		json.append(' ');
+	}
+	auto Pod = [](QByteArray& bytes, quint32 val) {
+		bytes.append(reinterpret_cast<const char*>(&val), sizeof(val));
+	};
+	QByteArray glb("glTF");
+	Pod(glb, 2);
+	Pod(glb, quint32(12 + 8 + json.size() + 8 + binary.size()));
+	Pod(glb, quint32(json.size()));
+	glb.append("JSON");
+	glb.append(json);
+	Pod(glb, quint32(binary.size()));
+	glb.append("BIN", 4);
+	glb.append(binary);
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath("nested.glb");
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write(glb);
+	file.close();
+
+	const ModelData data = ModelLoader::DecodeFile(path);
+	QCOMPARE(data.m_meshes.size(), size_t(1));
+	QVERIFY(data.m_sceneGraph);
+	const MeshData& mesh = data.m_meshes[0];
+	QCOMPARE(mesh.m_instanceTransforms.size(), size_t(2));
+	QCOMPARE(mesh.m_instanceTransforms[0].column(3), QVector4D(1.f, 2.f, 3.f, 1.f));
+	QCOMPARE(mesh.m_instanceTransforms[1].column(3), QVector4D(5.f, 0.f, 0.f, 1.f));
+	QCOMPARE(mesh.m_nodes.size(), size_t(2));
+	QCOMPARE(data.m_sceneGraph->Node(mesh.m_nodes[0]).m_world, mesh.m_instanceTransforms[0]);
+	const int top = data.m_sceneGraph->Node(mesh.m_nodes[0]).m_parent >= 0 ? data.m_sceneGraph->Node(data.m_sceneGraph->Node(mesh.m_nodes[0]).m_parent).m_parent : -1;
+	QVERIFY(top >= 0);
+
+	// Moving the top node of the chain moves the first instance and its bounds, hiding it
+	// only hides that instance and leaves the bounds alone
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(LoadModelAndWait(path));
+	QCOMPARE(pGraphicsWindow->GetSceneGraph().NodeCount(), data.m_sceneGraph->NodeCount());
+	const Mesh& shown = pGraphicsWindow->GetCurrentModel().m_meshes[0];
+	QVERIFY(pGraphicsWindow->setNodeTransform(top, Translation(-1.f, 0.f, 0.f)));
+	QCOMPARE(shown.m_instanceTransforms[0].column(3), QVector4D(-1.f, 2.f, 3.f, 1.f));
+	QCOMPARE(shown.m_instanceTransforms[1].column(3), QVector4D(5.f, 0.f, 0.f, 1.f));
+	QCOMPARE(shown.m_AABBMin, QVector3D(-1.f, 0.f, 0.f));
+	QVERIFY(pGraphicsWindow->setNodeHidden(top, true));
+	QCOMPARE(shown.m_AABBMin, QVector3D(-1.f, 0.f, 0.f));
+	QCOMPARE(shown.m_hiddenDrawCount, 1);
+	QVERIFY(shown.m_hiddenDraws[0] && !shown.m_hiddenDraws[1]);
+	QVERIFY(pGraphicsWindow->isolateNode(top));
+	QVERIFY(shown.IsHidden());
+	QVERIFY(pGraphicsWindow->isolateNode(-1));
+	QVERIFY(pGraphicsWindow->setNodeHidden(top, false));
+	QCOMPARE(shown.m_hiddenDrawCount, 0);
+	QVERIFY(!pGraphicsWindow->setNodeHidden(data.m_sceneGraph->NodeCount(), true));
+	pGraphicsWindow->unloadModel();
+}
+
+void ModelViewerTest::nodeVisibility()
+{
+	// Hiding one node of a hundred thousand only goes over that node
+	const int nodeCount = 100000;
+	SceneGraph graph;
+	graph.AddNode("root", -1, QMatrix4x4());
+	for (int i = 1; i < nodeCount; ++i) {
+		graph.AddNode(QString(), 0, QMatrix4x4());
+	}
+	graph.SetHidden(nodeCount / 2, true);
+	std::vector<NodeRange> changed = graph.UpdateVisibility();
+	QCOMPARE(changed.size(), size_t(1));
+	QCOMPARE(changed[0].m_first, nodeCount / 2);
+	QCOMPARE(changed[0].m_end, nodeCount / 2 + 1);
+	QVERIFY(!graph.IsVisible(nodeCount / 2));
+	QVERIFY(graph.IsVisible(nodeCount / 2 + 1));
+
+	// Runs of shown draws skip the hidden ones
+	Mesh mesh;
+	mesh.m_instanceTransforms.resize(6);
+	std::vector<std::pair<int, int>> runs;
+	GpuModelBuilder::VisibleRuns(mesh, runs);
+	QCOMPARE(runs, (std::vector<std::pair<int, int>>{ { 0, 6 } }));
+	QVERIFY(GpuModelBuilder::SetDrawHidden(mesh, 2, true));
+	QVERIFY(!GpuModelBuilder::SetDrawHidden(mesh, 2, true));
+	QVERIFY(GpuModelBuilder::SetDrawHidden(mesh, 5, true));
+	GpuModelBuilder::VisibleRuns(mesh, runs);
+	QCOMPARE(runs, (std::vector<std::pair<int, int>>{ { 0, 2 }, { 3, 2 } }));
+	QCOMPARE(mesh.m_hiddenDrawCount, 2);
+	QVERIFY(!mesh.IsHidden());
+
+	// A root with a row of nodes drawing the same triangle, listed by the outliner
+	const int rowCount = 64;
+	const float positions[] = { 0.f, 0.f, 0.f, 1.f, 0.f, 0.f, 0.f, 1.f, 0.f };
+	const quint32 indices[] = { 0, 1, 2 };
+	QByteArray binary;
+	binary.append(reinterpret_cast<const char*>(positions), sizeof(positions));
+	binary.append(reinterpret_cast<const char*>(indices), sizeof(indices));
+	QJsonObject root;
+	root["asset"] = QJsonObject{ { "version", "2.0" } };
+	root["buffers"] = QJsonArray{ QJsonObject{ { "byteLength", binary.size() } } };
+	root["bufferViews"] = QJsonArray{
+		QJsonObject{ { "buffer", 0 }, { "byteOffset", 0 }, { "byteLength", 36 } },
+		QJsonObject{ { "buffer", 0 }, { "byteOffset", 36 }, { "byteLength", 12 } },
+	};
+	root["accessors"] = QJsonArray{
+		QJsonObject{ { "bufferView", 0 }, { "componentType", 5126 }, { "count", 3 }, { "type", "VEC3" } },
+		QJsonObject{ { "bufferView", 1 }, { "componentType", 5125 }, { "count", 3 }, { "type", "SCALAR" } },
+	};
+	root["meshes"] = QJsonArray{ QJsonObject{ { "primitives", QJsonArray{ QJsonObject{ { "attributes", QJsonObject{ { "POSITION", 0 } } }, { "indices", 1 } } } } } };
+	QJsonArray nodes;
+	QJsonArray children;
+	nodes.append(QJsonObject{ { "name", "row" } });
+	for (int i = 1; i <= rowCount; ++i) {
+		nodes.append(QJsonObject{ { "mesh", 0 }, { "translation", QJsonArray{ 2 * i, 0, 0 } } });
+		children.append(i);
+	}
+	QJsonObject rowNode = nodes[0].toObject();
+	rowNode["children"] = children;
+	nodes[0] = rowNode;
+	root["nodes"] = nodes;
+	root["scenes"] = QJsonArray{ QJsonObject{ { "nodes", QJsonArray{ 0 } } } };
+	root["scene"] = 0;
+	QByteArray json = QJsonDocument(root).toJson(QJsonDocument::Compact);
+	while (json.size() % 4 != 0) {
+		json.append(' ');
+	}
+	auto Pod = [](QByteArray& bytes, quint32 val) {
+		bytes.append(reinterpret_cast<const char*>(&val), sizeof(val));
+	};
+	QByteArray glb("glTF");
+	Pod(glb, 2);
+	Pod(glb, quint32(12 + 8 + json.size() + 8 + binary.size()));
+	Pod(glb, quint32(json.size()));
+	glb.append("JSON");
+	glb.append(json);
+	Pod(glb, quint32(binary.size()));
+	glb.append("BIN", 4);
+	glb.append(binary);
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath("row.glb");
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write(glb);
+	file.close();
+
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	SceneOutliner outliner(pGraphicsWindow);
+	QVERIFY(LoadModelAndWait(path));
+	const Mesh& shown = pGraphicsWindow->GetCurrentModel().m_meshes[0];
+	QCOMPARE(shown.DrawCount(), rowCount);
+	const QMatrix4x4 transform = shown.m_instanceTransforms[3];
+
+	// Unchecking a node hides its instance and nothing else, the matrices stay
+	QAbstractItemModel* pNodes = outliner.nodeModel();
+	QCOMPARE(pNodes->rowCount(), 1);
+	const int rowNode = pGraphicsWindow->GetSceneGraph().FindNode("row");
+	QVERIFY(rowNode >= 0);
+	const QModelIndex rowIndex = outliner.nodeIndex(rowNode);
+	QCOMPARE(pNodes->data(rowIndex).toString(), QString("row"));
+	QCOMPARE(pNodes->rowCount(rowIndex), rowCount);
+	const QModelIndex childIndex = pNodes->index(3, 0, rowIndex);
+	QCOMPARE(pNodes->parent(childIndex), rowIndex);
+	const int child = int(childIndex.internalId());
+	const int instance = int(std::find(shown.m_nodes.begin(), shown.m_nodes.end(), child) - shown.m_nodes.begin());
+	QVERIFY(instance < rowCount);
+	QVERIFY(pNodes->setData(childIndex, Qt::Unchecked, Qt::CheckStateRole));
+	QCOMPARE(pNodes->data(childIndex, Qt::CheckStateRole).toInt(), int(Qt::Unchecked));
+	QCOMPARE(shown.m_hiddenDrawCount, 1);
+	QVERIFY(shown.m_hiddenDraws[instance]);
+	QCOMPARE(shown.m_instanceTransforms[3], transform);
+
+	// Isolating the node shows only it, hiding every other instance of the mesh
+	QTreeView* pView = outliner.findChild<QTreeView*>("sceneOutlinerView");
+	QVERIFY(pView);
+	pView->setCurrentIndex(childIndex);
+	QVERIFY(pNodes->setData(childIndex, Qt::Checked, Qt::CheckStateRole));
+	outliner.findChild<QPushButton*>("isolateButton")->click();
+	QCOMPARE(pGraphicsWindow->GetSceneGraph().Isolated(), child);
+	QCOMPARE(shown.m_hiddenDrawCount, rowCount - 1);
+	QVERIFY(!shown.m_hiddenDraws[instance]);
+	QVERIFY(pNodes->data(childIndex, Qt::FontRole).value<QFont>().bold());
+	outliner.findChild<QPushButton*>("showAllButton")->click();
+	QCOMPARE(shown.m_hiddenDrawCount, 0);
+
+	// Hiding the row hides the whole mesh
+	QVERIFY(pNodes->setData(rowIndex, Qt::Unchecked, Qt::CheckStateRole));
+	QVERIFY(shown.IsHidden());
+	QVERIFY(pNodes->setData(rowIndex, Qt::Checked, Qt::CheckStateRole));
+	QVERIFY(!shown.IsHidden());
+	pGraphicsWindow->unloadModel();
+}
+
+void ModelViewerTest::lazyUpload()
+{
+	// Uploaded lazily, even a small model is streamed, and only what is in view gets buffers
+	AppSettings* settings = m_pWindow->GetSettingsWindow()->getSettings();
+	settings->setValue("ViewerGraphicsWindow/lazyUpload", true);
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	settings->remove("ViewerGraphicsWindow/lazyUpload");
+	const Model& model = pGraphicsWindow->GetCurrentModel();
+	QVERIFY(model.m_streamer);
+	QTest::qWait(100);
+	QCOMPARE(model.m_streamer->ResidentCount(), model.m_streamer->MeshCount());
+
+	// Hiding a node works on a streamed model, moving one doesn't
+	const Mesh& mesh = model.m_meshes[0];
+	QVERIFY(!mesh.m_nodes.empty());
+	const int node = mesh.m_nodes[0];
+	QVERIFY(!pGraphicsWindow->setNodeTransform(node, QMatrix4x4()));
+	QVERIFY(pGraphicsWindow->setNodeHidden(node, true));
+	QVERIFY(mesh.IsHidden());
+
+	// Hidden meshes aren't requested, so they are the ones freed once the budget is short
+	model.m_streamer->SetBudget(1);
+	pGraphicsWindow->update();
+	QTest::qWait(100);
+	QVERIFY(!GeometryStreamer::IsResident(mesh));
+
+	// Shown again, the mesh is uploaded the next frame it is in view
+	model.m_streamer->SetBudget(std::numeric_limits<qint64>::max());
+	QVERIFY(pGraphicsWindow->setNodeHidden(node, false));
+	QTest::qWait(100);
+	QVERIFY(GeometryStreamer::IsResident(mesh));
+	pGraphicsWindow->unloadModel();
 }
 
-void ModelViewerTest::invalidFile()
+void ModelViewerTest::posterRendering()
 {
-	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
-	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+	// Rows written in bands read back as they were, without alpha
+	const QSize size(37, 23);
+	QImage source(size, QImage::Format_RGBA8888);
+	for (int y = 0; y < size.height(); ++y) {
+		for (int x = 0; x < size.width(); ++x) {
+			source.setPixelColor(x, y, x < 20 ? QColor(40, 80, 120) : QColor(x * 6, y * 11, (x * y) % 256));
+		}
+	}
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString imagePath = dir.filePath("bands.png");
+	{
+		PngWriter writer;
+		QVERIFY(writer.Open(imagePath, size));
+		for (int y = 0; y < size.height(); y += 10) {
+			QVERIFY(writer.WriteRows(source.constScanLine(y), 10, source.bytesPerLine()));
+		}
+		QVERIFY(writer.Close());
+	}
+	const QImage written(imagePath);
+	QCOMPARE(written.size(), size);
+	for (int y = 0; y < size.height(); ++y) {
+		for (int x = 0; x < size.width(); ++x) {
+			QCOMPARE(written.pixelColor(x, y), source.pixelColor(x, y));
+		}
+	}
 
-	QSignalSpy beginLoadSignalSpy(pGraphicsWindow, SIGNAL(BeginModelLoading(QString)));
-	QSignalSpy endLoadSignalSpy(pGraphicsWindow, SIGNAL(EndModelLoading(bool, QString)));
+	// Files missing rows are removed
+	{
+		PngWriter writer;
+		QVERIFY(writer.Open(dir.filePath("short.png"), size));
+		QVERIFY(writer.WriteRows(source.constScanLine(0), 5, source.bytesPerLine()));
+		QVERIFY(!writer.Close());
+		QVERIFY(!QFile::exists(dir.filePath("short.png")));
+	}
 
-	QString path("../Data/Models/Avent.mtl");
-	m_pWindow->GetGraphicsWindow()->loadModel(path);
+	// A point lands in a tile where it lands in the whole image, less the tile's corner
+	const QSize imageSize(1000, 600);
+	QMatrix4x4 projection;
+	projection.perspective(45.f, float(imageSize.width()) / float(imageSize.height()), 0.1f, 100.f);
+	const QRect tile(400, 300, 256, 128);
+	const QMatrix4x4 tileProjection = PosterRenderer::TileProjection(projection, imageSize, tile);
+	const QVector3D point(0.3f, 0.25f, -2.f);
+	auto Pixel = [](const QMatrix4x4& m, const QVector3D& p, const QSize& viewport) {
+		const QVector3D ndc = m.map(p);
+		return QPointF((ndc.x() + 1.f) * 0.5f * viewport.width(), (1.f - ndc.y()) * 0.5f * viewport.height());
+	};
+	const QPointF inImage = Pixel(projection, point, imageSize);
+	const QPointF inTile = Pixel(tileProjection, point, tile.size());
+	QVERIFY(qAbs(inTile.x() - (inImage.x() - tile.x())) < 1e-2);
+	QVERIFY(qAbs(inTile.y() - (inImage.y() - tile.y())) < 1e-2);
+	QVERIFY(qAbs(tileProjection.map(point).z() - projection.map(point).z()) < 1e-5f);
 
-	// Ensure the correct signals were sent
-	QCOMPARE(beginLoadSignalSpy.count(), 1);
-	QCOMPARE(endLoadSignalSpy.count(), 1);
+	// A poster several windows wide is drawn in tiles and written whole
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	const QSize windowSize = pGraphicsWindow->size() * pGraphicsWindow->devicePixelRatio();
+	const QSize posterSize(windowSize.width() * 2 + 7, windowSize.height() * 2 + 3);
+	const QString posterPath = dir.filePath("poster.png");
+	QSignalSpy exported(pGraphicsWindow, SIGNAL(PosterExported(bool, QString)));
+	QVERIFY(pGraphicsWindow->exportPoster(posterPath, posterSize));
+	QVERIFY(!pGraphicsWindow->exportPoster(dir.filePath("other.png"), posterSize));
+	QVERIFY(exported.wait(30000));
+	QVERIFY(exported.takeFirst().at(0).toBool());
+	const QImage poster(posterPath);
+	QCOMPARE(poster.size(), posterSize);
+	QVERIFY(poster.pixelColor(posterSize.width() / 2, posterSize.height() / 2) != poster.pixelColor(0, 0));
+	pGraphicsWindow->unloadModel();
+}
 
-	auto arguments = endLoadSignalSpy.takeFirst();
-	QVERIFY(arguments.at(0).toBool() == false);
+void ModelViewerTest::videoExport()
+{
+	// Hardware encoders come first, software ones only without them
+	QCOMPARE(VideoEncoder::PickEncoder({ "mpeg4", "libx264", "h264_qsv", "h264_nvenc" }), QString("h264_nvenc"));
+	QCOMPARE(VideoEncoder::PickEncoder({ "mpeg4", "libx264", "h264_qsv" }), QString("h264_qsv"));
+	QCOMPARE(VideoEncoder::PickEncoder({ "mpeg4", "libx264" }), QString("libx264"));
+	QVERIFY(VideoEncoder::PickEncoder({ "png", "gif" }).isEmpty());
 
-	// Check that the status is updated
-	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_error);
+	// A turntable ends where it started, one turn further around
+	CameraPose start;
+	start.m_rotX = 30.f;
+	start.m_rotY = 15.f;
+	const CameraPath turntable = CameraPath::Turntable(start, 2.f);
+	QCOMPARE(turntable.Duration(), 2.f);
+	QCOMPARE(turntable.Sample(1.f).m_rotX, 210.f);
+	QCOMPARE(turntable.Sample(2.f).m_rotX, 390.f);
+	QCOMPARE(turntable.Sample(1.f).m_rotY, 15.f);
+	QCOMPARE(turntable.FrameCount(1.f / 10.f), 21);
+
+	// Every frame of the path ends up in the video, or in the image sequence without FFmpeg
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	QTemporaryDir dir;
+	const QString videoPath = dir.filePath("turntable.mp4");
+	const CameraPath path = CameraPath::Turntable(pGraphicsWindow->GetCameraPose(), 0.5f);
+	QSignalSpy exported(pGraphicsWindow, SIGNAL(VideoExported(bool, QString)));
+	QVERIFY(pGraphicsWindow->exportVideo(videoPath, path, 10));
+	QVERIFY(!pGraphicsWindow->exportVideo(dir.filePath("other.mp4"), path, 10));
+	QVERIFY(exported.wait(60000));
+	const QList<QVariant> arguments = exported.takeFirst();
+	QVERIFY(arguments.at(0).toBool());
+	if (VideoEncoder::FindFfmpeg().isEmpty()) {
+		const QDir sequence(arguments.at(1).toString());
+		QCOMPARE(sequence.dirName(), QString("turntable"));
+		QCOMPARE(sequence.entryList({ "frame_*.png" }, QDir::Files).size(), path.FrameCount(0.1f));
+	}
+	else {
+		QCOMPARE(arguments.at(1).toString(), videoPath);
+		QVERIFY(QFileInfo(videoPath).size() > 0);
+	}
+	pGraphicsWindow->unloadModel();
 }
 
-void ModelViewerTest::loadingPage()
+void ModelViewerTest::splitViewports()
 {
+	// The cells tile the window without gaps, two side by side and four in a grid
+	const QSize size(101, 51);
+	QCOMPARE(SplitView::Cell(size, 1, 0), QRect(0, 0, 101, 51));
+	QCOMPARE(SplitView::Cell(size, 2, 0), QRect(0, 0, 50, 51));
+	QCOMPARE(SplitView::Cell(size, 2, 1), QRect(50, 0, 51, 51));
+	QCOMPARE(SplitView::Cell(size, 3, 2), QRect(67, 0, 34, 51));
+	QCOMPARE(SplitView::Cell(size, 4, 3), QRect(50, 25, 51, 26));
+	QVERIFY(SplitView::Cell(size, 2, 2).isNull());
+	QCOMPARE(SplitView::CellAt(size, 4, QPoint(10, 40)), 2);
+	QCOMPARE(SplitView::CellAt(size, 4, QPoint(200, 40)), -1);
+
+	// Every viewport draws the model from the buffers it was uploaded to once
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
 	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
-	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	const qint64 uploadedBytes = pGraphicsWindow->GetUploadedBytes();
+	const QColor background = pGraphicsWindow->grabFramebuffer().pixelColor(0, 0);
+	QVERIFY(!pGraphicsWindow->setViewportAngles(1, 90.f, 0.f));
+	pGraphicsWindow->setViewportCount(2);
+	QCOMPARE(pGraphicsWindow->viewportCount(), 2);
+	QVERIFY(pGraphicsWindow->setViewportAngles(1, 90.f, 0.f));
+	const QImage frame = pGraphicsWindow->grabFramebuffer();
+	for (int i = 0; i < 2; ++i) {
+		const QRect cell = SplitView::Cell(frame.size(), 2, i);
+		QVERIFY(frame.pixelColor(cell.center()) != background);
+	}
+	QCOMPARE(pGraphicsWindow->GetUploadedBytes(), uploadedBytes);
 
+	// A viewport takes shaders of its own, and keeps them when they don't link
+	QVERIFY(pGraphicsWindow->setViewportShaders(1, "../Data/Shaders/ads.vert", "../Data/Shaders/ads.frag"));
+	QVERIFY(!pGraphicsWindow->setViewportShaders(1, QString(), "missing.frag"));
+	QVERIFY(!pGraphicsWindow->grabFramebuffer().isNull());
+	QVERIFY(pGraphicsWindow->setViewportShaders(1));
+
+	pGraphicsWindow->setViewportCount(9);
+	QCOMPARE(pGraphicsWindow->viewportCount(), SplitView::k_maxViewports);
+	pGraphicsWindow->setViewportCount(1);
+	QCOMPARE(pGraphicsWindow->viewportCount(), 1);
+	QVERIFY(pGraphicsWindow->grabFramebuffer().pixelColor(frame.rect().center()) != background);
 	pGraphicsWindow->unloadModel();
+}
 
-	// Check the status before
-	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_empty);
+void ModelViewerTest::modelComparison()
+{
+	// The heatmap runs from blue over green to red
+	QCOMPARE(ModelComparison::HeatColor(0.f), QVector3D(0.f, 0.f, 1.f));
+	QCOMPARE(ModelComparison::HeatColor(0.5f), QVector3D(0.f, 1.f, 0.f));
+	QCOMPARE(ModelComparison::HeatColor(1.f), QVector3D(1.f, 0.f, 0.f));
 
-	QSignalSpy beginLoadSignalSpy(pGraphicsWindow, SIGNAL(BeginModelLoading(QString)));
-	QSignalSpy endLoadSignalSpy(pGraphicsWindow, SIGNAL(EndModelLoading(bool, QString)));
+	// Points project into the face, onto an edge or onto a corner
+	const QVector3D a(0.f, 0.f, 0.f), b(1.f, 0.f, 0.f), c(0.f, 1.f, 0.f);
+	QCOMPARE(SurfaceDistance::ClosestPoint(QVector3D(0.25f, 0.25f, 2.f), a, b, c), QVector3D(0.25f, 0.25f, 0.f));
+	QCOMPARE(SurfaceDistance::ClosestPoint(QVector3D(0.5f, -1.f, 0.f), a, b, c), QVector3D(0.5f, 0.f, 0.f));
+	QCOMPARE(SurfaceDistance::ClosestPoint(QVector3D(2.f, -1.f, 1.f), a, b, c), b);
 
-	QString path("../Data/Models/cubeColor.ply");
-	m_pWindow->GetGraphicsWindow()->loadModel(path);
+	// The hierarchy finds the same distances as trying every triangle
+	SurfaceDistance sphere;
+	sphere.Build(Primitives::Cached(PrimitiveShape::Sphere, 24));
+	QVERIFY(sphere.NodeCount() > 1);
+	const std::vector<QVector3D>& positions = sphere.Positions();
+	const std::vector<GLuint>& indices = sphere.Indices();
+	for (int i = 0; i < 32; ++i) {
+		const QVector3D point = 1.5f * QVector3D(std::sin(float(i)), std::cos(1.7f * float(i)), std::sin(0.3f * float(i)));
+		float nearest = std::numeric_limits<float>::max();
+		for (size_t t = 0; t + 2 < indices.size(); t += 3) {
+			const QVector3D closest = SurfaceDistance::ClosestPoint(point, positions[indices[t]], positions[indices[t + 1]], positions[indices[t + 2]]);
+			nearest = std::min(nearest, (closest - point).length());
+		}
+		QVERIFY(qAbs(sphere.Distance(point) - nearest) < 1e-5f);
+	}
 
-	// Ensure the correct signals were sent
-	QCOMPARE(beginLoadSignalSpy.count(), 1);
-	QCOMPARE(endLoadSignalSpy.count(), 1);
+	// A model is no distance from itself, and the corners of a grown cube are as far as they moved
+	const ModelData cube = Primitives::Cached(PrimitiveShape::Cube);
+	const SurfaceComparison same = SurfaceComparison::Compare(cube, cube);
+	QVERIFY(!same.m_original.IsEmpty());
+	QCOMPARE(same.m_hausdorff, 0.f);
+	ModelData grown = cube;
+	grown.m_meshes[0].m_transform.scale(1.1f);
+	const SurfaceComparison scaled = SurfaceComparison::Compare(cube, grown);
+	QVERIFY(qAbs(scaled.m_hausdorff - 0.1f * std::sqrt(3.f)) < 1e-4f);
+	QVERIFY(qAbs(scaled.m_comparedHausdorff - 0.1f * std::sqrt(3.f)) < 1e-4f);
+	for (float distance : scaled.m_originalDistances) {
+		QVERIFY(qAbs(distance - 0.1f) < 1e-4f);
+	}
 
-	auto arguments = endLoadSignalSpy.takeFirst();
-	QVERIFY(arguments.at(0).toBool() == true);
-	
-	// Check that the status is updated
-	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+	// A coarser sphere is close to the fine one but not on it
+	const SurfaceComparison coarse = SurfaceComparison::Compare(Primitives::Cached(PrimitiveShape::Sphere, 64), Primitives::Cached(PrimitiveShape::Sphere, 12));
+	QVERIFY(coarse.m_hausdorff > 0.f);
+	QVERIFY(coarse.m_hausdorff < 0.2f);
+	QVERIFY(coarse.m_mean < coarse.m_hausdorff);
+
+	// The viewer measures off the GUI thread and then shows both models side by side
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(!pGraphicsWindow->compareWith());
+	const QColor background = pGraphicsWindow->grabFramebuffer().pixelColor(0, 0);
+	QSignalSpy finished(pGraphicsWindow, &ViewerGraphicsWindow::ComparisonFinished);
+	QVERIFY(pGraphicsWindow->compareModels(Primitives::Cached(PrimitiveShape::Sphere, 64), Primitives::Cached(PrimitiveShape::Sphere, 12)));
+	QVERIFY(finished.count() > 0 || finished.wait(10000));
+	QVERIFY(finished.first().at(0).toBool());
+	QVERIFY(qAbs(finished.first().at(1).toFloat() - coarse.m_hausdorff) < 1e-5f);
+	QCOMPARE(pGraphicsWindow->compareMode(), int(k_compareSideBySide));
+	const QImage frame = pGraphicsWindow->grabFramebuffer();
+	for (int i = 0; i < 2; ++i) {
+		QVERIFY(frame.pixelColor(SplitView::Cell(frame.size(), 2, i).center()) != background);
+	}
+
+	pGraphicsWindow->setCompareMode(k_compareHeatmap);
+	QVERIFY(!pGraphicsWindow->grabFramebuffer().isNull());
+	pGraphicsWindow->setCompareMode(k_compareDifference);
+	QVERIFY(!pGraphicsWindow->grabFramebuffer().isNull());
+	pGraphicsWindow->setCompareMode(k_compareOff);
+	QCOMPARE(pGraphicsWindow->compareMode(), int(k_compareOff));
+	pGraphicsWindow->unloadModel();
 }
 
-void ModelViewerTest::unloadModel()
+void ModelViewerTest::meshSimplification()
 {
-	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
-	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+	// A flat grid needs no more than two triangles, and its border stays where it was
+	MeshTriangles grid;
+	const int cells = 16;
+	for (int y = 0; y <= cells; ++y) {
+		for (int x = 0; x <= cells; ++x) {
+			grid.m_positions.push_back(QVector3D(float(x), float(y), 0.f));
+		}
+	}
+	for (int y = 0; y < cells; ++y) {
+		for (int x = 0; x < cells; ++x) {
+			const quint32 a = quint32(y * (cells + 1) + x);
+			const quint32 c = a + quint32(cells + 1);
+			grid.m_indices.insert(grid.m_indices.end(), { a, a + 1, c + 1, a, c + 1, c });
+		}
+	}
+	const SimplifiedMesh flat = MeshSimplifier::Simplify(grid, 1, 1e-3f);
+	QCOMPARE(flat.m_indices.size(), size_t(6));
+	QVERIFY(flat.m_error < 1e-3f);
+	float area = 0.f;
+	for (size_t t = 0; t < flat.m_indices.size(); t += 3) {
+		const QVector3D a = grid.m_positions[flat.m_indices[t]];
+		area += 0.5f * QVector3D::crossProduct(grid.m_positions[flat.m_indices[t + 1]] - a, grid.m_positions[flat.m_indices[t + 2]] - a).z();
+	}
+	QVERIFY(qAbs(area - float(cells * cells)) < 1e-3f);
 
-	// Load model
-	QString path("../Data/Models/cubeColor.ply");
-	m_pWindow->GetGraphicsWindow()->loadModel(path);
+	// A sphere at a quarter of its triangles uses the vertices it had and faces the same way
+	SurfaceDistance sphere;
+	sphere.Build(Primitives::Cached(PrimitiveShape::Sphere, 64));
+	MeshTriangles round;
+	round.m_positions = sphere.Positions();
+	round.m_indices = sphere.Indices();
+	const size_t triangleCount = round.m_indices.size() / 3;
+	const SimplifiedMesh quarter = MeshSimplifier::Simplify(round, triangleCount / 4, std::numeric_limits<float>::max());
+	QVERIFY(quarter.m_indices.size() / 3 <= triangleCount / 4);
+	QVERIFY(quarter.m_indices.size() / 3 > triangleCount / 8);
+	QVERIFY(quarter.m_error > 0.f);
+	const auto facing = [&round](const std::vector<quint32>& indices, size_t t) {
+		const QVector3D a = round.m_positions[indices[t]];
+		const QVector3D b = round.m_positions[indices[t + 1]];
+		const QVector3D c = round.m_positions[indices[t + 2]];
+		return QVector3D::dotProduct(QVector3D::crossProduct(b - a, c - a), a + b + c) > 0.f;
+	};
+	const bool outward = facing(round.m_indices, 0);
+	for (size_t t = 0; t < quarter.m_indices.size(); t += 3) {
+		QVERIFY(quarter.m_indices[t] < round.m_positions.size() && quarter.m_indices[t + 1] < round.m_positions.size() && quarter.m_indices[t + 2] < round.m_positions.size());
+		QCOMPARE(facing(quarter.m_indices, t), outward);
+	}
+	const SimplifiedMesh bounded = MeshSimplifier::Simplify(round, 1, 0.01f);
+	QVERIFY(bounded.m_error <= 0.01f);
+	QVERIFY(bounded.m_indices.size() < round.m_indices.size());
 
-	// Check the status after
-	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+	// Every mesh of a model keeps the same share of its triangles
+	SimplifyOptions options;
+	QVERIFY(!options.IsActive());
+	QCOMPARE(MeshSimplifier::SimplifyMeshes({ grid }, options)[0].m_indices, grid.m_indices);
+	options.m_targetTriangles = 250;
+	QCOMPARE(MeshSimplifier::KeepRatio(options, 1000), 0.25f);
+	QCOMPARE(MeshSimplifier::KeepRatio(options, 100), 1.f);
+	size_t kept = 0;
+	for (const SimplifiedMesh& mesh : MeshSimplifier::SimplifyMeshes({ grid, round }, options)) {
+		kept += mesh.m_indices.size() / 3;
+	}
+	QVERIFY(kept <= 252);
+
+	// A simplified scene drops the vertices its triangles no longer use
+	Assimp::Importer importer;
+	const aiScene* pScene = importer.ReadFile("../Data/Models/lowpolytree.obj", aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
+	QVERIFY(pScene);
+	aiScene* pCopy = nullptr;
+	aiCopyScene(pScene, &pCopy);
+	QVERIFY(pCopy);
+	uint faces = 0;
+	uint vertices = 0;
+	for (uint m = 0; m < pScene->mNumMeshes; ++m) {
+		faces += pScene->mMeshes[m]->mNumFaces;
+		vertices += pScene->mMeshes[m]->mNumVertices;
+	}
+	options.m_targetTriangles = faces / 2;
+	QVERIFY(MeshSimplifier::SimplifyScene(pCopy, options));
+	uint simplifiedFaces = 0;
+	uint simplifiedVertices = 0;
+	for (uint m = 0; m < pCopy->mNumMeshes; ++m) {
+		const aiMesh* pMesh = pCopy->mMeshes[m];
+		simplifiedFaces += pMesh->mNumFaces;
+		simplifiedVertices += pMesh->mNumVertices;
+		for (uint f = 0; f < pMesh->mNumFaces; ++f) {
+			for (uint i = 0; i < pMesh->mFaces[f].mNumIndices; ++i) {
+				QVERIFY(pMesh->mFaces[f].mIndices[i] < pMesh->mNumVertices);
+			}
+		}
+	}
+	QVERIFY(simplifiedFaces < faces);
+	QVERIFY(simplifiedVertices < vertices);
+	aiFreeScene(pCopy);
 
+	// The view swaps the simplified indices in and the full detail back
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
 	pGraphicsWindow->unloadModel();
+	QVERIFY(!pGraphicsWindow->previewSimplification(options));
+	const QColor background = pGraphicsWindow->grabFramebuffer().pixelColor(0, 0);
+	QVERIFY(pGraphicsWindow->addPrimitive(PrimitiveShape::Sphere));
+	const int indexCount = pGraphicsWindow->GetCurrentModel().m_meshes[0].m_indexCount;
+	QSignalSpy finished(pGraphicsWindow, &ViewerGraphicsWindow::SimplificationFinished);
+	options.m_targetTriangles = indexCount / 3 / 4;
+	QVERIFY(pGraphicsWindow->previewSimplification(options));
+	QVERIFY(finished.count() > 0 || finished.wait(10000));
+	const qint64 triangles = finished.first().at(0).toLongLong();
+	QVERIFY(triangles <= options.m_targetTriangles);
+	QCOMPARE(finished.first().at(1).toLongLong(), qint64(indexCount / 3));
+	QCOMPARE(qint64(pGraphicsWindow->GetCurrentModel().m_meshes[0].m_indexCount), triangles * 3);
+	QVERIFY(pGraphicsWindow->simplification().IsActive());
+	const QImage frame = pGraphicsWindow->grabFramebuffer();
+	QVERIFY(frame.pixelColor(frame.rect().center()) != background);
 
-	// Check the status after
-	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_empty);
+	pGraphicsWindow->endSimplification();
+	QVERIFY(!pGraphicsWindow->simplification().IsActive());
+	QCOMPARE(pGraphicsWindow->GetCurrentModel().m_meshes[0].m_indexCount, indexCount);
+	QVERIFY(pGraphicsWindow->previewSimplification(options));
+	QVERIFY(finished.wait(10000));
+	pGraphicsWindow->unloadModel();
+	QVERIFY(!pGraphicsWindow->simplification().IsActive());
 }
 
-void ModelViewerTest::testShow()
+void ModelViewerTest::sectionPlanes()
 {
-	QVERIFY(m_pWindow->isHidden());
-	m_pWindow->show();
-	QTest::qWait(100);
-	QVERIFY(m_pWindow->isHidden() == false);
-	m_pWindow->hide();
-}
+	// Section planes cull what the view frustum keeps, up to as many as it holds
+	const QVector4D keepLeft(-1.f, 0.f, 0.f, 0.f);
+	const Frustum view(QMatrix4x4(), &keepLeft, 1);
+	QCOMPARE(view.PlaneCount(), 7);
+	QVERIFY(view.Intersects(QVector3D(-0.5f, -0.5f, -0.5f), QVector3D(-0.1f, 0.5f, 0.5f)));
+	QVERIFY(view.Intersects(QVector3D(-0.5f, -0.5f, -0.5f), QVector3D(0.5f, 0.5f, 0.5f)));
+	QVERIFY(!view.Intersects(QVector3D(0.1f, -0.5f, -0.5f), QVector3D(0.5f, 0.5f, 0.5f)));
+	QVERIFY(!view.IntersectsSphere(QVector3D(0.5f, 0.f, 0.f), 0.25f));
+	QVERIFY(view.IntersectsSphere(QVector3D(0.1f, 0.f, 0.f), 0.25f));
+	const std::vector<QVector4D> many(10, keepLeft);
+	QCOMPARE(Frustum(QMatrix4x4(), many.data(), int(many.size())).PlaneCount(), 6 + Frustum::k_maxExtraPlanes);
 
-void ModelViewerTest::loadModel()
-{
-	Model loaded = ModelLoader::LoadModel("../Data/Primitives/cube.obj");
-	QVERIFY(loaded.m_isValid);
+	// A plane across the unit box cuts out a square on the plane, its corners in order
+	const QVector4D half(1.f, 0.f, 0.f, -0.5f);
+	QVERIFY(SectionCaps::Crosses(half, QVector3D(0.f, 0.f, 0.f), QVector3D(1.f, 1.f, 1.f)));
+	QVERIFY(!SectionCaps::Crosses(half, QVector3D(0.6f, 0.f, 0.f), QVector3D(1.f, 1.f, 1.f)));
+	const std::vector<QVector3D> square = SectionCaps::BoxSection(half, QVector3D(0.f, 0.f, 0.f), QVector3D(1.f, 1.f, 1.f));
+	QCOMPARE(square.size(), size_t(4));
+	for (size_t i = 0; i < square.size(); ++i) {
+		QCOMPARE(square[i].x(), 0.5f);
+		// Neighbours share a side of the square, so they are one apart
+		QVERIFY(qAbs((square[(i + 1) % square.size()] - square[i]).length() - 1.f) < 1e-5f);
+	}
+	QVERIFY(SectionCaps::BoxSection(half, QVector3D(0.6f, 0.f, 0.f), QVector3D(1.f, 1.f, 1.f)).empty());
+	QCOMPARE(SectionCaps::BoxSection(QVector4D(1.f, 1.f, 1.f, -1.5f), QVector3D(0.f, 0.f, 0.f), QVector3D(1.f, 1.f, 1.f)).size(), size_t(6));
+
+	// The view keeps the model where a plane keeps it, and fills the cut
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	pGraphicsWindow->unloadModel();
+	const QColor background = pGraphicsWindow->grabFramebuffer().pixelColor(0, 0);
+	QVERIFY(pGraphicsWindow->addPrimitive(PrimitiveShape::Sphere));
+	const auto Covered = [&]() {
+		const QImage frame = pGraphicsWindow->grabFramebuffer();
+		int covered = 0;
+		for (int y = 0; y < frame.height(); y += 8) {
+			for (int x = 0; x < frame.width(); x += 8) {
+				covered += frame.pixelColor(x, y) != background ? 1 : 0;
+			}
+		}
+		return covered;
+	};
+	const int whole = Covered();
+	QVERIFY(whole > 0);
+	pGraphicsWindow->setSectionPlanes({ QVector4D(0.f, 0.f, 0.f, -1.f) });
+	QCOMPARE(pGraphicsWindow->sectionPlanes().size(), size_t(1));
+	const int cutAway = Covered();
+	QVERIFY(cutAway < whole);
+	pGraphicsWindow->setSectionPlanes({ QVector4D(0.f, 0.f, -1.f, 0.f) });
+	QVERIFY(pGraphicsWindow->sectionCaps());
+	QVERIFY(Covered() > cutAway);
+	pGraphicsWindow->setSectionPlanes(many, false);
+	QCOMPARE(pGraphicsWindow->sectionPlanes().size(), size_t(Frustum::k_maxExtraPlanes));
+	QVERIFY(!pGraphicsWindow->sectionCaps());
+	pGraphicsWindow->setSectionPlanes({});
+	QCOMPARE(Covered(), whole);
+	pGraphicsWindow->unloadModel();
 }
 
-void ModelViewerTest::saveModel() 
+void ModelViewerTest::framePacing()
 {
-	if (disableAnnoyingTests) {
-		return;
-	}
+	QCOMPARE(FramePacer::SwapInterval(k_presentVsync), 1);
+	QCOMPARE(FramePacer::SwapInterval(k_presentAdaptive), -1);
+	QCOMPARE(FramePacer::SwapInterval(k_presentUncapped), 0);
+	QCOMPARE(FramePacer::SwapInterval(k_presentLimited), 0);
 
-	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
-	GraphicsWindowDelegate* pGraphicsDelegate = m_pWindow->GetGraphicsDelegate();
+	// Steps close to whole refreshes move the view by exactly that many, others as measured
+	FramePacer pacer;
+	PacingOptions options;
+	pacer.SetOptions(options, 100.f);
+	QVERIFY(!pacer.Delays());
+	QCOMPARE(pacer.TargetInterval(), 0.01f);
+	QCOMPARE(pacer.FrameStep(0.0108f), 0.01f);
+	QCOMPARE(pacer.FrameStep(0.0195f), 0.02f);
+	QCOMPARE(pacer.FrameStep(0.015f), 0.015f);
+	QCOMPARE(pacer.FrameStep(0.004f), 0.004f);
+	QCOMPARE(pacer.NextFrameDelay(1.0, 0.003f), 0.f);
 
-	// Load model
-	QString path("../Data/Models/cubeColor.ply");
-	m_pWindow->GetGraphicsWindow()->loadModel(path);
+	// Low latency starts the frame as late as it still makes the refresh
+	options.m_lowLatency = true;
+	pacer.SetOptions(options, 100.f);
+	QVERIFY(pacer.Delays());
+	QVERIFY(qAbs(pacer.NextFrameDelay(1.0, 0.003f) - (0.01f - 0.003f - FramePacer::k_lowLatencyMargin)) < 1e-6f);
+	QCOMPARE(pacer.NextFrameDelay(1.0, 0.02f), 0.f);
+	const float lowLatency = pacer.InputToPhoton(0.f, 0.003f, 0.f);
+	options.m_lowLatency = false;
+	pacer.SetOptions(options, 100.f);
+	QVERIFY(pacer.InputToPhoton(0.f, 0.003f, 0.f) > lowLatency);
+	QVERIFY(pacer.InputToPhoton(0.005f, 0.003f, 0.f) > pacer.InputToPhoton(0.f, 0.003f, 0.f));
 
-	// Check the status after
-	QVERIFY(pGraphicsDelegate->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+	// Uncapped never waits and moves the view by the time measured
+	options.m_presentMode = k_presentUncapped;
+	pacer.SetOptions(options, 100.f);
+	QCOMPARE(pacer.TargetInterval(), 0.f);
+	QCOMPARE(pacer.FrameStep(0.0108f), 0.0108f);
+	QCOMPARE(pacer.NextFrameDelay(1.0, 0.f), 0.f);
 
-	// Save model
-	bool success = ModelLoader::ExportModel("../Data/Models/");
-	QVERIFY(success);
+	// The limiter keeps to its rate from frame to frame, and starts over after a late frame
+	options.m_presentMode = k_presentLimited;
+	options.m_frameLimit = 50;
+	pacer.SetOptions(options, 144.f);
+	QVERIFY(pacer.Delays());
+	QCOMPARE(pacer.TargetInterval(), 0.02f);
+	QCOMPARE(pacer.NextFrameDelay(1.0, 0.f), 0.f);
+	QVERIFY(qAbs(pacer.NextFrameDelay(1.005, 0.f) - 0.015f) < 1e-5f);
+	QVERIFY(qAbs(pacer.NextFrameDelay(1.031, 0.f) - 0.009f) < 1e-5f);
+	QCOMPARE(pacer.NextFrameDelay(1.2, 0.f), 0.f);
+	QVERIFY(qAbs(pacer.NextFrameDelay(1.21, 0.f) - 0.01f) < 1e-5f);
+
+	// The viewer shows the present mode in its overlay and keeps drawing with each
+	ResetViewAndShow();
+	QVERIFY(QTest::qWaitForWindowExposed(m_pWindow));
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	AppSettings* settings = m_pWindow->GetSettingsWindow()->getSettings();
+	for (int mode : { int(k_presentLimited), int(k_presentUncapped), int(k_presentVsync) }) {
+		settings->setValue("ViewerGraphicsWindow/presentMode", mode);
+		settings->setValue("ViewerGraphicsWindow/lowLatency", mode == k_presentVsync);
+		pGraphicsWindow->loadSettings();
+		QSignalSpy swapped(pGraphicsWindow, &QOpenGLWidget::frameSwapped);
+		pGraphicsWindow->update();
+		QVERIFY(swapped.wait(5000));
+	}
+	settings->remove("ViewerGraphicsWindow/presentMode");
+	settings->remove("ViewerGraphicsWindow/lowLatency");
+	pGraphicsWindow->loadSettings();
 }
 
-void ModelViewerTest::loadShader()
+void ModelViewerTest::startupPhases()
 {
-	bool success = m_pWindow->GetGraphicsWindow()->loadVertexShader("../Data/Shaders/ads.vert");
-	QVERIFY(success);
-	success = m_pWindow->GetGraphicsWindow()->loadFragmentShader("../Data/Shaders/ads.frag");
-	QVERIFY(success);
+	// Every part of the viewer reads and writes the one settings object
+	QCOMPARE(AppSettings::Shared(), AppSettings::Shared());
+	QCOMPARE(m_pWindow->GetSettingsWindow()->getSettings(), AppSettings::Shared());
+	QCOMPARE(m_pWindow->GetSettingsWindow(), m_pWindow->GetSettingsWindow());
+
+	// The render passes are created once the landing page was painted, which ends the trace
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QTRY_VERIFY(pGraphicsWindow->IsInitialized());
+	QTRY_VERIFY(pGraphicsWindow->IsResourcesCreated());
+	QTRY_VERIFY(StartupTrace::IsFinished());
+	QVERIFY(StartupTrace::Active() == nullptr);
+	QVERIFY(StartupTrace::DurationNs() > 0);
+
+	std::set<QByteArray> names;
+	for (const ImportTrace::Event& event : StartupTrace::Trace().Events()) {
+		QVERIFY(event.m_endNs <= StartupTrace::DurationNs());
+		names.insert(QByteArray(event.m_name));
+	}
+	QVERIFY(names.count("graphics window"));
+	QVERIFY(names.count("link program"));
+	QVERIFY(names.count("first paint"));
+	QVERIFY(StartupTrace::Summary().startsWith("Started in"));
+
+	// Finishing again changes nothing
+	const qint64 duration = StartupTrace::DurationNs();
+	StartupTrace::Finish();
+	QCOMPARE(StartupTrace::DurationNs(), duration);
 }
 
-void ModelViewerTest::loadCurrentShaders()
+void ModelViewerTest::settingsStore()
 {
-	bool success = m_pWindow->GetGraphicsWindow()->reloadCurrentShaders();
-	QVERIFY(success);
+	AppSettings* settings = AppSettings::Shared();
+	QSignalSpy changed(settings, &AppSettings::Changed);
+
+	// Values are typed and a change is told once, setting the same value again is no change
+	settings->setValue("ModelViewerTest/store/count", 3);
+	settings->setValue("ModelViewerTest/store/count", 3);
+	settings->setValue("ModelViewerTest/store/name", QString("grid"));
+	QCOMPARE(changed.count(), 2);
+	QCOMPARE(changed.at(0).at(0).toString(), QString("ModelViewerTest/store/count"));
+	QCOMPARE(settings->get<int>("ModelViewerTest/store/count", 0), 3);
+	QCOMPARE(settings->get<QString>("ModelViewerTest/store/name", QString()), QString("grid"));
+	QCOMPARE(settings->get<int>("ModelViewerTest/store/missing", 7), 7);
+
+	// Changes are written in the background, a new QSettings sees them after a sync
+	settings->sync();
+	{
+		QSettings stored("The Model Viewers team", "Model Viewer");
+		QCOMPARE(stored.value("ModelViewerTest/store/count").toInt(), 3);
+	}
+
+	// Removing a group removes the keys below it, and not those that only share its name
+	settings->setValue("ModelViewerTest/storeOther", true);
+	changed.clear();
+	settings->remove("ModelViewerTest/store");
+	QCOMPARE(changed.count(), 1);
+	QVERIFY(!settings->contains("ModelViewerTest/store/count"));
+	QVERIFY(!settings->contains("ModelViewerTest/store/name"));
+	QVERIFY(settings->contains("ModelViewerTest/storeOther"));
+	settings->remove("ModelViewerTest");
+	settings->sync();
+	{
+		QSettings stored("The Model Viewers team", "Model Viewer");
+		QVERIFY(!stored.contains("ModelViewerTest/store/count"));
+		QVERIFY(!stored.contains("ModelViewerTest/storeOther"));
+	}
+
+	// The viewer picks up its settings changed anywhere without being asked to
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	const float fieldOfView = pGraphicsWindow->fieldOfView;
+	settings->setValue("ViewerGraphicsWindow/fieldOfView", fieldOfView + 10.f);
+	QTRY_COMPARE(pGraphicsWindow->fieldOfView, fieldOfView + 10.f);
+	settings->remove("ViewerGraphicsWindow/fieldOfView");
+	QTRY_COMPARE(pGraphicsWindow->fieldOfView, 45.f);
 }
 
-void ModelViewerTest::editCurrentShaders()
+void ModelViewerTest::jobSystem()
 {
-	if (disableAnnoyingTests) {
-		return;
+	// Jobs return their value through the future and know they run as a job
+	QVERIFY(!JobSystem::InJob());
+	QCOMPARE(JobSystem::Run(JobPriority::Load, [] { return 42; }).result(), 42);
+	QVERIFY(JobSystem::Run(JobPriority::Normal, [] { return JobSystem::InJob(); }).result());
+
+	// A job cancelled before it started never runs
+	std::atomic<bool> ran(false);
+	CancelToken token;
+	token.Cancel();
+	QFuture<void> skipped = JobSystem::Run(JobPriority::Interactive, [&ran] { ran = true; }, token);
+	skipped.waitForFinished();
+	QVERIFY(skipped.isCanceled());
+	QVERIFY(!ran);
+
+	// With every worker busy, a freed worker takes the queued jobs by priority
+	QThreadPool* pPool = JobSystem::Pool();
+	const int workers = pPool->maxThreadCount();
+	QSemaphore gate;
+	std::atomic<int> blocking(0);
+	std::vector<QFuture<void>> blockers;
+	for (int i = 0; i < workers; ++i) {
+		blockers.push_back(JobSystem::Run(JobPriority::Interactive, [&] { ++blocking; gate.acquire(); }));
+	}
+	QTRY_COMPARE(blocking.load(), workers);
+	QMutex orderMutex;
+	std::vector<int> order;
+	std::vector<QFuture<void>> queued;
+	for (JobPriority priority : { JobPriority::Prewarm, JobPriority::Load, JobPriority::Normal, JobPriority::Interactive }) {
+		queued.push_back(JobSystem::Run(priority, [&, priority] {
+			QMutexLocker lock(&orderMutex);
+			order.push_back(int(priority));
+		}));
+	}
+	gate.release(1);
+	for (QFuture<void>& job : queued) {
+		job.waitForFinished();
 	}
+	gate.release(workers - 1);
+	for (QFuture<void>& blocker : blockers) {
+		blocker.waitForFinished();
+	}
+	QCOMPARE(order, std::vector<int>({ int(JobPriority::Interactive), int(JobPriority::Load), int(JobPriority::Normal), int(JobPriority::Prewarm) }));
 
-	bool success = m_pWindow->GetGraphicsWindow()->editCurrentShaders();
-	QVERIFY(success);
+	// Continuations run on the main thread, unless cancelled or their context is gone
+	int result = 0;
+	QThread* pThread = nullptr;
+	JobSystem::Then(JobPriority::Load, [] { return 7; }, m_pWindow, [&](int value) {
+		result = value;
+		pThread = QThread::currentThread();
+	});
+	QTRY_COMPARE(result, 7);
+	QCOMPARE(pThread, QCoreApplication::instance()->thread());
+
+	bool called = false;
+	CancelToken cancelled;
+	JobSystem::Then(JobPriority::Load, [cancelled]() mutable { cancelled.Cancel(); }, m_pWindow, [&called] { called = true; }, cancelled);
+	QObject* pContext = new QObject();
+	JobSystem::Post(pContext, [&called] { called = true; });
+	delete pContext;
+	QTest::qWait(50);
+	QVERIFY(!called);
 }
 
-void ModelViewerTest::openShaderFile()
+void ModelViewerTest::virtualTextures()
 {
-	if (disableAnnoyingTests) {
-		return;
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+
+	// A texture with alpha is paged losslessly, one level of pages over a tail that fits
+	QImage image(1000, 700, QImage::Format_RGBA8888);
+	for (int y = 0; y < image.height(); ++y) {
+		uchar* pLine = image.scanLine(y);
+		for (int x = 0; x < image.width(); ++x) {
+			const uchar texel[4] = { uchar(x), uchar(y), uchar(x ^ y), uchar(128 + (x + y) % 128) };
+			std::memcpy(pLine + 4 * x, texel, 4);
+		}
 	}
+	const QString path = dir.filePath("texture.mvpages");
+	QVERIFY(PageFile::Write(path, image));
+	PageFile pages;
+	QVERIFY(pages.Open(path));
+	QCOMPARE(pages.Size(), QSize(1000, 700));
+	QCOMPARE(pages.Levels(), 1);
+	QCOMPARE(pages.LevelPages(0), QSize(9, 6));
 
-	bool success = m_pWindow->GetGraphicsWindow()->openShaderFile("../Data/Shaders/basic.frag");
-	QVERIFY(success);
+	// A page holds its texels and a border of its neighbours', the edge repeats outside
+	const QImage page = pages.ReadPage(0, 8, 0);
+	QCOMPARE(page.size(), QSize(PageFile::k_pageSize, PageFile::k_pageSize));
+	for (int y = 0; y < page.height(); ++y) {
+		for (int x = 0; x < page.width(); ++x) {
+			const int sourceX = qBound(0, 8 * PageFile::k_pageContent - PageFile::k_pageBorder + x, image.width() - 1);
+			const int sourceY = qBound(0, y - PageFile::k_pageBorder, image.height() - 1);
+			QCOMPARE(std::memcmp(page.constScanLine(y) + 4 * x, image.constScanLine(sourceY) + 4 * sourceX, 4), 0);
+		}
+	}
+	QVERIFY(pages.ReadPage(0, 9, 0).isNull());
+	QVERIFY(pages.ReadPage(1, 0, 0).isNull());
+
+	// The tail is the next level, each texel the rounded average of four
+	const QImage tail = pages.Tail();
+	QCOMPARE(tail.size(), QSize(500, 350));
+	for (int c = 0; c < 4; ++c) {
+		const int sum = image.constScanLine(2)[4 * 6 + c] + image.constScanLine(2)[4 * 7 + c] + image.constScanLine(3)[4 * 6 + c] + image.constScanLine(3)[4 * 7 + c];
+		QCOMPARE(int(tail.constScanLine(1)[4 * 3 + c]), (sum + 2) / 4);
+	}
+
+	// Levels halve rounding up, only those over the tail's size are paged
+	QCOMPARE(PageFile::LevelSize(QSize(1001, 3), 1), QSize(501, 2));
+	QVERIFY(PageFile::NeedsPages(QSize(513, 10)));
+	QVERIFY(!PageFile::NeedsPages(QSize(512, 512)));
+	QVERIFY(!pages.Open(dir.filePath("missing.mvpages")));
+	QVERIFY(PageFile::PathFor("a", dir.path()) != PageFile::PathFor("b", dir.path()));
+
+	// Requests pack into one value, and the feedback's cleared pixels ask for nothing
+	int slot = 0, level = 0, x = 0, y = 0;
+	VirtualTextures::UnpackRequest(VirtualTextures::PackRequest(15, 5, 255, 4095), slot, level, x, y);
+	QCOMPARE(slot, 15);
+	QCOMPARE(level, 5);
+	QCOMPARE(x, 255);
+	QCOMPARE(y, 4095);
+	const uchar texel[4] = { 3, 2, 1, 5 };
+	const uchar cleared[4] = {};
+	quint32 request = 0;
+	QVERIFY(VirtualTextures::ReadFeedback(texel, request));
+	QCOMPARE(request, VirtualTextures::PackRequest(4, 1, 3, 2));
+	QVERIFY(!VirtualTextures::ReadFeedback(cleared, request));
+
+	// Missing pages point at their nearest resident ancestor, or nowhere without one
+	const std::vector<QSize> levelPages = { QSize(4, 2), QSize(2, 1), QSize(1, 1) };
+	std::vector<std::vector<int>> atlasPages = { std::vector<int>(8, -1), { -1, 6 }, { -1 } };
+	atlasPages[0][0] = 1;
+	std::vector<std::vector<quint32>> table;
+	VirtualTextures::FillPageTable(atlasPages, levelPages, 4, table);
+	auto Entry = [&](int entryLevel, int index) {
+		const uchar* pTexel = reinterpret_cast<const uchar*>(&table[entryLevel][index]);
+		return QVector<int>{ pTexel[0], pTexel[1], pTexel[2], pTexel[3] };
+	};
+	QCOMPARE(Entry(0, 0), (QVector<int>{ 1, 0, 0, 255 }));
+	QCOMPARE(Entry(0, 7), (QVector<int>{ 2, 1, 1, 255 }));
+	QCOMPARE(Entry(0, 1), (QVector<int>{ 0, 0, 0, 0 }));
+	QCOMPARE(Entry(1, 1), (QVector<int>{ 2, 1, 1, 255 }));
+	QCOMPARE(Entry(2, 0), (QVector<int>{ 0, 0, 0, 0 }));
+
+	// The archive's 8x8 checker is too small to page, and paging is cached apart
+	const QString modelPath("../Data/Models/quadPack.zip/models/quad.obj");
+	LoadOptions options;
+	options.m_pageFolder = dir.path();
+	const ModelData data = ModelLoader::DecodeFile(modelPath, options);
+	QVERIFY(!data.m_meshes.empty());
+	const TextureData& texture = data.m_materials[data.m_meshes[0].m_material].m_maps[k_baseColorMap];
+	QCOMPARE(texture.m_image.size(), QSize(8, 8));
+	QVERIFY(texture.m_pageFile.isEmpty());
+	options.m_virtualTextureSize = 0;
+	QVERIFY(ModelCache::Key("../Data/Models/quadPack.zip", options) != ModelCache::Key("../Data/Models/quadPack.zip", LoadOptions()));
 }
 
-void ModelViewerTest::changeColorUniforms()
+void ModelViewerTest::evictWhenHidden()
 {
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	QVERIFY(!pGraphicsWindow->IsSuspended());
+	pGraphicsWindow->SetRotation(20.f, 30.f);
+	const QMatrix4x4 view = pGraphicsWindow->GetModelMatrix();
+
+	// Hidden, nothing is drawn, and the evicted model frees its memory
+	m_pWindow->hide();
+	QVERIFY(pGraphicsWindow->IsSuspended());
+	QVERIFY(pGraphicsWindow->evictModel());
+	QVERIFY(pGraphicsWindow->IsEvicted());
+	QVERIFY(!pGraphicsWindow->IsModelValid());
+	QVERIFY(!pGraphicsWindow->evictModel());
+
+	// Shown again it comes back in the view it was left in
+	QSignalSpy endLoadSignalSpy(pGraphicsWindow, SIGNAL(EndModelLoading(bool, QString)));
 	m_pWindow->show();
-	m_pWindow->GetGraphicsWindow()->colorRChanged(255);
-	m_pWindow->GetGraphicsWindow()->colorGChanged(255);
-	m_pWindow->GetGraphicsWindow()->colorBChanged(255);
-	QVERIFY(m_pWindow->GetGraphicsWindow()->getADColor()[0] == 1.0
-		&& m_pWindow->GetGraphicsWindow()->getADColor()[1] == 1.0
-		&& m_pWindow->GetGraphicsWindow()->getADColor()[2] == 1.0);
+	QVERIFY(endLoadSignalSpy.wait(30000));
+	QVERIFY(endLoadSignalSpy.takeFirst().at(0).toBool());
+	QVERIFY(!pGraphicsWindow->IsSuspended());
+	QVERIFY(!pGraphicsWindow->IsEvicted());
+	QVERIFY(pGraphicsWindow->IsModelValid());
+	QCOMPARE(pGraphicsWindow->GetModelMatrix(), view);
 
-	m_pWindow->GetGraphicsWindow()->lightAmbient(0.20);
-	m_pWindow->GetGraphicsWindow()->lightDiffuse(0.40);
-	m_pWindow->GetGraphicsWindow()->lightSpecular(0.30);
+	pGraphicsWindow->unloadModel();
 	m_pWindow->hide();
-	QVERIFY(m_pWindow->GetGraphicsWindow()->getADS()[0] > 0.18 && m_pWindow->GetGraphicsWindow()->getADS()[0] < 0.22);
-	QVERIFY(m_pWindow->GetGraphicsWindow()->getADS()[1] > 0.38 && m_pWindow->GetGraphicsWindow()->getADS()[1] < 0.42);
-	QVERIFY(m_pWindow->GetGraphicsWindow()->getADS()[2] > 0.28 && m_pWindow->GetGraphicsWindow()->getADS()[2] < 0.32);
+}
+
+void ModelViewerTest::largeCoordinates()
+{
+	// A georeferenced cube two units wide, a million units out
+	QByteArray obj;
+	for (int corner = 0; corner < 8; ++corner) {
+		obj += QString("v %1 %2 %3\n").arg(corner & 1 ? 1000001 : 999999).arg(corner & 2 ? 2000001 : 1999999).arg(corner & 4 ? 500001 : 499999).toUtf8();
+	}
+	obj += "f 1 2 4 3\nf 5 7 8 6\nf 1 5 6 2\nf 3 4 8 7\nf 1 3 7 5\nf 2 6 8 4\n";
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath("far.obj");
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write(obj);
+	file.close();
+
+	// It is moved to the origin, and keeps where it was in double precision
+	const ModelData farModel = ModelLoader::DecodeFile(path);
+	QVERIFY(!farModel.m_meshes.empty());
+	QCOMPARE(farModel.m_origin[0], 1000000.0);
+	QCOMPARE(farModel.m_origin[1], 2000000.0);
+	QCOMPARE(farModel.m_origin[2], 500000.0);
+	QVector3D min(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (const MeshData& mesh : farModel.m_meshes) {
+		BoundsMath::AddTransformedBox(mesh.m_transform, mesh.m_AABBMin, mesh.m_AABBMax, min, max);
+	}
+	QCOMPARE(min, QVector3D(-1.f, -1.f, -1.f));
+	QCOMPARE(max, QVector3D(1.f, 1.f, 1.f));
+
+	// Models around the origin stay where they are
+	const ModelData centered = ModelLoader::DecodeFile("../Data/Primitives/Sphere.obj");
+	QVERIFY(centered.m_origin == (std::array<double, 3>()));
+
+	// The clip planes take in the whole model, unless they are set by hand
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	QVERIFY(LoadModelAndWait(path));
+	QVERIFY(pGraphicsWindow->autoClipPlanes);
+	const QMatrix4x4 modelView = pGraphicsWindow->GetModelMatrix();
+	float nearDistance = 0.f;
+	float farDistance = 0.f;
+	pGraphicsWindow->FitClipPlanes(modelView, nearDistance, farDistance);
+	QVector3D viewMin(FLT_MAX, FLT_MAX, FLT_MAX);
+	QVector3D viewMax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	const Model& model = pGraphicsWindow->GetCurrentModel();
+	BoundsMath::AddTransformedBox(modelView, model.m_AABBMin, model.m_AABBMax, viewMin, viewMax);
+	QVERIFY(nearDistance > 0.f);
+	QVERIFY(nearDistance <= -viewMax.z());
+	QVERIFY(farDistance >= -viewMin.z());
+	QCOMPARE(model.m_origin[1], 2000000.0);
 
+	pGraphicsWindow->autoClipPlanes = false;
+	pGraphicsWindow->FitClipPlanes(modelView, nearDistance, farDistance);
+	QCOMPARE(nearDistance, pGraphicsWindow->nearPlane);
+	QCOMPARE(farDistance, pGraphicsWindow->farPlane);
+	pGraphicsWindow->autoClipPlanes = true;
+
+	pGraphicsWindow->unloadModel();
+	m_pWindow->hide();
 }
 
-void ModelViewerTest::displayModel()
+void ModelViewerTest::pointCloud()
 {
-	m_pWindow->show();
-	bool success = m_pWindow->GetGraphicsWindow()->loadModel("../Data/Primitives/cube.obj");
-	QVERIFY(success);
-	success = m_pWindow->GetGraphicsWindow()->loadModel("../Data/Models/cubeColor.ply");
-	QVERIFY(success);
-	success = m_pWindow->GetGraphicsWindow()->loadModel("../Data/Primitives/Dodecahedron.stl");
-	QVERIFY(success);
-	success = m_pWindow->GetGraphicsWindow()->loadModel("../Data/Primitives/Icosahedron.stl");
-	QVERIFY(success);
+	// A scan of a 10 by 10 square as a binary PLY file, too many points for one node
+	const int pointCount = 50000;
+	QByteArray ply = QString("ply\nformat binary_little_endian 1.0\nelement vertex %1\nproperty float x\nproperty float y\n"
+		"property float z\nproperty uchar red\nproperty uchar green\nproperty uchar blue\nend_header\n").arg(pointCount).toUtf8();
+	std::mt19937 random(7);
+	std::uniform_real_distribution<float> side(0.f, 10.f);
+	for (int i = 0; i < pointCount; ++i) {
+		const float position[3] = { side(random), side(random), 0.f };
+		const uchar color[3] = { 255, uchar(i % 256), 0 };
+		ply.append(reinterpret_cast<const char*>(position), sizeof(position));
+		ply.append(reinterpret_cast<const char*>(color), sizeof(color));
+	}
+	QTemporaryDir dir;
+	QVERIFY(dir.isValid());
+	const QString path = dir.filePath("scan.ply");
+	QFile file(path);
+	QVERIFY(file.open(QIODevice::WriteOnly));
+	file.write(ply);
+	file.close();
+
+	// Every point lands in one node of the octree, each node after its parent. The meshes
+	// share one block of points with RGBA8 colors.
+	PointCloudLoader loader;
+	QVERIFY2(loader.Read(path), qPrintable(loader.FailureReason()));
+	QCOMPARE(loader.PointCount(), qint64(pointCount));
+	QVERIFY(loader.NodeCount() > 1);
+	const ModelData read = loader.TakeModel();
+	QCOMPARE(int(read.m_meshes.size()), loader.NodeCount());
+	QCOMPARE(read.m_sceneGraph->Node(0).m_name, QString("r"));
+	qint64 meshPoints = 0;
+	for (const MeshData& meshData : read.m_meshes) {
+		QCOMPARE(meshData.m_indexCount, 0);
+		QCOMPARE(meshData.m_vertexStride, int(sizeof(PointCloudLoader::Point)));
+		QCOMPARE(meshData.m_colorType, GLenum(GL_UNSIGNED_BYTE));
+		QVERIFY(meshData.m_pMapping == read.m_meshes.front().m_pMapping);
+		const uchar* pColor = reinterpret_cast<const uchar*>(meshData.m_vertexData.constData()) + meshData.m_colorOffset;
+		QCOMPARE(int(pColor[0]), 255);
+		QCOMPARE(int(pColor[2]), 0);
+		QCOMPARE(int(pColor[3]), 255);
+		meshPoints += meshData.m_vertexData.size() / meshData.m_vertexStride;
+	}
+	QCOMPARE(meshPoints, qint64(pointCount));
+
+	// The runs of points the nodes keep cover the reordered points once, the color tells them apart
+	std::vector<PointCloudLoader::Point> points(pointCount);
+	for (int i = 0; i < pointCount; ++i) {
+		points[i] = { { side(random), side(random), side(random) }, quint32(i) };
+	}
+	const std::vector<PointCloudLoader::OctreeNode> nodes = PointCloudLoader::BuildOctree(points);
+	std::vector<int> seen(pointCount, 0);
+	size_t kept = 0;
+	for (int n = 0; n < int(nodes.size()); ++n) {
+		QVERIFY(nodes[n].m_parent < n);
+		QVERIFY(n == 0 || nodes[n].m_name.compare(0, nodes[nodes[n].m_parent].m_name.size(), nodes[nodes[n].m_parent].m_name) == 0);
+		QVERIFY(nodes[n].m_first + nodes[n].m_count <= points.size());
+		for (size_t i = nodes[n].m_first; i < nodes[n].m_first + nodes[n].m_count; ++i) {
+			++seen[points[i].m_color];
+		}
+		kept += nodes[n].m_count;
+	}
+	QCOMPARE(kept, points.size());
+	QVERIFY(std::all_of(seen.begin(), seen.end(), [](int count) { return count == 1; }));
+
+	// Compressed formats say what they need
+	PointCloudLoader compressed;
+	QVERIFY(!compressed.Read(dir.filePath("scan.laz")));
+	QVERIFY(compressed.FailureReason().contains("LASzip"));
+
+	// Decoded, the nodes stay meshes of their own
+	const ModelData data = ModelLoader::DecodeFile(path);
+	QCOMPARE(int(data.m_meshes.size()), loader.NodeCount());
+	Model model;
+	model.m_sceneGraph = data.m_sceneGraph;
+	for (const MeshData& meshData : data.m_meshes) {
+		QCOMPARE(meshData.m_indexCount, 0);
+		QCOMPARE(int(meshData.m_nodes.size()), 1);
+		QVERIFY(meshData.m_vertexStride > 0);
+		Mesh mesh;
+		mesh.m_indexCount = 0;
+		mesh.m_vertexCount = meshData.m_vertexData.size() / meshData.m_vertexStride;
+		mesh.m_nodes = meshData.m_nodes;
+		mesh.m_transform = meshData.m_transform;
+		mesh.m_AABBMin = meshData.m_AABBMin;
+		mesh.m_AABBMax = meshData.m_AABBMax;
+		model.m_meshes.push_back(mesh);
+	}
+	model.Finalize();
+
+	// The budget picks the nodes covering the most of the screen, parents first
+	PointCloudLod lod;
+	lod.Build(model, *data.m_sceneGraph);
+	QCOMPARE(lod.NodeCount(), loader.NodeCount());
+	QCOMPARE(lod.PointCount(), qint64(pointCount));
+	QMatrix4x4 projection;
+	projection.perspective(45.f, 1.f, 0.1f, 100.f);
+	QMatrix4x4 view;
+	view.lookAt(QVector3D(5.f, 5.f, 20.f), QVector3D(5.f, 5.f, 0.f), QVector3D(0.f, 1.f, 0.f));
+	const Frustum frustum(projection * view);
+	const float pixelScale = 300.f / std::tan(qDegreesToRadians(22.5f));
+	std::vector<int> picked;
+	QCOMPARE(lod.Select(model, frustum, view, pixelScale, std::numeric_limits<qint64>::max(), picked), qint64(pointCount));
+	QCOMPARE(int(picked.size()), lod.NodeCount());
+	const qint64 rootPoints = model.m_meshes[picked.front()].m_vertexCount;
+	QCOMPARE(lod.Select(model, frustum, view, pixelScale, rootPoints, picked), rootPoints);
+	QCOMPARE(int(picked.size()), 1);
+	QCOMPARE(model.m_meshes[picked.front()].m_nodes.front(), data.m_sceneGraph->FindNode("r"));
+
+	// A cloud out of view draws nothing
+	QMatrix4x4 away;
+	away.lookAt(QVector3D(5.f, 5.f, 20.f), QVector3D(5.f, 5.f, 40.f), QVector3D(0.f, 1.f, 0.f));
+	QCOMPARE(lod.Select(model, Frustum(projection * away), away, pixelScale, std::numeric_limits<qint64>::max(), picked), qint64(0));
+	QVERIFY(picked.empty());
+
+	// Meshes that aren't points in a tree have no octree
+	PointCloudLod none;
+	const ModelData sphere = ModelLoader::DecodeFile("../Data/Primitives/Sphere.obj");
+	Model sphereModel;
+	for (const MeshData& meshData : sphere.m_meshes) {
+		Mesh mesh;
+		mesh.m_indexCount = meshData.m_indexCount;
+		mesh.m_vertexCount = 1;
+		mesh.m_nodes = meshData.m_nodes;
+		sphereModel.m_meshes.push_back(mesh);
+	}
+	none.Build(sphereModel, *sphere.m_sceneGraph);
+	QVERIFY(none.IsEmpty());
+
+	// The viewer draws it as points whatever the display mode
+	ResetViewAndShow();
+	QVERIFY(LoadModelAndWait(path));
 	QTest::qWait(100);
-	QVERIFY(success);
+	m_pWindow->GetGraphicsWindow()->unloadModel();
+	m_pWindow->hide();
+}
+
+void ModelViewerTest::remoteView()
+{
+	// A frame, bottom row first, red on top and blue below
+	const QSize size(64, 32);
+	std::vector<uchar> pixels(size_t(size.width() * size.height() * 4));
+	for (int y = 0; y < size.height(); ++y) {
+		for (int x = 0; x < size.width(); ++x) {
+			uchar* pPixel = &pixels[size_t((y * size.width() + x) * 4)];
+			pPixel[0] = y < size.height() / 2 ? 0 : 255;
+			pPixel[1] = 0;
+			pPixel[2] = y < size.height() / 2 ? 255 : 0;
+			pPixel[3] = 255;
+		}
+	}
+
+	// A frame is taken while none is compressed and fewer than the most in flight are
+	FrameStream stream;
+	QSignalSpy encodedSpy(&stream, &FrameStream::FrameEncoded);
+	QSignalSpy wantedSpy(&stream, &FrameStream::FrameWanted);
+	QVERIFY(stream.WantsFrame());
+	QVERIFY(!stream.WantsFrame());
+	stream.AddFrame(pixels.data(), size);
+	QVERIFY(encodedSpy.wait(5000));
+	QCOMPARE(encodedSpy.first().at(0).toInt(), 0);
+	QCOMPARE(encodedSpy.first().at(1).toSize(), size);
+	const QImage decoded = QImage::fromData(encodedSpy.first().at(2).toByteArray(), "JPG");
+	QCOMPARE(decoded.size(), size);
+	QVERIFY(qRed(decoded.pixel(4, 4)) > 200 && qBlue(decoded.pixel(4, 4)) < 50);
+	QVERIFY(qBlue(decoded.pixel(4, size.height() - 4)) > 200);
+	for (int i = 1; i < FrameStream::k_maxFramesInFlight; ++i) {
+		QVERIFY(stream.WantsFrame());
+		stream.AddFrame(pixels.data(), size);
+		QVERIFY(encodedSpy.wait(5000));
+	}
+	QCOMPARE(stream.FramesInFlight(), FrameStream::k_maxFramesInFlight);
+	QVERIFY(!stream.WantsFrame());
+
+	// Acknowledging asks for the frame turned down, at full scale while frames get through fast
+	stream.Acknowledge(FrameStream::k_maxFramesInFlight - 1);
+	QCOMPARE(stream.FramesInFlight(), 0);
+	QCOMPARE(wantedSpy.count(), 1);
+	QCOMPARE(stream.Scale(), 1.f);
+	stream.Reset();
+	QVERIFY(stream.WantsFrame());
+
+	// A client moves the camera and gets the frames drawn back
+	QVERIFY(LoadModelAndWait("../Data/Models/cubeColor.ply"));
+	ResetViewAndShow();
+	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
+	ScriptRunner runner(pGraphicsWindow);
+	runner.Start();
+	RemoteViewServer server(pGraphicsWindow, &runner);
+	server.SetToken("secret");
+	QVERIFY(server.Listen(0));
+
+	// Clients without the token, or with a line that doesn't end, are dropped
+	QTcpSocket stranger;
+	stranger.connectToHost(QHostAddress::LocalHost, server.Port());
+	QVERIFY(stranger.waitForConnected(5000));
+	stranger.write("{\"command\": \"camera\", \"rotX\": 45}\n");
+	QTRY_VERIFY(stranger.state() == QAbstractSocket::UnconnectedState);
+	QVERIFY(!pGraphicsWindow->IsStreamingFrames());
+	QTRY_VERIFY(!server.HasClient());
+	QTcpSocket flood;
+	flood.connectToHost(QHostAddress::LocalHost, server.Port());
+	QVERIFY(flood.waitForConnected(5000));
+	flood.write(QByteArray(RemoteViewServer::k_maxLineBytes + 1024, 'x'));
+	QTRY_VERIFY(flood.state() == QAbstractSocket::UnconnectedState);
+	QTRY_VERIFY(!server.HasClient());
+
+	// A client that never gives the token doesn't keep the slot
+	QTcpSocket idle;
+	idle.connectToHost(QHostAddress::LocalHost, server.Port());
+	QVERIFY(idle.waitForConnected(5000));
+	QTRY_VERIFY(server.HasClient());
+	QTRY_VERIFY_WITH_TIMEOUT(idle.state() == QAbstractSocket::UnconnectedState, RemoteViewServer::k_tokenTimeoutMs * 2);
+	QVERIFY(!server.HasClient());
+
+	// Only commands that change the view are taken remotely
+	QVERIFY(RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "camera" } }));
+	QVERIFY(RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "playback" }, { "keys", QJsonArray() } }));
+	QVERIFY(!RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "playback" }, { "path", "path.json" } }));
+	QVERIFY(!RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "load" }, { "path", "model.obj" } }));
+	QVERIFY(!RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "screenshot" }, { "path", "frame.png" } }));
+	QVERIFY(!RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "quit" } }));
+	QVERIFY(RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "wait" }, { "seconds", 1 } }));
+	QVERIFY(!RemoteViewServer::IsViewCommand(QJsonObject{ { "command", "wait" }, { "seconds", 1e12 } }));
+
+	QTcpSocket client;
+	client.connectToHost(QHostAddress::LocalHost, server.Port());
+	QVERIFY(client.waitForConnected(5000));
+	QTRY_VERIFY(server.HasClient());
+	client.write("{\"token\": \"secret\"}\n{\"command\": \"load\", \"path\": \"model.obj\"}\n");
+	QTRY_VERIFY(pGraphicsWindow->IsStreamingFrames());
+	client.write("{\"command\": \"camera\", \"rotX\": 45}\n");
+
+	QByteArray received;
+	QJsonObject refused;
+	QJsonObject result;
+	QImage frame;
+	int frameIndex = -1;
+	QElapsedTimer timer;
+	timer.start();
+	while ((result.isEmpty() || frame.isNull()) && timer.elapsed() < 10000) {
+		QTest::qWait(10);
+		received += client.readAll();
+		int end = -1;
+		while ((end = received.indexOf('\n')) >= 0) {
+			const QJsonObject object = QJsonDocument::fromJson(received.left(end)).object();
+			if (!object.contains("frame")) {
+				(object.value("ok").toBool() ? result : refused) = object;
+				received.remove(0, end + 1);
+				continue;
+			}
+			const int bytes = object.value("bytes").toInt();
+			if (received.size() < end + 1 + bytes) {
+				break;
+			}
+			frame = QImage::fromData(received.mid(end + 1, bytes), "JPG");
+			QCOMPARE(frame.size(), QSize(object.value("width").toInt(), object.value("height").toInt()));
+			frameIndex = object.value("frame").toInt();
+			received.remove(0, end + 1 + bytes);
+		}
+	}
+	QVERIFY(refused.value("error").toString().contains("load"));
+	QCOMPARE(result.value("command").toString(), QString("camera"));
+	QVERIFY(result.value("ok").toBool());
+	QCOMPARE(pGraphicsWindow->GetCameraPose().m_rotX, 45.f);
+	QVERIFY(!frame.isNull());
+	QVERIFY(server.Stream().FramesInFlight() <= FrameStream::k_maxFramesInFlight);
+	client.write(QString("{\"ack\": %1}\n").arg(frameIndex).toUtf8());
+
+	// Only one client is served at a time
+	QTcpSocket other;
+	other.connectToHost(QHostAddress::LocalHost, server.Port());
+	QVERIFY(other.waitForConnected(5000));
+	QTRY_VERIFY(other.canReadLine());
+	QVERIFY(!QJsonDocument::fromJson(other.readLine()).object().value("ok").toBool());
+
+	client.disconnectFromHost();
+	QTRY_VERIFY(!server.HasClient());
+	QVERIFY(!pGraphicsWindow->IsStreamingFrames());
+	pGraphicsWindow->unloadModel();
 	m_pWindow->hide();
 }
 
@@ -433,7 +4744,7 @@ void ModelViewerTest::defaultZoom()
 	ResetViewAndShow();
 
 	// Load a different model
-	bool success = m_pWindow->GetGraphicsWindow()->loadModel("../Data/Models/cubeColor.ply");
+	bool success = LoadModelAndWait("../Data/Models/cubeColor.ply");
 	QVERIFY(success);
 	
 	// Check that the scene was resized to show this model
@@ -452,7 +4763,7 @@ void ModelViewerTest::testKeyboard()
 	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
 
 	// Load a model
-	bool success = m_pWindow->GetGraphicsWindow()->loadModel("../Data/Models/cubeColor.ply");
+	bool success = LoadModelAndWait("../Data/Models/cubeColor.ply");
 	QVERIFY(success);
 
 	auto testKey = [=](int key) {
@@ -622,6 +4933,9 @@ void ModelViewerTest::testSettings()
 	QComboBox* msaa = pSettingsWindow->findChild<QComboBox*>("msaa");
 	msaa->setCurrentIndex(2);
 	QVERIFY((pSettingsWindow->getSettings()->value("ViewerGraphicsWindow/msaaLevel")) == 4);
+	msaa->setCurrentIndex(msaa->findText("FXAA"));
+	QVERIFY((pSettingsWindow->getSettings()->value("ViewerGraphicsWindow/msaaLevel")) == -1);
+	msaa->setCurrentIndex(2);
 	
 	QPushButton* resetViewSettings = pSettingsWindow->findChild<QPushButton*>("resetViewSettings");
 	QTest::mouseClick(resetViewSettings,Qt::MouseButton::LeftButton);
@@ -646,7 +4960,7 @@ void ModelViewerTest::testLandingPage()
 	ResetViewAndShow();
 	ViewerGraphicsWindow* pGraphicsWindow = m_pWindow->GetGraphicsWindow();
 	LandingPage* lp = m_pWindow->GetGraphicsDelegate()->GetLandingWidget();
-	QSettings* settings = m_pWindow->GetSettingsWindow()->getSettings();
+	AppSettings* settings = m_pWindow->GetSettingsWindow()->getSettings();
 
 	pGraphicsWindow->unloadModel();
 	QTest::qWait(100);
@@ -654,7 +4968,7 @@ void ModelViewerTest::testLandingPage()
 	QPushButton* loadFile1 = lp->findChild<QPushButton*>("loadFile1");
 	if (loadFile1) {
 		QTest::mouseClick(loadFile1, Qt::MouseButton::LeftButton);
-		QVERIFY(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+		QTRY_VERIFY_WITH_TIMEOUT(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model, 30000);
 		pGraphicsWindow->unloadModel();
 		QTest::qWait(100);
 	}
@@ -662,7 +4976,7 @@ void ModelViewerTest::testLandingPage()
 	QPushButton* loadFile2 = lp->findChild<QPushButton*>("loadFile2");
 	if (loadFile2) {
 		QTest::mouseClick(loadFile2, Qt::MouseButton::LeftButton);
-		QVERIFY(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+		QTRY_VERIFY_WITH_TIMEOUT(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model, 30000);
 		pGraphicsWindow->unloadModel();
 		QTest::qWait(100);
 	}
@@ -670,7 +4984,7 @@ void ModelViewerTest::testLandingPage()
 	QPushButton* loadFile3 = lp->findChild<QPushButton*>("loadFile3");
 	if (loadFile3) {
 		QTest::mouseClick(loadFile3, Qt::MouseButton::LeftButton);
-		QVERIFY(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model);
+		QTRY_VERIFY_WITH_TIMEOUT(m_pWindow->GetGraphicsDelegate()->GetStatus() == GraphicsWindowDelegate::Status::k_model, 30000);
 		pGraphicsWindow->unloadModel();
 		QTest::qWait(100);
 	}
@@ -678,5 +4992,33 @@ void ModelViewerTest::testLandingPage()
 	QVERIFY(settings->value("LandingPage/file1") == settings->value("LandingPage/file2") == settings->value("LandingPage/file3"));
 }
 
-QTEST_MAIN(ModelViewerTest)
+int RunPerformanceTests(int argc, char* argv[]);
+
+// Runs the tests, then the performance tests in perf.cpp, with the arguments given. -perf runs
+// only the performance tests, and MODELVIEWER_SKIP_PERF skips them. Test functions named in
+// the arguments are looked up in the tests that run, so name them together with -perf.
+int main(int argc, char* argv[])
+{
+	QApplication app(argc, argv);
+	app.setAttribute(Qt::AA_Use96Dpi, true);
+	QTEST_SET_MAIN_SOURCE_PATH
+
+	std::vector<char*> args(argv, argv + argc);
+	auto perfArg = std::find_if(args.begin(), args.end(), [](const char* arg) { return qstrcmp(arg, "-perf") == 0; });
+	const bool perfOnly = perfArg != args.end();
+	if (perfOnly) {
+		args.erase(perfArg);
+	}
+
+	int failed = 0;
+	if (!perfOnly) {
+		ModelViewerTest test;
+		failed += QTest::qExec(&test, int(args.size()), args.data());
+	}
+	if (perfOnly || !qEnvironmentVariableIsSet("MODELVIEWER_SKIP_PERF")) {
+		failed += RunPerformanceTests(int(args.size()), args.data());
+	}
+	return failed;
+}
+
 #include "test.moc"
\ No newline at end of file